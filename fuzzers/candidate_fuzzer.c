@@ -0,0 +1,56 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+#include "../src/debug.h"
+#include "../src/sdp-utils.h"
+
+int janus_log_level = LOG_NONE;
+gboolean janus_log_timestamps = FALSE;
+gboolean janus_log_colors = FALSE;
+char *janus_log_global_prefix = NULL;
+int lock_debug = 0;
+int refcount_debug = 0;
+
+/* This is to avoid linking with openSSL */
+int RAND_bytes(uint8_t *key, int len) {
+	return 0;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+	/* Candidate lines reach the tokenizer as NUL-terminated strings */
+	if(size <= 0)
+		return 0;
+	char candidate[size];
+	memcpy(candidate, data, size);
+	candidate[size-1] = '\0';
+	/* Tokenize the candidate with the single-pass parser */
+	janus_sdp_candidate_tokens tokens;
+	int res = janus_sdp_candidate_tokenize(candidate, &tokens);
+	if(res < 7)
+		return 0;
+	/* The tokenizer liked this line: the sscanf-based parsing it
+	 * replaced must agree on every field it assigned, since the
+	 * tokenizer is meant to accept a strict subset of what sscanf
+	 * did (plain decimal numbers, tokens fitting their buffers) */
+	char rfoundation[33] = "", rtransport[4] = "", rip[50] = "", rtype[6] = "", rrelip[40] = "";
+	guint32 rcomponent = 0, rpriority = 0, rport = 0, rrelport = 0;
+	int old_res = sscanf(candidate, "%32s %30u %3s %30u %49s %30u typ %5s %*s %39s %*s %30u",
+		rfoundation, &rcomponent, rtransport, &rpriority,
+			rip, &rport, rtype, rrelip, &rrelport);
+	if(old_res != res)
+		abort();
+	if(strcmp(rfoundation, tokens.foundation) || rcomponent != tokens.component ||
+			strcmp(rtransport, tokens.transport) || rpriority != tokens.priority ||
+			strcmp(rip, tokens.ip) || rport != tokens.port || strcmp(rtype, tokens.type))
+		abort();
+	if(res >= 8 && strcmp(rrelip, tokens.relip))
+		abort();
+	if(res >= 9 && rrelport != tokens.relport)
+		abort();
+
+	return 0;
+}
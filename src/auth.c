@@ -33,7 +33,14 @@
 #include "mutex.h"
 #include "utils.h"
 
-/* Hash table to contain the tokens to match */
+/* Hash table to contain the tokens to match. The table is treated as
+ * an immutable snapshot: checking a token is just an atomic pointer
+ * read followed by a lookup, with no locking involved, while writers
+ * (still serialized by the mutex) clone the current snapshot, apply
+ * their changes to the copy and atomically publish it. Old snapshots
+ * are retired and only destroyed after a grace period, so that readers
+ * that grabbed the pointer right before a swap can safely complete
+ * their lookup (which takes microseconds, not seconds) */
 static GHashTable *tokens = NULL, *allowed_plugins = NULL;
 static gboolean auth_enabled = FALSE;
 static janus_mutex mutex = JANUS_MUTEX_INITIALIZER;
@@ -43,6 +50,67 @@ static void janus_auth_free_token(char *token) {
 	g_free(token);
 }
 
+/* Retired token snapshots, waiting for the grace period to elapse */
+typedef struct janus_auth_retired_tokens {
+	GHashTable *table;
+	gint64 when;
+} janus_auth_retired_tokens;
+static GSList *retired_tokens = NULL;
+#define JANUS_AUTH_TOKENS_GRACE		(5*G_USEC_PER_SEC)
+
+/* Clone the current snapshot (must be called with the mutex held) */
+static GHashTable *janus_auth_clone_tokens(void) {
+	GHashTable *snapshot = g_hash_table_new_full(g_str_hash, g_str_equal, (GDestroyNotify)janus_auth_free_token, NULL);
+	if(tokens != NULL) {
+		GHashTableIter iter;
+		gpointer value;
+		g_hash_table_iter_init(&iter, tokens);
+		while(g_hash_table_iter_next(&iter, NULL, &value)) {
+			char *token = g_strdup((char *)value);
+			g_hash_table_insert(snapshot, token, token);
+		}
+	}
+	return snapshot;
+}
+
+/* Publish a new snapshot, retiring the old one (must be called with
+ * the mutex held) */
+static void janus_auth_publish_tokens(GHashTable *snapshot) {
+	GHashTable *old = tokens;
+	g_atomic_pointer_set(&tokens, snapshot);
+	gint64 now = janus_get_monotonic_time();
+	if(old != NULL) {
+		janus_auth_retired_tokens *retired = g_malloc(sizeof(janus_auth_retired_tokens));
+		retired->table = old;
+		retired->when = now;
+		retired_tokens = g_slist_prepend(retired_tokens, retired);
+	}
+	/* Get rid of the snapshots no reader can be looking at anymore:
+	 * the list is newest first, so we can cut it at the first old one */
+	GSList *item = retired_tokens, *prev = NULL;
+	while(item != NULL) {
+		janus_auth_retired_tokens *retired = (janus_auth_retired_tokens *)item->data;
+		if(now - retired->when >= JANUS_AUTH_TOKENS_GRACE)
+			break;
+		prev = item;
+		item = item->next;
+	}
+	if(item != NULL) {
+		if(prev != NULL)
+			prev->next = NULL;
+		else
+			retired_tokens = NULL;
+		GSList *drop = item;
+		while(drop != NULL) {
+			janus_auth_retired_tokens *retired = (janus_auth_retired_tokens *)drop->data;
+			g_hash_table_destroy(retired->table);
+			g_free(retired);
+			drop = drop->next;
+		}
+		g_slist_free(item);
+	}
+}
+
 /* Setup */
 void janus_auth_init(gboolean enabled, const char *secret) {
 	if(enabled) {
@@ -73,11 +141,32 @@ gboolean janus_auth_is_signed_mode(void) {
 	return auth_enabled && auth_secret != NULL;
 }
 
+void janus_auth_update_secret(const char *secret) {
+	if(!auth_enabled || auth_secret == NULL || secret == NULL || !strcmp(auth_secret, secret))
+		return;
+	janus_mutex_lock(&mutex);
+	/* Notice that we don't free the previous secret: other threads may be
+	 * reading it to validate a signature right now, and leaking a short
+	 * string on the rare occasions the secret is rotated is harmless */
+	auth_secret = g_strdup(secret);
+	janus_mutex_unlock(&mutex);
+	JANUS_LOG(LOG_INFO, "Updated the signed-token authentication secret\n");
+}
+
 void janus_auth_deinit(void) {
 	janus_mutex_lock(&mutex);
 	if(tokens != NULL)
 		g_hash_table_destroy(tokens);
 	tokens = NULL;
+	GSList *drop = retired_tokens;
+	while(drop != NULL) {
+		janus_auth_retired_tokens *retired = (janus_auth_retired_tokens *)drop->data;
+		g_hash_table_destroy(retired->table);
+		g_free(retired);
+		drop = drop->next;
+	}
+	g_slist_free(retired_tokens);
+	retired_tokens = NULL;
 	if(allowed_plugins != NULL)
 		g_hash_table_destroy(allowed_plugins);
 	allowed_plugins = NULL;
@@ -188,8 +277,35 @@ gboolean janus_auth_add_token(const char *token) {
 		janus_mutex_unlock(&mutex);
 		return TRUE;
 	}
+	GHashTable *snapshot = janus_auth_clone_tokens();
 	char *new_token = g_strdup(token);
-	g_hash_table_insert(tokens, new_token, new_token);
+	g_hash_table_insert(snapshot, new_token, new_token);
+	janus_auth_publish_tokens(snapshot);
+	janus_mutex_unlock(&mutex);
+	return TRUE;
+}
+
+gboolean janus_auth_add_tokens(GList *tokens_list) {
+	if(!auth_enabled || tokens == NULL) {
+		JANUS_LOG(LOG_ERR, "Can't add tokens, stored-authentication mechanism is disabled\n");
+		return FALSE;
+	}
+	if(tokens_list == NULL)
+		return FALSE;
+	/* We clone the snapshot once and apply all the changes to the copy,
+	 * so that adding thousands of tokens only means a single swap */
+	janus_mutex_lock(&mutex);
+	GHashTable *snapshot = janus_auth_clone_tokens();
+	GList *item = tokens_list;
+	while(item != NULL) {
+		const char *token = (const char *)item->data;
+		if(token != NULL && g_hash_table_lookup(snapshot, token) == NULL) {
+			char *new_token = g_strdup(token);
+			g_hash_table_insert(snapshot, new_token, new_token);
+		}
+		item = item->next;
+	}
+	janus_auth_publish_tokens(snapshot);
 	janus_mutex_unlock(&mutex);
 	return TRUE;
 }
@@ -198,14 +314,13 @@ gboolean janus_auth_check_token(const char *token) {
 	/* Always TRUE if the mechanism is disabled, of course */
 	if(!auth_enabled)
 		return TRUE;
-	if (tokens == NULL)
+	/* Readers just work on whatever snapshot is currently published,
+	 * no locking involved: see the comment on top */
+	GHashTable *snapshot = g_atomic_pointer_get(&tokens);
+	if(snapshot == NULL)
 		return janus_auth_check_signature(token, "janus");
-	janus_mutex_lock(&mutex);
-	if(token && g_hash_table_lookup(tokens, token)) {
-		janus_mutex_unlock(&mutex);
+	if(token && g_hash_table_lookup(snapshot, token))
 		return TRUE;
-	}
-	janus_mutex_unlock(&mutex);
 	return FALSE;
 }
 
@@ -234,7 +349,12 @@ gboolean janus_auth_remove_token(const char *token) {
 		return FALSE;
 	}
 	janus_mutex_lock(&mutex);
-	gboolean ok = token && g_hash_table_remove(tokens, token);
+	gboolean ok = token && g_hash_table_lookup(tokens, token) != NULL;
+	if(ok) {
+		GHashTable *snapshot = janus_auth_clone_tokens();
+		g_hash_table_remove(snapshot, token);
+		janus_auth_publish_tokens(snapshot);
+	}
 	/* Also clear the allowed plugins mapping */
 	GList *list = g_hash_table_lookup(allowed_plugins, token);
 	g_hash_table_remove(allowed_plugins, token);
@@ -245,6 +365,33 @@ gboolean janus_auth_remove_token(const char *token) {
 	return ok;
 }
 
+gboolean janus_auth_remove_tokens(GList *tokens_list) {
+	if(!auth_enabled || tokens == NULL) {
+		JANUS_LOG(LOG_ERR, "Can't remove tokens, stored-authentication mechanism is disabled\n");
+		return FALSE;
+	}
+	if(tokens_list == NULL)
+		return FALSE;
+	/* As when adding in bulk, a single clone and a single swap */
+	janus_mutex_lock(&mutex);
+	GHashTable *snapshot = janus_auth_clone_tokens();
+	GList *item = tokens_list;
+	while(item != NULL) {
+		const char *token = (const char *)item->data;
+		if(token != NULL && g_hash_table_remove(snapshot, token)) {
+			/* Also clear the allowed plugins mapping */
+			GList *list = g_hash_table_lookup(allowed_plugins, token);
+			g_hash_table_remove(allowed_plugins, token);
+			if(list != NULL)
+				g_list_free(list);
+		}
+		item = item->next;
+	}
+	janus_auth_publish_tokens(snapshot);
+	janus_mutex_unlock(&mutex);
+	return TRUE;
+}
+
 /* Plugins access */
 gboolean janus_auth_allow_plugin(const char *token, janus_plugin *plugin) {
 	if(!auth_enabled || allowed_plugins == NULL) {
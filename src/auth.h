@@ -32,6 +32,11 @@ gboolean janus_auth_is_enabled(void);
 gboolean janus_auth_is_stored_mode(void);
 /*! \brief Method to check whether the mechanism is in signed-token mode or not */
 gboolean janus_auth_is_signed_mode(void);
+/*! \brief Method to update the secret used to validate signed tokens at runtime
+ * \note Only effective when signed-token mode is active: tokens signed with the
+ * previous secret will stop validating as soon as the new one is in place
+ * @param[in] secret the new secret to validate signed tokens against */
+void janus_auth_update_secret(const char *secret);
 /*! \brief Method to de-initialize the mechanism */
 void janus_auth_deinit(void);
 
@@ -51,6 +56,12 @@ gboolean janus_auth_check_signature_contains(const char *token, const char *real
  * @param[in] token The new valid token
  * @returns TRUE if the operation was successful, FALSE otherwise */
 gboolean janus_auth_add_token(const char *token);
+/*! \brief Method to add a batch of valid tokens in a single operation
+ * \note Much cheaper than adding tokens one by one when rotating many
+ * of them, as the internal token store is only swapped once
+ * @param[in] tokens_list A GList of token strings to add (not consumed)
+ * @returns TRUE if the operation was successful, FALSE otherwise */
+gboolean janus_auth_add_tokens(GList *tokens_list);
 /*! \brief Method to check whether a provided token is valid or not
  * \note verifies both token signatures and against stored tokens
  * @param[in] token The token to validate
@@ -64,6 +75,12 @@ GList *janus_auth_list_tokens(void);
  * @param[in] token The valid to invalidate
  * @returns TRUE if the operation was successful, FALSE otherwise */
 gboolean janus_auth_remove_token(const char *token);
+/*! \brief Method to invalidate a batch of tokens in a single operation
+ * \note Much cheaper than removing tokens one by one when rotating many
+ * of them, as the internal token store is only swapped once
+ * @param[in] tokens_list A GList of token strings to remove (not consumed)
+ * @returns TRUE if the operation was successful, FALSE otherwise */
+gboolean janus_auth_remove_tokens(GList *tokens_list);
 
 /*! \brief Method to allow a token to use a plugin
  * @param[in] token The token that can now access this plugin
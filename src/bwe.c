@@ -0,0 +1,190 @@
+/*! \file    bwe.c
+ * \author   Lorenzo Miniero <lorenzo@meetecho.com>
+ * \copyright GNU General Public License v3
+ * \brief    Send-side bandwidth estimation
+ * \details  Implementation of a simplified, GCC-style, send-side
+ * bandwidth estimator, fed from the transport-wide CC feedback the
+ * peers send us. See bwe.h for an overview of how the pieces interact:
+ * the short version is that the ICE code tells us about every packet
+ * it sends with a transport-wide sequence number, the RTCP code tells
+ * us when (and whether) each of those packets arrived, and we keep a
+ * running estimate of how much the link can actually take.
+ *
+ * \ingroup protocols
+ * \ref protocols
+ */
+
+#include <string.h>
+
+#include "bwe.h"
+#include "debug.h"
+#include "utils.h"
+
+/* Size of the ring of in-flight packets (power of two): TWCC feedback
+ * normally comes every 50-250ms, so this covers several seconds even
+ * at high packet rates before a slot gets overwritten */
+#define JANUS_BWE_RING_SIZE			4096
+/* Bounds for the estimate, in bits per second */
+#define JANUS_BWE_MIN_BITRATE		64000
+#define JANUS_BWE_MAX_BITRATE		50000000
+/* Filtered delay gradient (us per packet) above which we consider the
+ * link to be building a queue, and below the negative of which we
+ * consider the queue to be draining */
+#define JANUS_BWE_DELAY_THRESHOLD	1000.0
+/* How long we wait, after a decrease, before we decrease again */
+#define JANUS_BWE_DECREASE_BACKOFF	(300*1000)
+/* Size of the window we compute the acknowledged bitrate on */
+#define JANUS_BWE_RATE_WINDOW		(500*1000)
+
+typedef struct janus_bwe_sent_packet {
+	/*! \brief Transport-wide sequence number (to detect stale slots) */
+	guint16 seq;
+	/*! \brief Whether this slot contains a packet awaiting feedback */
+	gboolean used;
+	/*! \brief Size of the packet, in bytes */
+	int size;
+	/*! \brief Monotonic time the packet was sent at */
+	gint64 sent;
+} janus_bwe_sent_packet;
+
+struct janus_bwe {
+	/*! \brief Ring of packets in flight, indexed by transport-wide seq */
+	janus_bwe_sent_packet ring[JANUS_BWE_RING_SIZE];
+	/*! \brief Current estimate in bps (atomic, this is what plugins read) */
+	volatile gint estimate;
+	/*! \brief Filtered one-way delay gradient, in us per packet */
+	double delay_avg;
+	/*! \brief Send/arrival times of the previous acked packet, to compute gradients */
+	gint64 prev_sent, prev_arrival;
+	/*! \brief Whether we have a previous acked packet at all */
+	gboolean have_prev;
+	/*! \brief Accumulators for the feedback currently being reported */
+	int fb_received, fb_lost;
+	double fb_delay_sum;
+	int fb_delay_count;
+	/*! \brief Acknowledged bitrate, computed on a short rolling window */
+	double acked_bitrate;
+	gint64 window_start;
+	guint32 window_bytes;
+	/*! \brief Monotonic time of the last decrease, to avoid overreacting */
+	gint64 last_decrease;
+};
+
+janus_bwe *janus_bwe_create(void) {
+	janus_bwe *bwe = g_malloc0(sizeof(janus_bwe));
+	return bwe;
+}
+
+void janus_bwe_packet_sent(janus_bwe *bwe, guint16 seq, int size) {
+	if(bwe == NULL || size < 1)
+		return;
+	janus_bwe_sent_packet *p = &bwe->ring[seq & (JANUS_BWE_RING_SIZE-1)];
+	p->seq = seq;
+	p->used = TRUE;
+	p->size = size;
+	p->sent = janus_get_monotonic_time();
+}
+
+void janus_bwe_packet_acked(janus_bwe *bwe, guint16 seq, gint64 arrival, gboolean received) {
+	if(bwe == NULL)
+		return;
+	janus_bwe_sent_packet *p = &bwe->ring[seq & (JANUS_BWE_RING_SIZE-1)];
+	if(!p->used || p->seq != seq) {
+		/* We don't know this packet (stale feedback, or the slot was reused) */
+		return;
+	}
+	p->used = FALSE;
+	if(!received) {
+		bwe->fb_lost++;
+		return;
+	}
+	bwe->fb_received++;
+	/* Track the acknowledged bitrate on a short rolling window */
+	gint64 now = janus_get_monotonic_time();
+	if(bwe->window_start == 0)
+		bwe->window_start = now;
+	bwe->window_bytes += p->size;
+	gint64 elapsed = now - bwe->window_start;
+	if(elapsed >= JANUS_BWE_RATE_WINDOW) {
+		double rate = (double)bwe->window_bytes*8*G_USEC_PER_SEC/(double)elapsed;
+		bwe->acked_bitrate = (bwe->acked_bitrate == 0) ? rate : (bwe->acked_bitrate/2 + rate/2);
+		bwe->window_start = now;
+		bwe->window_bytes = 0;
+	}
+	/* Update the one-way delay gradient: what grows when a queue is
+	 * building is the difference between how spaced the packets arrived
+	 * and how spaced we sent them, clocks cancel out of the difference */
+	if(bwe->have_prev) {
+		double gradient = (double)((arrival - bwe->prev_arrival) - (p->sent - bwe->prev_sent));
+		bwe->fb_delay_sum += gradient;
+		bwe->fb_delay_count++;
+	}
+	bwe->prev_sent = p->sent;
+	bwe->prev_arrival = arrival;
+	bwe->have_prev = TRUE;
+}
+
+void janus_bwe_feedback_done(janus_bwe *bwe) {
+	if(bwe == NULL)
+		return;
+	int received = bwe->fb_received, lost = bwe->fb_lost;
+	double delay = (bwe->fb_delay_count > 0) ? (bwe->fb_delay_sum/bwe->fb_delay_count) : 0.0;
+	bwe->fb_received = 0;
+	bwe->fb_lost = 0;
+	bwe->fb_delay_sum = 0.0;
+	bwe->fb_delay_count = 0;
+	if(received + lost == 0)
+		return;
+	/* Filter the per-feedback average gradient, so that a single bursty
+	 * feedback doesn't immediately trigger an overuse signal */
+	bwe->delay_avg = (bwe->delay_avg == 0.0) ? delay : (0.75*bwe->delay_avg + 0.25*delay);
+	double loss = (double)lost/(double)(received + lost);
+	double estimate = (double)g_atomic_int_get(&bwe->estimate);
+	if(estimate == 0.0) {
+		/* No estimate yet: start from what the link just delivered */
+		if(bwe->acked_bitrate == 0.0)
+			return;
+		estimate = bwe->acked_bitrate;
+	}
+	gint64 now = janus_get_monotonic_time();
+	if(bwe->delay_avg > JANUS_BWE_DELAY_THRESHOLD) {
+		/* Delay is growing, a queue is building somewhere: back off to a
+		 * fraction of the acknowledged bitrate (but not too often) */
+		if(bwe->acked_bitrate > 0 && (now - bwe->last_decrease) >= JANUS_BWE_DECREASE_BACKOFF) {
+			estimate = 0.85*bwe->acked_bitrate;
+			bwe->last_decrease = now;
+		}
+	} else if(loss > 0.1) {
+		/* Meaningful loss: decrease proportionally */
+		if((now - bwe->last_decrease) >= JANUS_BWE_DECREASE_BACKOFF) {
+			estimate = estimate*(1.0 - 0.5*loss);
+			bwe->last_decrease = now;
+		}
+	} else if(loss < 0.02 && bwe->delay_avg > -JANUS_BWE_DELAY_THRESHOLD) {
+		/* Clean feedback: ramp up, but never too far beyond what the
+		 * link has proven it can actually deliver */
+		estimate = estimate*1.05;
+		if(bwe->acked_bitrate > 0 && estimate > 1.5*bwe->acked_bitrate)
+			estimate = 1.5*bwe->acked_bitrate;
+	}
+	/* If the delay gradient is negative the queue is draining: hold */
+	if(estimate < JANUS_BWE_MIN_BITRATE)
+		estimate = JANUS_BWE_MIN_BITRATE;
+	else if(estimate > JANUS_BWE_MAX_BITRATE)
+		estimate = JANUS_BWE_MAX_BITRATE;
+	g_atomic_int_set(&bwe->estimate, (gint)estimate);
+	JANUS_LOG(LOG_HUGE, "[BWE] estimate=%d bps (acked=%.0f, delay=%.0fus, loss=%.2f)\n",
+		(gint)estimate, bwe->acked_bitrate, bwe->delay_avg, loss);
+}
+
+guint32 janus_bwe_get_estimate(janus_bwe *bwe) {
+	if(bwe == NULL)
+		return 0;
+	return (guint32)g_atomic_int_get(&bwe->estimate);
+}
+
+void janus_bwe_destroy(janus_bwe *bwe) {
+	if(bwe == NULL)
+		return;
+	g_free(bwe);
+}
@@ -0,0 +1,65 @@
+/*! \file    bwe.h
+ * \author   Lorenzo Miniero <lorenzo@meetecho.com>
+ * \copyright GNU General Public License v3
+ * \brief    Send-side bandwidth estimation (headers)
+ * \details  Implementation of a simplified, GCC-style, send-side
+ * bandwidth estimator, fed from the transport-wide CC feedback the
+ * peers send us. The ICE code records the size and send time of every
+ * packet it tags with a transport-wide sequence number; when a TWCC
+ * feedback comes in, the RTCP code reports the arrival time (or loss)
+ * of each of those packets back to the estimator, which tracks the
+ * acknowledged bitrate and a filtered one-way delay gradient. Growing
+ * queuing delay or meaningful loss pull the estimate down towards a
+ * fraction of what the link actually delivered, while clean feedback
+ * lets it ramp back up. The resulting estimate can be queried by
+ * plugins through the \c get_bandwidth_estimate core callback, e.g.,
+ * to proactively switch simulcast layers before NACK storms begin.
+ *
+ * All the feeding happens on the handle loop thread, so the estimator
+ * doesn't need a lock: only the estimate itself is read atomically,
+ * as plugins will query it from their own threads.
+ *
+ * \ingroup protocols
+ * \ref protocols
+ */
+
+#ifndef JANUS_BWE_H
+#define JANUS_BWE_H
+
+#include <glib.h>
+
+typedef struct janus_bwe janus_bwe;
+
+/*! \brief Helper to create a new bandwidth estimator
+ * @returns A pointer to a valid janus_bwe instance, if successful, NULL otherwise */
+janus_bwe *janus_bwe_create(void);
+/*! \brief Record a packet we just sent with a transport-wide sequence number
+ * \note Must be invoked from the handle loop thread
+ * @param bwe The janus_bwe instance to update
+ * @param seq The transport-wide sequence number the packet was tagged with
+ * @param size Size of the packet, in bytes */
+void janus_bwe_packet_sent(janus_bwe *bwe, guint16 seq, int size);
+/*! \brief Report what a TWCC feedback said about one of the packets we sent
+ * \note Must be invoked from the handle loop thread, once per packet the
+ * feedback covers, in order; arrival times are reconstructed by the caller
+ * from the feedback reference time and the receive deltas
+ * @param bwe The janus_bwe instance to update
+ * @param seq The transport-wide sequence number the feedback refers to
+ * @param arrival Reconstructed arrival time at the peer, in microseconds
+ * (only meaningful when the packet was received)
+ * @param received Whether the peer actually received the packet */
+void janus_bwe_packet_acked(janus_bwe *bwe, guint16 seq, gint64 arrival, gboolean received);
+/*! \brief Run the estimator, after all the packets a TWCC feedback covers
+ * have been reported via janus_bwe_packet_acked
+ * \note Must be invoked from the handle loop thread
+ * @param bwe The janus_bwe instance to update */
+void janus_bwe_feedback_done(janus_bwe *bwe);
+/*! \brief Atomically get the current bandwidth estimate
+ * @param bwe The janus_bwe instance to query
+ * @returns The estimate in bits per second, or 0 if there's no estimate yet */
+guint32 janus_bwe_get_estimate(janus_bwe *bwe);
+/*! \brief Destroy an existing bandwidth estimator
+ * @param bwe The janus_bwe instance to destroy */
+void janus_bwe_destroy(janus_bwe *bwe);
+
+#endif
@@ -18,6 +18,7 @@
 extern int janus_log_level;
 extern gboolean janus_log_timestamps;
 extern gboolean janus_log_colors;
+extern gboolean janus_log_binary;
 extern char *janus_log_global_prefix;
 
 /** @name Janus log colors
@@ -91,6 +92,16 @@ static const char *janus_log_prefix[] = {
 #define JANUS_LOG(level, format, ...) \
 do { \
 	if (level > LOG_NONE && level <= LOG_MAX && level <= janus_log_level) { \
+		if (janus_log_binary) { \
+			/* Binary logging: no formatting on this thread, we just
+			 * serialize the raw arguments and render text offline.
+			 * Each call site registers its format string once, the
+			 * first time it's hit, and gets a numeric ID back */ \
+			static volatile gint janus_log_fmt_id = 0; \
+			janus_log_binary_record(&janus_log_fmt_id, level, \
+				__FILE__, __FUNCTION__, __LINE__, format, ##__VA_ARGS__); \
+			break; \
+		} \
 		char janus_log_ts[64] = ""; \
 		char janus_log_src[128] = ""; \
 		if (janus_log_timestamps) { \
@@ -8,6 +8,8 @@
  * \ref protocols
  */
 
+#include <string.h>
+
 #include <glib.h>
 
 #include "dtls-bio.h"
@@ -31,7 +33,9 @@ int janus_dtls_bio_agent_get_mtu(void) {
 
 /* BIO implementation */
 static int janus_dtls_bio_agent_write(BIO *h, const char *buf, int num);
+static int janus_dtls_bio_agent_read(BIO *h, char *buf, int num);
 static long janus_dtls_bio_agent_ctrl(BIO *h, int cmd, long arg1, void *arg2);
+static long janus_dtls_bio_agent_read_ctrl(BIO *h, int cmd, long arg1, void *arg2);
 static int janus_dtls_bio_agent_new(BIO *h);
 static int janus_dtls_bio_agent_free(BIO *data);
 
@@ -49,8 +53,21 @@ static BIO_METHOD janus_dtls_bio_agent_methods = {
 	janus_dtls_bio_agent_free,
 	NULL
 };
+static BIO_METHOD janus_dtls_bio_agent_read_methods = {
+	BIO_TYPE_BIO,
+	"janus agent reader",
+	NULL,
+	janus_dtls_bio_agent_read,
+	NULL,
+	NULL,
+	janus_dtls_bio_agent_read_ctrl,
+	janus_dtls_bio_agent_new,
+	janus_dtls_bio_agent_free,
+	NULL
+};
 #else
 static BIO_METHOD *janus_dtls_bio_agent_methods = NULL;
+static BIO_METHOD *janus_dtls_bio_agent_read_methods = NULL;
 #endif
 int janus_dtls_bio_agent_init(void) {
 #if JANUS_USE_OPENSSL_PRE_1_1_API
@@ -64,6 +81,14 @@ int janus_dtls_bio_agent_init(void) {
 	BIO_meth_set_ctrl(janus_dtls_bio_agent_methods, janus_dtls_bio_agent_ctrl);
 	BIO_meth_set_create(janus_dtls_bio_agent_methods, janus_dtls_bio_agent_new);
 	BIO_meth_set_destroy(janus_dtls_bio_agent_methods, janus_dtls_bio_agent_free);
+	janus_dtls_bio_agent_read_methods = BIO_meth_new(BIO_TYPE_BIO, "janus agent reader");
+	if(!janus_dtls_bio_agent_read_methods) {
+		return -1;
+	}
+	BIO_meth_set_read(janus_dtls_bio_agent_read_methods, janus_dtls_bio_agent_read);
+	BIO_meth_set_ctrl(janus_dtls_bio_agent_read_methods, janus_dtls_bio_agent_read_ctrl);
+	BIO_meth_set_create(janus_dtls_bio_agent_read_methods, janus_dtls_bio_agent_new);
+	BIO_meth_set_destroy(janus_dtls_bio_agent_read_methods, janus_dtls_bio_agent_free);
 #endif
 	return 0;
 }
@@ -76,6 +101,14 @@ static BIO_METHOD *BIO_janus_dtls_agent_method(void) {
 #endif
 }
 
+static BIO_METHOD *BIO_janus_dtls_agent_read_method(void) {
+#if JANUS_USE_OPENSSL_PRE_1_1_API
+	return(&janus_dtls_bio_agent_read_methods);
+#else
+	return janus_dtls_bio_agent_read_methods;
+#endif
+}
+
 BIO *BIO_janus_dtls_agent_new(void *dtls) {
 	BIO* bio = BIO_new(BIO_janus_dtls_agent_method());
 	if(bio == NULL) {
@@ -89,6 +122,19 @@ BIO *BIO_janus_dtls_agent_new(void *dtls) {
 	return bio;
 }
 
+BIO *BIO_janus_dtls_agent_read_new(void *dtls) {
+	BIO* bio = BIO_new(BIO_janus_dtls_agent_read_method());
+	if(bio == NULL) {
+		return NULL;
+	}
+#if JANUS_USE_OPENSSL_PRE_1_1_API
+	bio->ptr = dtls;
+#else
+	BIO_set_data(bio, dtls);
+#endif
+	return bio;
+}
+
 static int janus_dtls_bio_agent_new(BIO *bio) {
 #if JANUS_USE_OPENSSL_PRE_1_1_API
 	bio->init = 1;
@@ -185,3 +231,55 @@ static long janus_dtls_bio_agent_ctrl(BIO *bio, int cmd, long num, void *ptr) {
 	}
 	return 0;
 }
+
+static int janus_dtls_bio_agent_read(BIO *bio, char *out, int outl) {
+	janus_dtls_srtp *dtls;
+#if JANUS_USE_OPENSSL_PRE_1_1_API
+	dtls = (janus_dtls_srtp *)bio->ptr;
+#else
+	dtls = (janus_dtls_srtp *)BIO_get_data(bio);
+#endif
+	if(dtls == NULL) {
+		JANUS_LOG(LOG_ERR, "No DTLS-SRTP stack, no DTLS bridge...\n");
+		return -1;
+	}
+	BIO_clear_retry_flags(bio);
+	if(dtls->incoming_data == NULL || dtls->incoming_len <= 0 || out == NULL || outl <= 0) {
+		/* No datagram pending: report a retriable failure, which is what
+		 * the memory BIO this replaced did when it ran empty */
+		BIO_set_retry_read(bio);
+		return -1;
+	}
+	/* Serve OpenSSL straight from the buffer the datagram arrived in:
+	 * there's no intermediate buffering to go through anymore */
+	int len = (dtls->incoming_len > outl) ? outl : dtls->incoming_len;
+	memcpy(out, dtls->incoming_data, len);
+	dtls->incoming_data += len;
+	dtls->incoming_len -= len;
+	if(dtls->incoming_len == 0)
+		dtls->incoming_data = NULL;
+	JANUS_LOG(LOG_HUGE, "janus_dtls_bio_agent_read: %p, %d\n", out, len);
+	return len;
+}
+
+static long janus_dtls_bio_agent_read_ctrl(BIO *bio, int cmd, long num, void *ptr) {
+	switch(cmd) {
+		case BIO_CTRL_FLUSH:
+			/* The OpenSSL library needs this */
+			return 1;
+		case BIO_CTRL_PENDING: {
+			janus_dtls_srtp *dtls;
+#if JANUS_USE_OPENSSL_PRE_1_1_API
+			dtls = (janus_dtls_srtp *)bio->ptr;
+#else
+			dtls = (janus_dtls_srtp *)BIO_get_data(bio);
+#endif
+			return (dtls != NULL) ? dtls->incoming_len : 0L;
+		}
+		case BIO_CTRL_WPENDING:
+			return 0L;
+		default:
+			JANUS_LOG(LOG_HUGE, "janus_dtls_bio_agent_read_ctrl: %d\n", cmd);
+	}
+	return 0;
+}
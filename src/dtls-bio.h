@@ -1,8 +1,11 @@
 /*! \file    dtls-bio.h
  * \author   Lorenzo Miniero <lorenzo@meetecho.com>
  * \copyright GNU General Public License v3
- * \brief    OpenSSL BIO agent writer
- * \details  OpenSSL BIO that writes packets to a libnice agent.
+ * \brief    OpenSSL BIO agent reader/writer
+ * \details  OpenSSL BIOs that bridge packets between OpenSSL and a
+ * libnice agent without intermediate buffering: the writer sends
+ * outgoing packets straight to the agent, the reader hands incoming
+ * datagrams to OpenSSL by reference from the buffer they arrived in.
  *
  * \ingroup protocols
  * \ref protocols
@@ -21,6 +24,11 @@ int janus_dtls_bio_agent_init(void);
 /*! \brief OpenSSL BIO agent writer constructor */
 BIO *BIO_janus_dtls_agent_new(void *dtls);
 
+/*! \brief OpenSSL BIO agent reader constructor: rather than buffering
+ * incoming DTLS data in a memory BIO, this reads straight from the
+ * datagram the DTLS stack is currently processing */
+BIO *BIO_janus_dtls_agent_read_new(void *dtls);
+
 /*! \brief Set the MTU for the BIO agent writer
  * \note The default starting MTU is 1472, in case fragmentation is needed
  * the OpenSSL DTLS stack automatically decreases it. That said, if
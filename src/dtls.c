@@ -18,6 +18,9 @@
 #include "rtcp.h"
 #include "events.h"
 
+#include <sys/stat.h>
+#include <fcntl.h>
+
 #include <openssl/err.h>
 #include <openssl/bn.h>
 #include <openssl/evp.h>
@@ -122,6 +125,46 @@ gboolean janus_dtls_are_selfsigned_certs_ok(void) {
  * that value cannot be modified (it will in OpenSSL v1.1.1) */
 static guint16 dtls_timeout_base = 1000;
 
+/* Optional worker pool the DTLS handshake crypto is offloaded to: with
+ * shared event loops, a burst of new PeerConnections would otherwise have
+ * OpenSSL doing RSA/ECDSA math on the same threads that are relaying media
+ * for everybody else, with visible jitter. When enabled, handshake related
+ * messages are processed on the pool (serialized per stack by a mutex),
+ * and the final notification is posted back to the handle loop */
+static GThreadPool *dtls_handshake_pool = NULL;
+static guint dtls_handshake_pool_size = 0;
+void janus_dtls_srtp_set_handshake_pool_size(guint size) {
+	dtls_handshake_pool_size = size;
+}
+/* Copy of an incoming DTLS message, deferred to the handshake pool */
+typedef struct janus_dtls_deferred_msg {
+	char *buf;
+	uint16_t len;
+} janus_dtls_deferred_msg;
+static void janus_dtls_deferred_msg_free(janus_dtls_deferred_msg *msg) {
+	if(msg == NULL)
+		return;
+	g_free(msg->buf);
+	g_free(msg);
+}
+static void janus_dtls_srtp_pool_process(gpointer data, gpointer user_data);
+static gboolean janus_dtls_notify_handshake_done(gpointer user_data);
+/* Make sure there's a pool job scheduled for this stack: a single job at
+ * a time is enough, as it drains all the deferred messages in order */
+static void janus_dtls_srtp_pool_schedule(janus_dtls_srtp *dtls) {
+	if(!g_atomic_int_compare_and_exchange(&dtls->pool_scheduled, 0, 1))
+		return;
+	janus_refcount_increase(&dtls->ref);
+	GError *error = NULL;
+	g_thread_pool_push(dtls_handshake_pool, dtls, &error);
+	if(error != NULL) {
+		JANUS_LOG(LOG_WARN, "Couldn't offload DTLS processing to the handshake pool, doing it inline... %d (%s)\n",
+			error->code, error->message ? error->message : "??");
+		g_error_free(error);
+		janus_dtls_srtp_pool_process(dtls, NULL);
+	}
+}
+
 static SSL_CTX *ssl_ctx = NULL;
 static X509 *ssl_cert = NULL;
 static EVP_PKEY *ssl_key = NULL;
@@ -389,6 +432,47 @@ error:
 	return -1;
 }
 
+static int janus_dtls_save_keys(const char *server_pem, const char *server_key,
+		X509 *certificate, EVP_PKEY *private_key) {
+	FILE *f = NULL;
+
+	f = fopen(server_pem, "w");
+	if(!f) {
+		JANUS_LOG(LOG_WARN, "Error creating certificate file (%s)\n", g_strerror(errno));
+		return -1;
+	}
+	if(!PEM_write_X509(f, certificate)) {
+		JANUS_LOG(LOG_WARN, "PEM_write_X509 failed\n");
+		fclose(f);
+		unlink(server_pem);
+		return -1;
+	}
+	fclose(f);
+
+	/* Only we should be able to read the private key: create the file
+	 * with the right mode right away, rather than chmod it afterwards */
+	int fd = open(server_key, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+	if(fd > -1)
+		f = fdopen(fd, "w");
+	if(!f) {
+		JANUS_LOG(LOG_WARN, "Error creating key file (%s)\n", g_strerror(errno));
+		if(fd > -1)
+			close(fd);
+		unlink(server_pem);
+		return -1;
+	}
+	if(!PEM_write_PrivateKey(f, private_key, NULL, NULL, 0, NULL, NULL)) {
+		JANUS_LOG(LOG_WARN, "PEM_write_PrivateKey failed\n");
+		fclose(f);
+		unlink(server_pem);
+		unlink(server_key);
+		return -1;
+	}
+	fclose(f);
+
+	return 0;
+}
+
 /* Versioning info ( */
 const char *janus_get_ssl_version(void) {
 	return OPENSSL_VERSION_TEXT;
@@ -396,7 +480,7 @@ const char *janus_get_ssl_version(void) {
 
 /* DTLS-SRTP initialization */
 gint janus_dtls_srtp_init(const char *server_pem, const char *server_key, const char *password,
-		const char *ciphers, guint16 timeout, gboolean rsa_private_key, gboolean accept_selfsigned) {
+		const char *autocert_folder, const char *ciphers, guint16 timeout, gboolean rsa_private_key, gboolean accept_selfsigned) {
 	const char *crypto_lib = NULL;
 #if JANUS_USE_OPENSSL_PRE_1_1_API && !defined(HAVE_BORINGSSL)
 #if defined(LIBRESSL_VERSION_NUMBER)
@@ -418,6 +502,19 @@ gint janus_dtls_srtp_init(const char *server_pem, const char *server_key, const
 #ifdef HAVE_BORINGSSL
 	crypto_lib = "BoringSSL";
 #endif
+	if(dtls_handshake_pool_size > 0) {
+		GError *error = NULL;
+		dtls_handshake_pool = g_thread_pool_new(janus_dtls_srtp_pool_process, NULL,
+			dtls_handshake_pool_size, FALSE, &error);
+		if(error != NULL) {
+			JANUS_LOG(LOG_WARN, "Error creating the DTLS handshake pool, handshakes will run on the handle loops... %d (%s)\n",
+				error->code, error->message ? error->message : "??");
+			g_error_free(error);
+			dtls_handshake_pool = NULL;
+		} else {
+			JANUS_LOG(LOG_INFO, "Offloading DTLS handshakes to a pool of %u threads\n", dtls_handshake_pool_size);
+		}
+	}
 	JANUS_LOG(LOG_INFO, "Crypto: %s\n", crypto_lib);
 #ifndef HAVE_SRTP_AESGCM
 	JANUS_LOG(LOG_WARN, "The libsrtp installation does not support AES-GCM profiles\n");
@@ -446,10 +543,33 @@ gint janus_dtls_srtp_init(const char *server_pem, const char *server_key, const
 #endif
 
 	if(!server_pem && !server_key) {
-		JANUS_LOG(LOG_INFO, "No cert/key specified, autogenerating some...\n");
-		if(janus_dtls_generate_keys(&ssl_cert, &ssl_key, rsa_private_key) != 0) {
-			JANUS_LOG(LOG_FATAL, "Error generating DTLS key/certificate\n");
-			return -2;
+		/* If we have a folder to persist autogenerated certificates to, check
+		 * whether a previous startup left some there we can reuse, so that
+		 * restarts don't have to pay for the key generation every time */
+		gboolean generate = TRUE;
+		char autocert_pem[512], autocert_key[512];
+		if(autocert_folder != NULL) {
+			g_snprintf(autocert_pem, sizeof(autocert_pem), "%s/janus-autocert.pem", autocert_folder);
+			g_snprintf(autocert_key, sizeof(autocert_key), "%s/janus-autocert.key", autocert_folder);
+			if(g_file_test(autocert_pem, G_FILE_TEST_EXISTS) && g_file_test(autocert_key, G_FILE_TEST_EXISTS)) {
+				JANUS_LOG(LOG_INFO, "No cert/key specified, reusing the autogenerated ones in %s\n", autocert_folder);
+				if(janus_dtls_load_keys(autocert_pem, autocert_key, NULL, &ssl_cert, &ssl_key) == 0) {
+					generate = FALSE;
+				} else {
+					JANUS_LOG(LOG_WARN, "Error loading the persisted certificate/key, generating new ones\n");
+				}
+			}
+		}
+		if(generate) {
+			JANUS_LOG(LOG_INFO, "No cert/key specified, autogenerating some...\n");
+			if(janus_dtls_generate_keys(&ssl_cert, &ssl_key, rsa_private_key) != 0) {
+				JANUS_LOG(LOG_FATAL, "Error generating DTLS key/certificate\n");
+				return -2;
+			}
+			if(autocert_folder != NULL && janus_dtls_save_keys(autocert_pem, autocert_key, ssl_cert, ssl_key) == 0) {
+				/* Saving is best effort: if it failed we just generate new ones at the next startup */
+				JANUS_LOG(LOG_INFO, "Persisted the autogenerated certificate/key to %s\n", autocert_folder);
+			}
 		}
 	} else if(!server_pem || !server_key) {
 		JANUS_LOG(LOG_FATAL, "DTLS certificate and key must be specified\n");
@@ -524,6 +644,11 @@ static void janus_dtls_srtp_free(const janus_refcount *dtls_ref) {
 	janus_dtls_srtp *dtls = janus_refcount_containerof(dtls_ref, janus_dtls_srtp, ref);
 	/* This stack can be destroyed, free all the resources */
 	dtls->pc = NULL;
+	if(dtls->deferred_msgs != NULL) {
+		g_async_queue_unref(dtls->deferred_msgs);
+		dtls->deferred_msgs = NULL;
+	}
+	janus_mutex_destroy(&dtls->ssl_mutex);
 	if(dtls->ssl != NULL) {
 		SSL_free(dtls->ssl);
 		dtls->ssl = NULL;
@@ -540,6 +665,14 @@ static void janus_dtls_srtp_free(const janus_refcount *dtls_ref) {
 			srtp_dealloc(dtls->srtp_out);
 			dtls->srtp_out = NULL;
 		}
+		if(dtls->srtp_ectx_in) {
+			janus_srtp_engine_destroy_context(dtls->srtp_ectx_in);
+			dtls->srtp_ectx_in = NULL;
+		}
+		if(dtls->srtp_ectx_out) {
+			janus_srtp_engine_destroy_context(dtls->srtp_ectx_out);
+			dtls->srtp_ectx_out = NULL;
+		}
 		/* FIXME What about dtls->remote_policy and dtls->local_policy? */
 	}
 	g_free(dtls);
@@ -547,6 +680,10 @@ static void janus_dtls_srtp_free(const janus_refcount *dtls_ref) {
 }
 
 void janus_dtls_srtp_cleanup(void) {
+	if(dtls_handshake_pool != NULL) {
+		g_thread_pool_free(dtls_handshake_pool, FALSE, TRUE);
+		dtls_handshake_pool = NULL;
+	}
 	if(ssl_cert != NULL) {
 		X509_free(ssl_cert);
 		ssl_cert = NULL;
@@ -581,6 +718,9 @@ janus_dtls_srtp *janus_dtls_srtp_create(void *ice_pc, janus_dtls_role role) {
 	janus_dtls_srtp *dtls = g_malloc0(sizeof(janus_dtls_srtp));
 	g_atomic_int_set(&dtls->destroyed, 0);
 	janus_refcount_init(&dtls->ref, janus_dtls_srtp_free);
+	janus_mutex_init(&dtls->ssl_mutex);
+	if(dtls_handshake_pool != NULL)
+		dtls->deferred_msgs = g_async_queue_new_full((GDestroyNotify)janus_dtls_deferred_msg_free);
 	/* Create SSL context, at last */
 	dtls->srtp_valid = 0;
 	dtls->ssl = SSL_new(ssl_ctx);
@@ -592,14 +732,13 @@ janus_dtls_srtp *janus_dtls_srtp_create(void *ice_pc, janus_dtls_role role) {
 	}
 	SSL_set_ex_data(dtls->ssl, 0, dtls);
 	SSL_set_info_callback(dtls->ssl, janus_dtls_callback);
-	dtls->read_bio = BIO_new(BIO_s_mem());
+	dtls->read_bio = BIO_janus_dtls_agent_read_new(dtls);
 	if(!dtls->read_bio) {
 		JANUS_LOG(LOG_ERR, "[%"SCNu64"]   Error creating read BIO! (%s)\n",
 			handle->handle_id, ERR_reason_error_string(ERR_get_error()));
 		janus_refcount_decrease(&dtls->ref);
 		return NULL;
 	}
-	BIO_set_mem_eof_return(dtls->read_bio, -1);
 	dtls->write_bio = BIO_janus_dtls_agent_new(dtls);
 	if(!dtls->write_bio) {
 		JANUS_LOG(LOG_ERR, "[%"SCNu64"]   Error creating write BIO! (%s)\n",
@@ -646,9 +785,7 @@ janus_dtls_srtp *janus_dtls_srtp_create(void *ice_pc, janus_dtls_role role) {
 	return dtls;
 }
 
-void janus_dtls_srtp_handshake(janus_dtls_srtp *dtls) {
-	if(dtls == NULL || dtls->ssl == NULL)
-		return;
+static void janus_dtls_srtp_handshake_internal(janus_dtls_srtp *dtls) {
 	if(dtls->dtls_state == JANUS_DTLS_STATE_CREATED) {
 		/* Starting the handshake now: enforce the role */
 		dtls->dtls_started = janus_get_monotonic_time();
@@ -665,6 +802,18 @@ void janus_dtls_srtp_handshake(janus_dtls_srtp *dtls) {
 	janus_dtls_notify_state_change(dtls);
 }
 
+void janus_dtls_srtp_handshake(janus_dtls_srtp *dtls) {
+	if(dtls == NULL || dtls->ssl == NULL)
+		return;
+	if(dtls_handshake_pool != NULL) {
+		/* Have a pool thread take care of the crypto */
+		g_atomic_int_set(&dtls->handshake_pending, 1);
+		janus_dtls_srtp_pool_schedule(dtls);
+		return;
+	}
+	janus_dtls_srtp_handshake_internal(dtls);
+}
+
 int janus_dtls_srtp_create_sctp(janus_dtls_srtp *dtls) {
 #ifdef HAVE_SCTP
 	if(dtls == NULL)
@@ -689,11 +838,7 @@ int janus_dtls_srtp_create_sctp(janus_dtls_srtp *dtls) {
 #endif
 }
 
-void janus_dtls_srtp_incoming_msg(janus_dtls_srtp *dtls, char *buf, uint16_t len) {
-	if(dtls == NULL) {
-		JANUS_LOG(LOG_ERR, "No DTLS-SRTP stack, no incoming message...\n");
-		return;
-	}
+static void janus_dtls_srtp_incoming_msg_internal(janus_dtls_srtp *dtls, char *buf, uint16_t len) {
 	janus_ice_peerconnection *pc = (janus_ice_peerconnection *)dtls->pc;
 	if(pc == NULL) {
 		JANUS_LOG(LOG_ERR, "No WebRTC PeerConnection, no DTLS...\n");
@@ -716,12 +861,11 @@ void janus_dtls_srtp_incoming_msg(janus_dtls_srtp *dtls, char *buf, uint16_t len
 		/* Handshake not started yet: maybe we're still waiting for the answer and the DTLS role? */
 		return;
 	}
-	int written = BIO_write(dtls->read_bio, buf, len);
-	if(written != len) {
-		JANUS_LOG(LOG_WARN, "[%"SCNu64"]     Only written %d/%d of those bytes on the read BIO...\n", handle->handle_id, written, len);
-	} else {
-		JANUS_LOG(LOG_HUGE, "[%"SCNu64"]     Written %d bytes on the read BIO...\n", handle->handle_id, written);
-	}
+	/* Hand the datagram to the read BIO by reference: OpenSSL will pull
+	 * it directly from this buffer, with no intermediate buffering */
+	dtls->incoming_data = buf;
+	dtls->incoming_len = len;
+	JANUS_LOG(LOG_HUGE, "[%"SCNu64"]     Passing %d bytes to the read BIO...\n", handle->handle_id, len);
 	/* Try to read data */
 	char data[1500];	/* FIXME */
 	int read = SSL_read(dtls->ssl, &data, 1500);
@@ -950,6 +1094,44 @@ void janus_dtls_srtp_incoming_msg(janus_dtls_srtp *dtls, char *buf, uint16_t len
 					JANUS_LOG(LOG_ERR, "[%"SCNu64"]  -- %d (%s)\n", handle->handle_id, res, janus_srtp_error_str(res));
 					goto done;
 				}
+				/* If an alternative crypto engine was selected and supports this
+				 * profile, create engine contexts too: they take precedence over
+				 * the libsrtp sessions we just created, which remain the fallback */
+				janus_srtp_profile engine_profile = 0;
+				switch(srtp_profile->id) {
+					case SRTP_AES128_CM_SHA1_80:
+						engine_profile = JANUS_SRTP_AES128_CM_SHA1_80;
+						break;
+					case SRTP_AES128_CM_SHA1_32:
+						engine_profile = JANUS_SRTP_AES128_CM_SHA1_32;
+						break;
+#ifdef HAVE_SRTP_AESGCM
+					case SRTP_AEAD_AES_256_GCM:
+						engine_profile = JANUS_SRTP_AEAD_AES_256_GCM;
+						break;
+					case SRTP_AEAD_AES_128_GCM:
+						engine_profile = JANUS_SRTP_AEAD_AES_128_GCM;
+						break;
+#endif
+					default:
+						break;
+				}
+				if(engine_profile != 0) {
+					dtls->srtp_ectx_in = janus_srtp_engine_create_context(TRUE, engine_profile,
+						remote_key, key_length, remote_salt, salt_length);
+					dtls->srtp_ectx_out = janus_srtp_engine_create_context(FALSE, engine_profile,
+						local_key, key_length, local_salt, salt_length);
+					if((dtls->srtp_ectx_in != NULL) != (dtls->srtp_ectx_out != NULL)) {
+						/* Only one direction made it: don't mix engines, use libsrtp for both */
+						janus_srtp_engine_destroy_context(dtls->srtp_ectx_in);
+						dtls->srtp_ectx_in = NULL;
+						janus_srtp_engine_destroy_context(dtls->srtp_ectx_out);
+						dtls->srtp_ectx_out = NULL;
+					} else if(dtls->srtp_ectx_in != NULL) {
+						JANUS_LOG(LOG_VERB, "[%"SCNu64"] Using the '%s' SRTP engine for component %d in stream %d\n",
+							handle->handle_id, janus_srtp_engine_selected(), pc->component_id, pc->stream_id);
+					}
+				}
 				dtls->srtp_profile = srtp_profile->id;
 				dtls->srtp_valid = 1;
 				JANUS_LOG(LOG_VERB, "[%"SCNu64"] Created outbound SRTP session for component %d in stream %d\n", handle->handle_id, pc->component_id, pc->stream_id);
@@ -964,7 +1146,18 @@ void janus_dtls_srtp_incoming_msg(janus_dtls_srtp *dtls, char *buf, uint16_t len
 done:
 			if(!janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_ALERT) && dtls->srtp_valid) {
 				/* Handshake successfully completed */
-				janus_ice_dtls_handshake_done(handle);
+				if(dtls_handshake_pool != NULL) {
+					/* We're on a pool thread: notify the ICE layer from the handle
+					 * loop instead, so that plugins keep getting their setup_media
+					 * callback on the thread they expect */
+					janus_refcount_increase(&dtls->ref);
+					GSource *done = g_idle_source_new();
+					g_source_set_callback(done, janus_dtls_notify_handshake_done, dtls, NULL);
+					g_source_attach(done, handle->mainctx);
+					g_source_unref(done);
+				} else {
+					janus_ice_dtls_handshake_done(handle);
+				}
 			} else {
 				/* Something went wrong in either DTLS or SRTP... tell the plugin about it */
 				janus_dtls_callback(dtls->ssl, SSL_CB_ALERT, 0);
@@ -974,14 +1167,74 @@ done:
 	}
 }
 
+void janus_dtls_srtp_incoming_msg(janus_dtls_srtp *dtls, char *buf, uint16_t len) {
+	if(dtls == NULL) {
+		JANUS_LOG(LOG_ERR, "No DTLS-SRTP stack, no incoming message...\n");
+		return;
+	}
+	if(dtls_handshake_pool != NULL && (!dtls->ready || g_atomic_int_get(&dtls->pool_scheduled))) {
+		/* Handshake still going on (or messages still queued): copy the
+		 * message and let a pool thread process it, in arrival order */
+		janus_dtls_deferred_msg *msg = g_malloc(sizeof(janus_dtls_deferred_msg));
+		msg->buf = g_malloc(len);
+		memcpy(msg->buf, buf, len);
+		msg->len = len;
+		g_async_queue_push(dtls->deferred_msgs, msg);
+		janus_dtls_srtp_pool_schedule(dtls);
+		return;
+	}
+	janus_mutex_lock(&dtls->ssl_mutex);
+	janus_dtls_srtp_incoming_msg_internal(dtls, buf, len);
+	/* The datagram was handed to OpenSSL by reference, and the buffer is
+	 * only ours for the duration of this call: don't leave it dangling */
+	dtls->incoming_data = NULL;
+	dtls->incoming_len = 0;
+	janus_mutex_unlock(&dtls->ssl_mutex);
+}
+
+/* Notify the ICE layer a handshake completed on the handshake pool: this
+ * runs as an idle source on the handle loop */
+static gboolean janus_dtls_notify_handshake_done(gpointer user_data) {
+	janus_dtls_srtp *dtls = (janus_dtls_srtp *)user_data;
+	janus_ice_peerconnection *pc = (janus_ice_peerconnection *)dtls->pc;
+	if(pc != NULL && pc->handle != NULL && !g_atomic_int_get(&dtls->destroyed))
+		janus_ice_dtls_handshake_done(pc->handle);
+	janus_refcount_decrease(&dtls->ref);
+	return G_SOURCE_REMOVE;
+}
+
+static void janus_dtls_srtp_pool_process(gpointer data, gpointer user_data) {
+	janus_dtls_srtp *dtls = (janus_dtls_srtp *)data;
+	janus_mutex_lock(&dtls->ssl_mutex);
+	/* Clear the flag first: messages deferred from now on will get their own job */
+	g_atomic_int_set(&dtls->pool_scheduled, 0);
+	if(!g_atomic_int_get(&dtls->destroyed)) {
+		if(g_atomic_int_compare_and_exchange(&dtls->handshake_pending, 1, 0))
+			janus_dtls_srtp_handshake_internal(dtls);
+		janus_dtls_deferred_msg *msg = NULL;
+		while((msg = g_async_queue_try_pop(dtls->deferred_msgs)) != NULL) {
+			janus_dtls_srtp_incoming_msg_internal(dtls, msg->buf, msg->len);
+			/* The buffer was handed to OpenSSL by reference and we're
+			 * about to free it: don't leave it dangling */
+			dtls->incoming_data = NULL;
+			dtls->incoming_len = 0;
+			janus_dtls_deferred_msg_free(msg);
+		}
+	}
+	janus_mutex_unlock(&dtls->ssl_mutex);
+	janus_refcount_decrease(&dtls->ref);
+}
+
 void janus_dtls_srtp_send_alert(janus_dtls_srtp *dtls) {
 	if(!dtls)
 		return;
 	/* Send alert */
 	janus_refcount_increase(&dtls->ref);
+	janus_mutex_lock(&dtls->ssl_mutex);
 	if(dtls != NULL && dtls->ssl != NULL) {
 		SSL_shutdown(dtls->ssl);
 	}
+	janus_mutex_unlock(&dtls->ssl_mutex);
 	janus_refcount_decrease(&dtls->ref);
 }
 
@@ -1060,11 +1313,11 @@ void janus_dtls_sctp_data_ready(janus_dtls_srtp *dtls) {
 	janus_ice_notify_data_ready(handle);
 }
 
-void janus_dtls_wrap_sctp_data(janus_dtls_srtp *dtls, char *label, char *protocol, gboolean textdata, char *buf, int len) {
+void janus_dtls_wrap_sctp_data(janus_dtls_srtp *dtls, char *label, char *protocol, gboolean textdata, char *buf, int len, uint16_t pr_policy, uint32_t pr_value) {
 	if(dtls == NULL || !dtls->ready || dtls->sctp == NULL || buf == NULL || len < 1)
 		return;
 	janus_refcount_increase(&dtls->sctp->ref);
-	janus_sctp_send_data(dtls->sctp, label, protocol, textdata, buf, len);
+	janus_sctp_send_data(dtls->sctp, label, protocol, textdata, buf, len, pr_policy, pr_value);
 	janus_refcount_decrease(&dtls->sctp->ref);
 }
 
@@ -1119,9 +1372,11 @@ gboolean janus_dtls_retry(gpointer stack) {
 		janus_ice_webrtc_hangup(handle, "DTLS timeout");
 		goto stoptimer;
 	}
+	janus_mutex_lock(&dtls->ssl_mutex);
 	struct timeval timeout = {0};
 	if(DTLSv1_get_timeout(dtls->ssl, &timeout) == 0) {
 		/* failed to get timeout. try again on next iter */
+		janus_mutex_unlock(&dtls->ssl_mutex);
 		return TRUE;
 	}
 	guint64 timeout_value = timeout.tv_sec*1000 + timeout.tv_usec/1000;
@@ -1136,18 +1391,19 @@ gboolean janus_dtls_retry(gpointer stack) {
 		if(res == -1 && SSL_get_error(dtls->ssl, res) != SSL_ERROR_WANT_WRITE) {
 			/* DTLSv1_handle_timeout returned an unrecoverable error, fail right away
 			 * Ref.: https://webrtc-review.googlesource.com/c/src/+/260100 */
+			janus_mutex_unlock(&dtls->ssl_mutex);
 			JANUS_LOG(LOG_ERR, "[%"SCNu64"] DTLSv1_handle_timeout failed...\n", handle->handle_id);
 			janus_ice_webrtc_hangup(handle, "DTLS error");
 			goto stoptimer;
 		}
 	}
+	janus_mutex_unlock(&dtls->ssl_mutex);
 	return TRUE;
 
 stoptimer:
-	if(pc->dtlsrt_source != NULL) {
-		g_source_destroy(pc->dtlsrt_source);
-		g_source_unref(pc->dtlsrt_source);
-		pc->dtlsrt_source = NULL;
+	if(pc->dtlsrt_job != NULL) {
+		/* No need to cancel the job, returning FALSE removes it */
+		pc->dtlsrt_job = NULL;
 	}
 	return FALSE;
 }
@@ -20,6 +20,7 @@
 
 #include "rtp.h"
 #include "rtpsrtp.h"
+#include "srtp-engine.h"
 #include "sctp.h"
 #include "refcount.h"
 #include "dtls-bio.h"
@@ -32,13 +33,23 @@ const char *janus_get_ssl_version(void);
  * @param[in] server_pem Path to the certificate to use
  * @param[in] server_key Path to the key to use
  * @param[in] password Password needed to use the key, if any
+ * @param[in] autocert_folder Folder to persist an autogenerated certificate/key to, so that
+ * they can be reused at the next startup (ignored if a certificate is specified, or if NULL)
  * @param[in] ciphers DTLS ciphers to use (will use hardcoded defaults, if NULL)
  * @param[in] timeout DTLS timeout base, in ms, to use for retransmissions (ignored if not using BoringSSL)
  * @param[in] rsa_private_key Whether RSA certificates should be generated, instead of NIST P-256
  * @param[in] accept_selfsigned Whether to accept self-signed certificates (default) or enforce validation
  * @returns 0 in case of success, a negative integer on errors */
 gint janus_dtls_srtp_init(const char *server_pem, const char *server_key, const char *password,
-	const char *ciphers, guint16 timeout, gboolean rsa_private_key, gboolean accept_selfsigned);
+	const char *autocert_folder, const char *ciphers, guint16 timeout, gboolean rsa_private_key, gboolean accept_selfsigned);
+/*! \brief Method to configure the size of the DTLS handshake pool, to be
+ * invoked before janus_dtls_srtp_init
+ * \note When a pool is available, the handshake crypto runs on its threads
+ * rather than on the handle event loops, which keeps media on shared static
+ * loops from jittering during join storms; 0 (the default) means handshakes
+ * keep being processed on the loops, as before
+ * @param[in] size Number of threads to use for DTLS handshakes (0 to disable the pool) */
+void janus_dtls_srtp_set_handshake_pool_size(guint size);
 /*! \brief Method to cleanup DTLS stuff before exiting */
 void janus_dtls_srtp_cleanup(void);
 /*! \brief Method to return a string representation (SHA-256) of the certificate fingerprint */
@@ -80,6 +91,11 @@ typedef struct janus_dtls_srtp {
 	BIO *read_bio;
 	/*! \brief Write BIO (outgoing DTLS data) */
 	BIO *write_bio;
+	/*! \brief Incoming datagram the read BIO hands to OpenSSL by reference
+	 * (only valid while the message that carried it is being processed) */
+	const char *incoming_data;
+	/*! \brief How much of the incoming datagram OpenSSL hasn't consumed yet */
+	int incoming_len;
 	/*! \brief Whether SRTP has been correctly set up for this component or not */
 	gint srtp_valid;
 	/*! \brief The SRTP profile currently in use */
@@ -88,6 +104,11 @@ typedef struct janus_dtls_srtp {
 	srtp_t srtp_in;
 	/*! \brief libsrtp context for outgoing SRTP packets */
 	srtp_t srtp_out;
+	/*! \brief Alternative crypto engine context for incoming SRTP packets
+	 * (NULL when using the libsrtp sessions above, which remain the fallback) */
+	janus_srtp_engine_ctx *srtp_ectx_in;
+	/*! \brief Alternative crypto engine context for outgoing SRTP packets */
+	janus_srtp_engine_ctx *srtp_ectx_out;
 	/*! \brief libsrtp policy for incoming SRTP packets */
 	srtp_policy_t remote_policy;
 	/*! \brief libsrtp policy for outgoing SRTP packets */
@@ -96,6 +117,14 @@ typedef struct janus_dtls_srtp {
 	int ready;
 	/*! \brief The number of retransmissions that have occurred for this DTLS instance so far */
 	int retransmissions;
+	/*! \brief Mutex serializing access to the SSL stack, in case handshakes are offloaded to the handshake pool */
+	janus_mutex ssl_mutex;
+	/*! \brief Incoming DTLS messages deferred to the handshake pool, if enabled */
+	GAsyncQueue *deferred_msgs;
+	/*! \brief Whether a handshake pool job is currently scheduled for this stack */
+	volatile gint pool_scheduled;
+	/*! \brief Whether a handshake needs to be started by the handshake pool */
+	volatile gint handshake_pending;
 #ifdef HAVE_SCTP
 	/*! \brief SCTP association, if DataChannels are involved */
 	janus_sctp_association *sctp;
@@ -157,8 +186,10 @@ void janus_dtls_sctp_data_ready(janus_dtls_srtp *dtls);
  * @param[in] protocol The protocol of the data channel to use
  * @param[in] textdata Whether the buffer is text (domstring) or binary data
  * @param[in] buf The data buffer to encapsulate
- * @param[in] len The data length */
-void janus_dtls_wrap_sctp_data(janus_dtls_srtp *dtls, char *label, char *protocol, gboolean textdata, char *buf, int len);
+ * @param[in] len The data length
+ * @param[in] pr_policy The PR-SCTP partial reliability policy to send with (0=reliable)
+ * @param[in] pr_value The partial reliability parameter (lifetime in ms or number of retransmissions) */
+void janus_dtls_wrap_sctp_data(janus_dtls_srtp *dtls, char *label, char *protocol, gboolean textdata, char *buf, int len, uint16_t pr_policy, uint32_t pr_value);
 
 /*! \brief Callback (called from the SCTP stack) to encapsulate in DTLS outgoing SCTP data (DataChannel)
  * @param[in] dtls The janus_dtls_srtp instance to use
@@ -13,6 +13,7 @@
 #include <stdarg.h>
 
 #include "events.h"
+#include "lfq.h"
 #include "utils.h"
 
 static struct janus_event_types {
@@ -37,30 +38,132 @@ static gboolean eventsenabled = FALSE;
 static char *server = NULL;
 static GHashTable *eventhandlers = NULL;
 
-static GAsyncQueue *events = NULL;
-static json_t exit_event;
+/* Size of the lock-free rings events are queued on: pushes to the main
+ * ring never lose events (they overflow to the control lane), while the
+ * ring slow handlers are served from drops events when it's full */
+#define JANUS_EVENTS_QUEUE_SIZE		8192
+/* Size of the pool of dispatcher threads serving regular handlers */
+#define JANUS_EVENTS_DISPATCHERS	2
+static janus_lfq *events = NULL, *slow_events = NULL;
+static int fast_handlers = 0, slow_handlers = 0;
+static volatile gint slow_events_dropped = 0;
 
-static GThread *events_thread;
+static GThread *events_threads[JANUS_EVENTS_DISPATCHERS];
+static GThread *slow_events_thread = NULL;
 void *janus_events_thread(void *data);
 
+/* Per-handler, per-handle rate limiting of media stats events: handlers
+ * that set a stats_interval only get one stats event per handle within
+ * that window, with the ones in between coalesced into the next one */
+typedef struct janus_events_stats_state {
+	gint64 last;		/* Monotonic time of the last stats event we let through */
+	guint coalesced;	/* How many stats events we've coalesced since then */
+} janus_events_stats_state;
+static GHashTable *stats_states = NULL;		/* Maps handlers to a handle-indexed table of states */
+static janus_mutex stats_mutex = JANUS_MUTEX_INITIALIZER;
+
+/* Helper to check whether a media stats event is due for a handler, or
+ * should be coalesced into the next one instead: when due, the number of
+ * events coalesced since the last delivered one is returned too */
+static gboolean janus_events_stats_due(janus_eventhandler *e, json_t *event, guint *coalesced) {
+	guint64 handle_id = json_integer_value(json_object_get(event, "handle_id"));
+	if(handle_id == 0)
+		return TRUE;
+	gint64 now = janus_get_monotonic_time();
+	janus_mutex_lock(&stats_mutex);
+	GHashTable *handles = g_hash_table_lookup(stats_states, e);
+	if(handles == NULL) {
+		handles = g_hash_table_new_full(g_int64_hash, g_int64_equal, (GDestroyNotify)g_free, (GDestroyNotify)g_free);
+		g_hash_table_insert(stats_states, e, handles);
+	}
+	janus_events_stats_state *state = g_hash_table_lookup(handles, &handle_id);
+	if(state == NULL) {
+		/* First stats event for this handle: let it through */
+		state = g_malloc0(sizeof(janus_events_stats_state));
+		state->last = now;
+		g_hash_table_insert(handles, janus_uint64_dup(handle_id), state);
+		janus_mutex_unlock(&stats_mutex);
+		*coalesced = 0;
+		return TRUE;
+	}
+	if(now - state->last < (gint64)e->stats_interval * 1000) {
+		/* Too soon: this event is coalesced into the next delivered one */
+		state->coalesced++;
+		janus_mutex_unlock(&stats_mutex);
+		return FALSE;
+	}
+	state->last = now;
+	*coalesced = state->coalesced;
+	state->coalesced = 0;
+	janus_mutex_unlock(&stats_mutex);
+	return TRUE;
+}
+
+/* Helper to get rid of the stats state of a handle that's gone */
+static void janus_events_stats_cleanup(guint64 handle_id) {
+	if(handle_id == 0)
+		return;
+	janus_mutex_lock(&stats_mutex);
+	GHashTableIter iter;
+	gpointer value;
+	g_hash_table_iter_init(&iter, stats_states);
+	while(g_hash_table_iter_next(&iter, NULL, &value)) {
+		GHashTable *handles = value;
+		g_hash_table_remove(handles, &handle_id);
+	}
+	janus_mutex_unlock(&stats_mutex);
+}
+
 int janus_events_init(gboolean enabled, char *server_name, GHashTable *handlers) {
 	eventsenabled = enabled;
 	if(eventsenabled) {
-		events = g_async_queue_new();
+		events = janus_lfq_new(JANUS_EVENTS_QUEUE_SIZE);
+		stats_states = g_hash_table_new_full(NULL, NULL, NULL, (GDestroyNotify)g_hash_table_destroy);
 		if(server_name != NULL)
 			server = g_strdup(server_name);
 		eventhandlers = handlers;
-		/* We setup a thread for passing events to the handlers */
+		/* Count how many of the handlers want the slow lane: those are
+		 * served by a dedicated thread, so that one of them blocking
+		 * can't delay delivery to the others */
+		GHashTableIter iter;
+		gpointer value;
+		g_hash_table_iter_init(&iter, eventhandlers);
+		while(g_hash_table_iter_next(&iter, NULL, &value)) {
+			janus_eventhandler *e = value;
+			if(e == NULL)
+				continue;
+			if(e->slow)
+				slow_handlers++;
+			else
+				fast_handlers++;
+		}
+		/* We setup a small pool of threads for passing events to the handlers */
 		GError *error = NULL;
-		events_thread = g_thread_try_new("janus events thread", janus_events_thread, NULL, &error);
-		if(error != NULL) {
-			eventsenabled = FALSE;
-			g_free(server);
-			g_async_queue_unref(events);
-			JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the Events handler thread...\n",
-				error->code, error->message ? error->message : "??");
-			g_error_free(error);
-			return -1;
+		int i = 0;
+		for(i = 0; i < JANUS_EVENTS_DISPATCHERS; i++) {
+			char tname[16];
+			g_snprintf(tname, sizeof(tname), "janus events %d", i);
+			events_threads[i] = g_thread_try_new(tname, janus_events_thread, NULL, &error);
+			if(error != NULL) {
+				eventsenabled = FALSE;
+				JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the Events handler thread...\n",
+					error->code, error->message ? error->message : "??");
+				g_error_free(error);
+				janus_events_deinit();
+				return -1;
+			}
+		}
+		if(slow_handlers > 0) {
+			slow_events = janus_lfq_new(JANUS_EVENTS_QUEUE_SIZE);
+			slow_events_thread = g_thread_try_new("janus events slow", janus_events_thread, GINT_TO_POINTER(1), &error);
+			if(error != NULL) {
+				eventsenabled = FALSE;
+				JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the slow Events handler thread...\n",
+					error->code, error->message ? error->message : "??");
+				g_error_free(error);
+				janus_events_deinit();
+				return -1;
+			}
 		}
 	}
 	return 0;
@@ -68,16 +171,37 @@ int janus_events_init(gboolean enabled, char *server_name, GHashTable *handlers)
 
 void janus_events_deinit(void) {
 	eventsenabled = FALSE;
+	/* The dispatchers drain what's queued and leave once we're disabled */
+	int i = 0;
+	for(i = 0; i < JANUS_EVENTS_DISPATCHERS; i++) {
+		if(events_threads[i] != NULL) {
+			g_thread_join(events_threads[i]);
+			events_threads[i] = NULL;
+		}
+	}
+	if(slow_events_thread != NULL) {
+		g_thread_join(slow_events_thread);
+		slow_events_thread = NULL;
+	}
+	json_t *event = NULL;
 	if(events != NULL) {
-		g_async_queue_push(events, &exit_event);
+		while((event = janus_lfq_try_pop(events)) != NULL)
+			json_decref(event);
+		janus_lfq_destroy(events);
+		events = NULL;
+	}
+	if(slow_events != NULL) {
+		while((event = janus_lfq_try_pop(slow_events)) != NULL)
+			json_decref(event);
+		janus_lfq_destroy(slow_events);
+		slow_events = NULL;
 	}
-	if(events_thread != NULL) {
-		g_thread_join(events_thread);
-		events_thread = NULL;
+	if(stats_states != NULL) {
+		g_hash_table_destroy(stats_states);
+		stats_states = NULL;
 	}
-	if(events != NULL)
-		g_async_queue_unref(events);
 	g_free(server);
+	server = NULL;
 }
 
 gboolean janus_events_is_enabled(void) {
@@ -270,56 +394,107 @@ void janus_events_notify_handlers(int type, int subtype, guint64 session_id, ...
 		json_decref(event);
 		return;
 	}
-	/* Enqueue the event */
-	g_async_queue_push(events, event);
-}
-
-void *janus_events_thread(void *data) {
-	JANUS_LOG(LOG_VERB, "Joining Events handler thread\n");
-	json_t *event = NULL;
-
-	while(eventsenabled) {
-		/* Any event in queue? */
-		event = g_async_queue_pop(events);
-		if(event == &exit_event)
-			break;
-
-		/* Notify all interested handlers, increasing the event reference to make sure it's not lost because of errors */
-		int type = json_integer_value(json_object_get(event, "type"));
-		guint count = g_hash_table_size(eventhandlers);
-		GHashTableIter iter;
-		gpointer value;
-		g_hash_table_iter_init(&iter, eventhandlers);
+	/* Enqueue the event: the ring is lock-free, so this is cheap enough
+	 * to do from the media path too, no matter how many threads push */
+	if(slow_handlers > 0) {
+		/* Slow handlers get their own reference through a droppable lane:
+		 * if they can't keep up, it's their events that are lost, not the
+		 * delivery to the other handlers */
 		json_incref(event);
-		while(g_hash_table_iter_next(&iter, NULL, &value)) {
-			janus_eventhandler *e = value;
-			if(e == NULL)
-				continue;
-			if(!janus_flags_is_set(&e->events_mask, type))
-				continue;
-			if(count == 1) {
-				/* Single event handler: pass this instance directly */
-				e->incoming_event(event);
-			} else {
-				/* Multiple event handlers, that may modify the event: pass a copy */
-				json_t *copy = json_deep_copy(event);
-				e->incoming_event(copy);
-				json_decref(copy);
+		if(!janus_lfq_try_push(slow_events, event)) {
+			json_decref(event);
+			if(g_atomic_int_add(&slow_events_dropped, 1) % 10000 == 0) {
+				JANUS_LOG(LOG_WARN, "Slow event handlers can't keep up, dropping events for them (%d dropped so far)\n",
+					g_atomic_int_get(&slow_events_dropped));
 			}
 		}
+	}
+	if(fast_handlers > 0) {
+		janus_lfq_push(events, event);
+	} else {
 		json_decref(event);
+	}
+}
 
-		/* Unref the final event reference, interested handlers will have their own reference */
-		json_decref(event);
+/* Notify all the interested handlers on this dispatcher's lane about an event */
+static void janus_events_dispatch(json_t *event, gboolean slow) {
+	/* Increase the event reference to make sure it's not lost because of errors */
+	int type = json_integer_value(json_object_get(event, "type"));
+	gboolean stats = (type == JANUS_EVENT_TYPE_MEDIA &&
+		json_integer_value(json_object_get(event, "subtype")) == JANUS_EVENT_SUBTYPE_MEDIA_STATS);
+	if(type == JANUS_EVENT_TYPE_HANDLE) {
+		/* If this handle is going away, get rid of its stats state too */
+		json_t *name = json_object_get(json_object_get(event, "event"), "name");
+		if(name != NULL && json_string_value(name) != NULL && !strcasecmp(json_string_value(name), "detached"))
+			janus_events_stats_cleanup(json_integer_value(json_object_get(event, "handle_id")));
+	}
+	/* We can only pass the instance itself when there's one handler in
+	 * total: with more (even on the other lane) everyone gets a copy,
+	 * as handlers are allowed to modify the event they're given */
+	gboolean direct = ((slow ? slow_handlers : fast_handlers) == 1 &&
+		(slow ? fast_handlers : slow_handlers) == 0);
+	GHashTableIter iter;
+	gpointer value;
+	g_hash_table_iter_init(&iter, eventhandlers);
+	json_incref(event);
+	while(g_hash_table_iter_next(&iter, NULL, &value)) {
+		janus_eventhandler *e = value;
+		if(e == NULL)
+			continue;
+		if((e->slow && !slow) || (!e->slow && slow))
+			continue;
+		if(!janus_flags_is_set(&e->events_mask, type))
+			continue;
+		guint coalesced = 0;
+		if(stats && e->stats_interval > 0 && !janus_events_stats_due(e, event, &coalesced)) {
+			/* This handler is rate limiting stats events, and it's too
+			 * soon for this handle: coalesce it into the next delivery */
+			continue;
+		}
+		if(direct && coalesced == 0) {
+			/* Single event handler: pass this instance directly */
+			e->incoming_event(event);
+		} else {
+			/* Multiple event handlers, that may modify the event: pass a copy */
+			json_t *copy = json_deep_copy(event);
+			if(coalesced > 0) {
+				/* Tell the handler how many stats events this one summarizes */
+				json_t *body = json_object_get(copy, "event");
+				if(json_is_object(body))
+					json_object_set_new(body, "coalesced", json_integer(coalesced));
+			}
+			e->incoming_event(copy);
+			json_decref(copy);
+		}
 	}
+	json_decref(event);
 
-	/* Cleanup pending events */
-	while((event = g_async_queue_try_pop(events)) != NULL) {
-		if(event != &exit_event)
-			json_decref(event);
+	/* Unref the final event reference, interested handlers will have their own reference */
+	json_decref(event);
+}
+
+void *janus_events_thread(void *data) {
+	/* This thread either serves the regular handlers (as part of a small
+	 * pool consuming the same ring) or, alone, the slow ones */
+	gboolean slow = (GPOINTER_TO_INT(data) == 1);
+	janus_lfq *queue = slow ? slow_events : events;
+	JANUS_LOG(LOG_VERB, "Joining %sEvents handler thread\n", slow ? "slow " : "");
+	json_t *event = NULL;
+
+	while(TRUE) {
+		/* Any event in queue? The ring has no blocking pop, so when it's
+		 * empty we nap briefly instead of spinning on it */
+		event = janus_lfq_try_pop(queue);
+		if(event == NULL) {
+			if(!eventsenabled)
+				break;
+			g_usleep(2000);
+			continue;
+		}
+		janus_events_dispatch(event, slow);
 	}
 
-	JANUS_LOG(LOG_VERB, "Leaving Events handler thread\n");
+	JANUS_LOG(LOG_VERB, "Leaving %sEvents handler thread\n", slow ? "slow " : "");
 	return NULL;
 }
 
@@ -65,7 +65,10 @@ janus_eventhandler *create(void) {
  * mask of the events it is interested in, a \c events_mask janus_flag
  * object that must refer to the available types defined in this header.
  * The core, in fact, will refer to that mask to check whether your event
- * handler is interested in a specific event or not.
+ * handler is interested in a specific event or not. Handlers that may
+ * block when notified (e.g., because delivery to an external backend
+ * happens synchronously) can also set the \c slow flag, to be serviced
+ * on a dedicated dispatch lane that can't delay the other handlers.
  *
  * Unlike other kind of modules (transports, plugins), the \c init() method
  * here only passes the path to the configurations files folder, as event
@@ -101,7 +104,7 @@ janus_eventhandler *create(void) {
 
 
 /*! \brief Version of the API, to match the one event handler plugins were compiled against */
-#define JANUS_EVENTHANDLER_API_VERSION	3
+#define JANUS_EVENTHANDLER_API_VERSION	4
 
 /*! \brief Initialization of all event handler plugin properties to NULL
  *
@@ -203,6 +206,8 @@ static janus_eventhandler janus_fake_eventhandler_plugin =
 		.get_package = NULL,					\
 		.incoming_event = NULL,					\
 		.events_mask = JANUS_EVENT_TYPE_NONE,	\
+		.slow = FALSE,							\
+		.stats_interval = 0,					\
 		## __VA_ARGS__ }
 
 
@@ -272,6 +277,23 @@ struct janus_eventhandler {
 
 	/*! \brief Mask of events this handler is interested in, as a janus_flags object */
 	janus_flags events_mask;
+	/*! \brief Whether this handler should be considered slow
+	 * \details Handlers that may block in \c incoming_event (e.g., because
+	 * they talk to an external service) can set this flag to have their
+	 * events dispatched on a separate, droppable, lane: this way a stuck
+	 * handler can't delay delivery to the other handlers, at the price of
+	 * potentially losing events when it can't keep up with the rate */
+	gboolean slow;
+	/*! \brief Minimum interval, in milliseconds, between two media stats
+	 * events for the same handle delivered to this handler (0 means no limit)
+	 * \details Media stats are by far the most frequent event type (they're
+	 * generated at every RTCP interval, for every handle), and monitoring
+	 * rarely needs them at that rate: when an interval is set, the core
+	 * coalesces the intermediate stats events for each handle, and only
+	 * delivers the most recent one once the interval has passed, with a
+	 * \c coalesced property in the body reporting how many were skipped
+	 * (the counters in media stats are cumulative, so no totals are lost) */
+	guint stats_interval;
 };
 
 /*! \brief The hook that event handler plugins need to implement to be created from the Janus core */
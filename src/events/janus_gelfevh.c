@@ -31,6 +31,7 @@
 #include <arpa/inet.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <zlib.h>
 #include "../ip-utils.h"
 
 /* Plugin information */
@@ -86,6 +87,16 @@ janus_eventhandler *create(void) {
 /* Compression, if any */
 static gboolean compress = FALSE;
 static int compression = 6; /* Z_DEFAULT_COMPRESSION */
+/* To avoid paying a full zlib setup and teardown on every single event,
+ * we keep a deflater around and just reset it in between messages */
+static z_stream zstream;
+static int zstream_level = -1;	/* Compression level the deflater was initialized with */
+
+/* How long to keep accumulating events before writing them out, so that
+ * serialization, compression and I/O amortize over a batch (in ms, 0 means
+ * events are sent as soon as they show up, like we used to) */
+static int flush_interval = 100;
+#define JANUS_GELFEVH_MAX_BATCH	500
 
 /* Useful stuff */
 static volatile gint initialized = 0, stopping = 0;
@@ -127,7 +138,8 @@ static struct janus_json_parameter tweak_parameters[] = {
 	{"backend", JSON_STRING, 0},
 	{"port", JSON_STRING, 0},
 	{"max_gelf_msg_len", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
-	{"janus_gelfevh_socket_type", JSON_STRING, 0}
+	{"janus_gelfevh_socket_type", JSON_STRING, 0},
+	{"flush_interval", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE}
 };
 /* Error codes (for the tweaking via Admin API */
 #define JANUS_GELFEVH_ERROR_INVALID_REQUEST		411
@@ -193,6 +205,51 @@ static int janus_gelfevh_connect(void) {
 }
 
 static char compressed_text[8192];
+/* Compress a message with the reusable deflater, (re)initializing it if
+ * needed: only ever called from the handler thread, so no locking */
+static size_t janus_gelfevh_compress(char *text, size_t tlen, char *compressed, size_t zlen) {
+	if(zstream_level != compression) {
+		/* First time, or the compression factor was tweaked: set up the deflater */
+		if(zstream_level != -1)
+			deflateEnd(&zstream);
+		memset(&zstream, 0, sizeof(zstream));
+		if(deflateInit2(&zstream, compression, Z_DEFLATED, 15 | 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+			/* Fall back to the one-shot helper */
+			zstream_level = -1;
+			return janus_gzip_compress(compression, text, tlen, compressed, zlen);
+		}
+		zstream_level = compression;
+	} else if(deflateReset(&zstream) != Z_OK) {
+		deflateEnd(&zstream);
+		zstream_level = -1;
+		return janus_gzip_compress(compression, text, tlen, compressed, zlen);
+	}
+	zstream.next_in = (Bytef *)text;
+	zstream.avail_in = (uInt)tlen;
+	zstream.next_out = (Bytef *)compressed;
+	zstream.avail_out = (uInt)zlen;
+	int res = deflate(&zstream, Z_FINISH);
+	if(res != Z_STREAM_END) {
+		JANUS_LOG(LOG_ERR, "deflate error: %d\n", res);
+		return 0;
+	}
+	return zlen - zstream.avail_out;
+}
+/* Write a buffer out on the TCP socket, looping on partial writes */
+static int janus_gelfevh_send_tcp(char *buffer, int length) {
+	int out_bytes = 0;
+	while(length > 0) {
+		out_bytes = send(sockfd, buffer, length, 0);
+		if(out_bytes <= 0) {
+			JANUS_LOG(LOG_WARN, "Sending TCP message failed, dropping event(s): %d (%s)\n", errno, g_strerror(errno));
+			close(sockfd);
+			return -1;
+		}
+		buffer += out_bytes;
+		length -= out_bytes;
+	}
+	return 0;
+}
 static int janus_gelfevh_send(char *message) {
 	if(!message) {
 		JANUS_LOG(LOG_WARN, "Message is NULL, not sending to GELF!\n");
@@ -200,26 +257,14 @@ static int janus_gelfevh_send(char *message) {
 	}
 	if(transport == JANUS_GELFEVH_SOCKET_TYPE_TCP) {
 		/* TCP */
-		int out_bytes = 0;
-		int length = strlen(message) + 1;
-		char *buffer = message;
-		while(length > 0) {
-			out_bytes = send(sockfd, buffer, length, 0);
-			if(out_bytes <= 0) {
-				JANUS_LOG(LOG_WARN, "Sending TCP message failed, dropping event: %d (%s)\n", errno, g_strerror(errno));
-				close(sockfd);
-				return -1;
-			}
-			buffer += out_bytes;
-			length -= out_bytes;
-		}
+		return janus_gelfevh_send_tcp(message, strlen(message) + 1);
 	} else {
 		/* UDP chunking with headers. Check if we need to compress the data */
 		int len = strlen(message);
 		char *buf = message;
 		if(compress) {
 			size_t compressed_len = 0;
-			compressed_len = janus_gzip_compress(compression,
+			compressed_len = janus_gelfevh_compress(
 				message, strlen(message),
 				compressed_text, sizeof(compressed_text));
 			if(compressed_len == 0) {
@@ -339,6 +384,14 @@ int janus_gelfevh_init(const char *config_path) {
 				max_gelf_msg_len = atoi(item->value);
 			}
 		}
+		item = janus_config_get(config, config_general, janus_config_type_item, "flush_interval");
+		if(item && item->value) {
+			if(atoi(item->value) < 0) {
+				JANUS_LOG(LOG_WARN, "Invalid flush_interval, using default: %dms\n", flush_interval);
+			} else {
+				flush_interval = atoi(item->value);
+			}
+		}
 		/* Which events should we subscribe to? */
 		item = janus_config_get(config, config_general, janus_config_type_item, "events");
 		if(item && item->value)
@@ -420,6 +473,10 @@ void janus_gelfevh_destroy(void) {
 	g_atomic_int_set(&initialized, 0);
 	g_atomic_int_set(&stopping, 0);
 
+	if(zstream_level != -1) {
+		deflateEnd(&zstream);
+		zstream_level = -1;
+	}
 	close(sockfd);
 
 	JANUS_LOG(LOG_INFO, "%s destroyed!\n", JANUS_GELFEVH_NAME);
@@ -511,6 +568,8 @@ json_t *janus_gelfevh_handle_request(json_t *request) {
 			req_port = json_string_value(json_object_get(request, "port"));
 		if(json_object_get(request, "max_message_len"))
 			max_gelf_msg_len = json_integer_value(json_object_get(request, "max_message_len"));
+		if(json_object_get(request, "flush_interval"))
+			flush_interval = json_integer_value(json_object_get(request, "flush_interval"));
 		if(strcasecmp(json_string_value(json_object_get(request, "protocol")), "tcp") == 0) {
 			transport = JANUS_GELFEVH_SOCKET_TYPE_TCP;
 		} else if(strcasecmp(json_string_value(json_object_get(request, "protocol")), "udp") == 0) {
@@ -567,10 +626,38 @@ plugin_response:
 		}
 }
 
+/* Helper to turn an event into the GELF message to deliver */
+static char *janus_gelfevh_stringify(json_t *event) {
+	/* Add custom fields */
+	json_t *output = json_object();
+
+	int type = json_integer_value(json_object_get(event, "type"));
+	const char *short_message = janus_events_type_to_name(type);
+	json_t *microtimestamp = json_object_get(event, "timestamp");
+	if(microtimestamp && json_is_integer(microtimestamp)) {
+		double created_timestamp = (double)json_integer_value(microtimestamp) / 1000000;
+		json_object_set_new(output, "timestamp", json_real(created_timestamp));
+	} else {
+		json_object_set_new(output, "timestamp", json_real(janus_get_real_time()));
+	}
+	json_object_set(output, "host", json_object_get(event, "emitter"));
+	json_object_set_new(output, "version", json_string("1.1"));
+	json_object_set(output, "level", json_object_get(event, "type"));
+	json_object_set_new(output, "short_message", json_string(short_message));
+	json_object_set(output, "full_message", event);
+
+	char *message = json_dumps(output, json_format);
+	json_decref(output);
+	return message;
+}
+
 /* Thread to handle incoming events */
 static void *janus_gelfevh_handler(void *data) {
 	JANUS_LOG(LOG_VERB, "Joining GelfEventHandler handler thread\n");
 	json_t *event = NULL;
+	gboolean exiting = FALSE;
+	GPtrArray *batch = g_ptr_array_new();
+	GString *buffer = g_string_new(NULL);
 
 	while(g_atomic_int_get(&initialized) && !g_atomic_int_get(&stopping)) {
 		event = g_async_queue_pop(events);
@@ -578,39 +665,54 @@ static void *janus_gelfevh_handler(void *data) {
 			continue;
 		if(event == &exit_event)
 			break;
-
-		/* Handle event */
-		while(TRUE) {
-			/* Add custom fields */
-			json_t *output = json_object();
-
-			int type = json_integer_value(json_object_get(event, "type"));
-			const char *short_message = janus_events_type_to_name(type);
-			json_t *microtimestamp = json_object_get(event, "timestamp");
-			if(microtimestamp && json_is_integer(microtimestamp)) {
-				double created_timestamp = (double)json_integer_value(microtimestamp) / 1000000;
-				json_object_set_new(output, "timestamp", json_real(created_timestamp));
-			} else {
-				json_object_set_new(output, "timestamp", json_real(janus_get_real_time()));
+		g_ptr_array_add(batch, event);
+		if(flush_interval > 0) {
+			/* Keep accumulating events until the flush interval elapses, so
+			 * that serialization and I/O are amortized over the whole batch */
+			gint64 deadline = janus_get_monotonic_time() + (gint64)flush_interval*1000;
+			gint64 remaining = 0;
+			while(batch->len < JANUS_GELFEVH_MAX_BATCH &&
+					(remaining = deadline - janus_get_monotonic_time()) > 0) {
+				event = g_async_queue_timeout_pop(events, remaining);
+				if(event == NULL)
+					break;
+				if(event == &exit_event) {
+					exiting = TRUE;
+					break;
+				}
+				g_ptr_array_add(batch, event);
 			}
-			json_object_set(output, "host", json_object_get(event, "emitter"));
-			json_object_set_new(output, "version", json_string("1.1"));
-			json_object_set(output, "level", json_object_get(event, "type"));
-			json_object_set_new(output, "short_message", json_string(short_message));
-			json_object_set(output, "full_message", event);
-
-			char *message = json_dumps(output, json_format);
-			if(janus_gelfevh_send(message) < 0) {
+		}
+
+		/* Handle the batched events */
+		guint i = 0;
+		for(i = 0; i < batch->len; i++) {
+			event = (json_t *)g_ptr_array_index(batch, i);
+			char *message = janus_gelfevh_stringify(event);
+			if(message == NULL)
+				continue;
+			if(transport == JANUS_GELFEVH_SOCKET_TYPE_TCP) {
+				/* Over TCP we can collect the whole batch in a single buffer
+				 * (messages are null-delimited) and write it out in one go */
+				g_string_append_len(buffer, message, strlen(message) + 1);
+			} else if(janus_gelfevh_send(message) < 0) {
 				JANUS_LOG(LOG_WARN, "Couldn't send event to GELF, reconnect?, or event was null: %s\n", message);
 			}
-			json_decref(output);
 			free(message);
-			output = NULL;
-
-			break;
+			json_decref(event);
+		}
+		if(buffer->len > 0) {
+			if(janus_gelfevh_send_tcp(buffer->str, buffer->len) < 0) {
+				JANUS_LOG(LOG_WARN, "Couldn't send batch of %u event(s) to GELF, reconnect?\n", batch->len);
+			}
+			g_string_truncate(buffer, 0);
 		}
-		json_decref(event);
+		g_ptr_array_set_size(batch, 0);
+		if(exiting)
+			break;
 	}
+	g_ptr_array_free(batch, TRUE);
+	g_string_free(buffer, TRUE);
 	JANUS_LOG(LOG_VERB, "Leaving GELF Event handler thread\n");
 	return NULL;
 }
@@ -62,7 +62,10 @@ static janus_eventhandler janus_sampleevh =
 		.incoming_event = janus_sampleevh_incoming_event,
 		.handle_request = janus_sampleevh_handle_request,
 
-		.events_mask = JANUS_EVENT_TYPE_NONE
+		.events_mask = JANUS_EVENT_TYPE_NONE,
+		/* Delivery happens via HTTP POSTs to an external backend, which
+		 * may be arbitrarily slow: don't let that delay other handlers */
+		.slow = TRUE
 	);
 
 /* Plugin creator */
@@ -106,6 +109,29 @@ static size_t janus_sampleehv_write_data(void *buffer, size_t size, size_t nmemb
 	return size*nmemb;
 }
 
+/* Connection pool towards the backend: rather than setting up a new
+ * libcurl context for each POST, we keep a small set of persistent
+ * connections (so keep-alive, and HTTP/2 if libcurl and the backend
+ * support it), which also allows for concurrent in-flight batches.
+ * Events from the same session are always sent on the same connection,
+ * so that their relative ordering is preserved */
+#define JANUS_SAMPLEEVH_MAX_CONNECTIONS	8
+typedef struct janus_sampleevh_connection {
+	CURL *curl;						/* Reusable libcurl easy handle */
+	struct curl_slist *headers;		/* Headers of the ongoing POST, if any */
+	GQueue *pending;				/* Serialized batches waiting to be sent */
+	char *inflight;					/* Batch currently being sent (or retried) */
+	char compressed[8192];			/* Compressed version of the inflight batch */
+	size_t compressed_len;
+	gboolean busy;					/* Whether a POST is in progress on this connection */
+	int retransmit;					/* Retransmission attempts for the inflight batch */
+	gint64 retry_at;				/* Monotonic time the next retransmission is due */
+	json_t *building;				/* Batch being grouped in the current iteration */
+} janus_sampleevh_connection;
+static janus_sampleevh_connection connections[JANUS_SAMPLEEVH_MAX_CONNECTIONS];
+static int max_connections = 4;
+static CURLM *multi = NULL;
+
 
 /* Parameter validation (for tweaking via Admin API) */
 static struct janus_json_parameter request_parameters[] = {
@@ -193,10 +219,31 @@ int janus_sampleevh_init(const char *config_path) {
 						retransmissions_backoff = rb;
 					}
 				}
+				/* How many concurrent connections to the backend can we use? */
+				item = janus_config_get(config, config_general, janus_config_type_item, "max_connections");
+				if(item && item->value) {
+					int mc = atoi(item->value);
+					if(mc < 1 || mc > JANUS_SAMPLEEVH_MAX_CONNECTIONS) {
+						JANUS_LOG(LOG_WARN, "Invalid value for 'max_connections' (should be 1-%d), using default (%d)\n",
+							JANUS_SAMPLEEVH_MAX_CONNECTIONS, max_connections);
+					} else {
+						max_connections = mc;
+					}
+				}
 				/* Which events should we subscribe to? */
 				item = janus_config_get(config, config_general, janus_config_type_item, "events");
 				if(item && item->value)
 					janus_events_edit_events_mask(item->value, &janus_sampleevh.events_mask);
+				/* Should media stats be rate limited for us? */
+				item = janus_config_get(config, config_general, janus_config_type_item, "stats_interval");
+				if(item && item->value) {
+					int si = atoi(item->value);
+					if(si < 0) {
+						JANUS_LOG(LOG_WARN, "Invalid negative value for 'stats_interval', ignoring rate limit\n");
+					} else {
+						janus_sampleevh.stats_interval = si;
+					}
+				}
 				/* Is grouping of events ok? */
 				item = janus_config_get(config, config_general, janus_config_type_item, "grouping");
 				if(item && item->value)
@@ -442,24 +489,139 @@ plugin_response:
 		}
 }
 
+/* Helper to start a POST on an idle connection, if it has anything queued */
+static int janus_sampleevh_connection_start(janus_sampleevh_connection *conn) {
+	if(conn->inflight == NULL) {
+		conn->inflight = g_queue_pop_head(conn->pending);
+		if(conn->inflight == NULL)
+			return 0;
+		conn->retransmit = 0;
+	}
+	if(conn->curl == NULL) {
+		conn->curl = curl_easy_init();
+		if(conn->curl == NULL) {
+			JANUS_LOG(LOG_ERR, "Error initializing CURL context\n");
+			free(conn->inflight);
+			conn->inflight = NULL;
+			return -1;
+		}
+	}
+	CURL *curl = conn->curl;
+	janus_mutex_lock(&evh_mutex);
+	curl_easy_setopt(curl, CURLOPT_URL, backend);
+	/* Any credentials? */
+	if(backend_user != NULL && backend_pwd != NULL) {
+		curl_easy_setopt(curl, CURLOPT_USERNAME, backend_user);
+		curl_easy_setopt(curl, CURLOPT_PASSWORD, backend_pwd);
+	}
+	janus_mutex_unlock(&evh_mutex);
+	conn->headers = curl_slist_append(NULL, "Content-Type: application/json");
+	/* Check if we need to compress the data */
+	if(compress) {
+		conn->compressed_len = janus_gzip_compress(compression,
+			conn->inflight, strlen(conn->inflight),
+			conn->compressed, sizeof(conn->compressed));
+		if(conn->compressed_len == 0) {
+			JANUS_LOG(LOG_ERR, "Failed to compress event (%zu bytes)...\n", strlen(conn->inflight));
+			/* Nothing we can do... get rid of the event */
+			curl_slist_free_all(conn->headers);
+			conn->headers = NULL;
+			free(conn->inflight);
+			conn->inflight = NULL;
+			return -1;
+		}
+		conn->headers = curl_slist_append(conn->headers, "Content-Encoding: gzip");
+	}
+	curl_easy_setopt(curl, CURLOPT_HTTPHEADER, conn->headers);
+	curl_easy_setopt(curl, CURLOPT_POSTFIELDS, compress ? conn->compressed : conn->inflight);
+	curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, compress ? conn->compressed_len : strlen(conn->inflight));
+	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, janus_sampleehv_write_data);
+	/* Don't wait forever (let's say, 10 seconds) */
+	curl_easy_setopt(curl, CURLOPT_TIMEOUT, 10L);
+	/* Keep the connection to the backend alive across POSTs */
+	curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+#if LIBCURL_VERSION_NUM >= 0x072f00	/* 7.47.0 */
+	/* Negotiate HTTP/2 on TLS connections, if the backend supports it */
+	curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+#endif
+	curl_multi_add_handle(multi, curl);
+	conn->busy = TRUE;
+	return 0;
+}
+
+/* Helper invoked when a POST completes, successfully or not */
+static void janus_sampleevh_connection_done(janus_sampleevh_connection *conn, CURLcode res) {
+	curl_multi_remove_handle(multi, conn->curl);
+	conn->busy = FALSE;
+	if(conn->headers) {
+		curl_slist_free_all(conn->headers);
+		conn->headers = NULL;
+	}
+	if(res != CURLE_OK) {
+		JANUS_LOG(LOG_ERR, "Couldn't relay event to the backend: %s\n", curl_easy_strerror(res));
+		if(max_retransmissions > 0) {
+			/* Retransmissions enabled, let's try again */
+			if(conn->retransmit == max_retransmissions) {
+				conn->retransmit = 0;
+				JANUS_LOG(LOG_WARN, "Maximum number of retransmissions reached (%d), event lost...\n", max_retransmissions);
+			} else {
+				int next = retransmissions_backoff * (pow(2, conn->retransmit));
+				JANUS_LOG(LOG_WARN, "Retransmitting event in %d ms...\n", next);
+				conn->retry_at = janus_get_monotonic_time() + ((gint64)next)*1000;
+				conn->retransmit++;
+				/* Keep the inflight batch around for the retry */
+				return;
+			}
+		} else {
+			JANUS_LOG(LOG_WARN, "Retransmissions disabled, event lost...\n");
+		}
+	} else {
+		JANUS_LOG(LOG_DBG, "Event sent!\n");
+		conn->retransmit = 0;
+	}
+	free(conn->inflight);
+	conn->inflight = NULL;
+	conn->retry_at = 0;
+}
+
 /* Thread to handle incoming events */
 static void *janus_sampleevh_handler(void *data) {
 	JANUS_LOG(LOG_VERB, "Joining SampleEventHandler handler thread\n");
-	json_t *event = NULL, *output = NULL;
-	char *event_text = NULL;
-	char compressed_text[8192];
-	size_t compressed_len = 0;
+	json_t *event = NULL;
 	int count = 0, max = group_events ? 100 : 1;
-	int retransmit = 0;
-	while(g_atomic_int_get(&initialized) && !g_atomic_int_get(&stopping)) {
-		if(!retransmit) {
-			event = g_async_queue_pop(events);
-			if(event == &exit_event)
+	int i = 0;
+	gboolean exiting = FALSE;
+	/* Create the multi handle all transfers will share: the connection
+	 * cache it provides is what keeps the backend connections alive and
+	 * reused across POSTs */
+	multi = curl_multi_init();
+	if(multi == NULL) {
+		JANUS_LOG(LOG_ERR, "Error initializing CURL multi context\n");
+		return NULL;
+	}
+	for(i=0; i<max_connections; i++)
+		connections[i].pending = g_queue_new();
+	while(g_atomic_int_get(&initialized) && !g_atomic_int_get(&stopping) && !exiting) {
+		/* Check if there's anything in flight, queued, or waiting for a retry */
+		gboolean active = FALSE;
+		for(i=0; i<max_connections; i++) {
+			if(connections[i].busy || connections[i].inflight != NULL ||
+					g_queue_get_length(connections[i].pending) > 0) {
+				active = TRUE;
 				break;
-			count = 0;
-			output = NULL;
+			}
+		}
+		/* If all connections are idle we can block on the queue, otherwise
+		 * we just peek at it, so that we keep servicing the transfers */
+		if(active)
+			event = g_async_queue_timeout_pop(events, 20000);
+		else
+			event = g_async_queue_pop(events);
+		if(event == &exit_event)
+			break;
+		count = 0;
 
-			while(TRUE) {
+		while(event != NULL) {
 				/* Handle event: just for fun, let's see how long it took for us to take care of this */
 				json_t *created = json_object_get(event, "timestamp");
 				if(created && json_is_integer(created)) {
@@ -688,109 +850,92 @@ static void *janus_sampleevh_handler(void *data) {
 						JANUS_LOG(LOG_WARN, "Unknown type of event '%d'\n", type);
 						break;
 				}
-				if(!group_events) {
-					/* We're done here, we just need a single event */
-					output = event;
-					break;
+			/* Events from the same session always use the same connection,
+			 * so that their relative ordering is preserved */
+			guint64 session_id = json_integer_value(json_object_get(event, "session_id"));
+			janus_sampleevh_connection *conn = &connections[session_id % (guint64)max_connections];
+			if(!group_events) {
+				/* Serialize and queue this event on its own */
+				char *event_text = json_dumps(event, json_format);
+				json_decref(event);
+				if(event_text == NULL) {
+					JANUS_LOG(LOG_WARN, "Failed to stringify event, event lost...\n");
+				} else {
+					g_queue_push_tail(conn->pending, event_text);
 				}
+			} else {
 				/* If we got here, we're grouping */
-				if(output == NULL)
-					output = json_array();
-				json_array_append_new(output, event);
-				/* Never group more than a maximum number of events, though, or we might stay here forever */
-				count++;
-				if(count == max)
-					break;
-				event = g_async_queue_try_pop(events);
-				if(event == NULL || event == &exit_event)
-					break;
+				if(conn->building == NULL)
+					conn->building = json_array();
+				json_array_append_new(conn->building, event);
 			}
+			/* Never group more than a maximum number of events, though, or we might stay here forever */
+			count++;
+			if(count == max)
+				break;
+			event = g_async_queue_try_pop(events);
+			if(event == &exit_event) {
+				exiting = TRUE;
+				break;
+			}
+		}
 
-			/* Since this a simple plugin, it does the same for all events: so just convert to string... */
-			event_text = json_dumps(output, json_format);
+		/* Serialize the batches we just grouped */
+		for(i=0; i<max_connections; i++) {
+			if(connections[i].building == NULL)
+				continue;
+			char *event_text = json_dumps(connections[i].building, json_format);
+			json_decref(connections[i].building);
+			connections[i].building = NULL;
 			if(event_text == NULL) {
 				JANUS_LOG(LOG_WARN, "Failed to stringify event, event lost...\n");
-				/* Nothing we can do... get rid of the event */
-				json_decref(output);
-				output = NULL;
 				continue;
 			}
+			g_queue_push_tail(connections[i].pending, event_text);
 		}
-		/* Whether we just prepared the event or this is a retransmission, send it via HTTP POST */
-		CURLcode res;
-		struct curl_slist *headers = NULL;
-		CURL *curl = curl_easy_init();
-		if(curl == NULL) {
-			JANUS_LOG(LOG_ERR, "Error initializing CURL context\n");
-			goto done;
-		}
-		janus_mutex_lock(&evh_mutex);
-		curl_easy_setopt(curl, CURLOPT_URL, backend);
-		/* Any credentials? */
-		if(backend_user != NULL && backend_pwd != NULL) {
-			curl_easy_setopt(curl, CURLOPT_USERNAME, backend_user);
-			curl_easy_setopt(curl, CURLOPT_PASSWORD, backend_pwd);
-		}
-		janus_mutex_unlock(&evh_mutex);
-		headers = curl_slist_append(headers, "Content-Type: application/json");
-		/* Check if we need to compress the data */
-		if(compress) {
-			compressed_len = janus_gzip_compress(compression,
-				event_text, strlen(event_text),
-				compressed_text, sizeof(compressed_text));
-			if(compressed_len == 0) {
-				JANUS_LOG(LOG_ERR, "Failed to compress event (%zu bytes)...\n", strlen(event_text));
-				/* Nothing we can do... get rid of the event */
-				if(curl)
-					curl_easy_cleanup(curl);
-				free(event_text);
-				json_decref(output);
-				output = NULL;
+		/* Start new POSTs on the idle connections */
+		gint64 now = janus_get_monotonic_time();
+		for(i=0; i<max_connections; i++) {
+			janus_sampleevh_connection *conn = &connections[i];
+			if(conn->busy || now < conn->retry_at)
 				continue;
-			}
-			headers = curl_slist_append(headers, "Content-Encoding: gzip");
+			if(conn->inflight != NULL || g_queue_get_length(conn->pending) > 0)
+				janus_sampleevh_connection_start(conn);
 		}
-		curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-		curl_easy_setopt(curl, CURLOPT_POSTFIELDS, compress ? compressed_text : event_text);
-		curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, compress ? compressed_len : strlen(event_text));
-		curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, janus_sampleehv_write_data);
-		/* Don't wait forever (let's say, 10 seconds) */
-		curl_easy_setopt(curl, CURLOPT_TIMEOUT, 10L);
-		/* Send the request */
-		res = curl_easy_perform(curl);
-		if(res != CURLE_OK) {
-			JANUS_LOG(LOG_ERR, "Couldn't relay event to the backend: %s\n", curl_easy_strerror(res));
-			if(max_retransmissions > 0) {
-				/* Retransmissions enabled, let's try again */
-				if(retransmit == max_retransmissions) {
-					retransmit = 0;
-					JANUS_LOG(LOG_WARN, "Maximum number of retransmissions reached (%d), event lost...\n", max_retransmissions);
-				} else {
-					int next = retransmissions_backoff * (pow(2, retransmit));
-					JANUS_LOG(LOG_WARN, "Retransmitting event in %d ms...\n", next);
-					g_usleep(next*1000);
-					retransmit++;
+		/* Service the ongoing transfers */
+		int running = 0;
+		curl_multi_perform(multi, &running);
+		CURLMsg *msg = NULL;
+		int remaining = 0;
+		while((msg = curl_multi_info_read(multi, &remaining)) != NULL) {
+			if(msg->msg != CURLMSG_DONE)
+				continue;
+			for(i=0; i<max_connections; i++) {
+				if(connections[i].curl == msg->easy_handle) {
+					janus_sampleevh_connection_done(&connections[i], msg->data.result);
+					break;
 				}
-			} else {
-				JANUS_LOG(LOG_WARN, "Retransmissions disabled, event lost...\n");
 			}
-		} else {
-			JANUS_LOG(LOG_DBG, "Event sent!\n");
-			retransmit = 0;
 		}
-done:
-		/* Cleanup */
-		if(curl)
-			curl_easy_cleanup(curl);
-		if(headers)
-			curl_slist_free_all(headers);
-		if(!retransmit)
+	}
+	/* Get rid of the connection pool */
+	for(i=0; i<max_connections; i++) {
+		janus_sampleevh_connection *conn = &connections[i];
+		if(conn->busy)
+			curl_multi_remove_handle(multi, conn->curl);
+		if(conn->curl)
+			curl_easy_cleanup(conn->curl);
+		if(conn->headers)
+			curl_slist_free_all(conn->headers);
+		free(conn->inflight);
+		char *event_text = NULL;
+		while((event_text = g_queue_pop_head(conn->pending)) != NULL)
 			free(event_text);
-
-		/* Done, let's unref the event */
-		json_decref(output);
-		output = NULL;
+		g_queue_free(conn->pending);
+		conn->pending = NULL;
 	}
+	curl_multi_cleanup(multi);
+	multi = NULL;
 	JANUS_LOG(LOG_VERB, "Leaving SampleEventHandler handler thread\n");
 	return NULL;
 }
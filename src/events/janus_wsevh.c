@@ -90,6 +90,16 @@ static GQueue *events = NULL;
 static janus_mutex events_mutex = JANUS_MUTEX_INITIALIZER;
 static gboolean group_events = TRUE;
 static volatile gint events_cap_on_reconnect = 0, dropped = 0;
+/* Besides the cap we can enforce while reconnecting, we can also bound the
+ * queue at all times, so that a long backend outage doesn't eat all the
+ * memory: when the bound is hit we keep the newest events, and optionally
+ * sacrifice media statistics events before anything else, since they're
+ * periodic and losing a few is usually more acceptable than losing, e.g.,
+ * the events telling you a PeerConnection went away */
+static guint max_queued_events = 0;	/* Unlimited by default */
+static gboolean drop_stats_first = FALSE;
+static guint events_hwm = 0;	/* Protected by events_mutex, like the counters below */
+static guint64 dropped_events = 0, dropped_stats = 0;
 static void janus_wsevh_event_free(json_t *event) {
 	json_decref(event);
 }
@@ -105,7 +115,9 @@ static struct janus_json_parameter request_parameters[] = {
 static struct janus_json_parameter tweak_parameters[] = {
 	{"events", JSON_STRING, 0},
 	{"grouping", JANUS_JSON_BOOL, 0},
-	{"events_cap_on_reconnect", JANUS_JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE}
+	{"events_cap_on_reconnect", JANUS_JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
+	{"max_queued_events", JANUS_JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
+	{"drop_policy", JSON_STRING, 0}
 };
 /* Error codes (for the tweaking via Admin API */
 #define JANUS_WSEVH_ERROR_INVALID_REQUEST		411
@@ -362,6 +374,21 @@ int janus_wsevh_init(const char *config_path) {
 	if(events_cap_on_reconnect < 0)
 		events_cap_on_reconnect = 0;
 
+	/* Do we need to bound the queue at all times, and how should we drop */
+	item = janus_config_get(config, config_general, janus_config_type_item, "max_queued_events");
+	if(item && item->value) {
+		int mqe = atoi(item->value);
+		max_queued_events = mqe > 0 ? (guint)mqe : 0;
+	}
+	item = janus_config_get(config, config_general, janus_config_type_item, "drop_policy");
+	if(item && item->value) {
+		if(!strcasecmp(item->value, "stats-first")) {
+			drop_stats_first = TRUE;
+		} else if(strcasecmp(item->value, "newest")) {
+			JANUS_LOG(LOG_WARN, "Unsupported drop policy '%s', using default (newest)\n", item->value);
+		}
+	}
+
 	/* Handle the rest of the configuration, starting from the server details */
 	item = janus_config_get(config, config_general, janus_config_type_item, "backend");
 	if(item && item->value)
@@ -512,6 +539,8 @@ void janus_wsevh_incoming_event(json_t *event) {
 	json_incref(event);
 	janus_mutex_lock(&events_mutex);
 	g_queue_push_tail(events, event);
+	if(g_queue_get_length(events) > events_hwm)
+		events_hwm = g_queue_get_length(events);
 	if(g_atomic_int_get(&reconnect)) {
 		/* We're reconnecting: check if there's a cap to how many events to keep in the buffer */
 		guint cap = g_atomic_int_get(&events_cap_on_reconnect);
@@ -521,10 +550,37 @@ void janus_wsevh_incoming_event(json_t *event) {
 			while(g_queue_get_length(events) > cap) {
 				drop = g_queue_pop_head(events);
 				json_decref(drop);
+				dropped_events++;
 				g_atomic_int_inc(&dropped);
 			}
 		}
 	}
+	/* Enforce the global bound on the queue too, if one was configured */
+	if(max_queued_events > 0 && g_queue_get_length(events) > max_queued_events) {
+		json_t *drop = NULL;
+		while(g_queue_get_length(events) > max_queued_events) {
+			drop = NULL;
+			if(drop_stats_first) {
+				/* Look for the oldest media statistics event to sacrifice first */
+				GList *queued_item = events->head;
+				while(queued_item != NULL) {
+					json_t *queued = (json_t *)queued_item->data;
+					if(json_integer_value(json_object_get(queued, "type")) == JANUS_EVENT_TYPE_MEDIA) {
+						drop = queued;
+						g_queue_delete_link(events, queued_item);
+						dropped_stats++;
+						break;
+					}
+					queued_item = queued_item->next;
+				}
+			}
+			if(drop == NULL)
+				drop = g_queue_pop_head(events);
+			json_decref(drop);
+			dropped_events++;
+			g_atomic_int_inc(&dropped);
+		}
+	}
 	janus_mutex_unlock(&events_mutex);
 	/* We notify the websocket thread so that it can be handled */
 #if (LWS_LIBRARY_VERSION_MAJOR >= 3)
@@ -569,6 +625,34 @@ json_t *janus_wsevh_handle_request(json_t *request) {
 		/* Whether we should put a cap on queued events when reconnecting */
 		if(json_object_get(request, "events_cap_on_reconnect"))
 			g_atomic_int_set(&events_cap_on_reconnect, json_integer_value(json_object_get(request, "events_cap_on_reconnect")));
+		/* Whether we should bound the queue at all times, and how to drop */
+		if(json_object_get(request, "max_queued_events"))
+			max_queued_events = json_integer_value(json_object_get(request, "max_queued_events"));
+		if(json_object_get(request, "drop_policy")) {
+			const char *policy = json_string_value(json_object_get(request, "drop_policy"));
+			if(!strcasecmp(policy, "stats-first")) {
+				drop_stats_first = TRUE;
+			} else if(!strcasecmp(policy, "newest")) {
+				drop_stats_first = FALSE;
+			} else {
+				error_code = JANUS_WSEVH_ERROR_INVALID_ELEMENT;
+				g_snprintf(error_cause, 512, "Unsupported drop policy '%s'", policy);
+			}
+		}
+	} else if(!strcasecmp(request_text, "status")) {
+		/* Return the queue depth and the drop metrics */
+		json_t *response = json_object();
+		json_object_set_new(response, "result", json_integer(200));
+		janus_mutex_lock(&events_mutex);
+		json_object_set_new(response, "queued_events", json_integer(events ? g_queue_get_length(events) : 0));
+		json_object_set_new(response, "queued_events_hwm", json_integer(events_hwm));
+		json_object_set_new(response, "dropped_events", json_integer(dropped_events));
+		json_object_set_new(response, "dropped_stats_events", json_integer(dropped_stats));
+		janus_mutex_unlock(&events_mutex);
+		json_object_set_new(response, "max_queued_events", json_integer(max_queued_events));
+		json_object_set_new(response, "drop_policy", json_string(drop_stats_first ? "stats-first" : "newest"));
+		json_object_set_new(response, "connected", g_atomic_int_get(&reconnect) ? json_false() : json_true());
+		return response;
 	} else {
 		JANUS_LOG(LOG_VERB, "Unknown request '%s'\n", request_text);
 		error_code = JANUS_WSEVH_ERROR_INVALID_REQUEST;
@@ -654,9 +738,17 @@ static char *janus_wsevh_stringify_events(void) {
 	event = g_queue_peek_head(events);
 	if(event != NULL)
 		(void)g_queue_pop_head(events);
+	guint backlog = g_queue_get_length(events);
 	janus_mutex_unlock(&events_mutex);
 	if(event == NULL)
 		return NULL;
+	if(backlog > 100) {
+		/* We're draining a backlog (e.g., we just reconnected after an
+		 * outage): batch events in larger frames, rather than serializing
+		 * and writing them one (or a few) at a time, or we'll stay behind
+		 * for a long time; consumers must accept arrays when we're lagging */
+		max = group_events ? 500 : 100;
+	}
 
 	/* Start with the stringification, grouping if required */
 	count = 0;
@@ -669,7 +761,7 @@ static char *janus_wsevh_stringify_events(void) {
 			gint64 now = janus_get_monotonic_time();
 			JANUS_LOG(LOG_DBG, "Handled event after %"SCNu64" us\n", now-then);
 		}
-		if(!group_events) {
+		if(max == 1) {
 			/* We're done here, we just need a single event */
 			output = event;
 			break;
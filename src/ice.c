@@ -18,6 +18,17 @@
  * \ref protocols
  */
 
+#ifdef __linux__
+/* Needed for pthread_setaffinity_np and CPU_SET */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <sched.h>
+#include <pthread.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#endif
+
 #include <ifaddrs.h>
 #include <poll.h>
 #include <net/if.h>
@@ -38,6 +49,7 @@
 #include "apierror.h"
 #include "ip-utils.h"
 #include "events.h"
+#include "metrics.h"
 
 /* STUN server/port, if any */
 static char *janus_stun_server = NULL;
@@ -203,8 +215,22 @@ typedef struct janus_ice_static_event_loop {
 	int id;
 	GMainContext *mainctx;
 	GMainLoop *mainloop;
+	/* Timer wheel shared by all the handles attached to this loop */
+	janus_timer_wheel *wheel;
+	/* Pool of prewarmed ICE agents handles on this loop can claim, if enabled */
+	GAsyncQueue *agent_pool;
 	GThread *thread;
 	uint16_t handles;
+	/* CPU core the loop thread is pinned to, if any (-1 means no pinning) */
+	int core;
+	/* Packet throughput accounting, used for load-aware loop selection */
+	volatile gint packets;
+	gint last_packets;
+	gint64 last_check;
+	guint pps;
+	/* Whether the loop thread should leave (used by the busy-spin mode,
+	 * where the thread iterates the context rather than running the loop) */
+	volatile gint quit;
 	volatile gint destroyed;
 	janus_refcount ref;
 } janus_ice_static_event_loop;
@@ -215,15 +241,167 @@ static void janus_ice_static_event_loop_destroy(janus_ice_static_event_loop *loo
 }
 static void janus_ice_static_event_loop_free(const janus_refcount *loop_ref) {
 	janus_ice_static_event_loop *loop = janus_refcount_containerof(loop_ref, janus_ice_static_event_loop, ref);
+	if(loop->agent_pool != NULL)
+		g_async_queue_unref(loop->agent_pool);
 	g_free(loop);
 }
 static int static_event_loops = 0;
+/* Optional pool of prewarmed ICE agents: creating and configuring a NiceAgent
+ * (and binding the sockets of its stream) contributes a good chunk of the
+ * attach-to-offer latency, but since the configuration is the same for every
+ * agent we can keep a few pre-created ones around, and have handles claim one
+ * instantly when setting up a PeerConnection. Agents are permanently bound to
+ * their GMainContext at construction, though, so this is only possible when
+ * handles share the static event loops (each loop gets its own pool, topped
+ * up in the background by the loop thread itself) */
+static int janus_ice_agent_pool_size = 0;
+void janus_ice_set_agent_pool_size(int size) {
+	if(size < 0)
+		size = 0;
+	janus_ice_agent_pool_size = size;
+	if(janus_ice_agent_pool_size > 0)
+		JANUS_LOG(LOG_INFO, "Static event loops will keep a pool of %d prewarmed ICE agents each\n", janus_ice_agent_pool_size);
+}
+typedef struct janus_ice_pooled_agent {
+	NiceAgent *agent;
+	guint stream_id;
+	/* When the agent was created, to detect stale local addresses */
+	gint64 created;
+} janus_ice_pooled_agent;
+static void janus_ice_pooled_agent_free(janus_ice_pooled_agent *pooled) {
+	if(pooled == NULL)
+		return;
+	if(pooled->agent != NULL)
+		g_object_unref(pooled->agent);
+	g_free(pooled);
+}
 static gboolean allow_loop_indication = FALSE;
 static GSList *event_loops = NULL;
 static janus_mutex event_loops_mutex = JANUS_MUTEX_INITIALIZER;
+/* Optional set of CPU cores to pin the static event loop threads to,
+ * as configured via the event_loops_affinity property */
+static int *event_loops_cores = NULL;
+static guint event_loops_cores_num = 0;
+void janus_ice_set_static_event_loops_affinity(const char *cores) {
+	if(cores == NULL || *cores == '\0')
+		return;
+#ifndef __linux__
+	JANUS_LOG(LOG_WARN, "CPU affinity for event loops is only supported on Linux, ignoring '%s'\n", cores);
+	return;
+#else
+	/* Parse a comma-separated list of cores and/or ranges, e.g., "0,2,4-7" */
+	GArray *list = g_array_new(FALSE, FALSE, sizeof(int));
+	gchar **tokens = g_strsplit(cores, ",", -1);
+	int i = 0;
+	for(i=0; tokens[i] != NULL; i++) {
+		char *token = g_strstrip(tokens[i]);
+		if(*token == '\0')
+			continue;
+		char *dash = strchr(token, '-');
+		int from = -1, to = -1;
+		if(dash != NULL) {
+			*dash = '\0';
+			from = atoi(token);
+			to = atoi(dash+1);
+		} else {
+			from = to = atoi(token);
+		}
+		if(from < 0 || to < from || to >= CPU_SETSIZE) {
+			JANUS_LOG(LOG_WARN, "Invalid core or range in event loops affinity ('%s'), ignoring the whole setting\n", cores);
+			g_strfreev(tokens);
+			g_array_free(list, TRUE);
+			return;
+		}
+		int core = 0;
+		for(core=from; core<=to; core++)
+			g_array_append_val(list, core);
+	}
+	g_strfreev(tokens);
+	if(list->len == 0) {
+		g_array_free(list, TRUE);
+		return;
+	}
+	event_loops_cores_num = list->len;
+	event_loops_cores = (int *)g_array_free(list, FALSE);
+	JANUS_LOG(LOG_INFO, "Static event loop threads will be pinned to %u CPU core(s) (%s)\n",
+		event_loops_cores_num, cores);
+#endif
+}
+/* Optional busy-spin mode for the static event loops: instead of sleeping
+ * in poll and paying the wakeup latency every time media is queued, the
+ * loop threads keep iterating their context without ever blocking. This
+ * burns a full core per loop, so it only makes sense on latency-critical
+ * deployments that pin the loops to dedicated cores via the affinity setting */
+static gboolean event_loops_spin = FALSE;
+void janus_ice_set_static_event_loops_spin(gboolean spin) {
+	event_loops_spin = spin;
+	if(event_loops_spin)
+		JANUS_LOG(LOG_INFO, "Static event loop threads will busy-spin on their context\n");
+}
+/* Source we attach to every event loop context to keep the coarse monotonic
+ * clock fresh: prepare and check run once per loop iteration (right before
+ * and after polling), which is exactly the granularity the cached timestamp
+ * should have; the source itself never dispatches anything */
+static gboolean janus_ice_coarse_clock_prepare(GSource *source, gint *timeout_) {
+	janus_update_monotonic_time_coarse();
+	*timeout_ = -1;
+	return FALSE;
+}
+static gboolean janus_ice_coarse_clock_check(GSource *source) {
+	janus_update_monotonic_time_coarse();
+	return FALSE;
+}
+static gboolean janus_ice_coarse_clock_dispatch(GSource *source, GSourceFunc callback, gpointer user_data) {
+	/* Never reached, as prepare and check always return FALSE */
+	return G_SOURCE_CONTINUE;
+}
+static GSourceFuncs janus_ice_coarse_clock_funcs = {
+	janus_ice_coarse_clock_prepare,
+	janus_ice_coarse_clock_check,
+	janus_ice_coarse_clock_dispatch,
+	NULL, NULL, NULL
+};
+static void janus_ice_coarse_clock_attach(GMainContext *ctx) {
+	GSource *source = g_source_new(&janus_ice_coarse_clock_funcs, sizeof(GSource));
+	g_source_set_name(source, "coarse-clock");
+	g_source_attach(source, ctx);
+	g_source_unref(source);
+}
+/* Refresh the packets-per-second estimate of a static loop: the counter
+ * itself is atomic, as it's bumped by the loop thread when dispatching,
+ * while the estimate is only updated with the event_loops_mutex held */
+static void janus_ice_static_event_loop_update_load(janus_ice_static_event_loop *loop) {
+	gint64 now = janus_get_monotonic_time();
+	if(loop->last_check == 0) {
+		loop->last_check = now;
+		loop->last_packets = g_atomic_int_get(&loop->packets);
+		return;
+	}
+	if(now - loop->last_check < G_USEC_PER_SEC/2)
+		return;
+	gint packets = g_atomic_int_get(&loop->packets);
+	loop->pps = (guint)(((gint64)(packets - loop->last_packets)) * G_USEC_PER_SEC / (now - loop->last_check));
+	loop->last_packets = packets;
+	loop->last_check = now;
+}
 static void *janus_ice_static_event_loop_thread(void *data) {
 	janus_ice_static_event_loop *loop = data;
 	JANUS_LOG(LOG_VERB, "[loop#%d] Event loop thread started\n", loop->id);
+#ifdef __linux__
+	if(loop->core > -1) {
+		/* Pin this thread to the core it was assigned */
+		cpu_set_t cpuset;
+		CPU_ZERO(&cpuset);
+		CPU_SET(loop->core, &cpuset);
+		if(pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset) != 0) {
+			JANUS_LOG(LOG_WARN, "[loop#%d] Error pinning the event loop thread to core %d\n",
+				loop->id, loop->core);
+			loop->core = -1;
+		} else {
+			JANUS_LOG(LOG_VERB, "[loop#%d] Event loop thread pinned to core %d\n", loop->id, loop->core);
+		}
+	}
+#endif
 	if(loop->mainloop == NULL) {
 		JANUS_LOG(LOG_ERR, "[loop#%d] Invalid loop...\n", loop->id);
 		g_thread_unref(g_thread_self());
@@ -231,7 +409,13 @@ static void *janus_ice_static_event_loop_thread(void *data) {
 		return NULL;
 	}
 	JANUS_LOG(LOG_DBG, "[loop#%d] Looping...\n", loop->id);
-	g_main_loop_run(loop->mainloop);
+	if(!event_loops_spin) {
+		g_main_loop_run(loop->mainloop);
+	} else {
+		/* Busy-spin on the context with non-blocking iterations */
+		while(!g_atomic_int_get(&loop->quit))
+			(void)g_main_context_iteration(loop->mainctx, FALSE);
+	}
 	/* When the loop quits, we can unref it */
 	g_main_loop_unref(loop->mainloop);
 	g_main_context_unref(loop->mainctx);
@@ -257,8 +441,15 @@ void janus_ice_set_static_event_loops(int loops, gboolean allow_api) {
 	for(i=0; i<loops; i++) {
 		janus_ice_static_event_loop *loop = g_malloc0(sizeof(janus_ice_static_event_loop));
 		loop->id = static_event_loops;
+		/* If a set of cores was configured, assign them to loops round-robin */
+		loop->core = event_loops_cores_num > 0 ?
+			event_loops_cores[loop->id % event_loops_cores_num] : -1;
 		loop->mainctx = g_main_context_new();
 		loop->mainloop = g_main_loop_new(loop->mainctx, FALSE);
+		loop->wheel = janus_timer_wheel_create(loop->mainctx);
+		janus_ice_coarse_clock_attach(loop->mainctx);
+		if(janus_ice_agent_pool_size > 0)
+			loop->agent_pool = g_async_queue_new_full((GDestroyNotify)janus_ice_pooled_agent_free);
 		janus_refcount_init(&loop->ref, janus_ice_static_event_loop_free);
 		/* Now spawn a thread for this loop */
 		GError *error = NULL;
@@ -267,6 +458,7 @@ void janus_ice_set_static_event_loops(int loops, gboolean allow_api) {
 		janus_refcount_increase(&loop->ref);
 		loop->thread = g_thread_try_new(tname, &janus_ice_static_event_loop_thread, loop, &error);
 		if(error != NULL) {
+			janus_timer_wheel_destroy(loop->wheel);
 			g_main_loop_unref(loop->mainloop);
 			g_main_context_unref(loop->mainctx);
 			janus_refcount_decrease(&loop->ref);
@@ -293,15 +485,43 @@ json_t *janus_ice_static_event_loops_info(void) {
 	GSList *l = event_loops;
 	while(l) {
 		janus_ice_static_event_loop *loop = (janus_ice_static_event_loop *)l->data;
+		janus_ice_static_event_loop_update_load(loop);
 		json_t *info = json_object();
 		json_object_set_new(info, "id", json_integer(loop->id));
 		json_object_set_new(info, "handles", json_integer(loop->handles));
+		if(loop->core > -1)
+			json_object_set_new(info, "core", json_integer(loop->core));
+		json_object_set_new(info, "packets", json_integer(g_atomic_int_get(&loop->packets)));
+		json_object_set_new(info, "packets-per-second", json_integer(loop->pps));
 		json_array_append_new(list, info);
 		l = l->next;
 	}
 	janus_mutex_unlock(&event_loops_mutex);
 	return list;
 }
+json_t *janus_ice_static_event_loops_rebalance(void) {
+	/* Force a refresh of the load estimate of each loop, regardless of how
+	 * recently it was computed, and return the updated mapping: notice that
+	 * handles already attached to a loop are not migrated (their libnice
+	 * agent is bound to the loop context), so rebalancing only drives how
+	 * new handles will be distributed */
+	if(static_event_loops > 0) {
+		janus_mutex_lock(&event_loops_mutex);
+		gint64 now = janus_get_monotonic_time();
+		GSList *l = event_loops;
+		while(l) {
+			janus_ice_static_event_loop *loop = (janus_ice_static_event_loop *)l->data;
+			gint packets = g_atomic_int_get(&loop->packets);
+			if(loop->last_check > 0 && now > loop->last_check)
+				loop->pps = (guint)(((gint64)(packets - loop->last_packets)) * G_USEC_PER_SEC / (now - loop->last_check));
+			loop->last_packets = packets;
+			loop->last_check = now;
+			l = l->next;
+		}
+		janus_mutex_unlock(&event_loops_mutex);
+	}
+	return janus_ice_static_event_loops_info();
+}
 void janus_ice_stop_static_event_loops(void) {
 	if(static_event_loops < 1)
 		return;
@@ -310,15 +530,44 @@ void janus_ice_stop_static_event_loops(void) {
 	GSList *l = event_loops;
 	while(l) {
 		janus_ice_static_event_loop *loop = (janus_ice_static_event_loop *)l->data;
+		/* Destroy the wheel before the thread leaves, as that unrefs the context */
+		janus_timer_wheel_destroy(loop->wheel);
+		loop->wheel = NULL;
+		g_atomic_int_set(&loop->quit, 1);
 		if(loop->mainloop != NULL && g_main_loop_is_running(loop->mainloop))
 			g_main_loop_quit(loop->mainloop);
+		g_main_context_wakeup(loop->mainctx);
 		g_thread_join(loop->thread);
 		l = l->next;
 	}
 	g_slist_free_full(event_loops, (GDestroyNotify)janus_ice_static_event_loop_destroy);
+	g_free(event_loops_cores);
+	event_loops_cores = NULL;
+	event_loops_cores_num = 0;
 	janus_mutex_unlock(&event_loops_mutex);
 }
 
+/* Optional SO_BUSY_POLL budget (in microseconds) for the media sockets:
+ * when set, the kernel busy-polls the device queue for that long before
+ * sleeping, cutting the softirq wakeup latency on incoming media. Only
+ * available on Linux, and only when libnice can hand us the sockets */
+static int janus_ice_busy_poll = 0;
+void janus_ice_set_busy_poll(int busy_poll) {
+	if(busy_poll < 0) {
+		JANUS_LOG(LOG_WARN, "Invalid busy-poll budget (%d), ignoring\n", busy_poll);
+		return;
+	}
+	janus_ice_busy_poll = busy_poll;
+	if(janus_ice_busy_poll > 0) {
+#if defined(__linux__) && defined(HAVE_NICE_SOCKETS) && defined(SO_BUSY_POLL)
+		JANUS_LOG(LOG_INFO, "Media sockets will busy-poll for up to %d us\n", janus_ice_busy_poll);
+#else
+		JANUS_LOG(LOG_WARN, "Busy-polling on media sockets is not supported on this system, ignoring\n");
+		janus_ice_busy_poll = 0;
+#endif
+	}
+}
+
 /* NAT 1:1 stuff */
 static gboolean nat_1_1_enabled = FALSE;
 static gboolean keep_private_host = FALSE;
@@ -388,6 +637,92 @@ gboolean janus_ice_is_ignored(const char *ip) {
 	return FALSE;
 }
 
+/* Cached set of local addresses to gather candidates for: enumerating and
+ * filtering the interfaces costs milliseconds per handle, while the set only
+ * changes when addresses are actually added to or removed from the machine,
+ * so we only redo the getifaddrs() pass when the cache is marked as dirty
+ * (by the netlink watch, where available) or when it gets too old */
+static GSList *janus_ice_local_addresses = NULL;
+static gint64 janus_ice_local_addresses_time = 0;
+static volatile gint janus_ice_local_addresses_dirty = 1;
+static janus_mutex janus_ice_local_addresses_mutex = JANUS_MUTEX_INITIALIZER;
+/* Without a netlink watch we conservatively refresh the cache once a minute */
+#define JANUS_ICE_ADDRESSES_CACHE_TTL	(60*G_USEC_PER_SEC)
+#ifdef __linux__
+static GThread *janus_ice_addrwatch_thread = NULL;
+static volatile int janus_ice_addrwatch_fd = -1;
+static void *janus_ice_addrwatch(void *user_data) {
+	/* Block on the netlink socket: any link or address change on the
+	 * machine marks the cached set of local addresses as dirty, so that
+	 * the next handle being set up re-enumerates the interfaces */
+	char buf[4096];
+	while(janus_ice_addrwatch_fd != -1) {
+		ssize_t res = recv(janus_ice_addrwatch_fd, buf, sizeof(buf), 0);
+		if(res < 0) {
+			if(errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)
+				continue;
+			break;
+		}
+		g_atomic_int_set(&janus_ice_local_addresses_dirty, 1);
+	}
+	return NULL;
+}
+#endif
+static void janus_ice_refresh_local_addresses(void) {
+	/* Note: we're called with the cache mutex held */
+	g_slist_free_full(janus_ice_local_addresses, (GDestroyNotify)g_free);
+	janus_ice_local_addresses = NULL;
+	struct ifaddrs *ifaddr, *ifa;
+	int family, s, n;
+	char host[NI_MAXHOST];
+	if(getifaddrs(&ifaddr) == -1) {
+		JANUS_LOG(LOG_ERR, "Error getting list of interfaces... %d (%s)\n",
+			errno, g_strerror(errno));
+		return;
+	}
+	for(ifa = ifaddr, n = 0; ifa != NULL; ifa = ifa->ifa_next, n++) {
+		if(ifa->ifa_addr == NULL)
+			continue;
+		/* Skip interfaces which are not up and running */
+		if(!((ifa->ifa_flags & IFF_UP) && (ifa->ifa_flags & IFF_RUNNING)))
+			continue;
+		/* Skip loopback interfaces */
+		if(ifa->ifa_flags & IFF_LOOPBACK)
+			continue;
+		family = ifa->ifa_addr->sa_family;
+		if(family != AF_INET && family != AF_INET6)
+			continue;
+		/* We only add IPv6 addresses if support for them has been explicitly enabled */
+		if(family == AF_INET6 && !janus_ipv6_enabled)
+			continue;
+		/* Check the interface name first, we can ignore that as well: enforce list would be checked later */
+		if(janus_ice_enforce_list == NULL && ifa->ifa_name != NULL && janus_ice_is_ignored(ifa->ifa_name))
+			continue;
+		s = getnameinfo(ifa->ifa_addr,
+				(family == AF_INET) ? sizeof(struct sockaddr_in) : sizeof(struct sockaddr_in6),
+				host, NI_MAXHOST, NULL, 0, NI_NUMERICHOST);
+		if(s != 0) {
+			JANUS_LOG(LOG_ERR, "getnameinfo() failed: %s\n", gai_strerror(s));
+			continue;
+		}
+		/* Skip 0.0.0.0, :: and, unless otherwise configured, local scoped addresses  */
+		if(!strcmp(host, "0.0.0.0") || !strcmp(host, "::") || (!janus_ipv6_linklocal_enabled && !strncmp(host, "fe80:", 5)))
+			continue;
+		/* Check if this IP address is in the ignore/enforce list: the enforce list has the precedence but the ignore list can then discard candidates */
+		if(janus_ice_enforce_list != NULL) {
+			if(ifa->ifa_name != NULL && !janus_ice_is_enforced(ifa->ifa_name) && !janus_ice_is_enforced(host))
+				continue;
+		}
+		if(janus_ice_is_ignored(host))
+			continue;
+		/* Ok, save the address for the ICE agents */
+		JANUS_LOG(LOG_VERB, "Adding %s to the addresses to gather candidates for\n", host);
+		janus_ice_local_addresses = g_slist_append(janus_ice_local_addresses, g_strdup(host));
+	}
+	freeifaddrs(ifaddr);
+	janus_ice_local_addresses_time = janus_get_monotonic_time();
+}
+
 
 /* Frequency of statistics via event handlers (one second by default) */
 static int janus_ice_event_stats_period = 1;
@@ -439,18 +774,26 @@ static janus_media_type janus_media_type_from_packet(int type) {
 	}
 	return JANUS_MEDIA_UNKNOWN;
 }
+/* Size of the lock-free ring each handle queues outgoing packets on:
+ * in case a burst is larger than this, packets transparently overflow
+ * to the mutex-protected control lane, so nothing is ever lost */
+#define JANUS_ICE_QUEUED_PACKETS_SIZE	1024
 /* Janus enqueued (S)RTP/(S)RTCP packet to send */
 typedef struct janus_ice_queued_packet {
 	gint mindex;
 	char *data;
 	char *label;
 	char *protocol;
+	uint16_t pr_policy;
+	uint32_t pr_value;
 	janus_plugin_rtp_extensions extensions;
 	gint length;
 	gint type;
 	gboolean control, control_ext;
 	gboolean retransmission;
 	gboolean encrypted;
+	gboolean pooled_data;
+	gboolean traced;
 	gint64 added;
 } janus_ice_queued_packet;
 /* A few static, fake, messages we use as a trigger: e.g., to start a
@@ -469,7 +812,6 @@ typedef struct janus_ice_nacked_packet {
 	janus_ice_peerconnection_medium *medium;
 	int vindex;
 	guint16 seq_number;
-	guint source_id;
 } janus_ice_nacked_packet;
 static gboolean janus_ice_nacked_packet_cleanup(gpointer user_data) {
 	janus_ice_nacked_packet *pkt = (janus_ice_nacked_packet *)user_data;
@@ -478,7 +820,7 @@ static gboolean janus_ice_nacked_packet_cleanup(gpointer user_data) {
 		JANUS_LOG(LOG_HUGE, "[%"SCNu64"] Cleaning up NACKed packet %"SCNu16" (SSRC %"SCNu32", vindex %d)...\n",
 			pkt->medium->pc->handle->handle_id, pkt->seq_number, pkt->medium->ssrc_peer[pkt->vindex], pkt->vindex);
 		g_hash_table_remove(pkt->medium->rtx_nacked[pkt->vindex], GUINT_TO_POINTER(pkt->seq_number));
-		g_hash_table_remove(pkt->medium->pending_nacked_cleanup, GUINT_TO_POINTER(pkt->source_id));
+		g_hash_table_remove(pkt->medium->pending_nacked_cleanup, pkt);
 	}
 
 	return G_SOURCE_REMOVE;
@@ -507,6 +849,39 @@ static void janus_ice_plugin_session_free(const janus_refcount *app_handle_ref);
 static void janus_ice_peerconnection_free(const janus_refcount *pc_ref);
 static void janus_ice_peerconnection_medium_free(const janus_refcount *medium_ref);
 
+/* Size of the block backing a per-handle memory arena: the handle, its
+ * PeerConnection, the media and their RTCP contexts comfortably fit in here
+ * (with room for renegotiations), and anything that doesn't falls back to
+ * the heap, while still being owned and accounted for by the arena */
+#define JANUS_ICE_ARENA_SIZE	(32*1024)
+static void janus_ice_arena_free(const janus_refcount *arena_ref) {
+	janus_ice_arena *arena = janus_refcount_containerof(arena_ref, janus_ice_arena, ref);
+	g_slist_free_full(arena->overflow, (GDestroyNotify)g_free);
+	g_free(arena->buffer);
+	g_free(arena);
+}
+static janus_ice_arena *janus_ice_arena_create(void) {
+	janus_ice_arena *arena = g_malloc0(sizeof(janus_ice_arena));
+	arena->buffer = g_malloc0(JANUS_ICE_ARENA_SIZE);
+	arena->size = JANUS_ICE_ARENA_SIZE;
+	janus_refcount_init(&arena->ref, janus_ice_arena_free);
+	return arena;
+}
+void *janus_ice_arena_alloc(janus_ice_arena *arena, size_t size) {
+	/* Keep allocations aligned to 16 bytes */
+	size = (size + 15) & ~((size_t)15);
+	if(arena->offset + size > arena->size) {
+		/* Doesn't fit in the block, fall back to the heap but keep track of it */
+		void *chunk = g_malloc0(size);
+		arena->overflow = g_slist_prepend(arena->overflow, chunk);
+		arena->overflow_bytes += size;
+		return chunk;
+	}
+	void *chunk = arena->buffer + arena->offset;
+	arena->offset += size;
+	return chunk;
+}
+
 /* Custom GSource for outgoing traffic */
 typedef struct janus_ice_outgoing_traffic {
 	GSource parent;
@@ -515,18 +890,123 @@ typedef struct janus_ice_outgoing_traffic {
 } janus_ice_outgoing_traffic;
 static gboolean janus_ice_outgoing_rtcp_handle(gpointer user_data);
 static gboolean janus_ice_outgoing_stats_handle(gpointer user_data);
-static gboolean janus_ice_outgoing_traffic_handle(janus_ice_handle *handle, janus_ice_queued_packet *pkt);
+static void janus_ice_free_queued_packet(janus_ice_queued_packet *pkt);
+/* Number of packets to batch in a single sendmmsg-style submission when
+ * draining the outgoing queue: when disabled (batch size <= 1), each
+ * packet results in its own nice_agent_send, as it used to be. Audio is
+ * not batched by default, to avoid adding latency to voice, but that
+ * can be enabled separately */
+#define MAX_EGRESS_BATCH_SIZE	64
+static uint egress_batch_size = 0;
+static gboolean egress_batch_audio = FALSE;
+/* Batch of protected packets waiting for a single sendmmsg-style flush:
+ * it only lives for the duration of one dispatch of the traffic source */
+typedef struct janus_ice_egress_batch {
+	GOutputVector vectors[MAX_EGRESS_BATCH_SIZE];
+	NiceOutputMessage messages[MAX_EGRESS_BATCH_SIZE];
+	janus_ice_queued_packet *packets[MAX_EGRESS_BATCH_SIZE];
+	guint count;
+	/* When a crypto engine with a batched protect is in use, packets are
+	 * queued unprotected and the whole batch is protected in one engine
+	 * call at flush time (NULL means packets were protected on add) */
+	janus_srtp_engine_ctx *ectx;
+} janus_ice_egress_batch;
+static void janus_ice_egress_batch_flush(janus_ice_handle *handle, janus_ice_egress_batch *batch) {
+	if(batch == NULL || batch->count == 0)
+		return;
+	if(batch->ectx != NULL) {
+		/* Packets were queued unprotected: protect the whole batch in a single engine call */
+		char *bufs[MAX_EGRESS_BATCH_SIZE];
+		int lens[MAX_EGRESS_BATCH_SIZE];
+		guint i = 0, out = 0;
+		for(i=0; i<batch->count; i++) {
+			bufs[i] = batch->packets[i]->data;
+			lens[i] = (int)batch->vectors[i].size;
+		}
+		janus_srtp_engine_protect_batch(batch->ectx, bufs, lens, batch->count);
+		for(i=0; i<batch->count; i++) {
+			if(lens[i] < 0) {
+				/* Protection failed: drop the packet, the periodic summary will report it */
+				handle->srtp_errors_count++;
+				handle->last_srtp_error = srtp_err_status_cipher_fail;
+				janus_ice_free_queued_packet(batch->packets[i]);
+				continue;
+			}
+			batch->packets[out] = batch->packets[i];
+			batch->vectors[out].buffer = batch->packets[out]->data;
+			batch->vectors[out].size = lens[i];
+			out++;
+		}
+		batch->count = out;
+		batch->ectx = NULL;
+		if(out == 0)
+			return;
+	}
+	janus_ice_peerconnection *pc = handle->pc;
+	if(pc != NULL && handle->agent != NULL) {
+		/* A single syscall for the whole batch, via libnice's messages API */
+		gint sent = nice_agent_send_messages_nonblocking(handle->agent,
+			pc->stream_id, pc->component_id, batch->messages, batch->count, NULL, NULL);
+		if(sent < 0 || (guint)sent != batch->count) {
+			JANUS_LOG(LOG_ERR, "[%"SCNu64"] ... only sent %d batched packets? (batch was %u)\n",
+				handle->handle_id, sent, batch->count);
+		}
+	}
+	guint i = 0;
+	for(i=0; i<batch->count; i++)
+		janus_ice_free_queued_packet(batch->packets[i]);
+	batch->count = 0;
+}
+static void janus_ice_egress_batch_add(janus_ice_handle *handle, janus_ice_egress_batch *batch,
+		janus_ice_queued_packet *pkt, int length, janus_srtp_engine_ctx *ectx) {
+	if(batch->count > 0 && batch->ectx != ectx) {
+		/* This packet needs a different protection mode than the ones queued
+		 * so far (the flush protects either all of the batch or none of it):
+		 * flush them before queueing it, which is safe, as their bookkeeping
+		 * was completed when they were handled */
+		janus_ice_egress_batch_flush(handle, batch);
+	}
+	batch->ectx = ectx;
+	batch->vectors[batch->count].buffer = pkt->data;
+	batch->vectors[batch->count].size = length;
+	batch->messages[batch->count].buffers = &batch->vectors[batch->count];
+	batch->messages[batch->count].n_buffers = 1;
+	batch->packets[batch->count] = pkt;
+	batch->count++;
+	/* Note: we never flush from here, as the caller still has bookkeeping
+	 * to do on the packet it just queued (stats, retransmit buffer): the
+	 * dispatch loop checks the batch size after each packet is handled */
+}
+static gboolean janus_ice_outgoing_traffic_handle(janus_ice_handle *handle,
+	janus_ice_queued_packet *pkt, janus_ice_egress_batch *batch);
 static gboolean janus_ice_outgoing_traffic_prepare(GSource *source, gint *timeout) {
 	janus_ice_outgoing_traffic *t = (janus_ice_outgoing_traffic *)source;
-	return (g_async_queue_length(t->handle->queued_packets) > 0);
+	return (janus_lfq_length(t->handle->queued_packets) > 0);
 }
 static gboolean janus_ice_outgoing_traffic_dispatch(GSource *source, GSourceFunc callback, gpointer user_data) {
 	janus_ice_outgoing_traffic *t = (janus_ice_outgoing_traffic *)source;
 	int ret = G_SOURCE_CONTINUE;
 	janus_ice_queued_packet *pkt = NULL;
-	while((pkt = g_async_queue_try_pop(t->handle->queued_packets)) != NULL) {
-		if(janus_ice_outgoing_traffic_handle(t->handle, pkt) == G_SOURCE_REMOVE)
+	janus_ice_egress_batch batch = { .count = 0 };
+	gint count = 0;
+	while((pkt = janus_lfq_try_pop(t->handle->queued_packets)) != NULL) {
+		count++;
+		if(janus_ice_outgoing_traffic_handle(t->handle, pkt, &batch) == G_SOURCE_REMOVE)
 			ret = G_SOURCE_REMOVE;
+		/* Only flush between packets, never from within the handler: flushing
+		 * frees the queued packets, and the handler may still be reading the
+		 * one it just queued (each handled packet adds at most one slot, so
+		 * the batch can never outgrow its arrays before we check it here) */
+		if(batch.count >= egress_batch_size || batch.count >= MAX_EGRESS_BATCH_SIZE)
+			janus_ice_egress_batch_flush(t->handle, &batch);
+	}
+	/* Done draining the queue, flush any packet still waiting in the batch */
+	janus_ice_egress_batch_flush(t->handle, &batch);
+	/* If this handle lives on a static loop, track the work done there too,
+	 * so that new handles can be assigned to the least loaded loop */
+	if(count > 0 && t->handle->static_event_loop != NULL) {
+		janus_ice_static_event_loop *loop = (janus_ice_static_event_loop *)t->handle->static_event_loop;
+		g_atomic_int_add(&loop->packets, count);
 	}
 	return ret;
 }
@@ -595,6 +1075,49 @@ uint janus_get_slowlink_threshold(void) {
 	return slowlink_threshold;
 }
 
+/* Depth of a handle's outgoing packet queue beyond which we start dropping
+ * video under pressure, rather than letting a slow consumer grow the queue
+ * unbounded towards an OOM (0=unbounded, which keeps the old behaviour) */
+#define DEFAULT_QUEUED_PACKETS_LIMIT	0
+static uint queued_packets_limit = DEFAULT_QUEUED_PACKETS_LIMIT;
+void janus_set_queued_packets_limit(uint limit) {
+	queued_packets_limit = limit;
+	if(queued_packets_limit == 0)
+		JANUS_LOG(LOG_VERB, "Disabling queued-packets limit (unbounded queues)\n");
+	else
+		JANUS_LOG(LOG_VERB, "Setting queued-packets limit to %u packets\n", queued_packets_limit);
+}
+uint janus_get_queued_packets_limit(void) {
+	return queued_packets_limit;
+}
+
+/* Sampled latency tracing: when enabled, one RTP packet every N gets
+ * timestamped at the interesting stages of the pipeline, and the deltas
+ * are accumulated in small per-handle histograms. When disabled (the
+ * default), the only cost on the media path is an atomic read */
+static volatile gint janus_ice_trace_sampling = 0;
+static volatile gint janus_ice_trace_counter = 0;
+void janus_ice_set_trace_sampling(int rate) {
+	if(rate < 0)
+		rate = 0;
+	g_atomic_int_set(&janus_ice_trace_sampling, rate);
+	if(rate == 0)
+		JANUS_LOG(LOG_VERB, "Disabling sampled latency tracing\n");
+	else
+		JANUS_LOG(LOG_VERB, "Setting latency tracing sampling to 1 packet every %d\n", rate);
+}
+int janus_ice_get_trace_sampling(void) {
+	return g_atomic_int_get(&janus_ice_trace_sampling);
+}
+static void janus_ice_trace_account(janus_ice_handle *handle, int stage, gint64 latency) {
+	static const gint64 edges[JANUS_ICE_TRACE_BUCKETS-1] =
+		{ 100, 250, 500, 1000, 2000, 5000, 10000, 20000, 40000 };
+	int bucket = 0;
+	while(bucket < JANUS_ICE_TRACE_BUCKETS-1 && latency >= edges[bucket])
+		bucket++;
+	handle->trace_latency[stage][bucket]++;
+}
+
 /* Period, in milliseconds, to refer to for sending TWCC feedback */
 #define DEFAULT_TWCC_PERIOD		200
 static uint twcc_period = DEFAULT_TWCC_PERIOD;
@@ -611,6 +1134,23 @@ uint janus_get_twcc_period(void) {
 	return twcc_period;
 }
 
+void janus_set_egress_batching(uint packets, gboolean audio) {
+	if(packets > MAX_EGRESS_BATCH_SIZE) {
+		JANUS_LOG(LOG_WARN, "Capping egress batch size to %d packets\n", MAX_EGRESS_BATCH_SIZE);
+		packets = MAX_EGRESS_BATCH_SIZE;
+	}
+	egress_batch_size = packets;
+	egress_batch_audio = audio;
+	if(egress_batch_size <= 1)
+		JANUS_LOG(LOG_VERB, "Disabling egress batching\n");
+	else
+		JANUS_LOG(LOG_VERB, "Setting egress batching to %u packets (audio %s)\n",
+			egress_batch_size, egress_batch_audio ? "included" : "excluded");
+}
+uint janus_get_egress_batching(void) {
+	return egress_batch_size;
+}
+
 /* DSCP value, which we can set via libnice: it's disabled by default */
 static int dscp_ef = 0;
 void janus_set_dscp(int dscp) {
@@ -633,6 +1173,41 @@ static inline void janus_ice_free_rtp_packet(janus_rtp_packet *pkt) {
 	g_free(pkt);
 }
 
+/* Object pools for queued packets and media-sized buffers: relaying a
+ * packet used to cost two allocations (the janus_ice_queued_packet and
+ * its data buffer) and two frees, typically on different threads, which
+ * put the allocator under pressure on busy instances. Recycled objects
+ * are kept on lock-free rings instead, and we transparently fall back
+ * to the allocator when a pool is empty (or full, when releasing) */
+#define JANUS_ICE_PACKET_POOL_SIZE	4096
+#define JANUS_ICE_POOLED_BUFFER_SIZE	(1500+SRTP_MAX_TAG_LEN)
+static janus_lfq *packet_pool = NULL, *buffer_pool = NULL;
+static janus_ice_queued_packet *janus_ice_alloc_queued_packet(int buflen) {
+	janus_ice_queued_packet *pkt = packet_pool ? janus_lfq_try_pop(packet_pool) : NULL;
+	if(pkt == NULL)
+		pkt = g_malloc(sizeof(janus_ice_queued_packet));
+	pkt->data = NULL;
+	pkt->pooled_data = FALSE;
+	pkt->traced = FALSE;
+	if(buflen > 0) {
+		if(buflen <= JANUS_ICE_POOLED_BUFFER_SIZE) {
+			/* Media-sized buffer, check if we can recycle one */
+			pkt->data = buffer_pool ? janus_lfq_try_pop(buffer_pool) : NULL;
+			if(pkt->data == NULL)
+				pkt->data = g_malloc(JANUS_ICE_POOLED_BUFFER_SIZE);
+			pkt->pooled_data = TRUE;
+		} else {
+			pkt->data = g_malloc(buflen);
+		}
+	}
+	return pkt;
+}
+static void janus_ice_release_buffer(char *data, gboolean pooled) {
+	if(data == NULL)
+		return;
+	if(!pooled || buffer_pool == NULL || !janus_lfq_try_push(buffer_pool, data))
+		g_free(data);
+}
 static void janus_ice_free_queued_packet(janus_ice_queued_packet *pkt) {
 	if(pkt == NULL || pkt == &janus_ice_start_gathering ||
 			pkt == &janus_ice_add_candidates ||
@@ -643,15 +1218,26 @@ static void janus_ice_free_queued_packet(janus_ice_queued_packet *pkt) {
 			pkt == &janus_ice_data_ready) {
 		return;
 	}
-	g_free(pkt->data);
+	janus_ice_release_buffer(pkt->data, pkt->pooled_data);
 	g_free(pkt->label);
 	g_free(pkt->protocol);
-	g_free(pkt);
+	if(packet_pool == NULL || !janus_lfq_try_push(packet_pool, pkt))
+		g_free(pkt);
 }
 
 /* Minimum and maximum value, in milliseconds, for the NACK queue/retransmissions (default=200ms/1000ms) */
 #define DEFAULT_MIN_NACK_QUEUE	200
 #define DEFAULT_MAX_NACK_QUEUE	1000
+/* Number of slots (power of two) in the circular retransmission buffer each
+ * medium keeps for NACKs: packets are indexed by their RTP sequence number,
+ * so lookup on an incoming NACK is O(1) and inserting evicts at most the
+ * packet that used the same slot 512 sequence numbers ago */
+#define JANUS_ICE_RETRANSMIT_RING_SIZE	512
+/* Number of slots (power of two) in the ring of arrival timestamps we keep
+ * for transport wide cc feedback: at the default 200ms feedback period this
+ * accommodates several thousand packets per second without ever allocating
+ * on the per-packet path */
+#define JANUS_ICE_TWCC_RING_SIZE	2048
 /* Min/Max time to rate limit retransmissions of the same packet */
 #define MAX_NACK_IGNORE			DEFAULT_MAX_NACK_QUEUE*1000
 #define MIN_NACK_IGNORE			40000
@@ -686,18 +1272,15 @@ static void janus_cleanup_nack_buffer(gint64 now, janus_ice_peerconnection *pc,
 			continue;
 		if((medium->type == JANUS_MEDIA_AUDIO && !audio) || (medium->type == JANUS_MEDIA_VIDEO && !video))
 			continue;
-		if(medium->retransmit_buffer) {
-			janus_rtp_packet *p = (janus_rtp_packet *)g_queue_peek_head(medium->retransmit_buffer);
-			while(p && (!now || (now - p->created >= (gint64)medium->nack_queue_ms*1000))) {
-				/* Packet is too old, get rid of it */
-				g_queue_pop_head(medium->retransmit_buffer);
-				/* Remove from hashtable too */
-				janus_rtp_header *header = (janus_rtp_header *)p->data;
-				guint16 seq = ntohs(header->seq_number);
-				g_hash_table_remove(medium->retransmit_seqs, GUINT_TO_POINTER(seq));
-				/* Free the packet */
-				janus_ice_free_rtp_packet(p);
-				p = (janus_rtp_packet *)g_queue_peek_head(medium->retransmit_buffer);
+		if(medium->retransmit_ring) {
+			guint i = 0;
+			for(i=0; i<JANUS_ICE_RETRANSMIT_RING_SIZE; i++) {
+				janus_rtp_packet *p = medium->retransmit_ring[i];
+				if(p && (!now || (now - p->created >= (gint64)medium->nack_queue_ms*1000))) {
+					/* Packet is too old (or we're clearing the whole buffer), get rid of it */
+					medium->retransmit_ring[i] = NULL;
+					janus_ice_free_rtp_packet(p);
+				}
 			}
 		}
 	}
@@ -796,8 +1379,8 @@ static void janus_ice_clear_queued_packets(janus_ice_handle *handle) {
 		return;
 	}
 	janus_ice_queued_packet *pkt = NULL;
-	while(g_async_queue_length(handle->queued_packets) > 0) {
-		pkt = g_async_queue_try_pop(handle->queued_packets);
+	while(janus_lfq_length(handle->queued_packets) > 0) {
+		pkt = janus_lfq_try_pop(handle->queued_packets);
 		janus_ice_free_queued_packet(pkt);
 	}
 }
@@ -1056,17 +1639,82 @@ void janus_ice_init(gboolean ice_lite, gboolean ice_tcp, gboolean full_trickle,
 	/* We keep track of plugin sessions to avoid problems */
 	plugin_sessions = g_hash_table_new_full(NULL, NULL, NULL, (GDestroyNotify)janus_plugin_session_dereference);
 
+	/* Object pools for relayed packets and their buffers */
+	packet_pool = janus_lfq_new(JANUS_ICE_PACKET_POOL_SIZE);
+	buffer_pool = janus_lfq_new(JANUS_ICE_PACKET_POOL_SIZE);
+
 #ifdef HAVE_TURNRESTAPI
 	/* Initialize the TURN REST API client stack, whether we're going to use it or not */
 	janus_turnrest_init();
 #endif
 
+#ifdef __linux__
+	/* Watch for link/address changes via netlink, so that we know when the
+	 * cached set of local addresses needs to be enumerated from scratch */
+	janus_ice_addrwatch_fd = socket(AF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
+	if(janus_ice_addrwatch_fd != -1) {
+		struct sockaddr_nl sanl;
+		memset(&sanl, 0, sizeof(sanl));
+		sanl.nl_family = AF_NETLINK;
+		sanl.nl_groups = RTMGRP_LINK | RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR;
+		/* A receive timeout, so that the watch thread can notice a shutdown */
+		struct timeval timeout = { .tv_sec = 1, .tv_usec = 0 };
+		if(bind(janus_ice_addrwatch_fd, (struct sockaddr *)&sanl, sizeof(sanl)) < 0 ||
+				setsockopt(janus_ice_addrwatch_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) < 0) {
+			JANUS_LOG(LOG_WARN, "Error binding netlink socket... %d (%s)\n", errno, g_strerror(errno));
+			close(janus_ice_addrwatch_fd);
+			janus_ice_addrwatch_fd = -1;
+		} else {
+			GError *error = NULL;
+			janus_ice_addrwatch_thread = g_thread_try_new("addr watch", janus_ice_addrwatch, NULL, &error);
+			if(error != NULL) {
+				JANUS_LOG(LOG_WARN, "Got error %d (%s) trying to launch the address watch thread...\n",
+					error->code, error->message ? error->message : "??");
+				g_error_free(error);
+				close(janus_ice_addrwatch_fd);
+				janus_ice_addrwatch_fd = -1;
+			}
+		}
+	}
+	if(janus_ice_addrwatch_fd == -1)
+		JANUS_LOG(LOG_WARN, "Netlink watch unavailable, the interfaces cache will be refreshed periodically instead\n");
+#endif
 }
 
 void janus_ice_deinit(void) {
 #ifdef HAVE_TURNRESTAPI
 	janus_turnrest_deinit();
 #endif
+	/* Get rid of the object pools: we need to drain them first, as
+	 * the queues don't know how the recycled objects were allocated */
+	gpointer item = NULL;
+	if(packet_pool != NULL) {
+		while((item = janus_lfq_try_pop(packet_pool)) != NULL)
+			g_free(item);
+		janus_lfq_destroy(packet_pool);
+		packet_pool = NULL;
+	}
+	if(buffer_pool != NULL) {
+		while((item = janus_lfq_try_pop(buffer_pool)) != NULL)
+			g_free(item);
+		janus_lfq_destroy(buffer_pool);
+		buffer_pool = NULL;
+	}
+#ifdef __linux__
+	/* Stop the netlink watch, if it was running */
+	if(janus_ice_addrwatch_thread != NULL) {
+		int fd = janus_ice_addrwatch_fd;
+		janus_ice_addrwatch_fd = -1;
+		g_thread_join(janus_ice_addrwatch_thread);
+		janus_ice_addrwatch_thread = NULL;
+		close(fd);
+	}
+#endif
+	/* Get rid of the cached local addresses too */
+	janus_mutex_lock(&janus_ice_local_addresses_mutex);
+	g_slist_free_full(janus_ice_local_addresses, (GDestroyNotify)g_free);
+	janus_ice_local_addresses = NULL;
+	janus_mutex_unlock(&janus_ice_local_addresses_mutex);
 }
 
 int janus_ice_test_stun_server(janus_network_address *addr, uint16_t port,
@@ -1369,7 +2017,11 @@ janus_ice_handle *janus_ice_handle_create(void *core_session, const char *opaque
 			handle_id = 0;
 		}
 	}
-	handle = (janus_ice_handle *)g_malloc0(sizeof(janus_ice_handle));
+	/* All the fixed handle state lives in a per-handle arena, which also
+	 * gives us per-handle memory accounting for the Admin API */
+	janus_ice_arena *arena = janus_ice_arena_create();
+	handle = (janus_ice_handle *)janus_ice_arena_alloc(arena, sizeof(janus_ice_handle));
+	handle->arena = arena;
 	JANUS_LOG(LOG_INFO, "Creating new handle in session %"SCNu64": %"SCNu64"; %p %p\n", session->session_id, handle_id, core_session, handle);
 	janus_refcount_init(&handle->ref, janus_ice_handle_free);
 	janus_refcount_increase(&session->ref);
@@ -1383,7 +2035,7 @@ janus_ice_handle *janus_ice_handle_create(void *core_session, const char *opaque
 	handle->app = NULL;
 	handle->app_handle = NULL;
 	handle->queued_candidates = g_async_queue_new();
-	handle->queued_packets = g_async_queue_new();
+	handle->queued_packets = janus_lfq_new(JANUS_ICE_QUEUED_PACKETS_SIZE);
 	janus_mutex_init(&handle->mutex);
 	janus_flags_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_ALERT);
 	janus_session_handles_insert(session, handle);
@@ -1427,6 +2079,8 @@ gint janus_ice_handle_attach_plugin(void *core_session, janus_ice_handle *handle
 	if(static_event_loops == 0) {
 		handle->mainctx = g_main_context_new();
 		handle->mainloop = g_main_loop_new(handle->mainctx, FALSE);
+		handle->timer_wheel = janus_timer_wheel_create(handle->mainctx);
+		janus_ice_coarse_clock_attach(handle->mainctx);
 	} else {
 		/* We're actually using static event loops, pick one from the list */
 		if(!allow_loop_indication && loop_index > -1) {
@@ -1445,24 +2099,33 @@ gint janus_ice_handle_attach_plugin(void *core_session, janus_ice_handle *handle
 				automatic_selection = FALSE;
 				handle->mainctx = loop->mainctx;
 				handle->mainloop = loop->mainloop;
+				handle->timer_wheel = loop->wheel;
+				handle->static_event_loop = loop;
 				loop->handles++;
 				JANUS_LOG(LOG_VERB, "[%"SCNu64"] Manually added handle to loop #%d\n", handle->handle_id, loop->id);
 			}
 		}
 		if(automatic_selection) {
-			/* Pick an available loop automatically (least loaded) */
+			/* Pick an available loop automatically (least loaded): we look at
+			 * the recent packet throughput of each loop first, as the number of
+			 * handles alone says nothing about how busy they actually are, and
+			 * only fall back to the handles count to break ties */
 			int handles = -1;
+			guint pps = 0;
 			janus_ice_static_event_loop *loop = NULL;
 			GSList *l = event_loops;
 			while(l) {
 				janus_ice_static_event_loop *el = (janus_ice_static_event_loop *)l->data;
+				janus_ice_static_event_loop_update_load(el);
 				if(el->handles == 0) {
 					/* Best option, stop here */
 					loop = el;
 					break;
 				}
-				if(handles == -1 || el->handles < handles) {
+				if(loop == NULL || el->pps < pps ||
+						(el->pps == pps && el->handles < handles)) {
 					handles = el->handles;
+					pps = el->pps;
 					loop = el;
 				}
 				l = l->next;
@@ -1471,6 +2134,7 @@ gint janus_ice_handle_attach_plugin(void *core_session, janus_ice_handle *handle
 			loop->handles++;
 			handle->mainctx = loop->mainctx;
 			handle->mainloop = loop->mainloop;
+			handle->timer_wheel = loop->wheel;
 			handle->static_event_loop = loop;
 			JANUS_LOG(LOG_VERB, "[%"SCNu64"] Automatically added handle to loop #%d\n", handle->handle_id, loop->id);
 		}
@@ -1552,7 +2216,7 @@ gint janus_ice_handle_destroy(void *core_session, janus_ice_handle *handle) {
 	if(g_atomic_int_compare_and_exchange(&handle->app_handle->stopped, 0, 1)) {
 		/* Notify the plugin that the session's over (the plugin will
 		 * remove the other reference to the plugin session handle) */
-		g_async_queue_push(handle->queued_packets, &janus_ice_detach_handle);
+		janus_lfq_push(handle->queued_packets, &janus_ice_detach_handle);
 		g_main_context_wakeup(handle->mainctx);
 	}
 	/* Get rid of the handle now */
@@ -1577,8 +2241,13 @@ static void janus_ice_handle_free(const janus_refcount *handle_ref) {
 	}
 	if(handle->queued_packets != NULL) {
 		janus_ice_clear_queued_packets(handle);
-		g_async_queue_unref(handle->queued_packets);
+		janus_lfq_destroy(handle->queued_packets);
 	}
+	if(static_event_loops == 0 && handle->timer_wheel != NULL) {
+		/* The handle owns the wheel only when it has a dedicated loop */
+		janus_timer_wheel_destroy(handle->timer_wheel);
+	}
+	handle->timer_wheel = NULL;
 	if(static_event_loops == 0 && handle->mainloop != NULL) {
 		g_main_loop_unref(handle->mainloop);
 		handle->mainloop = NULL;
@@ -1598,7 +2267,9 @@ static void janus_ice_handle_free(const janus_refcount *handle_ref) {
 	g_free(handle->opaque_id);
 	g_free(handle->token);
 	janus_mutex_destroy(&handle->mutex);
-	g_free(handle);
+	/* The handle itself lives in the arena: dropping our reference frees the
+	 * whole block, unless the PeerConnection or a medium is still in there */
+	janus_refcount_decrease(&handle->arena->ref);
 }
 
 #ifdef HAVE_CLOSE_ASYNC
@@ -1626,6 +2297,14 @@ static void janus_ice_plugin_session_free(const janus_refcount *app_handle_ref)
 	g_free(app_handle);
 }
 
+void janus_ice_handle_info_invalidate(janus_ice_handle *handle) {
+	if(handle == NULL)
+		return;
+	/* Just bump the state version: the next handle_info will notice the
+	 * cached summary was built against an older version and rebuild it */
+	g_atomic_int_inc(&handle->info_version);
+}
+
 void janus_ice_webrtc_hangup(janus_ice_handle *handle, const char *reason) {
 	if(handle == NULL)
 		return;
@@ -1645,11 +2324,7 @@ void janus_ice_webrtc_hangup(janus_ice_handle *handle, const char *reason) {
 	handle->hangup_reason = reason;
 	/* Let's message the loop, we'll notify the plugin from there */
 	if(handle->queued_packets != NULL) {
-#if GLIB_CHECK_VERSION(2, 46, 0)
-		g_async_queue_push_front(handle->queued_packets, &janus_ice_hangup_peerconnection);
-#else
-		g_async_queue_push(handle->queued_packets, &janus_ice_hangup_peerconnection);
-#endif
+		janus_lfq_push_front(handle->queued_packets, &janus_ice_hangup_peerconnection);
 		g_main_context_wakeup(handle->mainctx);
 	}
 	if(g_atomic_int_dec_and_test(&handle->has_pc))
@@ -1675,6 +2350,14 @@ static void janus_ice_webrtc_free(janus_ice_handle *handle) {
 		janus_ice_peerconnection_destroy(handle->pc);
 		handle->pc = NULL;
 	}
+	/* Forget the cached keyframe checker too, a new
+	 * PeerConnection may negotiate a different codec */
+	g_atomic_pointer_set(&handle->video_keyframe_checker, NULL);
+	if(handle->info_cache != NULL) {
+		json_decref(handle->info_cache);
+		handle->info_cache = NULL;
+	}
+	janus_ice_handle_info_invalidate(handle);
 	if(handle->agent != NULL) {
 #ifdef HAVE_CLOSE_ASYNC
 		if(G_IS_OBJECT(handle->agent)) {
@@ -1740,14 +2423,15 @@ void janus_ice_peerconnection_destroy(janus_ice_peerconnection *pc) {
 		return;
 	/* Remove all media instances */
 	g_hash_table_remove_all(pc->media);
+	pc->cached_ssrc = 0;
+	pc->cached_medium = NULL;
 	g_hash_table_remove_all(pc->media_byssrc);
 	g_hash_table_remove_all(pc->media_bymid);
 	g_hash_table_remove_all(pc->media_bytype);
 	/* Get rid of the DTLS stack */
-	if(pc->dtlsrt_source != NULL) {
-		g_source_destroy(pc->dtlsrt_source);
-		g_source_unref(pc->dtlsrt_source);
-		pc->dtlsrt_source = NULL;
+	if(pc->dtlsrt_job != NULL) {
+		janus_timer_job_cancel(pc->dtlsrt_job);
+		pc->dtlsrt_job = NULL;
 	}
 	if(pc->dtls != NULL) {
 		janus_dtls_srtp_destroy(pc->dtls);
@@ -1770,10 +2454,9 @@ static void janus_ice_peerconnection_free(const janus_refcount *pc_ref) {
 	g_hash_table_destroy(pc->media_byssrc);
 	g_hash_table_destroy(pc->media_bymid);
 	g_hash_table_destroy(pc->media_bytype);
-	if(pc->icestate_source != NULL) {
-		g_source_destroy(pc->icestate_source);
-		g_source_unref(pc->icestate_source);
-		pc->icestate_source = NULL;
+	if(pc->icestate_job != NULL) {
+		janus_timer_job_cancel(pc->icestate_job);
+		pc->icestate_job = NULL;
 	}
 	g_free(pc->remote_hashing);
 	pc->remote_hashing = NULL;
@@ -1783,8 +2466,9 @@ static void janus_ice_peerconnection_free(const janus_refcount *pc_ref) {
 	pc->ruser = NULL;
 	g_free(pc->rpass);
 	pc->rpass = NULL;
-	g_slist_free_full(pc->transport_wide_received_seq_nums, (GDestroyNotify)g_free);
-	pc->transport_wide_received_seq_nums = NULL;
+	g_free(pc->twcc_arrival_times);
+	pc->twcc_arrival_times = NULL;
+	pc->twcc_have_pending = FALSE;
 	if(pc->candidates != NULL) {
 		GSList *i = NULL, *candidates = pc->candidates;
 		for(i = candidates; i; i = i->next) {
@@ -1820,6 +2504,8 @@ static void janus_ice_peerconnection_free(const janus_refcount *pc_ref) {
 	pc->remote_candidates = NULL;
 	g_free(pc->selected_pair);
 	pc->selected_pair = NULL;
+	janus_bwe_destroy(pc->bwe);
+	pc->bwe = NULL;
 	if(pc->payload_types != NULL)
 		g_hash_table_destroy(pc->payload_types);
 	pc->payload_types = NULL;
@@ -1835,14 +2521,17 @@ static void janus_ice_peerconnection_free(const janus_refcount *pc_ref) {
 	if(pc->nacks_queue != NULL)
 		g_queue_free(pc->nacks_queue);
 	janus_mutex_destroy(&pc->mutex);
-	g_free(pc);
+	/* The PeerConnection itself lives in the handle arena, just unref it */
+	janus_refcount_decrease(&pc->arena->ref);
 }
 
 janus_ice_peerconnection_medium *janus_ice_peerconnection_medium_create(janus_ice_handle *handle, janus_media_type type) {
 	if(handle == NULL || handle->pc == NULL)
 		return NULL;
 	janus_ice_peerconnection *pc = handle->pc;
-	janus_ice_peerconnection_medium *medium = g_malloc0(sizeof(janus_ice_peerconnection_medium));
+	janus_ice_peerconnection_medium *medium = janus_ice_arena_alloc(handle->arena, sizeof(janus_ice_peerconnection_medium));
+	medium->arena = handle->arena;
+	janus_refcount_increase(&medium->arena->ref);
 	medium->pc = pc;
 	medium->type = type;
 	medium->mindex = g_hash_table_size(pc->media);
@@ -1859,7 +2548,7 @@ janus_ice_peerconnection_medium *janus_ice_peerconnection_medium_create(janus_ic
 			/* Create an SSRC for RFC4588 as well */
 			medium->ssrc_rtx = janus_random_uint32();	/* FIXME Should we look for conflicts? */
 		}
-		medium->rtcp_ctx[0] = g_malloc0(sizeof(janus_rtcp_context));
+		medium->rtcp_ctx[0] = janus_ice_arena_alloc(medium->arena, sizeof(janus_rtcp_context));
 		medium->rtcp_ctx[0]->tb = (type == JANUS_MEDIA_VIDEO ? 90000 : 48000);	/* May change later */
 		medium->rtcp_ctx[0]->in_link_quality = 100;
 		medium->rtcp_ctx[0]->in_media_link_quality = 100;
@@ -1878,6 +2567,7 @@ janus_ice_peerconnection_medium *janus_ice_peerconnection_medium_create(janus_ic
 	/* For backwards compatibility, we address media by type too (e.g., first video stream) */
 	g_hash_table_insert(pc->media_bytype, GINT_TO_POINTER(type), medium);
 	janus_refcount_increase(&medium->ref);
+	janus_ice_handle_info_invalidate(handle);
 	return medium;
 }
 
@@ -1921,11 +2611,9 @@ static void janus_ice_peerconnection_medium_free(const janus_refcount *medium_re
 	medium->clock_rates = NULL;
 	g_free(medium->codec);
 	medium->codec = NULL;
-	g_free(medium->rtcp_ctx[0]);
+	/* RTCP contexts live in the handle arena, no need to free them */
 	medium->rtcp_ctx[0] = NULL;
-	g_free(medium->rtcp_ctx[1]);
 	medium->rtcp_ctx[1] = NULL;
-	g_free(medium->rtcp_ctx[2]);
 	medium->rtcp_ctx[2] = NULL;
 	if(medium->rtx_nacked[0])
 		g_hash_table_destroy(medium->rtx_nacked[0]);
@@ -1942,25 +2630,23 @@ static void janus_ice_peerconnection_medium_free(const janus_refcount *medium_re
 			gpointer val;
 			g_hash_table_iter_init(&iter, medium->pending_nacked_cleanup);
 			while(g_hash_table_iter_next(&iter, NULL, &val)) {
-				GSource *source = val;
-				g_source_destroy(source);
+				janus_timer_job *job = val;
+				janus_timer_job_cancel(job);
 			}
 		}
 		g_hash_table_destroy(medium->pending_nacked_cleanup);
 	}
 	medium->pending_nacked_cleanup = NULL;
-	if(medium->retransmit_buffer != NULL) {
-		janus_rtp_packet *p = NULL;
-		while((p = (janus_rtp_packet *)g_queue_pop_head(medium->retransmit_buffer)) != NULL) {
-			/* Remove from hashtable too */
-			janus_rtp_header *header = (janus_rtp_header *)p->data;
-			guint16 seq = ntohs(header->seq_number);
-			g_hash_table_remove(medium->retransmit_seqs, GUINT_TO_POINTER(seq));
-			/* Free the packet */
-			janus_ice_free_rtp_packet(p);
+	if(medium->retransmit_ring != NULL) {
+		guint i = 0;
+		for(i=0; i<JANUS_ICE_RETRANSMIT_RING_SIZE; i++) {
+			if(medium->retransmit_ring[i] != NULL)
+				janus_ice_free_rtp_packet(medium->retransmit_ring[i]);
 		}
-		g_queue_free(medium->retransmit_buffer);
-		g_hash_table_destroy(medium->retransmit_seqs);
+		g_free(medium->retransmit_ring);
+		g_free(medium->retransmit_ring_seqs);
+		medium->retransmit_ring = NULL;
+		medium->retransmit_ring_seqs = NULL;
 	}
 	if(medium->last_seqs[0])
 		janus_seq_list_free(&medium->last_seqs[0]);
@@ -1969,7 +2655,8 @@ static void janus_ice_peerconnection_medium_free(const janus_refcount *medium_re
 	if(medium->last_seqs[2])
 		janus_seq_list_free(&medium->last_seqs[2]);
 	janus_mutex_destroy(&medium->mutex);
-	g_free(medium);
+	/* The medium itself lives in the handle arena, just unref it */
+	janus_refcount_decrease(&medium->arena->ref);
 }
 
 /* Call plugin slow_link callback if a minimum of lost packets are detected within a second */
@@ -2070,10 +2757,9 @@ static gboolean janus_ice_check_failed(gpointer data) {
 	return TRUE;
 
 stoptimer:
-	if(pc && pc->icestate_source != NULL) {
-		g_source_destroy(pc->icestate_source);
-		g_source_unref(pc->icestate_source);
-		pc->icestate_source = NULL;
+	if(pc && pc->icestate_job != NULL) {
+		/* No need to cancel the job, we're removing it by returning FALSE */
+		pc->icestate_job = NULL;
 	}
 	return FALSE;
 }
@@ -2092,6 +2778,7 @@ static void janus_ice_cb_candidate_gathering_done(NiceAgent *agent, guint stream
 	}
 	pc->gathered = janus_get_monotonic_time();
 	pc->cdone = TRUE;
+	janus_ice_handle_info_invalidate(handle);
 	/* If we're doing full-trickle, send an event to the user too */
 	if(janus_full_trickle_enabled) {
 		/* Send a "trickle" event with completed:true to the browser */
@@ -2116,6 +2803,7 @@ static void janus_ice_cb_component_state_changed(NiceAgent *agent, guint stream_
 	}
 	guint prev_state = pc->state;
 	pc->state = state;
+	janus_ice_handle_info_invalidate(handle);
 	/* Notify event handlers */
 	if(janus_events_is_enabled()) {
 		janus_session *session = (janus_session *)handle->session;
@@ -2153,12 +2841,11 @@ static void janus_ice_cb_component_state_changed(NiceAgent *agent, guint stream_
 			answer_recv ? "received" : "pending",
 			alert_set ? "set" : "not set");
 		/* In case we haven't started a timer yet, let's do it now */
-		if(pc->icestate_source == NULL && pc->icefailed_detected == 0) {
+		if(pc->icestate_job == NULL && pc->icefailed_detected == 0) {
 			pc->icefailed_detected = janus_get_monotonic_time();
-			pc->icestate_source = g_timeout_source_new(500);
-			g_source_set_callback(pc->icestate_source, janus_ice_check_failed, pc, NULL);
-			guint id = g_source_attach(pc->icestate_source, handle->mainctx);
-			JANUS_LOG(LOG_VERB, "[%"SCNu64"] Creating ICE state check timer with ID %u\n", handle->handle_id, id);
+			pc->icestate_job = janus_timer_wheel_add(handle->timer_wheel, 500, TRUE,
+				janus_ice_check_failed, pc, NULL);
+			JANUS_LOG(LOG_VERB, "[%"SCNu64"] Creating ICE state check timer\n", handle->handle_id);
 		}
 	}
 }
@@ -2238,6 +2925,7 @@ static void janus_ice_cb_new_selected_pair (NiceAgent *agent, guint stream_id, g
 		gchar *prev_selected_pair = pc->selected_pair;
 		pc->selected_pair = g_strdup(sp);
 		g_clear_pointer(&prev_selected_pair, g_free);
+		janus_ice_handle_info_invalidate(handle);
 	}
 	/* Notify event handlers */
 	if(newpair && janus_events_is_enabled()) {
@@ -2276,11 +2964,7 @@ static void janus_ice_cb_new_selected_pair (NiceAgent *agent, guint stream_id, g
 	JANUS_LOG(LOG_VERB, "[%"SCNu64"]   Component is ready enough, starting DTLS handshake...\n", handle->handle_id);
 	pc->connected = janus_get_monotonic_time();
 	/* Start the DTLS handshake, at last */
-#if GLIB_CHECK_VERSION(2, 46, 0)
-	g_async_queue_push_front(handle->queued_packets, &janus_ice_dtls_handshake);
-#else
-	g_async_queue_push(handle->queued_packets, &janus_ice_dtls_handshake);
-#endif
+	janus_lfq_push_front(handle->queued_packets, &janus_ice_dtls_handshake);
 	g_main_context_wakeup(handle->mainctx);
 }
 
@@ -2530,6 +3214,7 @@ static void janus_ice_cb_new_remote_candidate (NiceAgent *agent, NiceCandidate *
 	if(res != 0) {
 		JANUS_LOG(LOG_ERR, "[%"SCNu64"] Failed to parse prflx candidate... (%d)\n", handle->handle_id, res);
 	}
+	janus_ice_handle_info_invalidate(handle);
 
 candidatedone:
 #ifndef HAVE_LIBNICE_TCP
@@ -2582,9 +3267,25 @@ static void janus_ice_cb_nice_recv(NiceAgent *agent, guint stream_id, guint comp
 		} else {
 			janus_rtp_header *header = (janus_rtp_header *)buf;
 			guint32 packet_ssrc = ntohl(header->ssrc);
-			/* Which medium does this refer to? Is this audio or video? */
+			/* If sampled latency tracing is on, check if this packet should be traced */
+			gint64 trace_start = 0;
+			int trace = g_atomic_int_get(&janus_ice_trace_sampling);
+			if(trace > 0 && (guint)g_atomic_int_add(&janus_ice_trace_counter, 1) % (guint)trace == 0)
+				trace_start = janus_get_monotonic_time();
+			/* Which medium does this refer to? Is this audio or video? Check
+			 * the single-entry cache first, as packets arrive in bursts from
+			 * the same source, and fall back to the hash table on a miss */
 			int video = 0, vindex = 0, rtx = 0;
-			janus_ice_peerconnection_medium *medium = g_hash_table_lookup(pc->media_byssrc, GINT_TO_POINTER(packet_ssrc));
+			janus_ice_peerconnection_medium *medium = NULL;
+			if(pc->cached_medium != NULL && pc->cached_ssrc == packet_ssrc) {
+				medium = pc->cached_medium;
+			} else {
+				medium = g_hash_table_lookup(pc->media_byssrc, GINT_TO_POINTER(packet_ssrc));
+				if(medium != NULL) {
+					pc->cached_ssrc = packet_ssrc;
+					pc->cached_medium = medium;
+				}
+			}
 			if(medium == NULL) {
 				/* SSRC not found, try the mid/rid RTP extensions if in use */
 				if(pc->mid_ext_id > 0) {
@@ -2643,6 +3344,8 @@ static void janus_ice_cb_nice_recv(NiceAgent *agent, guint stream_id, guint comp
 							if(found) {
 								g_hash_table_insert(pc->media_byssrc, GINT_TO_POINTER(packet_ssrc), medium);
 								janus_refcount_increase(&medium->ref);
+								pc->cached_ssrc = packet_ssrc;
+								pc->cached_medium = medium;
 							} else {
 								medium = NULL;
 							}
@@ -2693,7 +3396,9 @@ static void janus_ice_cb_nice_recv(NiceAgent *agent, guint stream_id, guint comp
 
 			int buflen = len;
 			srtp_err_status_t res = janus_is_webrtc_encryption_enabled() ?
-				srtp_unprotect(pc->dtls->srtp_in, buf, &buflen) : srtp_err_status_ok;
+				(pc->dtls->srtp_ectx_in != NULL ?
+					janus_srtp_engine_unprotect(pc->dtls->srtp_ectx_in, buf, &buflen) :
+					srtp_unprotect(pc->dtls->srtp_in, buf, &buflen)) : srtp_err_status_ok;
 			if(res != srtp_err_status_ok) {
 				if(res != srtp_err_status_replay_fail && res != srtp_err_status_replay_old) {
 					/* Only print the error if it's not a 'replay fail' or 'replay old' (which is probably just the result of us NACKing a packet) */
@@ -2740,16 +3445,22 @@ static void janus_ice_cb_nice_recv(NiceAgent *agent, guint stream_id, guint comp
 						}
 					}
 				}
+				/* Index all the RTP extensions with a single scan of the extension
+				 * block, so that the lookups below don't each rescan the packet:
+				 * this must happen after the rtx handling above, since that may
+				 * have rewritten an extension ID and moved the payload around */
+				janus_rtp_header_extension_index extensions;
+				janus_rtp_header_extension_parse_all(buf, buflen, &extensions);
 				/* Check if we need to handle transport wide cc */
 				if(pc->do_transport_wide_cc) {
 					guint16 transport_seq_num;
 					/* Get transport wide seq num */
-					if(janus_rtp_header_extension_parse_transport_wide_cc(buf, buflen, pc->transport_wide_cc_ext_id, &transport_seq_num) == 0) {
+					if(janus_rtp_header_extension_read_transport_wide_cc(&extensions, pc->transport_wide_cc_ext_id, &transport_seq_num) == 0) {
 						/* Get current timestamp */
 						struct timeval now;
 						gettimeofday(&now,0);
-						/* Create <seq num, time> pair */
-						janus_rtcp_transport_wide_cc_stats *stats = g_malloc0(sizeof(janus_rtcp_transport_wide_cc_stats));
+						/* Get the extended value the last received seq num maps to */
+						guint32 last_ext_seq_num = pc->transport_wide_cc_cycles<<16 | pc->transport_wide_cc_last_seq_num;
 						/* Check if we have a sequence wrap */
 						if(transport_seq_num<0x0FFF && (pc->transport_wide_cc_last_seq_num&0xFFFF)>0xF000) {
 							/* Increase cycles */
@@ -2757,14 +3468,31 @@ static void janus_ice_cb_nice_recv(NiceAgent *agent, guint stream_id, guint comp
 						}
 						/* Get extended value */
 						guint32 transport_ext_seq_num = pc->transport_wide_cc_cycles<<16 | transport_seq_num;
-						/* Store last received transport seq num */
-						pc->transport_wide_cc_last_seq_num = transport_seq_num;
-						/* Set stats values */
-						stats->transport_seq_num = transport_ext_seq_num;
-						stats->timestamp = (((guint64)now.tv_sec)*1E6+now.tv_usec);
-						/* Lock and append to received list */
+						/* Lock and store the arrival time in the ring (no allocation involved) */
 						janus_mutex_lock(&pc->mutex);
-						pc->transport_wide_received_seq_nums = g_slist_prepend(pc->transport_wide_received_seq_nums, stats);
+						if(pc->twcc_arrival_times == NULL)
+							pc->twcc_arrival_times = g_malloc0(JANUS_ICE_TWCC_RING_SIZE*sizeof(guint64));
+						if(!pc->twcc_have_pending && transport_ext_seq_num > pc->transport_wide_cc_last_feedback_seq_num) {
+							pc->twcc_first_seq_num = transport_ext_seq_num;
+							pc->twcc_have_pending = TRUE;
+						} else if(transport_ext_seq_num < pc->twcc_first_seq_num &&
+								transport_ext_seq_num > pc->transport_wide_cc_last_feedback_seq_num) {
+							/* Out of order, but not reported as lost yet */
+							pc->twcc_first_seq_num = transport_ext_seq_num;
+						}
+						if(transport_ext_seq_num > last_ext_seq_num) {
+							/* Clear the slots we're skipping over, they may hold
+							 * entries from a full ring ago */
+							guint32 gap = transport_ext_seq_num - last_ext_seq_num;
+							if(gap > JANUS_ICE_TWCC_RING_SIZE)
+								gap = JANUS_ICE_TWCC_RING_SIZE;
+							guint32 i = 0;
+							for(i=1; i<gap; i++)
+								pc->twcc_arrival_times[(last_ext_seq_num+i) & (JANUS_ICE_TWCC_RING_SIZE-1)] = 0;
+							pc->transport_wide_cc_last_seq_num = transport_seq_num;
+						}
+						pc->twcc_arrival_times[transport_ext_seq_num & (JANUS_ICE_TWCC_RING_SIZE-1)] =
+							(((guint64)now.tv_sec)*1E6+now.tv_usec);
 						janus_mutex_unlock(&pc->mutex);
 					}
 				}
@@ -2829,6 +3557,10 @@ static void janus_ice_cb_nice_recv(NiceAgent *agent, guint stream_id, guint comp
 						else if(!strcasecmp(medium->codec, "h265"))
 							medium->video_is_keyframe = &janus_h265_is_keyframe;
 					}
+					if(medium->type == JANUS_MEDIA_VIDEO && medium->video_is_keyframe != NULL) {
+						/* Cache the checker on the handle too, for the backpressure checks */
+						g_atomic_pointer_set(&handle->video_keyframe_checker, medium->video_is_keyframe);
+					}
 				}
 				/* Prepare the data to pass to the responsible plugin */
 				janus_plugin_rtp rtp = { .mindex = medium->mindex, .video = video, .buffer = buf, .length = buflen };
@@ -2837,7 +3569,7 @@ static void janus_ice_cb_nice_recv(NiceAgent *agent, guint stream_id, guint comp
 				if(!video && pc->audiolevel_ext_id != -1) {
 					gboolean vad = FALSE;
 					int level = -1;
-					if(janus_rtp_header_extension_parse_audio_level(buf, buflen,
+					if(janus_rtp_header_extension_read_audio_level(&extensions,
 							pc->audiolevel_ext_id, &vad, &level) == 0) {
 						rtp.extensions.audio_level = level;
 						rtp.extensions.audio_level_vad = vad;
@@ -2845,7 +3577,7 @@ static void janus_ice_cb_nice_recv(NiceAgent *agent, guint stream_id, guint comp
 				}
 				if(video && pc->videoorientation_ext_id != -1) {
 					gboolean c = FALSE, f = FALSE, r1 = FALSE, r0 = FALSE;
-					if(janus_rtp_header_extension_parse_video_orientation(buf, buflen,
+					if(janus_rtp_header_extension_read_video_orientation(&extensions,
 							pc->videoorientation_ext_id, &c, &f, &r1, &r0) == 0) {
 						rtp.extensions.video_rotation = 0;
 						if(r1 && r0)
@@ -2860,7 +3592,7 @@ static void janus_ice_cb_nice_recv(NiceAgent *agent, guint stream_id, guint comp
 				}
 				if(video && pc->playoutdelay_ext_id != -1) {
 					uint16_t min = 0, max = 0;
-					if(janus_rtp_header_extension_parse_playout_delay(buf, buflen,
+					if(janus_rtp_header_extension_read_playout_delay(&extensions,
 							pc->playoutdelay_ext_id, &min, &max) == 0) {
 						rtp.extensions.min_delay = min;
 						rtp.extensions.max_delay = max;
@@ -2869,7 +3601,7 @@ static void janus_ice_cb_nice_recv(NiceAgent *agent, guint stream_id, guint comp
 				if(video && pc->dependencydesc_ext_id != -1) {
 					uint8_t dd[256];
 					int len = sizeof(dd);
-					if(janus_rtp_header_extension_parse_dependency_desc(buf, buflen,
+					if(janus_rtp_header_extension_read_dependency_desc(&extensions,
 							pc->dependencydesc_ext_id, dd, &len) == 0 && len > 0) {
 						/* We copy the DD bytes as they are: it's up to plugins to parse it, if needed */
 						rtp.extensions.dd_len = len;
@@ -2878,14 +3610,14 @@ static void janus_ice_cb_nice_recv(NiceAgent *agent, guint stream_id, guint comp
 				}
 				if(pc->abs_capture_time_ext_id != -1) {
 					uint64_t abs_ts = 0;
-					if(janus_rtp_header_extension_parse_abs_capture_time(buf, buflen,
+					if(janus_rtp_header_extension_read_abs_capture_time(&extensions,
 							pc->abs_capture_time_ext_id, &abs_ts) == 0) {
 						rtp.extensions.abs_capture_ts = abs_ts;
 					}
 				}
 				if(pc->videolayers_ext_id != -1) {
 					int8_t spatial_layers = -1, temporal_layers = -1;
-					if(janus_rtp_header_extension_parse_video_layers_allocation(buf, buflen,
+					if(janus_rtp_header_extension_read_video_layers_allocation(&extensions,
 							pc->videolayers_ext_id, &spatial_layers, &temporal_layers) == 0) {
 						/* We copy the VLA bytes as they are: it's up to plugins to parse it, if needed */
 						rtp.extensions.spatial_layers = spatial_layers;
@@ -2896,13 +3628,23 @@ static void janus_ice_cb_nice_recv(NiceAgent *agent, guint stream_id, guint comp
 				janus_plugin *plugin = (janus_plugin *)handle->app;
 				if(plugin && plugin->incoming_rtp && handle->app_handle &&
 						!g_atomic_int_get(&handle->app_handle->stopped) &&
-						!g_atomic_int_get(&handle->destroyed))
-					plugin->incoming_rtp(handle->app_handle, &rtp);
+						!g_atomic_int_get(&handle->destroyed)) {
+					if(trace_start == 0) {
+						plugin->incoming_rtp(handle->app_handle, &rtp);
+					} else {
+						/* This packet is being traced: account how long it took
+						 * to get here, and how long the plugin kept it */
+						gint64 trace_handoff = janus_get_monotonic_time();
+						plugin->incoming_rtp(handle->app_handle, &rtp);
+						janus_ice_trace_account(handle, JANUS_ICE_TRACE_INGEST, trace_handoff - trace_start);
+						janus_ice_trace_account(handle, JANUS_ICE_TRACE_PLUGIN, janus_get_monotonic_time() - trace_handoff);
+					}
+				}
 				/* Restore the header for the stats (plugins may have messed with it) */
 				*header = backup;
 				/* Update stats (overall data received, and data received in the last second) */
 				if(buflen > 0) {
-					gint64 now = janus_get_monotonic_time();
+					gint64 now = janus_get_monotonic_time_coarse();
 					if(medium->in_stats.info[vindex].bytes == 0 || medium->in_stats.info[vindex].notified_lastsec) {
 						/* We either received our first packet, or we started receiving it again after missing more than a second */
 						medium->in_stats.info[vindex].notified_lastsec = FALSE;
@@ -2911,6 +3653,8 @@ static void janus_ice_cb_nice_recv(NiceAgent *agent, guint stream_id, guint comp
 					/* Overall video data for this SSRC */
 					medium->in_stats.info[vindex].packets++;
 					medium->in_stats.info[vindex].bytes += buflen;
+					janus_metrics_inc(JANUS_METRIC_RTP_PACKETS_IN);
+					janus_metrics_add(JANUS_METRIC_RTP_BYTES_IN, buflen);
 					/* Last second video data for this SSRC */
 					if(medium->in_stats.info[vindex].updated == 0)
 						medium->in_stats.info[vindex].updated = now;
@@ -2971,7 +3715,7 @@ static void janus_ice_cb_nice_recv(NiceAgent *agent, guint stream_id, guint comp
 				}
 
 				GSList *nacks = NULL;
-				gint64 now = janus_get_monotonic_time();
+				gint64 now = janus_get_monotonic_time_coarse();
 
 				if(janus_seq_in_range(new_seqn, cur_seqn, LAST_SEQS_MAX_LEN)) {
 					/* Add new seq objs forward */
@@ -3005,18 +3749,16 @@ static void janus_ice_cb_nice_recv(NiceAgent *agent, guint stream_id, guint comp
 								if(medium->rtx_nacked[vindex] == NULL)
 									medium->rtx_nacked[vindex] = g_hash_table_new(NULL, NULL);
 								g_hash_table_insert(medium->rtx_nacked[vindex], GUINT_TO_POINTER(cur_seq->seq), GINT_TO_POINTER(1));
-								/* We don't track it forever, though: add a timed source to remove it in a few seconds */
+								/* We don't track it forever, though: add a timed job to remove it in a few seconds */
 								janus_ice_nacked_packet *np = g_malloc(sizeof(janus_ice_nacked_packet));
 								np->medium = medium;
 								np->seq_number = cur_seq->seq;
 								np->vindex = vindex;
 								if(medium->pending_nacked_cleanup == NULL)
 									medium->pending_nacked_cleanup = g_hash_table_new(NULL, NULL);
-								GSource *timeout_source = g_timeout_source_new_seconds(5);
-								g_source_set_callback(timeout_source, janus_ice_nacked_packet_cleanup, np, (GDestroyNotify)g_free);
-								np->source_id = g_source_attach(timeout_source, handle->mainctx);
-								g_source_unref(timeout_source);
-								g_hash_table_insert(medium->pending_nacked_cleanup, GUINT_TO_POINTER(np->source_id), timeout_source);
+								janus_timer_job *cleanup_job = janus_timer_wheel_add(handle->timer_wheel, 5000, FALSE,
+									janus_ice_nacked_packet_cleanup, np, (GDestroyNotify)g_free);
+								g_hash_table_insert(medium->pending_nacked_cleanup, np, cleanup_job);
 							}
 						} else if(cur_seq->state == SEQ_NACKED  && now - cur_seq->ts > SEQ_NACKED_WAIT) {
 							JANUS_LOG(LOG_HUGE, "[%"SCNu64"] Missed sequence number %"SCNu16" (%s stream #%d), sending 2nd NACK\n",
@@ -3054,6 +3796,7 @@ static void janus_ice_cb_nice_recv(NiceAgent *agent, guint stream_id, guint comp
 					/* Update stats */
 					medium->nack_sent_recent_cnt += nacks_count;
 					medium->out_stats.info[vindex].nacks += nacks_count;
+					janus_metrics_add(JANUS_METRIC_NACKS_OUT, nacks_count);
 				}
 				if(medium->nack_sent_recent_cnt &&
 						(now - medium->nack_sent_log_ts) > 5*G_USEC_PER_SEC) {
@@ -3076,7 +3819,9 @@ static void janus_ice_cb_nice_recv(NiceAgent *agent, guint stream_id, guint comp
 		} else {
 			int buflen = len;
 			srtp_err_status_t res = janus_is_webrtc_encryption_enabled() ?
-				srtp_unprotect_rtcp(pc->dtls->srtp_in, buf, &buflen) : srtp_err_status_ok;
+				(pc->dtls->srtp_ectx_in != NULL ?
+					janus_srtp_engine_unprotect_rtcp(pc->dtls->srtp_ectx_in, buf, &buflen) :
+					srtp_unprotect_rtcp(pc->dtls->srtp_in, buf, &buflen)) : srtp_err_status_ok;
 			if(res != srtp_err_status_ok) {
 				JANUS_LOG(LOG_ERR, "[%"SCNu64"]     SRTCP unprotect error: %s (len=%d-->%d)\n", handle->handle_id, janus_srtp_error_str(res), len, buflen);
 			} else {
@@ -3084,8 +3829,17 @@ static void janus_ice_cb_nice_recv(NiceAgent *agent, guint stream_id, guint comp
 				if(g_atomic_int_get(&handle->dump_packets))
 					janus_text2pcap_dump(handle->text2pcap, JANUS_TEXT2PCAP_RTCP, TRUE, buf, buflen,
 						"[session=%"SCNu64"][handle=%"SCNu64"]", session->session_id, handle->handle_id);
+				/* Inspect the compound packet once, collecting everything we'll need */
+				janus_rtcp_summary summary;
+				if(pc->nacks_queue == NULL)
+					pc->nacks_queue = g_queue_new();
+				GQueue *nacks = pc->nacks_queue;
+				if(janus_rtcp_inspect(buf, buflen, &summary, nacks) < 0) {
+					/* Drop the packet if it doesn't look like a valid compound */
+					return;
+				}
 				/* Check if there's an RTCP BYE: in case, let's log it */
-				if(janus_rtcp_has_bye(buf, buflen)) {
+				if(summary.has_bye) {
 					/* Note: we used to use this as a trigger to close the PeerConnection, but not anymore
 					 * Discussion here, https://groups.google.com/forum/#!topic/meetecho-janus/4XtfbYB7Jvc */
 					JANUS_LOG(LOG_VERB, "[%"SCNu64"] Got RTCP BYE on stream %u (component %u)\n", handle->handle_id, stream_id, component_id);
@@ -3093,13 +3847,13 @@ static void janus_ice_cb_nice_recv(NiceAgent *agent, guint stream_id, guint comp
 				/* Is this audio or video? */
 				int video = 0, vindex = 0;
 				/* Bundled streams, should we check the SSRCs? */
-				guint32 rtcp_ssrc = janus_rtcp_get_sender_ssrc(buf, buflen);
+				guint32 rtcp_ssrc = summary.sender_ssrc;
 				janus_ice_peerconnection_medium *medium = g_hash_table_lookup(pc->media_byssrc, GINT_TO_POINTER(rtcp_ssrc));
 				if(medium == NULL) {
 					/* We don't know the remote SSRC: this can happen for recvonly clients
 					 * (see https://groups.google.com/forum/#!topic/discuss-webrtc/5yuZjV7lkNc)
 					 * Check the local SSRC, compare it to what we have */
-					rtcp_ssrc = janus_rtcp_get_receiver_ssrc(buf, buflen);
+					rtcp_ssrc = summary.receiver_ssrc;
 					medium = g_hash_table_lookup(pc->media_byssrc, GINT_TO_POINTER(rtcp_ssrc));
 					if(medium == NULL) {
 						if(rtcp_ssrc > 0) {
@@ -3124,6 +3878,8 @@ static void janus_ice_cb_nice_recv(NiceAgent *agent, guint stream_id, guint comp
 
 				/* Let's process this RTCP (compound?) packet, and update the RTCP context for this stream in case */
 				rtcp_context *rtcp_ctx = medium->rtcp_ctx[vindex];
+				if(rtcp_ctx != NULL)
+					rtcp_ctx->bwe = pc->bwe;
 				uint32_t rtt = rtcp_ctx ? rtcp_ctx->rtt : 0;
 				if(janus_rtcp_parse(rtcp_ctx, buf, buflen) < 0) {
 					/* Drop the packet if the parsing function returns with an error */
@@ -3146,31 +3902,31 @@ static void janus_ice_cb_nice_recv(NiceAgent *agent, guint stream_id, guint comp
 					medium->nack_queue_ms = mavg;
 				}
 				JANUS_LOG(LOG_HUGE, "[%"SCNu64"] Got %s RTCP (%d bytes)\n", handle->handle_id, video ? "video" : "audio", buflen);
+				janus_metrics_inc(JANUS_METRIC_RTCP_PACKETS_IN);
 				/* See if there's any REMB bitrate to track */
-				uint32_t bitrate = janus_rtcp_get_remb(buf, buflen);
-				if(bitrate > 0)
-					pc->remb_bitrate = bitrate;
+				if(summary.remb_bitrate > 0)
+					pc->remb_bitrate = summary.remb_bitrate;
 
 				/* Now let's see if there are any NACKs to handle */
-				gint64 now = janus_get_monotonic_time();
-				if(pc->nacks_queue == NULL)
-					pc->nacks_queue = g_queue_new();
-				GQueue *nacks = pc->nacks_queue;
-				janus_rtcp_get_nacks(buf, buflen, nacks);
+				gint64 now = janus_get_monotonic_time_coarse();
 				guint nacks_count = g_queue_get_length(nacks);
 				if(nacks_count && medium->do_nacks) {
 					/* Handle NACK */
 					JANUS_LOG(LOG_HUGE, "[%"SCNu64"]     Just got some NACKS (%d) we should handle...\n", handle->handle_id, nacks_count);
-					GHashTable *retransmit_seqs = medium->retransmit_seqs;
-					GQueue *queue = (retransmit_seqs != NULL ? nacks : NULL);
+					GQueue *queue = (medium->retransmit_ring != NULL ? nacks : NULL);
 					int retransmits_cnt = 0;
 					janus_mutex_lock(&medium->mutex);
 					while(queue != NULL && g_queue_get_length(queue) > 0) {
 						unsigned int seqnr = GPOINTER_TO_UINT(g_queue_pop_tail(queue));
 						JANUS_LOG(LOG_DBG, "[%"SCNu64"]   >> %u\n", handle->handle_id, seqnr);
 						int in_rb = 0;
-						/* Check if we have the packet */
-						janus_rtp_packet *p = g_hash_table_lookup(retransmit_seqs, GUINT_TO_POINTER(seqnr));
+						/* Check if we have the packet: the slot may have been
+						 * reused by a more recent packet, or hold a stale one */
+						guint16 slot = (guint16)seqnr & (JANUS_ICE_RETRANSMIT_RING_SIZE-1);
+						janus_rtp_packet *p = medium->retransmit_ring[slot];
+						if(p != NULL && (medium->retransmit_ring_seqs[slot] != (guint16)seqnr ||
+								now - p->created >= (gint64)medium->nack_queue_ms*1000))
+							p = NULL;
 						if(p == NULL) {
 							JANUS_LOG(LOG_HUGE, "[%"SCNu64"]   >> >> Can't retransmit packet %u, we don't have it...\n", handle->handle_id, seqnr);
 						} else {
@@ -3192,9 +3948,8 @@ static void janus_ice_cb_nice_recv(NiceAgent *agent, guint stream_id, guint comp
 							}
 							retransmits_cnt++;
 							/* Enqueue it */
-							janus_ice_queued_packet *pkt = g_malloc(sizeof(janus_ice_queued_packet));
+							janus_ice_queued_packet *pkt = janus_ice_alloc_queued_packet(p->length+SRTP_MAX_TAG_LEN);
 							pkt->mindex = medium->mindex;
-							pkt->data = g_malloc(p->length+SRTP_MAX_TAG_LEN);
 							memcpy(pkt->data, p->data, p->length);
 							pkt->length = p->length;
 							pkt->type = video ? JANUS_ICE_PACKET_VIDEO : JANUS_ICE_PACKET_AUDIO;
@@ -3204,7 +3959,7 @@ static void janus_ice_cb_nice_recv(NiceAgent *agent, guint stream_id, guint comp
 							pkt->retransmission = TRUE;
 							pkt->label = NULL;
 							pkt->protocol = NULL;
-							pkt->added = janus_get_monotonic_time();
+							pkt->added = janus_get_monotonic_time_coarse();
 							/* What to send and how depends on whether we're doing RFC4588 or not */
 							if(!video || !janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_RFC4588_RTX)) {
 								/* We're not: just clarify the packet was already encrypted before */
@@ -3219,11 +3974,7 @@ static void janus_ice_cb_nice_recv(NiceAgent *agent, guint stream_id, guint comp
 								header->seq_number = htons(medium->rtx_seq_number);
 							}
 							if(handle->queued_packets != NULL) {
-#if GLIB_CHECK_VERSION(2, 46, 0)
-								g_async_queue_push_front(handle->queued_packets, pkt);
-#else
-								g_async_queue_push(handle->queued_packets, pkt);
-#endif
+								janus_lfq_push_front(handle->queued_packets, pkt);
 								g_main_context_wakeup(handle->mainctx);
 							} else {
 								janus_ice_free_queued_packet(pkt);
@@ -3235,10 +3986,12 @@ static void janus_ice_cb_nice_recv(NiceAgent *agent, guint stream_id, guint comp
 						g_queue_pop_tail(queue);
 					}
 					medium->retransmit_recent_cnt += retransmits_cnt;
+					janus_metrics_add(JANUS_METRIC_RETRANSMISSIONS, retransmits_cnt);
 					/* FIXME Remove the NACK compound packet, we've handled it */
 					buflen = janus_rtcp_remove_nacks(buf, buflen);
 					/* Update stats */
 					medium->in_stats.info[vindex].nacks += nacks_count;
+					janus_metrics_add(JANUS_METRIC_NACKS_IN, nacks_count);
 					janus_mutex_unlock(&medium->mutex);
 				}
 				if(medium->retransmit_recent_cnt &&
@@ -3445,6 +4198,7 @@ static int janus_ice_candidate_to_string(janus_ice_handle *handle, NiceCandidate
 	if(log_candidate) {
 		/* Save for the summary, in case we need it */
 		pc->local_candidates = g_slist_append(pc->local_candidates, g_strdup(buffer));
+		janus_ice_handle_info_invalidate(handle);
 		/* Notify event handlers */
 		if(janus_events_is_enabled()) {
 			janus_session *session = (janus_session *)handle->session;
@@ -3518,11 +4272,7 @@ void janus_ice_add_remote_candidate(janus_ice_handle *handle, NiceCandidate *c)
 	if(handle->queued_candidates != NULL)
 		g_async_queue_push(handle->queued_candidates, c);
 	if(handle->queued_packets != NULL) {
-#if GLIB_CHECK_VERSION(2, 46, 0)
-		g_async_queue_push_front(handle->queued_packets, &janus_ice_add_candidates);
-#else
-		g_async_queue_push(handle->queued_packets, &janus_ice_add_candidates);
-#endif
+		janus_lfq_push_front(handle->queued_packets, &janus_ice_add_candidates);
 		g_main_context_wakeup(handle->mainctx);
 	}
 }
@@ -3559,16 +4309,100 @@ void janus_ice_setup_remote_candidates(janus_ice_handle *handle, guint stream_id
 		gsc = gsc->next;
 	}
 	if(handle->queued_packets != NULL) {
-#if GLIB_CHECK_VERSION(2, 46, 0)
-		g_async_queue_push_front(handle->queued_packets, &janus_ice_add_candidates);
-#else
-		g_async_queue_push(handle->queued_packets, &janus_ice_add_candidates);
-#endif
+		janus_lfq_push_front(handle->queued_packets, &janus_ice_add_candidates);
 		g_main_context_wakeup(handle->mainctx);
 	}
 	pc->process_started = TRUE;
 }
 
+/* Helper to create and configure a new NiceAgent on the given context: all
+ * the configuration is driven by static properties, which is what allows the
+ * prewarmed agent pool to create agents ahead of time. The stream (and so the
+ * local sockets) is created here as well; per-handle aspects like controlling
+ * mode, signals, TURN credentials and TOS are up to the caller */
+static NiceAgent *janus_ice_create_agent(GMainContext *mainctx, guint *stream_id) {
+	NiceAgent *agent = g_object_new(NICE_TYPE_AGENT,
+		"compatibility", NICE_COMPATIBILITY_RFC5245,
+		"main-context", mainctx,
+		"reliable", FALSE,
+		"full-mode", janus_ice_lite_enabled ? FALSE : TRUE,
+#ifdef HAVE_ICE_NOMINATION
+		"nomination-mode", janus_ice_nomination,
+#endif
+#ifdef HAVE_CONSENT_FRESHNESS
+		"consent-freshness", janus_ice_consent_freshness ? TRUE : FALSE,
+#endif
+		"keepalive-conncheck", janus_ice_keepalive_connchecks ? TRUE : FALSE,
+#ifdef HAVE_LIBNICE_TCP
+		"ice-udp", TRUE,
+		"ice-tcp", janus_ice_tcp_enabled ? TRUE : FALSE,
+#endif
+		NULL);
+	/* Any STUN server to use? */
+	if(janus_stun_server != NULL && janus_stun_port > 0) {
+		g_object_set(G_OBJECT(agent),
+			"stun-server", janus_stun_server,
+			"stun-server-port", janus_stun_port,
+			NULL);
+	}
+	g_object_set(G_OBJECT(agent), "upnp", FALSE, NULL);
+	/* Add all local addresses, except those in the ignore list: the set is
+	 * cached globally, so that during attach storms we don't re-enumerate
+	 * the interfaces for every agent when nothing changed on the machine */
+	janus_mutex_lock(&janus_ice_local_addresses_mutex);
+	gboolean refresh = g_atomic_int_compare_and_exchange(&janus_ice_local_addresses_dirty, 1, 0);
+#ifdef __linux__
+	if(!refresh && janus_ice_addrwatch_thread == NULL)
+		refresh = (janus_get_monotonic_time() - janus_ice_local_addresses_time) >= JANUS_ICE_ADDRESSES_CACHE_TTL;
+#else
+	if(!refresh)
+		refresh = (janus_get_monotonic_time() - janus_ice_local_addresses_time) >= JANUS_ICE_ADDRESSES_CACHE_TTL;
+#endif
+	if(refresh)
+		janus_ice_refresh_local_addresses();
+	GSList *address = janus_ice_local_addresses;
+	while(address) {
+		const char *host = (const char *)address->data;
+		JANUS_LOG(LOG_VERB, "Adding %s to the addresses to gather candidates for\n", host);
+		NiceAddress addr_local;
+		nice_address_init (&addr_local);
+		if(!nice_address_set_from_string (&addr_local, host)) {
+			JANUS_LOG(LOG_WARN, "Skipping invalid address %s\n", host);
+		} else {
+			nice_agent_add_local_address (agent, &addr_local);
+		}
+		address = address->next;
+	}
+	janus_mutex_unlock(&janus_ice_local_addresses_mutex);
+	/* Now create a ICE stream for all the media we'll handle */
+	guint id = nice_agent_add_stream(agent, 1);
+#ifdef HAVE_PORTRANGE
+	/* FIXME: libnice supports this since 0.1.0, but the 0.1.3 on Fedora fails with an undefined reference! */
+	nice_agent_set_port_range(agent, id, 1, rtp_range_min, rtp_range_max);
+#endif
+	if(stream_id != NULL)
+		*stream_id = id;
+	return agent;
+}
+
+/* Idle callback we post to a static event loop to top its agent pool up to
+ * the configured size: it runs on the loop thread, so creating and binding
+ * the replacement agents doesn't add latency to the attach path */
+static gboolean janus_ice_agent_pool_refill(gpointer user_data) {
+	janus_ice_static_event_loop *loop = (janus_ice_static_event_loop *)user_data;
+	while(g_async_queue_length(loop->agent_pool) < janus_ice_agent_pool_size) {
+		janus_ice_pooled_agent *pooled = g_malloc0(sizeof(janus_ice_pooled_agent));
+		pooled->agent = janus_ice_create_agent(loop->mainctx, &pooled->stream_id);
+		pooled->created = janus_get_monotonic_time();
+		g_async_queue_push(loop->agent_pool, pooled);
+	}
+	return G_SOURCE_REMOVE;
+}
+static void janus_ice_agent_pool_refill_unref(gpointer user_data) {
+	janus_ice_static_event_loop *loop = (janus_ice_static_event_loop *)user_data;
+	janus_refcount_decrease(&loop->ref);
+}
+
 int janus_ice_setup_local(janus_ice_handle *handle, gboolean offer, gboolean trickle, janus_dtls_role dtls_role) {
 	if(!handle || g_atomic_int_get(&handle->destroyed))
 		return -1;
@@ -3603,33 +4437,51 @@ int janus_ice_setup_local(janus_ice_handle *handle, gboolean offer, gboolean tri
 	handle->controlling = janus_ice_lite_enabled ? FALSE : !offer;
 	JANUS_LOG(LOG_INFO, "[%"SCNu64"] Creating ICE agent (ICE %s mode, %s)\n", handle->handle_id,
 		janus_ice_lite_enabled ? "Lite" : "Full", handle->controlling ? "controlling" : "controlled");
-	handle->agent = g_object_new(NICE_TYPE_AGENT,
-		"compatibility", NICE_COMPATIBILITY_RFC5245,
-		"main-context", handle->mainctx,
-		"reliable", FALSE,
-		"full-mode", janus_ice_lite_enabled ? FALSE : TRUE,
-#ifdef HAVE_ICE_NOMINATION
-		"nomination-mode", janus_ice_nomination,
-#endif
-#ifdef HAVE_CONSENT_FRESHNESS
-		"consent-freshness", janus_ice_consent_freshness ? TRUE : FALSE,
-#endif
-		"keepalive-conncheck", janus_ice_keepalive_connchecks ? TRUE : FALSE,
-#ifdef HAVE_LIBNICE_TCP
-		"ice-udp", TRUE,
-		"ice-tcp", janus_ice_tcp_enabled ? TRUE : FALSE,
+	handle->agent = NULL;
+	handle->cdone = 0;
+	handle->stream_id = 0;
+	janus_ice_static_event_loop *eloop = (janus_ice_static_event_loop *)handle->static_event_loop;
+	if(eloop != NULL && eloop->agent_pool != NULL) {
+		/* This handle shares a static event loop with a prewarmed agent pool:
+		 * try to claim one, skipping agents whose cached local addresses have
+		 * gone stale in the meanwhile */
+		gboolean stale = g_atomic_int_get(&janus_ice_local_addresses_dirty) != 0;
+#ifdef __linux__
+		if(!stale && janus_ice_addrwatch_thread == NULL)
+			stale = (janus_get_monotonic_time() - janus_ice_local_addresses_time) >= JANUS_ICE_ADDRESSES_CACHE_TTL;
+#else
+		if(!stale)
+			stale = (janus_get_monotonic_time() - janus_ice_local_addresses_time) >= JANUS_ICE_ADDRESSES_CACHE_TTL;
 #endif
-		NULL);
+		janus_ice_pooled_agent *pooled = NULL;
+		while(!stale && (pooled = g_async_queue_try_pop(eloop->agent_pool)) != NULL) {
+			if(pooled->created < janus_ice_local_addresses_time) {
+				/* The address cache was refreshed after this agent was created */
+				janus_ice_pooled_agent_free(pooled);
+				continue;
+			}
+			JANUS_LOG(LOG_VERB, "[%"SCNu64"] Claimed a prewarmed ICE agent from loop #%d\n",
+				handle->handle_id, eloop->id);
+			handle->agent = pooled->agent;
+			handle->stream_id = pooled->stream_id;
+			g_free(pooled);
+			break;
+		}
+		/* Schedule a background refill of the pool on the loop thread */
+		GSource *refill = g_idle_source_new();
+		g_source_set_name(refill, "agent-pool-refill");
+		janus_refcount_increase(&eloop->ref);
+		g_source_set_callback(refill, janus_ice_agent_pool_refill, eloop, janus_ice_agent_pool_refill_unref);
+		g_source_attach(refill, eloop->mainctx);
+		g_source_unref(refill);
+	}
+	if(handle->agent == NULL) {
+		/* No pool (or nothing to claim), create and configure the agent now */
+		handle->agent = janus_ice_create_agent(handle->mainctx, &handle->stream_id);
+	}
 	handle->agent_created = janus_get_monotonic_time();
 	handle->srtp_errors_count = 0;
 	handle->last_srtp_error = 0;
-	/* Any STUN server to use? */
-	if(janus_stun_server != NULL && janus_stun_port > 0) {
-		g_object_set(G_OBJECT(handle->agent),
-			"stun-server", janus_stun_server,
-			"stun-server-port", janus_stun_port,
-			NULL);
-	}
 	/* Any dynamic TURN credentials to retrieve via REST API? */
 	gboolean have_turnrest_credentials = FALSE;
 #ifdef HAVE_TURNRESTAPI
@@ -3658,7 +4510,6 @@ int janus_ice_setup_local(janus_ice_handle *handle, gboolean offer, gboolean tri
 		}
 	}
 #endif
-	g_object_set(G_OBJECT(handle->agent), "upnp", FALSE, NULL);
 	g_object_set(G_OBJECT(handle->agent), "controlling-mode", handle->controlling, NULL);
 	g_signal_connect (G_OBJECT (handle->agent), "candidate-gathering-done",
 		G_CALLBACK (janus_ice_cb_candidate_gathering_done), handle);
@@ -3685,72 +4536,14 @@ int janus_ice_setup_local(janus_ice_handle *handle, gboolean offer, gboolean tri
 #endif
 		G_CALLBACK (janus_ice_cb_new_remote_candidate), handle);
 
-	/* Add all local addresses, except those in the ignore list */
-	struct ifaddrs *ifaddr, *ifa;
-	int family, s, n;
-	char host[NI_MAXHOST];
-	if(getifaddrs(&ifaddr) == -1) {
-		JANUS_LOG(LOG_ERR, "[%"SCNu64"] Error getting list of interfaces... %d (%s)\n",
-			handle->handle_id, errno, g_strerror(errno));
-	} else {
-		for(ifa = ifaddr, n = 0; ifa != NULL; ifa = ifa->ifa_next, n++) {
-			if(ifa->ifa_addr == NULL)
-				continue;
-			/* Skip interfaces which are not up and running */
-			if(!((ifa->ifa_flags & IFF_UP) && (ifa->ifa_flags & IFF_RUNNING)))
-				continue;
-			/* Skip loopback interfaces */
-			if(ifa->ifa_flags & IFF_LOOPBACK)
-				continue;
-			family = ifa->ifa_addr->sa_family;
-			if(family != AF_INET && family != AF_INET6)
-				continue;
-			/* We only add IPv6 addresses if support for them has been explicitly enabled */
-			if(family == AF_INET6 && !janus_ipv6_enabled)
-				continue;
-			/* Check the interface name first, we can ignore that as well: enforce list would be checked later */
-			if(janus_ice_enforce_list == NULL && ifa->ifa_name != NULL && janus_ice_is_ignored(ifa->ifa_name))
-				continue;
-			s = getnameinfo(ifa->ifa_addr,
-					(family == AF_INET) ? sizeof(struct sockaddr_in) : sizeof(struct sockaddr_in6),
-					host, NI_MAXHOST, NULL, 0, NI_NUMERICHOST);
-			if(s != 0) {
-				JANUS_LOG(LOG_ERR, "[%"SCNu64"] getnameinfo() failed: %s\n", handle->handle_id, gai_strerror(s));
-				continue;
-			}
-			/* Skip 0.0.0.0, :: and, unless otherwise configured, local scoped addresses  */
-			if(!strcmp(host, "0.0.0.0") || !strcmp(host, "::") || (!janus_ipv6_linklocal_enabled && !strncmp(host, "fe80:", 5)))
-				continue;
-			/* Check if this IP address is in the ignore/enforce list: the enforce list has the precedence but the ignore list can then discard candidates */
-			if(janus_ice_enforce_list != NULL) {
-				if(ifa->ifa_name != NULL && !janus_ice_is_enforced(ifa->ifa_name) && !janus_ice_is_enforced(host))
-					continue;
-			}
-			if(janus_ice_is_ignored(host))
-				continue;
-			/* Ok, add interface to the ICE agent */
-			JANUS_LOG(LOG_VERB, "[%"SCNu64"] Adding %s to the addresses to gather candidates for\n", handle->handle_id, host);
-			NiceAddress addr_local;
-			nice_address_init (&addr_local);
-			if(!nice_address_set_from_string (&addr_local, host)) {
-				JANUS_LOG(LOG_WARN, "[%"SCNu64"] Skipping invalid address %s\n", handle->handle_id, host);
-				continue;
-			}
-			nice_agent_add_local_address (handle->agent, &addr_local);
-		}
-		freeifaddrs(ifaddr);
-	}
-
-	handle->cdone = 0;
-	handle->stream_id = 0;
-	/* Now create a ICE stream for all the media we'll handle */
-	handle->stream_id = nice_agent_add_stream(handle->agent, 1);
 	if(dscp_ef > 0) {
 		/* A DSCP value was configured, shift it and pass it to libnice as a TOS */
 		nice_agent_set_stream_tos(handle->agent, handle->stream_id, dscp_ef << 2);
 	}
-	/* Create the PeerConnection object */
-	janus_ice_peerconnection *pc = g_malloc0(sizeof(janus_ice_peerconnection));
+	/* Create the PeerConnection object, in the handle arena */
+	janus_ice_peerconnection *pc = janus_ice_arena_alloc(handle->arena, sizeof(janus_ice_peerconnection));
+	pc->arena = handle->arena;
+	janus_refcount_increase(&pc->arena->ref);
 	janus_refcount_init(&pc->ref, janus_ice_peerconnection_free);
 	janus_refcount_increase(&handle->ref);
 	pc->stream_id = handle->stream_id;
@@ -3793,10 +4586,6 @@ int janus_ice_setup_local(janus_ice_handle *handle, gboolean offer, gboolean tri
 	pc->media_bymid = g_hash_table_new_full(g_str_hash, g_str_equal,
 		(GDestroyNotify)g_free, (GDestroyNotify)janus_ice_peerconnection_medium_dereference);
 	pc->media_bytype = g_hash_table_new_full(NULL, NULL, NULL, (GDestroyNotify)janus_ice_peerconnection_medium_dereference);
-#ifdef HAVE_PORTRANGE
-	/* FIXME: libnice supports this since 0.1.0, but the 0.1.3 on Fedora fails with an undefined reference! */
-	nice_agent_set_port_range(handle->agent, handle->stream_id, 1, rtp_range_min, rtp_range_max);
-#endif
 	/* Gather now only if we're doing hanf-trickle */
 	if(!janus_full_trickle_enabled && !nice_agent_gather_candidates(handle->agent, handle->stream_id)) {
 #ifdef HAVE_TURNRESTAPI
@@ -3830,11 +4619,7 @@ int janus_ice_setup_local(janus_ice_handle *handle, gboolean offer, gboolean tri
 	janus_refcount_increase(&pc->dtls->ref);
 	/* If we're doing full-tricke, start gathering asynchronously */
 	if(janus_full_trickle_enabled) {
-#if GLIB_CHECK_VERSION(2, 46, 0)
-		g_async_queue_push_front(handle->queued_packets, &janus_ice_start_gathering);
-#else
-		g_async_queue_push(handle->queued_packets, &janus_ice_start_gathering);
-#endif
+		janus_lfq_push_front(handle->queued_packets, &janus_ice_start_gathering);
 		g_main_context_wakeup(handle->mainctx);
 	}
 	return 0;
@@ -3891,6 +4676,49 @@ void janus_ice_resend_trickles(janus_ice_handle *handle) {
 	janus_ice_notify_trickle(handle, NULL);
 }
 
+/* Helper to (re)build the preformatted block of fixed outgoing header extensions
+ * (mid, abs-send-time, transport-wide CC) for a medium: since the negotiated
+ * layout doesn't change between packets, we serialize it once and on egress
+ * just patch the per-packet values at the offsets we precompute here */
+static void janus_ice_rtp_extension_template_build(janus_ice_handle *handle,
+		janus_ice_peerconnection_medium *medium, gboolean video) {
+	char *extensions = medium->ext_template;
+	memset(extensions, 0, sizeof(medium->ext_template));
+	janus_rtp_header_extension *extheader = (janus_rtp_header_extension *)extensions;
+	extheader->type = htons(0xBEDE);
+	char *index = extensions + 4;
+	uint16_t extlen = 0;
+	medium->ext_abs_send_time_offset = 0;
+	medium->ext_twcc_offset = 0;
+	if(video && handle->pc->abs_send_time_ext_id > 0) {
+		*index = (handle->pc->abs_send_time_ext_id << 4) + 2;
+		medium->ext_abs_send_time_offset = 4 + extlen + 1;
+		index += 4;
+		extlen += 4;
+	}
+	if(video && handle->pc->transport_wide_cc_ext_id > 0) {
+		*index = (handle->pc->transport_wide_cc_ext_id << 4) + 1;
+		medium->ext_twcc_offset = 4 + extlen + 1;
+		index += 3;
+		extlen += 3;
+	}
+	if(handle->pc->mid_ext_id > 0 && medium->mid != NULL) {
+		size_t midlen = strlen(medium->mid) & 0x0F;
+		*index = (handle->pc->mid_ext_id << 4) + (midlen ? midlen-1 : 0);
+		memcpy(index+1, medium->mid, midlen);
+		extlen += (midlen + 1);
+	}
+	uint16_t words = extlen/4;
+	if(extlen%4 != 0)
+		words++;
+	extheader->length = htons(words);
+	medium->ext_template_len = 4 + (words*4);
+	/* Keep track of the IDs we used, so that we can detect renegotiations */
+	medium->ext_template_mid_id = handle->pc->mid_ext_id;
+	medium->ext_template_ast_id = video ? handle->pc->abs_send_time_ext_id : 0;
+	medium->ext_template_twcc_id = video ? handle->pc->transport_wide_cc_ext_id : 0;
+}
+
 static void janus_ice_rtp_extension_update(janus_ice_handle *handle, janus_ice_peerconnection_medium *medium, janus_ice_queued_packet *packet) {
 	if(handle == NULL || handle->pc == NULL || medium == NULL || packet == NULL || packet->data == NULL)
 		return;
@@ -3920,6 +4748,38 @@ static void janus_ice_rtp_extension_update(janus_ice_handle *handle, janus_ice_p
 		/* Write the extension(s) */
 		header->extension = 1;
 		memset(extensions, 0, sizeof(extensions));
+		/* If this packet only needs the fixed extensions, serve the preformatted
+		 * block we built for this medium and patch the per-packet values with
+		 * direct stores, rather than laying out the whole block again */
+		gboolean fixed_only = !use_2byte &&
+			!(!video && packet->extensions.audio_level > -1 && handle->pc->audiolevel_ext_id > 0) &&
+			!(video && packet->extensions.video_rotation > -1 && handle->pc->videoorientation_ext_id > 0) &&
+			!(video && packet->extensions.min_delay > -1 && packet->extensions.max_delay > -1 && handle->pc->playoutdelay_ext_id > 0) &&
+			!(video && packet->extensions.dd_len > 0 && handle->pc->dependencydesc_ext_id > 0) &&
+			!(packet->extensions.abs_capture_ts > 0 && handle->pc->abs_capture_time_ext_id > 0);
+		if(fixed_only) {
+			if(medium->ext_template_len == 0 ||
+					medium->ext_template_mid_id != handle->pc->mid_ext_id ||
+					medium->ext_template_ast_id != (video ? handle->pc->abs_send_time_ext_id : 0) ||
+					medium->ext_template_twcc_id != (video ? handle->pc->transport_wide_cc_ext_id : 0)) {
+				/* First packet for this medium, or the layout was renegotiated */
+				janus_ice_rtp_extension_template_build(handle, medium, video);
+			}
+			memcpy(extensions, medium->ext_template, medium->ext_template_len);
+			if(medium->ext_abs_send_time_offset > 0) {
+				int64_t now = (((janus_get_monotonic_time()/1000) << 18) + 500) / 1000;
+				uint32_t abs_ts = (uint32_t)now & 0x00FFFFFF;
+				uint32_t abs24 = htonl(abs_ts) >> 8;
+				memcpy(extensions + medium->ext_abs_send_time_offset, &abs24, 3);
+			}
+			if(medium->ext_twcc_offset > 0) {
+				handle->pc->transport_wide_cc_out_seq_num++;
+				uint16_t transSeqNum = htons(handle->pc->transport_wide_cc_out_seq_num);
+				memcpy(extensions + medium->ext_twcc_offset, &transSeqNum, 2);
+			}
+			extlen = medium->ext_template_len;	/* Already includes the RFC5285 header and padding */
+			goto exts_done;
+		}
 		janus_rtp_header_extension *extheader = (janus_rtp_header_extension *)extensions;
 		extheader->type = htons(use_2byte ? 0x1000 : 0xBEDE);
 		extheader->length = 0;
@@ -4122,6 +4982,7 @@ static void janus_ice_rtp_extension_update(janus_ice_handle *handle, janus_ice_p
 		extheader->length = htons(words);
 		/* Update lengths (taking into account the RFC5285 header) */
 		extlen = 4 + (words*4);
+exts_done:
 		totlen += extlen;
 	}
 	/* Check if we need to resize this packet buffer first */
@@ -4138,11 +4999,15 @@ static void janus_ice_rtp_extension_update(janus_ice_handle *handle, janus_ice_p
 		memcpy(packet->data + RTP_HEADER_SIZE, extensions, extlen);
 	}
 	packet->length = totlen;
+	/* If we tagged this packet with a transport-wide sequence number,
+	 * tell the bandwidth estimator about it (creating it, if needed) */
+	if(video && handle->pc->transport_wide_cc_ext_id > 0) {
+		if(handle->pc->bwe == NULL)
+			handle->pc->bwe = janus_bwe_create();
+		janus_bwe_packet_sent(handle->pc->bwe, handle->pc->transport_wide_cc_out_seq_num, packet->length);
+	}
 }
 
-static gint rtcp_transport_wide_cc_stats_comparator(gconstpointer item1, gconstpointer item2) {
-	return ((rtcp_transport_wide_cc_stats*)item1)->transport_seq_num - ((rtcp_transport_wide_cc_stats*)item2)->transport_seq_num;
-}
 static gboolean janus_ice_outgoing_transport_wide_cc_feedback(gpointer user_data) {
 	janus_ice_handle *handle = (janus_ice_handle *)user_data;
 	janus_ice_peerconnection *pc = handle->pc;
@@ -4182,50 +5047,34 @@ static gboolean janus_ice_outgoing_transport_wide_cc_feedback(gpointer user_data
 		return G_SOURCE_CONTINUE;
 	}
 
-	if(pc && pc->do_transport_wide_cc) {
+	if(pc && pc->do_transport_wide_cc && pc->twcc_have_pending) {
 		/* Create a transport wide feedback message */
 		size_t size = 1300;
 		char rtcpbuf[1300];
-		/* Order packet list */
-		pc->transport_wide_received_seq_nums = g_slist_sort(pc->transport_wide_received_seq_nums,
-			rtcp_transport_wide_cc_stats_comparator);
-		/* Create full stats queue */
+		/* Walk the arrival time ring in sequence order: slots holding a 0 are
+		 * packets we never received, and are reported as lost */
+		janus_mutex_lock(&pc->mutex);
+		guint32 max_seq_num = pc->transport_wide_cc_cycles<<16 | pc->transport_wide_cc_last_seq_num;
+		guint32 seq = pc->transport_wide_cc_last_feedback_seq_num ?
+			pc->transport_wide_cc_last_feedback_seq_num+1 : pc->twcc_first_seq_num;
+		if(max_seq_num - seq >= JANUS_ICE_TWCC_RING_SIZE) {
+			/* Way too much to report, anything older than the ring is gone */
+			seq = max_seq_num - JANUS_ICE_TWCC_RING_SIZE + 1;
+		}
 		GQueue *packets = g_queue_new();
-		/* For all packets */
-		GSList *it = NULL;
-		for(it = pc->transport_wide_received_seq_nums; it; it = it->next) {
-			/* Get stat */
-			janus_rtcp_transport_wide_cc_stats *stats = (janus_rtcp_transport_wide_cc_stats *)it->data;
-			/* Get transport seq */
-			guint32 transport_seq_num = stats->transport_seq_num;
-			/* Check if it is an out of order  */
-			if(transport_seq_num < pc->transport_wide_cc_last_feedback_seq_num) {
-				/* Skip, it was already reported as lost */
-				g_free(stats);
-				continue;
-			}
-			/* If not first */
-			if(pc->transport_wide_cc_last_feedback_seq_num) {
-				/* For each lost */
-				guint32 i = 0;
-				for(i = pc->transport_wide_cc_last_feedback_seq_num+1; i<transport_seq_num; ++i) {
-					/* Create new stat */
-					janus_rtcp_transport_wide_cc_stats *missing = g_malloc(sizeof(janus_rtcp_transport_wide_cc_stats));
-					/* Add missing packet */
-					missing->transport_seq_num = i;
-					missing->timestamp = 0;
-					/* Add it */
-					g_queue_push_tail(packets, missing);
-				}
-			}
-			/* Store last */
-			pc->transport_wide_cc_last_feedback_seq_num = transport_seq_num;
-			/* Add this one */
+		janus_rtcp_transport_wide_cc_stats *stats_pool =
+			g_malloc((max_seq_num-seq+1)*sizeof(janus_rtcp_transport_wide_cc_stats));
+		guint stats_num = 0;
+		for(; seq != max_seq_num+1; seq++) {
+			janus_rtcp_transport_wide_cc_stats *stats = &stats_pool[stats_num++];
+			stats->transport_seq_num = seq;
+			stats->timestamp = pc->twcc_arrival_times[seq & (JANUS_ICE_TWCC_RING_SIZE-1)];
+			pc->twcc_arrival_times[seq & (JANUS_ICE_TWCC_RING_SIZE-1)] = 0;
 			g_queue_push_tail(packets, stats);
 		}
-		/* Free and reset stats list */
-		g_slist_free(pc->transport_wide_received_seq_nums);
-		pc->transport_wide_received_seq_nums = NULL;
+		pc->transport_wide_cc_last_feedback_seq_num = max_seq_num;
+		pc->twcc_have_pending = FALSE;
+		janus_mutex_unlock(&pc->mutex);
 		/* Create and enqueue RTCP packets */
 		guint packets_len = 0;
 		while((packets_len = g_queue_get_length(packets)) > 0) {
@@ -4263,6 +5112,7 @@ static gboolean janus_ice_outgoing_transport_wide_cc_feedback(gpointer user_data
 		}
 		/* Free mem */
 		g_queue_free(packets);
+		g_free(stats_pool);
 	}
 	return G_SOURCE_CONTINUE;
 }
@@ -4277,17 +5127,30 @@ static gboolean janus_ice_outgoing_rtcp_handle(gpointer user_data) {
 		medium = g_hash_table_lookup(pc->media, GUINT_TO_POINTER(mi));
 		if(!medium || (medium->type != JANUS_MEDIA_AUDIO && medium->type != JANUS_MEDIA_VIDEO))
 			continue;
-		if(medium->out_stats.info[0].packets > 0) {
-			/* Create a SR/SDES compound */
-			int srlen = 28;
-			int sdeslen = 16;
-			char rtcpbuf[sizeof(janus_rtcp_sr)+sdeslen];
-			memset(rtcpbuf, 0, sizeof(rtcpbuf));
-			rtcp_sr *sr = (rtcp_sr *)&rtcpbuf;
+		int srlen = 28;
+		int sdeslen = 16;
+		if(!medium->rtcp_templates_set) {
+			/* Lay out the static parts of the SR/SDES and RR compounds once:
+			 * from now on we'll only patch the dynamic fields in place */
+			medium->rtcp_templates_set = TRUE;
+			memset(medium->rtcp_sr_template, 0, sizeof(medium->rtcp_sr_template));
+			rtcp_sr *sr = (rtcp_sr *)medium->rtcp_sr_template;
 			sr->header.version = 2;
 			sr->header.type = RTCP_SR;
 			sr->header.rc = 0;
 			sr->header.length = htons((srlen/4)-1);
+			janus_rtcp_sdes_cname(&medium->rtcp_sr_template[srlen], sdeslen, "janus", 5);
+			memset(medium->rtcp_rr_template, 0, sizeof(medium->rtcp_rr_template));
+			rtcp_rr *rr = (rtcp_rr *)medium->rtcp_rr_template;
+			rr->header.version = 2;
+			rr->header.type = RTCP_RR;
+			rr->header.rc = 1;
+			rr->header.length = htons((sizeof(medium->rtcp_rr_template)/4)-1);
+		}
+		if(medium->out_stats.info[0].packets > 0) {
+			/* Patch the dynamic fields of the SR/SDES compound */
+			char *rtcpbuf = medium->rtcp_sr_template;
+			rtcp_sr *sr = (rtcp_sr *)rtcpbuf;
 			sr->ssrc = htonl(medium->ssrc);
 			struct timeval tv;
 			gettimeofday(&tv, NULL);
@@ -4308,7 +5171,6 @@ static gboolean janus_ice_outgoing_rtcp_handle(gpointer user_data) {
 			sr->si.s_packets = htonl(medium->out_stats.info[0].packets);
 			sr->si.s_octets = htonl(medium->out_stats.info[0].bytes);
 			rtcp_sdes *sdes = (rtcp_sdes *)&rtcpbuf[srlen];
-			janus_rtcp_sdes_cname((char *)sdes, sdeslen, "janus", 5);
 			sdes->chunk.ssrc = htonl(medium->ssrc);
 			/* Enqueue it, we'll send it later */
 			janus_plugin_rtcp rtcp = { .mindex = medium->mindex,
@@ -4324,15 +5186,9 @@ static gboolean janus_ice_outgoing_rtcp_handle(gpointer user_data) {
 			int vindex=0;
 			for(vindex=0; vindex<3; vindex++) {
 				if(medium->rtcp_ctx[vindex] && medium->rtcp_ctx[vindex]->rtp_recvd) {
-					/* Create a RR */
-					int rrlen = 32;
-					char rtcpbuf[32];
-					memset(rtcpbuf, 0, sizeof(rtcpbuf));
-					rtcp_rr *rr = (rtcp_rr *)&rtcpbuf;
-					rr->header.version = 2;
-					rr->header.type = RTCP_RR;
-					rr->header.rc = 1;
-					rr->header.length = htons((rrlen/4)-1);
+					/* Patch the dynamic fields of the RR (the report block is all dynamic) */
+					char *rtcpbuf = medium->rtcp_rr_template;
+					rtcp_rr *rr = (rtcp_rr *)rtcpbuf;
 					rr->ssrc = htonl(medium->ssrc);
 					janus_rtcp_report_block(medium->rtcp_ctx[vindex], &rr->rb[0]);
 					rr->rb[0].ssrc = htonl(medium->ssrc_peer[vindex]);
@@ -4499,10 +5355,59 @@ static gboolean janus_ice_outgoing_stats_handle(gpointer user_data) {
 	return G_SOURCE_CONTINUE;
 }
 
-static gboolean janus_ice_outgoing_traffic_handle(janus_ice_handle *handle, janus_ice_queued_packet *pkt) {
+#if defined(__linux__) && defined(HAVE_NICE_SOCKETS) && defined(SO_BUSY_POLL)
+static void janus_ice_busy_poll_sockets(janus_ice_handle *handle) {
+	/* Apply the configured busy-poll budget to the candidate sockets */
+	janus_ice_peerconnection *pc = handle->pc;
+	if(janus_ice_busy_poll == 0 || handle->agent == NULL || pc == NULL)
+		return;
+	GPtrArray *sockets = NULL;
+	nice_agent_get_sockets(handle->agent, pc->stream_id, pc->component_id, &sockets);
+	if(sockets == NULL)
+		return;
+	guint i = 0;
+	for(i = 0; i < sockets->len; i++) {
+		GSocket *gsocket = g_ptr_array_index(sockets, i);
+		int fd = g_socket_get_fd(gsocket);
+		if(fd < 0)
+			continue;
+		int budget = janus_ice_busy_poll;
+		if(setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &budget, sizeof(budget)) < 0) {
+			JANUS_LOG(LOG_WARN, "[%"SCNu64"] Error setting SO_BUSY_POLL on socket %d... %d (%s)\n",
+				handle->handle_id, fd, errno, g_strerror(errno));
+		}
+#ifdef SO_PREFER_BUSY_POLL
+		/* Prefer busy-polling over interrupts too: not all kernels
+		 * have this (5.11+), so a failure here is not a problem */
+		int prefer = 1;
+		(void)setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &prefer, sizeof(prefer));
+#endif
+	}
+	g_ptr_array_unref(sockets);
+}
+#endif
+
+static gboolean janus_ice_candidate_is_duplicate(GSList *candidates, NiceCandidate *c) {
+	/* Check if a candidate with the same foundation and address is in the batch
+	 * already: mobile clients often send the same candidate more than once in a
+	 * burst, and there's no point in feeding the duplicates to libnice */
+	GSList *i = candidates;
+	while(i) {
+		NiceCandidate *ic = (NiceCandidate *)i->data;
+		if(ic->type == c->type && !strncmp(ic->foundation, c->foundation, NICE_CANDIDATE_MAX_FOUNDATION) &&
+				nice_address_equal(&ic->addr, &c->addr))
+			return TRUE;
+		i = i->next;
+	}
+	return FALSE;
+}
+
+static gboolean janus_ice_outgoing_traffic_handle(janus_ice_handle *handle,
+		janus_ice_queued_packet *pkt, janus_ice_egress_batch *batch) {
 	janus_session *session = (janus_session *)handle->session;
 	janus_ice_peerconnection *pc = handle->pc;
 	janus_ice_peerconnection_medium *medium = NULL;
+	gboolean batched = FALSE;
 	if(pkt == &janus_ice_start_gathering) {
 		/* Start gathering candidates */
 		if(handle->agent == NULL) {
@@ -4510,6 +5415,11 @@ static gboolean janus_ice_outgoing_traffic_handle(janus_ice_handle *handle, janu
 		} else if(!nice_agent_gather_candidates(handle->agent, handle->stream_id)) {
 			JANUS_LOG(LOG_ERR, "[%"SCNu64"] Error gathering candidates...\n", handle->handle_id);
 			janus_ice_webrtc_hangup(handle, "ICE gathering error");
+		} else {
+#if defined(__linux__) && defined(HAVE_NICE_SOCKETS) && defined(SO_BUSY_POLL)
+			/* The candidate sockets exist now, apply the busy-poll budget if configured */
+			janus_ice_busy_poll_sockets(handle);
+#endif
 		}
 		return G_SOURCE_CONTINUE;
 	} else if(pkt == &janus_ice_add_candidates) {
@@ -4519,7 +5429,11 @@ static gboolean janus_ice_outgoing_traffic_handle(janus_ice_handle *handle, janu
 		while((c = g_async_queue_try_pop(handle->queued_candidates)) != NULL) {
 			JANUS_LOG(LOG_VERB, "[%"SCNu64"] Processing candidate %p\n", handle->handle_id, c);
 			if(c->priority > 0) {
-				candidates = g_slist_append(candidates, c);
+				if(janus_ice_candidate_is_duplicate(candidates, c)) {
+					JANUS_LOG(LOG_VERB, "[%"SCNu64"] Candidate %p is a duplicate, ignoring it\n", handle->handle_id, c);
+				} else {
+					candidates = g_slist_append(candidates, c);
+				}
 			} else {
 				/* Workaround for https://gitlab.freedesktop.org/libnice/libnice/-/issues/181 */
 				JANUS_LOG(LOG_WARN, "[%"SCNu64"] Candidate %p has priority 0, ignoring it\n", handle->handle_id, c);
@@ -4552,10 +5466,8 @@ static gboolean janus_ice_outgoing_traffic_handle(janus_ice_handle *handle, janu
 		/* Start the DTLS handshake */
 		janus_dtls_srtp_handshake(pc->dtls);
 		/* Create retransmission timer */
-		pc->dtlsrt_source = g_timeout_source_new(50);
-		g_source_set_callback(pc->dtlsrt_source, janus_dtls_retry, pc->dtls, NULL);
-		guint id = g_source_attach(pc->dtlsrt_source, handle->mainctx);
-		JANUS_LOG(LOG_VERB, "[%"SCNu64"] Creating retransmission timer with ID %u\n", handle->handle_id, id);
+		pc->dtlsrt_job = janus_timer_wheel_add(handle->timer_wheel, 50, TRUE, janus_dtls_retry, pc->dtls, NULL);
+		JANUS_LOG(LOG_VERB, "[%"SCNu64"] Creating retransmission timer\n", handle->handle_id);
 		return G_SOURCE_CONTINUE;
 	} else if(pkt == &janus_ice_media_stopped) {
 		/* Some media has been disabled on the way in, so use the callback to notify the peer */
@@ -4590,21 +5502,18 @@ static gboolean janus_ice_outgoing_traffic_handle(janus_ice_handle *handle, janu
 		if(plugin != NULL && handle->app_handle != NULL) {
 			plugin->hangup_media(handle->app_handle);
 		}
-		/* Get rid of the attached sources */
-		if(handle->rtcp_source) {
-			g_source_destroy(handle->rtcp_source);
-			g_source_unref(handle->rtcp_source);
-			handle->rtcp_source = NULL;
+		/* Get rid of the scheduled jobs */
+		if(handle->rtcp_job) {
+			janus_timer_job_cancel(handle->rtcp_job);
+			handle->rtcp_job = NULL;
 		}
-		if(handle->twcc_source) {
-			g_source_destroy(handle->twcc_source);
-			g_source_unref(handle->twcc_source);
-			handle->twcc_source = NULL;
+		if(handle->twcc_job) {
+			janus_timer_job_cancel(handle->twcc_job);
+			handle->twcc_job = NULL;
 		}
-		if(handle->stats_source) {
-			g_source_destroy(handle->stats_source);
-			g_source_unref(handle->stats_source);
-			handle->stats_source = NULL;
+		if(handle->stats_job) {
+			janus_timer_job_cancel(handle->stats_job);
+			handle->stats_job = NULL;
 		}
 		/* If event handlers are active, send stats one last time */
 		if(janus_events_is_enabled()) {
@@ -4665,9 +5574,15 @@ static gboolean janus_ice_outgoing_traffic_handle(janus_ice_handle *handle, janu
 		janus_ice_free_queued_packet(pkt);
 		return G_SOURCE_CONTINUE;
 	}
-	gint64 age = (janus_get_monotonic_time() - pkt->added);
+	/* Traced packets keep using the precise clock, as they feed the latency accounting */
+	gint64 age = ((pkt->traced ? janus_get_monotonic_time() : janus_get_monotonic_time_coarse()) - pkt->added);
+	/* If this packet is being traced, account how long it was queued:
+	 * we're about to send it on the wire in this very iteration */
+	if(pkt->traced)
+		janus_ice_trace_account(handle, JANUS_ICE_TRACE_QUEUE, age);
 	if(age > G_USEC_PER_SEC) {
 		JANUS_LOG(LOG_WARN, "[%"SCNu64"] Discarding too old outgoing packet (age=%"SCNi64"us)\n", handle->handle_id, age);
+		janus_metrics_inc(JANUS_METRIC_PACKETS_DROPPED);
 		janus_ice_free_queued_packet(pkt);
 		return G_SOURCE_CONTINUE;
 	}
@@ -4707,9 +5622,14 @@ static gboolean janus_ice_outgoing_traffic_handle(janus_ice_handle *handle, janu
 		medium->noerrorlog = FALSE;
 		if(pkt->encrypted) {
 			/* Already SRTCP */
-			int sent = nice_agent_send(handle->agent, pc->stream_id, pc->component_id, pkt->length, (const gchar *)pkt->data);
-			if(sent < pkt->length) {
-				JANUS_LOG(LOG_ERR, "[%"SCNu64"] ... only sent %d bytes? (was %d)\n", handle->handle_id, sent, pkt->length);
+			if(batch != NULL && egress_batch_size > 1) {
+				janus_ice_egress_batch_add(handle, batch, pkt, pkt->length, NULL);
+				batched = TRUE;
+			} else {
+				int sent = nice_agent_send(handle->agent, pc->stream_id, pc->component_id, pkt->length, (const gchar *)pkt->data);
+				if(sent < pkt->length) {
+					JANUS_LOG(LOG_ERR, "[%"SCNu64"] ... only sent %d bytes? (was %d)\n", handle->handle_id, sent, pkt->length);
+				}
 			}
 		} else {
 			/* Check if there's anything we need to do before sending */
@@ -4764,11 +5684,11 @@ static gboolean janus_ice_outgoing_traffic_handle(janus_ice_handle *handle, janu
 						remb->ssrc[2] = htonl(medium->ssrc_peer[2]);
 					}
 				}
-				/* Free old packet and update */
-				char *prev_data = pkt->data;
+				/* Release the old packet buffer and update */
+				janus_ice_release_buffer(pkt->data, pkt->pooled_data);
 				pkt->data = rtcpbuf;
+				pkt->pooled_data = FALSE;
 				pkt->length = rrlen+pkt->length;
-				g_clear_pointer(&prev_data, g_free);
 			}
 			/* Do we need to dump this packet for debugging? */
 			if(g_atomic_int_get(&handle->dump_packets))
@@ -4777,7 +5697,9 @@ static gboolean janus_ice_outgoing_traffic_handle(janus_ice_handle *handle, janu
 			/* Encrypt SRTCP */
 			int protected = pkt->length;
 			int res = janus_is_webrtc_encryption_enabled() ?
-				srtp_protect_rtcp(pc->dtls->srtp_out, pkt->data, &protected) : srtp_err_status_ok;
+				(pc->dtls->srtp_ectx_out != NULL ?
+					janus_srtp_engine_protect_rtcp(pc->dtls->srtp_ectx_out, pkt->data, &protected) :
+					srtp_protect_rtcp(pc->dtls->srtp_out, pkt->data, &protected)) : srtp_err_status_ok;
 			if(res != srtp_err_status_ok) {
 				/* We don't spam the logs for every SRTP error: just take note of this, and print a summary later */
 				handle->srtp_errors_count++;
@@ -4786,13 +5708,20 @@ static gboolean janus_ice_outgoing_traffic_handle(janus_ice_handle *handle, janu
 				JANUS_LOG(LOG_DBG, "[%"SCNu64"] ... SRTCP protect error... %s (len=%d-->%d)...\n", handle->handle_id, janus_srtp_error_str(res), pkt->length, protected);
 			} else {
 				/* Shoot! */
-				int sent = nice_agent_send(handle->agent, pc->stream_id, pc->component_id, protected, pkt->data);
-				if(sent < protected) {
-					JANUS_LOG(LOG_ERR, "[%"SCNu64"] ... only sent %d bytes? (was %d)\n", handle->handle_id, sent, protected);
+				if(batch != NULL && egress_batch_size > 1) {
+					janus_ice_egress_batch_add(handle, batch, pkt, protected, NULL);
+					batched = TRUE;
+				} else {
+					int sent = nice_agent_send(handle->agent, pc->stream_id, pc->component_id, protected, pkt->data);
+					if(sent < protected) {
+						JANUS_LOG(LOG_ERR, "[%"SCNu64"] ... only sent %d bytes? (was %d)\n", handle->handle_id, sent, protected);
+					}
 				}
+				janus_metrics_inc(JANUS_METRIC_RTCP_PACKETS_OUT);
 			}
 		}
-		janus_ice_free_queued_packet(pkt);
+		if(!batched)
+			janus_ice_free_queued_packet(pkt);
 	} else {
 		/* RTP or data */
 		if(pkt->type == JANUS_ICE_PACKET_AUDIO || pkt->type == JANUS_ICE_PACKET_VIDEO) {
@@ -4816,9 +5745,14 @@ static gboolean janus_ice_outgoing_traffic_handle(janus_ice_handle *handle, janu
 				/* Already RTP (probably a retransmission?) */
 				janus_rtp_header *header = (janus_rtp_header *)pkt->data;
 				JANUS_LOG(LOG_HUGE, "[%"SCNu64"] ... Retransmitting seq.nr %"SCNu16"\n\n", handle->handle_id, ntohs(header->seq_number));
-				int sent = nice_agent_send(handle->agent, pc->stream_id, pc->component_id, pkt->length, (const gchar *)pkt->data);
-				if(sent < pkt->length) {
-					JANUS_LOG(LOG_ERR, "[%"SCNu64"] ... only sent %d bytes? (was %d)\n", handle->handle_id, sent, pkt->length);
+				if(batch != NULL && egress_batch_size > 1 && (video || egress_batch_audio)) {
+					janus_ice_egress_batch_add(handle, batch, pkt, pkt->length, NULL);
+					batched = TRUE;
+				} else {
+					int sent = nice_agent_send(handle->agent, pc->stream_id, pc->component_id, pkt->length, (const gchar *)pkt->data);
+					if(sent < pkt->length) {
+						JANUS_LOG(LOG_ERR, "[%"SCNu64"] ... only sent %d bytes? (was %d)\n", handle->handle_id, sent, pkt->length);
+					}
 				}
 			} else {
 				/* Prune/update/set RTP extensions */
@@ -4857,6 +5791,10 @@ static gboolean janus_ice_outgoing_traffic_handle(janus_ice_handle *handle, janu
 						else if(!strcasecmp(medium->codec, "h265"))
 							medium->video_is_keyframe = &janus_h265_is_keyframe;
 					}
+					if(video && medium->video_is_keyframe != NULL) {
+						/* Cache the checker on the handle too, for the backpressure checks */
+						g_atomic_pointer_set(&handle->video_keyframe_checker, medium->video_is_keyframe);
+					}
 				}
 				/* Do we need to dump this packet for debugging? */
 				if(g_atomic_int_get(&handle->dump_packets))
@@ -4902,10 +5840,25 @@ static gboolean janus_ice_outgoing_traffic_handle(janus_ice_handle *handle, janu
 					/* Copy the payload */
 					memcpy(p->data+hsize+2, payload, pkt->length - hsize);
 				}
-				/* Encrypt SRTP */
+				/* Encrypt SRTP: if we're batching and the crypto engine has a
+				 * batched protect, defer protection to the batch flush instead */
+				janus_srtp_engine_ctx *ectx = janus_is_webrtc_encryption_enabled() ? pc->dtls->srtp_ectx_out : NULL;
+				gboolean batching = (batch != NULL && egress_batch_size > 1 && (video || egress_batch_audio));
+				gboolean batch_protect = (batching && ectx != NULL && janus_srtp_engine_has_batch(ectx));
+				if(batch_protect && p == NULL && medium->do_nacks &&
+						medium->nack_queue_ms > 0 && !pkt->retransmission) {
+					/* We'll have to save the protected packet in the retransmit
+					 * buffer after sending it, so we can't defer the protection
+					 * to the batch flush, or we'd store (and later retransmit)
+					 * the plain RTP packet instead: protect this one right away */
+					batch_protect = FALSE;
+				}
 				int protected = pkt->length;
-				int res = janus_is_webrtc_encryption_enabled() ?
-					srtp_protect(pc->dtls->srtp_out, pkt->data, &protected) : srtp_err_status_ok;
+				int res = srtp_err_status_ok;
+				if(janus_is_webrtc_encryption_enabled() && !batch_protect) {
+					res = (ectx != NULL) ? janus_srtp_engine_protect(ectx, pkt->data, &protected) :
+						srtp_protect(pc->dtls->srtp_out, pkt->data, &protected);
+				}
 				if(res != srtp_err_status_ok) {
 					/* We don't spam the logs for every SRTP error: just take note of this, and print a summary later */
 					handle->srtp_errors_count++;
@@ -4919,9 +5872,16 @@ static gboolean janus_ice_outgoing_traffic_handle(janus_ice_handle *handle, janu
 					janus_ice_free_rtp_packet(p);
 				} else {
 					/* Shoot! */
-					int sent = nice_agent_send(handle->agent, pc->stream_id, pc->component_id, protected, pkt->data);
-					if(sent < protected) {
-						JANUS_LOG(LOG_ERR, "[%"SCNu64"] ... only sent %d bytes? (was %d)\n", handle->handle_id, sent, protected);
+					int sent = protected;
+					if(batching) {
+						/* Queue the packet: the syscall happens when the batch is flushed */
+						janus_ice_egress_batch_add(handle, batch, pkt, protected, batch_protect ? ectx : NULL);
+						batched = TRUE;
+					} else {
+						sent = nice_agent_send(handle->agent, pc->stream_id, pc->component_id, protected, pkt->data);
+						if(sent < protected) {
+							JANUS_LOG(LOG_ERR, "[%"SCNu64"] ... only sent %d bytes? (was %d)\n", handle->handle_id, sent, protected);
+						}
 					}
 					/* Update stats */
 					if(sent > 0) {
@@ -4930,8 +5890,11 @@ static gboolean janus_ice_outgoing_traffic_handle(janus_ice_handle *handle, janu
 						guint32 timestamp = ntohl(header->timestamp);
 						medium->out_stats.info[0].packets++;
 						medium->out_stats.info[0].bytes += pkt->length;
+						janus_metrics_inc(JANUS_METRIC_RTP_PACKETS_OUT);
+						janus_metrics_add(JANUS_METRIC_RTP_BYTES_OUT, pkt->length);
+						janus_metrics_add(JANUS_METRIC_QUEUE_WAIT_US, (guint64)age);
 						/* Last second outgoing media */
-						gint64 now = janus_get_monotonic_time();
+						gint64 now = janus_get_monotonic_time_coarse();
 						if(medium->out_stats.info[0].updated == 0)
 							medium->out_stats.info[0].updated = now;
 						if(now > medium->out_stats.info[0].updated &&
@@ -4969,7 +5932,8 @@ static gboolean janus_ice_outgoing_traffic_handle(janus_ice_handle *handle, janu
 						/* Save the packet for retransmissions that may be needed later */
 						if(!medium->do_nacks) {
 							/* ... unless NACKs are disabled for this medium */
-							janus_ice_free_queued_packet(pkt);
+							if(!batched)
+								janus_ice_free_queued_packet(pkt);
 							return G_SOURCE_CONTINUE;
 						}
 						if(p == NULL) {
@@ -4980,18 +5944,21 @@ static gboolean janus_ice_outgoing_traffic_handle(janus_ice_handle *handle, janu
 							p->length = protected;
 							janus_plugin_rtp_extensions_reset(&p->extensions);
 						}
-						p->created = janus_get_monotonic_time();
+						p->created = janus_get_monotonic_time_coarse();
 						p->last_retransmit = 0;
 						p->current_backoff = 0;
 						janus_rtp_header *header = (janus_rtp_header *)pkt->data;
 						guint16 seq = ntohs(header->seq_number);
-						if(medium->retransmit_buffer == NULL) {
-							medium->retransmit_buffer = g_queue_new();
-							medium->retransmit_seqs = g_hash_table_new(NULL, NULL);
+						if(medium->retransmit_ring == NULL) {
+							medium->retransmit_ring = g_malloc0(JANUS_ICE_RETRANSMIT_RING_SIZE*sizeof(janus_rtp_packet *));
+							medium->retransmit_ring_seqs = g_malloc0(JANUS_ICE_RETRANSMIT_RING_SIZE*sizeof(guint16));
 						}
-						g_queue_push_tail(medium->retransmit_buffer, p);
-						/* Insert in the table too, for quick lookup */
-						g_hash_table_insert(medium->retransmit_seqs, GUINT_TO_POINTER(seq), p);
+						/* Store it in the ring, evicting whatever used the slot before */
+						guint16 slot = seq & (JANUS_ICE_RETRANSMIT_RING_SIZE-1);
+						if(medium->retransmit_ring[slot] != NULL)
+							janus_ice_free_rtp_packet(medium->retransmit_ring[slot]);
+						medium->retransmit_ring[slot] = p;
+						medium->retransmit_ring_seqs[slot] = seq;
 					} else {
 						janus_ice_free_rtp_packet(p);
 					}
@@ -5015,7 +5982,8 @@ static gboolean janus_ice_outgoing_traffic_handle(janus_ice_handle *handle, janu
 			medium->noerrorlog = FALSE;
 			/* TODO Support binary data */
 			janus_dtls_wrap_sctp_data(pc->dtls, pkt->label, pkt->protocol,
-				pkt->type == JANUS_ICE_PACKET_TEXT, pkt->data, pkt->length);
+				pkt->type == JANUS_ICE_PACKET_TEXT, pkt->data, pkt->length,
+				pkt->pr_policy, pkt->pr_value);
 #endif
 		} else if(pkt->type == JANUS_ICE_PACKET_SCTP) {
 			/* SCTP data to push */
@@ -5039,7 +6007,9 @@ static gboolean janus_ice_outgoing_traffic_handle(janus_ice_handle *handle, janu
 		} else {
 			JANUS_LOG(LOG_WARN, "[%"SCNu64"] Unsupported packet type %d\n", handle->handle_id, pkt->type);
 		}
-		janus_ice_free_queued_packet(pkt);
+		/* In case the packet was queued for a batched send, the batch owns it now */
+		if(!batched)
+			janus_ice_free_queued_packet(pkt);
 	}
 	return G_SOURCE_CONTINUE;
 }
@@ -5048,7 +6018,35 @@ static void janus_ice_queue_packet(janus_ice_handle *handle, janus_ice_queued_pa
 	/* TODO: There is a potential race condition where the "queued_packets"
 	 * could get released between the condition and pushing the packet. */
 	if(handle->queued_packets != NULL) {
-		g_async_queue_push(handle->queued_packets, pkt);
+		/* Track the high-water mark of the queue, to help spot slow consumers */
+		gint qlen = janus_lfq_length(handle->queued_packets);
+		if(qlen > g_atomic_int_get(&handle->queued_packets_high))
+			g_atomic_int_set(&handle->queued_packets_high, qlen);
+		if(queued_packets_limit > 0 && (guint)qlen >= queued_packets_limit &&
+				pkt->type == JANUS_ICE_PACKET_VIDEO && !pkt->control && !pkt->retransmission) {
+			/* The queue is over the configured limit, drop this video packet
+			 * unless it's part of a keyframe: audio, RTCP, data and control
+			 * messages are never dropped because of backpressure. Note we use
+			 * the keyframe checker cached on the handle: the PeerConnection
+			 * media tables belong to the loop thread, and are not safe to
+			 * walk from here to resolve the medium */
+			gboolean keyframe = FALSE;
+			gboolean (* video_is_keyframe)(const char* buffer, int len) =
+				g_atomic_pointer_get(&handle->video_keyframe_checker);
+			if(video_is_keyframe != NULL && !pkt->encrypted) {
+				int plen = 0;
+				char *payload = janus_rtp_payload(pkt->data, pkt->length, &plen);
+				if(payload != NULL)
+					keyframe = video_is_keyframe(payload, plen);
+			}
+			if(!keyframe) {
+				g_atomic_int_inc(&handle->queued_packets_dropped);
+				janus_metrics_inc(JANUS_METRIC_PACKETS_DROPPED);
+				janus_ice_free_queued_packet(pkt);
+				return;
+			}
+		}
+		janus_lfq_push(handle->queued_packets, pkt);
 		g_main_context_wakeup(handle->mainctx);
 	} else {
 		janus_ice_free_queued_packet(pkt);
@@ -5060,10 +6058,19 @@ void janus_ice_relay_rtp(janus_ice_handle *handle, janus_plugin_rtp *packet) {
 			!janus_is_rtp(packet->buffer, packet->length))
 		return;
 	/* Queue this packet as it is (we'll prune/update/set extensions later) */
-	janus_ice_queued_packet *pkt = g_malloc(sizeof(janus_ice_queued_packet));
+	janus_ice_queued_packet *pkt = NULL;
+	if(packet->transfer_buffer) {
+		/* The plugin allocated the buffer with tailroom for the SRTP tag
+		 * and is handing it over: queue it as it is, no copy needed */
+		pkt = janus_ice_alloc_queued_packet(0);
+		pkt->data = packet->buffer;
+		packet->buffer = NULL;
+		packet->transfer_buffer = FALSE;
+	} else {
+		pkt = janus_ice_alloc_queued_packet(packet->length + SRTP_MAX_TAG_LEN);
+		memcpy(pkt->data, packet->buffer, packet->length);
+	}
 	pkt->mindex = packet->mindex;
-	pkt->data = g_malloc(packet->length + SRTP_MAX_TAG_LEN);
-	memcpy(pkt->data, packet->buffer, packet->length);
 	pkt->length = packet->length;
 	pkt->type = packet->video ? JANUS_ICE_PACKET_VIDEO : JANUS_ICE_PACKET_AUDIO;
 	pkt->extensions = packet->extensions;
@@ -5073,7 +6080,14 @@ void janus_ice_relay_rtp(janus_ice_handle *handle, janus_plugin_rtp *packet) {
 	pkt->retransmission = FALSE;
 	pkt->label = NULL;
 	pkt->protocol = NULL;
-	pkt->added = janus_get_monotonic_time();
+	pkt->added = janus_get_monotonic_time_coarse();
+	/* If sampled latency tracing is on, check if this packet should be traced */
+	int trace = g_atomic_int_get(&janus_ice_trace_sampling);
+	if(trace > 0 && (guint)g_atomic_int_add(&janus_ice_trace_counter, 1) % (guint)trace == 0) {
+		pkt->traced = TRUE;
+		/* Traced packets keep a precise timestamp, as it feeds the latency accounting */
+		pkt->added = janus_get_monotonic_time();
+	}
 	janus_ice_queue_packet(handle, pkt);
 }
 
@@ -5106,9 +6120,8 @@ void janus_ice_relay_rtcp_internal(janus_ice_handle *handle, janus_ice_peerconne
 		}
 	}
 	/* Queue this packet */
-	janus_ice_queued_packet *pkt = g_malloc(sizeof(janus_ice_queued_packet));
+	janus_ice_queued_packet *pkt = janus_ice_alloc_queued_packet(rtcp_len+SRTP_MAX_TAG_LEN+4);
 	pkt->mindex = (has_medium) ? medium->mindex : packet->mindex;
-	pkt->data = g_malloc(rtcp_len+SRTP_MAX_TAG_LEN+4);
 	memcpy(pkt->data, rtcp_buf, rtcp_len);
 	pkt->length = rtcp_len;
 	pkt->type = packet->video ? JANUS_ICE_PACKET_VIDEO : JANUS_ICE_PACKET_AUDIO;
@@ -5119,7 +6132,7 @@ void janus_ice_relay_rtcp_internal(janus_ice_handle *handle, janus_ice_peerconne
 	pkt->retransmission = FALSE;
 	pkt->label = NULL;
 	pkt->protocol = NULL;
-	pkt->added = janus_get_monotonic_time();
+	pkt->added = janus_get_monotonic_time_coarse();
 	janus_ice_queue_packet(handle, pkt);
 	if(rtcp_buf != packet->buffer) {
 		/* We filtered the original packet, deallocate it */
@@ -5166,8 +6179,7 @@ void janus_ice_send_remb(janus_ice_handle *handle, uint32_t bitrate) {
 void janus_ice_relay_data(janus_ice_handle *handle, janus_plugin_data *packet) {
 	if(!handle || !handle->pc || handle->queued_packets == NULL || packet == NULL || packet->buffer == NULL || packet->length < 1)
 		return;
-	janus_ice_queued_packet *pkt = g_malloc(sizeof(janus_ice_queued_packet));
-	pkt->data = g_malloc(packet->length);
+	janus_ice_queued_packet *pkt = janus_ice_alloc_queued_packet(packet->length);
 	pkt->mindex = -1;
 	memcpy(pkt->data, packet->buffer, packet->length);
 	pkt->length = packet->length;
@@ -5179,7 +6191,9 @@ void janus_ice_relay_data(janus_ice_handle *handle, janus_plugin_data *packet) {
 	pkt->retransmission = FALSE;
 	pkt->label = packet->label ? g_strdup(packet->label) : NULL;
 	pkt->protocol = packet->protocol ? g_strdup(packet->protocol) : NULL;
-	pkt->added = janus_get_monotonic_time();
+	pkt->pr_policy = (uint16_t)packet->pr_policy;
+	pkt->pr_value = packet->pr_value;
+	pkt->added = janus_get_monotonic_time_coarse();
 	janus_ice_queue_packet(handle, pkt);
 }
 #endif
@@ -5194,8 +6208,7 @@ void janus_ice_relay_sctp(janus_ice_handle *handle, char *buffer, int length) {
 	if(!medium)	/* Queue this packet */
 		return;
 	/* Queue this packet */
-	janus_ice_queued_packet *pkt = g_malloc(sizeof(janus_ice_queued_packet));
-	pkt->data = g_malloc(length);
+	janus_ice_queued_packet *pkt = janus_ice_alloc_queued_packet(length);
 	pkt->mindex = medium->mindex;
 	memcpy(pkt->data, buffer, length);
 	pkt->length = length;
@@ -5207,7 +6220,7 @@ void janus_ice_relay_sctp(janus_ice_handle *handle, char *buffer, int length) {
 	pkt->retransmission = FALSE;
 	pkt->label = NULL;
 	pkt->protocol = NULL;
-	pkt->added = janus_get_monotonic_time();
+	pkt->added = janus_get_monotonic_time_coarse();
 	janus_ice_queue_packet(handle, pkt);
 #endif
 }
@@ -5217,11 +6230,7 @@ void janus_ice_notify_data_ready(janus_ice_handle *handle) {
 	if(!handle || handle->queued_packets == NULL)
 		return;
 	/* Queue this event */
-#if GLIB_CHECK_VERSION(2, 46, 0)
-	g_async_queue_push_front(handle->queued_packets, &janus_ice_data_ready);
-#else
-	g_async_queue_push(handle->queued_packets, &janus_ice_data_ready);
-#endif
+	janus_lfq_push_front(handle->queued_packets, &janus_ice_data_ready);
 	g_main_context_wakeup(handle->mainctx);
 #endif
 }
@@ -5230,11 +6239,7 @@ void janus_ice_notify_media_stopped(janus_ice_handle *handle) {
 	if(!handle || handle->queued_packets == NULL)
 		return;
 	/* Queue this event */
-#if GLIB_CHECK_VERSION(2, 46, 0)
-	g_async_queue_push_front(handle->queued_packets, &janus_ice_media_stopped);
-#else
-	g_async_queue_push(handle->queued_packets, &janus_ice_media_stopped);
-#endif
+	janus_lfq_push_front(handle->queued_packets, &janus_ice_media_stopped);
 	g_main_context_wakeup(handle->mainctx);
 }
 
@@ -5251,25 +6256,20 @@ void janus_ice_dtls_handshake_done(janus_ice_handle *handle) {
 		return;
 	}
 	janus_flags_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_READY);
-	/* Create a source for RTCP and one for stats */
-	handle->rtcp_source = g_timeout_source_new_seconds(1);
-	g_source_set_priority(handle->rtcp_source, G_PRIORITY_DEFAULT);
-	g_source_set_callback(handle->rtcp_source, janus_ice_outgoing_rtcp_handle, handle, NULL);
-	g_source_attach(handle->rtcp_source, handle->mainctx);
+	/* Schedule a job for RTCP and one for stats on the timer wheel */
+	handle->rtcp_job = janus_timer_wheel_add(handle->timer_wheel, 1000, TRUE,
+		janus_ice_outgoing_rtcp_handle, handle, NULL);
 	if(twcc_period != 1000) {
-		/* The Transport Wide CC feedback period is different, create another source */
-		handle->twcc_source = g_timeout_source_new(twcc_period);
-		g_source_set_priority(handle->twcc_source, G_PRIORITY_DEFAULT);
-		g_source_set_callback(handle->twcc_source, janus_ice_outgoing_transport_wide_cc_feedback, handle, NULL);
-		g_source_attach(handle->twcc_source, handle->mainctx);
+		/* The Transport Wide CC feedback period is different, schedule another job */
+		handle->twcc_job = janus_timer_wheel_add(handle->timer_wheel, twcc_period, TRUE,
+			janus_ice_outgoing_transport_wide_cc_feedback, handle, NULL);
 	}
 	handle->last_event_stats = 0;
 	handle->last_srtp_summary = -1;
-	handle->stats_source = g_timeout_source_new_seconds(1);
-	g_source_set_callback(handle->stats_source, janus_ice_outgoing_stats_handle, handle, NULL);
-	g_source_set_priority(handle->stats_source, G_PRIORITY_DEFAULT);
-	g_source_attach(handle->stats_source, handle->mainctx);
+	handle->stats_job = janus_timer_wheel_add(handle->timer_wheel, 1000, TRUE,
+		janus_ice_outgoing_stats_handle, handle, NULL);
 	janus_mutex_unlock(&handle->mutex);
+	janus_ice_handle_info_invalidate(handle);
 	JANUS_LOG(LOG_INFO, "[%"SCNu64"] The DTLS handshake has been completed\n", handle->handle_id);
 	/* Notify the plugin that the WebRTC PeerConnection is ready to be used */
 	janus_plugin *plugin = (janus_plugin *)handle->app;
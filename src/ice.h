@@ -24,11 +24,14 @@
 #include <glib.h>
 #include <agent.h>
 
+#include "bwe.h"
 #include "sdp.h"
 #include "dtls.h"
 #include "sctp.h"
 #include "rtcp.h"
 #include "text2pcap.h"
+#include "lfq.h"
+#include "timerwheel.h"
 #include "utils.h"
 #include "ip-utils.h"
 #include "refcount.h"
@@ -202,12 +205,31 @@ void janus_set_slowlink_threshold(uint packets);
 /*! \brief Method to get the current slowlink-threshold value (see above)
  * @returns The current slowlink-threshold value */
 uint janus_get_slowlink_threshold(void);
+/*! \brief Method to modify the queued-packets limit (i.e., the depth of a handle's
+ * outgoing packet queue beyond which video packets are dropped under pressure,
+ * rather than letting a slow consumer grow the queue unbounded; audio, RTCP,
+ * data and control messages are always preserved)
+ * @param[in] limit The new limit value, in packets (0=unbounded) */
+void janus_set_queued_packets_limit(uint limit);
+/*! \brief Method to get the current queued-packets limit (see above)
+ * @returns The current queued-packets limit */
+uint janus_get_queued_packets_limit(void);
 /*! \brief Method to modify the TWCC feedback period (i.e., how often TWCC feedback is sent back to media senders)
  * @param[in] period The new period value, in milliseconds */
 void janus_set_twcc_period(uint period);
 /*! \brief Method to get the current TWCC period (see above)
  * @returns The current TWCC period */
 uint janus_get_twcc_period(void);
+/*! \brief Method to configure the batching of outgoing media packets (i.e., how many
+ * protected packets can be submitted with a single sendmmsg-style syscall when draining
+ * the outgoing queue; batching is disabled by default)
+ * @param[in] packets The new batch size, in packets (0 or 1 to disable batching)
+ * @param[in] audio Whether audio packets should be batched too (they're not by default,
+ * to avoid adding latency to voice) */
+void janus_set_egress_batching(uint packets, gboolean audio);
+/*! \brief Method to get the current egress batch size (see above)
+ * @returns The current egress batch size, in packets */
+uint janus_get_egress_batching(void);
 /*! \brief Method to modify the DSCP value to set, which is disabled by default
  * @param[in] dscp The new DSCP value (0 to disable) */
 void janus_set_dscp(int dscp);
@@ -224,6 +246,25 @@ int janus_ice_get_event_stats_period(void);
  * @returns The current number of active PeerConnections */
 int janus_ice_get_peerconnection_num(void);
 
+/*! \brief Stages of the sampled latency tracing through the media pipeline */
+#define JANUS_ICE_TRACE_INGEST	0	/* From RTP ingest to the plugin handoff (parsing, extensions, lookups) */
+#define JANUS_ICE_TRACE_PLUGIN	1	/* Time spent in the plugin incoming_rtp callback */
+#define JANUS_ICE_TRACE_QUEUE	2	/* From janus_ice_relay_rtp to the packet being sent on the wire */
+#define JANUS_ICE_TRACE_STAGES	3
+/*! \brief Number of buckets of the tracing histograms:
+ * <100us, <250us, <500us, <1ms, <2ms, <5ms, <10ms, <20ms, <40ms, more */
+#define JANUS_ICE_TRACE_BUCKETS	10
+/*! \brief Method to enable sampled latency tracing: for one RTP packet every
+ * \c rate, timestamps are taken at ingest, plugin handoff and wire-out, and
+ * accumulated in per-stage histograms per handle, queryable via the Admin API
+ * (handle_info); sampling is off by default and costs a single atomic read
+ * per packet when disabled
+ * @param[in] rate Sample one packet every rate (0 to disable tracing) */
+void janus_ice_set_trace_sampling(int rate);
+/*! \brief Method to get the current latency tracing sampling rate (see above)
+ * @returns The current sampling rate (0 if tracing is disabled) */
+int janus_ice_get_trace_sampling(void);
+
 /*! \brief Method to define whether the media stats shall be dispatched in one event (true) or in dedicated single events (false - default)
  * @param[in] combine_media_stats_to_one_event true to combine media statistics in on event or false to send dedicated events */
 void janus_ice_event_set_combine_media_stats(gboolean combine_media_stats_to_one_event);
@@ -343,6 +384,37 @@ enum {
 };
 
 
+/*! \brief Per-handle memory arena: the fixed, handle-lifetime structures (the
+ * handle itself, its PeerConnection, the media and their RTCP contexts) are
+ * carved out of a single block, which keeps them close in memory and makes it
+ * possible to answer "how much RAM does this handle cost" via the Admin API.
+ * The arena is reference counted by the structures living in it, so the block
+ * is freed wholesale once the handle and all its tenants are gone */
+typedef struct janus_ice_arena {
+	/*! \brief Block all the arena allocations are carved from */
+	char *buffer;
+	/*! \brief Size of the block */
+	size_t size;
+	/*! \brief First free byte in the block */
+	size_t offset;
+	/*! \brief Allocations that didn't fit in the block and fell back to the heap */
+	GSList *overflow;
+	/*! \brief Bytes allocated from the heap because they didn't fit in the block */
+	size_t overflow_bytes;
+	/*! \brief Reference counter for this instance */
+	janus_refcount ref;
+} janus_ice_arena;
+/*! \brief Allocate a zeroed chunk out of a handle arena
+ * \note The returned memory is owned by the arena itself: it must not be
+ * freed individually, just unref the arena when its tenant is dismissed
+ * (chunks that don't fit in the block fall back to the heap, but are still
+ * owned, accounted for and eventually freed by the arena)
+ * @param[in] arena The arena to allocate from
+ * @param[in] size Size of the chunk to allocate
+ * @returns A pointer to the allocated chunk */
+void *janus_ice_arena_alloc(janus_ice_arena *arena, size_t size);
+
+
 /*! \brief Janus ICE handle */
 struct janus_ice_handle {
 	/*! \brief Opaque pointer to the core/peer session */
@@ -371,8 +443,13 @@ struct janus_ice_handle {
 	void *static_event_loop;
 	/*! \brief GLib thread for the handle and libnice */
 	GThread *thread;
-	/*! \brief GLib sources for outgoing traffic, recurring RTCP, and stats (and optionally TWCC) */
-	GSource *rtp_source, *rtcp_source, *stats_source, *twcc_source;
+	/*! \brief GLib source for outgoing traffic */
+	GSource *rtp_source;
+	/*! \brief Timer wheel of the loop this handle lives on (owned by the
+	 * handle only when each handle has its own loop, shared otherwise) */
+	janus_timer_wheel *timer_wheel;
+	/*! \brief Timer wheel jobs for recurring RTCP and stats (and optionally TWCC) */
+	janus_timer_job *rtcp_job, *stats_job, *twcc_job;
 	/*! \brief libnice ICE agent */
 	NiceAgent *agent;
 	/*! \brief Monotonic time of when the ICE agent has been created */
@@ -400,7 +477,18 @@ struct janus_ice_handle {
 	/*! \brief Queue of remote candidates that still need to be processed */
 	GAsyncQueue *queued_candidates;
 	/*! \brief Queue of events in the loop and outgoing packets to send */
-	GAsyncQueue *queued_packets;
+	janus_lfq *queued_packets;
+	/*! \brief Largest depth the outgoing packet queue has reached (high-water mark) */
+	volatile gint queued_packets_high;
+	/*! \brief Number of outgoing packets dropped because the queue was over the configured limit */
+	volatile gint queued_packets_dropped;
+	/*! \brief Keyframe checker of the video medium, cached on the handle: the
+	 * backpressure check runs on plugin threads, which can't safely walk the
+	 * PeerConnection tables to resolve the medium (written by the loop only) */
+	gboolean (* video_keyframe_checker)(const char* buffer, int len);
+	/*! \brief Histograms of sampled per-stage latencies, when tracing is on
+	 * (see janus_ice_set_trace_sampling); only ever written from the handle loop */
+	guint64 trace_latency[JANUS_ICE_TRACE_STAGES][JANUS_ICE_TRACE_BUCKETS];
 	/*! \brief Count of the recent SRTP replay errors, in order to avoid spamming the logs */
 	guint srtp_errors_count;
 	/*! \brief Count of the recent SRTP replay errors, in order to avoid spamming the logs */
@@ -411,6 +499,19 @@ struct janus_ice_handle {
 	volatile gint dump_packets;
 	/*! \brief In case this session must be saved to text2pcap, the instance to dump packets to */
 	janus_text2pcap *text2pcap;
+	/*! \brief Cached Admin API summary of the PeerConnection, so that frequent
+	 * handle_info polling doesn't rebuild the whole tree every time (protected
+	 * by the handle mutex, like the rest of the Admin API info) */
+	json_t *info_cache;
+	/*! \brief Monotonic time of when the cached summary was generated */
+	gint64 info_cache_time;
+	/*! \brief WebRTC state version the cached summary was generated at */
+	gint info_cache_version;
+	/*! \brief WebRTC state version, bumped whenever ICE, DTLS or negotiation
+	 * state changes; media stats don't count, the cache TTL covers those */
+	volatile gint info_version;
+	/*! \brief Memory arena the fixed handle state is allocated from */
+	janus_ice_arena *arena;
 	/*! \brief Mutex to lock/unlock the ICE session */
 	janus_mutex mutex;
 	/*! \brief Atomic flag to check whether a PeerConnection was established */
@@ -449,12 +550,12 @@ struct janus_ice_peerconnection {
 	gchar *selected_pair;
 	/*! \brief Whether the setup of remote candidates for this component has started or not */
 	gboolean process_started;
-	/*! \brief Timer to check when we should consider ICE as failed */
-	GSource *icestate_source;
+	/*! \brief Timer wheel job to check when we should consider ICE as failed */
+	janus_timer_job *icestate_job;
 	/*! \brief Time of when we first detected an ICE failed (we'll need this for the timer above) */
 	gint64 icefailed_detected;
-	/*! \brief Re-transmission timer for DTLS */
-	GSource *dtlsrt_source;
+	/*! \brief Re-transmission timer wheel job for DTLS */
+	janus_timer_job *dtlsrt_job;
 	/*! \brief DTLS-SRTP stack */
 	janus_dtls_srtp *dtls;
 	/*! \brief SDES mid RTP extension ID */
@@ -489,8 +590,17 @@ struct janus_ice_peerconnection {
 	guint16 transport_wide_cc_cycles;
 	/*! \brief Transport wide cc rtp ext ID */
 	guint transport_wide_cc_feedback_count;
-	/*! \brief GLib list of transport wide cc stats in reverse received order */
-	GSList *transport_wide_received_seq_nums;
+	/*! \brief Preallocated ring of arrival timestamps of incoming packets, indexed
+	 * by (extended) transport wide sequence number (a 0 means not received) */
+	guint64 *twcc_arrival_times;
+	/*! \brief Smallest transport wide seq num not reported in feedback yet */
+	guint32 twcc_first_seq_num;
+	/*! \brief Whether there's anything to report in the next feedback */
+	gboolean twcc_have_pending;
+	/*! \brief Send-side bandwidth estimator, fed from the transport wide
+	 * cc feedback the peer sends us (created lazily with the first packet
+	 * we tag with a transport wide sequence number) */
+	janus_bwe *bwe;
 	/*! \brief Latest REMB feedback we received */
 	uint32_t remb_bitrate;
 	/*! \brief DTLS role of the server for this stream */
@@ -509,6 +619,11 @@ struct janus_ice_peerconnection {
 	GHashTable *media;
 	/*! \brief GLib hash table of media (SSRCs are the keys) */
 	GHashTable *media_byssrc;
+	/*! \brief Single-entry cache of the last SSRC we received media on, and the
+	 * medium it maps to: incoming media typically arrives in bursts from the same
+	 * source, so this saves a hash table lookup per packet in the common case */
+	guint32 cached_ssrc;
+	janus_ice_peerconnection_medium *cached_medium;
 	/*! \brief GLib hash table of media (mids are the keys) */
 	GHashTable *media_bymid;
 	/*! \brief GLib hash table of media (media types are the keys)
@@ -528,6 +643,8 @@ struct janus_ice_peerconnection {
 	GQueue *nacks_queue;
 	/*! \brief Helper flag to avoid flooding the console with the same error all over again */
 	gboolean noerrorlog;
+	/*! \brief Memory arena this PeerConnection is allocated from */
+	janus_ice_arena *arena;
 	/*! \brief Mutex to lock/unlock this stream */
 	janus_mutex mutex;
 	/*! \brief Atomic flag to check if this instance has been destroyed */
@@ -585,6 +702,24 @@ struct janus_ice_peerconnection_medium {
 	gboolean send, recv;
 	/*! \brief RTCP context(s) for the medium (may be simulcasting) */
 	janus_rtcp_context *rtcp_ctx[3];
+	/*! \brief Preformatted SR/SDES and RR compounds for the periodic reports:
+	 * the layout never changes, so we build it once and only patch the dynamic
+	 * fields (SSRCs, timestamps, counters, report blocks) at every interval */
+	char rtcp_sr_template[sizeof(janus_rtcp_sr)+16];
+	char rtcp_rr_template[32];
+	/*! \brief Whether the templates above have been laid out already */
+	gboolean rtcp_templates_set;
+	/*! \brief Preformatted header extension block for outgoing RTP packets that
+	 * only carry the fixed extensions (mid, abs-send-time, transport-wide CC):
+	 * the negotiated layout doesn't change between packets, so we serialize it
+	 * once and only patch the per-packet values at precomputed offsets */
+	char ext_template[32];
+	/*! \brief Size of the preformatted extension block (0 if not built yet) */
+	uint16_t ext_template_len;
+	/*! \brief Offsets of the abs-send-time and transport-wide CC payloads in the template (0 if absent) */
+	uint16_t ext_abs_send_time_offset, ext_twcc_offset;
+	/*! \brief Extension IDs the template was built with, to detect renegotiations */
+	int ext_template_mid_id, ext_template_ast_id, ext_template_twcc_id;
 	/*! \brief Size of the NACK queue (in ms), dynamically updated per the RTT */
 	uint16_t nack_queue_ms;
 	/*! \brief Map(s) of the NACKed packets (to track retransmissions and avoid duplicates) */
@@ -601,10 +736,11 @@ struct janus_ice_peerconnection_medium {
 	guint32 last_rtp_ts;
 	/*! \brief Whether we should do NACKs (in or out) for this medium */
 	gboolean do_nacks;
-	/*! \brief List of previously sent janus_rtp_packet RTP packets, in case we receive NACKs */
-	GQueue *retransmit_buffer;
-	/*! \brief HashTable of retransmittable sequence numbers, in case we receive NACKs */
-	GHashTable *retransmit_seqs;
+	/*! \brief Circular buffer of previously sent janus_rtp_packet RTP packets,
+	 * indexed by RTP sequence number, in case we receive NACKs */
+	janus_rtp_packet **retransmit_ring;
+	/*! \brief Sequence number currently stored in each slot of the ring */
+	guint16 *retransmit_ring_seqs;
 	/*! \brief Current sequence number for the RFC4588 rtx SSRC session */
 	guint16 rtx_seq_number;
 	/*! \brief Last time a log message about sending retransmits was printed */
@@ -623,6 +759,8 @@ struct janus_ice_peerconnection_medium {
 	janus_ice_stats out_stats;
 	/*! \brief Helper flag to avoid flooding the console with the same error all over again */
 	gboolean noerrorlog;
+	/*! \brief Memory arena this medium is allocated from */
+	janus_ice_arena *arena;
 	/*! \brief Mutex to lock/unlock this medium */
 	janus_mutex mutex;
 	/*! \brief Atomic flag to check if this instance has been destroyed */
@@ -696,6 +834,12 @@ gint janus_ice_handle_destroy(void *core_session, janus_ice_handle *handle);
  * @param[in] handle The Janus ICE handle instance managing the WebRTC PeerConnection to hangup
  * @param[in] reason A description of why this happened */
 void janus_ice_webrtc_hangup(janus_ice_handle *handle, const char *reason);
+/*! \brief Method to mark the cached Admin API summary of a handle as stale
+ * \details Invoked whenever ICE, DTLS or negotiation state changes, so that
+ * the next handle_info request regenerates the summary instead of serving
+ * the cached one: cheap enough to be called from the media loop
+ * @param[in] handle The Janus ICE handle whose state changed */
+void janus_ice_handle_info_invalidate(janus_ice_handle *handle);
 /*! \brief Method to only free resources related to a specific Webrtc PeerConnection allocated by a Janus ICE handle
  * @param[in] pc The Janus ICE component instance to free */
 void janus_ice_peerconnection_destroy(janus_ice_peerconnection *pc);
@@ -794,6 +938,34 @@ void janus_ice_resend_trickles(janus_ice_handle *handle);
  * @param[in] loops The number of static event loops to start (0 to disable the feature)
  * @param[in] allow_api Whether allocation on a specific loop driven via API should be allowed or not (false by default) */
 void janus_ice_set_static_event_loops(int loops, gboolean allow_api);
+/*! \brief Method to configure the CPU cores static event loop threads should
+ * be pinned to, to be invoked before janus_ice_set_static_event_loops
+ * @note This is only supported on Linux: on other platforms the setting is
+ * ignored with a warning. Cores are assigned to loops round-robin, so e.g.
+ * on a dual-socket machine you can keep all loops on the NUMA node the NIC
+ * interrupts are routed to
+ * @param[in] cores Comma-separated list of cores and/or ranges (e.g., "0,2,4-7") */
+void janus_ice_set_static_event_loops_affinity(const char *cores);
+/*! \brief Method to make the static event loop threads busy-spin on their
+ * context instead of sleeping in poll, to be invoked before janus_ice_set_static_event_loops
+ * @note This burns a full CPU core per loop, so it only makes sense for
+ * latency-critical deployments that pin the loops to dedicated cores
+ * @param[in] spin Whether the loop threads should busy-spin */
+void janus_ice_set_static_event_loops_spin(gboolean spin);
+/*! \brief Method to configure the size of the prewarmed ICE agent pool each
+ * static event loop should keep, to be invoked before janus_ice_set_static_event_loops
+ * @note Agents are permanently bound to their GMainContext when created, so
+ * prewarming requires static event loops: the setting is ignored when each
+ * handle gets its own dedicated loop
+ * @param[in] size How many prewarmed agents each loop should keep (0 to disable) */
+void janus_ice_set_agent_pool_size(int size);
+/*! \brief Method to configure a busy-poll budget for the media sockets
+ * (SO_BUSY_POLL): when set, the kernel busy-polls the device queue for that
+ * long before sleeping, cutting the wakeup latency on incoming media
+ * @note This is only effective on Linux, with a libnice version that can
+ * hand over the candidate sockets: elsewhere the setting is ignored with a warning
+ * @param[in] busy_poll The busy-poll budget in microseconds (0 to disable) */
+void janus_ice_set_busy_poll(int busy_poll);
 /*! \brief Method to return the number of static event loops, if enabled
  * @returns The number of static event loops, if configured, or 0 if the feature is disabled */
 int janus_ice_get_static_event_loops(void);
@@ -804,6 +976,12 @@ gboolean janus_ice_is_loop_indication_allowed(void);
  * @note This is only used by the Admin API
  * @returns a json_t array with the required info */
 json_t *janus_ice_static_event_loops_info(void);
+/*! \brief Helper method to force a refresh of the load estimates of the static
+ * loops, which drive how new handles are distributed across them
+ * @note This is only used by the Admin API: existing handles are not migrated,
+ * as their libnice agent is bound to the loop context they were created on
+ * @returns a json_t array with the updated info */
+json_t *janus_ice_static_event_loops_rebalance(void);
 /*! \brief Method to stop all the static event loops, if enabled
  * @note This will wait for the related threads to exit, and so may delay the shutdown process */
 void janus_ice_stop_static_event_loops(void);
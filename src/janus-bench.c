@@ -0,0 +1,373 @@
+/*! \file    janus-bench.c
+ * \author   Lorenzo Miniero <lorenzo@meetecho.com>
+ * \copyright GNU General Public License v3
+ * \brief    Microbenchmarks for per-packet primitives
+ * \details  Utility that benchmarks the primitives every packet in the
+ * media path goes through: RTP header extension parsing, RTCP SSRC
+ * fixing and NACK parsing, SDP parsing and serialization, SRTP
+ * protect/unprotect, and reference counting. Each benchmark runs a fixed
+ * number of iterations, timing them both with the monotonic clock and,
+ * where the architecture allows it, with the CPU cycle counter, and the
+ * results are emitted as a JSON report so that runs on different commits
+ * can be diffed: per-packet regressions in these helpers are invisible
+ * in functional testing and only show up at scale, so comparing these
+ * numbers before and after a change is much cheaper than finding out in
+ * production. The easiest way to run the suite is \c make \c bench :
+ *
+\verbatim
+make bench
+./janus-bench -o baseline.json
+\endverbatim
+ *
+ * \note The \c srtp_protect_unprotect benchmark measures a full
+ * round-trip, as replay protection prevents unprotecting the same
+ * ciphertext twice: diff it against \c srtp_protect to estimate the
+ * cost of unprotect alone.
+ *
+ * \ingroup tools
+ * \ref tools
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#include <glib.h>
+#include <jansson.h>
+
+#include "rtp.h"
+#include "rtcp.h"
+#include "rtpsrtp.h"
+#include "sdp-utils.h"
+#include "refcount.h"
+#include "debug.h"
+#include "utils.h"
+#include "version.h"
+
+int janus_log_level = 4;
+gboolean janus_log_timestamps = FALSE;
+gboolean janus_log_colors = TRUE;
+char *janus_log_global_prefix = NULL;
+int lock_debug = 0;
+int refcount_debug = 0;
+
+/* Options */
+static const char *bench_report_file = "-";
+static guint64 bench_iterations = 1000000;
+
+/* Reading the CPU cycle counter, where we know how to */
+#if defined(__x86_64__) || defined(__i386__)
+static inline guint64 bench_cycles(void) {
+	guint32 lo = 0, hi = 0;
+	__asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+	return ((guint64)hi << 32) | lo;
+}
+#elif defined(__aarch64__)
+static inline guint64 bench_cycles(void) {
+	guint64 value = 0;
+	__asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(value));
+	return value;
+}
+#else
+static inline guint64 bench_cycles(void) {
+	return 0;
+}
+#endif
+
+/* Helper to add the results of a benchmark to the report */
+static void bench_add_result(json_t *benchmarks, const char *name,
+		guint64 iterations, gint64 elapsed, guint64 cycles) {
+	json_t *result = json_object();
+	json_object_set_new(result, "iterations", json_integer(iterations));
+	json_object_set_new(result, "total_us", json_integer(elapsed));
+	json_object_set_new(result, "ns_per_op",
+		json_real(iterations ? (gdouble)elapsed*1000/(gdouble)iterations : 0));
+	json_object_set_new(result, "cycles_per_op",
+		json_real(iterations ? (gdouble)cycles/(gdouble)iterations : 0));
+	json_object_set_new(benchmarks, name, result);
+	JANUS_LOG(LOG_INFO, "  %-24s %8.1f ns/op, %8.1f cycles/op\n", name,
+		iterations ? (gdouble)elapsed*1000/(gdouble)iterations : 0,
+		iterations ? (gdouble)cycles/(gdouble)iterations : 0);
+}
+
+/* Prevent the compiler from optimizing a benchmarked result away */
+static volatile int bench_sink = 0;
+
+/* RTP header extension parsing (one scan of a packet carrying
+ * audio-level, transport-wide CC and mid extensions) */
+static void bench_rtp_extensions(json_t *benchmarks) {
+	char packet[64];
+	memset(packet, 0, sizeof(packet));
+	janus_rtp_header *header = (janus_rtp_header *)packet;
+	header->version = 2;
+	header->extension = 1;
+	header->type = 111;
+	header->seq_number = htons(1);
+	header->timestamp = htonl(960);
+	header->ssrc = htonl(2468);
+	/* One-byte extensions block: audio-level (1), twcc (3), mid (4) */
+	janus_rtp_header_extension *ext = (janus_rtp_header_extension *)(packet + 12);
+	ext->type = htons(0xBEDE);
+	ext->length = htons(3);
+	char *extdata = packet + 16;
+	extdata[0] = (1 << 4);	/* audio-level, 1 byte */
+	extdata[1] = 0x80 | 42;
+	extdata[2] = (3 << 4) | 1;	/* transport-wide CC, 2 bytes */
+	extdata[3] = 0x12;
+	extdata[4] = 0x34;
+	extdata[5] = (4 << 4) | 2;	/* mid, 3 bytes */
+	extdata[6] = 'a';
+	extdata[7] = 'b';
+	extdata[8] = 'c';
+	int len = 12 + 4 + 12;
+	janus_rtp_header_extension_index index;
+	gboolean vad = FALSE;
+	int level = 0;
+	uint16_t transseq = 0;
+	guint64 i = 0, start_cycles = bench_cycles();
+	gint64 start = janus_get_monotonic_time();
+	for(i = 0; i < bench_iterations; i++) {
+		bench_sink += janus_rtp_header_extension_parse_all(packet, len, &index);
+		bench_sink += janus_rtp_header_extension_read_audio_level(&index, 1, &vad, &level);
+		bench_sink += janus_rtp_header_extension_read_transport_wide_cc(&index, 3, &transseq);
+	}
+	bench_add_result(benchmarks, "rtp_extension_parse", bench_iterations,
+		janus_get_monotonic_time() - start, bench_cycles() - start_cycles);
+}
+
+/* RTCP SSRC rewriting on a compound SR+SDES packet */
+static void bench_rtcp_fix_ssrc(json_t *benchmarks) {
+	char packet[40];
+	memset(packet, 0, sizeof(packet));
+	janus_rtcp_header *sr = (janus_rtcp_header *)packet;
+	sr->version = 2;
+	sr->type = RTCP_SR;
+	sr->length = htons(6);
+	janus_rtcp_header *sdes = (janus_rtcp_header *)(packet + 28);
+	sdes->version = 2;
+	sdes->type = RTCP_SDES;
+	sdes->rc = 1;
+	sdes->length = htons(2);
+	int len = sizeof(packet);
+	guint64 i = 0, start_cycles = bench_cycles();
+	gint64 start = janus_get_monotonic_time();
+	for(i = 0; i < bench_iterations; i++) {
+		bench_sink += janus_rtcp_fix_ssrc(NULL, packet, len, 1, 1234, 5678);
+	}
+	bench_add_result(benchmarks, "rtcp_fix_ssrc", bench_iterations,
+		janus_get_monotonic_time() - start, bench_cycles() - start_cycles);
+}
+
+/* RTCP NACK parsing (one FCI entry with a full bitmask, 17 sequence numbers) */
+static void bench_rtcp_get_nacks(json_t *benchmarks) {
+	char packet[16];
+	memset(packet, 0, sizeof(packet));
+	janus_rtcp_header *rtcp = (janus_rtcp_header *)packet;
+	rtcp->version = 2;
+	rtcp->type = RTCP_RTPFB;
+	rtcp->rc = 1;	/* Generic NACK */
+	rtcp->length = htons(3);
+	packet[12] = 0x01;	/* PID */
+	packet[13] = 0x00;
+	packet[14] = 0xFF;	/* BLP */
+	packet[15] = 0xFF;
+	int len = sizeof(packet);
+	GQueue *nacks = g_queue_new();
+	guint64 i = 0, start_cycles = bench_cycles();
+	gint64 start = janus_get_monotonic_time();
+	for(i = 0; i < bench_iterations; i++) {
+		janus_rtcp_get_nacks(packet, len, nacks);
+		bench_sink += g_queue_get_length(nacks);
+	}
+	bench_add_result(benchmarks, "rtcp_get_nacks", bench_iterations,
+		janus_get_monotonic_time() - start, bench_cycles() - start_cycles);
+	g_queue_free(nacks);
+}
+
+/* SDP parsing and serialization of a typical audio+video offer */
+static void bench_sdp(json_t *benchmarks) {
+	const char *offer =
+		"v=0\r\no=- 1234567890 1 IN IP4 127.0.0.1\r\ns=Bench\r\nt=0 0\r\n"
+		"m=audio 9 UDP/TLS/RTP/SAVPF 111\r\nc=IN IP4 127.0.0.1\r\n"
+		"a=rtpmap:111 opus/48000/2\r\na=fmtp:111 useinbandfec=1\r\n"
+		"a=extmap:1 urn:ietf:params:rtp-hdrext:ssrc-audio-level\r\n"
+		"a=sendrecv\r\na=mid:audio\r\n"
+		"m=video 9 UDP/TLS/RTP/SAVPF 96 97\r\nc=IN IP4 127.0.0.1\r\n"
+		"a=rtpmap:96 VP8/90000\r\na=rtpmap:97 rtx/90000\r\na=fmtp:97 apt=96\r\n"
+		"a=rtcp-fb:96 nack\r\na=rtcp-fb:96 nack pli\r\na=rtcp-fb:96 goog-remb\r\n"
+		"a=extmap:3 http://www.ietf.org/id/draft-holmer-rmcat-transport-wide-cc-extensions-01\r\n"
+		"a=sendrecv\r\na=mid:video\r\n";
+	char error[512];
+	/* Parsing and writing allocate, so fewer iterations are plenty */
+	guint64 iterations = bench_iterations/10;
+	guint64 i = 0, start_cycles = bench_cycles();
+	gint64 start = janus_get_monotonic_time();
+	for(i = 0; i < iterations; i++) {
+		janus_sdp *sdp = janus_sdp_parse(offer, error, sizeof(error));
+		if(sdp == NULL) {
+			JANUS_LOG(LOG_ERR, "Error parsing benchmark SDP: %s\n", error);
+			return;
+		}
+		char *rendered = janus_sdp_write(sdp);
+		bench_sink += strlen(rendered);
+		g_free(rendered);
+		janus_sdp_destroy(sdp);
+	}
+	bench_add_result(benchmarks, "sdp_parse_write", iterations,
+		janus_get_monotonic_time() - start, bench_cycles() - start_cycles);
+}
+
+/* SRTP protect, and protect+unprotect round-trip, on a 1200 byte packet
+ * with AES128-CM-SHA1-80 (the most commonly negotiated profile) */
+static void bench_srtp(json_t *benchmarks) {
+	uint8_t key[SRTP_MASTER_LENGTH];
+	memset(key, 0x24, sizeof(key));
+	srtp_policy_t out_policy, in_policy;
+	memset(&out_policy, 0, sizeof(out_policy));
+	srtp_crypto_policy_set_aes_cm_128_hmac_sha1_80(&(out_policy.rtp));
+	srtp_crypto_policy_set_aes_cm_128_hmac_sha1_80(&(out_policy.rtcp));
+	out_policy.ssrc.type = ssrc_any_outbound;
+	out_policy.key = key;
+	memset(&in_policy, 0, sizeof(in_policy));
+	srtp_crypto_policy_set_aes_cm_128_hmac_sha1_80(&(in_policy.rtp));
+	srtp_crypto_policy_set_aes_cm_128_hmac_sha1_80(&(in_policy.rtcp));
+	in_policy.ssrc.type = ssrc_any_inbound;
+	in_policy.key = key;
+	srtp_t srtp_out = NULL, srtp_in = NULL;
+	if(srtp_create(&srtp_out, &out_policy) != srtp_err_status_ok ||
+			srtp_create(&srtp_in, &in_policy) != srtp_err_status_ok) {
+		JANUS_LOG(LOG_ERR, "Error creating SRTP sessions, skipping SRTP benchmarks\n");
+		return;
+	}
+	char template[1200], buffer[1200 + SRTP_MAX_TRAILER_LEN];
+	memset(template, 0x11, sizeof(template));
+	janus_rtp_header *header = (janus_rtp_header *)template;
+	memset(header, 0, sizeof(*header));
+	header->version = 2;
+	header->type = 96;
+	header->ssrc = htonl(1357);
+	/* Crypto is expensive, so fewer iterations are plenty: mind the
+	 * sequence number, though, replay protection hates reuse */
+	guint64 iterations = bench_iterations/10;
+	if(iterations > 400000)
+		iterations = 400000;
+	guint16 seq = 0;
+	guint64 i = 0, start_cycles = bench_cycles();
+	gint64 start = janus_get_monotonic_time();
+	for(i = 0; i < iterations; i++) {
+		header->seq_number = htons(seq++);
+		memcpy(buffer, template, sizeof(template));
+		int len = sizeof(template);
+		bench_sink += srtp_protect(srtp_out, buffer, &len);
+	}
+	bench_add_result(benchmarks, "srtp_protect", iterations,
+		janus_get_monotonic_time() - start, bench_cycles() - start_cycles);
+	srtp_dealloc(srtp_out);
+	if(srtp_create(&srtp_out, &out_policy) != srtp_err_status_ok) {
+		JANUS_LOG(LOG_ERR, "Error recreating the SRTP session, skipping the round-trip benchmark\n");
+		srtp_dealloc(srtp_in);
+		return;
+	}
+	seq = 0;
+	start_cycles = bench_cycles();
+	start = janus_get_monotonic_time();
+	for(i = 0; i < iterations; i++) {
+		header->seq_number = htons(seq++);
+		memcpy(buffer, template, sizeof(template));
+		int len = sizeof(template);
+		bench_sink += srtp_protect(srtp_out, buffer, &len);
+		bench_sink += srtp_unprotect(srtp_in, buffer, &len);
+	}
+	bench_add_result(benchmarks, "srtp_protect_unprotect", iterations,
+		janus_get_monotonic_time() - start, bench_cycles() - start_cycles);
+	srtp_dealloc(srtp_out);
+	srtp_dealloc(srtp_in);
+}
+
+/* Reference counting (an increase/decrease pair on a private counter) */
+typedef struct bench_refcounted {
+	janus_refcount ref;
+} bench_refcounted;
+static void bench_refcounted_free(const janus_refcount *counter) {
+	bench_refcounted *object = janus_refcount_containerof(counter, bench_refcounted, ref);
+	g_free(object);
+}
+static void bench_refcount(json_t *benchmarks) {
+	bench_refcounted *object = g_malloc0(sizeof(bench_refcounted));
+	janus_refcount_init(&object->ref, bench_refcounted_free);
+	guint64 i = 0, start_cycles = bench_cycles();
+	gint64 start = janus_get_monotonic_time();
+	for(i = 0; i < bench_iterations; i++) {
+		janus_refcount_increase(&object->ref);
+		janus_refcount_decrease(&object->ref);
+	}
+	bench_add_result(benchmarks, "refcount_inc_dec", bench_iterations,
+		janus_get_monotonic_time() - start, bench_cycles() - start_cycles);
+	janus_refcount_decrease(&object->ref);
+}
+
+/* Main Code */
+int main(int argc, char *argv[]) {
+	JANUS_LOG(LOG_INFO, "Janus microbenchmarks version %s (%s)\n", janus_version_string, janus_build_git_sha);
+	int opt = 0;
+	while((opt = getopt(argc, argv, "i:o:h")) != -1) {
+		switch(opt) {
+			case 'i':
+				bench_iterations = g_ascii_strtoull(optarg, NULL, 10);
+				break;
+			case 'o':
+				bench_report_file = optarg;
+				break;
+			case 'h':
+			default:
+				JANUS_LOG(LOG_INFO, "Usage: %s [options]\n", argv[0]);
+				JANUS_LOG(LOG_INFO, "  -i <count>  Base number of iterations (default: %"SCNu64")\n", bench_iterations);
+				JANUS_LOG(LOG_INFO, "  -o <file>   Where to write the JSON report, - for stdout (default: %s)\n", bench_report_file);
+				exit(opt == 'h' ? 0 : 1);
+		}
+	}
+	if(bench_iterations < 1000) {
+		JANUS_LOG(LOG_FATAL, "Too few iterations for meaningful numbers (at least 1000)\n");
+		exit(1);
+	}
+	if(srtp_init() != srtp_err_status_ok) {
+		JANUS_LOG(LOG_FATAL, "Error initializing libsrtp\n");
+		exit(1);
+	}
+	JANUS_LOG(LOG_INFO, "Running benchmarks (%"SCNu64" iterations)\n", bench_iterations);
+	json_t *benchmarks = json_object();
+	bench_rtp_extensions(benchmarks);
+	bench_rtcp_fix_ssrc(benchmarks);
+	bench_rtcp_get_nacks(benchmarks);
+	bench_sdp(benchmarks);
+	bench_srtp(benchmarks);
+	bench_refcount(benchmarks);
+	/* Done, build and emit the report */
+	json_t *report = json_object();
+	json_object_set_new(report, "version", json_string(janus_version_string));
+	json_object_set_new(report, "commit", json_string(janus_build_git_sha));
+	json_object_set_new(report, "iterations", json_integer(bench_iterations));
+	json_object_set_new(report, "benchmarks", benchmarks);
+	char *dump = json_dumps(report, JSON_INDENT(2) | JSON_PRESERVE_ORDER);
+	json_decref(report);
+	if(!strcmp(bench_report_file, "-")) {
+		JANUS_PRINT("%s\n", dump);
+	} else {
+		FILE *file = fopen(bench_report_file, "wt");
+		if(file == NULL) {
+			JANUS_LOG(LOG_ERR, "Error opening report file '%s': %d (%s)\n",
+				bench_report_file, errno, g_strerror(errno));
+			JANUS_PRINT("%s\n", dump);
+		} else {
+			fwrite(dump, sizeof(char), strlen(dump), file);
+			fwrite("\n", sizeof(char), 1, file);
+			fclose(file);
+			JANUS_LOG(LOG_INFO, "Report written to %s\n", bench_report_file);
+		}
+	}
+	free(dump);
+	srtp_shutdown();
+	exit(0);
+}
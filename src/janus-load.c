@@ -0,0 +1,497 @@
+/*! \file    janus-load.c
+ * \author   Lorenzo Miniero <lorenzo@meetecho.com>
+ * \copyright GNU General Public License v3
+ * \brief    Simple load generator for Janus instances
+ * \details  Utility to drive a target Janus instance over WebSockets for
+ * benchmarking purposes: it creates a configurable number of sessions and
+ * handles against the EchoTest or VideoRoom plugin, keeps them alive, and
+ * keeps issuing signalling requests on each of them, measuring the
+ * request/response latency of every transaction. Optionally, it can also
+ * pump synthetic RTP traffic at a configured bitrate towards a UDP address
+ * (e.g., a Streaming mountpoint or a remote publisher port), to put load
+ * on the media path as well. At the end of the run, a machine-readable
+ * JSON report with the latency distribution is emitted, so that runs on
+ * different versions or tunings can be compared.
+ *
+ * Using the utility is quite simple, e.g.:
+ *
+\verbatim
+./janus-load -u ws://127.0.0.1:8188/ -n 100 -P echotest -d 60 -o report.json
+\endverbatim
+ *
+ * drives 100 EchoTest sessions for a minute and writes the report to
+ * \c report.json (use \c - , the default, for stdout).
+ *
+ * \note This tool only exercises the signalling plane and, optionally, a
+ * plain RTP pump: it doesn't negotiate full PeerConnections, as that would
+ * require a complete client-side WebRTC stack.
+ *
+ * \ingroup tools
+ * \ref tools
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <glib.h>
+#include <jansson.h>
+#include <libwebsockets.h>
+
+#include "debug.h"
+#include "utils.h"
+#include "version.h"
+
+int janus_log_level = 4;
+gboolean janus_log_timestamps = FALSE;
+gboolean janus_log_colors = TRUE;
+char *janus_log_global_prefix = NULL;
+int lock_debug = 0;
+
+/* Options */
+static const char *load_url = "ws://127.0.0.1:8188/";
+static const char *load_plugin = "echotest";
+static const char *load_report = "-";
+static const char *load_media_target = NULL;
+static int load_sessions = 10, load_duration = 30,
+	load_keepalive = 25, load_room = 1234, load_bitrate = 512;
+
+/* State of each session we're driving */
+typedef enum load_session_state {
+	LOAD_STARTING = 0,
+	LOAD_CREATING,
+	LOAD_ATTACHING,
+	LOAD_RUNNING
+} load_session_state;
+typedef struct load_session {
+	load_session_state state;
+	guint64 session_id;
+	guint64 handle_id;
+	gint64 last_keepalive;
+	gint64 last_message;
+} load_session;
+static load_session *sessions = NULL;
+
+/* Transactions in flight (transaction string -> monotonic time it was sent) */
+static GHashTable *transactions = NULL;
+/* Collected request/response latencies, in microseconds */
+static GArray *latencies = NULL;
+static guint64 requests = 0, responses = 0, events = 0;
+
+/* WebSocket connection */
+static struct lws *wsconn = NULL;
+static GAsyncQueue *outgoing = NULL;
+static GString *incoming = NULL;
+static volatile gint connected = 0, closed = 0, done = 0;
+
+/* Media pump stats */
+static guint64 media_packets = 0, media_bytes = 0;
+
+/* Helper to queue an outgoing request, tagging it with a new transaction */
+static void load_send(json_t *message) {
+	char *transaction = janus_random_uuid();
+	json_object_set_new(message, "transaction", json_string(transaction));
+	g_hash_table_insert(transactions, transaction,
+		janus_uint64_dup(janus_get_monotonic_time()));
+	requests++;
+	char *payload = json_dumps(message, JSON_COMPACT | JSON_PRESERVE_ORDER);
+	json_decref(message);
+	g_async_queue_push(outgoing, payload);
+	if(wsconn != NULL)
+		lws_callback_on_writable(wsconn);
+}
+
+/* Helper to process a message coming from the Janus instance */
+static void load_incoming(const char *payload) {
+	json_error_t error;
+	json_t *message = json_loads(payload, 0, &error);
+	if(message == NULL) {
+		JANUS_LOG(LOG_WARN, "Error parsing incoming message: %s\n", error.text);
+		return;
+	}
+	/* If there's a transaction we know about, track the round-trip time */
+	const char *transaction = json_string_value(json_object_get(message, "transaction"));
+	guint64 *sent = transaction ? g_hash_table_lookup(transactions, transaction) : NULL;
+	if(sent != NULL) {
+		gdouble latency = (gdouble)(janus_get_monotonic_time() - *sent);
+		g_array_append_val(latencies, latency);
+		g_hash_table_remove(transactions, transaction);
+		responses++;
+	} else {
+		events++;
+	}
+	const char *janus_text = json_string_value(json_object_get(message, "janus"));
+	guint64 session_id = json_integer_value(json_object_get(message, "session_id"));
+	if(janus_text != NULL && !strcasecmp(janus_text, "error")) {
+		json_t *err = json_object_get(message, "error");
+		JANUS_LOG(LOG_WARN, "Got an error: %s\n",
+			json_string_value(json_object_get(err, "reason")));
+	}
+	/* Move the related session along its state machine */
+	int i = 0;
+	for(i = 0; i < load_sessions; i++) {
+		load_session *ls = &sessions[i];
+		if(ls->state == LOAD_CREATING && session_id == 0 &&
+				janus_text != NULL && !strcasecmp(janus_text, "success") &&
+				ls->session_id == 0) {
+			/* Take this as the answer to the oldest pending "create" */
+			ls->session_id = json_integer_value(json_object_get(json_object_get(message, "data"), "id"));
+			if(ls->session_id == 0)
+				continue;
+			/* Attach a handle to the plugin */
+			json_t *attach = json_object();
+			json_object_set_new(attach, "janus", json_string("attach"));
+			json_object_set_new(attach, "session_id", json_integer(ls->session_id));
+			char plugin[64];
+			g_snprintf(plugin, sizeof(plugin), "janus.plugin.%s", load_plugin);
+			json_object_set_new(attach, "plugin", json_string(plugin));
+			ls->state = LOAD_ATTACHING;
+			load_send(attach);
+			break;
+		} else if(ls->state == LOAD_ATTACHING && session_id == ls->session_id &&
+				janus_text != NULL && !strcasecmp(janus_text, "success")) {
+			ls->handle_id = json_integer_value(json_object_get(json_object_get(message, "data"), "id"));
+			if(ls->handle_id == 0)
+				continue;
+			ls->state = LOAD_RUNNING;
+			ls->last_keepalive = janus_get_monotonic_time();
+			break;
+		}
+	}
+	json_decref(message);
+}
+
+/* Periodic tick: start new sessions, send keepalives and plugin messages */
+static void load_tick(void) {
+	gint64 now = janus_get_monotonic_time();
+	int i = 0;
+	for(i = 0; i < load_sessions; i++) {
+		load_session *ls = &sessions[i];
+		if(ls->state == LOAD_STARTING) {
+			/* Create sessions one at a time, so that we can match answers */
+			if(i > 0 && sessions[i-1].state < LOAD_RUNNING)
+				break;
+			json_t *create = json_object();
+			json_object_set_new(create, "janus", json_string("create"));
+			ls->state = LOAD_CREATING;
+			load_send(create);
+			break;
+		}
+		if(ls->state != LOAD_RUNNING)
+			continue;
+		if(now - ls->last_keepalive > (gint64)load_keepalive*G_USEC_PER_SEC) {
+			ls->last_keepalive = now;
+			json_t *keepalive = json_object();
+			json_object_set_new(keepalive, "janus", json_string("keepalive"));
+			json_object_set_new(keepalive, "session_id", json_integer(ls->session_id));
+			load_send(keepalive);
+		}
+		if(now - ls->last_message > G_USEC_PER_SEC) {
+			/* Issue a cheap plugin request every second, to generate load */
+			ls->last_message = now;
+			json_t *message = json_object();
+			json_object_set_new(message, "janus", json_string("message"));
+			json_object_set_new(message, "session_id", json_integer(ls->session_id));
+			json_object_set_new(message, "handle_id", json_integer(ls->handle_id));
+			json_t *body = json_object();
+			if(!strcasecmp(load_plugin, "videoroom")) {
+				json_object_set_new(body, "request", json_string("listparticipants"));
+				json_object_set_new(body, "room", json_integer(load_room));
+			} else {
+				json_object_set_new(body, "audio", json_true());
+				json_object_set_new(body, "video", json_true());
+			}
+			json_object_set_new(message, "body", body);
+			load_send(message);
+		}
+	}
+}
+
+/* WebSocket client callback */
+static int load_ws_callback(struct lws *wsi, enum lws_callback_reasons reason,
+		void *user, void *in, size_t len) {
+	switch(reason) {
+		case LWS_CALLBACK_CLIENT_ESTABLISHED:
+			JANUS_LOG(LOG_INFO, "Connected to %s\n", load_url);
+			g_atomic_int_set(&connected, 1);
+			break;
+		case LWS_CALLBACK_CLIENT_RECEIVE:
+			g_string_append_len(incoming, (char *)in, len);
+			if(lws_is_final_fragment(wsi) && lws_remaining_packet_payload(wsi) == 0) {
+				load_incoming(incoming->str);
+				g_string_truncate(incoming, 0);
+			}
+			break;
+		case LWS_CALLBACK_CLIENT_WRITEABLE: {
+			char *payload = g_async_queue_try_pop(outgoing);
+			if(payload != NULL) {
+				size_t plen = strlen(payload);
+				unsigned char *buffer = g_malloc(LWS_PRE + plen);
+				memcpy(buffer + LWS_PRE, payload, plen);
+				lws_write(wsi, buffer + LWS_PRE, plen, LWS_WRITE_TEXT);
+				g_free(buffer);
+				g_free(payload);
+				if(g_async_queue_length(outgoing) > 0)
+					lws_callback_on_writable(wsi);
+			}
+			break;
+		}
+		case LWS_CALLBACK_CLIENT_CONNECTION_ERROR:
+			JANUS_LOG(LOG_FATAL, "Error connecting to %s: %s\n",
+				load_url, in ? (char *)in : "??");
+			g_atomic_int_set(&closed, 1);
+			break;
+		case LWS_CALLBACK_CLIENT_CLOSED:
+			JANUS_LOG(LOG_INFO, "Connection to %s closed\n", load_url);
+			g_atomic_int_set(&closed, 1);
+			break;
+		default:
+			break;
+	}
+	return 0;
+}
+static struct lws_protocols load_protocols[] = {
+	{ "janus-protocol", load_ws_callback, 0, 65536, 0, NULL, 0 },
+	{ NULL, NULL, 0, 0, 0, NULL, 0 }
+};
+
+/* Synthetic RTP pump towards the configured UDP address */
+static gpointer load_media_thread(gpointer user_data) {
+	char host[256];
+	g_snprintf(host, sizeof(host), "%s", load_media_target);
+	char *colon = strrchr(host, ':');
+	uint16_t port = colon ? atoi(colon+1) : 0;
+	if(colon)
+		*colon = '\0';
+	if(port == 0) {
+		JANUS_LOG(LOG_WARN, "Invalid media target '%s', not pumping media\n", load_media_target);
+		return NULL;
+	}
+	int fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if(fd < 0) {
+		JANUS_LOG(LOG_WARN, "Error creating media socket: %d (%s)\n", errno, g_strerror(errno));
+		return NULL;
+	}
+	struct sockaddr_in addr = { 0 };
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	inet_pton(AF_INET, host, &addr.sin_addr);
+	/* Prepare an RTP packet with a synthetic payload: at the configured
+	 * bitrate, we send 1200-byte packets at the resulting interval */
+	char packet[1200];
+	memset(packet, 0, sizeof(packet));
+	packet[0] = 0x80;
+	packet[1] = 96;
+	guint32 ssrc = htonl(janus_random_uint32());
+	memcpy(packet + 8, &ssrc, sizeof(ssrc));
+	guint16 seq = 0;
+	guint32 ts = 0;
+	gint64 interval = ((gint64)sizeof(packet)*8*1000)/load_bitrate;	/* In microseconds */
+	JANUS_LOG(LOG_INFO, "Pumping ~%d kbit/s of synthetic RTP to %s\n", load_bitrate, load_media_target);
+	while(!g_atomic_int_get(&done)) {
+		seq++;
+		ts += 3000;
+		guint16 nseq = htons(seq);
+		memcpy(packet + 2, &nseq, sizeof(nseq));
+		guint32 nts = htonl(ts);
+		memcpy(packet + 4, &nts, sizeof(nts));
+		if(sendto(fd, packet, sizeof(packet), 0, (struct sockaddr *)&addr, sizeof(addr)) > 0) {
+			media_packets++;
+			media_bytes += sizeof(packet);
+		}
+		g_usleep(interval);
+	}
+	close(fd);
+	return NULL;
+}
+
+/* Helpers to compute the latency distribution */
+static int load_latency_sort(gconstpointer a, gconstpointer b) {
+	gdouble la = *(gdouble *)a, lb = *(gdouble *)b;
+	return la < lb ? -1 : (la > lb ? 1 : 0);
+}
+static gdouble load_latency_percentile(GArray *sorted, int percentile) {
+	if(sorted->len == 0)
+		return 0;
+	guint index = (sorted->len * percentile) / 100;
+	if(index >= sorted->len)
+		index = sorted->len - 1;
+	return g_array_index(sorted, gdouble, index);
+}
+
+/* Main Code */
+int main(int argc, char *argv[]) {
+	JANUS_LOG(LOG_INFO, "Janus load generator version %s (%s)\n", janus_version_string, janus_build_git_sha);
+	int opt = 0;
+	while((opt = getopt(argc, argv, "u:n:P:R:d:k:M:b:o:h")) != -1) {
+		switch(opt) {
+			case 'u':
+				load_url = optarg;
+				break;
+			case 'n':
+				load_sessions = atoi(optarg);
+				break;
+			case 'P':
+				load_plugin = optarg;
+				break;
+			case 'R':
+				load_room = atoi(optarg);
+				break;
+			case 'd':
+				load_duration = atoi(optarg);
+				break;
+			case 'k':
+				load_keepalive = atoi(optarg);
+				break;
+			case 'M':
+				load_media_target = optarg;
+				break;
+			case 'b':
+				load_bitrate = atoi(optarg);
+				break;
+			case 'o':
+				load_report = optarg;
+				break;
+			case 'h':
+			default:
+				JANUS_LOG(LOG_INFO, "Usage: %s [options]\n", argv[0]);
+				JANUS_LOG(LOG_INFO, "  -u <url>       WebSockets backend to connect to (default: %s)\n", load_url);
+				JANUS_LOG(LOG_INFO, "  -n <count>     Number of sessions to create (default: %d)\n", load_sessions);
+				JANUS_LOG(LOG_INFO, "  -P <plugin>    Plugin to drive: echotest or videoroom (default: %s)\n", load_plugin);
+				JANUS_LOG(LOG_INFO, "  -R <room>      VideoRoom room to poll (default: %d)\n", load_room);
+				JANUS_LOG(LOG_INFO, "  -d <seconds>   How long to run (default: %d)\n", load_duration);
+				JANUS_LOG(LOG_INFO, "  -k <seconds>   Keepalive interval (default: %d)\n", load_keepalive);
+				JANUS_LOG(LOG_INFO, "  -M <host:port> Pump synthetic RTP to this UDP address (default: none)\n");
+				JANUS_LOG(LOG_INFO, "  -b <kbps>      Bitrate of the synthetic RTP (default: %d)\n", load_bitrate);
+				JANUS_LOG(LOG_INFO, "  -o <file>      Where to write the JSON report, - for stdout (default: %s)\n", load_report);
+				exit(opt == 'h' ? 0 : 1);
+		}
+	}
+	if(load_sessions < 1 || load_duration < 1 || load_keepalive < 1 || load_bitrate < 1) {
+		JANUS_LOG(LOG_FATAL, "Invalid number of sessions, duration, keepalive or bitrate\n");
+		exit(1);
+	}
+	if(strcasecmp(load_plugin, "echotest") && strcasecmp(load_plugin, "videoroom")) {
+		JANUS_LOG(LOG_FATAL, "Unsupported plugin '%s' (echotest or videoroom)\n", load_plugin);
+		exit(1);
+	}
+	sessions = g_malloc0(load_sessions * sizeof(load_session));
+	transactions = g_hash_table_new_full(g_str_hash, g_str_equal,
+		(GDestroyNotify)g_free, (GDestroyNotify)g_free);
+	latencies = g_array_new(FALSE, FALSE, sizeof(gdouble));
+	outgoing = g_async_queue_new();
+	incoming = g_string_new(NULL);
+	/* Connect to the target instance */
+	const char *prot = NULL, *address = NULL, *path = NULL;
+	int port = 0;
+	char *url = g_strdup(load_url);
+	if(lws_parse_uri(url, &prot, &address, &port, &path) < 0) {
+		JANUS_LOG(LOG_FATAL, "Error parsing URL '%s'\n", load_url);
+		exit(1);
+	}
+	struct lws_context_creation_info info = { 0 };
+	info.port = CONTEXT_PORT_NO_LISTEN;
+	info.protocols = load_protocols;
+	info.options = LWS_SERVER_OPTION_DO_SSL_GLOBAL_INIT;
+	struct lws_context *context = lws_create_context(&info);
+	if(context == NULL) {
+		JANUS_LOG(LOG_FATAL, "Error creating WebSockets context\n");
+		exit(1);
+	}
+	struct lws_client_connect_info connect_info = { 0 };
+	connect_info.context = context;
+	connect_info.address = address;
+	connect_info.port = port;
+	connect_info.path = path;
+	connect_info.host = address;
+	connect_info.origin = address;
+	connect_info.protocol = load_protocols[0].name;
+	connect_info.ssl_connection = !strcasecmp(prot, "wss") ? LCCSCF_USE_SSL : 0;
+	wsconn = lws_client_connect_via_info(&connect_info);
+	if(wsconn == NULL) {
+		JANUS_LOG(LOG_FATAL, "Error connecting to %s\n", load_url);
+		exit(1);
+	}
+	/* If we have to pump media too, do it from a separate thread */
+	GThread *media = NULL;
+	if(load_media_target != NULL)
+		media = g_thread_new("load media", load_media_thread, NULL);
+	/* Drive the sessions until the configured duration elapses */
+	gint64 start = janus_get_monotonic_time();
+	while(!g_atomic_int_get(&closed) &&
+			janus_get_monotonic_time() - start < (gint64)load_duration*G_USEC_PER_SEC) {
+		lws_service(context, 50);
+		if(g_atomic_int_get(&connected))
+			load_tick();
+	}
+	g_atomic_int_set(&done, 1);
+	gint64 elapsed = janus_get_monotonic_time() - start;
+	if(media != NULL)
+		g_thread_join(media);
+	lws_context_destroy(context);
+	g_free(url);
+	/* Compute the latency distribution and build the report */
+	g_array_sort(latencies, load_latency_sort);
+	gdouble total = 0;
+	guint i = 0;
+	for(i = 0; i < latencies->len; i++)
+		total += g_array_index(latencies, gdouble, i);
+	json_t *report = json_object();
+	json_object_set_new(report, "target", json_string(load_url));
+	json_object_set_new(report, "plugin", json_string(load_plugin));
+	json_object_set_new(report, "sessions", json_integer(load_sessions));
+	json_object_set_new(report, "duration", json_real((gdouble)elapsed/(gdouble)G_USEC_PER_SEC));
+	json_t *signalling = json_object();
+	json_object_set_new(signalling, "requests", json_integer(requests));
+	json_object_set_new(signalling, "responses", json_integer(responses));
+	json_object_set_new(signalling, "pending", json_integer(g_hash_table_size(transactions)));
+	json_object_set_new(signalling, "events", json_integer(events));
+	json_t *latency = json_object();
+	json_object_set_new(latency, "min", json_real(latencies->len ? g_array_index(latencies, gdouble, 0) : 0));
+	json_object_set_new(latency, "max", json_real(latencies->len ? g_array_index(latencies, gdouble, latencies->len-1) : 0));
+	json_object_set_new(latency, "avg", json_real(latencies->len ? total/latencies->len : 0));
+	json_object_set_new(latency, "p50", json_real(load_latency_percentile(latencies, 50)));
+	json_object_set_new(latency, "p90", json_real(load_latency_percentile(latencies, 90)));
+	json_object_set_new(latency, "p99", json_real(load_latency_percentile(latencies, 99)));
+	json_object_set_new(signalling, "latency_us", latency);
+	json_object_set_new(report, "signalling", signalling);
+	if(load_media_target != NULL) {
+		json_t *media_info = json_object();
+		json_object_set_new(media_info, "target", json_string(load_media_target));
+		json_object_set_new(media_info, "packets", json_integer(media_packets));
+		json_object_set_new(media_info, "bytes", json_integer(media_bytes));
+		json_object_set_new(media_info, "bitrate_kbps",
+			json_real(elapsed > 0 ? (gdouble)media_bytes*8*1000/(gdouble)elapsed : 0));
+		json_object_set_new(report, "media", media_info);
+	}
+	char *dump = json_dumps(report, JSON_INDENT(2) | JSON_PRESERVE_ORDER);
+	json_decref(report);
+	if(!strcmp(load_report, "-")) {
+		JANUS_PRINT("%s\n", dump);
+	} else {
+		FILE *file = fopen(load_report, "wt");
+		if(file == NULL) {
+			JANUS_LOG(LOG_ERR, "Error opening report file '%s': %d (%s)\n",
+				load_report, errno, g_strerror(errno));
+			JANUS_PRINT("%s\n", dump);
+		} else {
+			fwrite(dump, sizeof(char), strlen(dump), file);
+			fwrite("\n", sizeof(char), 1, file);
+			fclose(file);
+			JANUS_LOG(LOG_INFO, "Report written to %s\n", load_report);
+		}
+	}
+	free(dump);
+	JANUS_LOG(LOG_INFO, "Done: %"SCNu64" requests, %"SCNu64" responses, %"SCNu64" events\n",
+		requests, responses, events);
+	g_array_free(latencies, TRUE);
+	g_hash_table_destroy(transactions);
+	g_string_free(incoming, TRUE);
+	g_async_queue_unref(outgoing);
+	g_free(sessions);
+	exit(0);
+}
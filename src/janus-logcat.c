@@ -0,0 +1,471 @@
+/*! \file    janus-logcat.c
+ * \author   Lorenzo Miniero <lorenzo@meetecho.com>
+ * \copyright GNU General Public License v3
+ * \brief    Simple utility to render binary Janus logs to text
+ * \details  When binary logging is enabled (see \c log_to_binary in
+ * \c janus.jcfg), Janus doesn't format log lines at runtime: each
+ * JANUS_LOG call serializes its raw arguments to a compact record that
+ * references the format string by ID, which makes logging cheap enough
+ * to keep high verbosity levels on in production. This tool reads such
+ * a binary log and renders the records back to the text the JANUS_LOG
+ * macro would have produced, either offline or tailing the file as the
+ * server writes it.
+ *
+ * Using the utility is quite simple. Just pass the path to the binary
+ * log as an argument, e.g.:
+ *
+\verbatim
+./janus-logcat /path/to/janus.jlog
+\endverbatim
+ *
+ * renders the whole file to stdout, while:
+ *
+\verbatim
+./janus-logcat -f -l 5 /path/to/janus.jlog
+\endverbatim
+ *
+ * follows the file as it grows (like tail -f would), only rendering
+ * lines up to the verbose level.
+ *
+ * \note Records are written in host byte order, so the log should be
+ * rendered on the same architecture (or at least one with the same
+ * endianness) as the server that wrote it.
+ *
+ * \ingroup tools
+ * \ref tools
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include <glib.h>
+
+#include "debug.h"
+#include "version.h"
+
+int janus_log_level = LOG_INFO;
+gboolean janus_log_timestamps = FALSE;
+gboolean janus_log_colors = FALSE;
+char *janus_log_global_prefix = NULL;
+int lock_debug = 0;
+
+/* This must match what src/log.c writes */
+#define JANUS_LOG_BINARY_MAGIC	"JBLOG001"
+
+/* A format string we read from a dictionary record */
+typedef struct janus_logcat_fmt {
+	char *format;
+	char *file;
+	char *function;
+	int line;
+	char *sig;
+} janus_logcat_fmt;
+static void janus_logcat_fmt_free(janus_logcat_fmt *f) {
+	if(f == NULL)
+		return;
+	g_free(f->format);
+	g_free(f->file);
+	g_free(f->function);
+	g_free(f->sig);
+	g_free(f);
+}
+/* Format strings by ID: IDs restart at each logging session */
+static GHashTable *formats = NULL;
+/* Threads get a small sequential number, for readability */
+static GHashTable *threads = NULL;
+
+/* Options */
+static gboolean follow = FALSE, show_threads = FALSE;
+static int maxlevel = LOG_MAX;
+
+/* Helpers to read fields (a short read means a truncated record, which
+ * when following the file just means the server isn't done writing it) */
+static gboolean janus_logcat_read(FILE *file, void *dest, size_t len) {
+	return fread(dest, 1, len, file) == len;
+}
+static char *janus_logcat_read_string16(FILE *file) {
+	guint16 len = 0;
+	if(!janus_logcat_read(file, &len, sizeof(len)))
+		return NULL;
+	char *str = g_malloc(len+1);
+	if(len > 0 && !janus_logcat_read(file, str, len)) {
+		g_free(str);
+		return NULL;
+	}
+	str[len] = '\0';
+	return str;
+}
+
+/* Render the prefix of a line (timestamp, level, source) the same way
+ * the JANUS_LOG macro would */
+static void janus_logcat_prefix(GString *out, gint64 timestamp, int level, janus_logcat_fmt *f, guint64 thread) {
+	char ts[64];
+	struct tm tmresult;
+	time_t ltime = (time_t)(timestamp/G_GINT64_CONSTANT(1000000));
+	localtime_r(&ltime, &tmresult);
+	strftime(ts, sizeof(ts), "[%a %b %e %T %Y] ", &tmresult);
+	g_string_append(out, ts);
+	if(show_threads && thread != 0) {
+		gpointer num = g_hash_table_lookup(threads, &thread);
+		if(num == NULL) {
+			guint64 *key = g_malloc(sizeof(guint64));
+			*key = thread;
+			num = GUINT_TO_POINTER(g_hash_table_size(threads)+1);
+			g_hash_table_insert(threads, key, num);
+		}
+		g_string_append_printf(out, "[t%02u] ", GPOINTER_TO_UINT(num));
+	}
+	if(level >= LOG_NONE && level <= LOG_MAX)
+		g_string_append(out, janus_log_prefix[level | ((int)janus_log_colors << 3)]);
+	if(f != NULL && (level == LOG_FATAL || level == LOG_ERR || level == LOG_DBG))
+		g_string_append_printf(out, "[%s:%s:%d] ", f->file, f->function, f->line);
+}
+
+/* Render a log record: we walk the format string and its argument
+ * signature in parallel, reading each argument from the serialized
+ * payload. The directive is rebuilt with a length modifier matching
+ * the width arguments are stored with, so the original modifiers
+ * don't matter */
+static gboolean janus_logcat_render(GString *out, janus_logcat_fmt *f, char *args, guint32 arglen) {
+	const char *p = f->format, *sig = f->sig;
+	char *arg = args, *argend = args + arglen;
+	char dir[64];
+	while(*p) {
+		if(*p != '%') {
+			g_string_append_c(out, *p);
+			p++;
+			continue;
+		}
+		const char *start = p;
+		p++;
+		if(*p == '%') {
+			g_string_append_c(out, '%');
+			p++;
+			continue;
+		}
+		/* Copy flags, width and precision, reading any '*' arguments */
+		int stars = 0;
+		gint32 starv[2] = { 0, 0 };
+		while(*p == '-' || *p == '+' || *p == ' ' || *p == '#' || *p == '0' || *p == '\'')
+			p++;
+		if(*p == '*') {
+			if(*sig != 'i' || arg + sizeof(gint32) > argend)
+				return FALSE;
+			memcpy(&starv[stars], arg, sizeof(gint32));
+			arg += sizeof(gint32);
+			stars++;
+			sig++;
+			p++;
+		} else {
+			while(*p >= '0' && *p <= '9')
+				p++;
+		}
+		if(*p == '.') {
+			p++;
+			if(*p == '*') {
+				if(*sig != 'i' || arg + sizeof(gint32) > argend)
+					return FALSE;
+				memcpy(&starv[stars], arg, sizeof(gint32));
+				arg += sizeof(gint32);
+				stars++;
+				sig++;
+				p++;
+			} else {
+				while(*p >= '0' && *p <= '9')
+					p++;
+			}
+		}
+		/* Skip the original length modifiers, we rebuild our own */
+		const char *lenmod = p;
+		while(*p == 'h' || *p == 'l' || *p == 'j' || *p == 'z' || *p == 't' || *p == 'L')
+			p++;
+		char conv = *p;
+		if(conv == '\0')
+			return FALSE;
+		p++;
+		/* Rebuild the directive: flags/width/precision as they were */
+		size_t plen = (size_t)(lenmod - start);
+		if(plen >= sizeof(dir) - 4)
+			return FALSE;
+		memcpy(dir, start, plen);
+		char *d = dir + plen;
+		switch(*sig) {
+			case 'i': {
+				gint32 v = 0;
+				if(arg + sizeof(v) > argend)
+					return FALSE;
+				memcpy(&v, arg, sizeof(v));
+				arg += sizeof(v);
+				*d++ = conv;
+				*d = '\0';
+				if(stars == 0)
+					g_string_append_printf(out, dir, v);
+				else if(stars == 1)
+					g_string_append_printf(out, dir, starv[0], v);
+				else
+					g_string_append_printf(out, dir, starv[0], starv[1], v);
+				break;
+			}
+			case 'l': case 'q': case 'z': {
+				gint64 v = 0;
+				if(arg + sizeof(v) > argend)
+					return FALSE;
+				memcpy(&v, arg, sizeof(v));
+				arg += sizeof(v);
+				*d++ = 'l';
+				*d++ = 'l';
+				*d++ = conv;
+				*d = '\0';
+				if(stars == 0)
+					g_string_append_printf(out, dir, (long long)v);
+				else if(stars == 1)
+					g_string_append_printf(out, dir, starv[0], (long long)v);
+				else
+					g_string_append_printf(out, dir, starv[0], starv[1], (long long)v);
+				break;
+			}
+			case 'd': {
+				double v = 0;
+				if(arg + sizeof(v) > argend)
+					return FALSE;
+				memcpy(&v, arg, sizeof(v));
+				arg += sizeof(v);
+				*d++ = conv;
+				*d = '\0';
+				if(stars == 0)
+					g_string_append_printf(out, dir, v);
+				else if(stars == 1)
+					g_string_append_printf(out, dir, starv[0], v);
+				else
+					g_string_append_printf(out, dir, starv[0], starv[1], v);
+				break;
+			}
+			case 'p': {
+				guint64 v = 0;
+				if(arg + sizeof(v) > argend)
+					return FALSE;
+				memcpy(&v, arg, sizeof(v));
+				arg += sizeof(v);
+				*d++ = conv;
+				*d = '\0';
+				if(stars == 0)
+					g_string_append_printf(out, dir, (void *)(gsize)v);
+				else if(stars == 1)
+					g_string_append_printf(out, dir, starv[0], (void *)(gsize)v);
+				else
+					g_string_append_printf(out, dir, starv[0], starv[1], (void *)(gsize)v);
+				break;
+			}
+			case 's': {
+				guint32 len = 0;
+				if(arg + sizeof(len) > argend)
+					return FALSE;
+				memcpy(&len, arg, sizeof(len));
+				arg += sizeof(len);
+				char *str = NULL;
+				if(len == G_MAXUINT32) {
+					str = g_strdup("(null)");
+				} else {
+					if(arg + len > argend)
+						return FALSE;
+					str = g_malloc(len+1);
+					memcpy(str, arg, len);
+					str[len] = '\0';
+					arg += len;
+				}
+				*d++ = conv;
+				*d = '\0';
+				if(stars == 0)
+					g_string_append_printf(out, dir, str);
+				else if(stars == 1)
+					g_string_append_printf(out, dir, starv[0], str);
+				else
+					g_string_append_printf(out, dir, starv[0], starv[1], str);
+				g_free(str);
+				break;
+			}
+			default:
+				return FALSE;
+		}
+		sig++;
+	}
+	return TRUE;
+}
+
+/* Main Code */
+int main(int argc, char *argv[]) {
+	/* Evaluate arguments */
+	int opt = 0;
+	while((opt = getopt(argc, argv, "fl:cTh")) != -1) {
+		switch(opt) {
+			case 'f':
+				follow = TRUE;
+				break;
+			case 'l':
+				maxlevel = atoi(optarg);
+				if(maxlevel < LOG_NONE || maxlevel > LOG_MAX) {
+					g_printerr("Invalid level: %s (valid values are 0-%d)\n", optarg, LOG_MAX);
+					exit(1);
+				}
+				break;
+			case 'c':
+				janus_log_colors = TRUE;
+				break;
+			case 'T':
+				show_threads = TRUE;
+				break;
+			case 'h':
+			default:
+				g_printerr("Janus version: %d (%s)\n", janus_version, janus_version_string);
+				g_printerr("Usage: %s [options] /path/to/janus.jlog\n", argv[0]);
+				g_printerr("  -f          Keep following the file as it grows (like tail -f)\n");
+				g_printerr("  -l <level>  Only render lines up to this level (default=%d)\n", LOG_MAX);
+				g_printerr("  -c          Enable colors in the rendered text\n");
+				g_printerr("  -T          Show which thread logged each line\n");
+				g_printerr("  -h          Print this help\n");
+				exit(opt == 'h' ? 0 : 1);
+		}
+	}
+	if(optind >= argc) {
+		g_printerr("Usage: %s [options] /path/to/janus.jlog (see -h)\n", argv[0]);
+		exit(1);
+	}
+	FILE *file = fopen(argv[optind], "rb");
+	if(file == NULL) {
+		g_printerr("Error opening binary log %s: %s\n", argv[optind], g_strerror(errno));
+		exit(1);
+	}
+	formats = g_hash_table_new_full(NULL, NULL, NULL, (GDestroyNotify)janus_logcat_fmt_free);
+	threads = g_hash_table_new_full(g_int64_hash, g_int64_equal, (GDestroyNotify)g_free, NULL);
+	GString *out = g_string_new(NULL);
+
+	long offset = 0;
+	gboolean started = FALSE;
+	while(TRUE) {
+		/* Remember where this record starts: on a short read while
+		 * following, we seek back and wait for the rest of it */
+		offset = ftell(file);
+		guint8 type = 0;
+		if(!janus_logcat_read(file, &type, sizeof(type)))
+			goto eof;
+		if(type == 'J') {
+			/* Start of a logging session: check the magic and reset the
+			 * dictionary, as format IDs restart with each session */
+			char magic[sizeof(JANUS_LOG_BINARY_MAGIC)] = { 'J' };
+			if(!janus_logcat_read(file, magic+1, strlen(JANUS_LOG_BINARY_MAGIC)-1))
+				goto eof;
+			magic[strlen(JANUS_LOG_BINARY_MAGIC)] = '\0';
+			if(strcmp(magic, JANUS_LOG_BINARY_MAGIC)) {
+				g_printerr("Invalid magic '%s', is this a Janus binary log?\n", magic);
+				break;
+			}
+			g_hash_table_remove_all(formats);
+			started = TRUE;
+			continue;
+		}
+		if(!started) {
+			g_printerr("Invalid file, is this a Janus binary log?\n");
+			break;
+		}
+		if(type == 'F') {
+			/* Dictionary record: a format string and its signature */
+			guint32 id = 0;
+			gint32 line = 0;
+			if(!janus_logcat_read(file, &id, sizeof(id)) || !janus_logcat_read(file, &line, sizeof(line)))
+				goto eof;
+			janus_logcat_fmt *f = g_malloc0(sizeof(janus_logcat_fmt));
+			f->line = line;
+			f->sig = janus_logcat_read_string16(file);
+			f->format = janus_logcat_read_string16(file);
+			f->file = janus_logcat_read_string16(file);
+			f->function = janus_logcat_read_string16(file);
+			if(f->sig == NULL || f->format == NULL || f->file == NULL || f->function == NULL) {
+				janus_logcat_fmt_free(f);
+				goto eof;
+			}
+			g_hash_table_insert(formats, GUINT_TO_POINTER(id), f);
+			continue;
+		}
+		if(type == 'L') {
+			/* Log record: resolve the format and render the arguments */
+			guint32 id = 0, arglen = 0;
+			guint8 level = 0;
+			gint64 timestamp = 0;
+			guint64 thread = 0;
+			if(!janus_logcat_read(file, &id, sizeof(id)) || !janus_logcat_read(file, &level, sizeof(level)) ||
+					!janus_logcat_read(file, &timestamp, sizeof(timestamp)) ||
+					!janus_logcat_read(file, &thread, sizeof(thread)) ||
+					!janus_logcat_read(file, &arglen, sizeof(arglen)))
+				goto eof;
+			char *args = g_malloc(arglen);
+			if(arglen > 0 && !janus_logcat_read(file, args, arglen)) {
+				g_free(args);
+				goto eof;
+			}
+			janus_logcat_fmt *f = g_hash_table_lookup(formats, GUINT_TO_POINTER(id));
+			if(level <= maxlevel) {
+				g_string_set_size(out, 0);
+				if(f == NULL) {
+					/* The dictionary record must have been dropped */
+					janus_logcat_prefix(out, timestamp, level, NULL, thread);
+					g_string_append_printf(out, "(unknown format string #%"PRIu32")\n", id);
+				} else {
+					janus_logcat_prefix(out, timestamp, level, f, thread);
+					if(!janus_logcat_render(out, f, args, arglen))
+						g_string_append_printf(out, "(malformed record for '%s')\n", f->format);
+				}
+				fwrite(out->str, 1, out->len, stdout);
+			}
+			g_free(args);
+			continue;
+		}
+		if(type == 'T') {
+			/* Preformatted text record */
+			guint8 level = 0;
+			gint64 timestamp = 0;
+			guint64 thread = 0;
+			guint32 len = 0;
+			if(!janus_logcat_read(file, &level, sizeof(level)) ||
+					!janus_logcat_read(file, &timestamp, sizeof(timestamp)) ||
+					!janus_logcat_read(file, &thread, sizeof(thread)) ||
+					!janus_logcat_read(file, &len, sizeof(len)))
+				goto eof;
+			char *text = g_malloc(len+1);
+			if(len > 0 && !janus_logcat_read(file, text, len)) {
+				g_free(text);
+				goto eof;
+			}
+			text[len] = '\0';
+			if(level <= maxlevel) {
+				g_string_set_size(out, 0);
+				janus_logcat_prefix(out, timestamp, level, NULL, thread);
+				g_string_append(out, text);
+				fwrite(out->str, 1, out->len, stdout);
+			}
+			g_free(text);
+			continue;
+		}
+		g_printerr("Invalid record type '%c' at offset %ld, stopping here\n", type, offset);
+		break;
+eof:
+		if(!follow)
+			break;
+		/* Tail mode: seek back to the start of the truncated record,
+		 * flush what we rendered so far and wait for more */
+		fseek(file, offset, SEEK_SET);
+		clearerr(file);
+		fflush(stdout);
+		g_usleep(G_USEC_PER_SEC/4);
+	}
+	fflush(stdout);
+
+	fclose(file);
+	g_string_free(out, TRUE);
+	g_hash_table_destroy(formats);
+	g_hash_table_destroy(threads);
+	return 0;
+}
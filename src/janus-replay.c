@@ -0,0 +1,442 @@
+/*! \file    janus-replay.c
+ * \author   Lorenzo Miniero <lorenzo@meetecho.com>
+ * \copyright GNU General Public License v3
+ * \brief    Replay harness feeding captured traffic to the media hot path
+ * \details  Utility that replays real captured traffic (either a .pcap
+ * capture, e.g., one converted with \c mjr2pcap , or a .mjr recording
+ * directly) through the same per-packet primitives the core runs on
+ * every incoming packet: RTP validation and header extension parsing,
+ * switching context updates, RTCP context statistics and compound
+ * packet parsing. The fuzzers exercise the parsers for robustness, but
+ * give no performance signal: this harness reports per-stage throughput
+ * and allocation counts for a real-world packet mix, so that changes to
+ * the ice.c/rtp.c/rtcp.c hot paths can be validated against actual
+ * traffic before they ship. Packets can be replayed as fast as possible
+ * (the default) or paced on the capture timestamps at a configurable
+ * speed multiplier, e.g.:
+ *
+\verbatim
+make janus-replay
+./janus-replay -s 10 /path/to/capture.pcap
+\endverbatim
+ *
+ * Allocation counts are collected by interposing the allocator, where
+ * the C library supports that, and cover everything the replayed stages
+ * allocate (including GLib and Jansson): a hot path that starts
+ * allocating per packet is a regression this catches even when the
+ * timing noise would hide it.
+ *
+ * \ingroup tools
+ * \ref tools
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#include <glib.h>
+#include <jansson.h>
+
+#include "rtp.h"
+#include "rtcp.h"
+#include "debug.h"
+#include "utils.h"
+#include "version.h"
+
+int janus_log_level = 4;
+gboolean janus_log_timestamps = FALSE;
+gboolean janus_log_colors = TRUE;
+char *janus_log_global_prefix = NULL;
+int lock_debug = 0;
+int refcount_debug = 0;
+
+/* Options */
+static const char *replay_report_file = "-";
+static double replay_speed = 0;		/* 0 means as fast as possible */
+static int replay_audiolevel_ext = 1, replay_twcc_ext = 3, replay_orientation_ext = 4;
+
+/* Allocation counting: on glibc, defining the allocator entry points in
+ * the executable interposes them for every dynamically linked library
+ * too, so the counts cover GLib and Jansson as well */
+#ifdef __GLIBC__
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+static volatile guint64 replay_allocations = 0;
+void *malloc(size_t size) {
+	replay_allocations++;
+	return __libc_malloc(size);
+}
+void *calloc(size_t nmemb, size_t size) {
+	replay_allocations++;
+	return __libc_calloc(nmemb, size);
+}
+void *realloc(void *ptr, size_t size) {
+	replay_allocations++;
+	return __libc_realloc(ptr, size);
+}
+void free(void *ptr) {
+	__libc_free(ptr);
+}
+static guint64 replay_allocations_now(void) {
+	return replay_allocations;
+}
+#else
+static guint64 replay_allocations_now(void) {
+	return 0;
+}
+#endif
+
+/* Per-stage accounting */
+typedef struct janus_replay_stage {
+	const char *name;	/* Name of the stage in the report */
+	guint64 packets;	/* Packets that went through this stage */
+	guint64 bytes;		/* Bytes that went through this stage */
+	gint64 elapsed;		/* Time spent in this stage (microseconds) */
+	guint64 allocations;	/* Allocations performed by this stage */
+} janus_replay_stage;
+enum {
+	REPLAY_STAGE_RTP_PARSE = 0,
+	REPLAY_STAGE_RTP_EXTENSIONS,
+	REPLAY_STAGE_RTP_CONTEXT,
+	REPLAY_STAGE_RTCP_PARSE,
+	REPLAY_STAGE_RTCP_NACKS,
+	REPLAY_STAGES
+};
+static janus_replay_stage replay_stages[REPLAY_STAGES] = {
+	{ .name = "rtp_parse" },
+	{ .name = "rtp_extensions" },
+	{ .name = "rtp_context" },
+	{ .name = "rtcp_parse" },
+	{ .name = "rtcp_nacks" },
+};
+/* Helpers to time a stage: meant to wrap each call, e.g.,
+ *   janus_replay_stage_start(&before, &allocs);
+ *   (stage call)
+ *   janus_replay_stage_done(REPLAY_STAGE_X, len, before, allocs); */
+static inline void janus_replay_stage_start(gint64 *before, guint64 *allocs) {
+	*allocs = replay_allocations_now();
+	*before = janus_get_monotonic_time();
+}
+static inline void janus_replay_stage_done(int stage, int len, gint64 before, guint64 allocs) {
+	replay_stages[stage].elapsed += janus_get_monotonic_time() - before;
+	replay_stages[stage].allocations += replay_allocations_now() - allocs;
+	replay_stages[stage].packets++;
+	replay_stages[stage].bytes += len;
+}
+
+/* Prevent the compiler from optimizing a replayed stage away */
+static volatile int replay_sink = 0;
+
+/* Media streams are tracked by SSRC, so that each gets its own
+ * switching and RTCP contexts like streams in the core do */
+typedef struct janus_replay_stream {
+	uint32_t ssrc;
+	janus_rtp_switching_context sctx;
+	janus_rtcp_context rtcp_ctx;
+} janus_replay_stream;
+#define REPLAY_MAX_STREAMS	32
+static janus_replay_stream replay_streams[REPLAY_MAX_STREAMS];
+static int replay_streams_num = 0;
+static janus_replay_stream *janus_replay_stream_find(uint32_t ssrc) {
+	int i = 0;
+	for(i = 0; i < replay_streams_num; i++) {
+		if(replay_streams[i].ssrc == ssrc)
+			return &replay_streams[i];
+	}
+	if(replay_streams_num == REPLAY_MAX_STREAMS)
+		return &replay_streams[0];
+	janus_replay_stream *stream = &replay_streams[replay_streams_num];
+	replay_streams_num++;
+	stream->ssrc = ssrc;
+	janus_rtp_switching_context_reset(&stream->sctx);
+	return stream;
+}
+
+/* Helper struct for the source we're replaying from */
+typedef struct janus_replay_source {
+	FILE *file;				/* Source file */
+	gboolean pcap;			/* Whether this is a .pcap capture or a .mjr recording */
+	gboolean swapped;		/* Whether the .pcap was saved with the opposite endianness */
+	gboolean parsed_header;	/* Whether we parsed the .mjr info header already */
+	gboolean has_timestamps;	/* Whether the .mjr recording includes packet timestamps */
+} janus_replay_source;
+
+/* Helper to open the source file and detect its format from the magic */
+static int janus_replay_source_open(janus_replay_source *source, const char *filename) {
+	memset(source, 0, sizeof(*source));
+	source->file = fopen(filename, "rb");
+	if(source->file == NULL) {
+		JANUS_LOG(LOG_ERR, "Could not open file %s\n", filename);
+		return -1;
+	}
+	uint32_t magic = 0;
+	if(fread(&magic, sizeof(uint32_t), 1, source->file) != 1) {
+		JANUS_LOG(LOG_ERR, "Could not read the header of %s\n", filename);
+		return -1;
+	}
+	if(magic == 0xa1b2c3d4 || magic == 0xd4c3b2a1 ||
+			magic == 0xa1b23c4d || magic == 0x4d3cb2a1) {
+		/* Classic pcap (with either timestamp resolution): skip the
+		 * rest of the global header, we assume Ethernet encapsulation */
+		source->pcap = TRUE;
+		source->swapped = (magic == 0xd4c3b2a1 || magic == 0x4d3cb2a1);
+		fseek(source->file, 24, SEEK_SET);
+		return 0;
+	}
+	/* Not pcap, rewind and treat it as a .mjr recording */
+	fseek(source->file, 0, SEEK_SET);
+	return 0;
+}
+
+/* Helper to read the next packet: returns its length, filling in the
+ * capture timestamp (in microseconds), or -1 at the end of the source */
+static int janus_replay_source_next(janus_replay_source *source, char *buffer, int buflen, gint64 *when) {
+	if(source->pcap) {
+		/* Traverse the pcap records, looking for IPv4/UDP payloads */
+		uint32_t record[4];
+		while(TRUE) {
+			if(fread(record, sizeof(uint32_t), 4, source->file) != 4)
+				return -1;
+			if(source->swapped) {
+				record[0] = GUINT32_SWAP_LE_BE(record[0]);
+				record[1] = GUINT32_SWAP_LE_BE(record[1]);
+				record[2] = GUINT32_SWAP_LE_BE(record[2]);
+			}
+			uint32_t incl_len = record[2];
+			*when = (gint64)record[0]*G_USEC_PER_SEC + record[1];
+			if(incl_len > (uint32_t)buflen) {
+				/* Too large to be interesting, skip */
+				fseek(source->file, incl_len, SEEK_CUR);
+				continue;
+			}
+			if(fread(buffer, sizeof(char), incl_len, source->file) != incl_len)
+				return -1;
+			/* Skip the Ethernet/IP/UDP encapsulation */
+			if(incl_len < 14 + 20 + 8)
+				continue;
+			uint16_t ethtype = ntohs(*(uint16_t *)(buffer + 12));
+			if(ethtype != 0x0800)
+				continue;
+			int iphlen = (buffer[14] & 0x0F)*4;
+			if(buffer[14+9] != 17 || incl_len < (uint32_t)(14 + iphlen + 8))
+				continue;	/* Not UDP */
+			int skip = 14 + iphlen + 8;
+			memmove(buffer, buffer + skip, incl_len - skip);
+			return incl_len - skip;
+		}
+	}
+	/* This is a .mjr recording, traverse its frames */
+	char prebuffer[1500];
+	int bytes = 0;
+	uint16_t len = 0;
+	while(TRUE) {
+		bytes = fread(prebuffer, sizeof(char), 8, source->file);
+		if(bytes != 8 || prebuffer[0] != 'M')
+			return -1;
+		if(prebuffer[1] == 'J') {
+			if(!source->parsed_header && prebuffer[2] == 'R' && prebuffer[3] == '0' && prebuffer[4] == '0' &&
+					prebuffer[5] == '0' && prebuffer[6] == '0' && prebuffer[7] == '2')
+				source->has_timestamps = TRUE;
+			/* Header or frame index block, skip it */
+			if(fread(&len, sizeof(uint16_t), 1, source->file) != 1)
+				return -1;
+			len = ntohs(len);
+			if(len > 0)
+				source->parsed_header = TRUE;
+			fseek(source->file, len, SEEK_CUR);
+			continue;
+		}
+		if(prebuffer[1] != 'E')
+			return -1;
+		/* This is a frame */
+		if(fread(&len, sizeof(uint16_t), 1, source->file) != 1)
+			return -1;
+		len = ntohs(len);
+		if(source->has_timestamps) {
+			uint32_t pkt_ts = 0;
+			memcpy(&pkt_ts, prebuffer+4, sizeof(uint32_t));
+			*when = (gint64)ntohl(pkt_ts)*1000;
+		} else {
+			*when = 0;
+		}
+		if(len < 12 || len > buflen) {
+			fseek(source->file, len, SEEK_CUR);
+			continue;
+		}
+		if(fread(buffer, sizeof(char), len, source->file) != len)
+			return -1;
+		return len;
+	}
+}
+
+
+/* Main Code */
+int main(int argc, char *argv[]) {
+	JANUS_LOG(LOG_INFO, "Janus replay harness version %s (%s)\n", janus_version_string, janus_build_git_sha);
+	int opt = 0;
+	while((opt = getopt(argc, argv, "s:o:A:T:V:h")) != -1) {
+		switch(opt) {
+			case 's':
+				replay_speed = atof(optarg);
+				break;
+			case 'o':
+				replay_report_file = optarg;
+				break;
+			case 'A':
+				replay_audiolevel_ext = atoi(optarg);
+				break;
+			case 'T':
+				replay_twcc_ext = atoi(optarg);
+				break;
+			case 'V':
+				replay_orientation_ext = atoi(optarg);
+				break;
+			case 'h':
+			default:
+				JANUS_LOG(LOG_INFO, "Usage: %s [options] capture.pcap|recording.mjr\n", argv[0]);
+				JANUS_LOG(LOG_INFO, "  -s <mult>   Pace packets on the capture timestamps at this speed multiplier (default: as fast as possible)\n");
+				JANUS_LOG(LOG_INFO, "  -o <file>   Where to write the JSON report, - for stdout (default: %s)\n", replay_report_file);
+				JANUS_LOG(LOG_INFO, "  -A <id>     Extension ID to use for audio-level (default: %d)\n", replay_audiolevel_ext);
+				JANUS_LOG(LOG_INFO, "  -T <id>     Extension ID to use for transport-wide CC (default: %d)\n", replay_twcc_ext);
+				JANUS_LOG(LOG_INFO, "  -V <id>     Extension ID to use for video-orientation (default: %d)\n", replay_orientation_ext);
+				exit(opt == 'h' ? 0 : 1);
+		}
+	}
+	if(optind >= argc) {
+		JANUS_LOG(LOG_FATAL, "Missing source file, see %s -h\n", argv[0]);
+		exit(1);
+	}
+	janus_replay_source source;
+	if(janus_replay_source_open(&source, argv[optind]) < 0)
+		exit(1);
+	JANUS_LOG(LOG_INFO, "Replaying %s (%s)%s\n", argv[optind],
+		source.pcap ? "pcap capture" : "mjr recording",
+		replay_speed > 0 ? "" : " as fast as possible");
+
+	/* Now traverse the source, replaying each packet through the same
+	 * per-packet stages the core runs on incoming traffic */
+	char buffer[1500];
+	gint64 when = 0, first_ts = -1, started = janus_get_monotonic_time();
+	gint64 before = 0;
+	guint64 allocs = 0, packets = 0, bytes = 0, rtp_packets = 0, rtcp_packets = 0, ignored = 0;
+	GQueue nacks = G_QUEUE_INIT;
+	int len = 0;
+	while((len = janus_replay_source_next(&source, buffer, sizeof(buffer), &when)) > 0) {
+		if(replay_speed > 0 && when > 0) {
+			/* Pace the replay on the capture timestamps */
+			if(first_ts == -1)
+				first_ts = when;
+			gint64 due = started + (gint64)((double)(when - first_ts)/replay_speed);
+			gint64 now = janus_get_monotonic_time();
+			if(due > now)
+				g_usleep(due - now);
+		}
+		packets++;
+		bytes += len;
+		if(janus_is_rtp(buffer, len)) {
+			rtp_packets++;
+			/* Validate the packet and index its header extensions */
+			janus_rtp_header *header = (janus_rtp_header *)buffer;
+			janus_rtp_header_extension_index extindex;
+			janus_replay_stage_start(&before, &allocs);
+			replay_sink += janus_rtp_header_extension_parse_all(buffer, len, &extindex);
+			janus_replay_stage_done(REPLAY_STAGE_RTP_PARSE, len, before, allocs);
+			/* Read the extensions the core reads on the media path */
+			gboolean vad = FALSE;
+			int level = 0;
+			uint16_t transseq = 0;
+			gboolean c = FALSE, f = FALSE;
+			janus_replay_stage_start(&before, &allocs);
+			replay_sink += janus_rtp_header_extension_read_audio_level(&extindex, replay_audiolevel_ext, &vad, &level);
+			replay_sink += janus_rtp_header_extension_read_transport_wide_cc(&extindex, replay_twcc_ext, &transseq);
+			replay_sink += janus_rtp_header_extension_read_video_orientation(&extindex, replay_orientation_ext, &c, &f);
+			janus_replay_stage_done(REPLAY_STAGE_RTP_EXTENSIONS, len, before, allocs);
+			/* Update the per-SSRC switching and RTCP contexts */
+			janus_replay_stream *stream = janus_replay_stream_find(ntohl(header->ssrc));
+			janus_replay_stage_start(&before, &allocs);
+			janus_rtp_header_update(header, &stream->sctx, FALSE, 0);
+			replay_sink += janus_rtcp_process_incoming_rtp(&stream->rtcp_ctx, buffer, len,
+				FALSE, FALSE, FALSE, NULL);
+			janus_replay_stage_done(REPLAY_STAGE_RTP_CONTEXT, len, before, allocs);
+		} else if(janus_is_rtcp(buffer, len)) {
+			rtcp_packets++;
+			/* Parse the compound packet, updating the RTCP context of
+			 * the stream the first SSRC in there belongs to */
+			uint32_t ssrc = 0;
+			if(len >= 8)
+				memcpy(&ssrc, buffer+4, sizeof(uint32_t));
+			janus_replay_stream *stream = janus_replay_stream_find(ntohl(ssrc));
+			janus_replay_stage_start(&before, &allocs);
+			replay_sink += janus_rtcp_parse(&stream->rtcp_ctx, buffer, len);
+			janus_replay_stage_done(REPLAY_STAGE_RTCP_PARSE, len, before, allocs);
+			/* Extract NACKs, like the core does on feedback */
+			janus_replay_stage_start(&before, &allocs);
+			janus_rtcp_get_nacks(buffer, len, &nacks);
+			janus_replay_stage_done(REPLAY_STAGE_RTCP_NACKS, len, before, allocs);
+			g_queue_clear(&nacks);
+		} else {
+			ignored++;
+		}
+	}
+	gint64 elapsed = janus_get_monotonic_time() - started;
+	fclose(source.file);
+	if(packets == 0) {
+		JANUS_LOG(LOG_FATAL, "No packets found in the source file\n");
+		exit(1);
+	}
+	JANUS_LOG(LOG_INFO, "Replayed %"SCNu64" packets (%"SCNu64" RTP, %"SCNu64" RTCP, %"SCNu64" ignored) in %"SCNi64"ms\n",
+		packets, rtp_packets, rtcp_packets, ignored, elapsed/1000);
+
+	/* Done, build and emit the report */
+	json_t *report = json_object();
+	json_object_set_new(report, "version", json_string(janus_version_string));
+	json_object_set_new(report, "commit", json_string(janus_build_git_sha));
+	json_object_set_new(report, "source", json_string(argv[optind]));
+	json_object_set_new(report, "speed", json_real(replay_speed));
+	json_object_set_new(report, "packets", json_integer(packets));
+	json_object_set_new(report, "bytes", json_integer(bytes));
+	json_object_set_new(report, "streams", json_integer(replay_streams_num));
+	json_object_set_new(report, "duration_us", json_integer(elapsed));
+	json_object_set_new(report, "packets_per_second",
+		json_real(elapsed ? (gdouble)packets*G_USEC_PER_SEC/(gdouble)elapsed : 0));
+	json_t *stages = json_object();
+	int i = 0;
+	for(i = 0; i < REPLAY_STAGES; i++) {
+		janus_replay_stage *stage = &replay_stages[i];
+		json_t *result = json_object();
+		json_object_set_new(result, "packets", json_integer(stage->packets));
+		json_object_set_new(result, "bytes", json_integer(stage->bytes));
+		json_object_set_new(result, "total_us", json_integer(stage->elapsed));
+		json_object_set_new(result, "ns_per_packet",
+			json_real(stage->packets ? (gdouble)stage->elapsed*1000/(gdouble)stage->packets : 0));
+		json_object_set_new(result, "allocations", json_integer(stage->allocations));
+		json_object_set_new(stages, stage->name, result);
+		JANUS_LOG(LOG_INFO, "  %-16s %8.1f ns/packet, %"SCNu64" allocations\n", stage->name,
+			stage->packets ? (gdouble)stage->elapsed*1000/(gdouble)stage->packets : 0,
+			stage->allocations);
+	}
+	json_object_set_new(report, "stages", stages);
+	char *dump = json_dumps(report, JSON_INDENT(2) | JSON_PRESERVE_ORDER);
+	json_decref(report);
+	if(!strcmp(replay_report_file, "-")) {
+		JANUS_PRINT("%s\n", dump);
+	} else {
+		FILE *file = fopen(replay_report_file, "wt");
+		if(file == NULL) {
+			JANUS_LOG(LOG_ERR, "Error opening report file '%s': %d (%s)\n",
+				replay_report_file, errno, g_strerror(errno));
+			JANUS_PRINT("%s\n", dump);
+		} else {
+			fwrite(dump, sizeof(char), strlen(dump), file);
+			fwrite("\n", sizeof(char), 1, file);
+			fclose(file);
+			JANUS_LOG(LOG_INFO, "Report written to %s\n", replay_report_file);
+		}
+	}
+	free(dump);
+	exit(0);
+}
@@ -0,0 +1,305 @@
+/*! \file    janus-sctp-bench.c
+ * \author   Lorenzo Miniero <lorenzo@meetecho.com>
+ * \copyright GNU General Public License v3
+ * \brief    Simple utility to benchmark usrsctp throughput
+ * \details  The SCTP stack that backs data channels has a few knobs
+ * that matter a lot for throughput-oriented workloads: the size of the
+ * send and receive buffers, the stream scheduler, message interleaving
+ * (I-DATA) and NR-SACKs, all of which can be configured in janus.jcfg.
+ * This tool pairs two usrsctp sockets back to back in memory, pushes a
+ * configurable amount of data through one stream with the knobs you
+ * select, and reports the resulting throughput, so you can validate a
+ * combination before deploying it.
+ *
+ * Using the utility is quite simple, e.g.:
+ *
+\verbatim
+./janus-sctp-bench -b 1048576 -r 1048576 -s prio -i -n -t 256
+\endverbatim
+ *
+ * pushes 256 MB through the pair with 1 MB buffers, the priority
+ * scheduler, interleaving and NR-SACKs enabled. Run it once with the
+ * defaults and once with your candidate tuning to compare.
+ *
+ * \ingroup tools
+ * \ref tools
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#include <glib.h>
+#include <usrsctp.h>
+
+#include "debug.h"
+#include "utils.h"
+#include "version.h"
+
+int janus_log_level = 4;
+gboolean janus_log_timestamps = FALSE;
+gboolean janus_log_colors = TRUE;
+char *janus_log_global_prefix = NULL;
+int lock_debug = 0;
+
+/* The two "addresses" of the in-memory pair */
+static int bench_client_id = 1, bench_server_id = 2;
+/* Packets in flight between the two sides: we don't call
+ * usrsctp_conninput from within the output callback, as that would
+ * re-enter the stack, so a pump thread shuttles them instead */
+typedef struct bench_packet {
+	void *destination;
+	size_t length;
+	char buffer[];
+} bench_packet;
+static GAsyncQueue *bench_packets = NULL;
+static volatile gint bench_done = 0;
+/* What to send, and the options to apply */
+static int msg_size = 16384, total_mb = 64;
+static int sndbuf_size = 0, rcvbuf_size = 0, scheduler = -1;
+static gboolean interleaving = FALSE, nr_sack = FALSE;
+
+static int bench_conn_output(void *addr, void *buffer, size_t length, uint8_t tos, uint8_t set_df) {
+	/* Queue the packet for the other side of the pair */
+	bench_packet *pkt = g_malloc(sizeof(bench_packet) + length);
+	pkt->destination = (addr == &bench_client_id) ? (void *)&bench_server_id : (void *)&bench_client_id;
+	pkt->length = length;
+	memcpy(pkt->buffer, buffer, length);
+	g_async_queue_push(bench_packets, pkt);
+	return 0;
+}
+
+static gpointer bench_pump_thread(gpointer user_data) {
+	bench_packet *pkt = NULL;
+	while(!g_atomic_int_get(&bench_done)) {
+		pkt = g_async_queue_timeout_pop(bench_packets, 100000);
+		if(pkt == NULL)
+			continue;
+		usrsctp_conninput(pkt->destination, pkt->buffer, pkt->length, 0);
+		g_free(pkt);
+	}
+	while((pkt = g_async_queue_try_pop(bench_packets)) != NULL)
+		g_free(pkt);
+	return NULL;
+}
+
+static void bench_apply_options(struct socket *sock) {
+	if(sndbuf_size > 0 && usrsctp_setsockopt(sock, SOL_SOCKET, SO_SNDBUF, &sndbuf_size, sizeof(sndbuf_size)) < 0)
+		JANUS_LOG(LOG_WARN, "setsockopt error: SO_SNDBUF (%d, %s)\n", errno, g_strerror(errno));
+	if(rcvbuf_size > 0 && usrsctp_setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf_size, sizeof(rcvbuf_size)) < 0)
+		JANUS_LOG(LOG_WARN, "setsockopt error: SO_RCVBUF (%d, %s)\n", errno, g_strerror(errno));
+	uint32_t nodelay = 1;
+	if(usrsctp_setsockopt(sock, IPPROTO_SCTP, SCTP_NODELAY, &nodelay, sizeof(nodelay)) < 0)
+		JANUS_LOG(LOG_WARN, "setsockopt error: SCTP_NODELAY (%d, %s)\n", errno, g_strerror(errno));
+	struct sctp_assoc_value av;
+#ifdef SCTP_PLUGGABLE_SS
+	if(scheduler != -1) {
+		av.assoc_id = SCTP_ALL_ASSOC;
+		av.assoc_value = scheduler;
+		if(usrsctp_setsockopt(sock, IPPROTO_SCTP, SCTP_PLUGGABLE_SS, &av, sizeof(av)) < 0)
+			JANUS_LOG(LOG_WARN, "setsockopt error: SCTP_PLUGGABLE_SS (%d, %s)\n", errno, g_strerror(errno));
+	}
+#endif
+#ifdef SCTP_INTERLEAVING_SUPPORTED
+	if(interleaving) {
+		int level = 2;
+		if(usrsctp_setsockopt(sock, IPPROTO_SCTP, SCTP_FRAGMENT_INTERLEAVE, &level, sizeof(level)) < 0) {
+			JANUS_LOG(LOG_WARN, "setsockopt error: SCTP_FRAGMENT_INTERLEAVE (%d, %s)\n", errno, g_strerror(errno));
+		} else {
+			av.assoc_id = SCTP_ALL_ASSOC;
+			av.assoc_value = 1;
+			if(usrsctp_setsockopt(sock, IPPROTO_SCTP, SCTP_INTERLEAVING_SUPPORTED, &av, sizeof(av)) < 0)
+				JANUS_LOG(LOG_WARN, "setsockopt error: SCTP_INTERLEAVING_SUPPORTED (%d, %s)\n", errno, g_strerror(errno));
+		}
+	}
+#endif
+}
+
+static gpointer bench_sender_thread(gpointer user_data) {
+	struct socket *sock = (struct socket *)user_data;
+	/* Connect to the server side of the pair */
+	struct sockaddr_conn sconn;
+	memset(&sconn, 0, sizeof(sconn));
+	sconn.sconn_family = AF_CONN;
+	sconn.sconn_port = htons(5000);
+	sconn.sconn_addr = &bench_client_id;
+	if(usrsctp_connect(sock, (struct sockaddr *)&sconn, sizeof(sconn)) < 0) {
+		JANUS_LOG(LOG_FATAL, "Error connecting the pair... (%d, %s)\n", errno, g_strerror(errno));
+		g_atomic_int_set(&bench_done, 1);
+		return NULL;
+	}
+	/* Push the configured amount of data through a single stream */
+	char *buffer = g_malloc0(msg_size);
+	struct sctp_sndinfo sndinfo;
+	memset(&sndinfo, 0, sizeof(sndinfo));
+	sndinfo.snd_sid = 0;
+	sndinfo.snd_ppid = htonl(53);	/* Binary, like a data channel file transfer */
+	gint64 sent = 0, total = (gint64)total_mb*1024*1024;
+	while(sent < total && !g_atomic_int_get(&bench_done)) {
+		ssize_t res = usrsctp_sendv(sock, buffer, msg_size, NULL, 0,
+			&sndinfo, (socklen_t)sizeof(sndinfo), SCTP_SENDV_SNDINFO, 0);
+		if(res < 0) {
+			if(errno == EWOULDBLOCK || errno == EAGAIN) {
+				g_usleep(1000);
+				continue;
+			}
+			JANUS_LOG(LOG_FATAL, "Error sending message... (%d, %s)\n", errno, g_strerror(errno));
+			break;
+		}
+		sent += res;
+	}
+	g_free(buffer);
+	return NULL;
+}
+
+/* Main Code */
+int main(int argc, char *argv[]) {
+	JANUS_LOG(LOG_INFO, "Janus SCTP benchmark tool version %s (%s)\n", janus_version_string, janus_build_git_sha);
+	int opt = 0;
+	while((opt = getopt(argc, argv, "b:r:s:m:t:inh")) != -1) {
+		switch(opt) {
+			case 'b':
+				sndbuf_size = atoi(optarg);
+				break;
+			case 'r':
+				rcvbuf_size = atoi(optarg);
+				break;
+			case 's':
+#ifdef SCTP_PLUGGABLE_SS
+				if(!strcasecmp(optarg, "default"))
+					scheduler = SCTP_SS_DEFAULT;
+				else if(!strcasecmp(optarg, "rr"))
+					scheduler = SCTP_SS_ROUND_ROBIN;
+				else if(!strcasecmp(optarg, "rr-packet"))
+					scheduler = SCTP_SS_RR_PACKET;
+				else if(!strcasecmp(optarg, "prio"))
+					scheduler = SCTP_SS_PRIORITY;
+				else if(!strcasecmp(optarg, "fcfs"))
+					scheduler = SCTP_SS_FIRST_COME;
+				else
+					JANUS_LOG(LOG_WARN, "Unknown stream scheduler '%s', ignoring\n", optarg);
+#else
+				JANUS_LOG(LOG_WARN, "This usrsctp doesn't expose pluggable stream schedulers, ignoring '%s'\n", optarg);
+#endif
+				break;
+			case 'm':
+				msg_size = atoi(optarg);
+				break;
+			case 't':
+				total_mb = atoi(optarg);
+				break;
+			case 'i':
+				interleaving = TRUE;
+				break;
+			case 'n':
+				nr_sack = TRUE;
+				break;
+			case 'h':
+			default:
+				JANUS_LOG(LOG_INFO, "Usage: %s [options]\n", argv[0]);
+				JANUS_LOG(LOG_INFO, "  -b <bytes>     Send buffer size (default: usrsctp's)\n");
+				JANUS_LOG(LOG_INFO, "  -r <bytes>     Receive buffer size (default: usrsctp's)\n");
+				JANUS_LOG(LOG_INFO, "  -s <name>      Stream scheduler: default, rr, rr-packet, prio, fcfs\n");
+				JANUS_LOG(LOG_INFO, "  -i             Enable message interleaving (I-DATA)\n");
+				JANUS_LOG(LOG_INFO, "  -n             Enable NR-SACKs\n");
+				JANUS_LOG(LOG_INFO, "  -m <bytes>     Message size (default: %d)\n", msg_size);
+				JANUS_LOG(LOG_INFO, "  -t <MB>        How much data to push (default: %d)\n", total_mb);
+				exit(opt == 'h' ? 0 : 1);
+		}
+	}
+	if(msg_size < 1 || total_mb < 1) {
+		JANUS_LOG(LOG_FATAL, "Invalid message size or total amount of data\n");
+		exit(1);
+	}
+	/* Initialize the SCTP stack, with the two sides of the pair as addresses */
+	usrsctp_init(0, bench_conn_output, NULL);
+	usrsctp_sysctl_set_sctp_ecn_enable(0);
+	if(sndbuf_size > 0)
+		usrsctp_sysctl_set_sctp_sendspace(sndbuf_size);
+	if(rcvbuf_size > 0)
+		usrsctp_sysctl_set_sctp_recvspace(rcvbuf_size);
+	if(nr_sack)
+		usrsctp_sysctl_set_sctp_nrsack_enable(1);
+	usrsctp_register_address(&bench_client_id);
+	usrsctp_register_address(&bench_server_id);
+	bench_packets = g_async_queue_new();
+	GThread *pump = g_thread_new("sctp bench pump", bench_pump_thread, NULL);
+	/* Server side of the pair */
+	struct socket *server = usrsctp_socket(AF_CONN, SOCK_STREAM, IPPROTO_SCTP, NULL, NULL, 0, NULL);
+	if(server == NULL) {
+		JANUS_LOG(LOG_FATAL, "Error creating server socket... (%d, %s)\n", errno, g_strerror(errno));
+		exit(1);
+	}
+	bench_apply_options(server);
+	struct sockaddr_conn sconn;
+	memset(&sconn, 0, sizeof(sconn));
+	sconn.sconn_family = AF_CONN;
+	sconn.sconn_port = htons(5000);
+	sconn.sconn_addr = &bench_server_id;
+	if(usrsctp_bind(server, (struct sockaddr *)&sconn, sizeof(sconn)) < 0 || usrsctp_listen(server, 1) < 0) {
+		JANUS_LOG(LOG_FATAL, "Error binding/listening... (%d, %s)\n", errno, g_strerror(errno));
+		exit(1);
+	}
+	/* Client side of the pair, sending from its own thread */
+	struct socket *client = usrsctp_socket(AF_CONN, SOCK_STREAM, IPPROTO_SCTP, NULL, NULL, 0, NULL);
+	if(client == NULL) {
+		JANUS_LOG(LOG_FATAL, "Error creating client socket... (%d, %s)\n", errno, g_strerror(errno));
+		exit(1);
+	}
+	bench_apply_options(client);
+	memset(&sconn, 0, sizeof(sconn));
+	sconn.sconn_family = AF_CONN;
+	sconn.sconn_port = htons(5001);
+	sconn.sconn_addr = &bench_client_id;
+	if(usrsctp_bind(client, (struct sockaddr *)&sconn, sizeof(sconn)) < 0) {
+		JANUS_LOG(LOG_FATAL, "Error binding client... (%d, %s)\n", errno, g_strerror(errno));
+		exit(1);
+	}
+	GThread *sender = g_thread_new("sctp bench sender", bench_sender_thread, client);
+	/* Accept the association and drain it, measuring as we go */
+	socklen_t addrlen = sizeof(sconn);
+	struct socket *conn = usrsctp_accept(server, (struct sockaddr *)&sconn, &addrlen);
+	if(conn == NULL) {
+		JANUS_LOG(LOG_FATAL, "Error accepting the association... (%d, %s)\n", errno, g_strerror(errno));
+		exit(1);
+	}
+	JANUS_LOG(LOG_INFO, "Pushing %d MB in messages of %d bytes...\n", total_mb, msg_size);
+	char *buffer = g_malloc(65536);
+	gint64 received = 0, total = (gint64)total_mb*1024*1024;
+	gint64 start = janus_get_monotonic_time();
+	while(received < total) {
+		struct sockaddr_conn from;
+		socklen_t fromlen = sizeof(from);
+		struct sctp_rcvinfo rcvinfo;
+		socklen_t infolen = sizeof(rcvinfo);
+		unsigned int infotype = 0;
+		int flags = 0;
+		ssize_t res = usrsctp_recvv(conn, buffer, 65536, (struct sockaddr *)&from, &fromlen,
+			&rcvinfo, &infolen, &infotype, &flags);
+		if(res <= 0) {
+			JANUS_LOG(LOG_FATAL, "Error receiving message... (%d, %s)\n", errno, g_strerror(errno));
+			break;
+		}
+		received += res;
+	}
+	gint64 elapsed = janus_get_monotonic_time() - start;
+	g_free(buffer);
+	if(elapsed > 0 && received > 0) {
+		double mbps = (double)received*8/(double)elapsed;
+		JANUS_LOG(LOG_INFO, "Received %"SCNi64" MB in %.2fs: %.0f Mbit/s\n",
+			received/(1024*1024), (double)elapsed/(double)G_USEC_PER_SEC, mbps);
+	}
+	/* Done */
+	g_thread_join(sender);
+	usrsctp_close(conn);
+	usrsctp_close(client);
+	usrsctp_close(server);
+	g_atomic_int_set(&bench_done, 1);
+	g_thread_join(pump);
+	g_async_queue_unref(bench_packets);
+	while(usrsctp_finish() != 0)
+		g_usleep(10000);
+	exit(0);
+}
@@ -43,6 +43,7 @@
 #include "auth.h"
 #include "record.h"
 #include "events.h"
+#include "metrics.h"
 
 
 #define JANUS_NAME				"Janus WebRTC Server"
@@ -123,6 +124,9 @@ static struct janus_json_parameter add_token_parameters[] = {
 static struct janus_json_parameter token_parameters[] = {
 	{"token", JSON_STRING, JANUS_JSON_PARAM_REQUIRED}
 };
+static struct janus_json_parameter tokens_parameters[] = {
+	{"tokens", JSON_ARRAY, JANUS_JSON_PARAM_REQUIRED}
+};
 static struct janus_json_parameter admin_parameters[] = {
 	{"transaction", JSON_STRING, JANUS_JSON_PARAM_REQUIRED},
 	{"janus", JSON_STRING, JANUS_JSON_PARAM_REQUIRED}
@@ -130,12 +134,22 @@ static struct janus_json_parameter admin_parameters[] = {
 static struct janus_json_parameter debug_parameters[] = {
 	{"debug", JANUS_JSON_BOOL, JANUS_JSON_PARAM_REQUIRED}
 };
+static struct janus_json_parameter refsampling_parameters[] = {
+	{"rate", JSON_INTEGER, JANUS_JSON_PARAM_REQUIRED | JANUS_JSON_PARAM_POSITIVE}
+};
+static struct janus_json_parameter profile_parameters[] = {
+	{"profile", JANUS_JSON_BOOL, JANUS_JSON_PARAM_REQUIRED}
+};
 static struct janus_json_parameter timeout_parameters[] = {
 	{"timeout", JSON_INTEGER, JANUS_JSON_PARAM_REQUIRED | JANUS_JSON_PARAM_POSITIVE}
 };
 static struct janus_json_parameter session_timeout_parameters[] = {
 	{"timeout", JSON_INTEGER, JANUS_JSON_PARAM_REQUIRED}
 };
+static struct janus_json_parameter page_parameters[] = {
+	{"limit", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
+	{"cursor", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE}
+};
 static struct janus_json_parameter level_parameters[] = {
 	{"level", JSON_INTEGER, JANUS_JSON_PARAM_REQUIRED | JANUS_JSON_PARAM_POSITIVE}
 };
@@ -157,6 +171,9 @@ static struct janus_json_parameter nmt_parameters[] = {
 static struct janus_json_parameter st_parameters[] = {
 	{"slowlink_threshold", JSON_INTEGER, JANUS_JSON_PARAM_REQUIRED | JANUS_JSON_PARAM_POSITIVE}
 };
+static struct janus_json_parameter ts_parameters[] = {
+	{"trace_sampling", JSON_INTEGER, JANUS_JSON_PARAM_REQUIRED | JANUS_JSON_PARAM_POSITIVE}
+};
 static struct janus_json_parameter ans_parameters[] = {
 	{"accept", JANUS_JSON_BOOL, JANUS_JSON_PARAM_REQUIRED}
 };
@@ -192,6 +209,9 @@ static struct janus_json_parameter text2pcap_parameters[] = {
 static struct janus_json_parameter handleinfo_parameters[] = {
 	{"plugin_only", JANUS_JSON_BOOL, 0}
 };
+static struct janus_json_parameter importhandle_parameters[] = {
+	{"exported", JSON_OBJECT, JANUS_JSON_PARAM_REQUIRED}
+};
 static struct janus_json_parameter resaddr_parameters[] = {
 	{"address", JSON_STRING, JANUS_JSON_PARAM_REQUIRED}
 };
@@ -602,7 +622,28 @@ static janus_transport_callbacks janus_handler_transport =
 	};
 static GAsyncQueue *requests = NULL;
 static janus_request exit_message;
-static GThreadPool *tasks = NULL;
+/* Requests are dispatched to two priority lanes, each backed by its own
+ * thread pool: plugin messages (which may take arbitrarily long in the
+ * plugin) go to the slow lane, while keepalives and trickles go to a
+ * small fast lane, so that during a signalling storm they're never stuck
+ * behind heavyweight requests and sessions don't time out spuriously.
+ * Each lane is sized adaptively from the time requests spend queued:
+ * when a request waited too long we add a thread (up to a cap), and when
+ * a lane has been quiet for a while we shrink back towards the base size */
+#define JANUS_LANE_GROW_WAIT		(50*1000)			/* Microseconds */
+#define JANUS_LANE_SHRINK_AFTER		(60*G_USEC_PER_SEC)
+typedef struct janus_request_lane {
+	const char *name;					/* Name of the lane, for logging */
+	GThreadPool *pool;					/* Thread pool backing this lane */
+	janus_metric_histogram histogram;	/* Queue-time histogram to feed */
+	int base, cap;						/* Threads to start from, and how many at most (0 means don't resize) */
+	int size;							/* Current maximum size of the pool */
+	gint64 last_busy;					/* Last time queueing delay asked for more threads */
+	janus_mutex mutex;					/* Mutex to serialize resizes */
+} janus_request_lane;
+static janus_request_lane slow_lane = { .name = "slow", .histogram = JANUS_METRIC_HIST_REQUEST_WAIT_SLOW };
+static janus_request_lane fast_lane = { .name = "fast", .histogram = JANUS_METRIC_HIST_REQUEST_WAIT_FAST };
+static GThreadPool *tasks = NULL, *fast_tasks = NULL;
 void janus_transport_task(gpointer data, gpointer user_data);
 ///@}
 
@@ -621,6 +662,10 @@ void janus_plugin_relay_data(janus_plugin_session *plugin_session, janus_plugin_
 void janus_plugin_send_pli(janus_plugin_session *plugin_session);
 void janus_plugin_send_pli_stream(janus_plugin_session *plugin_session, int mindex);
 void janus_plugin_send_remb(janus_plugin_session *plugin_session, uint32_t bitrate);
+uint32_t janus_plugin_get_bandwidth_estimate(janus_plugin_session *plugin_session);
+void *janus_plugin_get_relay_target(janus_plugin_session *plugin_session);
+void janus_plugin_relay_rtp_target(void *target, janus_plugin_rtp *packet);
+void janus_plugin_drop_relay_target(void *target);
 void janus_plugin_close_pc(janus_plugin_session *plugin_session);
 void janus_plugin_end_session(janus_plugin_session *plugin_session);
 void janus_plugin_notify_event(janus_plugin *plugin, janus_plugin_session *plugin_session, json_t *event);
@@ -643,15 +688,81 @@ static janus_callbacks janus_handler_plugin =
 		.auth_is_signed = janus_plugin_auth_is_signed,
 		.auth_is_signature_valid = janus_plugin_auth_is_signature_valid,
 		.auth_signature_contains = janus_plugin_auth_signature_contains,
+		.get_bandwidth_estimate = janus_plugin_get_bandwidth_estimate,
+		.get_relay_target = janus_plugin_get_relay_target,
+		.relay_rtp_target = janus_plugin_relay_rtp_target,
+		.drop_relay_target = janus_plugin_drop_relay_target,
 	};
 ///@}
 
 
 /* Core Sessions */
-static janus_mutex sessions_mutex = JANUS_MUTEX_INITIALIZER;
-static GHashTable *sessions = NULL;
+/* The global session table is sharded by session ID, with a lock per shard:
+ * this way session lookups, creations and destructions coming from different
+ * transports don't all serialize on a single mutex (which used to be quite
+ * visible during reconnect storms), and the watchdog only ever blocks the
+ * shard of a session it's actually reaping */
+#define JANUS_SESSIONS_SHARDS	64
+typedef struct janus_sessions_shard {
+	janus_mutex mutex;
+	GHashTable *table;
+} janus_sessions_shard;
+static janus_sessions_shard sessions_shards[JANUS_SESSIONS_SHARDS];
+static gboolean sessions_inited = FALSE;
+/* Map a session ID to the shard its session lives in */
+static janus_sessions_shard *janus_session_shard(guint64 session_id) {
+	return &sessions_shards[g_int64_hash(&session_id) & (JANUS_SESSIONS_SHARDS-1)];
+}
 static GMainContext *sessions_watchdog_context = NULL;
 
+/* Session timeouts are tracked in a timer wheel, so that the watchdog
+ * only ever visits sessions whose scheduled expiry has actually come
+ * due, rather than sweeping the whole session table every couple of
+ * seconds (which with many thousands of sessions meant blocking each
+ * shard for a long time). The wheel stores session IDs, not pointers:
+ * nothing is ever removed from it eagerly, the sweep simply drops IDs
+ * whose session is gone in the meanwhile, and re-buckets sessions that
+ * turn out to still be active. Activity on a session only updates its
+ * last_activity timestamp, it never touches the wheel */
+#define JANUS_SESSIONS_WHEEL_SLOTS	256
+#define JANUS_SESSIONS_WHEEL_SPAN	2	/* Seconds covered by each slot */
+static GSList *sessions_wheel[JANUS_SESSIONS_WHEEL_SLOTS];
+static janus_mutex sessions_wheel_mutex = JANUS_MUTEX_INITIALIZER;
+static gint64 sessions_wheel_cursor = 0;
+/* Schedule a timeout check for a session at the specified monotonic time */
+static void janus_sessions_wheel_schedule(guint64 session_id, gint64 expiry) {
+	gint64 slot = (expiry / G_USEC_PER_SEC) / JANUS_SESSIONS_WHEEL_SPAN;
+	janus_mutex_lock(&sessions_wheel_mutex);
+	/* Never schedule in a slot the sweep has already passed */
+	if(slot <= sessions_wheel_cursor)
+		slot = sessions_wheel_cursor + 1;
+	sessions_wheel[slot % JANUS_SESSIONS_WHEEL_SLOTS] =
+		g_slist_prepend(sessions_wheel[slot % JANUS_SESSIONS_WHEEL_SLOTS], janus_uint64_dup(session_id));
+	janus_mutex_unlock(&sessions_wheel_mutex);
+}
+/* When is this session due for its next timeout check? */
+static gint64 janus_session_expiry(janus_session *session) {
+	/* Use either session-specific timeout or global */
+	gint64 timeout = (gint64)session->timeout;
+	if(timeout == -1)
+		timeout = (gint64)global_session_timeout;
+	gint64 expiry = 0;
+	if(timeout > 0)
+		expiry = session->last_activity + timeout * G_USEC_PER_SEC;
+	if(g_atomic_int_get(&session->transport_gone) && reclaim_session_timeout > 0) {
+		gint64 reclaim = session->last_activity + (gint64)reclaim_session_timeout * G_USEC_PER_SEC;
+		if(expiry == 0 || reclaim < expiry)
+			expiry = reclaim;
+	}
+	if(expiry == 0) {
+		/* Timeouts are disabled for this session: check again (e.g., in
+		 * case that changed in the meanwhile) a full wheel turn from now */
+		expiry = janus_get_monotonic_time() +
+			(gint64)(JANUS_SESSIONS_WHEEL_SLOTS - 2) * JANUS_SESSIONS_WHEEL_SPAN * G_USEC_PER_SEC;
+	}
+	return expiry;
+}
+
 /* Counters */
 static volatile gint sessions_num = 0;
 static volatile gint handles_num = 0;
@@ -661,6 +772,78 @@ static void janus_ice_handle_dereference(janus_ice_handle *handle) {
 		janus_refcount_decrease(&handle->ref);
 }
 
+/* The per-session map of handles is treated as an immutable snapshot,
+ * just like the token store in auth.c: looking a handle up is an atomic
+ * pointer read plus a lookup, with no locking, while changes (which are
+ * comparatively rare, even on sessions multiplexing tens of handles)
+ * clone the snapshot under the session mutex and atomically publish the
+ * copy. Since every snapshot owns a reference on each handle it maps,
+ * retired snapshots keep lookups safe until they're destroyed, which
+ * only happens after a grace period (or when the session is freed) */
+typedef struct janus_session_retired_handles {
+	GHashTable *table;
+	gint64 when;
+} janus_session_retired_handles;
+#define JANUS_SESSION_HANDLES_GRACE		(5*G_USEC_PER_SEC)
+
+static GHashTable *janus_session_handles_table_new(void) {
+	return g_hash_table_new_full(g_int64_hash, g_int64_equal, (GDestroyNotify)g_free, (GDestroyNotify)janus_ice_handle_dereference);
+}
+
+/* Clone the current snapshot (must be called with the session mutex held) */
+static GHashTable *janus_session_handles_clone(janus_session *session) {
+	GHashTable *snapshot = janus_session_handles_table_new();
+	if(session->ice_handles != NULL) {
+		GHashTableIter iter;
+		gpointer value;
+		g_hash_table_iter_init(&iter, session->ice_handles);
+		while(g_hash_table_iter_next(&iter, NULL, &value)) {
+			janus_ice_handle *handle = (janus_ice_handle *)value;
+			janus_refcount_increase(&handle->ref);
+			g_hash_table_insert(snapshot, janus_uint64_dup(handle->handle_id), handle);
+		}
+	}
+	return snapshot;
+}
+
+/* Publish a new snapshot, retiring the old one (must be called with
+ * the session mutex held) */
+static void janus_session_handles_publish(janus_session *session, GHashTable *snapshot) {
+	GHashTable *old = session->ice_handles;
+	g_atomic_pointer_set(&session->ice_handles, snapshot);
+	gint64 now = janus_get_monotonic_time();
+	if(old != NULL) {
+		janus_session_retired_handles *retired = g_malloc(sizeof(janus_session_retired_handles));
+		retired->table = old;
+		retired->when = now;
+		session->retired_handles = g_slist_prepend(session->retired_handles, retired);
+	}
+	/* Get rid of the snapshots no lookup can be working on anymore:
+	 * the list is newest first, so we can cut it at the first old one */
+	GSList *item = session->retired_handles, *prev = NULL;
+	while(item != NULL) {
+		janus_session_retired_handles *retired = (janus_session_retired_handles *)item->data;
+		if(now - retired->when >= JANUS_SESSION_HANDLES_GRACE)
+			break;
+		prev = item;
+		item = item->next;
+	}
+	if(item != NULL) {
+		if(prev != NULL)
+			prev->next = NULL;
+		else
+			session->retired_handles = NULL;
+		GSList *drop = item;
+		while(drop != NULL) {
+			janus_session_retired_handles *retired = (janus_session_retired_handles *)drop->data;
+			g_hash_table_destroy(retired->table);
+			g_free(retired);
+			drop = drop->next;
+		}
+		g_slist_free(item);
+	}
+}
+
 static void janus_session_free(const janus_refcount *session_ref) {
 	janus_session *session = janus_refcount_containerof(session_ref, janus_session, ref);
 	/* This session can be destroyed, free all the resources */
@@ -668,25 +851,35 @@ static void janus_session_free(const janus_refcount *session_ref) {
 		g_hash_table_destroy(session->ice_handles);
 		session->ice_handles = NULL;
 	}
+	GSList *drop = session->retired_handles;
+	while(drop != NULL) {
+		janus_session_retired_handles *retired = (janus_session_retired_handles *)drop->data;
+		g_hash_table_destroy(retired->table);
+		g_free(retired);
+		drop = drop->next;
+	}
+	g_slist_free(session->retired_handles);
+	session->retired_handles = NULL;
 	if(session->source != NULL) {
 		janus_request_destroy(session->source);
 		session->source = NULL;
 	}
 	janus_mutex_destroy(&session->mutex);
+	janus_mutex_destroy(&session->source_mutex);
 	g_free(session);
 }
 
 static janus_request *janus_session_get_request(janus_session *session) {
 	if(session == NULL)
 		return NULL;
-	janus_mutex_lock(&session->mutex);
+	janus_mutex_lock(&session->source_mutex);
 	janus_request *source = session->source;
 	if(source != NULL && !g_atomic_int_get(&source->destroyed)) {
 		janus_refcount_increase(&source->ref);
 	} else {
 		source = NULL;
 	}
-	janus_mutex_unlock(&session->mutex);
+	janus_mutex_unlock(&session->source_mutex);
 	return source;
 }
 static void janus_request_unref(janus_request *request) {
@@ -695,47 +888,74 @@ static void janus_request_unref(janus_request *request) {
 }
 
 static gboolean janus_check_sessions(gpointer user_data) {
-	janus_mutex_lock(&sessions_mutex);
-	if(sessions && g_hash_table_size(sessions) > 0) {
-		GHashTableIter iter;
-		gpointer value;
-		g_hash_table_iter_init(&iter, sessions);
-		while (g_hash_table_iter_next(&iter, NULL, &value)) {
-			janus_session *session = (janus_session *) value;
-			if(!session || g_atomic_int_get(&session->destroyed))
-				continue;
-			gint64 now = janus_get_monotonic_time();
-			/* Use either session-specific timeout or global. */
-			gint64 timeout = (gint64)session->timeout;
-			if(timeout == -1)
-				timeout = (gint64)global_session_timeout;
-			if((timeout > 0 && (now - session->last_activity >= timeout * G_USEC_PER_SEC)) ||
-					((g_atomic_int_get(&session->transport_gone) && now - session->last_activity >= (gint64)reclaim_session_timeout * G_USEC_PER_SEC))) {
-				if(g_atomic_int_compare_and_exchange(&session->timedout, 0, 1)) {
-					JANUS_LOG(LOG_INFO, "Timeout expired for session %"SCNu64"...\n", session->session_id);
-					/* Mark the session as over, we'll deal with it later */
-					janus_session_handles_clear(session);
-					/* Notify the transport */
-					janus_request *source = janus_session_get_request(session);
-					if(source) {
-						json_t *event = janus_create_message("timeout", session->session_id, NULL);
-						/* Send this to the transport client and notify the session's over */
-						source->transport->send_message(source->instance, NULL, FALSE, event);
-						source->transport->session_over(source->instance, session->session_id, TRUE, FALSE);
-					}
-					janus_request_unref(source);
-					/* Notify event handlers as well */
-					if(janus_events_is_enabled())
-						janus_events_notify_handlers(JANUS_EVENT_TYPE_SESSION, JANUS_EVENT_SUBTYPE_NONE,
-							session->session_id, "timeout", NULL);
-					g_hash_table_iter_remove(&iter);
-					g_atomic_int_dec_and_test(&sessions_num);
-					janus_session_destroy(session);
-				}
+	if(!sessions_inited)
+		return G_SOURCE_CONTINUE;
+	/* Only visit the wheel slots that have come due since the last
+	 * sweep: whatever we find there has either actually expired, or is
+	 * still active and just gets re-bucketed at its new expiry time */
+	gint64 now = janus_get_monotonic_time();
+	gint64 due = (now / G_USEC_PER_SEC) / JANUS_SESSIONS_WHEEL_SPAN;
+	janus_mutex_lock(&sessions_wheel_mutex);
+	if(due - sessions_wheel_cursor > JANUS_SESSIONS_WHEEL_SLOTS) {
+		/* We've been stalled for more than a full turn, don't wrap twice */
+		sessions_wheel_cursor = due - JANUS_SESSIONS_WHEEL_SLOTS;
+	}
+	GSList *check = NULL;
+	while(sessions_wheel_cursor < due) {
+		sessions_wheel_cursor++;
+		int slot = sessions_wheel_cursor % JANUS_SESSIONS_WHEEL_SLOTS;
+		check = g_slist_concat(sessions_wheel[slot], check);
+		sessions_wheel[slot] = NULL;
+	}
+	janus_mutex_unlock(&sessions_wheel_mutex);
+	GSList *item = NULL;
+	for(item = check; item != NULL; item = item->next) {
+		guint64 session_id = *((guint64 *)item->data);
+		janus_session *session = janus_session_find(session_id);
+		if(session == NULL) {
+			/* The session's gone, just drop the stale wheel entry */
+			continue;
+		}
+		if(g_atomic_int_get(&session->destroyed)) {
+			janus_refcount_decrease(&session->ref);
+			continue;
+		}
+		now = janus_get_monotonic_time();
+		gint64 expiry = janus_session_expiry(session);
+		if(expiry > now) {
+			/* Still active (or timeouts are disabled), re-bucket it */
+			janus_sessions_wheel_schedule(session_id, expiry);
+			janus_refcount_decrease(&session->ref);
+			continue;
+		}
+		if(g_atomic_int_compare_and_exchange(&session->timedout, 0, 1)) {
+			JANUS_LOG(LOG_INFO, "Timeout expired for session %"SCNu64"...\n", session_id);
+			/* Mark the session as over, we'll deal with it later */
+			janus_session_handles_clear(session);
+			/* Notify the transport */
+			janus_request *source = janus_session_get_request(session);
+			if(source) {
+				json_t *event = janus_create_message("timeout", session_id, NULL);
+				/* Send this to the transport client and notify the session's over */
+				source->transport->send_message(source->instance, NULL, FALSE, event);
+				source->transport->session_over(source->instance, session_id, TRUE, FALSE);
 			}
+			janus_request_unref(source);
+			/* Notify event handlers as well */
+			if(janus_events_is_enabled())
+				janus_events_notify_handlers(JANUS_EVENT_TYPE_SESSION, JANUS_EVENT_SUBTYPE_NONE,
+					session_id, "timeout", NULL);
+			/* Remove the session from its shard and get rid of it */
+			janus_sessions_shard *shard = janus_session_shard(session_id);
+			janus_mutex_lock(&shard->mutex);
+			if(g_hash_table_remove(shard->table, &session_id))
+				g_atomic_int_dec_and_test(&sessions_num);
+			janus_mutex_unlock(&shard->mutex);
+			janus_session_destroy(session);
 		}
+		janus_refcount_decrease(&session->ref);
 	}
-	janus_mutex_unlock(&sessions_mutex);
+	g_slist_free_full(check, (GDestroyNotify)g_free);
 
 	return G_SOURCE_CONTINUE;
 }
@@ -798,23 +1018,29 @@ janus_session *janus_session_create(guint64 session_id) {
 	g_atomic_int_set(&session->transport_gone, 0);
 	session->last_activity = janus_get_monotonic_time();
 	session->ice_handles = NULL;
+	session->retired_handles = NULL;
 	janus_mutex_init(&session->mutex);
-	janus_mutex_lock(&sessions_mutex);
-	g_hash_table_insert(sessions, janus_uint64_dup(session->session_id), session);
+	janus_mutex_init(&session->source_mutex);
+	janus_sessions_shard *shard = janus_session_shard(session->session_id);
+	janus_mutex_lock(&shard->mutex);
+	g_hash_table_insert(shard->table, janus_uint64_dup(session->session_id), session);
 	g_atomic_int_inc(&sessions_num);
-	janus_mutex_unlock(&sessions_mutex);
+	janus_mutex_unlock(&shard->mutex);
+	/* Schedule the first timeout check in the timer wheel */
+	janus_sessions_wheel_schedule(session->session_id, janus_session_expiry(session));
 	return session;
 }
 
 janus_session *janus_session_find(guint64 session_id) {
-	janus_mutex_lock(&sessions_mutex);
-	janus_session *session = g_hash_table_lookup(sessions, &session_id);
+	janus_sessions_shard *shard = janus_session_shard(session_id);
+	janus_mutex_lock(&shard->mutex);
+	janus_session *session = g_hash_table_lookup(shard->table, &session_id);
 	if(session != NULL) {
 		/* A successful find automatically increases the reference counter:
 		 * it's up to the caller to decrease it again when done */
 		janus_refcount_increase(&session->ref);
 	}
-	janus_mutex_unlock(&sessions_mutex);
+	janus_mutex_unlock(&shard->mutex);
 	return session;
 }
 
@@ -853,32 +1079,37 @@ gint janus_session_destroy(janus_session *session) {
 janus_ice_handle *janus_session_handles_find(janus_session *session, guint64 handle_id) {
 	if(session == NULL)
 		return NULL;
-	janus_mutex_lock(&session->mutex);
-	janus_ice_handle *handle = session->ice_handles ? g_hash_table_lookup(session->ice_handles, &handle_id) : NULL;
+	/* Lock-free: lookups work on the currently published snapshot, which
+	 * owns a reference on every handle it maps (see the comment on top) */
+	GHashTable *snapshot = g_atomic_pointer_get(&session->ice_handles);
+	janus_ice_handle *handle = snapshot ? g_hash_table_lookup(snapshot, &handle_id) : NULL;
 	if(handle != NULL) {
 		/* A successful find automatically increases the reference counter:
 		 * it's up to the caller to decrease it again when done */
 		janus_refcount_increase(&handle->ref);
 	}
-	janus_mutex_unlock(&session->mutex);
 	return handle;
 }
 
 void janus_session_handles_insert(janus_session *session, janus_ice_handle *handle) {
 	janus_mutex_lock(&session->mutex);
-	if(session->ice_handles == NULL)
-		session->ice_handles = g_hash_table_new_full(g_int64_hash, g_int64_equal, (GDestroyNotify)g_free, (GDestroyNotify)janus_ice_handle_dereference);
+	GHashTable *snapshot = janus_session_handles_clone(session);
 	janus_refcount_increase(&handle->ref);
-	g_hash_table_insert(session->ice_handles, janus_uint64_dup(handle->handle_id), handle);
+	g_hash_table_insert(snapshot, janus_uint64_dup(handle->handle_id), handle);
 	g_atomic_int_inc(&handles_num);
+	janus_session_handles_publish(session, snapshot);
 	janus_mutex_unlock(&session->mutex);
 }
 
 gint janus_session_handles_remove(janus_session *session, janus_ice_handle *handle) {
 	janus_mutex_lock(&session->mutex);
 	gint error = janus_ice_handle_destroy(session, handle);
-	if(g_hash_table_remove(session->ice_handles, &handle->handle_id))
+	if(session->ice_handles != NULL && g_hash_table_lookup(session->ice_handles, &handle->handle_id) != NULL) {
+		GHashTable *snapshot = janus_session_handles_clone(session);
+		g_hash_table_remove(snapshot, &handle->handle_id);
+		janus_session_handles_publish(session, snapshot);
 		g_atomic_int_dec_and_test(&handles_num);
+	}
 	janus_mutex_unlock(&session->mutex);
 	return error;
 }
@@ -888,16 +1119,18 @@ void janus_session_handles_clear(janus_session *session) {
 	if(session->ice_handles != NULL && g_hash_table_size(session->ice_handles) > 0) {
 		GHashTableIter iter;
 		gpointer value;
-		/* Remove all handles */
+		/* Destroy all handles */
 		g_hash_table_iter_init(&iter, session->ice_handles);
 		while (g_hash_table_iter_next(&iter, NULL, &value)) {
 			janus_ice_handle *handle = value;
 			if(!handle)
 				continue;
 			janus_ice_handle_destroy(session, handle);
-			g_hash_table_iter_remove(&iter);
 			g_atomic_int_dec_and_test(&handles_num);
 		}
+		/* Publish an empty snapshot, the old one (which still owns the
+		 * references) is retired as usual */
+		janus_session_handles_publish(session, janus_session_handles_table_new());
 	}
 	janus_mutex_unlock(&session->mutex);
 }
@@ -920,6 +1153,68 @@ json_t *janus_session_handles_list_json(janus_session *session) {
 	return list;
 }
 
+static guint64 janus_session_handles_memory(janus_session *session) {
+	/* Sum the arena usage of all the handles in the session, for accounting */
+	guint64 bytes = 0;
+	janus_mutex_lock(&session->mutex);
+	if(session->ice_handles != NULL && g_hash_table_size(session->ice_handles) > 0) {
+		GHashTableIter iter;
+		gpointer value;
+		g_hash_table_iter_init(&iter, session->ice_handles);
+		while (g_hash_table_iter_next(&iter, NULL, &value)) {
+			janus_ice_handle *handle = value;
+			if(!handle || handle->arena == NULL)
+				continue;
+			bytes += handle->arena->offset + handle->arena->overflow_bytes;
+		}
+	}
+	janus_mutex_unlock(&session->mutex);
+	return bytes;
+}
+
+/* Helpers to paginate ID listings in the Admin API: IDs larger than the
+ * cursor are collected, sorted, and only the first page is returned, with
+ * the last ID acting as the cursor for the next query. Since IDs are
+ * random, pages are served in ID order, which is stable under concurrent
+ * session/handle creation and teardown without keeping any state (or any
+ * lock) between queries */
+static gint janus_page_id_compare(gconstpointer a, gconstpointer b) {
+	guint64 ida = *(guint64 *)a, idb = *(guint64 *)b;
+	return ida < idb ? -1 : (ida > idb ? 1 : 0);
+}
+static guint64 janus_page_ids(GArray *ids, guint limit, json_t *list) {
+	/* Emit (at most) a page of sorted IDs, and return the next cursor
+	 * (0 if there's nothing beyond this page) */
+	g_array_sort(ids, janus_page_id_compare);
+	guint64 next_cursor = 0;
+	guint i = 0;
+	for(i = 0; i < ids->len && i < limit; i++)
+		json_array_append_new(list, json_integer(g_array_index(ids, guint64, i)));
+	if(ids->len > limit)
+		next_cursor = g_array_index(ids, guint64, limit-1);
+	return next_cursor;
+}
+static json_t *janus_session_handles_page_json(janus_session *session, guint limit, guint64 cursor, guint64 *next_cursor) {
+	json_t *list = json_array();
+	/* Snapshots are immutable and retired with a grace period, so we can
+	 * walk the current one without taking the session mutex at all */
+	GHashTable *snapshot = g_atomic_pointer_get(&session->ice_handles);
+	if(snapshot != NULL && g_hash_table_size(snapshot) > 0) {
+		GArray *ids = g_array_new(FALSE, FALSE, sizeof(guint64));
+		GHashTableIter iter;
+		gpointer value;
+		g_hash_table_iter_init(&iter, snapshot);
+		while(g_hash_table_iter_next(&iter, NULL, &value)) {
+			janus_ice_handle *handle = value;
+			if(handle != NULL && handle->handle_id > cursor)
+				g_array_append_val(ids, handle->handle_id);
+		}
+		*next_cursor = janus_page_ids(ids, limit, list);
+		g_array_free(ids, TRUE);
+	}
+	return list;
+}
+
 /* Requests management */
 static void janus_request_free(const janus_refcount *request_ref) {
 	janus_request *request = janus_refcount_containerof(request_ref, janus_request, ref);
@@ -954,6 +1249,7 @@ janus_request *janus_request_new(janus_transport *transport, janus_transport_ses
 	} else {
 		request->error = NULL;
 	}
+	request->queued = janus_get_monotonic_time();
 	g_atomic_int_set(&request->destroyed, 0);
 	janus_refcount_init(&request->ref, janus_request_free);
 	return request;
@@ -1292,10 +1588,11 @@ int janus_process_incoming_request(janus_request *request) {
 			ret = janus_process_error(request, session_id, transaction_text, JANUS_ERROR_INVALID_REQUEST_PATH, "Unhandled request '%s' at this path", message_text);
 			goto jsondone;
 		}
-		janus_mutex_lock(&sessions_mutex);
-		if(g_hash_table_remove(sessions, &session->session_id))
+		janus_sessions_shard *shard = janus_session_shard(session->session_id);
+		janus_mutex_lock(&shard->mutex);
+		if(g_hash_table_remove(shard->table, &session->session_id))
 			g_atomic_int_dec_and_test(&sessions_num);
-		janus_mutex_unlock(&sessions_mutex);
+		janus_mutex_unlock(&shard->mutex);
 		/* Notify the source that the session has been destroyed */
 		janus_request *source = janus_session_get_request(session);
 		if(source && source->transport)
@@ -1350,11 +1647,11 @@ int janus_process_incoming_request(janus_request *request) {
 		/* Send the success reply */
 		ret = janus_process_success(request, reply);
 	} else if(!strcasecmp(message_text, "claim")) {
-		janus_mutex_lock(&session->mutex);
+		janus_mutex_lock(&session->source_mutex);
 		if(session->source != NULL) {
 			/* If we're claiming from the same transport, ignore */
 			if(session->source->instance == request->instance) {
-				janus_mutex_unlock(&session->mutex);
+				janus_mutex_unlock(&session->source_mutex);
 				/* Prepare JSON reply */
 				json_t *reply = json_object();
 				json_object_set_new(reply, "janus", json_string("success"));
@@ -1374,7 +1671,7 @@ int janus_process_incoming_request(janus_request *request) {
 		session->source->transport->session_claimed(session->source->instance, session->session_id);
 		/* Previous transport may be gone, clear flag */
 		g_atomic_int_set(&session->transport_gone, 0);
-		janus_mutex_unlock(&session->mutex);
+		janus_mutex_unlock(&session->source_mutex);
 		/* Prepare JSON reply */
 		json_t *reply = json_object();
 		json_object_set_new(reply, "janus", json_string("success"));
@@ -2138,6 +2435,157 @@ jsondone:
 }
 
 /* Admin/monitor WebServer requests handler */
+static void janus_admin_lock_contention_info(void *mutex, const char *name,
+		guint64 samples, guint64 contended, guint64 wait_us, guint64 wait_max_us, void *user_data) {
+	json_t *list = (json_t *)user_data;
+	json_t *info = json_object();
+	json_object_set_new(info, "name", json_string(name));
+	json_object_set_new(info, "samples", json_integer(samples));
+	json_object_set_new(info, "contended", json_integer(contended));
+	json_object_set_new(info, "wait_us", json_integer(wait_us));
+	json_object_set_new(info, "wait_max_us", json_integer(wait_max_us));
+	json_array_append_new(list, info);
+}
+
+/* Registry of the configuration settings that the "reload_config" Admin API
+ * request can apply at runtime: everything else in janus.jcfg is only read
+ * at startup, and changing it still requires a restart */
+static const char *janus_reloadable_settings[] = {
+	"general.debug_level",
+	"general.debug_timestamps",
+	"general.debug_colors",
+	"general.session_timeout",
+	"general.token_auth_secret",
+	"media.dscp",
+	"media.min_nack_queue",
+	"media.nack_optimizations",
+	"media.no_media_timer",
+	"media.slowlink_threshold",
+	"media.queued_packets_limit",
+	"media.twcc_period",
+	"events.stats_period",
+	"events.combine_media_stats",
+	NULL
+};
+/* Static helper to re-parse the configuration file and apply the settings in
+ * the reloadable registry: returns an object with what was actually applied */
+static json_t *janus_admin_config_reload(void) {
+	janus_config *new_config = janus_config_parse(config_file);
+	if(new_config == NULL)
+		return NULL;
+	json_t *applied = json_object();
+	janus_config_category *c_general = janus_config_get_create(new_config, NULL, janus_config_type_category, "general");
+	janus_config_category *c_media = janus_config_get_create(new_config, NULL, janus_config_type_category, "media");
+	janus_config_category *c_events = janus_config_get_create(new_config, NULL, janus_config_type_category, "events");
+	/* Logging */
+	janus_config_item *item = janus_config_get(new_config, c_general, janus_config_type_item, "debug_level");
+	if(item && item->value) {
+		int level = atoi(item->value);
+		if(level >= LOG_NONE && level <= LOG_MAX && level != janus_log_level) {
+			janus_log_level = level;
+			json_object_set_new(applied, "debug_level", json_integer(janus_log_level));
+		}
+	}
+	item = janus_config_get(new_config, c_general, janus_config_type_item, "debug_timestamps");
+	if(item && item->value && janus_is_true(item->value) != janus_log_timestamps) {
+		janus_log_timestamps = janus_is_true(item->value);
+		json_object_set_new(applied, "debug_timestamps", janus_log_timestamps ? json_true() : json_false());
+	}
+	item = janus_config_get(new_config, c_general, janus_config_type_item, "debug_colors");
+	if(item && item->value && janus_is_true(item->value) != janus_log_colors) {
+		janus_log_colors = janus_is_true(item->value);
+		json_object_set_new(applied, "debug_colors", janus_log_colors ? json_true() : json_false());
+	}
+	/* Session timeout */
+	item = janus_config_get(new_config, c_general, janus_config_type_item, "session_timeout");
+	if(item && item->value) {
+		int st = atoi(item->value);
+		if(st >= 0 && (uint)st != global_session_timeout) {
+			global_session_timeout = st;
+			json_object_set_new(applied, "session_timeout", json_integer(global_session_timeout));
+		}
+	}
+	/* Token authentication secret (only relevant in signed-token mode; we
+	 * don't echo the secret itself back, just the fact we rotated it) */
+	item = janus_config_get(new_config, c_general, janus_config_type_item, "token_auth_secret");
+	if(item && item->value && janus_auth_is_signed_mode()) {
+		janus_auth_update_secret(item->value);
+		json_object_set_new(applied, "token_auth_secret", json_true());
+	}
+	/* Media knobs (these use the same setters the Admin API exposes, so they
+	 * only affect PeerConnections from now on where that's the semantics) */
+	item = janus_config_get(new_config, c_media, janus_config_type_item, "dscp");
+	if(item && item->value) {
+		int dscp = atoi(item->value);
+		if(dscp >= 0) {
+			janus_set_dscp(dscp);
+			json_object_set_new(applied, "dscp", json_integer(dscp));
+		}
+	}
+	item = janus_config_get(new_config, c_media, janus_config_type_item, "min_nack_queue");
+	if(item && item->value) {
+		int mnq = atoi(item->value);
+		if(mnq >= 0) {
+			janus_set_min_nack_queue(mnq);
+			json_object_set_new(applied, "min_nack_queue", json_integer(janus_get_min_nack_queue()));
+		}
+	}
+	item = janus_config_get(new_config, c_media, janus_config_type_item, "nack_optimizations");
+	if(item && item->value) {
+		janus_set_nack_optimizations_enabled(janus_is_true(item->value));
+		json_object_set_new(applied, "nack_optimizations", janus_is_nack_optimizations_enabled() ? json_true() : json_false());
+	}
+	item = janus_config_get(new_config, c_media, janus_config_type_item, "no_media_timer");
+	if(item && item->value) {
+		int nmt = atoi(item->value);
+		if(nmt >= 0) {
+			janus_set_no_media_timer(nmt);
+			json_object_set_new(applied, "no_media_timer", json_integer(janus_get_no_media_timer()));
+		}
+	}
+	item = janus_config_get(new_config, c_media, janus_config_type_item, "slowlink_threshold");
+	if(item && item->value) {
+		int st = atoi(item->value);
+		if(st >= 0) {
+			janus_set_slowlink_threshold(st);
+			json_object_set_new(applied, "slowlink_threshold", json_integer(janus_get_slowlink_threshold()));
+		}
+	}
+	item = janus_config_get(new_config, c_media, janus_config_type_item, "queued_packets_limit");
+	if(item && item->value) {
+		int qpl = atoi(item->value);
+		if(qpl >= 0) {
+			janus_set_queued_packets_limit(qpl);
+			json_object_set_new(applied, "queued_packets_limit", json_integer(qpl));
+		}
+	}
+	item = janus_config_get(new_config, c_media, janus_config_type_item, "twcc_period");
+	if(item && item->value) {
+		int tp = atoi(item->value);
+		if(tp > 0) {
+			janus_set_twcc_period(tp);
+			json_object_set_new(applied, "twcc_period", json_integer(tp));
+		}
+	}
+	/* Event handlers tweaks (enabling/disabling the broadcaster itself or
+	 * loading new handlers still requires a restart) */
+	item = janus_config_get(new_config, c_events, janus_config_type_item, "stats_period");
+	if(item && item->value) {
+		int period = atoi(item->value);
+		if(period >= 0) {
+			janus_ice_set_event_stats_period(period);
+			json_object_set_new(applied, "stats_period", json_integer(period));
+		}
+	}
+	item = janus_config_get(new_config, c_events, janus_config_type_item, "combine_media_stats");
+	if(item && item->value) {
+		janus_ice_event_set_combine_media_stats(janus_is_true(item->value));
+		json_object_set_new(applied, "combine_media_stats", janus_is_true(item->value) ? json_true() : json_false());
+	}
+	janus_config_destroy(new_config);
+	return applied;
+}
+
 int janus_process_incoming_admin_request(janus_request *request) {
 	int ret = -1;
 	int error_code = 0;
@@ -2207,10 +2655,13 @@ int janus_process_incoming_admin_request(janus_request *request) {
 			json_object_set_new(status, "log_rotate_sig", json_integer(janus_log_rotate_sig));
 			json_object_set_new(status, "locking_debug", lock_debug ? json_true() : json_false());
 			json_object_set_new(status, "refcount_debug", refcount_debug ? json_true() : json_false());
+			json_object_set_new(status, "refcount_sampling", json_integer(g_atomic_int_get(&refcount_sample_rate)));
 			json_object_set_new(status, "min_nack_queue", json_integer(janus_get_min_nack_queue()));
 			json_object_set_new(status, "nack-optimizations", janus_is_nack_optimizations_enabled() ? json_true() : json_false());
 			json_object_set_new(status, "no_media_timer", json_integer(janus_get_no_media_timer()));
 			json_object_set_new(status, "slowlink_threshold", json_integer(janus_get_slowlink_threshold()));
+			json_object_set_new(status, "recorder_pending_bytes", json_integer(janus_recorder_pending_bytes()));
+			json_object_set_new(status, "recorder_dropped_frames", json_integer(janus_recorder_dropped_frames()));
 			json_object_set_new(reply, "status", status);
 			/* Send the success reply */
 			ret = janus_process_success(request, reply);
@@ -2281,6 +2732,37 @@ int janus_process_incoming_admin_request(janus_request *request) {
 			/* Send the success reply */
 			ret = janus_process_success(request, reply);
 			goto jsondone;
+		} else if(!strcasecmp(message_text, "set_lock_profile")) {
+			/* Enable/disable the sampling lock contention profiler */
+			JANUS_VALIDATE_JSON_OBJECT(root, profile_parameters,
+				error_code, error_cause, FALSE,
+				JANUS_ERROR_MISSING_MANDATORY_ELEMENT, JANUS_ERROR_INVALID_ELEMENT_TYPE);
+			if(error_code != 0) {
+				ret = janus_process_error_string(request, session_id, transaction_text, error_code, error_cause);
+				goto jsondone;
+			}
+			json_t *profile = json_object_get(root, "profile");
+			g_atomic_int_set(&lock_profile, json_is_true(profile) ? 1 : 0);
+			/* Prepare JSON reply */
+			json_t *reply = janus_create_message("success", 0, transaction_text);
+			json_object_set_new(reply, "lock_profile", json_is_true(profile) ? json_true() : json_false());
+			/* Send the success reply */
+			ret = janus_process_success(request, reply);
+			goto jsondone;
+		} else if(!strcasecmp(message_text, "lock_contention")) {
+			/* Return the per-lock table the contention profiler collected so far,
+			 * optionally resetting the counters afterwards ("reset": true) */
+			json_t *list = json_array();
+			janus_mutex_profile_foreach(janus_admin_lock_contention_info, list);
+			if(json_is_true(json_object_get(root, "reset")))
+				janus_mutex_profile_reset();
+			/* Prepare JSON reply */
+			json_t *reply = janus_create_message("success", 0, transaction_text);
+			json_object_set_new(reply, "lock_profile", g_atomic_int_get(&lock_profile) ? json_true() : json_false());
+			json_object_set_new(reply, "locks", list);
+			/* Send the success reply */
+			ret = janus_process_success(request, reply);
+			goto jsondone;
 		} else if(!strcasecmp(message_text, "set_refcount_debug")) {
 			/* Enable/disable the reference counter debug (would show a message on the console for every increase/decrease) */
 			JANUS_VALIDATE_JSON_OBJECT(root, debug_parameters,
@@ -2302,6 +2784,30 @@ int janus_process_incoming_admin_request(janus_request *request) {
 			/* Send the success reply */
 			ret = janus_process_success(request, reply);
 			goto jsondone;
+		} else if(!strcasecmp(message_text, "set_refcount_sampling")) {
+			/* Change the rate of the sampled reference tracker (0 disables it) */
+			JANUS_VALIDATE_JSON_OBJECT(root, refsampling_parameters,
+				error_code, error_cause, FALSE,
+				JANUS_ERROR_MISSING_MANDATORY_ELEMENT, JANUS_ERROR_INVALID_ELEMENT_TYPE);
+			if(error_code != 0) {
+				ret = janus_process_error_string(request, session_id, transaction_text, error_code, error_cause);
+				goto jsondone;
+			}
+			json_t *rate = json_object_get(root, "rate");
+			g_atomic_int_set(&refcount_sample_rate, (gint)json_integer_value(rate));
+			/* Prepare JSON reply */
+			json_t *reply = janus_create_message("success", 0, transaction_text);
+			json_object_set_new(reply, "refcount_sampling", json_integer(g_atomic_int_get(&refcount_sample_rate)));
+			/* Send the success reply */
+			ret = janus_process_success(request, reply);
+			goto jsondone;
+		} else if(!strcasecmp(message_text, "refcount_summary")) {
+			/* Dump the objects the sampled reference tracker currently knows about */
+			json_t *reply = janus_create_message("success", 0, transaction_text);
+			json_object_set_new(reply, "refcounts", janus_refcount_sample_summary());
+			/* Send the success reply */
+			ret = janus_process_success(request, reply);
+			goto jsondone;
 		} else if(!strcasecmp(message_text, "set_log_timestamps")) {
 			/* Enable/disable the log timestamps */
 			JANUS_VALIDATE_JSON_OBJECT(root, timestamps_parameters,
@@ -2411,6 +2917,58 @@ int janus_process_incoming_admin_request(janus_request *request) {
 			/* Send the success reply */
 			ret = janus_process_success(request, reply);
 			goto jsondone;
+		} else if(!strcasecmp(message_text, "set_trace_sampling")) {
+			/* Change the sampling rate of the latency tracing (0 disables it) */
+			JANUS_VALIDATE_JSON_OBJECT(root, ts_parameters,
+				error_code, error_cause, FALSE,
+				JANUS_ERROR_MISSING_MANDATORY_ELEMENT, JANUS_ERROR_INVALID_ELEMENT_TYPE);
+			if(error_code != 0) {
+				ret = janus_process_error_string(request, session_id, transaction_text, error_code, error_cause);
+				goto jsondone;
+			}
+			json_t *ts = json_object_get(root, "trace_sampling");
+			int ts_num = json_integer_value(ts);
+			janus_ice_set_trace_sampling(ts_num);
+			/* Prepare JSON reply */
+			json_t *reply = json_object();
+			json_object_set_new(reply, "janus", json_string("success"));
+			json_object_set_new(reply, "transaction", json_string(transaction_text));
+			json_object_set_new(reply, "trace_sampling", json_integer(janus_ice_get_trace_sampling()));
+			/* Send the success reply */
+			ret = janus_process_success(request, reply);
+			goto jsondone;
+		} else if(!strcasecmp(message_text, "reload_config")) {
+			/* Re-parse the configuration file and apply the settings that are
+			 * safe to change at runtime, so that a live server can be tuned
+			 * without a restart: the "reloadable_settings" request returns
+			 * the registry of what this can actually apply */
+			json_t *applied = janus_admin_config_reload();
+			if(applied == NULL) {
+				ret = janus_process_error(request, session_id, transaction_text, JANUS_ERROR_UNKNOWN,
+					"Error re-parsing configuration file (%s)", config_file);
+				goto jsondone;
+			}
+			JANUS_LOG(LOG_INFO, "Reloaded configuration from %s (%zu settings changed)\n",
+				config_file, json_object_size(applied));
+			/* Prepare JSON reply */
+			json_t *reply = janus_create_message("success", 0, transaction_text);
+			json_object_set_new(reply, "config_file", json_string(config_file));
+			json_object_set_new(reply, "applied", applied);
+			/* Send the success reply */
+			ret = janus_process_success(request, reply);
+			goto jsondone;
+		} else if(!strcasecmp(message_text, "reloadable_settings")) {
+			/* Return the registry of settings that "reload_config" can apply live */
+			json_t *list = json_array();
+			int i = 0;
+			for(i = 0; janus_reloadable_settings[i] != NULL; i++)
+				json_array_append_new(list, json_string(janus_reloadable_settings[i]));
+			/* Prepare JSON reply */
+			json_t *reply = janus_create_message("success", 0, transaction_text);
+			json_object_set_new(reply, "settings", list);
+			/* Send the success reply */
+			ret = janus_process_success(request, reply);
+			goto jsondone;
 		} else if(!strcasecmp(message_text, "accept_new_sessions")) {
 			/* Configure whether we should accept new incoming sessions or not:
 			 * this can be particularly useful whenever, e.g., we want to stop
@@ -2618,26 +3176,56 @@ int janus_process_incoming_admin_request(janus_request *request) {
 			ret = janus_process_success(request, reply);
 			goto jsondone;
 		} else if(!strcasecmp(message_text, "list_sessions")) {
-			/* List sessions */
+			/* List sessions, optionally one page at a time: monitoring on a
+			 * busy instance should iterate with 'limit'/'cursor' rather than
+			 * pulling tens of thousands of IDs in a single huge response */
 			session_id = 0;
+			JANUS_VALIDATE_JSON_OBJECT(root, page_parameters,
+				error_code, error_cause, FALSE,
+				JANUS_ERROR_MISSING_MANDATORY_ELEMENT, JANUS_ERROR_INVALID_ELEMENT_TYPE);
+			if(error_code != 0) {
+				ret = janus_process_error_string(request, session_id, transaction_text, error_code, error_cause);
+				goto jsondone;
+			}
+			guint limit = json_integer_value(json_object_get(root, "limit"));
+			guint64 cursor = json_integer_value(json_object_get(root, "cursor"));
 			json_t *list = json_array();
-			if(sessions != NULL && g_hash_table_size(sessions) > 0) {
-				janus_mutex_lock(&sessions_mutex);
-				GHashTableIter iter;
-				gpointer value;
-				g_hash_table_iter_init(&iter, sessions);
-				while (g_hash_table_iter_next(&iter, NULL, &value)) {
-					janus_session *session = value;
-					if(session == NULL) {
-						continue;
+			guint64 next_cursor = 0;
+			if(sessions_inited && g_atomic_int_get(&sessions_num) > 0) {
+				GArray *ids = (limit > 0 ? g_array_new(FALSE, FALSE, sizeof(guint64)) : NULL);
+				int shard = 0;
+				for(shard = 0; shard < JANUS_SESSIONS_SHARDS; shard++) {
+					janus_sessions_shard *s = &sessions_shards[shard];
+					janus_mutex_lock(&s->mutex);
+					GHashTableIter iter;
+					gpointer value;
+					g_hash_table_iter_init(&iter, s->table);
+					while (g_hash_table_iter_next(&iter, NULL, &value)) {
+						janus_session *session = value;
+						if(session == NULL) {
+							continue;
+						}
+						if(limit > 0) {
+							/* Just collect the IDs beyond the cursor for now: we
+							 * only serialize a page, after releasing the lock */
+							if(session->session_id > cursor)
+								g_array_append_val(ids, session->session_id);
+						} else {
+							json_array_append_new(list, json_integer(session->session_id));
+						}
 					}
-					json_array_append_new(list, json_integer(session->session_id));
+					janus_mutex_unlock(&s->mutex);
+				}
+				if(limit > 0) {
+					next_cursor = janus_page_ids(ids, limit, list);
+					g_array_free(ids, TRUE);
 				}
-				janus_mutex_unlock(&sessions_mutex);
 			}
 			/* Prepare JSON reply */
 			json_t *reply = janus_create_message("success", 0, transaction_text);
 			json_object_set_new(reply, "sessions", list);
+			if(limit > 0)
+				json_object_set_new(reply, "next_cursor", json_integer(next_cursor));
 			/* Send the success reply */
 			ret = janus_process_success(request, reply);
 			goto jsondone;
@@ -2645,6 +3233,45 @@ int janus_process_incoming_admin_request(janus_request *request) {
 			/* Add a token valid for authentication */
 			ret = janus_request_allow_token(request, session_id, transaction_text, TRUE, TRUE);
 			goto jsondone;
+		} else if(!strcasecmp(message_text, "add_tokens") || !strcasecmp(message_text, "remove_tokens")) {
+			/* Add or invalidate a batch of tokens in a single operation:
+			 * much cheaper than one request per token when rotating many */
+			gboolean add = !strcasecmp(message_text, "add_tokens");
+			if(!janus_auth_is_stored_mode()) {
+				ret = janus_process_error(request, session_id, transaction_text, JANUS_ERROR_UNKNOWN, "Stored-Token based authentication disabled");
+				goto jsondone;
+			}
+			JANUS_VALIDATE_JSON_OBJECT(root, tokens_parameters,
+				error_code, error_cause, FALSE,
+				JANUS_ERROR_MISSING_MANDATORY_ELEMENT, JANUS_ERROR_INVALID_ELEMENT_TYPE);
+			if(error_code != 0) {
+				ret = janus_process_error_string(request, session_id, transaction_text, error_code, error_cause);
+				goto jsondone;
+			}
+			json_t *tokens_json = json_object_get(root, "tokens");
+			GList *tokens_list = NULL;
+			size_t i = 0;
+			for(i=0; i<json_array_size(tokens_json); i++) {
+				json_t *token = json_array_get(tokens_json, i);
+				if(!json_is_string(token)) {
+					g_list_free(tokens_list);
+					ret = janus_process_error(request, session_id, transaction_text, JANUS_ERROR_INVALID_ELEMENT_TYPE, "Invalid element type (tokens should be an array of strings)");
+					goto jsondone;
+				}
+				tokens_list = g_list_prepend(tokens_list, (char *)json_string_value(token));
+			}
+			gboolean ok = add ? janus_auth_add_tokens(tokens_list) : janus_auth_remove_tokens(tokens_list);
+			g_list_free(tokens_list);
+			if(!ok) {
+				ret = janus_process_error(request, session_id, transaction_text, JANUS_ERROR_UNKNOWN, "Error %s tokens", add ? "adding" : "removing");
+				goto jsondone;
+			}
+			/* Prepare JSON reply */
+			json_t *reply = janus_create_message("success", 0, transaction_text);
+			json_object_set_new(reply, "tokens", json_integer(json_array_size(tokens_json)));
+			/* Send the success reply */
+			ret = janus_process_success(request, reply);
+			goto jsondone;
 		} else if(!strcasecmp(message_text, "list_tokens")) {
 			/* List all the valid tokens */
 			if(!janus_auth_is_stored_mode()) {
@@ -2809,6 +3436,18 @@ int janus_process_incoming_admin_request(janus_request *request) {
 			/* Send the success reply */
 			ret = janus_process_success(request, reply);
 			goto jsondone;
+		} else if(!strcasecmp(message_text, "rebalance_loops")) {
+			/* Refresh the load estimates of the static event loops: handles
+			 * already attached to a loop can't be migrated (their libnice agent
+			 * is bound to the loop context), but new handles will be assigned
+			 * according to the refreshed per-loop throughput */
+			json_t *list = janus_ice_static_event_loops_rebalance();
+			/* Prepare JSON reply */
+			json_t *reply = janus_create_message("success", 0, transaction_text);
+			json_object_set_new(reply, "loops", list);
+			/* Send the success reply */
+			ret = janus_process_success(request, reply);
+			goto jsondone;
 		} else {
 			/* No message we know of */
 			ret = janus_process_error(request, session_id, transaction_text, JANUS_ERROR_INVALID_REQUEST_PATH, "Unhandled request '%s' at this path", message_text);
@@ -2857,10 +3496,11 @@ int janus_process_incoming_admin_request(janus_request *request) {
 	if(handle == NULL) {
 		/* Session-related */
 		if(!strcasecmp(message_text, "destroy_session")) {
-			janus_mutex_lock(&sessions_mutex);
-			if(g_hash_table_remove(sessions, &session->session_id))
+			janus_sessions_shard *shard = janus_session_shard(session->session_id);
+			janus_mutex_lock(&shard->mutex);
+			if(g_hash_table_remove(shard->table, &session->session_id))
 				g_atomic_int_dec_and_test(&sessions_num);
-			janus_mutex_unlock(&sessions_mutex);
+			janus_mutex_unlock(&shard->mutex);
 			/* Notify the source that the session has been destroyed */
 			janus_request *source = janus_session_get_request(session);
 			if(source && source->transport)
@@ -2900,6 +3540,9 @@ int janus_process_incoming_admin_request(janus_request *request) {
 			janus_mutex_lock(&session->mutex);
 			session->timeout = timeout_num;
 			janus_mutex_unlock(&session->mutex);
+			/* Re-bucket the session in the timer wheel, in case the new
+			 * timeout is closer than the check we had scheduled */
+			janus_sessions_wheel_schedule(session->session_id, janus_session_expiry(session));
 
 			/* Prepare JSON reply */
 			json_t *reply = json_object();
@@ -2908,6 +3551,74 @@ int janus_process_incoming_admin_request(janus_request *request) {
 			json_object_set_new(reply, "timeout", json_integer(timeout_num));
 			json_object_set_new(reply, "session_id", json_integer(session_id));
 
+			/* Send the success reply */
+			ret = janus_process_success(request, reply);
+			goto jsondone;
+		} else if(!strcasecmp(message_text, "import_handle")) {
+			/* Restore a handle that was exported on another instance via
+			 * export_handle: we create a new handle attached to the same
+			 * plugin and hand it the serialized state; it's then up to the
+			 * plugin to send the peer a new offer with an ICE restart, to
+			 * re-establish media towards this instance */
+			JANUS_VALIDATE_JSON_OBJECT(root, importhandle_parameters,
+				error_code, error_cause, FALSE,
+				JANUS_ERROR_MISSING_MANDATORY_ELEMENT, JANUS_ERROR_INVALID_ELEMENT_TYPE);
+			if(error_code != 0) {
+				ret = janus_process_error_string(request, session_id, transaction_text, error_code, error_cause);
+				goto jsondone;
+			}
+			json_t *exported = json_object_get(root, "exported");
+			const char *plugin_text = json_string_value(json_object_get(exported, "plugin"));
+			janus_plugin *plugin_t = plugin_text ? janus_plugin_find(plugin_text) : NULL;
+			if(plugin_t == NULL) {
+				ret = janus_process_error(request, session_id, transaction_text, JANUS_ERROR_PLUGIN_NOT_FOUND, "No such plugin '%s'", plugin_text);
+				goto jsondone;
+			}
+			if(plugin_t->import_session == NULL) {
+				/* FIXME This check will NOT work with legacy plugins that were compiled BEFORE the method was specified in plugin.h */
+				ret = janus_process_error(request, session_id, transaction_text, JANUS_ERROR_UNKNOWN,
+					"Plugin %s doesn't support session migration", plugin_t->get_package());
+				goto jsondone;
+			}
+			json_t *state = json_object_get(exported, "plugin_state");
+			if(!json_is_object(state)) {
+				ret = janus_process_error(request, session_id, transaction_text, JANUS_ERROR_INVALID_ELEMENT_TYPE,
+					"Invalid element type (plugin_state should be an object)");
+				goto jsondone;
+			}
+			const char *opaque_id = json_string_value(json_object_get(exported, "opaque_id"));
+			const char *token_value = json_string_value(json_object_get(exported, "token"));
+			/* Create handle */
+			handle = janus_ice_handle_create(session, opaque_id, token_value);
+			if(handle == NULL) {
+				ret = janus_process_error(request, session_id, transaction_text, JANUS_ERROR_UNKNOWN, "Memory error");
+				goto jsondone;
+			}
+			handle_id = handle->handle_id;
+			/* We increase the counter as this request is using the handle */
+			janus_refcount_increase(&handle->ref);
+			/* Attach to the plugin */
+			int error = 0;
+			if((error = janus_ice_handle_attach_plugin(session, handle, plugin_t, -1)) != 0) {
+				/* TODO Make error struct to pass verbose information */
+				janus_session_handles_remove(session, handle);
+				JANUS_LOG(LOG_ERR, "Couldn't attach to plugin '%s', error '%d'\n", plugin_text, error);
+				ret = janus_process_error(request, session_id, transaction_text, JANUS_ERROR_PLUGIN_ATTACH, "Couldn't attach to plugin: error '%d'", error);
+				goto jsondone;
+			}
+			/* Hand the serialized state to the plugin */
+			if(plugin_t->import_session(handle->app_handle, state) < 0) {
+				JANUS_LOG(LOG_ERR, "Plugin '%s' couldn't restore the session state\n", plugin_text);
+				janus_session_handles_remove(session, handle);
+				ret = janus_process_error(request, session_id, transaction_text, JANUS_ERROR_UNKNOWN,
+					"Plugin %s couldn't restore the session state", plugin_t->get_package());
+				goto jsondone;
+			}
+			/* Prepare JSON reply */
+			json_t *reply = janus_create_message("success", session_id, transaction_text);
+			json_t *data = json_object();
+			json_object_set_new(data, "id", json_integer(handle_id));
+			json_object_set_new(reply, "data", data);
 			/* Send the success reply */
 			ret = janus_process_success(request, reply);
 			goto jsondone;
@@ -2917,11 +3628,29 @@ int janus_process_incoming_admin_request(janus_request *request) {
 			goto jsondone;
 		}
 
-		/* List handles */
-		json_t *list = janus_session_handles_list_json(session);
+		/* List handles, optionally one page at a time (in which case we walk
+		 * the immutable handles snapshot, without the session mutex at all) */
+		JANUS_VALIDATE_JSON_OBJECT(root, page_parameters,
+			error_code, error_cause, FALSE,
+			JANUS_ERROR_MISSING_MANDATORY_ELEMENT, JANUS_ERROR_INVALID_ELEMENT_TYPE);
+		if(error_code != 0) {
+			ret = janus_process_error_string(request, session_id, transaction_text, error_code, error_cause);
+			goto jsondone;
+		}
+		guint limit = json_integer_value(json_object_get(root, "limit"));
+		guint64 cursor = json_integer_value(json_object_get(root, "cursor"));
+		json_t *list = NULL;
+		guint64 next_cursor = 0;
+		if(limit > 0)
+			list = janus_session_handles_page_json(session, limit, cursor, &next_cursor);
+		else
+			list = janus_session_handles_list_json(session);
 		/* Prepare JSON reply */
 		json_t *reply = janus_create_message("success", session_id, transaction_text);
 		json_object_set_new(reply, "handles", list);
+		if(limit > 0)
+			json_object_set_new(reply, "next_cursor", json_integer(next_cursor));
+		json_object_set_new(reply, "handles_memory", json_integer(janus_session_handles_memory(session)));
 		/* Send the success reply */
 		ret = janus_process_success(request, reply);
 		goto jsondone;
@@ -2955,6 +3684,51 @@ int janus_process_incoming_admin_request(janus_request *request) {
 			/* Send the success reply */
 			ret = janus_process_success(request, reply);
 			goto jsondone;
+		} else if(!strcasecmp(message_text, "export_handle")) {
+			/* Serialize the state of this handle, so that the session can be
+			 * migrated to another instance (e.g., when draining this one) */
+			if(handle->app == NULL || handle->app_handle == NULL) {
+				ret = janus_process_error(request, session_id, transaction_text, JANUS_ERROR_PLUGIN_DETACH, "No plugin attached");
+				goto jsondone;
+			}
+			janus_plugin *plugin_t = (janus_plugin *)handle->app;
+			if(plugin_t->export_session == NULL) {
+				/* FIXME This check will NOT work with legacy plugins that were compiled BEFORE the method was specified in plugin.h */
+				ret = janus_process_error(request, session_id, transaction_text, JANUS_ERROR_UNKNOWN,
+					"Plugin %s doesn't support session migration", plugin_t->get_package());
+				goto jsondone;
+			}
+			json_t *state = plugin_t->export_session(handle->app_handle);
+			if(state == NULL || !json_is_object(state)) {
+				if(state != NULL)
+					json_decref(state);
+				ret = janus_process_error(request, session_id, transaction_text, JANUS_ERROR_UNKNOWN,
+					"Plugin %s marked this session as not migratable", plugin_t->get_package());
+				goto jsondone;
+			}
+			json_t *exported = json_object();
+			json_object_set_new(exported, "plugin", json_string(plugin_t->get_package()));
+			janus_mutex_lock(&handle->mutex);
+			if(handle->opaque_id)
+				json_object_set_new(exported, "opaque_id", json_string(handle->opaque_id));
+			if(handle->token)
+				json_object_set_new(exported, "token", json_string(handle->token));
+			/* The SDPs carry everything the new instance may want to know about
+			 * the PeerConnection (ICE credentials and candidates, DTLS fingerprint,
+			 * codecs, extensions): media itself will be re-established by the
+			 * importing instance with an ICE restart towards the peer anyway */
+			if(handle->local_sdp)
+				json_object_set_new(exported, "local_sdp", json_string(handle->local_sdp));
+			if(handle->remote_sdp)
+				json_object_set_new(exported, "remote_sdp", json_string(handle->remote_sdp));
+			janus_mutex_unlock(&handle->mutex);
+			json_object_set_new(exported, "plugin_state", state);
+			/* Prepare JSON reply */
+			json_t *reply = janus_create_message("success", session_id, transaction_text);
+			json_object_set_new(reply, "exported", exported);
+			/* Send the success reply */
+			ret = janus_process_success(request, reply);
+			goto jsondone;
 		} else if(!strcasecmp(message_text, "start_pcap") || !strcasecmp(message_text, "start_text2pcap")) {
 			/* Start dumping RTP and RTCP packets to a pcap or text2pcap file */
 			JANUS_VALIDATE_JSON_OBJECT(root, text2pcap_parameters,
@@ -3025,10 +3799,10 @@ int janus_process_incoming_admin_request(janus_request *request) {
 		json_object_set_new(info, "session_id", json_integer(session_id));
 		json_object_set_new(info, "session_last_activity", json_integer(session->last_activity));
 		json_object_set_new(info, "session_timeout", json_integer(session->timeout == -1 ? global_session_timeout : (guint)session->timeout));
-		janus_mutex_lock(&session->mutex);
+		janus_mutex_lock(&session->source_mutex);
 		if(session->source && session->source->transport)
 			json_object_set_new(info, "session_transport", json_string(session->source->transport->get_package()));
-		janus_mutex_unlock(&session->mutex);
+		janus_mutex_unlock(&session->source_mutex);
 		janus_mutex_lock(&handle->mutex);
 		json_object_set_new(info, "handle_id", json_integer(handle_id));
 		if(handle->opaque_id)
@@ -3039,6 +3813,14 @@ int janus_process_incoming_admin_request(janus_request *request) {
 			g_main_loop_is_running(handle->mainloop)) ? json_true() : json_false());
 		json_object_set_new(info, "created", json_integer(handle->created));
 		json_object_set_new(info, "current_time", json_integer(janus_get_monotonic_time()));
+		if(handle->arena != NULL) {
+			/* Memory accounting: how much RAM the fixed state of this handle costs */
+			json_t *memory = json_object();
+			json_object_set_new(memory, "arena_size", json_integer(handle->arena->size));
+			json_object_set_new(memory, "arena_used", json_integer(handle->arena->offset));
+			json_object_set_new(memory, "heap_overflow", json_integer(handle->arena->overflow_bytes));
+			json_object_set_new(info, "memory", memory);
+		}
 		if(handle->app && janus_plugin_session_is_alive(handle->app_handle)) {
 			janus_plugin *plugin = (janus_plugin *)handle->app;
 			json_object_set_new(info, "plugin", json_string(plugin->get_package()));
@@ -3098,8 +3880,26 @@ int janus_process_incoming_admin_request(janus_request *request) {
 		json_object_set_new(info, "sdps", sdps);
 		if(handle->pending_trickles)
 			json_object_set_new(info, "pending-trickles", json_integer(g_list_length(handle->pending_trickles)));
-		if(handle->queued_packets)
-			json_object_set_new(info, "queued-packets", json_integer(g_async_queue_length(handle->queued_packets)));
+		if(handle->queued_packets) {
+			json_object_set_new(info, "queued-packets", json_integer(janus_lfq_length(handle->queued_packets)));
+			json_object_set_new(info, "queued-packets-high", json_integer(g_atomic_int_get(&handle->queued_packets_high)));
+			json_object_set_new(info, "queued-packets-dropped", json_integer(g_atomic_int_get(&handle->queued_packets_dropped)));
+		}
+		if(janus_ice_get_trace_sampling() > 0) {
+			/* Sampled latency tracing is on, add the per-stage histograms:
+			 * buckets are <100us, <250us, <500us, <1ms, <2ms, <5ms, <10ms, <20ms, <40ms, more */
+			static const char *stages[JANUS_ICE_TRACE_STAGES] = { "ingest", "plugin", "queue" };
+			json_t *trace = json_object();
+			json_object_set_new(trace, "sampling", json_integer(janus_ice_get_trace_sampling()));
+			int s = 0, b = 0;
+			for(s=0; s<JANUS_ICE_TRACE_STAGES; s++) {
+				json_t *buckets = json_array();
+				for(b=0; b<JANUS_ICE_TRACE_BUCKETS; b++)
+					json_array_append_new(buckets, json_integer(handle->trace_latency[s][b]));
+				json_object_set_new(trace, stages[s], buckets);
+			}
+			json_object_set_new(info, "latency-trace", trace);
+		}
 		if(g_atomic_int_get(&handle->dump_packets) && handle->text2pcap) {
 			if(handle->text2pcap->text) {
 				json_object_set_new(info, "dump-to-text2pcap", json_true());
@@ -3110,7 +3910,26 @@ int janus_process_incoming_admin_request(janus_request *request) {
 			}
 		}
 		if(handle->pc) {
-			json_t *p = janus_admin_peerconnection_summary(handle->pc);
+			/* The PeerConnection summary is by far the most expensive part of
+			 * this report, so we serve a cached version as long as the WebRTC
+			 * state hasn't changed and the cache is recent enough: the TTL
+			 * only bounds how stale the media stats in there can get */
+			json_t *p = NULL;
+			gint info_version = g_atomic_int_get(&handle->info_version);
+			gint64 now = janus_get_monotonic_time();
+			if(handle->info_cache != NULL && handle->info_cache_version == info_version &&
+					(now - handle->info_cache_time) < G_USEC_PER_SEC) {
+				p = json_incref(handle->info_cache);
+			} else {
+				p = janus_admin_peerconnection_summary(handle->pc);
+				if(p != NULL) {
+					if(handle->info_cache != NULL)
+						json_decref(handle->info_cache);
+					handle->info_cache = json_incref(p);
+					handle->info_cache_version = info_version;
+					handle->info_cache_time = now;
+				}
+			}
 			if(p)
 				json_object_set_new(info, "webrtc", p);
 		}
@@ -3190,7 +4009,7 @@ json_t *janus_admin_peerconnection_summary(janus_ice_peerconnection *pc) {
 	json_object_set_new(i, "state", json_string(janus_get_ice_state_name(pc->state)));
 	if(pc->icefailed_detected) {
 		json_object_set_new(i, "failed-detected", json_integer(pc->icefailed_detected));
-		json_object_set_new(i, "icetimer-started", pc->icestate_source ? json_true() : json_false());
+		json_object_set_new(i, "icetimer-started", pc->icestate_job ? json_true() : json_false());
 	}
 	if(pc->gathered > 0)
 		json_object_set_new(i, "gathered", json_integer(pc->gathered));
@@ -3482,16 +4301,21 @@ void janus_transport_incoming_request(janus_transport *plugin, janus_transport_s
 void janus_transport_gone(janus_transport *plugin, janus_transport_session *transport) {
 	/* Get rid of sessions this transport was handling */
 	JANUS_LOG(LOG_VERB, "A %s transport instance has gone away (%p)\n", plugin->get_package(), transport);
-	janus_mutex_lock(&sessions_mutex);
-	if(sessions && g_hash_table_size(sessions) > 0) {
+	int shard = 0;
+	for(shard = 0; sessions_inited && shard < JANUS_SESSIONS_SHARDS; shard++) {
+		janus_sessions_shard *s = &sessions_shards[shard];
+		janus_mutex_lock(&s->mutex);
 		GHashTableIter iter;
 		gpointer value;
-		g_hash_table_iter_init(&iter, sessions);
+		g_hash_table_iter_init(&iter, s->table);
 		while(g_hash_table_iter_next(&iter, NULL, &value)) {
 			janus_session *session = (janus_session *) value;
 			if(!session || g_atomic_int_get(&session->destroyed) || g_atomic_int_get(&session->timedout) || session->last_activity == 0)
 				continue;
-			if(session->source && session->source->instance == transport) {
+			janus_mutex_lock(&session->source_mutex);
+			gboolean gone = (session->source && session->source->instance == transport);
+			janus_mutex_unlock(&session->source_mutex);
+			if(gone) {
 				JANUS_LOG(LOG_VERB, "  -- Session %"SCNu64" will be over if not reclaimed\n", session->session_id);
 				JANUS_LOG(LOG_VERB, "  -- Marking Session %"SCNu64" as over\n", session->session_id);
 				if(reclaim_session_timeout < 1) { /* Reclaim session timeouts are disabled */
@@ -3506,11 +4330,15 @@ void janus_transport_gone(janus_transport *plugin, janus_transport_session *tran
 				} else {
 					/* Set flag for transport_gone. The Janus sessions watchdog will clean this up if not reclaimed */
 					g_atomic_int_set(&session->transport_gone, 1);
+					/* Re-bucket the session, as the reclaim timeout may be
+					 * closer than the check we had scheduled (a duplicate
+					 * wheel entry is harmless, stale ones are just dropped) */
+					janus_sessions_wheel_schedule(session->session_id, janus_session_expiry(session));
 				}
 			}
 		}
+		janus_mutex_unlock(&s->mutex);
 	}
-	janus_mutex_unlock(&sessions_mutex);
 }
 
 gboolean janus_transport_is_api_secret_needed(janus_transport *plugin) {
@@ -3546,6 +4374,35 @@ void janus_transport_notify_event(janus_transport *plugin, void *transport, json
 	}
 }
 
+/* Helper to track the queueing delay of a request lane, feeding the
+ * related histogram and growing or shrinking the pool accordingly */
+static void janus_request_lane_update(janus_request_lane *lane, gint64 wait) {
+	if(wait < 0)
+		wait = 0;
+	janus_metrics_observe(lane->histogram, (guint64)wait);
+	if(lane->cap <= 0)
+		return;	/* This lane is not resized (e.g., an unlimited pool) */
+	gint64 now = janus_get_monotonic_time();
+	janus_mutex_lock(&lane->mutex);
+	if(wait > JANUS_LANE_GROW_WAIT) {
+		lane->last_busy = now;
+		if(lane->size < lane->cap) {
+			lane->size++;
+			JANUS_LOG(LOG_INFO, "Requests are queueing up in the %s lane (waited %"SCNi64"us), growing the pool to %d threads\n",
+				lane->name, wait, lane->size);
+			g_thread_pool_set_max_threads(lane->pool, lane->size, NULL);
+		}
+	} else if(lane->size > lane->base && (now - lane->last_busy) > JANUS_LANE_SHRINK_AFTER) {
+		/* The lane has been quiet for a while, shrink one step at a time */
+		lane->last_busy = now;
+		lane->size--;
+		JANUS_LOG(LOG_VERB, "The %s lane has been quiet for a while, shrinking the pool to %d threads\n",
+			lane->name, lane->size);
+		g_thread_pool_set_max_threads(lane->pool, lane->size, NULL);
+	}
+	janus_mutex_unlock(&lane->mutex);
+}
+
 void janus_transport_task(gpointer data, gpointer user_data) {
 	JANUS_LOG(LOG_VERB, "Transport task pool, serving request\n");
 	janus_request *request = (janus_request *)data;
@@ -3553,6 +4410,10 @@ void janus_transport_task(gpointer data, gpointer user_data) {
 		JANUS_LOG(LOG_ERR, "Missing request\n");
 		return;
 	}
+	/* Track how long this request spent waiting in the queue */
+	janus_request_lane *lane = (janus_request_lane *)user_data;
+	if(lane != NULL)
+		janus_request_lane_update(lane, janus_get_monotonic_time() - request->queued);
 	if(!request->admin)
 		janus_process_incoming_request(request);
 	else
@@ -3576,10 +4437,15 @@ static void *janus_transport_requests(void *data) {
 		/* Process the request synchronously only it's not a message for a plugin */
 		json_t *message = json_object_get(request->message, "janus");
 		const gchar *message_text = json_string_value(message);
-		if(message_text && !strcasecmp(message_text, request->admin ? "message_plugin" : "message")) {
-			/* Spawn a task thread */
+		if(message_text && (!strcasecmp(message_text, request->admin ? "message_plugin" : "message") ||
+				(!request->admin && (!strcasecmp(message_text, "keepalive") || !strcasecmp(message_text, "trickle"))))) {
+			/* Spawn a task thread: plugin messages go to the slow lane,
+			 * keepalives and trickles to the fast lane, so that they can't
+			 * get stuck behind heavyweight requests during a storm (or
+			 * stall this dispatching thread on a contended handle) */
+			gboolean fast = strcasecmp(message_text, request->admin ? "message_plugin" : "message");
 			GError *tperror = NULL;
-			g_thread_pool_push(tasks, request, &tperror);
+			g_thread_pool_push(fast ? fast_tasks : tasks, request, &tperror);
 			if(tperror != NULL) {
 				/* Something went wrong... */
 				JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to push task in thread pool...\n",
@@ -4293,6 +5159,45 @@ void janus_plugin_send_remb(janus_plugin_session *plugin_session, uint32_t bitra
 	janus_ice_send_remb(handle, bitrate);
 }
 
+uint32_t janus_plugin_get_bandwidth_estimate(janus_plugin_session *plugin_session) {
+	if((plugin_session < (janus_plugin_session *)0x1000) || g_atomic_int_get(&plugin_session->stopped))
+		return 0;
+	janus_ice_handle *handle = (janus_ice_handle *)plugin_session->gateway_handle;
+	if(!handle || handle->pc == NULL)
+		return 0;
+	return janus_bwe_get_estimate(handle->pc->bwe);
+}
+
+void *janus_plugin_get_relay_target(janus_plugin_session *plugin_session) {
+	if((plugin_session < (janus_plugin_session *)0x1000) || g_atomic_int_get(&plugin_session->stopped))
+		return NULL;
+	janus_ice_handle *handle = (janus_ice_handle *)plugin_session->gateway_handle;
+	if(!handle)
+		return NULL;
+	/* The target is just the ICE handle itself: we take a reference so
+	 * that it stays valid even across a PeerConnection teardown, until
+	 * the plugin releases it via drop_relay_target */
+	janus_refcount_increase(&handle->ref);
+	return handle;
+}
+
+void janus_plugin_relay_rtp_target(void *target, janus_plugin_rtp *packet) {
+	janus_ice_handle *handle = (janus_ice_handle *)target;
+	if(handle == NULL || packet == NULL || packet->buffer == NULL || packet->length < 1)
+		return;
+	if(janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_STOP)
+			|| janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_ALERT))
+		return;
+	janus_ice_relay_rtp(handle, packet);
+}
+
+void janus_plugin_drop_relay_target(void *target) {
+	janus_ice_handle *handle = (janus_ice_handle *)target;
+	if(handle == NULL)
+		return;
+	janus_refcount_decrease(&handle->ref);
+}
+
 static gboolean janus_plugin_close_pc_internal(gpointer user_data) {
 	/* We actually enforce the close_pc here */
 	janus_plugin_session *plugin_session = (janus_plugin_session *) user_data;
@@ -4417,6 +5322,56 @@ gboolean janus_plugin_auth_signature_contains(janus_plugin *plugin, const char *
 }
 
 
+/* Helpers we use at startup to initialize event handlers, plugins and
+ * transports concurrently: their init methods don't share any state, and
+ * some of them can take several seconds (e.g., SIP stacks, scripting
+ * engines, or the creation of many streaming mountpoints), so there's no
+ * point in waiting for each of them serially before accepting traffic */
+typedef struct janus_startup_init_task {
+	janus_eventhandler *eventhandler;	/* Event handler to initialize, if any */
+	janus_plugin *plugin;				/* Plugin to initialize, if any */
+	janus_transport *transport;			/* Transport to initialize, if any */
+	void *so;							/* Shared object, in case init fails and we need to unload it */
+	int res;							/* What the init method returned */
+	gint64 elapsed;						/* How long the init method took, in microseconds */
+} janus_startup_init_task;
+static void janus_startup_init_process(gpointer data, gpointer user_data) {
+	janus_startup_init_task *task = (janus_startup_init_task *)data;
+	const char *name = NULL;
+	gint64 started = janus_get_monotonic_time();
+	if(task->eventhandler != NULL) {
+		name = task->eventhandler->get_package();
+		task->res = task->eventhandler->init(configs_folder);
+	} else if(task->plugin != NULL) {
+		name = task->plugin->get_package();
+		task->res = task->plugin->init(&janus_handler_plugin, configs_folder);
+	} else if(task->transport != NULL) {
+		name = task->transport->get_package();
+		task->res = task->transport->init(&janus_handler_transport, configs_folder);
+	}
+	task->elapsed = janus_get_monotonic_time() - started;
+	JANUS_LOG(LOG_INFO, "Initialized '%s' in %"SCNi64"ms\n", name, task->elapsed/1000);
+}
+static GThreadPool *janus_startup_pool_create(void) {
+	GError *error = NULL;
+	GThreadPool *pool = g_thread_pool_new(janus_startup_init_process, NULL, -1, FALSE, &error);
+	if(error != NULL) {
+		/* Not fatal: we'll just initialize everything serially, as before */
+		JANUS_LOG(LOG_WARN, "Got error %d (%s) trying to launch the startup pool, initializing serially...\n",
+			error->code, error->message ? error->message : "??");
+		g_error_free(error);
+		pool = NULL;
+	}
+	return pool;
+}
+static void janus_startup_init_enqueue(GThreadPool *pool, janus_startup_init_task *task) {
+	if(pool != NULL)
+		g_thread_pool_push(pool, task, NULL);
+	else
+		janus_startup_init_process(task, NULL);
+}
+
+
 /* Main */
 gint main(int argc, char *argv[]) {
 	/* Core dumps may be disallowed by parent of this process; change that */
@@ -4538,6 +5493,10 @@ gint main(int argc, char *argv[]) {
 		if(item && item->value)
 			logfile = item->value;
 	}
+	/* Check if we need to log binary records too (rendered offline via janus-logcat) */
+	janus_config_item *binlog = janus_config_get(config, config_general, janus_config_type_item, "log_to_binary");
+	if(binlog && binlog->value)
+		janus_log_set_binary_file(binlog->value);
 
 	/* Set an optional signal handler for log rotation */
 	const char *log_rotate_sig = NULL;
@@ -5086,6 +6045,18 @@ gint main(int argc, char *argv[]) {
 	} else {
 		janus_recorder_init(FALSE, NULL);
 	}
+	/* Check if recording files should be preallocated in large extents */
+	item = janus_config_get(config, config_general, janus_config_type_item, "recordings_prealloc_size");
+	if(item && item->value)
+		janus_recorder_set_prealloc_size(g_ascii_strtoull(item->value, NULL, 10));
+	/* Check if recordings should be segmented in multiple files */
+	item = janus_config_get(config, config_general, janus_config_type_item, "recordings_segment_time");
+	janus_config_item *item2 = janus_config_get(config, config_general, janus_config_type_item, "recordings_segment_size");
+	if((item && item->value) || (item2 && item2->value)) {
+		janus_recorder_set_segmentation(
+			(item && item->value) ? (guint)atoi(item->value) : 0,
+			(item2 && item2->value) ? g_ascii_strtoull(item2->value, NULL, 10) : 0);
+	}
 
 	/* Check if we should hide dependencies in "info" requests */
 	item = janus_config_get(config, config_general, janus_config_type_item, "hide_dependencies");
@@ -5237,6 +6208,18 @@ gint main(int argc, char *argv[]) {
 	item = janus_config_get(config, config_general, janus_config_type_item, "event_loops");
 	if(item && item->value) {
 		int loops = atoi(item->value);
+		/* Check if the loop threads should be pinned to a specific set of CPU cores */
+		item = janus_config_get(config, config_general, janus_config_type_item, "event_loops_affinity");
+		if(item && item->value)
+			janus_ice_set_static_event_loops_affinity(item->value);
+		/* Check if the loop threads should busy-spin on their context (trades CPU for latency) */
+		item = janus_config_get(config, config_general, janus_config_type_item, "event_loops_spin");
+		if(item && item->value)
+			janus_ice_set_static_event_loops_spin(janus_is_true(item->value));
+		/* Check if the loops should keep a pool of prewarmed ICE agents around */
+		item = janus_config_get(config, config_general, janus_config_type_item, "agent_pool_size");
+		if(item && item->value)
+			janus_ice_set_agent_pool_size(atoi(item->value));
 		/* Check if we should allow API calls to specify which loops to use for new handles */
 		gboolean loops_api = FALSE;
 		item = janus_config_get(config, config_general, janus_config_type_item, "allow_loop_indication");
@@ -5394,6 +6377,16 @@ gint main(int argc, char *argv[]) {
 			janus_set_slowlink_threshold(st);
 		}
 	}
+	/* Queued-packets limit (backpressure on handle queues) */
+	item = janus_config_get(config, config_media, janus_config_type_item, "queued_packets_limit");
+	if(item && item->value) {
+		int qpl = atoi(item->value);
+		if(qpl < 0) {
+			JANUS_LOG(LOG_WARN, "Ignoring queued_packets_limit value as it's not a positive integer\n");
+		} else {
+			janus_set_queued_packets_limit(qpl);
+		}
+	}
 	/* TWCC period */
 	item = janus_config_get(config, config_media, janus_config_type_item, "twcc_period");
 	if(item && item->value) {
@@ -5405,6 +6398,28 @@ gint main(int argc, char *argv[]) {
 		}
 	}
 
+	/* Egress batching */
+	item = janus_config_get(config, config_media, janus_config_type_item, "egress_batch");
+	if(item && item->value) {
+		int eb = atoi(item->value);
+		if(eb < 0) {
+			JANUS_LOG(LOG_WARN, "Ignoring egress_batch value as it's not a positive integer\n");
+		} else {
+			gboolean eba = FALSE;
+			item = janus_config_get(config, config_media, janus_config_type_item, "egress_batch_audio");
+			if(item && item->value)
+				eba = janus_is_true(item->value);
+			janus_set_egress_batching(eb, eba);
+		}
+	}
+
+	/* SRTP crypto engine: we only select it after the DTLS stack (and so
+	 * libsrtp) has been initialized, since selection benchmarks all engines */
+	const char *srtp_engine_name = NULL;
+	item = janus_config_get(config, config_media, janus_config_type_item, "srtp_engine");
+	if(item && item->value)
+		srtp_engine_name = item->value;
+
 	/* Setup OpenSSL stuff */
 	const char *server_pem;
 	item = janus_config_get(config, config_certs, janus_config_type_item, "cert_pem");
@@ -5427,6 +6442,13 @@ gint main(int argc, char *argv[]) {
 	} else {
 		password = item->value;
 	}
+	const char *cert_folder;
+	item = janus_config_get(config, config_certs, janus_config_type_item, "cert_folder");
+	if(!item || !item->value) {
+		cert_folder = NULL;
+	} else {
+		cert_folder = item->value;
+	}
 	JANUS_LOG(LOG_VERB, "Using certificates:\n\t%s\n\t%s\n", server_pem, server_key);
 
 	SSL_library_init();
@@ -5443,6 +6465,15 @@ gint main(int argc, char *argv[]) {
 	item = janus_config_get(config, config_certs, janus_config_type_item, "dtls_ciphers");
 	if(item && item->value)
 		dtls_ciphers = item->value;
+	item = janus_config_get(config, config_media, janus_config_type_item, "dtls_handshake_pool");
+	if(item && item->value) {
+		int pool_size = atoi(item->value);
+		if(pool_size < 0) {
+			JANUS_LOG(LOG_WARN, "Invalid DTLS handshake pool size: %s (disabling)\n", item->value);
+		} else {
+			janus_dtls_srtp_set_handshake_pool_size(pool_size);
+		}
+	}
 	guint16 dtls_timeout = 1000;
 	item = janus_config_get(config, config_media, janus_config_type_item, "dtls_timeout");
 	if(item && item->value && janus_string_to_uint16(item->value, &dtls_timeout) < 0) {
@@ -5457,17 +6488,46 @@ gint main(int argc, char *argv[]) {
 	item = janus_config_get(config, config_certs, janus_config_type_item, "dtls_accept_selfsigned");
 	if(item && item->value)
 		dtls_accept_selfsigned = janus_is_true(item->value);
-	if(janus_dtls_srtp_init(server_pem, server_key, password, dtls_ciphers, dtls_timeout, rsa_private_key, dtls_accept_selfsigned) < 0) {
+	if(janus_dtls_srtp_init(server_pem, server_key, password, cert_folder, dtls_ciphers, dtls_timeout, rsa_private_key, dtls_accept_selfsigned) < 0) {
 		janus_options_destroy();
 		exit(1);
 	}
+	janus_srtp_engine_select(srtp_engine_name);
 	/* Check if there's any custom value for the starting MTU to use in the BIO filter */
 	item = janus_config_get(config, config_media, janus_config_type_item, "dtls_mtu");
 	if(item && item->value)
 		janus_dtls_bio_agent_set_mtu(atoi(item->value));
+	/* Check if media sockets should busy-poll (trades CPU for lower wakeup latency) */
+	item = janus_config_get(config, config_media, janus_config_type_item, "busy_poll");
+	if(item && item->value)
+		janus_ice_set_busy_poll(atoi(item->value));
 
 #ifdef HAVE_SCTP
 	/* Initialize SCTP for DataChannels */
+	item = janus_config_get(config, config_media, janus_config_type_item, "data_coalescing");
+	if(item && item->value)
+		janus_sctp_set_data_coalescing(janus_is_true(item->value));
+	/* Check if the SCTP stack should be tuned for throughput */
+	int sctp_sndbuf = 0, sctp_rcvbuf = 0;
+	const char *sctp_scheduler = NULL;
+	gboolean sctp_interleaving = FALSE, sctp_nr_sack = FALSE;
+	item = janus_config_get(config, config_media, janus_config_type_item, "sctp_send_buffer");
+	if(item && item->value)
+		sctp_sndbuf = atoi(item->value);
+	item = janus_config_get(config, config_media, janus_config_type_item, "sctp_receive_buffer");
+	if(item && item->value)
+		sctp_rcvbuf = atoi(item->value);
+	item = janus_config_get(config, config_media, janus_config_type_item, "sctp_scheduler");
+	if(item && item->value)
+		sctp_scheduler = item->value;
+	item = janus_config_get(config, config_media, janus_config_type_item, "sctp_interleaving");
+	if(item && item->value)
+		sctp_interleaving = janus_is_true(item->value);
+	item = janus_config_get(config, config_media, janus_config_type_item, "sctp_nr_sack");
+	if(item && item->value)
+		sctp_nr_sack = janus_is_true(item->value);
+	if(sctp_sndbuf > 0 || sctp_rcvbuf > 0 || sctp_scheduler != NULL || sctp_interleaving || sctp_nr_sack)
+		janus_sctp_set_tuning(sctp_sndbuf, sctp_rcvbuf, sctp_scheduler, sctp_interleaving, sctp_nr_sack);
 	if(janus_sctp_init() < 0) {
 		janus_options_destroy();
 		exit(1);
@@ -5483,7 +6543,18 @@ gint main(int argc, char *argv[]) {
 	}
 
 	/* Sessions */
-	sessions = g_hash_table_new_full(g_int64_hash, g_int64_equal, (GDestroyNotify)g_free, NULL);
+	int shard = 0;
+	char shard_name[64];
+	for(shard = 0; shard < JANUS_SESSIONS_SHARDS; shard++) {
+		janus_mutex_init(&sessions_shards[shard].mutex);
+		sessions_shards[shard].table = g_hash_table_new_full(g_int64_hash, g_int64_equal, (GDestroyNotify)g_free, NULL);
+		/* Name the shard locks in the contention profiler table */
+		g_snprintf(shard_name, sizeof(shard_name), "sessions/%d", shard);
+		janus_mutex_profile_register(&sessions_shards[shard].mutex, shard_name);
+	}
+	/* Start sweeping the timeouts wheel from the current slot */
+	sessions_wheel_cursor = (janus_get_monotonic_time() / G_USEC_PER_SEC) / JANUS_SESSIONS_WHEEL_SPAN;
+	sessions_inited = TRUE;
 	/* Start the sessions timeout watchdog */
 	sessions_watchdog_context = g_main_context_new();
 	GMainLoop *watchdog_loop = g_main_loop_new(sessions_watchdog_context, FALSE);
@@ -5508,7 +6579,7 @@ gint main(int argc, char *argv[]) {
 	}
 	/* Create a thread pool to handle asynchronous requests, no matter what the transport */
 	error = NULL;
-	tasks = g_thread_pool_new(janus_transport_task, NULL, task_pool_size, FALSE, &error);
+	tasks = g_thread_pool_new(janus_transport_task, &slow_lane, task_pool_size, FALSE, &error);
 	if(error != NULL) {
 		/* Something went wrong... */
 		JANUS_LOG(LOG_FATAL, "Got error %d (%s) trying to launch the request pool task thread...\n",
@@ -5517,9 +6588,37 @@ gint main(int argc, char *argv[]) {
 		janus_options_destroy();
 		exit(1);
 	}
+	slow_lane.pool = tasks;
+	slow_lane.base = task_pool_size;
+	slow_lane.size = task_pool_size;
+	/* If the pool is unlimited there's nothing to resize, otherwise we
+	 * allow the queueing delay to temporarily grow it up to four times */
+	slow_lane.cap = task_pool_size > 0 ? task_pool_size*4 : 0;
+	janus_mutex_init(&slow_lane.mutex);
+	/* A second, smaller, pool acts as a fast lane for keepalives and trickles */
+	error = NULL;
+	fast_tasks = g_thread_pool_new(janus_transport_task, &fast_lane, 2, FALSE, &error);
+	if(error != NULL) {
+		/* Something went wrong... */
+		JANUS_LOG(LOG_FATAL, "Got error %d (%s) trying to launch the fast lane pool task thread...\n",
+			error->code, error->message ? error->message : "??");
+		g_error_free(error);
+		janus_options_destroy();
+		exit(1);
+	}
+	fast_lane.pool = fast_tasks;
+	fast_lane.base = 2;
+	fast_lane.size = 2;
+	fast_lane.cap = 16;
+	janus_mutex_init(&fast_lane.mutex);
 	/* Wait 120 seconds before stopping idle threads to avoid the creation of too many threads for AddressSanitizer. */
 	g_thread_pool_set_max_idle_time(120 * 1000);
 
+	/* Create a temporary thread pool we'll use to initialize event handlers,
+	 * plugins and transports concurrently, to speed up the startup phase */
+	GThreadPool *startup_pool = janus_startup_pool_create();
+	GList *startup_tasks = NULL;
+
 	/* Load event handlers */
 	path = NULL;
 	dir = NULL;
@@ -5642,7 +6741,13 @@ gint main(int argc, char *argv[]) {
 							janus_eventhandler->get_package(), janus_eventhandler->get_api_compatibility(), JANUS_EVENTHANDLER_API_VERSION);
 						continue;
 					}
-					janus_eventhandler->init(configs_folder);
+					/* Defer the initialization to the startup pool: we'll wait
+					 * for all event handlers before starting the broadcaster */
+					janus_startup_init_task *init_task = g_malloc0(sizeof(janus_startup_init_task));
+					init_task->eventhandler = janus_eventhandler;
+					init_task->so = event;
+					startup_tasks = g_list_prepend(startup_tasks, init_task);
+					janus_startup_init_enqueue(startup_pool, init_task);
 					JANUS_LOG(LOG_VERB, "\tVersion: %d (%s)\n", janus_eventhandler->get_version(), janus_eventhandler->get_version_string());
 					JANUS_LOG(LOG_VERB, "\t   [%s] %s\n", janus_eventhandler->get_package(), janus_eventhandler->get_name());
 					JANUS_LOG(LOG_VERB, "\t   %s\n", janus_eventhandler->get_description());
@@ -5680,6 +6785,14 @@ gint main(int argc, char *argv[]) {
 		if(disabled_eventhandlers != NULL)
 			g_strfreev(disabled_eventhandlers);
 		disabled_eventhandlers = NULL;
+		/* Wait for all event handler init methods to complete, since the
+		 * broadcaster we're about to start will dispatch events to them */
+		if(startup_pool != NULL) {
+			g_thread_pool_free(startup_pool, FALSE, TRUE);
+			startup_pool = NULL;
+		}
+		g_list_free_full(startup_tasks, (GDestroyNotify)g_free);
+		startup_tasks = NULL;
 		/* Initialize the event broadcaster */
 		if(janus_events_init(enable_events, (server_name ? server_name : (char *)JANUS_SERVER_NAME), eventhandlers) < 0) {
 			JANUS_LOG(LOG_FATAL, "Error initializing the Event handlers mechanism...\n");
@@ -5694,6 +6807,11 @@ gint main(int argc, char *argv[]) {
 	}
 
 	/* Load plugins */
+	if(startup_pool == NULL) {
+		/* We tore the startup pool down to wait for event handlers, create a
+		 * new one so that plugins and transports are initialized in parallel too */
+		startup_pool = janus_startup_pool_create();
+	}
 	path = PLUGINDIR;
 	item = janus_config_get(config, config_general, janus_config_type_item, "plugins_folder");
 	if(item && item->value)
@@ -5790,29 +6908,13 @@ gint main(int argc, char *argv[]) {
 					janus_plugin->get_package(), janus_plugin->get_api_compatibility(), JANUS_PLUGIN_API_VERSION);
 				continue;
 			}
-			if(janus_plugin->init(&janus_handler_plugin, configs_folder) < 0) {
-				JANUS_LOG(LOG_WARN, "The '%s' plugin could not be initialized\n", janus_plugin->get_package());
-				dlclose(plugin);
-				continue;
-			}
-			JANUS_LOG(LOG_VERB, "\tVersion: %d (%s)\n", janus_plugin->get_version(), janus_plugin->get_version_string());
-			JANUS_LOG(LOG_VERB, "\t   [%s] %s\n", janus_plugin->get_package(), janus_plugin->get_name());
-			JANUS_LOG(LOG_VERB, "\t   %s\n", janus_plugin->get_description());
-			JANUS_LOG(LOG_VERB, "\t   Plugin API version: %d\n", janus_plugin->get_api_compatibility());
-			if(!janus_plugin->incoming_rtp && !janus_plugin->incoming_rtcp && !janus_plugin->incoming_data) {
-				JANUS_LOG(LOG_WARN, "The '%s' plugin doesn't implement any callback for RTP/RTCP/data... is this on purpose?\n",
-					janus_plugin->get_package());
-			}
-			if(!janus_plugin->incoming_rtp && !janus_plugin->incoming_rtcp && janus_plugin->incoming_data) {
-				JANUS_LOG(LOG_WARN, "The '%s' plugin will only handle data channels (no RTP/RTCP)... is this on purpose?\n",
-					janus_plugin->get_package());
-			}
-			if(plugins == NULL)
-				plugins = g_hash_table_new(g_str_hash, g_str_equal);
-			g_hash_table_insert(plugins, (gpointer)janus_plugin->get_package(), janus_plugin);
-			if(plugins_so == NULL)
-				plugins_so = g_hash_table_new(g_str_hash, g_str_equal);
-			g_hash_table_insert(plugins_so, (gpointer)janus_plugin->get_package(), plugin);
+			/* Defer the initialization to the startup pool: we'll only add the
+			 * plugin to the core once we know its init method succeeded */
+			janus_startup_init_task *init_task = g_malloc0(sizeof(janus_startup_init_task));
+			init_task->plugin = janus_plugin;
+			init_task->so = plugin;
+			startup_tasks = g_list_prepend(startup_tasks, init_task);
+			janus_startup_init_enqueue(startup_pool, init_task);
 		}
 	}
 	closedir(dir);
@@ -5918,31 +7020,81 @@ gint main(int argc, char *argv[]) {
 					janus_transport->get_package(), janus_transport->get_api_compatibility(), JANUS_TRANSPORT_API_VERSION);
 				continue;
 			}
-			if(janus_transport->init(&janus_handler_transport, configs_folder) < 0) {
-				JANUS_LOG(LOG_WARN, "The '%s' plugin could not be initialized\n", janus_transport->get_package());
-				dlclose(transport);
-				continue;
-			}
-			JANUS_LOG(LOG_VERB, "\tVersion: %d (%s)\n", janus_transport->get_version(), janus_transport->get_version_string());
-			JANUS_LOG(LOG_VERB, "\t   [%s] %s\n", janus_transport->get_package(), janus_transport->get_name());
-			JANUS_LOG(LOG_VERB, "\t   %s\n", janus_transport->get_description());
-			JANUS_LOG(LOG_VERB, "\t   Plugin API version: %d\n", janus_transport->get_api_compatibility());
-			JANUS_LOG(LOG_VERB, "\t   Janus API: %s\n", janus_transport->is_janus_api_enabled() ? "enabled" : "disabled");
-			JANUS_LOG(LOG_VERB, "\t   Admin API: %s\n", janus_transport->is_admin_api_enabled() ? "enabled" : "disabled");
-			janus_api_enabled = janus_api_enabled || janus_transport->is_janus_api_enabled();
-			admin_api_enabled = admin_api_enabled || janus_transport->is_admin_api_enabled();
-			if(transports == NULL)
-				transports = g_hash_table_new(g_str_hash, g_str_equal);
-			g_hash_table_insert(transports, (gpointer)janus_transport->get_package(), janus_transport);
-			if(transports_so == NULL)
-				transports_so = g_hash_table_new(g_str_hash, g_str_equal);
-			g_hash_table_insert(transports_so, (gpointer)janus_transport->get_package(), transport);
+			/* Defer the initialization to the startup pool: we'll only add the
+			 * transport to the core once we know its init method succeeded */
+			janus_startup_init_task *init_task = g_malloc0(sizeof(janus_startup_init_task));
+			init_task->transport = janus_transport;
+			init_task->so = transport;
+			startup_tasks = g_list_prepend(startup_tasks, init_task);
+			janus_startup_init_enqueue(startup_pool, init_task);
 		}
 	}
 	closedir(dir);
 	if(disabled_transports != NULL)
 		g_strfreev(disabled_transports);
 	disabled_transports = NULL;
+	/* Wait for all plugin and transport init methods to complete, and only
+	 * register the ones that were initialized successfully */
+	if(startup_pool != NULL) {
+		g_thread_pool_free(startup_pool, FALSE, TRUE);
+		startup_pool = NULL;
+	}
+	startup_tasks = g_list_reverse(startup_tasks);
+	GList *temp = startup_tasks;
+	while(temp) {
+		janus_startup_init_task *init_task = (janus_startup_init_task *)temp->data;
+		if(init_task->plugin != NULL) {
+			janus_plugin *janus_plugin = init_task->plugin;
+			if(init_task->res < 0) {
+				JANUS_LOG(LOG_WARN, "The '%s' plugin could not be initialized\n", janus_plugin->get_package());
+				dlclose(init_task->so);
+			} else {
+				JANUS_LOG(LOG_VERB, "\tVersion: %d (%s)\n", janus_plugin->get_version(), janus_plugin->get_version_string());
+				JANUS_LOG(LOG_VERB, "\t   [%s] %s\n", janus_plugin->get_package(), janus_plugin->get_name());
+				JANUS_LOG(LOG_VERB, "\t   %s\n", janus_plugin->get_description());
+				JANUS_LOG(LOG_VERB, "\t   Plugin API version: %d\n", janus_plugin->get_api_compatibility());
+				if(!janus_plugin->incoming_rtp && !janus_plugin->incoming_rtcp && !janus_plugin->incoming_data) {
+					JANUS_LOG(LOG_WARN, "The '%s' plugin doesn't implement any callback for RTP/RTCP/data... is this on purpose?\n",
+						janus_plugin->get_package());
+				}
+				if(!janus_plugin->incoming_rtp && !janus_plugin->incoming_rtcp && janus_plugin->incoming_data) {
+					JANUS_LOG(LOG_WARN, "The '%s' plugin will only handle data channels (no RTP/RTCP)... is this on purpose?\n",
+						janus_plugin->get_package());
+				}
+				if(plugins == NULL)
+					plugins = g_hash_table_new(g_str_hash, g_str_equal);
+				g_hash_table_insert(plugins, (gpointer)janus_plugin->get_package(), janus_plugin);
+				if(plugins_so == NULL)
+					plugins_so = g_hash_table_new(g_str_hash, g_str_equal);
+				g_hash_table_insert(plugins_so, (gpointer)janus_plugin->get_package(), init_task->so);
+			}
+		} else if(init_task->transport != NULL) {
+			janus_transport *janus_transport = init_task->transport;
+			if(init_task->res < 0) {
+				JANUS_LOG(LOG_WARN, "The '%s' plugin could not be initialized\n", janus_transport->get_package());
+				dlclose(init_task->so);
+			} else {
+				JANUS_LOG(LOG_VERB, "\tVersion: %d (%s)\n", janus_transport->get_version(), janus_transport->get_version_string());
+				JANUS_LOG(LOG_VERB, "\t   [%s] %s\n", janus_transport->get_package(), janus_transport->get_name());
+				JANUS_LOG(LOG_VERB, "\t   %s\n", janus_transport->get_description());
+				JANUS_LOG(LOG_VERB, "\t   Plugin API version: %d\n", janus_transport->get_api_compatibility());
+				JANUS_LOG(LOG_VERB, "\t   Janus API: %s\n", janus_transport->is_janus_api_enabled() ? "enabled" : "disabled");
+				JANUS_LOG(LOG_VERB, "\t   Admin API: %s\n", janus_transport->is_admin_api_enabled() ? "enabled" : "disabled");
+				janus_api_enabled = janus_api_enabled || janus_transport->is_janus_api_enabled();
+				admin_api_enabled = admin_api_enabled || janus_transport->is_admin_api_enabled();
+				if(transports == NULL)
+					transports = g_hash_table_new(g_str_hash, g_str_equal);
+				g_hash_table_insert(transports, (gpointer)janus_transport->get_package(), janus_transport);
+				if(transports_so == NULL)
+					transports_so = g_hash_table_new(g_str_hash, g_str_equal);
+				g_hash_table_insert(transports_so, (gpointer)janus_transport->get_package(), init_task->so);
+			}
+		}
+		g_free(init_task);
+		temp = temp->next;
+	}
+	g_list_free(startup_tasks);
+	startup_tasks = NULL;
 	/* Make sure at least a Janus API transport is available */
 	if(!janus_api_enabled) {
 		JANUS_LOG(LOG_FATAL, "No Janus API transport is available... enable at least one and restart Janus\n");
@@ -6017,6 +7169,7 @@ gint main(int argc, char *argv[]) {
 	}
 	/* Get rid of requests tasks and thread too */
 	g_thread_pool_free(tasks, FALSE, FALSE);
+	g_thread_pool_free(fast_tasks, FALSE, FALSE);
 	JANUS_LOG(LOG_INFO, "Ending requests thread...\n");
 	g_async_queue_push(requests, &exit_message);
 	g_thread_join(requests_thread);
@@ -6024,7 +7177,14 @@ gint main(int argc, char *argv[]) {
 	g_async_queue_unref(requests);
 
 	JANUS_LOG(LOG_INFO, "Destroying sessions...\n");
-	g_clear_pointer(&sessions, g_hash_table_destroy);
+	sessions_inited = FALSE;
+	for(shard = 0; shard < JANUS_SESSIONS_SHARDS; shard++)
+		g_clear_pointer(&sessions_shards[shard].table, g_hash_table_destroy);
+	int slot = 0;
+	for(slot = 0; slot < JANUS_SESSIONS_WHEEL_SLOTS; slot++) {
+		g_slist_free_full(sessions_wheel[slot], (GDestroyNotify)g_free);
+		sessions_wheel[slot] = NULL;
+	}
 	janus_ice_deinit();
 	JANUS_LOG(LOG_INFO, "Freeing crypto resources...\n");
 	janus_dtls_srtp_cleanup();
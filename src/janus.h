@@ -56,8 +56,15 @@ typedef struct janus_session {
 	gint timeout;
 	/*! \brief Flag to notify that transport is gone */
 	volatile gint transport_gone;
-	/*! \brief Mutex to lock/unlock this session */
+	/*! \brief Mutex serializing changes to the map of handles (lookups
+	 * are lock-free, they work on the currently published snapshot) */
 	janus_mutex mutex;
+	/*! \brief Mutex protecting the request source, kept separate from
+	 * the handles mutex so that claims and notifications going through
+	 * the source don't serialize with handle management */
+	janus_mutex source_mutex;
+	/*! \brief Handle table snapshots waiting out their grace period before destruction */
+	GSList *retired_handles;
 	/*! \brief Atomic flag to check if this instance has been destroyed */
 	volatile gint destroyed;
 	/*! \brief Reference counter for this instance */
@@ -129,6 +136,8 @@ struct janus_request {
 	json_t *message;
 	/*! \brief Pointer to any JSON errors parsing the original request */
 	json_error_t *error;
+	/*! \brief Monotonic time this request was queued for processing at */
+	gint64 queued;
 	/*! \brief Atomic flag to check if this instance has been destroyed */
 	volatile gint destroyed;
 	/*! \brief Reference counter for this instance */
@@ -0,0 +1,216 @@
+/*! \file    lfq.c
+ * \author   Lorenzo Miniero <lorenzo@meetecho.com>
+ * \copyright GNU General Public License v3
+ * \brief    Lock-free bounded queue for the media path
+ * \details  Implementation of a bounded lock-free queue, used as a
+ * replacement for GAsyncQueue in hot paths (e.g., the per-handle queue
+ * of outgoing packets in the ICE code). The fast path is a fixed-size
+ * ring of pointers with per-slot sequence counters, so that pushes and
+ * pops never need to take a mutex; a separate, unbounded, control lane
+ * (still backed by a GAsyncQueue) is used for the rare messages that
+ * need to jump ahead of queued media; a third lane, drained after the
+ * ring, absorbs the overflow in case the ring is full, so that no
+ * packet is ever lost because of the bounded size (and none is ever
+ * reordered because of it). The ring itself follows the classic
+ * bounded MPMC design by Dmitry Vyukov: each slot carries a sequence
+ * number that tells
+ * producers and consumers whether the slot is free or holds an item,
+ * which keeps the queue correct even with more than one producer
+ * (e.g., a plugin thread relaying media plus the handle loop pushing
+ * RTCP or retransmissions).
+ *
+ * \ingroup core
+ * \ref core
+ */
+
+#include <string.h>
+
+#include "lfq.h"
+#include "debug.h"
+
+typedef struct janus_lfq_slot {
+	/*! \brief Slot sequence number (Vyukov-style occupancy marker) */
+	volatile guint seq;
+	/*! \brief The queued item */
+	gpointer item;
+} janus_lfq_slot;
+
+struct janus_lfq {
+	/*! \brief Ring of slots (power-of-two size) */
+	janus_lfq_slot *slots;
+	/*! \brief Mask to wrap positions to the ring size */
+	guint mask;
+	/*! \brief Producer position */
+	volatile guint head;
+	/*! \brief Consumer position */
+	volatile guint tail;
+	/*! \brief Atomic depth counter (ring plus control and overflow lanes) */
+	volatile gint depth;
+	/*! \brief Control lane, for priority messages */
+	GAsyncQueue *control;
+	/*! \brief Overflow lane, for when the ring is full: unlike the control
+	 * lane it's drained after the ring, to preserve the FIFO order */
+	GAsyncQueue *overflow;
+	/*! \brief Number of items currently in the overflow lane: as long as
+	 * it's positive, new pushes keep targeting the overflow lane too,
+	 * as queueing to the ring would jump ahead of older items */
+	volatile gint overflowed;
+};
+
+janus_lfq *janus_lfq_new(guint size) {
+	if(size < 2)
+		size = 2;
+	/* Round the size up to the next power of two */
+	guint rounded = 2;
+	while(rounded < size && rounded != 0)
+		rounded <<= 1;
+	if(rounded == 0)
+		return NULL;
+	janus_lfq *queue = g_malloc0(sizeof(janus_lfq));
+	queue->slots = g_malloc0(rounded*sizeof(janus_lfq_slot));
+	queue->mask = rounded-1;
+	guint i = 0;
+	for(i=0; i<rounded; i++)
+		queue->slots[i].seq = i;
+	queue->control = g_async_queue_new();
+	queue->overflow = g_async_queue_new();
+	return queue;
+}
+
+void janus_lfq_push(janus_lfq *queue, gpointer item) {
+	if(queue == NULL)
+		return;
+	if(g_atomic_int_get((gint *)&queue->overflowed) > 0) {
+		/* The ring overflowed and the overflow lane hasn't been drained
+		 * yet: keep pushing there, older items must be popped first */
+		g_atomic_int_inc((gint *)&queue->overflowed);
+		g_async_queue_push(queue->overflow, item);
+		g_atomic_int_inc((gint *)&queue->depth);
+		return;
+	}
+	guint pos = (guint)g_atomic_int_get((gint *)&queue->head);
+	while(TRUE) {
+		janus_lfq_slot *slot = &queue->slots[pos & queue->mask];
+		guint seq = (guint)g_atomic_int_get((gint *)&slot->seq);
+		gint diff = (gint)(seq - pos);
+		if(diff == 0) {
+			/* Slot is free, try to claim it */
+			if(g_atomic_int_compare_and_exchange((gint *)&queue->head, (gint)pos, (gint)(pos+1))) {
+				slot->item = item;
+				g_atomic_int_set((gint *)&slot->seq, (gint)(pos+1));
+				g_atomic_int_inc((gint *)&queue->depth);
+				return;
+			}
+			pos = (guint)g_atomic_int_get((gint *)&queue->head);
+		} else if(diff < 0) {
+			/* Ring is full, overflow to the overflow lane rather than losing
+			 * the item: being drained after the ring, FIFO order is kept */
+			g_atomic_int_inc((gint *)&queue->overflowed);
+			g_async_queue_push(queue->overflow, item);
+			g_atomic_int_inc((gint *)&queue->depth);
+			return;
+		} else {
+			/* Another producer got here first, retry from the new head */
+			pos = (guint)g_atomic_int_get((gint *)&queue->head);
+		}
+	}
+}
+
+gboolean janus_lfq_try_push(janus_lfq *queue, gpointer item) {
+	if(queue == NULL)
+		return FALSE;
+	guint pos = (guint)g_atomic_int_get((gint *)&queue->head);
+	while(TRUE) {
+		janus_lfq_slot *slot = &queue->slots[pos & queue->mask];
+		guint seq = (guint)g_atomic_int_get((gint *)&slot->seq);
+		gint diff = (gint)(seq - pos);
+		if(diff == 0) {
+			/* Slot is free, try to claim it */
+			if(g_atomic_int_compare_and_exchange((gint *)&queue->head, (gint)pos, (gint)(pos+1))) {
+				slot->item = item;
+				g_atomic_int_set((gint *)&slot->seq, (gint)(pos+1));
+				g_atomic_int_inc((gint *)&queue->depth);
+				return TRUE;
+			}
+			pos = (guint)g_atomic_int_get((gint *)&queue->head);
+		} else if(diff < 0) {
+			/* Ring is full, let the caller deal with the item */
+			return FALSE;
+		} else {
+			/* Another producer got here first, retry from the new head */
+			pos = (guint)g_atomic_int_get((gint *)&queue->head);
+		}
+	}
+}
+
+void janus_lfq_push_front(janus_lfq *queue, gpointer item) {
+	if(queue == NULL)
+		return;
+#if GLIB_CHECK_VERSION(2, 46, 0)
+	g_async_queue_push_front(queue->control, item);
+#else
+	g_async_queue_push(queue->control, item);
+#endif
+	g_atomic_int_inc((gint *)&queue->depth);
+}
+
+gpointer janus_lfq_try_pop(janus_lfq *queue) {
+	if(queue == NULL)
+		return NULL;
+	/* Control lane first: priority messages jump ahead of queued media */
+	gpointer item = g_async_queue_try_pop(queue->control);
+	if(item != NULL) {
+		(void)g_atomic_int_dec_and_test((gint *)&queue->depth);
+		return item;
+	}
+	guint pos = (guint)g_atomic_int_get((gint *)&queue->tail);
+	while(TRUE) {
+		janus_lfq_slot *slot = &queue->slots[pos & queue->mask];
+		guint seq = (guint)g_atomic_int_get((gint *)&slot->seq);
+		gint diff = (gint)(seq - (pos+1));
+		if(diff == 0) {
+			/* Slot holds an item, try to claim it */
+			if(g_atomic_int_compare_and_exchange((gint *)&queue->tail, (gint)pos, (gint)(pos+1))) {
+				item = slot->item;
+				slot->item = NULL;
+				g_atomic_int_set((gint *)&slot->seq, (gint)(pos+queue->mask+1));
+				(void)g_atomic_int_dec_and_test((gint *)&queue->depth);
+				return item;
+			}
+			pos = (guint)g_atomic_int_get((gint *)&queue->tail);
+		} else if(diff < 0) {
+			/* Ring is empty: check the overflow lane, whose items are
+			 * younger than anything that was queued in the ring */
+			if(g_atomic_int_get((gint *)&queue->overflowed) > 0) {
+				item = g_async_queue_try_pop(queue->overflow);
+				if(item != NULL) {
+					(void)g_atomic_int_dec_and_test((gint *)&queue->overflowed);
+					(void)g_atomic_int_dec_and_test((gint *)&queue->depth);
+					return item;
+				}
+			}
+			return NULL;
+		} else {
+			/* Another consumer got here first, retry from the new tail */
+			pos = (guint)g_atomic_int_get((gint *)&queue->tail);
+		}
+	}
+}
+
+gint janus_lfq_length(janus_lfq *queue) {
+	if(queue == NULL)
+		return 0;
+	gint depth = g_atomic_int_get((gint *)&queue->depth);
+	return depth > 0 ? depth : 0;
+}
+
+void janus_lfq_destroy(janus_lfq *queue) {
+	if(queue == NULL)
+		return;
+	/* Items are popped and discarded: callers drain the queue first if needed */
+	while(janus_lfq_try_pop(queue) != NULL);
+	g_async_queue_unref(queue->control);
+	g_async_queue_unref(queue->overflow);
+	g_free(queue->slots);
+	g_free(queue);
+}
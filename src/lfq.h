@@ -0,0 +1,70 @@
+/*! \file    lfq.h
+ * \author   Lorenzo Miniero <lorenzo@meetecho.com>
+ * \copyright GNU General Public License v3
+ * \brief    Lock-free bounded queue for the media path (headers)
+ * \details  Implementation of a bounded lock-free queue, used as a
+ * replacement for GAsyncQueue in hot paths (e.g., the per-handle queue
+ * of outgoing packets in the ICE code). The fast path is a fixed-size
+ * ring of pointers with per-slot sequence counters, so that pushes and
+ * pops never need to take a mutex; a separate, unbounded, control lane
+ * (still backed by a GAsyncQueue) is used for the rare messages that
+ * need to jump ahead of queued media (e.g., loop triggers that were
+ * previously pushed with \c g_async_queue_push_front); a third lane,
+ * drained after the ring, absorbs the overflow in case the ring is
+ * full, so that no packet is ever lost because of the bounded size,
+ * nor reordered because of it. The current depth of the queue can be
+ * checked with a single atomic read, which makes it cheap to poll from
+ * a GSource prepare callback.
+ *
+ * \ingroup core
+ * \ref core
+ */
+
+#ifndef JANUS_LFQ_H
+#define JANUS_LFQ_H
+
+#include <glib.h>
+
+typedef struct janus_lfq janus_lfq;
+
+/*! \brief Helper to create a new lock-free queue
+ * @param size Size of the ring (will be rounded up to a power of two)
+ * @returns A pointer to a valid janus_lfq instance, if successful, NULL otherwise */
+janus_lfq *janus_lfq_new(guint size);
+/*! \brief Push an item at the back of the queue
+ * \note In case the ring is full, the item transparently ends up in the
+ * (mutex-protected) overflow lane instead, so this never loses data,
+ * and since that lane is drained after the ring, FIFO order is kept
+ * @param queue The janus_lfq instance to push to
+ * @param item The item to push */
+void janus_lfq_push(janus_lfq *queue, gpointer item);
+/*! \brief Push an item at the back of the queue, but only if the ring has room
+ * \note Unlike janus_lfq_push, this never touches the control lane: in case
+ * the ring is full the item is simply not queued, which is what object pools
+ * want (the caller can then just free the item instead)
+ * @param queue The janus_lfq instance to push to
+ * @param item The item to push
+ * @returns TRUE if the item was queued, FALSE if the ring was full */
+gboolean janus_lfq_try_push(janus_lfq *queue, gpointer item);
+/*! \brief Push an item at the front of the queue, ahead of queued media
+ * \note Items pushed this way always go through the control lane, which
+ * the consumer drains before the ring: this is meant for rare control
+ * messages and retransmissions, not for regular media
+ * @param queue The janus_lfq instance to push to
+ * @param item The item to push */
+void janus_lfq_push_front(janus_lfq *queue, gpointer item);
+/*! \brief Pop an item from the queue, if any (control lane first)
+ * @param queue The janus_lfq instance to pop from
+ * @returns A pointer to the popped item, if any, NULL otherwise */
+gpointer janus_lfq_try_pop(janus_lfq *queue);
+/*! \brief Atomically check how many items are queued
+ * @param queue The janus_lfq instance to query
+ * @returns The current depth of the queue */
+gint janus_lfq_length(janus_lfq *queue);
+/*! \brief Destroy an existing lock-free queue
+ * \note Any item still queued is popped and discarded: in case items
+ * need to be deallocated, drain the queue before destroying it
+ * @param queue The janus_lfq instance to destroy */
+void janus_lfq_destroy(janus_lfq *queue);
+
+#endif
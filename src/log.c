@@ -5,8 +5,11 @@
  * \details   Implementation of a simple buffered logger designed to remove
  * I/O wait from threads that may be sensitive to such delays. Each time
  * there's stuff to be written (to stdout, log files, or external loggers),
- * it's added to an async queue, which is consumed from a dedicated thread
- * that then actually takes care of I/O.
+ * it's formatted into a preallocated buffer recycled from a pool and
+ * pushed through a lock-free ring, which is consumed from a dedicated
+ * thread that then actually takes care of I/O, flushing lines in
+ * batches. If the ring is ever full, lines are dropped and counted
+ * rather than blocking the thread that's logging.
  *
  * \ingroup core
  * \ref core
@@ -18,31 +21,215 @@
 
 #include "log.h"
 #include "debug.h"
+#include "lfq.h"
 #include "utils.h"
 #include "loggers/logger.h"
 
 #define THREAD_NAME "log"
 
+/* Size of the ring log lines go through, and of the pool of reusable
+ * line buffers: both bound the amount of memory logging can use */
+#define JANUS_LOG_QUEUE_SIZE	8192
+#define JANUS_LOG_POOL_SIZE		512
+/* Lines within a batch are flushed to file/console together, not one by one */
+#define JANUS_LOG_FLUSH_LINES	64
+
 typedef struct janus_log_buffer {
 	int64_t timestamp;
-	char *str;
+	char *str;		/* Points to buf, unless the line was too long for it */
+	size_t binlen;	/* If non-zero, str is a binary record of this size, not text */
+	char buf[1024];
 } janus_log_buffer;
 static janus_log_buffer exit_message;
 static janus_log_buffer reload_message;
-static void janus_log_buffer_free(janus_log_buffer *b) {
-	if(b == NULL || b == &exit_message)
+
+static janus_lfq *janus_log_queue = NULL;
+/* Pool of already allocated buffers: in the steady state, logging a
+ * line doesn't need any allocation, as buffers the logger thread is
+ * done with are recycled through here */
+static janus_lfq *janus_log_pool = NULL;
+/* Lines dropped because the ring was full (logging never blocks) */
+static volatile gint janus_log_dropped = 0;
+
+static void janus_log_buffer_release(janus_log_buffer *b) {
+	if(b == NULL || b == &exit_message || b == &reload_message)
 		return;
-	g_free(b->str);
-	g_free(b);
+	if(b->str != NULL && b->str != b->buf)
+		g_free(b->str);
+	b->str = NULL;
+	/* Put the buffer back in the pool for reuse, if there's room */
+	if(janus_log_pool == NULL || !janus_lfq_try_push(janus_log_pool, b))
+		g_free(b);
 }
 
-static GAsyncQueue *janus_log_queue = NULL;
 static GThread *log_thread = NULL;
 
 static gboolean janus_log_console = TRUE;
 static char *janus_log_filepath = NULL;
 static FILE *janus_log_file = NULL;
 
+/* Binary logging: when enabled, JANUS_LOG doesn't format any text but
+ * serializes the raw arguments to a compact record, referencing the
+ * format string by a numeric ID assigned the first time each call site
+ * is hit; janus-logcat renders the records back to text offline. The
+ * binary log is a plain stream of records, each starting with a type
+ * octet: 'J' (start of a logging session, followed by the rest of the
+ * magic string), 'F' (format string dictionary entry), 'L' (log record
+ * with serialized arguments) or 'T' (preformatted text, used when a
+ * format string contains directives we can't serialize). Fields are in
+ * host byte order, as records are meant to be rendered where (or at
+ * least on the same architecture as) they were written. */
+gboolean janus_log_binary = FALSE;
+static char *janus_binlog_filepath = NULL;
+static FILE *janus_binlog_file = NULL;
+#define JANUS_LOG_BINARY_MAGIC		"JBLOG001"
+#define JANUS_LOG_BINARY_MAX_FMTS	8192
+#define JANUS_LOG_BINARY_MAX_ARGS	15
+typedef struct janus_log_binary_fmt {
+	const char *format;		/* These all point to static strings from the call site */
+	const char *file;
+	const char *function;
+	int line;
+	char sig[JANUS_LOG_BINARY_MAX_ARGS+1];	/* One type octet per argument */
+} janus_log_binary_fmt;
+/* Registered format strings, indexed by ID-1: slots are only written
+ * under the registration mutex, and only read after their ID has been
+ * published with an atomic store, so readers don't need the lock */
+static janus_log_binary_fmt *janus_log_binary_fmts[JANUS_LOG_BINARY_MAX_FMTS];
+static gint janus_log_binary_fmts_num = 0;
+static GMutex janus_log_binary_fmts_mutex;
+
+/* Compute the argument signature of a printf format string: one octet
+ * per argument ('i' int, 'l' long, 'q' long long, 'z' size_t/ptrdiff_t,
+ * 'd' double, 's' string, 'p' pointer). Returns the number of arguments,
+ * or -1 if the format uses directives we can't serialize (in which case
+ * the call site falls back to formatting text at log time) */
+static int janus_log_binary_signature(const char *format, char *sig, size_t siglen) {
+	size_t args = 0;
+	const char *p = format;
+	while(*p) {
+		if(*p != '%') {
+			p++;
+			continue;
+		}
+		p++;
+		if(*p == '%') {
+			/* Escaped percent, no argument */
+			p++;
+			continue;
+		}
+		/* Flags */
+		while(*p == '-' || *p == '+' || *p == ' ' || *p == '#' || *p == '0' || *p == '\'')
+			p++;
+		/* Width (a '*' means an extra int argument) */
+		if(*p == '*') {
+			if(args >= siglen-1)
+				return -1;
+			sig[args++] = 'i';
+			p++;
+		} else {
+			while(*p >= '0' && *p <= '9')
+				p++;
+		}
+		/* Precision */
+		if(*p == '.') {
+			p++;
+			if(*p == '*') {
+				if(args >= siglen-1)
+					return -1;
+				sig[args++] = 'i';
+				p++;
+			} else {
+				while(*p >= '0' && *p <= '9')
+					p++;
+			}
+		}
+		/* Length modifiers */
+		char length = 0;
+		while(*p == 'h' || *p == 'l' || *p == 'j' || *p == 'z' || *p == 't' || *p == 'L') {
+			if(*p == 'l' && length == 'l')
+				length = 'q';	/* ll */
+			else
+				length = *p;
+			p++;
+		}
+		/* Conversion */
+		char type = 0;
+		switch(*p) {
+			case 'd': case 'i':
+			case 'o': case 'u': case 'x': case 'X':
+				if(length == 'l')
+					type = 'l';
+				else if(length == 'q' || length == 'j')
+					type = 'q';
+				else if(length == 'z' || length == 't')
+					type = 'z';
+				else if(length == 0 || length == 'h')
+					type = 'i';	/* chars and shorts are promoted to int */
+				break;
+			case 'e': case 'E': case 'f': case 'F':
+			case 'g': case 'G': case 'a': case 'A':
+				if(length != 'L')
+					type = 'd';	/* floats are promoted to double */
+				break;
+			case 'c':
+				if(length == 0)
+					type = 'i';
+				break;
+			case 's':
+				if(length == 0)
+					type = 's';
+				break;
+			case 'p':
+				type = 'p';
+				break;
+			default:
+				break;
+		}
+		if(type == 0)
+			return -1;
+		if(args >= siglen-1)
+			return -1;
+		sig[args++] = type;
+		p++;
+	}
+	sig[args] = '\0';
+	return (int)args;
+}
+
+/* Little helpers to append fixed-size fields and counted strings when
+ * serializing records (all fields are written in host byte order) */
+#define JANUS_LOG_BINARY_APPEND(p, v) \
+	do { memcpy(p, &(v), sizeof(v)); p += sizeof(v); } while(0)
+static char *janus_log_binary_append_string(char *p, const char *str) {
+	guint16 len = str ? (guint16)strlen(str) : 0;
+	JANUS_LOG_BINARY_APPEND(p, len);
+	if(len > 0) {
+		memcpy(p, str, len);
+		p += len;
+	}
+	return p;
+}
+
+/* Serialize a dictionary record ('F') for a registered format string:
+ * allocates the record and returns its size */
+static gsize janus_log_binary_fmt_record(gint fmtid, janus_log_binary_fmt *f, char **record) {
+	gsize len = 1 + sizeof(guint32) + sizeof(gint32) + 4*sizeof(guint16) +
+		strlen(f->sig) + strlen(f->format) + strlen(f->file) + strlen(f->function);
+	char *p = g_malloc(len);
+	*record = p;
+	*p++ = 'F';
+	guint32 id = (guint32)fmtid;
+	JANUS_LOG_BINARY_APPEND(p, id);
+	gint32 line = (gint32)f->line;
+	JANUS_LOG_BINARY_APPEND(p, line);
+	p = janus_log_binary_append_string(p, f->sig);
+	p = janus_log_binary_append_string(p, f->format);
+	p = janus_log_binary_append_string(p, f->file);
+	p = janus_log_binary_append_string(p, f->function);
+	return len;
+}
+
 static GHashTable *external_loggers = NULL;
 
 static volatile gint initialized = 0;
@@ -61,6 +248,12 @@ char *janus_log_get_logfile_path(void) {
 }
 
 static void janus_log_print_buffer(janus_log_buffer *b) {
+	if(b->binlen > 0) {
+		/* Binary record: this only goes to the binary log file */
+		if(janus_binlog_file)
+			fwrite(b->str, 1, b->binlen, janus_binlog_file);
+		return;
+	}
 	if(janus_log_console)
 		fputs(b->str, stdout);
 	if(janus_log_file)
@@ -76,63 +269,149 @@ static void janus_log_print_buffer(janus_log_buffer *b) {
 			l->incoming_logline(b->timestamp, b->str);
 		}
 	}
-	/* Flush the buffers */
+}
+
+static void janus_log_flush(void) {
 	if(janus_log_console)
 		fflush(stdout);
 	if(janus_log_file)
 		fflush(janus_log_file);
+	if(janus_binlog_file)
+		fflush(janus_binlog_file);
+}
+
+/* Start a new logging session in the binary log: we write the magic
+ * string and then a dictionary entry for each format string registered
+ * so far, so that the file is self-contained even after a log rotation */
+static void janus_log_binary_write_session(void) {
+	if(janus_binlog_file == NULL)
+		return;
+	fwrite(JANUS_LOG_BINARY_MAGIC, 1, strlen(JANUS_LOG_BINARY_MAGIC), janus_binlog_file);
+	g_mutex_lock(&janus_log_binary_fmts_mutex);
+	gint i = 0;
+	for(i=0; i<janus_log_binary_fmts_num; i++) {
+		char *record = NULL;
+		gsize len = janus_log_binary_fmt_record(i+1, janus_log_binary_fmts[i], &record);
+		fwrite(record, 1, len, janus_binlog_file);
+		g_free(record);
+	}
+	g_mutex_unlock(&janus_log_binary_fmts_mutex);
+	fflush(janus_binlog_file);
 }
 
 static void *janus_log_thread(void *ctx) {
 	janus_log_buffer *b = NULL;
+	int printed = 0;
+	gint reported_drops = 0;
 
-	while(!g_atomic_int_get(&stopping)) {
-		b = g_async_queue_pop(janus_log_queue);
-		if(b == NULL || b == &exit_message)
+	while(TRUE) {
+		b = janus_lfq_try_pop(janus_log_queue);
+		if(b == NULL) {
+			/* Nothing left to write: did we drop any line since last time? */
+			gint dropped = g_atomic_int_get(&janus_log_dropped);
+			if(dropped != reported_drops) {
+				janus_log_buffer note;
+				note.timestamp = janus_get_real_time();
+				g_snprintf(note.buf, sizeof(note.buf), "[WARN] Dropped %d log lines, the logging queue was full\n",
+					dropped - reported_drops);
+				note.str = note.buf;
+				note.binlen = 0;
+				janus_log_print_buffer(&note);
+				if(janus_binlog_file != NULL) {
+					/* Note the drops in the binary log too, as a preformatted record */
+					char drops[128], header[1 + sizeof(guint8) + sizeof(gint64) + sizeof(guint64) + sizeof(guint32)];
+					g_snprintf(drops, sizeof(drops), "Dropped %d log lines, the logging queue was full\n",
+						dropped - reported_drops);
+					char *p = header;
+					*p++ = 'T';
+					guint8 lvl = LOG_WARN;
+					JANUS_LOG_BINARY_APPEND(p, lvl);
+					gint64 ts = note.timestamp;
+					JANUS_LOG_BINARY_APPEND(p, ts);
+					guint64 thread = 0;
+					JANUS_LOG_BINARY_APPEND(p, thread);
+					guint32 payload = (guint32)strlen(drops);
+					JANUS_LOG_BINARY_APPEND(p, payload);
+					fwrite(header, 1, sizeof(header), janus_binlog_file);
+					fwrite(drops, 1, payload, janus_binlog_file);
+				}
+				reported_drops = dropped;
+				printed++;
+			}
+			/* Flush the batch we wrote so far, and wait for more lines */
+			if(printed > 0) {
+				janus_log_flush();
+				printed = 0;
+			}
+			if(g_atomic_int_get(&stopping))
+				break;
+			g_usleep(20000);
+			continue;
+		}
+		if(b == &exit_message)
 			break;
 		if(b == &reload_message) {
 			JANUS_PRINT("Got a log reload request.\n");
 			/* Ensure everything in the buffer has been written before reopening the file */
-			while((b = g_async_queue_try_pop(janus_log_queue)) != NULL) {
-				if(b->str != NULL)
+			while((b = janus_lfq_try_pop(janus_log_queue)) != NULL) {
+				if(b != &exit_message && b != &reload_message && b->str != NULL)
 					janus_log_print_buffer(b);
-				janus_log_buffer_free(b);
+				janus_log_buffer_release(b);
 			}
-			fflush(janus_log_file);
-			fclose(janus_log_file);
-			/* Now let's start using the log file again */
-			janus_log_file = fopen(janus_log_filepath, "awt");
-			if(janus_log_file == NULL) {
-				JANUS_PRINT("Error opening log file %s: %s\n", janus_log_filepath, g_strerror(errno));
-				continue;
+			if(janus_log_file != NULL) {
+				fflush(janus_log_file);
+				fclose(janus_log_file);
+				/* Now let's start using the log file again */
+				janus_log_file = fopen(janus_log_filepath, "awt");
+				if(janus_log_file == NULL)
+					JANUS_PRINT("Error opening log file %s: %s\n", janus_log_filepath, g_strerror(errno));
+			}
+			if(janus_binlog_file != NULL) {
+				fflush(janus_binlog_file);
+				fclose(janus_binlog_file);
+				/* Reopen the binary log and start a new session there,
+				 * so that the rotated file is self-contained too */
+				janus_binlog_file = fopen(janus_binlog_filepath, "ab");
+				if(janus_binlog_file == NULL)
+					JANUS_PRINT("Error opening binary log file %s: %s\n", janus_binlog_filepath, g_strerror(errno));
+				else
+					janus_log_binary_write_session();
 			}
 			continue;
 		}
 		if(b->str == NULL) {
-			janus_log_buffer_free(b);
+			janus_log_buffer_release(b);
 			continue;
 		}
 		/* We have something to log */
 		janus_log_print_buffer(b);
 		/* Done, get rid of this log line */
-		janus_log_buffer_free(b);
+		janus_log_buffer_release(b);
+		/* Only flush every now and then, rather than after every line */
+		printed++;
+		if(printed >= JANUS_LOG_FLUSH_LINES) {
+			janus_log_flush();
+			printed = 0;
+		}
 	}
 	/* Print all that's left to print */
-	while((b = g_async_queue_try_pop(janus_log_queue)) != NULL) {
-		if(b->str != NULL)
+	while((b = janus_lfq_try_pop(janus_log_queue)) != NULL) {
+		if(b != &exit_message && b != &reload_message && b->str != NULL)
 			janus_log_print_buffer(b);
-		janus_log_buffer_free(b);
+		janus_log_buffer_release(b);
 	}
-	if(janus_log_console)
-		fflush(stdout);
-	if(janus_log_file)
-		fflush(janus_log_file);
+	janus_log_flush();
 
 	if(janus_log_file)
 		fclose(janus_log_file);
 	janus_log_file = NULL;
 	g_free(janus_log_filepath);
 	janus_log_filepath = NULL;
+	if(janus_binlog_file)
+		fclose(janus_binlog_file);
+	janus_binlog_file = NULL;
+	g_free(janus_binlog_filepath);
+	janus_binlog_filepath = NULL;
 
 	return NULL;
 }
@@ -140,21 +419,288 @@ static void *janus_log_thread(void *ctx) {
 void janus_vprintf(const char *format, ...) {
 	if(g_atomic_int_get(&stopping))
 		return;
-	if(janus_log_queue == NULL)
-		janus_log_queue = g_async_queue_new_full((GDestroyNotify)janus_log_buffer_free);
-	/* Serialize it to a string */
+	if(janus_log_queue == NULL) {
+		janus_log_queue = janus_lfq_new(JANUS_LOG_QUEUE_SIZE);
+		janus_log_pool = janus_lfq_new(JANUS_LOG_POOL_SIZE);
+	}
+	/* Get a line buffer: in the steady state we just recycle one from
+	 * the pool, so there's no allocation on this path */
+	janus_log_buffer *b = janus_lfq_try_pop(janus_log_pool);
+	if(b == NULL)
+		b = g_malloc(sizeof(janus_log_buffer));
+	/* Serialize the string to the buffer itself */
 	va_list ap;
 	va_start(ap, format);
-	char *str = NULL;
-	int len = g_vasprintf(&str, format, ap);
+	int len = g_vsnprintf(b->buf, sizeof(b->buf), format, ap);
 	va_end(ap);
-	if(len < 0 || str == NULL)
+	if(len < 0) {
+		b->str = NULL;
+		janus_log_buffer_release(b);
 		return;
-	/* Queue the new log buffer */
-	janus_log_buffer *b = g_malloc(sizeof(janus_log_buffer));
+	}
+	if((size_t)len < sizeof(b->buf)) {
+		b->str = b->buf;
+	} else {
+		/* The line didn't fit in the preallocated buffer: format it again on the heap */
+		b->str = g_malloc(len+1);
+		va_start(ap, format);
+		g_vsnprintf(b->str, len+1, format, ap);
+		va_end(ap);
+	}
 	b->timestamp = janus_get_real_time();
-	b->str = str;
-	g_async_queue_push(janus_log_queue, b);
+	b->binlen = 0;
+	/* Queue the new log line: if the ring is full we drop it and keep
+	 * count, since blocking here would defeat the purpose of the logger */
+	if(!janus_lfq_try_push(janus_log_queue, b)) {
+		g_atomic_int_inc(&janus_log_dropped);
+		janus_log_buffer_release(b);
+	}
+}
+
+/* Queue an already serialized binary record (takes ownership of it) */
+static void janus_log_binary_queue(char *record, gsize len) {
+	janus_log_buffer *b = janus_lfq_try_pop(janus_log_pool);
+	if(b == NULL)
+		b = g_malloc(sizeof(janus_log_buffer));
+	if(len <= sizeof(b->buf)) {
+		memcpy(b->buf, record, len);
+		b->str = b->buf;
+		g_free(record);
+	} else {
+		b->str = record;
+	}
+	b->timestamp = janus_get_real_time();
+	b->binlen = len;
+	if(!janus_lfq_try_push(janus_log_queue, b)) {
+		g_atomic_int_inc(&janus_log_dropped);
+		janus_log_buffer_release(b);
+	}
+}
+
+/* Register the format string of a call site and assign it an ID: this
+ * only happens the first time each call site is hit, as the macro
+ * caches the ID in a per-call-site static afterwards */
+static gint janus_log_binary_register(volatile gint *id,
+		const char *file, const char *function, int line, const char *format) {
+	g_mutex_lock(&janus_log_binary_fmts_mutex);
+	gint fmtid = g_atomic_int_get(id);
+	if(fmtid != 0) {
+		/* Somebody else just registered this call site */
+		g_mutex_unlock(&janus_log_binary_fmts_mutex);
+		return fmtid;
+	}
+	char sig[JANUS_LOG_BINARY_MAX_ARGS+1];
+	if(janus_log_binary_fmts_num >= JANUS_LOG_BINARY_MAX_FMTS ||
+			janus_log_binary_signature(format, sig, sizeof(sig)) < 0) {
+		/* We can't serialize the arguments of this call site, have it
+		 * format its lines to text at log time instead */
+		g_atomic_int_set(id, -1);
+		g_mutex_unlock(&janus_log_binary_fmts_mutex);
+		return -1;
+	}
+	janus_log_binary_fmt *f = g_malloc(sizeof(janus_log_binary_fmt));
+	f->format = format;
+	f->file = file;
+	f->function = function;
+	f->line = line;
+	g_strlcpy(f->sig, sig, sizeof(f->sig));
+	fmtid = janus_log_binary_fmts_num + 1;
+	janus_log_binary_fmts[fmtid-1] = f;
+	janus_log_binary_fmts_num = fmtid;
+	/* Queue the dictionary record before publishing the ID, so that in
+	 * the binary log it always precedes the records referencing it */
+	char *record = NULL;
+	gsize len = janus_log_binary_fmt_record(fmtid, f, &record);
+	janus_log_binary_queue(record, len);
+	g_atomic_int_set(id, fmtid);
+	g_mutex_unlock(&janus_log_binary_fmts_mutex);
+	return fmtid;
+}
+
+/* Compute the serialized size of the arguments of a log call, walking
+ * the signature of its format string */
+static gsize janus_log_binary_args_size(const char *sig, va_list ap) {
+	gsize len = 0;
+	while(*sig) {
+		switch(*sig) {
+			case 'i':
+				(void)va_arg(ap, int);
+				len += sizeof(gint32);
+				break;
+			case 'l':
+				(void)va_arg(ap, long);
+				len += sizeof(gint64);
+				break;
+			case 'q':
+				(void)va_arg(ap, long long);
+				len += sizeof(gint64);
+				break;
+			case 'z':
+				(void)va_arg(ap, size_t);
+				len += sizeof(guint64);
+				break;
+			case 'd':
+				(void)va_arg(ap, double);
+				len += sizeof(double);
+				break;
+			case 'p':
+				(void)va_arg(ap, void *);
+				len += sizeof(guint64);
+				break;
+			case 's': {
+				const char *str = va_arg(ap, const char *);
+				len += sizeof(guint32) + (str ? strlen(str) : 0);
+				break;
+			}
+			default:
+				break;
+		}
+		sig++;
+	}
+	return len;
+}
+
+/* Serialize the arguments of a log call (strings are copied inline,
+ * since they may not be around anymore by the time we render them) */
+static void janus_log_binary_args_serialize(char *p, const char *sig, va_list ap) {
+	while(*sig) {
+		switch(*sig) {
+			case 'i': {
+				gint32 v = (gint32)va_arg(ap, int);
+				JANUS_LOG_BINARY_APPEND(p, v);
+				break;
+			}
+			case 'l': {
+				gint64 v = (gint64)va_arg(ap, long);
+				JANUS_LOG_BINARY_APPEND(p, v);
+				break;
+			}
+			case 'q': {
+				gint64 v = (gint64)va_arg(ap, long long);
+				JANUS_LOG_BINARY_APPEND(p, v);
+				break;
+			}
+			case 'z': {
+				guint64 v = (guint64)va_arg(ap, size_t);
+				JANUS_LOG_BINARY_APPEND(p, v);
+				break;
+			}
+			case 'd': {
+				double v = va_arg(ap, double);
+				JANUS_LOG_BINARY_APPEND(p, v);
+				break;
+			}
+			case 'p': {
+				guint64 v = (guint64)(gsize)va_arg(ap, void *);
+				JANUS_LOG_BINARY_APPEND(p, v);
+				break;
+			}
+			case 's': {
+				const char *str = va_arg(ap, const char *);
+				guint32 len = str ? (guint32)strlen(str) : G_MAXUINT32;
+				JANUS_LOG_BINARY_APPEND(p, len);
+				if(str && len > 0) {
+					memcpy(p, str, len);
+					p += len;
+				}
+				break;
+			}
+			default:
+				break;
+		}
+		sig++;
+	}
+}
+
+void janus_log_binary_record(volatile gint *id, int level,
+		const char *file, const char *function, int line, const char *format, ...) {
+	if(g_atomic_int_get(&stopping))
+		return;
+	if(janus_log_queue == NULL) {
+		janus_log_queue = janus_lfq_new(JANUS_LOG_QUEUE_SIZE);
+		janus_log_pool = janus_lfq_new(JANUS_LOG_POOL_SIZE);
+	}
+	gint fmtid = g_atomic_int_get(id);
+	if(fmtid == 0)
+		fmtid = janus_log_binary_register(id, file, function, line, format);
+	janus_log_buffer *b = janus_lfq_try_pop(janus_log_pool);
+	if(b == NULL)
+		b = g_malloc(sizeof(janus_log_buffer));
+	b->timestamp = janus_get_real_time();
+	gint64 ts = b->timestamp;
+	guint64 thread = (guint64)(gsize)g_thread_self();
+	guint8 lvl = (guint8)level;
+	char *p = NULL;
+	va_list ap;
+	if(fmtid < 0) {
+		/* This format string has directives we can't serialize: format
+		 * the text here and wrap it in a preformatted record instead */
+		char src[128] = "", text[1024];
+		if(level == LOG_FATAL || level == LOG_ERR || level == LOG_DBG) {
+			g_snprintf(src, sizeof(src), "[%s:%s:%d] ", file, function, line);
+		}
+		va_start(ap, format);
+		int textlen = g_vsnprintf(text, sizeof(text), format, ap);
+		va_end(ap);
+		if(textlen < 0) {
+			b->str = NULL;
+			janus_log_buffer_release(b);
+			return;
+		}
+		char *msg = text;
+		if((size_t)textlen >= sizeof(text)) {
+			/* The line didn't fit in the preallocated buffer: format it again on the heap */
+			msg = g_malloc(textlen+1);
+			va_start(ap, format);
+			g_vsnprintf(msg, textlen+1, format, ap);
+			va_end(ap);
+		}
+		guint32 payload = (guint32)(strlen(src) + textlen);
+		gsize len = 1 + sizeof(guint8) + sizeof(gint64) + sizeof(guint64) + sizeof(guint32) + payload;
+		b->str = (len <= sizeof(b->buf)) ? b->buf : g_malloc(len);
+		p = b->str;
+		*p++ = 'T';
+		JANUS_LOG_BINARY_APPEND(p, lvl);
+		JANUS_LOG_BINARY_APPEND(p, ts);
+		JANUS_LOG_BINARY_APPEND(p, thread);
+		JANUS_LOG_BINARY_APPEND(p, payload);
+		memcpy(p, src, strlen(src));
+		p += strlen(src);
+		memcpy(p, msg, textlen);
+		if(msg != text)
+			g_free(msg);
+		b->binlen = len;
+	} else {
+		/* Serialize the raw arguments, per the signature of this format
+		 * string: no formatting happens at all on this path */
+		janus_log_binary_fmt *f = janus_log_binary_fmts[fmtid-1];
+		va_list ap2;
+		va_start(ap, format);
+		va_copy(ap2, ap);
+		gsize arglen = janus_log_binary_args_size(f->sig, ap);
+		va_end(ap);
+		gsize len = 1 + sizeof(guint32) + sizeof(guint8) +
+			sizeof(gint64) + sizeof(guint64) + sizeof(guint32) + arglen;
+		b->str = (len <= sizeof(b->buf)) ? b->buf : g_malloc(len);
+		p = b->str;
+		*p++ = 'L';
+		guint32 rid = (guint32)fmtid;
+		JANUS_LOG_BINARY_APPEND(p, rid);
+		JANUS_LOG_BINARY_APPEND(p, lvl);
+		JANUS_LOG_BINARY_APPEND(p, ts);
+		JANUS_LOG_BINARY_APPEND(p, thread);
+		guint32 al = (guint32)arglen;
+		JANUS_LOG_BINARY_APPEND(p, al);
+		janus_log_binary_args_serialize(p, f->sig, ap2);
+		va_end(ap2);
+		b->binlen = len;
+	}
+	/* Queue the new record: as with text lines, if the ring is full we
+	 * drop it and keep count rather than block */
+	if(!janus_lfq_try_push(janus_log_queue, b)) {
+		g_atomic_int_inc(&janus_log_dropped);
+		janus_log_buffer_release(b);
+	}
 }
 
 int janus_log_init(gboolean daemon, gboolean console, const char *logfile, GHashTable *loggers) {
@@ -176,9 +722,21 @@ int janus_log_init(gboolean daemon, gboolean console, const char *logfile, GHash
 		}
 		janus_log_filepath = g_strdup(logfile);
 	}
+	if(janus_binlog_filepath != NULL) {
+		/* Open the binary log for writing (and append), and start a
+		 * logging session there: from now on, JANUS_LOG serializes
+		 * records instead of formatting text */
+		janus_binlog_file = fopen(janus_binlog_filepath, "ab");
+		if(janus_binlog_file == NULL) {
+			JANUS_PRINT("Error opening binary log file %s: %s\n", janus_binlog_filepath, g_strerror(errno));
+			goto error;
+		}
+		janus_log_binary_write_session();
+		janus_log_binary = TRUE;
+	}
 	if(external_loggers != NULL)
 		JANUS_PRINT("Adding %d external loggers\n", g_hash_table_size(external_loggers));
-	if(!janus_log_console && logfile == NULL && external_loggers == NULL) {
+	if(!janus_log_console && logfile == NULL && janus_binlog_filepath == NULL && external_loggers == NULL) {
 		JANUS_PRINT("WARNING: logging completely disabled!\n");
 		JANUS_PRINT("         (no stdout, no logfile and no external loggers, this may not be what you want...)\n");
 	}
@@ -197,8 +755,10 @@ int janus_log_init(gboolean daemon, gboolean console, const char *logfile, GHash
 			goto error;
 		}
 	}
-	if(janus_log_queue == NULL)
-		janus_log_queue = g_async_queue_new_full((GDestroyNotify)janus_log_buffer_free);
+	if(janus_log_queue == NULL) {
+		janus_log_queue = janus_lfq_new(JANUS_LOG_QUEUE_SIZE);
+		janus_log_pool = janus_lfq_new(JANUS_LOG_POOL_SIZE);
+	}
 	log_thread = g_thread_new(THREAD_NAME, &janus_log_thread, NULL);
 	return 0;
 
@@ -208,26 +768,53 @@ error:
 	return -1;
 }
 
+int janus_log_set_binary_file(const char *binlogfile) {
+	if(binlogfile == NULL)
+		return -1;
+	if(g_atomic_int_get(&initialized)) {
+		/* Too late, the logger is already running */
+		return -1;
+	}
+	g_free(janus_binlog_filepath);
+	janus_binlog_filepath = g_strdup(binlogfile);
+	return 0;
+}
+
 void janus_log_reload(void) {
-	if(janus_log_file == NULL || log_thread == NULL)
+	if((janus_log_file == NULL && janus_binlog_file == NULL) || log_thread == NULL)
 		return;
-	g_async_queue_push(janus_log_queue, &reload_message);
+	janus_lfq_push_front(janus_log_queue, &reload_message);
 }
 
 void janus_log_destroy(void) {
 	g_atomic_int_set(&stopping, 1);
 	if(log_thread != NULL) {
-		g_async_queue_push(janus_log_queue, &exit_message);
+		janus_lfq_push_front(janus_log_queue, &exit_message);
 		g_thread_join(log_thread);
 	} else if(!g_atomic_int_get(&initialized)) {
 		/* Never initialized Print what was in the buffer to stdout */
 		janus_log_buffer *b = NULL;
-		while((b = g_async_queue_try_pop(janus_log_queue)) != NULL) {
-			if(b->str != NULL)
+		while((b = janus_lfq_try_pop(janus_log_queue)) != NULL) {
+			if(b != &exit_message && b != &reload_message && b->str != NULL)
 				janus_log_print_buffer(b);
-			janus_log_buffer_free(b);
+			janus_log_buffer_release(b);
 		}
+		janus_log_flush();
 	}
-	g_async_queue_unref(janus_log_queue);
+	/* Get rid of the registered format strings, if any */
+	janus_log_binary = FALSE;
+	gint i = 0;
+	for(i=0; i<janus_log_binary_fmts_num; i++) {
+		g_free(janus_log_binary_fmts[i]);
+		janus_log_binary_fmts[i] = NULL;
+	}
+	janus_log_binary_fmts_num = 0;
+	/* Get rid of the pooled buffers and the queues themselves */
+	janus_log_buffer *b = NULL;
+	while((b = janus_lfq_try_pop(janus_log_pool)) != NULL)
+		g_free(b);
+	janus_lfq_destroy(janus_log_pool);
+	janus_log_pool = NULL;
+	janus_lfq_destroy(janus_log_queue);
 	janus_log_queue = NULL;
 }
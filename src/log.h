@@ -24,6 +24,25 @@
 * \note This output is buffered and may not appear immediately on stdout. */
 void janus_vprintf(const char *format, ...) G_GNUC_PRINTF(1, 2);
 
+/*! \brief Log a binary record, without formatting any text
+ * \details This is what JANUS_LOG expands to when binary logging is
+ * enabled: rather than rendering the line via vsnprintf, the raw
+ * arguments are serialized to a compact record referencing the format
+ * string by ID, and text is only rendered offline (or at the tail) by
+ * the bundled \c janus-logcat tool. The first time a call site is hit
+ * its format string is registered and assigned an ID, which is cached
+ * in a per-call-site static the macro provides.
+ * @param[in] id Pointer to the per-call-site format ID cache
+ * @param[in] level The log level of this line
+ * @param[in] file The source file the line comes from
+ * @param[in] function The function the line comes from
+ * @param[in] line The source line number
+ * @param[in] format Format string (must be a string literal), followed
+ * by the optional parameters to serialize (printf style) */
+void janus_log_binary_record(volatile gint *id, int level,
+	const char *file, const char *function, int line,
+	const char *format, ...) G_GNUC_PRINTF(6, 7);
+
 /*! \brief Log initialization
 * \note This should be called before attempting to use the logger. A buffer
 * pool and processing thread are created.
@@ -33,6 +52,15 @@ void janus_vprintf(const char *format, ...) G_GNUC_PRINTF(1, 2);
 * @param loggers Hash table of external loggers registered in the core, if any
 * @returns 0 in case of success, a negative integer otherwise */
 int janus_log_init(gboolean daemon, gboolean console, const char *logfile, GHashTable *loggers);
+/*! \brief Enable binary logging to the specified file
+ * \note This must be called before janus_log_init: once the logger is
+ * initialized, log lines are written to the binary log as compact
+ * records instead of being formatted to text, which makes logging
+ * cheap enough to keep high verbosity levels on in production. Use
+ * \c janus-logcat to render the records back to text.
+ * @param binlogfile Binary log file to write the records to
+ * @returns 0 in case of success, a negative integer otherwise */
+int janus_log_set_binary_file(const char *binlogfile);
 /*! \brief Reopen log file (log rotation) */
 void janus_log_reload(void);
 /*! \brief Log destruction */
@@ -13,11 +13,13 @@
  */
 
 #include <errno.h>
+#include <sys/uio.h>
 
 #include "logger.h"
 
 #include "../debug.h"
 #include "../config.h"
+#include "../mutex.h"
 #include "../utils.h"
 
 
@@ -96,6 +98,18 @@ static void janus_jsonlog_line_free(janus_jsonlog_line *jline) {
 static FILE *logfile = NULL;
 static char *logfilename = NULL;
 
+/* Rather than one fwrite+fflush per line, lines are batched and written
+ * out with a single writev: a batch is bounded both in lines and bytes */
+#define JANUS_JSONLOG_BATCH			64
+#define JANUS_JSONLOG_BATCH_BYTES	(256*1024)
+/* To keep memory bounded when the disk can't keep up, lines queued
+ * beyond this limit are dropped (and counted); 0 means no limit */
+static int max_queued = 8192;
+/* Backpressure counters, queryable via the Admin API */
+static volatile gint dropped_lines = 0;
+static guint64 written_lines = 0, written_bytes = 0, flushes = 0;
+static janus_mutex stats_mutex = JANUS_MUTEX_INITIALIZER;
+
 
 /* Parameter validation (for querying or tweaking via Admin API) */
 static struct janus_json_parameter request_parameters[] = {
@@ -172,6 +186,16 @@ int janus_jsonlog_init(const char *server_name, const char *config_path) {
 					json_format = JSON_INDENT(3) | JSON_PRESERVE_ORDER;
 				}
 			}
+			/* Check if we should cap the backlog of queued lines */
+			item = janus_config_get(config, config_general, janus_config_type_item, "max_queued");
+			if(item && item->value) {
+				int mq = atoi(item->value);
+				if(mq < 0) {
+					JANUS_LOG(LOG_WARN, "Invalid negative value for 'max_queued', using default (%d)\n", max_queued);
+				} else {
+					max_queued = mq;
+				}
+			}
 			/* Done */
 			enabled = (logfile != NULL);
 		}
@@ -270,6 +294,11 @@ void janus_jsonlog_incoming_logline(int64_t timestamp, const char *line) {
 	 * it in our own thread: we have a monotonic time indicator of when the
 	 * log line was actually added on this machine, so that, if relevant, we can
 	 * compute any delay in the actual log line processing ourselves. */
+	if(max_queued > 0 && g_async_queue_length(loglines) >= max_queued) {
+		/* Too much backlog, drop the line and keep count */
+		g_atomic_int_inc(&dropped_lines);
+		return;
+	}
 	janus_jsonlog_line *l = g_malloc(sizeof(janus_jsonlog_line));
 	l->timestamp = timestamp;
 	l->line = g_strdup(line);
@@ -293,8 +322,16 @@ json_t *janus_jsonlog_handle_request(json_t *request) {
 	/* Get the request */
 	const char *request_text = json_string_value(json_object_get(request, "request"));
 	if(!strcasecmp(request_text, "info")) {
-		/* We only support a request to get some info from the plugin */
+		/* We only support a request to get some info from the plugin,
+		 * including how the logger is keeping up with the log volume */
 		json_object_set_new(response, "result", json_integer(200));
+		json_object_set_new(response, "queued", json_integer(loglines ? g_async_queue_length(loglines) : 0));
+		janus_mutex_lock(&stats_mutex);
+		json_object_set_new(response, "written_lines", json_integer(written_lines));
+		json_object_set_new(response, "written_bytes", json_integer(written_bytes));
+		json_object_set_new(response, "flushes", json_integer(flushes));
+		janus_mutex_unlock(&stats_mutex);
+		json_object_set_new(response, "dropped_lines", json_integer(g_atomic_int_get(&dropped_lines)));
 	} else {
 		JANUS_LOG(LOG_VERB, "Unknown request '%s'\n", request_text);
 		error_code = JANUS_JSONLOG_ERROR_INVALID_REQUEST;
@@ -319,37 +356,80 @@ static void *janus_jsonlog_thread(void *data) {
 	janus_jsonlog_line *jline = NULL;
 	json_t *json = NULL;
 	char *json_text = NULL;
-	size_t json_len = 0, offset = 0, written = 0;
+	char *texts[JANUS_JSONLOG_BATCH];
+	struct iovec iovs[2*JANUS_JSONLOG_BATCH];
+	int count = 0, i = 0;
+	size_t batch_bytes = 0;
+	gboolean exiting = FALSE;
 
-	while(g_atomic_int_get(&initialized) && !g_atomic_int_get(&stopping)) {
+	while(!exiting && g_atomic_int_get(&initialized) && !g_atomic_int_get(&stopping)) {
 		/* Get a log line from the queue */
 		jline = g_async_queue_pop(loglines);
-		if(jline == &exit_line)
-			break;
-
-		/* Create a new JSON object with its contents */
-		json = json_object();
-		json_object_set_new(json, "timestamp", json_integer(jline->timestamp));
-		if(jline->line != NULL)
-			json_object_set_new(json, "line", json_string(jline->line));
-		janus_jsonlog_line_free(jline);
-
-		/* Convert the JSON object to string */
-		json_text = json_dumps(json, json_format);
-		json_decref(json);
-
-		/* Save it to file */
-		json_len = strlen(json_text);
-		offset = 0;
-		while(json_len > 0) {
-			written = fwrite(json_text + offset, sizeof(char), json_len, logfile);
-			json_len -= written;
-			offset += written;
+		count = 0;
+		batch_bytes = 0;
+		while(jline != NULL) {
+			if(jline == &exit_line) {
+				exiting = TRUE;
+				break;
+			}
+
+			/* Create a new JSON object with its contents */
+			json = json_object();
+			json_object_set_new(json, "timestamp", json_integer(jline->timestamp));
+			if(jline->line != NULL)
+				json_object_set_new(json, "line", json_string(jline->line));
+			janus_jsonlog_line_free(jline);
+
+			/* Convert the JSON object to string, and add it to the batch */
+			json_text = json_dumps(json, json_format);
+			json_decref(json);
+			if(json_text != NULL) {
+				texts[count] = json_text;
+				iovs[2*count].iov_base = json_text;
+				iovs[2*count].iov_len = strlen(json_text);
+				iovs[2*count+1].iov_base = (char *)"\n";
+				iovs[2*count+1].iov_len = 1;
+				batch_bytes += iovs[2*count].iov_len + 1;
+				count++;
+			}
+			/* Keep batching until we have enough lines or bytes, or the queue is empty */
+			if(count == JANUS_JSONLOG_BATCH || batch_bytes >= JANUS_JSONLOG_BATCH_BYTES)
+				break;
+			jline = g_async_queue_try_pop(loglines);
 		}
-		const char *lf = "\n";
-		fwrite(lf, sizeof(char), strlen(lf), logfile);
-		fflush(logfile);
-		free(json_text);
+		if(count == 0)
+			continue;
+		/* Save the whole batch to file with a single writev */
+		int fd = fileno(logfile);
+		struct iovec *iov = iovs;
+		int pending = 2*count;
+		while(pending > 0) {
+			ssize_t res = writev(fd, iov, pending);
+			if(res < 0) {
+				if(errno == EINTR)
+					continue;
+				JANUS_LOG(LOG_ERR, "Error writing to the JSON log file... %d (%s)\n", errno, g_strerror(errno));
+				break;
+			}
+			/* Skip the iovecs we fully wrote, and adjust the partial one, if any */
+			size_t wrote = (size_t)res;
+			while(pending > 0 && wrote >= iov->iov_len) {
+				wrote -= iov->iov_len;
+				iov++;
+				pending--;
+			}
+			if(pending > 0 && wrote > 0) {
+				iov->iov_base = (char *)iov->iov_base + wrote;
+				iov->iov_len -= wrote;
+			}
+		}
+		janus_mutex_lock(&stats_mutex);
+		written_lines += count;
+		written_bytes += batch_bytes;
+		flushes++;
+		janus_mutex_unlock(&stats_mutex);
+		for(i=0; i<count; i++)
+			free(texts[i]);
 	}
 	JANUS_LOG(LOG_VERB, "Leaving JSON logger thread\n");
 	return NULL;
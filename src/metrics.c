@@ -0,0 +1,158 @@
+/*! \file    metrics.c
+ * \author   Lorenzo Miniero <lorenzo@meetecho.com>
+ * \copyright GNU General Public License v3
+ * \brief    Lock-free operational metrics
+ * \details  Lightweight counters for operational stats that are cheap
+ * enough to update from the media path. Counters are striped: each
+ * thread writes to its own slot (assigned the first time it updates a
+ * metric), so incrementing a counter never takes a lock and never
+ * bounces a shared cacheline between loops. Totals are only computed
+ * on demand, when a scraper asks for them, by summing the stripes; the
+ * text rendering follows the Prometheus exposition format, so that the
+ * output of janus_metrics_render() can be served as-is by a transport
+ * (see the \c metrics_path option in the HTTP transport).
+ *
+ * \ingroup core
+ * \ref core
+ */
+
+#include <inttypes.h>
+
+#include "metrics.h"
+#include "ice.h"
+
+/* Number of stripes: each thread that updates metrics gets its own, so
+ * this just needs to be larger than the number of threads that touch
+ * the media path (with more threads than stripes, threads start sharing
+ * and a tiny fraction of increments may be lost, which for operational
+ * counters is an acceptable trade-off for staying lock-free) */
+#define JANUS_METRICS_STRIPES	128
+
+static volatile guint64 stripes[JANUS_METRICS_STRIPES][JANUS_METRIC_COUNT];
+static volatile gint next_stripe = 0;
+static GPrivate stripe_key;
+
+/* Names and help lines, in the order of the janus_metric enum */
+static const char *metric_names[JANUS_METRIC_COUNT] = {
+	"janus_rtp_packets_in_total",
+	"janus_rtp_bytes_in_total",
+	"janus_rtp_packets_out_total",
+	"janus_rtp_bytes_out_total",
+	"janus_rtcp_packets_in_total",
+	"janus_rtcp_packets_out_total",
+	"janus_nacks_in_total",
+	"janus_nacks_out_total",
+	"janus_retransmissions_total",
+	"janus_packets_dropped_total",
+	"janus_queue_wait_us_total"
+};
+static const char *metric_help[JANUS_METRIC_COUNT] = {
+	"RTP packets received from peers",
+	"RTP bytes received from peers",
+	"RTP packets sent to peers",
+	"RTP bytes sent to peers",
+	"RTCP packets received from peers",
+	"RTCP packets sent to peers",
+	"NACKs received from peers",
+	"NACKs sent to peers",
+	"Packets retransmitted in response to a NACK",
+	"Outgoing packets dropped (queue over limit, or too old)",
+	"Cumulative time outgoing packets spent queued, in microseconds"
+};
+
+/* Histogram buckets (microseconds): each stripe only counts its own
+ * bucket, the cumulative "le" counters Prometheus expects are computed
+ * at render time; the last slot of each stripe holds the running sum */
+#define JANUS_METRICS_HIST_BUCKETS	6
+static const guint64 hist_bucket_le[JANUS_METRICS_HIST_BUCKETS-1] = {
+	1000, 5000, 20000, 100000, 500000
+};
+static volatile guint64 hist_stripes[JANUS_METRICS_STRIPES][JANUS_METRIC_HIST_COUNT][JANUS_METRICS_HIST_BUCKETS+1];
+static const char *hist_names[JANUS_METRIC_HIST_COUNT] = {
+	"janus_request_wait_fast_us",
+	"janus_request_wait_slow_us"
+};
+static const char *hist_help[JANUS_METRIC_HIST_COUNT] = {
+	"Time API requests spent queued in the fast lane (keepalives, trickles)",
+	"Time API requests spent queued in the slow lane (plugin messages)"
+};
+
+/* Check which stripe this thread writes to: 0 means not assigned
+ * yet, so what we actually store is the stripe index plus one */
+static guint janus_metrics_stripe(void) {
+	gpointer p = g_private_get(&stripe_key);
+	if(p == NULL) {
+		guint stripe = ((guint)g_atomic_int_add(&next_stripe, 1)) % JANUS_METRICS_STRIPES;
+		p = GUINT_TO_POINTER(stripe+1);
+		g_private_set(&stripe_key, p);
+	}
+	return GPOINTER_TO_UINT(p)-1;
+}
+
+void janus_metrics_add(janus_metric metric, guint64 value) {
+	if(metric >= JANUS_METRIC_COUNT)
+		return;
+	/* This is the only thread writing to this slot (barring more
+	 * threads than stripes), so a plain add is all we need */
+	stripes[janus_metrics_stripe()][metric] += value;
+}
+
+void janus_metrics_observe(janus_metric_histogram histogram, guint64 value) {
+	if(histogram >= JANUS_METRIC_HIST_COUNT)
+		return;
+	guint stripe = janus_metrics_stripe();
+	int b = 0;
+	while(b < JANUS_METRICS_HIST_BUCKETS-1 && value > hist_bucket_le[b])
+		b++;
+	hist_stripes[stripe][histogram][b]++;
+	hist_stripes[stripe][histogram][JANUS_METRICS_HIST_BUCKETS] += value;
+}
+
+guint64 janus_metrics_get(janus_metric metric) {
+	if(metric >= JANUS_METRIC_COUNT)
+		return 0;
+	guint64 total = 0;
+	int i = 0;
+	for(i=0; i<JANUS_METRICS_STRIPES; i++)
+		total += stripes[i][metric];
+	return total;
+}
+
+char *janus_metrics_render(void) {
+	GString *text = g_string_sized_new(2048);
+	int m = 0;
+	for(m=0; m<JANUS_METRIC_COUNT; m++) {
+		g_string_append_printf(text, "# HELP %s %s\n", metric_names[m], metric_help[m]);
+		g_string_append_printf(text, "# TYPE %s counter\n", metric_names[m]);
+		g_string_append_printf(text, "%s %"SCNu64"\n", metric_names[m], janus_metrics_get(m));
+	}
+	/* Histograms too, turning the per-bucket counts into cumulative "le" buckets */
+	int h = 0, b = 0, i = 0;
+	for(h=0; h<JANUS_METRIC_HIST_COUNT; h++) {
+		g_string_append_printf(text, "# HELP %s %s\n", hist_names[h], hist_help[h]);
+		g_string_append_printf(text, "# TYPE %s histogram\n", hist_names[h]);
+		guint64 count = 0, sum = 0;
+		for(b=0; b<JANUS_METRICS_HIST_BUCKETS; b++) {
+			guint64 bucket = 0;
+			for(i=0; i<JANUS_METRICS_STRIPES; i++)
+				bucket += hist_stripes[i][h][b];
+			count += bucket;
+			if(b < JANUS_METRICS_HIST_BUCKETS-1) {
+				g_string_append_printf(text, "%s_bucket{le=\"%"SCNu64"\"} %"SCNu64"\n",
+					hist_names[h], hist_bucket_le[b], count);
+			} else {
+				g_string_append_printf(text, "%s_bucket{le=\"+Inf\"} %"SCNu64"\n",
+					hist_names[h], count);
+			}
+		}
+		for(i=0; i<JANUS_METRICS_STRIPES; i++)
+			sum += hist_stripes[i][h][JANUS_METRICS_HIST_BUCKETS];
+		g_string_append_printf(text, "%s_sum %"SCNu64"\n", hist_names[h], sum);
+		g_string_append_printf(text, "%s_count %"SCNu64"\n", hist_names[h], count);
+	}
+	/* A few gauges on the current state, on top of the counters */
+	g_string_append(text, "# HELP janus_peerconnections Number of active PeerConnections\n");
+	g_string_append(text, "# TYPE janus_peerconnections gauge\n");
+	g_string_append_printf(text, "janus_peerconnections %d\n", janus_ice_get_peerconnection_num());
+	return g_string_free(text, FALSE);
+}
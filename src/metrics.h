@@ -0,0 +1,78 @@
+/*! \file    metrics.h
+ * \author   Lorenzo Miniero <lorenzo@meetecho.com>
+ * \copyright GNU General Public License v3
+ * \brief    Lock-free operational metrics (headers)
+ * \details  Lightweight counters for operational stats that are cheap
+ * enough to update from the media path. Counters are striped: each
+ * thread writes to its own slot (assigned the first time it updates a
+ * metric), so incrementing a counter never takes a lock and never
+ * bounces a shared cacheline between loops. Totals are only computed
+ * on demand, when a scraper asks for them, by summing the stripes; the
+ * text rendering follows the Prometheus exposition format, so that the
+ * output of janus_metrics_render() can be served as-is by a transport
+ * (see the \c metrics_path option in the HTTP transport).
+ *
+ * \ingroup core
+ * \ref core
+ */
+
+#ifndef JANUS_METRICS_H
+#define JANUS_METRICS_H
+
+#include <glib.h>
+
+/*! \brief Metrics we keep track of: all of them are monotonic counters */
+typedef enum janus_metric {
+	/*! \brief RTP packets/bytes received from peers */
+	JANUS_METRIC_RTP_PACKETS_IN = 0,
+	JANUS_METRIC_RTP_BYTES_IN,
+	/*! \brief RTP packets/bytes sent to peers */
+	JANUS_METRIC_RTP_PACKETS_OUT,
+	JANUS_METRIC_RTP_BYTES_OUT,
+	/*! \brief RTCP packets received from/sent to peers */
+	JANUS_METRIC_RTCP_PACKETS_IN,
+	JANUS_METRIC_RTCP_PACKETS_OUT,
+	/*! \brief NACKs we received from peers, and NACKs we sent them */
+	JANUS_METRIC_NACKS_IN,
+	JANUS_METRIC_NACKS_OUT,
+	/*! \brief Packets we retransmitted in response to a NACK */
+	JANUS_METRIC_RETRANSMISSIONS,
+	/*! \brief Outgoing packets dropped (queue over limit, or too old) */
+	JANUS_METRIC_PACKETS_DROPPED,
+	/*! \brief Cumulative time outgoing packets spent queued, in microseconds:
+	 * divided by the packets out counter this gives the average loop lag */
+	JANUS_METRIC_QUEUE_WAIT_US,
+	JANUS_METRIC_COUNT
+} janus_metric;
+
+/*! \brief Histograms we keep track of: all values are in microseconds */
+typedef enum janus_metric_histogram {
+	/*! \brief Time API requests spent queued in the fast lane (keepalives, trickles) */
+	JANUS_METRIC_HIST_REQUEST_WAIT_FAST = 0,
+	/*! \brief Time API requests spent queued in the slow lane (plugin messages) */
+	JANUS_METRIC_HIST_REQUEST_WAIT_SLOW,
+	JANUS_METRIC_HIST_COUNT
+} janus_metric_histogram;
+
+/*! \brief Add a value to one of the metrics (lock-free, meant to be
+ * usable from the media path)
+ * @param metric The metric to update
+ * @param value The value to add */
+void janus_metrics_add(janus_metric metric, guint64 value);
+/*! \brief Shorthand to increment a metric by one */
+#define janus_metrics_inc(metric) janus_metrics_add(metric, 1)
+/*! \brief Record a value in one of the histograms (lock-free, using
+ * the same striping as the counters)
+ * @param histogram The histogram to update
+ * @param value The value to record, in microseconds */
+void janus_metrics_observe(janus_metric_histogram histogram, guint64 value);
+/*! \brief Get the current total of a metric, summing all the stripes
+ * @param metric The metric to query
+ * @returns The current total */
+guint64 janus_metrics_get(janus_metric metric);
+/*! \brief Render all metrics (plus a few gauges, e.g., the number of
+ * sessions and PeerConnections) in the Prometheus text exposition format
+ * @returns A newly allocated string to be freed with g_free() */
+char *janus_metrics_render(void);
+
+#endif
@@ -0,0 +1,131 @@
+/*! \file    mutex.c
+ * \author   Lorenzo Miniero <lorenzo@meetecho.com>
+ * \copyright GNU General Public License v3
+ * \brief    Lock contention profiler
+ * \details  Implementation of the sampling lock contention profiler that
+ * the janus_mutex wrappers feed when it's enabled: sampled acquisitions
+ * are aggregated in a small fixed-size table, keyed by the address of
+ * the mutex, which can then be queried and reset via the Admin API.
+ * Long-lived locks that matter (e.g., session or room tables) can be
+ * given a human-readable name with janus_mutex_profile_register, so
+ * that the table is actually readable: unnamed locks are reported by
+ * their address. Unlike the locking debug, which logs every single
+ * operation, sampling makes this cheap enough for production use.
+ *
+ * \ingroup core
+ * \ref core
+ */
+
+#include <string.h>
+
+#include "mutex.h"
+
+volatile gint lock_profile = 0;
+volatile gint lock_profile_counter = 0;
+
+/* Fixed size of the contention table: with sampling in place the profiler
+ * is meant for the few long-lived locks that matter (session and room
+ * tables, queues), not for every short-lived per-handle mutex */
+#define JANUS_MUTEX_PROFILE_MAX_LOCKS	256
+
+typedef struct janus_mutex_profile_entry {
+	/*! \brief Address of the mutex this entry refers to */
+	void *mutex;
+	/*! \brief Human-readable name (the address, if never registered) */
+	char name[64];
+	/*! \brief Number of sampled acquisitions */
+	guint64 samples;
+	/*! \brief Number of sampled acquisitions that had to wait */
+	guint64 contended;
+	/*! \brief Total and maximum sampled wait, in microseconds */
+	guint64 wait_us, wait_max_us;
+} janus_mutex_profile_entry;
+static janus_mutex_profile_entry lock_profile_table[JANUS_MUTEX_PROFILE_MAX_LOCKS];
+static guint lock_profile_entries = 0;
+static janus_mutex lock_profile_mutex = JANUS_MUTEX_INITIALIZER;
+
+static janus_mutex_profile_entry *janus_mutex_profile_find(void *mutex, gboolean create) {
+	guint i = 0;
+	for(i = 0; i < lock_profile_entries; i++) {
+		if(lock_profile_table[i].mutex == mutex)
+			return &lock_profile_table[i];
+	}
+	if(!create || lock_profile_entries == JANUS_MUTEX_PROFILE_MAX_LOCKS)
+		return NULL;
+	janus_mutex_profile_entry *entry = &lock_profile_table[lock_profile_entries];
+	memset(entry, 0, sizeof(janus_mutex_profile_entry));
+	entry->mutex = mutex;
+	g_snprintf(entry->name, sizeof(entry->name), "%p", mutex);
+	lock_profile_entries++;
+	return entry;
+}
+
+void janus_mutex_profile_sample(void *mutex, gint64 wait_us) {
+	/* Use the raw lock here, we don't want to sample ourselves */
+	janus_mutex_lock_nodebug(&lock_profile_mutex);
+	janus_mutex_profile_entry *entry = janus_mutex_profile_find(mutex, TRUE);
+	if(entry != NULL) {
+		entry->samples++;
+		if(wait_us > 0) {
+			entry->contended++;
+			entry->wait_us += (guint64)wait_us;
+			if((guint64)wait_us > entry->wait_max_us)
+				entry->wait_max_us = (guint64)wait_us;
+		}
+	}
+	janus_mutex_unlock_nodebug(&lock_profile_mutex);
+}
+
+void janus_mutex_profile_register(void *mutex, const char *name) {
+	if(mutex == NULL || name == NULL)
+		return;
+	janus_mutex_lock_nodebug(&lock_profile_mutex);
+	janus_mutex_profile_entry *entry = janus_mutex_profile_find(mutex, TRUE);
+	if(entry != NULL)
+		g_snprintf(entry->name, sizeof(entry->name), "%s", name);
+	janus_mutex_unlock_nodebug(&lock_profile_mutex);
+}
+
+void janus_mutex_profile_unregister(void *mutex) {
+	if(mutex == NULL)
+		return;
+	janus_mutex_lock_nodebug(&lock_profile_mutex);
+	guint i = 0;
+	for(i = 0; i < lock_profile_entries; i++) {
+		if(lock_profile_table[i].mutex == mutex) {
+			/* Move the last entry into the slot we're freeing */
+			lock_profile_entries--;
+			if(i != lock_profile_entries)
+				lock_profile_table[i] = lock_profile_table[lock_profile_entries];
+			break;
+		}
+	}
+	janus_mutex_unlock_nodebug(&lock_profile_mutex);
+}
+
+void janus_mutex_profile_foreach(janus_mutex_profile_iterator iterator, void *user_data) {
+	if(iterator == NULL)
+		return;
+	janus_mutex_lock_nodebug(&lock_profile_mutex);
+	guint i = 0;
+	for(i = 0; i < lock_profile_entries; i++) {
+		janus_mutex_profile_entry *entry = &lock_profile_table[i];
+		iterator(entry->mutex, entry->name, entry->samples, entry->contended,
+			entry->wait_us, entry->wait_max_us, user_data);
+	}
+	janus_mutex_unlock_nodebug(&lock_profile_mutex);
+}
+
+void janus_mutex_profile_reset(void) {
+	/* Zero the counters but keep the entries, so that registered names survive */
+	janus_mutex_lock_nodebug(&lock_profile_mutex);
+	guint i = 0;
+	for(i = 0; i < lock_profile_entries; i++) {
+		janus_mutex_profile_entry *entry = &lock_profile_table[i];
+		entry->samples = 0;
+		entry->contended = 0;
+		entry->wait_us = 0;
+		entry->wait_max_us = 0;
+	}
+	janus_mutex_unlock_nodebug(&lock_profile_mutex);
+}
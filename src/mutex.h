@@ -17,6 +17,52 @@
 
 extern int lock_debug;
 
+/*! \brief Sampling lock contention profiler: when enabled, one lock
+ * acquisition every JANUS_MUTEX_PROFILE_INTERVAL is timed, and the wait
+ * times are aggregated in a small per-lock table that can be queried and
+ * reset via the Admin API. Unlike the locking debug, which logs every
+ * single operation, this is cheap enough to enable in production. */
+extern volatile gint lock_profile;
+/*! \brief Running counter used to decide which acquisitions to sample */
+extern volatile gint lock_profile_counter;
+/*! \brief How often the contention profiler samples lock acquisitions */
+#define JANUS_MUTEX_PROFILE_INTERVAL	256
+/*! \brief Record a sampled acquisition in the contention table (used by the janus_mutex_lock wrapper)
+ * @param mutex Address of the mutex that was acquired
+ * @param wait_us How long the sampled acquisition had to wait, in microseconds (0 if uncontended) */
+void janus_mutex_profile_sample(void *mutex, gint64 wait_us);
+/*! \brief Give a human-readable name to a mutex in the contention table
+ * \note Without a name, a lock is reported by its address: naming is meant
+ * for the few long-lived locks worth tracking (session and room tables and so on)
+ * @param mutex Address of the mutex to name
+ * @param name The name to report for this mutex (copied, at most 63 characters) */
+void janus_mutex_profile_register(void *mutex, const char *name);
+/*! \brief Remove a mutex from the contention table (e.g., before destroying it)
+ * @param mutex Address of the mutex to remove */
+void janus_mutex_profile_unregister(void *mutex);
+/*! \brief Callback for iterating on the contention table via janus_mutex_profile_foreach */
+typedef void (*janus_mutex_profile_iterator)(void *mutex, const char *name,
+	guint64 samples, guint64 contended, guint64 wait_us, guint64 wait_max_us, void *user_data);
+/*! \brief Iterate on the entries of the contention table
+ * @param iterator The callback to invoke for each entry
+ * @param user_data Opaque pointer passed to the callback as is */
+void janus_mutex_profile_foreach(janus_mutex_profile_iterator iterator, void *user_data);
+/*! \brief Reset the counters in the contention table (registered names are kept) */
+void janus_mutex_profile_reset(void);
+/*! \brief Janus mutex lock with contention sampling (one acquisition every
+ * JANUS_MUTEX_PROFILE_INTERVAL is timed and recorded in the contention table) */
+#define janus_mutex_lock_profile(a) { \
+	if((guint)g_atomic_int_add(&lock_profile_counter, 1) % JANUS_MUTEX_PROFILE_INTERVAL != 0) { \
+		janus_mutex_lock_nodebug(a); \
+	} else if(janus_mutex_trylock_fast(a)) { \
+		janus_mutex_profile_sample((void *)(a), 0); \
+	} else { \
+		gint64 jmp_started = g_get_monotonic_time(); \
+		janus_mutex_lock_nodebug(a); \
+		janus_mutex_profile_sample((void *)(a), g_get_monotonic_time() - jmp_started); \
+	} \
+}
+
 #ifdef USE_PTHREAD_MUTEX
 
 /*! \brief Janus mutex implementation */
@@ -31,8 +77,10 @@ typedef pthread_mutex_t janus_mutex;
 #define janus_mutex_lock_nodebug(a) pthread_mutex_lock(a)
 /*! \brief Janus mutex lock with debug (prints the line that locked a mutex) */
 #define janus_mutex_lock_debug(a) { JANUS_PRINT("[%s:%s:%d:lock] %p\n", __FILE__, __FUNCTION__, __LINE__, a); pthread_mutex_lock(a); }
-/*! \brief Janus mutex lock wrapper (selective locking debug) */
-#define janus_mutex_lock(a) { if(!lock_debug) { janus_mutex_lock_nodebug(a); } else { janus_mutex_lock_debug(a); } }
+/*! \brief Janus mutex fast try lock (no debug), evaluating to whether the lock was acquired */
+#define janus_mutex_trylock_fast(a) (pthread_mutex_trylock(a) == 0)
+/*! \brief Janus mutex lock wrapper (selective locking debug and contention sampling) */
+#define janus_mutex_lock(a) { if(lock_debug) { janus_mutex_lock_debug(a); } else if(lock_profile) { janus_mutex_lock_profile(a); } else { janus_mutex_lock_nodebug(a); } }
 /*! \brief Janus mutex try lock without debug */
 #define janus_mutex_trylock_nodebug(a) { ret = !pthread_mutex_trylock(a); }
 /*! \brief Janus mutex try lock with debug (prints the line that tried to lock a mutex) */
@@ -81,8 +129,10 @@ typedef GMutex janus_mutex;
 #define janus_mutex_lock_nodebug(a) g_mutex_lock(a)
 /*! \brief Janus mutex lock with debug (prints the line that locked a mutex) */
 #define janus_mutex_lock_debug(a) { JANUS_PRINT("[%s:%s:%d:lock] %p\n", __FILE__, __FUNCTION__, __LINE__, a); g_mutex_lock(a); }
-/*! \brief Janus mutex lock wrapper (selective locking debug) */
-#define janus_mutex_lock(a) { if(!lock_debug) { janus_mutex_lock_nodebug(a); } else { janus_mutex_lock_debug(a); } }
+/*! \brief Janus mutex fast try lock (no debug), evaluating to whether the lock was acquired */
+#define janus_mutex_trylock_fast(a) g_mutex_trylock(a)
+/*! \brief Janus mutex lock wrapper (selective locking debug and contention sampling) */
+#define janus_mutex_lock(a) { if(lock_debug) { janus_mutex_lock_debug(a); } else if(lock_profile) { janus_mutex_lock_profile(a); } else { janus_mutex_lock_nodebug(a); } }
 /*! \brief Janus mutex try lock without debug */
 #define janus_mutex_trylock_nodebug(a) { ret = g_mutex_trylock(a); }
 /*! \brief Janus mutex try lock with debug (prints the line that tried to lock a mutex) */
@@ -113,4 +163,44 @@ typedef GCond janus_condition;
 
 #endif
 
+/*! \brief Hint to the CPU that we're in a spin-wait loop */
+#if defined(__x86_64__) || defined(__i386__)
+#define janus_mutex_cpu_relax() __builtin_ia32_pause()
+#elif defined(__aarch64__) || defined(__arm__)
+#define janus_mutex_cpu_relax() __asm__ __volatile__("yield")
+#else
+#define janus_mutex_cpu_relax() ((void)0)
+#endif
+/*! \brief How many times we retry a contended lock before parking */
+#define JANUS_MUTEX_SPIN_LIMIT	128
+/*! \brief Janus mutex lock with bounded spinning before parking: media-path
+ * critical sections (queue pushes and pops, subscriber list walks) are held
+ * for tens of nanoseconds, so when one is contended the owner is almost
+ * always about to release it, and the futex park/unpark round trip of a
+ * regular lock costs far more than just waiting it out. This retries the
+ * lock a bounded number of times (with a CPU relax hint in between) before
+ * falling back to the regular blocking lock, and should only be used on
+ * locks we know are short-hold: spinning on a lock that's held for long just
+ * burns CPU. Use the contention profiler to verify where it actually pays
+ * off; when the locking debug or the profiler are enabled, this degrades to
+ * the regular wrapper, so that every acquisition is still logged/sampled */
+#define janus_mutex_lock_spin(a) { \
+	if(lock_debug || lock_profile) { \
+		janus_mutex_lock(a); \
+	} else if(!janus_mutex_trylock_fast(a)) { \
+		int jms_spins = 0; \
+		gboolean jms_acquired = FALSE; \
+		while(jms_spins++ < JANUS_MUTEX_SPIN_LIMIT) { \
+			janus_mutex_cpu_relax(); \
+			if(janus_mutex_trylock_fast(a)) { \
+				jms_acquired = TRUE; \
+				break; \
+			} \
+		} \
+		if(!jms_acquired) { \
+			janus_mutex_lock_nodebug(a); \
+		} \
+	} \
+}
+
 #endif
@@ -469,7 +469,8 @@ room-<unique room ID>: {
 			"sampling_rate" : <sampling rate of the mixer>,
 			"spatial_audio" : <true|false, whether the mix has spatial audio (stereo)>,
 			"record" : <true|false, whether the room is being recorded>,
-			"num_participants" : <count of the participants>
+			"num_participants" : <count of the participants>,
+			"mixer_latency" : <object with a histogram of the mixer tick latencies, to monitor starvation>
 		},
 		// Other rooms
 	]
@@ -499,7 +500,8 @@ room-<unique room ID>: {
 			"sampling_rate" : <sampling rate of the mixer>,
 			"spatial_audio" : <true|false, whether the mix has spatial audio (stereo)>,
 			"record" : <true|false, whether the room is being recorded>,
-			"num_participants" : <count of the participants>
+			"num_participants" : <count of the participants>,
+			"mixer_latency" : <object with a histogram of the mixer tick latencies, to monitor starvation>
 		},
 		// Other rooms
 	]
@@ -1225,6 +1227,9 @@ room-<unique room ID>: {
 #include <sys/socket.h>
 #include <netdb.h>
 #include <sys/time.h>
+#ifdef __linux__
+#include <sys/timerfd.h>
+#endif
 #include <poll.h>
 
 #include "../debug.h"
@@ -1490,9 +1495,14 @@ static GThread *handler_thread;
 static void *janus_audiobridge_handler(void *data);
 static void janus_audiobridge_relay_rtp_packet(gpointer data, gpointer user_data);
 static void *janus_audiobridge_mixer_thread(void *data);
-static void *janus_audiobridge_participant_thread(void *data);
+static void janus_audiobridge_mixer_setup(void);
+static void janus_audiobridge_participant_pool_process(gpointer data, gpointer user_data);
 static void janus_audiobridge_hangup_media_internal(janus_plugin_session *handle);
 
+/* Thread pool to decode participant audio and encode the outgoing mixes in
+ * parallel: participants are scheduled by the mixer thread at every tick */
+static GThreadPool *participant_pool = NULL;
+
 /* Extension to add while recording (e.g., "tmp" --> ".wav.tmp") */
 static char *rec_tempext = NULL;
 
@@ -1552,6 +1562,8 @@ typedef struct janus_audiobridge_room {
 	gboolean muted;				/* Whether the room is globally muted (except for admins and played files) */
 	GHashTable *allowed;		/* Map of participants (as tokens) allowed to join */
 	GThread *thread;			/* Mixer thread for this room */
+	volatile gint mixer_latency[4];	/* Histogram of mixer tick latencies (<5ms, <20ms, <80ms, more), to monitor starvation */
+	volatile gint mixer_resyncs;	/* Number of times the mixer fell so far behind that we dropped the backlog */
 	volatile gint destroyed;	/* Whether this room has been destroyed */
 	janus_mutex mutex;			/* Mutex to lock this room instance */
 	/* RTP forwarders for this room's mix */
@@ -1735,6 +1747,32 @@ static void janus_audiobridge_file_free(janus_audiobridge_file *ctx) {
 }
 #endif
 
+/* Relay loops: rather than spawning a dedicated thread per plain RTP
+ * participant, media for all of them is relayed by a small set of event
+ * loops, each serving many participants at the same time (the same
+ * consolidation the SIP and NoSIP plugins do for calls); a participant
+ * is assigned to the least busy loop when their media starts, and their
+ * RTP socket is monitored there via a custom GSource. By default we
+ * spawn one loop per CPU core (capped), but the number can be changed
+ * via the 'relay_loops' property in the config */
+#define JANUS_AUDIOBRIDGE_MAX_RELAY_LOOPS	16
+typedef struct janus_audiobridge_relay_loop {
+	int id;						/* Loop index */
+	GMainContext *mainctx;		/* Loop context */
+	GMainLoop *mainloop;		/* The loop itself */
+	GThread *thread;			/* Thread running the loop */
+	volatile gint participants;	/* Number of participants currently assigned to this loop */
+} janus_audiobridge_relay_loop;
+static janus_audiobridge_relay_loop *relay_loops = NULL;
+static int num_relay_loops = 0;
+static void *janus_audiobridge_relay_loop_thread(void *data) {
+	janus_audiobridge_relay_loop *loop = (janus_audiobridge_relay_loop *)data;
+	JANUS_LOG(LOG_VERB, "[loop#%d] Joining AudioBridge relay loop thread\n", loop->id);
+	g_main_loop_run(loop->mainloop);
+	JANUS_LOG(LOG_VERB, "[loop#%d] Leaving AudioBridge relay loop thread\n", loop->id);
+	return NULL;
+}
+
 /* In case we need to support plain RTP participants, this struct helps with that */
 typedef struct janus_audiobridge_plainrtp_media {
 	char *remote_audio_ip;
@@ -1745,13 +1783,13 @@ typedef struct janus_audiobridge_plainrtp_media {
 	int audio_pt;
 	gboolean audio_send;
 	janus_rtp_switching_context context;
-	int pipefd[2];
-	GThread *thread;
+	janus_audiobridge_relay_loop *relay_loop;
+	GSource *source;
+	int pollerrs;
 	volatile int initialized;
 } janus_audiobridge_plainrtp_media;
 static void janus_audiobridge_plainrtp_media_cleanup(janus_audiobridge_plainrtp_media *media);
 static int janus_audiobridge_plainrtp_allocate_port(janus_audiobridge_plainrtp_media *media);
-static void *janus_audiobridge_plainrtp_relay_thread(void *data);
 
 /* AudioBridge participant */
 typedef struct janus_audiobridge_participant {
@@ -1785,14 +1823,16 @@ typedef struct janus_audiobridge_participant {
 	/* RTP stuff */
 	JitterBuffer *jitter;	/* Jitter buffer of incoming audio packets */
 	gint64 jitter_next_check;	/* Timestamp to perform next jitter buffer size check */
-	GList *inbuf;			/* Decoded audio from this participant, to feed to the mixer */
+	struct janus_audiobridge_rtp_relay_packet *inbuf;	/* Preallocated ring of decoded frames from this participant, to feed to the mixer */
+	opus_int16 *inbuf_data;	/* Preallocated PCM storage backing the ring slots */
+	int inbuf_head;			/* Index of the oldest queued frame in the ring */
+	volatile gint inbuf_count;	/* Number of queued frames in the ring */
 	GAsyncQueue *outbuf;	/* Mixed audio to send to this participant */
 	janus_mutex qmutex;		/* Incoming queue mutex */
 	int opus_pt;			/* Opus payload type */
 	int extmap_id;			/* Audio level RTP extension id, if any */
 	int dBov_level;			/* Value in dBov of the audio level (last value from extension) */
-	int audio_active_packets;	/* Participant's number of audio packets to accumulate */
-	int audio_dBov_sum;	    /* Participant's accumulated dBov value for audio level */
+	janus_audiolevel_context audiolevel_ctx;	/* Talk detection context (smoothed audio level) */
 	int user_audio_active_packets; /* Participant's number of audio packets to evaluate */
 	int user_audio_level_average;	 /* Participant's average level of dBov value */
 	gboolean talking;		/* Whether this participant is currently talking (uses audio levels extension) */
@@ -1811,7 +1851,13 @@ typedef struct janus_audiobridge_participant {
 	uint32_t last_timestamp;	/* Last in seq timestamp */
 	uint16_t last_seq; 		/* Last sequence number */
 	gboolean reset;				/* Whether or not the Opus context must be reset, without re-joining the room */
-	GThread *thread;			/* Encoding thread for this participant */
+	volatile gint processing;	/* Whether a codec pool worker is currently serving this participant */
+	gint64 clock_before;		/* Reference time for the decoding clock */
+	int jitter_ticks;			/* Number of jitter buffer ticks since the last delay update */
+	int lost_packets_gap;		/* Consecutive lost packets, for PLC purposes */
+	gboolean decoded_first;		/* Whether we already decoded at least a packet from this participant */
+	gboolean fade_in;			/* Whether the next audible frame should be faded in, after a silence gap */
+	struct janus_audiobridge_rtp_relay_packet *outpkt;	/* Scratch packet for encoding the outgoing mix */
 	gboolean mjr_active;		/* Whether this participant has to be recorded to an mjr file or not */
 	gchar *mjr_base;			/* Base name for the mjr recording (e.g., /path/to/filename, will generate /path/to/filename-audio.mjr) */
 	janus_recorder *arc;		/* The Janus recorder instance for this user's audio, if enabled */
@@ -1827,6 +1873,7 @@ typedef struct janus_audiobridge_participant {
 	volatile gint destroyed;	/* Whether this participant has been destroyed */
 	janus_refcount ref;			/* Reference counter for this participant */
 } janus_audiobridge_participant;
+static int janus_audiobridge_plainrtp_attach(janus_audiobridge_participant *participant);
 
 typedef struct janus_audiobridge_rtp_relay_packet {
 	janus_rtp_header *data;
@@ -1835,6 +1882,7 @@ typedef struct janus_audiobridge_rtp_relay_packet {
 	uint32_t timestamp;
 	uint16_t seq_number;
 	gboolean silence;
+	gboolean encoded;	/* Whether this is a shared pre-encoded mix, rather than raw PCM */
 } janus_audiobridge_rtp_relay_packet;
 
 /* Buffered audio/video packet */
@@ -1869,18 +1917,9 @@ static void janus_audiobridge_participant_clear_jitter_buffer(janus_audiobridge_
 }
 
 static void janus_audiobridge_participant_clear_inbuf(janus_audiobridge_participant *participant) {
-	while(participant->inbuf) {
-		GList *first = g_list_first(participant->inbuf);
-		janus_audiobridge_rtp_relay_packet *pkt = (janus_audiobridge_rtp_relay_packet *)first->data;
-		participant->inbuf = g_list_delete_link(participant->inbuf, first);
-		first = NULL;
-		if(pkt == NULL)
-			continue;
-		g_free(pkt->data);
-		pkt->data = NULL;
-		g_free(pkt);
-		pkt = NULL;
-	}
+	/* Frames are queued in a preallocated ring, so just reset the indexes */
+	participant->inbuf_head = 0;
+	g_atomic_int_set(&participant->inbuf_count, 0);
 }
 
 static void janus_audiobridge_participant_clear_outbuf(janus_audiobridge_participant *participant) {
@@ -1910,6 +1949,10 @@ static void janus_audiobridge_participant_unref(janus_audiobridge_participant *p
 static void janus_audiobridge_participant_free(const janus_refcount *participant_ref) {
 	janus_audiobridge_participant *participant = janus_refcount_containerof(participant_ref, janus_audiobridge_participant, ref);
 	/* This participant can be destroyed, free all the resources */
+	if(string_ids && participant->annc == NULL) {
+		/* Announcements never intern their ID (they're not in the participants table) */
+		janus_string_id_release(participant->user_id_str);
+	}
 	g_free(participant->user_id_str);
 	g_free(participant->display);
 	if(participant->encoder)
@@ -1919,6 +1962,8 @@ static void janus_audiobridge_participant_free(const janus_refcount *participant
 	if(participant->jitter)
 		jitter_buffer_destroy(participant->jitter);
 	janus_audiobridge_participant_clear_inbuf(participant);
+	g_free(participant->inbuf);
+	g_free(participant->inbuf_data);
 	if(participant->outbuf != NULL) {
 		janus_audiobridge_participant_clear_outbuf(participant);
 		g_async_queue_unref(participant->outbuf);
@@ -1951,6 +1996,10 @@ static void janus_audiobridge_participant_free(const janus_refcount *participant
 	janus_mutex_destroy(&participant->pmutex);
 	janus_mutex_destroy(&participant->qmutex);
 	janus_mutex_destroy(&participant->rec_mutex);
+	if(participant->outpkt != NULL) {
+		g_free(((janus_audiobridge_rtp_relay_packet *)participant->outpkt)->data);
+		g_free(participant->outpkt);
+	}
 	g_free(participant);
 }
 
@@ -1988,6 +2037,8 @@ static void janus_audiobridge_room_destroy(janus_audiobridge_room *audiobridge)
 static void janus_audiobridge_room_free(const janus_refcount *audiobridge_ref) {
 	janus_audiobridge_room *audiobridge = janus_refcount_containerof(audiobridge_ref, janus_audiobridge_room, ref);
 	/* This room can be destroyed, free all the resources */
+	if(string_ids)
+		janus_string_id_release(audiobridge->room_id_str);
 	g_free(audiobridge->room_id_str);
 	g_free(audiobridge->room_name);
 	g_free(audiobridge->room_secret);
@@ -2275,6 +2326,9 @@ static int janus_audiobridge_resample(int16_t *input, int input_num, int input_r
 #define JITTER_BUFFER_MAX_GAP_SIZE 20
 #define JITTER_BUFFER_CHECK_USECS 1*G_USEC_PER_SEC
 #define QUEUE_IN_MAX_PACKETS 4
+/* Size of the preallocated ring where decoded frames are queued for the mixer:
+ * just needs to be a bit larger than the maximum queue-in depth above */
+#define QUEUE_IN_RING_SIZE 8
 
 
 /* Error codes */
@@ -2524,6 +2578,8 @@ int janus_audiobridge_init(janus_callbacks *callback, const char *config_path) {
 		/* Invalid arguments */
 		return -1;
 	}
+	/* Pick the best mixing kernels this CPU supports */
+	janus_audiobridge_mixer_setup();
 
 	/* Read configuration */
 	char filename[255];
@@ -2601,6 +2657,17 @@ int janus_audiobridge_init(janus_callbacks *callback, const char *config_path) {
 				freeifaddrs(ifas);
 			}
 		}
+		janus_config_item *loops = janus_config_get(config, config_general, janus_config_type_item, "relay_loops");
+		if(loops && loops->value) {
+			num_relay_loops = atoi(loops->value);
+			if(num_relay_loops < 1) {
+				JANUS_LOG(LOG_WARN, "Invalid number of relay loops (%s), falling back to one per CPU core\n", loops->value);
+				num_relay_loops = 0;
+			} else if(num_relay_loops > JANUS_AUDIOBRIDGE_MAX_RELAY_LOOPS) {
+				JANUS_LOG(LOG_WARN, "Capping number of relay loops to %d\n", JANUS_AUDIOBRIDGE_MAX_RELAY_LOOPS);
+				num_relay_loops = JANUS_AUDIOBRIDGE_MAX_RELAY_LOOPS;
+			}
+		}
 		janus_config_item *rpr = janus_config_get(config, config_general, janus_config_type_item, "rtp_port_range");
 		if(rpr && rpr->value) {
 			/* Split in min and max port */
@@ -2644,7 +2711,7 @@ int janus_audiobridge_init(janus_callbacks *callback, const char *config_path) {
 	JANUS_LOG(LOG_VERB, "Local IP set to %s\n", local_ip);
 
 	/* Iterate on all rooms */
-	rooms = g_hash_table_new_full(string_ids ? g_str_hash : g_int64_hash, string_ids ? g_str_equal : g_int64_equal,
+	rooms = g_hash_table_new_full(g_int64_hash, g_int64_equal,
 		(GDestroyNotify)g_free, (GDestroyNotify)janus_audiobridge_room_destroy);
 	if(config != NULL) {
 		GList *clist = janus_config_get_categories(config, NULL), *cl = clist;
@@ -2703,10 +2770,12 @@ int janus_audiobridge_init(janus_callbacks *callback, const char *config_path) {
 					cl = cl->next;
 					continue;
 				}
+			} else {
+				audiobridge->room_id = janus_string_id_find(room_num);
 			}
 			/* Let's make sure the room doesn't exist already */
 			janus_mutex_lock(&rooms_mutex);
-			if(g_hash_table_lookup(rooms, string_ids ? (gpointer)room_num : (gpointer)&audiobridge->room_id) != NULL) {
+			if(g_hash_table_lookup(rooms, (gpointer)&audiobridge->room_id) != NULL) {
 				/* It does... */
 				janus_mutex_unlock(&rooms_mutex);
 				JANUS_LOG(LOG_ERR, "Can't add the AudioBridge room, room %s already exists...\n", room_num);
@@ -2716,6 +2785,8 @@ int janus_audiobridge_init(janus_callbacks *callback, const char *config_path) {
 			}
 			janus_mutex_unlock(&rooms_mutex);
 			audiobridge->room_id_str = g_strdup(room_num);
+			if(string_ids)
+				audiobridge->room_id = janus_string_id_intern(audiobridge->room_id_str);
 			char *description = NULL;
 			if(desc != NULL && desc->value != NULL && strlen(desc->value) > 0)
 				description = g_strdup(desc->value);
@@ -2816,7 +2887,7 @@ int janus_audiobridge_init(janus_callbacks *callback, const char *config_path) {
 				audiobridge->allow_plainrtp = janus_is_true(allowrtp->value);
 			audiobridge->destroy = 0;
 			audiobridge->participants = g_hash_table_new_full(
-				string_ids ? g_str_hash : g_int64_hash, string_ids ? g_str_equal : g_int64_equal,
+				g_int64_hash, g_int64_equal,
 				(GDestroyNotify)g_free, (GDestroyNotify)janus_audiobridge_participant_unref);
 			audiobridge->anncs = g_hash_table_new_full(g_str_hash, g_str_equal,
 				(GDestroyNotify)g_free, (GDestroyNotify)janus_audiobridge_participant_unref);
@@ -2889,7 +2960,7 @@ int janus_audiobridge_init(janus_callbacks *callback, const char *config_path) {
 			} else {
 				janus_mutex_lock(&rooms_mutex);
 				g_hash_table_insert(rooms,
-					string_ids ? (gpointer)g_strdup(audiobridge->room_id_str) : (gpointer)janus_uint64_dup(audiobridge->room_id),
+					(gpointer)janus_uint64_dup(audiobridge->room_id),
 					audiobridge);
 				janus_mutex_unlock(&rooms_mutex);
 			}
@@ -2926,6 +2997,36 @@ int janus_audiobridge_init(janus_callbacks *callback, const char *config_path) {
 		JANUS_LOG(LOG_WARN, "IPv6 disabled, will only create VideoRoom forwarders to IPv4 addresses\n");
 	}
 
+	/* Spawn the loops that will relay media for all plain RTP participants:
+	 * since each of them serves many participants at the same time, we don't
+	 * need a dedicated thread per participant, which wouldn't scale on
+	 * SIP-trunk-fed conferences with many plain RTP attendees */
+	if(num_relay_loops == 0) {
+		num_relay_loops = g_get_num_processors();
+		if(num_relay_loops > JANUS_AUDIOBRIDGE_MAX_RELAY_LOOPS)
+			num_relay_loops = JANUS_AUDIOBRIDGE_MAX_RELAY_LOOPS;
+	}
+	relay_loops = g_malloc0(num_relay_loops * sizeof(janus_audiobridge_relay_loop));
+	int l = 0;
+	for(l=0; l<num_relay_loops; l++) {
+		janus_audiobridge_relay_loop *loop = &relay_loops[l];
+		loop->id = l;
+		loop->mainctx = g_main_context_new();
+		loop->mainloop = g_main_loop_new(loop->mainctx, FALSE);
+		GError *lerror = NULL;
+		char tname[16];
+		g_snprintf(tname, sizeof(tname), "abrelay %d", l);
+		loop->thread = g_thread_try_new(tname, janus_audiobridge_relay_loop_thread, loop, &lerror);
+		if(lerror != NULL) {
+			JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch a relay loop thread...\n",
+				lerror->code, lerror->message ? lerror->message : "??");
+			g_error_free(lerror);
+			janus_config_destroy(config);
+			return -1;
+		}
+	}
+	JANUS_LOG(LOG_INFO, "Spawned %d event loops to relay media for plain RTP participants\n", num_relay_loops);
+
 	g_atomic_int_set(&initialized, 1);
 
 	/* Launch the thread that will handle incoming messages */
@@ -2939,6 +3040,18 @@ int janus_audiobridge_init(janus_callbacks *callback, const char *config_path) {
 		janus_config_destroy(config);
 		return -1;
 	}
+	/* Create the thread pool that will serve the participant codecs */
+	error = NULL;
+	participant_pool = g_thread_pool_new(janus_audiobridge_participant_pool_process, NULL,
+		g_get_num_processors(), FALSE, &error);
+	if(error != NULL) {
+		g_atomic_int_set(&initialized, 0);
+		JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to create the AudioBridge codec pool...\n",
+			error->code, error->message ? error->message : "??");
+		g_error_free(error);
+		janus_config_destroy(config);
+		return -1;
+	}
 	JANUS_LOG(LOG_INFO, "%s initialized!\n", JANUS_AUDIOBRIDGE_NAME);
 	return 0;
 }
@@ -2953,6 +3066,34 @@ void janus_audiobridge_destroy(void) {
 		g_thread_join(handler_thread);
 		handler_thread = NULL;
 	}
+	if(participant_pool != NULL) {
+		g_thread_pool_free(participant_pool, FALSE, TRUE);
+		participant_pool = NULL;
+	}
+	/* Get rid of the relay loops: unreffing the contexts also gets rid of
+	 * the sources of participants that were still attached to the loops */
+	int l = 0;
+	for(l=0; l<num_relay_loops; l++) {
+		janus_audiobridge_relay_loop *loop = &relay_loops[l];
+		if(loop->mainloop != NULL && g_main_loop_is_running(loop->mainloop)) {
+			g_main_loop_quit(loop->mainloop);
+			g_main_context_wakeup(loop->mainctx);
+		}
+		if(loop->thread != NULL) {
+			g_thread_join(loop->thread);
+			loop->thread = NULL;
+		}
+		if(loop->mainloop != NULL) {
+			g_main_loop_unref(loop->mainloop);
+			loop->mainloop = NULL;
+		}
+		if(loop->mainctx != NULL) {
+			g_main_context_unref(loop->mainctx);
+			loop->mainctx = NULL;
+		}
+	}
+	g_free(relay_loops);
+	relay_loops = NULL;
 	/* FIXME We should destroy the sessions cleanly */
 	janus_mutex_lock(&sessions_mutex);
 	g_hash_table_destroy(sessions);
@@ -3107,7 +3248,7 @@ json_t *janus_audiobridge_query_session(janus_plugin_session *handle) {
 		if(participant->jitter)
 			jitter_buffer_ctl(participant->jitter, JITTER_BUFFER_GET_AVALIABLE_COUNT, &count);
 		json_object_set_new(info, "buffer-in", json_integer(count));
-		json_object_set_new(info, "queue-in", json_integer(g_list_length(participant->inbuf)));
+		json_object_set_new(info, "queue-in", json_integer(g_atomic_int_get(&participant->inbuf_count)));
 		janus_mutex_unlock(&participant->qmutex);
 		if(participant->outbuf)
 			json_object_set_new(info, "queue-out", json_integer(g_async_queue_length(participant->outbuf)));
@@ -3166,9 +3307,10 @@ static int janus_audiobridge_access_room(json_t *root, gboolean check_modify, ja
 		room_id_str = room_id_num;
 	} else {
 		room_id_str = (char *)json_string_value(room);
+		room_id = janus_string_id_find(room_id_str);
 	}
 	*audiobridge = g_hash_table_lookup(rooms,
-		string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+		(gpointer)&room_id);
 	if(*audiobridge == NULL) {
 		JANUS_LOG(LOG_ERR, "No such room (%s)\n", room_id_str);
 		error_code = JANUS_AUDIOBRIDGE_ERROR_NO_SUCH_ROOM;
@@ -3324,6 +3466,7 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 			room_id_str = room_id_num;
 		} else {
 			room_id_str = (char *)json_string_value(room);
+			room_id = janus_string_id_find(room_id_str);
 		}
 		if(room_id == 0 && room_id_str == NULL) {
 			JANUS_LOG(LOG_WARN, "Desired room ID is empty, which is not allowed... picking random ID instead\n");
@@ -3331,7 +3474,12 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 		janus_mutex_lock(&rooms_mutex);
 		if(room_id > 0 || room_id_str != NULL) {
 			/* Let's make sure the room doesn't exist already */
-			if(g_hash_table_lookup(rooms, string_ids ? (gpointer)room_id_str : (gpointer)&room_id) != NULL) {
+			if(string_ids && room_id == 0) {
+				/* Re-resolve the ID now that we hold the lock, in case
+				 * a concurrent create interned it in the meanwhile */
+				room_id = janus_string_id_find(room_id_str);
+			}
+			if(g_hash_table_lookup(rooms, (gpointer)&room_id) != NULL) {
 				/* It does... */
 				janus_mutex_unlock(&rooms_mutex);
 				error_code = JANUS_AUDIOBRIDGE_ERROR_ROOM_EXISTS;
@@ -3358,7 +3506,7 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 		} else if(string_ids && room_id_str == NULL) {
 			while(room_id_str == NULL) {
 				room_id_str = janus_random_uuid();
-				if(g_hash_table_lookup(rooms, room_id_str) != NULL) {
+				if(janus_string_id_find(room_id_str) != 0) {
 					/* Room ID already taken, try another one */
 					g_clear_pointer(&room_id_str, g_free);
 				}
@@ -3367,6 +3515,8 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 		}
 		audiobridge->room_id = room_id;
 		audiobridge->room_id_str = room_id_str ? g_strdup(room_id_str) : NULL;
+		if(string_ids)
+			audiobridge->room_id = janus_string_id_intern(audiobridge->room_id_str);
 		char *description = NULL;
 		if(desc != NULL && strlen(json_string_value(desc)) > 0) {
 			description = g_strdup(json_string_value(desc));
@@ -3470,7 +3620,7 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 			audiobridge->allow_plainrtp = TRUE;
 		audiobridge->destroy = 0;
 		audiobridge->participants = g_hash_table_new_full(
-			string_ids ? g_str_hash : g_int64_hash, string_ids ? g_str_equal : g_int64_equal,
+			g_int64_hash, g_int64_equal,
 			(GDestroyNotify)g_free, (GDestroyNotify)janus_audiobridge_participant_unref);
 		audiobridge->anncs = g_hash_table_new_full(g_str_hash, g_str_equal,
 			(GDestroyNotify)g_free, (GDestroyNotify)janus_audiobridge_participant_unref);
@@ -3518,7 +3668,7 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 		audiobridge->rtp_udp_sock = -1;
 		janus_mutex_init(&audiobridge->rtp_mutex);
 		g_hash_table_insert(rooms,
-			string_ids ? (gpointer)g_strdup(audiobridge->room_id_str) : (gpointer)janus_uint64_dup(audiobridge->room_id),
+			(gpointer)janus_uint64_dup(audiobridge->room_id),
 			audiobridge);
 		JANUS_LOG(LOG_VERB, "Created AudioBridge: %s (%s, %s, secret: %s, pin: %s)\n",
 			audiobridge->room_id_str, audiobridge->room_name,
@@ -3539,7 +3689,7 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 				error->code, error->message ? error->message : "??");
 			g_error_free(error);
 			janus_refcount_decrease(&audiobridge->ref);
-			g_hash_table_remove(rooms, string_ids ? (gpointer)audiobridge->room_id_str : (gpointer)&audiobridge->room_id);
+			g_hash_table_remove(rooms, (gpointer)&audiobridge->room_id);
 			janus_mutex_unlock(&rooms_mutex);
 			if(room_id_allocated)
 				g_free(room_id_str);
@@ -3667,10 +3817,11 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 			room_id_str = room_id_num;
 		} else {
 			room_id_str = (char *)json_string_value(room);
+			room_id = janus_string_id_find(room_id_str);
 		}
 		janus_mutex_lock(&rooms_mutex);
 		janus_audiobridge_room *audiobridge = g_hash_table_lookup(rooms,
-			string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+			(gpointer)&room_id);
 		if(audiobridge == NULL) {
 			janus_mutex_unlock(&rooms_mutex);
 			error_code = JANUS_AUDIOBRIDGE_ERROR_NO_SUCH_ROOM;
@@ -3841,10 +3992,11 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 			room_id_str = room_id_num;
 		} else {
 			room_id_str = (char *)json_string_value(room);
+			room_id = janus_string_id_find(room_id_str);
 		}
 		janus_mutex_lock(&rooms_mutex);
 		janus_audiobridge_room *audiobridge = g_hash_table_lookup(rooms,
-			string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+			(gpointer)&room_id);
 		if(audiobridge == NULL) {
 			janus_mutex_unlock(&rooms_mutex);
 			error_code = JANUS_AUDIOBRIDGE_ERROR_NO_SUCH_ROOM;
@@ -3863,7 +4015,7 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 		}
 		/* Remove room */
 		janus_refcount_increase(&audiobridge->ref);
-		g_hash_table_remove(rooms, string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+		g_hash_table_remove(rooms, (gpointer)&room_id);
 		if(save) {
 			/* This change is permanent: save to the configuration file too
 			 * FIXME: We should check if anything fails... */
@@ -4085,6 +4237,14 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 			json_object_set_new(rl, "record", g_atomic_int_get(&room->record) ? json_true() : json_false());
 			json_object_set_new(rl, "muted", room->muted ? json_true() : json_false());
 			json_object_set_new(rl, "num_participants", json_integer(g_hash_table_size(room->participants)));
+			/* Add the mixer tick latency histogram, for monitoring purposes */
+			json_t *latency = json_object();
+			json_object_set_new(latency, "ontime", json_integer(g_atomic_int_get(&room->mixer_latency[0])));
+			json_object_set_new(latency, "late_5ms", json_integer(g_atomic_int_get(&room->mixer_latency[1])));
+			json_object_set_new(latency, "late_20ms", json_integer(g_atomic_int_get(&room->mixer_latency[2])));
+			json_object_set_new(latency, "late_80ms", json_integer(g_atomic_int_get(&room->mixer_latency[3])));
+			json_object_set_new(latency, "resyncs", json_integer(g_atomic_int_get(&room->mixer_resyncs)));
+			json_object_set_new(rl, "mixer_latency", latency);
 			json_array_append_new(list, rl);
 			janus_refcount_decrease(&room->ref);
 		}
@@ -4115,9 +4275,10 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 			room_id_str = room_id_num;
 		} else {
 			room_id_str = (char *)json_string_value(room);
+			room_id = janus_string_id_find(room_id_str);
 		}
 		janus_mutex_lock(&rooms_mutex);
-		gboolean room_exists = g_hash_table_contains(rooms, string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+		gboolean room_exists = g_hash_table_contains(rooms, (gpointer)&room_id);
 		janus_mutex_unlock(&rooms_mutex);
 		response = json_object();
 		json_object_set_new(response, "audiobridge", json_string("success"));
@@ -4161,10 +4322,11 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 			room_id_str = room_id_num;
 		} else {
 			room_id_str = (char *)json_string_value(room);
+			room_id = janus_string_id_find(room_id_str);
 		}
 		janus_mutex_lock(&rooms_mutex);
 		janus_audiobridge_room *audiobridge = g_hash_table_lookup(rooms,
-			string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+			(gpointer)&room_id);
 		if(audiobridge == NULL) {
 			janus_mutex_unlock(&rooms_mutex);
 			error_code = JANUS_AUDIOBRIDGE_ERROR_NO_SUCH_ROOM;
@@ -4285,10 +4447,11 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 			room_id_str = room_id_num;
 		} else {
 			room_id_str = (char *)json_string_value(room);
+			room_id = janus_string_id_find(room_id_str);
 		}
 		janus_mutex_lock(&rooms_mutex);
 		janus_audiobridge_room *audiobridge = g_hash_table_lookup(rooms,
-			string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+			(gpointer)&room_id);
 		if(audiobridge == NULL) {
 			janus_mutex_unlock(&rooms_mutex);
 			error_code = JANUS_AUDIOBRIDGE_ERROR_NO_SUCH_ROOM;
@@ -4317,9 +4480,10 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 			user_id_str = user_id_num;
 		} else {
 			user_id_str = (char *)json_string_value(id);
+			user_id = janus_string_id_find(user_id_str);
 		}
 		janus_audiobridge_participant *participant = g_hash_table_lookup(audiobridge->participants,
-			string_ids ? (gpointer)user_id_str : (gpointer)&user_id);
+			(gpointer)&user_id);
 		if(participant == NULL) {
 			janus_mutex_unlock(&audiobridge->mutex);
 			janus_refcount_decrease(&audiobridge->ref);
@@ -4435,10 +4599,11 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 			room_id_str = room_id_num;
 		} else {
 			room_id_str = (char *)json_string_value(room);
+			room_id = janus_string_id_find(room_id_str);
 		}
 		janus_mutex_lock(&rooms_mutex);
 		janus_audiobridge_room *audiobridge = g_hash_table_lookup(rooms,
-			string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+			(gpointer)&room_id);
 		if(audiobridge == NULL) {
 			janus_mutex_unlock(&rooms_mutex);
 			error_code = JANUS_AUDIOBRIDGE_ERROR_NO_SUCH_ROOM;
@@ -4558,10 +4723,11 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 			room_id_str = room_id_num;
 		} else {
 			room_id_str = (char *)json_string_value(room);
+			room_id = janus_string_id_find(room_id_str);
 		}
 		janus_mutex_lock(&rooms_mutex);
 		janus_audiobridge_room *audiobridge = g_hash_table_lookup(rooms,
-			string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+			(gpointer)&room_id);
 		if(audiobridge == NULL) {
 			janus_mutex_unlock(&rooms_mutex);
 			error_code = JANUS_AUDIOBRIDGE_ERROR_NO_SUCH_ROOM;
@@ -4590,9 +4756,10 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 			user_id_str = user_id_num;
 		} else {
 			user_id_str = (char *)json_string_value(id);
+			user_id = janus_string_id_find(user_id_str);
 		}
 		janus_audiobridge_participant *participant = g_hash_table_lookup(audiobridge->participants,
-			string_ids ? (gpointer)user_id_str : (gpointer)&user_id);
+			(gpointer)&user_id);
 		if(participant == NULL) {
 			janus_mutex_unlock(&audiobridge->mutex);
 			janus_refcount_decrease(&audiobridge->ref);
@@ -4653,10 +4820,11 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 			room_id_str = room_id_num;
 		} else {
 			room_id_str = (char *)json_string_value(room);
+			room_id = janus_string_id_find(room_id_str);
 		}
 		janus_mutex_lock(&rooms_mutex);
 		janus_audiobridge_room *audiobridge = g_hash_table_lookup(rooms,
-			string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+			(gpointer)&room_id);
 		if(audiobridge == NULL) {
 			janus_mutex_unlock(&rooms_mutex);
 			error_code = JANUS_AUDIOBRIDGE_ERROR_NO_SUCH_ROOM;
@@ -4683,9 +4851,10 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 			user_id_str = user_id_num;
 		} else {
 			user_id_str = (char *)json_string_value(id);
+			user_id = janus_string_id_find(user_id_str);
 		}
 		janus_audiobridge_participant *participant = g_hash_table_lookup(audiobridge->participants,
-			string_ids ? (gpointer)user_id_str : (gpointer)&user_id);
+			(gpointer)&user_id);
 		if(participant == NULL) {
 			janus_mutex_unlock(&audiobridge->mutex);
 			janus_refcount_decrease(&audiobridge->ref);
@@ -4755,10 +4924,11 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 			room_id_str = room_id_num;
 		} else {
 			room_id_str = (char *)json_string_value(room);
+			room_id = janus_string_id_find(room_id_str);
 		}
 		janus_mutex_lock(&rooms_mutex);
 		janus_audiobridge_room *audiobridge = g_hash_table_lookup(rooms,
-			string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+			(gpointer)&room_id);
 		if(audiobridge == NULL) {
 			janus_mutex_unlock(&rooms_mutex);
 			error_code = JANUS_AUDIOBRIDGE_ERROR_NO_SUCH_ROOM;
@@ -4844,10 +5014,11 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 			room_id_str = room_id_num;
 		} else {
 			room_id_str = (char *)json_string_value(room);
+			room_id = janus_string_id_find(room_id_str);
 		}
 		janus_mutex_lock(&rooms_mutex);
 		janus_audiobridge_room *audiobridge = g_hash_table_lookup(rooms,
-			string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+			(gpointer)&room_id);
 		if(audiobridge == NULL) {
 			janus_mutex_unlock(&rooms_mutex);
 			error_code = JANUS_AUDIOBRIDGE_ERROR_NO_SUCH_ROOM;
@@ -4936,6 +5107,7 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 			room_id_str = room_id_num;
 		} else {
 			room_id_str = (char *)json_string_value(room);
+			room_id = janus_string_id_find(room_id_str);
 		}
 		guint32 ssrc_value = 0;
 		json_t *ssrc = json_object_get(root, "ssrc");
@@ -5037,7 +5209,7 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 		/* Update room */
 		janus_mutex_lock(&rooms_mutex);
 		janus_audiobridge_room *audiobridge = g_hash_table_lookup(rooms,
-			string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+			(gpointer)&room_id);
 		if(audiobridge == NULL) {
 			janus_mutex_unlock(&rooms_mutex);
 			JANUS_LOG(LOG_ERR, "No such room (%s)\n", room_id_str);
@@ -5148,12 +5320,13 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 			room_id_str = room_id_num;
 		} else {
 			room_id_str = (char *)json_string_value(room);
+			room_id = janus_string_id_find(room_id_str);
 		}
 		guint32 stream_id = json_integer_value(json_object_get(root, "stream_id"));
 		/* Update room */
 		janus_mutex_lock(&rooms_mutex);
 		janus_audiobridge_room *audiobridge = g_hash_table_lookup(rooms,
-			string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+			(gpointer)&room_id);
 		if(audiobridge == NULL) {
 			janus_mutex_unlock(&rooms_mutex);
 			JANUS_LOG(LOG_ERR, "No such room (%s)\n", room_id_str);
@@ -5209,10 +5382,11 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 			room_id_str = room_id_num;
 		} else {
 			room_id_str = (char *)json_string_value(room);
+			room_id = janus_string_id_find(room_id_str);
 		}
 		janus_mutex_lock(&rooms_mutex);
 		janus_audiobridge_room *audiobridge = g_hash_table_lookup(rooms,
-			string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+			(gpointer)&room_id);
 		if(audiobridge == NULL) {
 			janus_mutex_unlock(&rooms_mutex);
 			error_code = JANUS_AUDIOBRIDGE_ERROR_NO_SUCH_ROOM;
@@ -5320,11 +5494,12 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 			room_id_str = room_id_num;
 		} else {
 			room_id_str = (char *)json_string_value(room);
+			room_id = janus_string_id_find(room_id_str);
 		}
 		/* Update room */
 		janus_mutex_lock(&rooms_mutex);
 		janus_audiobridge_room *audiobridge = g_hash_table_lookup(rooms,
-			string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+			(gpointer)&room_id);
 		if(audiobridge == NULL) {
 			janus_mutex_unlock(&rooms_mutex);
 			JANUS_LOG(LOG_ERR, "No such room (%s)\n", room_id_str);
@@ -5497,11 +5672,12 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 			room_id_str = room_id_num;
 		} else {
 			room_id_str = (char *)json_string_value(room);
+			room_id = janus_string_id_find(room_id_str);
 		}
 		/* Update room */
 		janus_mutex_lock(&rooms_mutex);
 		janus_audiobridge_room *audiobridge = g_hash_table_lookup(rooms,
-			string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+			(gpointer)&room_id);
 		if(audiobridge == NULL) {
 			janus_mutex_unlock(&rooms_mutex);
 			JANUS_LOG(LOG_ERR, "No such room (%s)\n", room_id_str);
@@ -5569,10 +5745,11 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 		    room_id_str = room_id_num;
 		} else {
 		    room_id_str = (char *)json_string_value(room);
+		    room_id = janus_string_id_find(room_id_str);
 		}
 		janus_mutex_lock(&rooms_mutex);
 		janus_audiobridge_room *audiobridge = g_hash_table_lookup(rooms,
-		    string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+		    (gpointer)&room_id);
 		if(audiobridge == NULL) {
 		    janus_mutex_unlock(&rooms_mutex);
 		    error_code = JANUS_AUDIOBRIDGE_ERROR_NO_SUCH_ROOM;
@@ -5664,11 +5841,12 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 			room_id_str = room_id_num;
 		} else {
 			room_id_str = (char *)json_string_value(room);
+			room_id = janus_string_id_find(room_id_str);
 		}
 		/* Update room */
 		janus_mutex_lock(&rooms_mutex);
 		janus_audiobridge_room *audiobridge = g_hash_table_lookup(rooms,
-			string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+			(gpointer)&room_id);
 		if(audiobridge == NULL) {
 			janus_mutex_unlock(&rooms_mutex);
 			JANUS_LOG(LOG_ERR, "No such room (%s)\n", room_id_str);
@@ -5772,11 +5950,12 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 			room_id_str = room_id_num;
 		} else {
 			room_id_str = (char *)json_string_value(room);
+			room_id = janus_string_id_find(room_id_str);
 		}
 		/* Update room */
 		janus_mutex_lock(&rooms_mutex);
 		janus_audiobridge_room *audiobridge = g_hash_table_lookup(rooms,
-			string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+			(gpointer)&room_id);
 		if(audiobridge == NULL) {
 			janus_mutex_unlock(&rooms_mutex);
 			JANUS_LOG(LOG_ERR, "No such room (%s)\n", room_id_str);
@@ -5885,10 +6064,11 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 			room_id_str = room_id_num;
 		} else {
 			room_id_str = (char *)json_string_value(room);
+			room_id = janus_string_id_find(room_id_str);
 		}
 		janus_mutex_lock(&rooms_mutex);
 		janus_audiobridge_room *audiobridge = g_hash_table_lookup(rooms,
-			string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+			(gpointer)&room_id);
 		if(audiobridge == NULL) {
 			janus_mutex_unlock(&rooms_mutex);
 			error_code = JANUS_AUDIOBRIDGE_ERROR_NO_SUCH_ROOM;
@@ -5907,9 +6087,10 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 			user_id_str = user_id_num;
 		} else {
 			user_id_str = (char *)json_string_value(id);
+			user_id = janus_string_id_find(user_id_str);
 		}
 		janus_audiobridge_participant *participant = g_hash_table_lookup(audiobridge->participants,
-			string_ids ? (gpointer)user_id_str : (gpointer)&user_id);
+			(gpointer)&user_id);
 		if(participant == NULL) {
 			janus_mutex_unlock(&audiobridge->mutex);
 			janus_refcount_decrease(&audiobridge->ref);
@@ -5984,6 +6165,10 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 				g_cond_signal(&participant->suspend_cond);
 				janus_mutex_unlock(&participant->suspend_cond_mutex);
 				notify_participant = TRUE;
+				/* Make sure the RTP context is reset, as the sequence numbers will have a gap */
+				participant->context.seq_reset = TRUE;
+				participant->decoded_first = FALSE;
+				janus_audiobridge_participant_clear_outbuf(participant);
 				/* Should we create a new recording? */
 				json_t *record = json_object_get(root, "record");
 				json_t *recfile = json_object_get(root, "filename");
@@ -6357,7 +6542,7 @@ void janus_audiobridge_incoming_rtp(janus_plugin_session *handle, janus_plugin_r
 		/* Queue the audio packet in the jitter buffer (we won't decode now, there might be buffering involved) */
 		if(participant->jitter) {
 			janus_audiobridge_buffer_packet *pkt = janus_audiobridge_buffer_packet_create(packet);
-			janus_mutex_lock(&participant->qmutex);
+			janus_mutex_lock_spin(&participant->qmutex);
 			JitterBufferPacket jbp = {0};
 			jbp.data = (char *)pkt;
 			jbp.len = 0;
@@ -6441,13 +6626,11 @@ static void janus_audiobridge_hangup_media_internal(janus_plugin_session *handle
 		return;
 	/* Get rid of participant */
 	janus_audiobridge_participant *participant = (janus_audiobridge_participant *)session->participant;
-	/* If this was a plain RTP participant, notify the thread that it's time to go */
-	if(participant->plainrtp && participant->plainrtp_media.pipefd[1] > 0) {
-		int code = 1;
-		ssize_t res = 0;
-		do {
-			res = write(participant->plainrtp_media.pipefd[1], &code, sizeof(int));
-		} while(res == -1 && errno == EINTR);
+	/* If this was a plain RTP participant, detach it from its relay loop */
+	if(participant->plainrtp) {
+		janus_mutex_lock(&participant->pmutex);
+		janus_audiobridge_plainrtp_media_cleanup(&participant->plainrtp_media);
+		janus_mutex_unlock(&participant->pmutex);
 	}
 	participant->plainrtp = FALSE;
 	janus_mutex_lock(&rooms_mutex);
@@ -6463,7 +6646,7 @@ static void janus_audiobridge_hangup_media_internal(janus_plugin_session *handle
 		json_object_set_new(event, "leaving",
 			string_ids ? json_string(participant->user_id_str) : json_integer(participant->user_id));
 		removed = g_hash_table_remove(audiobridge->participants,
-			string_ids ? (gpointer)participant->user_id_str : (gpointer)&participant->user_id);
+			(gpointer)&participant->user_id);
 		GHashTableIter iter;
 		gpointer value;
 		g_hash_table_iter_init(&iter, audiobridge->participants);
@@ -6514,8 +6697,7 @@ static void janus_audiobridge_hangup_media_internal(janus_plugin_session *handle
 	participant->decoder = NULL;
 	g_atomic_int_set(&participant->decoding, 0);
 	participant->reset = FALSE;
-	participant->audio_active_packets = 0;
-	participant->audio_dBov_sum = 0;
+	janus_audiolevel_context_reset(&participant->audiolevel_ctx);
 	participant->talking = FALSE;
 	g_free(participant->mjr_base);
 	participant->mjr_base = NULL;
@@ -6673,10 +6855,11 @@ static void *janus_audiobridge_handler(void *data) {
 				room_id_str = room_id_num;
 			} else {
 				room_id_str = (char *)json_string_value(room);
+				room_id = janus_string_id_find(room_id_str);
 			}
 			janus_mutex_lock(&rooms_mutex);
 			janus_audiobridge_room *audiobridge = g_hash_table_lookup(rooms,
-				string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+				(gpointer)&room_id);
 			if(audiobridge == NULL) {
 				janus_mutex_unlock(&rooms_mutex);
 				janus_mutex_unlock(&sessions_mutex);
@@ -6828,9 +7011,10 @@ static void *janus_audiobridge_handler(void *data) {
 					user_id_str = user_id_num;
 				} else {
 					user_id_str = (char *)json_string_value(id);
+					user_id = janus_string_id_find(user_id_str);
 				}
 				if(g_hash_table_lookup(audiobridge->participants,
-						string_ids ? (gpointer)user_id_str : (gpointer)&user_id) != NULL) {
+						(gpointer)&user_id) != NULL) {
 					/* User ID already taken */
 					janus_mutex_unlock(&audiobridge->mutex);
 					janus_refcount_decrease(&audiobridge->ref);
@@ -6860,7 +7044,7 @@ static void *janus_audiobridge_handler(void *data) {
 					/* Generate a random ID */
 					while(user_id_str == NULL) {
 						user_id_str = janus_random_uuid();
-						if(g_hash_table_lookup(audiobridge->participants, user_id_str) != NULL) {
+						if(janus_string_id_find(user_id_str) != 0) {
 							/* User ID already taken, try another one */
 							g_clear_pointer(&user_id_str, g_free);
 						}
@@ -6901,6 +7085,8 @@ static void *janus_audiobridge_handler(void *data) {
 			participant->room = audiobridge;
 			participant->user_id = user_id;
 			participant->user_id_str = user_id_str ? g_strdup(user_id_str) : NULL;
+			if(string_ids)
+				participant->user_id = janus_string_id_intern(participant->user_id_str);
 			participant->group = group;
 			g_free(participant->display);
 			participant->admin = admin;
@@ -6935,6 +7121,7 @@ static void *janus_audiobridge_handler(void *data) {
 				participant->opus_pt = 0;
 				participant->extmap_id = 0;
 				participant->dBov_level = 0;
+				janus_audiolevel_context_reset(&participant->audiolevel_ctx);
 				participant->talking = FALSE;
 			}
 			JANUS_LOG(LOG_VERB, "Creating Opus encoder/decoder (sampling rate %d)\n", audiobridge->sampling_rate);
@@ -7107,44 +7294,13 @@ static void *janus_audiobridge_handler(void *data) {
 				}
 			}
 			janus_mutex_unlock(&participant->rec_mutex);
-			/* Finally, start the encoding thread if it hasn't already */
-			if(participant->thread == NULL) {
-				GError *error = NULL;
-				char roomtrunc[5], parttrunc[5];
-				g_snprintf(roomtrunc, sizeof(roomtrunc), "%s", audiobridge->room_id_str);
-				g_snprintf(parttrunc, sizeof(parttrunc), "%s", participant->user_id_str);
-				char tname[16];
-				g_snprintf(tname, sizeof(tname), "mixer %s %s", roomtrunc, parttrunc);
-				janus_refcount_increase(&session->ref);
-				janus_refcount_increase(&participant->ref);
-				participant->thread = g_thread_try_new(tname, &janus_audiobridge_participant_thread, participant, &error);
-				if(error != NULL) {
-					janus_refcount_decrease(&participant->ref);
-					janus_refcount_decrease(&session->ref);
+			/* No need to start a dedicated encoding thread: the mixer thread
+			 * will schedule this participant on the shared codec pool */
+			if(participant->plainrtp && participant->plainrtp_media.audio_rtp_fd != -1 && participant->plainrtp_media.source == NULL) {
+				/* Have one of the relay loops monitor the socket for incoming plain RTP traffic too */
+				if(janus_audiobridge_plainrtp_attach(participant) < 0) {
 					/* FIXME We should fail here... */
-					JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the participant thread...\n",
-						error->code, error->message ? error->message : "??");
-					g_error_free(error);
-				}
-			}
-			if(participant->plainrtp && participant->plainrtp_media.audio_rtp_fd != -1 && participant->plainrtp_media.thread == NULL) {
-				/* Spawn a thread for incoming plain RTP traffic too */
-				GError *error = NULL;
-				char roomtrunc[5], parttrunc[5];
-				g_snprintf(roomtrunc, sizeof(roomtrunc), "%s", audiobridge->room_id_str);
-				g_snprintf(parttrunc, sizeof(parttrunc), "%s", participant->user_id_str);
-				char tname[16];
-				g_snprintf(tname, sizeof(tname), "rtp %s %s", roomtrunc, parttrunc);
-				janus_refcount_increase(&session->ref);
-				janus_refcount_increase(&participant->ref);
-				participant->plainrtp_media.thread = g_thread_try_new(tname, &janus_audiobridge_plainrtp_relay_thread, participant, &error);
-				if(error != NULL) {
-					janus_refcount_decrease(&participant->ref);
-					janus_refcount_decrease(&session->ref);
-					/* FIXME We should fail here... */
-					JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the plain RTP participant thread...\n",
-						error->code, error->message ? error->message : "??");
-					g_error_free(error);
+					JANUS_LOG(LOG_ERR, "Error attaching the plain RTP participant to a relay loop...\n");
 				}
 			}
 			/* If a PeerConnection exists, make sure to update the RTP headers */
@@ -7155,7 +7311,7 @@ static void *janus_audiobridge_handler(void *data) {
 			session->participant = participant;
 			janus_refcount_increase(&participant->ref);
 			g_hash_table_insert(audiobridge->participants,
-				string_ids ? (gpointer)g_strdup(participant->user_id_str) : (gpointer)janus_uint64_dup(participant->user_id),
+				(gpointer)janus_uint64_dup(participant->user_id),
 				participant);
 			janus_mutex_unlock(&sessions_mutex);
 			/* Notify the other participants */
@@ -7552,6 +7708,7 @@ static void *janus_audiobridge_handler(void *data) {
 				room_id_str = room_id_num;
 			} else {
 				room_id_str = (char *)json_string_value(room);
+				room_id = janus_string_id_find(room_id_str);
 			}
 			janus_mutex_lock(&rooms_mutex);
 			janus_audiobridge_participant *participant = (janus_audiobridge_participant *)session->participant;
@@ -7572,7 +7729,7 @@ static void *janus_audiobridge_handler(void *data) {
 				goto error;
 			}
 			janus_audiobridge_room *audiobridge = g_hash_table_lookup(rooms,
-				string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+				(gpointer)&room_id);
 			if(audiobridge == NULL) {
 				janus_mutex_unlock(&rooms_mutex);
 				error_code = JANUS_AUDIOBRIDGE_ERROR_NO_SUCH_ROOM;
@@ -7693,9 +7850,10 @@ static void *janus_audiobridge_handler(void *data) {
 					user_id_str = user_id_num;
 				} else {
 					user_id_str = (char *)json_string_value(id);
+					user_id = janus_string_id_find(user_id_str);
 				}
 				if(g_hash_table_lookup(audiobridge->participants,
-						string_ids ? (gpointer)user_id_str : (gpointer)&user_id) != NULL) {
+						(gpointer)&user_id) != NULL) {
 					/* User ID already taken */
 					janus_mutex_unlock(&audiobridge->mutex);
 					janus_refcount_decrease(&audiobridge->ref);
@@ -7725,7 +7883,7 @@ static void *janus_audiobridge_handler(void *data) {
 					/* Generate a random ID */
 					while(user_id_str == NULL) {
 						user_id_str = janus_random_uuid();
-						if(g_hash_table_lookup(audiobridge->participants, user_id_str) != NULL) {
+						if(janus_string_id_find(user_id_str) != 0) {
 							/* User ID already taken, try another one */
 							g_clear_pointer(&user_id_str, g_free);
 						}
@@ -7734,8 +7892,7 @@ static void *janus_audiobridge_handler(void *data) {
 				}
 				JANUS_LOG(LOG_VERB, "  -- Participant ID in new room %s: %s\n", room_id_str, user_id_str);
 			}
-			participant->audio_active_packets = 0;
-			participant->audio_dBov_sum = 0;
+			janus_audiolevel_context_reset(&participant->audiolevel_ctx);
 			participant->talking = FALSE;
 			/* Is the sampling rate of the new room the same as the one in the old room, or should we update the decoder/encoder? */
 			janus_audiobridge_room *old_audiobridge = participant->room;
@@ -7743,7 +7900,7 @@ static void *janus_audiobridge_handler(void *data) {
 			janus_refcount_increase(&participant->ref);
 			janus_mutex_lock(&old_audiobridge->mutex);
 			g_hash_table_remove(old_audiobridge->participants,
-				string_ids ? (gpointer)participant->user_id_str : (gpointer)&participant->user_id);
+				(gpointer)&participant->user_id);
 			if(old_audiobridge->sampling_rate != audiobridge->sampling_rate ||
 					old_audiobridge->spatial_audio != audiobridge->spatial_audio) {
 				/* Create a new one that takes into account the sampling rate we want now */
@@ -7762,7 +7919,7 @@ static void *janus_audiobridge_handler(void *data) {
 					g_snprintf(error_cause, 512, "Error creating Opus encoder");
 					/* Join the old room again... */
 					g_hash_table_insert(audiobridge->participants,
-						string_ids ? (gpointer)g_strdup(participant->user_id_str) : (gpointer)janus_uint64_dup(participant->user_id),
+						(gpointer)janus_uint64_dup(participant->user_id),
 						participant);
 					janus_mutex_unlock(&old_audiobridge->mutex);
 					janus_mutex_unlock(&audiobridge->mutex);
@@ -7804,7 +7961,7 @@ static void *janus_audiobridge_handler(void *data) {
 					g_snprintf(error_cause, 512, "Error creating Opus decoder");
 					/* Join the old room again... */
 					g_hash_table_insert(audiobridge->participants,
-						string_ids ? (gpointer)g_strdup(participant->user_id_str) : (gpointer)janus_uint64_dup(participant->user_id),
+						(gpointer)janus_uint64_dup(participant->user_id),
 						participant);
 					janus_mutex_unlock(&old_audiobridge->mutex);
 					janus_mutex_unlock(&audiobridge->mutex);
@@ -7869,8 +8026,12 @@ static void *janus_audiobridge_handler(void *data) {
 			janus_refcount_decrease(&old_audiobridge->ref);
 			/* Done, join the new one */
 			participant->user_id = user_id;
+			if(string_ids)
+				janus_string_id_release(participant->user_id_str);
 			g_free(participant->user_id_str);
 			participant->user_id_str = user_id_str ? g_strdup(user_id_str) : NULL;
+			if(string_ids)
+				participant->user_id = janus_string_id_intern(participant->user_id_str);
 			participant->group = group;
 			participant->admin = admin;
 			g_free(participant->display);
@@ -7889,8 +8050,7 @@ static void *janus_audiobridge_handler(void *data) {
 				if(pauseevs && json_is_true(pauseevs))
 					g_atomic_int_set(&participant->paused_events, 1);
 			}
-			participant->audio_active_packets = 0;
-			participant->audio_dBov_sum = 0;
+			janus_audiolevel_context_reset(&participant->audiolevel_ctx);
 			participant->talking = FALSE;
 			participant->volume_gain = volume;
 			participant->stereo = audiobridge->spatial_audio;
@@ -7920,7 +8080,7 @@ static void *janus_audiobridge_handler(void *data) {
 			}
 #endif
 			g_hash_table_insert(audiobridge->participants,
-				string_ids ? (gpointer)g_strdup(participant->user_id_str) : (gpointer)janus_uint64_dup(participant->user_id),
+				(gpointer)janus_uint64_dup(participant->user_id),
 				participant);
 			/* Notify the other participants */
 			json_t *newuser = json_object();
@@ -8044,7 +8204,7 @@ static void *janus_audiobridge_handler(void *data) {
 				json_decref(event);
 				/* Actually leave the room... */
 				removed = g_hash_table_remove(audiobridge->participants,
-					string_ids ? (gpointer)participant->user_id_str : (gpointer)&participant->user_id);
+					(gpointer)&participant->user_id);
 				participant->room = NULL;
 			}
 			/* Get rid of queued packets */
@@ -8280,6 +8440,7 @@ static void *janus_audiobridge_handler(void *data) {
 			/* Was the audio level extension negotiated? */
 			participant->extmap_id = 0;
 			participant->dBov_level = 0;
+			janus_audiolevel_context_reset(&participant->audiolevel_ctx);
 			if(extmap_id > -1 && participant->room && participant->room->audiolevel_ext) {
 				/* Add an extmap attribute too */
 				participant->extmap_id = extmap_id;
@@ -8444,6 +8605,208 @@ static void janus_audiobridge_update_wav_header(janus_audiobridge_room *audiobri
 	}
 }
 
+/* Vectorized helpers for the hot loops in the mixer thread: we only accelerate
+ * the unity-gain paths (by far the most common case), since the gained and
+ * spatial paths must replicate the exact truncating integer divisions of the
+ * scalar code; the 16-bit conversion truncates just like the scalar loops do */
+static void janus_audiobridge_mixer_sum_c(opus_int32 *mix, const opus_int16 *pcm, int samples) {
+	int i = 0;
+	for(i=0; i<samples; i++)
+		mix[i] += pcm[i];
+}
+static void janus_audiobridge_mixer_sum32_c(opus_int32 *mix, const opus_int32 *sub, int samples) {
+	int i = 0;
+	for(i=0; i<samples; i++)
+		mix[i] += sub[i];
+}
+static void janus_audiobridge_mixer_sub_c(opus_int16 *out, const opus_int32 *mix, const opus_int16 *pcm, int samples) {
+	int i = 0;
+	for(i=0; i<samples; i++)
+		out[i] = mix[i] - (pcm ? pcm[i] : 0);
+}
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+__attribute__((target("avx2")))
+static void janus_audiobridge_mixer_sum_avx2(opus_int32 *mix, const opus_int16 *pcm, int samples) {
+	int i = 0;
+	for(i=0; i+16<=samples; i+=16) {
+		__m256i s = _mm256_loadu_si256((const __m256i *)&pcm[i]);
+		__m256i lo = _mm256_cvtepi16_epi32(_mm256_castsi256_si128(s));
+		__m256i hi = _mm256_cvtepi16_epi32(_mm256_extracti128_si256(s, 1));
+		_mm256_storeu_si256((__m256i *)&mix[i],
+			_mm256_add_epi32(_mm256_loadu_si256((const __m256i *)&mix[i]), lo));
+		_mm256_storeu_si256((__m256i *)&mix[i+8],
+			_mm256_add_epi32(_mm256_loadu_si256((const __m256i *)&mix[i+8]), hi));
+	}
+	for(; i<samples; i++)
+		mix[i] += pcm[i];
+}
+__attribute__((target("avx2")))
+static void janus_audiobridge_mixer_sum32_avx2(opus_int32 *mix, const opus_int32 *sub, int samples) {
+	int i = 0;
+	for(i=0; i+8<=samples; i+=8) {
+		_mm256_storeu_si256((__m256i *)&mix[i],
+			_mm256_add_epi32(_mm256_loadu_si256((const __m256i *)&mix[i]),
+				_mm256_loadu_si256((const __m256i *)&sub[i])));
+	}
+	for(; i<samples; i++)
+		mix[i] += sub[i];
+}
+__attribute__((target("avx2")))
+static void janus_audiobridge_mixer_sub_avx2(opus_int16 *out, const opus_int32 *mix, const opus_int16 *pcm, int samples) {
+	int i = 0;
+	for(i=0; i+16<=samples; i+=16) {
+		__m256i mlo = _mm256_loadu_si256((const __m256i *)&mix[i]);
+		__m256i mhi = _mm256_loadu_si256((const __m256i *)&mix[i+8]);
+		if(pcm != NULL) {
+			__m256i s = _mm256_loadu_si256((const __m256i *)&pcm[i]);
+			mlo = _mm256_sub_epi32(mlo, _mm256_cvtepi16_epi32(_mm256_castsi256_si128(s)));
+			mhi = _mm256_sub_epi32(mhi, _mm256_cvtepi16_epi32(_mm256_extracti128_si256(s, 1)));
+		}
+		/* Truncate to 16 bits, exactly like the scalar assignment does */
+		mlo = _mm256_srai_epi32(_mm256_slli_epi32(mlo, 16), 16);
+		mhi = _mm256_srai_epi32(_mm256_slli_epi32(mhi, 16), 16);
+		__m256i packed = _mm256_packs_epi32(mlo, mhi);
+		packed = _mm256_permute4x64_epi64(packed, 0xD8);
+		_mm256_storeu_si256((__m256i *)&out[i], packed);
+	}
+	for(; i<samples; i++)
+		out[i] = mix[i] - (pcm ? pcm[i] : 0);
+}
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+static void janus_audiobridge_mixer_sum_neon(opus_int32 *mix, const opus_int16 *pcm, int samples) {
+	int i = 0;
+	for(i=0; i+8<=samples; i+=8) {
+		int16x8_t s = vld1q_s16(&pcm[i]);
+		vst1q_s32(&mix[i], vaddw_s16(vld1q_s32(&mix[i]), vget_low_s16(s)));
+		vst1q_s32(&mix[i+4], vaddw_s16(vld1q_s32(&mix[i+4]), vget_high_s16(s)));
+	}
+	for(; i<samples; i++)
+		mix[i] += pcm[i];
+}
+static void janus_audiobridge_mixer_sum32_neon(opus_int32 *mix, const opus_int32 *sub, int samples) {
+	int i = 0;
+	for(i=0; i+4<=samples; i+=4)
+		vst1q_s32(&mix[i], vaddq_s32(vld1q_s32(&mix[i]), vld1q_s32(&sub[i])));
+	for(; i<samples; i++)
+		mix[i] += sub[i];
+}
+static void janus_audiobridge_mixer_sub_neon(opus_int16 *out, const opus_int32 *mix, const opus_int16 *pcm, int samples) {
+	int i = 0;
+	for(i=0; i+8<=samples; i+=8) {
+		int32x4_t mlo = vld1q_s32(&mix[i]);
+		int32x4_t mhi = vld1q_s32(&mix[i+4]);
+		if(pcm != NULL) {
+			int16x8_t s = vld1q_s16(&pcm[i]);
+			mlo = vsubw_s16(mlo, vget_low_s16(s));
+			mhi = vsubw_s16(mhi, vget_high_s16(s));
+		}
+		/* vmovn truncates to 16 bits, exactly like the scalar assignment does */
+		vst1q_s16(&out[i], vcombine_s16(vmovn_s32(mlo), vmovn_s32(mhi)));
+	}
+	for(; i<samples; i++)
+		out[i] = mix[i] - (pcm ? pcm[i] : 0);
+}
+#endif
+#ifdef HAVE_RNNOISE
+/* Same approach for the int16 <-> float conversions in the denoiser: RNNoise
+ * wants floats in the 16-bit range, so these are plain widen/truncate loops */
+static void janus_audiobridge_denoise_i2f_c(float *out, const opus_int16 *in, int samples) {
+	int i = 0;
+	for(i=0; i<samples; i++)
+		out[i] = in[i];
+}
+static void janus_audiobridge_denoise_f2i_c(opus_int16 *out, const float *in, int samples) {
+	int i = 0;
+	for(i=0; i<samples; i++)
+		out[i] = in[i];
+}
+#if defined(__x86_64__) && defined(__GNUC__)
+__attribute__((target("avx2")))
+static void janus_audiobridge_denoise_i2f_avx2(float *out, const opus_int16 *in, int samples) {
+	int i = 0;
+	for(i=0; i+16<=samples; i+=16) {
+		__m256i s = _mm256_loadu_si256((const __m256i *)&in[i]);
+		_mm256_storeu_ps(&out[i], _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_castsi256_si128(s))));
+		_mm256_storeu_ps(&out[i+8], _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(s, 1))));
+	}
+	for(; i<samples; i++)
+		out[i] = in[i];
+}
+__attribute__((target("avx2")))
+static void janus_audiobridge_denoise_f2i_avx2(opus_int16 *out, const float *in, int samples) {
+	int i = 0;
+	for(i=0; i+16<=samples; i+=16) {
+		/* cvttps truncates towards zero, just like the scalar cast does */
+		__m256i lo = _mm256_cvttps_epi32(_mm256_loadu_ps(&in[i]));
+		__m256i hi = _mm256_cvttps_epi32(_mm256_loadu_ps(&in[i+8]));
+		lo = _mm256_srai_epi32(_mm256_slli_epi32(lo, 16), 16);
+		hi = _mm256_srai_epi32(_mm256_slli_epi32(hi, 16), 16);
+		__m256i packed = _mm256_packs_epi32(lo, hi);
+		packed = _mm256_permute4x64_epi64(packed, 0xD8);
+		_mm256_storeu_si256((__m256i *)&out[i], packed);
+	}
+	for(; i<samples; i++)
+		out[i] = in[i];
+}
+#elif defined(__aarch64__)
+static void janus_audiobridge_denoise_i2f_neon(float *out, const opus_int16 *in, int samples) {
+	int i = 0;
+	for(i=0; i+8<=samples; i+=8) {
+		int16x8_t s = vld1q_s16(&in[i]);
+		vst1q_f32(&out[i], vcvtq_f32_s32(vmovl_s16(vget_low_s16(s))));
+		vst1q_f32(&out[i+4], vcvtq_f32_s32(vmovl_s16(vget_high_s16(s))));
+	}
+	for(; i<samples; i++)
+		out[i] = in[i];
+}
+static void janus_audiobridge_denoise_f2i_neon(opus_int16 *out, const float *in, int samples) {
+	int i = 0;
+	for(i=0; i+8<=samples; i+=8) {
+		/* vcvtq truncates towards zero, just like the scalar cast does */
+		int32x4_t lo = vcvtq_s32_f32(vld1q_f32(&in[i]));
+		int32x4_t hi = vcvtq_s32_f32(vld1q_f32(&in[i+4]));
+		vst1q_s16(&out[i], vcombine_s16(vmovn_s32(lo), vmovn_s32(hi)));
+	}
+	for(; i<samples; i++)
+		out[i] = in[i];
+}
+#endif
+#endif
+/* Kernels the mixer thread will actually use (runtime dispatched at startup) */
+static void (*janus_audiobridge_mixer_sum)(opus_int32 *mix, const opus_int16 *pcm, int samples) = janus_audiobridge_mixer_sum_c;
+static void (*janus_audiobridge_mixer_sum32)(opus_int32 *mix, const opus_int32 *sub, int samples) = janus_audiobridge_mixer_sum32_c;
+static void (*janus_audiobridge_mixer_sub)(opus_int16 *out, const opus_int32 *mix, const opus_int16 *pcm, int samples) = janus_audiobridge_mixer_sub_c;
+#ifdef HAVE_RNNOISE
+static void (*janus_audiobridge_denoise_i2f)(float *out, const opus_int16 *in, int samples) = janus_audiobridge_denoise_i2f_c;
+static void (*janus_audiobridge_denoise_f2i)(opus_int16 *out, const float *in, int samples) = janus_audiobridge_denoise_f2i_c;
+#endif
+static void janus_audiobridge_mixer_setup(void) {
+#if defined(__x86_64__) && defined(__GNUC__)
+	if(__builtin_cpu_supports("avx2")) {
+		janus_audiobridge_mixer_sum = janus_audiobridge_mixer_sum_avx2;
+		janus_audiobridge_mixer_sum32 = janus_audiobridge_mixer_sum32_avx2;
+		janus_audiobridge_mixer_sub = janus_audiobridge_mixer_sub_avx2;
+#ifdef HAVE_RNNOISE
+		janus_audiobridge_denoise_i2f = janus_audiobridge_denoise_i2f_avx2;
+		janus_audiobridge_denoise_f2i = janus_audiobridge_denoise_f2i_avx2;
+#endif
+		JANUS_LOG(LOG_INFO, "AudioBridge mixer will use the AVX2 kernels\n");
+	}
+#elif defined(__aarch64__)
+	/* NEON is part of the baseline on aarch64 */
+	janus_audiobridge_mixer_sum = janus_audiobridge_mixer_sum_neon;
+	janus_audiobridge_mixer_sum32 = janus_audiobridge_mixer_sum32_neon;
+	janus_audiobridge_mixer_sub = janus_audiobridge_mixer_sub_neon;
+#ifdef HAVE_RNNOISE
+	janus_audiobridge_denoise_i2f = janus_audiobridge_denoise_i2f_neon;
+	janus_audiobridge_denoise_f2i = janus_audiobridge_denoise_f2i_neon;
+#endif
+	JANUS_LOG(LOG_INFO, "AudioBridge mixer will use the NEON kernels\n");
+#endif
+}
+
 /* Thread to mix the contributions from all participants */
 static void *janus_audiobridge_mixer_thread(void *data) {
 	JANUS_LOG(LOG_VERB, "Audio bridge thread starting...\n");
@@ -8508,6 +8871,37 @@ static void *janus_audiobridge_mixer_thread(void *data) {
 		}
 	}
 
+	/* Muted participants all receive the same full mix, so we encode it once on a
+	 * shared encoder and fan the frame out, instead of encoding it per listener:
+	 * only listeners using the default encoder settings are eligible, though */
+	int encerror = 0;
+	OpusEncoder *listener_encoder = opus_encoder_create(audiobridge->sampling_rate,
+		audiobridge->spatial_audio ? 2 : 1, OPUS_APPLICATION_VOIP, &encerror);
+	if(encerror != OPUS_OK) {
+		JANUS_LOG(LOG_WARN, "Error creating the shared listeners encoder, will encode per participant... (%d)\n", encerror);
+		listener_encoder = NULL;
+	} else {
+		if(audiobridge->sampling_rate == 8000) {
+			opus_encoder_ctl(listener_encoder, OPUS_SET_MAX_BANDWIDTH(OPUS_BANDWIDTH_NARROWBAND));
+		} else if(audiobridge->sampling_rate == 12000) {
+			opus_encoder_ctl(listener_encoder, OPUS_SET_MAX_BANDWIDTH(OPUS_BANDWIDTH_MEDIUMBAND));
+		} else if(audiobridge->sampling_rate == 16000) {
+			opus_encoder_ctl(listener_encoder, OPUS_SET_MAX_BANDWIDTH(OPUS_BANDWIDTH_WIDEBAND));
+		} else if(audiobridge->sampling_rate == 24000) {
+			opus_encoder_ctl(listener_encoder, OPUS_SET_MAX_BANDWIDTH(OPUS_BANDWIDTH_SUPERWIDEBAND));
+		} else if(audiobridge->sampling_rate == 48000) {
+			opus_encoder_ctl(listener_encoder, OPUS_SET_MAX_BANDWIDTH(OPUS_BANDWIDTH_FULLBAND));
+		} else {
+			JANUS_LOG(LOG_WARN, "Unsupported sampling rate %d, setting 16kHz\n", audiobridge->sampling_rate);
+			opus_encoder_ctl(listener_encoder, OPUS_SET_MAX_BANDWIDTH(OPUS_BANDWIDTH_WIDEBAND));
+		}
+		opus_encoder_ctl(listener_encoder, OPUS_SET_COMPLEXITY(DEFAULT_COMPLEXITY));
+		if(audiobridge->default_bitrate > 0)
+			opus_encoder_ctl(listener_encoder, OPUS_SET_BITRATE(audiobridge->default_bitrate));
+	}
+	opus_int32 listener_len = 0;
+	uint8_t listener_payload[1500];
+
 	/* Base RTP packets, in case there are forwarders involved */
 	gboolean have_opus[JANUS_AUDIOBRIDGE_MAX_GROUPS+1],
 		have_alaw[JANUS_AUDIOBRIDGE_MAX_GROUPS+1],
@@ -8517,6 +8911,9 @@ static void *janus_audiobridge_mixer_thread(void *data) {
 	/* In case we need G.711 forwarders */
 	uint8_t *rtpalaw = g_malloc0((12+G711_SAMPLES) * (groups_num+1)),
 			*rtpulaw = g_malloc0((12+G711_SAMPLES) * (groups_num+1));
+	/* All this room's forwarders share the same socket, so we batch the packets
+	 * they generate in a tick and send them with a single syscall, when we can */
+	janus_rtp_forwarder_batch *fwd_batch = g_malloc0(sizeof(janus_rtp_forwarder_batch));
 
 	/* Timer */
 	struct timeval now, before;
@@ -8524,6 +8921,26 @@ static void *janus_audiobridge_mixer_thread(void *data) {
 	now.tv_sec = before.tv_sec;
 	now.tv_usec = before.tv_usec;
 	time_t passed, d_s, d_us;
+#ifdef __linux__
+	/* Pace the mixer with a periodic timerfd on absolute monotonic deadlines, when
+	 * available: contrary to sleep-based pacing, the kernel keeps track of the
+	 * expirations we may have missed, so the tick doesn't drift under load */
+	int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	if(tfd != -1) {
+		struct itimerspec tspec = { { 0, 20000000 }, { 0, 20000000 } };
+		if(timerfd_settime(tfd, 0, &tspec, NULL) < 0) {
+			close(tfd);
+			tfd = -1;
+		}
+	}
+	if(tfd == -1)
+		JANUS_LOG(LOG_WARN, "Error creating mixer timerfd for room %s, falling back to sleep-based pacing... %d (%s)\n",
+			audiobridge->room_id_str, errno, g_strerror(errno));
+	uint64_t owed = 0;
+#endif
+	/* We also track how late each tick fires with respect to the ideal
+	 * 20ms schedule, so that starvation shows up in the room histogram */
+	gint64 tick_deadline = janus_get_monotonic_time() + 20000;
 
 	/* RTP */
 	guint16 seq = 0;
@@ -8536,17 +8953,63 @@ static void *janus_audiobridge_mixer_thread(void *data) {
 	int lgain = 0, rgain = 0, diff = 0;
 	while(!g_atomic_int_get(&stopping) && !g_atomic_int_get(&audiobridge->destroyed)) {
 		/* See if it's time to prepare a frame */
-		gettimeofday(&now, NULL);
-		d_s = now.tv_sec - before.tv_sec;
-		d_us = now.tv_usec - before.tv_usec;
-		if(d_us < 0) {
-			d_us += 1000000;
-			--d_s;
-		}
-		passed = d_s*1000000 + d_us;
-		if(passed < 15000) {	/* Let's wait about 15ms at max */
-			g_usleep(5000);
-			continue;
+#ifdef __linux__
+		if(tfd != -1) {
+			if(owed > 0) {
+				/* We're catching up on ticks we missed, mix right away */
+				owed--;
+			} else {
+				uint64_t expirations = 0;
+				if(read(tfd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+					g_usleep(5000);
+					continue;
+				}
+				if(expirations > 1) {
+					/* We were scheduled late and missed one or more deadlines:
+					 * those are owed frames, which we'll mix back to back */
+					owed = expirations - 1;
+					if(owed > 25) {
+						/* More than half a second behind: bursting that much stale
+						 * audio wouldn't help anyone, drop the backlog and resync */
+						JANUS_LOG(LOG_WARN, "Mixer thread for room %s fell %"SCNu64" ticks behind, resyncing\n",
+							audiobridge->room_id_str, owed);
+						g_atomic_int_inc(&audiobridge->mixer_resyncs);
+						tick_deadline += 20000*owed;
+						owed = 0;
+					}
+				}
+			}
+		} else
+#endif
+		{
+			gettimeofday(&now, NULL);
+			d_s = now.tv_sec - before.tv_sec;
+			d_us = now.tv_usec - before.tv_usec;
+			if(d_us < 0) {
+				d_us += 1000000;
+				--d_s;
+			}
+			passed = d_s*1000000 + d_us;
+			if(passed < 15000) {	/* Let's wait about 15ms at max */
+				g_usleep(5000);
+				continue;
+			}
+		}
+		/* Update the tick latency histogram, before we start mixing */
+		gint64 tick_late = janus_get_monotonic_time() - tick_deadline;
+		if(tick_late < 5000)
+			g_atomic_int_inc(&audiobridge->mixer_latency[0]);
+		else if(tick_late < 20000)
+			g_atomic_int_inc(&audiobridge->mixer_latency[1]);
+		else if(tick_late < 80000)
+			g_atomic_int_inc(&audiobridge->mixer_latency[2]);
+		else
+			g_atomic_int_inc(&audiobridge->mixer_latency[3]);
+		tick_deadline += 20000;
+		if(tick_late > 500000) {
+			/* The fallback pacing fell very far behind too, resync the schedule */
+			g_atomic_int_inc(&audiobridge->mixer_resyncs);
+			tick_deadline = janus_get_monotonic_time() + 20000;
 		}
 		/* If we're recording to a wav file, update the info */
 		if(g_atomic_int_get(&audiobridge->record) && !g_atomic_int_get(&audiobridge->wav_header_added)) {
@@ -8602,8 +9065,7 @@ static void *janus_audiobridge_mixer_thread(void *data) {
 			ps = ps->next;
 		}
 		janus_mutex_unlock_nodebug(&audiobridge->mutex);
-		for(i=0; i<samples; i++)
-			buffer[i] = 0;
+		memset(buffer, 0, samples*sizeof(opus_int32));
 		if(groups_num > 0)
 			memset(groupBuffers, 0, groupBuffersSize);
 		ps = participants_list;
@@ -8611,13 +9073,13 @@ static void *janus_audiobridge_mixer_thread(void *data) {
 			janus_audiobridge_participant *p = (janus_audiobridge_participant *)ps->data;
 			janus_mutex_lock(&p->qmutex);
 			if(g_atomic_int_get(&p->destroyed) || !p->session || !g_atomic_int_get(&p->session->started) ||
-					!g_atomic_int_get(&p->active) || p->muted || g_atomic_int_get(&p->suspended) || !p->inbuf) {
+					!g_atomic_int_get(&p->active) || p->muted || g_atomic_int_get(&p->suspended) ||
+					g_atomic_int_get(&p->inbuf_count) == 0) {
 				janus_mutex_unlock(&p->qmutex);
 				ps = ps->next;
 				continue;
 			}
-			GList *peek = g_list_first(p->inbuf);
-			janus_audiobridge_rtp_relay_packet *pkt = (janus_audiobridge_rtp_relay_packet *)(peek ? peek->data : NULL);
+			janus_audiobridge_rtp_relay_packet *pkt = &p->inbuf[p->inbuf_head];
 			if(pkt != NULL && !pkt->silence) {
 				if(p->codec != JANUS_AUDIOCODEC_OPUS && audiobridge->sampling_rate != 8000) {
 					/* Upsample this to whatever the mixer needs */
@@ -8634,12 +9096,11 @@ static void *janus_audiobridge_mixer_thread(void *data) {
 				if(groups_num == 0) {
 					/* Add to the main mix */
 					if(!p->stereo) {
-						for(i=0; i<samples; i++) {
-							if(p->volume_gain == 100) {
-								buffer[i] += curBuffer[i];
-							} else {
+						if(p->volume_gain == 100) {
+							janus_audiobridge_mixer_sum(buffer, curBuffer, samples);
+						} else {
+							for(i=0; i<samples; i++)
 								buffer[i] += (curBuffer[i]*p->volume_gain)/100;
-							}
 						}
 					} else {
 						diff = 50 - p->spatial_position;
@@ -8681,12 +9142,11 @@ static void *janus_audiobridge_mixer_thread(void *data) {
 					/* Add to the group submix */
 					int index = p->group-1;
 					if(!p->stereo) {
-						for(i=0; i<samples; i++) {
-							if(p->volume_gain == 100) {
-								*(groupBuffers + index*samples + i) += curBuffer[i];
-							} else {
+						if(p->volume_gain == 100) {
+							janus_audiobridge_mixer_sum(groupBuffers + index*samples, curBuffer, samples);
+						} else {
+							for(i=0; i<samples; i++)
 								*(groupBuffers + index*samples + i) += (curBuffer[i]*p->volume_gain)/100;
-							}
 						}
 					} else {
 						diff = 50 - p->spatial_position;
@@ -8794,22 +9254,20 @@ static void *janus_audiobridge_mixer_thread(void *data) {
 				}
 				if(groups_num == 0) {
 					/* Add to the main mix */
-					for(i=0; i<samples; i++) {
-						if(p->volume_gain == 100) {
-							buffer[i] += resampled[i];
-						} else {
+					if(p->volume_gain == 100) {
+						janus_audiobridge_mixer_sum(buffer, resampled, samples);
+					} else {
+						for(i=0; i<samples; i++)
 							buffer[i] += (resampled[i]*p->volume_gain)/100;
-						}
 					}
 				} else {
 					/* Add to the group submix */
 					index = p->group-1;
-					for(i=0; i<samples; i++) {
-						if(p->volume_gain == 100) {
-							*(groupBuffers + index*samples + i) += resampled[i];
-						} else {
+					if(p->volume_gain == 100) {
+						janus_audiobridge_mixer_sum(groupBuffers + index*samples, resampled, samples);
+					} else {
+						for(i=0; i<samples; i++)
 							*(groupBuffers + index*samples + i) += (resampled[i]*p->volume_gain)/100;
-						}
 					}
 				}
 				ps = ps->next;
@@ -8820,17 +9278,13 @@ static void *janus_audiobridge_mixer_thread(void *data) {
 		/* If groups are in use, put them together in the main mix */
 		if(groups_num > 0) {
 			/* Mix all submixes */
-			for(index=0; index<groups_num; index++) {
-				for(i=0; i<samples; i++)
-					buffer[i] += *(groupBuffers + index*samples + i);
-			}
+			for(index=0; index<groups_num; index++)
+				janus_audiobridge_mixer_sum32(buffer, groupBuffers + index*samples, samples);
 		}
 		/* Are we recording the mix? (only do it if there's someone in, though...) */
 		if(audiobridge->recording != NULL && g_list_length(participants_list) > 0) {
-			for(i=0; i<samples; i++) {
-				/* FIXME Smoothen/Normalize instead of truncating? */
-				outBuffer[i] = buffer[i];
-			}
+			/* FIXME Smoothen/Normalize instead of truncating? */
+			janus_audiobridge_mixer_sub(outBuffer, buffer, NULL, samples);
 			fwrite(outBuffer, sizeof(opus_int16), samples, audiobridge->recording);
 			/* Every 5 seconds we update the wav header */
 			gint64 now = janus_get_monotonic_time();
@@ -8852,6 +9306,7 @@ static void *janus_audiobridge_mixer_thread(void *data) {
 			}
 		}
 		/* Send proper packet to each participant (remove own contribution) */
+		listener_len = 0;	/* We'll encode the shared listeners frame lazily, once per tick */
 		ps = participants_list;
 		while(ps) {
 			janus_audiobridge_participant *p = (janus_audiobridge_participant *)ps->data;
@@ -8862,45 +9317,90 @@ static void *janus_audiobridge_mixer_thread(void *data) {
 				continue;
 			}
 			janus_audiobridge_rtp_relay_packet *pkt = NULL;
-			janus_mutex_lock(&p->qmutex);
-			if(g_atomic_int_get(&p->active) && !p->muted && p->inbuf) {
-				GList *first = g_list_first(p->inbuf);
-				pkt = (janus_audiobridge_rtp_relay_packet *)(first ? first->data : NULL);
-				p->inbuf = g_list_delete_link(p->inbuf, first);
+			janus_mutex_lock_spin(&p->qmutex);
+			if(g_atomic_int_get(&p->active) && !p->muted && g_atomic_int_get(&p->inbuf_count) > 0) {
+				pkt = &p->inbuf[p->inbuf_head];
+				p->inbuf_head = (p->inbuf_head + 1) % QUEUE_IN_RING_SIZE;
+				g_atomic_int_add(&p->inbuf_count, -1);
 			}
 			janus_mutex_unlock(&p->qmutex);
+			if(listener_encoder != NULL && pkt == NULL && p->muted && p->codec == JANUS_AUDIOCODEC_OPUS &&
+					!p->fec && p->expected_loss == 0 && p->opus_complexity == DEFAULT_COMPLEXITY &&
+					p->opus_bitrate == audiobridge->default_bitrate && p->stereo == audiobridge->spatial_audio) {
+				/* This is a muted listener with default encoder settings: rather than
+				 * encoding the same full mix on their own encoder, we encode it once
+				 * on the shared encoder and fan the resulting frame out as is */
+				if(listener_len == 0) {
+					/* FIXME Smoothen/Normalize instead of truncating? */
+					janus_audiobridge_mixer_sub(outBuffer, buffer, NULL, samples);
+					listener_len = opus_encode(listener_encoder, outBuffer,
+						audiobridge->spatial_audio ? samples/2 : samples, listener_payload, sizeof(listener_payload));
+					if(listener_len < 0) {
+						JANUS_LOG(LOG_ERR, "[Opus] Ops! got an error encoding the shared listeners frame: %d (%s)\n",
+							listener_len, opus_strerror(listener_len));
+					}
+				}
+				if(listener_len > 0) {
+					janus_audiobridge_rtp_relay_packet *mixedpkt = g_malloc(sizeof(janus_audiobridge_rtp_relay_packet));
+					mixedpkt->data = g_malloc(listener_len);
+					memcpy(mixedpkt->data, listener_payload, listener_len);
+					mixedpkt->length = listener_len;	/* This is the payload length, as the frame is encoded already */
+					mixedpkt->timestamp = ts;
+					mixedpkt->seq_number = seq;
+					mixedpkt->ssrc = audiobridge->room_ssrc;
+					mixedpkt->silence = FALSE;
+					mixedpkt->encoded = TRUE;
+					g_async_queue_push(p->outbuf, mixedpkt);
+					/* Schedule this participant on the codec pool, unless a worker is still serving them */
+					if(participant_pool != NULL && g_atomic_int_compare_and_exchange(&p->processing, 0, 1)) {
+						GError *pperror = NULL;
+						janus_refcount_increase(&p->ref);
+						g_thread_pool_push(participant_pool, p, &pperror);
+						if(pperror != NULL) {
+							JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to schedule participant on the codec pool...\n",
+								pperror->code, pperror->message ? pperror->message : "??");
+							g_error_free(pperror);
+							g_atomic_int_set(&p->processing, 0);
+							janus_refcount_decrease(&p->ref);
+						}
+					}
+					janus_refcount_decrease(&p->ref);
+					ps = ps->next;
+					continue;
+				}
+			}
 			/* Remove the participant's own contribution */
 			curBuffer = (opus_int16 *)((pkt && pkt->length && !pkt->silence) ? pkt->data : NULL);
-			if(!p->stereo) {
-				for(i=0; i<samples; i++) {
-					if(p->volume_gain == 100)
-						sumBuffer[i] = buffer[i] - (curBuffer ? (curBuffer[i]) : 0);
-					else
-						sumBuffer[i] = buffer[i] - (curBuffer ? (curBuffer[i]*p->volume_gain)/100 : 0);
-				}
+			if(!p->stereo && p->volume_gain == 100) {
+				/* FIXME Smoothen/Normalize instead of truncating? */
+				janus_audiobridge_mixer_sub(outBuffer, buffer, curBuffer, samples);
 			} else {
-				diff = 50 - p->spatial_position;
-				lgain = 50 + diff;
-				rgain = 50 - diff;
-				for(i=0; i<samples; i++) {
-					if(i%2 == 0) {
-						if(lgain == 100) {
-							sumBuffer[i] = buffer[i] - (curBuffer ? (curBuffer[i]) : 0);
-						} else {
-							sumBuffer[i] = buffer[i] - (curBuffer ? (curBuffer[i]*lgain)/100 : 0);
-						}
-					} else {
-						if(rgain == 100) {
-							sumBuffer[i] = buffer[i] - (curBuffer ? (curBuffer[i]) : 0);
+				if(!p->stereo) {
+					for(i=0; i<samples; i++)
+						sumBuffer[i] = buffer[i] - (curBuffer ? (curBuffer[i]*p->volume_gain)/100 : 0);
+				} else {
+					diff = 50 - p->spatial_position;
+					lgain = 50 + diff;
+					rgain = 50 - diff;
+					for(i=0; i<samples; i++) {
+						if(i%2 == 0) {
+							if(lgain == 100) {
+								sumBuffer[i] = buffer[i] - (curBuffer ? (curBuffer[i]) : 0);
+							} else {
+								sumBuffer[i] = buffer[i] - (curBuffer ? (curBuffer[i]*lgain)/100 : 0);
+							}
 						} else {
-							sumBuffer[i] = buffer[i] - (curBuffer ? (curBuffer[i]*rgain)/100 : 0);
+							if(rgain == 100) {
+								sumBuffer[i] = buffer[i] - (curBuffer ? (curBuffer[i]) : 0);
+							} else {
+								sumBuffer[i] = buffer[i] - (curBuffer ? (curBuffer[i]*rgain)/100 : 0);
+							}
 						}
 					}
 				}
-			}
-			for(i=0; i<samples; i++)
 				/* FIXME Smoothen/Normalize instead of truncating? */
-				outBuffer[i] = sumBuffer[i];
+				janus_audiobridge_mixer_sub(outBuffer, sumBuffer, NULL, samples);
+			}
 			/* Enqueue this mixed frame for encoding in the participant thread */
 			janus_audiobridge_rtp_relay_packet *mixedpkt = g_malloc(sizeof(janus_audiobridge_rtp_relay_packet));
 			mixedpkt->data = g_malloc(samples*2);
@@ -8924,13 +9424,23 @@ static void *janus_audiobridge_mixer_thread(void *data) {
 			mixedpkt->seq_number = seq;
 			mixedpkt->ssrc = audiobridge->room_ssrc;
 			mixedpkt->silence = FALSE;
+			mixedpkt->encoded = FALSE;
 			g_async_queue_push(p->outbuf, mixedpkt);
-			if(pkt) {
-				g_free(pkt->data);
-				pkt->data = NULL;
-				g_free(pkt);
-				pkt = NULL;
+			/* Schedule this participant on the codec pool, unless a worker is still serving them */
+			if(participant_pool != NULL && g_atomic_int_compare_and_exchange(&p->processing, 0, 1)) {
+				GError *pperror = NULL;
+				janus_refcount_increase(&p->ref);
+				g_thread_pool_push(participant_pool, p, &pperror);
+				if(pperror != NULL) {
+					JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to schedule participant on the codec pool...\n",
+						pperror->code, pperror->message ? pperror->message : "??");
+					g_error_free(pperror);
+					g_atomic_int_set(&p->processing, 0);
+					janus_refcount_decrease(&p->ref);
+				}
 			}
+			/* Nothing to free: the ring slot we popped will be reused in place */
+			pkt = NULL;
 			janus_refcount_decrease(&p->ref);
 			ps = ps->next;
 		}
@@ -8958,8 +9468,7 @@ static void *janus_audiobridge_mixer_thread(void *data) {
 			if(go_on) {
 				/* By default, let's send the mixed frame to everybody */
 				if(groups_num == 0) {
-					for(i=0; i<samples; i++)
-						outBuffer[i] = buffer[i];
+					janus_audiobridge_mixer_sub(outBuffer, buffer, NULL, samples);
 					have_opus[0] = FALSE;
 					have_alaw[0] = FALSE;
 					have_ulaw[0] = FALSE;
@@ -8983,13 +9492,11 @@ static void *janus_audiobridge_mixer_thread(void *data) {
 					if(groups_num > 0) {
 						if(rfm->group == 0) {
 							/* We're forwarding the main mix */
-							for(i=0; i<samples; i++)
-								outBuffer[i] = buffer[i];
+							janus_audiobridge_mixer_sub(outBuffer, buffer, NULL, samples);
 						} else {
 							/* We're forwarding a group mix */
 							index = rfm->group-1;
-							for(i=0; i<samples; i++)
-								outBuffer[i] = *(groupBuffers + index*samples + i);
+							janus_audiobridge_mixer_sub(outBuffer, groupBuffers + index*samples, NULL, samples);
 						}
 					}
 					if(rfm->codec == JANUS_AUDIOCODEC_OPUS) {
@@ -9048,9 +9555,10 @@ static void *janus_audiobridge_mixer_thread(void *data) {
 					rtph->seq_number = htons(rfm->seq_number);
 					rfm->timestamp += (rfm->codec == JANUS_AUDIOCODEC_OPUS ? OPUS_SAMPLES : G711_SAMPLES);
 					rtph->timestamp = htonl(rfm->timestamp);
-					/* Forward the packet */
-					janus_rtp_forwarder_send_rtp(rf, (char *)rtph, length+12, -1);
+					/* Queue the packet, we'll send the whole batch at once */
+					janus_rtp_forwarder_send_rtp_batched(rf, (char *)rtph, length+12, -1, fwd_batch);
 				}
+				janus_rtp_forwarder_batch_flush(fwd_batch);
 			}
 		}
 		janus_mutex_unlock(&audiobridge->rtp_mutex);
@@ -9063,7 +9571,14 @@ static void *janus_audiobridge_mixer_thread(void *data) {
 	g_free(rtpbuffer);
 	g_free(rtpalaw);
 	g_free(rtpulaw);
+	g_free(fwd_batch);
 	g_free(groupBuffers);
+#ifdef __linux__
+	if(tfd != -1)
+		close(tfd);
+#endif
+	if(listener_encoder)
+		opus_encoder_destroy(listener_encoder);
 	if(groupEncoders) {
 		for(index=0; index<groups_num; index++) {
 			if(groupEncoders[index])
@@ -9079,215 +9594,261 @@ static void *janus_audiobridge_mixer_thread(void *data) {
 	return NULL;
 }
 
-/* Thread to encode a mixed frame and send it to a specific participant */
-static void *janus_audiobridge_participant_thread(void *data) {
-	JANUS_LOG(LOG_VERB, "AudioBridge Participant thread starting...\n");
-	janus_audiobridge_participant *participant = (janus_audiobridge_participant *)data;
-	if(!participant) {
-		JANUS_LOG(LOG_ERR, "Invalid participant!\n");
-		g_thread_unref(g_thread_self());
-		return NULL;
+/* Helper to get the ring slot where the next decoded frame can be written:
+ * the slot is not visible to the mixer until the publish helper is called,
+ * so a failed decode simply leaves it around for the next frame to reuse */
+static janus_audiobridge_rtp_relay_packet *janus_audiobridge_participant_inbuf_slot(janus_audiobridge_participant *participant) {
+	if(participant->inbuf == NULL) {
+		/* Lazily allocate the ring and the PCM storage backing its slots */
+		participant->inbuf = g_malloc0(QUEUE_IN_RING_SIZE*sizeof(janus_audiobridge_rtp_relay_packet));
+		participant->inbuf_data = g_malloc0(QUEUE_IN_RING_SIZE*BUFFER_SAMPLES*sizeof(opus_int16));
+		int i = 0;
+		for(i=0; i<QUEUE_IN_RING_SIZE; i++)
+			participant->inbuf[i].data = (janus_rtp_header *)(participant->inbuf_data + i*BUFFER_SAMPLES);
 	}
-	JANUS_LOG(LOG_VERB, "Thread is for participant %s (%s)\n",
-		participant->user_id_str, participant->display ? participant->display : "??");
-	janus_audiobridge_session *session = participant->session;
+	janus_mutex_lock_spin(&participant->qmutex);
+	/* Do not let queue-in grow too much */
+	int count = g_atomic_int_get(&participant->inbuf_count);
+	if(count > QUEUE_IN_MAX_PACKETS) {
+		JANUS_LOG(LOG_WARN, "Participant queue-in contains too many packets, clearing now (count=%d)\n", count);
+		janus_audiobridge_participant_clear_inbuf(participant);
+	}
+	int slot = (participant->inbuf_head + g_atomic_int_get(&participant->inbuf_count)) % QUEUE_IN_RING_SIZE;
+	janus_mutex_unlock(&participant->qmutex);
+	janus_audiobridge_rtp_relay_packet *pkt = &participant->inbuf[slot];
+	/* The mixer may read up to a full mix size, so clear the whole slot */
+	memset(pkt->data, 0, BUFFER_SAMPLES*sizeof(opus_int16));
+	return pkt;
+}
+/* Helper to publish a decoded frame to the mixer, in O(1) and with no copies */
+static void janus_audiobridge_participant_inbuf_publish(janus_audiobridge_participant *participant, janus_audiobridge_rtp_relay_packet *pkt) {
+	janus_mutex_lock_spin(&participant->qmutex);
+	int tail = (participant->inbuf_head + g_atomic_int_get(&participant->inbuf_count)) % QUEUE_IN_RING_SIZE;
+	if(&participant->inbuf[tail] == pkt) {
+		g_atomic_int_add(&participant->inbuf_count, 1);
+	}
+	/* If the slot doesn't match, the queue was cleared while we were
+	 * decoding (e.g., because of a suspend), so we drop the frame */
+	janus_mutex_unlock(&participant->qmutex);
+}
 
-	/* Output buffer */
-	janus_audiobridge_rtp_relay_packet *outpkt = g_malloc(sizeof(janus_audiobridge_rtp_relay_packet));
-	outpkt->data = g_malloc0(1500);
-	outpkt->ssrc = 0;
-	outpkt->timestamp = 0;
-	outpkt->seq_number = 0;
-	outpkt->length = 0;
-	outpkt->silence = FALSE;
+/* Helper to decode pending audio from a participant and encode the outgoing
+ * mixes: this used to run in a dedicated thread per participant, but is now
+ * scheduled on a shared codec thread pool by the mixer thread at every clock
+ * tick; the "processing" flag guarantees that no more than one worker ever
+ * serves the same participant, so per-participant ordering is preserved */
+static void janus_audiobridge_participant_process(janus_audiobridge_participant *participant) {
+	janus_audiobridge_session *session = participant->session;
+	if(session == NULL || g_atomic_int_get(&session->destroyed) || g_atomic_int_get(&participant->suspended))
+		return;
+	if(participant->outpkt == NULL) {
+		/* Output scratch buffer, kept across runs */
+		janus_audiobridge_rtp_relay_packet *outpkt = g_malloc(sizeof(janus_audiobridge_rtp_relay_packet));
+		outpkt->data = g_malloc0(1500);
+		outpkt->ssrc = 0;
+		outpkt->timestamp = 0;
+		outpkt->seq_number = 0;
+		outpkt->length = 0;
+		outpkt->silence = FALSE;
+		participant->outpkt = outpkt;
+	}
+	janus_audiobridge_rtp_relay_packet *outpkt = (janus_audiobridge_rtp_relay_packet *)participant->outpkt;
 	uint8_t *payload = (uint8_t *)outpkt->data;
-
 	JitterBufferPacket jbp = {0};
 	janus_audiobridge_buffer_packet *bpkt = NULL;
 	janus_audiobridge_rtp_relay_packet *pkt = NULL;
 	janus_audiobridge_rtp_relay_packet *mixedpkt = NULL;
-	int jitter_ticks = 0;
 	janus_rtp_header *rtp = NULL;
-	gint64 now = janus_get_monotonic_time(), before = now;
-	gboolean first = TRUE;
 	int ret = 0;
-	int lost_packets_gap = 0;
-
-	/* Start working: check both the incoming queue (to decode and queue) and the outgoing one (to encode and send) */
-	while(!g_atomic_int_get(&stopping) && g_atomic_int_get(&session->destroyed) == 0) {
-		janus_mutex_lock(&participant->suspend_cond_mutex);
-		while(g_atomic_int_get(&participant->suspended)) {
-			g_cond_wait(&participant->suspend_cond, &participant->suspend_cond_mutex);
-			before = janus_get_monotonic_time();
-			participant->context.seq_reset = TRUE;
-			first = TRUE;
-			/* Clear the output queue since it might contain old packets and break RTP sequence */
-			janus_audiobridge_participant_clear_outbuf(participant);
-		}
-		janus_mutex_unlock(&participant->suspend_cond_mutex);
-		/* Start with packets to decode and queue for the mixer */
-		now = janus_get_monotonic_time();
-		/* Start by reading packets to decode from the jitter buffer on a clock */
-		if(now - before >= 18000) {
-			before += 20000;
-			if(participant->jitter) {
-				janus_mutex_lock(&participant->qmutex);
-				ret = jitter_buffer_get(participant->jitter, &jbp, participant->codec == JANUS_AUDIOCODEC_OPUS ? 960 : 160, NULL);
-				jitter_ticks++;
-				/* Adjust the buffer size every 50 ticks (~1 second) */
-				if(jitter_ticks == JITTER_BUFFER_MAX_PACKETS) {
-					jitter_buffer_update_delay(participant->jitter, NULL, NULL);
-					jitter_ticks = 0;
-				}
-				jitter_buffer_tick(participant->jitter);
-				janus_mutex_unlock(&participant->qmutex);
-				if(ret != JITTER_BUFFER_OK) {
-					/* We didn't get a packet: check if PLC can help */
-					if(!first && participant->codec == JANUS_AUDIOCODEC_OPUS && lost_packets_gap <= JITTER_BUFFER_MAX_GAP_SIZE && !participant->muted) {
-						lost_packets_gap++;
-						if(!g_atomic_int_compare_and_exchange(&participant->decoding, 0, 1)) {
-							/* This means we're cleaning up, so don't try to decode */
-							janus_audiobridge_buffer_packet_destroy(bpkt);
-							break;
-						}
-						int32_t output_samples = 0;
-						opus_decoder_ctl(participant->decoder, OPUS_GET_LAST_PACKET_DURATION(&output_samples));
-						/* Allocate a fake packet we can queue */
-						pkt = g_malloc(sizeof(janus_audiobridge_rtp_relay_packet));
-						pkt->data = g_malloc0(BUFFER_SAMPLES * sizeof(opus_int16));
-						pkt->ssrc = 0;
-						pkt->timestamp = participant->last_timestamp + OPUS_SAMPLES;
-						pkt->seq_number = participant->last_seq + 1;
-						/* This is a redundant packet, so we can't parse any extension info */
-						pkt->silence = FALSE;
-						janus_audiobridge_participant_istalking(session, participant, NULL, NULL);
-						pkt->length = opus_decode(participant->decoder, NULL, 0, (opus_int16 *)pkt->data, output_samples, 0);
-#ifdef HAVE_RNNOISE
-						/* Check if we need to denoise this packet */
-						if(participant->denoise)
-							janus_audiobridge_participant_denoise(participant, (char *)pkt->data, pkt->length);
-#endif
-						/* Update the details */
-						participant->last_seq = pkt->seq_number;
-						participant->last_timestamp = pkt->timestamp;
-						g_atomic_int_set(&participant->decoding, 0);
-						if(pkt->length < 0) {
-							JANUS_LOG(LOG_ERR, "[Opus] Ops! got an error decoding the Opus frame: %d (%s)\n", pkt->length, opus_strerror(pkt->length));
-							g_free(pkt->data);
-							g_free(pkt);
-							break;
-						}
-						/* Queue the decoded packet for the mixer */
-						janus_mutex_lock(&participant->qmutex);
-						/* Do not let queue-in grow too much */
-						guint count = g_list_length(participant->inbuf);
-						if((int) count > QUEUE_IN_MAX_PACKETS) {
-							JANUS_LOG(LOG_WARN, "Participant queue-in contains too many packets, clearing now (count=%u)\n", count);
-							janus_audiobridge_participant_clear_inbuf(participant);
-						}
-						participant->inbuf = g_list_append(participant->inbuf, pkt);
-						janus_mutex_unlock(&participant->qmutex);
-					} else {
-						/* No packet in the jitter buffer? Move on the talking detection, if needed */
-						janus_audiobridge_participant_istalking(session, participant, NULL, NULL);
-					}
-				} else {
-					/* Decode the audio packet */
-					bpkt = (janus_audiobridge_buffer_packet *)jbp.data;
+	gint64 now = janus_get_monotonic_time();
+	if(now - participant->clock_before > G_USEC_PER_SEC) {
+		/* We haven't been scheduled in a while (e.g., we just joined, or we
+		 * were suspended), so re-sync the decoding clock rather than catch up */
+		participant->clock_before = now;
+	}
+	/* Start with packets to decode and queue for the mixer, on a clock */
+	while(now - participant->clock_before >= 18000) {
+		participant->clock_before += 20000;
+		if(participant->jitter) {
+			janus_mutex_lock(&participant->qmutex);
+			ret = jitter_buffer_get(participant->jitter, &jbp, participant->codec == JANUS_AUDIOCODEC_OPUS ? 960 : 160, NULL);
+			participant->jitter_ticks++;
+			/* Adjust the buffer size every 50 ticks (~1 second) */
+			if(participant->jitter_ticks == JITTER_BUFFER_MAX_PACKETS) {
+				jitter_buffer_update_delay(participant->jitter, NULL, NULL);
+				participant->jitter_ticks = 0;
+			}
+			jitter_buffer_tick(participant->jitter);
+			janus_mutex_unlock(&participant->qmutex);
+			if(ret != JITTER_BUFFER_OK) {
+				/* We didn't get a packet: check if PLC can help */
+				if(participant->decoded_first && participant->codec == JANUS_AUDIOCODEC_OPUS && participant->lost_packets_gap <= JITTER_BUFFER_MAX_GAP_SIZE && !participant->muted) {
+					participant->lost_packets_gap++;
 					if(!g_atomic_int_compare_and_exchange(&participant->decoding, 0, 1)) {
 						/* This means we're cleaning up, so don't try to decode */
 						janus_audiobridge_buffer_packet_destroy(bpkt);
 						break;
 					}
-					/* Access the payload */
-					char *buffer = bpkt->rtp ? bpkt->rtp->buffer : NULL;
-					uint16_t len = bpkt->rtp ? bpkt->rtp->length : 0;
-					int plen = 0;
-					const unsigned char *payload = (const unsigned char *)janus_rtp_payload(buffer, len, &plen);
-					if(!payload) {
-						JANUS_LOG(LOG_ERR, "[%s] Ops! got an error accessing the RTP payload\n",
-							participant->codec == JANUS_AUDIOCODEC_OPUS ? "Opus" : "G.711");
-						g_atomic_int_set(&participant->decoding, 0);
-						janus_audiobridge_buffer_packet_destroy(bpkt);
-						continue;
-					}
-					rtp = (janus_rtp_header *)buffer;
-					first = FALSE;
-					lost_packets_gap = 0;
-					/* Decode the packet */
-					pkt = g_malloc(sizeof(janus_audiobridge_rtp_relay_packet));
-					pkt->data = g_malloc0(BUFFER_SAMPLES*sizeof(opus_int16));
+					int32_t output_samples = 0;
+					opus_decoder_ctl(participant->decoder, OPUS_GET_LAST_PACKET_DURATION(&output_samples));
+					/* Grab a ring slot for a fake packet we can queue */
+					pkt = janus_audiobridge_participant_inbuf_slot(participant);
 					pkt->ssrc = 0;
-					pkt->timestamp = ntohl(rtp->timestamp);
-					pkt->seq_number = ntohs(rtp->seq_number);
-					/* Check the audio level extension to see if this is silence */
+					pkt->timestamp = participant->last_timestamp + OPUS_SAMPLES;
+					pkt->seq_number = participant->last_seq + 1;
+					/* This is a redundant packet, so we can't parse any extension info */
 					pkt->silence = FALSE;
-					janus_audiobridge_participant_istalking(session, participant, bpkt->rtp, &pkt->silence);
-					pkt->length = 0;
-					if(participant->codec == JANUS_AUDIOCODEC_OPUS) {
-						/* Opus */
-						pkt->length = opus_decode(participant->decoder, payload, plen, (opus_int16 *)pkt->data, BUFFER_SAMPLES, 0);
-					} else if(participant->codec == JANUS_AUDIOCODEC_PCMA || participant->codec == JANUS_AUDIOCODEC_PCMU) {
-						/* G.711 */
-						if(plen != 160) {
-							JANUS_LOG(LOG_WARN, "[G.711] Wrong packet size (expected 160, got %d), skipping audio packet\n", plen);
-							g_atomic_int_set(&participant->decoding, 0);
-							janus_audiobridge_buffer_packet_destroy(bpkt);
-							g_free(pkt->data);
-							g_free(pkt);
-							continue;
-						}
-						int i = 0;
-						uint16_t *samples = (uint16_t *)pkt->data;
-						if(rtp->type == 0) {
-							/* mu-law */
-							for(i=0; i<plen; i++)
-								*(samples+i) = janus_audiobridge_g711_ulaw_dectable[*(payload+i)];
-						} else if(rtp->type == 8) {
-							/* a-law */
-							for(i=0; i<plen; i++)
-								*(samples+i) = janus_audiobridge_g711_alaw_dectable[*(payload+i)];
-						}
-						pkt->length = 320;
-					}
+					janus_audiobridge_participant_istalking(session, participant, NULL, NULL);
+					pkt->length = opus_decode(participant->decoder, NULL, 0, (opus_int16 *)pkt->data, output_samples, 0);
 #ifdef HAVE_RNNOISE
-					/* Check if we need to denoise this packet */
-					if(participant->denoise)
+					/* Check if we need to denoise this packet: if the last real
+					 * frame was silence, we're just concealing a silence gap,
+					 * and that's not worth the RNNoise cost */
+					if(participant->denoise && !participant->fade_in)
 						janus_audiobridge_participant_denoise(participant, (char *)pkt->data, pkt->length);
 #endif
-					/* Get rid of the buffered packet */
-					janus_audiobridge_buffer_packet_destroy(bpkt);
 					/* Update the details */
 					participant->last_seq = pkt->seq_number;
 					participant->last_timestamp = pkt->timestamp;
 					g_atomic_int_set(&participant->decoding, 0);
 					if(pkt->length < 0) {
-						if(participant->codec == JANUS_AUDIOCODEC_OPUS) {
-							JANUS_LOG(LOG_ERR, "[Opus] Ops! got an error decoding the Opus frame: %d (%s)\n", pkt->length, opus_strerror(pkt->length));
-						} else {
-							JANUS_LOG(LOG_ERR, "[G.711] Ops! got an error decoding the audio frame\n");
-						}
-						g_free(pkt->data);
-						g_free(pkt);
+						JANUS_LOG(LOG_ERR, "[Opus] Ops! got an error decoding the Opus frame: %d (%s)\n", pkt->length, opus_strerror(pkt->length));
+						/* The ring slot wasn't published, so it will just be reused */
+						break;
+					}
+					/* Publish the decoded packet to the mixer */
+					janus_audiobridge_participant_inbuf_publish(participant, pkt);
+				} else {
+					/* No packet in the jitter buffer? Move on the talking detection, if needed */
+					janus_audiobridge_participant_istalking(session, participant, NULL, NULL);
+				}
+			} else {
+				/* Decode the audio packet */
+				bpkt = (janus_audiobridge_buffer_packet *)jbp.data;
+				if(!g_atomic_int_compare_and_exchange(&participant->decoding, 0, 1)) {
+					/* This means we're cleaning up, so don't try to decode */
+					janus_audiobridge_buffer_packet_destroy(bpkt);
+					break;
+				}
+				/* Access the payload */
+				char *buffer = bpkt->rtp ? bpkt->rtp->buffer : NULL;
+				uint16_t len = bpkt->rtp ? bpkt->rtp->length : 0;
+				int plen = 0;
+				const unsigned char *payload = (const unsigned char *)janus_rtp_payload(buffer, len, &plen);
+				if(!payload) {
+					JANUS_LOG(LOG_ERR, "[%s] Ops! got an error accessing the RTP payload\n",
+						participant->codec == JANUS_AUDIOCODEC_OPUS ? "Opus" : "G.711");
+					g_atomic_int_set(&participant->decoding, 0);
+					janus_audiobridge_buffer_packet_destroy(bpkt);
+					continue;
+				}
+				rtp = (janus_rtp_header *)buffer;
+				participant->decoded_first = TRUE;
+				participant->lost_packets_gap = 0;
+				/* Decode the packet into a ring slot */
+				pkt = janus_audiobridge_participant_inbuf_slot(participant);
+				pkt->ssrc = 0;
+				pkt->timestamp = ntohl(rtp->timestamp);
+				pkt->seq_number = ntohs(rtp->seq_number);
+				/* Check the audio level extension to see if this is silence */
+				pkt->silence = FALSE;
+				janus_audiobridge_participant_istalking(session, participant, bpkt->rtp, &pkt->silence);
+				/* An Opus DTX frame (1-2 bytes long) counts as silence as well */
+				if(!pkt->silence && participant->codec == JANUS_AUDIOCODEC_OPUS && plen <= 2)
+					pkt->silence = TRUE;
+				pkt->length = 0;
+				if(pkt->silence) {
+					/* Silent frame: the mixer skips those anyway, so don't waste cycles
+					 * decoding it; we just publish the empty slot, to keep the queue
+					 * pacing intact, and fade the next audible frame in instead */
+					participant->fade_in = TRUE;
+					participant->last_seq = ntohs(rtp->seq_number);
+					participant->last_timestamp = ntohl(rtp->timestamp);
+					g_atomic_int_set(&participant->decoding, 0);
+					janus_audiobridge_buffer_packet_destroy(bpkt);
+					janus_audiobridge_participant_inbuf_publish(participant, pkt);
+					continue;
+				}
+				if(participant->codec == JANUS_AUDIOCODEC_OPUS) {
+					/* Opus */
+					pkt->length = opus_decode(participant->decoder, payload, plen, (opus_int16 *)pkt->data, BUFFER_SAMPLES, 0);
+				} else if(participant->codec == JANUS_AUDIOCODEC_PCMA || participant->codec == JANUS_AUDIOCODEC_PCMU) {
+					/* G.711 */
+					if(plen != 160) {
+						JANUS_LOG(LOG_WARN, "[G.711] Wrong packet size (expected 160, got %d), skipping audio packet\n", plen);
+						g_atomic_int_set(&participant->decoding, 0);
+						janus_audiobridge_buffer_packet_destroy(bpkt);
 						continue;
 					}
-					/* Queue the decoded packet for the mixer */
-					janus_mutex_lock(&participant->qmutex);
-					/* Do not let queue-in grow too much */
-					guint count = g_list_length(participant->inbuf);
-					if(count > QUEUE_IN_MAX_PACKETS) {
-						JANUS_LOG(LOG_WARN, "Participant queue-in contains too many packets, clearing now (count=%u)\n", count);
-						janus_audiobridge_participant_clear_inbuf(participant);
+					int i = 0;
+					uint16_t *samples = (uint16_t *)pkt->data;
+					if(rtp->type == 0) {
+						/* mu-law */
+						for(i=0; i<plen; i++)
+							*(samples+i) = janus_audiobridge_g711_ulaw_dectable[*(payload+i)];
+					} else if(rtp->type == 8) {
+						/* a-law */
+						for(i=0; i<plen; i++)
+							*(samples+i) = janus_audiobridge_g711_alaw_dectable[*(payload+i)];
 					}
-					participant->inbuf = g_list_append(participant->inbuf, pkt);
-					janus_mutex_unlock(&participant->qmutex);
+					pkt->length = 320;
+				}
+#ifdef HAVE_RNNOISE
+				/* Check if we need to denoise this packet */
+				if(participant->denoise)
+					janus_audiobridge_participant_denoise(participant, (char *)pkt->data, pkt->length);
+#endif
+				/* Get rid of the buffered packet */
+				janus_audiobridge_buffer_packet_destroy(bpkt);
+				/* Update the details */
+				participant->last_seq = pkt->seq_number;
+				participant->last_timestamp = pkt->timestamp;
+				g_atomic_int_set(&participant->decoding, 0);
+				if(pkt->length < 0) {
+					if(participant->codec == JANUS_AUDIOCODEC_OPUS) {
+						JANUS_LOG(LOG_ERR, "[Opus] Ops! got an error decoding the Opus frame: %d (%s)\n", pkt->length, opus_strerror(pkt->length));
+					} else {
+						JANUS_LOG(LOG_ERR, "[G.711] Ops! got an error decoding the audio frame\n");
+					}
+					/* The ring slot wasn't published, so it will just be reused */
+					continue;
+				}
+				if(participant->fade_in && pkt->length > 0) {
+					/* First audible frame after a silence gap: apply a short linear
+					 * fade-in, so that re-admission to the mix isn't too abrupt */
+					int fade_samples = participant->codec == JANUS_AUDIOCODEC_OPUS ?
+						pkt->length * (participant->stereo ? 2 : 1) : 160;
+					opus_int16 *fade_data = (opus_int16 *)pkt->data;
+					int fi = 0;
+					for(fi=0; fi<fade_samples; fi++)
+						fade_data[fi] = (opus_int16)(((opus_int32)fade_data[fi] * fi) / fade_samples);
+					participant->fade_in = FALSE;
 				}
+				/* Publish the decoded packet to the mixer */
+				janus_audiobridge_participant_inbuf_publish(participant, pkt);
 			}
 		}
-		/* Now check if there's packets to encode */
-		mixedpkt = g_async_queue_try_pop(participant->outbuf);
-		if(mixedpkt != NULL && g_atomic_int_get(&session->destroyed) == 0 && g_atomic_int_get(&session->started)) {
-			if(g_atomic_int_get(&participant->active) && (participant->codec == JANUS_AUDIOCODEC_PCMA ||
+	}
+	/* Now check if there's packets to encode */
+	while((mixedpkt = g_async_queue_try_pop(participant->outbuf)) != NULL) {
+		if(g_atomic_int_get(&session->destroyed) == 0 && g_atomic_int_get(&session->started)) {
+			if(g_atomic_int_get(&participant->active) && mixedpkt->encoded) {
+				/* The mixer thread encoded this frame already (shared listeners
+				 * fast path), we only need to add the RTP header and relay it */
+				memcpy(payload+12, mixedpkt->data, mixedpkt->length);
+				outpkt->length = mixedpkt->length+12;	/* Take the RTP header into consideration */
+				/* Update RTP header */
+				outpkt->data->version = 2;
+				outpkt->data->markerbit = 0;	/* FIXME Should be 1 for the first packet */
+				outpkt->data->seq_number = htons(mixedpkt->seq_number);
+				outpkt->data->timestamp = htonl(mixedpkt->timestamp);
+				outpkt->data->ssrc = htonl(mixedpkt->ssrc);	/* The Janus core will fix this anyway */
+				/* Backup the actual timestamp and sequence number set by the audiobridge, in case a room is changed */
+				outpkt->ssrc = mixedpkt->ssrc;
+				outpkt->timestamp = mixedpkt->timestamp;
+				outpkt->seq_number = mixedpkt->seq_number;
+				janus_audiobridge_relay_rtp_packet(participant->session, outpkt);
+			} else if(g_atomic_int_get(&participant->active) && (participant->codec == JANUS_AUDIOCODEC_PCMA ||
 					participant->codec == JANUS_AUDIOCODEC_PCMU) && g_atomic_int_compare_and_exchange(&participant->encoding, 0, 1)) {
 				/* Encode using G.711 */
 				if(mixedpkt->length != 320) {
@@ -9342,21 +9903,19 @@ static void *janus_audiobridge_participant_thread(void *data) {
 				}
 			}
 		}
-		if(mixedpkt) {
-			g_free(mixedpkt->data);
-			g_free(mixedpkt);
-		}
-		g_usleep(2500);
+		g_free(mixedpkt->data);
+		g_free(mixedpkt);
 	}
-	/* We're done, get rid of the resources */
-	g_free(outpkt->data);
-	g_free(outpkt);
-	JANUS_LOG(LOG_VERB, "AudioBridge Participant thread leaving...\n");
+}
 
+/* Worker function for the codec thread pool */
+static void janus_audiobridge_participant_pool_process(gpointer data, gpointer user_data) {
+	janus_audiobridge_participant *participant = (janus_audiobridge_participant *)data;
+	if(participant == NULL)
+		return;
+	janus_audiobridge_participant_process(participant);
+	g_atomic_int_set(&participant->processing, 0);
 	janus_refcount_decrease(&participant->ref);
-	janus_refcount_decrease(&session->ref);
-	g_thread_unref(g_thread_self());
-	return NULL;
 }
 
 static void janus_audiobridge_relay_rtp_packet(gpointer data, gpointer user_data) {
@@ -9418,12 +9977,13 @@ static void janus_audiobridge_plainrtp_media_cleanup(janus_audiobridge_plainrtp_
 	media->remote_audio_ip = NULL;
 	media->audio_ssrc = 0;
 	media->audio_ssrc_peer = 0;
-	if(media->pipefd[0] > 0)
-		close(media->pipefd[0]);
-	media->pipefd[0] = -1;
-	if(media->pipefd[1] > 0)
-		close(media->pipefd[1]);
-	media->pipefd[1] = -1;
+	/* Detach from the relay loop, if we were attached to one */
+	if(media->source != NULL) {
+		g_source_destroy(media->source);
+		media->source = NULL;
+	}
+	media->relay_loop = NULL;
+	media->pollerrs = 0;
 }
 static int janus_audiobridge_plainrtp_allocate_port(janus_audiobridge_plainrtp_media *media) {
 	/* Read global slider */
@@ -9483,135 +10043,164 @@ static int janus_audiobridge_plainrtp_allocate_port(janus_audiobridge_plainrtp_m
 	}
 	return -1;
 }
-/* Thread to relay RTP/RTCP frames coming from the peer */
-static void *janus_audiobridge_plainrtp_relay_thread(void *data) {
-	janus_audiobridge_participant *participant = (janus_audiobridge_participant *)data;
-	if(!participant) {
-		JANUS_LOG(LOG_ERR, "Invalid participant!\n");
-		g_thread_unref(g_thread_self());
-		return NULL;
+/* Custom GSource we use to have the relay loops monitor the RTP socket of
+ * a plain RTP participant: each participant has one of these attached to
+ * the loop they were assigned to, which is how we serve many plain RTP
+ * participants with a few threads, rather than with a dedicated thread
+ * per participant as we used to */
+typedef struct janus_audiobridge_plainrtp_source {
+	GSource parent;
+	janus_audiobridge_participant *participant;
+	janus_audiobridge_session *session;
+	janus_audiobridge_relay_loop *loop;
+	gpointer tag;	/* Tag returned by g_source_add_unix_fd */
+	int fd;			/* File descriptor we're monitoring */
+} janus_audiobridge_plainrtp_source;
+static gboolean janus_audiobridge_plainrtp_source_prepare(GSource *source, gint *timeout) {
+	/* We use the timeout as a watchdog for the participant, the same way
+	 * the old per-participant relay thread woke from its poll every second */
+	*timeout = 1000;
+	return FALSE;
+}
+static gboolean janus_audiobridge_plainrtp_source_check(GSource *source) {
+	/* Always dispatch: besides the socket, the dispatch callback also
+	 * checks whether the participant is still there (at least once per second) */
+	return TRUE;
+}
+static gboolean janus_audiobridge_plainrtp_source_dispatch(GSource *source, GSourceFunc callback, gpointer user_data) {
+	janus_audiobridge_plainrtp_source *ps = (janus_audiobridge_plainrtp_source *)source;
+	janus_audiobridge_participant *participant = ps->participant;
+	janus_audiobridge_session *session = ps->session;
+	if(g_source_is_destroyed(source))
+		return G_SOURCE_REMOVE;
+	if(session == NULL || g_atomic_int_get(&session->destroyed) || g_atomic_int_get(&session->hangingup)) {
+		/* The participant is gone: cleanup the media session and detach from the loop */
+		janus_mutex_lock(&participant->pmutex);
+		if(participant->plainrtp_media.source == source)
+			participant->plainrtp_media.source = NULL;
+		participant->plainrtp = FALSE;
+		janus_audiobridge_plainrtp_media_cleanup(&participant->plainrtp_media);
+		janus_mutex_unlock(&participant->pmutex);
+		JANUS_LOG(LOG_VERB, "[AudioBridge-%p] Detaching plain RTP participant from relay loop #%d\n",
+			session, ps->loop->id);
+		return G_SOURCE_REMOVE;
+	}
+	if(ps->tag == NULL || ps->fd == -1)
+		return G_SOURCE_CONTINUE;
+	GIOCondition revents = g_source_query_unix_fd(source, ps->tag);
+	if(revents & (G_IO_ERR | G_IO_HUP)) {
+		/* Check the socket error */
+		int error = 0;
+		socklen_t errlen = sizeof(error);
+		getsockopt(ps->fd, SOL_SOCKET, SO_ERROR, (void *)&error, &errlen);
+		if(error == 0) {
+			/* Maybe not a breaking error after all? */
+			return G_SOURCE_CONTINUE;
+		}
+		/* FIXME Should we be more tolerant of ICMP errors on RTP sockets as well? */
+		participant->plainrtp_media.pollerrs++;
+		if(participant->plainrtp_media.pollerrs < 100)
+			return G_SOURCE_CONTINUE;
+		JANUS_LOG(LOG_ERR, "[AudioBridge-%p] Too many errors polling %d: %s...\n", session,
+			ps->fd, revents & G_IO_ERR ? "G_IO_ERR" : "G_IO_HUP");
+		JANUS_LOG(LOG_ERR, "[AudioBridge-%p]   -- %d (%s)\n", session, error, g_strerror(error));
+		/* Can we assume it's pretty much over, after a POLLERR? Close the
+		 * channel: we'll be detached from the loop at the next dispatch */
+		janus_audiobridge_hangup_media(session->handle);
+		return G_SOURCE_CONTINUE;
+	} else if(revents & G_IO_IN) {
+		/* Got an RTP packet */
+		char buffer[1500];
+		struct sockaddr_storage remote = { 0 };
+		socklen_t addrlen = sizeof(remote);
+		int bytes = recvfrom(ps->fd, buffer, sizeof(buffer), 0, (struct sockaddr *)&remote, &addrlen);
+		if(bytes < 0) {
+			/* Failed to read? */
+			return G_SOURCE_CONTINUE;
+		}
+		/* Audio RTP */
+		if(!janus_is_rtp(buffer, bytes)) {
+			/* Not an RTP packet? */
+			return G_SOURCE_CONTINUE;
+		}
+		/* Handle the packet */
+		participant->plainrtp_media.pollerrs = 0;
+		rtp_header *header = (rtp_header *)buffer;
+		if(participant->plainrtp_media.audio_ssrc_peer != ntohl(header->ssrc)) {
+			participant->plainrtp_media.audio_ssrc_peer = ntohl(header->ssrc);
+			JANUS_LOG(LOG_VERB, "[AudioBridge-%p] Got peer audio SSRC: %"SCNu32"\n",
+				session, participant->plainrtp_media.audio_ssrc_peer);
+		}
+		/* Check if the SSRC changed (e.g., after a re-INVITE or UPDATE) */
+		janus_rtp_header_update(header, &participant->plainrtp_media.context, FALSE, 0);
+		/* Handle as a WebRTC RTP packet */
+		janus_plugin_rtp packet = { .video = FALSE, .buffer = buffer, .length = bytes };
+		janus_plugin_rtp_extensions_reset(&packet.extensions);
+		janus_audiobridge_incoming_rtp(session->handle, &packet);
 	}
+	return G_SOURCE_CONTINUE;
+}
+static void janus_audiobridge_plainrtp_source_finalize(GSource *source) {
+	janus_audiobridge_plainrtp_source *ps = (janus_audiobridge_plainrtp_source *)source;
+	if(ps->loop != NULL)
+		g_atomic_int_add(&ps->loop->participants, -1);
+	if(ps->participant != NULL) {
+		janus_refcount_decrease(&ps->participant->ref);
+		ps->participant = NULL;
+	}
+	if(ps->session != NULL) {
+		janus_refcount_decrease(&ps->session->ref);
+		ps->session = NULL;
+	}
+}
+static GSourceFuncs janus_audiobridge_plainrtp_source_funcs = {
+	janus_audiobridge_plainrtp_source_prepare,
+	janus_audiobridge_plainrtp_source_check,
+	janus_audiobridge_plainrtp_source_dispatch,
+	janus_audiobridge_plainrtp_source_finalize,
+	NULL, NULL
+};
+
+/* Helper to assign a plain RTP participant to one of the relay loops, and
+ * start monitoring their RTP socket there; returns 0 on success, a negative
+ * integer otherwise (e.g., if the relay loops aren't there) */
+static int janus_audiobridge_plainrtp_attach(janus_audiobridge_participant *participant) {
 	janus_audiobridge_session *session = participant->session;
-	JANUS_LOG(LOG_INFO, "[AudioBridge-%p] Starting Plain RTP participant thread\n", session);
-
-	/* File descriptors */
-	socklen_t addrlen;
-	struct sockaddr_storage remote = { 0 };
-	int resfd = 0, bytes = 0, pollerrs = 0;
-	struct pollfd fds[2];
-	int pipe_fd = participant->plainrtp_media.pipefd[0];
-	char buffer[1500];
-	memset(buffer, 0, 1500);
-	/* Loop */
-	int num = 0;
-	gboolean goon = TRUE;
-
-	/* Fake RTP packet */
-	janus_plugin_rtp packet = { .video = FALSE, .buffer = buffer, .length = 0 };
-	janus_plugin_rtp_extensions_reset(&packet.extensions);
-
-	while(goon && session != NULL && !g_atomic_int_get(&session->destroyed) && !g_atomic_int_get(&session->hangingup)) {
-		/* Prepare poll */
-		num = 0;
-		if(participant->plainrtp_media.audio_rtp_fd != -1) {
-			fds[num].fd = participant->plainrtp_media.audio_rtp_fd;
-			fds[num].events = POLLIN;
-			fds[num].revents = 0;
-			num++;
-		}
-		if(pipe_fd != -1) {
-			fds[num].fd = pipe_fd;
-			fds[num].events = POLLIN;
-			fds[num].revents = 0;
-			num++;
-		}
-		/* Wait for some data */
-		resfd = poll(fds, num, 1000);
-		if(resfd < 0) {
-			if(errno == EINTR) {
-				JANUS_LOG(LOG_HUGE, "[AudioBridge-%p] Got an EINTR (%s), ignoring...\n", session, g_strerror(errno));
-				continue;
-			}
-			JANUS_LOG(LOG_ERR, "[AudioBridge-%p] Error polling...\n", session);
-			JANUS_LOG(LOG_ERR, "[AudioBridge-%p]   -- %d (%s)\n", session, errno, g_strerror(errno));
-			break;
-		} else if(resfd == 0) {
-			/* No data, keep going */
-			continue;
-		}
-		if(session == NULL || g_atomic_int_get(&session->destroyed))
-			break;
-		int i = 0;
-		for(i=0; i<num; i++) {
-			if(fds[i].revents & (POLLERR | POLLHUP)) {
-				/* Check the socket error */
-				int error = 0;
-				socklen_t errlen = sizeof(error);
-				getsockopt(fds[i].fd, SOL_SOCKET, SO_ERROR, (void *)&error, &errlen);
-				if(error == 0) {
-					/* Maybe not a breaking error after all? */
-					continue;
-				}
-				/* FIXME Should we be more tolerant of ICMP errors on RTP sockets as well? */
-				pollerrs++;
-				if(pollerrs < 100)
-					continue;
-				JANUS_LOG(LOG_ERR, "[AudioBridge-%p] Too many errors polling %d (socket #%d): %s...\n", session,
-					fds[i].fd, i, fds[i].revents & POLLERR ? "POLLERR" : "POLLHUP");
-				JANUS_LOG(LOG_ERR, "[AudioBridge-%p]   -- %d (%s)\n", session, error, g_strerror(error));
-				/* Can we assume it's pretty much over, after a POLLERR? */
-				goon = FALSE;
-				/* Close the channel */
-				janus_audiobridge_hangup_media(session->handle);
-				break;
-			} else if(fds[i].revents & POLLIN) {
-				if(pipe_fd != -1 && fds[i].fd == pipe_fd) {
-					/* Poll interrupted for a reason, go on */
-					int code = 0;
-					(void)read(pipe_fd, &code, sizeof(int));
-					break;
-				}
-				/* Got an RTP packet */
-				addrlen = sizeof(remote);
-				bytes = recvfrom(fds[i].fd, buffer, 1500, 0, (struct sockaddr *)&remote, &addrlen);
-				if(bytes < 0) {
-					/* Failed to read? */
-					continue;
-				}
-				/* Audio RTP */
-				if(!janus_is_rtp(buffer, bytes)) {
-					/* Not an RTP packet? */
-					continue;
-				}
-				/* Handle the packet */
-				pollerrs = 0;
-				rtp_header *header = (rtp_header *)buffer;
-				if(participant->plainrtp_media.audio_ssrc_peer != ntohl(header->ssrc)) {
-					participant->plainrtp_media.audio_ssrc_peer = ntohl(header->ssrc);
-					JANUS_LOG(LOG_VERB, "[AudioBridge-%p] Got peer audio SSRC: %"SCNu32"\n",
-						session, participant->plainrtp_media.audio_ssrc_peer);
-				}
-				/* Check if the SSRC changed (e.g., after a re-INVITE or UPDATE) */
-				janus_rtp_header_update(header, &participant->plainrtp_media.context, FALSE, 0);
-				/* Handle as a WebRTC RTP packet */
-				packet.length = bytes;
-				janus_audiobridge_incoming_rtp(session->handle, &packet);
-				continue;
-			}
-		}
+	if(session == NULL || g_atomic_int_get(&session->destroyed) || relay_loops == NULL)
+		return -1;
+	/* Pick the loop with the lowest number of participants */
+	janus_audiobridge_relay_loop *loop = &relay_loops[0];
+	int i = 0;
+	for(i=1; i<num_relay_loops; i++) {
+		if(g_atomic_int_get(&relay_loops[i].participants) < g_atomic_int_get(&loop->participants))
+			loop = &relay_loops[i];
 	}
-	/* Cleanup the media session */
-	participant->plainrtp_media.thread = NULL;
 	janus_mutex_lock(&participant->pmutex);
-	participant->plainrtp = FALSE;
-	janus_audiobridge_plainrtp_media_cleanup(&participant->plainrtp_media);
+	if(participant->plainrtp_media.source != NULL) {
+		/* There's a source already (e.g., a previous session on the same
+		 * handle): get rid of it, the new one picks up the new socket */
+		g_source_destroy(participant->plainrtp_media.source);
+		participant->plainrtp_media.source = NULL;
+	}
+	/* Create a source to have the loop monitor the RTP socket */
+	GSource *source = g_source_new(&janus_audiobridge_plainrtp_source_funcs, sizeof(janus_audiobridge_plainrtp_source));
+	janus_audiobridge_plainrtp_source *ps = (janus_audiobridge_plainrtp_source *)source;
+	janus_refcount_increase(&session->ref);
+	janus_refcount_increase(&participant->ref);
+	ps->participant = participant;
+	ps->session = session;
+	ps->loop = loop;
+	ps->fd = participant->plainrtp_media.audio_rtp_fd;
+	ps->tag = g_source_add_unix_fd(source, ps->fd, G_IO_IN | G_IO_ERR);
+	g_atomic_int_inc(&loop->participants);
+	participant->plainrtp_media.relay_loop = loop;
+	participant->plainrtp_media.pollerrs = 0;
+	participant->plainrtp_media.source = source;
+	g_source_attach(source, loop->mainctx);
+	g_source_unref(source);	/* The loop context owns the source now */
 	janus_mutex_unlock(&participant->pmutex);
-	/* Done */
-	JANUS_LOG(LOG_INFO, "[AudioBridge-%p] Leaving Plain RTP participant thread\n", session);
-	janus_refcount_decrease(&participant->ref);
-	janus_refcount_decrease(&session->ref);
-	g_thread_unref(g_thread_self());
-	return NULL;
+	JANUS_LOG(LOG_VERB, "[AudioBridge-%p] Plain RTP participant attached to relay loop #%d\n", session, loop->id);
+	return 0;
 }
 
 static void janus_audiobridge_participant_istalking(janus_audiobridge_session *session,
@@ -9633,26 +10222,12 @@ static void janus_audiobridge_participant_istalking(janus_audiobridge_session *s
 			audio_active_packets = participant->user_audio_active_packets;
 		if(participant->user_audio_level_average > 0)
 			audio_level_average = participant->user_audio_level_average;
-		participant->audio_dBov_sum += level;
-		participant->audio_active_packets++;
 		participant->dBov_level = level;
-		if(participant->audio_active_packets > 0 && participant->audio_active_packets == audio_active_packets) {
-			gboolean notify_talk_event = FALSE;
-			if((float) participant->audio_dBov_sum / (float) participant->audio_active_packets < audio_level_average) {
-				/* Participant talking, should we notify all participants? */
-				if(!participant->talking)
-					notify_talk_event = TRUE;
-				participant->talking = TRUE;
-			} else {
-				/* Participant not talking anymore, should we notify all participants? */
-				if(participant->talking)
-					notify_talk_event = TRUE;
-				participant->talking = FALSE;
-			}
-			participant->audio_active_packets = 0;
-			participant->audio_dBov_sum = 0;
+		/* Feed the level to the talk detection context */
+		if(janus_audiolevel_context_process(&participant->audiolevel_ctx, level, audio_active_packets, audio_level_average)) {
+			participant->talking = participant->audiolevel_ctx.talking;
 			/* Only notify in case of state changes */
-			if(participant->room && notify_talk_event) {
+			if(participant->room) {
 				janus_mutex_lock(&participant->room->mutex);
 				json_t *event = json_object();
 				json_object_set_new(event, "audiobridge", json_string(participant->talking ? "talking" : "stopped-talking"));
@@ -9777,13 +10352,9 @@ static void janus_audiobridge_participant_denoise(janus_audiobridge_participant
 	/* Denoise in chunks of 480 samples */
 	if(!participant->resampler_stereo) {
 		for(i=0; i<upsample_buffer_count; i+= DENOISER_FRAME_SIZE) {
-			for(j=0; j<DENOISER_FRAME_SIZE; j++) {
-				denoiser_buffer[j] = upsample_buffer[i + j];
-			}
+			janus_audiobridge_denoise_i2f(denoiser_buffer, &upsample_buffer[i], DENOISER_FRAME_SIZE);
 			rnnoise_process_frame(participant->rnnoise[0], denoiser_buffer, denoiser_buffer);
-			for(j=0; j<DENOISER_FRAME_SIZE; j++) {
-				upsample_buffer[i + j] = denoiser_buffer[j];
-			}
+			janus_audiobridge_denoise_f2i(&upsample_buffer[i], denoiser_buffer, DENOISER_FRAME_SIZE);
 		}
 	} else {
 		for(i=0; i<upsample_buffer_count; i+= DENOISER_FRAME_SIZE) {
@@ -186,6 +186,37 @@ timeCallback("resumeScheduler", null, 0);
  * compact and less verbose, and as such is preferred in cases where
  * timing and opaque arguments are not needed.
  *
+ * \section duksharding Sharding packet callbacks across Duktape contexts
+ *
+ * By default, every callback the C code routes to the JavaScript script
+ * runs on a single Duktape context, protected by a global mutex: when a
+ * script decides to handle media itself (via \c incomingRtp() and related
+ * callbacks), that single context easily becomes a bottleneck, as every
+ * packet of every session has to go through it. To help with that, the
+ * plugin can be configured, via the \c packet_contexts property, to create
+ * a pool of additional Duktape contexts dedicated to packet callbacks:
+ * each context loads its own copy of the script (from the bytecode
+ * compiled at startup, so the source is only compiled once), and sessions
+ * are sharded across the pool in a round robin fashion, so that media
+ * processing can happen in parallel on different cores.
+ *
+ * Since each context is an independent interpreter, globals are NOT shared
+ * between the main context and the pool. To keep per-session state working,
+ * the session lifecycle callbacks ( \c createSession(), \c destroySession(),
+ * \c setupMedia() and \c hangupMedia() ) are replayed on the context a
+ * session has been sharded on, but everything else (message handling, the
+ * coroutine scheduler, timed callbacks) only happens on the main context:
+ * scripts relying on globals shared between application logic and packet
+ * processing should leave the property unset, which preserves the
+ * traditional single-context behaviour.
+ *
+ * As an additional note, the \c pushEvent() and \c notifyEvent() functions
+ * accept plain objects for their event/jsep arguments, besides the JSON
+ * strings documented above, and \c handleMessage() can return the
+ * synchronous response as a plain object as well: passing objects directly
+ * is cheaper, as it avoids a \c JSON.stringify() in the script and the
+ * corresponding parsing in the C code for each signalling message.
+ *
  * Refer to the \ref jspapi section for more information on how you
  * can register your own C functions.
  */
@@ -272,6 +303,16 @@ static char *duktape_folder = NULL;
 /* Duktape stuff */
 duk_context *duktape_ctx = NULL;
 janus_mutex duktape_mutex = JANUS_MUTEX_INITIALIZER;
+/* Optional pool of additional Duktape contexts dedicated to packet callbacks:
+ * when enabled via the 'packet_contexts' property, sessions are sharded across
+ * the pool, so that scripts doing per-packet processing (incomingRtp and
+ * related callbacks) don't all contend on the single global context. Each
+ * context loads its own copy of the script (from the bytecode compiled at
+ * startup), so globals are NOT shared with the main context: scripts relying
+ * on that should keep this disabled (which is the default) */
+static janus_duktape_packet_context *packet_contexts = NULL;
+static int num_packet_contexts = 0;
+static volatile gint next_packet_context = 0;
 static const char *duktape_functions[] = {
 	"init", "destroy", "resumeScheduler",
 	"createSession", "destroySession", "querySession",
@@ -367,6 +408,29 @@ static void janus_duktape_session_free(const janus_refcount *session_ref) {
 	g_free(session);
 }
 
+/* Helper to replay a session lifecycle notification on the copy of the script
+ * this session's packet callbacks have been sharded on, if any: application
+ * logic always runs on the main context, but media oriented scripts typically
+ * need to know about their sessions in per-context state too */
+static void janus_duktape_packet_context_notify(janus_duktape_session *session, const char *function) {
+	janus_duktape_packet_context *shard = session->packet_ctx;
+	if(shard == NULL)
+		return;
+	janus_mutex_lock(&shard->mutex);
+	duk_idx_t thr_idx = duk_push_thread(shard->ctx);
+	duk_context *t = duk_get_context(shard->ctx, thr_idx);
+	duk_get_global_string(t, function);
+	duk_push_number(t, session->id);
+	int res = duk_pcall(t, 1);
+	if(res != DUK_EXEC_SUCCESS) {
+		/* Something went wrong... */
+		JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(t, -1));
+	}
+	duk_pop(t);
+	duk_pop(shard->ctx);
+	janus_mutex_unlock(&shard->mutex);
+}
+
 /* Packet data and routing */
 typedef struct janus_duktape_rtp_relay_packet {
 	janus_duktape_session *sender;
@@ -438,6 +502,67 @@ static const char *janus_duktape_type_string(int type) {
 	return NULL;
 }
 
+/* Helper to convert a JavaScript value to a Jansson object directly, without
+ * going through a JSON string: this allows scripts to pass plain objects to
+ * pushEvent/notifyEvent and return them as synchronous handleMessage
+ * responses, skipping the JSON.stringify/json_loads round trip per call */
+static json_t *janus_duktape_get_json(duk_context *ctx, duk_idx_t idx) {
+	idx = duk_normalize_index(ctx, idx);
+	switch(duk_get_type(ctx, idx)) {
+		case DUK_TYPE_NULL:
+			return json_null();
+		case DUK_TYPE_BOOLEAN:
+			return json_boolean(duk_get_boolean(ctx, idx));
+		case DUK_TYPE_NUMBER: {
+			double number = (double)duk_get_number(ctx, idx);
+			if(number == (double)(json_int_t)number)
+				return json_integer((json_int_t)number);
+			return json_real(number);
+		}
+		case DUK_TYPE_STRING:
+			return json_string(duk_get_string(ctx, idx));
+		case DUK_TYPE_OBJECT: {
+			if(duk_is_function(ctx, idx))
+				return NULL;
+			if(duk_is_array(ctx, idx)) {
+				json_t *array = json_array();
+				duk_size_t i = 0, length = duk_get_length(ctx, idx);
+				for(i = 0; i < length; i++) {
+					duk_get_prop_index(ctx, idx, (duk_uarridx_t)i);
+					json_t *value = janus_duktape_get_json(ctx, -1);
+					duk_pop(ctx);
+					if(value == NULL) {
+						json_decref(array);
+						return NULL;
+					}
+					json_array_append_new(array, value);
+				}
+				return array;
+			}
+			json_t *object = json_object();
+			duk_enum(ctx, idx, DUK_ENUM_OWN_PROPERTIES_ONLY);
+			while(duk_next(ctx, -1, 1)) {
+				const char *key = duk_get_string(ctx, -2);
+				json_t *value = janus_duktape_get_json(ctx, -1);
+				duk_pop_2(ctx);
+				if(key == NULL || value == NULL) {
+					if(value != NULL)
+						json_decref(value);
+					duk_pop(ctx);	/* Pop the enumerator too */
+					json_decref(object);
+					return NULL;
+				}
+				json_object_set_new(object, key, value);
+			}
+			duk_pop(ctx);	/* Pop the enumerator */
+			return object;
+		}
+		default:
+			break;
+	}
+	return NULL;
+}
+
 
 /* Methods that we expose to the JavaScript script */
 static duk_ret_t janus_duktape_method_getmodulesfolder(duk_context *ctx) {
@@ -546,12 +671,12 @@ static duk_ret_t janus_duktape_method_pushevent(duk_context *ctx) {
 			janus_duktape_type_string(DUK_TYPE_STRING), janus_duktape_type_string(duk_get_type(ctx, 1)));
 		return duk_throw(ctx);
 	}
-	if(duk_get_type(ctx, 2) != DUK_TYPE_STRING) {
+	if(duk_get_type(ctx, 2) != DUK_TYPE_STRING && duk_get_type(ctx, 2) != DUK_TYPE_OBJECT) {
 		duk_push_error_object(ctx, DUK_RET_TYPE_ERROR, "Invalid argument (expected %s, got %s)\n",
 			janus_duktape_type_string(DUK_TYPE_STRING), janus_duktape_type_string(duk_get_type(ctx, 2)));
 		return duk_throw(ctx);
 	}
-	if(duk_get_type(ctx, 3) != DUK_TYPE_STRING &&
+	if(duk_get_type(ctx, 3) != DUK_TYPE_STRING && duk_get_type(ctx, 3) != DUK_TYPE_OBJECT &&
 			duk_get_type(ctx, 3) != DUK_TYPE_UNDEFINED && duk_get_type(ctx, 3) != DUK_TYPE_NULL) {
 		duk_push_error_object(ctx, DUK_RET_TYPE_ERROR, "Invalid argument (expected %s, got %s)\n",
 			janus_duktape_type_string(DUK_TYPE_STRING), janus_duktape_type_string(duk_get_type(ctx, 3)));
@@ -559,18 +684,35 @@ static duk_ret_t janus_duktape_method_pushevent(duk_context *ctx) {
 	}
 	uint32_t id = (uint32_t)duk_get_number(ctx, 0);
 	const char *transaction = duk_get_string(ctx, 1);
-	const char *event_text = duk_get_string(ctx, 2);
-	const char *jsep_text = duk_get_string(ctx, 3);
-	/* Parse the event/jsep strings to Jansson objects */
+	/* Get the event/jsep arguments as Jansson objects: they can either be
+	 * passed as JSON strings (the traditional API) or as plain objects,
+	 * which is cheaper as it skips a JSON serialization round trip */
 	json_error_t error;
-	json_t *event = json_loads(event_text, 0, &error);
-	if(!event) {
-		duk_push_error_object(ctx, DUK_ERR_ERROR, "JSON error: on line %d: %s", error.line, error.text);
-		return duk_throw(ctx);
+	json_t *event = NULL;
+	if(duk_get_type(ctx, 2) == DUK_TYPE_OBJECT) {
+		event = janus_duktape_get_json(ctx, 2);
+		if(!event) {
+			duk_push_error_object(ctx, DUK_ERR_ERROR, "Couldn't convert event object");
+			return duk_throw(ctx);
+		}
+	} else {
+		const char *event_text = duk_get_string(ctx, 2);
+		event = json_loads(event_text, 0, &error);
+		if(!event) {
+			duk_push_error_object(ctx, DUK_ERR_ERROR, "JSON error: on line %d: %s", error.line, error.text);
+			return duk_throw(ctx);
+		}
 	}
 	json_t *jsep = NULL;
-	if(jsep_text != NULL) {
-		jsep = json_loads(jsep_text, 0, &error);
+	if(duk_get_type(ctx, 3) == DUK_TYPE_OBJECT) {
+		jsep = janus_duktape_get_json(ctx, 3);
+		if(!jsep) {
+			json_decref(event);
+			duk_push_error_object(ctx, DUK_ERR_ERROR, "Couldn't convert jsep object");
+			return duk_throw(ctx);
+		}
+	} else if(duk_get_string(ctx, 3) != NULL) {
+		jsep = json_loads(duk_get_string(ctx, 3), 0, &error);
 		if(!jsep) {
 			duk_push_error_object(ctx, DUK_ERR_ERROR, "JSON error: on line %d: %s", error.line, error.text);
 			json_decref(event);
@@ -657,27 +799,37 @@ static duk_ret_t janus_duktape_method_notifyevent(duk_context *ctx) {
 			janus_duktape_type_string(DUK_TYPE_NUMBER), janus_duktape_type_string(duk_get_type(ctx, 0)));
 		return duk_throw(ctx);
 	}
-	if(duk_get_type(ctx, 1) != DUK_TYPE_STRING) {
+	if(duk_get_type(ctx, 1) != DUK_TYPE_STRING && duk_get_type(ctx, 1) != DUK_TYPE_OBJECT) {
 		duk_push_error_object(ctx, DUK_RET_TYPE_ERROR, "Invalid argument (expected %s, got %s)\n",
 			janus_duktape_type_string(DUK_TYPE_STRING), janus_duktape_type_string(duk_get_type(ctx, 1)));
 		return duk_throw(ctx);
 	}
 	uint32_t id = (uint32_t)duk_get_number(ctx, 0);
-	const char *event_text = duk_get_string(ctx, 1);
-	if(event_text == NULL)
-		return duk_throw(ctx);
 	/* Get the arguments from the provided context */
 	if(!duktape_janus_core->events_is_enabled()) {
 		/* Event handlers are disabled in the core, ignoring */
 		duk_push_int(ctx, 0);
 		return 1;
 	}
-	/* Parse the event/jsep strings to Jansson objects */
-	json_error_t error;
-	json_t *event = json_loads(event_text, 0, &error);
-	if(!event) {
-		duk_push_error_object(ctx, DUK_ERR_ERROR, "JSON error: on line %d: %s", error.line, error.text);
-		return duk_throw(ctx);
+	/* Get the event as a Jansson object: as with pushEvent, it can either
+	 * be a JSON string or a plain object */
+	json_t *event = NULL;
+	if(duk_get_type(ctx, 1) == DUK_TYPE_OBJECT) {
+		event = janus_duktape_get_json(ctx, 1);
+		if(!event) {
+			duk_push_error_object(ctx, DUK_ERR_ERROR, "Couldn't convert event object");
+			return duk_throw(ctx);
+		}
+	} else {
+		const char *event_text = duk_get_string(ctx, 1);
+		if(event_text == NULL)
+			return duk_throw(ctx);
+		json_error_t error;
+		event = json_loads(event_text, 0, &error);
+		if(!event) {
+			duk_push_error_object(ctx, DUK_ERR_ERROR, "JSON error: on line %d: %s", error.line, error.text);
+			return duk_throw(ctx);
+		}
 	}
 	/* Find the session (optional) */
 	janus_mutex_lock(&duktape_sessions_mutex);
@@ -1482,6 +1634,65 @@ static duk_ret_t janus_duktape_method_stoprecording(duk_context *ctx) {
 
 
 /* Plugin implementation */
+/* Helper to register all our C functions in a Duktape context: all of them
+ * are safe to invoke from any context, as they rely on their own locks and
+ * only reference sessions by ID, so the main context and the packet contexts
+ * (if sharding is enabled) all get the same bindings */
+static void janus_duktape_register_functions(duk_context *ctx) {
+	duk_push_c_function(ctx, janus_duktape_method_getmodulesfolder, 0);
+	duk_put_global_string(ctx, "getModulesFolder");
+	duk_push_c_function(ctx, janus_duktape_method_readfile, 1);
+	duk_put_global_string(ctx, "readFile");
+	duk_push_c_function(ctx, janus_duktape_method_pokescheduler, 0);
+	duk_put_global_string(ctx, "pokeScheduler");
+	duk_push_c_function(ctx, janus_duktape_method_timecallback, 3);
+	duk_put_global_string(ctx, "timeCallback");
+	duk_push_c_function(ctx, janus_duktape_method_pushevent, 4);
+	duk_put_global_string(ctx, "pushEvent");
+	duk_push_c_function(ctx, janus_duktape_method_notifyevent, 2);
+	duk_put_global_string(ctx, "notifyEvent");
+	duk_push_c_function(ctx, janus_duktape_method_eventsisenabled, 0);
+	duk_put_global_string(ctx, "eventsIsEnabled");
+	duk_push_c_function(ctx, janus_duktape_method_closepc, 1);
+	duk_put_global_string(ctx, "closePc");
+	duk_push_c_function(ctx, janus_duktape_method_endsession, 1);
+	duk_put_global_string(ctx, "endSession");
+	duk_push_c_function(ctx, janus_duktape_method_configuremedium, 4);
+	duk_put_global_string(ctx, "configureMedium");
+	duk_push_c_function(ctx, janus_duktape_method_addrecipient, 2);
+	duk_put_global_string(ctx, "addRecipient");
+	duk_push_c_function(ctx, janus_duktape_method_removerecipient, 2);
+	duk_put_global_string(ctx, "removeRecipient");
+	duk_push_c_function(ctx, janus_duktape_method_setbitrate, 2);
+	duk_put_global_string(ctx, "setBitrate");
+	duk_push_c_function(ctx, janus_duktape_method_setplifreq, 2);
+	duk_put_global_string(ctx, "setPliFreq");
+	duk_push_c_function(ctx, janus_duktape_method_setsubstream, 2);
+	duk_put_global_string(ctx, "setSubstream");
+	duk_push_c_function(ctx, janus_duktape_method_settemporallayer, 2);
+	duk_put_global_string(ctx, "setTemporalLayer");
+	duk_push_c_function(ctx, janus_duktape_method_sendpli, 1);
+	duk_put_global_string(ctx, "sendPli");
+	duk_push_c_function(ctx, janus_duktape_method_relayrtp, 4);
+	duk_put_global_string(ctx, "relayRtp");
+	duk_push_c_function(ctx, janus_duktape_method_relayrtcp, 4);
+	duk_put_global_string(ctx, "relayRtcp");
+	duk_push_c_function(ctx, janus_duktape_method_relaydata, 5);	/* Legacy function, deprecated */
+	duk_put_global_string(ctx, "relayData");
+	duk_push_c_function(ctx, janus_duktape_method_relaytextdata, 5);
+	duk_put_global_string(ctx, "relayTextData");
+	duk_push_c_function(ctx, janus_duktape_method_relaybinarydata, 5);
+	duk_put_global_string(ctx, "relayBinaryData");
+	duk_push_c_function(ctx, janus_duktape_method_startrecording, 13);
+	duk_put_global_string(ctx, "startRecording");
+	duk_push_c_function(ctx, janus_duktape_method_stoprecording, 4);
+	duk_put_global_string(ctx, "stopRecording");
+	duk_push_c_function(ctx, janus_duktape_method_getversion, 0);
+	duk_put_global_string(ctx, "getDuktapeVersion");
+	/* Register all extra functions, if any were added */
+	janus_duktape_register_extra_functions(ctx);
+}
+
 int janus_duktape_init(janus_callbacks *callback, const char *config_path) {
 	if(g_atomic_int_get(&duktape_stopping)) {
 		/* Still stopping from before */
@@ -1525,6 +1736,15 @@ int janus_duktape_init(janus_callbacks *callback, const char *config_path) {
 	janus_config_item *conf = janus_config_get(config, config_general, janus_config_type_item, "config");
 	if(conf && conf->value)
 		duktape_config = g_strdup(conf->value);
+	int pool_size = 0;
+	janus_config_item *shards = janus_config_get(config, config_general, janus_config_type_item, "packet_contexts");
+	if(shards && shards->value) {
+		pool_size = atoi(shards->value);
+		if(pool_size < 0) {
+			JANUS_LOG(LOG_WARN, "Invalid number of packet contexts (%s), disabling sharding\n", shards->value);
+			pool_size = 0;
+		}
+	}
 	janus_config_destroy(config);
 
 	/* Initialize Duktape */
@@ -1538,58 +1758,7 @@ int janus_duktape_init(janus_callbacks *callback, const char *config_path) {
 	duk_module_duktape_init(duktape_ctx);
 
 	/* Register our functions */
-	duk_push_c_function(duktape_ctx, janus_duktape_method_getmodulesfolder, 0);
-	duk_put_global_string(duktape_ctx, "getModulesFolder");
-	duk_push_c_function(duktape_ctx, janus_duktape_method_readfile, 1);
-	duk_put_global_string(duktape_ctx, "readFile");
-	duk_push_c_function(duktape_ctx, janus_duktape_method_pokescheduler, 0);
-	duk_put_global_string(duktape_ctx, "pokeScheduler");
-	duk_push_c_function(duktape_ctx, janus_duktape_method_timecallback, 3);
-	duk_put_global_string(duktape_ctx, "timeCallback");
-	duk_push_c_function(duktape_ctx, janus_duktape_method_pushevent, 4);
-	duk_put_global_string(duktape_ctx, "pushEvent");
-	duk_push_c_function(duktape_ctx, janus_duktape_method_notifyevent, 2);
-	duk_put_global_string(duktape_ctx, "notifyEvent");
-	duk_push_c_function(duktape_ctx, janus_duktape_method_eventsisenabled, 0);
-	duk_put_global_string(duktape_ctx, "eventsIsEnabled");
-	duk_push_c_function(duktape_ctx, janus_duktape_method_closepc, 1);
-	duk_put_global_string(duktape_ctx, "closePc");
-	duk_push_c_function(duktape_ctx, janus_duktape_method_endsession, 1);
-	duk_put_global_string(duktape_ctx, "endSession");
-	duk_push_c_function(duktape_ctx, janus_duktape_method_configuremedium, 4);
-	duk_put_global_string(duktape_ctx, "configureMedium");
-	duk_push_c_function(duktape_ctx, janus_duktape_method_addrecipient, 2);
-	duk_put_global_string(duktape_ctx, "addRecipient");
-	duk_push_c_function(duktape_ctx, janus_duktape_method_removerecipient, 2);
-	duk_put_global_string(duktape_ctx, "removeRecipient");
-	duk_push_c_function(duktape_ctx, janus_duktape_method_setbitrate, 2);
-	duk_put_global_string(duktape_ctx, "setBitrate");
-	duk_push_c_function(duktape_ctx, janus_duktape_method_setplifreq, 2);
-	duk_put_global_string(duktape_ctx, "setPliFreq");
-	duk_push_c_function(duktape_ctx, janus_duktape_method_setsubstream, 2);
-	duk_put_global_string(duktape_ctx, "setSubstream");
-	duk_push_c_function(duktape_ctx, janus_duktape_method_settemporallayer, 2);
-	duk_put_global_string(duktape_ctx, "setTemporalLayer");
-	duk_push_c_function(duktape_ctx, janus_duktape_method_sendpli, 1);
-	duk_put_global_string(duktape_ctx, "sendPli");
-	duk_push_c_function(duktape_ctx, janus_duktape_method_relayrtp, 4);
-	duk_put_global_string(duktape_ctx, "relayRtp");
-	duk_push_c_function(duktape_ctx, janus_duktape_method_relayrtcp, 4);
-	duk_put_global_string(duktape_ctx, "relayRtcp");
-	duk_push_c_function(duktape_ctx, janus_duktape_method_relaydata, 5);	/* Legacy function, deprecated */
-	duk_put_global_string(duktape_ctx, "relayData");
-	duk_push_c_function(duktape_ctx, janus_duktape_method_relaytextdata, 5);
-	duk_put_global_string(duktape_ctx, "relayTextData");
-	duk_push_c_function(duktape_ctx, janus_duktape_method_relaybinarydata, 5);
-	duk_put_global_string(duktape_ctx, "relayBinaryData");
-	duk_push_c_function(duktape_ctx, janus_duktape_method_startrecording, 13);
-	duk_put_global_string(duktape_ctx, "startRecording");
-	duk_push_c_function(duktape_ctx, janus_duktape_method_stoprecording, 4);
-	duk_put_global_string(duktape_ctx, "stopRecording");
-	duk_push_c_function(duktape_ctx, janus_duktape_method_getversion, 0);
-	duk_put_global_string(duktape_ctx, "getDuktapeVersion");
-	/* Register all extra functions, if any were added */
-	janus_duktape_register_extra_functions(duktape_ctx);
+	janus_duktape_register_functions(duktape_ctx);
 
 	/* Now load the script (FIXME badly) */
 	FILE *f = fopen(duktape_file, "rb");
@@ -1623,13 +1792,32 @@ int janus_duktape_init(janus_callbacks *callback, const char *config_path) {
 		return -1;
 	}
 	fclose(f);
+	/* Compile the script once: we dump the compiled program to bytecode, so
+	 * that additional contexts (if sharding is enabled) can load it without
+	 * paying for a compilation of the source each */
 	duk_push_lstring(duktape_ctx, (const char *)buf, (duk_size_t)len);
 	g_free(buf);
-	if(duk_peval(duktape_ctx) != 0) {
+	duk_push_string(duktape_ctx, duktape_file);
+	if(duk_pcompile(duktape_ctx, 0) != 0) {
+		JANUS_LOG(LOG_ERR, "Error compiling JS script %s: %s\n", duktape_file, duk_safe_to_string(duktape_ctx, -1));
+		duk_destroy_heap(duktape_ctx);
+		g_free(duktape_folder);
+		g_free(duktape_file);
+		return -1;
+	}
+	duk_dump_function(duktape_ctx);
+	duk_size_t bclen = 0;
+	void *bcdata = duk_get_buffer_data(duktape_ctx, -1, &bclen);
+	char *bytecode = (char *)g_malloc(bclen);
+	memcpy(bytecode, bcdata, bclen);
+	/* Now load the bytecode back and run the program in the main context */
+	duk_load_function(duktape_ctx);
+	if(duk_pcall(duktape_ctx, 0) != DUK_EXEC_SUCCESS) {
 		JANUS_LOG(LOG_ERR, "Error loading JS script %s: %s\n", duktape_file, duk_safe_to_string(duktape_ctx, -1));
 		duk_destroy_heap(duktape_ctx);
 		g_free(duktape_folder);
 		g_free(duktape_file);
+		g_free(bytecode);
 		return -1;
 	}
 	duk_pop(duktape_ctx);
@@ -1642,6 +1830,7 @@ int janus_duktape_init(janus_callbacks *callback, const char *config_path) {
 			duk_destroy_heap(duktape_ctx);
 			g_free(duktape_folder);
 			g_free(duktape_file);
+			g_free(bytecode);
 			return -1;
 		}
 	}
@@ -1719,6 +1908,7 @@ int janus_duktape_init(janus_callbacks *callback, const char *config_path) {
 		g_free(duktape_folder);
 		g_free(duktape_file);
 		g_free(duktape_config);
+		g_free(bytecode);
 		return -1;
 	}
 	/* Launch the timer loop thread (which will be responsible for scheduling timed callbacks) */
@@ -1738,6 +1928,7 @@ int janus_duktape_init(janus_callbacks *callback, const char *config_path) {
 		g_free(duktape_folder);
 		g_free(duktape_file);
 		g_free(duktape_config);
+		g_free(bytecode);
 		return -1;
 	}
 
@@ -1760,9 +1951,72 @@ int janus_duktape_init(janus_callbacks *callback, const char *config_path) {
 		g_free(duktape_folder);
 		g_free(duktape_file);
 		g_free(duktape_config);
+		g_free(bytecode);
 		return -1;
 	}
 
+	/* If sharding of packet callbacks was requested, and the script actually
+	 * handles packets itself, create the pool of additional Duktape contexts */
+	if(pool_size > 0 && !(has_incoming_rtp || has_incoming_rtcp ||
+			has_incoming_data_legacy || has_incoming_text_data || has_incoming_binary_data)) {
+		JANUS_LOG(LOG_WARN, "Sharded packet contexts configured, but the script doesn't handle packets itself, ignoring\n");
+		pool_size = 0;
+	}
+	if(pool_size > 0) {
+		JANUS_LOG(LOG_INFO, "Creating %d additional Duktape context%s for packet callbacks\n",
+			pool_size, pool_size == 1 ? "" : "s");
+		packet_contexts = g_malloc0(pool_size * sizeof(janus_duktape_packet_context));
+		int s = 0;
+		for(s = 0; s < pool_size; s++) {
+			duk_context *ctx = duk_create_heap_default();
+			if(ctx != NULL) {
+				duk_console_init(ctx, DUK_CONSOLE_PROXY_WRAPPER);
+				duk_module_duktape_init(ctx);
+				janus_duktape_register_functions(ctx);
+				/* Load the bytecode we compiled before, and run the program */
+				void *bcdup = duk_push_fixed_buffer(ctx, bclen);
+				memcpy(bcdup, bytecode, bclen);
+				duk_load_function(ctx);
+				if(duk_pcall(ctx, 0) != DUK_EXEC_SUCCESS) {
+					JANUS_LOG(LOG_ERR, "Error loading JS script in packet context %d: %s\n",
+						s, duk_safe_to_string(ctx, -1));
+					duk_destroy_heap(ctx);
+					ctx = NULL;
+				} else {
+					duk_pop(ctx);
+					/* Init this copy of the script too */
+					duk_get_global_string(ctx, "init");
+					duk_push_string(ctx, duktape_config);
+					if(duk_pcall(ctx, 1) != DUK_EXEC_SUCCESS) {
+						JANUS_LOG(LOG_ERR, "Duktape error in packet context %d: %s\n",
+							s, duk_safe_to_string(ctx, -1));
+						duk_destroy_heap(ctx);
+						ctx = NULL;
+					} else {
+						duk_pop(ctx);
+					}
+				}
+			}
+			if(ctx == NULL) {
+				/* Not a fatal error: get rid of the pool and fall back to the main context */
+				JANUS_LOG(LOG_ERR, "Error creating Duktape packet context, disabling sharding\n");
+				int c = 0;
+				for(c = 0; c < s; c++) {
+					duk_destroy_heap(packet_contexts[c].ctx);
+					janus_mutex_destroy(&packet_contexts[c].mutex);
+				}
+				g_free(packet_contexts);
+				packet_contexts = NULL;
+				break;
+			}
+			packet_contexts[s].ctx = ctx;
+			janus_mutex_init(&packet_contexts[s].mutex);
+		}
+		if(packet_contexts != NULL)
+			num_packet_contexts = pool_size;
+	}
+	g_free(bytecode);
+
 	g_free(duktape_file);
 	g_free(duktape_config);
 
@@ -1821,6 +2075,25 @@ void janus_duktape_destroy(void) {
 	duktape_ctx = NULL;
 	janus_mutex_unlock(&duktape_mutex);
 
+	/* Get rid of the packet contexts too, if sharding was enabled */
+	if(packet_contexts != NULL) {
+		int s = 0;
+		for(s = 0; s < num_packet_contexts; s++) {
+			janus_mutex_lock(&packet_contexts[s].mutex);
+			/* Deinit this copy of the script as well */
+			duk_get_global_string(packet_contexts[s].ctx, "destroy");
+			if(duk_pcall(packet_contexts[s].ctx, 0) != DUK_EXEC_SUCCESS)
+				JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(packet_contexts[s].ctx, -1));
+			duk_destroy_heap(packet_contexts[s].ctx);
+			packet_contexts[s].ctx = NULL;
+			janus_mutex_unlock(&packet_contexts[s].mutex);
+			janus_mutex_destroy(&packet_contexts[s].mutex);
+		}
+		g_free(packet_contexts);
+		packet_contexts = NULL;
+		num_packet_contexts = 0;
+	}
+
 	g_free(duktape_script_version_string);
 	g_free(duktape_script_description);
 	g_free(duktape_script_name);
@@ -2081,6 +2354,11 @@ void janus_duktape_create_session(janus_plugin_session *handle, int *error) {
 	g_atomic_int_set(&session->hangingup, 0);
 	g_atomic_int_set(&session->destroyed, 0);
 	janus_refcount_init(&session->ref, janus_duktape_session_free);
+	if(num_packet_contexts > 0) {
+		/* Packet callbacks are sharded: assign this session a context, round robin */
+		guint index = (guint)g_atomic_int_add(&next_packet_context, 1) % num_packet_contexts;
+		session->packet_ctx = &packet_contexts[index];
+	}
 	handle->plugin_handle = session;
 	g_hash_table_insert(duktape_sessions, handle, session);
 	g_hash_table_insert(duktape_ids, GUINT_TO_POINTER(session->id), session);
@@ -2100,6 +2378,7 @@ void janus_duktape_create_session(janus_plugin_session *handle, int *error) {
 	duk_pop(t);
 	duk_pop(duktape_ctx);
 	janus_mutex_unlock(&duktape_mutex);
+	janus_duktape_packet_context_notify(session, "createSession");
 
 	return;
 }
@@ -2136,6 +2415,7 @@ void janus_duktape_destroy_session(janus_plugin_session *handle, int *error) {
 	duk_pop(t);
 	duk_pop(duktape_ctx);
 	janus_mutex_unlock(&duktape_mutex);
+	janus_duktape_packet_context_notify(session, "destroySession");
 
 	/* Get any rid references recipients of this sessions may have */
 	janus_mutex_lock(&session->recipients_mutex);
@@ -2311,6 +2591,18 @@ struct janus_plugin_result *janus_duktape_handle_message(janus_plugin_session *h
 			return janus_plugin_result_new(JANUS_PLUGIN_ERROR, "Duktape error", NULL);
 		}
 		return janus_plugin_result_new(JANUS_PLUGIN_OK, NULL, json);
+	} else if(duk_get_type(t, 0) == DUK_TYPE_OBJECT) {
+		/* The script returned the synchronous response as a plain object,
+		 * which we can convert directly without a JSON string round trip */
+		json_t *json = janus_duktape_get_json(t, 0);
+		duk_pop(t);
+		duk_pop(duktape_ctx);
+		janus_mutex_unlock(&duktape_mutex);
+		if(!json) {
+			JANUS_LOG(LOG_ERR, "Couldn't convert response object\n");
+			return janus_plugin_result_new(JANUS_PLUGIN_ERROR, "Duktape error", NULL);
+		}
+		return janus_plugin_result_new(JANUS_PLUGIN_OK, NULL, json);
 	}
 	/* If we got here, we didn't get what we expect */
 	duk_pop(t);
@@ -2393,6 +2685,7 @@ void janus_duktape_setup_media(janus_plugin_session *handle) {
 	duk_pop(t);
 	duk_pop(duktape_ctx);
 	janus_mutex_unlock(&duktape_mutex);
+	janus_duktape_packet_context_notify(session, "setupMedia");
 	janus_refcount_decrease(&session->ref);
 }
 
@@ -2411,10 +2704,14 @@ void janus_duktape_incoming_rtp(janus_plugin_session *handle, janus_plugin_rtp *
 	uint16_t len = rtp_packet->length;
 	/* Check if the JS script wants to handle/manipulate RTP packets itself */
 	if(has_incoming_rtp) {
-		/* Yep, pass the data to the JS script and return */
-		janus_mutex_lock(&duktape_mutex);
-		duk_idx_t thr_idx = duk_push_thread(duktape_ctx);
-		duk_context *t = duk_get_context(duktape_ctx, thr_idx);
+		/* Yep, pass the data to the JS script and return: if this session's
+		 * packet callbacks are sharded, use its dedicated context */
+		janus_duktape_packet_context *shard = session->packet_ctx;
+		duk_context *ctx = shard ? shard->ctx : duktape_ctx;
+		janus_mutex *mutex = shard ? &shard->mutex : &duktape_mutex;
+		janus_mutex_lock(mutex);
+		duk_idx_t thr_idx = duk_push_thread(ctx);
+		duk_context *t = duk_get_context(ctx, thr_idx);
 		duk_get_global_string(t, "incomingRtp");
 		duk_push_number(t, session->id);
 		duk_push_boolean(t, video);
@@ -2426,8 +2723,8 @@ void janus_duktape_incoming_rtp(janus_plugin_session *handle, janus_plugin_rtp *
 			JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(t, -1));
 		}
 		duk_pop(t);
-		duk_pop(duktape_ctx);
-		janus_mutex_unlock(&duktape_mutex);
+		duk_pop(ctx);
+		janus_mutex_unlock(mutex);
 		return;
 	}
 	/* Is this session allowed to send media? */
@@ -2528,10 +2825,14 @@ void janus_duktape_incoming_rtcp(janus_plugin_session *handle, janus_plugin_rtcp
 	uint16_t len = packet->length;
 	/* Check if the JS script wants to handle/manipulate RTCP packets itself */
 	if(has_incoming_rtcp) {
-		/* Yep, pass the data to the JS script and return */
-		janus_mutex_lock(&duktape_mutex);
-		duk_idx_t thr_idx = duk_push_thread(duktape_ctx);
-		duk_context *t = duk_get_context(duktape_ctx, thr_idx);
+		/* Yep, pass the data to the JS script and return: if this session's
+		 * packet callbacks are sharded, use its dedicated context */
+		janus_duktape_packet_context *shard = session->packet_ctx;
+		duk_context *ctx = shard ? shard->ctx : duktape_ctx;
+		janus_mutex *mutex = shard ? &shard->mutex : &duktape_mutex;
+		janus_mutex_lock(mutex);
+		duk_idx_t thr_idx = duk_push_thread(ctx);
+		duk_context *t = duk_get_context(ctx, thr_idx);
 		duk_get_global_string(t, "incomingRtcp");
 		duk_push_number(t, session->id);
 		duk_push_boolean(t, video);
@@ -2543,8 +2844,8 @@ void janus_duktape_incoming_rtcp(janus_plugin_session *handle, janus_plugin_rtcp
 			JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(t, -1));
 		}
 		duk_pop(t);
-		duk_pop(duktape_ctx);
-		janus_mutex_unlock(&duktape_mutex);
+		duk_pop(ctx);
+		janus_mutex_unlock(mutex);
 		return;
 	}
 	/* If a REMB arrived, make sure we cap it to our configuration, and send it as a video RTCP */
@@ -2587,9 +2888,13 @@ void janus_duktape_incoming_data(janus_plugin_session *handle, janus_plugin_data
 		/* Yep, pass the data to the JS script and return */
 		if(packet->binary && !has_incoming_text_data)
 			JANUS_LOG(LOG_WARN, "Missing 'incomingTextData', invoking deprecated function 'incomingData' instead\n");
-		janus_mutex_lock(&duktape_mutex);
-		duk_idx_t thr_idx = duk_push_thread(duktape_ctx);
-		duk_context *t = duk_get_context(duktape_ctx, thr_idx);
+		/* If this session's packet callbacks are sharded, use its dedicated context */
+		janus_duktape_packet_context *shard = session->packet_ctx;
+		duk_context *ctx = shard ? shard->ctx : duktape_ctx;
+		janus_mutex *mutex = shard ? &shard->mutex : &duktape_mutex;
+		janus_mutex_lock(mutex);
+		duk_idx_t thr_idx = duk_push_thread(ctx);
+		duk_context *t = duk_get_context(ctx, thr_idx);
 		duk_get_global_string(t, packet->binary ? "incomingBinaryData" : (has_incoming_text_data ? "incomingTextData" : "incomingData"));
 		duk_push_number(t, session->id);
 		/* We use a string for both text and binary data */
@@ -2603,8 +2908,8 @@ void janus_duktape_incoming_data(janus_plugin_session *handle, janus_plugin_data
 			JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(t, -1));
 		}
 		duk_pop(t);
-		duk_pop(duktape_ctx);
-		janus_mutex_unlock(&duktape_mutex);
+		duk_pop(ctx);
+		janus_mutex_unlock(mutex);
 		return;
 	}
 	/* Is this session allowed to send data? */
@@ -2763,6 +3068,7 @@ void janus_duktape_hangup_media(janus_plugin_session *handle) {
 	duk_pop(t);
 	duk_pop(duktape_ctx);
 	janus_mutex_unlock(&duktape_mutex);
+	janus_duktape_packet_context_notify(session, "hangupMedia");
 	janus_refcount_decrease(&session->ref);
 }
 
@@ -47,6 +47,12 @@ extern janus_callbacks *duktape_janus_core;
 extern duk_context *duktape_ctx;
 extern janus_mutex duktape_mutex;
 
+/* Additional Duktape context dedicated to packet callbacks, when sharding is enabled */
+typedef struct janus_duktape_packet_context {
+	duk_context *ctx;		/* Independent Duktape heap running its own copy of the script */
+	janus_mutex mutex;		/* Mutex to serialize access to this context */
+} janus_duktape_packet_context;
+
 /* Duktape session: we keep only the barebone stuff here, the rest will be in the JavaScript script */
 typedef struct janus_duktape_session {
 	janus_plugin_session *handle;		/* Pointer to the core-plugin session */
@@ -84,6 +90,7 @@ typedef struct janus_duktape_session {
 	volatile gint dataready;			/* Whether the data channel was established on this sessions's PeerConnection */
 	volatile gint hangingup;			/* Whether this session's PeerConnection is hanging up */
 	volatile gint destroyed;			/* Whether this session's been marked as destroyed */
+	janus_duktape_packet_context *packet_ctx;	/* Duktape context to use for this session's packet callbacks (NULL=main context) */
 	/* If you need any additional property (e.g., for hooks you added in janus_duktape_extra.c) add them below this line */
 
 	/* Reference counter */
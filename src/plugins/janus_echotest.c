@@ -109,6 +109,47 @@
 	"echotest" : "event",
 	"result": "done"
 }
+\endverbatim
+ *
+ * \section echobench Benchmark mode
+ *
+ * To make media path optimizations measurable without external tools,
+ * the plugin can also generate synthetic RTP traffic itself, and track
+ * how long each packet takes to traverse the echo path, up to the point
+ * where it's handed to the core for delivery. A benchmark is started
+ * (and stopped early, if needed) with:
+ *
+\verbatim
+{
+	"benchmark" : "start|stop",
+	"pps" : <packets per second to generate; optional, default=1000>,
+	"size" : <payload size in bytes, max 1200; optional, default=200>,
+	"duration" : <benchmark duration in seconds; optional, default=10>
+}
+\endverbatim
+ *
+ * Each attached handle can run its own generator, so attaching multiple
+ * handles and starting a benchmark on each provides an aggregate load
+ * test. When the benchmark is over, a report is sent back with the number
+ * of packets that were generated, the rate that was actually achieved,
+ * whether the target rate proved sustainable (i.e., the generator never
+ * fell behind schedule), and a percentile breakdown of the per-packet
+ * latency through the media path, in microseconds:
+ *
+\verbatim
+{
+	"echotest" : "event",
+	"result" : {
+		"event" : "benchmark",
+		"packets" : <number of packets generated>,
+		"target_pps" : <rate that was asked>,
+		"achieved_pps" : <rate that was actually achieved>,
+		"sustainable" : true|false,
+		"latency" : {
+			"median" : <µs>, "p90" : <µs>, "p99" : <µs>, "max" : <µs>
+		}
+	}
+}
 \endverbatim
  */
 
@@ -212,6 +253,10 @@ static struct janus_json_parameter request_parameters[] = {
 	{"opusred", JANUS_JSON_BOOL, 0},
 	{"min_delay", JSON_INTEGER, 0},
 	{"max_delay", JSON_INTEGER, 0},
+	{"benchmark", JSON_STRING, 0},
+	{"pps", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
+	{"size", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
+	{"duration", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
 };
 
 /* Useful stuff */
@@ -220,6 +265,7 @@ static gboolean notify_events = TRUE;
 static janus_callbacks *gateway = NULL;
 static GThread *handler_thread;
 static void *janus_echotest_handler(void *data);
+static void *janus_echotest_benchmark_thread(void *data);
 static void janus_echotest_hangup_media_internal(janus_plugin_session *handle);
 
 typedef struct janus_echotest_message {
@@ -259,6 +305,8 @@ typedef struct janus_echotest_session {
 	guint16 slowlink_count;
 	int16_t min_delay, max_delay;
 	int8_t spatial_layers, temporal_layers;
+	guint benchmark_pps, benchmark_size, benchmark_duration;
+	volatile gint benchmarking;	/* Whether a synthetic benchmark is running on this session */
 	volatile gint hangingup;
 	volatile gint destroyed;
 	janus_refcount ref;
@@ -312,6 +360,7 @@ static void janus_echotest_message_free(janus_echotest_message *msg) {
 #define JANUS_ECHOTEST_ERROR_INVALID_JSON		412
 #define JANUS_ECHOTEST_ERROR_INVALID_ELEMENT	413
 #define JANUS_ECHOTEST_ERROR_INVALID_SDP		414
+#define JANUS_ECHOTEST_ERROR_BENCHMARK			415
 
 
 /* Plugin implementation */
@@ -453,6 +502,7 @@ void janus_echotest_create_session(janus_plugin_session *handle, int *error) {
 	session->max_delay = -1;
 	session->spatial_layers = -1;
 	session->temporal_layers = -1;
+	g_atomic_int_set(&session->benchmarking, 0);
 	session->destroyed = 0;
 	g_atomic_int_set(&session->hangingup, 0);
 	g_atomic_int_set(&session->destroyed, 0);
@@ -539,6 +589,8 @@ json_t *janus_echotest_query_session(janus_plugin_session *handle) {
 	}
 	if(session->e2ee)
 		json_object_set_new(info, "e2ee", json_true());
+	if(g_atomic_int_get(&session->benchmarking))
+		json_object_set_new(info, "benchmarking", json_true());
 	json_object_set_new(info, "slowlink_count", json_integer(session->slowlink_count));
 	json_object_set_new(info, "hangingup", json_integer(g_atomic_int_get(&session->hangingup)));
 	json_object_set_new(info, "destroyed", json_integer(g_atomic_int_get(&session->destroyed)));
@@ -834,6 +886,111 @@ void janus_echotest_slow_link(janus_plugin_session *handle, int mindex, gboolean
 	janus_refcount_decrease(&session->ref);
 }
 
+/* Synthetic benchmark: a generator thread crafts RTP packets at the target
+ * rate and feeds them through the same incoming_rtp entry point the core
+ * uses, so that each packet traverses the whole echo path (simulcast
+ * handling, recording, handing the packet back via relay_rtp). The time
+ * each packet spends in that path is sampled via a monotonic timestamp
+ * embedded in the payload, and aggregated in a microsecond histogram we
+ * then compute percentiles from; if the generator couldn't stay on
+ * schedule, the target rate is reported as not sustainable */
+#define JANUS_ECHOTEST_BENCHMARK_MAXLAT		8192	/* The histogram covers per-packet latencies up to ~8ms */
+static guint32 janus_echotest_benchmark_percentile(guint32 *histogram, guint64 samples, int percentile) {
+	guint64 target = (samples * percentile) / 100, count = 0;
+	int i = 0;
+	for(i = 0; i <= JANUS_ECHOTEST_BENCHMARK_MAXLAT; i++) {
+		count += histogram[i];
+		if(count > target)
+			return i;
+	}
+	return JANUS_ECHOTEST_BENCHMARK_MAXLAT;
+}
+static void *janus_echotest_benchmark_thread(void *data) {
+	janus_echotest_session *session = (janus_echotest_session *)data;
+	guint pps = session->benchmark_pps, size = session->benchmark_size, duration = session->benchmark_duration;
+	JANUS_LOG(LOG_INFO, "[%s-%p] Starting benchmark: %u packets/s, %u bytes of payload, %u seconds\n",
+		JANUS_ECHOTEST_PACKAGE, session->handle, pps, size, duration);
+	guint32 *histogram = g_malloc0((JANUS_ECHOTEST_BENCHMARK_MAXLAT+1)*sizeof(guint32));
+	char *buffer = g_malloc0(sizeof(janus_rtp_header) + size);
+	janus_rtp_header *header = (janus_rtp_header *)buffer;
+	header->version = 2;
+	header->type = 111;	/* The payload type doesn't really matter, we only care about the path */
+	header->ssrc = htonl(g_random_int());
+	uint16_t seq = g_random_int() & 0xFFFF;
+	uint32_t rtp_ts = g_random_int();
+	/* We pace the generator in 10ms bursts, to avoid a sleep between every two packets */
+	guint burst = pps/100;
+	if(burst == 0)
+		burst = 1;
+	gint64 started = g_get_monotonic_time(), next = started,
+		finish = started + (gint64)duration*G_USEC_PER_SEC;
+	guint64 generated = 0, late = 0;
+	gint64 max_lat = 0;
+	while(g_atomic_int_get(&session->benchmarking) && !g_atomic_int_get(&session->destroyed) &&
+			!g_atomic_int_get(&stopping) && g_get_monotonic_time() < finish) {
+		guint i = 0;
+		for(i = 0; i < burst; i++) {
+			seq++;
+			rtp_ts += 960;
+			header->seq_number = htons(seq);
+			header->timestamp = htonl(rtp_ts);
+			gint64 before = g_get_monotonic_time();
+			memcpy(buffer + sizeof(janus_rtp_header), &before, sizeof(before));
+			janus_plugin_rtp packet = { .mindex = -1, .video = FALSE,
+				.buffer = buffer, .length = sizeof(janus_rtp_header) + size };
+			janus_plugin_rtp_extensions_reset(&packet.extensions);
+			janus_echotest_incoming_rtp(session->handle, &packet);
+			/* The timestamp we embedded is still in the payload: check how
+			 * long the packet took to be handed back to the core for delivery */
+			gint64 embedded = 0;
+			memcpy(&embedded, buffer + sizeof(janus_rtp_header), sizeof(embedded));
+			gint64 latency = g_get_monotonic_time() - embedded;
+			if(latency > max_lat)
+				max_lat = latency;
+			histogram[latency > JANUS_ECHOTEST_BENCHMARK_MAXLAT ? JANUS_ECHOTEST_BENCHMARK_MAXLAT : latency]++;
+			generated++;
+		}
+		next += G_USEC_PER_SEC/100;
+		gint64 now = g_get_monotonic_time();
+		if(now < next)
+			g_usleep(next - now);
+		else
+			late++;	/* This burst ended after the next one was due: we're not keeping up */
+	}
+	gint64 elapsed = g_get_monotonic_time() - started;
+	guint64 achieved = elapsed > 0 ? (generated*G_USEC_PER_SEC)/elapsed : 0;
+	JANUS_LOG(LOG_INFO, "[%s-%p] Benchmark over: %"SCNu64" packets in %"SCNi64"ms (%"SCNu64" packets/s)\n",
+		JANUS_ECHOTEST_PACKAGE, session->handle, generated, elapsed/1000, achieved);
+	/* Notify the results */
+	json_t *event = json_object();
+	json_object_set_new(event, "echotest", json_string("event"));
+	json_t *result = json_object();
+	json_object_set_new(result, "event", json_string("benchmark"));
+	json_object_set_new(result, "packets", json_integer(generated));
+	json_object_set_new(result, "target_pps", json_integer(pps));
+	json_object_set_new(result, "achieved_pps", json_integer(achieved));
+	/* If we never fell behind schedule, the target rate is sustainable */
+	json_object_set_new(result, "sustainable", late == 0 ? json_true() : json_false());
+	if(generated > 0) {
+		/* All latency values are in microseconds */
+		json_t *latency = json_object();
+		json_object_set_new(latency, "median", json_integer(janus_echotest_benchmark_percentile(histogram, generated, 50)));
+		json_object_set_new(latency, "p90", json_integer(janus_echotest_benchmark_percentile(histogram, generated, 90)));
+		json_object_set_new(latency, "p99", json_integer(janus_echotest_benchmark_percentile(histogram, generated, 99)));
+		json_object_set_new(latency, "max", json_integer(max_lat));
+		json_object_set_new(result, "latency", latency);
+	}
+	json_object_set_new(event, "result", result);
+	gateway->push_event(session->handle, &janus_echotest_plugin, NULL, event, NULL);
+	json_decref(event);
+	g_free(histogram);
+	g_free(buffer);
+	g_atomic_int_set(&session->benchmarking, 0);
+	janus_refcount_decrease(&session->ref);
+	g_thread_unref(g_thread_self());
+	return NULL;
+}
+
 static void janus_echotest_recorder_close(janus_echotest_session *session) {
 	if(session->arc) {
 		janus_recorder *rc = session->arc;
@@ -888,6 +1045,8 @@ static void janus_echotest_hangup_media_internal(janus_plugin_session *handle) {
 	janus_mutex_lock(&session->rec_mutex);
 	janus_echotest_recorder_close(session);
 	janus_mutex_unlock(&session->rec_mutex);
+	/* Interrupt the benchmark, if one was running */
+	g_atomic_int_set(&session->benchmarking, 0);
 	/* Reset controls */
 	session->has_audio = FALSE;
 	session->has_video = FALSE;
@@ -1045,6 +1204,10 @@ static void *janus_echotest_handler(void *data) {
 		json_t *opusred = json_object_get(root, "opusred");
 		json_t *min_delay = json_object_get(root, "min_delay");
 		json_t *max_delay = json_object_get(root, "max_delay");
+		json_t *benchmark = json_object_get(root, "benchmark");
+		json_t *bench_pps = json_object_get(root, "pps");
+		json_t *bench_size = json_object_get(root, "size");
+		json_t *bench_duration = json_object_get(root, "duration");
 		/* Enforce request */
 		if(audio) {
 			session->audio_active = json_is_true(audio);
@@ -1162,6 +1325,44 @@ static void *janus_echotest_handler(void *data) {
 					session->min_delay = session->max_delay;
 			}
 		}
+		if(benchmark) {
+			const char *action = json_string_value(benchmark);
+			if(!strcasecmp(action, "start")) {
+				if(!g_atomic_int_compare_and_exchange(&session->benchmarking, 0, 1)) {
+					JANUS_LOG(LOG_ERR, "Benchmark already in progress\n");
+					error_code = JANUS_ECHOTEST_ERROR_BENCHMARK;
+					g_snprintf(error_cause, 512, "Benchmark already in progress");
+					goto error;
+				}
+				session->benchmark_pps = bench_pps ? json_integer_value(bench_pps) : 1000;
+				session->benchmark_size = bench_size ? json_integer_value(bench_size) : 200;
+				if(session->benchmark_size > 1200)
+					session->benchmark_size = 1200;
+				session->benchmark_duration = bench_duration ? json_integer_value(bench_duration) : 10;
+				/* Spawn the generator thread: it will hold a reference to the session */
+				janus_refcount_increase(&session->ref);
+				GError *thread_error = NULL;
+				g_thread_try_new("echotest bench", janus_echotest_benchmark_thread, session, &thread_error);
+				if(thread_error != NULL) {
+					g_atomic_int_set(&session->benchmarking, 0);
+					janus_refcount_decrease(&session->ref);
+					JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the benchmark thread...\n",
+						thread_error->code, thread_error->message ? thread_error->message : "??");
+					g_error_free(thread_error);
+					error_code = JANUS_ECHOTEST_ERROR_BENCHMARK;
+					g_snprintf(error_cause, 512, "Error launching the benchmark thread");
+					goto error;
+				}
+			} else if(!strcasecmp(action, "stop")) {
+				/* The generator thread will notice, push its report and exit */
+				g_atomic_int_set(&session->benchmarking, 0);
+			} else {
+				JANUS_LOG(LOG_ERR, "Invalid benchmark action '%s' (should be start|stop)\n", action);
+				error_code = JANUS_ECHOTEST_ERROR_INVALID_ELEMENT;
+				g_snprintf(error_cause, 512, "Invalid benchmark action '%s' (should be start|stop)", action);
+				goto error;
+			}
+		}
 
 		/* Any SDP to handle? */
 		if(msg_sdp) {
@@ -1173,7 +1374,7 @@ static void *janus_echotest_handler(void *data) {
 
 		if(!audio && !video && !videocodec && !videoprofile && !opusred && !bitrate &&
 				!substream && !temporal && !fallback && !spatial_layer && !temporal_layer &&
-				!record && !min_delay && !max_delay && !msg_sdp) {
+				!record && !min_delay && !max_delay && !benchmark && !msg_sdp) {
 			JANUS_LOG(LOG_ERR, "No supported attributes found\n");
 			error_code = JANUS_ECHOTEST_ERROR_INVALID_ELEMENT;
 			g_snprintf(error_cause, 512, "Message error: no supported attributes found");
@@ -187,6 +187,29 @@ timeCallback("resumeScheduler", nil, 0)
  * compact and less verbose, and as such is preferred in cases where
  * timing and opaque arguments are not needed.
  *
+ * \section luasharding Sharding packet callbacks across Lua states
+ *
+ * By default, every callback the C code routes to the Lua script runs on
+ * a single Lua state, protected by a global mutex: when a script decides
+ * to handle media itself (via \c incomingRtp() and related callbacks),
+ * that single state easily becomes a bottleneck, as every packet of every
+ * session has to go through it. To help with that, the plugin can be
+ * configured, via the \c packet_states property, to create a pool of
+ * additional Lua states dedicated to packet callbacks: each state loads
+ * and inits its own copy of the script, and sessions are sharded across
+ * the pool in a round robin fashion, so that media processing can happen
+ * in parallel on different cores.
+ *
+ * Since each state is an independent interpreter, globals are NOT shared
+ * between the main state and the pool. To keep per-session tables working,
+ * the session lifecycle callbacks ( \c createSession(), \c destroySession(),
+ * \c setupMedia() and \c hangupMedia() ) are replayed on the state a
+ * session has been sharded on, but everything else (message handling, the
+ * coroutine scheduler, timed callbacks) only happens on the main state:
+ * scripts relying on globals shared between application logic and packet
+ * processing should leave the property unset, which preserves the
+ * traditional single-state behaviour.
+ *
  * Refer to the \ref luapapi section for more information on how you
  * can register your own C functions.
  */
@@ -272,6 +295,15 @@ janus_callbacks *lua_janus_core = NULL;
 /* Lua stuff */
 lua_State *lua_state = NULL;
 janus_mutex lua_mutex = JANUS_MUTEX_INITIALIZER;
+/* Optional pool of additional Lua states dedicated to packet callbacks: when
+ * enabled via the 'packet_states' property, sessions are sharded across the
+ * pool, so that scripts doing per-packet processing (incomingRtp and related
+ * callbacks) don't all contend on the single global state. Each state runs
+ * its own copy of the script, so globals are NOT shared with the main state:
+ * scripts relying on that should keep this disabled (which is the default) */
+static janus_lua_packet_state *packet_states = NULL;
+static int num_packet_states = 0;
+static volatile gint next_packet_state = 0;
 static const char *lua_functions[] = {
 	"init", "destroy", "resumeScheduler",
 	"createSession", "destroySession", "querySession",
@@ -367,6 +399,23 @@ static void janus_lua_session_free(const janus_refcount *session_ref) {
 	g_free(session);
 }
 
+/* Helper to replay a session lifecycle notification on the copy of the script
+ * this session's packet callbacks have been sharded on, if any: application
+ * logic always runs on the main state, but media oriented scripts typically
+ * need to know about their sessions in per-state tables too */
+static void janus_lua_packet_state_notify(janus_lua_session *session, const char *function) {
+	janus_lua_packet_state *shard = session->packet_state;
+	if(shard == NULL)
+		return;
+	janus_mutex_lock(&shard->mutex);
+	lua_State *t = lua_newthread(shard->state);
+	lua_getglobal(t, function);
+	lua_pushnumber(t, session->id);
+	lua_call(t, 1, 0);
+	lua_pop(shard->state, 1);
+	janus_mutex_unlock(&shard->mutex);
+}
+
 /* Packet data and routing */
 typedef struct janus_lua_rtp_relay_packet {
 	janus_lua_session *sender;
@@ -1321,6 +1370,55 @@ static int janus_lua_method_stoprecording(lua_State *s) {
 
 
 /* Plugin implementation */
+/* Helper to register all our C functions in a Lua state: all of them are
+ * safe to invoke from any state, as they rely on their own locks and only
+ * reference sessions by ID, so the main state and the packet states (if
+ * sharding is enabled) all get the same bindings */
+static void janus_lua_register_functions(lua_State *state) {
+	lua_register(state, "janusLog", janus_lua_method_januslog);
+	lua_register(state, "pokeScheduler", janus_lua_method_pokescheduler);
+	lua_register(state, "timeCallback", janus_lua_method_timecallback);
+	lua_register(state, "pushEvent", janus_lua_method_pushevent);
+	lua_register(state, "notifyEvent", janus_lua_method_notifyevent);
+	lua_register(state, "eventsIsEnabled", janus_lua_method_eventsisenabled);
+	lua_register(state, "closePc", janus_lua_method_closepc);
+	lua_register(state, "endSession", janus_lua_method_endsession);
+	lua_register(state, "configureMedium", janus_lua_method_configuremedium);
+	lua_register(state, "addRecipient", janus_lua_method_addrecipient);
+	lua_register(state, "removeRecipient", janus_lua_method_removerecipient);
+	lua_register(state, "setBitrate", janus_lua_method_setbitrate);
+	lua_register(state, "setPliFreq", janus_lua_method_setplifreq);
+	lua_register(state, "setSubstream", janus_lua_method_setsubstream);
+	lua_register(state, "setTemporalLayer", janus_lua_method_settemporallayer);
+	lua_register(state, "sendPli", janus_lua_method_sendpli);
+	lua_register(state, "relayRtp", janus_lua_method_relayrtp);
+	lua_register(state, "relayRtcp", janus_lua_method_relayrtcp);
+	lua_register(state, "relayData", janus_lua_method_relaydata);	/* Legacy function, deprecated */
+	lua_register(state, "relayTextData", janus_lua_method_relaytextdata);
+	lua_register(state, "relayBinaryData", janus_lua_method_relaybinarydata);
+	lua_register(state, "startRecording", janus_lua_method_startrecording);
+	lua_register(state, "stopRecording", janus_lua_method_stoprecording);
+	/* Register all extra functions, if any were added */
+	janus_lua_register_extra_functions(state);
+}
+
+/* Helper to add the (optional) script folder to a Lua state's package path,
+ * so that other scripts can be loaded from there */
+static void janus_lua_add_folder_to_path(lua_State *state, const char *folder) {
+	if(folder == NULL)
+		return;
+	lua_getglobal(state, "package");
+	lua_getfield(state, -1, "path");
+	const char *cur_path = lua_tostring(state, -1);
+	char new_path[1024];
+	memset(new_path, 0, sizeof(new_path));
+	g_snprintf(new_path, sizeof(new_path), "%s;%s/?.lua", cur_path, folder);
+	lua_pop(state, 1);
+	lua_pushstring(state, new_path);
+	lua_setfield(state, -2, "path");
+	lua_pop(state, 1);
+}
+
 int janus_lua_init(janus_callbacks *callback, const char *config_path) {
 	if(g_atomic_int_get(&lua_stopping)) {
 		/* Still stopping from before */
@@ -1365,52 +1463,26 @@ int janus_lua_init(janus_callbacks *callback, const char *config_path) {
 	janus_config_item *conf = janus_config_get(config, config_general, janus_config_type_item, "config");
 	if(conf && conf->value)
 		lua_config = g_strdup(conf->value);
+	int pool_size = 0;
+	janus_config_item *shards = janus_config_get(config, config_general, janus_config_type_item, "packet_states");
+	if(shards && shards->value) {
+		pool_size = atoi(shards->value);
+		if(pool_size < 0) {
+			JANUS_LOG(LOG_WARN, "Invalid number of packet states (%s), disabling sharding\n", shards->value);
+			pool_size = 0;
+		}
+	}
 	janus_config_destroy(config);
 
 	/* Initialize Lua */
 	lua_state = luaL_newstate();
 	luaL_openlibs(lua_state);
 
-	if(lua_folder != NULL) {
-		/* Add the script folder to the path, so that we can load other scripts from there */
-		lua_getglobal(lua_state, "package");
-		lua_getfield(lua_state, -1, "path");
-		const char *cur_path = lua_tostring(lua_state, -1);
-		char new_path[1024];
-		memset(new_path, 0, sizeof(new_path));
-		g_snprintf(new_path, sizeof(new_path), "%s;%s/?.lua", cur_path, lua_folder);
-		lua_pop(lua_state, 1);
-		lua_pushstring(lua_state, new_path);
-		lua_setfield(lua_state, -2, "path");
-		lua_pop(lua_state, 1);
-	}
+	/* Add the script folder to the path, so that we can load other scripts from there */
+	janus_lua_add_folder_to_path(lua_state, lua_folder);
 
 	/* Register our functions */
-	lua_register(lua_state, "janusLog", janus_lua_method_januslog);
-	lua_register(lua_state, "pokeScheduler", janus_lua_method_pokescheduler);
-	lua_register(lua_state, "timeCallback", janus_lua_method_timecallback);
-	lua_register(lua_state, "pushEvent", janus_lua_method_pushevent);
-	lua_register(lua_state, "notifyEvent", janus_lua_method_notifyevent);
-	lua_register(lua_state, "eventsIsEnabled", janus_lua_method_eventsisenabled);
-	lua_register(lua_state, "closePc", janus_lua_method_closepc);
-	lua_register(lua_state, "endSession", janus_lua_method_endsession);
-	lua_register(lua_state, "configureMedium", janus_lua_method_configuremedium);
-	lua_register(lua_state, "addRecipient", janus_lua_method_addrecipient);
-	lua_register(lua_state, "removeRecipient", janus_lua_method_removerecipient);
-	lua_register(lua_state, "setBitrate", janus_lua_method_setbitrate);
-	lua_register(lua_state, "setPliFreq", janus_lua_method_setplifreq);
-	lua_register(lua_state, "setSubstream", janus_lua_method_setsubstream);
-	lua_register(lua_state, "setTemporalLayer", janus_lua_method_settemporallayer);
-	lua_register(lua_state, "sendPli", janus_lua_method_sendpli);
-	lua_register(lua_state, "relayRtp", janus_lua_method_relayrtp);
-	lua_register(lua_state, "relayRtcp", janus_lua_method_relayrtcp);
-	lua_register(lua_state, "relayData", janus_lua_method_relaydata);	/* Legacy function, deprecated */
-	lua_register(lua_state, "relayTextData", janus_lua_method_relaytextdata);
-	lua_register(lua_state, "relayBinaryData", janus_lua_method_relaybinarydata);
-	lua_register(lua_state, "startRecording", janus_lua_method_startrecording);
-	lua_register(lua_state, "stopRecording", janus_lua_method_stoprecording);
-	/* Register all extra functions, if any were added */
-	janus_lua_register_extra_functions(lua_state);
+	janus_lua_register_functions(lua_state);
 
 	/* Now load the script */
 	int err = luaL_dofile(lua_state, lua_file);
@@ -1537,6 +1609,48 @@ int janus_lua_init(janus_callbacks *callback, const char *config_path) {
 	lua_pushstring(lua_state, lua_config);
 	lua_call(lua_state, 1, 0);
 
+	/* If sharding of packet callbacks was requested, and the script actually
+	 * handles packets itself, create the pool of additional Lua states */
+	if(pool_size > 0 && !(has_incoming_rtp || has_incoming_rtcp ||
+			has_incoming_data_legacy || has_incoming_text_data || has_incoming_binary_data)) {
+		JANUS_LOG(LOG_WARN, "Sharded packet states configured, but the script doesn't handle packets itself, ignoring\n");
+		pool_size = 0;
+	}
+	if(pool_size > 0) {
+		JANUS_LOG(LOG_INFO, "Creating %d additional Lua state%s for packet callbacks\n",
+			pool_size, pool_size == 1 ? "" : "s");
+		packet_states = g_malloc0(pool_size * sizeof(janus_lua_packet_state));
+		int s = 0;
+		for(s = 0; s < pool_size; s++) {
+			lua_State *state = luaL_newstate();
+			luaL_openlibs(state);
+			janus_lua_add_folder_to_path(state, lua_folder);
+			janus_lua_register_functions(state);
+			if(luaL_dofile(state, lua_file)) {
+				/* Not a fatal error: get rid of the pool and fall back to the main state */
+				JANUS_LOG(LOG_ERR, "Error loading Lua script %s in packet state %d (%s), disabling sharding\n",
+					lua_file, s, lua_tostring(state, -1));
+				lua_close(state);
+				int c = 0;
+				for(c = 0; c < s; c++) {
+					lua_close(packet_states[c].state);
+					janus_mutex_destroy(&packet_states[c].mutex);
+				}
+				g_free(packet_states);
+				packet_states = NULL;
+				break;
+			}
+			/* Init this copy of the script too */
+			lua_getglobal(state, "init");
+			lua_pushstring(state, lua_config);
+			lua_call(state, 1, 0);
+			packet_states[s].state = state;
+			janus_mutex_init(&packet_states[s].mutex);
+		}
+		if(packet_states != NULL)
+			num_packet_states = pool_size;
+	}
+
 	g_free(lua_folder);
 	g_free(lua_file);
 	g_free(lua_config);
@@ -1592,6 +1706,24 @@ void janus_lua_destroy(void) {
 	lua_state = NULL;
 	janus_mutex_unlock(&lua_mutex);
 
+	/* Get rid of the packet states too, if sharding was enabled */
+	if(packet_states != NULL) {
+		int s = 0;
+		for(s = 0; s < num_packet_states; s++) {
+			janus_mutex_lock(&packet_states[s].mutex);
+			/* Deinit this copy of the script as well */
+			lua_getglobal(packet_states[s].state, "destroy");
+			lua_call(packet_states[s].state, 0, 0);
+			lua_close(packet_states[s].state);
+			packet_states[s].state = NULL;
+			janus_mutex_unlock(&packet_states[s].mutex);
+			janus_mutex_destroy(&packet_states[s].mutex);
+		}
+		g_free(packet_states);
+		packet_states = NULL;
+		num_packet_states = 0;
+	}
+
 	g_free(lua_script_version_string);
 	g_free(lua_script_description);
 	g_free(lua_script_name);
@@ -1790,6 +1922,11 @@ void janus_lua_create_session(janus_plugin_session *handle, int *error) {
 	g_atomic_int_set(&session->hangingup, 0);
 	g_atomic_int_set(&session->destroyed, 0);
 	janus_refcount_init(&session->ref, janus_lua_session_free);
+	if(num_packet_states > 0) {
+		/* Packet callbacks are sharded: assign this session a state, round robin */
+		guint index = (guint)g_atomic_int_add(&next_packet_state, 1) % num_packet_states;
+		session->packet_state = &packet_states[index];
+	}
 	handle->plugin_handle = session;
 	g_hash_table_insert(lua_sessions, handle, session);
 	g_hash_table_insert(lua_ids, GUINT_TO_POINTER(session->id), session);
@@ -1803,6 +1940,7 @@ void janus_lua_create_session(janus_plugin_session *handle, int *error) {
 	lua_call(t, 1, 0);
 	lua_pop(lua_state, 1);
 	janus_mutex_unlock(&lua_mutex);
+	janus_lua_packet_state_notify(session, "createSession");
 
 	return;
 }
@@ -1833,6 +1971,7 @@ void janus_lua_destroy_session(janus_plugin_session *handle, int *error) {
 	lua_call(t, 1, 0);
 	lua_pop(lua_state, 1);
 	janus_mutex_unlock(&lua_mutex);
+	janus_lua_packet_state_notify(session, "destroySession");
 
 	/* Get any rid references recipients of this sessions may have */
 	janus_mutex_lock(&session->recipients_mutex);
@@ -2057,6 +2196,7 @@ void janus_lua_setup_media(janus_plugin_session *handle) {
 	lua_call(t, 1, 0);
 	lua_pop(lua_state, 1);
 	janus_mutex_unlock(&lua_mutex);
+	janus_lua_packet_state_notify(session, "setupMedia");
 	janus_refcount_decrease(&session->ref);
 }
 
@@ -2075,17 +2215,21 @@ void janus_lua_incoming_rtp(janus_plugin_session *handle, janus_plugin_rtp *rtp_
 	uint16_t len = rtp_packet->length;
 	/* Check if the Lua script wants to handle/manipulate RTP packets itself */
 	if(has_incoming_rtp) {
-		/* Yep, pass the data to the Lua script and return */
-		janus_mutex_lock(&lua_mutex);
-		lua_State *t = lua_newthread(lua_state);
+		/* Yep, pass the data to the Lua script and return: if this session's
+		 * packet callbacks are sharded, use its dedicated state */
+		janus_lua_packet_state *shard = session->packet_state;
+		lua_State *state = shard ? shard->state : lua_state;
+		janus_mutex *mutex = shard ? &shard->mutex : &lua_mutex;
+		janus_mutex_lock(mutex);
+		lua_State *t = lua_newthread(state);
 		lua_getglobal(t, "incomingRtp");
 		lua_pushnumber(t, session->id);
 		lua_pushboolean(t, video);
 		lua_pushlstring(t, buf, len);
 		lua_pushnumber(t, len);
 		lua_call(t, 4, 0);
-		lua_pop(lua_state, 1);
-		janus_mutex_unlock(&lua_mutex);
+		lua_pop(state, 1);
+		janus_mutex_unlock(mutex);
 		return;
 	}
 	/* Is this session allowed to send media? */
@@ -2188,17 +2332,21 @@ void janus_lua_incoming_rtcp(janus_plugin_session *handle, janus_plugin_rtcp *pa
 	uint16_t len = packet->length;
 	/* Check if the Lua script wants to handle/manipulate RTCP packets itself */
 	if(has_incoming_rtcp) {
-		/* Yep, pass the data to the Lua script and return */
-		janus_mutex_lock(&lua_mutex);
-		lua_State *t = lua_newthread(lua_state);
+		/* Yep, pass the data to the Lua script and return: if this session's
+		 * packet callbacks are sharded, use its dedicated state */
+		janus_lua_packet_state *shard = session->packet_state;
+		lua_State *state = shard ? shard->state : lua_state;
+		janus_mutex *mutex = shard ? &shard->mutex : &lua_mutex;
+		janus_mutex_lock(mutex);
+		lua_State *t = lua_newthread(state);
 		lua_getglobal(t, "incomingRtcp");
 		lua_pushnumber(t, session->id);
 		lua_pushboolean(t, video);
 		lua_pushlstring(t, buf, len);
 		lua_pushnumber(t, len);
 		lua_call(t, 4, 0);
-		lua_pop(lua_state, 1);
-		janus_mutex_unlock(&lua_mutex);
+		lua_pop(state, 1);
+		janus_mutex_unlock(mutex);
 		return;
 	}
 	/* If a REMB arrived, make sure we cap it to our configuration, and send it as a video RTCP */
@@ -2241,8 +2389,12 @@ void janus_lua_incoming_data(janus_plugin_session *handle, janus_plugin_data *pa
 		/* Yep, pass the data to the Lua script and return */
 		if(!packet->binary && !has_incoming_text_data)
 			JANUS_LOG(LOG_WARN, "Missing 'incomingTextData', invoking deprecated function 'incomingData' instead\n");
-		janus_mutex_lock(&lua_mutex);
-		lua_State *t = lua_newthread(lua_state);
+		/* If this session's packet callbacks are sharded, use its dedicated state */
+		janus_lua_packet_state *shard = session->packet_state;
+		lua_State *state = shard ? shard->state : lua_state;
+		janus_mutex *mutex = shard ? &shard->mutex : &lua_mutex;
+		janus_mutex_lock(mutex);
+		lua_State *t = lua_newthread(state);
 		lua_getglobal(t, packet->binary ? "incomingBinaryData" : (has_incoming_text_data ? "incomingTextData" : "incomingData"));
 		lua_pushnumber(t, session->id);
 		/* We use a string for both text and binary data */
@@ -2251,8 +2403,8 @@ void janus_lua_incoming_data(janus_plugin_session *handle, janus_plugin_data *pa
 		lua_pushlstring(t, label, label ? strlen(label) : 0);
 		lua_pushlstring(t, protocol, protocol ? strlen(protocol) : 0);
 		lua_call(t, 5, 0);
-		lua_pop(lua_state, 1);
-		janus_mutex_unlock(&lua_mutex);
+		lua_pop(state, 1);
+		janus_mutex_unlock(mutex);
 		return;
 	}
 	/* Is this session allowed to send data? */
@@ -2393,6 +2545,7 @@ void janus_lua_hangup_media(janus_plugin_session *handle) {
 	lua_call(t, 1, 0);
 	lua_pop(lua_state, 1);
 	janus_mutex_unlock(&lua_mutex);
+	janus_lua_packet_state_notify(session, "hangupMedia");
 	janus_refcount_decrease(&session->ref);
 }
 
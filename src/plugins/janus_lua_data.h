@@ -47,6 +47,12 @@ extern janus_callbacks *lua_janus_core;
 extern lua_State *lua_state;
 extern janus_mutex lua_mutex;
 
+/* Additional Lua state dedicated to packet callbacks, when sharding is enabled */
+typedef struct janus_lua_packet_state {
+	lua_State *state;		/* Independent Lua state running its own copy of the script */
+	janus_mutex mutex;		/* Mutex to serialize access to this state */
+} janus_lua_packet_state;
+
 /* Lua session: we keep only the barebone stuff here, the rest will be in the Lua script */
 typedef struct janus_lua_session {
 	janus_plugin_session *handle;		/* Pointer to the core-plugin session */
@@ -83,6 +89,7 @@ typedef struct janus_lua_session {
 	volatile gint dataready;			/* Whether the data channel was established on this sessions's PeerConnection */
 	volatile gint hangingup;			/* Whether this session's PeerConnection is hanging up */
 	volatile gint destroyed;			/* Whether this session's been marked as destroyed */
+	janus_lua_packet_state *packet_state;	/* Lua state to use for this session's packet callbacks (NULL=main state) */
 	/* If you need any additional property (e.g., for hooks you added in janus_lua_extra.c) add them below this line */
 
 	/* Reference counter */
@@ -299,6 +299,31 @@ static uint16_t rtp_range_slider = DEFAULT_RTP_RANGE_MIN;
 static int dscp_audio_rtp = 0;
 static int dscp_video_rtp = 0;
 
+/* Relay loops: rather than spawning a dedicated thread per call, media for
+ * all calls is relayed by a small set of event loops, each serving many
+ * calls at the same time (same thing the SIP plugin does); a call is
+ * assigned to the least busy loop when its media starts, and its RTP/RTCP
+ * sockets are monitored there via a custom GSource. By default we spawn
+ * one loop per CPU core (capped), but the number can be changed via the
+ * 'relay_loops' property in the config */
+#define JANUS_NOSIP_MAX_RELAY_LOOPS	16
+typedef struct janus_nosip_relay_loop {
+	int id;						/* Loop index */
+	GMainContext *mainctx;		/* Loop context */
+	GMainLoop *mainloop;		/* The loop itself */
+	GThread *thread;			/* Thread running the loop */
+	volatile gint calls;		/* Number of calls currently assigned to this loop */
+} janus_nosip_relay_loop;
+static janus_nosip_relay_loop *relay_loops = NULL;
+static int num_relay_loops = 0;
+static void *janus_nosip_relay_loop_thread(void *data) {
+	janus_nosip_relay_loop *loop = (janus_nosip_relay_loop *)data;
+	JANUS_LOG(LOG_VERB, "[loop#%d] Joining NoSIP relay loop thread\n", loop->id);
+	g_main_loop_run(loop->mainloop);
+	JANUS_LOG(LOG_VERB, "[loop#%d] Leaving NoSIP relay loop thread\n", loop->id);
+	return NULL;
+}
+
 static GThread *handler_thread;
 static void *janus_nosip_handler(void *data);
 static void janus_nosip_hangup_media_internal(janus_plugin_session *handle);
@@ -330,6 +355,7 @@ typedef struct janus_nosip_media {
 	srtp_t audio_srtp_in, audio_srtp_out;
 	srtp_policy_t audio_remote_policy, audio_local_policy;
 	char *audio_srtp_local_profile, *audio_srtp_local_crypto;
+	char *audio_srtp_remote_profile, *audio_srtp_remote_crypto;
 	gboolean audio_send;
 	gboolean has_video;
 	int video_rtp_fd, video_rtcp_fd;
@@ -343,10 +369,13 @@ typedef struct janus_nosip_media {
 	srtp_t video_srtp_in, video_srtp_out;
 	srtp_policy_t video_remote_policy, video_local_policy;
 	char *video_srtp_local_profile, *video_srtp_local_crypto;
+	char *video_srtp_remote_profile, *video_srtp_remote_crypto;
 	gboolean video_send;
 	gboolean video_pli_supported;
 	janus_rtp_switching_context acontext, vcontext;
-	int pipefd[2];
+	janus_nosip_relay_loop *relay_loop;
+	GSource *source;
+	int pollerrs;
 	gboolean updated;
 	int video_orientation_extension_id;
 	int audio_level_extension_id;
@@ -362,7 +391,6 @@ typedef struct janus_nosip_session {
 	janus_recorder *vrc;		/* The Janus recorder instance for this user's video, if enabled */
 	janus_recorder *vrc_peer;	/* The Janus recorder instance for the peer's video, if enabled */
 	janus_mutex rec_mutex;		/* Mutex to protect the recorders from race conditions */
-	GThread *relayer_thread;
 	volatile gint hangingup;
 	volatile gint destroyed;
 	janus_refcount ref;
@@ -576,8 +604,18 @@ static int janus_nosip_srtp_set_remote(janus_nosip_session *session, gboolean vi
 			break;
 	}
 	policy->ssrc.type = ssrc_any_inbound;
+	guchar *prev_key = policy->key;
 	policy->key = decoded;
 	policy->next = NULL;
+	/* If the peer rekeyed, get rid of the previous context first */
+	if(video && session->media.video_srtp_in != NULL) {
+		srtp_dealloc(session->media.video_srtp_in);
+		session->media.video_srtp_in = NULL;
+	} else if(!video && session->media.audio_srtp_in != NULL) {
+		srtp_dealloc(session->media.audio_srtp_in);
+		session->media.audio_srtp_in = NULL;
+	}
+	g_free(prev_key);
 	/* Create SRTP context */
 	srtp_err_status_t res = srtp_create(video ? &session->media.video_srtp_in : &session->media.audio_srtp_in, policy);
 	if(res != srtp_err_status_ok) {
@@ -590,6 +628,19 @@ static int janus_nosip_srtp_set_remote(janus_nosip_session *session, gboolean vi
 	if((video && session->media.video_srtp_in) || (!video && session->media.audio_srtp_in)) {
 		JANUS_LOG(LOG_VERB, "%s inbound SRTP session created\n", video ? "Video" : "Audio");
 	}
+	/* Take note of the profile and crypto we set, to detect unchanged
+	 * parameters on renegotiations and keep the context alive, then */
+	if(video) {
+		g_free(session->media.video_srtp_remote_profile);
+		session->media.video_srtp_remote_profile = g_strdup(profile);
+		g_free(session->media.video_srtp_remote_crypto);
+		session->media.video_srtp_remote_crypto = g_strdup(crypto);
+	} else {
+		g_free(session->media.audio_srtp_remote_profile);
+		session->media.audio_srtp_remote_profile = g_strdup(profile);
+		g_free(session->media.audio_srtp_remote_crypto);
+		session->media.audio_srtp_remote_crypto = g_strdup(crypto);
+	}
 	return 0;
 }
 static void janus_nosip_srtp_cleanup(janus_nosip_session *session) {
@@ -619,6 +670,10 @@ static void janus_nosip_srtp_cleanup(janus_nosip_session *session) {
 		g_free(session->media.audio_srtp_local_crypto);
 		session->media.audio_srtp_local_crypto = NULL;
 	}
+	g_free(session->media.audio_srtp_remote_profile);
+	session->media.audio_srtp_remote_profile = NULL;
+	g_free(session->media.audio_srtp_remote_crypto);
+	session->media.audio_srtp_remote_crypto = NULL;
 	/* Video */
 	session->media.video_srtp_tag = 0;
 	if(session->media.video_srtp_out)
@@ -639,6 +694,10 @@ static void janus_nosip_srtp_cleanup(janus_nosip_session *session) {
 		g_free(session->media.video_srtp_local_crypto);
 		session->media.video_srtp_local_crypto = NULL;
 	}
+	g_free(session->media.video_srtp_remote_profile);
+	session->media.video_srtp_remote_profile = NULL;
+	g_free(session->media.video_srtp_remote_crypto);
+	session->media.video_srtp_remote_crypto = NULL;
 }
 
 void janus_nosip_media_reset(janus_nosip_session *session) {
@@ -649,6 +708,7 @@ void janus_nosip_media_reset(janus_nosip_session *session) {
 	g_free(session->media.remote_video_ip);
 	session->media.remote_video_ip = NULL;
 	session->media.updated = FALSE;
+	session->media.pollerrs = 0;
 	session->media.ready = FALSE;
 	session->media.require_srtp = FALSE;
 	session->media.has_audio = FALSE;
@@ -673,7 +733,8 @@ void janus_nosip_sdp_process(janus_nosip_session *session, janus_sdp *sdp, gbool
 char *janus_nosip_sdp_manipulate(janus_nosip_session *session, janus_sdp *sdp, gboolean answer);
 /* Media */
 static int janus_nosip_allocate_local_ports(janus_nosip_session *session, gboolean update);
-static void *janus_nosip_relay_thread(void *data);
+static int janus_nosip_media_attach(janus_nosip_session *session);
+static void janus_nosip_media_update(janus_nosip_session *session);
 static void janus_nosip_media_cleanup(janus_nosip_session *session);
 
 
@@ -768,6 +829,18 @@ int janus_nosip_init(janus_callbacks *callback, const char *config_path) {
 			}
 		}
 
+		item = janus_config_get(config, config_general, janus_config_type_item, "relay_loops");
+		if(item && item->value) {
+			num_relay_loops = atoi(item->value);
+			if(num_relay_loops < 1) {
+				JANUS_LOG(LOG_WARN, "Invalid number of relay loops (%s), falling back to one per CPU core\n", item->value);
+				num_relay_loops = 0;
+			} else if(num_relay_loops > JANUS_NOSIP_MAX_RELAY_LOOPS) {
+				JANUS_LOG(LOG_WARN, "Capping number of relay loops to %d\n", JANUS_NOSIP_MAX_RELAY_LOOPS);
+				num_relay_loops = JANUS_NOSIP_MAX_RELAY_LOOPS;
+			}
+		}
+
 		item = janus_config_get(config, config_general, janus_config_type_item, "rtp_port_range");
 		if(item && item->value) {
 			/* Split in min and max port */
@@ -871,6 +944,34 @@ int janus_nosip_init(janus_callbacks *callback, const char *config_path) {
 		ipv6_disabled = TRUE;
 	}
 
+	/* Spawn the loops that will relay media for all calls: since each of
+	 * them serves many calls at the same time, we don't need a dedicated
+	 * thread per call, which wouldn't scale with many concurrent sessions */
+	if(num_relay_loops == 0) {
+		num_relay_loops = g_get_num_processors();
+		if(num_relay_loops > JANUS_NOSIP_MAX_RELAY_LOOPS)
+			num_relay_loops = JANUS_NOSIP_MAX_RELAY_LOOPS;
+	}
+	relay_loops = g_malloc0(num_relay_loops * sizeof(janus_nosip_relay_loop));
+	int l = 0;
+	for(l=0; l<num_relay_loops; l++) {
+		janus_nosip_relay_loop *loop = &relay_loops[l];
+		loop->id = l;
+		loop->mainctx = g_main_context_new();
+		loop->mainloop = g_main_loop_new(loop->mainctx, FALSE);
+		GError *lerror = NULL;
+		char tname[16];
+		g_snprintf(tname, sizeof(tname), "nosiprelay %d", l);
+		loop->thread = g_thread_try_new(tname, janus_nosip_relay_loop_thread, loop, &lerror);
+		if(lerror != NULL) {
+			JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch a relay loop thread...\n",
+				lerror->code, lerror->message ? lerror->message : "??");
+			g_error_free(lerror);
+			return -1;
+		}
+	}
+	JANUS_LOG(LOG_INFO, "Spawned %d event loops to relay media for NoSIP calls\n", num_relay_loops);
+
 	g_atomic_int_set(&initialized, 1);
 
 	GError *error = NULL;
@@ -897,6 +998,30 @@ void janus_nosip_destroy(void) {
 		g_thread_join(handler_thread);
 		handler_thread = NULL;
 	}
+	/* Get rid of the relay loops: unreffing the contexts also gets rid of
+	 * the media sources of calls that were still attached to the loops */
+	int l = 0;
+	for(l=0; l<num_relay_loops; l++) {
+		janus_nosip_relay_loop *loop = &relay_loops[l];
+		if(loop->mainloop != NULL && g_main_loop_is_running(loop->mainloop)) {
+			g_main_loop_quit(loop->mainloop);
+			g_main_context_wakeup(loop->mainctx);
+		}
+		if(loop->thread != NULL) {
+			g_thread_join(loop->thread);
+			loop->thread = NULL;
+		}
+		if(loop->mainloop != NULL) {
+			g_main_loop_unref(loop->mainloop);
+			loop->mainloop = NULL;
+		}
+		if(loop->mainctx != NULL) {
+			g_main_context_unref(loop->mainctx);
+			loop->mainctx = NULL;
+		}
+	}
+	g_free(relay_loops);
+	relay_loops = NULL;
 	/* FIXME We should destroy the sessions cleanly */
 	janus_mutex_lock(&sessions_mutex);
 	g_hash_table_destroy(sessions);
@@ -967,8 +1092,12 @@ void janus_nosip_create_session(janus_plugin_session *handle, int *error) {
 	session->media.srtp_profile = 0;
 	session->media.audio_srtp_local_profile = NULL;
 	session->media.audio_srtp_local_crypto = NULL;
+	session->media.audio_srtp_remote_profile = NULL;
+	session->media.audio_srtp_remote_crypto = NULL;
 	session->media.video_srtp_local_profile = NULL;
 	session->media.video_srtp_local_crypto = NULL;
+	session->media.video_srtp_remote_profile = NULL;
+	session->media.video_srtp_remote_crypto = NULL;
 	session->media.has_audio = FALSE;
 	session->media.audio_rtp_fd = -1;
 	session->media.audio_rtcp_fd = -1;
@@ -1001,8 +1130,9 @@ void janus_nosip_create_session(janus_plugin_session *handle, int *error) {
 	/* Initialize the RTP context */
 	janus_rtp_switching_context_reset(&session->media.acontext);
 	janus_rtp_switching_context_reset(&session->media.vcontext);
-	session->media.pipefd[0] = -1;
-	session->media.pipefd[1] = -1;
+	session->media.relay_loop = NULL;
+	session->media.source = NULL;
+	session->media.pollerrs = 0;
 	session->media.updated = FALSE;
 	session->media.audio_remote_policy.ssrc.type = ssrc_any_inbound;
 	session->media.audio_local_policy.ssrc.type = ssrc_any_inbound;
@@ -1310,20 +1440,14 @@ static void janus_nosip_hangup_media_internal(janus_plugin_session *handle) {
 	if(!g_atomic_int_compare_and_exchange(&session->hangingup, 0, 1))
 		return;
 	session->media.simulcast_ssrc = 0;
-	/* Notify the thread that it's time to go */
-	if(session->media.pipefd[1] > 0) {
-		int code = 1;
-		ssize_t res = 0;
-		do {
-			res = write(session->media.pipefd[1], &code, sizeof(int));
-		} while(res == -1 && errno == EINTR);
-	}
-	/* Do cleanup if media thread has not been created */
-	if(!session->media.ready && !session->relayer_thread) {
-		janus_mutex_lock(&session->mutex);
-		janus_nosip_media_cleanup(session);
-		janus_mutex_unlock(&session->mutex);
+	/* Detach the call from its relay loop, if needed, and do the cleanup */
+	janus_mutex_lock(&session->mutex);
+	if(session->media.source != NULL) {
+		g_source_destroy(session->media.source);
+		session->media.source = NULL;
 	}
+	janus_nosip_media_cleanup(session);
+	janus_mutex_unlock(&session->mutex);
 	/* Get rid of the recorders, if available */
 	janus_mutex_lock(&session->rec_mutex);
 	janus_nosip_recorder_close(session, TRUE, TRUE, TRUE, TRUE);
@@ -1629,18 +1753,9 @@ static void *janus_nosip_handler(void *data) {
 			if(!sdp_update && !offer) {
 				/* Start the media */
 				session->media.ready = TRUE;	/* FIXME Maybe we need a better way to signal this */
-				GError *error = NULL;
-				char tname[16];
-				g_snprintf(tname, sizeof(tname), "nosiprtp %p", session);
-				janus_refcount_increase(&session->ref);
-				session->relayer_thread = g_thread_try_new(tname, janus_nosip_relay_thread, session, &error);
-				if(error != NULL) {
-					session->relayer_thread = NULL;
+				if(janus_nosip_media_attach(session) < 0) {
 					session->media.ready = FALSE;
-					janus_refcount_decrease(&session->ref);
-					JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the RTP/RTCP thread...\n",
-						error->code, error->message ? error->message : "??");
-					g_error_free(error);
+					JANUS_LOG(LOG_ERR, "Error attaching the call to a relay loop...\n");
 				}
 			}
 		} else if(!strcasecmp(request_text, "hangup")) {
@@ -1944,11 +2059,6 @@ void janus_nosip_sdp_process(janus_nosip_session *session, janus_sdp *sdp, gbool
 			if(a->name) {
 				if(!strcasecmp(a->name, "crypto")) {
 					if(m->type == JANUS_SDP_AUDIO || m->type == JANUS_SDP_VIDEO) {
-						if((m->type == JANUS_SDP_AUDIO && session->media.audio_srtp_in != NULL) || (m->type == JANUS_SDP_VIDEO && session->media.video_srtp_in != NULL)) {
-							/* Remote SRTP is already set */
-							tempA = tempA->next;
-							continue;
-						}
 						gint32 tag = 0;
 						char profile[101], crypto[101];
 						int res = a->value ? (sscanf(a->value, "%"SCNi32" %100s inline:%100s",
@@ -1957,6 +2067,19 @@ void janus_nosip_sdp_process(janus_nosip_session *session, janus_sdp *sdp, gbool
 							JANUS_LOG(LOG_WARN, "Failed to parse crypto line, ignoring... %s\n", a->value);
 						} else {
 							gboolean video = (m->type == JANUS_SDP_VIDEO);
+							const char *prev_profile = video ? session->media.video_srtp_remote_profile : session->media.audio_srtp_remote_profile;
+							const char *prev_crypto = video ? session->media.video_srtp_remote_crypto : session->media.audio_srtp_remote_crypto;
+							if((video ? session->media.video_srtp_in : session->media.audio_srtp_in) != NULL &&
+									prev_profile != NULL && !strcasecmp(profile, prev_profile) &&
+									prev_crypto != NULL && !strcmp(crypto, prev_crypto)) {
+								/* The crypto parameters didn't change (e.g., a hold/resume
+								 * renegotiation): keep the existing SRTP context alive,
+								 * so we don't drop packets while it's being recreated */
+								JANUS_LOG(LOG_VERB, "[NoSIP-%p] Unchanged remote %s crypto, keeping SRTP context\n",
+									session, video ? "video" : "audio");
+								tempA = tempA->next;
+								continue;
+							}
 							if(answer && ((!video && tag != session->media.audio_srtp_tag) || (video && tag != session->media.video_srtp_tag))) {
 								/* Not the tag for the crypto line we offered */
 								tempA = tempA->next;
@@ -2005,15 +2128,11 @@ void janus_nosip_sdp_process(janus_nosip_session *session, janus_sdp *sdp, gbool
 		temp = temp->next;
 	}
 	if(update && changed && *changed) {
-		/* Something changed: mark this on the session, so that the thread can update the sockets */
+		/* Something changed: mark this on the session, so that the relay
+		 * loop can update the sockets, and wake it up to do it right away */
 		session->media.updated = TRUE;
-		if(session->media.pipefd[1] > 0) {
-			int code = 1;
-			ssize_t res = 0;
-			do {
-				res = write(session->media.pipefd[1], &code, sizeof(int));
-			} while(res == -1 && errno == EINTR);
-		}
+		if(session->media.relay_loop != NULL)
+			g_main_context_wakeup(session->media.relay_loop->mainctx);
 	}
 }
 
@@ -2222,14 +2341,6 @@ static int janus_nosip_allocate_local_ports(janus_nosip_session *session, gboole
 		session->media.local_video_rtp_port = 0;
 		session->media.local_video_rtcp_port = 0;
 		session->media.video_ssrc = 0;
-		if(session->media.pipefd[0] > 0) {
-			close(session->media.pipefd[0]);
-			session->media.pipefd[0] = -1;
-		}
-		if(session->media.pipefd[1] > 0) {
-			close(session->media.pipefd[1]);
-			session->media.pipefd[1] = -1;
-		}
 	}
 	/* Start */
 	if(session->media.has_audio &&
@@ -2280,19 +2391,12 @@ static int janus_nosip_allocate_local_ports(janus_nosip_session *session, gboole
 		session->media.local_video_rtp_port = ports[0];
 		session->media.local_video_rtcp_port = ports[1];
 	}
-	/* We need this to quickly interrupt the poll when it's time to update a session or wrap up */
-	if(!update) {
-		pipe(session->media.pipefd);
-	} else {
-		/* Something changed: mark this on the session, so that the thread can update the sockets */
+	if(update) {
+		/* Something changed: mark this on the session, so that the relay
+		 * loop can update the sockets, and wake it up to do it right away */
 		session->media.updated = TRUE;
-		if(session->media.pipefd[1] > 0) {
-			int code = 1;
-			ssize_t res = 0;
-			do {
-				res = write(session->media.pipefd[1], &code, sizeof(int));
-			} while(res == -1 && errno == EINTR);
-		}
+		if(session->media.relay_loop != NULL)
+			g_main_context_wakeup(session->media.relay_loop->mainctx);
 	}
 	return 0;
 }
@@ -2396,14 +2500,6 @@ static void janus_nosip_media_cleanup(janus_nosip_session *session) {
 	session->media.video_ssrc = 0;
 	session->media.video_ssrc_peer = 0;
 	session->media.simulcast_ssrc = 0;
-	if(session->media.pipefd[0] > 0) {
-		close(session->media.pipefd[0]);
-		session->media.pipefd[0] = -1;
-	}
-	if(session->media.pipefd[1] > 0) {
-		close(session->media.pipefd[1]);
-		session->media.pipefd[1] = -1;
-	}
 	/* Clean up SRTP stuff, if needed */
 	janus_nosip_srtp_cleanup(session);
 
@@ -2411,300 +2507,332 @@ static void janus_nosip_media_cleanup(janus_nosip_session *session) {
 	janus_nosip_media_reset(session);
 }
 
-/* Thread to relay RTP/RTCP frames coming from the peer */
-static void *janus_nosip_relay_thread(void *data) {
-	janus_nosip_session *session = (janus_nosip_session *)data;
-	if(!session) {
-		g_thread_unref(g_thread_self());
-		return NULL;
+/* Helper to (re)connect the RTP/RTCP sockets to the peer, when the remote
+ * address has been learnt or has changed (e.g., because of an SDP update) */
+static void janus_nosip_media_update(janus_nosip_session *session) {
+	if(!session->media.updated)
+		return;
+	session->media.updated = FALSE;
+	/* Resolve the addresses, if needed */
+	gboolean have_audio_server_ip = FALSE;
+	gboolean have_video_server_ip = FALSE;
+	struct sockaddr_storage audio_server_addr = { 0 }, video_server_addr = { 0 };
+	if(session->media.remote_audio_ip && strcmp(session->media.remote_audio_ip, "0.0.0.0")) {
+		if(janus_network_resolve_address(session->media.remote_audio_ip, &audio_server_addr) < 0) {
+			JANUS_LOG(LOG_ERR, "[NoSIP-%p] Couldn't resolve audio address '%s'\n",
+				session, session->media.remote_audio_ip);
+		} else {
+			/* Address resolved */
+			have_audio_server_ip = TRUE;
+		}
 	}
-	JANUS_LOG(LOG_INFO, "[NoSIP-%p] Starting relay thread\n", session);
-
-	/* File descriptors */
-	socklen_t addrlen;
-	struct sockaddr_in remote = { 0 };
-	int resfd = 0, bytes = 0, pollerrs = 0;
-	struct pollfd fds[5];
-	int pipe_fd = session->media.pipefd[0];
-	char buffer[1500];
-	memset(buffer, 0, 1500);
-	if(pipe_fd == -1) {
-		/* If the pipe file descriptor doesn't exist, it means we're done already,
-		 * and/or we may never be notified about sessions being closed, so give up */
-		JANUS_LOG(LOG_WARN, "[NoSIP-%p] Leaving thread, no pipe file descriptor...\n", session);
-		janus_refcount_decrease(&session->ref);
-		g_thread_unref(g_thread_self());
-		return NULL;
+	if(session->media.remote_video_ip && strcmp(session->media.remote_video_ip, "0.0.0.0")) {
+		if(janus_network_resolve_address(session->media.remote_video_ip, &video_server_addr) < 0) {
+			JANUS_LOG(LOG_ERR, "[NoSIP-%p] Couldn't resolve video address '%s'\n",
+				session, session->media.remote_video_ip);
+		} else {
+			/* Address resolved */
+			have_video_server_ip = TRUE;
+		}
 	}
-	/* Loop */
-	int num = 0;
-	gboolean goon = TRUE;
-
-	session->media.updated = TRUE; /* Connect UDP sockets upon loop entry */
-	gboolean have_audio_server_ip = TRUE;
-	gboolean have_video_server_ip = TRUE;
-
-	while(goon && session != NULL &&
-			!g_atomic_int_get(&session->destroyed) && !g_atomic_int_get(&session->hangingup)) {
-
-		if(session->media.updated) {
-			/* Apparently there was a session update, or the loop has just been entered */
-			session->media.updated = FALSE;
-
-			/* Resolve the addresses, if needed */
-			have_audio_server_ip = FALSE;
-			have_video_server_ip = FALSE;
-			struct sockaddr_storage audio_server_addr = { 0 }, video_server_addr = { 0 };
-			if(session->media.remote_audio_ip && strcmp(session->media.remote_audio_ip, "0.0.0.0")) {
-				if(janus_network_resolve_address(session->media.remote_audio_ip, &audio_server_addr) < 0) {
-					JANUS_LOG(LOG_ERR, "[NoSIP-%p] Couldn't resolve audio address '%s'\n",
-						session, session->media.remote_audio_ip);
-				} else {
-					/* Address resolved */
-					have_audio_server_ip = TRUE;
-				}
-			}
-			if(session->media.remote_video_ip && strcmp(session->media.remote_video_ip, "0.0.0.0")) {
-				if(janus_network_resolve_address(session->media.remote_video_ip, &video_server_addr) < 0) {
-					JANUS_LOG(LOG_ERR, "[NoSIP-%p] Couldn't resolve video address '%s'\n",
-						session, session->media.remote_video_ip);
-				} else {
-					/* Address resolved */
-					have_video_server_ip = TRUE;
-				}
-			}
+	if(have_audio_server_ip || have_video_server_ip) {
+		janus_nosip_connect_sockets(session, have_audio_server_ip ? &audio_server_addr : NULL,
+			have_video_server_ip ? &video_server_addr : NULL);
+	} else if(session->media.remote_audio_ip == NULL && session->media.remote_video_ip == NULL) {
+		JANUS_LOG(LOG_ERR, "[NoSIP-%p] Couldn't update session details: both audio and video remote IP addresses are NULL\n", session);
+	} else {
+		if(session->media.remote_audio_ip)
+			JANUS_LOG(LOG_ERR, "[NoSIP-%p] Couldn't update session details: audio remote IP address (%s) is invalid\n",
+				session, session->media.remote_audio_ip);
+		if(session->media.remote_video_ip)
+			JANUS_LOG(LOG_ERR, "[NoSIP-%p] Couldn't update session details: video remote IP address (%s) is invalid\n",
+				session, session->media.remote_video_ip);
+	}
+}
 
-			if(have_audio_server_ip || have_video_server_ip) {
-				janus_nosip_connect_sockets(session, have_audio_server_ip ? &audio_server_addr : NULL,
-					have_video_server_ip ? &video_server_addr : NULL);
-			} else if (session->media.remote_audio_ip == NULL && session->media.remote_video_ip == NULL) {
-				JANUS_LOG(LOG_ERR, "[NoSIP-%p] Couldn't update session details: both audio and video remote IP addresses are NULL\n", session);
+/* Custom GSource we use to have the relay loops monitor the RTP/RTCP
+ * sockets of a call: each call has one of these attached to the loop it
+ * was assigned to, which is how we relay media for many calls with a few
+ * threads, rather than with a dedicated thread per call as we used to */
+typedef struct janus_nosip_media_fd {
+	gpointer tag;	/* Tag returned by g_source_add_unix_fd */
+	int fd;			/* File descriptor we're monitoring */
+} janus_nosip_media_fd;
+typedef struct janus_nosip_media_source {
+	GSource parent;
+	janus_nosip_session *session;
+	janus_nosip_relay_loop *loop;
+	janus_nosip_media_fd audio_rtp, audio_rtcp, video_rtp, video_rtcp;
+} janus_nosip_media_source;
+/* Helper to sync one of the monitored sockets with the session: sockets may
+ * be created, closed or replaced by SDP updates, so we check at every update */
+static void janus_nosip_media_source_sync_fd(janus_nosip_media_source *ms, janus_nosip_media_fd *mfd, int fd) {
+	if(mfd->tag != NULL && mfd->fd != fd) {
+		g_source_remove_unix_fd((GSource *)ms, mfd->tag);
+		mfd->tag = NULL;
+		mfd->fd = -1;
+	}
+	if(mfd->tag == NULL && fd != -1) {
+		mfd->tag = g_source_add_unix_fd((GSource *)ms, fd, G_IO_IN | G_IO_ERR);
+		mfd->fd = fd;
+	}
+}
+static void janus_nosip_media_source_sync(janus_nosip_media_source *ms) {
+	janus_nosip_session *session = ms->session;
+	janus_nosip_media_source_sync_fd(ms, &ms->audio_rtp, session->media.audio_rtp_fd);
+	janus_nosip_media_source_sync_fd(ms, &ms->audio_rtcp, session->media.audio_rtcp_fd);
+	janus_nosip_media_source_sync_fd(ms, &ms->video_rtp, session->media.video_rtp_fd);
+	janus_nosip_media_source_sync_fd(ms, &ms->video_rtcp, session->media.video_rtcp_fd);
+}
+/* Helper to check one of the monitored sockets after a poll: returns 0 when
+ * done (or nothing to do), a negative integer when the PeerConnection should
+ * be closed because of too many errors on the sockets */
+static int janus_nosip_media_source_pollfd(janus_nosip_media_source *ms, janus_nosip_media_fd *mfd, gboolean video, gboolean rtcp) {
+	if(mfd->tag == NULL || mfd->fd == -1)
+		return 0;
+	janus_nosip_session *session = ms->session;
+	GIOCondition revents = g_source_query_unix_fd((GSource *)ms, mfd->tag);
+	if(revents & (G_IO_ERR | G_IO_HUP)) {
+		/* If we just updated the session, let's wait until things have calmed down */
+		if(session->media.updated)
+			return 0;
+		/* Check the socket error */
+		int error = 0;
+		socklen_t errlen = sizeof(error);
+		getsockopt(mfd->fd, SOL_SOCKET, SO_ERROR, (void *)&error, &errlen);
+		if(error == 0) {
+			/* Maybe not a breaking error after all? */
+			return 0;
+		} else if(error == 111 && rtcp) {
+			/* ICMP error? If it's related to RTCP, let's just close the RTCP socket and move on */
+			JANUS_LOG(LOG_WARN, "[NoSIP-%p] Got a '%s' on the %s RTCP socket, closing it\n",
+				session, g_strerror(error), video ? "video" : "audio");
+			janus_mutex_lock(&session->mutex);
+			g_source_remove_unix_fd((GSource *)ms, mfd->tag);
+			mfd->tag = NULL;
+			mfd->fd = -1;
+			if(video) {
+				close(session->media.video_rtcp_fd);
+				session->media.video_rtcp_fd = -1;
 			} else {
-				if(session->media.remote_audio_ip)
-					JANUS_LOG(LOG_ERR, "[NoSIP-%p] Couldn't update session details: audio remote IP address (%s) is invalid\n",
-						session, session->media.remote_audio_ip);
-				if(session->media.remote_video_ip)
-					JANUS_LOG(LOG_ERR, "[NoSIP-%p] Couldn't update session details: video remote IP address (%s) is invalid\n",
-						session, session->media.remote_video_ip);
+				close(session->media.audio_rtcp_fd);
+				session->media.audio_rtcp_fd = -1;
 			}
+			janus_mutex_unlock(&session->mutex);
+			return 0;
 		}
-
-		/* Prepare poll */
-		num = 0;
-		if(session->media.audio_rtp_fd != -1) {
-			fds[num].fd = session->media.audio_rtp_fd;
-			fds[num].events = POLLIN;
-			fds[num].revents = 0;
-			num++;
-		}
-		if(session->media.audio_rtcp_fd != -1) {
-			fds[num].fd = session->media.audio_rtcp_fd;
-			fds[num].events = POLLIN;
-			fds[num].revents = 0;
-			num++;
-		}
-		if(session->media.video_rtp_fd != -1) {
-			fds[num].fd = session->media.video_rtp_fd;
-			fds[num].events = POLLIN;
-			fds[num].revents = 0;
-			num++;
-		}
-		if(session->media.video_rtcp_fd != -1) {
-			fds[num].fd = session->media.video_rtcp_fd;
-			fds[num].events = POLLIN;
-			fds[num].revents = 0;
-			num++;
-		}
-		/* Finally, let's add the pipe */
-		pipe_fd = session->media.pipefd[0];
-		if(pipe_fd == -1) {
-			/* Pipe was closed? Means the call is over */
-			break;
+		/* FIXME Should we be more tolerant of ICMP errors on RTP sockets as well? */
+		session->media.pollerrs++;
+		if(session->media.pollerrs < 100)
+			return 0;
+		JANUS_LOG(LOG_ERR, "[NoSIP-%p] Too many errors polling %d (%s %s socket)...\n", session,
+			mfd->fd, video ? "video" : "audio", rtcp ? "RTCP" : "RTP");
+		JANUS_LOG(LOG_ERR, "[NoSIP-%p]   -- %d (%s)\n", session, error, g_strerror(error));
+		return -1;	/* Can we assume it's pretty much over, after a POLLERR? */
+	}
+	if(!(revents & G_IO_IN))
+		return 0;
+	/* Got an RTP/RTCP packet */
+	char buffer[1500];
+	struct sockaddr_storage remote;
+	socklen_t addrlen = sizeof(remote);
+	int bytes = recvfrom(mfd->fd, buffer, sizeof(buffer), 0, (struct sockaddr *)&remote, &addrlen);
+	if(bytes < 0) {
+		/* Failed to read? */
+		return 0;
+	}
+	if(!rtcp) {
+		/* Audio or Video RTP */
+		if(!janus_is_rtp(buffer, bytes)) {
+			/* Not an RTP packet? */
+			return 0;
 		}
-		fds[num].fd = pipe_fd;
-		fds[num].events = POLLIN;
-		fds[num].revents = 0;
-		num++;
-		/* Wait for some data */
-		resfd = poll(fds, num, 1000);
-		if(resfd < 0) {
-			if(errno == EINTR) {
-				JANUS_LOG(LOG_HUGE, "[NoSIP-%p] Got an EINTR (%s), ignoring...\n", session, g_strerror(errno));
-				continue;
+		session->media.pollerrs = 0;
+		rtp_header *header = (rtp_header *)buffer;
+		if((video && session->media.video_ssrc_peer != ntohl(header->ssrc)) ||
+				(!video && session->media.audio_ssrc_peer != ntohl(header->ssrc))) {
+			if(video && session->media.video_ssrc_peer == 0) {
+				session->media.video_ssrc_peer = ntohl(header->ssrc);
+			} else if(!video && session->media.audio_ssrc_peer == 0) {
+				session->media.audio_ssrc_peer = ntohl(header->ssrc);
+			}
+			JANUS_LOG(LOG_VERB, "[NoSIP-%p] Got SIP peer %s SSRC: %"SCNu32"\n",
+				session, video ? "video" : "audio",
+				video ? session->media.video_ssrc_peer : session->media.audio_ssrc_peer);
+		}
+		/* Is this SRTP? */
+		if(session->media.has_srtp_remote) {
+			int buflen = bytes;
+			srtp_err_status_t res = srtp_unprotect(
+				(video ? session->media.video_srtp_in : session->media.audio_srtp_in),
+				buffer, &buflen);
+			if(res != srtp_err_status_ok && res != srtp_err_status_replay_fail && res != srtp_err_status_replay_old) {
+				guint32 timestamp = ntohl(header->timestamp);
+				guint16 seq = ntohs(header->seq_number);
+				JANUS_LOG(LOG_ERR, "[NoSIP-%p] %s SRTP unprotect error: %s (len=%d-->%d, ts=%"SCNu32", seq=%"SCNu16")\n",
+					session, video ? "Video" : "Audio", janus_srtp_error_str(res), bytes, buflen, timestamp, seq);
+				return 0;
+			}
+			bytes = buflen;
+		}
+		/* Check if the SSRC changed (e.g., after a re-INVITE or UPDATE) */
+		janus_rtp_header_update(header, video ? &session->media.vcontext : &session->media.acontext, video, 0);
+		/* Save the frame if we're recording */
+		header->ssrc = htonl(video ? session->media.video_ssrc_peer : session->media.audio_ssrc_peer);
+		janus_recorder_save_frame(video ? session->vrc_peer : session->arc_peer, buffer, bytes);
+		/* Relay to browser */
+		janus_plugin_rtp rtp = { .mindex = -1, .video = video, .buffer = buffer, .length = bytes };
+		/* Add audio-level extension, if present */
+		janus_plugin_rtp_extensions_reset(&rtp.extensions);
+		if(!video && session->media.audio_level_extension_id != -1) {
+			gboolean vad = FALSE;
+			int level = -1;
+			if(janus_rtp_header_extension_parse_audio_level(buffer, bytes,
+					session->media.audio_level_extension_id, &vad, &level) == 0) {
+				rtp.extensions.audio_level = level;
+				rtp.extensions.audio_level_vad = vad;
+			}
+		} else if(video && session->media.video_orientation_extension_id > 0) {
+			gboolean c = FALSE, f = FALSE, r1 = FALSE, r0 = FALSE;
+			if(janus_rtp_header_extension_parse_video_orientation(buffer, bytes,
+					session->media.video_orientation_extension_id, &c, &f, &r1, &r0) == 0) {
+				rtp.extensions.video_rotation = 0;
+				if(r1 && r0)
+					rtp.extensions.video_rotation = 270;
+				else if(r1)
+					rtp.extensions.video_rotation = 180;
+				else if(r0)
+					rtp.extensions.video_rotation = 90;
+				rtp.extensions.video_back_camera = c;
+				rtp.extensions.video_flipped = f;
 			}
-			JANUS_LOG(LOG_ERR, "[NoSIP-%p] Error polling...\n", session);
-			JANUS_LOG(LOG_ERR, "[NoSIP-%p]   -- %d (%s)\n", session, errno, g_strerror(errno));
-			break;
-		} else if(resfd == 0) {
-			/* No data, keep going */
-			continue;
 		}
-		if(session == NULL || g_atomic_int_get(&session->destroyed))
-			break;
-		int i = 0;
-		for(i=0; i<num; i++) {
-			if(fds[i].revents & (POLLERR | POLLHUP)) {
-				/* If we just updated the session, let's wait until things have calmed down */
-				if(session->media.updated)
-					break;
-				/* Check the socket error */
-				int error = 0;
-				socklen_t errlen = sizeof(error);
-				getsockopt(fds[i].fd, SOL_SOCKET, SO_ERROR, (void *)&error, &errlen);
-				if(error == 0) {
-					/* Maybe not a breaking error after all? */
-					continue;
-				} else if(error == 111) {
-					/* ICMP error? If it's related to RTCP, let's just close the RTCP socket and move on */
-					if(fds[i].fd == session->media.audio_rtcp_fd) {
-						JANUS_LOG(LOG_WARN, "[NoSIP-%p] Got a '%s' on the audio RTCP socket, closing it\n",
-							session, g_strerror(error));
-						janus_mutex_lock(&session->mutex);
-						close(session->media.audio_rtcp_fd);
-						session->media.audio_rtcp_fd = -1;
-						janus_mutex_unlock(&session->mutex);
-					} else if(fds[i].fd == session->media.video_rtcp_fd) {
-						JANUS_LOG(LOG_WARN, "[NoSIP-%p] Got a '%s' on the video RTCP socket, closing it\n",
-							session, g_strerror(error));
-						janus_mutex_lock(&session->mutex);
-						close(session->media.video_rtcp_fd);
-						session->media.video_rtcp_fd = -1;
-						janus_mutex_unlock(&session->mutex);
-					}
-				}
-				/* FIXME Should we be more tolerant of ICMP errors on RTP sockets as well? */
-				pollerrs++;
-				if(pollerrs < 100)
-					continue;
-				JANUS_LOG(LOG_ERR, "[NoSIP-%p] Too many errors polling %d (socket #%d): %s...\n", session,
-					fds[i].fd, i, fds[i].revents & POLLERR ? "POLLERR" : "POLLHUP");
-				JANUS_LOG(LOG_ERR, "[NoSIP-%p]   -- %d (%s)\n", session, error, g_strerror(error));
-				/* Can we assume it's pretty much over, after a POLLERR? */
-				goon = FALSE;
-				/* FIXME Close the PeerConnection */
-				gateway->close_pc(session->handle);
-				break;
-			} else if(fds[i].revents & POLLIN) {
-				if(pipe_fd != -1 && fds[i].fd == pipe_fd) {
-					/* Poll interrupted for a reason, go on */
-					int code = 0;
-					(void)read(pipe_fd, &code, sizeof(int));
-					break;
-				}
-				/* Got an RTP/RTCP packet */
-				addrlen = sizeof(remote);
-				bytes = recvfrom(fds[i].fd, buffer, 1500, 0, (struct sockaddr*)&remote, &addrlen);
-				if(bytes < 0) {
-					/* Failed to read? */
-					continue;
-				}
-				/* Let's check what this is */
-				gboolean video = fds[i].fd == session->media.video_rtp_fd || fds[i].fd == session->media.video_rtcp_fd;
-				gboolean rtcp = fds[i].fd == session->media.audio_rtcp_fd || fds[i].fd == session->media.video_rtcp_fd;
-				if(!rtcp) {
-					/* Audio or Video RTP */
-					if(!janus_is_rtp(buffer, bytes)) {
-						/* Not an RTP packet? */
-						continue;
-					}
-					pollerrs = 0;
-					rtp_header *header = (rtp_header *)buffer;
-					if((video && session->media.video_ssrc_peer != ntohl(header->ssrc)) ||
-							(!video && session->media.audio_ssrc_peer != ntohl(header->ssrc))) {
-						if(video && session->media.video_ssrc_peer == 0) {
-							session->media.video_ssrc_peer = ntohl(header->ssrc);
-						} else if(!video && session->media.audio_ssrc_peer == 0) {
-							session->media.audio_ssrc_peer = ntohl(header->ssrc);
-						}
-						JANUS_LOG(LOG_VERB, "[NoSIP-%p] Got SIP peer %s SSRC: %"SCNu32"\n",
-							session, video ? "video" : "audio",
-							video ? session->media.video_ssrc_peer : session->media.audio_ssrc_peer);
-					}
-					/* Is this SRTP? */
-					if(session->media.has_srtp_remote) {
-						int buflen = bytes;
-						srtp_err_status_t res = srtp_unprotect(
-							(video ? session->media.video_srtp_in : session->media.audio_srtp_in),
-							buffer, &buflen);
-						if(res != srtp_err_status_ok && res != srtp_err_status_replay_fail && res != srtp_err_status_replay_old) {
-							guint32 timestamp = ntohl(header->timestamp);
-							guint16 seq = ntohs(header->seq_number);
-							JANUS_LOG(LOG_ERR, "[NoSIP-%p] %s SRTP unprotect error: %s (len=%d-->%d, ts=%"SCNu32", seq=%"SCNu16")\n",
-								session, video ? "Video" : "Audio", janus_srtp_error_str(res), bytes, buflen, timestamp, seq);
-							continue;
-						}
-						bytes = buflen;
-					}
-					/* Check if the SSRC changed (e.g., after a re-INVITE or UPDATE) */
-					janus_rtp_header_update(header, video ? &session->media.vcontext : &session->media.acontext, video, 0);
-					/* Save the frame if we're recording */
-					header->ssrc = htonl(video ? session->media.video_ssrc_peer : session->media.audio_ssrc_peer);
-					janus_recorder_save_frame(video ? session->vrc_peer : session->arc_peer, buffer, bytes);
-					/* Relay to browser */
-					janus_plugin_rtp rtp = { .mindex = -1, .video = video, .buffer = buffer, .length = bytes };
-					/* Add audio-level extension, if present */
-					janus_plugin_rtp_extensions_reset(&rtp.extensions);
-					if(!video && session->media.audio_level_extension_id != -1) {
-						gboolean vad = FALSE;
-						int level = -1;
-						if(janus_rtp_header_extension_parse_audio_level(buffer, bytes,
-								session->media.audio_level_extension_id, &vad, &level) == 0) {
-							rtp.extensions.audio_level = level;
-							rtp.extensions.audio_level_vad = vad;
-						}
-					} else if(video && session->media.video_orientation_extension_id > 0) {
-						gboolean c = FALSE, f = FALSE, r1 = FALSE, r0 = FALSE;
-						if(janus_rtp_header_extension_parse_video_orientation(buffer, bytes,
-								session->media.video_orientation_extension_id, &c, &f, &r1, &r0) == 0) {
-							rtp.extensions.video_rotation = 0;
-							if(r1 && r0)
-								rtp.extensions.video_rotation = 270;
-							else if(r1)
-								rtp.extensions.video_rotation = 180;
-							else if(r0)
-								rtp.extensions.video_rotation = 90;
-							rtp.extensions.video_back_camera = c;
-							rtp.extensions.video_flipped = f;
-						}
-					}
-					gateway->relay_rtp(session->handle, &rtp);
-					continue;
-				} else {
-					/* Audio or Video RTCP */
-					if(!janus_is_rtcp(buffer, bytes)) {
-						/* Not an RTCP packet? */
-						continue;
-					}
-					if(session->media.has_srtp_remote) {
-						int buflen = bytes;
-						srtp_err_status_t res = srtp_unprotect_rtcp(
-							(video ? session->media.video_srtp_in : session->media.audio_srtp_in),
-							buffer, &buflen);
-						if(res != srtp_err_status_ok && res != srtp_err_status_replay_fail && res != srtp_err_status_replay_old) {
-							JANUS_LOG(LOG_ERR, "[NoSIP-%p] %s SRTCP unprotect error: %s (len=%d-->%d)\n",
-								session, video ? "Video" : "Audio", janus_srtp_error_str(res), bytes, buflen);
-							continue;
-						}
-						bytes = buflen;
-					}
-					/* Relay to browser */
-					janus_plugin_rtcp rtcp = { .mindex = -1, .video = video, .buffer = buffer, bytes };
-					gateway->relay_rtcp(session->handle, &rtcp);
-					continue;
-				}
+		gateway->relay_rtp(session->handle, &rtp);
+	} else {
+		/* Audio or Video RTCP */
+		if(!janus_is_rtcp(buffer, bytes)) {
+			/* Not an RTCP packet? */
+			return 0;
+		}
+		if(session->media.has_srtp_remote) {
+			int buflen = bytes;
+			srtp_err_status_t res = srtp_unprotect_rtcp(
+				(video ? session->media.video_srtp_in : session->media.audio_srtp_in),
+				buffer, &buflen);
+			if(res != srtp_err_status_ok && res != srtp_err_status_replay_fail && res != srtp_err_status_replay_old) {
+				JANUS_LOG(LOG_ERR, "[NoSIP-%p] %s SRTCP unprotect error: %s (len=%d-->%d)\n",
+					session, video ? "Video" : "Audio", janus_srtp_error_str(res), bytes, buflen);
+				return 0;
 			}
+			bytes = buflen;
 		}
+		/* Relay to browser */
+		janus_plugin_rtcp rtcp = { .mindex = -1, .video = video, .buffer = buffer, bytes };
+		gateway->relay_rtcp(session->handle, &rtcp);
 	}
-	/* Cleanup the media session */
+	return 0;
+}
+static gboolean janus_nosip_media_source_prepare(GSource *source, gint *timeout) {
+	/* We use the timeout as a watchdog for the call, the same way the old
+	 * per-call relay thread used to wake from its poll every second */
+	*timeout = 1000;
+	return FALSE;
+}
+static gboolean janus_nosip_media_source_check(GSource *source) {
+	/* Always dispatch: besides the sockets, the dispatch callback also
+	 * checks whether the call is still there (at least once per second) */
+	return TRUE;
+}
+static gboolean janus_nosip_media_source_dispatch(GSource *source, GSourceFunc callback, gpointer user_data) {
+	janus_nosip_media_source *ms = (janus_nosip_media_source *)source;
+	janus_nosip_session *session = ms->session;
+	if(g_source_is_destroyed(source))
+		return G_SOURCE_REMOVE;
+	if(session == NULL || g_atomic_int_get(&session->destroyed) || g_atomic_int_get(&session->hangingup)) {
+		/* The call is over: cleanup the media session and detach from the loop */
+		janus_mutex_lock(&session->mutex);
+		if(session->media.source == source)
+			session->media.source = NULL;
+		janus_nosip_media_cleanup(session);
+		janus_mutex_unlock(&session->mutex);
+		JANUS_LOG(LOG_VERB, "[NoSIP-%p] Detaching call from relay loop #%d\n", session, ms->loop->id);
+		return G_SOURCE_REMOVE;
+	}
+	if(session->media.updated) {
+		/* Apparently there was a session update: reconnect the sockets to
+		 * the peer, and refresh the ones we're monitoring, if they changed */
+		janus_nosip_media_update(session);
+		janus_nosip_media_source_sync(ms);
+	}
+	/* Check the sockets we're monitoring */
+	if(janus_nosip_media_source_pollfd(ms, &ms->audio_rtp, FALSE, FALSE) < 0 ||
+			janus_nosip_media_source_pollfd(ms, &ms->audio_rtcp, FALSE, TRUE) < 0 ||
+			janus_nosip_media_source_pollfd(ms, &ms->video_rtp, TRUE, FALSE) < 0 ||
+			janus_nosip_media_source_pollfd(ms, &ms->video_rtcp, TRUE, TRUE) < 0) {
+		/* Too many errors on the sockets, assume the call is over */
+		/* FIXME Close the PeerConnection */
+		gateway->close_pc(session->handle);
+		/* We'll be detached from the loop when the session is hung up */
+	}
+	return G_SOURCE_CONTINUE;
+}
+static void janus_nosip_media_source_finalize(GSource *source) {
+	janus_nosip_media_source *ms = (janus_nosip_media_source *)source;
+	if(ms->loop != NULL)
+		g_atomic_int_add(&ms->loop->calls, -1);
+	if(ms->session != NULL) {
+		janus_refcount_decrease(&ms->session->ref);
+		ms->session = NULL;
+	}
+}
+static GSourceFuncs janus_nosip_media_source_funcs = {
+	janus_nosip_media_source_prepare,
+	janus_nosip_media_source_check,
+	janus_nosip_media_source_dispatch,
+	janus_nosip_media_source_finalize,
+	NULL, NULL
+};
+
+/* Helper to assign a call to one of the relay loops, and start monitoring
+ * its RTP/RTCP sockets there; returns 0 on success, a negative integer
+ * otherwise (e.g., if the relay loops aren't there) */
+static int janus_nosip_media_attach(janus_nosip_session *session) {
+	if(session == NULL || g_atomic_int_get(&session->destroyed) || relay_loops == NULL)
+		return -1;
+	/* Pick the loop with the lowest number of calls */
+	janus_nosip_relay_loop *loop = &relay_loops[0];
+	int i = 0;
+	for(i=1; i<num_relay_loops; i++) {
+		if(g_atomic_int_get(&relay_loops[i].calls) < g_atomic_int_get(&loop->calls))
+			loop = &relay_loops[i];
+	}
+	/* Connect the UDP sockets to the peer right away */
+	session->media.updated = TRUE;
+	janus_nosip_media_update(session);
 	janus_mutex_lock(&session->mutex);
-	janus_nosip_media_cleanup(session);
+	if(session->media.source != NULL) {
+		/* There's a source already (e.g., a previous call on the same
+		 * handle): get rid of it, the new one picks up the new sockets */
+		g_source_destroy(session->media.source);
+		session->media.source = NULL;
+	}
+	/* Create a source to have the loop monitor the RTP/RTCP sockets */
+	GSource *source = g_source_new(&janus_nosip_media_source_funcs, sizeof(janus_nosip_media_source));
+	janus_nosip_media_source *ms = (janus_nosip_media_source *)source;
+	janus_refcount_increase(&session->ref);
+	ms->session = session;
+	ms->loop = loop;
+	ms->audio_rtp.fd = ms->audio_rtcp.fd = ms->video_rtp.fd = ms->video_rtcp.fd = -1;
+	janus_nosip_media_source_sync(ms);
+	g_atomic_int_inc(&loop->calls);
+	session->media.relay_loop = loop;
+	session->media.pollerrs = 0;
+	session->media.source = source;
+	g_source_attach(source, loop->mainctx);
+	g_source_unref(source);	/* The loop context owns the source now */
 	janus_mutex_unlock(&session->mutex);
-	/* Done */
-	JANUS_LOG(LOG_INFO, "Leaving NoSIP relay thread\n");
-	session->relayer_thread = NULL;
-	janus_refcount_decrease(&session->ref);
-	g_thread_unref(g_thread_self());
-	return NULL;
+	JANUS_LOG(LOG_VERB, "[NoSIP-%p] Call attached to relay loop #%d\n", session, loop->id);
+	return 0;
 }
 
 /* Helper method to send an RTCP PLI to the peer */
@@ -375,6 +375,11 @@
 #include <arpa/inet.h>
 #include <sys/stat.h>
 #include <sys/time.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
 #include <jansson.h>
 
 #include "../debug.h"
@@ -492,6 +497,10 @@ static janus_callbacks *gateway = NULL;
 static GThread *handler_thread;
 static void *janus_recordplay_handler(void *data);
 static void janus_recordplay_hangup_media_internal(janus_plugin_session *handle);
+#ifdef __linux__
+static GThread *watcher_thread;
+static void *janus_recordplay_watcher_thread(void *data);
+#endif
 
 typedef struct janus_recordplay_message {
 	janus_plugin_session *handle;
@@ -536,6 +545,10 @@ typedef struct janus_recordplay_recording {
 	char *drc_file;				/* Data file name */
 	gboolean textdata;			/* Whether data format is text */
 	char *offer;				/* The SDP offer that will be sent to watchers */
+	janus_recordplay_frame_packet *aindex;	/* Cached audio frame index (for playout) */
+	janus_recordplay_frame_packet *vindex;	/* Cached video frame index (for playout) */
+	janus_recordplay_frame_packet *dindex;	/* Cached data frame index (for playout) */
+	volatile gint indexed;		/* Whether the frame indexes above have been built already */
 	gboolean e2ee;				/* Whether media in the recording is encrypted, e.g., using Insertable Streams */
 	GList *viewers;				/* List of users watching this recording */
 	volatile gint paused;		/* Whether this recording is paused */
@@ -560,9 +573,9 @@ typedef struct janus_recordplay_session {
 	janus_recorder *vrc;	/* Video recorder */
 	janus_recorder *drc;	/* Data recorder */
 	janus_mutex rec_mutex;	/* Mutex to protect the recorders from race conditions */
-	janus_recordplay_frame_packet *aframes;	/* Audio frames (for playout) */
-	janus_recordplay_frame_packet *vframes;	/* Video frames (for playout) */
-	janus_recordplay_frame_packet *dframes;	/* Data packets (for playout) */
+	janus_recordplay_frame_packet *aframes;	/* Audio frames (for playout; shared with the recording, not owned) */
+	janus_recordplay_frame_packet *vframes;	/* Video frames (for playout; shared with the recording, not owned) */
+	janus_recordplay_frame_packet *dframes;	/* Data packets (for playout; shared with the recording, not owned) */
 	gboolean opusred;		/* Whether this user supports RED for audio (for playout) */
 	gboolean textdata;		/* Whether data format is text */
 	guint video_remb_startup;
@@ -608,9 +621,21 @@ static void janus_recordplay_recording_destroy(janus_recordplay_recording *recor
 		janus_refcount_decrease(&recording->ref);
 }
 
+static void janus_recordplay_frame_packets_free(janus_recordplay_frame_packet *list) {
+	janus_recordplay_frame_packet *tmp = NULL;
+	while(list) {
+		tmp = list->next;
+		g_free(list);
+		list = tmp;
+	}
+}
+
 static void janus_recordplay_recording_free(const janus_refcount *recording_ref) {
 	janus_recordplay_recording *recording = janus_refcount_containerof(recording_ref, janus_recordplay_recording, ref);
 	/* This recording can be destroyed, free all the resources */
+	janus_recordplay_frame_packets_free(recording->aindex);
+	janus_recordplay_frame_packets_free(recording->vindex);
+	janus_recordplay_frame_packets_free(recording->dindex);
 	g_free(recording->name);
 	g_free(recording->date);
 	g_free(recording->arc_file);
@@ -627,6 +652,41 @@ static char *recordings_path = NULL;
 void janus_recordplay_update_recordings_list(void);
 static void *janus_recordplay_playout_thread(void *data);
 
+/* Persistent index of the parsed recordings: a JSON object mapping .nfo
+ * filenames to what we parsed out of them (and the related MJR headers),
+ * keyed by mtime, so that restarts and refreshes only pay the parsing
+ * cost for files that actually changed since the previous scan */
+#define JANUS_RECORDPLAY_CACHE_FILE		".recordings.cache"
+static json_t *recordings_cache = NULL;
+static gboolean recordings_cache_dirty = FALSE;
+static janus_mutex recordings_cache_mutex = JANUS_MUTEX_INITIALIZER;
+static void janus_recordplay_cache_load(void);
+static void janus_recordplay_cache_save(void);
+/* Only one scan at a time makes sense: concurrent requests piggyback */
+static volatile gint updating_recordings = 0;
+
+/* Helper to build (and cache) the frame indexes of a recording: this is done
+ * once, when the recording is imported, so that viewers don't have to wait
+ * for the MJR files to be re-parsed every time a playout starts */
+static void janus_recordplay_index_recording(janus_recordplay_recording *rec) {
+	if(rec == NULL || g_atomic_int_get(&rec->destroyed))
+		return;
+	janus_mutex_lock(&rec->mutex);
+	if(g_atomic_int_get(&rec->indexed)) {
+		/* We did this already */
+		janus_mutex_unlock(&rec->mutex);
+		return;
+	}
+	if(rec->arc_file && rec->aindex == NULL)
+		rec->aindex = janus_recordplay_get_frames(recordings_path, rec->arc_file);
+	if(rec->vrc_file && rec->vindex == NULL)
+		rec->vindex = janus_recordplay_get_frames(recordings_path, rec->vrc_file);
+	if(rec->drc_file && rec->dindex == NULL)
+		rec->dindex = janus_recordplay_get_frames(recordings_path, rec->drc_file);
+	g_atomic_int_set(&rec->indexed, 1);
+	janus_mutex_unlock(&rec->mutex);
+}
+
 /* Helper to send RTCP feedback back to recorders, if needed */
 void janus_recordplay_send_rtcp_feedback(janus_plugin_session *handle, int video, char *buf, int len);
 
@@ -963,6 +1023,7 @@ int janus_recordplay_init(janus_callbacks *callback, const char *config_path) {
 		}
 	}
 	recordings = g_hash_table_new_full(g_int64_hash, g_int64_equal, (GDestroyNotify)g_free, (GDestroyNotify)janus_recordplay_recording_destroy);
+	janus_recordplay_cache_load();
 	janus_recordplay_update_recordings_list();
 
 	sessions = g_hash_table_new_full(NULL, NULL, NULL, (GDestroyNotify)janus_recordplay_session_destroy);
@@ -986,6 +1047,17 @@ int janus_recordplay_init(janus_callbacks *callback, const char *config_path) {
 		admin_key = NULL;
 		return -1;
 	}
+#ifdef __linux__
+	/* Launch the thread that will watch the recordings folder for changes:
+	 * if this fails the list simply won't refresh automatically */
+	watcher_thread = g_thread_try_new("recordplay watcher", janus_recordplay_watcher_thread, NULL, &error);
+	if(error != NULL) {
+		JANUS_LOG(LOG_WARN, "Got error %d (%s) trying to launch the Record&Play watcher thread, recordings list updates will need explicit refreshes...\n",
+			error->code, error->message ? error->message : "??");
+		g_error_free(error);
+		error = NULL;
+	}
+#endif
 	JANUS_LOG(LOG_INFO, "%s initialized!\n", JANUS_RECORDPLAY_NAME);
 	return 0;
 }
@@ -1000,6 +1072,12 @@ void janus_recordplay_destroy(void) {
 		g_thread_join(handler_thread);
 		handler_thread = NULL;
 	}
+#ifdef __linux__
+	if(watcher_thread != NULL) {
+		g_thread_join(watcher_thread);
+		watcher_thread = NULL;
+	}
+#endif
 	/* FIXME We should destroy the sessions cleanly */
 	janus_mutex_lock(&sessions_mutex);
 	g_hash_table_destroy(sessions);
@@ -1009,6 +1087,10 @@ void janus_recordplay_destroy(void) {
 	janus_mutex_unlock(&sessions_mutex);
 	g_async_queue_unref(messages);
 	messages = NULL;
+	/* Persist the recordings index, if it changed since the last scan */
+	janus_recordplay_cache_save();
+	json_decref(recordings_cache);
+	recordings_cache = NULL;
 	g_free(recordings_path);
 	recordings_path = NULL;
 	g_free(admin_key);
@@ -2165,23 +2247,28 @@ recdone:
 				g_snprintf(error_cause, 512, "No such recording");
 				goto error;
 			}
-			/* Access the frames */
+			/* Access the frames: the indexes are built when a recording is
+			 * imported and cached in the recording itself, so that viewers
+			 * don't pay for a re-parsing of the MJR files at every playout
+			 * (we may still need to build them here, though, e.g., for a
+			 * recording we just saved ourselves) */
+			janus_recordplay_index_recording(rec);
 			if(rec->arc_file) {
-				session->aframes = janus_recordplay_get_frames(recordings_path, rec->arc_file);
+				session->aframes = rec->aindex;
 				if(session->aframes == NULL) {
 					JANUS_LOG(LOG_WARN, "Error opening audio recording, trying to go on anyway\n");
 					warning = "Broken audio file, playing video only";
 				}
 			}
 			if(rec->vrc_file) {
-				session->vframes = janus_recordplay_get_frames(recordings_path, rec->vrc_file);
+				session->vframes = rec->vindex;
 				if(session->vframes == NULL) {
 					JANUS_LOG(LOG_WARN, "Error opening video recording, trying to go on anyway\n");
 					warning = "Broken video file, playing audio only";
 				}
 			}
 			if(rec->drc_file) {
-				session->dframes = janus_recordplay_get_frames(recordings_path, rec->drc_file);
+				session->dframes = rec->dindex;
 				if(session->dframes == NULL) {
 					JANUS_LOG(LOG_WARN, "Error opening data recording, trying to go on anyway\n");
 					warning = "Broken data file, playing audio/video only";
@@ -2344,13 +2431,266 @@ error:
 	return NULL;
 }
 
+/* Helper to finalize an imported recording (payload types, offer, refcount) */
+static janus_recordplay_recording *janus_recordplay_import_finish(janus_recordplay_recording *rec) {
+	rec->audio_pt = AUDIO_PT;
+	if(rec->opusred_pt > 0 && rec->audio_pt == rec->opusred_pt)
+		rec->audio_pt++;
+	if(rec->acodec != JANUS_AUDIOCODEC_NONE) {
+		/* Some audio codecs have a fixed payload type that we can't mess with */
+		if(rec->acodec == JANUS_AUDIOCODEC_PCMU)
+			rec->audio_pt = 0;
+		else if(rec->acodec == JANUS_AUDIOCODEC_PCMA)
+			rec->audio_pt = 8;
+		else if(rec->acodec == JANUS_AUDIOCODEC_G722)
+			rec->audio_pt = 9;
+	}
+	rec->video_pt = VIDEO_PT;
+	rec->viewers = NULL;
+	if(janus_recordplay_generate_offer(rec) < 0) {
+		JANUS_LOG(LOG_WARN, "Could not generate offer for recording %"SCNu64"...\n", rec->id);
+	}
+	g_atomic_int_set(&rec->paused, 0);
+	g_atomic_int_set(&rec->destroyed, 0);
+	g_atomic_int_set(&rec->completed, 1);
+	janus_refcount_init(&rec->ref, janus_recordplay_recording_free);
+	janus_mutex_init(&rec->mutex);
+	return rec;
+}
+
+/* Helper to import a recording from a .nfo file (and the MJR headers it
+ * points to): the returned recording is not added to the list yet, and
+ * when a cache entry pointer is provided it's filled in as well, so that
+ * the next scan can skip the parsing entirely */
+static janus_recordplay_recording *janus_recordplay_import_recording(const char *filename, json_t **cached) {
+	char recpath[1024];
+	memset(recpath, 0, 1024);
+	g_snprintf(recpath, 1024, "%s/%s", recordings_path, filename);
+	janus_config *nfo = janus_config_parse(recpath);
+	if(nfo == NULL) {
+		JANUS_LOG(LOG_ERR, "Invalid recording '%s'...\n", filename);
+		return NULL;
+	}
+	GList *cl = janus_config_get_categories(nfo, NULL);
+	if(cl == NULL || cl->data == NULL) {
+		JANUS_LOG(LOG_WARN, "No recording info in '%s', skipping...\n", filename);
+		janus_config_destroy(nfo);
+		return NULL;
+	}
+	janus_config_category *cat = (janus_config_category *)cl->data;
+	guint64 id = g_ascii_strtoull(cat->name, NULL, 0);
+	if(id == 0) {
+		JANUS_LOG(LOG_WARN, "Invalid ID, skipping...\n");
+		g_list_free(cl);
+		janus_config_destroy(nfo);
+		return NULL;
+	}
+	janus_config_item *pvt = janus_config_get(nfo, cat, janus_config_type_item, "private");
+	janus_config_item *name = janus_config_get(nfo, cat, janus_config_type_item, "name");
+	janus_config_item *date = janus_config_get(nfo, cat, janus_config_type_item, "date");
+	janus_config_item *audio = janus_config_get(nfo, cat, janus_config_type_item, "audio");
+	janus_config_item *video = janus_config_get(nfo, cat, janus_config_type_item, "video");
+	janus_config_item *data = janus_config_get(nfo, cat, janus_config_type_item, "data");
+	if(!name || !name->value || strlen(name->value) == 0 || !date || !date->value || strlen(date->value) == 0) {
+		JANUS_LOG(LOG_WARN, "Invalid info for recording %"SCNu64", skipping...\n", id);
+		g_list_free(cl);
+		janus_config_destroy(nfo);
+		return NULL;
+	}
+	if((!audio || !audio->value) && (!video || !video->value)) {
+		JANUS_LOG(LOG_WARN, "No audio and no video in recording %"SCNu64", skipping...\n", id);
+		g_list_free(cl);
+		janus_config_destroy(nfo);
+		return NULL;
+	}
+	janus_recordplay_recording *rec = g_malloc0(sizeof(janus_recordplay_recording));
+	rec->id = id;
+	rec->is_private = (pvt == NULL) ? TRUE : private_recordings;
+	if(pvt && pvt->value)
+		rec->is_private = janus_is_true(pvt->value);
+	rec->name = g_strdup(name->value);
+	rec->date = g_strdup(date->value);
+	if(audio && audio->value) {
+		rec->arc_file = g_strdup(audio->value);
+		char *ext = strstr(rec->arc_file, ".mjr");
+		if(ext != NULL)
+			*ext = '\0';
+		/* Check which codec is in this recording (and if it's end-to-end encrypted) */
+		gboolean e2ee = FALSE;
+		char fmtp[256];
+		fmtp[0] = '\0';
+		rec->acodec = janus_audiocodec_from_name(janus_recordplay_parse_codec(recordings_path,
+			rec->arc_file, fmtp, sizeof(fmtp), &rec->audiolevel_ext_id, NULL, &rec->opusred_pt, &e2ee));
+		if(strlen(fmtp) > 0)
+			rec->afmtp = g_strdup(fmtp);
+		if(e2ee)
+			rec->e2ee = TRUE;
+	}
+	if(video && video->value) {
+		rec->vrc_file = g_strdup(video->value);
+		char *ext = strstr(rec->vrc_file, ".mjr");
+		if(ext != NULL)
+			*ext = '\0';
+		/* Check which codec is in this recording (and if it's end-to-end encrypted) */
+		gboolean e2ee = FALSE;
+		char fmtp[256];
+		fmtp[0] = '\0';
+		rec->vcodec = janus_videocodec_from_name(janus_recordplay_parse_codec(recordings_path,
+			rec->vrc_file, fmtp, sizeof(fmtp), NULL, &rec->videoorient_ext_id, NULL, &e2ee));
+		if(strlen(fmtp) > 0)
+			rec->vfmtp = g_strdup(fmtp);
+		if(e2ee)
+			rec->e2ee = TRUE;
+	}
+	if(data && data->value) {
+		rec->drc_file = g_strdup(data->value);
+		char *ext = strstr(rec->drc_file, ".mjr");
+		if(ext != NULL)
+			*ext = '\0';
+		const char *textcodec = janus_recordplay_parse_codec(recordings_path,
+			rec->drc_file, NULL, sizeof(NULL), NULL, NULL, NULL, NULL);
+		rec->textdata = textcodec && (!strcasecmp(textcodec, "text"));
+	}
+	g_list_free(cl);
+	janus_config_destroy(nfo);
+	janus_recordplay_import_finish(rec);
+	if(cached != NULL) {
+		/* Fill in the cache entry for this recording too */
+		json_t *entry = json_object();
+		json_object_set_new(entry, "id", json_integer(rec->id));
+		json_object_set_new(entry, "private", rec->is_private ? json_true() : json_false());
+		json_object_set_new(entry, "name", json_string(rec->name));
+		json_object_set_new(entry, "date", json_string(rec->date));
+		if(rec->arc_file != NULL) {
+			json_object_set_new(entry, "audio", json_string(rec->arc_file));
+			json_object_set_new(entry, "acodec", json_string(janus_audiocodec_name(rec->acodec)));
+			if(rec->afmtp != NULL)
+				json_object_set_new(entry, "afmtp", json_string(rec->afmtp));
+			json_object_set_new(entry, "audiolevel_ext_id", json_integer(rec->audiolevel_ext_id));
+			json_object_set_new(entry, "opusred_pt", json_integer(rec->opusred_pt));
+		}
+		if(rec->vrc_file != NULL) {
+			json_object_set_new(entry, "video", json_string(rec->vrc_file));
+			json_object_set_new(entry, "vcodec", json_string(janus_videocodec_name(rec->vcodec)));
+			if(rec->vfmtp != NULL)
+				json_object_set_new(entry, "vfmtp", json_string(rec->vfmtp));
+			json_object_set_new(entry, "videoorient_ext_id", json_integer(rec->videoorient_ext_id));
+		}
+		if(rec->drc_file != NULL) {
+			json_object_set_new(entry, "data", json_string(rec->drc_file));
+			json_object_set_new(entry, "textdata", rec->textdata ? json_true() : json_false());
+		}
+		if(rec->e2ee)
+			json_object_set_new(entry, "e2ee", json_true());
+		*cached = entry;
+	}
+	return rec;
+}
+
+/* Helper to import a recording from a persistent cache entry, skipping
+ * the .nfo parsing and the MJR header checks entirely */
+static janus_recordplay_recording *janus_recordplay_import_cached_recording(json_t *entry) {
+	guint64 id = json_integer_value(json_object_get(entry, "id"));
+	json_t *name = json_object_get(entry, "name");
+	json_t *date = json_object_get(entry, "date");
+	if(id == 0 || !json_is_string(name) || !json_is_string(date))
+		return NULL;
+	janus_recordplay_recording *rec = g_malloc0(sizeof(janus_recordplay_recording));
+	rec->id = id;
+	rec->is_private = json_is_true(json_object_get(entry, "private"));
+	rec->name = g_strdup(json_string_value(name));
+	rec->date = g_strdup(json_string_value(date));
+	json_t *audio = json_object_get(entry, "audio");
+	if(json_is_string(audio)) {
+		rec->arc_file = g_strdup(json_string_value(audio));
+		rec->acodec = janus_audiocodec_from_name(json_string_value(json_object_get(entry, "acodec")));
+		json_t *afmtp = json_object_get(entry, "afmtp");
+		if(json_is_string(afmtp))
+			rec->afmtp = g_strdup(json_string_value(afmtp));
+		rec->audiolevel_ext_id = json_integer_value(json_object_get(entry, "audiolevel_ext_id"));
+		rec->opusred_pt = json_integer_value(json_object_get(entry, "opusred_pt"));
+	}
+	json_t *video = json_object_get(entry, "video");
+	if(json_is_string(video)) {
+		rec->vrc_file = g_strdup(json_string_value(video));
+		rec->vcodec = janus_videocodec_from_name(json_string_value(json_object_get(entry, "vcodec")));
+		json_t *vfmtp = json_object_get(entry, "vfmtp");
+		if(json_is_string(vfmtp))
+			rec->vfmtp = g_strdup(json_string_value(vfmtp));
+		rec->videoorient_ext_id = json_integer_value(json_object_get(entry, "videoorient_ext_id"));
+	}
+	json_t *data = json_object_get(entry, "data");
+	if(json_is_string(data)) {
+		rec->drc_file = g_strdup(json_string_value(data));
+		rec->textdata = json_is_true(json_object_get(entry, "textdata"));
+	}
+	if(json_is_true(json_object_get(entry, "e2ee")))
+		rec->e2ee = TRUE;
+	return janus_recordplay_import_finish(rec);
+}
+
+/* Helpers to load and persist the recordings index */
+static void janus_recordplay_cache_load(void) {
+	char cachefile[1024];
+	g_snprintf(cachefile, 1024, "%s/%s", recordings_path, JANUS_RECORDPLAY_CACHE_FILE);
+	json_error_t error;
+	recordings_cache = json_load_file(cachefile, 0, &error);
+	if(recordings_cache != NULL && !json_is_object(recordings_cache)) {
+		json_decref(recordings_cache);
+		recordings_cache = NULL;
+	}
+	if(recordings_cache == NULL)
+		recordings_cache = json_object();
+	else
+		JANUS_LOG(LOG_INFO, "Loaded a recordings index with %zu entries\n", json_object_size(recordings_cache));
+}
+static void janus_recordplay_cache_save(void) {
+	janus_mutex_lock(&recordings_cache_mutex);
+	if(!recordings_cache_dirty) {
+		janus_mutex_unlock(&recordings_cache_mutex);
+		return;
+	}
+	char cachefile[1024], tmpfile[1040];
+	g_snprintf(cachefile, 1024, "%s/%s", recordings_path, JANUS_RECORDPLAY_CACHE_FILE);
+	g_snprintf(tmpfile, 1040, "%s.tmp", cachefile);
+	/* Write to a temporary file first, so that a crash can't truncate the index */
+	if(json_dump_file(recordings_cache, tmpfile, JSON_COMPACT) < 0 || rename(tmpfile, cachefile) < 0) {
+		JANUS_LOG(LOG_WARN, "Error saving the recordings index to %s...\n", cachefile);
+	} else {
+		recordings_cache_dirty = FALSE;
+	}
+	janus_mutex_unlock(&recordings_cache_mutex);
+}
+
+/* Helper struct and workers for scanning the recordings folder in parallel */
+typedef struct janus_recordplay_scan_job {
+	char *filename;		/* .nfo file this job refers to */
+	time_t mtime;		/* Its modification time, for the persistent index */
+	janus_recordplay_recording *rec;	/* The imported recording, if successful */
+	json_t *entry;		/* The related persistent index entry */
+} janus_recordplay_scan_job;
+static void janus_recordplay_scan_worker(gpointer data, gpointer user_data) {
+	janus_recordplay_scan_job *job = (janus_recordplay_scan_job *)data;
+	job->rec = janus_recordplay_import_recording(job->filename, &job->entry);
+	if(job->entry != NULL)
+		json_object_set_new(job->entry, "mtime", json_integer(job->mtime));
+}
+static void janus_recordplay_index_worker(gpointer data, gpointer user_data) {
+	janus_recordplay_recording *rec = (janus_recordplay_recording *)data;
+	janus_recordplay_index_recording(rec);
+	janus_refcount_decrease(&rec->ref);
+}
+
 void janus_recordplay_update_recordings_list(void) {
 	if(recordings_path == NULL)
 		return;
+	/* Only one scan at a time: concurrent requests piggyback on it */
+	if(!g_atomic_int_compare_and_exchange(&updating_recordings, 0, 1))
+		return;
 	JANUS_LOG(LOG_VERB, "Updating recordings list in %s\n", recordings_path);
 	janus_mutex_lock(&recordings_mutex);
 	/* First of all, let's keep track of which recordings are currently available */
-	GList *old_recordings = NULL;
+	GList *old_recordings = NULL, *new_recordings = NULL;
 	if(recordings != NULL && g_hash_table_size(recordings) > 0) {
 		GHashTableIter iter;
 		gpointer value;
@@ -2363,149 +2703,141 @@ void janus_recordplay_update_recordings_list(void) {
 			}
 		}
 	}
+	janus_mutex_unlock(&recordings_mutex);
 	/* Open dir */
 	DIR *dir = opendir(recordings_path);
 	if(!dir) {
 		JANUS_LOG(LOG_ERR, "Couldn't open folder...\n");
 		g_list_free(old_recordings);
-		janus_mutex_unlock(&recordings_mutex);
+		g_atomic_int_set(&updating_recordings, 0);
 		return;
 	}
 	struct dirent *recent = NULL;
 	char recpath[1024];
+	GList *pending = NULL;
+	GHashTable *seen = g_hash_table_new_full(g_str_hash, g_str_equal, (GDestroyNotify)g_free, NULL);
 	while((recent = readdir(dir))) {
 		int len = strlen(recent->d_name);
 		if(len < 4)
 			continue;
 		if(strcasecmp(recent->d_name+len-4, ".nfo"))
 			continue;
-		JANUS_LOG(LOG_VERB, "Importing recording '%s'...\n", recent->d_name);
+		g_hash_table_insert(seen, g_strdup(recent->d_name), GINT_TO_POINTER(1));
 		memset(recpath, 0, 1024);
 		g_snprintf(recpath, 1024, "%s/%s", recordings_path, recent->d_name);
-		janus_config *nfo = janus_config_parse(recpath);
-		if(nfo == NULL) {
-			JANUS_LOG(LOG_ERR, "Invalid recording '%s'...\n", recent->d_name);
-			continue;
-		}
-		GList *cl = janus_config_get_categories(nfo, NULL);
-		if(cl == NULL || cl->data == NULL) {
-			JANUS_LOG(LOG_WARN, "No recording info in '%s', skipping...\n", recent->d_name);
-			janus_config_destroy(nfo);
-			continue;
-		}
-		janus_config_category *cat = (janus_config_category *)cl->data;
-		guint64 id = g_ascii_strtoull(cat->name, NULL, 0);
-		if(id == 0) {
-			JANUS_LOG(LOG_WARN, "Invalid ID, skipping...\n");
-			g_list_free(cl);
-			janus_config_destroy(nfo);
+		struct stat st = { 0 };
+		if(stat(recpath, &st) < 0)
 			continue;
+		/* Check the persistent index first: on a hit (same mtime as the
+		 * previous scan) we can skip the .nfo and MJR parsing entirely */
+		janus_mutex_lock(&recordings_cache_mutex);
+		json_t *entry = json_object_get(recordings_cache, recent->d_name);
+		if(entry != NULL && json_integer_value(json_object_get(entry, "mtime")) == (json_int_t)st.st_mtime)
+			json_incref(entry);
+		else
+			entry = NULL;
+		janus_mutex_unlock(&recordings_cache_mutex);
+		if(entry != NULL) {
+			guint64 id = json_integer_value(json_object_get(entry, "id"));
+			janus_mutex_lock(&recordings_mutex);
+			janus_recordplay_recording *rec = g_hash_table_lookup(recordings, &id);
+			if(rec != NULL) {
+				JANUS_LOG(LOG_VERB, "Skipping recording with ID %"SCNu64", it's already in the list...\n", id);
+				/* Mark that we updated this recording */
+				old_recordings = g_list_remove(old_recordings, &rec->id);
+				janus_mutex_unlock(&recordings_mutex);
+				json_decref(entry);
+				continue;
+			}
+			janus_mutex_unlock(&recordings_mutex);
+			rec = janus_recordplay_import_cached_recording(entry);
+			json_decref(entry);
+			if(rec != NULL) {
+				JANUS_LOG(LOG_VERB, "Importing recording '%s' (from the index)...\n", recent->d_name);
+				janus_mutex_lock(&recordings_mutex);
+				g_hash_table_insert(recordings, janus_uint64_dup(rec->id), rec);
+				/* Take note that we'll need to build the frame indexes too */
+				janus_refcount_increase(&rec->ref);
+				new_recordings = g_list_prepend(new_recordings, rec);
+				janus_mutex_unlock(&recordings_mutex);
+				continue;
+			}
+			/* The index entry was stale or broken, parse the file again */
 		}
-		janus_recordplay_recording *rec = g_hash_table_lookup(recordings, &id);
-		if(rec != NULL) {
-			JANUS_LOG(LOG_VERB, "Skipping recording with ID %"SCNu64", it's already in the list...\n", id);
-			g_list_free(cl);
-			janus_config_destroy(nfo);
-			/* Mark that we updated this recording */
-			old_recordings = g_list_remove(old_recordings, &rec->id);
-			continue;
-		}
-		janus_config_item *pvt = janus_config_get(nfo, cat, janus_config_type_item, "private");
-		janus_config_item *name = janus_config_get(nfo, cat, janus_config_type_item, "name");
-		janus_config_item *date = janus_config_get(nfo, cat, janus_config_type_item, "date");
-		janus_config_item *audio = janus_config_get(nfo, cat, janus_config_type_item, "audio");
-		janus_config_item *video = janus_config_get(nfo, cat, janus_config_type_item, "video");
-		janus_config_item *data = janus_config_get(nfo, cat, janus_config_type_item, "data");
-		if(!name || !name->value || strlen(name->value) == 0 || !date || !date->value || strlen(date->value) == 0) {
-			JANUS_LOG(LOG_WARN, "Invalid info for recording %"SCNu64", skipping...\n", id);
-			g_list_free(cl);
-			janus_config_destroy(nfo);
-			continue;
-		}
-		if((!audio || !audio->value) && (!video || !video->value)) {
-			JANUS_LOG(LOG_WARN, "No audio and no video in recording %"SCNu64", skipping...\n", id);
-			janus_config_destroy(nfo);
-			continue;
-		}
-		rec = g_malloc0(sizeof(janus_recordplay_recording));
-		rec->id = id;
-		rec->is_private = (pvt == NULL) ? TRUE : private_recordings;
-		if(pvt && pvt->value)
-			rec->is_private = janus_is_true(pvt->value);
-		rec->name = g_strdup(name->value);
-		rec->date = g_strdup(date->value);
-		if(audio && audio->value) {
-			rec->arc_file = g_strdup(audio->value);
-			char *ext = strstr(rec->arc_file, ".mjr");
-			if(ext != NULL)
-				*ext = '\0';
-			/* Check which codec is in this recording (and if it's end-to-end encrypted) */
-			gboolean e2ee = FALSE;
-			char fmtp[256];
-			fmtp[0] = '\0';
-			rec->acodec = janus_audiocodec_from_name(janus_recordplay_parse_codec(recordings_path,
-				rec->arc_file, fmtp, sizeof(fmtp), &rec->audiolevel_ext_id, NULL, &rec->opusred_pt, &e2ee));
-			if(strlen(fmtp) > 0)
-				rec->afmtp = g_strdup(fmtp);
-			if(e2ee)
-				rec->e2ee = TRUE;
-		}
-		if(video && video->value) {
-			rec->vrc_file = g_strdup(video->value);
-			char *ext = strstr(rec->vrc_file, ".mjr");
-			if(ext != NULL)
-				*ext = '\0';
-			/* Check which codec is in this recording (and if it's end-to-end encrypted) */
-			gboolean e2ee = FALSE;
-			char fmtp[256];
-			fmtp[0] = '\0';
-			rec->vcodec = janus_videocodec_from_name(janus_recordplay_parse_codec(recordings_path,
-				rec->vrc_file, fmtp, sizeof(fmtp), NULL, &rec->videoorient_ext_id, NULL, &e2ee));
-			if(strlen(fmtp) > 0)
-				rec->vfmtp = g_strdup(fmtp);
-			if(e2ee)
-				rec->e2ee = TRUE;
-		}
-		if(data && data->value) {
-			rec->drc_file = g_strdup(data->value);
-			char *ext = strstr(rec->drc_file, ".mjr");
-			if(ext != NULL)
-				*ext = '\0';
-			const char *textcodec = janus_recordplay_parse_codec(recordings_path,
-				rec->drc_file, NULL, sizeof(NULL), NULL, NULL, NULL, NULL);
-			rec->textdata = textcodec && (!strcasecmp(textcodec, "text"));
-		}
-		rec->audio_pt = AUDIO_PT;
-		if(rec->opusred_pt > 0 && rec->audio_pt == rec->opusred_pt)
-			rec->audio_pt++;
-		if(rec->acodec != JANUS_AUDIOCODEC_NONE) {
-			/* Some audio codecs have a fixed payload type that we can't mess with */
-			if(rec->acodec == JANUS_AUDIOCODEC_PCMU)
-				rec->audio_pt = 0;
-			else if(rec->acodec == JANUS_AUDIOCODEC_PCMA)
-				rec->audio_pt = 8;
-			else if(rec->acodec == JANUS_AUDIOCODEC_G722)
-				rec->audio_pt = 9;
-		}
-		rec->video_pt = VIDEO_PT;
-		rec->viewers = NULL;
-		if(janus_recordplay_generate_offer(rec) < 0) {
-			JANUS_LOG(LOG_WARN, "Could not generate offer for recording %"SCNu64"...\n", rec->id);
-		}
-		g_atomic_int_set(&rec->paused, 0);
-		g_atomic_int_set(&rec->destroyed, 0);
-		g_atomic_int_set(&rec->completed, 1);
-		janus_refcount_init(&rec->ref, janus_recordplay_recording_free);
-		janus_mutex_init(&rec->mutex);
-
-		g_list_free(cl);
-		janus_config_destroy(nfo);
-
-		/* Add to the list of recordings */
-		g_hash_table_insert(recordings, janus_uint64_dup(rec->id), rec);
+		JANUS_LOG(LOG_VERB, "Importing recording '%s'...\n", recent->d_name);
+		janus_recordplay_scan_job *job = g_malloc0(sizeof(janus_recordplay_scan_job));
+		job->filename = g_strdup(recent->d_name);
+		job->mtime = st.st_mtime;
+		pending = g_list_prepend(pending, job);
 	}
 	closedir(dir);
+	/* Parse the new .nfo files (and the MJR headers they point to) in a
+	 * worker pool, rather than one at a time: with large archives this
+	 * is what dominates the scan time */
+	if(pending != NULL) {
+		GThreadPool *pool = g_thread_pool_new(janus_recordplay_scan_worker, NULL,
+			g_get_num_processors(), FALSE, NULL);
+		GList *temp = pending;
+		while(temp != NULL) {
+			if(pool != NULL)
+				g_thread_pool_push(pool, temp->data, NULL);
+			else
+				janus_recordplay_scan_worker(temp->data, NULL);
+			temp = temp->next;
+		}
+		if(pool != NULL)
+			g_thread_pool_free(pool, FALSE, TRUE);	/* This waits for the workers */
+		/* Now collect the results */
+		temp = pending;
+		while(temp != NULL) {
+			janus_recordplay_scan_job *job = (janus_recordplay_scan_job *)temp->data;
+			if(job->rec != NULL) {
+				janus_mutex_lock(&recordings_mutex);
+				janus_recordplay_recording *rec = g_hash_table_lookup(recordings, &job->rec->id);
+				if(rec != NULL) {
+					JANUS_LOG(LOG_VERB, "Skipping recording with ID %"SCNu64", it's already in the list...\n", job->rec->id);
+					/* Mark that we updated this recording */
+					old_recordings = g_list_remove(old_recordings, &rec->id);
+					janus_mutex_unlock(&recordings_mutex);
+					janus_refcount_decrease(&job->rec->ref);
+				} else {
+					g_hash_table_insert(recordings, janus_uint64_dup(job->rec->id), job->rec);
+					/* Take note that we'll need to build the frame indexes too */
+					janus_refcount_increase(&job->rec->ref);
+					new_recordings = g_list_prepend(new_recordings, job->rec);
+					janus_mutex_unlock(&recordings_mutex);
+				}
+			}
+			if(job->entry != NULL) {
+				janus_mutex_lock(&recordings_cache_mutex);
+				json_object_set_new(recordings_cache, job->filename, job->entry);
+				recordings_cache_dirty = TRUE;
+				janus_mutex_unlock(&recordings_cache_mutex);
+			}
+			g_free(job->filename);
+			g_free(job);
+			temp = temp->next;
+		}
+		g_list_free(pending);
+	}
+	/* Prune index entries whose .nfo file is gone */
+	janus_mutex_lock(&recordings_cache_mutex);
+	GList *stale = NULL;
+	const char *cache_key = NULL;
+	json_t *cache_value = NULL;
+	json_object_foreach(recordings_cache, cache_key, cache_value) {
+		if(cache_value != NULL && !g_hash_table_contains(seen, cache_key))
+			stale = g_list_prepend(stale, (gpointer)cache_key);
+	}
+	while(stale != NULL) {
+		json_object_del(recordings_cache, (const char *)stale->data);
+		recordings_cache_dirty = TRUE;
+		stale = g_list_delete_link(stale, stale);
+	}
+	janus_mutex_unlock(&recordings_cache_mutex);
+	g_hash_table_destroy(seen);
 	/* Now let's check if any of the previously existing recordings was removed */
+	janus_mutex_lock(&recordings_mutex);
 	if(old_recordings != NULL) {
 		while(old_recordings != NULL) {
 			guint64 id = *((guint64 *)old_recordings->data);
@@ -2521,7 +2853,79 @@ void janus_recordplay_update_recordings_list(void) {
 		g_list_free(old_recordings);
 	}
 	janus_mutex_unlock(&recordings_mutex);
+	/* Persist the updated index */
+	janus_recordplay_cache_save();
+	/* Finally, build the frame indexes of the recordings we just imported:
+	 * we use a worker pool here too, as parsing the MJR files of long
+	 * recordings can take a while */
+	if(new_recordings != NULL) {
+		GThreadPool *pool = g_thread_pool_new(janus_recordplay_index_worker, NULL,
+			g_get_num_processors(), FALSE, NULL);
+		while(new_recordings != NULL) {
+			janus_recordplay_recording *new_rec = (janus_recordplay_recording *)new_recordings->data;
+			if(pool != NULL)
+				g_thread_pool_push(pool, new_rec, NULL);
+			else
+				janus_recordplay_index_worker(new_rec, NULL);
+			new_recordings = g_list_delete_link(new_recordings, new_recordings);
+		}
+		if(pool != NULL)
+			g_thread_pool_free(pool, FALSE, TRUE);
+	}
+	g_atomic_int_set(&updating_recordings, 0);
+}
+
+#ifdef __linux__
+/* Instead of periodically rescanning the recordings folder, we keep an
+ * inotify watch on it: changes to .nfo files schedule a (debounced)
+ * refresh, which the persistent index then makes cheap */
+static void *janus_recordplay_watcher_thread(void *data) {
+	JANUS_LOG(LOG_VERB, "Joining Record&Play watcher thread\n");
+	int fd = inotify_init1(IN_NONBLOCK);
+	if(fd < 0) {
+		JANUS_LOG(LOG_WARN, "Couldn't create inotify instance, recordings list updates will need explicit refreshes... %d (%s)\n",
+			errno, g_strerror(errno));
+		return NULL;
+	}
+	int wd = inotify_add_watch(fd, recordings_path,
+		IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM);
+	if(wd < 0) {
+		JANUS_LOG(LOG_WARN, "Couldn't watch %s, recordings list updates will need explicit refreshes... %d (%s)\n",
+			recordings_path, errno, g_strerror(errno));
+		close(fd);
+		return NULL;
+	}
+	char buffer[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	gint64 pending_since = 0;
+	while(!g_atomic_int_get(&stopping)) {
+		struct pollfd pfd = { .fd = fd, .events = POLLIN };
+		int res = poll(&pfd, 1, 200);
+		if(res > 0) {
+			ssize_t bytes = read(fd, buffer, sizeof(buffer));
+			ssize_t offset = 0;
+			while(bytes > 0 && offset < bytes) {
+				struct inotify_event *event = (struct inotify_event *)(buffer + offset);
+				if(event->len > 0) {
+					int len = strlen(event->name);
+					if(len >= 4 && !strcasecmp(event->name+len-4, ".nfo")) {
+						/* A recording changed, schedule a refresh */
+						pending_since = janus_get_monotonic_time();
+					}
+				}
+				offset += sizeof(struct inotify_event) + event->len;
+			}
+		}
+		if(pending_since > 0 && (janus_get_monotonic_time() - pending_since) > G_USEC_PER_SEC) {
+			/* Things have settled down, refresh the list now */
+			pending_since = 0;
+			janus_recordplay_update_recordings_list();
+		}
+	}
+	close(fd);
+	JANUS_LOG(LOG_VERB, "Leaving Record&Play watcher thread\n");
+	return NULL;
 }
+#endif
 
 janus_recordplay_frame_packet *janus_recordplay_get_frames(const char *dir, const char *filename) {
 	if(!dir || !filename)
@@ -2990,19 +3394,18 @@ static void *janus_recordplay_playout_thread(void *sessiondata) {
 			return NULL;
 		}
 	}
-	/* Timer */
+	/* Timer: we pace each stream against absolute deadlines computed from
+	 * when its first packet was sent, so that scheduling delays don't
+	 * accumulate as drift over the duration of the playout */
 	gboolean asent = FALSE, vsent = FALSE, dsent = FALSE;
-	struct timeval now, abefore, vbefore, dbefore;
-	time_t d_s, d_us;
-	gettimeofday(&now, NULL);
-	gettimeofday(&abefore, NULL);
-	gettimeofday(&vbefore, NULL);
-	gettimeofday(&dbefore, NULL);
+	gint64 now = janus_get_monotonic_time(),
+		astart = 0, vstart = 0, dstart = now,
+		adeadline = 0, vdeadline = 0, ddeadline = 0;
 
 	janus_recordplay_frame_packet *audio = session->aframes, *video = session->vframes, *data = session->dframes;
 	char *buffer = g_malloc0(1500);
 	int bytes = 0;
-	int64_t ts_diff = 0, passed = 0;
+	int64_t ts_diff = 0;
 
 	int audio_pt = session->recording->audio_pt;
 	int video_pt = session->recording->video_pt;
@@ -3015,8 +3418,20 @@ static void *janus_recordplay_playout_thread(void *sessiondata) {
 	while(!g_atomic_int_get(&session->destroyed) && session->active
 			&& !g_atomic_int_get(&rec->destroyed) && (audio || video)) {
 		if(!asent && !vsent && !dsent) {
-			/* We skipped the last round, so sleep a bit (5ms) */
-			g_usleep(5000);
+			/* We skipped the last round: sleep until the earliest pending
+			 * deadline, rather than polling at a fixed pace */
+			gint64 next = 0;
+			if(audio && (next == 0 || adeadline < next))
+				next = adeadline;
+			if(video && (next == 0 || vdeadline < next))
+				next = vdeadline;
+			if(data && (next == 0 || ddeadline < next))
+				next = ddeadline;
+			now = janus_get_monotonic_time();
+			if(next > now) {
+				/* Cap the sleep anyway, so that we notice right away if the session goes away */
+				g_usleep((next - now) > 100000 ? 100000 : (next - now));
+			}
 		}
 		asent = FALSE;
 		vsent = FALSE;
@@ -3054,37 +3469,19 @@ static void *janus_recordplay_playout_thread(void *sessiondata) {
 				janus_plugin_rtp prtp = { .mindex = -1, .video = FALSE, .buffer = (char *)buffer, .length = bytes };
 				janus_plugin_rtp_extensions_reset(&prtp.extensions);
 				gateway->relay_rtp(session->handle, &prtp);
-				gettimeofday(&now, NULL);
-				abefore.tv_sec = now.tv_sec;
-				abefore.tv_usec = now.tv_usec;
+				astart = janus_get_monotonic_time();
 				asent = TRUE;
 				audio = audio->next;
 			} else {
-				/* What's the timestamp skip from the previous packet? */
-				ts_diff = audio->ts - audio->prev->ts;
+				/* When is this packet due, relative to the first one we sent? */
+				ts_diff = audio->ts - session->aframes->ts;
 				ts_diff = (ts_diff*1000)/akhz;
+				adeadline = astart + ts_diff;
 				/* Check if it's time to send */
-				gettimeofday(&now, NULL);
-				d_s = now.tv_sec - abefore.tv_sec;
-				d_us = now.tv_usec - abefore.tv_usec;
-				if(d_us < 0) {
-					d_us += 1000000;
-					--d_s;
-				}
-				passed = d_s*1000000 + d_us;
-				if(passed < (ts_diff-5000)) {
+				now = janus_get_monotonic_time();
+				if(now < adeadline) {
 					asent = FALSE;
 				} else {
-					/* Update the reference time */
-					abefore.tv_usec += ts_diff%1000000;
-					if(abefore.tv_usec > 1000000) {
-						abefore.tv_sec++;
-						abefore.tv_usec -= 1000000;
-					}
-					if(ts_diff/1000000 > 0) {
-						abefore.tv_sec += ts_diff/1000000;
-						abefore.tv_usec -= ts_diff/1000000;
-					}
 					/* Send now */
 					fseek(afile, audio->offset, SEEK_SET);
 					bytes = fread(buffer, sizeof(char), audio->len, afile);
@@ -3139,35 +3536,17 @@ static void *janus_recordplay_playout_thread(void *sessiondata) {
 					video = video->next;
 				}
 				vsent = TRUE;
-				gettimeofday(&now, NULL);
-				vbefore.tv_sec = now.tv_sec;
-				vbefore.tv_usec = now.tv_usec;
+				vstart = janus_get_monotonic_time();
 			} else {
-				/* What's the timestamp skip from the previous packet? */
-				ts_diff = video->ts - video->prev->ts;
+				/* When is this packet due, relative to the first one we sent? */
+				ts_diff = video->ts - session->vframes->ts;
 				ts_diff = (ts_diff*1000)/vkhz;
+				vdeadline = vstart + ts_diff;
 				/* Check if it's time to send */
-				gettimeofday(&now, NULL);
-				d_s = now.tv_sec - vbefore.tv_sec;
-				d_us = now.tv_usec - vbefore.tv_usec;
-				if(d_us < 0) {
-					d_us += 1000000;
-					--d_s;
-				}
-				passed = d_s*1000000 + d_us;
-				if(passed < (ts_diff-5000)) {
+				now = janus_get_monotonic_time();
+				if(now < vdeadline) {
 					vsent = FALSE;
 				} else {
-					/* Update the reference time */
-					vbefore.tv_usec += ts_diff%1000000;
-					if(vbefore.tv_usec > 1000000) {
-						vbefore.tv_sec++;
-						vbefore.tv_usec -= 1000000;
-					}
-					if(ts_diff/1000000 > 0) {
-						vbefore.tv_sec += ts_diff/1000000;
-						vbefore.tv_usec -= ts_diff/1000000;
-					}
 					/* There may be multiple packets with the same timestamp, send them all */
 					uint64_t ts = video->ts;
 					while(video && video->ts == ts) {
@@ -3189,33 +3568,13 @@ static void *janus_recordplay_playout_thread(void *sessiondata) {
 			}
 		}
 		if(data) {
-			u_int64_t prev_ts = 0; /* All timestamps for data are indexed to 0, since when parsing ts = when - c_time */
-			if(data->prev)
-				prev_ts = data->prev->ts;
-			ts_diff = data->ts - prev_ts;
-
+			/* All timestamps for data are indexed to 0, since when parsing ts = when - c_time */
+			ddeadline = dstart + data->ts;
 			/* Check if it's time to send */
-			gettimeofday(&now, NULL);
-			d_s = now.tv_sec - dbefore.tv_sec;
-			d_us = now.tv_usec - dbefore.tv_usec;
-			if(d_us < 0) {
-				d_us += 1000000;
-				--d_s;
-			}
-			passed = d_s*1000000 + d_us;
-			if(passed < (ts_diff-5000)) {
+			now = janus_get_monotonic_time();
+			if(now < ddeadline) {
 				dsent = FALSE;
 			} else {
-				/* Update the reference time */
-				dbefore.tv_usec += ts_diff%1000000;
-				if(dbefore.tv_usec > 1000000) {
-					dbefore.tv_sec++;
-					dbefore.tv_usec -= 1000000;
-				}
-				if(ts_diff/1000000 > 0) {
-					dbefore.tv_sec += ts_diff/1000000;
-					dbefore.tv_usec -= ts_diff/1000000;
-				}
 				/* Read data packet */
 				fseek(dfile, data->offset, SEEK_SET);
 				bytes = fread(buffer, sizeof(char), data->len, dfile);
@@ -3238,28 +3597,10 @@ static void *janus_recordplay_playout_thread(void *sessiondata) {
 
 	g_free(buffer);
 
-	/* Get rid of the indexes */
-	janus_recordplay_frame_packet *tmp = NULL;
-	audio = session->aframes;
-	while(audio) {
-		tmp = audio->next;
-		g_free(audio);
-		audio = tmp;
-	}
+	/* Detach from the indexes (they're owned by the recording, which caches
+	 * them for the next viewers, so there's nothing to free here) */
 	session->aframes = NULL;
-	video = session->vframes;
-	while(video) {
-		tmp = video->next;
-		g_free(video);
-		video = tmp;
-	}
 	session->vframes = NULL;
-	data = session->dframes;
-	while(data) {
-		tmp = data->next;
-		g_free(data);
-		data = tmp;
-	}
 	session->dframes = NULL;
 
 	if(afile)
@@ -927,8 +927,68 @@ static char *sips_certs_dir = NULL;
 static int sip_timer_t1x64 = JANUS_DEFAULT_SIP_TIMER_T1X64;
 static uint16_t dtmf_keys[] = {'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', '*', '#', 'A', 'B', 'C', 'D'};
 
+/* Relay loops: rather than spawning a dedicated thread per call, media for
+ * all calls is relayed by a small set of event loops, each serving many
+ * calls at the same time (pretty much what the core does when static event
+ * loops are configured); a call is assigned to the least busy loop when its
+ * media starts, and its RTP/RTCP sockets are monitored there via a custom
+ * GSource. By default we spawn one loop per CPU core (capped), but the
+ * number can be changed via the 'relay_loops' property in the config */
+#define JANUS_SIP_MAX_RELAY_LOOPS	16
+typedef struct janus_sip_relay_loop {
+	int id;						/* Loop index */
+	GMainContext *mainctx;		/* Loop context */
+	GMainLoop *mainloop;		/* The loop itself */
+	GThread *thread;			/* Thread running the loop */
+	volatile gint calls;		/* Number of calls currently assigned to this loop */
+} janus_sip_relay_loop;
+static janus_sip_relay_loop *relay_loops = NULL;
+static int num_relay_loops = 0;
+static void *janus_sip_relay_loop_thread(void *data) {
+	janus_sip_relay_loop *loop = (janus_sip_relay_loop *)data;
+	JANUS_LOG(LOG_VERB, "[loop#%d] Joining SIP relay loop thread\n", loop->id);
+	g_main_loop_run(loop->mainloop);
+	JANUS_LOG(LOG_VERB, "[loop#%d] Leaving SIP relay loop thread\n", loop->id);
+	return NULL;
+}
+
 static gboolean query_contact_header = FALSE;
 
+/* Sofia event loops: by default each account gets its own Sofia stack,
+ * running on a dedicated thread; when 'event_loops' is configured, the
+ * accounts are sharded on a fixed set of shared Sofia event loops instead
+ * (hashing on the account username), so that thousands of registrations
+ * don't mean thousands of threads, and signalling throughput scales with
+ * the configured number of loops rather than with luck */
+typedef struct janus_sip_sofia_loop {
+	int id;					/* Loop index */
+	su_root_t *root;		/* The shared Sofia event loop */
+	GThread *thread;		/* Thread running the loop */
+	volatile gint started;	/* Whether the loop is up and running */
+} janus_sip_sofia_loop;
+static janus_sip_sofia_loop *sofia_loops = NULL;
+static int sofia_event_loops = 0;
+/* Payload of the messages we post to the shared event loops: stacks can
+ * only be created and destroyed on the thread running their loop */
+typedef struct janus_sip_sofia_loop_msg {
+	janus_sip_sofia_loop *loop;
+	struct janus_sip_session *session;
+} janus_sip_sofia_loop_msg;
+static void janus_sip_sofia_setup_cb(su_root_magic_t *magic, su_msg_r msg, su_msg_arg_t *arg);
+static void janus_sip_sofia_teardown_cb(su_root_magic_t *magic, su_msg_r msg, su_msg_arg_t *arg);
+static void janus_sip_sofia_loop_break_cb(su_root_magic_t *magic, su_msg_r msg, su_msg_arg_t *arg);
+static gpointer janus_sip_sofia_loop_thread(gpointer user_data) {
+	janus_sip_sofia_loop *loop = (janus_sip_sofia_loop *)user_data;
+	JANUS_LOG(LOG_VERB, "[loop#%d] Joining Sofia event loop thread\n", loop->id);
+	loop->root = su_root_create(NULL);
+	g_atomic_int_set(&loop->started, 1);
+	su_root_run(loop->root);
+	su_root_destroy(loop->root);
+	loop->root = NULL;
+	JANUS_LOG(LOG_VERB, "[loop#%d] Leaving Sofia event loop thread\n", loop->id);
+	return NULL;
+}
+
 static GThread *handler_thread;
 static void *janus_sip_handler(void *data);
 static void janus_sip_hangup_media_internal(janus_plugin_session *handle);
@@ -1026,6 +1086,7 @@ struct ssip_s {
 	char *contact_header;	/* Only needed for Sofia SIP >= 1.13 */
 	GHashTable *subscriptions;
 	janus_mutex smutex;
+	gboolean shared_root;	/* Whether s_root is a shared event loop (so not ours to break or destroy) */
 	struct janus_sip_session *session;
 };
 
@@ -1103,7 +1164,9 @@ typedef struct janus_sip_media {
 	gboolean video_pli_supported;
 	janus_sdp_mdirection hold_video_dir, pre_hold_video_dir;
 	janus_rtp_switching_context acontext, vcontext;
-	int pipefd[2];
+	janus_sip_relay_loop *relay_loop;
+	GSource *source;
+	int pollerrs;
 	gboolean updated;
 	int video_orientation_extension_id;
 	int audio_level_extension_id;
@@ -1131,7 +1194,6 @@ typedef struct janus_sip_session {
 	janus_recorder *vrc;		/* The Janus recorder instance for this user's video, if enabled */
 	janus_recorder *vrc_peer;	/* The Janus recorder instance for the peer's video, if enabled */
 	janus_mutex rec_mutex;		/* Mutex to protect the recorders from race conditions */
-	GThread *relayer_thread;
 	volatile gint establishing, established;
 	volatile gint hangingup;
 	volatile gint destroyed;
@@ -1576,6 +1638,7 @@ static void janus_sip_media_reset(janus_sip_session *session) {
 	session->media.earlymedia = FALSE;
 	session->media.update = FALSE;
 	session->media.updated = FALSE;
+	session->media.pollerrs = 0;
 	session->media.autoaccept_reinvites = TRUE;
 	session->media.ready = FALSE;
 	session->media.require_srtp = FALSE;
@@ -1614,7 +1677,8 @@ void janus_sip_sdp_process(janus_sip_session *session, janus_sdp *sdp, gboolean
 char *janus_sip_sdp_manipulate(janus_sip_session *session, janus_sdp *sdp, gboolean answer);
 /* Media */
 static int janus_sip_allocate_local_ports(janus_sip_session *session, gboolean update);
-static void *janus_sip_relay_thread(void *data);
+static int janus_sip_media_attach(janus_sip_session *session);
+static void janus_sip_media_update(janus_sip_session *session);
 static void janus_sip_media_cleanup(janus_sip_session *session);
 static void janus_sip_check_rfc2833(janus_sip_session *session, char *buffer, int len);
 
@@ -2054,6 +2118,16 @@ int janus_sip_init(janus_callbacks *callback, const char *config_path) {
 			JANUS_LOG(LOG_VERB, "SIP keep-alive interval set to %d seconds\n", keepalive_interval);
 		}
 
+		item = janus_config_get(config, config_general, janus_config_type_item, "event_loops");
+		if(item && item->value)
+			sofia_event_loops = atoi(item->value);
+		if(sofia_event_loops < 0) {
+			JANUS_LOG(LOG_ERR, "Invalid number of Sofia event loops: %d (falling back to one stack per account)\n", sofia_event_loops);
+			sofia_event_loops = 0;
+		} else if(sofia_event_loops > 0) {
+			JANUS_LOG(LOG_VERB, "Sharding SIP accounts on %d Sofia event loops\n", sofia_event_loops);
+		}
+
 		item = janus_config_get(config, config_general, janus_config_type_item, "sip_timer_t1x64");
 		if(item && item->value)
 			sip_timer_t1x64 = atoi(item->value);
@@ -2137,6 +2211,18 @@ int janus_sip_init(janus_callbacks *callback, const char *config_path) {
 		}
 
 		/* Check if Sofia should find certificates in a custom folder  */
+		item = janus_config_get(config, config_general, janus_config_type_item, "relay_loops");
+		if(item && item->value) {
+			num_relay_loops = atoi(item->value);
+			if(num_relay_loops < 1) {
+				JANUS_LOG(LOG_WARN, "Invalid number of relay loops (%s), falling back to one per CPU core\n", item->value);
+				num_relay_loops = 0;
+			} else if(num_relay_loops > JANUS_SIP_MAX_RELAY_LOOPS) {
+				JANUS_LOG(LOG_WARN, "Capping number of relay loops to %d\n", JANUS_SIP_MAX_RELAY_LOOPS);
+				num_relay_loops = JANUS_SIP_MAX_RELAY_LOOPS;
+			}
+		}
+
 		item = janus_config_get(config, config_general, janus_config_type_item, "sips_certs_dir");
 		if(item && item->value) {
 			sips_certs_dir = g_strdup(item->value);
@@ -2190,6 +2276,43 @@ int janus_sip_init(janus_callbacks *callback, const char *config_path) {
 			JANUS_LOG(LOG_WARN, "sofia-sip logs redirection unavailable on this version of the library\n");
 		}
 	}
+	if(sofia_event_loops > 0) {
+		/* Create the shared event loops the accounts will be sharded onto */
+		sofia_loops = g_malloc0(sofia_event_loops * sizeof(janus_sip_sofia_loop));
+		int i = 0;
+		for(i = 0; i < sofia_event_loops; i++) {
+			janus_sip_sofia_loop *loop = &sofia_loops[i];
+			loop->id = i;
+			char tname[16];
+			g_snprintf(tname, sizeof(tname), "sip loop %d", i);
+			GError *error = NULL;
+			loop->thread = g_thread_try_new(tname, janus_sip_sofia_loop_thread, loop, &error);
+			if(error != NULL) {
+				JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch a Sofia event loop thread...\n",
+					error->code, error->message ? error->message : "??");
+				g_error_free(error);
+				/* Stop the loops we had started already */
+				int j = 0;
+				for(j = 0; j < i; j++) {
+					su_msg_r quit = SU_MSG_R_INIT;
+					if(su_msg_create(quit, su_root_task(sofia_loops[j].root), su_task_null,
+							janus_sip_sofia_loop_break_cb, sizeof(janus_sip_sofia_loop_msg)) == 0) {
+						janus_sip_sofia_loop_msg *data = (janus_sip_sofia_loop_msg *)su_msg_data(quit);
+						data->loop = &sofia_loops[j];
+						su_msg_send(quit);
+					}
+					g_thread_join(sofia_loops[j].thread);
+				}
+				g_free(sofia_loops);
+				sofia_loops = NULL;
+				su_deinit();
+				return -1;
+			}
+			/* Wait for the loop to be up, we'll need its task right away */
+			while(!g_atomic_int_get(&loop->started))
+				g_usleep(5000);
+		}
+	}
 
 	sessions = g_hash_table_new_full(NULL, NULL, NULL, (GDestroyNotify)janus_sip_session_destroy);
 	identities = g_hash_table_new(g_str_hash, g_str_equal);
@@ -2226,6 +2349,34 @@ int janus_sip_init(janus_callbacks *callback, const char *config_path) {
 		ipv6_disabled = TRUE;
 	}
 
+	/* Spawn the loops that will relay media for all calls: since each of
+	 * them serves many calls at the same time, we don't need a dedicated
+	 * thread per call, which wouldn't scale with many concurrent sessions */
+	if(num_relay_loops == 0) {
+		num_relay_loops = g_get_num_processors();
+		if(num_relay_loops > JANUS_SIP_MAX_RELAY_LOOPS)
+			num_relay_loops = JANUS_SIP_MAX_RELAY_LOOPS;
+	}
+	relay_loops = g_malloc0(num_relay_loops * sizeof(janus_sip_relay_loop));
+	int l = 0;
+	for(l=0; l<num_relay_loops; l++) {
+		janus_sip_relay_loop *loop = &relay_loops[l];
+		loop->id = l;
+		loop->mainctx = g_main_context_new();
+		loop->mainloop = g_main_loop_new(loop->mainctx, FALSE);
+		GError *lerror = NULL;
+		char tname[16];
+		g_snprintf(tname, sizeof(tname), "siprelay %d", l);
+		loop->thread = g_thread_try_new(tname, janus_sip_relay_loop_thread, loop, &lerror);
+		if(lerror != NULL) {
+			JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch a relay loop thread...\n",
+				lerror->code, lerror->message ? lerror->message : "??");
+			g_error_free(lerror);
+			return -1;
+		}
+	}
+	JANUS_LOG(LOG_INFO, "Spawned %d event loops to relay media for SIP calls\n", num_relay_loops);
+
 	g_atomic_int_set(&initialized, 1);
 
 	/* Launch the thread that will handle incoming messages */
@@ -2252,6 +2403,30 @@ void janus_sip_destroy(void) {
 		g_thread_join(handler_thread);
 		handler_thread = NULL;
 	}
+	/* Get rid of the relay loops: unreffing the contexts also gets rid of
+	 * the media sources of calls that were still attached to the loops */
+	int l = 0;
+	for(l=0; l<num_relay_loops; l++) {
+		janus_sip_relay_loop *loop = &relay_loops[l];
+		if(loop->mainloop != NULL && g_main_loop_is_running(loop->mainloop)) {
+			g_main_loop_quit(loop->mainloop);
+			g_main_context_wakeup(loop->mainctx);
+		}
+		if(loop->thread != NULL) {
+			g_thread_join(loop->thread);
+			loop->thread = NULL;
+		}
+		if(loop->mainloop != NULL) {
+			g_main_loop_unref(loop->mainloop);
+			loop->mainloop = NULL;
+		}
+		if(loop->mainctx != NULL) {
+			g_main_context_unref(loop->mainctx);
+			loop->mainctx = NULL;
+		}
+	}
+	g_free(relay_loops);
+	relay_loops = NULL;
 	/* FIXME We should destroy the sessions cleanly */
 	janus_mutex_lock(&sessions_mutex);
 	g_hash_table_destroy(sessions);
@@ -2272,6 +2447,23 @@ void janus_sip_destroy(void) {
 	g_atomic_int_set(&initialized, 0);
 	g_atomic_int_set(&stopping, 0);
 
+	/* Stop the shared event loops, if any */
+	if(sofia_loops != NULL) {
+		int i = 0;
+		for(i = 0; i < sofia_event_loops; i++) {
+			janus_sip_sofia_loop *loop = &sofia_loops[i];
+			su_msg_r quit = SU_MSG_R_INIT;
+			if(su_msg_create(quit, su_root_task(loop->root), su_task_null,
+					janus_sip_sofia_loop_break_cb, sizeof(janus_sip_sofia_loop_msg)) == 0) {
+				janus_sip_sofia_loop_msg *data = (janus_sip_sofia_loop_msg *)su_msg_data(quit);
+				data->loop = loop;
+				su_msg_send(quit);
+			}
+			g_thread_join(loop->thread);
+		}
+		g_free(sofia_loops);
+		sofia_loops = NULL;
+	}
 	/* Deinitialize sofia */
 	su_deinit();
 
@@ -2406,8 +2598,9 @@ void janus_sip_create_session(janus_plugin_session *handle, int *error) {
 	/* Initialize the RTP context */
 	janus_rtp_switching_context_reset(&session->media.acontext);
 	janus_rtp_switching_context_reset(&session->media.vcontext);
-	session->media.pipefd[0] = -1;
-	session->media.pipefd[1] = -1;
+	session->media.relay_loop = NULL;
+	session->media.source = NULL;
+	session->media.pollerrs = 0;
 	session->media.updated = FALSE;
 	session->media.audio_remote_policy.ssrc.type = ssrc_any_inbound;
 	session->media.audio_local_policy.ssrc.type = ssrc_any_inbound;
@@ -2870,8 +3063,8 @@ static void janus_sip_hangup_media_internal(janus_plugin_session *handle) {
 	if(!g_atomic_int_compare_and_exchange(&session->hangingup, 0, 1))
 		return;
 	session->media.simulcast_ssrc = 0;
-	/* Do cleanup if media thread has not been created */
-	if(!session->media.ready && !session->relayer_thread) {
+	/* Do cleanup if the call was never attached to a relay loop */
+	if(!session->media.ready && session->media.source == NULL) {
 		janus_mutex_lock(&session->mutex);
 		janus_sip_media_cleanup(session);
 		janus_mutex_unlock(&session->mutex);
@@ -3358,21 +3551,45 @@ static void *janus_sip_handler(void *data) {
 
 			session->account.registration_status = janus_sip_registration_status_registering;
 			if(!refresh && session->stack == NULL) {
-				/* Start the thread first */
-				GError *error = NULL;
-				char tname[16];
-				g_snprintf(tname, sizeof(tname), "sip %s", session->account.username);
-				janus_refcount_increase(&session->ref);
-				g_thread_try_new(tname, janus_sip_sofia_thread, session, &error);
-				if(error != NULL) {
-					janus_refcount_decrease(&session->ref);
-					JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the SIP Sofia thread...\n",
-						error->code, error->message ? error->message : "??");
-					error_code = JANUS_SIP_ERROR_UNKNOWN_ERROR;
-					g_snprintf(error_cause, 512, "Got error %d (%s) trying to launch the SIP Sofia thread",
-						error->code, error->message ? error->message : "??");
-					g_error_free(error);
-					goto error;
+				if(sofia_event_loops > 0) {
+					/* Shard this account on one of the shared event loops: the
+					 * stack has to be created on the loop thread, so we post a
+					 * message there and wait for the nua to appear */
+					janus_sip_sofia_loop *loop = &sofia_loops[g_str_hash(session->account.username) % sofia_event_loops];
+					janus_refcount_increase(&session->ref);
+					gboolean posted = FALSE;
+					su_msg_r setup = SU_MSG_R_INIT;
+					if(su_msg_create(setup, su_root_task(loop->root), su_task_null,
+							janus_sip_sofia_setup_cb, sizeof(janus_sip_sofia_loop_msg)) == 0) {
+						janus_sip_sofia_loop_msg *data = (janus_sip_sofia_loop_msg *)su_msg_data(setup);
+						data->loop = loop;
+						data->session = session;
+						posted = (su_msg_send(setup) == 0);
+					}
+					if(!posted) {
+						janus_refcount_decrease(&session->ref);
+						JANUS_LOG(LOG_ERR, "Error delivering the SIP account to event loop #%d...\n", loop->id);
+						error_code = JANUS_SIP_ERROR_UNKNOWN_ERROR;
+						g_snprintf(error_cause, 512, "Error delivering the SIP account to event loop #%d", loop->id);
+						goto error;
+					}
+				} else {
+					/* Start the thread first */
+					GError *error = NULL;
+					char tname[16];
+					g_snprintf(tname, sizeof(tname), "sip %s", session->account.username);
+					janus_refcount_increase(&session->ref);
+					g_thread_try_new(tname, janus_sip_sofia_thread, session, &error);
+					if(error != NULL) {
+						janus_refcount_decrease(&session->ref);
+						JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the SIP Sofia thread...\n",
+							error->code, error->message ? error->message : "??");
+						error_code = JANUS_SIP_ERROR_UNKNOWN_ERROR;
+						g_snprintf(error_cause, 512, "Got error %d (%s) trying to launch the SIP Sofia thread",
+							error->code, error->message ? error->message : "??");
+						g_error_free(error);
+						goto error;
+					}
 				}
 				long int timeout = 0;
 				while(session->stack == NULL || session->stack->s_nua == NULL) {
@@ -4214,18 +4431,9 @@ static void *janus_sip_handler(void *data) {
 			if(answer) {
 				/* Start the media */
 				session->media.ready = TRUE;	/* FIXME Maybe we need a better way to signal this */
-				GError *error = NULL;
-				char tname[16];
-				g_snprintf(tname, sizeof(tname), "siprtp %s", session->account.username);
-				janus_refcount_increase(&session->ref);
-				session->relayer_thread = g_thread_try_new(tname, janus_sip_relay_thread, session, &error);
-				if(error != NULL) {
-					session->relayer_thread = NULL;
+				if(janus_sip_media_attach(session) < 0) {
 					session->media.ready = FALSE;
-					janus_refcount_decrease(&session->ref);
-					JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the RTP/RTCP thread...\n",
-						error->code, error->message ? error->message : "??");
-					g_error_free(error);
+					JANUS_LOG(LOG_ERR, "Error attaching the call to a relay loop...\n");
 				}
 			}
 		} else if(!strcasecmp(request_text, "update")) {
@@ -5451,7 +5659,7 @@ void janus_sip_sofia_callback(nua_event_t event, int status, char const *phrase,
 			}
 			gboolean reinvite = FALSE, busy = FALSE;
 			if(session->stack->s_nh_i == NULL) {
-				if(g_atomic_int_get(&session->establishing) || g_atomic_int_get(&session->established) || session->relayer_thread != NULL) {
+				if(g_atomic_int_get(&session->establishing) || g_atomic_int_get(&session->established) || session->media.source != NULL) {
 					/* Still busy establishing another call (or maybe still cleaning up the previous call) */
 					busy = TRUE;
 				}
@@ -5475,7 +5683,7 @@ void janus_sip_sofia_callback(nua_event_t event, int status, char const *phrase,
 				while(temp != NULL) {
 					helper = (janus_sip_session *)temp->data;
 					if(helper->stack->s_nh_i == NULL && !g_atomic_int_get(&helper->establishing) &&
-							!g_atomic_int_get(&helper->established) && helper->relayer_thread == NULL) {
+							!g_atomic_int_get(&helper->established) && helper->media.source == NULL) {
 						/* Found! */
 						break;
 					}
@@ -5927,8 +6135,21 @@ void janus_sip_sofia_callback(nua_event_t event, int status, char const *phrase,
 					session->active_calls = g_list_remove(session->active_calls, s);
 				}
 				janus_mutex_unlock(&session->mutex);
-				/* End the event loop: su_root_run() will return */
-				su_root_break(ssip->s_root);
+				if(!ssip->shared_root) {
+					/* End the event loop: su_root_run() will return */
+					su_root_break(ssip->s_root);
+				} else {
+					/* The loop is shared with other accounts, so we can't break it:
+					 * we post a message to tear this stack down instead, since the
+					 * nua can't be destroyed from within its own callback */
+					su_msg_r td = SU_MSG_R_INIT;
+					if(su_msg_create(td, su_root_task(ssip->s_root), su_task_null,
+							janus_sip_sofia_teardown_cb, sizeof(janus_sip_sofia_loop_msg)) == 0) {
+						janus_sip_sofia_loop_msg *data = (janus_sip_sofia_loop_msg *)su_msg_data(td);
+						data->session = session;
+						su_msg_send(td);
+					}
+				}
 			}
 			break;
 		case nua_r_terminate:
@@ -6248,18 +6469,9 @@ void janus_sip_sofia_callback(nua_event_t event, int status, char const *phrase,
 				break;
 			}
 			if(!session->media.earlymedia && !session->media.update) {
-				GError *error = NULL;
-				char tname[16];
-				g_snprintf(tname, sizeof(tname), "siprtp %s", session->account.username);
-				janus_refcount_increase(&session->ref);
-				session->relayer_thread = g_thread_try_new(tname, janus_sip_relay_thread, session, &error);
-				if(error != NULL) {
-					session->relayer_thread = NULL;
+				if(janus_sip_media_attach(session) < 0) {
 					session->media.ready = FALSE;
-					janus_refcount_decrease(&session->ref);
-					JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the RTP/RTCP thread...\n",
-						error->code, error->message ? error->message : "??");
-					g_error_free(error);
+					JANUS_LOG(LOG_ERR, "Error attaching the call to a relay loop...\n");
 				}
 			}
 			/* Check if there's an isfocus feature parameter in the Contact header */
@@ -6795,15 +7007,11 @@ void janus_sip_sdp_process(janus_sip_session *session, janus_sdp *sdp, gboolean
 	}
 
 	if(update && changed && *changed) {
-		/* Something changed: mark this on the session, so that the thread can update the sockets */
+		/* Something changed: mark this on the session, so that the relay
+		 * loop can update the sockets, and wake it up to do it right away */
 		session->media.updated = TRUE;
-		if(session->media.pipefd[1] > 0) {
-			int code = 1;
-			ssize_t res = 0;
-			do {
-				res = write(session->media.pipefd[1], &code, sizeof(int));
-			} while(res == -1 && errno == EINTR);
-		}
+		if(session->media.relay_loop != NULL)
+			g_main_context_wakeup(session->media.relay_loop->mainctx);
 	}
 }
 
@@ -6945,14 +7153,6 @@ static int janus_sip_allocate_local_ports(janus_sip_session *session, gboolean u
 		session->media.local_video_rtp_port = 0;
 		session->media.local_video_rtcp_port = 0;
 		session->media.video_ssrc = 0;
-		if(session->media.pipefd[0] > 0) {
-			close(session->media.pipefd[0]);
-			session->media.pipefd[0] = -1;
-		}
-		if(session->media.pipefd[1] > 0) {
-			close(session->media.pipefd[1]);
-			session->media.pipefd[1] = -1;
-		}
 	}
 	gboolean use_ipv6_address_family = !ipv6_disabled &&
 		(janus_network_address_is_null(&janus_network_local_media_ip) || janus_network_local_media_ip.family == AF_INET6);
@@ -7141,10 +7341,6 @@ static int janus_sip_allocate_local_ports(janus_sip_session *session, gboolean u
 			session->media.local_video_rtcp_port = rtcp_port;
 		}
 	}
-	if(!update) {
-		/* We need this to quickly interrupt the poll when it's time to update a session or wrap up */
-		pipe(session->media.pipefd);
-	}
 	return 0;
 }
 
@@ -7242,14 +7438,6 @@ static void janus_sip_media_cleanup(janus_sip_session *session) {
 	session->media.video_ssrc = 0;
 	session->media.video_ssrc_peer = 0;
 	session->media.simulcast_ssrc = 0;
-	if(session->media.pipefd[0] > 0) {
-		close(session->media.pipefd[0]);
-		session->media.pipefd[0] = -1;
-	}
-	if(session->media.pipefd[1] > 0) {
-		close(session->media.pipefd[1]);
-		session->media.pipefd[1] = -1;
-	}
 	/* Clean up SRTP stuff, if needed */
 	janus_sip_srtp_cleanup(session);
 
@@ -7257,408 +7445,415 @@ static void janus_sip_media_cleanup(janus_sip_session *session) {
 	janus_sip_media_reset(session);
 }
 
-/* Thread to relay RTP/RTCP frames coming from the SIP peer */
-static void *janus_sip_relay_thread(void *data) {
-	janus_sip_session *session = (janus_sip_session *)data;
-	if(!session) {
-		g_thread_unref(g_thread_self());
-		return NULL;
-	}
-	if(!session->account.username || !session->callee) {
-		janus_refcount_decrease(&session->ref);
-		g_thread_unref(g_thread_self());
-		return NULL;
+/* Helper to (re)connect the RTP/RTCP sockets to the peer, when the remote
+ * address has been learnt or has changed (e.g., because of a re-INVITE) */
+static void janus_sip_media_update(janus_sip_session *session) {
+	if(!session->media.updated)
+		return;
+	session->media.updated = FALSE;
+	/* Resolve the addresses, if needed */
+	gboolean have_audio_server_ip = FALSE;
+	gboolean have_video_server_ip = FALSE;
+	struct sockaddr_storage audio_server_addr = { 0 }, video_server_addr = { 0 };
+	if(session->media.remote_audio_ip && strcmp(session->media.remote_audio_ip, "0.0.0.0")) {
+		if(janus_network_resolve_address(session->media.remote_audio_ip, &audio_server_addr) < 0) {
+			JANUS_LOG(LOG_ERR, "[SIP-%s] Couldn't resolve audio address '%s'\n",
+				session->account.username, session->media.remote_audio_ip);
+		} else {
+			/* Address resolved */
+			have_audio_server_ip = TRUE;
+		}
 	}
-	JANUS_LOG(LOG_VERB, "Starting relay thread (%s <--> %s)\n", session->account.username, session->callee);
-
-	if(!session->callee) {
-		JANUS_LOG(LOG_WARN, "[SIP-%s] Leaving thread, no callee...\n", session->account.username);
-		janus_refcount_decrease(&session->ref);
-		g_thread_unref(g_thread_self());
-		return NULL;
+	if(session->media.remote_video_ip && strcmp(session->media.remote_video_ip, "0.0.0.0")) {
+		if(janus_network_resolve_address(session->media.remote_video_ip, &video_server_addr) < 0) {
+			JANUS_LOG(LOG_ERR, "[SIP-%s] Couldn't resolve video address '%s'\n",
+				session->account.username, session->media.remote_video_ip);
+		} else {
+			/* Address resolved */
+			have_video_server_ip = TRUE;
+		}
 	}
-	/* File descriptors */
-	socklen_t addrlen;
-	struct sockaddr_in remote;
-	int resfd = 0, bytes = 0, pollerrs = 0;
-	struct pollfd fds[5];
-	int pipe_fd = session->media.pipefd[0];
-	char buffer[1500];
-	memset(buffer, 0, 1500);
-	if(pipe_fd == -1) {
-		/* If the pipe file descriptor doesn't exist, it means we're done already,
-		 * and/or we may never be notified about sessions being closed, so give up */
-		JANUS_LOG(LOG_WARN, "[SIP-%s] Leaving thread, no pipe file descriptor...\n", session->account.username);
-		janus_refcount_decrease(&session->ref);
-		g_thread_unref(g_thread_self());
-		return NULL;
+	if(have_audio_server_ip || have_video_server_ip) {
+		janus_sip_connect_sockets(session, have_audio_server_ip ? &audio_server_addr : NULL,
+			have_video_server_ip ? &video_server_addr : NULL);
+	} else if(session->media.remote_audio_ip == NULL && session->media.remote_video_ip == NULL) {
+		JANUS_LOG(LOG_ERR, "[SIP-%p] Couldn't update session details: both audio and video remote IP addresses are NULL\n",
+			session->account.username);
+	} else {
+		if(session->media.remote_audio_ip)
+			JANUS_LOG(LOG_ERR, "[SIP-%p] Couldn't update session details: audio remote IP address (%s) is invalid\n",
+				session->account.username, session->media.remote_audio_ip);
+		if(session->media.remote_video_ip)
+			JANUS_LOG(LOG_ERR, "[SIP-%p] Couldn't update session details: video remote IP address (%s) is invalid\n",
+				session->account.username, session->media.remote_video_ip);
+	}
+	/* In case we're on hold (remote address is 0.0.0.0) set the send properties to FALSE */
+	if(have_audio_server_ip && !strcmp(session->media.remote_audio_ip, "0.0.0.0")) {
+		session->media.audio_send = FALSE;
+		session->media.audio_recv = FALSE;
+	}
+	if(have_video_server_ip && !strcmp(session->media.remote_video_ip, "0.0.0.0")) {
+		session->media.video_send = FALSE;
+		session->media.video_recv = FALSE;
 	}
-	/* Loop */
-	int num = 0;
-	gboolean goon = TRUE;
-
-	session->media.updated = TRUE; /* Connect UDP sockets upon loop entry */
-	gboolean have_audio_server_ip = TRUE;
-	gboolean have_video_server_ip = TRUE;
-
-	while(goon && session != NULL && !g_atomic_int_get(&session->destroyed) &&
-			session->status > janus_sip_call_status_idle &&
-			session->status < janus_sip_call_status_closing) {	/* FIXME We need a per-call watchdog as well */
-
-		if(session->media.updated) {
-			/* Apparently there was a session update, or the loop has just been entered */
-			session->media.updated = FALSE;
-
-			/* Resolve the addresses, if needed */
-			have_audio_server_ip = FALSE;
-			have_video_server_ip = FALSE;
-			struct sockaddr_storage audio_server_addr = { 0 }, video_server_addr = { 0 };
-			if(session->media.remote_audio_ip && strcmp(session->media.remote_audio_ip, "0.0.0.0")) {
-				if(janus_network_resolve_address(session->media.remote_audio_ip, &audio_server_addr) < 0) {
-					JANUS_LOG(LOG_ERR, "[SIP-%s] Couldn't resolve audio address '%s'\n",
-						session->account.username, session->media.remote_audio_ip);
-				} else {
-					/* Address resolved */
-					have_audio_server_ip = TRUE;
-				}
-			}
-			if(session->media.remote_video_ip && strcmp(session->media.remote_video_ip, "0.0.0.0")) {
-				if(janus_network_resolve_address(session->media.remote_video_ip, &video_server_addr) < 0) {
-					JANUS_LOG(LOG_ERR, "[SIP-%s] Couldn't resolve video address '%s'\n",
-						session->account.username, session->media.remote_video_ip);
-				} else {
-					/* Address resolved */
-					have_video_server_ip = TRUE;
-				}
-			}
+}
 
-			if(have_audio_server_ip || have_video_server_ip) {
-				janus_sip_connect_sockets(session, have_audio_server_ip ? &audio_server_addr : NULL,
-					have_video_server_ip ? &video_server_addr : NULL);
-			} else if(session->media.remote_audio_ip == NULL && session->media.remote_video_ip == NULL) {
-				JANUS_LOG(LOG_ERR, "[SIP-%p] Couldn't update session details: both audio and video remote IP addresses are NULL\n",
-					session->account.username);
+/* Custom GSource we use to have the relay loops monitor the RTP/RTCP
+ * sockets of a call: each call has one of these attached to the loop it
+ * was assigned to, which is how we relay media for many calls with a few
+ * threads, rather than with a dedicated thread per call as we used to */
+typedef struct janus_sip_media_fd {
+	gpointer tag;	/* Tag returned by g_source_add_unix_fd */
+	int fd;			/* File descriptor we're monitoring */
+} janus_sip_media_fd;
+typedef struct janus_sip_media_source {
+	GSource parent;
+	janus_sip_session *session;
+	janus_sip_relay_loop *loop;
+	janus_sip_media_fd audio_rtp, audio_rtcp, video_rtp, video_rtcp;
+} janus_sip_media_source;
+/* Helper to sync one of the monitored sockets with the session: sockets may
+ * be created, closed or replaced by re-INVITEs, so we check at every update */
+static void janus_sip_media_source_sync_fd(janus_sip_media_source *ms, janus_sip_media_fd *mfd, int fd) {
+	if(mfd->tag != NULL && mfd->fd != fd) {
+		g_source_remove_unix_fd((GSource *)ms, mfd->tag);
+		mfd->tag = NULL;
+		mfd->fd = -1;
+	}
+	if(mfd->tag == NULL && fd != -1) {
+		mfd->tag = g_source_add_unix_fd((GSource *)ms, fd, G_IO_IN | G_IO_ERR);
+		mfd->fd = fd;
+	}
+}
+static void janus_sip_media_source_sync(janus_sip_media_source *ms) {
+	janus_sip_session *session = ms->session;
+	janus_sip_media_source_sync_fd(ms, &ms->audio_rtp, session->media.audio_rtp_fd);
+	janus_sip_media_source_sync_fd(ms, &ms->audio_rtcp, session->media.audio_rtcp_fd);
+	janus_sip_media_source_sync_fd(ms, &ms->video_rtp, session->media.video_rtp_fd);
+	janus_sip_media_source_sync_fd(ms, &ms->video_rtcp, session->media.video_rtcp_fd);
+}
+/* Helper to check one of the monitored sockets after a poll: returns 0 when
+ * done (or nothing to do), a negative integer when the call should be hung
+ * up because of too many errors on its sockets */
+static int janus_sip_media_source_pollfd(janus_sip_media_source *ms, janus_sip_media_fd *mfd, gboolean video, gboolean rtcp) {
+	if(mfd->tag == NULL || mfd->fd == -1)
+		return 0;
+	janus_sip_session *session = ms->session;
+	GIOCondition revents = g_source_query_unix_fd((GSource *)ms, mfd->tag);
+	if(revents & (G_IO_ERR | G_IO_HUP)) {
+		/* If we just updated the session, let's wait until things have calmed down */
+		if(session->media.updated)
+			return 0;
+		/* Check the socket error */
+		int error = 0;
+		socklen_t errlen = sizeof(error);
+		getsockopt(mfd->fd, SOL_SOCKET, SO_ERROR, (void *)&error, &errlen);
+		if(error == 0) {
+			/* Maybe not a breaking error after all? */
+			return 0;
+		} else if(error == 111 && rtcp) {
+			/* ICMP error? If it's related to RTCP, let's just close the RTCP socket and move on */
+			JANUS_LOG(LOG_WARN, "[SIP-%s] Got a '%s' on the %s RTCP socket, closing it\n",
+				session->account.username, g_strerror(error), video ? "video" : "audio");
+			janus_mutex_lock(&session->mutex);
+			g_source_remove_unix_fd((GSource *)ms, mfd->tag);
+			mfd->tag = NULL;
+			mfd->fd = -1;
+			if(video) {
+				close(session->media.video_rtcp_fd);
+				session->media.video_rtcp_fd = -1;
 			} else {
-				if(session->media.remote_audio_ip)
-					JANUS_LOG(LOG_ERR, "[SIP-%p] Couldn't update session details: audio remote IP address (%s) is invalid\n",
-						session->account.username, session->media.remote_audio_ip);
-				if(session->media.remote_video_ip)
-					JANUS_LOG(LOG_ERR, "[SIP-%p] Couldn't update session details: video remote IP address (%s) is invalid\n",
-						session->account.username, session->media.remote_video_ip);
-			}
-
-			/* In case we're on hold (remote address is 0.0.0.0) set the send properties to FALSE */
-			if(have_audio_server_ip && !strcmp(session->media.remote_audio_ip, "0.0.0.0")) {
-				session->media.audio_send = FALSE;
-				session->media.audio_recv = FALSE;
-			}
-			if(have_video_server_ip && !strcmp(session->media.remote_video_ip, "0.0.0.0")) {
-				session->media.video_send = FALSE;
-				session->media.video_recv = FALSE;
+				close(session->media.audio_rtcp_fd);
+				session->media.audio_rtcp_fd = -1;
 			}
+			janus_mutex_unlock(&session->mutex);
+			return 0;
 		}
-
-		/* Prepare poll */
-		num = 0;
-		if(session->media.audio_rtp_fd != -1) {
-			fds[num].fd = session->media.audio_rtp_fd;
-			fds[num].events = POLLIN;
-			fds[num].revents = 0;
-			num++;
+		/* FIXME Should we be more tolerant of ICMP errors on RTP sockets as well? */
+		session->media.pollerrs++;
+		if(session->media.pollerrs < 100)
+			return 0;
+		JANUS_LOG(LOG_ERR, "[SIP-%s] Too many errors polling %d (%s %s socket)...\n", session->account.username,
+			mfd->fd, video ? "video" : "audio", rtcp ? "RTCP" : "RTP");
+		JANUS_LOG(LOG_ERR, "[SIP-%s]   -- %d (%s)\n", session->account.username, error, g_strerror(error));
+		return -1;	/* Can we assume it's pretty much over, after a POLLERR? */
+	}
+	if(!(revents & G_IO_IN))
+		return 0;
+	/* Got an RTP/RTCP packet */
+	char buffer[1500];
+	struct sockaddr_storage remote;
+	socklen_t addrlen = sizeof(remote);
+	int bytes = recvfrom(mfd->fd, buffer, sizeof(buffer), 0, (struct sockaddr *)&remote, &addrlen);
+	if(!video && !rtcp) {
+		/* Got something audio (RTP) */
+		if(bytes < 0 || !janus_is_rtp(buffer, bytes)) {
+			/* Failed to read or not an RTP packet? */
+			return 0;
 		}
-		if(session->media.audio_rtcp_fd != -1) {
-			fds[num].fd = session->media.audio_rtcp_fd;
-			fds[num].events = POLLIN;
-			fds[num].revents = 0;
-			num++;
+		session->media.pollerrs = 0;
+		if(!session->media.audio_recv) {
+			/* Dropping audio packet, we weren't expecting anything */
+			return 0;
 		}
-		if(session->media.video_rtp_fd != -1) {
-			fds[num].fd = session->media.video_rtp_fd;
-			fds[num].events = POLLIN;
-			fds[num].revents = 0;
-			num++;
+		if(session->media.on_hold && session->media.hold_audio_dir != JANUS_SDP_RECVONLY) {
+			/* Dropping audio packet, the call is on hold and we're not receiving anything */
+			return 0;
 		}
-		if(session->media.video_rtcp_fd != -1) {
-			fds[num].fd = session->media.video_rtcp_fd;
-			fds[num].events = POLLIN;
-			fds[num].revents = 0;
-			num++;
+		janus_rtp_header *header = (janus_rtp_header *)buffer;
+		janus_sip_check_rfc2833(session, buffer, bytes);
+		if(session->media.audio_ssrc_peer == 0) {
+			session->media.audio_ssrc_peer = ntohl(header->ssrc);
+			JANUS_LOG(LOG_VERB, "Got SIP peer audio SSRC: %"SCNu32"\n", session->media.audio_ssrc_peer);
 		}
-		/* Finally, let's add the pipe */
-		pipe_fd = session->media.pipefd[0];
-		if(pipe_fd == -1) {
-			/* Pipe was closed? Means the call is over */
-			break;
+		/* Is this SRTP? */
+		if(session->media.has_srtp_remote_audio) {
+			int buflen = bytes;
+			srtp_err_status_t res = srtp_unprotect(session->media.audio_srtp_in, buffer, &buflen);
+			if(res != srtp_err_status_ok && res != srtp_err_status_replay_fail && res != srtp_err_status_replay_old) {
+				guint32 timestamp = ntohl(header->timestamp);
+				guint16 seq = ntohs(header->seq_number);
+				JANUS_LOG(LOG_ERR, "[SIP-%s] Audio SRTP unprotect error: %s (len=%d-->%d, ts=%"SCNu32", seq=%"SCNu16")\n",
+					session->account.username, janus_srtp_error_str(res), bytes, buflen, timestamp, seq);
+				return 0;
+			}
+			bytes = buflen;
 		}
-		fds[num].fd = pipe_fd;
-		fds[num].events = POLLIN;
-		fds[num].revents = 0;
-		num++;
-		/* Wait for some data */
-		resfd = poll(fds, num, 1000);
-		if(resfd < 0) {
-			if(errno == EINTR) {
-				JANUS_LOG(LOG_HUGE, "[SIP-%s] Got an EINTR (%s), ignoring...\n", session->account.username, g_strerror(errno));
-				continue;
+		/* Check if the SSRC changed (e.g., after a re-INVITE or UPDATE) */
+		janus_rtp_header_update(header, &session->media.acontext, FALSE, 0);
+		/* Save the frame if we're recording */
+		header->ssrc = htonl(session->media.audio_ssrc_peer);
+		janus_recorder_save_frame(session->arc_peer, buffer, bytes);
+		/* Relay to application */
+		janus_plugin_rtp rtp = { .mindex = -1, .video = FALSE, .buffer = buffer, .length = bytes };
+		janus_plugin_rtp_extensions_reset(&rtp.extensions);
+		/* Add audio-level extension, if present */
+		if(session->media.audio_level_extension_id != -1) {
+			gboolean vad = FALSE;
+			int level = -1;
+			if(janus_rtp_header_extension_parse_audio_level(buffer, bytes,
+					session->media.audio_level_extension_id, &vad, &level) == 0) {
+				rtp.extensions.audio_level = level;
+				rtp.extensions.audio_level_vad = vad;
 			}
-			JANUS_LOG(LOG_ERR, "[SIP-%s] Error polling...\n", session->account.username);
-			JANUS_LOG(LOG_ERR, "[SIP-%s]   -- %d (%s)\n", session->account.username, errno, g_strerror(errno));
-			break;
-		} else if(resfd == 0) {
-			/* No data, keep going */
-			continue;
 		}
-		if(session == NULL || g_atomic_int_get(&session->destroyed) ||
-				session->status <= janus_sip_call_status_idle ||
-				session->status >= janus_sip_call_status_closing)
-			break;
-		int i = 0;
-		for(i=0; i<num; i++) {
-			if(fds[i].revents & (POLLERR | POLLHUP)) {
-				/* If we just updated the session, let's wait until things have calmed down */
-				if(session->media.updated)
-					break;
-				/* Check the socket error */
-				int error = 0;
-				socklen_t errlen = sizeof(error);
-				getsockopt(fds[i].fd, SOL_SOCKET, SO_ERROR, (void *)&error, &errlen);
-				if(error == 0) {
-					/* Maybe not a breaking error after all? */
-					continue;
-				} else if(error == 111) {
-					/* ICMP error? If it's related to RTCP, let's just close the RTCP socket and move on */
-					if(fds[i].fd == session->media.audio_rtcp_fd) {
-						JANUS_LOG(LOG_WARN, "[SIP-%s] Got a '%s' on the audio RTCP socket, closing it\n",
-							session->account.username, g_strerror(error));
-						janus_mutex_lock(&session->mutex);
-						close(session->media.audio_rtcp_fd);
-						session->media.audio_rtcp_fd = -1;
-						janus_mutex_unlock(&session->mutex);
-						continue;
-					} else if(fds[i].fd == session->media.video_rtcp_fd) {
-						JANUS_LOG(LOG_WARN, "[SIP-%s] Got a '%s' on the video RTCP socket, closing it\n",
-							session->account.username, g_strerror(error));
-						janus_mutex_lock(&session->mutex);
-						close(session->media.video_rtcp_fd);
-						session->media.video_rtcp_fd = -1;
-						janus_mutex_unlock(&session->mutex);
-						continue;
-					}
-				}
-				/* FIXME Should we be more tolerant of ICMP errors on RTP sockets as well? */
-				pollerrs++;
-				if(pollerrs < 100)
-					continue;
-				JANUS_LOG(LOG_ERR, "[SIP-%s] Too many errors polling %d (socket #%d): %s...\n", session->account.username,
-					fds[i].fd, i, fds[i].revents & POLLERR ? "POLLERR" : "POLLHUP");
-				JANUS_LOG(LOG_ERR, "[SIP-%s]   -- %d (%s)\n", session->account.username, error, g_strerror(error));
-				goon = FALSE;	/* Can we assume it's pretty much over, after a POLLERR? */
-				/* FIXME Simulate a "hangup" coming from the application */
-				janus_sip_hangup_media(session->handle);
-				break;
-			} else if(fds[i].revents & POLLIN) {
-				if(pipe_fd != -1 && fds[i].fd == pipe_fd) {
-					/* Poll interrupted for a reason, go on */
-					int code = 0;
-					(void)read(pipe_fd, &code, sizeof(int));
-					break;
-				}
-				/* Got an RTP/RTCP packet */
-				if(session->media.audio_rtp_fd != -1 && fds[i].fd == session->media.audio_rtp_fd) {
-					/* Got something audio (RTP) */
-					addrlen = sizeof(remote);
-					bytes = recvfrom(session->media.audio_rtp_fd, buffer, 1500, 0, (struct sockaddr*)&remote, &addrlen);
-					if(bytes < 0 || !janus_is_rtp(buffer, bytes)) {
-						/* Failed to read or not an RTP packet? */
-						continue;
-					}
-					pollerrs = 0;
-					if(!session->media.audio_recv) {
-						/* Dropping audio packet, we weren't expecting anything */
-						continue;
-					}
-					if(session->media.on_hold && session->media.hold_audio_dir != JANUS_SDP_RECVONLY) {
-						/* Dropping video packet, the call is on hold and we're not receiving anything */
-						continue;
-					}
-					janus_rtp_header *header = (janus_rtp_header *)buffer;
-					janus_sip_check_rfc2833(session, buffer, bytes);
-					if(session->media.audio_ssrc_peer == 0) {
-						session->media.audio_ssrc_peer = ntohl(header->ssrc);
-						JANUS_LOG(LOG_VERB, "Got SIP peer audio SSRC: %"SCNu32"\n", session->media.audio_ssrc_peer);
-					}
-					/* Is this SRTP? */
-					if(session->media.has_srtp_remote_audio) {
-						int buflen = bytes;
-						srtp_err_status_t res = srtp_unprotect(session->media.audio_srtp_in, buffer, &buflen);
-						if(res != srtp_err_status_ok && res != srtp_err_status_replay_fail && res != srtp_err_status_replay_old) {
-							guint32 timestamp = ntohl(header->timestamp);
-							guint16 seq = ntohs(header->seq_number);
-							JANUS_LOG(LOG_ERR, "[SIP-%s] Audio SRTP unprotect error: %s (len=%d-->%d, ts=%"SCNu32", seq=%"SCNu16")\n",
-								session->account.username, janus_srtp_error_str(res), bytes, buflen, timestamp, seq);
-							continue;
-						}
-						bytes = buflen;
-					}
-					/* Check if the SSRC changed (e.g., after a re-INVITE or UPDATE) */
-					janus_rtp_header_update(header, &session->media.acontext, FALSE, 0);
-					/* Save the frame if we're recording */
-					header->ssrc = htonl(session->media.audio_ssrc_peer);
-					janus_recorder_save_frame(session->arc_peer, buffer, bytes);
-					/* Relay to application */
-					janus_plugin_rtp rtp = { .mindex = -1, .video = FALSE, .buffer = buffer, .length = bytes };
-					janus_plugin_rtp_extensions_reset(&rtp.extensions);
-					/* Add audio-level extension, if present */
-					if(session->media.audio_level_extension_id != -1) {
-						gboolean vad = FALSE;
-						int level = -1;
-						if(janus_rtp_header_extension_parse_audio_level(buffer, bytes,
-								session->media.audio_level_extension_id, &vad, &level) == 0) {
-							rtp.extensions.audio_level = level;
-							rtp.extensions.audio_level_vad = vad;
-						}
-					}
-					gateway->relay_rtp(session->handle, &rtp);
-					continue;
-				} else if(session->media.audio_rtcp_fd != -1 && fds[i].fd == session->media.audio_rtcp_fd) {
-					/* Got something audio (RTCP) */
-					addrlen = sizeof(remote);
-					bytes = recvfrom(session->media.audio_rtcp_fd, buffer, 1500, 0, (struct sockaddr*)&remote, &addrlen);
-					if(bytes < 0 || !janus_is_rtcp(buffer, bytes)) {
-						/* Failed to read or not an RTCP packet? */
-						continue;
-					}
-					pollerrs = 0;
-					if(!session->media.video_recv) {
-						/* Dropping video packet, we weren't expecting anything */
-						continue;
-					}
-					if(session->media.on_hold && session->media.hold_video_dir != JANUS_SDP_RECVONLY) {
-						/* Dropping video packet, the call is on hold and we're not receiving anything */
-						continue;
-					}
-					/* Is this SRTCP? */
-					if(session->media.has_srtp_remote_audio) {
-						int buflen = bytes;
-						srtp_err_status_t res = srtp_unprotect_rtcp(session->media.audio_srtp_in, buffer, &buflen);
-						if(res != srtp_err_status_ok && res != srtp_err_status_replay_fail && res != srtp_err_status_replay_old) {
-							JANUS_LOG(LOG_ERR, "[SIP-%s] Audio SRTCP unprotect error: %s (len=%d-->%d)\n",
-								session->account.username, janus_srtp_error_str(res), bytes, buflen);
-							continue;
-						}
-						bytes = buflen;
-					}
-					/* Relay to application */
-					janus_plugin_rtcp rtcp = { .mindex = -1, .video = FALSE, .buffer = buffer, bytes };
-					gateway->relay_rtcp(session->handle, &rtcp);
-					continue;
-				} else if(session->media.video_rtp_fd != -1 && fds[i].fd == session->media.video_rtp_fd) {
-					/* Got something video (RTP) */
-					addrlen = sizeof(remote);
-					bytes = recvfrom(session->media.video_rtp_fd, buffer, 1500, 0, (struct sockaddr*)&remote, &addrlen);
-					if(bytes < 0 || !janus_is_rtp(buffer, bytes)) {
-						/* Failed to read or not an RTP packet? */
-						continue;
-					}
-					pollerrs = 0;
-					janus_rtp_header *header = (janus_rtp_header *)buffer;
-					if(session->media.video_ssrc_peer == 0) {
-						session->media.video_ssrc_peer = ntohl(header->ssrc);
-						JANUS_LOG(LOG_VERB, "Got SIP peer video SSRC: %"SCNu32"\n", session->media.video_ssrc_peer);
-					}
-					/* Is this SRTP? */
-					if(session->media.has_srtp_remote_video) {
-						int buflen = bytes;
-						srtp_err_status_t res = srtp_unprotect(session->media.video_srtp_in, buffer, &buflen);
-						if(res != srtp_err_status_ok && res != srtp_err_status_replay_fail && res != srtp_err_status_replay_old) {
-							guint32 timestamp = ntohl(header->timestamp);
-							guint16 seq = ntohs(header->seq_number);
-							JANUS_LOG(LOG_ERR, "[SIP-%s] Video SRTP unprotect error: %s (len=%d-->%d, ts=%"SCNu32", seq=%"SCNu16")\n",
-								session->account.username, janus_srtp_error_str(res), bytes, buflen, timestamp, seq);
-							continue;
-						}
-						bytes = buflen;
-					}
-					/* Check if the SSRC changed (e.g., after a re-INVITE or UPDATE) */
-					janus_rtp_header_update(header, &session->media.vcontext, TRUE, 0);
-					/* Save the frame if we're recording */
-					header->ssrc = htonl(session->media.video_ssrc_peer);
-					janus_recorder_save_frame(session->vrc_peer, buffer, bytes);
-					/* Relay to application */
-					janus_plugin_rtp rtp = { .mindex = -1, .video = TRUE, .buffer = buffer, .length = bytes };
-					janus_plugin_rtp_extensions_reset(&rtp.extensions);
-					/* Add video-orientation extension, if present */
-					if(session->media.video_orientation_extension_id > 0) {
-						gboolean c = FALSE, f = FALSE, r1 = FALSE, r0 = FALSE;
-						if(janus_rtp_header_extension_parse_video_orientation(buffer, bytes,
-								session->media.video_orientation_extension_id, &c, &f, &r1, &r0) == 0) {
-							rtp.extensions.video_rotation = 0;
-							if(r1 && r0)
-								rtp.extensions.video_rotation = 270;
-							else if(r1)
-								rtp.extensions.video_rotation = 180;
-							else if(r0)
-								rtp.extensions.video_rotation = 90;
-							rtp.extensions.video_back_camera = c;
-							rtp.extensions.video_flipped = f;
-						}
-					}
-					gateway->relay_rtp(session->handle, &rtp);
-					continue;
-				} else if(session->media.video_rtcp_fd != -1 && fds[i].fd == session->media.video_rtcp_fd) {
-					/* Got something video (RTCP) */
-					addrlen = sizeof(remote);
-					bytes = recvfrom(session->media.video_rtcp_fd, buffer, 1500, 0, (struct sockaddr*)&remote, &addrlen);
-					if(bytes < 0 || !janus_is_rtcp(buffer, bytes)) {
-						/* Failed to read or not an RTCP packet? */
-						continue;
-					}
-					pollerrs = 0;
-					/* Is this SRTCP? */
-					if(session->media.has_srtp_remote_video) {
-						int buflen = bytes;
-						srtp_err_status_t res = srtp_unprotect_rtcp(session->media.video_srtp_in, buffer, &buflen);
-						if(res != srtp_err_status_ok && res != srtp_err_status_replay_fail && res != srtp_err_status_replay_old) {
-							JANUS_LOG(LOG_ERR, "[SIP-%s] Video SRTP unprotect error: %s (len=%d-->%d)\n",
-								session->account.username, janus_srtp_error_str(res), bytes, buflen);
-							continue;
-						}
-						bytes = buflen;
-					}
-					/* Relay to application */
-					janus_plugin_rtcp rtcp = { .mindex = -1, .video = TRUE, .buffer = buffer, bytes };
-					gateway->relay_rtcp(session->handle, &rtcp);
-					continue;
-				}
+		gateway->relay_rtp(session->handle, &rtp);
+	} else if(!video && rtcp) {
+		/* Got something audio (RTCP) */
+		if(bytes < 0 || !janus_is_rtcp(buffer, bytes)) {
+			/* Failed to read or not an RTCP packet? */
+			return 0;
+		}
+		session->media.pollerrs = 0;
+		if(!session->media.video_recv) {
+			/* Dropping video packet, we weren't expecting anything */
+			return 0;
+		}
+		if(session->media.on_hold && session->media.hold_video_dir != JANUS_SDP_RECVONLY) {
+			/* Dropping video packet, the call is on hold and we're not receiving anything */
+			return 0;
+		}
+		/* Is this SRTCP? */
+		if(session->media.has_srtp_remote_audio) {
+			int buflen = bytes;
+			srtp_err_status_t res = srtp_unprotect_rtcp(session->media.audio_srtp_in, buffer, &buflen);
+			if(res != srtp_err_status_ok && res != srtp_err_status_replay_fail && res != srtp_err_status_replay_old) {
+				JANUS_LOG(LOG_ERR, "[SIP-%s] Audio SRTCP unprotect error: %s (len=%d-->%d)\n",
+					session->account.username, janus_srtp_error_str(res), bytes, buflen);
+				return 0;
+			}
+			bytes = buflen;
+		}
+		/* Relay to application */
+		janus_plugin_rtcp rtcp = { .mindex = -1, .video = FALSE, .buffer = buffer, bytes };
+		gateway->relay_rtcp(session->handle, &rtcp);
+	} else if(video && !rtcp) {
+		/* Got something video (RTP) */
+		if(bytes < 0 || !janus_is_rtp(buffer, bytes)) {
+			/* Failed to read or not an RTP packet? */
+			return 0;
+		}
+		session->media.pollerrs = 0;
+		janus_rtp_header *header = (janus_rtp_header *)buffer;
+		if(session->media.video_ssrc_peer == 0) {
+			session->media.video_ssrc_peer = ntohl(header->ssrc);
+			JANUS_LOG(LOG_VERB, "Got SIP peer video SSRC: %"SCNu32"\n", session->media.video_ssrc_peer);
+		}
+		/* Is this SRTP? */
+		if(session->media.has_srtp_remote_video) {
+			int buflen = bytes;
+			srtp_err_status_t res = srtp_unprotect(session->media.video_srtp_in, buffer, &buflen);
+			if(res != srtp_err_status_ok && res != srtp_err_status_replay_fail && res != srtp_err_status_replay_old) {
+				guint32 timestamp = ntohl(header->timestamp);
+				guint16 seq = ntohs(header->seq_number);
+				JANUS_LOG(LOG_ERR, "[SIP-%s] Video SRTP unprotect error: %s (len=%d-->%d, ts=%"SCNu32", seq=%"SCNu16")\n",
+					session->account.username, janus_srtp_error_str(res), bytes, buflen, timestamp, seq);
+				return 0;
+			}
+			bytes = buflen;
+		}
+		/* Check if the SSRC changed (e.g., after a re-INVITE or UPDATE) */
+		janus_rtp_header_update(header, &session->media.vcontext, TRUE, 0);
+		/* Save the frame if we're recording */
+		header->ssrc = htonl(session->media.video_ssrc_peer);
+		janus_recorder_save_frame(session->vrc_peer, buffer, bytes);
+		/* Relay to application */
+		janus_plugin_rtp rtp = { .mindex = -1, .video = TRUE, .buffer = buffer, .length = bytes };
+		janus_plugin_rtp_extensions_reset(&rtp.extensions);
+		/* Add video-orientation extension, if present */
+		if(session->media.video_orientation_extension_id > 0) {
+			gboolean c = FALSE, f = FALSE, r1 = FALSE, r0 = FALSE;
+			if(janus_rtp_header_extension_parse_video_orientation(buffer, bytes,
+					session->media.video_orientation_extension_id, &c, &f, &r1, &r0) == 0) {
+				rtp.extensions.video_rotation = 0;
+				if(r1 && r0)
+					rtp.extensions.video_rotation = 270;
+				else if(r1)
+					rtp.extensions.video_rotation = 180;
+				else if(r0)
+					rtp.extensions.video_rotation = 90;
+				rtp.extensions.video_back_camera = c;
+				rtp.extensions.video_flipped = f;
 			}
 		}
+		gateway->relay_rtp(session->handle, &rtp);
+	} else {
+		/* Got something video (RTCP) */
+		if(bytes < 0 || !janus_is_rtcp(buffer, bytes)) {
+			/* Failed to read or not an RTCP packet? */
+			return 0;
+		}
+		session->media.pollerrs = 0;
+		/* Is this SRTCP? */
+		if(session->media.has_srtp_remote_video) {
+			int buflen = bytes;
+			srtp_err_status_t res = srtp_unprotect_rtcp(session->media.video_srtp_in, buffer, &buflen);
+			if(res != srtp_err_status_ok && res != srtp_err_status_replay_fail && res != srtp_err_status_replay_old) {
+				JANUS_LOG(LOG_ERR, "[SIP-%s] Video SRTP unprotect error: %s (len=%d-->%d)\n",
+					session->account.username, janus_srtp_error_str(res), bytes, buflen);
+				return 0;
+			}
+			bytes = buflen;
+		}
+		/* Relay to application */
+		janus_plugin_rtcp rtcp = { .mindex = -1, .video = TRUE, .buffer = buffer, bytes };
+		gateway->relay_rtcp(session->handle, &rtcp);
 	}
-	/* Cleanup the media session */
+	return 0;
+}
+static gboolean janus_sip_media_source_prepare(GSource *source, gint *timeout) {
+	/* We use the timeout as a watchdog for the call, the same way the old
+	 * per-call relay thread used to wake from its poll every second */
+	*timeout = 1000;
+	return FALSE;
+}
+static gboolean janus_sip_media_source_check(GSource *source) {
+	/* Always dispatch: besides the sockets, the dispatch callback also
+	 * checks whether the call is still there (at least once per second) */
+	return TRUE;
+}
+static gboolean janus_sip_media_source_dispatch(GSource *source, GSourceFunc callback, gpointer user_data) {
+	janus_sip_media_source *ms = (janus_sip_media_source *)source;
+	janus_sip_session *session = ms->session;
+	if(g_source_is_destroyed(source))
+		return G_SOURCE_REMOVE;
+	if(session == NULL || g_atomic_int_get(&session->destroyed) ||
+			session->status <= janus_sip_call_status_idle ||
+			session->status >= janus_sip_call_status_closing) {	/* FIXME We need a per-call watchdog as well */
+		/* The call is over: cleanup the media session and detach from the loop */
+		janus_mutex_lock(&session->mutex);
+		if(session->media.source == source)
+			session->media.source = NULL;
+		janus_sip_media_cleanup(session);
+		janus_mutex_unlock(&session->mutex);
+		JANUS_LOG(LOG_VERB, "[SIP-%s] Detaching call from relay loop #%d\n",
+			session->account.username ? session->account.username : "??", ms->loop->id);
+		return G_SOURCE_REMOVE;
+	}
+	if(session->media.updated) {
+		/* Apparently there was a session update: reconnect the sockets to
+		 * the peer, and refresh the ones we're monitoring, if they changed */
+		janus_sip_media_update(session);
+		janus_sip_media_source_sync(ms);
+	}
+	/* Check the sockets we're monitoring */
+	if(janus_sip_media_source_pollfd(ms, &ms->audio_rtp, FALSE, FALSE) < 0 ||
+			janus_sip_media_source_pollfd(ms, &ms->audio_rtcp, FALSE, TRUE) < 0 ||
+			janus_sip_media_source_pollfd(ms, &ms->video_rtp, TRUE, FALSE) < 0 ||
+			janus_sip_media_source_pollfd(ms, &ms->video_rtcp, TRUE, TRUE) < 0) {
+		/* Too many errors on the sockets, assume the call is over */
+		/* FIXME Simulate a "hangup" coming from the application */
+		janus_sip_hangup_media(session->handle);
+		/* We'll be detached from the loop when the call status changes */
+	}
+	return G_SOURCE_CONTINUE;
+}
+static void janus_sip_media_source_finalize(GSource *source) {
+	janus_sip_media_source *ms = (janus_sip_media_source *)source;
+	if(ms->loop != NULL)
+		g_atomic_int_add(&ms->loop->calls, -1);
+	if(ms->session != NULL) {
+		janus_refcount_decrease(&ms->session->ref);
+		ms->session = NULL;
+	}
+}
+static GSourceFuncs janus_sip_media_source_funcs = {
+	janus_sip_media_source_prepare,
+	janus_sip_media_source_check,
+	janus_sip_media_source_dispatch,
+	janus_sip_media_source_finalize,
+	NULL, NULL
+};
+
+/* Helper to assign a call to one of the relay loops, and start monitoring
+ * its RTP/RTCP sockets there; returns 0 on success, a negative integer
+ * otherwise (e.g., if the relay loops aren't there) */
+static int janus_sip_media_attach(janus_sip_session *session) {
+	if(session == NULL || g_atomic_int_get(&session->destroyed) || relay_loops == NULL)
+		return -1;
+	if(!session->account.username || !session->callee) {
+		JANUS_LOG(LOG_WARN, "[SIP-%s] Not attaching call to a relay loop, no callee...\n", session->account.username);
+		return -1;
+	}
+	/* Pick the loop with the lowest number of calls */
+	janus_sip_relay_loop *loop = &relay_loops[0];
+	int i = 0;
+	for(i=1; i<num_relay_loops; i++) {
+		if(g_atomic_int_get(&relay_loops[i].calls) < g_atomic_int_get(&loop->calls))
+			loop = &relay_loops[i];
+	}
+	/* Connect the UDP sockets to the peer right away */
+	session->media.updated = TRUE;
+	janus_sip_media_update(session);
 	janus_mutex_lock(&session->mutex);
-	janus_sip_media_cleanup(session);
+	if(session->media.source != NULL) {
+		/* There's a source already (e.g., a previous call on the same
+		 * handle): get rid of it, the new one picks up the new sockets */
+		g_source_destroy(session->media.source);
+		session->media.source = NULL;
+	}
+	/* Create a source to have the loop monitor the RTP/RTCP sockets */
+	GSource *source = g_source_new(&janus_sip_media_source_funcs, sizeof(janus_sip_media_source));
+	janus_sip_media_source *ms = (janus_sip_media_source *)source;
+	janus_refcount_increase(&session->ref);
+	ms->session = session;
+	ms->loop = loop;
+	ms->audio_rtp.fd = ms->audio_rtcp.fd = ms->video_rtp.fd = ms->video_rtcp.fd = -1;
+	janus_sip_media_source_sync(ms);
+	g_atomic_int_inc(&loop->calls);
+	session->media.relay_loop = loop;
+	session->media.pollerrs = 0;
+	session->media.source = source;
+	g_source_attach(source, loop->mainctx);
+	g_source_unref(source);	/* The loop context owns the source now */
 	janus_mutex_unlock(&session->mutex);
-	/* Done */
-	JANUS_LOG(LOG_VERB, "Leaving SIP relay thread\n");
-	session->relayer_thread = NULL;
-	janus_refcount_decrease(&session->ref);
-	g_thread_unref(g_thread_self());
-	return NULL;
+	JANUS_LOG(LOG_VERB, "[SIP-%s] Call attached to relay loop #%d\n", session->account.username, loop->id);
+	return 0;
 }
 
 
 /* Sofia Event thread */
-gpointer janus_sip_sofia_thread(gpointer user_data) {
-	janus_sip_session *session = (janus_sip_session *)user_data;
-	if(session == NULL) {
-		g_thread_unref(g_thread_self());
-		return NULL;
-	}
-	if(session->account.username == NULL) {
-		janus_refcount_decrease(&session->ref);
-		g_thread_unref(g_thread_self());
-		return NULL;
-	}
-	JANUS_LOG(LOG_VERB, "Joining sofia loop thread (%s)...\n", session->account.username);
+static void janus_sip_sofia_setup(janus_sip_session *session, su_root_t *root) {
 	session->stack = g_malloc0(sizeof(ssip_t));
 	su_home_init(session->stack->s_home);
 	session->stack->session = session;
@@ -7666,7 +7861,13 @@ gpointer janus_sip_sofia_thread(gpointer user_data) {
 	session->stack->s_nh_r = NULL;
 	session->stack->s_nh_i = NULL;
 	session->stack->s_nh_m = NULL;
-	session->stack->s_root = su_root_create(session->stack);
+	if(root != NULL) {
+		/* We're using one of the shared event loops */
+		session->stack->s_root = root;
+		session->stack->shared_root = TRUE;
+	} else {
+		session->stack->s_root = su_root_create(session->stack);
+	}
 	session->stack->subscriptions = NULL;
 	janus_mutex_init(&session->stack->smutex);
 	JANUS_LOG(LOG_VERB, "Setting up sofia stack (sip:%s@%s)\n", session->account.username, local_ip);
@@ -7703,8 +7904,9 @@ gpointer janus_sip_sofia_thread(gpointer user_data) {
 				TAG_NULL());
 	if(query_contact_header)
 		nua_get_params(session->stack->s_nua, SIPTAG_FROM_STR(""), TAG_END());
-	su_root_run(session->stack->s_root);
-	/* When we get here, we're done */
+}
+
+static void janus_sip_sofia_teardown(janus_sip_session *session) {
 	janus_mutex_lock(&session->stack->smutex);
 	nua_t *s_nua = session->stack->s_nua;
 	session->stack->s_nua = NULL;
@@ -7727,9 +7929,43 @@ gpointer janus_sip_sofia_thread(gpointer user_data) {
 	session->stack->subscriptions = NULL;
 	janus_mutex_unlock(&session->stack->smutex);
 	nua_destroy(s_nua);
-	su_root_destroy(session->stack->s_root);
+	if(!session->stack->shared_root)
+		su_root_destroy(session->stack->s_root);
 	session->stack->s_root = NULL;
 	janus_refcount_decrease(&session->ref);
+}
+
+static void janus_sip_sofia_setup_cb(su_root_magic_t *magic, su_msg_r msg, su_msg_arg_t *arg) {
+	janus_sip_sofia_loop_msg *data = (janus_sip_sofia_loop_msg *)arg;
+	janus_sip_sofia_setup(data->session, data->loop->root);
+}
+
+static void janus_sip_sofia_teardown_cb(su_root_magic_t *magic, su_msg_r msg, su_msg_arg_t *arg) {
+	janus_sip_sofia_loop_msg *data = (janus_sip_sofia_loop_msg *)arg;
+	janus_sip_sofia_teardown(data->session);
+}
+
+static void janus_sip_sofia_loop_break_cb(su_root_magic_t *magic, su_msg_r msg, su_msg_arg_t *arg) {
+	janus_sip_sofia_loop_msg *data = (janus_sip_sofia_loop_msg *)arg;
+	su_root_break(data->loop->root);
+}
+
+gpointer janus_sip_sofia_thread(gpointer user_data) {
+	janus_sip_session *session = (janus_sip_session *)user_data;
+	if(session == NULL) {
+		g_thread_unref(g_thread_self());
+		return NULL;
+	}
+	if(session->account.username == NULL) {
+		janus_refcount_decrease(&session->ref);
+		g_thread_unref(g_thread_self());
+		return NULL;
+	}
+	JANUS_LOG(LOG_VERB, "Joining sofia loop thread (%s)...\n", session->account.username);
+	janus_sip_sofia_setup(session, NULL);
+	su_root_run(session->stack->s_root);
+	/* When we get here, we're done */
+	janus_sip_sofia_teardown(session);
 	JANUS_LOG(LOG_VERB, "Leaving sofia loop thread...\n");
 	g_thread_unref(g_thread_self());
 	return NULL;
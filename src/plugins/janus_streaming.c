@@ -97,7 +97,8 @@ videopt = <video RTP payload type> (e.g., 100)
 videocodec = name of the video codec (vp8)
 videofmtp = Codec specific parameters, if any
 videobufferkf = true|false (whether the plugin should store the latest
-	keyframe and send it immediately for new viewers, EXPERIMENTAL)
+	keyframe and the GOP that followed it, and send them immediately
+	for new viewers, EXPERIMENTAL)
 videosimulcast = true|false (do|don't enable video simulcasting)
 videoport2 = second local port for receiving video frames (only for rtp, and simulcasting)
 videoport3 = third local port for receiving video frames (only for rtp, and simulcasting)
@@ -110,6 +111,12 @@ h264sps = if using H.264 as a video codec, value of the sprop-parameter-sets
 collision = in case of collision (more than one SSRC hitting the same port), the plugin
 	will discard incoming RTP packets with a new SSRC unless this many milliseconds
 	passed, which would then change the current SSRC (0=disabled)
+failover = in case more than one source is feeding the same port (e.g., a primary
+	and a hot-standby encoder), lock onto the active SSRC and discard packets
+	from any other SSRC; only when nothing has been received from the active
+	source for this many milliseconds, switch to the new SSRC instead: since
+	sequence numbers and timestamps are rewritten per-viewer, subscribers
+	will not notice the switch and no renegotiation is needed (0=disabled)
 dataport = local port for receiving data messages to relay
 datamcast = multicast group for receiving data messages, if any
 dataiface = network interface or IP address to bind to, if any (binds to all otherwise)
@@ -909,13 +916,24 @@ multistream-test: {
  */
 
 
+#ifdef __linux__
+/* Needed for recvmmsg() */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#endif
+
 #include "plugin.h"
 
 #include <errno.h>
 #include <netdb.h>
+#include <sys/mman.h>
 #include <sys/poll.h>
 #include <sys/socket.h>
 #include <sys/time.h>
+#ifdef __linux__
+#include <sys/timerfd.h>
+#endif
 
 #include <jansson.h>
 
@@ -1067,6 +1085,7 @@ static struct janus_json_parameter create_parameters[] = {
 };
 static struct janus_json_parameter rtp_parameters[] = {
 	{"collision", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
+	{"failover", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
 	{"threads", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
 	{"srtpsuite", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
 	{"srtpcrypto", JSON_STRING, 0},
@@ -1252,6 +1271,23 @@ static uint16_t rtp_range_max = DEFAULT_RTP_RANGE_MAX;
 static uint16_t rtp_range_slider = DEFAULT_RTP_RANGE_MIN;
 static janus_mutex fd_mutex = JANUS_MUTEX_INITIALIZER;
 
+/* To make on-demand mountpoint creation faster, we keep a small pool of
+ * prewarmed RTP/RTCP port pairs, already bound on the configured range:
+ * creating a mountpoint that doesn't need a specific port, multicast
+ * group or network interface claims a bound pair from the pool right
+ * away, and a helper thread refills the pool in the background */
+#define JANUS_STREAMING_PORT_POOL_SIZE	16
+typedef struct janus_streaming_port_pair {
+	int rtp_fd, rtcp_fd;		/* Bound file descriptors */
+	int rtp_port, rtcp_port;	/* Ports they're bound to */
+} janus_streaming_port_pair;
+static GQueue *port_pool = NULL;
+static janus_mutex port_pool_mutex = JANUS_MUTEX_INITIALIZER;
+static GAsyncQueue *port_pool_tasks = NULL;
+static GThread *pool_thread = NULL;
+static int port_pool_exit = 0;
+static void *janus_streaming_port_pool_thread(void *data);
+
 static void *janus_streaming_ondemand_thread(void *data);
 static void *janus_streaming_filesource_thread(void *data);
 static void janus_streaming_relay_rtp_packet(gpointer data, gpointer user_data);
@@ -1278,6 +1314,12 @@ typedef struct janus_streaming_rtp_keyframe {
 	/* This is where we store packets while we're still collecting the whole keyframe */
 	GList *temp_keyframe;
 	guint32 temp_ts;
+	/* We also store the packets that followed the last keyframe (i.e., the
+	 * current GOP, within a bounded budget), so that new viewers can be
+	 * burst-replayed a whole renderable sequence instead of a single frame */
+	GList *gop;
+	GList *gop_last;
+	guint32 gop_bytes;
 	janus_mutex mutex;
 } janus_streaming_rtp_keyframe;
 
@@ -1285,6 +1327,7 @@ typedef struct janus_streaming_rtp_relay_packet {
 	int mindex;
 	janus_rtp_header *data;
 	gint length;
+	volatile gint refcount;	/* Set when the packet is shared across helper threads */
 	gboolean is_rtp;	/* This may be a data packet and not RTP */
 	gboolean is_data;
 	gboolean is_video;
@@ -1303,12 +1346,46 @@ typedef struct janus_streaming_rtp_relay_packet {
 	gboolean textdata;
 } janus_streaming_rtp_relay_packet;
 static janus_streaming_rtp_relay_packet exit_packet;
+/* All relay packets (and their payloads) live in recyclable pool slots, so
+ * that the per-packet allocations don't show up on the media path at all */
+#define JANUS_STREAMING_PACKET_POOL_SLOTS	1024
+static janus_plugin_packet_pool packet_pool;
 static void janus_streaming_rtp_relay_packet_free(janus_streaming_rtp_relay_packet *pkt) {
 	if(pkt == NULL || pkt == &exit_packet)
 		return;
-	g_free(pkt->data);
-	g_free(pkt);
-
+	janus_plugin_packet_pool_release(pkt);
+}
+static void janus_streaming_rtp_relay_packet_unref(janus_streaming_rtp_relay_packet *pkt) {
+	if(pkt == NULL || pkt == &exit_packet)
+		return;
+	if(g_atomic_int_dec_and_test(&pkt->refcount))
+		janus_streaming_rtp_relay_packet_free(pkt);
+}
+static janus_streaming_rtp_relay_packet *janus_streaming_rtp_relay_packet_clone(janus_streaming_rtp_relay_packet *packet) {
+	janus_streaming_rtp_relay_packet *copy = janus_plugin_packet_pool_claim(&packet_pool, packet->length);
+	copy->mindex = packet->mindex;
+	copy->data = (janus_rtp_header *)janus_plugin_packet_pool_buffer(&packet_pool, copy);
+	memcpy(copy->data, packet->data, packet->length);
+	copy->length = packet->length;
+	copy->is_rtp = packet->is_rtp;
+	copy->is_data = packet->is_data;
+	copy->textdata = packet->textdata;
+	copy->is_video = packet->is_video;
+	copy->is_keyframe = packet->is_keyframe;
+	copy->simulcast = packet->simulcast;
+	copy->ssrc[0] = packet->ssrc[0];
+	copy->ssrc[1] = packet->ssrc[1];
+	copy->ssrc[2] = packet->ssrc[2];
+	copy->codec = packet->codec;
+	copy->substream = packet->substream;
+	copy->svc = packet->svc;
+	if(copy->svc)
+		copy->svc_info = packet->svc_info;
+	copy->ptype = packet->ptype;
+	copy->timestamp = packet->timestamp;
+	copy->seq_number = packet->seq_number;
+	g_atomic_int_set(&copy->refcount, 1);
+	return copy;
 }
 
 #ifdef HAVE_LIBCURL
@@ -1332,6 +1409,7 @@ typedef struct janus_streaming_rtp_source {
 	janus_mutex rec_mutex;		/* Mutex to protect the recorders of all media streams from race conditions */
 	int pipefd[2];				/* Just needed to quickly interrupt the poll when it's time to wrap up */
 	int rtp_collision;			/* Whether we should take care of potential RTP collisions */
+	int failover;				/* Whether we should lock onto the active SSRC and only switch to a standby source after this timeout (ms) */
 	uint32_t lowest_bitrate;	/* Lowest bitrate received by viewers via REMB since last update */
 	gint64 remb_latest;			/* Time of latest sent REMB (to avoid flooding) */
 #ifdef HAVE_LIBCURL
@@ -1437,6 +1515,8 @@ static void janus_streaming_rtp_source_stream_unref(janus_streaming_rtp_source_s
 	if(stream)
 		janus_refcount_decrease(&stream->ref);
 }
+static void janus_streaming_gop_cache_append(janus_streaming_rtp_source_stream *stream, char *buffer, int bytes, janus_rtp_header *rtp);
+static void janus_streaming_gop_cache_clear(janus_streaming_rtp_source_stream *stream);
 
 typedef struct janus_streaming_file_source {
 	char *filename;
@@ -1467,8 +1547,11 @@ typedef struct janus_streaming_mountpoint {
 	janus_streaming_source streaming_source;
 	void *source;	/* Can differ according to the source type */
 	GDestroyNotify source_destroy;
+	char *cached_offer;		/* Serialized SDP offer we can serve to default subscribers, if any */
 	GList *viewers;
 	int helper_threads;		/* Only relevant for RTP/RTSP mountpoints */
+	int helper_threads_base;	/* Number of helpers configured at creation (lower bound when autoscaling) */
+	guint helpers_spawned;	/* How many helpers we spawned overall (used to assign unique IDs) */
 	GList *threads;			/* Only relevant for RTP/RTSP mountpoints */
 	volatile gint destroyed;
 	janus_mutex mutex;
@@ -1477,6 +1560,10 @@ typedef struct janus_streaming_mountpoint {
 GHashTable *mountpoints = NULL, *mountpoints_temp = NULL;
 janus_mutex mountpoints_mutex = JANUS_MUTEX_INITIALIZER;
 static char *admin_key = NULL;
+/* Upper bound for autoscaling the helper threads of a mountpoint: when
+ * larger than the configured number of helpers, mountpoints whose helpers
+ * are lagging behind get new ones spawned dynamically, up to this value */
+static int helper_threads_max = 0;
 
 typedef struct janus_streaming_helper {
 	janus_streaming_mountpoint *mp;
@@ -1485,6 +1572,8 @@ typedef struct janus_streaming_helper {
 	int num_viewers;
 	GList *viewers;
 	GAsyncQueue *queued_packets;
+	char *scratch;			/* Reusable buffer where shared packets are copied before rewriting headers */
+	gint scratch_size;
 	volatile gint destroyed;
 	janus_mutex mutex;
 	janus_refcount ref;
@@ -1499,11 +1588,12 @@ static void janus_streaming_helper_free(const janus_refcount *helper_ref) {
 	g_async_queue_unref(helper->queued_packets);
 	if(helper->viewers != NULL)
 		g_list_free(helper->viewers);
+	g_free(helper->scratch);
 	janus_mutex_destroy(&helper->mutex);
 	g_free(helper);
 }
 static void *janus_streaming_helper_thread(void *data);
-static void janus_streaming_helper_rtprtcp_packet(gpointer data, gpointer user_data);
+static void janus_streaming_helper_rtprtcp_packet(janus_streaming_mountpoint *mp, janus_streaming_rtp_relay_packet *packet);
 
 /* Helpers to create an RTP live source (e.g., from gstreamer/ffmpeg/vlc/etc.) */
 janus_streaming_rtp_source_stream *janus_streaming_create_rtp_source_stream(
@@ -1515,7 +1605,7 @@ janus_streaming_rtp_source_stream *janus_streaming_create_rtp_source_stream(
 		gboolean textdata, gboolean buffermsg);
 janus_streaming_mountpoint *janus_streaming_create_rtp_source(
 		uint64_t id, char *id_str, char *name, char *desc, char *metadata,
-		GList *media, int srtpsuite, char *srtpcrypto, int threads, int rtp_collision,
+		GList *media, int srtpsuite, char *srtpcrypto, int threads, int rtp_collision, int failover,
 		gboolean e2ee, gboolean playoutdelay_ext, int abscapturetime_src_ext_id);
 /* Helper to create a file/ondemand live source */
 janus_streaming_mountpoint *janus_streaming_create_file_source(
@@ -1530,6 +1620,15 @@ janus_streaming_mountpoint *janus_streaming_create_rtsp_source(
 		const janus_network_address *iface, int threads,
 		gint64 reconnect_delay, gint64 session_timeout, int rtsp_timeout, int rtsp_conn_timeout,
 		gboolean error_on_failure);
+#ifdef HAVE_LIBCURL
+/* At startup we bring RTSP mountpoints up in parallel from a bounded pool of
+ * workers, rather than connecting to each camera serially: mountpoints whose
+ * session isn't up yet are inserted in a "pending" state, and are either
+ * activated or removed by a worker once the RTSP handshake completes */
+static GThreadPool *mp_init_pool = NULL;
+static volatile gint mp_init_phase = 0;
+static void janus_streaming_mp_init_process(gpointer data, gpointer user_data);
+#endif
 
 typedef struct janus_streaming_message {
 	janus_plugin_session *handle;
@@ -1638,12 +1737,15 @@ static void janus_streaming_mountpoint_destroy(janus_streaming_mountpoint *mount
 static void janus_streaming_mountpoint_free(const janus_refcount *mp_ref) {
 	janus_streaming_mountpoint *mp = janus_refcount_containerof(mp_ref, janus_streaming_mountpoint, ref);
 	/* This mountpoint can be destroyed, free all the resources */
+	if(string_ids)
+		janus_string_id_release(mp->id_str);
 	g_free(mp->id_str);
 	g_free(mp->name);
 	g_free(mp->description);
 	g_free(mp->metadata);
 	g_free(mp->secret);
 	g_free(mp->pin);
+	g_free(mp->cached_offer);
 	janus_mutex_lock(&mp->mutex);
 	if(mp->viewers != NULL)
 		g_list_free(mp->viewers);
@@ -1981,6 +2083,10 @@ int janus_streaming_init(janus_callbacks *callback, const char *config_path) {
 			errno, g_strerror(errno));
 	}
 
+	/* All the relay packets we queue will live in recyclable pool slots */
+	janus_plugin_packet_pool_init(&packet_pool,
+		sizeof(janus_streaming_rtp_relay_packet), 1500, JANUS_STREAMING_PACKET_POOL_SLOTS);
+
 	/* Read configuration */
 	char filename[255];
 	g_snprintf(filename, 255, "%s/%s.jcfg", config_path, JANUS_STREAMING_PACKAGE);
@@ -2065,12 +2171,28 @@ int janus_streaming_init(janus_callbacks *callback, const char *config_path) {
 		if(string_ids) {
 			JANUS_LOG(LOG_INFO, "Streaming will use alphanumeric IDs, not numeric\n");
 		}
+		janus_config_item *htmax = janus_config_get(config, config_general, janus_config_type_item, "helper_threads_max");
+		if(htmax != NULL && htmax->value != NULL) {
+			helper_threads_max = atoi(htmax->value);
+			if(helper_threads_max < 0) {
+				JANUS_LOG(LOG_WARN, "Invalid value for 'helper_threads_max', disabling autoscaling\n");
+				helper_threads_max = 0;
+			} else if(helper_threads_max > 0) {
+				JANUS_LOG(LOG_INFO, "Helper threads will be autoscaled up to %d per mountpoint\n", helper_threads_max);
+			}
+		}
 	}
 	/* Iterate on all mountpoints */
-	mountpoints = g_hash_table_new_full(string_ids ? g_str_hash : g_int64_hash, string_ids ? g_str_equal : g_int64_equal,
+	mountpoints = g_hash_table_new_full(g_int64_hash, g_int64_equal,
 		(GDestroyNotify)g_free, (GDestroyNotify)janus_streaming_mountpoint_destroy);
 	mountpoints_temp = g_hash_table_new_full(string_ids ? g_str_hash : g_int64_hash, string_ids ? g_str_equal : g_int64_equal,
 		(GDestroyNotify)g_free, NULL);
+#ifdef HAVE_LIBCURL
+	/* Bring RTSP mountpoints up in parallel, rather than one at a time */
+	mp_init_pool = g_thread_pool_new(janus_streaming_mp_init_process, NULL,
+		g_get_num_processors(), FALSE, NULL);
+	g_atomic_int_set(&mp_init_phase, 1);
+#endif
 	if(config != NULL) {
 		GList *clist = janus_config_get_categories(config, NULL), *cl = clist;
 		while(cl != NULL) {
@@ -2111,9 +2233,11 @@ int janus_streaming_init(janus_callbacks *callback, const char *config_path) {
 						cl = cl->next;
 						continue;
 					}
+				} else {
+					mpid = janus_string_id_find(id->value);
 				}
 				/* Let's make sure the mountpoint doesn't exist already */
-				if(g_hash_table_lookup(mountpoints, string_ids ? (gpointer)id->value : (gpointer)&mpid) != NULL) {
+				if(g_hash_table_lookup(mountpoints, &mpid) != NULL) {
 					/* It does... */
 					janus_mutex_unlock(&mountpoints_mutex);
 					JANUS_LOG(LOG_ERR, "Can't add the Streaming mountpoint '%s', ID '%s' already exists...\n",
@@ -2133,6 +2257,7 @@ int janus_streaming_init(janus_callbacks *callback, const char *config_path) {
 				janus_config_item *pin = janus_config_get(config, cat, janus_config_type_item, "pin");
 				janus_config_item *media = janus_config_get(config, cat, janus_config_type_array, "media");
 				janus_config_item *rtpcollision = janus_config_get(config, cat, janus_config_type_item, "collision");
+				janus_config_item *rtpfailover = janus_config_get(config, cat, janus_config_type_item, "failover");
 				janus_config_item *threads = janus_config_get(config, cat, janus_config_type_item, "threads");
 				janus_config_item *ssuite = janus_config_get(config, cat, janus_config_type_item, "srtpsuite");
 				janus_config_item *scrypto = janus_config_get(config, cat, janus_config_type_item, "srtpcrypto");
@@ -2150,6 +2275,11 @@ int janus_streaming_init(janus_callbacks *callback, const char *config_path) {
 					cl = cl->next;
 					continue;
 				}
+				if(rtpfailover && rtpfailover->value && atoi(rtpfailover->value) < 0) {
+					JANUS_LOG(LOG_ERR, "Can't add 'rtp' mountpoint '%s', invalid failover configuration...\n", cat->name);
+					cl = cl->next;
+					continue;
+				}
 				if(threads && threads->value && atoi(threads->value) < 0) {
 					JANUS_LOG(LOG_ERR, "Can't add 'rtp' mountpoint '%s', invalid threads configuration...\n", cat->name);
 					cl = cl->next;
@@ -2558,6 +2688,7 @@ int janus_streaming_init(janus_callbacks *callback, const char *config_path) {
 						scrypto && scrypto->value ? (char *)scrypto->value : NULL,
 						(threads && threads->value) ? atoi(threads->value) : 0,
 						(rtpcollision && rtpcollision->value) ?  atoi(rtpcollision->value) : 0,
+						(rtpfailover && rtpfailover->value) ? atoi(rtpfailover->value) : 0,
 						(e2ee && e2ee->value) ? janus_is_true(e2ee->value) : FALSE,
 						(pd && pd->value) ? janus_is_true(pd->value) : FALSE,
 						abscaptime_src_id_int)) == NULL) {
@@ -2841,6 +2972,12 @@ int janus_streaming_init(janus_callbacks *callback, const char *config_path) {
 		g_list_free(clist);
 		/* Done: we keep the configuration file open in case we get a "create" or "destroy" with permanent=true */
 	}
+#ifdef HAVE_LIBCURL
+	/* Done parsing the configuration: from now on, new RTSP mountpoints
+	 * created via API go back to connecting synchronously, so that errors
+	 * can be reported to whoever issued the "create" request */
+	g_atomic_int_set(&mp_init_phase, 0);
+#endif
 	if(ifas) {
 		freeifaddrs(ifas);
 	}
@@ -2876,6 +3013,20 @@ int janus_streaming_init(janus_callbacks *callback, const char *config_path) {
 		janus_config_destroy(config);
 		return -1;
 	}
+	/* Prewarm a few port pairs that mountpoint creation can claim instantly */
+	port_pool = g_queue_new();
+	port_pool_tasks = g_async_queue_new();
+	int p = 0;
+	for(p=0; p<JANUS_STREAMING_PORT_POOL_SIZE; p++)
+		g_async_queue_push(port_pool_tasks, GUINT_TO_POINTER(1));
+	error = NULL;
+	pool_thread = g_thread_try_new("streaming pool", janus_streaming_port_pool_thread, NULL, &error);
+	if(error != NULL) {
+		/* Not a fatal error: creating a mountpoint will just bind its own ports */
+		JANUS_LOG(LOG_WARN, "Got error %d (%s) trying to launch the Streaming port pool thread...\n",
+			error->code, error->message ? error->message : "??");
+		g_error_free(error);
+	}
 	JANUS_LOG(LOG_INFO, "%s initialized!\n", JANUS_STREAMING_NAME);
 	return 0;
 }
@@ -2890,7 +3041,36 @@ void janus_streaming_destroy(void) {
 		g_thread_join(handler_thread);
 		handler_thread = NULL;
 	}
+	/* Get rid of the prewarmed port pool too */
+	if(pool_thread != NULL) {
+		g_async_queue_push(port_pool_tasks, &port_pool_exit);
+		g_thread_join(pool_thread);
+		pool_thread = NULL;
+	}
+	janus_mutex_lock(&port_pool_mutex);
+	if(port_pool != NULL) {
+		janus_streaming_port_pair *pair = NULL;
+		while((pair = g_queue_pop_head(port_pool)) != NULL) {
+			close(pair->rtp_fd);
+			close(pair->rtcp_fd);
+			g_free(pair);
+		}
+		g_queue_free(port_pool);
+		port_pool = NULL;
+	}
+	janus_mutex_unlock(&port_pool_mutex);
+	if(port_pool_tasks != NULL) {
+		g_async_queue_unref(port_pool_tasks);
+		port_pool_tasks = NULL;
+	}
 
+#ifdef HAVE_LIBCURL
+	/* Wait for any pending mountpoint bring-up to complete */
+	if(mp_init_pool != NULL) {
+		g_thread_pool_free(mp_init_pool, FALSE, TRUE);
+		mp_init_pool = NULL;
+	}
+#endif
 	/* Remove all mountpoints */
 	janus_mutex_lock(&mountpoints_mutex);
 	g_hash_table_destroy(mountpoints);
@@ -2905,6 +3085,9 @@ void janus_streaming_destroy(void) {
 	g_async_queue_unref(messages);
 	messages = NULL;
 
+	/* All mountpoints (and so all relay packets) are gone, free the pool too */
+	janus_plugin_packet_pool_destroy(&packet_pool);
+
 	janus_config_destroy(config);
 	g_free(admin_key);
 
@@ -3182,10 +3365,10 @@ static json_t *janus_streaming_process_synchronous_request(janus_streaming_sessi
 			id_value_str = id_num;
 		} else {
 			id_value_str = (char *)json_string_value(id);
+			id_value = janus_string_id_find(id_value_str);
 		}
 		janus_mutex_lock(&mountpoints_mutex);
-		janus_streaming_mountpoint *mp = g_hash_table_lookup(mountpoints,
-			string_ids ? (gpointer)id_value_str : (gpointer)&id_value);
+		janus_streaming_mountpoint *mp = g_hash_table_lookup(mountpoints, &id_value);
 		if(mp == NULL) {
 			janus_mutex_unlock(&mountpoints_mutex);
 			JANUS_LOG(LOG_VERB, "No such mountpoint/stream %s\n", id_value_str);
@@ -3266,8 +3449,26 @@ static json_t *janus_streaming_process_synchronous_request(janus_streaming_sessi
 			}
 			if(source->rtp_collision > 0)
 				json_object_set_new(ml, "collision", json_integer(source->rtp_collision));
-			if(mp->helper_threads > 0)
+			if(mp->helper_threads > 0) {
 				json_object_set_new(ml, "threads", json_integer(mp->helper_threads));
+				if(admin) {
+					/* Also report the current load of each helper thread */
+					json_t *helpers = json_array();
+					janus_mutex_lock(&mp->mutex);
+					GList *l = mp->threads;
+					while(l) {
+						janus_streaming_helper *ht = (janus_streaming_helper *)l->data;
+						json_t *h = json_object();
+						json_object_set_new(h, "id", json_integer(ht->id));
+						json_object_set_new(h, "viewers", json_integer(ht->num_viewers));
+						json_object_set_new(h, "queued", json_integer(g_async_queue_length(ht->queued_packets)));
+						json_array_append_new(helpers, h);
+						l = l->next;
+					}
+					janus_mutex_unlock(&mp->mutex);
+					json_object_set_new(ml, "helpers", helpers);
+				}
+			}
 			/* Iterate on media now */
 			GList *temp = source->media;
 			while(temp) {
@@ -3394,9 +3595,11 @@ static json_t *janus_streaming_process_synchronous_request(janus_streaming_sessi
 		janus_mutex_lock(&mountpoints_mutex);
 		guint64 mpid = string_ids ? 0 : json_integer_value(id);
 		char *mpid_str = (char *)(string_ids ? json_string_value(id) : NULL);
+		if(string_ids && mpid_str != NULL)
+			mpid = janus_string_id_find(mpid_str);
 		if((!string_ids && mpid > 0) || (string_ids && mpid_str != NULL)) {
 			/* Make sure the provided ID isn't already in use */
-			if(g_hash_table_lookup(mountpoints, string_ids ? (gpointer)mpid_str : (gpointer)&mpid) != NULL ||
+			if(g_hash_table_lookup(mountpoints, &mpid) != NULL ||
 					g_hash_table_lookup(mountpoints_temp, string_ids ? (gpointer)mpid_str : (gpointer)&mpid) != NULL) {
 				janus_mutex_unlock(&mountpoints_mutex);
 				JANUS_LOG(LOG_ERR, "A stream with the provided ID already exists\n");
@@ -3420,7 +3623,7 @@ static json_t *janus_streaming_process_synchronous_request(janus_streaming_sessi
 			JANUS_LOG(LOG_VERB, "Missing alphanumeric id, will generate a random one...\n");
 			while(mpid_str == 0) {
 				mpid_str = janus_random_uuid();
-				if(g_hash_table_lookup(mountpoints, mpid_str) != NULL ||
+				if(janus_string_id_find(mpid_str) != 0 ||
 						g_hash_table_lookup(mountpoints_temp, mpid_str) != NULL) {
 					/* ID already in use, try another one */
 					g_free(mpid_str);
@@ -3450,6 +3653,7 @@ static json_t *janus_streaming_process_synchronous_request(janus_streaming_sessi
 			json_t *md = json_object_get(root, "metadata");
 			json_t *is_private = json_object_get(root, "is_private");
 			json_t *rtpcollision = json_object_get(root, "collision");
+			json_t *rtpfailover = json_object_get(root, "failover");
 			json_t *threads = json_object_get(root, "threads");
 			json_t *ssuite = json_object_get(root, "srtpsuite");
 			json_t *scrypto = json_object_get(root, "srtpcrypto");
@@ -3898,6 +4102,7 @@ static json_t *janus_streaming_process_synchronous_request(janus_streaming_sessi
 					scrypto ? (char *)json_string_value(scrypto) : NULL,
 					threads ? json_integer_value(threads) : 0,
 					rtpcollision ? json_integer_value(rtpcollision) : 0,
+					rtpfailover ? json_integer_value(rtpfailover) : 0,
 					e2ee ? json_is_true(e2ee) : FALSE,
 					pd ? json_is_true(pd) : FALSE,
 					abscaptime_src_id ? json_integer_value(abscaptime_src_id) : 0);
@@ -4245,6 +4450,10 @@ static json_t *janus_streaming_process_synchronous_request(janus_streaming_sessi
 					g_snprintf(value, BUFSIZ, "%d", source->rtp_collision);
 					janus_config_add(config, c, janus_config_item_create("collision", value));
 				}
+				if(source->failover > 0) {
+					g_snprintf(value, BUFSIZ, "%d", source->failover);
+					janus_config_add(config, c, janus_config_item_create("failover", value));
+				}
 				if(source->srtpsuite > 0 && source->srtpcrypto) {
 					g_snprintf(value, BUFSIZ, "%d", source->srtpsuite);
 					janus_config_add(config, c, janus_config_item_create("srtpsuite", value));
@@ -4510,10 +4719,10 @@ static json_t *janus_streaming_process_synchronous_request(janus_streaming_sessi
 			id_value_str = id_num;
 		} else {
 			id_value_str = (char *)json_string_value(id);
+			id_value = janus_string_id_find(id_value_str);
 		}
 		janus_mutex_lock(&mountpoints_mutex);
-		janus_streaming_mountpoint *mp = g_hash_table_lookup(mountpoints,
-			string_ids ? (gpointer)id_value_str : (gpointer)&id_value);
+		janus_streaming_mountpoint *mp = g_hash_table_lookup(mountpoints, &id_value);
 		if(mp == NULL) {
 			janus_mutex_unlock(&mountpoints_mutex);
 			JANUS_LOG(LOG_ERR, "No such mountpoint (%s)\n", id_value_str);
@@ -4549,6 +4758,9 @@ static json_t *janus_streaming_process_synchronous_request(janus_streaming_sessi
 		}
 		if(is_private)
 			mp->is_private = json_is_true(is_private);
+		/* Don't serve a stale offer to new subscribers after an edit */
+		g_free(mp->cached_offer);
+		mp->cached_offer = NULL;
 		/* A secret may be required for this action */
 		JANUS_CHECK_SECRET(mp->secret, root, "secret", error_code, error_cause,
 			JANUS_STREAMING_ERROR_MISSING_ELEMENT, JANUS_STREAMING_ERROR_INVALID_ELEMENT, JANUS_STREAMING_ERROR_UNAUTHORIZED);
@@ -4648,6 +4860,10 @@ static json_t *janus_streaming_process_synchronous_request(janus_streaming_sessi
 						g_snprintf(value, BUFSIZ, "%d", source->rtp_collision);
 						janus_config_add(config, c, janus_config_item_create("collision", value));
 					}
+					if(source->failover > 0) {
+						g_snprintf(value, BUFSIZ, "%d", source->failover);
+						janus_config_add(config, c, janus_config_item_create("failover", value));
+					}
 					if(source->srtpsuite > 0 && source->srtpcrypto) {
 						g_snprintf(value, BUFSIZ, "%d", source->srtpsuite);
 						janus_config_add(config, c, janus_config_item_create("srtpsuite", value));
@@ -4807,10 +5023,10 @@ static json_t *janus_streaming_process_synchronous_request(janus_streaming_sessi
 			id_value_str = id_num;
 		} else {
 			id_value_str = (char *)json_string_value(id);
+			id_value = janus_string_id_find(id_value_str);
 		}
 		janus_mutex_lock(&mountpoints_mutex);
-		janus_streaming_mountpoint *mp = g_hash_table_lookup(mountpoints,
-			string_ids ? (gpointer)id_value_str : (gpointer)&id_value);
+		janus_streaming_mountpoint *mp = g_hash_table_lookup(mountpoints, &id_value);
 		if(mp == NULL) {
 			janus_mutex_unlock(&mountpoints_mutex);
 			JANUS_LOG(LOG_VERB, "No such mountpoint/stream %s\n", id_value_str);
@@ -4924,6 +5140,7 @@ static json_t *janus_streaming_process_synchronous_request(janus_streaming_sessi
 			id_value_str = id_num;
 		} else {
 			id_value_str = (char *)json_string_value(id);
+			id_value = janus_string_id_find(id_value_str);
 		}
 		json_t *permanent = json_object_get(root, "permanent");
 		gboolean save = permanent ? json_is_true(permanent) : FALSE;
@@ -4934,8 +5151,7 @@ static json_t *janus_streaming_process_synchronous_request(janus_streaming_sessi
 			goto prepare_response;
 		}
 		janus_mutex_lock(&mountpoints_mutex);
-		janus_streaming_mountpoint *mp = g_hash_table_lookup(mountpoints,
-			string_ids ? (gpointer)id_value_str : (gpointer)&id_value);
+		janus_streaming_mountpoint *mp = g_hash_table_lookup(mountpoints, &id_value);
 		if(mp == NULL) {
 			janus_mutex_unlock(&mountpoints_mutex);
 			JANUS_LOG(LOG_VERB, "No such mountpoint/stream %s\n", id_value_str);
@@ -4954,8 +5170,7 @@ static json_t *janus_streaming_process_synchronous_request(janus_streaming_sessi
 		}
 		JANUS_LOG(LOG_VERB, "Request to unmount mountpoint/stream %s\n", id_value_str);
 		/* Remove mountpoint from the hashtable: this will get it destroyed eventually */
-		g_hash_table_remove(mountpoints,
-			string_ids ? (gpointer)id_value_str : (gpointer)&id_value);
+		g_hash_table_remove(mountpoints, &id_value);
 		/* FIXME Should we kick the current viewers as well? */
 		janus_mutex_lock(&mp->mutex);
 		GList *viewer = g_list_first(mp->viewers);
@@ -5074,10 +5289,10 @@ static json_t *janus_streaming_process_synchronous_request(janus_streaming_sessi
 			id_value_str = id_num;
 		} else {
 			id_value_str = (char *)json_string_value(id);
+			id_value = janus_string_id_find(id_value_str);
 		}
 		janus_mutex_lock(&mountpoints_mutex);
-		janus_streaming_mountpoint *mp = g_hash_table_lookup(mountpoints,
-			string_ids ? (gpointer)id_value_str : (gpointer)&id_value);
+		janus_streaming_mountpoint *mp = g_hash_table_lookup(mountpoints, &id_value);
 		if(mp == NULL) {
 			janus_mutex_unlock(&mountpoints_mutex);
 			JANUS_LOG(LOG_VERB, "No such mountpoint/stream %s\n", id_value_str);
@@ -5357,10 +5572,10 @@ static json_t *janus_streaming_process_synchronous_request(janus_streaming_sessi
 			id_value_str = id_num;
 		} else {
 			id_value_str = (char *)json_string_value(id);
+			id_value = janus_string_id_find(id_value_str);
 		}
 		janus_mutex_lock(&mountpoints_mutex);
-		janus_streaming_mountpoint *mp = g_hash_table_lookup(mountpoints,
-			string_ids ? (gpointer)id_value_str : (gpointer)&id_value);
+		janus_streaming_mountpoint *mp = g_hash_table_lookup(mountpoints, &id_value);
 		if(mp == NULL) {
 			janus_mutex_unlock(&mountpoints_mutex);
 			JANUS_LOG(LOG_VERB, "No such mountpoint/stream %s\n", id_value_str);
@@ -5622,7 +5837,18 @@ void janus_streaming_setup_media(janus_plugin_session *handle) {
 			if(stream->keyframe.enabled) {
 				JANUS_LOG(LOG_HUGE, "Any keyframe to send? (%s)\n", stream->mid);
 				janus_mutex_lock(&stream->keyframe.mutex);
-				if(stream->keyframe.latest_keyframe != NULL) {
+				if(stream->keyframe.gop != NULL) {
+					/* Burst-replay the whole GOP we cached, so that video can
+					 * render right away instead of waiting for the source to
+					 * get to the next keyframe: the RTP context of the session
+					 * takes care of rebasing timestamps and sequence numbers */
+					JANUS_LOG(LOG_HUGE, "Yep! %d packets (whole GOP)\n", g_list_length(stream->keyframe.gop));
+					GList *temp = stream->keyframe.gop;
+					while(temp) {
+						janus_streaming_relay_rtp_packet(session, temp->data);
+						temp = temp->next;
+					}
+				} else if(stream->keyframe.latest_keyframe != NULL) {
 					JANUS_LOG(LOG_HUGE, "Yep! %d packets\n", g_list_length(stream->keyframe.latest_keyframe));
 					GList *temp = stream->keyframe.latest_keyframe;
 					while(temp) {
@@ -5692,7 +5918,8 @@ void janus_streaming_incoming_rtcp(janus_plugin_session *handle, janus_plugin_rt
 		JANUS_LOG(LOG_HUGE, "Got video RTCP feedback from a viewer: SSRC %"SCNu32"\n",
 			janus_rtcp_get_sender_ssrc(buf, len));
 		/* We only relay PLI/FIR and REMB packets, but in a selective way */
-		if(janus_rtcp_has_fir(buf, len) || janus_rtcp_has_pli(buf, len)) {
+		janus_rtcp_summary summary;
+		if(janus_rtcp_inspect(buf, len, &summary, NULL) == 0 && (summary.has_fir || summary.has_pli)) {
 			/* We got a PLI/FIR, pass it along unless we just sent one */
 			JANUS_LOG(LOG_HUGE, "  -- Keyframe request\n");
 			janus_streaming_rtcp_pli_send(stream);
@@ -5903,6 +6130,7 @@ static void *janus_streaming_handler(void *data) {
 				id_value_str = id_num;
 			} else {
 				id_value_str = (char *)json_string_value(id);
+				id_value = janus_string_id_find(id_value_str);
 			}
 			/* The proper way is listing the mids of the streams we want to
 			 * receive: a missing or empty list will subscribe to them all */
@@ -5929,8 +6157,7 @@ static void *janus_streaming_handler(void *data) {
 			do_restart = restart ? json_is_true(restart) : FALSE;
 			/* Find the mountpoint and go on */
 			janus_mutex_lock(&mountpoints_mutex);
-			janus_streaming_mountpoint *mp = g_hash_table_lookup(mountpoints,
-				string_ids ? (gpointer)id_value_str : (gpointer)&id_value);
+			janus_streaming_mountpoint *mp = g_hash_table_lookup(mountpoints, &id_value);
 			if(mp == NULL) {
 				janus_mutex_unlock(&mountpoints_mutex);
 				janus_mutex_unlock(&sessions_mutex);
@@ -6251,6 +6478,20 @@ static void *janus_streaming_handler(void *data) {
 done:
 			/* Let's prepare an offer now, but let's also check if there's something we need to skip */
 			sdp_type = "offer";	/* We're always going to do the offer ourselves, never answer */
+			/* The offer we generate is exactly the same for all subscribers that
+			 * want everything the mountpoint has with the default properties, so
+			 * in that case we can serve a cached copy instead of regenerating the
+			 * SDP from scratch for each of them: anything session specific (media
+			 * selection, deprecated offer_* properties, renegotiations bumping the
+			 * SDP version) makes the offer unique and so bypasses the cache */
+			gboolean cacheable = !do_restart && session->sdp_version == 1 &&
+				offer_audio == NULL && offer_video == NULL && offer_data == NULL &&
+				(mids == NULL || json_array_size(mids) == 0);
+			if(cacheable && mp->cached_offer != NULL) {
+				/* We have a cached offer we can serve right away */
+				sdp = g_strdup(mp->cached_offer);
+				goto offer_ready;
+			}
 			char s_name[100];
 			g_snprintf(s_name, sizeof(s_name), "Mountpoint %s", mp->id_str);
 			janus_sdp *offer = janus_sdp_generate_offer(s_name, "0.0.0.0",
@@ -6330,6 +6571,12 @@ done:
 			}
 			sdp = janus_sdp_write(offer);
 			janus_sdp_destroy(offer);
+			if(cacheable) {
+				/* Cache this offer for the next default subscribers */
+				g_free(mp->cached_offer);
+				mp->cached_offer = g_strdup(sdp);
+			}
+offer_ready:
 			JANUS_LOG(LOG_VERB, "Going to %s this SDP:\n%s\n", sdp_type, sdp);
 			result = json_object();
 			json_object_set_new(result, "status", json_string(do_restart ? "updating" : "preparing"));
@@ -6415,11 +6662,11 @@ done:
 				id_value_str = id_num;
 			} else {
 				id_value_str = (char *)json_string_value(id);
+				id_value = janus_string_id_find(id_value_str);
 			}
 			/* Find the mountpoint and go on */
 			janus_mutex_lock(&mountpoints_mutex);
-			janus_streaming_mountpoint *mp = g_hash_table_lookup(mountpoints,
-				string_ids ? (gpointer)id_value_str : (gpointer)&id_value);
+			janus_streaming_mountpoint *mp = g_hash_table_lookup(mountpoints, &id_value);
 			if(mp == NULL) {
 				janus_mutex_unlock(&mountpoints_mutex);
 				janus_mutex_unlock(&sessions_mutex);
@@ -7027,10 +7274,10 @@ done:
 				id_value_str = id_num;
 			} else {
 				id_value_str = (char *)json_string_value(id);
+				id_value = janus_string_id_find(id_value_str);
 			}
 			janus_mutex_lock(&mountpoints_mutex);
-			janus_streaming_mountpoint *mp = g_hash_table_lookup(mountpoints,
-				string_ids ? (gpointer)id_value_str : (gpointer)&id_value);
+			janus_streaming_mountpoint *mp = g_hash_table_lookup(mountpoints, &id_value);
 			if(mp == NULL || g_atomic_int_get(&mp->destroyed)) {
 				janus_mutex_unlock(&mountpoints_mutex);
 				janus_mutex_unlock(&session->mutex);
@@ -7376,7 +7623,7 @@ static int janus_streaming_create_fd(int port, in_addr_t mcast, const janus_netw
 	return fd;
 }
 /* Helper to bind RTP/RTCP port pair (for RTSP) */
-static int janus_streaming_allocate_port_pair(const char *name, const char *media,
+static int janus_streaming_bind_port_pair(const char *name, const char *media,
 		in_addr_t mcast, const janus_network_address *iface, multiple_fds *fds, int ports[2]) {
 	/* Start from the global slider */
 	uint16_t rtp_port_next = rtp_range_slider;
@@ -7422,6 +7669,66 @@ static int janus_streaming_allocate_port_pair(const char *name, const char *medi
 	}
 	return -1;
 }
+/* Helper to claim a prewarmed port pair from the pool, if one is available */
+static int janus_streaming_claim_port_pair(const char *name, const char *media, multiple_fds *fds, int ports[2]) {
+	janus_mutex_lock(&port_pool_mutex);
+	janus_streaming_port_pair *pair = port_pool ? g_queue_pop_head(port_pool) : NULL;
+	janus_mutex_unlock(&port_pool_mutex);
+	if(pair == NULL)
+		return -1;
+	fds->fd = pair->rtp_fd;
+	fds->rtcp_fd = pair->rtcp_fd;
+	ports[0] = pair->rtp_port;
+	ports[1] = pair->rtcp_port;
+	g_free(pair);
+	JANUS_LOG(LOG_VERB, "[%s] Claimed a prewarmed port pair for %s (%d-%d)\n", name, media, ports[0], ports[1]);
+	/* Have the helper thread prewarm a new pair to replace this one */
+	if(port_pool_tasks != NULL)
+		g_async_queue_push(port_pool_tasks, GUINT_TO_POINTER(1));
+	return 0;
+}
+/* Helper to allocate an RTP/RTCP port pair: when there are no binding
+ * constraints we serve a prewarmed pair from the pool, so that creating
+ * an on-demand mountpoint doesn't have to wait for the binds */
+static int janus_streaming_allocate_port_pair(const char *name, const char *media,
+		in_addr_t mcast, const janus_network_address *iface, multiple_fds *fds, int ports[2]) {
+	if(!IN_MULTICAST(ntohl(mcast)) && janus_network_address_is_null(iface) &&
+			janus_streaming_claim_port_pair(name, media, fds, ports) == 0)
+		return 0;
+	return janus_streaming_bind_port_pair(name, media, mcast, iface, fds, ports);
+}
+/* Thread to refill the pool of prewarmed port pairs in the background */
+static void *janus_streaming_port_pool_thread(void *data) {
+	JANUS_LOG(LOG_VERB, "Joining Streaming port pool thread\n");
+	janus_network_address nil;
+	janus_network_address_nullify(&nil);
+	while(TRUE) {
+		gpointer task = g_async_queue_pop(port_pool_tasks);
+		if(task == (gpointer)&port_pool_exit || g_atomic_int_get(&stopping))
+			break;
+		janus_mutex_lock(&port_pool_mutex);
+		guint prewarmed = port_pool ? g_queue_get_length(port_pool) : 0;
+		janus_mutex_unlock(&port_pool_mutex);
+		if(prewarmed >= JANUS_STREAMING_PORT_POOL_SIZE)
+			continue;
+		multiple_fds fds = { -1, -1 };
+		int ports[2] = { 0, 0 };
+		if(janus_streaming_bind_port_pair("pool", "prewarmed pair", INADDR_ANY, &nil, &fds, ports) < 0) {
+			JANUS_LOG(LOG_WARN, "Couldn't prewarm a port pair for the pool, will try again at the next claim\n");
+			continue;
+		}
+		janus_streaming_port_pair *pair = g_malloc(sizeof(janus_streaming_port_pair));
+		pair->rtp_fd = fds.fd;
+		pair->rtcp_fd = fds.rtcp_fd;
+		pair->rtp_port = ports[0];
+		pair->rtcp_port = ports[1];
+		janus_mutex_lock(&port_pool_mutex);
+		g_queue_push_tail(port_pool, pair);
+		janus_mutex_unlock(&port_pool_mutex);
+	}
+	JANUS_LOG(LOG_VERB, "Leaving Streaming port pool thread\n");
+	return NULL;
+}
 
 /* Helper to return fd port */
 static int janus_streaming_get_fd_port(int fd) {
@@ -7449,8 +7756,9 @@ static void janus_streaming_rtp_source_stream_free(const janus_refcount *st_ref)
 	g_free(stream->host);
 	janus_mutex_lock(&stream->keyframe.mutex);
 	if(stream->keyframe.latest_keyframe != NULL)
-		g_list_free_full(stream->keyframe.latest_keyframe, (GDestroyNotify)janus_streaming_rtp_relay_packet_free);
+		g_list_free_full(stream->keyframe.latest_keyframe, (GDestroyNotify)janus_streaming_rtp_relay_packet_unref);
 	stream->keyframe.latest_keyframe = NULL;
+	janus_streaming_gop_cache_clear(stream);
 	janus_mutex_unlock(&stream->keyframe.mutex);
 	janus_mutex_lock(&stream->buffermsg_mutex);
 	if(stream->last_msg != NULL)
@@ -7681,6 +7989,9 @@ janus_streaming_rtp_source_stream *janus_streaming_create_rtp_source_stream(
 		stream->keyframe.latest_keyframe = NULL;
 		stream->keyframe.temp_keyframe = NULL;
 		stream->keyframe.temp_ts = 0;
+		stream->keyframe.gop = NULL;
+		stream->keyframe.gop_last = NULL;
+		stream->keyframe.gop_bytes = 0;
 		janus_mutex_init(&stream->keyframe.mutex);
 	} else if(mtype == JANUS_STREAMING_MEDIA_DATA) {
 		stream->textdata = textdata;
@@ -7694,7 +8005,7 @@ janus_streaming_rtp_source_stream *janus_streaming_create_rtp_source_stream(
 
 janus_streaming_mountpoint *janus_streaming_create_rtp_source(
 		uint64_t id, char *id_str, char *name, char *desc, char *metadata,
-		GList *media, int srtpsuite, char *srtpcrypto, int threads, int rtp_collision,
+		GList *media, int srtpsuite, char *srtpcrypto, int threads, int rtp_collision, int failover,
 		gboolean e2ee, gboolean playoutdelay_ext, int abscapturetime_src_ext_id) {
 	char id_num[30];
 	if(!string_ids) {
@@ -7724,6 +8035,8 @@ janus_streaming_mountpoint *janus_streaming_create_rtp_source(
 	janus_streaming_mountpoint *live_rtp = g_malloc0(sizeof(janus_streaming_mountpoint));
 	live_rtp->id = id;
 	live_rtp->id_str = g_strdup(id_str);
+	if(string_ids)
+		live_rtp->id = janus_string_id_intern(live_rtp->id_str);
 	live_rtp->name = g_strdup(name ? name : tempname);
 	char *description = NULL;
 	if(desc != NULL)
@@ -7815,6 +8128,7 @@ janus_streaming_mountpoint *janus_streaming_create_rtp_source(
 	pipe(live_rtp_source->pipefd);
 	janus_mutex_init(&live_rtp_source->rec_mutex);
 	live_rtp_source->rtp_collision = rtp_collision;
+	live_rtp_source->failover = failover;
 	live_rtp_source->e2ee = e2ee;
 	live_rtp_source->playoutdelay_ext = playoutdelay_ext;
 	live_rtp_source->abscapturetime_src_ext_id = abscapturetime_src_ext_id;
@@ -7826,7 +8140,7 @@ janus_streaming_mountpoint *janus_streaming_create_rtp_source(
 	janus_mutex_init(&live_rtp->mutex);
 	janus_mutex_lock(&mountpoints_mutex);
 	g_hash_table_insert(mountpoints,
-		string_ids ? (gpointer)g_strdup(live_rtp->id_str) : (gpointer)janus_uint64_dup(live_rtp->id),
+		janus_uint64_dup(live_rtp->id),
 		live_rtp);
 	g_hash_table_remove(mountpoints_temp, string_ids ? (gpointer)live_rtp->id_str : (gpointer)&live_rtp->id);
 	/* If we need helper threads, spawn them now */
@@ -7838,7 +8152,7 @@ janus_streaming_mountpoint *janus_streaming_create_rtp_source(
 			janus_streaming_helper *helper = g_malloc0(sizeof(janus_streaming_helper));
 			helper->id = i+1;
 			helper->mp = live_rtp;
-			helper->queued_packets = g_async_queue_new_full((GDestroyNotify)janus_streaming_rtp_relay_packet_free);
+			helper->queued_packets = g_async_queue_new_full((GDestroyNotify)janus_streaming_rtp_relay_packet_unref);
 			janus_mutex_init(&helper->mutex);
 			janus_refcount_init(&helper->ref, janus_streaming_helper_free);
 			live_rtp->helper_threads++;
@@ -7864,6 +8178,8 @@ janus_streaming_mountpoint *janus_streaming_create_rtp_source(
 			live_rtp->threads = g_list_append(live_rtp->threads, helper);
 		}
 	}
+	live_rtp->helper_threads_base = live_rtp->helper_threads;
+	live_rtp->helpers_spawned = live_rtp->helper_threads;
 	janus_mutex_unlock(&mountpoints_mutex);
 	/* Finally, create the mountpoint thread itself */
 	g_snprintf(tname, sizeof(tname), "mp %s", live_rtp->id_str);
@@ -7925,6 +8241,8 @@ janus_streaming_mountpoint *janus_streaming_create_file_source(
 	janus_streaming_mountpoint *file_source = g_malloc0(sizeof(janus_streaming_mountpoint));
 	file_source->id = id;
 	file_source->id_str = g_strdup(id_str);
+	if(string_ids)
+		file_source->id = janus_string_id_intern(file_source->id_str);
 	char tempname[255];
 	if(!name) {
 		memset(tempname, 0, 255);
@@ -7968,7 +8286,7 @@ janus_streaming_mountpoint *janus_streaming_create_file_source(
 	janus_mutex_init(&file_source->mutex);
 	janus_mutex_lock(&mountpoints_mutex);
 	g_hash_table_insert(mountpoints,
-		string_ids ? (gpointer)g_strdup(file_source->id_str) : (gpointer)janus_uint64_dup(file_source->id),
+		janus_uint64_dup(file_source->id),
 		file_source);
 	g_hash_table_remove(mountpoints_temp, string_ids ? (gpointer)file_source->id_str : (gpointer)&file_source->id);
 	janus_mutex_unlock(&mountpoints_mutex);
@@ -8734,6 +9052,9 @@ static int janus_streaming_rtsp_connect_to_server(janus_streaming_mountpoint *mp
 				stream->keyframe.latest_keyframe = NULL;
 				stream->keyframe.temp_keyframe = NULL;
 				stream->keyframe.temp_ts = 0;
+				stream->keyframe.gop = NULL;
+				stream->keyframe.gop_last = NULL;
+				stream->keyframe.gop_bytes = 0;
 				janus_mutex_init(&stream->keyframe.mutex);
 			}
 		}
@@ -8742,6 +9063,12 @@ static int janus_streaming_rtsp_connect_to_server(janus_streaming_mountpoint *mp
 	source->curl = curl;
 	source->curl_errbuf = curl_errbuf;
 	source->curldata = curldata;
+	/* A (re)connect may have changed the negotiated media, don't
+	 * serve an offer we may have cached before to new subscribers */
+	janus_mutex_lock(&mp->mutex);
+	g_free(mp->cached_offer);
+	mp->cached_offer = NULL;
+	janus_mutex_unlock(&mp->mutex);
 	return 0;
 }
 
@@ -8839,6 +9166,26 @@ static int janus_streaming_rtsp_play(janus_streaming_rtp_source *source) {
 	return 0;
 }
 
+/* Bring-up worker: connects pending RTSP mountpoints at startup, in parallel */
+static void janus_streaming_mp_init_process(gpointer data, gpointer user_data) {
+	janus_streaming_mountpoint *mp = (janus_streaming_mountpoint *)data;
+	janus_streaming_rtp_source *source = (janus_streaming_rtp_source *)mp->source;
+	JANUS_LOG(LOG_VERB, "[%s] Bringing the RTSP mountpoint up...\n", mp->name);
+	if(janus_streaming_rtsp_connect_to_server(mp) < 0 || janus_streaming_rtsp_play(source) < 0) {
+		/* This mountpoint was configured to fail on errors, get rid of it */
+		JANUS_LOG(LOG_ERR, "[%s] Error connecting to the RTSP server, removing mountpoint...\n", mp->name);
+		janus_mutex_lock(&mountpoints_mutex);
+		g_hash_table_remove(mountpoints, &mp->id);
+		janus_mutex_unlock(&mountpoints_mutex);
+	} else {
+		/* We're up: unblock the relay thread */
+		source->reconnect_timer = janus_get_monotonic_time();
+		source->reconnecting = FALSE;
+		JANUS_LOG(LOG_INFO, "[%s] RTSP mountpoint is up\n", mp->name);
+	}
+	janus_refcount_decrease(&mp->ref);
+}
+
 /* Helper to create an RTSP source */
 janus_streaming_mountpoint *janus_streaming_create_rtsp_source(
 		uint64_t id, char *id_str, char *name, char *desc, char *metadata,
@@ -8903,6 +9250,8 @@ janus_streaming_mountpoint *janus_streaming_create_rtsp_source(
 	janus_streaming_mountpoint *live_rtsp = g_malloc0(sizeof(janus_streaming_mountpoint));
 	live_rtsp->id = id;
 	live_rtsp->id_str = g_strdup(id_str);
+	if(string_ids)
+		live_rtsp->id = janus_string_id_intern(live_rtsp->id_str);
 	live_rtsp->name = sourcename;
 	live_rtsp->description = description;
 	live_rtsp->metadata = (metadata ? g_strdup(metadata) : NULL);
@@ -8951,19 +9300,30 @@ janus_streaming_mountpoint *janus_streaming_create_rtsp_source(
 	if(dovideo && vcodec)
 		live_rtsp_source->rtsp_acodecs.video_codec = janus_videocodec_from_name(vcodec);
 	live_rtsp_source->rtsp_vcodecs.fmtp = dovideo ? (vfmtp ? g_strdup(vfmtp) : NULL) : NULL;
-	/* If we need to return an error on failure, try connecting right now */
+	/* If we need to return an error on failure, try connecting right now,
+	 * unless we're still initializing: in that case we delegate the attempt
+	 * to one of the bring-up workers instead, so that a slow or unreachable
+	 * camera doesn't delay the plugin startup (and the other mountpoints) */
+	gboolean pending = FALSE;
 	if(error_on_failure) {
-		/* Now connect to the RTSP server */
-		if(janus_streaming_rtsp_connect_to_server(live_rtsp) < 0) {
-			/* Error connecting, get rid of the mountpoint */
-			janus_refcount_decrease(&live_rtsp->ref);
-			return NULL;
-		}
-		/* Send an RTSP PLAY, now */
-		if(janus_streaming_rtsp_play(live_rtsp_source) < 0) {
-			/* Error trying to play, get rid of the mountpoint */
-			janus_refcount_decrease(&live_rtsp->ref);
-			return NULL;
+		if(g_atomic_int_get(&mp_init_phase) && mp_init_pool != NULL) {
+			/* Mark the mountpoint as pending: the relay thread will idle
+			 * until a worker has brought the session up (or given up) */
+			live_rtsp_source->reconnecting = TRUE;
+			pending = TRUE;
+		} else {
+			/* Now connect to the RTSP server */
+			if(janus_streaming_rtsp_connect_to_server(live_rtsp) < 0) {
+				/* Error connecting, get rid of the mountpoint */
+				janus_refcount_decrease(&live_rtsp->ref);
+				return NULL;
+			}
+			/* Send an RTSP PLAY, now */
+			if(janus_streaming_rtsp_play(live_rtsp_source) < 0) {
+				/* Error trying to play, get rid of the mountpoint */
+				janus_refcount_decrease(&live_rtsp->ref);
+				return NULL;
+			}
 		}
 	}
 	/* If we need helper threads, spawn them now */
@@ -8975,7 +9335,7 @@ janus_streaming_mountpoint *janus_streaming_create_rtsp_source(
 			janus_streaming_helper *helper = g_malloc0(sizeof(janus_streaming_helper));
 			helper->id = i+1;
 			helper->mp = live_rtsp;
-			helper->queued_packets = g_async_queue_new_full((GDestroyNotify)janus_streaming_rtp_relay_packet_free);
+			helper->queued_packets = g_async_queue_new_full((GDestroyNotify)janus_streaming_rtp_relay_packet_unref);
 			janus_mutex_init(&helper->mutex);
 			janus_refcount_init(&helper->ref, janus_streaming_helper_free);
 			live_rtsp->helper_threads++;
@@ -9000,6 +9360,8 @@ janus_streaming_mountpoint *janus_streaming_create_rtsp_source(
 			live_rtsp->threads = g_list_append(live_rtsp->threads, helper);
 		}
 	}
+	live_rtsp->helper_threads_base = live_rtsp->helper_threads;
+	live_rtsp->helpers_spawned = live_rtsp->helper_threads;
 	/* Finally, start the thread that will receive the media packets */
 	g_snprintf(tname, sizeof(tname), "mp %s", live_rtsp->id_str);
 	janus_refcount_increase(&live_rtsp->ref);
@@ -9014,10 +9376,15 @@ janus_streaming_mountpoint *janus_streaming_create_rtsp_source(
 	}
 	janus_mutex_lock(&mountpoints_mutex);
 	g_hash_table_insert(mountpoints,
-		string_ids ? (gpointer)g_strdup(live_rtsp->id_str) : (gpointer)janus_uint64_dup(live_rtsp->id),
+		janus_uint64_dup(live_rtsp->id),
 		live_rtsp);
 	g_hash_table_remove(mountpoints_temp, string_ids ? (gpointer)live_rtsp->id_str : (gpointer)&live_rtsp->id);
 	janus_mutex_unlock(&mountpoints_mutex);
+	if(pending) {
+		/* Have one of the bring-up workers connect to the RTSP server */
+		janus_refcount_increase(&live_rtsp->ref);
+		g_thread_pool_push(mp_init_pool, live_rtsp, NULL);
+	}
 	return live_rtsp;
 }
 #else
@@ -9035,6 +9402,69 @@ janus_streaming_mountpoint *janus_streaming_create_rtsp_source(
 }
 #endif
 
+/* Memory-mapped view of a raw file-based mountpoint source: reading a
+ * frame becomes a plain memcpy, and looped playback just rewinds the
+ * offset, with no syscalls or re-opening involved */
+typedef struct janus_streaming_file_map {
+	char *data;			/* Mapped contents of the file */
+	size_t size;		/* Size of the mapping */
+	size_t offset;		/* Where the next frame will be read from */
+} janus_streaming_file_map;
+static int janus_streaming_file_map_init(janus_streaming_file_map *map, FILE *file) {
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	if(size <= 0)
+		return -1;
+	char *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+	if(data == MAP_FAILED)
+		return -1;
+#ifdef MADV_SEQUENTIAL
+	/* Let the kernel read ahead for us */
+	(void)madvise(data, size, MADV_SEQUENTIAL | MADV_WILLNEED);
+#endif
+	map->data = data;
+	map->size = (size_t)size;
+	map->offset = 0;
+	return 0;
+}
+/* Helper to read a frame from the mapping: returns the frame size, or 0
+ * in case we reached the end of the file and rewound (the frame slot is
+ * skipped, just like the stdio reader did on EOF) */
+static int janus_streaming_file_map_read(janus_streaming_file_map *map, char *buf, size_t len) {
+	if(map->offset + len > map->size) {
+		/* Rewind */
+		map->offset = 0;
+		return 0;
+	}
+	memcpy(buf, map->data + map->offset, len);
+	map->offset += len;
+	return (int)len;
+}
+static void janus_streaming_file_map_cleanup(janus_streaming_file_map *map) {
+	if(map->data != NULL)
+		munmap(map->data, map->size);
+	map->data = NULL;
+}
+
+#ifdef __linux__
+/* Helper to wait for the next tick of a periodic pacing timerfd: since
+ * the kernel keeps track of the expirations we may have missed, pacing
+ * doesn't drift no matter how long each iteration takes; missed ticks
+ * are owed frames, which we send right away to catch up */
+static gboolean janus_streaming_timerfd_wait(int tfd, uint64_t *owed) {
+	if(*owed > 0) {
+		(*owed)--;
+		return TRUE;
+	}
+	uint64_t expirations = 0;
+	if(read(tfd, &expirations, sizeof(expirations)) != sizeof(expirations) || expirations == 0)
+		return FALSE;
+	*owed = expirations - 1;
+	return TRUE;
+}
+#endif
+
 /* Thread to send RTP packets from a file (on demand) */
 static void *janus_streaming_ondemand_thread(void *data) {
 	JANUS_LOG(LOG_VERB, "Filesource (on demand) RTP thread starting...\n");
@@ -9103,6 +9533,15 @@ static void *janus_streaming_ondemand_thread(void *data) {
 	}
 #endif
 
+	/* If this is a raw audio file, try to mmap() it, so that looped
+	 * playback doesn't involve any read/seek syscall or re-opening */
+	janus_streaming_file_map filemap = { 0 };
+	gboolean mapped = FALSE;
+	if(!source->opus) {
+		mapped = (janus_streaming_file_map_init(&filemap, audio) == 0);
+		if(!mapped)
+			JANUS_LOG(LOG_WARN, "[%s] Couldn't mmap() the file, falling back to stdio (%s)\n", name, source->filename);
+	}
 	/* Buffer */
 	char buf[1500];
 	memset(buf, 0, sizeof(buf));
@@ -9116,6 +9555,18 @@ static void *janus_streaming_ondemand_thread(void *data) {
 	header->seq_number = htons(seq);
 	header->timestamp = htonl(ts);
 	header->ssrc = htonl(1);	/* The gateway will fix this anyway */
+#ifdef __linux__
+	/* Pace ourselves with a periodic timerfd, when available */
+	int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	if(tfd != -1) {
+		struct itimerspec tspec = { { 0, 20000000 }, { 0, 20000000 } };
+		if(timerfd_settime(tfd, 0, &tspec, NULL) < 0) {
+			close(tfd);
+			tfd = -1;
+		}
+	}
+	uint64_t owed = 0;
+#endif
 	/* Timer */
 	struct timeval now, before;
 	gettimeofday(&before, NULL);
@@ -9131,6 +9582,14 @@ static void *janus_streaming_ondemand_thread(void *data) {
 	while(!g_atomic_int_get(&stopping) && !g_atomic_int_get(&mountpoint->destroyed) &&
 			!g_atomic_int_get(&session->stopping) && !g_atomic_int_get(&session->destroyed)) {
 		/* See if it's time to prepare a frame */
+#ifdef __linux__
+		if(tfd != -1) {
+			if(!janus_streaming_timerfd_wait(tfd, &owed)) {
+				g_usleep(5000);
+				continue;
+			}
+		} else {
+#endif
 		gettimeofday(&now, NULL);
 		d_s = now.tv_sec - before.tv_sec;
 		d_us = now.tv_usec - before.tv_usec;
@@ -9149,14 +9608,30 @@ static void *janus_streaming_ondemand_thread(void *data) {
 			before.tv_sec++;
 			before.tv_usec -= 1000000;
 		}
+#ifdef __linux__
+		}
+#endif
 		/* If not started or paused, wait some more */
-		if(!g_atomic_int_get(&session->started) || g_atomic_int_get(&session->paused) || !mountpoint->enabled)
+		if(!g_atomic_int_get(&session->started) || g_atomic_int_get(&session->paused) || !mountpoint->enabled) {
+#ifdef __linux__
+			/* Don't catch up on frames we skipped while paused */
+			owed = 0;
+#endif
 			continue;
+		}
 		if(source->opus) {
 #ifdef HAVE_LIBOGG
 			/* Get the next frame from the Opus file */
 			read = janus_streaming_opus_context_read(&opusctx, buf + RTP_HEADER_SIZE, plen);
 #endif
+		} else if(mapped) {
+			/* Read the next frame from the mapped file */
+			read = janus_streaming_file_map_read(&filemap, buf + RTP_HEADER_SIZE, 160);
+			if(read == 0) {
+				/* FIXME We're doing this forever... should this be configurable? */
+				JANUS_LOG(LOG_VERB, "[%s] Rewind! (%s)\n", name, source->filename);
+				continue;
+			}
 		} else {
 			/* Read frame from file... */
 			read = fread(buf + RTP_HEADER_SIZE, sizeof(char), 160, audio);
@@ -9196,6 +9671,12 @@ static void *janus_streaming_ondemand_thread(void *data) {
 	if(source->opus)
 		janus_streaming_opus_context_cleanup(&opusctx);
 #endif
+#ifdef __linux__
+	if(tfd != -1)
+		close(tfd);
+#endif
+	if(mapped)
+		janus_streaming_file_map_cleanup(&filemap);
 	g_free(name);
 	fclose(audio);
 	janus_refcount_decrease(&session->ref);
@@ -9255,6 +9736,15 @@ static void *janus_streaming_filesource_thread(void *data) {
 	}
 #endif
 
+	/* If this is a raw audio file, try to mmap() it, so that looped
+	 * playback doesn't involve any read/seek syscall or re-opening */
+	janus_streaming_file_map filemap = { 0 };
+	gboolean mapped = FALSE;
+	if(!source->opus) {
+		mapped = (janus_streaming_file_map_init(&filemap, audio) == 0);
+		if(!mapped)
+			JANUS_LOG(LOG_WARN, "[%s] Couldn't mmap() the file, falling back to stdio (%s)\n", name, source->filename);
+	}
 	/* Buffer */
 	char buf[1500];
 	memset(buf, 0, sizeof(buf));
@@ -9268,6 +9758,18 @@ static void *janus_streaming_filesource_thread(void *data) {
 	header->seq_number = htons(seq);
 	header->timestamp = htonl(ts);
 	header->ssrc = htonl(1);	/* The Janus core will fix this anyway */
+#ifdef __linux__
+	/* Pace ourselves with a periodic timerfd, when available */
+	int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	if(tfd != -1) {
+		struct itimerspec tspec = { { 0, 20000000 }, { 0, 20000000 } };
+		if(timerfd_settime(tfd, 0, &tspec, NULL) < 0) {
+			close(tfd);
+			tfd = -1;
+		}
+	}
+	uint64_t owed = 0;
+#endif
 	/* Timer */
 	struct timeval now, before;
 	gettimeofday(&before, NULL);
@@ -9282,6 +9784,14 @@ static void *janus_streaming_filesource_thread(void *data) {
 	janus_streaming_rtp_relay_packet packet;
 	while(!g_atomic_int_get(&stopping) && !g_atomic_int_get(&mountpoint->destroyed)) {
 		/* See if it's time to prepare a frame */
+#ifdef __linux__
+		if(tfd != -1) {
+			if(!janus_streaming_timerfd_wait(tfd, &owed)) {
+				g_usleep(5000);
+				continue;
+			}
+		} else {
+#endif
 		gettimeofday(&now, NULL);
 		d_s = now.tv_sec - before.tv_sec;
 		d_us = now.tv_usec - before.tv_usec;
@@ -9300,14 +9810,30 @@ static void *janus_streaming_filesource_thread(void *data) {
 			before.tv_sec++;
 			before.tv_usec -= 1000000;
 		}
+#ifdef __linux__
+		}
+#endif
 		/* If paused, wait some more */
-		if(!mountpoint->enabled)
+		if(!mountpoint->enabled) {
+#ifdef __linux__
+			/* Don't catch up on frames we skipped while paused */
+			owed = 0;
+#endif
 			continue;
+		}
 		if(source->opus) {
 #ifdef HAVE_LIBOGG
 			/* Get the next frame from the Opus file */
 			read = janus_streaming_opus_context_read(&opusctx, buf + RTP_HEADER_SIZE, plen);
 #endif
+		} else if(mapped) {
+			/* Read the next frame from the mapped file */
+			read = janus_streaming_file_map_read(&filemap, buf + RTP_HEADER_SIZE, 160);
+			if(read == 0) {
+				/* FIXME We're doing this forever... should this be configurable? */
+				JANUS_LOG(LOG_VERB, "[%s] Rewind! (%s)\n", name, source->filename);
+				continue;
+			}
 		} else {
 			/* Read frame from file... */
 			read = fread(buf + RTP_HEADER_SIZE, sizeof(char), 160, audio);
@@ -9349,12 +9875,168 @@ static void *janus_streaming_filesource_thread(void *data) {
 	if(source->opus)
 		janus_streaming_opus_context_cleanup(&opusctx);
 #endif
+#ifdef __linux__
+	if(tfd != -1)
+		close(tfd);
+#endif
+	if(mapped)
+		janus_streaming_file_map_cleanup(&filemap);
 	g_free(name);
 	fclose(audio);
 	janus_refcount_decrease(&mountpoint->ref);
 	return NULL;
 }
 
+/* Number of datagrams we try to read from a media socket in a single
+ * syscall: busy mountpoints are syscall-bound when reading one at a time */
+#define JANUS_STREAMING_RECV_BATCH	32
+
+/* How many bytes of the current GOP we're willing to cache per video
+ * stream, when buffering of keyframes is enabled */
+#define JANUS_STREAMING_GOP_CACHE_MAX_BYTES	(2*1024*1024)
+/* Helper to add a video packet to the GOP cache of a stream, within the
+ * configured budget (must be called with the keyframe mutex held) */
+static void janus_streaming_gop_cache_append(janus_streaming_rtp_source_stream *stream, char *buffer, int bytes, janus_rtp_header *rtp) {
+	if(stream->keyframe.gop == NULL) {
+		/* We haven't cached a whole keyframe yet */
+		return;
+	}
+	if(stream->keyframe.gop_bytes + (guint32)bytes > JANUS_STREAMING_GOP_CACHE_MAX_BYTES) {
+		/* Out of budget: keep what we have, new viewers will still get the keyframe */
+		return;
+	}
+	janus_streaming_rtp_relay_packet *pkt = janus_plugin_packet_pool_claim(&packet_pool, bytes);
+	pkt->mindex = stream->mindex;
+	pkt->data = (janus_rtp_header *)janus_plugin_packet_pool_buffer(&packet_pool, pkt);
+	memcpy(pkt->data, buffer, bytes);
+	pkt->data->ssrc = htons(1);
+	pkt->data->type = stream->codecs.pt;
+	pkt->is_rtp = TRUE;
+	pkt->is_video = TRUE;
+	pkt->length = bytes;
+	pkt->ptype = rtp->type;
+	pkt->timestamp = ntohl(rtp->timestamp);
+	pkt->seq_number = ntohs(rtp->seq_number);
+	g_atomic_int_set(&pkt->refcount, 1);
+	stream->keyframe.gop_last = g_list_append(stream->keyframe.gop_last, pkt);
+	if(stream->keyframe.gop_last->next != NULL)
+		stream->keyframe.gop_last = stream->keyframe.gop_last->next;
+	stream->keyframe.gop_bytes += bytes;
+}
+/* Helper to get rid of a cached GOP (must be called with the keyframe mutex held) */
+static void janus_streaming_gop_cache_clear(janus_streaming_rtp_source_stream *stream) {
+	if(stream->keyframe.gop != NULL)
+		g_list_free_full(stream->keyframe.gop, (GDestroyNotify)janus_streaming_rtp_relay_packet_unref);
+	stream->keyframe.gop = NULL;
+	stream->keyframe.gop_last = NULL;
+	stream->keyframe.gop_bytes = 0;
+}
+
+/* Autoscaling of helper threads: queue depth that triggers a scale up,
+ * and how many idle checks in a row are needed before we scale down */
+#define JANUS_STREAMING_HELPER_SCALE_UP_DEPTH		100
+#define JANUS_STREAMING_HELPER_SCALE_DOWN_ROUNDS	10
+/* Helper to spawn a new helper thread on a running mountpoint (the
+ * mountpoint mutex must be held by the caller) */
+static janus_streaming_helper *janus_streaming_helper_spawn(janus_streaming_mountpoint *mp) {
+	janus_streaming_helper *helper = g_malloc0(sizeof(janus_streaming_helper));
+	helper->id = ++mp->helpers_spawned;
+	helper->mp = mp;
+	helper->queued_packets = g_async_queue_new_full((GDestroyNotify)janus_streaming_rtp_relay_packet_unref);
+	janus_mutex_init(&helper->mutex);
+	janus_refcount_init(&helper->ref, janus_streaming_helper_free);
+	/* Spawn a thread and add references */
+	GError *error = NULL;
+	char tname[16];
+	g_snprintf(tname, sizeof(tname), "help %u-%"SCNu64, helper->id, mp->id);
+	janus_refcount_increase(&mp->ref);
+	janus_refcount_increase(&helper->ref);
+	helper->thread = g_thread_try_new(tname, &janus_streaming_helper_thread, helper, &error);
+	if(error != NULL) {
+		JANUS_LOG(LOG_ERR, "[%s] Got error %d (%s) trying to launch a new helper thread...\n",
+			mp->name, error->code, error->message ? error->message : "??");
+		g_error_free(error);
+		janus_refcount_decrease(&mp->ref);	/* This is for the helper thread */
+		janus_refcount_decrease(&helper->ref);
+		/* This extra unref is for the init */
+		janus_refcount_decrease(&helper->ref);
+		return NULL;
+	}
+	mp->threads = g_list_append(mp->threads, helper);
+	mp->helper_threads++;
+	JANUS_LOG(LOG_INFO, "[%s] Spawned new helper thread #%u (%d in total)\n",
+		mp->name, helper->id, mp->helper_threads);
+	return helper;
+}
+/* Helper to retire one of the helper threads of a mountpoint, moving its
+ * viewers to the remaining ones (the mountpoint mutex must be held) */
+static void janus_streaming_helper_retire(janus_streaming_mountpoint *mp, janus_streaming_helper *helper) {
+	mp->threads = g_list_remove(mp->threads, helper);
+	mp->helper_threads--;
+	/* Move the viewers of this helper to the least loaded remaining ones */
+	janus_mutex_lock(&helper->mutex);
+	GList *v = helper->viewers;
+	while(v) {
+		int viewers = -1;
+		janus_streaming_helper *target = NULL;
+		GList *l = mp->threads;
+		while(l) {
+			janus_streaming_helper *ht = (janus_streaming_helper *)l->data;
+			if(viewers == -1 || (target == NULL && ht->num_viewers == 0) || ht->num_viewers < viewers) {
+				viewers = ht->num_viewers;
+				target = ht;
+			}
+			l = l->next;
+		}
+		if(target == NULL)
+			break;
+		janus_mutex_lock(&target->mutex);
+		target->viewers = g_list_append(target->viewers, v->data);
+		target->num_viewers++;
+		janus_mutex_unlock(&target->mutex);
+		v = v->next;
+	}
+	g_list_free(helper->viewers);
+	helper->viewers = NULL;
+	helper->num_viewers = 0;
+	janus_mutex_unlock(&helper->mutex);
+	JANUS_LOG(LOG_INFO, "[%s] Retiring helper thread #%u (%d left)\n",
+		mp->name, helper->id, mp->helper_threads);
+	g_async_queue_push(helper->queued_packets, &exit_packet);
+	janus_streaming_helper_destroy(helper);
+}
+/* Helper to burst-read a batch of datagrams from a media socket: on Linux
+ * this translates to a single recvmmsg() syscall, on other platforms we
+ * just read one packet at a time. Returns the number of datagrams read */
+static int janus_streaming_recv_burst(int fd, char bufs[][1500], int *lens) {
+#ifdef __linux__
+	struct mmsghdr msgs[JANUS_STREAMING_RECV_BATCH];
+	struct iovec iovs[JANUS_STREAMING_RECV_BATCH];
+	memset(msgs, 0, sizeof(msgs));
+	int i = 0;
+	for(i=0; i<JANUS_STREAMING_RECV_BATCH; i++) {
+		iovs[i].iov_base = bufs[i];
+		iovs[i].iov_len = 1500;
+		msgs[i].msg_hdr.msg_iov = &iovs[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+	/* We only get here after a POLLIN, so there's at least one message:
+	 * MSG_DONTWAIT makes sure we don't block waiting for a full batch */
+	int res = recvmmsg(fd, msgs, JANUS_STREAMING_RECV_BATCH, MSG_DONTWAIT, NULL);
+	if(res < 1)
+		return 0;
+	for(i=0; i<res; i++)
+		lens[i] = msgs[i].msg_len;
+	return res;
+#else
+	int bytes = recv(fd, bufs[0], 1500, 0);
+	if(bytes < 1)
+		return 0;
+	lens[0] = bytes;
+	return 1;
+#endif
+}
+
 /* Thread to relay RTP frames coming from gstreamer/ffmpeg/others */
 static void *janus_streaming_relay_thread(void *data) {
 	JANUS_LOG(LOG_VERB, "Starting streaming relay thread\n");
@@ -9413,6 +10095,9 @@ static void *janus_streaming_relay_thread(void *data) {
 	struct pollfd *fds = g_malloc(num * sizeof(struct pollfd));
 	char buffer[1500];
 	memset(buffer, 0, 1500);
+	/* Batch of buffers for burst reads on the media sockets */
+	char bufs[JANUS_STREAMING_RECV_BATCH][1500];
+	int lens[JANUS_STREAMING_RECV_BATCH];
 	/* We'll have a dynamic number of streams */
 #ifdef HAVE_LIBCURL
 	/* In case this is an RTSP restreamer, we may have to send keep-alive from time to time */
@@ -9425,7 +10110,81 @@ static void *janus_streaming_relay_thread(void *data) {
 #endif
 	/* Loop */
 	janus_streaming_rtp_relay_packet packet;
+	gint64 last_autoscale = janus_get_monotonic_time();
+	int idle_rounds = 0;
 	while(!g_atomic_int_get(&stopping) && !g_atomic_int_get(&mountpoint->destroyed)) {
+		/* Check if we should scale the helper threads up or down */
+		if(helper_threads_max > 0 && mountpoint->helper_threads_base > 0 &&
+				(janus_get_monotonic_time() - last_autoscale) >= G_USEC_PER_SEC) {
+			last_autoscale = janus_get_monotonic_time();
+			janus_mutex_lock(&mountpoint->mutex);
+			/* Find the deepest helper queue */
+			int depth = 0;
+			GList *l = mountpoint->threads;
+			while(l) {
+				janus_streaming_helper *ht = (janus_streaming_helper *)l->data;
+				int qlen = g_async_queue_length(ht->queued_packets);
+				if(qlen > depth)
+					depth = qlen;
+				l = l->next;
+			}
+			if(depth > JANUS_STREAMING_HELPER_SCALE_UP_DEPTH &&
+					mountpoint->helper_threads < helper_threads_max) {
+				/* Helpers are lagging behind: spawn a new one and rebalance */
+				idle_rounds = 0;
+				janus_streaming_helper *helper = janus_streaming_helper_spawn(mountpoint);
+				if(helper != NULL) {
+					/* Move viewers from the busier helpers to the new one */
+					int total = 0;
+					l = mountpoint->threads;
+					while(l) {
+						total += ((janus_streaming_helper *)l->data)->num_viewers;
+						l = l->next;
+					}
+					int fair = total / mountpoint->helper_threads;
+					l = mountpoint->threads;
+					while(l) {
+						janus_streaming_helper *ht = (janus_streaming_helper *)l->data;
+						if(ht != helper && ht->num_viewers > fair) {
+							janus_mutex_lock(&ht->mutex);
+							janus_mutex_lock(&helper->mutex);
+							while(ht->num_viewers > fair && ht->viewers != NULL) {
+								gpointer s = ht->viewers->data;
+								ht->viewers = g_list_delete_link(ht->viewers, ht->viewers);
+								ht->num_viewers--;
+								helper->viewers = g_list_append(helper->viewers, s);
+								helper->num_viewers++;
+							}
+							janus_mutex_unlock(&helper->mutex);
+							janus_mutex_unlock(&ht->mutex);
+						}
+						l = l->next;
+					}
+				}
+			} else if(depth == 0 && mountpoint->helper_threads > mountpoint->helper_threads_base) {
+				idle_rounds++;
+				if(idle_rounds >= JANUS_STREAMING_HELPER_SCALE_DOWN_ROUNDS) {
+					/* Helpers have been idle for a while: retire the one with the fewest viewers */
+					idle_rounds = 0;
+					int viewers = -1;
+					janus_streaming_helper *victim = NULL;
+					l = mountpoint->threads;
+					while(l) {
+						janus_streaming_helper *ht = (janus_streaming_helper *)l->data;
+						if(viewers == -1 || ht->num_viewers < viewers) {
+							viewers = ht->num_viewers;
+							victim = ht;
+						}
+						l = l->next;
+					}
+					if(victim != NULL)
+						janus_streaming_helper_retire(mountpoint, victim);
+				}
+			} else {
+				idle_rounds = 0;
+			}
+			janus_mutex_unlock(&mountpoint->mutex);
+		}
 #ifdef HAVE_LIBCURL
 		/* Let's check regularly if the RTSP server seems to be gone */
 		if(source->rtsp) {
@@ -9650,79 +10409,92 @@ static void *janus_streaming_relay_thread(void *data) {
 #ifdef HAVE_LIBCURL
 					source->reconnect_timer = now;
 #endif
-					addrlen = sizeof(remote);
-					bytes = recvfrom(fds[i].fd, buffer, 1500, 0, (struct sockaddr *)&remote, &addrlen);
-					if(bytes < 0 || !janus_is_rtp(buffer, bytes)) {
-						/* Failed to read or not an RTP packet? */
-						continue;
-					}
-					janus_rtp_header *rtp = (janus_rtp_header *)buffer;
-					ssrc = ntohl(rtp->ssrc);
-					if(source->rtp_collision > 0 && stream->last_ssrc[0] && ssrc != stream->last_ssrc[0] &&
-							(now-stream->last_received[0]) < (gint64)1000*source->rtp_collision) {
-						JANUS_LOG(LOG_WARN, "[%s] RTP collision on audio mountpoint, dropping packet (#%d, ssrc=%"SCNu32")\n",
-							name, stream->mindex, ssrc);
-						continue;
-					}
-					stream->last_received[0] = now;
-					/* Do we have a new stream? */
-					if(ssrc != stream->last_ssrc[0]) {
-						stream->ssrc = stream->last_ssrc[0] = ssrc;
-						JANUS_LOG(LOG_INFO, "[%s] New audio stream! (#%d, ssrc=%"SCNu32")\n", name, stream->mindex, ssrc);
-					}
-					/* If paused, ignore this packet */
-					if(!mountpoint->enabled && !stream->rc)
-						continue;
-					/* Is this SRTP? */
-					if(source->is_srtp) {
-						int buflen = bytes;
-						srtp_err_status_t res = srtp_unprotect(source->srtp_ctx, buffer, &buflen);
-						if(res != srtp_err_status_ok) {
-							guint32 timestamp = ntohl(rtp->timestamp);
-							guint16 seq = ntohs(rtp->seq_number);
-							JANUS_LOG(LOG_ERR, "[%s] Audio (#%d) SRTP unprotect error: %s (len=%d-->%d, ts=%"SCNu32", seq=%"SCNu16")\n",
-								name, stream->mindex, janus_srtp_error_str(res), bytes, buflen, timestamp, seq);
+					int msgs = janus_streaming_recv_burst(fds[i].fd, bufs, lens);
+					int m = 0;
+					for(m = 0; m < msgs; m++) {
+						char *buffer = bufs[m];
+						int bytes = lens[m];
+						if(bytes < 1 || !janus_is_rtp(buffer, bytes)) {
+							/* Not an RTP packet? */
 							continue;
 						}
-						bytes = buflen;
-					}
-					/* Relay on all sessions */
-					packet.mindex = stream->mindex;
-					packet.data = rtp;
-					packet.length = bytes;
-					packet.is_rtp = TRUE;
-					packet.is_video = FALSE;
-					packet.is_keyframe = FALSE;
-					packet.data->type = stream->codecs.pt;
-					/* Is there a recorder? */
-					janus_rtp_header_update(packet.data, &stream->context[0], FALSE, 0);
-					if(stream->skew) {
-						int ret = janus_rtp_skew_compensate_audio(packet.data, &stream->context[0], now);
-						if(ret < 0) {
-							JANUS_LOG(LOG_WARN, "[%s] Dropping %d packets, audio source clock is too fast (#%d, ssrc=%"SCNu32")\n",
-								name, -ret, stream->mindex, ssrc);
+						janus_rtp_header *rtp = (janus_rtp_header *)buffer;
+						ssrc = ntohl(rtp->ssrc);
+						if(source->failover > 0 && stream->last_ssrc[0] && ssrc != stream->last_ssrc[0]) {
+							if((now-stream->last_received[0]) < (gint64)1000*source->failover) {
+								/* The active source is still alive, ignore the standby */
+								continue;
+							}
+							JANUS_LOG(LOG_WARN, "[%s] No audio from the active source in %dms, failing over (#%d, ssrc=%"SCNu32")\n",
+								name, source->failover, stream->mindex, ssrc);
+						} else if(source->rtp_collision > 0 && stream->last_ssrc[0] && ssrc != stream->last_ssrc[0] &&
+								(now-stream->last_received[0]) < (gint64)1000*source->rtp_collision) {
+							JANUS_LOG(LOG_WARN, "[%s] RTP collision on audio mountpoint, dropping packet (#%d, ssrc=%"SCNu32")\n",
+								name, stream->mindex, ssrc);
 							continue;
-						} else if(ret > 0) {
-							JANUS_LOG(LOG_WARN, "[%s] Jumping %d RTP sequence numbers, audio source clock is too slow (#%d, ssrc=%"SCNu32")\n",
-								name, ret, stream->mindex, ssrc);
 						}
-					}
-					if(stream->rc) {
-						packet.data->ssrc = htonl((uint32_t)mountpoint->id);
-						janus_recorder_save_frame(stream->rc, buffer, bytes);
-					}
-					if(mountpoint->enabled) {
-						packet.data->ssrc = htonl(ssrc);
-						/* Backup the actual payload type, timestamp and sequence number set by the restreamer, in case switching is involved */
-						packet.ptype = packet.data->type;
-						packet.timestamp = ntohl(packet.data->timestamp);
-						packet.seq_number = ntohs(packet.data->seq_number);
-						/* Go! */
-						janus_mutex_lock(&mountpoint->mutex);
-						g_list_foreach(mountpoint->helper_threads == 0 ? mountpoint->viewers : mountpoint->threads,
-							mountpoint->helper_threads == 0 ? janus_streaming_relay_rtp_packet : janus_streaming_helper_rtprtcp_packet,
-							&packet);
-						janus_mutex_unlock(&mountpoint->mutex);
+						stream->last_received[0] = now;
+						/* Do we have a new stream? */
+						if(ssrc != stream->last_ssrc[0]) {
+							stream->ssrc = stream->last_ssrc[0] = ssrc;
+							JANUS_LOG(LOG_INFO, "[%s] New audio stream! (#%d, ssrc=%"SCNu32")\n", name, stream->mindex, ssrc);
+						}
+						/* If paused, ignore this packet */
+						if(!mountpoint->enabled && !stream->rc)
+							continue;
+						/* Is this SRTP? */
+						if(source->is_srtp) {
+							int buflen = bytes;
+							srtp_err_status_t res = srtp_unprotect(source->srtp_ctx, buffer, &buflen);
+							if(res != srtp_err_status_ok) {
+								guint32 timestamp = ntohl(rtp->timestamp);
+								guint16 seq = ntohs(rtp->seq_number);
+								JANUS_LOG(LOG_ERR, "[%s] Audio (#%d) SRTP unprotect error: %s (len=%d-->%d, ts=%"SCNu32", seq=%"SCNu16")\n",
+									name, stream->mindex, janus_srtp_error_str(res), bytes, buflen, timestamp, seq);
+								continue;
+							}
+							bytes = buflen;
+						}
+						/* Relay on all sessions */
+						packet.mindex = stream->mindex;
+						packet.data = rtp;
+						packet.length = bytes;
+						packet.is_rtp = TRUE;
+						packet.is_video = FALSE;
+						packet.is_keyframe = FALSE;
+						packet.data->type = stream->codecs.pt;
+						/* Is there a recorder? */
+						janus_rtp_header_update(packet.data, &stream->context[0], FALSE, 0);
+						if(stream->skew) {
+							int ret = janus_rtp_skew_compensate_audio(packet.data, &stream->context[0], now);
+							if(ret < 0) {
+								JANUS_LOG(LOG_WARN, "[%s] Dropping %d packets, audio source clock is too fast (#%d, ssrc=%"SCNu32")\n",
+									name, -ret, stream->mindex, ssrc);
+								continue;
+							} else if(ret > 0) {
+								JANUS_LOG(LOG_WARN, "[%s] Jumping %d RTP sequence numbers, audio source clock is too slow (#%d, ssrc=%"SCNu32")\n",
+									name, ret, stream->mindex, ssrc);
+							}
+						}
+						if(stream->rc) {
+							packet.data->ssrc = htonl((uint32_t)mountpoint->id);
+							janus_recorder_save_frame(stream->rc, buffer, bytes);
+						}
+						if(mountpoint->enabled) {
+							packet.data->ssrc = htonl(ssrc);
+							/* Backup the actual payload type, timestamp and sequence number set by the restreamer, in case switching is involved */
+							packet.ptype = packet.data->type;
+							packet.timestamp = ntohl(packet.data->timestamp);
+							packet.seq_number = ntohs(packet.data->seq_number);
+							/* Go! */
+							janus_mutex_lock(&mountpoint->mutex);
+							if(mountpoint->helper_threads == 0) {
+								g_list_foreach(mountpoint->viewers, janus_streaming_relay_rtp_packet, &packet);
+							} else {
+								janus_streaming_helper_rtprtcp_packet(mountpoint, &packet);
+							}
+							janus_mutex_unlock(&mountpoint->mutex);
+						}
 					}
 					continue;
 				} else if(stream->type == JANUS_STREAMING_MEDIA_VIDEO && ((fds[i].fd == stream->fd[0]) ||
@@ -9741,230 +10513,265 @@ static void *janus_streaming_relay_thread(void *data) {
 #ifdef HAVE_LIBCURL
 					source->reconnect_timer = now;
 #endif
-					addrlen = sizeof(remote);
-					bytes = recvfrom(fds[i].fd, buffer, 1500, 0, (struct sockaddr *)&remote, &addrlen);
-					if(bytes < 0 || !janus_is_rtp(buffer, bytes)) {
-						/* Failed to read or not an RTP packet? */
-						continue;
-					}
-					janus_rtp_header *rtp = (janus_rtp_header *)buffer;
-					ssrc = ntohl(rtp->ssrc);
-					if(source->rtp_collision > 0 && stream->last_ssrc[index] && ssrc != stream->last_ssrc[index] &&
-							(now-stream->last_received[index]) < (gint64)1000*source->rtp_collision) {
-						JANUS_LOG(LOG_WARN, "[%s] RTP collision on video mountpoint, dropping packet (#%d, ssrc=%"SCNu32")\n",
-							name, stream->mindex, ssrc);
-						continue;
-					}
-					stream->last_received[index] = now;
-					/* Do we have a new stream? */
-					if(ssrc != stream->last_ssrc[index]) {
-						stream->last_ssrc[index] = ssrc;
-						if(index == 0)
-							stream->ssrc = ssrc;
-						JANUS_LOG(LOG_INFO, "[%s] New video stream! (#%d, ssrc=%"SCNu32", index %d)\n",
-							name, stream->mindex, ssrc, index);
-					}
-					/* Is this SRTP? */
-					if(source->is_srtp) {
-						int buflen = bytes;
-						srtp_err_status_t res = srtp_unprotect(source->srtp_ctx, buffer, &buflen);
-						if(res != srtp_err_status_ok) {
-							guint32 timestamp = ntohl(rtp->timestamp);
-							guint16 seq = ntohs(rtp->seq_number);
-							JANUS_LOG(LOG_ERR, "[%s] Video (#%d) SRTP unprotect error: %s (len=%d-->%d, ts=%"SCNu32", seq=%"SCNu16")\n",
-								name, stream->mindex, janus_srtp_error_str(res), bytes, buflen, timestamp, seq);
+					int msgs = janus_streaming_recv_burst(fds[i].fd, bufs, lens);
+					int m = 0;
+					for(m = 0; m < msgs; m++) {
+						char *buffer = bufs[m];
+						int bytes = lens[m];
+						if(bytes < 1 || !janus_is_rtp(buffer, bytes)) {
+							/* Not an RTP packet? */
 							continue;
 						}
-						bytes = buflen;
-					}
-					/* First of all, let's check if this is (part of) a keyframe that we may need to save it for future reference */
-					if(index == 0 && stream->keyframe.enabled) {
-						if(stream->keyframe.temp_ts > 0 && ntohl(rtp->timestamp) != stream->keyframe.temp_ts) {
-							/* We received the last part of the keyframe, get rid of the old one and use this from now on */
-							JANUS_LOG(LOG_HUGE, "[%s] ... ... last part of keyframe received! ts=%"SCNu32", %d packets\n",
-								name, stream->keyframe.temp_ts, g_list_length(stream->keyframe.temp_keyframe));
-							stream->keyframe.temp_ts = 0;
-							janus_mutex_lock(&stream->keyframe.mutex);
-							if(stream->keyframe.latest_keyframe != NULL)
-								g_list_free_full(stream->keyframe.latest_keyframe, (GDestroyNotify)janus_streaming_rtp_relay_packet_free);
-							stream->keyframe.latest_keyframe = stream->keyframe.temp_keyframe;
-							stream->keyframe.temp_keyframe = NULL;
-							janus_mutex_unlock(&stream->keyframe.mutex);
-						} else if(ntohl(rtp->timestamp) == stream->keyframe.temp_ts) {
-							/* Part of the keyframe we're currently saving, store */
-							janus_mutex_lock(&stream->keyframe.mutex);
-							JANUS_LOG(LOG_HUGE, "[%s] ... other part of keyframe received! ts=%"SCNu32"\n", name, stream->keyframe.temp_ts);
-							janus_streaming_rtp_relay_packet *pkt = g_malloc0(sizeof(janus_streaming_rtp_relay_packet));
-							pkt->mindex = stream->mindex;
-							pkt->data = g_malloc(bytes);
-							memcpy(pkt->data, buffer, bytes);
-							pkt->data->ssrc = htons(1);
-							pkt->data->type = stream->codecs.pt;
-							pkt->is_rtp = TRUE;
-							pkt->is_video = TRUE;
-							pkt->is_keyframe = TRUE;
-							pkt->length = bytes;
-							pkt->ptype = rtp->type;
-							pkt->timestamp = stream->keyframe.temp_ts;
-							pkt->seq_number = ntohs(rtp->seq_number);
-							stream->keyframe.temp_keyframe = g_list_append(stream->keyframe.temp_keyframe, pkt);
-							janus_mutex_unlock(&stream->keyframe.mutex);
-						} else {
-							gboolean kf = FALSE;
-							/* Parse RTP header first */
-							janus_rtp_header *header = (janus_rtp_header *)buffer;
-							guint32 timestamp = ntohl(header->timestamp);
-							guint16 seq = ntohs(header->seq_number);
-							JANUS_LOG(LOG_HUGE, "Checking if packet (size=%d, seq=%"SCNu16", ts=%"SCNu32") is a key frame...\n",
-								bytes, seq, timestamp);
+						janus_rtp_header *rtp = (janus_rtp_header *)buffer;
+						ssrc = ntohl(rtp->ssrc);
+						if(source->failover > 0 && stream->last_ssrc[index] && ssrc != stream->last_ssrc[index]) {
+							if((now-stream->last_received[index]) < (gint64)1000*source->failover) {
+								/* The active source is still alive, ignore the standby */
+								continue;
+							}
+							JANUS_LOG(LOG_WARN, "[%s] No video from the active source in %dms, failing over (#%d, ssrc=%"SCNu32", index %d)\n",
+								name, source->failover, stream->mindex, ssrc, index);
+						} else if(source->rtp_collision > 0 && stream->last_ssrc[index] && ssrc != stream->last_ssrc[index] &&
+								(now-stream->last_received[index]) < (gint64)1000*source->rtp_collision) {
+							JANUS_LOG(LOG_WARN, "[%s] RTP collision on video mountpoint, dropping packet (#%d, ssrc=%"SCNu32")\n",
+								name, stream->mindex, ssrc);
+							continue;
+						}
+						stream->last_received[index] = now;
+						/* Do we have a new stream? */
+						if(ssrc != stream->last_ssrc[index]) {
+							stream->last_ssrc[index] = ssrc;
+							if(index == 0)
+								stream->ssrc = ssrc;
+							JANUS_LOG(LOG_INFO, "[%s] New video stream! (#%d, ssrc=%"SCNu32", index %d)\n",
+								name, stream->mindex, ssrc, index);
+						}
+						/* Is this SRTP? */
+						if(source->is_srtp) {
+							int buflen = bytes;
+							srtp_err_status_t res = srtp_unprotect(source->srtp_ctx, buffer, &buflen);
+							if(res != srtp_err_status_ok) {
+								guint32 timestamp = ntohl(rtp->timestamp);
+								guint16 seq = ntohs(rtp->seq_number);
+								JANUS_LOG(LOG_ERR, "[%s] Video (#%d) SRTP unprotect error: %s (len=%d-->%d, ts=%"SCNu32", seq=%"SCNu16")\n",
+									name, stream->mindex, janus_srtp_error_str(res), bytes, buflen, timestamp, seq);
+								continue;
+							}
+							bytes = buflen;
+						}
+						/* First of all, let's check if this is (part of) a keyframe that we may need to save it for future reference */
+						if(index == 0 && stream->keyframe.enabled) {
+							if(stream->keyframe.temp_ts > 0 && ntohl(rtp->timestamp) != stream->keyframe.temp_ts) {
+								/* We received the last part of the keyframe, get rid of the old one and use this from now on */
+								JANUS_LOG(LOG_HUGE, "[%s] ... ... last part of keyframe received! ts=%"SCNu32", %d packets\n",
+									name, stream->keyframe.temp_ts, g_list_length(stream->keyframe.temp_keyframe));
+								stream->keyframe.temp_ts = 0;
+								janus_mutex_lock(&stream->keyframe.mutex);
+								if(stream->keyframe.latest_keyframe != NULL)
+									g_list_free_full(stream->keyframe.latest_keyframe, (GDestroyNotify)janus_streaming_rtp_relay_packet_unref);
+								stream->keyframe.latest_keyframe = stream->keyframe.temp_keyframe;
+								stream->keyframe.temp_keyframe = NULL;
+								/* The new keyframe also starts a new GOP cache */
+								janus_streaming_gop_cache_clear(stream);
+								stream->keyframe.gop = g_list_copy(stream->keyframe.latest_keyframe);
+								stream->keyframe.gop_last = g_list_last(stream->keyframe.gop);
+								GList *kf = stream->keyframe.gop;
+								while(kf) {
+									janus_streaming_rtp_relay_packet *kfpkt = (janus_streaming_rtp_relay_packet *)kf->data;
+									g_atomic_int_inc(&kfpkt->refcount);
+									stream->keyframe.gop_bytes += kfpkt->length;
+									kf = kf->next;
+								}
+								/* This packet follows the keyframe, so it's part of the new GOP too */
+								janus_streaming_gop_cache_append(stream, buffer, bytes, rtp);
+								janus_mutex_unlock(&stream->keyframe.mutex);
+							} else if(ntohl(rtp->timestamp) == stream->keyframe.temp_ts) {
+								/* Part of the keyframe we're currently saving, store */
+								janus_mutex_lock(&stream->keyframe.mutex);
+								JANUS_LOG(LOG_HUGE, "[%s] ... other part of keyframe received! ts=%"SCNu32"\n", name, stream->keyframe.temp_ts);
+								janus_streaming_rtp_relay_packet *pkt = janus_plugin_packet_pool_claim(&packet_pool, bytes);
+								pkt->mindex = stream->mindex;
+								pkt->data = (janus_rtp_header *)janus_plugin_packet_pool_buffer(&packet_pool, pkt);
+								memcpy(pkt->data, buffer, bytes);
+								pkt->data->ssrc = htons(1);
+								pkt->data->type = stream->codecs.pt;
+								pkt->is_rtp = TRUE;
+								pkt->is_video = TRUE;
+								pkt->is_keyframe = TRUE;
+								pkt->length = bytes;
+								pkt->ptype = rtp->type;
+								pkt->timestamp = stream->keyframe.temp_ts;
+								pkt->seq_number = ntohs(rtp->seq_number);
+								g_atomic_int_set(&pkt->refcount, 1);
+								stream->keyframe.temp_keyframe = g_list_append(stream->keyframe.temp_keyframe, pkt);
+								janus_mutex_unlock(&stream->keyframe.mutex);
+							} else {
+								gboolean kf = FALSE;
+								/* Parse RTP header first */
+								janus_rtp_header *header = (janus_rtp_header *)buffer;
+								guint32 timestamp = ntohl(header->timestamp);
+								guint16 seq = ntohs(header->seq_number);
+								JANUS_LOG(LOG_HUGE, "Checking if packet (size=%d, seq=%"SCNu16", ts=%"SCNu32") is a key frame...\n",
+									bytes, seq, timestamp);
+								int plen = 0;
+								char *payload = janus_rtp_payload(buffer, bytes, &plen);
+								if(payload) {
+									switch(stream->codecs.video_codec) {
+										case JANUS_VIDEOCODEC_VP8:
+											kf = janus_vp8_is_keyframe(payload, plen);
+											break;
+										case JANUS_VIDEOCODEC_VP9:
+											kf = janus_vp9_is_keyframe(payload, plen);
+											break;
+										case JANUS_VIDEOCODEC_H264:
+											kf = janus_h264_is_keyframe(payload, plen);
+											break;
+										case JANUS_VIDEOCODEC_AV1:
+											kf = janus_av1_is_keyframe(payload, plen);
+											break;
+										case JANUS_VIDEOCODEC_H265:
+											kf = janus_h265_is_keyframe(payload, plen);
+											break;
+										default:
+											break;
+									}
+									if(kf) {
+										/* New keyframe, start saving it */
+										stream->keyframe.temp_ts = ntohl(rtp->timestamp);
+										JANUS_LOG(LOG_HUGE, "[%s] New keyframe received! ts=%"SCNu32"\n", name, stream->keyframe.temp_ts);
+										janus_mutex_lock(&stream->keyframe.mutex);
+										janus_streaming_rtp_relay_packet *pkt = janus_plugin_packet_pool_claim(&packet_pool, bytes);
+										pkt->mindex = stream->mindex;
+										pkt->data = (janus_rtp_header *)janus_plugin_packet_pool_buffer(&packet_pool, pkt);
+										memcpy(pkt->data, buffer, bytes);
+										pkt->data->ssrc = htons(1);
+										pkt->data->type = stream->codecs.pt;
+										pkt->is_rtp = TRUE;
+										pkt->is_video = TRUE;
+										pkt->is_keyframe = TRUE;
+										pkt->length = bytes;
+										pkt->ptype = rtp->type;
+										pkt->timestamp = stream->keyframe.temp_ts;
+										pkt->seq_number = ntohs(rtp->seq_number);
+										g_atomic_int_set(&pkt->refcount, 1);
+										stream->keyframe.temp_keyframe = g_list_append(stream->keyframe.temp_keyframe, pkt);
+										janus_mutex_unlock(&stream->keyframe.mutex);
+									} else {
+										/* Not a keyframe: add it to the GOP cache, for new viewers */
+										janus_mutex_lock(&stream->keyframe.mutex);
+										janus_streaming_gop_cache_append(stream, buffer, bytes, rtp);
+										janus_mutex_unlock(&stream->keyframe.mutex);
+									}
+								}
+							}
+						}
+						/* If paused, ignore this packet */
+						if(!mountpoint->enabled && !stream->rc)
+							continue;
+						/* Relay on all sessions */
+						packet.mindex = stream->mindex;
+						packet.data = rtp;
+						packet.length = bytes;
+						packet.is_rtp = TRUE;
+						packet.is_video = TRUE;
+						packet.is_keyframe = FALSE;
+						packet.simulcast = stream->simulcast;
+						packet.substream = index;
+						packet.codec = stream->codecs.video_codec;
+						packet.svc = FALSE;
+						if(stream->svc) {
+							/* We're doing SVC: let's parse this packet to see which layers are there */
 							int plen = 0;
 							char *payload = janus_rtp_payload(buffer, bytes, &plen);
 							if(payload) {
-								switch(stream->codecs.video_codec) {
-									case JANUS_VIDEOCODEC_VP8:
-										kf = janus_vp8_is_keyframe(payload, plen);
-										break;
-									case JANUS_VIDEOCODEC_VP9:
-										kf = janus_vp9_is_keyframe(payload, plen);
-										break;
-									case JANUS_VIDEOCODEC_H264:
-										kf = janus_h264_is_keyframe(payload, plen);
-										break;
-									case JANUS_VIDEOCODEC_AV1:
-										kf = janus_av1_is_keyframe(payload, plen);
-										break;
-									case JANUS_VIDEOCODEC_H265:
-										kf = janus_h265_is_keyframe(payload, plen);
-										break;
-									default:
-										break;
-								}
-								if(kf) {
-									/* New keyframe, start saving it */
-									stream->keyframe.temp_ts = ntohl(rtp->timestamp);
-									JANUS_LOG(LOG_HUGE, "[%s] New keyframe received! ts=%"SCNu32"\n", name, stream->keyframe.temp_ts);
-									janus_mutex_lock(&stream->keyframe.mutex);
-									janus_streaming_rtp_relay_packet *pkt = g_malloc0(sizeof(janus_streaming_rtp_relay_packet));
-									pkt->mindex = stream->mindex;
-									pkt->data = g_malloc(bytes);
-									memcpy(pkt->data, buffer, bytes);
-									pkt->data->ssrc = htons(1);
-									pkt->data->type = stream->codecs.pt;
-									pkt->is_rtp = TRUE;
-									pkt->is_video = TRUE;
-									pkt->is_keyframe = TRUE;
-									pkt->length = bytes;
-									pkt->ptype = rtp->type;
-									pkt->timestamp = stream->keyframe.temp_ts;
-									pkt->seq_number = ntohs(rtp->seq_number);
-									stream->keyframe.temp_keyframe = g_list_append(stream->keyframe.temp_keyframe, pkt);
-									janus_mutex_unlock(&stream->keyframe.mutex);
+								gboolean found = FALSE;
+								memset(&packet.svc_info, 0, sizeof(packet.svc_info));
+								if(janus_vp9_parse_svc(payload, plen, &found, &packet.svc_info) == 0) {
+									packet.svc = found;
 								}
 							}
 						}
-					}
-					/* If paused, ignore this packet */
-					if(!mountpoint->enabled && !stream->rc)
-						continue;
-					/* Relay on all sessions */
-					packet.mindex = stream->mindex;
-					packet.data = rtp;
-					packet.length = bytes;
-					packet.is_rtp = TRUE;
-					packet.is_video = TRUE;
-					packet.is_keyframe = FALSE;
-					packet.simulcast = stream->simulcast;
-					packet.substream = index;
-					packet.codec = stream->codecs.video_codec;
-					packet.svc = FALSE;
-					if(stream->svc) {
-						/* We're doing SVC: let's parse this packet to see which layers are there */
-						int plen = 0;
-						char *payload = janus_rtp_payload(buffer, bytes, &plen);
-						if(payload) {
-							gboolean found = FALSE;
-							memset(&packet.svc_info, 0, sizeof(packet.svc_info));
-							if(janus_vp9_parse_svc(payload, plen, &found, &packet.svc_info) == 0) {
-								packet.svc = found;
+						packet.data->type = stream->codecs.pt;
+						/* Is there a recorder? (FIXME notice we only record the first substream, if simulcasting) */
+						janus_rtp_header_update(packet.data, &stream->context[index], TRUE, 0);
+						if(stream->skew) {
+							int ret = janus_rtp_skew_compensate_video(packet.data, &stream->context[index], now);
+							if(ret < 0) {
+								JANUS_LOG(LOG_WARN, "[%s] Dropping %d packets, video source clock is too fast (#%d, ssrc=%"SCNu32", index %d)\n",
+									name, -ret, stream->mindex, ssrc, index);
+								continue;
+							} else if(ret > 0) {
+								JANUS_LOG(LOG_WARN, "[%s] Jumping %d RTP sequence numbers, video source clock is too slow (#%d, ssrc=%"SCNu32", index %d)\n",
+									name, ret, stream->mindex, ssrc, index);
 							}
 						}
-					}
-					packet.data->type = stream->codecs.pt;
-					/* Is there a recorder? (FIXME notice we only record the first substream, if simulcasting) */
-					janus_rtp_header_update(packet.data, &stream->context[index], TRUE, 0);
-					if(stream->skew) {
-						int ret = janus_rtp_skew_compensate_video(packet.data, &stream->context[index], now);
-						if(ret < 0) {
-							JANUS_LOG(LOG_WARN, "[%s] Dropping %d packets, video source clock is too fast (#%d, ssrc=%"SCNu32", index %d)\n",
-								name, -ret, stream->mindex, ssrc, index);
-							continue;
-						} else if(ret > 0) {
-							JANUS_LOG(LOG_WARN, "[%s] Jumping %d RTP sequence numbers, video source clock is too slow (#%d, ssrc=%"SCNu32", index %d)\n",
-								name, ret, stream->mindex, ssrc, index);
+						if(stream->h264_spspps) {
+							int plen = 0;
+							char *payload = janus_rtp_payload((char *)packet.data, bytes, &plen);
+							/* We have our own SPS/PPS to send, check if we just received a keyframe */
+							if(payload && janus_h264_is_i_frame(payload, plen)) {
+								/* This is an I-frame: prepend an SPS/PPS packet */
+								janus_rtp_header *sps_rtp = (janus_rtp_header *)stream->h264_spspps;
+								sps_rtp->type = rtp->type;
+								sps_rtp->seq_number = rtp->seq_number;
+								rtp->seq_number = htons(ntohs(rtp->seq_number) + 1);
+								stream->context[index].base_seq--;
+								sps_rtp->timestamp = rtp->timestamp;
+								/* Save the packet, if needed */
+								sps_rtp->ssrc = htonl((uint32_t)mountpoint->id);
+								janus_recorder_save_frame(stream->rc, stream->h264_spspps, stream->h264_spspps_len);
+								sps_rtp->ssrc = rtp->ssrc;
+								/* Relay on all sessions */
+								janus_streaming_rtp_relay_packet spspkt = { 0 };
+								spspkt.mindex = stream->mindex;
+								spspkt.data = sps_rtp;
+								spspkt.length = stream->h264_spspps_len;
+								spspkt.is_rtp = TRUE;
+								spspkt.is_video = TRUE;
+								spspkt.is_keyframe = FALSE;
+								spspkt.simulcast = FALSE;
+								spspkt.codec = stream->codecs.video_codec;
+								spspkt.svc = FALSE;
+								spspkt.ptype = spspkt.data->type;
+								spspkt.timestamp = ntohl(spspkt.data->timestamp);
+								spspkt.seq_number = ntohs(spspkt.data->seq_number);
+								janus_mutex_lock(&mountpoint->mutex);
+								JANUS_LOG(LOG_HUGE, "[%s] Sending SPS/PPS (seq=%"SCNu16", ts=%"SCNu32")\n", name,
+									ntohs(spspkt.data->seq_number), ntohl(spspkt.data->timestamp));
+								if(mountpoint->helper_threads == 0) {
+									g_list_foreach(mountpoint->viewers, janus_streaming_relay_rtp_packet, &spspkt);
+								} else {
+									janus_streaming_helper_rtprtcp_packet(mountpoint, &spspkt);
+								}
+								janus_mutex_unlock(&mountpoint->mutex);
+							}
 						}
-					}
-					if(stream->h264_spspps) {
-						int plen = 0;
-						char *payload = janus_rtp_payload((char *)packet.data, bytes, &plen);
-						/* We have our own SPS/PPS to send, check if we just received a keyframe */
-						if(payload && janus_h264_is_i_frame(payload, plen)) {
-							/* This is an I-frame: prepend an SPS/PPS packet */
-							janus_rtp_header *sps_rtp = (janus_rtp_header *)stream->h264_spspps;
-							sps_rtp->type = rtp->type;
-							sps_rtp->seq_number = rtp->seq_number;
-							rtp->seq_number = htons(ntohs(rtp->seq_number) + 1);
-							stream->context[index].base_seq--;
-							sps_rtp->timestamp = rtp->timestamp;
-							/* Save the packet, if needed */
-							sps_rtp->ssrc = htonl((uint32_t)mountpoint->id);
-							janus_recorder_save_frame(stream->rc, stream->h264_spspps, stream->h264_spspps_len);
-							sps_rtp->ssrc = rtp->ssrc;
-							/* Relay on all sessions */
-							janus_streaming_rtp_relay_packet spspkt = { 0 };
-							spspkt.mindex = stream->mindex;
-							spspkt.data = sps_rtp;
-							spspkt.length = stream->h264_spspps_len;
-							spspkt.is_rtp = TRUE;
-							spspkt.is_video = TRUE;
-							spspkt.is_keyframe = FALSE;
-							spspkt.simulcast = FALSE;
-							spspkt.codec = stream->codecs.video_codec;
-							spspkt.svc = FALSE;
-							spspkt.ptype = spspkt.data->type;
-							spspkt.timestamp = ntohl(spspkt.data->timestamp);
-							spspkt.seq_number = ntohs(spspkt.data->seq_number);
+						if(index == 0 && stream->rc) {
+							packet.data->ssrc = htonl((uint32_t)mountpoint->id);
+							janus_recorder_save_frame(stream->rc, buffer, bytes);
+						}
+						if(mountpoint->enabled) {
+							packet.data->ssrc = htonl(ssrc);
+							/* Backup the actual payload type, timestamp and sequence number set by the restreamer, in case switching is involved */
+							packet.ptype = packet.data->type;
+							packet.timestamp = ntohl(packet.data->timestamp);
+							packet.seq_number = ntohs(packet.data->seq_number);
+							/* Take note of the simulcast SSRCs */
+							if(stream->simulcast) {
+								packet.ssrc[0] = stream->last_ssrc[0];
+								packet.ssrc[1] = stream->last_ssrc[1];
+								packet.ssrc[2] = stream->last_ssrc[2];
+							}
+							/* Go! */
 							janus_mutex_lock(&mountpoint->mutex);
-							JANUS_LOG(LOG_HUGE, "[%s] Sending SPS/PPS (seq=%"SCNu16", ts=%"SCNu32")\n", name,
-								ntohs(spspkt.data->seq_number), ntohl(spspkt.data->timestamp));
-							g_list_foreach(mountpoint->helper_threads == 0 ? mountpoint->viewers : mountpoint->threads,
-								mountpoint->helper_threads == 0 ? janus_streaming_relay_rtp_packet : janus_streaming_helper_rtprtcp_packet,
-								&spspkt);
+							if(mountpoint->helper_threads == 0) {
+								g_list_foreach(mountpoint->viewers, janus_streaming_relay_rtp_packet, &packet);
+							} else {
+								janus_streaming_helper_rtprtcp_packet(mountpoint, &packet);
+							}
 							janus_mutex_unlock(&mountpoint->mutex);
 						}
 					}
-					if(index == 0 && stream->rc) {
-						packet.data->ssrc = htonl((uint32_t)mountpoint->id);
-						janus_recorder_save_frame(stream->rc, buffer, bytes);
-					}
-					if(mountpoint->enabled) {
-						packet.data->ssrc = htonl(ssrc);
-						/* Backup the actual payload type, timestamp and sequence number set by the restreamer, in case switching is involved */
-						packet.ptype = packet.data->type;
-						packet.timestamp = ntohl(packet.data->timestamp);
-						packet.seq_number = ntohs(packet.data->seq_number);
-						/* Take note of the simulcast SSRCs */
-						if(stream->simulcast) {
-							packet.ssrc[0] = stream->last_ssrc[0];
-							packet.ssrc[1] = stream->last_ssrc[1];
-							packet.ssrc[2] = stream->last_ssrc[2];
-						}
-						/* Go! */
-						janus_mutex_lock(&mountpoint->mutex);
-						g_list_foreach(mountpoint->helper_threads == 0 ? mountpoint->viewers : mountpoint->threads,
-							mountpoint->helper_threads == 0 ? janus_streaming_relay_rtp_packet : janus_streaming_helper_rtprtcp_packet,
-							&packet);
-						janus_mutex_unlock(&mountpoint->mutex);
-					}
 					continue;
 				} else if(stream->type == JANUS_STREAMING_MEDIA_DATA && fds[i].fd == stream->fd[0]) {
 					/* Got something data (text) */
@@ -9974,54 +10781,60 @@ static void *janus_streaming_relay_thread(void *data) {
 #ifdef HAVE_LIBCURL
 					source->reconnect_timer = janus_get_monotonic_time();
 #endif
-					addrlen = sizeof(remote);
-					bytes = recvfrom(fds[i].fd, buffer, 1500, 0, (struct sockaddr *)&remote, &addrlen);
-					if(bytes < 1) {
-						/* Failed to read? */
-						continue;
-					}
-					if(!mountpoint->enabled && !stream->rc)
-						continue;
-					/* Copy the data */
-					char *data = g_malloc(bytes);
-					memcpy(data, buffer, bytes);
-					/* Relay on all sessions */
-					packet.mindex = stream->mindex;
-					packet.data = (janus_rtp_header *)data;
-					packet.length = bytes;
-					packet.is_rtp = FALSE;
-					packet.is_data = TRUE;
-					packet.textdata = stream->textdata;
-					/* Is there a recorder? */
-					janus_recorder_save_frame(stream->rc, data, bytes);
-					if(mountpoint->enabled) {
-						/* Are we keeping track of the last message being relayed? */
-						if(stream->buffermsg) {
-							janus_mutex_lock(&stream->buffermsg_mutex);
-							if(stream->last_msg != NULL) {
-								janus_streaming_rtp_relay_packet_free((janus_streaming_rtp_relay_packet *)stream->last_msg);
-								stream->last_msg = NULL;
+					int msgs = janus_streaming_recv_burst(fds[i].fd, bufs, lens);
+					int m = 0;
+					for(m = 0; m < msgs; m++) {
+						char *buffer = bufs[m];
+						int bytes = lens[m];
+						if(bytes < 1) {
+							/* Failed to read? */
+							continue;
+						}
+						if(!mountpoint->enabled && !stream->rc)
+							continue;
+						/* Copy the data */
+						char *data = g_malloc(bytes);
+						memcpy(data, buffer, bytes);
+						/* Relay on all sessions */
+						packet.mindex = stream->mindex;
+						packet.data = (janus_rtp_header *)data;
+						packet.length = bytes;
+						packet.is_rtp = FALSE;
+						packet.is_data = TRUE;
+						packet.textdata = stream->textdata;
+						/* Is there a recorder? */
+						janus_recorder_save_frame(stream->rc, data, bytes);
+						if(mountpoint->enabled) {
+							/* Are we keeping track of the last message being relayed? */
+							if(stream->buffermsg) {
+								janus_mutex_lock(&stream->buffermsg_mutex);
+								if(stream->last_msg != NULL) {
+									janus_streaming_rtp_relay_packet_free((janus_streaming_rtp_relay_packet *)stream->last_msg);
+									stream->last_msg = NULL;
+								}
+								janus_streaming_rtp_relay_packet *pkt = janus_plugin_packet_pool_claim(&packet_pool, bytes);
+								pkt->data = (janus_rtp_header *)janus_plugin_packet_pool_buffer(&packet_pool, pkt);
+								memcpy(pkt->data, data, bytes);
+								pkt->mindex = stream->mindex;
+								pkt->is_data = TRUE;
+								pkt->textdata = stream->textdata;
+								pkt->length = bytes;
+								/* Store the latest message */
+								stream->last_msg = pkt;
+								janus_mutex_unlock(&stream->buffermsg_mutex);
 							}
-							janus_streaming_rtp_relay_packet *pkt = g_malloc0(sizeof(janus_streaming_rtp_relay_packet));
-							pkt->data = g_malloc(bytes);
-							memcpy(pkt->data, data, bytes);
-							pkt->mindex = stream->mindex;
-							pkt->is_data = TRUE;
-							pkt->textdata = stream->textdata;
-							pkt->length = bytes;
-							/* Store the latest message */
-							stream->last_msg = pkt;
-							janus_mutex_unlock(&stream->buffermsg_mutex);
+							/* Go! */
+							janus_mutex_lock(&mountpoint->mutex);
+							if(mountpoint->helper_threads == 0) {
+								g_list_foreach(mountpoint->viewers, janus_streaming_relay_rtp_packet, &packet);
+							} else {
+								janus_streaming_helper_rtprtcp_packet(mountpoint, &packet);
+							}
+							janus_mutex_unlock(&mountpoint->mutex);
 						}
-						/* Go! */
-						janus_mutex_lock(&mountpoint->mutex);
-						g_list_foreach(mountpoint->helper_threads == 0 ? mountpoint->viewers : mountpoint->threads,
-							mountpoint->helper_threads == 0 ? janus_streaming_relay_rtp_packet : janus_streaming_helper_rtprtcp_packet,
-							&packet);
-						janus_mutex_unlock(&mountpoint->mutex);
+						g_free(packet.data);
+						packet.data = NULL;
 					}
-					g_free(packet.data);
-					packet.data = NULL;
 					continue;
 				} else if(fds[i].fd == stream->rtcp_fd) {
 					addrlen = sizeof(remote);
@@ -10047,9 +10860,11 @@ static void *janus_streaming_relay_thread(void *data) {
 					packet.length = bytes;
 					/* Go! */
 					janus_mutex_lock(&mountpoint->mutex);
-					g_list_foreach(mountpoint->helper_threads == 0 ? mountpoint->viewers : mountpoint->threads,
-						mountpoint->helper_threads == 0 ? janus_streaming_relay_rtcp_packet : janus_streaming_helper_rtprtcp_packet,
-						&packet);
+					if(mountpoint->helper_threads == 0) {
+						g_list_foreach(mountpoint->viewers, janus_streaming_relay_rtcp_packet, &packet);
+					} else {
+						janus_streaming_helper_rtprtcp_packet(mountpoint, &packet);
+					}
 					janus_mutex_unlock(&mountpoint->mutex);
 				}
 			}
@@ -10489,40 +11304,25 @@ static void janus_streaming_relay_rtcp_packet(gpointer data, gpointer user_data)
 	return;
 }
 
-static void janus_streaming_helper_rtprtcp_packet(gpointer data, gpointer user_data) {
-	janus_streaming_rtp_relay_packet *packet = (janus_streaming_rtp_relay_packet *)user_data;
+static void janus_streaming_helper_rtprtcp_packet(janus_streaming_mountpoint *mp, janus_streaming_rtp_relay_packet *packet) {
 	if(!packet || !packet->data || packet->length < 1) {
 		JANUS_LOG(LOG_ERR, "Invalid packet...\n");
 		return;
 	}
-	janus_streaming_helper *helper = (janus_streaming_helper *)data;
-	if(!helper) {
+	if(mp == NULL || mp->threads == NULL)
 		return;
+	/* Clone the packet once and share the same immutable buffer with all
+	 * helper threads: each helper only copies it at the header-rewrite
+	 * stage, right before relaying it to its viewers (the caller holds
+	 * the mountpoint mutex, so the list of helpers can't change here) */
+	janus_streaming_rtp_relay_packet *copy = janus_streaming_rtp_relay_packet_clone(packet);
+	g_atomic_int_set(&copy->refcount, g_list_length(mp->threads));
+	GList *l = mp->threads;
+	while(l) {
+		janus_streaming_helper *helper = (janus_streaming_helper *)l->data;
+		g_async_queue_push(helper->queued_packets, copy);
+		l = l->next;
 	}
-	/* Clone the packet and queue it for delivery on the helper thread */
-	janus_streaming_rtp_relay_packet *copy = g_malloc0(sizeof(janus_streaming_rtp_relay_packet));
-	copy->mindex = packet->mindex;
-	copy->data = g_malloc(packet->length);
-	memcpy(copy->data, packet->data, packet->length);
-	copy->length = packet->length;
-	copy->is_rtp = packet->is_rtp;
-	copy->is_data = packet->is_data;
-	copy->textdata = packet->textdata;
-	copy->is_video = packet->is_video;
-	copy->is_keyframe = packet->is_keyframe;
-	copy->simulcast = packet->simulcast;
-	copy->ssrc[0] = packet->ssrc[0];
-	copy->ssrc[1] = packet->ssrc[1];
-	copy->ssrc[2] = packet->ssrc[2];
-	copy->codec = packet->codec;
-	copy->substream = packet->substream;
-	copy->svc = packet->svc;
-	if(copy->svc)
-		copy->svc_info = packet->svc_info;
-	copy->ptype = packet->ptype;
-	copy->timestamp = packet->timestamp;
-	copy->seq_number = packet->seq_number;
-	g_async_queue_push(helper->queued_packets, copy);
 }
 
 static void *janus_streaming_helper_thread(void *data) {
@@ -10534,12 +11334,27 @@ static void *janus_streaming_helper_thread(void *data) {
 		pkt = g_async_queue_pop(helper->queued_packets);
 		if(pkt == &exit_packet)
 			break;
-		janus_mutex_lock(&helper->mutex);
-		g_list_foreach(helper->viewers,
-			pkt->is_rtp || pkt->is_data ? janus_streaming_relay_rtp_packet : janus_streaming_relay_rtcp_packet,
-			pkt);
+		janus_mutex_lock_spin(&helper->mutex);
+		if(pkt->is_rtp && !pkt->is_data) {
+			/* The buffer is shared with the other helpers, and relaying
+			 * RTP rewrites the header in place: copy it to our own
+			 * scratch buffer first, so that we can patch it safely */
+			if(helper->scratch == NULL || helper->scratch_size < pkt->length) {
+				helper->scratch = g_realloc(helper->scratch, pkt->length);
+				helper->scratch_size = pkt->length;
+			}
+			memcpy(helper->scratch, pkt->data, pkt->length);
+			janus_streaming_rtp_relay_packet copy = *pkt;
+			copy.data = (janus_rtp_header *)helper->scratch;
+			g_list_foreach(helper->viewers, janus_streaming_relay_rtp_packet, &copy);
+		} else {
+			/* RTCP and data packets are never touched, relay them as they are */
+			g_list_foreach(helper->viewers,
+				pkt->is_data ? janus_streaming_relay_rtp_packet : janus_streaming_relay_rtcp_packet,
+				pkt);
+		}
 		janus_mutex_unlock(&helper->mutex);
-		janus_streaming_rtp_relay_packet_free(pkt);
+		janus_streaming_rtp_relay_packet_unref(pkt);
 	}
 	JANUS_LOG(LOG_INFO, "[%s/#%d] Leaving Streaming helper thread\n", mp->name, helper->id);
 	janus_refcount_decrease(&helper->ref);
@@ -398,9 +398,21 @@ post = <optional backend to contact via HTTP post for all incoming messages>
 	"username" : "<unique username to have in the room; mandatory>",
 	"display" : "<display name to use in the room; optional>",
 	"token" : "<invitation token, in case the room has an ACL; optional>",
-	"history" : <true|false, whether to retrieve history messages when available (default=true)>
+	"history" : <true|false, whether to retrieve history messages when available (default=true)>,
+	"framing" : "<text|binary, the framing to use for messages sent to this user (default=text)>"
 }
 \endverbatim
+ *
+ * By default each outgoing message is sent as an individual text data
+ * channel message. Passing \c framing=binary when joining tells the
+ * plugin that this user wants messages delivered as binary data channel
+ * messages instead, where each payload is prefixed by its size as a
+ * 16-bit integer in network byte order: this allows the plugin to batch
+ * a burst of messages addressed to the same user (e.g., the history
+ * replay that follows a join) in a single data channel write, with one
+ * or more framed payloads in it. Notice that the option applies to the
+ * whole connection, not just the room being joined, so clients opting
+ * in must be prepared to parse framed payloads for all their rooms.
  *
  * A successful join will result in a \c success response, which will
  * include a list of all the other participants currently in the room:
@@ -701,7 +713,8 @@ static struct janus_json_parameter join_parameters[] = {
 	{"pin", JSON_STRING, 0},
 	{"token", JSON_STRING, 0},
 	{"display", JSON_STRING, 0},
-	{"history", JANUS_JSON_BOOL, 0}
+	{"history", JANUS_JSON_BOOL, 0},
+	{"framing", JSON_STRING, 0}
 };
 static struct janus_json_parameter message_parameters[] = {
 	{"text", JSON_STRING, JANUS_JSON_PARAM_REQUIRED},
@@ -759,6 +772,9 @@ typedef struct janus_textroom_session {
 	gint64 sdp_version;
 	GHashTable *rooms;			/* Map of rooms this user is in, and related participant instance */
 	janus_mutex mutex;			/* Mutex to lock this session */
+	gboolean binary_framing;	/* Whether messages should be sent to this user with length-prefixed framing */
+	GQueue *pending;			/* Messages queued for a framed write */
+	janus_mutex pendingmutex;	/* Mutex to protect the pending queue */
 	volatile gint setup;
 	volatile gint dataready;
 	volatile gint hangingup;
@@ -785,6 +801,8 @@ static void janus_textroom_room_destroy(janus_textroom_room *textroom) {
 static void janus_textroom_room_free(const janus_refcount *textroom_ref) {
 	janus_textroom_room *textroom = janus_refcount_containerof(textroom_ref, janus_textroom_room, ref);
 	/* This room can be destroyed, free all the resources */
+	if(string_ids)
+		janus_string_id_release(textroom->room_id_str);
 	g_free(textroom->room_id_str);
 	g_free(textroom->room_name);
 	g_free(textroom->room_secret);
@@ -808,7 +826,9 @@ static void janus_textroom_session_free(const janus_refcount *session_ref) {
 	janus_refcount_decrease(&session->handle->ref);
 	/* This session can be destroyed, free all the resources */
 	g_hash_table_destroy(session->rooms);
+	g_queue_free_full(session->pending, (GDestroyNotify)g_bytes_unref);
 	janus_mutex_destroy(&session->mutex);
+	janus_mutex_destroy(&session->pendingmutex);
 	g_free(session);
 }
 
@@ -830,6 +850,64 @@ static void janus_textroom_participant_free(const janus_refcount *participant_re
 	g_free(participant);
 }
 
+/* Helper to deliver an outgoing message to a user: serialized payloads are
+ * passed around as refcounted GBytes, so that a broadcast only serializes
+ * (and copies) each message once, no matter how many recipients there are.
+ * Users that asked for binary framing when joining have their messages
+ * queued rather than written right away, so that a burst addressed to the
+ * same user (e.g., a history replay) can be coalesced in a single data
+ * channel write by janus_textroom_session_sendq_flush; users on the
+ * default text framing are sent each message individually instead */
+static void janus_textroom_session_sendq(janus_textroom_session *session, GBytes *message) {
+	if(session == NULL || g_atomic_int_get(&session->destroyed))
+		return;
+	gsize length = 0;
+	gconstpointer buffer = g_bytes_get_data(message, &length);
+	if(session->binary_framing && length <= G_MAXUINT16) {
+		janus_mutex_lock(&session->pendingmutex);
+		g_queue_push_tail(session->pending, g_bytes_ref(message));
+		janus_mutex_unlock(&session->pendingmutex);
+		return;
+	}
+	if(session->binary_framing)
+		JANUS_LOG(LOG_WARN, "Message too large for length-prefixed framing (%zu bytes), sending it unframed\n", length);
+	janus_plugin_data data = { .label = NULL, .protocol = NULL, .binary = FALSE, .buffer = (char *)buffer, .length = length };
+	gateway->relay_data(session->handle, &data);
+}
+/* Helper to write all the messages queued for a user as a single binary
+ * data channel message, where each payload is prefixed by its size as a
+ * 16-bit integer in network byte order */
+static void janus_textroom_session_sendq_flush(janus_textroom_session *session) {
+	if(session == NULL || !session->binary_framing)
+		return;
+	janus_mutex_lock(&session->pendingmutex);
+	if(g_queue_get_length(session->pending) == 0) {
+		janus_mutex_unlock(&session->pendingmutex);
+		return;
+	}
+	/* Compute the size of the whole batch first */
+	gsize total = 0, length = 0;
+	GList *item = session->pending->head;
+	while(item) {
+		total += 2 + g_bytes_get_size((GBytes *)item->data);
+		item = item->next;
+	}
+	char *buffer = g_malloc(total), *p = buffer;
+	GBytes *message = NULL;
+	while((message = g_queue_pop_head(session->pending)) != NULL) {
+		gconstpointer payload = g_bytes_get_data(message, &length);
+		*p = (length >> 8) & 0xFF;
+		*(p+1) = length & 0xFF;
+		memcpy(p+2, payload, length);
+		p += (2 + length);
+		g_bytes_unref(message);
+	}
+	janus_mutex_unlock(&session->pendingmutex);
+	janus_plugin_data data = { .label = NULL, .protocol = NULL, .binary = TRUE, .buffer = buffer, .length = total };
+	gateway->relay_data(session->handle, &data);
+	g_free(buffer);
+}
+
 
 typedef struct janus_textroom_message {
 	janus_plugin_session *handle;
@@ -982,7 +1060,7 @@ int janus_textroom_init(janus_callbacks *callback, const char *config_path) {
 		}
 	}
 	/* Iterate on all rooms */
-	rooms = g_hash_table_new_full(string_ids ? g_str_hash : g_int64_hash, string_ids ? g_str_equal : g_int64_equal,
+	rooms = g_hash_table_new_full(g_int64_hash, g_int64_equal,
 		(GDestroyNotify)g_free, (GDestroyNotify)janus_textroom_room_destroy);
 	if(config != NULL) {
 		GList *clist = janus_config_get_categories(config, NULL), *cl = clist;
@@ -1021,10 +1099,12 @@ int janus_textroom_init(janus_callbacks *callback, const char *config_path) {
 					cl = cl->next;
 					continue;
 				}
+			} else {
+				textroom->room_id = janus_string_id_find(room_num);
 			}
 			/* Let's make sure the room doesn't exist already */
 			janus_mutex_lock(&rooms_mutex);
-			if(g_hash_table_lookup(rooms, string_ids ? (gpointer)room_num : (gpointer)&textroom->room_id) != NULL) {
+			if(g_hash_table_lookup(rooms, (gpointer)&textroom->room_id) != NULL) {
 				/* It does... */
 				janus_mutex_unlock(&rooms_mutex);
 				JANUS_LOG(LOG_ERR, "Can't add the TextRoom room, room %s already exists...\n", room_num);
@@ -1034,6 +1114,8 @@ int janus_textroom_init(janus_callbacks *callback, const char *config_path) {
 			}
 			janus_mutex_unlock(&rooms_mutex);
 			textroom->room_id_str = g_strdup(room_num);
+			if(string_ids)
+				textroom->room_id = janus_string_id_intern(textroom->room_id_str);
 			char *description = NULL;
 			if(desc != NULL && desc->value != NULL && strlen(desc->value) > 0)
 				description = g_strdup(desc->value);
@@ -1075,7 +1157,7 @@ int janus_textroom_init(janus_callbacks *callback, const char *config_path) {
 				textroom->room_secret ? textroom->room_secret : "no secret",
 				textroom->room_pin ? textroom->room_pin : "no pin", textroom->history_size);
 			g_hash_table_insert(rooms,
-				string_ids ? (gpointer)g_strdup(textroom->room_id_str) : (gpointer)janus_uint64_dup(textroom->room_id),
+				(gpointer)janus_uint64_dup(textroom->room_id),
 				textroom);
 			cl = cl->next;
 		}
@@ -1193,8 +1275,11 @@ void janus_textroom_create_session(janus_plugin_session *handle, int *error) {
 	}
 	janus_textroom_session *session = g_malloc0(sizeof(janus_textroom_session));
 	session->handle = handle;
-	session->rooms = g_hash_table_new_full(string_ids ? g_str_hash : g_int64_hash, string_ids ? g_str_equal : g_int64_equal,
+	session->rooms = g_hash_table_new_full(g_int64_hash, g_int64_equal,
 		(GDestroyNotify)g_free, (GDestroyNotify)janus_textroom_participant_dereference);
+	session->binary_framing = FALSE;
+	session->pending = g_queue_new();
+	janus_mutex_init(&session->pendingmutex);
 	session->destroyed = 0;
 	janus_mutex_init(&session->mutex);
 	janus_refcount_init(&session->ref, janus_textroom_session_free);
@@ -1550,10 +1635,11 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 			room_id_str = room_id_num;
 		} else {
 			room_id_str = (char *)json_string_value(room);
+			room_id = janus_string_id_find(room_id_str);
 		}
 		janus_mutex_lock(&rooms_mutex);
 		janus_textroom_room *textroom = g_hash_table_lookup(rooms,
-			string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+			(gpointer)&room_id);
 		if(textroom == NULL) {
 			janus_mutex_unlock(&rooms_mutex);
 			JANUS_LOG(LOG_ERR, "No such room (%s)\n", room_id_str);
@@ -1565,7 +1651,7 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 		janus_mutex_unlock(&rooms_mutex);
 		janus_mutex_lock(&textroom->mutex);
 		janus_textroom_participant *participant = g_hash_table_lookup(session->rooms,
-			string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+			(gpointer)&room_id);
 		if(participant == NULL) {
 			janus_mutex_unlock(&textroom->mutex);
 			janus_refcount_decrease(&textroom->ref);
@@ -1617,6 +1703,8 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 			history_text = json_dumps(msg, json_format);
 		}
 		json_decref(msg);
+		/* Serialize the payload once, and share it across recipients */
+		GBytes *outgoing = g_bytes_new(msg_text, strlen(msg_text));
 		/* Start preparing the response too */
 		reply = json_object();
 		json_object_set_new(reply, "textroom", json_string("success"));
@@ -1629,8 +1717,8 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 			janus_textroom_participant *top = g_hash_table_lookup(textroom->participants, to);
 			if(top) {
 				janus_refcount_increase(&top->ref);
-				janus_plugin_data data = { .label = NULL, .protocol = NULL, .binary = FALSE, .buffer = msg_text, .length = strlen(msg_text) };
-				gateway->relay_data(top->session->handle, &data);
+				janus_textroom_session_sendq(top->session, outgoing);
+				janus_textroom_session_sendq_flush(top->session);
 				janus_refcount_decrease(&top->ref);
 				json_object_set_new(sent, to, json_true());
 			} else {
@@ -1649,8 +1737,8 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 				janus_textroom_participant *top = g_hash_table_lookup(textroom->participants, to);
 				if(top) {
 					janus_refcount_increase(&top->ref);
-					janus_plugin_data data = { .label = NULL, .protocol = NULL, .binary = FALSE, .buffer = msg_text, .length = strlen(msg_text) };
-					gateway->relay_data(top->session->handle, &data);
+					janus_textroom_session_sendq(top->session, outgoing);
+					janus_textroom_session_sendq_flush(top->session);
 					janus_refcount_decrease(&top->ref);
 					json_object_set_new(sent, to, json_true());
 				} else {
@@ -1670,8 +1758,8 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 					janus_textroom_participant *top = value;
 					JANUS_LOG(LOG_VERB, "  >> To %s in %s: %s\n", top->username, room_id_str, message);
 					janus_refcount_increase(&top->ref);
-					janus_plugin_data data = { .label = NULL, .protocol = NULL, .binary = FALSE, .buffer = msg_text, .length = strlen(msg_text) };
-					gateway->relay_data(top->session->handle, &data);
+					janus_textroom_session_sendq(top->session, outgoing);
+					janus_textroom_session_sendq_flush(top->session);
 					janus_refcount_decrease(&top->ref);
 				}
 			}
@@ -1714,6 +1802,7 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 #endif
 		}
 		janus_refcount_decrease(&participant->ref);
+		g_bytes_unref(outgoing);
 		free(msg_text);
 		janus_mutex_unlock(&textroom->mutex);
 		janus_refcount_decrease(&textroom->ref);
@@ -1753,10 +1842,11 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 			room_id_str = room_id_num;
 		} else {
 			room_id_str = (char *)json_string_value(room);
+			room_id = janus_string_id_find(room_id_str);
 		}
 		janus_mutex_lock(&rooms_mutex);
 		janus_textroom_room *textroom = g_hash_table_lookup(rooms,
-			string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+			(gpointer)&room_id);
 		if(textroom == NULL) {
 			janus_mutex_unlock(&rooms_mutex);
 			JANUS_LOG(LOG_ERR, "No such room (%s)\n", room_id_str);
@@ -1776,7 +1866,7 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 			goto msg_response;
 		}
 		janus_mutex_lock(&session->mutex);
-		if(g_hash_table_lookup(session->rooms, string_ids ? (gpointer)room_id_str : (gpointer)&room_id) != NULL) {
+		if(g_hash_table_lookup(session->rooms, (gpointer)&room_id) != NULL) {
 			janus_mutex_unlock(&session->mutex);
 			janus_mutex_unlock(&textroom->mutex);
 			janus_refcount_decrease(&textroom->ref);
@@ -1813,6 +1903,26 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 		}
 		json_t *display = json_object_get(root, "display");
 		const char *display_text = json_string_value(display);
+		json_t *framing = json_object_get(root, "framing");
+		if(framing != NULL) {
+			const char *framing_text = json_string_value(framing);
+			if(!strcasecmp(framing_text, "binary")) {
+				/* This user wants length-prefixed binary framing, which means
+				 * we can batch bursts of messages in a single write: notice
+				 * this applies to the connection, not just this room */
+				session->binary_framing = TRUE;
+			} else if(!strcasecmp(framing_text, "text")) {
+				session->binary_framing = FALSE;
+			} else {
+				janus_mutex_unlock(&session->mutex);
+				janus_mutex_unlock(&textroom->mutex);
+				janus_refcount_decrease(&textroom->ref);
+				JANUS_LOG(LOG_ERR, "Invalid framing '%s' (should be text|binary)\n", framing_text);
+				error_code = JANUS_TEXTROOM_ERROR_INVALID_ELEMENT;
+				g_snprintf(error_cause, 512, "Invalid framing '%s' (should be text|binary)", framing_text);
+				goto msg_response;
+			}
+		}
 		/* Create a participant instance */
 		participant = g_malloc(sizeof(janus_textroom_participant));
 		participant->session = session;
@@ -1824,7 +1934,7 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 		janus_refcount_init(&participant->ref, janus_textroom_participant_free);
 		janus_refcount_increase(&participant->ref);
 		g_hash_table_insert(session->rooms,
-			string_ids ? (gpointer)g_strdup(textroom->room_id_str) : (gpointer)janus_uint64_dup(textroom->room_id),
+			(gpointer)janus_uint64_dup(textroom->room_id),
 			participant);
 		janus_refcount_increase(&participant->ref);
 		g_hash_table_insert(textroom->participants, participant->username, participant);
@@ -1835,14 +1945,16 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 			if(textroom->history != NULL && textroom->history->head != NULL) {
 				GList *temp = textroom->history->head;
 				char *text = NULL;
-				janus_plugin_data data = { .label = NULL, .protocol = NULL, .binary = FALSE, .buffer = NULL, .length = 0 };
 				while(temp) {
 					text = (char *)temp->data;
-					data.buffer = text;
-					data.length = strlen(text);
-					gateway->relay_data(handle, &data);
+					GBytes *old = g_bytes_new(text, strlen(text));
+					janus_textroom_session_sendq(session, old);
+					g_bytes_unref(old);
 					temp = temp->next;
 				}
+				/* If this user asked for framing, we don't flush here: the
+				 * whole history will go out in a single write, together
+				 * with the join event we're about to send */
 			}
 		}
 		/* Notify all participants */
@@ -1867,8 +1979,9 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 				g_snprintf(error_cause, 512, "Failed to stringify message");
 				goto msg_response;
 			}
-			janus_plugin_data data = { .label = NULL, .protocol = NULL, .binary = FALSE, .buffer = event_text, .length = strlen(event_text) };
-			gateway->relay_data(handle, &data);
+			GBytes *outgoing = g_bytes_new(event_text, strlen(event_text));
+			janus_textroom_session_sendq(session, outgoing);
+			janus_textroom_session_sendq_flush(session);
 			/* Broadcast */
 			GHashTableIter iter;
 			gpointer value;
@@ -1879,7 +1992,8 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 					continue;	/* Skip us */
 				janus_refcount_increase(&top->ref);
 				JANUS_LOG(LOG_VERB, "  >> To %s in %s\n", top->username, room_id_str);
-				gateway->relay_data(top->session->handle, &data);
+				janus_textroom_session_sendq(top->session, outgoing);
+				janus_textroom_session_sendq_flush(top->session);
 				/* Take note of this user */
 				json_t *p = json_object();
 				json_object_set_new(p, "username", json_string(top->username));
@@ -1888,6 +2002,7 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 				json_array_append_new(list, p);
 				janus_refcount_decrease(&top->ref);
 			}
+			g_bytes_unref(outgoing);
 			free(event_text);
 		}
 		janus_mutex_unlock(&session->mutex);
@@ -1930,10 +2045,11 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 			room_id_str = room_id_num;
 		} else {
 			room_id_str = (char *)json_string_value(room);
+			room_id = janus_string_id_find(room_id_str);
 		}
 		janus_mutex_lock(&rooms_mutex);
 		janus_textroom_room *textroom = g_hash_table_lookup(rooms,
-			string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+			(gpointer)&room_id);
 		if(textroom == NULL) {
 			janus_mutex_unlock(&rooms_mutex);
 			JANUS_LOG(LOG_ERR, "No such room (%s)\n", room_id_str);
@@ -1946,7 +2062,7 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 		janus_mutex_lock(&textroom->mutex);
 		janus_mutex_lock(&session->mutex);
 		janus_textroom_participant *participant = g_hash_table_lookup(session->rooms,
-			string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+			(gpointer)&room_id);
 		if(participant == NULL) {
 			janus_mutex_unlock(&session->mutex);
 			janus_mutex_unlock(&textroom->mutex);
@@ -1957,7 +2073,7 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 			goto msg_response;
 		}
 		janus_refcount_increase(&participant->ref);
-		g_hash_table_remove(session->rooms, string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+		g_hash_table_remove(session->rooms, (gpointer)&room_id);
 		g_hash_table_remove(textroom->participants, participant->username);
 		participant->session = NULL;
 		participant->room = NULL;
@@ -1982,8 +2098,9 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 				g_snprintf(error_cause, 512, "Failed to stringify message");
 				goto msg_response;
 			}
-			janus_plugin_data data = { .label = NULL, .protocol = NULL, .binary = FALSE, .buffer = event_text, .length = strlen(event_text) };
-			gateway->relay_data(handle, &data);
+			GBytes *outgoing = g_bytes_new(event_text, strlen(event_text));
+			janus_textroom_session_sendq(session, outgoing);
+			janus_textroom_session_sendq_flush(session);
 			/* Broadcast */
 			GHashTableIter iter;
 			gpointer value;
@@ -1994,9 +2111,11 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 					continue;	/* Skip us */
 				janus_refcount_increase(&top->ref);
 				JANUS_LOG(LOG_VERB, "  >> To %s in %s\n", top->username, room_id_str);
-				gateway->relay_data(top->session->handle, &data);
+				janus_textroom_session_sendq(top->session, outgoing);
+				janus_textroom_session_sendq_flush(top->session);
 				janus_refcount_decrease(&top->ref);
 			}
+			g_bytes_unref(outgoing);
 			free(event_text);
 		}
 		/* Also notify event handlers */
@@ -2091,10 +2210,11 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 			room_id_str = room_id_num;
 		} else {
 			room_id_str = (char *)json_string_value(room);
+			room_id = janus_string_id_find(room_id_str);
 		}
 		janus_mutex_lock(&rooms_mutex);
 		janus_textroom_room *textroom = g_hash_table_lookup(rooms,
-			string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+			(gpointer)&room_id);
 		if(textroom == NULL || g_atomic_int_get(&textroom->destroyed)) {
 			janus_mutex_unlock(&rooms_mutex);
 			JANUS_LOG(LOG_ERR, "No such room (%s)\n", room_id_str);
@@ -2162,10 +2282,11 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 			room_id_str = room_id_num;
 		} else {
 			room_id_str = (char *)json_string_value(room);
+			room_id = janus_string_id_find(room_id_str);
 		}
 		janus_mutex_lock(&rooms_mutex);
 		janus_textroom_room *textroom = g_hash_table_lookup(rooms,
-			string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+			(gpointer)&room_id);
 		if(textroom == NULL) {
 			janus_mutex_unlock(&rooms_mutex);
 			JANUS_LOG(LOG_ERR, "No such room (%s)\n", room_id_str);
@@ -2273,10 +2394,11 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 			room_id_str = room_id_num;
 		} else {
 			room_id_str = (char *)json_string_value(room);
+			room_id = janus_string_id_find(room_id_str);
 		}
 		janus_mutex_lock(&rooms_mutex);
 		janus_textroom_room *textroom = g_hash_table_lookup(rooms,
-			string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+			(gpointer)&room_id);
 		if(textroom == NULL) {
 			janus_mutex_unlock(&rooms_mutex);
 			JANUS_LOG(LOG_ERR, "No such room (%s)\n", room_id_str);
@@ -2322,15 +2444,17 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 				goto msg_response;
 			}
 			/* Broadcast */
+			GBytes *outgoing = g_bytes_new(event_text, strlen(event_text));
 			GHashTableIter iter;
 			gpointer value;
 			g_hash_table_iter_init(&iter, textroom->participants);
 			while(g_hash_table_iter_next(&iter, NULL, &value)) {
 				janus_textroom_participant *top = value;
 				JANUS_LOG(LOG_VERB, "  >> To %s in %s\n", top->username, room_id_str);
-				janus_plugin_data data = { .label = NULL, .protocol = NULL, .binary = FALSE, .buffer = event_text, .length = strlen(event_text) };
-				gateway->relay_data(top->session->handle, &data);
+				janus_textroom_session_sendq(top->session, outgoing);
+				janus_textroom_session_sendq_flush(top->session);
 			}
+			g_bytes_unref(outgoing);
 			free(event_text);
 		}
 		/* Also notify event handlers */
@@ -2342,7 +2466,7 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 			gateway->notify_event(&janus_textroom_plugin, session->handle, info);
 		}
 		/* Remove user from list */
-		g_hash_table_remove(participant->session->rooms, string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+		g_hash_table_remove(participant->session->rooms, (gpointer)&room_id);
 		g_hash_table_remove(textroom->participants, participant->username);
 		participant->session = NULL;
 		participant->room = NULL;
@@ -2384,10 +2508,11 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 			room_id_str = room_id_num;
 		} else {
 			room_id_str = (char *)json_string_value(room);
+			room_id = janus_string_id_find(room_id_str);
 		}
 		janus_mutex_lock(&rooms_mutex);
 		janus_textroom_room *textroom = g_hash_table_lookup(rooms,
-			string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+			(gpointer)&room_id);
 		if(textroom == NULL) {
 			janus_mutex_unlock(&rooms_mutex);
 			JANUS_LOG(LOG_ERR, "No such room (%s)\n", room_id_str);
@@ -2429,7 +2554,8 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 			g_snprintf(error_cause, 512, "Failed to stringify message");
 			goto msg_response;
 		}
-		/* Send the announcement to everybody in the room */
+		/* Send the announcement to everybody in the room, serializing it just once */
+		GBytes *outgoing = g_bytes_new(msg_text, strlen(msg_text));
 		if(textroom->participants) {
 			GHashTableIter iter;
 			gpointer value;
@@ -2438,11 +2564,12 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 				janus_textroom_participant *top = value;
 				JANUS_LOG(LOG_VERB, "  >> To %s in %s: %s\n", top->username, room_id_str, message);
 				janus_refcount_increase(&top->ref);
-				janus_plugin_data data = { .label = NULL, .protocol = NULL, .binary = FALSE, .buffer = msg_text, .length = strlen(msg_text) };
-				gateway->relay_data(top->session->handle, &data);
+				janus_textroom_session_sendq(top->session, outgoing);
+				janus_textroom_session_sendq_flush(top->session);
 				janus_refcount_decrease(&top->ref);
 			}
 		}
+		g_bytes_unref(outgoing);
 		if(textroom->history) {
 			/* Store in the history */
 			g_queue_push_tail(textroom->history, g_strdup(msg_text));
@@ -2561,14 +2688,20 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 			room_id_str = room_id_num;
 		} else {
 			room_id_str = (char *)json_string_value(room);
+			room_id = janus_string_id_find(room_id_str);
 		}
 		if(room_id == 0 && room_id_str == NULL) {
 			JANUS_LOG(LOG_WARN, "Desired room ID is empty, which is not allowed... picking random ID instead\n");
 		}
 		janus_mutex_lock(&rooms_mutex);
 		if(room_id > 0 || room_id_str != NULL) {
+			if(string_ids && room_id == 0) {
+				/* Re-resolve the ID now that we hold the lock, in case
+				 * a concurrent create interned it in the meanwhile */
+				room_id = janus_string_id_find(room_id_str);
+			}
 			/* Let's make sure the room doesn't exist already */
-			if(g_hash_table_lookup(rooms, string_ids ? (gpointer)room_id_str : (gpointer)&room_id) != NULL) {
+			if(g_hash_table_lookup(rooms, (gpointer)&room_id) != NULL) {
 				/* It does... */
 				janus_mutex_unlock(&rooms_mutex);
 				error_code = JANUS_TEXTROOM_ERROR_ROOM_EXISTS;
@@ -2594,7 +2727,7 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 		} else if(string_ids && room_id_str == NULL) {
 			while(room_id_str == NULL) {
 				room_id_str = janus_random_uuid();
-				if(g_hash_table_lookup(rooms, room_id_str) != NULL) {
+				if(janus_string_id_find(room_id_str) != 0) {
 					/* Room ID already taken, try another one */
 					g_clear_pointer(&room_id_str, g_free);
 				}
@@ -2603,6 +2736,8 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 		}
 		textroom->room_id = room_id;
 		textroom->room_id_str = room_id_str ? g_strdup(room_id_str) : NULL;
+		if(string_ids)
+			textroom->room_id = janus_string_id_intern(textroom->room_id_str);
 		char *description = NULL;
 		if(desc != NULL && strlen(json_string_value(desc)) > 0) {
 			description = g_strdup(json_string_value(desc));
@@ -2648,7 +2783,7 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 		janus_mutex_init(&textroom->mutex);
 		janus_refcount_init(&textroom->ref, janus_textroom_room_free);
 		g_hash_table_insert(rooms,
-			string_ids ? (gpointer)g_strdup(textroom->room_id_str) : (gpointer)janus_uint64_dup(textroom->room_id),
+			(gpointer)janus_uint64_dup(textroom->room_id),
 			textroom);
 		JANUS_LOG(LOG_VERB, "Created TextRoom: %s (%s, %s, secret: %s, pin: %s)\n",
 			textroom->room_id_str, textroom->room_name,
@@ -2730,9 +2865,10 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 			room_id_str = room_id_num;
 		} else {
 			room_id_str = (char *)json_string_value(room);
+			room_id = janus_string_id_find(room_id_str);
 		}
 		janus_mutex_lock(&rooms_mutex);
-		gboolean room_exists = g_hash_table_contains(rooms, string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+		gboolean room_exists = g_hash_table_contains(rooms, (gpointer)&room_id);
 		janus_mutex_unlock(&rooms_mutex);
 		if(!internal) {
 			/* Send response back */
@@ -2781,10 +2917,11 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 			room_id_str = room_id_num;
 		} else {
 			room_id_str = (char *)json_string_value(room);
+			room_id = janus_string_id_find(room_id_str);
 		}
 		janus_mutex_lock(&rooms_mutex);
 		janus_textroom_room *textroom = g_hash_table_lookup(rooms,
-			string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+			(gpointer)&room_id);
 		if(textroom == NULL) {
 			janus_mutex_unlock(&rooms_mutex);
 			JANUS_LOG(LOG_ERR, "No such room (%s)\n", room_id_str);
@@ -2909,10 +3046,11 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 			room_id_str = room_id_num;
 		} else {
 			room_id_str = (char *)json_string_value(room);
+			room_id = janus_string_id_find(room_id_str);
 		}
 		janus_mutex_lock(&rooms_mutex);
 		janus_textroom_room *textroom = g_hash_table_lookup(rooms,
-			string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+			(gpointer)&room_id);
 		if(textroom == NULL) {
 			janus_mutex_unlock(&rooms_mutex);
 			JANUS_LOG(LOG_ERR, "No such room (%s)\n", room_id_str);
@@ -2932,7 +3070,7 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 			goto msg_response;
 		}
 		/* Remove room */
-		g_hash_table_remove(rooms, string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+		g_hash_table_remove(rooms, (gpointer)&room_id);
 		if(save) {
 			/* This change is permanent: save to the configuration file too
 			 * FIXME: We should check if anything fails... */
@@ -2965,8 +3103,9 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 				g_snprintf(error_cause, 512, "Failed to stringify message");
 				goto msg_response;
 			}
-			janus_plugin_data data = { .label = NULL, .protocol = NULL, .binary = FALSE, .buffer = event_text, .length = strlen(event_text) };
-			gateway->relay_data(handle, &data);
+			GBytes *outgoing = g_bytes_new(event_text, strlen(event_text));
+			janus_textroom_session_sendq(session, outgoing);
+			janus_textroom_session_sendq_flush(session);
 			/* Broadcast */
 			GHashTableIter iter;
 			gpointer value;
@@ -2975,13 +3114,15 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 				janus_textroom_participant *top = value;
 				janus_refcount_increase(&top->ref);
 				JANUS_LOG(LOG_VERB, "  >> To %s in %s\n", top->username, room_id_str);
-				gateway->relay_data(top->session->handle, &data);
+				janus_textroom_session_sendq(top->session, outgoing);
+				janus_textroom_session_sendq_flush(top->session);
 				janus_mutex_lock(&top->session->mutex);
-				g_hash_table_remove(top->session->rooms, string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+				g_hash_table_remove(top->session->rooms, (gpointer)&room_id);
 				janus_mutex_unlock(&top->session->mutex);
 				janus_refcount_decrease(&top->ref);
 				janus_textroom_participant_destroy(top);
 			}
+			g_bytes_unref(outgoing);
 			free(event_text);
 		}
 		janus_mutex_unlock(&textroom->mutex);
@@ -3033,8 +3174,10 @@ msg_response:
 					if(reply_text == NULL) {
 						JANUS_LOG(LOG_ERR, "Failed to stringify message...\n");
 					} else {
-						janus_plugin_data data = { .label = NULL, .protocol = NULL, .binary = FALSE, .buffer = reply_text, .length = strlen(reply_text) };
-						gateway->relay_data(handle, &data);
+						GBytes *outgoing = g_bytes_new(reply_text, strlen(reply_text));
+						janus_textroom_session_sendq(session, outgoing);
+						janus_textroom_session_sendq_flush(session);
+						g_bytes_unref(outgoing);
 						free(reply_text);
 					}
 				} else {
@@ -379,6 +379,7 @@ typedef struct janus_videocall_session {
 	uint32_t bitrate, peer_bitrate;
 	guint16 slowlink_count;
 	struct janus_videocall_session *peer;
+	void *relay_target;		/* Core relay target for this PeerConnection, cached to skip per-packet session checks */
 	janus_rtp_switching_context context;
 	uint32_t ssrc[3];		/* Only needed in case VP8 (or H.264) simulcasting is involved */
 	char *rid[3];			/* Only needed if simulcasting is rid-based */
@@ -411,6 +412,9 @@ static void janus_videocall_session_unref(janus_videocall_session *session) {
 
 static void janus_videocall_session_free(const janus_refcount *session_ref) {
 	janus_videocall_session *session = janus_refcount_containerof(session_ref, janus_videocall_session, ref);
+	/* Release the cached relay target, if any */
+	if(session->relay_target != NULL)
+		gateway->drop_relay_target(session->relay_target);
 	/* Remove the reference to the core plugin session */
 	janus_refcount_decrease(&session->handle->ref);
 	/* This session can be destroyed, free all the resources */
@@ -597,6 +601,7 @@ void janus_videocall_create_session(janus_plugin_session *handle, int *error) {
 	session->bitrate = 0;	/* No limit */
 	session->peer_bitrate = 0;
 	session->peer = NULL;
+	session->relay_target = NULL;
 	session->username = NULL;
 	janus_rtp_switching_context_reset(&session->context);
 	janus_rtp_simulcasting_context_reset(&session->sim_context);
@@ -747,6 +752,12 @@ void janus_videocall_setup_media(janus_plugin_session *handle) {
 		return;
 	}
 	g_atomic_int_set(&session->hangingup, 0);
+	if(session->relay_target == NULL) {
+		/* Resolve the core relay target once: incoming_rtp will use it to hand
+		 * packets from our peer straight to the core, without going through
+		 * the per-packet session validation that relay_rtp performs */
+		session->relay_target = gateway->get_relay_target(handle);
+	}
 	janus_mutex_unlock(&sessions_mutex);
 	/* We really don't care, as we only relay RTP/RTCP we get in the first place anyway */
 }
@@ -826,7 +837,10 @@ void janus_videocall_incoming_rtp(janus_plugin_session *handle, janus_plugin_rtp
 			header->ssrc = htonl(1);
 			janus_recorder_save_frame(session->vrc, buf, len);
 			/* Send the frame back */
-			gateway->relay_rtp(peer->handle, packet);
+			if(peer->relay_target != NULL)
+				gateway->relay_rtp_target(peer->relay_target, packet);
+			else
+				gateway->relay_rtp(peer->handle, packet);
 			/* Restore header or core statistics will be messed up */
 			header->ssrc = htonl(ssrc);
 			header->timestamp = htonl(timestamp);
@@ -836,7 +850,10 @@ void janus_videocall_incoming_rtp(janus_plugin_session *handle, janus_plugin_rtp
 				/* Save the frame if we're recording */
 				janus_recorder_save_frame(video ? session->vrc : session->arc, buf, len);
 				/* Forward the packet to the peer */
-				gateway->relay_rtp(peer->handle, packet);
+				if(peer->relay_target != NULL)
+					gateway->relay_rtp_target(peer->relay_target, packet);
+				else
+					gateway->relay_rtp(peer->handle, packet);
 			}
 		}
 	}
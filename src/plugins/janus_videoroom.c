@@ -81,6 +81,7 @@ room-<unique room ID>: {
 	bitrate = <max video bitrate for senders> (e.g., 128000)
 	bitrate_cap = <true|false, whether the above cap should act as a limit to dynamic bitrate changes by publishers, default=false>,
 	fir_freq = <send a FIR to publishers every fir_freq seconds> (0=disable)
+	pli_window = <collapse keyframe requests to the same publisher stream closer than this many milliseconds> (0=default, 1s)
 	audiocodec = opus|g722|pcmu|pcma|isac32|isac16 (audio codec to force on publishers, default=opus
 				can be a comma separated list in order of preference, e.g., opus,pcmu)
 	videocodec = vp8|vp9|h264|av1|h265 (video codec to force on publishers, default=vp8
@@ -412,6 +413,7 @@ room-<unique room ID>: {
 			"bitrate" : <bitrate cap that should be forced (via REMB) on all publishers by default>,
 			"bitrate_cap" : <true|false, whether the above cap should act as a limit to dynamic bitrate changes by publishers (optional)>,
 			"fir_freq" : <how often a keyframe request is sent via PLI/FIR to active publishers>,
+			"pli_window" : <minimum interval, in milliseconds, between keyframe requests to the same publisher stream (optional)>,
 			"require_pvtid": <true|false, whether subscriptions in this room require a private_id>,
 			"require_e2ee": <true|false, whether end-to-end encrypted publishers are required>,
 			"dummy_publisher": <true|false, whether a dummy publisher exists for placeholder subscriptions>,
@@ -1608,6 +1610,8 @@ room-<unique room ID>: {
 	"mcast" : "<multicast group port for receiving RTP packets, if any>",
 	"iface" : "<network interface or IP address to bind to, if any (binds to all otherwise)>",
 	"port" : <local port for receiving all RTP packets; 0 will bind to a random one (default)>,
+	"multiplex" : <whether this publisher should be received on the shared multiplexed socket of the room, rather than on dedicated ports; optional, false by default>,
+	"stream_id" : <when multiplexing, the stream ID to demultiplex this publisher by; optional, will be chosen by the plugin if missing>,
 	"srtp_suite" : <length of authentication tag (32 or 80); optional>,
 	"srtp_crypto" : "<key to use as crypto (base64 encoded key as in SDES); optional>",
 	"streams" : [
@@ -1647,6 +1651,21 @@ room-<unique room ID>: {
 	"rtcp_port" : <port to latch to in order to receive RTCP feedback from this remote publisher>
 }
 \endverbatim
+ *
+ * Notice that, by default, each remote publisher gets its own pair of
+ * ports: when cascading many publishers to the same instance, that can
+ * mean a lot of sockets and NAT bindings. Setting \c multiplex to
+ * \c true will instead have the publisher received on a single socket
+ * shared by all the multiplexed remote publishers of the room, served
+ * by a single thread: in that case the response will contain a
+ * \c stream_id instead of \c rtcp_port , and each packet sent to the
+ * returned port is expected to be prefixed by the same compact 4-byte
+ * multiplexing header the inter-instance buses of the RTP forwarders
+ * use, carrying that stream ID (RTCP feedback like PLIs is sent back
+ * on the same multiplexed flow, prefixed the same way). The payload
+ * after the header is exactly what would otherwise be sent to a
+ * dedicated port, so demultiplexing by SSRC within each publisher
+ * works as usual.
  *
  * To update a previously created remote publisher, the \c update_remote_publisher
  * request is used, which must be formatted like the following:
@@ -1808,6 +1827,14 @@ room-<unique room ID>: {
  *
  */
 
+#ifdef __linux__
+/* Needed for recvmmsg */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <sys/socket.h>
+#endif
+
 #include "plugin.h"
 
 #include <jansson.h>
@@ -1914,6 +1941,7 @@ static struct janus_json_parameter create_parameters[] = {
 	{"bitrate", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
 	{"bitrate_cap", JANUS_JSON_BOOL, 0},
 	{"fir_freq", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
+	{"pli_window", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
 	{"publishers", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
 	{"audiocodec", JSON_STRING, 0},
 	{"videocodec", JSON_STRING, 0},
@@ -2215,6 +2243,8 @@ static struct janus_json_parameter remote_publisher_parameters[] = {
 	{"mcast", JANUS_JSON_STRING, 0},
 	{"iface", JANUS_JSON_STRING, 0},
 	{"port", JANUS_JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
+	{"multiplex", JANUS_JSON_BOOL, 0},
+	{"stream_id", JANUS_JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
 	{"streams", JANUS_JSON_ARRAY, JANUS_JSON_PARAM_REQUIRED},
 	{"metadata", JSON_OBJECT, 0},
 	{"srtp_suite", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
@@ -2335,6 +2365,7 @@ typedef struct janus_videoroom {
 	uint32_t bitrate;			/* Global bitrate limit */
 	gboolean bitrate_cap;		/* Whether the above limit is insormountable */
 	uint16_t fir_freq;			/* Regular FIR frequency (0=disabled) */
+	uint32_t pli_window;		/* Minimum interval between two PLIs for the same publisher stream, in ms (0=default) */
 	janus_audiocodec acodec[5];	/* Audio codec(s) to force on publishers */
 	janus_videocodec vcodec[5];	/* Video codec(s) to force on publishers */
 	char *vp9_profile;			/* VP9 codec profile to prefer, if more are negotiated */
@@ -2359,6 +2390,16 @@ typedef struct janus_videoroom {
 	gboolean notify_joining;	/* Whether an event is sent to notify all participants if a new participant joins the room */
 	int helper_threads;			/* Number of helper threads for relaying purposes */
 	GList *threads;				/* List of helper threads, if any */
+	GAsyncQueue *helper_work;	/* Shared ready-queue of helper partitions with pending packets */
+	json_t *roster_cache;		/* Cached participants list for listparticipants (lazily rebuilt, protected by mutex) */
+	volatile gint roster_dirty;	/* Whether the cached participants list needs to be rebuilt */
+	/* Shared ingest socket for multiplexed remote publishers, if any */
+	int remote_mux_fd;			/* Socket all the multiplexed remote publishers of this room are received on */
+	uint16_t remote_mux_port;	/* Port the shared ingest socket is bound to */
+	GHashTable *remote_mux_publishers;	/* Map of stream IDs to multiplexed remote publishers */
+	uint16_t remote_mux_next_id;	/* Next stream ID we'll assign (0 is reserved for keepalives) */
+	GThread *remote_mux_thread;	/* Thread draining the shared ingest socket */
+	janus_mutex remote_mux_mutex;	/* Mutex to protect the multiplexed publishers map */
 	janus_mutex mutex;			/* Mutex to lock this room instance */
 	janus_refcount ref;			/* Reference counter for this room */
 } janus_videoroom;
@@ -2383,9 +2424,14 @@ typedef struct janus_videoroom_session {
 static GHashTable *sessions;
 static janus_mutex sessions_mutex = JANUS_MUTEX_INITIALIZER;
 
-/* Abstraction of a relay helper thread, that decouples incoming media
- * from publishers from the task of distributing it to subscribers;
- * this is a port of the helper threads concept from the Streaming plugin */
+/* Abstraction of a relay helper, that decouples incoming media from
+ * publishers from the task of distributing it to subscribers; this is a
+ * port of the helper threads concept from the Streaming plugin. Helpers
+ * act as a work-stealing pool: subscribers stay softly attached to a
+ * helper partition (for cache locality), but any idle thread in the pool
+ * can pick up a partition with pending packets and relay a chunk of its
+ * fanout work, so a popular stream doesn't saturate a single thread
+ * while its siblings idle */
 typedef struct janus_videoroom_helper {
 	struct janus_videoroom *room;
 	guint id;
@@ -2393,10 +2439,17 @@ typedef struct janus_videoroom_helper {
 	int num_subscribers;
 	GHashTable *subscribers;
 	GAsyncQueue *queued_packets;
+	GAsyncQueue *work;			/* Reference to the shared ready-queue of the room */
+	volatile gint scheduled;	/* Whether this partition is already on the ready-queue */
+	char *scratch;				/* Reusable buffer to patch shared packets in */
+	int scratch_size;
 	volatile gint destroyed;
 	janus_mutex mutex;
 	janus_refcount ref;
 } janus_videoroom_helper;
+/* How many packets a thread relays for a partition before putting it
+ * back up for grabs, so fanout work is spread across the pool */
+#define JANUS_VIDEOROOM_HELPER_CHUNK	32
 static void janus_videoroom_helper_destroy(janus_videoroom_helper *helper) {
 	if(helper && g_atomic_int_compare_and_exchange(&helper->destroyed, 0, 1))
 		janus_refcount_decrease(&helper->ref);
@@ -2405,12 +2458,15 @@ static void janus_videoroom_helper_free(const janus_refcount *helper_ref) {
 	janus_videoroom_helper *helper = janus_refcount_containerof(helper_ref, janus_videoroom_helper, ref);
 	/* This helper can be destroyed, free all the resources */
 	g_async_queue_unref(helper->queued_packets);
+	if(helper->work != NULL)
+		g_async_queue_unref(helper->work);
 	if(helper->subscribers != NULL)
 		g_hash_table_destroy(helper->subscribers);
+	g_free(helper->scratch);
 	g_free(helper);
 }
 static void *janus_videoroom_helper_thread(void *data);
-static void janus_videoroom_helper_rtpdata_packet(gpointer data, gpointer user_data);
+static void janus_videoroom_helper_rtpdata_packet(janus_videoroom *room, struct janus_videoroom_rtp_relay_packet *packet);
 
 typedef struct janus_videoroom_publisher {
 	janus_videoroom_session *session;
@@ -2448,6 +2504,7 @@ typedef struct janus_videoroom_publisher {
 	gboolean remote;			/* Whether this is a remote publisher */
 	uint32_t remote_ssrc_offset;	/* SSRC offset to apply to the incoming RTP traffic */
 	int remote_fd, remote_rtcp_fd, pipefd[2];	/* Remote publisher sockets */
+	uint16_t remote_mux_id;		/* Stream ID on the shared room socket, if this remote publisher is multiplexed */
 	struct sockaddr_storage rtcp_addr;	/* RTCP address of the remote publisher */
 	GThread *remote_thread;		/* Remote publisher incoming packets thread */
 	volatile gint remote_leaving;
@@ -2458,6 +2515,10 @@ typedef struct janus_videoroom_publisher {
 	gboolean kicked;	/* Whether this participant has been kicked */
 	gboolean e2ee;		/* If media from this publisher is end-to-end encrypted */
 	janus_mutex mutex;			/* Mutex to lock this instance */
+	json_t *roster_info;		/* Cached roster entry for this publisher, if any (protected by streams_mutex) */
+	volatile gpointer snapshot;			/* Current RCU-style snapshot of the state the media path needs (room and streams by mindex) */
+	volatile gpointer snapshot_inuse;	/* Snapshot the media thread is currently reading from, if any */
+	janus_mutex snapshot_mutex;			/* Mutex to serialize control plane updates of the snapshot */
 	json_t *metadata;
 	volatile gint destroyed;
 	janus_refcount ref;
@@ -2497,8 +2558,7 @@ typedef struct janus_videoroom_publisher_stream {
 	int16_t min_delay, max_delay;
 	/* Audio level processing, if enabled */
 	int audio_dBov_level;					/* Value in dBov of the audio level (last value from extension) */
-	int audio_active_packets;				/* Participant's number of audio packets to accumulate */
-	int audio_dBov_sum;						/* Participant's accumulated dBov value for audio level */
+	janus_audiolevel_context audiolevel_ctx;	/* Talk detection context (smoothed audio level) */
 	gboolean talking;						/* Whether this participant is currently talking (uses audio levels extension) */
 	/* Recording related stuff, if enabled */
 	janus_recorder *rc;
@@ -2507,10 +2567,15 @@ typedef struct janus_videoroom_publisher_stream {
 	/* RTP (or data) forwarders for this stream, if any */
 	GHashTable *rtp_forwarders;
 	janus_mutex rtp_forwarders_mutex;
+	/* Batch the forwarders fan-out goes through, so that each packet results
+	 * in a single sendmmsg(), rather than one sendto() per forwarder (only
+	 * allocated when there are forwarders; protected by rtp_forwarders_mutex) */
+	janus_rtp_forwarder_batch *rtp_forwarders_batch;
 	/* In case this is a stream from a remote publisher */
 	volatile gint need_pli;		/* Whether we need to send a PLI later */
 	volatile gint sending_pli;	/* Whether we're currently sending a PLI */
 	gint64 pli_latest;			/* Time of latest sent PLI (to avoid flooding) */
+	janus_rtcp_pli_window pli_window;	/* Aggregation of concurrent keyframe requests towards this stream */
 	/* Only needed for SRTP support for remote publisher */
 	gboolean is_srtp;
 	int srtp_suite;
@@ -2519,10 +2584,26 @@ typedef struct janus_videoroom_publisher_stream {
 	srtp_policy_t srtp_policy;
 	/* Subscriptions to this publisher stream (who's receiving it)  */
 	GSList *subscribers;
+	/* Flat snapshot of the subscribers list, rebuilt lazily when it changes:
+	 * this is what the per-packet fanout iterates on, so that the hot path
+	 * walks a contiguous array rather than chasing list links */
+	GPtrArray *subscribers_index;
+	gboolean subscribers_index_dirty;
 	janus_mutex subscribers_mutex;
+	/* Cached last complete keyframe per simulcast substream: replayed to
+	 * subscribers on a substream switch (or a new join), so that video can
+	 * render right away instead of freezing until the publisher responds
+	 * to a PLI with a fresh keyframe */
+	GSList *keyframe_cache[3];
+	gboolean keyframe_caching[3];	/* Whether we're still collecting the keyframe of this substream */
+	uint32_t keyframe_ts[3];		/* RTP timestamp of the keyframe being cached */
+	guint keyframe_pkts[3];			/* Number of packets cached for this substream */
+	janus_mutex keyframe_mutex;
 	volatile gint destroyed;
 	janus_refcount ref;
 } janus_videoroom_publisher_stream;
+/* Cap to the number of packets we're willing to cache for a single keyframe */
+#define JANUS_VIDEOROOM_KEYFRAME_CACHE_MAX	512
 /* Helper to add a new RTP forwarder for a specific stream sent by publisher */
 static janus_rtp_forwarder *janus_videoroom_rtp_forwarder_add_helper(janus_videoroom_publisher *p,
 	janus_videoroom_publisher_stream *ps,
@@ -2543,12 +2624,24 @@ static uint16_t rtp_range_slider = DEFAULT_RTP_RANGE_MIN;
 static janus_mutex fd_mutex = JANUS_MUTEX_INITIALIZER;
 #define REMOTE_PUBLISHER_BASE_SSRC	1000
 #define REMOTE_PUBLISHER_SSRC_STEP	10
+/* How many datagrams, at most, we read from a shared ingest socket with a single recvmmsg() */
+#define REMOTE_PUBLISHER_BATCH		32
 /* Helpers to create a listener filedescriptor */
 static int janus_videoroom_create_fd(int port, in_addr_t mcast, const janus_network_address *iface, char *host, size_t hostlen);
 /* Helper to return fd port */
 static int janus_videoroom_get_fd_port(int fd);
 /* Thread responsible for a specific remote publisher */
 static void *janus_videoroom_remote_publisher_thread(void *data);
+/* Thread draining the shared ingest socket of a room, if any remote
+ * publisher is multiplexed on it rather than using dedicated ports */
+static void *janus_videoroom_remote_publisher_mux_thread(void *data);
+/* Helper to handle a packet coming from a remote publisher */
+static void janus_videoroom_remote_publisher_process(janus_videoroom_publisher *publisher, char *buffer, int bytes);
+/* Helper to demultiplex a datagram received on the shared ingest socket of a room */
+static void janus_videoroom_remote_publisher_mux_packet(janus_videoroom *videoroom,
+	char *buffer, int bytes, struct sockaddr_storage *addr, socklen_t addrlen);
+/* Helper to remove a remote publisher from the room and tear it down */
+static void janus_videoroom_remote_publisher_leave(janus_videoroom_publisher *publisher);
 
 typedef struct janus_videoroom_subscriber {
 	janus_videoroom_session *session;
@@ -2599,6 +2692,38 @@ typedef struct janus_videoroom_subscriber_stream {
 	janus_refcount ref;
 } janus_videoroom_subscriber_stream;
 
+/* Helpers to update the subscriptions to a publisher stream: they keep the
+ * flat fanout index in sync (must be called with subscribers_mutex held) */
+static void janus_videoroom_publisher_stream_add_subscriber(janus_videoroom_publisher_stream *ps,
+		janus_videoroom_subscriber_stream *ss) {
+	ps->subscribers = g_slist_append(ps->subscribers, ss);
+	ps->subscribers_index_dirty = TRUE;
+}
+static void janus_videoroom_publisher_stream_remove_subscriber(janus_videoroom_publisher_stream *ps,
+		janus_videoroom_subscriber_stream *ss) {
+	ps->subscribers = g_slist_remove(ps->subscribers, ss);
+	ps->subscribers_index_dirty = TRUE;
+}
+static void janus_videoroom_publisher_stream_clear_subscribers(janus_videoroom_publisher_stream *ps) {
+	g_slist_free(ps->subscribers);
+	ps->subscribers = NULL;
+	ps->subscribers_index_dirty = TRUE;
+}
+/* Refresh the flat fanout index, if needed (subscribers_mutex must be held) */
+static void janus_videoroom_publisher_stream_index_update(janus_videoroom_publisher_stream *ps) {
+	if(ps->subscribers_index == NULL)
+		ps->subscribers_index = g_ptr_array_new();
+	if(!ps->subscribers_index_dirty)
+		return;
+	g_ptr_array_set_size(ps->subscribers_index, 0);
+	GSList *l = ps->subscribers;
+	while(l) {
+		g_ptr_array_add(ps->subscribers_index, l->data);
+		l = l->next;
+	}
+	ps->subscribers_index_dirty = FALSE;
+}
+
 typedef struct janus_videoroom_stream_mapping {
 	janus_videoroom_publisher_stream *ps;
 	janus_videoroom_subscriber *subscriber;
@@ -2610,6 +2735,10 @@ typedef struct janus_videoroom_rtp_relay_packet {
 	janus_videoroom_publisher_stream *source;
 	janus_rtp_header *data;
 	gint length;
+	volatile gint refcount;	/* Set when the packet is shared across helper partitions */
+	int poffset;		/* Offset and length of the RTP payload, located once per packet */
+	int plen;
+	int keyframe;		/* Keyframe flag (1/0), computed once per packet at ingest, or -1 if we didn't check */
 	gboolean is_rtp;	/* This may be a data packet and not RTP */
 	gboolean is_video;
 	uint32_t ssrc[3];
@@ -2626,11 +2755,119 @@ typedef struct janus_videoroom_rtp_relay_packet {
 	gboolean textdata;
 } janus_videoroom_rtp_relay_packet;
 static janus_videoroom_rtp_relay_packet exit_packet;
+/* Marker pushed on the shared ready-queue to make a helper thread leave */
+static janus_videoroom_helper exit_helper;
+/* All cloned relay packets (and their payloads) live in recyclable pool
+ * slots, so that the per-packet allocations don't show up on the media path */
+#define JANUS_VIDEOROOM_PACKET_POOL_SLOTS	1024
+static janus_plugin_packet_pool packet_pool;
 static void janus_videoroom_rtp_relay_packet_free(janus_videoroom_rtp_relay_packet *pkt) {
 	if(pkt == NULL || pkt == &exit_packet)
 		return;
-	g_free(pkt->data);
-	g_free(pkt);
+	janus_plugin_packet_pool_release(pkt);
+}
+static void janus_videoroom_rtp_relay_packet_unref(janus_videoroom_rtp_relay_packet *pkt) {
+	if(pkt == NULL || pkt == &exit_packet)
+		return;
+	if(g_atomic_int_dec_and_test(&pkt->refcount))
+		janus_videoroom_rtp_relay_packet_free(pkt);
+}
+static janus_videoroom_rtp_relay_packet *janus_videoroom_rtp_relay_packet_clone(janus_videoroom_rtp_relay_packet *packet) {
+	janus_videoroom_rtp_relay_packet *copy = janus_plugin_packet_pool_claim(&packet_pool, packet->length);
+	copy->source = packet->source;
+	copy->data = (janus_rtp_header *)janus_plugin_packet_pool_buffer(&packet_pool, copy);
+	memcpy(copy->data, packet->data, packet->length);
+	copy->length = packet->length;
+	copy->poffset = packet->poffset;
+	copy->plen = packet->plen;
+	copy->keyframe = packet->keyframe;
+	copy->is_rtp = packet->is_rtp;
+	copy->textdata = packet->textdata;
+	copy->is_video = packet->is_video;
+	copy->simulcast = packet->simulcast;
+	copy->ssrc[0] = packet->ssrc[0];
+	copy->ssrc[1] = packet->ssrc[1];
+	copy->ssrc[2] = packet->ssrc[2];
+	copy->svc = packet->svc;
+	copy->svc_info = packet->svc_info;
+	copy->timestamp = packet->timestamp;
+	copy->seq_number = packet->seq_number;
+	copy->extensions = packet->extensions;
+	g_atomic_int_set(&copy->refcount, 1);
+	return copy;
+}
+
+/* Helpers to maintain and replay the per-substream keyframe cache of a publisher stream */
+static void janus_videoroom_keyframe_cache_update(janus_videoroom_publisher_stream *ps,
+		int sc, janus_videoroom_rtp_relay_packet *packet) {
+	if(ps == NULL || sc < 0 || sc > 2 || packet == NULL)
+		return;
+	uint32_t ts = packet->timestamp;
+	janus_mutex_lock(&ps->keyframe_mutex);
+	if(ps->keyframe_caching[sc] && ts == ps->keyframe_ts[sc]) {
+		/* Another packet of the keyframe we're collecting */
+		if(ps->keyframe_pkts[sc] < JANUS_VIDEOROOM_KEYFRAME_CACHE_MAX) {
+			ps->keyframe_cache[sc] = g_slist_append(ps->keyframe_cache[sc],
+				janus_videoroom_rtp_relay_packet_clone(packet));
+			ps->keyframe_pkts[sc]++;
+		} else {
+			/* Too large to be worth replaying, drop what we collected */
+			g_slist_free_full(ps->keyframe_cache[sc], (GDestroyNotify)janus_videoroom_rtp_relay_packet_unref);
+			ps->keyframe_cache[sc] = NULL;
+			ps->keyframe_pkts[sc] = 0;
+			ps->keyframe_caching[sc] = FALSE;
+		}
+	} else if(packet->keyframe == 1) {
+		/* A new keyframe starts here: drop the previous one and start collecting */
+		g_slist_free_full(ps->keyframe_cache[sc], (GDestroyNotify)janus_videoroom_rtp_relay_packet_unref);
+		ps->keyframe_cache[sc] = g_slist_append(NULL, janus_videoroom_rtp_relay_packet_clone(packet));
+		ps->keyframe_pkts[sc] = 1;
+		ps->keyframe_ts[sc] = ts;
+		ps->keyframe_caching[sc] = TRUE;
+	} else if(ps->keyframe_caching[sc]) {
+		/* First packet of a different frame: the cached keyframe is complete */
+		ps->keyframe_caching[sc] = FALSE;
+	}
+	janus_mutex_unlock(&ps->keyframe_mutex);
+}
+static void janus_videoroom_keyframe_cache_replay(janus_videoroom_subscriber_stream *stream,
+		janus_videoroom_publisher_stream *ps, int sc) {
+	if(stream == NULL || ps == NULL || !ps->simulcast || sc < 0 || sc > 2)
+		return;
+	char buffer[1500];
+	janus_mutex_lock(&ps->keyframe_mutex);
+	if(ps->keyframe_cache[sc] == NULL || ps->keyframe_caching[sc]) {
+		/* No complete keyframe cached for this substream (yet): the
+		 * regular PLI path will have to do */
+		janus_mutex_unlock(&ps->keyframe_mutex);
+		return;
+	}
+	JANUS_LOG(LOG_VERB, "Replaying cached keyframe (substream %d, %u packets)\n",
+		sc, ps->keyframe_pkts[sc]);
+	GSList *l = ps->keyframe_cache[sc];
+	while(l) {
+		janus_videoroom_rtp_relay_packet *cached = (janus_videoroom_rtp_relay_packet *)l->data;
+		if(cached->length <= (int)sizeof(buffer)) {
+			/* Relay a private copy, as the relay step patches the header in place */
+			memcpy(buffer, cached->data, cached->length);
+			janus_videoroom_rtp_relay_packet pkt = *cached;
+			pkt.data = (janus_rtp_header *)buffer;
+			janus_videoroom_relay_rtp_packet(stream, &pkt);
+		}
+		l = l->next;
+	}
+	janus_mutex_unlock(&ps->keyframe_mutex);
+}
+static void janus_videoroom_keyframe_cache_clear(janus_videoroom_publisher_stream *ps) {
+	janus_mutex_lock(&ps->keyframe_mutex);
+	int sc = 0;
+	for(sc = 0; sc < 3; sc++) {
+		g_slist_free_full(ps->keyframe_cache[sc], (GDestroyNotify)janus_videoroom_rtp_relay_packet_unref);
+		ps->keyframe_cache[sc] = NULL;
+		ps->keyframe_pkts[sc] = 0;
+		ps->keyframe_caching[sc] = FALSE;
+	}
+	janus_mutex_unlock(&ps->keyframe_mutex);
 }
 
 /* VideoRoom publishers can be forwarder remotely: we use the following
@@ -2728,9 +2965,16 @@ static void janus_videoroom_publisher_stream_free(const janus_refcount *ps_ref)
 	g_free(ps->vp9_profile);
 	janus_recorder_destroy(ps->rc);
 	g_slist_free(ps->subscribers);
+	if(ps->subscribers_index != NULL)
+		g_ptr_array_unref(ps->subscribers_index);
 	janus_mutex_destroy(&ps->subscribers_mutex);
+	int sc = 0;
+	for(sc = 0; sc < 3; sc++)
+		g_slist_free_full(ps->keyframe_cache[sc], (GDestroyNotify)janus_videoroom_rtp_relay_packet_unref);
+	janus_mutex_destroy(&ps->keyframe_mutex);
 	g_hash_table_destroy(ps->rtp_forwarders);
 	ps->rtp_forwarders = NULL;
+	g_free(ps->rtp_forwarders_batch);
 	janus_mutex_destroy(&ps->rtp_forwarders_mutex);
 	janus_mutex_destroy(&ps->rid_mutex);
 	janus_rtp_simulcasting_cleanup(NULL, NULL, ps->rid, NULL);
@@ -2767,8 +3011,77 @@ static void janus_videoroom_publisher_dereference_nodebug(janus_videoroom_publis
 	janus_refcount_decrease_nodebug(&p->ref);
 }
 
+/* RCU-style snapshot of the publisher state the media path needs for each
+ * packet: the media thread grabs the current snapshot without taking any
+ * lock, while the control plane (join/leave/renegotiations) atomically swaps
+ * in a new one whenever the room or the streams of the publisher change. An
+ * old snapshot is only freed once the media thread has moved off it, which
+ * we can track with a single hazard pointer, since media for a publisher is
+ * always delivered by one thread (its handle loop, or its remote thread) */
+typedef struct janus_videoroom_publisher_snapshot {
+	janus_videoroom *room;	/* Room the publisher is in (the snapshot owns a reference) */
+	GPtrArray *streams;		/* Streams indexed by mindex (the snapshot owns a reference to each) */
+} janus_videoroom_publisher_snapshot;
+
+static void janus_videoroom_publisher_snapshot_free(janus_videoroom_publisher_snapshot *snapshot) {
+	if(snapshot == NULL)
+		return;
+	if(snapshot->room != NULL)
+		janus_refcount_decrease(&snapshot->room->ref);
+	if(snapshot->streams != NULL) {
+		guint i = 0;
+		for(i = 0; i < snapshot->streams->len; i++) {
+			janus_videoroom_publisher_stream *ps = g_ptr_array_index(snapshot->streams, i);
+			if(ps != NULL)
+				janus_refcount_decrease(&ps->ref);
+		}
+		g_ptr_array_unref(snapshot->streams);
+	}
+	g_free(snapshot);
+}
+
+/* Rebuild the snapshot of a publisher: the control plane must invoke this
+ * every time the room or the streams of the publisher change, while still
+ * holding the mutex that protects the field that was just updated */
+static void janus_videoroom_publisher_snapshot_update(janus_videoroom_publisher *publisher) {
+	janus_mutex_lock(&publisher->snapshot_mutex);
+	janus_videoroom_publisher_snapshot *snapshot = NULL;
+	if(publisher->room != NULL && !g_atomic_int_get(&publisher->destroyed)) {
+		snapshot = g_malloc0(sizeof(janus_videoroom_publisher_snapshot));
+		snapshot->room = publisher->room;
+		janus_refcount_increase(&snapshot->room->ref);
+		snapshot->streams = g_ptr_array_new();
+		GList *temp = publisher->streams;
+		while(temp) {
+			janus_videoroom_publisher_stream *ps = (janus_videoroom_publisher_stream *)temp->data;
+			if(ps != NULL && ps->mindex >= 0) {
+				if((int)snapshot->streams->len <= ps->mindex)
+					g_ptr_array_set_size(snapshot->streams, ps->mindex+1);
+				if(g_ptr_array_index(snapshot->streams, ps->mindex) == NULL) {
+					janus_refcount_increase(&ps->ref);
+					snapshot->streams->pdata[ps->mindex] = ps;
+				}
+			}
+			temp = temp->next;
+		}
+	}
+	janus_videoroom_publisher_snapshot *old = g_atomic_pointer_get(&publisher->snapshot);
+	g_atomic_pointer_set(&publisher->snapshot, snapshot);
+	if(old != NULL) {
+		/* Wait for the media thread to move off the old snapshot before freeing it */
+		while(g_atomic_pointer_get(&publisher->snapshot_inuse) == old)
+			g_thread_yield();
+		janus_videoroom_publisher_snapshot_free(old);
+	}
+	janus_mutex_unlock(&publisher->snapshot_mutex);
+}
+
 static void janus_videoroom_publisher_destroy(janus_videoroom_publisher *p) {
 	if(p && g_atomic_int_compare_and_exchange(&p->destroyed, 0, 1)) {
+		/* Get rid of the RCU snapshot, if any: since the destroyed flag is
+		 * set, this swaps in a NULL snapshot and drops the references the
+		 * old one owned, or we'd have a circular reference to the streams */
+		janus_videoroom_publisher_snapshot_update(p);
 		janus_mutex_lock(&p->streams_mutex);
 		/* Forwarders with RTCP support may have an extra reference, stop their source */
 		janus_mutex_lock(&p->rtp_forwarders_mutex);
@@ -2810,13 +3123,18 @@ static void janus_videoroom_publisher_destroy(janus_videoroom_publisher *p) {
 
 static void janus_videoroom_publisher_free(const janus_refcount *p_ref) {
 	janus_videoroom_publisher *p = janus_refcount_containerof(p_ref, janus_videoroom_publisher, ref);
+	if(string_ids)
+		janus_string_id_release(p->user_id_str);
 	g_free(p->room_id_str);
 	g_free(p->user_id_str);
 	g_free(p->display);
 	g_free(p->recording_base);
 	if(p->metadata != NULL)
 		json_decref(p->metadata);
-	/* Get rid of all the streams */
+	if(p->roster_info != NULL)
+		json_decref(p->roster_info);
+	/* Get rid of all the streams (the snapshot is normally gone by now, but just in case) */
+	janus_videoroom_publisher_snapshot_free((janus_videoroom_publisher_snapshot *)p->snapshot);
 	g_list_free_full(p->streams, (GDestroyNotify)(janus_videoroom_publisher_stream_destroy));
 	g_hash_table_unref(p->streams_byid);
 	g_hash_table_unref(p->streams_bymid);
@@ -2839,6 +3157,7 @@ static void janus_videoroom_publisher_free(const janus_refcount *p_ref) {
 	janus_mutex_destroy(&p->subscribers_mutex);
 	janus_mutex_destroy(&p->own_subscriptions_mutex);
 	janus_mutex_destroy(&p->streams_mutex);
+	janus_mutex_destroy(&p->snapshot_mutex);
 	janus_mutex_destroy(&p->rtp_forwarders_mutex);
 	janus_mutex_destroy(&p->mutex);
 
@@ -2881,11 +3200,16 @@ static void janus_videoroom_room_free(const janus_refcount *room_ref) {
 	GList *l = room->threads;
 	while(l) {
 		janus_videoroom_helper *ht = (janus_videoroom_helper *)l->data;
-		g_async_queue_push(ht->queued_packets, &exit_packet);
+		/* One marker per thread: any of them may pick it up */
+		g_async_queue_push(room->helper_work, &exit_helper);
 		janus_videoroom_helper_destroy(ht);
 		l = l->next;
 	}
 	g_list_free(room->threads);
+	if(room->helper_work != NULL)
+		g_async_queue_unref(room->helper_work);
+	if(string_ids)
+		janus_string_id_release(room->room_id_str);
 	g_free(room->room_id_str);
 	g_free(room->room_name);
 	g_free(room->room_secret);
@@ -2896,6 +3220,10 @@ static void janus_videoroom_room_free(const janus_refcount *room_ref) {
 	g_hash_table_destroy(room->participants);
 	g_hash_table_destroy(room->private_ids);
 	g_hash_table_destroy(room->allowed);
+	if(room->remote_mux_publishers != NULL)
+		g_hash_table_destroy(room->remote_mux_publishers);
+	if(room->roster_cache != NULL)
+		json_decref(room->roster_cache);
 	g_free(room);
 }
 
@@ -2974,14 +3302,17 @@ static void janus_videoroom_reqpli(janus_videoroom_publisher_stream *ps, const c
 	janus_videoroom_publisher *remote_publisher = NULL;
 	if(ps->publisher->remote) {
 		remote_publisher = ps->publisher;
-		if(remote_publisher->remote_rtcp_fd < 0 || remote_publisher->rtcp_addr.ss_family == 0)
+		if(remote_publisher->remote_rtcp_fd < 0 && remote_publisher->remote_mux_id == 0)
+			return;
+		if(remote_publisher->rtcp_addr.ss_family == 0)
 			return;
 	}
 	if(!g_atomic_int_compare_and_exchange(&ps->sending_pli, 0, 1))
 		return;
 	gint64 now = janus_get_monotonic_time();
-	if(now - ps->pli_latest < G_USEC_PER_SEC) {
-		/* We just sent a PLI less than a second ago, schedule a new delivery later */
+	if(!janus_rtcp_pli_window_allow(&ps->pli_window, now)) {
+		/* We just sent a PLI within the aggregation window, collapse this
+		 * request into the previous one and schedule a new delivery later */
 		g_atomic_int_set(&ps->need_pli, 1);
 		g_atomic_int_set(&ps->sending_pli, 0);
 		return;
@@ -2999,15 +3330,29 @@ static void janus_videoroom_reqpli(janus_videoroom_publisher_stream *ps, const c
 		}
 	} else {
 		/* Generate a PLI */
-		char rtcp_buf[12];
-		int rtcp_len = 12;
-		janus_rtcp_pli((char *)&rtcp_buf, rtcp_len);
+		char rtcp_buf[JANUS_RTP_FORWARDER_BUS_HDR + 12];
+		char *rtcp = rtcp_buf;
+		int rtcp_len = 12, fd = remote_publisher->remote_rtcp_fd;
+		if(remote_publisher->remote_mux_id > 0) {
+			/* Multiplexed publisher: we'll prefix the PLI with the
+			 * multiplexing header, and send it back on the shared socket */
+			rtcp += JANUS_RTP_FORWARDER_BUS_HDR;
+			fd = remote_publisher->room ? remote_publisher->room->remote_mux_fd : -1;
+		}
+		janus_rtcp_pli(rtcp, rtcp_len);
 		uint32_t ssrc = REMOTE_PUBLISHER_BASE_SSRC + (ps->mindex*REMOTE_PUBLISHER_SSRC_STEP);
-		janus_rtcp_fix_ssrc(NULL, rtcp_buf, rtcp_len, 1, 1, ssrc);
+		janus_rtcp_fix_ssrc(NULL, rtcp, rtcp_len, 1, 1, ssrc);
+		if(remote_publisher->remote_mux_id > 0) {
+			janus_rtp_forwarder_bus_mux(rtcp_buf, sizeof(rtcp_buf), remote_publisher->remote_mux_id);
+			rtcp = rtcp_buf;
+			rtcp_len += JANUS_RTP_FORWARDER_BUS_HDR;
+		}
 		/* Send the packet */
 		socklen_t addrlen = remote_publisher->rtcp_addr.ss_family == AF_INET ? sizeof(struct sockaddr_in) : sizeof(struct sockaddr_in6);
 		int sent = 0;
-		if((sent = sendto(remote_publisher->remote_rtcp_fd, rtcp_buf, rtcp_len, 0,
+		if(fd < 0) {
+			/* No socket to send the PLI on */
+		} else if((sent = sendto(fd, rtcp, rtcp_len, 0,
 				(struct sockaddr *)&remote_publisher->rtcp_addr, addrlen)) < 0) {
 			JANUS_LOG(LOG_ERR, "Error in sendto... %d (%s)\n", errno, g_strerror(errno));
 		} else {
@@ -3143,6 +3488,10 @@ static void janus_videoroom_create_dummy_publisher(janus_videoroom *room, gboole
 	char user_id_num[30];
 	g_snprintf(user_id_num, sizeof(user_id_num), "%"SCNu64, publisher->user_id);
 	publisher->user_id_str = g_strdup(user_id_num);
+	if(string_ids) {
+		/* Intern the generated ID, so that it maps to a unique handle */
+		publisher->user_id = janus_string_id_intern(publisher->user_id_str);
+	}
 	publisher->display = g_strdup("Dummy publisher");
 	publisher->acodec = JANUS_AUDIOCODEC_NONE;
 	publisher->vcodec = JANUS_VIDEOCODEC_NONE;
@@ -3162,6 +3511,7 @@ static void janus_videoroom_create_dummy_publisher(janus_videoroom *room, gboole
 	publisher->udp_sock = -1;
 	g_atomic_int_set(&publisher->destroyed, 0);
 	janus_mutex_init(&publisher->mutex);
+	janus_mutex_init(&publisher->snapshot_mutex);
 	janus_refcount_init(&publisher->ref, janus_videoroom_publisher_free);
 	/* Now we create a separate publisher stream for each supported codec in the room */
 	janus_videoroom_publisher_stream *ps = NULL;
@@ -3187,6 +3537,7 @@ static void janus_videoroom_create_dummy_publisher(janus_videoroom *room, gboole
 		ps->acodec = room->acodec[i];
 		ps->vcodec = JANUS_VIDEOCODEC_NONE;
 		ps->pt = janus_audiocodec_pt(ps->acodec);
+		ps->pli_window.min_interval = ((gint64)room->pli_window)*1000;
 		if(fmtp != NULL && strcmp(fmtp, "none")) {
 			/* Parse the fmtp string to see what we support (opus only) */
 			if(ps->acodec == JANUS_AUDIOCODEC_OPUS) {
@@ -3205,6 +3556,7 @@ static void janus_videoroom_create_dummy_publisher(janus_videoroom *room, gboole
 		janus_refcount_increase(&ps->ref);	/* This is for the id-indexed hashtable */
 		janus_refcount_increase(&ps->ref);	/* This is for the mid-indexed hashtable */
 		janus_mutex_init(&ps->subscribers_mutex);
+		janus_mutex_init(&ps->keyframe_mutex);
 		janus_mutex_init(&ps->rtp_forwarders_mutex);
 		janus_mutex_init(&ps->rid_mutex);
 		ps->rtp_forwarders = g_hash_table_new_full(NULL, NULL, NULL, (GDestroyNotify)janus_rtp_forwarder_destroy);
@@ -3233,6 +3585,7 @@ static void janus_videoroom_create_dummy_publisher(janus_videoroom *room, gboole
 		ps->acodec = JANUS_AUDIOCODEC_NONE;
 		ps->vcodec = room->vcodec[i];
 		ps->pt = janus_videocodec_pt(ps->vcodec);
+		ps->pli_window.min_interval = ((gint64)room->pli_window)*1000;
 		if(fmtp != NULL && strcmp(fmtp, "none")) {
 			/* Parse the fmtp string to see what we support (H.264 and VP9 profiles only) */
 			if(ps->vcodec == JANUS_VIDEOCODEC_H264)
@@ -3252,6 +3605,7 @@ static void janus_videoroom_create_dummy_publisher(janus_videoroom *room, gboole
 		janus_refcount_increase(&ps->ref);	/* This is for the id-indexed hashtable */
 		janus_refcount_increase(&ps->ref);	/* This is for the mid-indexed hashtable */
 		janus_mutex_init(&ps->subscribers_mutex);
+		janus_mutex_init(&ps->keyframe_mutex);
 		janus_mutex_init(&ps->rtp_forwarders_mutex);
 		janus_mutex_init(&ps->rid_mutex);
 		ps->rtp_forwarders = g_hash_table_new_full(NULL, NULL, NULL, (GDestroyNotify)janus_rtp_forwarder_destroy);
@@ -3263,7 +3617,7 @@ static void janus_videoroom_create_dummy_publisher(janus_videoroom *room, gboole
 	/* Done: add the dummy publisher to the list */
 	janus_refcount_increase(&publisher->session->ref);
 	g_hash_table_insert(room->participants,
-		string_ids ? (gpointer)g_strdup(publisher->user_id_str) : (gpointer)janus_uint64_dup(publisher->user_id),
+		(gpointer)janus_uint64_dup(publisher->user_id),
 		publisher);
 }
 
@@ -3325,7 +3679,7 @@ static janus_videoroom_subscriber_stream *janus_videoroom_subscriber_stream_add(
 	stream->svc_context.spatial_target = 2;	/* FIXME Actually depends on the scalabilityMode */
 	stream->svc_context.temporal_target = 2;	/* FIXME Actually depends on the scalabilityMode */
 	janus_mutex_lock(&ps->subscribers_mutex);
-	ps->subscribers = g_slist_append(ps->subscribers, stream);
+	janus_videoroom_publisher_stream_add_subscriber(ps, stream);
 	/* If we're using helper threads, add the subscriber to one of those */
 	if(subscriber->room && subscriber->room->helper_threads > 0) {
 		int subscribers = -1;
@@ -3370,7 +3724,7 @@ static janus_videoroom_subscriber_stream *janus_videoroom_subscriber_stream_add_
 		if(stream_ps != NULL && stream_ps->type == ps->type && stream->type == JANUS_VIDEOROOM_MEDIA_DATA) {
 			/* We already have a datachannel m-line, no need for others: just update the subscribers list */
 			if(g_slist_find(ps->subscribers, stream) == NULL && g_slist_find(stream->publisher_streams, ps) == NULL) {
-				ps->subscribers = g_slist_append(ps->subscribers, stream);
+				janus_videoroom_publisher_stream_add_subscriber(ps, stream);
 				stream->publisher_streams = g_slist_append(stream->publisher_streams, ps);
 				/* The two streams reference each other */
 				janus_refcount_increase(&stream->ref);
@@ -3431,7 +3785,7 @@ static janus_videoroom_subscriber_stream *janus_videoroom_subscriber_stream_add_
 				}
 				janus_mutex_lock(&ps->subscribers_mutex);
 				if(g_slist_find(ps->subscribers, stream) == NULL && g_slist_find(stream->publisher_streams, ps) == NULL) {
-					ps->subscribers = g_slist_append(ps->subscribers, stream);
+					janus_videoroom_publisher_stream_add_subscriber(ps, stream);
 					stream->publisher_streams = g_slist_append(stream->publisher_streams, ps);
 					/* The two streams reference each other */
 					janus_refcount_increase(&stream->ref);
@@ -3491,7 +3845,7 @@ static void janus_videoroom_subscriber_stream_remove(janus_videoroom_subscriber_
 			}
 			s->opusfec = FALSE;
 			if(g_slist_find(ps->subscribers, s) != NULL) {
-				ps->subscribers = g_slist_remove(ps->subscribers, s);
+				janus_videoroom_publisher_stream_remove_subscriber(ps, s);
 				unref_ss = TRUE;
 			}
 			/* Remove the subscriber from the helper threads too, if any */
@@ -3708,6 +4062,10 @@ int janus_videoroom_init(janus_callbacks *callback, const char *config_path) {
 		return -1;
 	}
 
+	/* All the relay packets we clone will live in recyclable pool slots */
+	janus_plugin_packet_pool_init(&packet_pool,
+		sizeof(janus_videoroom_rtp_relay_packet), 1500, JANUS_VIDEOROOM_PACKET_POOL_SLOTS);
+
 	/* Read configuration */
 	char filename[255];
 	g_snprintf(filename, 255, "%s/%s.jcfg", config_path, JANUS_VIDEOROOM_PACKAGE);
@@ -3752,8 +4110,11 @@ int janus_videoroom_init(janus_callbacks *callback, const char *config_path) {
 			JANUS_LOG(LOG_INFO, "VideoRoom will use alphanumeric IDs, not numeric\n");
 		}
 	}
-	rooms = g_hash_table_new_full(string_ids ? g_str_hash : g_int64_hash, string_ids ? g_str_equal : g_int64_equal,
+	rooms = g_hash_table_new_full(g_int64_hash, g_int64_equal,
 		(GDestroyNotify)g_free, (GDestroyNotify)janus_videoroom_room_destroy);
+	/* Name our global locks in the core contention profiler table */
+	janus_mutex_profile_register(&rooms_mutex, "videoroom/rooms");
+	janus_mutex_profile_register(&sessions_mutex, "videoroom/sessions");
 	/* Iterate on all rooms */
 	if(config != NULL) {
 		GList *clist = janus_config_get_categories(config, NULL), *cl = clist;
@@ -3774,6 +4135,7 @@ int janus_videoroom_init(janus_callbacks *callback, const char *config_path) {
 			janus_config_item *bitrate_cap = janus_config_get(config, cat, janus_config_type_item, "bitrate_cap");
 			janus_config_item *maxp = janus_config_get(config, cat, janus_config_type_item, "publishers");
 			janus_config_item *firfreq = janus_config_get(config, cat, janus_config_type_item, "fir_freq");
+			janus_config_item *pliwindow = janus_config_get(config, cat, janus_config_type_item, "pli_window");
 			janus_config_item *audiocodec = janus_config_get(config, cat, janus_config_type_item, "audiocodec");
 			janus_config_item *videocodec = janus_config_get(config, cat, janus_config_type_item, "videocodec");
 			janus_config_item *vp9profile = janus_config_get(config, cat, janus_config_type_item, "vp9_profile");
@@ -3818,10 +4180,12 @@ int janus_videoroom_init(janus_callbacks *callback, const char *config_path) {
 					cl = cl->next;
 					continue;
 				}
+			} else {
+				videoroom->room_id = janus_string_id_find(room_num);
 			}
 			/* Let's make sure the room doesn't exist already */
 			janus_mutex_lock(&rooms_mutex);
-			if(g_hash_table_lookup(rooms, string_ids ? (gpointer)room_num : (gpointer)&videoroom->room_id) != NULL) {
+			if(g_hash_table_lookup(rooms, (gpointer)&videoroom->room_id) != NULL) {
 				/* It does... */
 				janus_mutex_unlock(&rooms_mutex);
 				JANUS_LOG(LOG_ERR, "Can't add the VideoRoom room, room %s already exists...\n", room_num);
@@ -3831,6 +4195,8 @@ int janus_videoroom_init(janus_callbacks *callback, const char *config_path) {
 			}
 			janus_mutex_unlock(&rooms_mutex);
 			videoroom->room_id_str = g_strdup(room_num);
+			if(string_ids)
+				videoroom->room_id = janus_string_id_intern(videoroom->room_id_str);
 			char *description = NULL;
 			if(desc != NULL && desc->value != NULL && strlen(desc->value) > 0)
 				description = g_strdup(desc->value);
@@ -3867,6 +4233,9 @@ int janus_videoroom_init(janus_callbacks *callback, const char *config_path) {
 			videoroom->fir_freq = 0;
 			if(firfreq != NULL && firfreq->value != NULL)
 				videoroom->fir_freq = atol(firfreq->value);
+			videoroom->pli_window = 0;
+			if(pliwindow != NULL && pliwindow->value != NULL)
+				videoroom->pli_window = atol(pliwindow->value);
 			/* By default, we force Opus as the only audio codec */
 			videoroom->acodec[0] = JANUS_AUDIOCODEC_OPUS;
 			videoroom->acodec[1] = JANUS_AUDIOCODEC_NONE;
@@ -4004,11 +4373,14 @@ int janus_videoroom_init(janus_callbacks *callback, const char *config_path) {
 			g_atomic_int_set(&videoroom->destroyed, 0);
 			janus_mutex_init(&videoroom->mutex);
 			janus_refcount_init(&videoroom->ref, janus_videoroom_room_free);
-			videoroom->participants = g_hash_table_new_full(string_ids ? g_str_hash : g_int64_hash, string_ids ? g_str_equal : g_int64_equal,
+			videoroom->participants = g_hash_table_new_full(g_int64_hash, g_int64_equal,
 				(GDestroyNotify)g_free, (GDestroyNotify)janus_videoroom_publisher_dereference);
 			videoroom->private_ids = g_hash_table_new(NULL, NULL);
 			videoroom->check_allowed = FALSE;	/* Static rooms can't have an "allowed" list yet, no hooks to the configuration file */
 			videoroom->allowed = g_hash_table_new_full(g_str_hash, g_str_equal, (GDestroyNotify)g_free, NULL);
+			videoroom->remote_mux_fd = -1;
+			videoroom->remote_mux_next_id = 1;
+			janus_mutex_init(&videoroom->remote_mux_mutex);
 			/* Should we create a dummy participant for placeholder m-lines? */
 			if(dummy_pub && dummy_pub->value && janus_is_true(dummy_pub->value)) {
 				videoroom->dummy_publisher = TRUE;
@@ -4058,12 +4430,14 @@ int janus_videoroom_init(janus_callbacks *callback, const char *config_path) {
 						GError *error = NULL;
 						char tname[16];
 						int i=0;
+						videoroom->helper_work = g_async_queue_new();
 						for(i=0; i<helper_threads; i++) {
 							janus_videoroom_helper *helper = g_malloc0(sizeof(janus_videoroom_helper));
 							helper->id = i+1;
 							helper->room = videoroom;
 							helper->subscribers = g_hash_table_new(NULL, NULL);
-							helper->queued_packets = g_async_queue_new_full((GDestroyNotify)janus_videoroom_rtp_relay_packet_free);
+							helper->queued_packets = g_async_queue_new_full((GDestroyNotify)janus_videoroom_rtp_relay_packet_unref);
+							helper->work = g_async_queue_ref(videoroom->helper_work);
 							janus_mutex_init(&helper->mutex);
 							janus_refcount_init(&helper->ref, janus_videoroom_helper_free);
 							/* Spawn a thread and add references */
@@ -4085,7 +4459,7 @@ int janus_videoroom_init(janus_callbacks *callback, const char *config_path) {
 			}
 			janus_mutex_lock(&rooms_mutex);
 			g_hash_table_insert(rooms,
-				string_ids ? (gpointer)g_strdup(videoroom->room_id_str) : (gpointer)janus_uint64_dup(videoroom->room_id),
+				(gpointer)janus_uint64_dup(videoroom->room_id),
 				videoroom);
 			janus_mutex_unlock(&rooms_mutex);
 			/* Compute a list of the supported codecs for the summary */
@@ -4184,9 +4558,15 @@ void janus_videoroom_destroy(void) {
 	rooms = NULL;
 	janus_mutex_unlock(&rooms_mutex);
 
+	janus_mutex_profile_unregister(&rooms_mutex);
+	janus_mutex_profile_unregister(&sessions_mutex);
+
 	g_async_queue_unref(messages);
 	messages = NULL;
 
+	/* All rooms (and so all relay packets) are gone, free the pool too */
+	janus_plugin_packet_pool_destroy(&packet_pool);
+
 	janus_config_destroy(config);
 	g_free(admin_key);
 
@@ -4307,6 +4687,98 @@ static void janus_videoroom_notify_participants(janus_videoroom_publisher *parti
 	}
 }
 
+/* Helpers to keep a cached, refcounted roster entry for each publisher: when
+ * lots of participants join a large room in a short time, we'd otherwise
+ * rebuild the same "publishers" list from scratch for each joiner, which
+ * means iterating on all streams of all publishers every time. The entry is
+ * built lazily, shared by reference with all concurrent readers, and simply
+ * invalidated whenever something it describes changes */
+static void janus_videoroom_publisher_roster_invalidate(janus_videoroom_publisher *p) {
+	/* Note: must be invoked while holding the streams_mutex */
+	if(p->roster_info != NULL) {
+		json_decref(p->roster_info);
+		p->roster_info = NULL;
+	}
+}
+
+static json_t *janus_videoroom_publisher_roster_info(janus_videoroom_publisher *p) {
+	/* Note: must be invoked while holding the streams_mutex */
+	if(p->roster_info == NULL) {
+		/* No cached entry (or it was invalidated), build it now */
+		json_t *pl = json_object();
+		json_object_set_new(pl, "id", string_ids ? json_string(p->user_id_str) : json_integer(p->user_id));
+		if(p->display)
+			json_object_set_new(pl, "display", json_string(p->display));
+		if(p->metadata)
+			json_object_set_new(pl, "metadata", json_deep_copy(p->metadata));
+		if(p->dummy)
+			json_object_set_new(pl, "dummy", json_true());
+		/* Add proper info on all the streams */
+		gboolean audio_added = FALSE, video_added = FALSE, talking_found = FALSE, talking = FALSE;
+		json_t *media = json_array();
+		GList *temp = p->streams;
+		while(temp) {
+			janus_videoroom_publisher_stream *ps = (janus_videoroom_publisher_stream *)temp->data;
+			json_t *info = json_object();
+			json_object_set_new(info, "type", json_string(janus_videoroom_media_str(ps->type)));
+			json_object_set_new(info, "mindex", json_integer(ps->mindex));
+			json_object_set_new(info, "mid", json_string(ps->mid));
+			if(ps->disabled) {
+				json_object_set_new(info, "disabled", json_true());
+			} else {
+				if(ps->description)
+					json_object_set_new(info, "description", json_string(ps->description));
+				if(ps->type == JANUS_VIDEOROOM_MEDIA_AUDIO) {
+					json_object_set_new(info, "codec", json_string(janus_audiocodec_name(ps->acodec)));
+					/* FIXME For backwards compatibility, we need audio_codec in the global info */
+					if(!audio_added) {
+						audio_added = TRUE;
+						json_object_set_new(pl, "audio_codec", json_string(janus_audiocodec_name(ps->acodec)));
+					}
+					if(ps->acodec == JANUS_AUDIOCODEC_OPUS) {
+						if(ps->opusstereo)
+							json_object_set_new(info, "stereo", json_true());
+						if(ps->opusfec)
+							json_object_set_new(info, "fec", json_true());
+						if(ps->opusdtx)
+							json_object_set_new(info, "dtx", json_true());
+					}
+					if(ps->audio_level_extmap_id > 0) {
+						json_object_set_new(info, "talking", talking ? json_true() : json_false());
+						/* FIXME For backwards compatibility, we also need talking in the global info */
+						talking_found = TRUE;
+						talking |= ps->talking;
+					}
+				} else if(ps->type == JANUS_VIDEOROOM_MEDIA_VIDEO) {
+					/* FIXME For backwards compatibility, we need video_codec in the global info */
+					json_object_set_new(info, "codec", json_string(janus_videocodec_name(ps->vcodec)));
+					if(!video_added) {
+						video_added = TRUE;
+						json_object_set_new(pl, "video_codec", json_string(janus_videocodec_name(ps->vcodec)));
+					}
+					if(ps->vcodec == JANUS_VIDEOCODEC_H264 && ps->h264_profile != NULL)
+						json_object_set_new(info, "h264_profile", json_string(ps->h264_profile));
+					else if(ps->vcodec == JANUS_VIDEOCODEC_VP9 && ps->vp9_profile != NULL)
+						json_object_set_new(info, "vp9_profile", json_string(ps->vp9_profile));
+					if(ps->simulcast)
+						json_object_set_new(info, "simulcast", json_true());
+					if(ps->svc)
+						json_object_set_new(info, "svc", json_true());
+				}
+				if(ps->muted)
+					json_object_set_new(info, "moderated", json_true());
+			}
+			json_array_append_new(media, info);
+			temp = temp->next;
+		}
+		json_object_set_new(pl, "streams", media);
+		if(talking_found)
+			json_object_set_new(pl, "talking", talking ? json_true() : json_false());
+		p->roster_info = pl;
+	}
+	return json_incref(p->roster_info);
+}
+
 static void janus_videoroom_notify_about_publisher(janus_videoroom_publisher *p, gboolean update) {
 	if(p == NULL)
 		return;
@@ -4454,7 +4926,7 @@ static void janus_videoroom_leave_or_unpublish(janus_videoroom_publisher *partic
 	if(participant->room == NULL || participant->dummy)
 		return;
 	janus_mutex_lock(&rooms_mutex);
-	if(!g_hash_table_lookup(rooms, string_ids ? (gpointer)participant->room_id_str : (gpointer)&participant->room_id)) {
+	if(!g_hash_table_lookup(rooms, (gpointer)&participant->room_id)) {
 		JANUS_LOG(LOG_ERR, "No such room (%s)\n", participant->room_id_str);
 		janus_mutex_unlock(&rooms_mutex);
 		return;
@@ -4496,12 +4968,15 @@ static void janus_videoroom_leave_or_unpublish(janus_videoroom_publisher *partic
 	}
 	if(is_leaving) {
 		g_hash_table_remove(participant->room->participants,
-			string_ids ? (gpointer)participant->user_id_str : (gpointer)&participant->user_id);
+			(gpointer)&participant->user_id);
 		g_hash_table_remove(participant->room->private_ids, GUINT_TO_POINTER(participant->pvt_id));
 		janus_mutex_lock(&participant->mutex);
 		g_clear_pointer(&participant->room, janus_videoroom_room_dereference);
+		janus_videoroom_publisher_snapshot_update(participant);
 		janus_mutex_unlock(&participant->mutex);
 	}
+	/* Either way the roster changed, so the cached list is stale */
+	g_atomic_int_set(&room->roster_dirty, 1);
 	janus_mutex_unlock(&room->mutex);
 	janus_refcount_decrease(&room->ref);
 	json_decref(event);
@@ -4648,6 +5123,8 @@ json_t *janus_videoroom_query_session(janus_plugin_session *handle) {
 						json_object_set_new(m, "audio-level-dBov", json_integer(ps->audio_dBov_level));
 						json_object_set_new(m, "talking", ps->talking ? json_true() : json_false());
 					}
+					if(ps->type == JANUS_VIDEOROOM_MEDIA_VIDEO)
+						json_object_set_new(m, "pli-suppressed", json_integer(ps->pli_window.suppressed));
 					janus_mutex_lock(&ps->subscribers_mutex);
 					json_object_set_new(m, "subscribers", json_integer(g_slist_length(ps->subscribers)));
 					janus_mutex_unlock(&ps->subscribers_mutex);
@@ -4701,9 +5178,10 @@ static int janus_videoroom_access_room(json_t *root, gboolean check_modify, gboo
 		room_id_str = room_id_num;
 	} else {
 		room_id_str = (char *)json_string_value(room);
+		room_id = janus_string_id_find(room_id_str);
 	}
 	*videoroom = g_hash_table_lookup(rooms,
-		string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+		(gpointer)&room_id);
 	if(*videoroom == NULL) {
 		JANUS_LOG(LOG_ERR, "No such room (%s)\n", room_id_str);
 		error_code = JANUS_VIDEOROOM_ERROR_NO_SUCH_ROOM;
@@ -4807,6 +5285,7 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 		json_t *bitrate = json_object_get(root, "bitrate");
 		json_t *bitrate_cap = json_object_get(root, "bitrate_cap");
 		json_t *fir_freq = json_object_get(root, "fir_freq");
+		json_t *pli_window = json_object_get(root, "pli_window");
 		json_t *publishers = json_object_get(root, "publishers");
 		json_t *allowed = json_object_get(root, "allowed");
 		json_t *audiocodec = json_object_get(root, "audiocodec");
@@ -4907,6 +5386,7 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 			room_id_str = room_id_num;
 		} else {
 			room_id_str = (char *)json_string_value(room);
+			room_id = janus_string_id_find(room_id_str);
 		}
 		if(room_id == 0 && room_id_str == NULL) {
 			JANUS_LOG(LOG_WARN, "Desired room ID is empty, which is not allowed... picking random ID instead\n");
@@ -4914,7 +5394,12 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 		janus_mutex_lock(&rooms_mutex);
 		if(room_id > 0 || room_id_str != NULL) {
 			/* Let's make sure the room doesn't exist already */
-			if(g_hash_table_lookup(rooms, string_ids ? (gpointer)room_id_str : (gpointer)&room_id) != NULL) {
+			if(string_ids && room_id == 0) {
+				/* Re-resolve the ID now that we hold the lock, in case
+				 * a concurrent create interned it in the meanwhile */
+				room_id = janus_string_id_find(room_id_str);
+			}
+			if(g_hash_table_lookup(rooms, (gpointer)&room_id) != NULL) {
 				/* It does... */
 				janus_mutex_unlock(&rooms_mutex);
 				error_code = JANUS_VIDEOROOM_ERROR_ROOM_EXISTS;
@@ -4940,7 +5425,7 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 		} else if(string_ids && room_id_str == NULL) {
 			while(room_id_str == NULL) {
 				room_id_str = janus_random_uuid();
-				if(g_hash_table_lookup(rooms, room_id_str) != NULL) {
+				if(janus_string_id_find(room_id_str) != 0) {
 					/* Room ID already taken, try another one */
 					g_clear_pointer(&room_id_str, g_free);
 				}
@@ -4949,6 +5434,8 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 		}
 		videoroom->room_id = room_id;
 		videoroom->room_id_str = room_id_str ? g_strdup(room_id_str) : NULL;
+		if(string_ids)
+			videoroom->room_id = janus_string_id_intern(videoroom->room_id_str);
 		if(room_id_allocated)
 			g_free(room_id_str);
 		char *description = NULL;
@@ -4988,18 +5475,23 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 		videoroom->fir_freq = 0;
 		if(fir_freq)
 			videoroom->fir_freq = json_integer_value(fir_freq);
+		videoroom->pli_window = 0;
+		if(pli_window)
+			videoroom->pli_window = json_integer_value(pli_window);
 		/* If we need helper threads, spawn them now */
 		videoroom->helper_threads = json_integer_value(threads);;
 		if(videoroom->helper_threads > 0) {
 			GError *error = NULL;
 			char tname[16];
 			int i=0;
+			videoroom->helper_work = g_async_queue_new();
 			for(i=0; i<videoroom->helper_threads; i++) {
 				janus_videoroom_helper *helper = g_malloc0(sizeof(janus_videoroom_helper));
 				helper->id = i+1;
 				helper->room = videoroom;
 				helper->subscribers = g_hash_table_new(NULL, NULL);
-				helper->queued_packets = g_async_queue_new_full((GDestroyNotify)janus_videoroom_rtp_relay_packet_free);
+				helper->queued_packets = g_async_queue_new_full((GDestroyNotify)janus_videoroom_rtp_relay_packet_unref);
+				helper->work = g_async_queue_ref(videoroom->helper_work);
 				janus_mutex_init(&helper->mutex);
 				janus_refcount_init(&helper->ref, janus_videoroom_helper_free);
 				/* Spawn a thread and add references */
@@ -5142,10 +5634,13 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 		g_atomic_int_set(&videoroom->destroyed, 0);
 		janus_mutex_init(&videoroom->mutex);
 		janus_refcount_init(&videoroom->ref, janus_videoroom_room_free);
-		videoroom->participants = g_hash_table_new_full(string_ids ? g_str_hash : g_int64_hash, string_ids ? g_str_equal : g_int64_equal,
+		videoroom->participants = g_hash_table_new_full(g_int64_hash, g_int64_equal,
 			(GDestroyNotify)g_free, (GDestroyNotify)janus_videoroom_publisher_dereference);
 		videoroom->private_ids = g_hash_table_new(NULL, NULL);
 		videoroom->allowed = g_hash_table_new_full(g_str_hash, g_str_equal, (GDestroyNotify)g_free, NULL);
+		videoroom->remote_mux_fd = -1;
+		videoroom->remote_mux_next_id = 1;
+		janus_mutex_init(&videoroom->remote_mux_mutex);
 		if(allowed != NULL) {
 			/* Populate the "allowed" list as an ACL for people trying to join */
 			if(json_array_size(allowed) > 0) {
@@ -5242,6 +5737,10 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 				g_snprintf(value, BUFSIZ, "%"SCNu16, videoroom->fir_freq);
 				janus_config_add(config, c, janus_config_item_create("fir_freq", value));
 			}
+			if(videoroom->pli_window) {
+				g_snprintf(value, BUFSIZ, "%"SCNu32, videoroom->pli_window);
+				janus_config_add(config, c, janus_config_item_create("pli_window", value));
+			}
 			char video_codecs[100];
 			char audio_codecs[100];
 			janus_videoroom_codecstr(videoroom, audio_codecs, video_codecs, sizeof(audio_codecs), ",");
@@ -5296,7 +5795,7 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 		}
 
 		g_hash_table_insert(rooms,
-			string_ids ? (gpointer)g_strdup(videoroom->room_id_str) : (gpointer)janus_uint64_dup(videoroom->room_id),
+			(gpointer)janus_uint64_dup(videoroom->room_id),
 			videoroom);
 		/* Show updated rooms list */
 		GHashTableIter iter;
@@ -5439,6 +5938,10 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 				g_snprintf(value, BUFSIZ, "%"SCNu16, videoroom->fir_freq);
 				janus_config_add(config, c, janus_config_item_create("fir_freq", value));
 			}
+			if(videoroom->pli_window) {
+				g_snprintf(value, BUFSIZ, "%"SCNu32, videoroom->pli_window);
+				janus_config_add(config, c, janus_config_item_create("pli_window", value));
+			}
 			char audio_codecs[100];
 			char video_codecs[100];
 			janus_videoroom_codecstr(videoroom, audio_codecs, video_codecs, sizeof(audio_codecs), ",");
@@ -5540,6 +6043,7 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 			room_id_str = room_id_num;
 		} else {
 			room_id_str = (char *)json_string_value(room);
+			room_id = janus_string_id_find(room_id_str);
 		}
 		janus_mutex_lock(&rooms_mutex);
 		janus_videoroom *videoroom = NULL;
@@ -5550,7 +6054,7 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 		}
 		/* Remove room, but add a reference until we're done */
 		janus_refcount_increase(&videoroom->ref);
-		g_hash_table_remove(rooms, string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+		g_hash_table_remove(rooms, (gpointer)&room_id);
 		/* Notify all participants that the fun is over, and that they'll be kicked */
 		JANUS_LOG(LOG_VERB, "Notifying all participants\n");
 		json_t *destroyed = json_object();
@@ -5565,6 +6069,7 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 			if(p && !g_atomic_int_get(&p->destroyed) && p->session && p->room && !p->dummy) {
 				janus_mutex_lock(&p->mutex);
 				g_clear_pointer(&p->room, janus_videoroom_room_dereference);
+				janus_videoroom_publisher_snapshot_update(p);
 				janus_mutex_unlock(&p->mutex);
 				/* Notify the user we're going to destroy the room... */
 				int ret = gateway->push_event(p->session->handle, &janus_videoroom_plugin, NULL, destroyed, NULL);
@@ -5648,6 +6153,7 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 				if(room->bitrate_cap)
 					json_object_set_new(rl, "bitrate_cap", json_true());
 				json_object_set_new(rl, "fir_freq", json_integer(room->fir_freq));
+				json_object_set_new(rl, "pli_window", json_integer(room->pli_window));
 				json_object_set_new(rl, "require_pvtid", room->require_pvtid ? json_true() : json_false());
 				json_object_set_new(rl, "require_e2ee", room->require_e2ee ? json_true() : json_false());
 				json_object_set_new(rl, "dummy_publisher", room->dummy_publisher ? json_true() : json_false());
@@ -5749,6 +6255,7 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 			room_id_str = room_id_num;
 		} else {
 			room_id_str = (char *)json_string_value(room);
+			room_id = janus_string_id_find(room_id_str);
 		}
 		guint64 publisher_id = 0;
 		char publisher_id_num[30], *publisher_id_str = NULL;
@@ -5758,6 +6265,7 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 			publisher_id_str = publisher_id_num;
 		} else {
 			publisher_id_str = (char *)json_string_value(pub_id);
+			publisher_id = janus_string_id_find(publisher_id_str);
 		}
 		const char *host = json_string_value(json_host), *resolved_host = NULL;
 		/* Check if we need to resolve this host address */
@@ -5893,7 +6401,7 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 		janus_mutex_unlock(&rooms_mutex);
 		janus_mutex_lock(&videoroom->mutex);
 		janus_videoroom_publisher *publisher = g_hash_table_lookup(videoroom->participants,
-			string_ids ? (gpointer)publisher_id_str : (gpointer)&publisher_id);
+			(gpointer)&publisher_id);
 		if(publisher == NULL) {
 			janus_mutex_unlock(&videoroom->mutex);
 			janus_refcount_decrease(&videoroom->ref);
@@ -6400,6 +6908,7 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 			room_id_str = room_id_num;
 		} else {
 			room_id_str = (char *)json_string_value(room);
+			room_id = janus_string_id_find(room_id_str);
 		}
 		guint64 publisher_id = 0;
 		char publisher_id_num[30], *publisher_id_str = NULL;
@@ -6409,6 +6918,7 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 			publisher_id_str = publisher_id_num;
 		} else {
 			publisher_id_str = (char *)json_string_value(pub_id);
+			publisher_id = janus_string_id_find(publisher_id_str);
 		}
 		guint32 stream_id = json_integer_value(id);
 		janus_mutex_lock(&rooms_mutex);
@@ -6422,7 +6932,7 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 		janus_mutex_unlock(&rooms_mutex);
 		janus_mutex_lock(&videoroom->mutex);
 		janus_videoroom_publisher *publisher = g_hash_table_lookup(videoroom->participants,
-			string_ids ? (gpointer)publisher_id_str : (gpointer)&publisher_id);
+			(gpointer)&publisher_id);
 		if(publisher == NULL) {
 			janus_mutex_unlock(&videoroom->mutex);
 			janus_refcount_decrease(&videoroom->ref);
@@ -6509,9 +7019,10 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 			room_id_str = room_id_num;
 		} else {
 			room_id_str = (char *)json_string_value(room);
+			room_id = janus_string_id_find(room_id_str);
 		}
 		janus_mutex_lock(&rooms_mutex);
-		gboolean room_exists = g_hash_table_contains(rooms, string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+		gboolean room_exists = g_hash_table_contains(rooms, (gpointer)&room_id);
 		janus_mutex_unlock(&rooms_mutex);
 		response = json_object();
 		json_object_set_new(response, "videoroom", json_string("success"));
@@ -6555,6 +7066,7 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 			room_id_str = room_id_num;
 		} else {
 			room_id_str = (char *)json_string_value(room);
+			room_id = janus_string_id_find(room_id_str);
 		}
 		janus_mutex_lock(&rooms_mutex);
 		janus_videoroom *videoroom = NULL;
@@ -6666,6 +7178,7 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 			room_id_str = room_id_num;
 		} else {
 			room_id_str = (char *)json_string_value(room);
+			room_id = janus_string_id_find(room_id_str);
 		}
 		janus_mutex_lock(&rooms_mutex);
 		janus_videoroom *videoroom = NULL;
@@ -6685,9 +7198,10 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 			user_id_str = user_id_num;
 		} else {
 			user_id_str = (char *)json_string_value(id);
+			user_id = janus_string_id_find(user_id_str);
 		}
 		janus_videoroom_publisher *participant = g_hash_table_lookup(videoroom->participants,
-			string_ids ? (gpointer)user_id_str : (gpointer)&user_id);
+			(gpointer)&user_id);
 		if(participant == NULL) {
 			janus_mutex_unlock(&videoroom->mutex);
 			janus_refcount_decrease(&videoroom->ref);
@@ -6793,6 +7307,7 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 			room_id_str = room_id_num;
 		} else {
 			room_id_str = (char *)json_string_value(room);
+			room_id = janus_string_id_find(room_id_str);
 		}
 		janus_mutex_lock(&rooms_mutex);
 		janus_videoroom *videoroom = NULL;
@@ -6812,9 +7327,10 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 			user_id_str = user_id_num;
 		} else {
 			user_id_str = (char *)json_string_value(id);
+			user_id = janus_string_id_find(user_id_str);
 		}
 		janus_videoroom_publisher *participant = g_hash_table_lookup(videoroom->participants,
-			string_ids ? (gpointer)user_id_str : (gpointer)&user_id);
+			(gpointer)&user_id);
 		if(participant == NULL) {
 			janus_mutex_unlock(&videoroom->mutex);
 			janus_refcount_decrease(&videoroom->ref);
@@ -6856,6 +7372,7 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 			}
 		}
 		ps->muted = muted;
+		janus_videoroom_publisher_roster_invalidate(participant);
 		janus_mutex_unlock(&participant->streams_mutex);
 		/* Prepare an event for this */
 		json_t *event = json_object();
@@ -6907,6 +7424,7 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 			room_id_str = room_id_num;
 		} else {
 			room_id_str = (char *)json_string_value(room);
+			room_id = janus_string_id_find(room_id_str);
 		}
 		janus_mutex_lock(&rooms_mutex);
 		janus_videoroom *videoroom = NULL;
@@ -6917,45 +7435,55 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 		}
 		janus_refcount_increase(&videoroom->ref);
 		janus_mutex_unlock(&rooms_mutex);
-		/* Return a list of all participants (whether they're publishing or not) */
-		json_t *list = json_array();
-		GHashTableIter iter;
-		gpointer value;
+		/* Return a list of all participants (whether they're publishing or not):
+		 * we keep a cached copy of the list, shared by reference with all
+		 * concurrent requests, and only rebuild it when the roster changed */
 		janus_mutex_lock(&videoroom->mutex);
-		g_hash_table_iter_init(&iter, videoroom->participants);
-		while (!g_atomic_int_get(&videoroom->destroyed) && g_hash_table_iter_next(&iter, NULL, &value)) {
-			janus_videoroom_publisher *p = value;
-			json_t *pl = json_object();
-			json_object_set_new(pl, "id", string_ids ? json_string(p->user_id_str) : json_integer(p->user_id));
-			if(p->display)
-				json_object_set_new(pl, "display", json_string(p->display));
-			if(p->metadata)
-				json_object_set_new(pl, "metadata", json_deep_copy(p->metadata));
-			if(p->dummy)
-				json_object_set_new(pl, "dummy", json_true());
-			if(p->remote)
-				json_object_set_new(pl, "remote", json_true());
-			json_object_set_new(pl, "publisher", g_atomic_int_get(&p->session->started) ? json_true() : json_false());
-			/* To see if the participant is talking, we need to find the audio stream(s) */
-			if(g_atomic_int_get(&p->session->started)) {
-				gboolean found = FALSE, talking = FALSE;
-				janus_mutex_lock(&p->streams_mutex);
-				GList *temp = p->streams;
-				while(temp) {
-					janus_videoroom_publisher_stream *ps = (janus_videoroom_publisher_stream *)temp->data;
-					if(ps && ps->type == JANUS_VIDEOROOM_MEDIA_AUDIO &&
-							ps->audio_level_extmap_id > 0) {
-						found = TRUE;
-						talking |= ps->talking;
+		if(videoroom->roster_cache == NULL || g_atomic_int_compare_and_exchange(&videoroom->roster_dirty, 1, 0)) {
+			if(videoroom->roster_cache != NULL) {
+				json_decref(videoroom->roster_cache);
+				videoroom->roster_cache = NULL;
+			}
+			json_t *cached = json_array();
+			GHashTableIter iter;
+			gpointer value;
+			g_hash_table_iter_init(&iter, videoroom->participants);
+			while (!g_atomic_int_get(&videoroom->destroyed) && g_hash_table_iter_next(&iter, NULL, &value)) {
+				janus_videoroom_publisher *p = value;
+				json_t *pl = json_object();
+				json_object_set_new(pl, "id", string_ids ? json_string(p->user_id_str) : json_integer(p->user_id));
+				if(p->display)
+					json_object_set_new(pl, "display", json_string(p->display));
+				if(p->metadata)
+					json_object_set_new(pl, "metadata", json_deep_copy(p->metadata));
+				if(p->dummy)
+					json_object_set_new(pl, "dummy", json_true());
+				if(p->remote)
+					json_object_set_new(pl, "remote", json_true());
+				json_object_set_new(pl, "publisher", g_atomic_int_get(&p->session->started) ? json_true() : json_false());
+				/* To see if the participant is talking, we need to find the audio stream(s) */
+				if(g_atomic_int_get(&p->session->started)) {
+					gboolean found = FALSE, talking = FALSE;
+					janus_mutex_lock(&p->streams_mutex);
+					GList *temp = p->streams;
+					while(temp) {
+						janus_videoroom_publisher_stream *ps = (janus_videoroom_publisher_stream *)temp->data;
+						if(ps && ps->type == JANUS_VIDEOROOM_MEDIA_AUDIO &&
+								ps->audio_level_extmap_id > 0) {
+							found = TRUE;
+							talking |= ps->talking;
+						}
+						temp = temp->next;
 					}
-					temp = temp->next;
+					janus_mutex_unlock(&p->streams_mutex);
+					if(found)
+						json_object_set_new(pl, "talking", talking ? json_true() : json_false());
 				}
-				janus_mutex_unlock(&p->streams_mutex);
-				if(found)
-					json_object_set_new(pl, "talking", talking ? json_true() : json_false());
+				json_array_append_new(cached, pl);
 			}
-			json_array_append_new(list, pl);
+			videoroom->roster_cache = cached;
 		}
+		json_t *list = json_incref(videoroom->roster_cache);
 		janus_mutex_unlock(&videoroom->mutex);
 		janus_refcount_decrease(&videoroom->ref);
 		response = json_object();
@@ -6985,6 +7513,7 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 			room_id_str = room_id_num;
 		} else {
 			room_id_str = (char *)json_string_value(room);
+			room_id = janus_string_id_find(room_id_str);
 		}
 		janus_mutex_lock(&rooms_mutex);
 		janus_videoroom *videoroom = NULL;
@@ -7220,6 +7749,7 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 			publisher_id_str = publisher_id_num;
 		} else {
 			publisher_id_str = (char *)json_string_value(pub_id);
+			publisher_id = janus_string_id_find(publisher_id_str);
 		}
 		const char *host = json_string_value(json_host), *resolved_host = NULL;
 		/* Check if we need to resolve this host address */
@@ -7265,7 +7795,7 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 		janus_mutex_unlock(&rooms_mutex);
 		janus_mutex_lock(&videoroom->mutex);
 		janus_videoroom_publisher *publisher = g_hash_table_lookup(videoroom->participants,
-			string_ids ? (gpointer)publisher_id_str : (gpointer)&publisher_id);
+			(gpointer)&publisher_id);
 		if(publisher == NULL) {
 			janus_mutex_unlock(&videoroom->mutex);
 			janus_refcount_decrease(&videoroom->ref);
@@ -7445,9 +7975,10 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 			publisher_id_str = publisher_id_num;
 		} else {
 			publisher_id_str = (char *)json_string_value(pub_id);
+			publisher_id = janus_string_id_find(publisher_id_str);
 		}
 		janus_videoroom_publisher *publisher = g_hash_table_lookup(videoroom->participants,
-			string_ids ? (gpointer)publisher_id_str : (gpointer)&publisher_id);
+			(gpointer)&publisher_id);
 		if(publisher == NULL || g_atomic_int_get(&publisher->destroyed)) {
 			janus_mutex_unlock(&videoroom->mutex);
 			janus_refcount_decrease(&videoroom->ref);
@@ -7549,9 +8080,10 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 			publisher_id_str = publisher_id_num;
 		} else {
 			publisher_id_str = (char *)json_string_value(id);
+			publisher_id = janus_string_id_find(publisher_id_str);
 		}
 		janus_videoroom_publisher *publisher = g_hash_table_lookup(videoroom->participants,
-			string_ids ? (gpointer)publisher_id_str : (gpointer)&publisher_id);
+			(gpointer)&publisher_id);
 		if(publisher == NULL || g_atomic_int_get(&publisher->destroyed)) {
 			janus_mutex_unlock(&videoroom->mutex);
 			janus_refcount_decrease(&videoroom->ref);
@@ -7704,9 +8236,10 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 				user_id_str = user_id_num;
 			} else {
 				user_id_str = (char *)json_string_value(id);
+				user_id = janus_string_id_find(user_id_str);
 			}
 			if(g_hash_table_lookup(videoroom->participants,
-					string_ids ? (gpointer)user_id_str : (gpointer)&user_id) != NULL) {
+					(gpointer)&user_id) != NULL) {
 				/* User ID already taken */
 				janus_mutex_unlock(&videoroom->mutex);
 				janus_refcount_decrease(&videoroom->ref);
@@ -7735,7 +8268,7 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 				/* Generate a random ID */
 				while(user_id_str == NULL) {
 					user_id_str = janus_random_uuid();
-					if(g_hash_table_lookup(videoroom->participants, user_id_str) != NULL) {
+					if(janus_string_id_find(user_id_str) != 0) {
 						/* User ID already taken, try another one */
 						g_clear_pointer(&user_id_str, g_free);
 					}
@@ -7771,37 +8304,113 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 		} else {
 			janus_network_address_nullify(&miface);
 		}
+		gboolean multiplex = json_is_true(json_object_get(root, "multiplex"));
 		uint16_t port = json_integer_value(json_object_get(root, "port"));
 		uint16_t rtcp_port = json_integer_value(json_object_get(root, "rtcp_port"));
+		uint16_t stream_id = 0;
 		char host[46];
 		host[0] = '\0';
-		int fd = janus_videoroom_create_fd(port, mcast ? inet_addr(mcast) : INADDR_ANY, &miface, host, sizeof(host));
-		if(fd < 0) {
-			if(user_id_allocated)
-				g_free(user_id_str);
-			janus_mutex_unlock(&videoroom->mutex);
-			janus_refcount_decrease(&videoroom->ref);
-			JANUS_LOG(LOG_ERR, "Could not open UDP socket for RTP stream for remote publisher, %d (%s)\n",
-				errno, g_strerror(errno));
-			error_code = JANUS_VIDEOROOM_ERROR_UNKNOWN_ERROR;
-			g_snprintf(error_cause, 512, "Could not open UDP socket for RTP stream");
-			goto prepare_response;
-		}
-		port = janus_videoroom_get_fd_port(fd);
-		int rtcp_fd = janus_videoroom_create_fd(rtcp_port, mcast ? inet_addr(mcast) : INADDR_ANY, &miface, host, sizeof(host));
-		if(rtcp_fd < 0) {
-			close(fd);
-			if(user_id_allocated)
-				g_free(user_id_str);
-			janus_mutex_unlock(&videoroom->mutex);
-			janus_refcount_decrease(&videoroom->ref);
-			JANUS_LOG(LOG_ERR, "Could not open UDP socket for remote publisher RTCP, %d (%s)\n",
-				errno, g_strerror(errno));
-			error_code = JANUS_VIDEOROOM_ERROR_UNKNOWN_ERROR;
-			g_snprintf(error_cause, 512, "Could not open UDP socket for RTP stream");
-			goto prepare_response;
+		int fd = -1, rtcp_fd = -1;
+		if(!multiplex) {
+			fd = janus_videoroom_create_fd(port, mcast ? inet_addr(mcast) : INADDR_ANY, &miface, host, sizeof(host));
+			if(fd < 0) {
+				if(user_id_allocated)
+					g_free(user_id_str);
+				janus_mutex_unlock(&videoroom->mutex);
+				janus_refcount_decrease(&videoroom->ref);
+				JANUS_LOG(LOG_ERR, "Could not open UDP socket for RTP stream for remote publisher, %d (%s)\n",
+					errno, g_strerror(errno));
+				error_code = JANUS_VIDEOROOM_ERROR_UNKNOWN_ERROR;
+				g_snprintf(error_cause, 512, "Could not open UDP socket for RTP stream");
+				goto prepare_response;
+			}
+			port = janus_videoroom_get_fd_port(fd);
+			rtcp_fd = janus_videoroom_create_fd(rtcp_port, mcast ? inet_addr(mcast) : INADDR_ANY, &miface, host, sizeof(host));
+			if(rtcp_fd < 0) {
+				close(fd);
+				if(user_id_allocated)
+					g_free(user_id_str);
+				janus_mutex_unlock(&videoroom->mutex);
+				janus_refcount_decrease(&videoroom->ref);
+				JANUS_LOG(LOG_ERR, "Could not open UDP socket for remote publisher RTCP, %d (%s)\n",
+					errno, g_strerror(errno));
+				error_code = JANUS_VIDEOROOM_ERROR_UNKNOWN_ERROR;
+				g_snprintf(error_cause, 512, "Could not open UDP socket for RTP stream");
+				goto prepare_response;
+			}
+			rtcp_port = janus_videoroom_get_fd_port(rtcp_fd);
+		} else {
+			/* This publisher will share the multiplexed ingest socket of the room */
+			janus_mutex_lock(&videoroom->remote_mux_mutex);
+			if(videoroom->remote_mux_fd == -1) {
+				/* First multiplexed publisher in this room: create the shared
+				 * socket, and the thread that will drain it for everybody */
+				int mux_fd = janus_videoroom_create_fd(port, mcast ? inet_addr(mcast) : INADDR_ANY, &miface, host, sizeof(host));
+				if(mux_fd < 0) {
+					janus_mutex_unlock(&videoroom->remote_mux_mutex);
+					if(user_id_allocated)
+						g_free(user_id_str);
+					janus_mutex_unlock(&videoroom->mutex);
+					janus_refcount_decrease(&videoroom->ref);
+					JANUS_LOG(LOG_ERR, "Could not open shared UDP socket for multiplexed remote publishers, %d (%s)\n",
+						errno, g_strerror(errno));
+					error_code = JANUS_VIDEOROOM_ERROR_UNKNOWN_ERROR;
+					g_snprintf(error_cause, 512, "Could not open UDP socket for RTP stream");
+					goto prepare_response;
+				}
+				videoroom->remote_mux_fd = mux_fd;
+				videoroom->remote_mux_port = janus_videoroom_get_fd_port(mux_fd);
+				videoroom->remote_mux_publishers = g_hash_table_new_full(NULL, NULL,
+					NULL, (GDestroyNotify)janus_videoroom_publisher_dereference);
+				GError *thread_error = NULL;
+				char mux_tname[16];
+				g_snprintf(mux_tname, sizeof(mux_tname), "vmux %s", videoroom->room_id_str);
+				janus_refcount_increase(&videoroom->ref);
+				videoroom->remote_mux_thread = g_thread_try_new(mux_tname,
+					janus_videoroom_remote_publisher_mux_thread, videoroom, &thread_error);
+				if(thread_error != NULL) {
+					janus_refcount_decrease(&videoroom->ref);
+					close(videoroom->remote_mux_fd);
+					videoroom->remote_mux_fd = -1;
+					g_hash_table_destroy(videoroom->remote_mux_publishers);
+					videoroom->remote_mux_publishers = NULL;
+					janus_mutex_unlock(&videoroom->remote_mux_mutex);
+					if(user_id_allocated)
+						g_free(user_id_str);
+					janus_mutex_unlock(&videoroom->mutex);
+					janus_refcount_decrease(&videoroom->ref);
+					JANUS_LOG(LOG_ERR, "Could not spawn thread for multiplexed remote publishers, %d (%s)\n",
+						errno, g_strerror(errno));
+					error_code = JANUS_VIDEOROOM_ERROR_UNKNOWN_ERROR;
+					g_snprintf(error_cause, 512, "Could not spawn thread for multiplexed remote publishers");
+					goto prepare_response;
+				}
+			}
+			port = videoroom->remote_mux_port;
+			/* Assign a stream ID to demultiplex this publisher by */
+			stream_id = json_integer_value(json_object_get(root, "stream_id"));
+			if(stream_id > 0 && g_hash_table_lookup(videoroom->remote_mux_publishers, GUINT_TO_POINTER(stream_id)) != NULL) {
+				janus_mutex_unlock(&videoroom->remote_mux_mutex);
+				if(user_id_allocated)
+					g_free(user_id_str);
+				janus_mutex_unlock(&videoroom->mutex);
+				janus_refcount_decrease(&videoroom->ref);
+				JANUS_LOG(LOG_ERR, "Stream ID %"SCNu16" already in use in the room\n", stream_id);
+				error_code = JANUS_VIDEOROOM_ERROR_ID_EXISTS;
+				g_snprintf(error_cause, 512, "Stream ID %"SCNu16" already in use in the room", stream_id);
+				goto prepare_response;
+			}
+			while(stream_id == 0) {
+				stream_id = videoroom->remote_mux_next_id++;
+				if(videoroom->remote_mux_next_id == 0) {
+					/* We wrapped around: 0 is reserved for keepalives */
+					videoroom->remote_mux_next_id = 1;
+				}
+				if(stream_id != 0 && g_hash_table_lookup(videoroom->remote_mux_publishers, GUINT_TO_POINTER(stream_id)) != NULL)
+					stream_id = 0;	/* Taken, try the next one */
+			}
+			janus_mutex_unlock(&videoroom->remote_mux_mutex);
 		}
-		rtcp_port = janus_videoroom_get_fd_port(rtcp_fd);
 		/* We create a dummy session first, that's not actually bound to anything */
 		janus_videoroom_session *session = g_malloc0(sizeof(janus_videoroom_session));
 		session->handle = NULL;
@@ -7819,6 +8428,8 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 		janus_refcount_increase(&videoroom->ref);
 		publisher->user_id = user_id;
 		publisher->user_id_str = user_id_allocated ? user_id_str : g_strdup(user_id_str);
+		if(string_ids)
+			publisher->user_id = janus_string_id_intern(publisher->user_id_str);
 		publisher->display = display_text ? g_strdup(display_text) : NULL;
 		publisher->acodec = JANUS_AUDIOCODEC_NONE;
 		publisher->vcodec = JANUS_VIDEOCODEC_NONE;
@@ -7827,8 +8438,10 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 		publisher->remote_ssrc_offset = janus_random_uint32();
 		publisher->remote_fd = fd;
 		publisher->remote_rtcp_fd = rtcp_fd;
+		publisher->remote_mux_id = stream_id;
 		publisher->metadata = metadata ? json_deep_copy(metadata) : NULL;
-		pipe(publisher->pipefd);
+		if(!multiplex)
+			pipe(publisher->pipefd);
 		janus_mutex_init(&publisher->subscribers_mutex);
 		janus_mutex_init(&publisher->own_subscriptions_mutex);
 		publisher->streams_byid = g_hash_table_new_full(NULL, NULL,
@@ -7843,6 +8456,7 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 		publisher->udp_sock = -1;
 		g_atomic_int_set(&publisher->destroyed, 0);
 		janus_mutex_init(&publisher->mutex);
+		janus_mutex_init(&publisher->snapshot_mutex);
 		janus_refcount_init(&publisher->ref, janus_videoroom_publisher_free);
 		/* Create publisher streams for all the things that the remote publisher is sending */
 		janus_videoroom_publisher_stream *ps = NULL;
@@ -7856,6 +8470,7 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 			gboolean disabled = json_is_true(json_object_get(s, "disabled"));
 			/* Create a publisher stream */
 			ps = g_malloc0(sizeof(janus_videoroom_publisher_stream));
+			ps->pli_window.min_interval = ((gint64)videoroom->pli_window)*1000;
 			if(mtype == JANUS_VIDEOROOM_MEDIA_AUDIO || mtype == JANUS_VIDEOROOM_MEDIA_VIDEO) {
 				/* First of all, let's check if we need to setup an SRTP for remote publisher */
 				if(srtp_suite > 0 && srtp_crypto != NULL) {
@@ -7985,6 +8600,7 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 			janus_refcount_increase(&ps->ref);	/* This is for the id-indexed hashtable */
 			janus_refcount_increase(&ps->ref);	/* This is for the mid-indexed hashtable */
 			janus_mutex_init(&ps->subscribers_mutex);
+			janus_mutex_init(&ps->keyframe_mutex);
 			janus_mutex_init(&ps->rtp_forwarders_mutex);
 			ps->rtp_forwarders = g_hash_table_new_full(NULL, NULL, NULL, (GDestroyNotify)janus_rtp_forwarder_destroy);
 			janus_mutex_lock(&publisher->streams_mutex);
@@ -7994,29 +8610,50 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 			janus_mutex_unlock(&publisher->streams_mutex);
 			mindex++;
 		}
-		/* Done, spawn a thread for this remote publisher */
-		GError *error = NULL;
-		char tname[16];
-		g_snprintf(tname, sizeof(tname), "vremote %s", publisher->user_id_str);
-		publisher->remote_thread = g_thread_try_new(tname, janus_videoroom_remote_publisher_thread, publisher, &error);
-		if(error != NULL) {
-			/* Something went wrong */
-			janus_mutex_unlock(&videoroom->mutex);
-			janus_refcount_decrease(&videoroom->ref);
+		janus_videoroom_publisher_snapshot_update(publisher);
+		if(multiplex) {
+			/* No dedicated thread for multiplexed publishers: we add the
+			 * publisher to the room ourselves, and then to the map the
+			 * shared ingest loop of the room uses to demultiplex frames */
+			janus_refcount_increase(&publisher->ref);
+			janus_refcount_increase(&publisher->session->ref);
+			g_hash_table_insert(videoroom->participants,
+				(gpointer)janus_uint64_dup(publisher->user_id),
+				publisher);
+			g_atomic_int_set(&videoroom->roster_dirty, 1);
+			/* Let's also notify all other participants that the publisher is here */
 			janus_mutex_lock(&publisher->streams_mutex);
-			g_list_free_full(publisher->streams, (GDestroyNotify)(janus_videoroom_publisher_stream_unref));
-			publisher->streams = NULL;
-			g_hash_table_remove_all(publisher->streams_byid);
-			g_hash_table_remove_all(publisher->streams_bymid);
+			janus_videoroom_notify_about_publisher(publisher, FALSE);
 			janus_mutex_unlock(&publisher->streams_mutex);
-			janus_videoroom_leave_or_unpublish(publisher, TRUE, FALSE);
-			janus_refcount_decrease(&publisher->session->ref);
-			janus_videoroom_publisher_destroy(publisher);
-			JANUS_LOG(LOG_ERR, "Could not spawn thread for remote publisher, %d (%s)\n",
-				errno, g_strerror(errno));
-			error_code = JANUS_VIDEOROOM_ERROR_UNKNOWN_ERROR;
-			g_snprintf(error_cause, 512, "Could not spawn thread for remote publisher");
-			goto prepare_response;
+			janus_refcount_increase(&publisher->ref);
+			janus_mutex_lock(&videoroom->remote_mux_mutex);
+			g_hash_table_insert(videoroom->remote_mux_publishers, GUINT_TO_POINTER(stream_id), publisher);
+			janus_mutex_unlock(&videoroom->remote_mux_mutex);
+		} else {
+			/* Done, spawn a thread for this remote publisher */
+			GError *error = NULL;
+			char tname[16];
+			g_snprintf(tname, sizeof(tname), "vremote %s", publisher->user_id_str);
+			publisher->remote_thread = g_thread_try_new(tname, janus_videoroom_remote_publisher_thread, publisher, &error);
+			if(error != NULL) {
+				/* Something went wrong */
+				janus_mutex_unlock(&videoroom->mutex);
+				janus_refcount_decrease(&videoroom->ref);
+				janus_mutex_lock(&publisher->streams_mutex);
+				g_list_free_full(publisher->streams, (GDestroyNotify)(janus_videoroom_publisher_stream_unref));
+				publisher->streams = NULL;
+				g_hash_table_remove_all(publisher->streams_byid);
+				g_hash_table_remove_all(publisher->streams_bymid);
+				janus_mutex_unlock(&publisher->streams_mutex);
+				janus_videoroom_leave_or_unpublish(publisher, TRUE, FALSE);
+				janus_refcount_decrease(&publisher->session->ref);
+				janus_videoroom_publisher_destroy(publisher);
+				JANUS_LOG(LOG_ERR, "Could not spawn thread for remote publisher, %d (%s)\n",
+					errno, g_strerror(errno));
+				error_code = JANUS_VIDEOROOM_ERROR_UNKNOWN_ERROR;
+				g_snprintf(error_cause, 512, "Could not spawn thread for remote publisher");
+				goto prepare_response;
+			}
 		}
 
 		janus_mutex_lock(&publisher->rec_mutex);
@@ -8045,7 +8682,10 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 		if(strlen(host) > 0)
 			json_object_set_new(response, "ip", json_string(host));
 		json_object_set_new(response, "port", json_integer(port));
-		json_object_set_new(response, "rtcp_port", json_integer(rtcp_port));
+		if(multiplex)
+			json_object_set_new(response, "stream_id", json_integer(stream_id));
+		else
+			json_object_set_new(response, "rtcp_port", json_integer(rtcp_port));
 		goto prepare_response;
 	} else if(!strcasecmp(request_text, "update_remote_publisher")) {
 		/* Update an existing remote publisher */
@@ -8151,9 +8791,10 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 			publisher_id_str = publisher_id_num;
 		} else {
 			publisher_id_str = (char *)json_string_value(id);
+			publisher_id = janus_string_id_find(publisher_id_str);
 		}
 		janus_videoroom_publisher *publisher = g_hash_table_lookup(videoroom->participants,
-			string_ids ? (gpointer)publisher_id_str : (gpointer)&publisher_id);
+			(gpointer)&publisher_id);
 		if(publisher == NULL || !publisher->remote || g_atomic_int_get(&publisher->remote_leaving)) {
 			janus_mutex_unlock(&videoroom->mutex);
 			janus_refcount_decrease(&videoroom->ref);
@@ -8216,6 +8857,7 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 			gboolean disabled = json_is_true(json_object_get(s, "disabled"));
 			/* Create a publisher stream */
 			ps = g_malloc0(sizeof(janus_videoroom_publisher_stream));
+			ps->pli_window.min_interval = ((gint64)videoroom->pli_window)*1000;
 			if(mtype == JANUS_VIDEOROOM_MEDIA_AUDIO || mtype == JANUS_VIDEOROOM_MEDIA_VIDEO) {
 				/* First of all, let's check if we need to setup an SRTP for remote publisher */
 				if(srtp_suite > 0 && srtp_crypto != NULL) {
@@ -8346,6 +8988,7 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 			janus_refcount_increase(&ps->ref);	/* This is for the id-indexed hashtable */
 			janus_refcount_increase(&ps->ref);	/* This is for the mid-indexed hashtable */
 			janus_mutex_init(&ps->subscribers_mutex);
+			janus_mutex_init(&ps->keyframe_mutex);
 			janus_mutex_init(&ps->rtp_forwarders_mutex);
 			ps->rtp_forwarders = g_hash_table_new_full(NULL, NULL, NULL, (GDestroyNotify)janus_rtp_forwarder_destroy);
 			publisher->streams = g_list_append(publisher->streams, ps);
@@ -8357,7 +9000,10 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 			/* Notify all other participants this publisher's media has changed */
 			janus_videoroom_notify_about_publisher(publisher, TRUE);
 		}
+		janus_videoroom_publisher_roster_invalidate(publisher);
+		janus_videoroom_publisher_snapshot_update(publisher);
 		janus_mutex_unlock(&publisher->streams_mutex);
+		g_atomic_int_set(&videoroom->roster_dirty, 1);
 
 		janus_mutex_lock(&publisher->rec_mutex);
 		janus_mutex_lock(&publisher->streams_mutex);
@@ -8424,9 +9070,10 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 			publisher_id_str = publisher_id_num;
 		} else {
 			publisher_id_str = (char *)json_string_value(id);
+			publisher_id = janus_string_id_find(publisher_id_str);
 		}
 		janus_videoroom_publisher *publisher = g_hash_table_lookup(videoroom->participants,
-			string_ids ? (gpointer)publisher_id_str : (gpointer)&publisher_id);
+			(gpointer)&publisher_id);
 		if(publisher == NULL || !publisher->remote || !g_atomic_int_compare_and_exchange(&publisher->remote_leaving, 0, 1)) {
 			janus_mutex_unlock(&videoroom->mutex);
 			janus_refcount_decrease(&videoroom->ref);
@@ -8435,17 +9082,29 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 			g_snprintf(error_cause, 512, "No such remote publisher (%s)", publisher_id_str);
 			goto prepare_response;
 		}
-		/* Mark the remote publisher as leaving, the thread will do the cleanup */
-		g_atomic_int_set(&publisher->remote_leaving, 1);
-		/* Notify the thread that it's time to go */
-		if(publisher->pipefd[1] > 0) {
-			int code = 1;
-			ssize_t res = 0;
-			do {
-				res = write(publisher->pipefd[1], &code, sizeof(int));
-			} while(res == -1 && errno == EINTR);
+		if(publisher->remote_mux_id > 0) {
+			/* Multiplexed publisher, so no dedicated thread: detach it from
+			 * the shared ingest socket and do the cleanup ourselves */
+			janus_refcount_increase(&publisher->ref);
+			janus_mutex_lock(&videoroom->remote_mux_mutex);
+			g_hash_table_remove(videoroom->remote_mux_publishers, GUINT_TO_POINTER(publisher->remote_mux_id));
+			janus_mutex_unlock(&videoroom->remote_mux_mutex);
+			janus_mutex_unlock(&videoroom->mutex);
+			janus_videoroom_remote_publisher_leave(publisher);
+			janus_refcount_decrease(&publisher->ref);
+		} else {
+			/* Mark the remote publisher as leaving, the thread will do the cleanup */
+			g_atomic_int_set(&publisher->remote_leaving, 1);
+			/* Notify the thread that it's time to go */
+			if(publisher->pipefd[1] > 0) {
+				int code = 1;
+				ssize_t res = 0;
+				do {
+					res = write(publisher->pipefd[1], &code, sizeof(int));
+				} while(res == -1 && errno == EINTR);
+			}
+			janus_mutex_unlock(&videoroom->mutex);
 		}
-		janus_mutex_unlock(&videoroom->mutex);
 		janus_refcount_decrease(&videoroom->ref);
 		/* Done */
 		response = json_object();
@@ -8649,6 +9308,8 @@ void janus_videoroom_setup_media(janus_plugin_session *handle) {
 			janus_mutex_lock(&participant->streams_mutex);
 			if(room) {
 				janus_videoroom_notify_about_publisher(participant, FALSE);
+				/* This participant is a publisher now, so the roster is stale */
+				g_atomic_int_set(&room->roster_dirty, 1);
 			}
 			/* Check if we need to start recording */
 			if((participant->room && participant->room->record) || participant->recording_active) {
@@ -8676,6 +9337,9 @@ void janus_videoroom_setup_media(janus_plugin_session *handle) {
 					janus_videoroom_subscriber_stream *ss = (janus_videoroom_subscriber_stream *)temp->data;
 					janus_videoroom_publisher_stream *ps = ss->publisher_streams ? ss->publisher_streams->data : NULL;
 					if(ps && ps->type == JANUS_VIDEOROOM_MEDIA_VIDEO && ps->publisher && ps->publisher->session) {
+						/* If the publisher is simulcasting and we have a cached keyframe
+						 * for the target substream, replay it so rendering starts right away */
+						janus_videoroom_keyframe_cache_replay(ss, ps, ss->sim_context.substream_target);
 						janus_videoroom_reqpli(ps, "New subscriber available");
 					}
 					temp = temp->next;
@@ -8714,22 +9378,29 @@ static void janus_videoroom_incoming_rtp_internal(janus_videoroom_session *sessi
 		janus_videoroom_publisher_dereference_nodebug(participant);
 		return;
 	}
-	janus_mutex_lock(&participant->mutex);
-	janus_videoroom *videoroom = participant->room;
-	if(videoroom == NULL) {
-		janus_mutex_unlock(&participant->mutex);
+	/* Grab the current snapshot of the publisher state: we flag the one we're
+	 * using so that the control plane defers freeing it (RCU-style), and we
+	 * only keep it flagged for as long as it takes to get our own references
+	 * to the room and to the stream this packet belongs to */
+	janus_videoroom_publisher_snapshot *snapshot = NULL;
+	do {
+		snapshot = g_atomic_pointer_get(&participant->snapshot);
+		g_atomic_pointer_set(&participant->snapshot_inuse, snapshot);
+	} while(snapshot != g_atomic_pointer_get(&participant->snapshot));
+	if(snapshot == NULL) {
+		/* Not in a room (anymore?) */
 		janus_videoroom_publisher_dereference_nodebug(participant);
 		return;
 	}
+	janus_videoroom *videoroom = snapshot->room;
 	janus_refcount_increase_nodebug(&videoroom->ref);
-	janus_mutex_unlock(&participant->mutex);
-
 	/* Find the stream this packet belongs to */
-	janus_mutex_lock(&participant->streams_mutex);
-	janus_videoroom_publisher_stream *ps = g_hash_table_lookup(participant->streams_byid, GINT_TO_POINTER(pkt->mindex));
+	janus_videoroom_publisher_stream *ps = (pkt->mindex >= 0 && pkt->mindex < (int)snapshot->streams->len) ?
+		g_ptr_array_index(snapshot->streams, pkt->mindex) : NULL;
 	if(ps != NULL)
 		janus_refcount_increase_nodebug(&ps->ref);
-	janus_mutex_unlock(&participant->streams_mutex);
+	/* We have our own references now, so we can release the snapshot */
+	g_atomic_pointer_set(&participant->snapshot_inuse, NULL);
 	if(ps == NULL || ps->disabled || g_atomic_int_get(&ps->destroyed)) {
 		/* No stream..? */
 		if(ps != NULL)
@@ -8746,52 +9417,39 @@ static void janus_videoroom_incoming_rtp_internal(janus_videoroom_session *sessi
 	if(!video && videoroom->audiolevel_event && ps->active && !ps->muted && ps->audio_level_extmap_id > 0) {
 		int level = pkt->extensions.audio_level;
 		if(level != -1) {
-			ps->audio_dBov_sum += level;
-			ps->audio_active_packets++;
 			ps->audio_dBov_level = level;
 			int audio_active_packets = participant->user_audio_active_packets ? participant->user_audio_active_packets : videoroom->audio_active_packets;
 			int audio_level_average = participant->user_audio_level_average ? participant->user_audio_level_average : videoroom->audio_level_average;
-			if(ps->audio_active_packets > 0 && ps->audio_active_packets == audio_active_packets) {
-				gboolean notify_talk_event = FALSE;
-				float audio_dBov_avg = (float)ps->audio_dBov_sum/(float)ps->audio_active_packets;
-				if(audio_dBov_avg < audio_level_average) {
-					/* Participant talking, should we notify all participants? */
-					if(!ps->talking)
-						notify_talk_event = TRUE;
-					ps->talking = TRUE;
-				} else {
-					/* Participant not talking anymore, should we notify all participants? */
-					if(ps->talking)
-						notify_talk_event = TRUE;
-					ps->talking = FALSE;
-				}
-				ps->audio_active_packets = 0;
-				ps->audio_dBov_sum = 0;
-				/* Only notify in case of state changes */
-				if(notify_talk_event) {
-					janus_mutex_lock(&videoroom->mutex);
-					json_t *event = json_object();
-					json_object_set_new(event, "videoroom", json_string(ps->talking ? "talking" : "stopped-talking"));
-					json_object_set_new(event, "room", string_ids ? json_string(videoroom->room_id_str) : json_integer(videoroom->room_id));
-					json_object_set_new(event, "id", string_ids ? json_string(participant->user_id_str) : json_integer(participant->user_id));
-					json_object_set_new(event, "mindex", json_integer(ps->mindex));
-					json_object_set_new(event, "mid", json_string(ps->mid));
-					json_object_set_new(event, "audio-level-dBov-avg", json_real(audio_dBov_avg));
-					/* Notify the speaker this event is related to as well */
-					janus_videoroom_notify_participants(participant, event, TRUE);
-					json_decref(event);
-					janus_mutex_unlock(&videoroom->mutex);
-					/* Also notify event handlers */
-					if(notify_events && gateway->events_is_enabled()) {
-						json_t *info = json_object();
-						json_object_set_new(info, "videoroom", json_string(ps->talking ? "talking" : "stopped-talking"));
-						json_object_set_new(info, "room", string_ids ? json_string(videoroom->room_id_str) : json_integer(videoroom->room_id));
-						json_object_set_new(info, "id", string_ids ? json_string(participant->user_id_str) : json_integer(participant->user_id));
-						json_object_set_new(info, "mindex", json_integer(ps->mindex));
-						json_object_set_new(info, "mid", json_string(ps->mid));
-						json_object_set_new(info, "audio-level-dBov-avg", json_real(audio_dBov_avg));
-						gateway->notify_event(&janus_videoroom_plugin, session->handle, info);
-					}
+			/* Feed the level to the talk detection context, and only notify in case of state changes */
+			if(janus_audiolevel_context_process(&ps->audiolevel_ctx, level, audio_active_packets, audio_level_average)) {
+				ps->talking = ps->audiolevel_ctx.talking;
+				janus_mutex_lock(&videoroom->mutex);
+				json_t *event = json_object();
+				json_object_set_new(event, "videoroom", json_string(ps->talking ? "talking" : "stopped-talking"));
+				json_object_set_new(event, "room", string_ids ? json_string(videoroom->room_id_str) : json_integer(videoroom->room_id));
+				json_object_set_new(event, "id", string_ids ? json_string(participant->user_id_str) : json_integer(participant->user_id));
+				json_object_set_new(event, "mindex", json_integer(ps->mindex));
+				json_object_set_new(event, "mid", json_string(ps->mid));
+				json_object_set_new(event, "audio-level-dBov-avg", json_real(ps->audiolevel_ctx.level_avg));
+				/* Notify the speaker this event is related to as well */
+				janus_videoroom_notify_participants(participant, event, TRUE);
+				json_decref(event);
+				janus_mutex_unlock(&videoroom->mutex);
+				/* The talking state is part of the cached roster, invalidate it */
+				janus_mutex_lock(&participant->streams_mutex);
+				janus_videoroom_publisher_roster_invalidate(participant);
+				janus_mutex_unlock(&participant->streams_mutex);
+				g_atomic_int_set(&videoroom->roster_dirty, 1);
+				/* Also notify event handlers */
+				if(notify_events && gateway->events_is_enabled()) {
+					json_t *info = json_object();
+					json_object_set_new(info, "videoroom", json_string(ps->talking ? "talking" : "stopped-talking"));
+					json_object_set_new(info, "room", string_ids ? json_string(videoroom->room_id_str) : json_integer(videoroom->room_id));
+					json_object_set_new(info, "id", string_ids ? json_string(participant->user_id_str) : json_integer(participant->user_id));
+					json_object_set_new(info, "mindex", json_integer(ps->mindex));
+					json_object_set_new(info, "mid", json_string(ps->mid));
+					json_object_set_new(info, "audio-level-dBov-avg", json_real(ps->audiolevel_ctx.level_avg));
+					gateway->notify_event(&janus_videoroom_plugin, session->handle, info);
 				}
 			}
 		}
@@ -8828,8 +9486,12 @@ static void janus_videoroom_incoming_rtp_internal(janus_videoroom_session *sessi
 				janus_mutex_unlock(&ps->rid_mutex);
 			}
 		}
-		/* Forward RTP to the appropriate port for the rtp_forwarders associated with this publisher, if there are any */
+		/* Forward RTP to the appropriate port for the rtp_forwarders associated with this publisher, if there are any:
+		 * the forwarders all share the publisher socket, so we queue the packets on a batch and flush it once
+		 * at the end of the fan-out, which results in a single sendmmsg() rather than one sendto() each */
 		janus_mutex_lock(&ps->rtp_forwarders_mutex);
+		if(ps->rtp_forwarders_batch == NULL && g_hash_table_size(ps->rtp_forwarders) > 0)
+			ps->rtp_forwarders_batch = g_malloc0(sizeof(janus_rtp_forwarder_batch));
 		GHashTableIter iter;
 		gpointer value;
 		g_hash_table_iter_init(&iter, ps->rtp_forwarders);
@@ -8837,20 +9499,28 @@ static void janus_videoroom_incoming_rtp_internal(janus_videoroom_session *sessi
 			janus_rtp_forwarder *rtp_forward = (janus_rtp_forwarder *)value;
 			if(rtp_forward->is_data || (video && !rtp_forward->is_video) || (!video && rtp_forward->is_video))
 				continue;
-			janus_rtp_forwarder_send_rtp_full(rtp_forward, buf, len, sc,
-				ps->vssrc, ps->rid, ps->vcodec, &ps->rid_mutex);
+			janus_rtp_forwarder_send_rtp_full_batched(rtp_forward, buf, len, sc,
+				ps->vssrc, ps->rid, ps->vcodec, &ps->rid_mutex, ps->rtp_forwarders_batch);
 		}
+		janus_rtp_forwarder_batch_flush(ps->rtp_forwarders_batch);
 		janus_mutex_unlock(&ps->rtp_forwarders_mutex);
 		/* Set the payload type of the publisher */
 		rtp->type = ps->pt;
+		/* Locate the payload once, and for video check once whether this is a
+		 * keyframe: subscribers will consume the cached flag, rather than all
+		 * parse the same payload descriptor again in the simulcast logic */
+		int plen = 0;
+		char *payload = janus_rtp_payload(buf, len, &plen);
+		int keyframe = (video && payload != NULL) ?
+			(janus_rtp_is_keyframe(ps->vcodec, payload, plen) ? 1 : 0) : -1;
 		/* Save the frame if we're recording */
 		if(!video || !ps->simulcast) {
 			janus_recorder_save_frame(ps->rc, buf, len);
 		} else {
 			/* We're simulcasting, save the best video quality */
-			gboolean save = janus_rtp_simulcasting_context_process_rtp(&ps->rec_simctx,
+			gboolean save = janus_rtp_simulcasting_context_process_rtp_full(&ps->rec_simctx,
 				buf, len, pkt->extensions.dd_content, pkt->extensions.dd_len,
-				ps->vssrc, ps->rid, ps->vcodec, &ps->rec_ctx, &ps->rid_mutex);
+				ps->vssrc, ps->rid, ps->vcodec, &ps->rec_ctx, &ps->rid_mutex, keyframe);
 			if(save) {
 				uint32_t seq_number = ntohs(rtp->seq_number);
 				uint32_t timestamp = ntohl(rtp->timestamp);
@@ -8874,10 +9544,11 @@ static void janus_videoroom_incoming_rtp_internal(janus_videoroom_session *sessi
 		packet.is_rtp = TRUE;
 		packet.is_video = video;
 		packet.svc = FALSE;
+		packet.poffset = payload ? (int)(payload - buf) : 0;
+		packet.plen = plen;
+		packet.keyframe = keyframe;
 		if(video && ps->svc) {
 			/* We're doing SVC: let's parse this packet to see which layers are there */
-			int plen = 0;
-			char *payload = janus_rtp_payload(buf, len, &plen);
 			if(payload == NULL) {
 				janus_videoroom_publisher_dereference_nodebug(participant);
 				janus_refcount_decrease_nodebug(&videoroom->ref);
@@ -8905,12 +9576,19 @@ static void janus_videoroom_incoming_rtp_internal(janus_videoroom_session *sessi
 			packet.extensions.min_delay = ps->min_delay;
 			packet.extensions.max_delay = ps->max_delay;
 		}
+		/* If this is simulcast video, update the keyframe cache of this substream */
+		if(video && ps->simulcast && sc >= 0 && sc <= 2)
+			janus_videoroom_keyframe_cache_update(ps, sc, &packet);
 		/* Go: some viewers may decide to drop the packet, but that's up to them */
 		janus_mutex_lock_nodebug(&ps->subscribers_mutex);
 		if(videoroom->helper_threads > 0) {
-			g_list_foreach(videoroom->threads, janus_videoroom_helper_rtpdata_packet, &packet);
+			janus_videoroom_helper_rtpdata_packet(videoroom, &packet);
 		} else {
-			g_slist_foreach(ps->subscribers, janus_videoroom_relay_rtp_packet, &packet);
+			/* Iterate on the flat fanout index, refreshing it if needed */
+			janus_videoroom_publisher_stream_index_update(ps);
+			guint i = 0;
+			for(i=0; i<ps->subscribers_index->len; i++)
+				janus_videoroom_relay_rtp_packet(g_ptr_array_index(ps->subscribers_index, i), &packet);
 		}
 		janus_mutex_unlock_nodebug(&ps->subscribers_mutex);
 
@@ -8947,29 +9625,8 @@ static void janus_videoroom_incoming_rtp_internal(janus_videoroom_session *sessi
 				/* We generate RTCP every tot seconds/frames */
 				gint64 now = janus_get_monotonic_time();
 				/* First check if this is a keyframe, though: if so, we reset the timer */
-				int plen = 0;
-				char *payload = janus_rtp_payload(buf, len, &plen);
-				if(payload == NULL) {
-					janus_videoroom_publisher_dereference_nodebug(participant);
-					janus_refcount_decrease_nodebug(&videoroom->ref);
-					return;
-				}
-				if(ps->vcodec == JANUS_VIDEOCODEC_VP8) {
-					if(janus_vp8_is_keyframe(payload, plen))
-						ps->fir_latest = now;
-				} else if(ps->vcodec == JANUS_VIDEOCODEC_VP9) {
-					if(janus_vp9_is_keyframe(payload, plen))
-						ps->fir_latest = now;
-				} else if(ps->vcodec == JANUS_VIDEOCODEC_H264) {
-					if(janus_h264_is_keyframe(payload, plen))
-						ps->fir_latest = now;
-				} else if(ps->vcodec == JANUS_VIDEOCODEC_AV1) {
-					if(janus_av1_is_keyframe(payload, plen))
-						ps->fir_latest = now;
-				} else if(ps->vcodec == JANUS_VIDEOCODEC_H265) {
-					if(janus_h265_is_keyframe(payload, plen))
-						ps->fir_latest = now;
-				}
+				if(packet.keyframe == 1)
+					ps->fir_latest = now;
 				if((now-ps->fir_latest) >= ((gint64)videoroom->fir_freq*G_USEC_PER_SEC)) {
 					/* FIXME We send a FIR every tot seconds */
 					janus_videoroom_reqpli(ps, "Regular keyframe request");
@@ -9020,7 +9677,8 @@ void janus_videoroom_incoming_rtcp(janus_plugin_session *handle, janus_plugin_rt
 		}
 		janus_refcount_increase_nodebug(&ps->ref);
 		janus_mutex_unlock(&s->streams_mutex);
-		if(janus_rtcp_has_fir(buf, len) || janus_rtcp_has_pli(buf, len)) {
+		janus_rtcp_summary summary;
+		if(janus_rtcp_inspect(buf, len, &summary, NULL) == 0 && (summary.has_fir || summary.has_pli)) {
 			/* We got a FIR or PLI, forward a PLI to the publisher */
 			janus_videoroom_publisher *p = ps->publisher;
 			if(p && p->session)
@@ -9140,9 +9798,13 @@ static void janus_videoroom_incoming_data_internal(janus_videoroom_session *sess
 	pkt.textdata = !packet->binary;
 	janus_mutex_lock_nodebug(&ps->subscribers_mutex);
 	if(videoroom->helper_threads > 0) {
-		g_list_foreach(videoroom->threads, janus_videoroom_helper_rtpdata_packet, &pkt);
+		janus_videoroom_helper_rtpdata_packet(videoroom, &pkt);
 	} else {
-		g_slist_foreach(ps->subscribers, janus_videoroom_relay_data_packet, &pkt);
+		/* Iterate on the flat fanout index, refreshing it if needed */
+		janus_videoroom_publisher_stream_index_update(ps);
+		guint i = 0;
+		for(i=0; i<ps->subscribers_index->len; i++)
+			janus_videoroom_relay_data_packet(g_ptr_array_index(ps->subscribers_index, i), &pkt);
 	}
 	janus_mutex_unlock_nodebug(&ps->subscribers_mutex);
 	janus_refcount_decrease_nodebug(&ps->ref);
@@ -9376,8 +10038,8 @@ static void janus_videoroom_hangup_media_internal(gpointer session_data) {
 					mappings = g_list_append(mappings, m);
 				}
 			}
-			g_slist_free(ps->subscribers);
-			ps->subscribers = NULL;
+			janus_videoroom_publisher_stream_clear_subscribers(ps);
+			janus_videoroom_keyframe_cache_clear(ps);
 			janus_rtp_simulcasting_cleanup(&ps->rid_extmap_id, ps->vssrc, ps->rid, &ps->rid_mutex);
 			g_free(ps->fmtp);
 			ps->fmtp = NULL;
@@ -9472,6 +10134,8 @@ static void janus_videoroom_hangup_media_internal(gpointer session_data) {
 		participant->streams = NULL;
 		g_hash_table_remove_all(participant->streams_byid);
 		g_hash_table_remove_all(participant->streams_bymid);
+		janus_videoroom_publisher_roster_invalidate(participant);
+		janus_videoroom_publisher_snapshot_update(participant);
 		janus_mutex_unlock(&participant->streams_mutex);
 		janus_videoroom_leave_or_unpublish(participant, FALSE, FALSE);
 		janus_refcount_decrease(&participant->ref);
@@ -9715,9 +10379,10 @@ static void *janus_videoroom_handler(void *data) {
 						user_id_str = user_id_num;
 					} else {
 						user_id_str = (char *)json_string_value(id);
+						user_id = janus_string_id_find(user_id_str);
 					}
 					if(g_hash_table_lookup(videoroom->participants,
-							string_ids ? (gpointer)user_id_str : (gpointer)&user_id) != NULL) {
+							(gpointer)&user_id) != NULL) {
 						/* User ID already taken */
 						janus_mutex_unlock(&videoroom->mutex);
 						janus_mutex_unlock(&sessions_mutex);
@@ -9747,7 +10412,7 @@ static void *janus_videoroom_handler(void *data) {
 						/* Generate a random ID */
 						while(user_id_str == NULL) {
 							user_id_str = janus_random_uuid();
-							if(g_hash_table_lookup(videoroom->participants, user_id_str) != NULL) {
+							if(janus_string_id_find(user_id_str) != 0) {
 								/* User ID already taken, try another one */
 								g_clear_pointer(&user_id_str, g_free);
 							}
@@ -9779,6 +10444,8 @@ static void *janus_videoroom_handler(void *data) {
 				videoroom = NULL;
 				publisher->user_id = user_id;
 				publisher->user_id_str = user_id_str ? g_strdup(user_id_str) : NULL;
+				if(string_ids)
+					publisher->user_id = janus_string_id_intern(publisher->user_id_str);
 				publisher->display = display_text ? g_strdup(display_text) : NULL;
 				publisher->metadata = NULL;
 				publisher->recording_active = FALSE;
@@ -9814,6 +10481,7 @@ static void *janus_videoroom_handler(void *data) {
 				}
 				g_atomic_int_set(&publisher->destroyed, 0);
 				janus_mutex_init(&publisher->mutex);
+				janus_mutex_init(&publisher->snapshot_mutex);
 				janus_refcount_init(&publisher->ref, janus_videoroom_publisher_free);
 				/* In case we also wanted to configure */
 				if(audiocodec && json_string_value(json_object_get(msg->jsep, "sdp")) != NULL) {
@@ -9916,9 +10584,10 @@ static void *janus_videoroom_handler(void *data) {
 				janus_refcount_increase(&publisher->ref);
 				janus_refcount_increase(&publisher->session->ref);
 				g_hash_table_insert(publisher->room->participants,
-					string_ids ? (gpointer)g_strdup(publisher->user_id_str) : (gpointer)janus_uint64_dup(publisher->user_id),
+					(gpointer)janus_uint64_dup(publisher->user_id),
 					publisher);
 				g_hash_table_insert(publisher->room->private_ids, GUINT_TO_POINTER(publisher->pvt_id), publisher);
+				g_atomic_int_set(&publisher->room->roster_dirty, 1);
 				janus_mutex_unlock(&session->mutex);
 				g_hash_table_iter_init(&iter, publisher->room->participants);
 				while (!g_atomic_int_get(&publisher->room->destroyed) && g_hash_table_iter_next(&iter, NULL, &value)) {
@@ -9934,78 +10603,10 @@ static void *janus_videoroom_handler(void *data) {
 						}
 						continue;
 					}
-					json_t *pl = json_object();
-					json_object_set_new(pl, "id", string_ids ? json_string(p->user_id_str) : json_integer(p->user_id));
-					if(p->display)
-						json_object_set_new(pl, "display", json_string(p->display));
-					if(p->metadata)
-						json_object_set_new(pl, "metadata", json_deep_copy(p->metadata));
-					if(p->dummy)
-						json_object_set_new(pl, "dummy", json_true());
-					/* Add proper info on all the streams */
-					gboolean audio_added = FALSE, video_added = FALSE, talking_found = FALSE, talking = FALSE;
-					json_t *media = json_array();
+					/* Add the cached roster entry of this publisher to the list */
 					janus_mutex_lock(&p->streams_mutex);
-					GList *temp = p->streams;
-					while(temp) {
-						janus_videoroom_publisher_stream *ps = (janus_videoroom_publisher_stream *)temp->data;
-						json_t *info = json_object();
-						json_object_set_new(info, "type", json_string(janus_videoroom_media_str(ps->type)));
-						json_object_set_new(info, "mindex", json_integer(ps->mindex));
-						json_object_set_new(info, "mid", json_string(ps->mid));
-
-						if(ps->disabled) {
-							json_object_set_new(info, "disabled", json_true());
-						} else {
-							if(ps->description)
-								json_object_set_new(info, "description", json_string(ps->description));
-							if(ps->type == JANUS_VIDEOROOM_MEDIA_AUDIO) {
-								json_object_set_new(info, "codec", json_string(janus_audiocodec_name(ps->acodec)));
-								/* FIXME For backwards compatibility, we need audio_codec in the global info */
-								if(!audio_added) {
-									audio_added = TRUE;
-									json_object_set_new(pl, "audio_codec", json_string(janus_audiocodec_name(ps->acodec)));
-								}
-								if(ps->acodec == JANUS_AUDIOCODEC_OPUS) {
-									if(ps->opusstereo)
-										json_object_set_new(info, "stereo", json_true());
-									if(ps->opusfec)
-										json_object_set_new(info, "fec", json_true());
-									if(ps->opusdtx)
-										json_object_set_new(info, "dtx", json_true());
-								}
-								if(ps->audio_level_extmap_id > 0) {
-									json_object_set_new(info, "talking", talking ? json_true() : json_false());
-									/* FIXME For backwards compatibility, we also need talking in the global info */
-									talking_found = TRUE;
-									talking |= ps->talking;
-								}
-							} else if(ps->type == JANUS_VIDEOROOM_MEDIA_VIDEO) {
-								/* FIXME For backwards compatibility, we need video_codec in the global info */
-								json_object_set_new(info, "codec", json_string(janus_videocodec_name(ps->vcodec)));
-								if(!video_added) {
-									video_added = TRUE;
-									json_object_set_new(pl, "video_codec", json_string(janus_videocodec_name(ps->vcodec)));
-								}
-								if(ps->vcodec == JANUS_VIDEOCODEC_H264 && ps->h264_profile != NULL)
-									json_object_set_new(info, "h264_profile", json_string(ps->h264_profile));
-								else if(ps->vcodec == JANUS_VIDEOCODEC_VP9 && ps->vp9_profile != NULL)
-									json_object_set_new(info, "vp9_profile", json_string(ps->vp9_profile));
-								if(ps->simulcast)
-									json_object_set_new(info, "simulcast", json_true());
-								if(ps->svc)
-									json_object_set_new(info, "svc", json_true());
-							}
-							if(ps->muted)
-								json_object_set_new(info, "moderated", json_true());
-						}
-						json_array_append_new(media, info);
-						temp = temp->next;
-					}
+					json_t *pl = janus_videoroom_publisher_roster_info(p);
 					janus_mutex_unlock(&p->streams_mutex);
-					json_object_set_new(pl, "streams", media);
-					if(talking_found)
-						json_object_set_new(pl, "talking", talking ? json_true() : json_false());
 					json_array_append_new(list, pl);
 				}
 				event = json_object();
@@ -10129,6 +10730,7 @@ static void *janus_videoroom_handler(void *data) {
 						feed_id_str = feed_id_num;
 					} else {
 						feed_id_str = (char *)json_string_value(feed);
+						feed_id = janus_string_id_find(feed_id_str);
 					}
 					/* Create a fake "streams" array and put the only feed there */
 					json_t *m = json_array();
@@ -10195,9 +10797,10 @@ static void *janus_videoroom_handler(void *data) {
 						feed_id_str = feed_id_num;
 					} else {
 						feed_id_str = (char *)json_string_value(feed);
+						feed_id = janus_string_id_find(feed_id_str);
 					}
 					janus_videoroom_publisher *publisher = g_hash_table_lookup(videoroom->participants,
-						string_ids ? (gpointer)feed_id_str : (gpointer)&feed_id);
+						(gpointer)&feed_id);
 					if(publisher == NULL || g_atomic_int_get(&publisher->destroyed) ||
 							!g_atomic_int_get(&publisher->session->started)) {
 						JANUS_LOG(LOG_ERR, "No such feed (%s)\n", feed_id_str);
@@ -10391,9 +10994,10 @@ static void *janus_videoroom_handler(void *data) {
 						feed_id_str = feed_id_num;
 					} else {
 						feed_id_str = (char *)json_string_value(feed);
+						feed_id = janus_string_id_find(feed_id_str);
 					}
 					janus_videoroom_publisher *publisher = g_hash_table_lookup(subscriber->room->participants,
-						string_ids ? (gpointer)feed_id_str : (gpointer)&feed_id);
+						(gpointer)&feed_id);
 					if(publisher == NULL) {
 						/* TODO We shouldn't let this happen... */
 						JANUS_LOG(LOG_WARN, "Skipping feed %s...\n", feed_id_str);
@@ -10422,7 +11026,7 @@ static void *janus_videoroom_handler(void *data) {
 							/* We already have a datachannel m-line, no need for others: just update the subscribers list */
 							janus_mutex_lock(&ps->subscribers_mutex);
 							if(g_slist_find(ps->subscribers, data_stream) == NULL && g_slist_find(data_stream->publisher_streams, ps) == NULL) {
-								ps->subscribers = g_slist_append(ps->subscribers, data_stream);
+								janus_videoroom_publisher_stream_add_subscriber(ps, data_stream);
 								data_stream->publisher_streams = g_slist_append(data_stream->publisher_streams, ps);
 								/* If we're using helper threads, add the subscriber to one of those */
 								if(subscriber->room && subscriber->room->helper_threads > 0) {
@@ -10509,7 +11113,7 @@ static void *janus_videoroom_handler(void *data) {
 								/* We already have a datachannel m-line, no need for others: just update the subscribers list */
 								janus_mutex_lock(&ps->subscribers_mutex);
 								if(g_slist_find(ps->subscribers, data_stream) == NULL && g_slist_find(data_stream->publisher_streams, ps) == NULL) {
-									ps->subscribers = g_slist_append(ps->subscribers, data_stream);
+									janus_videoroom_publisher_stream_add_subscriber(ps, data_stream);
 									data_stream->publisher_streams = g_slist_append(data_stream->publisher_streams, ps);
 									/* If we're using helper threads, add the subscriber to one of those */
 									if(subscriber->room && subscriber->room->helper_threads > 0) {
@@ -11085,6 +11689,11 @@ static void *janus_videoroom_handler(void *data) {
 						json_decref(display_event);
 					}
 					g_free(old_display);
+					/* The cached roster entry includes the display name, invalidate it */
+					janus_mutex_lock(&participant->streams_mutex);
+					janus_videoroom_publisher_roster_invalidate(participant);
+					janus_mutex_unlock(&participant->streams_mutex);
+					g_atomic_int_set(&participant->room->roster_dirty, 1);
 					janus_mutex_unlock(&participant->room->mutex);
 				}
 				if(metadata) {
@@ -11105,6 +11714,11 @@ static void *janus_videoroom_handler(void *data) {
 						json_decref(metadata_event);
 						json_decref(old_metadata);
 					}
+					/* The cached roster entry includes the metadata, invalidate it */
+					janus_mutex_lock(&participant->streams_mutex);
+					janus_videoroom_publisher_roster_invalidate(participant);
+					janus_mutex_unlock(&participant->streams_mutex);
+					g_atomic_int_set(&participant->room->roster_dirty, 1);
 					janus_mutex_unlock(&participant->room->mutex);
 				}
 				/* Are we updating the description? */
@@ -11129,8 +11743,10 @@ static void *janus_videoroom_handler(void *data) {
 						}
 					}
 					/* If at least a description changed, notify everyone else about the publisher details */
-					if(desc_updated)
+					if(desc_updated) {
+						janus_videoroom_publisher_roster_invalidate(participant);
 						janus_videoroom_notify_about_publisher(participant, TRUE);
+					}
 					janus_mutex_unlock(&participant->streams_mutex);
 					janus_mutex_unlock(&participant->room->mutex);
 				}
@@ -11340,10 +11956,11 @@ static void *janus_videoroom_handler(void *data) {
 							feed_id_str = feed_id_num;
 						} else {
 							feed_id_str = (char *)json_string_value(feed);
+							feed_id = janus_string_id_find(feed_id_str);
 						}
 						janus_mutex_lock(&subscriber->room->mutex);
 						janus_videoroom_publisher *publisher = g_hash_table_lookup(subscriber->room->participants,
-							string_ids ? (gpointer)feed_id_str : (gpointer)&feed_id);
+							(gpointer)&feed_id);
 						janus_mutex_unlock(&subscriber->room->mutex);
 						if(publisher == NULL || g_atomic_int_get(&publisher->destroyed) ||
 								!g_atomic_int_get(&publisher->session->started)) {
@@ -11457,6 +12074,7 @@ static void *janus_videoroom_handler(void *data) {
 							feed_id_str = feed_id_num;
 						} else {
 							feed_id_str = (char *)json_string_value(feed);
+							feed_id = janus_string_id_find(feed_id_str);
 						}
 						const char *sub_mid = json_string_value(json_object_get(s, "sub_mid"));
 						janus_videoroom_subscriber_stream *stream = NULL;
@@ -11471,7 +12089,7 @@ static void *janus_videoroom_handler(void *data) {
 							changes++;
 						} else if(feed_id_str != NULL) {
 							janus_videoroom_publisher *publisher = g_hash_table_lookup(subscriber->room->participants,
-								string_ids ? (gpointer)feed_id_str : (gpointer)&feed_id);
+								(gpointer)&feed_id);
 							if(publisher == NULL || g_atomic_int_get(&publisher->destroyed) ||
 									!g_atomic_int_get(&publisher->session->started)) {
 								JANUS_LOG(LOG_WARN, "Publisher '%s' not found, not unsubscribing...\n", feed_id_str);
@@ -11521,9 +12139,10 @@ static void *janus_videoroom_handler(void *data) {
 							feed_id_str = feed_id_num;
 						} else {
 							feed_id_str = (char *)json_string_value(feed);
+							feed_id = janus_string_id_find(feed_id_str);
 						}
 						janus_videoroom_publisher *publisher = g_hash_table_lookup(subscriber->room->participants,
-							string_ids ? (gpointer)feed_id_str : (gpointer)&feed_id);
+							(gpointer)&feed_id);
 						if(publisher == NULL || g_atomic_int_get(&publisher->destroyed) ||
 								!g_atomic_int_get(&publisher->session->started)) {
 							JANUS_LOG(LOG_WARN, "Publisher '%s' not found, not subscribing...\n", feed_id_str);
@@ -11970,6 +12589,9 @@ static void *janus_videoroom_handler(void *data) {
 									gateway->push_event(msg->handle, &janus_videoroom_plugin, NULL, event, NULL);
 									json_decref(event);
 								} else {
+									/* Replay the cached keyframe of the target substream, if we have
+									 * one, so the switch doesn't have to wait for a fresh keyframe */
+									janus_videoroom_keyframe_cache_replay(stream, ps, substream_target);
 									/* Send a PLI */
 									janus_videoroom_reqpli(ps, "Simulcasting substream change");
 								}
@@ -12148,6 +12770,7 @@ static void *janus_videoroom_handler(void *data) {
 						feed_id_str = feed_id_num;
 					} else {
 						feed_id_str = (char *)json_string_value(feed);
+						feed_id = janus_string_id_find(feed_id_str);
 					}
 					if(feed_id_str == NULL) {
 						JANUS_LOG(LOG_ERR, "At least one between 'streams' and 'feed' must be specified\n");
@@ -12158,7 +12781,7 @@ static void *janus_videoroom_handler(void *data) {
 					}
 					janus_mutex_lock(&subscriber->room->mutex);
 					janus_videoroom_publisher *publisher = g_hash_table_lookup(subscriber->room->participants,
-						string_ids ? (gpointer)feed_id_str : (gpointer)&feed_id);
+						(gpointer)&feed_id);
 					janus_mutex_unlock(&subscriber->room->mutex);
 					if(publisher == NULL || g_atomic_int_get(&publisher->destroyed) ||
 							!g_atomic_int_get(&publisher->session->started)) {
@@ -12262,10 +12885,11 @@ static void *janus_videoroom_handler(void *data) {
 						feed_id_str = feed_id_num;
 					} else {
 						feed_id_str = (char *)json_string_value(feed);
+						feed_id = janus_string_id_find(feed_id_str);
 					}
 					janus_mutex_lock(&subscriber->room->mutex);
 					janus_videoroom_publisher *publisher = g_hash_table_lookup(subscriber->room->participants,
-						string_ids ? (gpointer)feed_id_str : (gpointer)&feed_id);
+						(gpointer)&feed_id);
 					janus_mutex_unlock(&subscriber->room->mutex);
 					if(publisher == NULL || g_atomic_int_get(&publisher->destroyed) ||
 							!g_atomic_int_get(&publisher->session->started)) {
@@ -12348,10 +12972,11 @@ static void *janus_videoroom_handler(void *data) {
 						feed_id_str = feed_id_num;
 					} else {
 						feed_id_str = (char *)json_string_value(feed);
+						feed_id = janus_string_id_find(feed_id_str);
 					}
 					const char *mid = json_string_value(json_object_get(s, "mid"));
 					janus_videoroom_publisher *publisher = g_hash_table_lookup(subscriber->room->participants,
-						string_ids ? (gpointer)feed_id_str : (gpointer)&feed_id);
+						(gpointer)&feed_id);
 					if(publisher == NULL || g_atomic_int_get(&publisher->destroyed) ||
 							!g_atomic_int_get(&publisher->session->started)) {
 						JANUS_LOG(LOG_WARN, "Publisher '%s' not found, not switching...\n", feed_id_str);
@@ -12396,7 +13021,7 @@ static void *janus_videoroom_handler(void *data) {
 						unref = TRUE;
 						janus_videoroom_publisher_stream *stream_ps = stream->publisher_streams->data;
 						janus_mutex_lock(&stream_ps->subscribers_mutex);
-						stream_ps->subscribers = g_slist_remove(stream_ps->subscribers, stream);
+						janus_videoroom_publisher_stream_remove_subscriber(stream_ps, stream);
 						stream->publisher_streams = g_slist_remove(stream->publisher_streams, stream_ps);
 						/* Remove the subscriber from the helper threads too, if any */
 						if(subscriber->room && subscriber->room->helper_threads > 0) {
@@ -12425,7 +13050,7 @@ static void *janus_videoroom_handler(void *data) {
 					/* Subscribe to the new one */
 					janus_mutex_lock(&ps->subscribers_mutex);
 					stream->publisher_streams = g_slist_append(stream->publisher_streams, ps);
-					ps->subscribers = g_slist_append(ps->subscribers, stream);
+					janus_videoroom_publisher_stream_add_subscriber(ps, stream);
 					/* If we're using helper threads, add the subscriber to one of those */
 					if(subscriber->room && subscriber->room->helper_threads > 0) {
 						int subscribers = -1;
@@ -12465,6 +13090,9 @@ static void *janus_videoroom_handler(void *data) {
 						/* Reset sustream_target to 2 */
 						stream->sim_context.substream_target = 2;
 					}
+					/* If we have a cached keyframe for the target substream, replay
+					 * it right away, so the switch doesn't freeze the video */
+					janus_videoroom_keyframe_cache_replay(stream, ps, stream->sim_context.substream_target);
 					json_t *temporal = json_object_get(s, "temporal");
 					int templayer_target = temporal ? json_integer_value(temporal) : 2;
 					if(templayer_target >= 0 && templayer_target <= 2) {
@@ -12802,6 +13430,7 @@ static void *janus_videoroom_handler(void *data) {
 						/* Initialize a new publisher stream */
 						new_ps = TRUE;
 						ps = g_malloc0(sizeof(janus_videoroom_publisher_stream));
+						ps->pli_window.min_interval = ((gint64)videoroom->pli_window)*1000;
 						ps->type = JANUS_VIDEOROOM_MEDIA_NONE;
 						if(m->type == JANUS_SDP_AUDIO)
 							ps->type = JANUS_VIDEOROOM_MEDIA_AUDIO;
@@ -12823,6 +13452,7 @@ static void *janus_videoroom_handler(void *data) {
 						janus_refcount_init(&ps->ref, janus_videoroom_publisher_stream_free);
 						janus_refcount_increase(&ps->ref);	/* This is for the mid-indexed hashtable */
 						janus_mutex_init(&ps->subscribers_mutex);
+						janus_mutex_init(&ps->keyframe_mutex);
 						janus_mutex_init(&ps->rtp_forwarders_mutex);
 						janus_mutex_init(&ps->rid_mutex);
 						ps->rtp_forwarders = g_hash_table_new_full(NULL, NULL, NULL, (GDestroyNotify)janus_rtp_forwarder_destroy);
@@ -13210,7 +13840,10 @@ static void *janus_videoroom_handler(void *data) {
 					}
 					json_array_append_new(media, info);
 				}
+				janus_videoroom_publisher_roster_invalidate(participant);
+				janus_videoroom_publisher_snapshot_update(participant);
 				janus_mutex_unlock(&participant->streams_mutex);
+				g_atomic_int_set(&videoroom->roster_dirty, 1);
 				janus_mutex_unlock(&participant->rtp_forwarders_mutex);
 				janus_sdp_destroy(offer);
 				/* Replace the session name */
@@ -13330,8 +13963,8 @@ static void janus_videoroom_relay_rtp_packet(gpointer data, gpointer user_data)
 		/* Check if there's any SVC info to take into account */
 		if(packet->svc) {
 			/* Handle SVC: make sure we have a payload to work with */
-			int plen = 0;
-			char *payload = janus_rtp_payload((char *)packet->data, packet->length, &plen);
+			int plen = packet->plen;
+			char *payload = packet->poffset > 0 ? (char *)packet->data + packet->poffset : NULL;
 			if(payload == NULL)
 				return;
 			/* Process this packet: don't relay if it's not the layer we wanted to handle */
@@ -13385,14 +14018,14 @@ static void janus_videoroom_relay_rtp_packet(gpointer data, gpointer user_data)
 			memcpy(packet->data, &rtph, sizeof(rtph));
 		} else if(packet->simulcast) {
 			/* Handle simulcast: make sure we have a payload to work with */
-			int plen = 0;
-			char *payload = janus_rtp_payload((char *)packet->data, packet->length, &plen);
+			int plen = packet->plen;
+			char *payload = packet->poffset > 0 ? (char *)packet->data + packet->poffset : NULL;
 			if(payload == NULL)
 				return;
 			/* Process this packet: don't relay if it's not the SSRC/layer we wanted to handle */
-			gboolean relay = janus_rtp_simulcasting_context_process_rtp(&stream->sim_context,
+			gboolean relay = janus_rtp_simulcasting_context_process_rtp_full(&stream->sim_context,
 				(char *)packet->data, packet->length, packet->extensions.dd_content, packet->extensions.dd_len,
-				packet->ssrc, NULL, ps->vcodec, &stream->context, &ps->rid_mutex);
+				packet->ssrc, NULL, ps->vcodec, &stream->context, &ps->rid_mutex, packet->keyframe);
 			if(!relay) {
 				/* Did a lot of time pass before we could relay a packet? */
 				gint64 now = janus_get_monotonic_time();
@@ -13529,7 +14162,8 @@ static void janus_videoroom_rtp_forwarder_rtcp_receive(janus_rtp_forwarder *rf,
 	if(len > 0 && janus_is_rtcp(buffer, len)) {
 		JANUS_LOG(LOG_HUGE, "Got %s RTCP packet: %d bytes\n", rf->is_video ? "video" : "audio", len);
 		/* We only handle incoming video PLIs or FIR at the moment */
-		if(!janus_rtcp_has_fir(buffer, len) && !janus_rtcp_has_pli(buffer, len))
+		janus_rtcp_summary summary;
+		if(janus_rtcp_inspect(buffer, len, &summary, NULL) < 0 || (!summary.has_fir && !summary.has_pli))
 			return;
 		/* Check if this is a regular RTP forwarder, or a publisher remotization */
 		if(rf->metadata == NULL) {
@@ -13786,6 +14420,123 @@ static int janus_videoroom_get_fd_port(int fd) {
 	}
 	return ntohs(server.sin6_port);
 }
+/* Helper to handle a packet coming from a remote publisher, no matter if
+ * it was received on a dedicated socket or demultiplexed from the shared
+ * ingest socket of the room */
+static void janus_videoroom_remote_publisher_process(janus_videoroom_publisher *publisher, char *buffer, int bytes) {
+	janus_videoroom *videoroom = publisher->room;
+	/* Check SSRC and do relay_rtp accordingly */
+	if(!janus_is_rtp(buffer, bytes)) {
+		/* Not RTP, drop the packet */
+		return;
+	}
+	janus_rtp_header *rtp = (janus_rtp_header *)buffer;
+	uint32_t ssrc = ntohl(rtp->ssrc);
+	if(ssrc < REMOTE_PUBLISHER_BASE_SSRC) {
+		/* Can't be one of the SSRCs we're waiting for, innore */
+		JANUS_LOG(LOG_WARN, "[%s/%s] Invalid SSRC (%"SCNu32")\n",
+			videoroom->room_id_str, publisher->user_id_str, ssrc);
+		return;
+	}
+	uint32_t diff = ssrc - REMOTE_PUBLISHER_BASE_SSRC;
+	int mindex = diff/REMOTE_PUBLISHER_SSRC_STEP;
+	int vindex = diff - (mindex*REMOTE_PUBLISHER_SSRC_STEP);
+	janus_mutex_lock(&publisher->streams_mutex);
+	janus_videoroom_publisher_stream *ps = g_hash_table_lookup(publisher->streams_byid, GINT_TO_POINTER(mindex));
+	if(ps == NULL) {
+		janus_mutex_unlock(&publisher->streams_mutex);
+		JANUS_LOG(LOG_WARN, "[%s/%s] Invalid mindex %d\n",
+			videoroom->room_id_str, publisher->user_id_str, mindex);
+		return;
+	}
+	if((!ps->simulcast && vindex > 0) || vindex > 2) {
+		janus_mutex_unlock(&publisher->streams_mutex);
+		JANUS_LOG(LOG_WARN, "[%s/%s] Invalid substream %d\n",
+			videoroom->room_id_str, publisher->user_id_str, vindex);
+		return;
+	}
+	/* Check if this is an actual RTP packet, or an
+	 * envelope created to relay data channels */
+	if(ps->type == JANUS_VIDEOROOM_MEDIA_DATA) {
+		/* Handle as data channel, stripping the RTP header */
+		janus_refcount_increase_nodebug(&publisher->ref);
+		janus_mutex_unlock(&publisher->streams_mutex);
+		janus_plugin_data data = { 0 };
+		data.label = NULL;
+		data.protocol = NULL;
+		data.binary = rtp->type ? TRUE : FALSE;
+		data.buffer = buffer + 12;
+		data.length = bytes - 12;
+		/* Now handle the packet as if coming from a regular publisher */
+		janus_videoroom_incoming_data_internal(publisher->session, publisher, &data);
+		return;
+	}
+	/* Is this SRTP? */
+	if(ps->is_srtp) {
+		int buflen = bytes;
+		srtp_err_status_t res = srtp_unprotect(ps->srtp_ctx, buffer, &buflen);
+		if(res != srtp_err_status_ok) {
+			janus_mutex_unlock(&publisher->streams_mutex);
+			guint32 timestamp = ntohl(rtp->timestamp);
+			guint16 seq = ntohs(rtp->seq_number);
+			JANUS_LOG(LOG_ERR, "[%s] Publisher stream (#%d) SRTP unprotect error: %s (len=%d-->%d, ts=%"SCNu32", seq=%"SCNu16")\n",
+				publisher->user_id_str, ps->mindex, janus_srtp_error_str(res), bytes, buflen, timestamp, seq);
+			return;
+		}
+		bytes = buflen;
+	}
+	/* Prepare the RTP packet */
+	janus_plugin_rtp pkt = { 0 };
+	pkt.mindex = mindex;
+	pkt.video = (ps->type == JANUS_VIDEOROOM_MEDIA_VIDEO);
+	pkt.buffer = buffer;
+	pkt.length = bytes;
+	janus_plugin_rtp_extensions_reset(&pkt.extensions);
+	janus_refcount_increase_nodebug(&publisher->ref);
+	janus_mutex_unlock(&publisher->streams_mutex);
+	/* Parse RTP extensions before relaying the packet: we index
+	 * them all with a single scan of the extension block */
+	janus_rtp_header_extension_index extensions;
+	janus_rtp_header_extension_parse_all(buffer, bytes, &extensions);
+	if(!pkt.video && ps->audio_level_extmap_id > 0) {
+		gboolean vad = FALSE;
+		int level = -1;
+		if(janus_rtp_header_extension_read_audio_level(&extensions,
+				ps->audio_level_extmap_id, &vad, &level) == 0) {
+			pkt.extensions.audio_level = level;
+			pkt.extensions.audio_level_vad = vad;
+		}
+	}
+	if(pkt.video && ps->video_orient_extmap_id > 0) {
+		gboolean c = FALSE, f = FALSE, r1 = FALSE, r0 = FALSE;
+		if(janus_rtp_header_extension_read_video_orientation(&extensions,
+				ps->video_orient_extmap_id, &c, &f, &r1, &r0) == 0) {
+			pkt.extensions.video_rotation = 0;
+			if(r1 && r0)
+				pkt.extensions.video_rotation = 270;
+			else if(r1)
+				pkt.extensions.video_rotation = 180;
+			else if(r0)
+				pkt.extensions.video_rotation = 90;
+			pkt.extensions.video_back_camera = c;
+			pkt.extensions.video_flipped = f;
+		}
+	}
+	if(pkt.video && ps->playout_delay_extmap_id > 0) {
+		uint16_t min = 0, max = 0;
+		if(janus_rtp_header_extension_read_playout_delay(&extensions,
+				ps->playout_delay_extmap_id, &min, &max) == 0) {
+			pkt.extensions.min_delay = min;
+			pkt.extensions.max_delay = max;
+		}
+	}
+	/* Apply an SSRC offset to avoid issues when switching,
+	 * see https://github.com/meetecho/janus-gateway/issues/3444 */
+	rtp->ssrc = htonl(ntohl(rtp->ssrc) + publisher->remote_ssrc_offset);
+	/* Now handle the packet as if coming from a regular publisher */
+	janus_videoroom_incoming_rtp_internal(publisher->session, publisher, &pkt);
+}
+
 /* Thread responsible for a specific remote publisher */
 static void *janus_videoroom_remote_publisher_thread(void *user_data) {
 	janus_videoroom_publisher *publisher = (janus_videoroom_publisher *)user_data;
@@ -13820,19 +14571,15 @@ static void *janus_videoroom_remote_publisher_thread(void *user_data) {
 	}
 
 	/* RTP stuff */
-	janus_rtp_header *rtp = NULL;
-	uint32_t ssrc = 0, diff = 0;
-	int mindex = 0, vindex = 0;
 	janus_videoroom_publisher_stream *ps = NULL;
-	janus_plugin_rtp pkt = { 0 };
-	janus_plugin_data data = { 0 };
 	GList *temp = NULL;
 
 	/* As the first thing, we add the remote publisher to the list */
 	janus_mutex_lock(&videoroom->mutex);
 	g_hash_table_insert(videoroom->participants,
-		string_ids ? (gpointer)g_strdup(publisher->user_id_str) : (gpointer)janus_uint64_dup(publisher->user_id),
+		(gpointer)janus_uint64_dup(publisher->user_id),
 		publisher);
+	g_atomic_int_set(&videoroom->roster_dirty, 1);
 	/* Let's also notify all other participants that the publisher is here */
 	janus_mutex_lock(&publisher->streams_mutex);
 	janus_videoroom_notify_about_publisher(publisher, FALSE);
@@ -13926,116 +14673,27 @@ static void *janus_videoroom_remote_publisher_thread(void *user_data) {
 					continue;
 				}
 				/* Handle packet: check SSRC and do relay_rtp accordingly */
-				if(!janus_is_rtp(buffer, bytes)) {
-					/* Not RTP, drop the packet */
-					continue;
-				}
-				rtp = (janus_rtp_header *)buffer;
-				ssrc = ntohl(rtp->ssrc);
-				if(ssrc < REMOTE_PUBLISHER_BASE_SSRC) {
-					/* Can't be one of the SSRCs we're waiting for, innore */
-					JANUS_LOG(LOG_WARN, "[%s/%s] Invalid SSRC (%"SCNu32")\n",
-						videoroom->room_id_str, publisher->user_id_str, ssrc);
-					continue;
-				}
-				diff = ssrc - REMOTE_PUBLISHER_BASE_SSRC;
-				mindex = diff/REMOTE_PUBLISHER_SSRC_STEP;
-				vindex = diff - (mindex*REMOTE_PUBLISHER_SSRC_STEP);
-				janus_mutex_lock(&publisher->streams_mutex);
-				ps = g_hash_table_lookup(publisher->streams_byid, GINT_TO_POINTER(mindex));
-				if(ps == NULL) {
-					janus_mutex_unlock(&publisher->streams_mutex);
-					JANUS_LOG(LOG_WARN, "[%s/%s] Invalid mindex %d\n",
-						videoroom->room_id_str, publisher->user_id_str, mindex);
-					continue;
-				}
-				if((!ps->simulcast && vindex > 0) || vindex > 2) {
-					janus_mutex_unlock(&publisher->streams_mutex);
-					JANUS_LOG(LOG_WARN, "[%s/%s] Invalid substream %d\n",
-						videoroom->room_id_str, publisher->user_id_str, vindex);
-					continue;
-				}
-				/* Check if this is an actual RTP packet, or an
-				 * envelope created to relay data channels */
-				if(ps->type == JANUS_VIDEOROOM_MEDIA_DATA) {
-					/* Handle as data channel, stripping the RTP header */
-					janus_refcount_increase_nodebug(&publisher->ref);
-					janus_mutex_unlock(&publisher->streams_mutex);
-					data.label = NULL;
-					data.protocol = NULL;
-					data.binary = rtp->type ? TRUE : FALSE;
-					data.buffer = buffer + 12;
-					data.length = bytes - 12;
-					/* Now handle the packet as if coming from a regular publisher */
-					janus_videoroom_incoming_data_internal(publisher->session, publisher, &data);
-					continue;
-				}
-				/* Is this SRTP? */
-				if(ps->is_srtp) {
-					int buflen = bytes;
-					srtp_err_status_t res = srtp_unprotect(ps->srtp_ctx, buffer, &buflen);
-					if(res != srtp_err_status_ok) {
-						janus_mutex_unlock(&publisher->streams_mutex);
-						guint32 timestamp = ntohl(rtp->timestamp);
-						guint16 seq = ntohs(rtp->seq_number);
-						JANUS_LOG(LOG_ERR, "[%s] Publisher stream (#%d) SRTP unprotect error: %s (len=%d-->%d, ts=%"SCNu32", seq=%"SCNu16")\n",
-							publisher->user_id_str, ps->mindex, janus_srtp_error_str(res), bytes, buflen, timestamp, seq);
-						continue;
-					}
-					bytes = buflen;
-				}
-				/* Prepare the RTP packet */
-				pkt.mindex = mindex;
-				pkt.video = (ps->type == JANUS_VIDEOROOM_MEDIA_VIDEO);
-				pkt.buffer = buffer;
-				pkt.length = bytes;
-				janus_plugin_rtp_extensions_reset(&pkt.extensions);
-				janus_refcount_increase_nodebug(&publisher->ref);
-				janus_mutex_unlock(&publisher->streams_mutex);
-				/* Parse RTP extensions before relaying the packet */
-				if(!pkt.video && ps->audio_level_extmap_id > 0) {
-					gboolean vad = FALSE;
-					int level = -1;
-					if(janus_rtp_header_extension_parse_audio_level(buffer, bytes,
-							ps->audio_level_extmap_id, &vad, &level) == 0) {
-						pkt.extensions.audio_level = level;
-						pkt.extensions.audio_level_vad = vad;
-					}
-				}
-				if(pkt.video && ps->video_orient_extmap_id > 0) {
-					gboolean c = FALSE, f = FALSE, r1 = FALSE, r0 = FALSE;
-					if(janus_rtp_header_extension_parse_video_orientation(buffer, bytes,
-							ps->video_orient_extmap_id, &c, &f, &r1, &r0) == 0) {
-						pkt.extensions.video_rotation = 0;
-						if(r1 && r0)
-							pkt.extensions.video_rotation = 270;
-						else if(r1)
-							pkt.extensions.video_rotation = 180;
-						else if(r0)
-							pkt.extensions.video_rotation = 90;
-						pkt.extensions.video_back_camera = c;
-						pkt.extensions.video_flipped = f;
-					}
-				}
-				if(pkt.video && ps->playout_delay_extmap_id > 0) {
-					uint16_t min = 0, max = 0;
-					if(janus_rtp_header_extension_parse_playout_delay(buffer, bytes,
-							ps->playout_delay_extmap_id, &min, &max) == 0) {
-						pkt.extensions.min_delay = min;
-						pkt.extensions.max_delay = max;
-					}
-				}
-				/* Apply an SSRC offset to avoid issues when switching,
-				 * see https://github.com/meetecho/janus-gateway/issues/3444 */
-				rtp->ssrc = htonl(ntohl(rtp->ssrc) + publisher->remote_ssrc_offset);
-				/* Now handle the packet as if coming from a regular publisher */
-				janus_videoroom_incoming_rtp_internal(publisher->session, publisher, &pkt);
+				janus_videoroom_remote_publisher_process(publisher, buffer, bytes);
 			}
 		}
 	}
 cleanup:
-	/* If we got here, the remote publisher has been removed from the
-	 * room: let's notify all other publishers in the room */
+	janus_videoroom_remote_publisher_leave(publisher);
+	/* Done */
+	janus_refcount_decrease(&videoroom->ref);
+	g_thread_unref(g_thread_self());
+	return NULL;
+}
+
+/* Helper to remove a remote publisher from the room (closing all the
+ * subscriptions to its streams) and tear it down: for remote publishers
+ * with a dedicated thread this is the tail of the thread itself, while
+ * for multiplexed publishers it's invoked by whoever removes them */
+static void janus_videoroom_remote_publisher_leave(janus_videoroom_publisher *publisher) {
+	janus_videoroom *videoroom = publisher->room;
+	GList *temp = NULL;
+	/* The remote publisher has been removed from the room:
+	 * let's notify all other publishers in the room */
 	janus_mutex_lock(&publisher->rec_mutex);
 	g_free(publisher->recording_base);
 	publisher->recording_base = NULL;
@@ -14078,8 +14736,8 @@ cleanup:
 				mappings = g_list_append(mappings, m);
 			}
 		}
-		g_slist_free(ps->subscribers);
-		ps->subscribers = NULL;
+		janus_videoroom_publisher_stream_clear_subscribers(ps);
+		janus_videoroom_keyframe_cache_clear(ps);
 		int i=0;
 		for(i=0; i<3; i++) {
 			ps->vssrc[i] = 0;
@@ -14160,7 +14818,7 @@ cleanup:
 			temp = temp->next;
 		}
 	}
-	JANUS_LOG(LOG_VERB, "[%s/%s] Leaving remote publisher thread...\n",
+	JANUS_LOG(LOG_VERB, "[%s/%s] Remote publisher left...\n",
 		videoroom->room_id_str, publisher->user_id_str);
 	g_list_free(subscribers);
 	/* Free streams */
@@ -14168,45 +14826,212 @@ cleanup:
 	publisher->streams = NULL;
 	g_hash_table_remove_all(publisher->streams_byid);
 	g_hash_table_remove_all(publisher->streams_bymid);
+	janus_videoroom_publisher_roster_invalidate(publisher);
+	janus_videoroom_publisher_snapshot_update(publisher);
 	janus_mutex_unlock(&publisher->streams_mutex);
 	janus_videoroom_leave_or_unpublish(publisher, TRUE, FALSE);
 	janus_refcount_decrease(&publisher->session->ref);
 	janus_videoroom_publisher_destroy(publisher);
+}
+
+/* Helper to demultiplex one datagram received on the shared ingest socket
+ * of a room, and hand the payload to the right remote publisher */
+static void janus_videoroom_remote_publisher_mux_packet(janus_videoroom *videoroom,
+		char *buffer, int bytes, struct sockaddr_storage *addr, socklen_t addrlen) {
+	/* Find the publisher this frame belongs to via the multiplexing header */
+	uint16_t stream_id = 0;
+	int hdr = janus_rtp_forwarder_bus_demux(buffer, bytes, &stream_id);
+	if(hdr < 0) {
+		/* Not a valid frame for the shared socket, drop it */
+		JANUS_LOG(LOG_HUGE, "[%s] Dropping unexpected packet on the shared remote publishers socket (%d bytes)\n",
+			videoroom->room_id_str, bytes);
+		return;
+	}
+	if(stream_id == 0) {
+		/* Just a keepalive from a remote instance, nothing to relay */
+		return;
+	}
+	janus_mutex_lock(&videoroom->remote_mux_mutex);
+	janus_videoroom_publisher *publisher = g_hash_table_lookup(videoroom->remote_mux_publishers, GUINT_TO_POINTER(stream_id));
+	if(publisher == NULL || g_atomic_int_get(&publisher->remote_leaving) || g_atomic_int_get(&publisher->destroyed)) {
+		janus_mutex_unlock(&videoroom->remote_mux_mutex);
+		JANUS_LOG(LOG_HUGE, "[%s] No remote publisher with stream ID %"SCNu16", dropping packet\n",
+			videoroom->room_id_str, stream_id);
+		return;
+	}
+	janus_refcount_increase(&publisher->ref);
+	janus_mutex_unlock(&videoroom->remote_mux_mutex);
+	if(publisher->rtcp_addr.ss_family == 0) {
+		/* Latch to the source address, so that we can send RTCP
+		 * feedback (e.g., PLIs) back on the multiplexed flow */
+		memcpy(&publisher->rtcp_addr, addr, addrlen);
+	}
+	/* Handle the payload as if received on a dedicated socket */
+	janus_videoroom_remote_publisher_process(publisher, buffer + hdr, bytes - hdr);
+	janus_refcount_decrease(&publisher->ref);
+}
+
+/* Thread draining the shared ingest socket all the multiplexed remote
+ * publishers of a room are received on: a single loop serves them all,
+ * reading datagrams in batches and demultiplexing them by stream ID */
+static void *janus_videoroom_remote_publisher_mux_thread(void *user_data) {
+	janus_videoroom *videoroom = (janus_videoroom *)user_data;
+	if(videoroom == NULL) {
+		JANUS_LOG(LOG_ERR, "Invalid room instance\n");
+		g_thread_unref(g_thread_self());
+		return NULL;
+	}
+	JANUS_LOG(LOG_VERB, "[%s] Joining multiplexed remote publishers thread...\n", videoroom->room_id_str);
+
+	int resfd = 0, fd = videoroom->remote_mux_fd;
+	struct pollfd fds[1];
+	janus_videoroom_publisher *publisher = NULL;
+	janus_videoroom_publisher_stream *ps = NULL;
+	GHashTableIter iter;
+	gpointer value;
+#ifdef __linux__
+	/* State for the recvmmsg() batches (the buffers are too
+	 * large for the stack, so we keep them on the heap instead) */
+	char *rbufs = g_malloc(REMOTE_PUBLISHER_BATCH * 1500);
+	struct mmsghdr rmsgs[REMOTE_PUBLISHER_BATCH];
+	struct iovec riovs[REMOTE_PUBLISHER_BATCH];
+	struct sockaddr_storage raddrs[REMOTE_PUBLISHER_BATCH];
+	memset(rmsgs, 0, sizeof(rmsgs));
+	int m = 0, msgcount = 0;
+#else
+	int bytes = 0;
+	char buffer[1500];
+	struct sockaddr_storage remote = { 0 };
+	socklen_t addrlen;
+#endif
+
+	/* Loop */
+	while(!g_atomic_int_get(&videoroom->destroyed)) {
+		fds[0].fd = fd;
+		fds[0].events = POLLIN;
+		fds[0].revents = 0;
+		/* Check if any of the multiplexed publishers needs a PLI */
+		janus_mutex_lock(&videoroom->remote_mux_mutex);
+		g_hash_table_iter_init(&iter, videoroom->remote_mux_publishers);
+		while(g_hash_table_iter_next(&iter, NULL, &value)) {
+			publisher = (janus_videoroom_publisher *)value;
+			janus_mutex_lock(&publisher->streams_mutex);
+			GList *temp = publisher->streams;
+			while(temp) {
+				ps = (janus_videoroom_publisher_stream *)temp->data;
+				if(ps->type == JANUS_VIDEOROOM_MEDIA_VIDEO && g_atomic_int_get(&ps->need_pli))
+					janus_videoroom_reqpli(ps, "Delayed PLI request");
+				temp = temp->next;
+			}
+			janus_mutex_unlock(&publisher->streams_mutex);
+		}
+		janus_mutex_unlock(&videoroom->remote_mux_mutex);
+		/* Wait for some data */
+		resfd = poll(fds, 1, 1000);
+		if(resfd < 0) {
+			if(errno == EINTR) {
+				JANUS_LOG(LOG_HUGE, "[%s] Got an EINTR (%s), ignoring...\n",
+					videoroom->room_id_str, g_strerror(errno));
+				continue;
+			}
+			JANUS_LOG(LOG_ERR, "[%s] Error polling shared remote publishers socket... %d (%s)\n",
+				videoroom->room_id_str, errno, g_strerror(errno));
+			break;
+		} else if(resfd == 0) {
+			/* No data, keep going */
+			continue;
+		}
+		if(fds[0].revents & (POLLERR | POLLHUP)) {
+			/* Socket error? */
+			JANUS_LOG(LOG_ERR, "[%s] Error polling shared remote publishers socket: %s... %d (%s)\n",
+				videoroom->room_id_str, fds[0].revents & POLLERR ? "POLLERR" : "POLLHUP",
+				errno, g_strerror(errno));
+			break;
+		}
+		if(!(fds[0].revents & POLLIN))
+			continue;
+#ifdef __linux__
+		/* Read as many datagrams as are queued with a single recvmmsg() */
+		for(m=0; m<REMOTE_PUBLISHER_BATCH; m++) {
+			riovs[m].iov_base = rbufs + m*1500;
+			riovs[m].iov_len = 1500;
+			rmsgs[m].msg_hdr.msg_iov = &riovs[m];
+			rmsgs[m].msg_hdr.msg_iovlen = 1;
+			rmsgs[m].msg_hdr.msg_name = &raddrs[m];
+			rmsgs[m].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+		}
+		msgcount = recvmmsg(fd, rmsgs, REMOTE_PUBLISHER_BATCH, 0, NULL);
+		if(msgcount < 0)
+			continue;
+		for(m=0; m<msgcount; m++) {
+			janus_videoroom_remote_publisher_mux_packet(videoroom, rbufs + m*1500,
+				(int)rmsgs[m].msg_len, &raddrs[m], rmsgs[m].msg_hdr.msg_namelen);
+		}
+#else
+		addrlen = sizeof(remote);
+		bytes = recvfrom(fd, buffer, sizeof(buffer), 0, (struct sockaddr *)&remote, &addrlen);
+		if(bytes < 0)
+			continue;
+		janus_videoroom_remote_publisher_mux_packet(videoroom, buffer, bytes, &remote, addrlen);
+#endif
+	}
+
+	/* If we got here the room is going away: tear down any multiplexed
+	 * publisher that's still there, as no dedicated thread will */
+	janus_mutex_lock(&videoroom->remote_mux_mutex);
+	GList *leaving = NULL;
+	g_hash_table_iter_init(&iter, videoroom->remote_mux_publishers);
+	while(g_hash_table_iter_next(&iter, NULL, &value)) {
+		publisher = (janus_videoroom_publisher *)value;
+		if(g_atomic_int_compare_and_exchange(&publisher->remote_leaving, 0, 1)) {
+			janus_refcount_increase(&publisher->ref);
+			leaving = g_list_prepend(leaving, publisher);
+		}
+	}
+	g_hash_table_remove_all(videoroom->remote_mux_publishers);
+	videoroom->remote_mux_fd = -1;
+	janus_mutex_unlock(&videoroom->remote_mux_mutex);
+	close(fd);
+	GList *temp = leaving;
+	while(temp) {
+		publisher = (janus_videoroom_publisher *)temp->data;
+		janus_videoroom_remote_publisher_leave(publisher);
+		janus_refcount_decrease(&publisher->ref);
+		temp = temp->next;
+	}
+	g_list_free(leaving);
+#ifdef __linux__
+	g_free(rbufs);
+#endif
+
 	/* Done */
+	JANUS_LOG(LOG_VERB, "[%s] Leaving multiplexed remote publishers thread...\n", videoroom->room_id_str);
 	janus_refcount_decrease(&videoroom->ref);
 	g_thread_unref(g_thread_self());
 	return NULL;
 }
 
-static void janus_videoroom_helper_rtpdata_packet(gpointer data, gpointer user_data) {
-	janus_videoroom_rtp_relay_packet *packet = (janus_videoroom_rtp_relay_packet *)user_data;
+static void janus_videoroom_helper_rtpdata_packet(janus_videoroom *room, janus_videoroom_rtp_relay_packet *packet) {
 	if(!packet || !packet->data || packet->length < 1) {
 		JANUS_LOG(LOG_ERR, "Invalid packet...\n");
 		return;
 	}
-	janus_videoroom_helper *helper = (janus_videoroom_helper *)data;
-	if(!helper) {
-		//~ JANUS_LOG(LOG_ERR, "Invalid session...\n");
+	if(room == NULL || room->threads == NULL)
 		return;
+	/* Clone the packet once: all the helper partitions share the same
+	 * immutable copy, and only patch headers in their own scratch buffer */
+	janus_videoroom_rtp_relay_packet *copy = janus_videoroom_rtp_relay_packet_clone(packet);
+	g_atomic_int_set(&copy->refcount, g_list_length(room->threads));
+	/* Queue the shared copy on every partition, and flag the ones that
+	 * aren't on the ready-queue already so an idle thread picks them up */
+	GList *l = room->threads;
+	while(l) {
+		janus_videoroom_helper *helper = (janus_videoroom_helper *)l->data;
+		g_async_queue_push(helper->queued_packets, copy);
+		if(g_atomic_int_compare_and_exchange(&helper->scheduled, 0, 1))
+			g_async_queue_push(helper->work, helper);
+		l = l->next;
 	}
-	/* Clone the packet and queue it for delivery on the helper thread */
-	janus_videoroom_rtp_relay_packet *copy = g_malloc0(sizeof(janus_videoroom_rtp_relay_packet));
-	copy->source = packet->source;
-	copy->data = g_malloc(packet->length);
-	memcpy(copy->data, packet->data, packet->length);
-	copy->length = packet->length;
-	copy->is_rtp = packet->is_rtp;
-	copy->textdata = packet->textdata;
-	copy->is_video = packet->is_video;
-	copy->simulcast = packet->simulcast;
-	copy->ssrc[0] = packet->ssrc[0];
-	copy->ssrc[1] = packet->ssrc[1];
-	copy->ssrc[2] = packet->ssrc[2];
-	copy->svc = packet->svc;
-	copy->svc_info = packet->svc_info;
-	copy->timestamp = packet->timestamp;
-	copy->seq_number = packet->seq_number;
-	g_async_queue_push(helper->queued_packets, copy);
 }
 
 static void *janus_videoroom_helper_thread(void *data) {
@@ -14216,21 +15041,51 @@ static void *janus_videoroom_helper_thread(void *data) {
 	GList *subscribers = NULL;
 	JANUS_LOG(LOG_VERB, "[%s/#%d] Joining VideoRoom helper thread\n", room->room_id_str, helper->id);
 	janus_videoroom_rtp_relay_packet *pkt = NULL;
+	janus_videoroom_helper *partition = NULL;
 	while(!g_atomic_int_get(&stopping) && !g_atomic_int_get(&room->destroyed) && !g_atomic_int_get(&helper->destroyed)) {
-		pkt = g_async_queue_pop(helper->queued_packets);
-		if(pkt == &exit_packet)
+		/* Threads are not tied to their own subscribers: any thread in the
+		 * pool serves whichever partition has packets pending (work stealing) */
+		partition = g_async_queue_pop(helper->work);
+		if(partition == &exit_helper)
 			break;
-		janus_mutex_lock(&helper->mutex);
-		/* FIXME */
-		ps = pkt->source;
-		subscribers = g_hash_table_lookup(helper->subscribers, ps);
-		if(subscribers != NULL) {
-			g_list_foreach(subscribers,
-				pkt->is_rtp ? janus_videoroom_relay_rtp_packet : janus_videoroom_relay_data_packet,
-				pkt);
+		g_atomic_int_set(&partition->scheduled, 0);
+		/* Relay a chunk of packets for this partition: popping and relaying
+		 * under the partition mutex serializes it, so per-subscriber ordering
+		 * is preserved even when different threads pick it up over time */
+		janus_mutex_lock_spin(&partition->mutex);
+		int chunk = 0;
+		while(chunk < JANUS_VIDEOROOM_HELPER_CHUNK &&
+				(pkt = g_async_queue_try_pop(partition->queued_packets)) != NULL) {
+			ps = pkt->source;
+			subscribers = g_hash_table_lookup(partition->subscribers, ps);
+			if(subscribers != NULL) {
+				if(pkt->is_rtp) {
+					/* The packet buffer is shared with the other partitions, and
+					 * the relay step patches the RTP header (and, for VP8, the
+					 * payload descriptor) in place: work on a private copy in
+					 * the reusable scratch buffer of this partition */
+					if(partition->scratch_size < pkt->length) {
+						partition->scratch = g_realloc(partition->scratch, pkt->length);
+						partition->scratch_size = pkt->length;
+					}
+					memcpy(partition->scratch, pkt->data, pkt->length);
+					janus_videoroom_rtp_relay_packet patched = *pkt;
+					patched.data = (janus_rtp_header *)partition->scratch;
+					g_list_foreach(subscribers, janus_videoroom_relay_rtp_packet, &patched);
+				} else {
+					/* Data packets are never patched, relay the shared copy as is */
+					g_list_foreach(subscribers, janus_videoroom_relay_data_packet, pkt);
+				}
+			}
+			janus_videoroom_rtp_relay_packet_unref(pkt);
+			chunk++;
 		}
-		janus_mutex_unlock(&helper->mutex);
-		janus_videoroom_rtp_relay_packet_free(pkt);
+		janus_mutex_unlock(&partition->mutex);
+		/* If the partition still has packets queued (or got more while we
+		 * were relaying), put it back up for grabs for the next idle thread */
+		if(g_async_queue_length(partition->queued_packets) > 0 &&
+				g_atomic_int_compare_and_exchange(&partition->scheduled, 0, 1))
+			g_async_queue_push(helper->work, partition);
 	}
 	JANUS_LOG(LOG_VERB, "[%s/#%d] Leaving VideoRoom helper thread\n", room->room_id_str, helper->id);
 	janus_refcount_decrease(&helper->ref);
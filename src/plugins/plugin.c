@@ -73,10 +73,73 @@ janus_plugin_rtp *janus_plugin_rtp_duplicate(janus_plugin_rtp *packet) {
 			memcpy(p->buffer, packet->buffer, packet->length);
 			p->length = packet->length;
 		}
+		/* The duplicated buffer has no tailroom for the SRTP tag */
+		p->transfer_buffer = FALSE;
 		p->extensions = packet->extensions;
 	}
 	return p;
 }
+/* Recyclable packet pools: each slot is prefixed by a small preamble that
+ * remembers the owning pool, so that releasing a packet knows whether it
+ * should be recycled or freed (oversize packets get dedicated allocations) */
+typedef struct janus_plugin_packet_slot {
+	janus_plugin_packet_pool *pool;
+} janus_plugin_packet_slot;
+void janus_plugin_packet_pool_init(janus_plugin_packet_pool *pool,
+		size_t header_size, size_t buffer_size, guint max_slots) {
+	if(pool == NULL)
+		return;
+	/* Round the header up, to keep the payload buffer aligned after it */
+	pool->header_size = (header_size + 7) & ~(size_t)7;
+	pool->buffer_size = buffer_size;
+	pool->max_slots = max_slots;
+	pool->slots = g_async_queue_new_full((GDestroyNotify)g_free);
+}
+gpointer janus_plugin_packet_pool_claim(janus_plugin_packet_pool *pool, size_t length) {
+	if(pool == NULL || pool->slots == NULL)
+		return NULL;
+	janus_plugin_packet_slot *slot = NULL;
+	if(length <= pool->buffer_size) {
+		/* Try to recycle a released slot, and only allocate on a dry pool */
+		slot = g_async_queue_try_pop(pool->slots);
+		if(slot == NULL) {
+			slot = g_malloc(sizeof(janus_plugin_packet_slot) + pool->header_size + pool->buffer_size);
+			slot->pool = pool;
+		}
+	} else {
+		/* Larger than the slots we recycle, give it a dedicated allocation */
+		slot = g_malloc(sizeof(janus_plugin_packet_slot) + pool->header_size + length);
+		slot->pool = NULL;
+	}
+	gpointer packet = (gpointer)(slot + 1);
+	memset(packet, 0, pool->header_size);
+	return packet;
+}
+char *janus_plugin_packet_pool_buffer(janus_plugin_packet_pool *pool, gpointer packet) {
+	if(pool == NULL || packet == NULL)
+		return NULL;
+	return (char *)packet + pool->header_size;
+}
+void janus_plugin_packet_pool_release(gpointer packet) {
+	if(packet == NULL)
+		return;
+	janus_plugin_packet_slot *slot = ((janus_plugin_packet_slot *)packet) - 1;
+	janus_plugin_packet_pool *pool = slot->pool;
+	if(pool == NULL || pool->slots == NULL ||
+			(guint)g_async_queue_length(pool->slots) >= pool->max_slots) {
+		/* Oversize slot, destroyed pool or full pool: just free it */
+		g_free(slot);
+		return;
+	}
+	g_async_queue_push(pool->slots, slot);
+}
+void janus_plugin_packet_pool_destroy(janus_plugin_packet_pool *pool) {
+	if(pool == NULL || pool->slots == NULL)
+		return;
+	g_async_queue_unref(pool->slots);
+	pool->slots = NULL;
+}
+
 void janus_plugin_rtcp_reset(janus_plugin_rtcp *packet) {
 	if(packet) {
 		memset(packet, 0, sizeof(janus_plugin_rtcp));
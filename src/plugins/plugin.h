@@ -171,7 +171,7 @@ janus_plugin *create(void) {
  * Janus instance or it will crash.
  *
  */
-#define JANUS_PLUGIN_API_VERSION	106
+#define JANUS_PLUGIN_API_VERSION	107
 
 /*! \brief Initialization of all plugin properties to NULL
  *
@@ -211,6 +211,8 @@ static janus_plugin janus_echotest_plugin =
 		.hangup_media = NULL,			\
 		.destroy_session = NULL,		\
 		.query_session = NULL, 			\
+		.export_session = NULL,			\
+		.import_session = NULL,			\
 		## __VA_ARGS__ }
 
 
@@ -352,6 +354,25 @@ struct janus_plugin {
 	 * @param[in] handle The plugin/gateway session used for this peer
 	 * @returns A json_t object with the requested info */
 	json_t *(* const query_session)(janus_plugin_session *handle);
+	/*! \brief Method to serialize the plugin-specific state of a session, for migration purposes (optional)
+	 *  \note This was added to allow draining an instance without dropping its
+	 * sessions: the returned object is handed, as is, to \c import_session on
+	 * the instance the session is being moved to, so plugins are free to put
+	 * in there whatever they need to recreate the session elsewhere. Plugins
+	 * that don't implement the method (or return NULL from it) mark their
+	 * sessions as not migratable.
+	 * @param[in] handle The plugin/gateway session used for this peer
+	 * @returns A json_t object with the serialized state, if the session can be migrated, NULL otherwise */
+	json_t *(* const export_session)(janus_plugin_session *handle);
+	/*! \brief Method to restore plugin-specific session state serialized on another instance (optional)
+	 *  \note This is invoked on a freshly created session/handle, right after
+	 * \c create_session : once the state has been restored, it's up to the
+	 * plugin to re-establish media with the peer, typically by sending a new
+	 * offer with an ICE restart as soon as signalling is re-routed here.
+	 * @param[in] handle The plugin/gateway session used for this peer
+	 * @param[in] state The state object coming from \c export_session on the old instance
+	 * @returns 0 in case of success, a negative integer in case of error */
+	int (* const import_session)(janus_plugin_session *handle, json_t *state);
 
 };
 
@@ -439,6 +460,33 @@ struct janus_callbacks {
 	 * @param[in] desc The descriptor to search for
 	 * @returns TRUE if the token is valid, not expired and contains the descriptor, FALSE otherwise */
 	gboolean (* const auth_signature_contains)(janus_plugin *plugin, const char *token, const char *descriptor);
+	/*! \brief Method to get the current send-side bandwidth estimate for a PeerConnection
+	 * \note This is fed by the transport-wide CC feedback the peer sends us, so it's
+	 * only available when the transport-wide CC extension was negotiated: 0 is
+	 * returned when there's no estimate (yet)
+	 * @param[in] handle The plugin/gateway session of the PeerConnection to query
+	 * @returns The estimate in bits per second, or 0 if unavailable */
+	uint32_t (* const get_bandwidth_estimate)(janus_plugin_session *handle);
+
+	/*! \brief Helper to resolve a plugin/gateway session to an opaque relay
+	 * target, that can then be passed to relay_rtp_target() in place of the
+	 * session itself: for plugins that shovel media between two fixed peers
+	 * (e.g., 1:1 calls) this skips the per-packet session validation, which
+	 * can add up at high packet rates. The target keeps a reference to the
+	 * underlying PeerConnection handle, so it remains safe to use after the
+	 * PeerConnection is closed (packets are simply dropped), but it MUST be
+	 * released with drop_relay_target() when no longer needed
+	 * @param[in] handle The plugin/gateway session to resolve
+	 * @returns An opaque relay target, or NULL if the session is invalid */
+	void *(* const get_relay_target)(janus_plugin_session *handle);
+	/*! \brief Callback to relay RTP packets straight to a previously
+	 * resolved relay target (see get_relay_target)
+	 * @param[in] target The opaque relay target to send the packet to
+	 * @param[in] packet The RTP packet and related data */
+	void (* const relay_rtp_target)(void *target, janus_plugin_rtp *packet);
+	/*! \brief Helper to release a relay target obtained via get_relay_target
+	 * @param[in] target The opaque relay target to release */
+	void (* const drop_relay_target)(void *target);
 };
 
 /*! \brief The hook that plugins need to implement to be created from the Janus core */
@@ -607,6 +655,15 @@ struct janus_plugin_rtp {
 	char *buffer;
 	/*! \brief The packet length */
 	uint16_t length;
+	/*! \brief Whether the core can take ownership of the packet buffer when
+	 * relaying it, rather than copying it to a new allocation
+	 * @note Only set this to TRUE if the buffer was allocated with \c g_malloc
+	 * and has at least \c SRTP_MAX_TAG_LEN bytes of tailroom after the payload:
+	 * SRTP protection happens in place in the buffer that is queued for
+	 * delivery, so without that headroom the tag would overflow the allocation.
+	 * When the core takes the buffer, it sets this back to FALSE and NULLs the
+	 * \c buffer pointer, and will free the buffer itself after sending. */
+	gboolean transfer_buffer;
 	/*! \brief RTP extensions */
 	janus_plugin_rtp_extensions extensions;
 };
@@ -624,6 +681,51 @@ void janus_plugin_rtp_reset(janus_plugin_rtp *packet);
 */
 janus_plugin_rtp *janus_plugin_rtp_duplicate(janus_plugin_rtp *packet);
 
+/*! \brief Recyclable packet pool, to cut the per-packet allocations plugins
+ * pay when duplicating media for queueing (e.g., to relay helper threads):
+ * each slot hosts a plugin-defined packet struct followed by an MTU-sized
+ * payload buffer, and released slots are recycled rather than freed, so the
+ * steady state performs no allocations at all. Packets larger than the slot
+ * payload transparently get a dedicated allocation, freed on release. The
+ * pool is thread safe, so packets can be claimed and released from different
+ * threads (which is the whole point when fanning out to helpers) */
+typedef struct janus_plugin_packet_pool {
+	/*! \brief Queue of recycled slots, ready to be claimed again */
+	GAsyncQueue *slots;
+	/*! \brief Size of the packet struct hosted at the head of each slot */
+	size_t header_size;
+	/*! \brief Payload capacity of each slot */
+	size_t buffer_size;
+	/*! \brief Cap on the number of recycled slots we keep around */
+	guint max_slots;
+} janus_plugin_packet_pool;
+/*! \brief Helper method to initialise a packet pool
+ * @param[in] pool Pointer to the janus_plugin_packet_pool to initialise
+ * @param[in] header_size Size of the packet struct each slot should host
+ * @param[in] buffer_size Payload capacity of each slot (typically the MTU)
+ * @param[in] max_slots How many recycled slots to keep around at most */
+void janus_plugin_packet_pool_init(janus_plugin_packet_pool *pool,
+	size_t header_size, size_t buffer_size, guint max_slots);
+/*! \brief Helper method to claim a packet slot from a pool
+ * @param[in] pool Pointer to the janus_plugin_packet_pool to claim from
+ * @param[in] length Size of the payload the packet will carry
+ * @returns A pointer to the zeroed packet struct at the head of the slot;
+ * use janus_plugin_packet_pool_buffer to access the payload buffer */
+gpointer janus_plugin_packet_pool_claim(janus_plugin_packet_pool *pool, size_t length);
+/*! \brief Helper method to access the payload buffer of a claimed slot
+ * @param[in] pool Pointer to the janus_plugin_packet_pool the slot belongs to
+ * @param[in] packet The packet struct returned by janus_plugin_packet_pool_claim
+ * @returns A pointer to the payload buffer that follows the packet struct */
+char *janus_plugin_packet_pool_buffer(janus_plugin_packet_pool *pool, gpointer packet);
+/*! \brief Helper method to release a claimed slot back to its pool
+ * @note Only pass packets that were claimed via janus_plugin_packet_pool_claim
+ * @param[in] packet The packet struct returned by janus_plugin_packet_pool_claim */
+void janus_plugin_packet_pool_release(gpointer packet);
+/*! \brief Helper method to destroy a packet pool and free the recycled slots
+ * @note All claimed packets must have been released already when this is called
+ * @param[in] pool Pointer to the janus_plugin_packet_pool to destroy */
+void janus_plugin_packet_pool_destroy(janus_plugin_packet_pool *pool);
+
 /*! \brief Janus plugin RTCP packet */
 struct janus_plugin_rtcp {
 	/*! \brief Index of the stream (relative to the SDP)
@@ -645,6 +747,16 @@ struct janus_plugin_rtcp {
 */
 void janus_plugin_rtcp_reset(janus_plugin_rtcp *packet);
 
+/*! \brief Partial reliability policies a plugin can request when sending a data message */
+typedef enum janus_plugin_data_pr {
+	/*! \brief Reliable delivery (default) */
+	JANUS_PLUGIN_DATA_PR_NONE = 0,
+	/*! \brief Partially reliable delivery: stop retransmitting after a lifetime, in milliseconds */
+	JANUS_PLUGIN_DATA_PR_TTL = 1,
+	/*! \brief Partially reliable delivery: give up after a number of retransmissions */
+	JANUS_PLUGIN_DATA_PR_RTX = 2
+} janus_plugin_data_pr;
+
 /*! \brief Janus plugin data message
  * @note At the moment, we only support text based datachannels. In the
  * future, once we add support for binary data, this structure may be
@@ -656,6 +768,16 @@ struct janus_plugin_data {
 	char *protocol;
 	/*! \brief Whether the message data is text (default=FALSE) or binary */
 	gboolean binary;
+	/*! \brief Partial reliability policy to send this message with (PR-SCTP):
+	 * the default is JANUS_PLUGIN_DATA_PR_NONE, that is reliable delivery,
+	 * which is what you want for things like chat messages; for lossy
+	 * low-latency payloads (e.g., frequently refreshed telemetry), a TTL or
+	 * RTX policy avoids wasting bandwidth retransmitting stale messages */
+	janus_plugin_data_pr pr_policy;
+	/*! \brief Parameter for the partial reliability policy: the lifetime in
+	 * milliseconds for JANUS_PLUGIN_DATA_PR_TTL, the number of retransmissions
+	 * for JANUS_PLUGIN_DATA_PR_RTX; ignored for JANUS_PLUGIN_DATA_PR_NONE */
+	uint32_t pr_value;
 	/*! \brief The message data */
 	char *buffer;
 	/*! \brief The message length */
@@ -0,0 +1,749 @@
+/*! \file    janus-pp-composite.c
+ * \author   Lorenzo Miniero <lorenzo@meetecho.com>
+ * \copyright GNU General Public License v3
+ * \brief    Helper tool to composite several audio .mjr recordings into one file
+ * \details  Our Janus WebRTC gateway provides a simple helper (janus_recorder)
+ * to allow plugins to record audio, video and text frames sent by users.
+ * Recording a room results in one .mjr file per stream, which then need
+ * to be postprocessed individually and mixed offline. The
+ * \c janus-pp-composite tool takes the audio recordings of a session,
+ * decodes them, aligns them on the wall clock the recorder saved in each
+ * file, mixes them down to a single stereo track, and encodes the result
+ * to Opus in a single standard container, e.g.:
+ *
+\verbatim
+./janus-pp-composite /path/to/room.mka /path/to/user1-audio.mjr /path/to/user2-audio.mjr
+\endverbatim
+ *
+ * The sources are processed in a streaming fashion, one frame at a time,
+ * so memory usage doesn't depend on the size of the recordings. Passing
+ * \c --live makes the tool follow recordings that are still being
+ * written: it tails the growing .mjr files, mixes whatever wall clock
+ * says is due (leaving a short margin for recorder buffering), and
+ * considers a source done when the recorder appends its frame index
+ * footer at close time. This way the composite file is written
+ * incrementally during the call, and is ready moments after it ends.
+ *
+ * Only audio recordings in the newer .mjr format (the one including
+ * packet timestamps) can be composited, since the per-file wall clock
+ * reference is what the alignment is based upon: an attempt to process
+ * older recordings, or video/data ones, will result in an error. Video
+ * compositing (mixing layouts) is deliberately out of scope, as that
+ * would require a full video transcoding pipeline.
+ *
+ * \ingroup postprocessing
+ * \ref postprocessing
+ */
+
+#include <arpa/inet.h>
+#if defined(__MACH__) || defined(__FreeBSD__)
+#include <machine/endian.h>
+#else
+#include <endian.h>
+#endif
+#include <inttypes.h>
+#include <string.h>
+#include <stdlib.h>
+#include <signal.h>
+
+#include <glib.h>
+#include <jansson.h>
+
+#include "../debug.h"
+#include "../utils.h"
+#include "../version.h"
+#include "pp-rtp.h"
+#include "pp-avformat.h"
+
+int janus_log_level = 4;
+gboolean janus_log_timestamps = FALSE;
+gboolean janus_log_colors = TRUE;
+char *janus_log_global_prefix = NULL;
+int lock_debug = 0;
+
+int working = 0;
+
+/* We always mix at 48kHz stereo, which is what Opus expects */
+#define JANUS_PP_COMPOSITE_RATE			48000
+#define JANUS_PP_COMPOSITE_CHANNELS		2
+/* Samples per encoded frame (20ms at 48kHz) */
+#define JANUS_PP_COMPOSITE_SAMPLES		960
+/* Size of the rolling mix window, in samples (2 seconds): this bounds
+ * how much skew between sources we can absorb without dropping audio */
+#define JANUS_PP_COMPOSITE_WINDOW		(JANUS_PP_COMPOSITE_RATE*2)
+/* In live mode, how far behind the wall clock we mix (in samples), to
+ * leave the recorder some slack before we assume a source is silent */
+#define JANUS_PP_COMPOSITE_LIVE_MARGIN	(JANUS_PP_COMPOSITE_RATE/2)
+
+/* Default OpusHead extradata, in case the encoder doesn't provide one */
+static const uint8_t opus_extradata[19] = {
+	'O', 'p', 'u', 's', 'H', 'e', 'a', 'd',
+	1, 2, 0, 0, 128, 187,
+	0, 0, 0, 0, 0,
+};
+
+/* Signal handler */
+static void janus_pp_handle_signal(int signum) {
+	working = 0;
+}
+
+/* Helper struct to track the state of each source recording */
+typedef struct janus_pp_composite_track {
+	char *filename;			/* Path to the source .mjr file */
+	FILE *file;				/* Source file */
+	gboolean parsed_header;	/* Whether we parsed the info header already */
+	gboolean has_timestamps;	/* Whether the recording includes packet timestamps */
+	gboolean finished;		/* Whether we're done reading this recording */
+	char codec[10];			/* Audio codec in the recording */
+	gint64 started;			/* When the recording started (info header) */
+	int clock;				/* RTP clock rate of the codec */
+	AVCodecContext *dec;	/* Decoder for this track */
+	gboolean anchored;		/* Whether we aligned this track to the mix already */
+	int64_t base_sample;	/* Output sample the first packet maps to */
+	uint32_t last_rtp;		/* Last RTP timestamp we saw */
+	int64_t ext_rtp;		/* Extended RTP timestamp offset since the first packet */
+	int64_t watermark;		/* Output sample this track has been mixed up to */
+} janus_pp_composite_track;
+
+/* Rolling mix window: int32 accumulators so that summing tracks can't
+ * overflow, clamped to int16 when we hand frames to the encoder */
+static int32_t *mix_window = NULL;
+static int64_t mix_base = 0;	/* Absolute output sample mix_window wraps around */
+
+/* Helper to create a decoder for one of the codecs we support */
+static AVCodecContext *janus_pp_composite_create_decoder(const char *codec, int *clock) {
+	int codec_id = 0, samplerate = 0, channels = 1;
+	if(!strcasecmp(codec, "opus")) {
+		codec_id = AV_CODEC_ID_OPUS;
+		samplerate = 48000;
+		channels = 2;
+		*clock = 48000;
+	} else if(!strcasecmp(codec, "pcma")) {
+		codec_id = AV_CODEC_ID_PCM_ALAW;
+		samplerate = 8000;
+		*clock = 8000;
+	} else if(!strcasecmp(codec, "pcmu")) {
+		codec_id = AV_CODEC_ID_PCM_MULAW;
+		samplerate = 8000;
+		*clock = 8000;
+	} else if(!strcasecmp(codec, "g722")) {
+		codec_id = AV_CODEC_ID_ADPCM_G722;
+		/* G.722 is sampled at 16kHz, but its RTP clock rate is 8kHz */
+		samplerate = 16000;
+		*clock = 8000;
+	} else {
+		JANUS_LOG(LOG_ERR, "Unsupported audio codec '%s'...\n", codec);
+		return NULL;
+	}
+	const AVCodec *c = avcodec_find_decoder(codec_id);
+	if(c == NULL) {
+		JANUS_LOG(LOG_ERR, "No decoder available for '%s'...\n", codec);
+		return NULL;
+	}
+	AVCodecContext *dec = avcodec_alloc_context3(c);
+	if(dec == NULL)
+		return NULL;
+	dec->sample_rate = samplerate;
+#ifdef NEW_CHANNEL_LAYOUT
+	av_channel_layout_default(&dec->ch_layout, channels);
+#else
+	dec->channels = channels;
+	dec->channel_layout = av_get_default_channel_layout(channels);
+#endif
+	if(codec_id == AV_CODEC_ID_OPUS) {
+		/* The Opus decoder wants an OpusHead to know the channel mapping */
+		dec->extradata = av_malloc(sizeof(opus_extradata) + AV_INPUT_BUFFER_PADDING_SIZE);
+		memcpy(dec->extradata, opus_extradata, sizeof(opus_extradata));
+		dec->extradata_size = sizeof(opus_extradata);
+	}
+	if(avcodec_open2(dec, c, NULL) < 0) {
+		JANUS_LOG(LOG_ERR, "Error opening decoder for '%s'...\n", codec);
+		avcodec_free_context(&dec);
+		return NULL;
+	}
+	return dec;
+}
+
+/* Helper to parse the .mjr header of a track: in live mode we may have
+ * to wait for the recorder to actually write it */
+static int janus_pp_composite_parse_header(janus_pp_composite_track *track, gboolean live) {
+	char prebuffer[1500];
+	memset(prebuffer, 0, sizeof(prebuffer));
+	int bytes = 0;
+	uint16_t len = 0;
+	while(working && !track->parsed_header) {
+		long offset = ftell(track->file);
+		bytes = fread(prebuffer, sizeof(char), 8, track->file);
+		if(bytes != 8) {
+			if(live) {
+				/* The recorder hasn't written this part yet, try again */
+				fseek(track->file, offset, SEEK_SET);
+				clearerr(track->file);
+				g_usleep(100000);
+				continue;
+			}
+			JANUS_LOG(LOG_ERR, "Invalid header in %s (not enough bytes)...\n", track->filename);
+			return -1;
+		}
+		if(prebuffer[0] != 'M' || prebuffer[1] != 'J') {
+			JANUS_LOG(LOG_ERR, "Invalid header in %s...\n", track->filename);
+			return -1;
+		}
+		if(prebuffer[2] == 'R' && prebuffer[3] == '0' && prebuffer[4] == '0' &&
+				prebuffer[5] == '0' && prebuffer[6] == '0' && prebuffer[7] == '2') {
+			/* Main header is MJR00002: this means we have timestamps too */
+			track->has_timestamps = TRUE;
+		}
+		bytes = fread(&len, sizeof(uint16_t), 1, track->file);
+		if(bytes != 1) {
+			fseek(track->file, offset, SEEK_SET);
+			if(live) {
+				clearerr(track->file);
+				g_usleep(100000);
+				continue;
+			}
+			JANUS_LOG(LOG_ERR, "Invalid header in %s (not enough bytes)...\n", track->filename);
+			return -1;
+		}
+		len = ntohs(len);
+		if(len == 0 || len > sizeof(prebuffer)-1) {
+			JANUS_LOG(LOG_ERR, "Invalid info header in %s (%"SCNu16" bytes)...\n", track->filename, len);
+			return -1;
+		}
+		bytes = fread(prebuffer, sizeof(char), len, track->file);
+		if(bytes != len) {
+			fseek(track->file, offset, SEEK_SET);
+			if(live) {
+				clearerr(track->file);
+				g_usleep(100000);
+				continue;
+			}
+			JANUS_LOG(LOG_ERR, "Invalid info header in %s (not enough bytes)...\n", track->filename);
+			return -1;
+		}
+		prebuffer[len] = '\0';
+		json_error_t error;
+		json_t *mjr_header = json_loads(prebuffer, 0, &error);
+		if(!mjr_header) {
+			JANUS_LOG(LOG_ERR, "Error parsing header in %s, JSON error: on line %d: %s\n",
+				track->filename, error.line, error.text);
+			return -1;
+		}
+		/* We can only composite audio recordings */
+		json_t *type = json_object_get(mjr_header, "t");
+		if(!type || !json_is_string(type) || strcasecmp(json_string_value(type), "a")) {
+			json_decref(mjr_header);
+			JANUS_LOG(LOG_ERR, "%s is not an audio recording, can't composite it...\n", track->filename);
+			return -1;
+		}
+		if(!track->has_timestamps) {
+			/* Without packet timestamps we have no wall clock to align on */
+			json_decref(mjr_header);
+			JANUS_LOG(LOG_ERR, "%s is an older recording without packet timestamps, can't composite it...\n", track->filename);
+			return -1;
+		}
+		json_t *codec = json_object_get(mjr_header, "c");
+		if(!codec || !json_is_string(codec)) {
+			json_decref(mjr_header);
+			JANUS_LOG(LOG_ERR, "Missing/invalid codec in the info header of %s...\n", track->filename);
+			return -1;
+		}
+		g_snprintf(track->codec, sizeof(track->codec), "%s", json_string_value(codec));
+		json_t *updated = json_object_get(mjr_header, "u");
+		if(!updated || !json_is_integer(updated)) {
+			json_decref(mjr_header);
+			JANUS_LOG(LOG_ERR, "Missing/invalid updated time in the info header of %s...\n", track->filename);
+			return -1;
+		}
+		track->started = json_integer_value(updated);
+		json_decref(mjr_header);
+		track->parsed_header = TRUE;
+	}
+	return track->parsed_header ? 0 : -1;
+}
+
+/* Helper to read the next RTP packet of a track: returns the length of
+ * the packet, 0 if there's nothing more to read right now (live mode),
+ * or -1 at the end of the recording */
+static int janus_pp_composite_next_packet(janus_pp_composite_track *track,
+		char *buffer, int buflen, uint32_t *pkt_ts, gboolean live) {
+	char prebuffer[1500];
+	int bytes = 0;
+	uint16_t len = 0;
+	while(working) {
+		long offset = ftell(track->file);
+		bytes = fread(prebuffer, sizeof(char), 8, track->file);
+		if(bytes != 8) {
+			fseek(track->file, offset, SEEK_SET);
+			if(live) {
+				/* The recorder may still be writing, try again later */
+				clearerr(track->file);
+				return 0;
+			}
+			track->finished = TRUE;
+			return -1;
+		}
+		if(prebuffer[0] != 'M') {
+			JANUS_LOG(LOG_WARN, "Invalid frame header in %s, stopping here...\n", track->filename);
+			track->finished = TRUE;
+			return -1;
+		}
+		if(prebuffer[1] == 'J') {
+			/* Frame index chunks and footer are only appended when the
+			 * recording is over, so in both cases we're done here */
+			track->finished = TRUE;
+			return -1;
+		}
+		/* This is a frame */
+		bytes = fread(&len, sizeof(uint16_t), 1, track->file);
+		if(bytes != 1) {
+			fseek(track->file, offset, SEEK_SET);
+			if(live) {
+				clearerr(track->file);
+				return 0;
+			}
+			track->finished = TRUE;
+			return -1;
+		}
+		len = ntohs(len);
+		/* Read the packet timestamp */
+		memcpy(pkt_ts, prebuffer+4, sizeof(uint32_t));
+		*pkt_ts = ntohl(*pkt_ts);
+		if(len < 12 || len > buflen) {
+			/* Not RTP or too large, skip */
+			if(fseek(track->file, len, SEEK_CUR) < 0) {
+				track->finished = TRUE;
+				return -1;
+			}
+			continue;
+		}
+		bytes = fread(buffer, sizeof(char), len, track->file);
+		if(bytes != len) {
+			fseek(track->file, offset, SEEK_SET);
+			if(live) {
+				clearerr(track->file);
+				return 0;
+			}
+			track->finished = TRUE;
+			return -1;
+		}
+		return len;
+	}
+	return -1;
+}
+
+/* Helper to read a decoded sample as int16, whatever the sample format */
+static inline int32_t janus_pp_composite_sample(AVFrame *frame, int channel, int index) {
+#ifdef NEW_CHANNEL_LAYOUT
+	int channels = frame->ch_layout.nb_channels;
+#else
+	int channels = frame->channels;
+#endif
+	if(channel >= channels)
+		channel = channels - 1;
+	switch(frame->format) {
+		case AV_SAMPLE_FMT_S16:
+			return ((int16_t *)frame->data[0])[index*channels + channel];
+		case AV_SAMPLE_FMT_S16P:
+			return ((int16_t *)frame->data[channel])[index];
+		case AV_SAMPLE_FMT_FLT:
+			return (int32_t)(((float *)frame->data[0])[index*channels + channel] * 32767.0f);
+		case AV_SAMPLE_FMT_FLTP:
+			return (int32_t)(((float *)frame->data[channel])[index] * 32767.0f);
+		default:
+			return 0;
+	}
+}
+
+/* Helper to accumulate a decoded frame in the mix window, starting at
+ * the provided absolute output sample: narrowband codecs are upsampled
+ * to 48kHz with linear interpolation, since that's cheap and good
+ * enough for speech (and we don't depend on libswresample) */
+static void janus_pp_composite_mix(AVFrame *frame, int64_t pos) {
+	int factor = JANUS_PP_COMPOSITE_RATE / frame->sample_rate;
+	int i = 0, k = 0, c = 0;
+	for(i = 0; i < frame->nb_samples; i++) {
+		for(c = 0; c < JANUS_PP_COMPOSITE_CHANNELS; c++) {
+			int32_t s0 = janus_pp_composite_sample(frame, c, i);
+			int32_t s1 = (i+1 < frame->nb_samples) ? janus_pp_composite_sample(frame, c, i+1) : s0;
+			for(k = 0; k < factor; k++) {
+				int64_t sample = pos + (int64_t)i*factor + k;
+				if(sample < mix_base || sample >= mix_base + JANUS_PP_COMPOSITE_WINDOW)
+					continue;	/* Too late (already flushed) or too far ahead */
+				mix_window[(sample % JANUS_PP_COMPOSITE_WINDOW)*JANUS_PP_COMPOSITE_CHANNELS + c] +=
+					s0 + ((s1 - s0)*k)/factor;
+			}
+		}
+	}
+}
+
+/* Helper to encode and mux the next frame out of the mix window */
+static int janus_pp_composite_encode_frame(AVFormatContext *fctx, AVCodecContext *enc, AVFrame *frame) {
+	frame->nb_samples = JANUS_PP_COMPOSITE_SAMPLES;
+	if(av_frame_make_writable(frame) < 0)
+		return -1;
+	int i = 0, c = 0;
+	for(i = 0; i < JANUS_PP_COMPOSITE_SAMPLES; i++) {
+		int64_t sample = mix_base + i;
+		for(c = 0; c < JANUS_PP_COMPOSITE_CHANNELS; c++) {
+			int32_t *slot = &mix_window[(sample % JANUS_PP_COMPOSITE_WINDOW)*JANUS_PP_COMPOSITE_CHANNELS + c];
+			int32_t v = *slot;
+			*slot = 0;	/* Zero the slot as we consume it, so the window can wrap */
+			if(v > 32767)
+				v = 32767;
+			else if(v < -32768)
+				v = -32768;
+			if(enc->sample_fmt == AV_SAMPLE_FMT_S16) {
+				((int16_t *)frame->data[0])[i*JANUS_PP_COMPOSITE_CHANNELS + c] = (int16_t)v;
+			} else if(enc->sample_fmt == AV_SAMPLE_FMT_FLT) {
+				((float *)frame->data[0])[i*JANUS_PP_COMPOSITE_CHANNELS + c] = (float)v / 32768.0f;
+			} else {
+				/* Planar float */
+				((float *)frame->data[c])[i] = (float)v / 32768.0f;
+			}
+		}
+	}
+	frame->pts = mix_base;
+	mix_base += JANUS_PP_COMPOSITE_SAMPLES;
+	int res = avcodec_send_frame(enc, frame);
+	if(res < 0) {
+		JANUS_LOG(LOG_ERR, "Error encoding audio frame... %d\n", res);
+		return -1;
+	}
+#ifdef FF_API_INIT_PACKET
+	AVPacket *pkt = av_packet_alloc();
+#else
+	AVPacket apkt = { 0 }, *pkt = &apkt;
+	av_init_packet(pkt);
+#endif
+	while((res = avcodec_receive_packet(enc, pkt)) == 0) {
+		pkt->stream_index = 0;
+		av_packet_rescale_ts(pkt, enc->time_base, fctx->streams[0]->time_base);
+		if(av_write_frame(fctx, pkt) < 0)
+			JANUS_LOG(LOG_WARN, "Error writing audio frame to file...\n");
+		av_packet_unref(pkt);
+	}
+#ifdef FF_API_INIT_PACKET
+	av_packet_free(&pkt);
+#endif
+	return 0;
+}
+
+/* Helper to drain the encoder once we're done */
+static void janus_pp_composite_drain(AVFormatContext *fctx, AVCodecContext *enc) {
+	avcodec_send_frame(enc, NULL);
+#ifdef FF_API_INIT_PACKET
+	AVPacket *pkt = av_packet_alloc();
+#else
+	AVPacket apkt = { 0 }, *pkt = &apkt;
+	av_init_packet(pkt);
+#endif
+	while(avcodec_receive_packet(enc, pkt) == 0) {
+		pkt->stream_index = 0;
+		av_packet_rescale_ts(pkt, enc->time_base, fctx->streams[0]->time_base);
+		if(av_write_frame(fctx, pkt) < 0)
+			JANUS_LOG(LOG_WARN, "Error writing audio frame to file...\n");
+		av_packet_unref(pkt);
+	}
+#ifdef FF_API_INIT_PACKET
+	av_packet_free(&pkt);
+#endif
+}
+
+
+/* Main Code */
+int main(int argc, char *argv[]) {
+	janus_log_init(FALSE, TRUE, NULL, NULL);
+	atexit(janus_log_destroy);
+
+	/* Evaluate arguments */
+	gboolean live = FALSE;
+	int args = 1;
+	if(argc > 1 && !strcmp(argv[1], "--live")) {
+		live = TRUE;
+		args++;
+	}
+	if(argc - args < 3) {
+		JANUS_LOG(LOG_INFO, "Usage: %s [--live] destination.mka source1.mjr source2.mjr [...]\n", argv[0]);
+		exit(1);
+	}
+	char *destination = argv[args];
+	int tracks_num = argc - args - 1;
+
+	JANUS_LOG(LOG_INFO, "Janus version: %d (%s)\n", janus_version, janus_version_string);
+	JANUS_LOG(LOG_INFO, "Janus commit: %s\n", janus_build_git_sha);
+	JANUS_LOG(LOG_INFO, "Compiled on:  %s\n\n", janus_build_git_time);
+	JANUS_LOG(LOG_INFO, "Compositing %d recording(s) --> %s%s\n", tracks_num, destination,
+		live ? " (live)" : "");
+
+	/* Check the target container first */
+	const char *extension = strrchr(destination, '.');
+	if(extension == NULL) {
+		JANUS_LOG(LOG_ERR, "No extension in the destination file?\n");
+		exit(1);
+	}
+	extension++;
+	/* .opus and .ogg are the same thing, and .mka/.mkv are Matroska */
+	if(!strcasecmp(extension, "opus"))
+		extension = "ogg";
+	if(!strcasecmp(extension, "mka") || !strcasecmp(extension, "mkv"))
+		extension = "matroska";
+
+	/* Handle SIGINT */
+	working = 1;
+	signal(SIGINT, janus_pp_handle_signal);
+
+	/* Open the source files and parse their headers */
+	janus_pp_composite_track *tracks = g_malloc0(tracks_num * sizeof(janus_pp_composite_track));
+	int i = 0;
+	gint64 base_time = 0;
+	for(i = 0; i < tracks_num; i++) {
+		janus_pp_composite_track *track = &tracks[i];
+		track->filename = argv[args + 1 + i];
+		track->file = fopen(track->filename, "rb");
+		if(track->file == NULL) {
+			JANUS_LOG(LOG_ERR, "Could not open file %s\n", track->filename);
+			exit(1);
+		}
+		if(janus_pp_composite_parse_header(track, live) < 0)
+			exit(1);
+		track->dec = janus_pp_composite_create_decoder(track->codec, &track->clock);
+		if(track->dec == NULL)
+			exit(1);
+		JANUS_LOG(LOG_INFO, "  -- %s: %s\n", track->filename, track->codec);
+		/* The earliest recording provides the zero of the mix */
+		if(base_time == 0 || track->started < base_time)
+			base_time = track->started;
+	}
+	if(!working)
+		exit(1);
+
+	/* Create the target file */
+	janus_pp_setup_avformat();
+	AVFormatContext *fctx = janus_pp_create_avformatcontext(extension, NULL, destination);
+	if(fctx == NULL) {
+		JANUS_LOG(LOG_ERR, "Error allocating context\n");
+		exit(1);
+	}
+	/* Create the Opus encoder: prefer libopus, but fall back to the
+	 * native FFmpeg encoder in case libopus isn't available */
+	const AVCodec *codec = avcodec_find_encoder_by_name("libopus");
+	if(codec == NULL)
+		codec = avcodec_find_encoder(AV_CODEC_ID_OPUS);
+	if(codec == NULL) {
+		JANUS_LOG(LOG_ERR, "No Opus encoder available...\n");
+		exit(1);
+	}
+	AVCodecContext *enc = avcodec_alloc_context3(codec);
+	if(enc == NULL) {
+		JANUS_LOG(LOG_ERR, "Error allocating encoder context\n");
+		exit(1);
+	}
+	enc->sample_rate = JANUS_PP_COMPOSITE_RATE;
+	enc->bit_rate = 128000;
+#ifdef NEW_CHANNEL_LAYOUT
+	av_channel_layout_default(&enc->ch_layout, JANUS_PP_COMPOSITE_CHANNELS);
+#else
+	enc->channels = JANUS_PP_COMPOSITE_CHANNELS;
+	enc->channel_layout = av_get_default_channel_layout(JANUS_PP_COMPOSITE_CHANNELS);
+#endif
+	enc->time_base = (AVRational){ 1, JANUS_PP_COMPOSITE_RATE };
+	/* Pick a sample format the encoder supports (s16 if possible) */
+	enc->sample_fmt = codec->sample_fmts ? codec->sample_fmts[0] : AV_SAMPLE_FMT_S16;
+	if(codec->sample_fmts != NULL) {
+		int f = 0;
+		while(codec->sample_fmts[f] != AV_SAMPLE_FMT_NONE) {
+			if(codec->sample_fmts[f] == AV_SAMPLE_FMT_S16) {
+				enc->sample_fmt = AV_SAMPLE_FMT_S16;
+				break;
+			}
+			f++;
+		}
+	}
+	enc->strict_std_compliance = FF_COMPLIANCE_EXPERIMENTAL;
+	if(fctx->oformat->flags & AVFMT_GLOBALHEADER)
+		enc->flags |= CODEC_FLAG_GLOBAL_HEADER;
+	if(avcodec_open2(enc, codec, NULL) < 0) {
+		JANUS_LOG(LOG_ERR, "Error opening Opus encoder\n");
+		exit(1);
+	}
+	AVStream *stream = janus_pp_new_audio_avstream(fctx, AV_CODEC_ID_OPUS,
+		JANUS_PP_COMPOSITE_RATE, JANUS_PP_COMPOSITE_CHANNELS,
+		enc->extradata_size > 0 ? enc->extradata : opus_extradata,
+		enc->extradata_size > 0 ? enc->extradata_size : (int)sizeof(opus_extradata));
+	if(stream == NULL) {
+		JANUS_LOG(LOG_ERR, "Error adding stream\n");
+		exit(1);
+	}
+	if(avformat_write_header(fctx, NULL) < 0) {
+		JANUS_LOG(LOG_ERR, "Error writing header\n");
+		exit(1);
+	}
+
+	/* Prepare the mix window and the frame we'll encode from */
+	mix_window = g_malloc0(JANUS_PP_COMPOSITE_WINDOW * JANUS_PP_COMPOSITE_CHANNELS * sizeof(int32_t));
+	AVFrame *encframe = av_frame_alloc();
+	encframe->format = enc->sample_fmt;
+	encframe->sample_rate = JANUS_PP_COMPOSITE_RATE;
+#ifdef NEW_CHANNEL_LAYOUT
+	av_channel_layout_default(&encframe->ch_layout, JANUS_PP_COMPOSITE_CHANNELS);
+#else
+	encframe->channels = JANUS_PP_COMPOSITE_CHANNELS;
+	encframe->channel_layout = av_get_default_channel_layout(JANUS_PP_COMPOSITE_CHANNELS);
+#endif
+	encframe->nb_samples = JANUS_PP_COMPOSITE_SAMPLES;
+	if(av_frame_get_buffer(encframe, 0) < 0) {
+		JANUS_LOG(LOG_ERR, "Error allocating audio frame\n");
+		exit(1);
+	}
+	AVFrame *decframe = av_frame_alloc();
+	/* The decoders want some zeroed padding after the payload */
+	char buffer[1500 + AV_INPUT_BUFFER_PADDING_SIZE];
+	memset(buffer, 0, sizeof(buffer));
+	uint32_t pkt_ts = 0;
+
+	/* Now traverse the recordings, mixing as we go: each track is read
+	 * up to slightly past the mix head, and we only encode what all the
+	 * (unfinished) tracks have covered already */
+	JANUS_LOG(LOG_INFO, "Compositing...\n");
+	while(working) {
+		gboolean all_finished = TRUE, stalled = TRUE;
+		int64_t safe = -1;
+		for(i = 0; i < tracks_num; i++) {
+			janus_pp_composite_track *track = &tracks[i];
+			if(track->finished)
+				continue;
+			all_finished = FALSE;
+			while(!track->finished && track->watermark < mix_base + JANUS_PP_COMPOSITE_WINDOW/2) {
+				int len = janus_pp_composite_next_packet(track, buffer, 1500, &pkt_ts, live);
+				if(len <= 0)
+					break;
+				memset(buffer + len, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+				stalled = FALSE;
+				/* Parse the RTP header to locate the payload */
+				janus_pp_rtp_header *rtp = (janus_pp_rtp_header *)buffer;
+				if(rtp->version != 2)
+					continue;
+				int plen = len, skip = 12 + rtp->csrccount*4;
+				if(rtp->extension) {
+					janus_pp_rtp_header_extension *ext = (janus_pp_rtp_header_extension *)(buffer + skip);
+					skip += 4 + ntohs(ext->length)*4;
+				}
+				if(rtp->padding && plen > 0)
+					plen -= (uint8_t)buffer[len-1];
+				plen -= skip;
+				if(plen < 1)
+					continue;
+				uint32_t rtp_ts = ntohl(rtp->timestamp);
+				if(!track->anchored) {
+					/* Align the first packet of this track on the wall
+					 * clock the recorder saved, relative to the mix zero */
+					gint64 when = track->started + ((gint64)pkt_ts*1000);
+					track->base_sample = ((when - base_time) * (JANUS_PP_COMPOSITE_RATE/1000)) / 1000;
+					if(track->base_sample < 0)
+						track->base_sample = 0;
+					track->last_rtp = rtp_ts;
+					track->anchored = TRUE;
+				} else {
+					/* Within a track, the RTP timestamps drive the position */
+					track->ext_rtp += (gint32)(rtp_ts - track->last_rtp);
+					track->last_rtp = rtp_ts;
+				}
+				int64_t pos = track->base_sample +
+					(track->ext_rtp * JANUS_PP_COMPOSITE_RATE) / track->clock;
+				if(pos + JANUS_PP_COMPOSITE_RATE < mix_base || pos > mix_base + 10*JANUS_PP_COMPOSITE_WINDOW) {
+					/* Way out of the window (e.g., a broken timestamp), ignore */
+					continue;
+				}
+				/* Decode and mix */
+#ifdef FF_API_INIT_PACKET
+				AVPacket *pkt = av_packet_alloc();
+#else
+				AVPacket apkt = { 0 }, *pkt = &apkt;
+				av_init_packet(pkt);
+#endif
+				pkt->data = (uint8_t *)buffer + skip;
+				pkt->size = plen;
+				if(avcodec_send_packet(track->dec, pkt) == 0) {
+					while(avcodec_receive_frame(track->dec, decframe) == 0) {
+						int64_t end = pos + ((int64_t)decframe->nb_samples *
+							JANUS_PP_COMPOSITE_RATE) / decframe->sample_rate;
+						/* If the window can't hold this, force the mix forward */
+						while(end > mix_base + JANUS_PP_COMPOSITE_WINDOW) {
+							if(janus_pp_composite_encode_frame(fctx, enc, encframe) < 0)
+								break;
+						}
+						janus_pp_composite_mix(decframe, pos);
+						if(end > track->watermark)
+							track->watermark = end;
+						pos = end;
+						av_frame_unref(decframe);
+					}
+				}
+#ifdef FF_API_INIT_PACKET
+				av_packet_free(&pkt);
+#endif
+			}
+			int64_t wm = track->watermark;
+			if(live) {
+				/* In live mode the wall clock moves the watermark of idle
+				 * tracks forward too, or a muted participant would stall
+				 * the whole mix: we stay a bit behind real time to leave
+				 * the recorder some buffering slack */
+				int64_t live_wm = ((janus_get_real_time() - base_time) *
+					(JANUS_PP_COMPOSITE_RATE/1000)) / 1000 - JANUS_PP_COMPOSITE_LIVE_MARGIN;
+				if(live_wm > wm)
+					wm = live_wm;
+			}
+			if(safe == -1 || wm < safe)
+				safe = wm;
+		}
+		if(all_finished)
+			break;
+		/* Encode as many full frames as all tracks have covered */
+		while(working && mix_base + JANUS_PP_COMPOSITE_SAMPLES <= safe) {
+			if(janus_pp_composite_encode_frame(fctx, enc, encframe) < 0)
+				break;
+		}
+		if(stalled)
+			g_usleep(live ? 20000 : 1000);
+	}
+	/* Flush what's left in the window, drain the encoder and close */
+	int64_t tail = mix_base;
+	for(i = 0; i < tracks_num; i++) {
+		if(tracks[i].watermark > tail)
+			tail = tracks[i].watermark;
+	}
+	while(mix_base < tail) {
+		if(janus_pp_composite_encode_frame(fctx, enc, encframe) < 0)
+			break;
+	}
+	janus_pp_composite_drain(fctx, enc);
+	av_write_trailer(fctx);
+
+	/* We're done */
+	for(i = 0; i < tracks_num; i++) {
+		fclose(tracks[i].file);
+		avcodec_free_context(&tracks[i].dec);
+	}
+	g_free(tracks);
+	av_frame_free(&encframe);
+	av_frame_free(&decframe);
+	avcodec_free_context(&enc);
+	avio_close(fctx->pb);
+	avformat_free_context(fctx);
+	g_free(mix_window);
+
+	FILE *outfile = fopen(destination, "rb");
+	if(outfile == NULL) {
+		JANUS_LOG(LOG_INFO, "No destination file %s??\n", destination);
+	} else {
+		fseek(outfile, 0L, SEEK_END);
+		long fsize = ftell(outfile);
+		fclose(outfile);
+		JANUS_LOG(LOG_INFO, "%s is %zu bytes\n", destination, fsize);
+	}
+
+	JANUS_LOG(LOG_INFO, "Bye!\n");
+	return 0;
+}
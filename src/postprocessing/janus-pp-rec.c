@@ -93,6 +93,10 @@ Usage: janus-pp-rec [OPTIONS] source.mjr
                                 Minimum latency of moving average to reach
                                   before starting to correct timestamps.
                                   (default=500)
+  -T, --parallel                Process multiple recordings in parallel,
+                                  passing source/destination pairs (e.g.,
+                                  audio.mjr audio.opus video.mjr video.webm)
+                                  (default=off)
 \endverbatim
  *
  * \note This utility does not do any form of transcoding. It just
@@ -111,10 +115,14 @@ Usage: janus-pp-rec [OPTIONS] source.mjr
 #else
 #include <endian.h>
 #endif
+#include <errno.h>
 #include <inttypes.h>
 #include <string.h>
 #include <stdlib.h>
 #include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 #include <jansson.h>
 
@@ -122,6 +130,7 @@ Usage: janus-pp-rec [OPTIONS] source.mjr
 #include "../utils.h"
 #include "pp-options.h"
 #include "pp-rtp.h"
+#include "pp-index.h"
 #include "pp-webm.h"
 #include "pp-h264.h"
 #include "pp-av1.h"
@@ -302,6 +311,60 @@ int main(int argc, char *argv[]) {
 		exit(1);
 	}
 
+	if(options.parallel && !jsonheader_only && !header_only && !parse_only) {
+		/* We've been asked to process multiple recordings in parallel, in a
+		 * single invocation (e.g., all the tracks of a VideoRoom session):
+		 * since the media processors keep global state, each track gets its
+		 * own worker process, rather than a thread, running the very same
+		 * processing pipeline it would run in a separate invocation */
+		guint npaths = g_strv_length(options.paths);
+		if(npaths % 2 != 0) {
+			JANUS_LOG(LOG_ERR, "Parallel processing expects source/destination pairs (got %u paths)\n", npaths);
+			janus_pprec_options_destroy();
+			exit(1);
+		}
+		guint ntracks = npaths/2, i = 0;
+		pid_t *workers = g_malloc(ntracks * sizeof(pid_t));
+		pid_t pid = -1;
+		for(i = 0; i < ntracks; i++) {
+			pid = fork();
+			if(pid == -1) {
+				JANUS_LOG(LOG_ERR, "Error forking worker process... %d (%s)\n", errno, g_strerror(errno));
+				janus_pprec_options_destroy();
+				exit(1);
+			}
+			if(pid == 0) {
+				/* We're a worker: prefix our logs with the track number, so
+				 * that the interleaved progress reports can be told apart,
+				 * and process our own source/destination pair as usual */
+				char prefix[20];
+				g_snprintf(prefix, sizeof(prefix), "[track-%u] ", i+1);
+				janus_log_global_prefix = g_strdup(prefix);
+				source = options.paths[i*2];
+				destination = options.paths[i*2 + 1];
+				break;
+			}
+			workers[i] = pid;
+		}
+		if(pid != 0) {
+			/* We're the main process: just wait for all the workers */
+			JANUS_LOG(LOG_INFO, "Processing %u tracks in parallel\n", ntracks);
+			int status = 0, errors = 0;
+			for(i = 0; i < ntracks; i++) {
+				waitpid(workers[i], &status, 0);
+				if(!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+					JANUS_LOG(LOG_ERR, "Error processing track %u (%s)\n", i+1, options.paths[i*2]);
+					errors++;
+				}
+			}
+			g_free(workers);
+			JANUS_LOG(LOG_INFO, "%u/%u tracks processed\n", ntracks-errors, ntracks);
+			janus_pprec_options_destroy();
+			exit(errors ? 1 : 0);
+		}
+		g_free(workers);
+	}
+
 	if(!jsonheader_only) {
 		JANUS_LOG(LOG_INFO, "Janus version: %d (%s)\n", janus_version, janus_version_string);
 		JANUS_LOG(LOG_INFO, "Janus commit: %s\n", janus_build_git_sha);
@@ -362,6 +425,38 @@ int main(int argc, char *argv[]) {
 	if(!jsonheader_only)
 		JANUS_LOG(LOG_INFO, "File is %zu bytes\n", fsize);
 
+	/* Try to memory-map the recording: both the parsing that follows and
+	 * the media processors do a lot of small seeks and reads, which can be
+	 * brutally slow on network-backed storage, while on a sequentially
+	 * advised mapping they're just memory accesses; if anything fails,
+	 * we keep reading the file as we used to */
+	char *map = NULL;
+	if(fsize > 0) {
+		map = mmap(NULL, fsize, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+		if(map == MAP_FAILED) {
+			map = NULL;
+		} else {
+			madvise(map, fsize, MADV_SEQUENTIAL);
+			FILE *mapped = fmemopen(map, fsize, "rb");
+			if(mapped != NULL) {
+				fclose(file);
+				file = mapped;
+				if(!jsonheader_only)
+					JANUS_LOG(LOG_VERB, "Memory-mapped the recording\n");
+			} else {
+				munmap(map, fsize);
+				map = NULL;
+			}
+		}
+	}
+
+	/* Check if the recording ends with a frame index footer, which would
+	 * save us from scanning the whole file just to locate the frames */
+	uint32_t index_count = 0;
+	janus_pp_index_entry *index = janus_pp_index_parse(file, fsize, &index_count);
+	if(index != NULL && !jsonheader_only)
+		JANUS_LOG(LOG_INFO, "Found a frame index footer (%"SCNu32" frames)\n", index_count);
+
 	/* Handle SIGINT */
 	working = 1;
 	signal(SIGINT, janus_pp_handle_signal);
@@ -394,6 +489,10 @@ int main(int argc, char *argv[]) {
 			janus_pprec_options_destroy();
 			exit(0);
 		}
+		if(index != NULL && parsed_header) {
+			/* We have a frame index, no need to walk the rest of the file */
+			break;
+		}
 		/* Read frame header */
 		skip = 0;
 		fseek(file, offset, SEEK_SET);
@@ -739,6 +838,7 @@ int main(int argc, char *argv[]) {
 		offset += len;
 	}
 	if(!working || jsonheader_only) {
+		g_free(index);
 		g_free(metadata);
 		g_free(extension);
 		janus_pprec_options_destroy();
@@ -782,33 +882,49 @@ int main(int argc, char *argv[]) {
 	/* Extensions, if any */
 	int audiolevel = 0, rotation = 0, last_rotation = -1, rotated = -1;
 	uint16_t rtp_header_len, rtp_read_n;
+	uint32_t index_i = 0;
 	/* Start loop */
-	while(working && offset < fsize) {
-		/* Read frame header */
+	while(working && (index == NULL ? (offset < fsize) : (index_i < index_count))) {
 		skip = 0;
-		fseek(file, offset, SEEK_SET);
-		bytes = fread(prebuffer, sizeof(char), 8, file);
-		if(bytes != 8 || prebuffer[0] != 'M') {
-			/* Broken packet? Stop here */
-			break;
-		}
-		if(has_timestamps) {
-			/* Read the packet timestamp */
-			memcpy(&pkt_ts, prebuffer+4, sizeof(uint32_t));
-			pkt_ts = ntohl(pkt_ts);
-		}
-		prebuffer[(has_timestamps && prebuffer[1] != 'J') ? 4 : 8] = '\0';
-		JANUS_LOG(LOG_VERB, "Header: %s\n", prebuffer);
-		offset += 8;
-		bytes = fread(&len, sizeof(uint16_t), 1, file);
-		len = ntohs(len);
-		JANUS_LOG(LOG_VERB, "  -- Length: %"SCNu16"\n", len);
-		offset += 2;
-		if(prebuffer[1] == 'J' || (!data && len < 12)) {
-			/* Not RTP, skip */
-			JANUS_LOG(LOG_VERB, "  -- Not RTP, skipping\n");
-			offset += len;
-			continue;
+		if(index != NULL) {
+			/* We have a frame index, jump straight to the next frame */
+			pkt_ts = index[index_i].time;
+			len = index[index_i].len;
+			offset = index[index_i].offset + 10;
+			index_i++;
+			fseek(file, offset, SEEK_SET);
+			if(!data && len < 12) {
+				/* Not RTP, skip */
+				JANUS_LOG(LOG_VERB, "  -- Not RTP, skipping\n");
+				offset += len;
+				continue;
+			}
+		} else {
+			/* Read frame header */
+			fseek(file, offset, SEEK_SET);
+			bytes = fread(prebuffer, sizeof(char), 8, file);
+			if(bytes != 8 || prebuffer[0] != 'M') {
+				/* Broken packet? Stop here */
+				break;
+			}
+			if(has_timestamps) {
+				/* Read the packet timestamp */
+				memcpy(&pkt_ts, prebuffer+4, sizeof(uint32_t));
+				pkt_ts = ntohl(pkt_ts);
+			}
+			prebuffer[(has_timestamps && prebuffer[1] != 'J') ? 4 : 8] = '\0';
+			JANUS_LOG(LOG_VERB, "Header: %s\n", prebuffer);
+			offset += 8;
+			bytes = fread(&len, sizeof(uint16_t), 1, file);
+			len = ntohs(len);
+			JANUS_LOG(LOG_VERB, "  -- Length: %"SCNu16"\n", len);
+			offset += 2;
+			if(prebuffer[1] == 'J' || (!data && len < 12)) {
+				/* Not RTP, skip */
+				JANUS_LOG(LOG_VERB, "  -- Not RTP, skipping\n");
+				offset += len;
+				continue;
+			}
 		}
 		if(has_timestamps) {
 			JANUS_LOG(LOG_VERB, "  -- Time: %"SCNu32"ms\n", pkt_ts);
@@ -1137,6 +1253,9 @@ int main(int argc, char *argv[]) {
 		offset += len;
 		count++;
 	}
+	/* If we had a frame index, we don't need it anymore */
+	g_free(index);
+	index = NULL;
 	if(!working) {
 		if(info)
 			json_decref(info);
@@ -1516,6 +1635,8 @@ int main(int argc, char *argv[]) {
 		}
 	}
 	fclose(file);
+	if(map != NULL)
+		munmap(map, fsize);
 
 	file = fopen(destination, "rb");
 	if(file == NULL) {
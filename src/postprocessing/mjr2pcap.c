@@ -17,6 +17,13 @@
 \verbatim
 ./mjr2pcap /path/to/source.mjr /path/to/destination.pcap
 \endverbatim
+ *
+ * The recording is processed in a streaming fashion, one frame at a time,
+ * so memory usage doesn't depend on the size of the source file. Passing
+ * \c - as the source reads the recording from standard input, and passing
+ * \c - as the destination writes the capture to standard output (in which
+ * case logs are sent to standard error), so the tool can also sit in a
+ * shell pipeline.
  *
  * An attempt to process a non-RTP recording will result in an error.
  *
@@ -42,6 +49,7 @@
 #include "../debug.h"
 #include "../version.h"
 #include "pp-rtp.h"
+#include "pp-index.h"
 
 
 #define htonll(x) ((1==htonl(1)) ? (x) : ((gint64)htonl((x) & 0xFFFFFFFF) << 32) | htonl((x) >> 32))
@@ -147,192 +155,206 @@ static void janus_pp_handle_signal(int signum) {
 	working = 0;
 }
 
+/* Helper to skip bytes in the source file without seeking,
+ * since the recording may be coming from a pipe */
+static gboolean mjr2pcap_skip(FILE *file, size_t count) {
+	char waste[1500];
+	size_t bytes = 0;
+	while(count > 0) {
+		bytes = fread(waste, sizeof(char), count > sizeof(waste) ? sizeof(waste) : count, file);
+		if(bytes == 0)
+			return FALSE;
+		count -= bytes;
+	}
+	return TRUE;
+}
+
 
 /* Main Code */
 int main(int argc, char *argv[]) {
-	janus_log_init(FALSE, TRUE, NULL, NULL);
+	/* Evaluate arguments first: if we're going to write the capture
+	 * to stdout, we need to send the logs to stderr instead */
+	if(argc != 3) {
+		janus_log_init(FALSE, TRUE, NULL, NULL);
+		atexit(janus_log_destroy);
+		JANUS_LOG(LOG_INFO, "Usage: %s source.mjr destination.pcap\n", argv[0]);
+		exit(1);
+	}
+	char *source = argv[1], *destination = argv[2];
+	gboolean use_stdin = !strcmp(source, "-"), use_stdout = !strcmp(destination, "-");
+	janus_log_init(FALSE, !use_stdout, use_stdout ? "/dev/stderr" : NULL, NULL);
 	atexit(janus_log_destroy);
 
 	JANUS_LOG(LOG_INFO, "Janus version: %d (%s)\n", janus_version, janus_version_string);
 	JANUS_LOG(LOG_INFO, "Janus commit: %s\n", janus_build_git_sha);
 	JANUS_LOG(LOG_INFO, "Compiled on:  %s\n\n", janus_build_git_time);
-
-	/* Evaluate arguments */
-	if(argc != 3) {
-		JANUS_LOG(LOG_INFO, "Usage: %s source.mjr destination.pcap\n", argv[0]);
-		exit(1);
-	}
-	char *source = NULL, *destination = NULL;
-	source = argv[1];
-	destination = argv[2];
 	JANUS_LOG(LOG_INFO, "%s --> %s\n", source, destination);
 
-	/* Open the source file */
-	FILE *file = fopen(source, "rb");
+	/* Open the source file ("-" means we read the recording from stdin) */
+	FILE *file = use_stdin ? stdin : fopen(source, "rb");
 	if(file == NULL) {
 		JANUS_LOG(LOG_ERR, "Could not open file %s\n", source);
 		exit(1);
 	}
-	fseek(file, 0L, SEEK_END);
-	long fsize = ftell(file);
-	fseek(file, 0L, SEEK_SET);
-	JANUS_LOG(LOG_INFO, "File is %zu bytes\n", fsize);
+	uint32_t index_count = 0;
+	janus_pp_index_entry *index = NULL;
+	if(!use_stdin) {
+		fseek(file, 0L, SEEK_END);
+		long fsize = ftell(file);
+		fseek(file, 0L, SEEK_SET);
+		JANUS_LOG(LOG_INFO, "File is %zu bytes\n", fsize);
+		/* Check if the recording ends with a frame index footer, which would
+		 * save us from scanning the whole file just to locate the frames */
+		index = janus_pp_index_parse(file, fsize, &index_count);
+		if(index != NULL)
+			JANUS_LOG(LOG_INFO, "Found a frame index footer (%"SCNu32" frames)\n", index_count);
+	}
 
 	/* Handle SIGINT */
 	working = 1;
 	signal(SIGINT, janus_pp_handle_signal);
 
-	/* Pre-parse */
-	JANUS_LOG(LOG_INFO, "Pre-parsing file...\n");
+	/* Create the target file ("-" means we stream the capture to stdout) */
+	FILE *outfile = use_stdout ? stdout : fopen(destination, "wb");
+	if(outfile == NULL) {
+		JANUS_LOG(LOG_ERR, "Couldn't open output file\n");
+		exit(1);
+	}
+	/* Start with the PCAP header */
+	mjr2pcap_global_header pcap_header = {
+		0xa1b2c3d4, 2, 4, 0, 0, 65535, 1
+	};
+	fwrite(&pcap_header, sizeof(char), sizeof(pcap_header), outfile);
+	/* Now traverse the recording and save the RTP packets to the .pcap file:
+	 * we process the file sequentially, one frame at a time, so that memory
+	 * usage doesn't depend on its size and the source can also be a pipe;
+	 * when we have a frame index we jump from one frame to the next instead */
+	JANUS_LOG(LOG_INFO, "Traversing RTP packets...\n");
 	gboolean has_timestamps = FALSE;
 	gboolean parsed_header = FALSE;
 	json_t *mjr_header = NULL;
 	int bytes = 0;
-	long offset = 0;
 	uint16_t len = 0;
 	gint64 started = 0;
+	uint32_t pkt_ts = 0, index_i = 0;
 	char prebuffer[1500];
 	memset(prebuffer, 0, 1500);
-	/* Let's look for timestamp resets first */
-	while(working && offset < fsize) {
-		/* Read frame header */
-		fseek(file, offset, SEEK_SET);
-		bytes = fread(prebuffer, sizeof(char), 8, file);
-		if(bytes != 8 || prebuffer[0] != 'M') {
-			JANUS_LOG(LOG_WARN, "Invalid header at offset %ld (%s), the processing will stop here...\n",
-				offset, bytes != 8 ? "not enough bytes" : "wrong prefix");
-			break;
-		}
-		if(prebuffer[1] == 'E') {
-			/* Either the old .mjr format header ('MEETECHO' header followed by 'audio' or 'video'), or a frame */
-			offset += 8;
-			bytes = fread(&len, sizeof(uint16_t), 1, file);
-			len = ntohs(len);
-			offset += 2;
-			if(len == 5 && !parsed_header) {
-				/* Old .mjr format, check if this is an RTP recording */
-				bytes = fread(prebuffer, sizeof(char), 5, file);
-				if(prebuffer[0] != 'a' && prebuffer[0] != 'v') {
-					fclose(file);
-					JANUS_LOG(LOG_ERR, "Not an RTP recording (data currently unsupported)...\n");
-					exit(1);
-				}
-			} else if(len < 12) {
+	while(working) {
+		if(index != NULL && parsed_header) {
+			/* We have a frame index, jump straight to the next frame */
+			if(index_i >= index_count)
+				break;
+			pkt_ts = index[index_i].time;
+			len = index[index_i].len;
+			fseek(file, index[index_i].offset + 10, SEEK_SET);
+			index_i++;
+			if(len < 12 || len > 1500) {
 				/* Not RTP, skip */
-				JANUS_LOG(LOG_VERB, "Skipping packet (not RTP?)\n");
-				offset += len;
+				JANUS_LOG(LOG_VERB, "  -- Not RTP, skipping\n");
 				continue;
 			}
-		} else if(prebuffer[1] == 'J') {
-			/* New .mjr format, check if this is an RTP recording */
-			if(prebuffer[2] == 'R' && prebuffer[3] == '0' && prebuffer[4] == '0' &&
-					prebuffer[5] == '0' && prebuffer[6] == '0' && prebuffer[7] == '2') {
-				/* Main header is MJR00002: this means we have timestamps too */
-				has_timestamps = TRUE;
-				JANUS_LOG(LOG_VERB, "New .mjr format, will parse timestamps too\n");
+		} else {
+			/* Read frame header */
+			bytes = fread(prebuffer, sizeof(char), 8, file);
+			if(bytes != 8 || prebuffer[0] != 'M') {
+				if(!parsed_header) {
+					JANUS_LOG(LOG_WARN, "Invalid header (%s), the processing will stop here...\n",
+						bytes != 8 ? "not enough bytes" : "wrong prefix");
+				}
+				break;
 			}
-			offset += 8;
-			bytes = fread(&len, sizeof(uint16_t), 1, file);
-			len = ntohs(len);
-			offset += 2;
-			if(len > 0 && !parsed_header) {
-				/* This is the info header */
-				bytes = fread(prebuffer, sizeof(char), len, file);
-				prebuffer[len] = '\0';
-				json_error_t error;
-				mjr_header = json_loads(prebuffer, 0, &error);
-				if(!mjr_header) {
-					fclose(file);
-					JANUS_LOG(LOG_ERR, "Error parsing header, JSON error: on line %d: %s\n", error.line, error.text);
-					exit(1);
+			if(prebuffer[1] == 'J') {
+				/* New .mjr format, check if this is an RTP recording */
+				if(prebuffer[2] == 'R' && prebuffer[3] == '0' && prebuffer[4] == '0' &&
+						prebuffer[5] == '0' && prebuffer[6] == '0' && prebuffer[7] == '2') {
+					/* Main header is MJR00002: this means we have timestamps too */
+					has_timestamps = TRUE;
+					JANUS_LOG(LOG_VERB, "New .mjr format, will parse timestamps too\n");
 				}
-				/* Make sure the content is RTP */
-				json_t *type = json_object_get(mjr_header, "t");
-				if(!type || !json_is_string(type)) {
-					json_decref(mjr_header);
-					fclose(file);
-					JANUS_LOG(LOG_ERR, "Missing/invalid recording type in info header...\n");
-					exit(1);
+				bytes = fread(&len, sizeof(uint16_t), 1, file);
+				len = ntohs(len);
+				if(len > 0 && !parsed_header) {
+					/* This is the info header */
+					parsed_header = TRUE;
+					if(len > sizeof(prebuffer)-1) {
+						JANUS_LOG(LOG_ERR, "Info header too large (%"SCNu16" bytes)...\n", len);
+						fclose(file);
+						exit(1);
+					}
+					bytes = fread(prebuffer, sizeof(char), len, file);
+					prebuffer[len] = '\0';
+					json_error_t error;
+					mjr_header = json_loads(prebuffer, 0, &error);
+					if(!mjr_header) {
+						fclose(file);
+						JANUS_LOG(LOG_ERR, "Error parsing header, JSON error: on line %d: %s\n", error.line, error.text);
+						exit(1);
+					}
+					/* Make sure the content is RTP */
+					json_t *type = json_object_get(mjr_header, "t");
+					if(!type || !json_is_string(type)) {
+						json_decref(mjr_header);
+						fclose(file);
+						JANUS_LOG(LOG_ERR, "Missing/invalid recording type in info header...\n");
+						exit(1);
+					}
+					const char *t = json_string_value(type);
+					if(!strcasecmp(t, "d")) {
+						/* Data recordings are not supported yet */
+						json_decref(mjr_header);
+						fclose(file);
+						JANUS_LOG(LOG_ERR, "Not an RTP recording (data currently unsupported)...\n");
+						exit(1);
+					}
+					json_t *updated = json_object_get(mjr_header, "u");
+					if(!updated || !json_is_integer(updated)) {
+						json_decref(mjr_header);
+						fclose(file);
+						JANUS_LOG(LOG_ERR, "Missing/invalid updated time in info header...\n");
+						exit(1);
+					}
+					started = json_integer_value(updated);
+				} else if(!mjr2pcap_skip(file, len)) {
+					break;
+				}
+				continue;
+			} else if(prebuffer[1] == 'E') {
+				/* Either the old .mjr format header ('MEETECHO' header followed by 'audio' or 'video'), or a frame */
+				bytes = fread(&len, sizeof(uint16_t), 1, file);
+				len = ntohs(len);
+				if(len == 5 && !parsed_header) {
+					/* Old .mjr format, check if this is an RTP recording */
+					bytes = fread(prebuffer, sizeof(char), 5, file);
+					if(prebuffer[0] != 'a' && prebuffer[0] != 'v') {
+						fclose(file);
+						JANUS_LOG(LOG_ERR, "Not an RTP recording (data currently unsupported)...\n");
+						exit(1);
+					}
+					continue;
 				}
-				const char *t = json_string_value(type);
-				if(!strcasecmp(t, "d")) {
-					/* Data recordings are not supported yet */
-					json_decref(mjr_header);
-					fclose(file);
-					JANUS_LOG(LOG_ERR, "Not an RTP recording (data currently unsupported)...\n");
-					exit(1);
+				JANUS_LOG(LOG_VERB, "  -- Length: %"SCNu16"\n", len);
+				if(has_timestamps) {
+					/* Read the packet timestamp */
+					memcpy(&pkt_ts, prebuffer+4, sizeof(uint32_t));
+					pkt_ts = ntohl(pkt_ts);
 				}
-				json_t *updated = json_object_get(mjr_header, "u");
-				if(!updated || !json_is_integer(updated)) {
-					json_decref(mjr_header);
-					fclose(file);
-					JANUS_LOG(LOG_ERR, "Missing/invalid updated time in info header...\n");
-					exit(1);
+				if(len < 12 || len > 1500) {
+					/* Not RTP or way too large, skip */
+					JANUS_LOG(LOG_VERB, "  -- Not RTP, skipping\n");
+					if(!mjr2pcap_skip(file, len))
+						break;
+					continue;
 				}
-				started = json_integer_value(updated);
+			} else {
+				JANUS_LOG(LOG_ERR, "Invalid header...\n");
+				break;
 			}
-		} else {
-			JANUS_LOG(LOG_ERR, "Invalid header...\n");
-			json_decref(mjr_header);
-			fclose(file);
-			exit(1);
-		}
-		/* Skip data for now */
-		offset += len;
-	}
-
-	/* Create the target file */
-	FILE *outfile = fopen(destination, "wb");
-	if(outfile == NULL) {
-		json_decref(mjr_header);
-		JANUS_LOG(LOG_ERR, "Couldn't open output file\n");
-		exit(1);
-	}
-	/* Start with the PCAP header */
-	mjr2pcap_global_header pcap_header = {
-		0xa1b2c3d4, 2, 4, 0, 0, 65535, 1
-	};
-	fwrite(&pcap_header, sizeof(char), sizeof(pcap_header), outfile);
-	/* Now iterate on all packets, and save them to the .pcap file */
-	offset = 0;
-	JANUS_LOG(LOG_INFO, "Traversing RTP packets...\n");
-	uint32_t pkt_ts = 0;
-	while(working && offset < fsize) {
-		/* Read frame header */
-		fseek(file, offset, SEEK_SET);
-		bytes = fread(prebuffer, sizeof(char), 8, file);
-		if(bytes != 8 || prebuffer[0] != 'M') {
-			/* Broken packet? Stop here */
-			break;
-		}
-		if(has_timestamps) {
-			/* Read the packet timestamp */
-			memcpy(&pkt_ts, prebuffer+4, sizeof(uint32_t));
-			pkt_ts = ntohl(pkt_ts);
-		}
-		offset += 8;
-		bytes = fread(&len, sizeof(uint16_t), 1, file);
-		len = ntohs(len);
-		JANUS_LOG(LOG_VERB, "  -- Length: %"SCNu16"\n", len);
-		offset += 2;
-		if(prebuffer[1] == 'J' || len < 12) {
-			/* Not RTP, skip */
-			JANUS_LOG(LOG_VERB, "  -- Not RTP, skipping\n");
-			offset += len;
-			continue;
-		}
-		if(len > 1500) {
-			/* Way too large, very likely not RTP, skip */
-			JANUS_LOG(LOG_VERB, "  -- Too large packet (%d bytes), skipping\n", len);
-			offset += len;
-			continue;
 		}
 		/* Get the whole packet */
 		bytes = fread(prebuffer, sizeof(char), len, file);
 		if(bytes != len) {
-			JANUS_LOG(LOG_WARN, "  -- Failed to read packet (%d != %d bytes), skipping\n", bytes, len);
-			offset += len;
-			continue;
+			JANUS_LOG(LOG_WARN, "  -- Failed to read packet (%d != %d bytes), stopping here\n", bytes, len);
+			break;
 		}
 		/* Save the packet to PCAP */
 		int hsize = sizeof(mjr2pcap_ethernet_header) + sizeof(mjr2pcap_ip_header) +
@@ -372,21 +394,25 @@ int main(int argc, char *argv[]) {
 			}
 			tot -= temp;
 		}
-		offset += len;
 	}
 	/* We're done */
+	g_free(index);
 	json_decref(mjr_header);
 	fclose(file);
-	fclose(outfile);
-	outfile = fopen(destination, "rb");
-	if(outfile == NULL) {
-		JANUS_LOG(LOG_INFO, "No destination file %s??\n", destination);
+	if(use_stdout) {
+		fflush(outfile);
 	} else {
-		fseek(outfile, 0L, SEEK_END);
-		fsize = ftell(outfile);
-		fseek(outfile, 0L, SEEK_SET);
-		JANUS_LOG(LOG_INFO, "%s is %zu bytes\n", destination, fsize);
 		fclose(outfile);
+		outfile = fopen(destination, "rb");
+		if(outfile == NULL) {
+			JANUS_LOG(LOG_INFO, "No destination file %s??\n", destination);
+		} else {
+			fseek(outfile, 0L, SEEK_END);
+			long fsize = ftell(outfile);
+			fseek(outfile, 0L, SEEK_SET);
+			JANUS_LOG(LOG_INFO, "%s is %zu bytes\n", destination, fsize);
+			fclose(outfile);
+		}
 	}
 
 	JANUS_LOG(LOG_INFO, "Bye!\n");
@@ -25,6 +25,13 @@
  * the SSRC will instruct the tool to try and autodetect the first SSRC
  * it finds, and use that one as a filter.
  *
+ * The tool processes the capture in a streaming fashion, one packet at a
+ * time, so memory usage doesn't depend on the size of the source file.
+ * Passing \c - as the source reads the capture from standard input, and
+ * passing \c - as the destination writes the recording to standard output
+ * (in which case logs are sent to standard error), so the tool can also
+ * sit in a shell pipeline.
+ *
  * If the tool can't detect any RTP packet with the specified SSRC, itwill result in an error.
  *
  * \ingroup postprocessing
@@ -103,14 +110,8 @@ static GOptionEntry opt_entries[] = {
 
 /* Main Code */
 int main(int argc, char *argv[]) {
-	janus_log_init(FALSE, TRUE, NULL, NULL);
-	atexit(janus_log_destroy);
-
-	JANUS_LOG(LOG_INFO, "Janus version: %d (%s)\n", janus_version, janus_version_string);
-	JANUS_LOG(LOG_INFO, "Janus commit: %s\n", janus_build_git_sha);
-	JANUS_LOG(LOG_INFO, "Compiled on:  %s\n\n", janus_build_git_time);
-
-	/* Parse the command-line arguments */
+	/* Parse the command-line arguments first: if we're going to write the
+	 * recording to stdout, we need to send the logs to stderr instead */
 	GError *error = NULL;
 	GOptionContext *opts = g_option_context_new("source.pcap destination.mjr");
 	g_option_context_set_help_enabled(opts, TRUE);
@@ -120,6 +121,15 @@ int main(int argc, char *argv[]) {
 		g_error_free(error);
 		exit(1);
 	}
+	gboolean use_stdout = (paths != NULL && paths[0] != NULL &&
+		paths[1] != NULL && !strcmp(paths[1], "-"));
+	janus_log_init(FALSE, !use_stdout, use_stdout ? "/dev/stderr" : NULL, NULL);
+	atexit(janus_log_destroy);
+
+	JANUS_LOG(LOG_INFO, "Janus version: %d (%s)\n", janus_version, janus_version_string);
+	JANUS_LOG(LOG_INFO, "Janus commit: %s\n", janus_build_git_sha);
+	JANUS_LOG(LOG_INFO, "Compiled on:  %s\n\n", janus_build_git_time);
+
 	/* If some arguments are missing, fail */
 	if(codec == NULL || paths == NULL || paths[0] == NULL || paths[1] == NULL) {
 		char *help = g_option_context_get_help(opts, TRUE, NULL);
@@ -177,8 +187,8 @@ int main(int argc, char *argv[]) {
 		exit(1);
 	}
 
-	/* Create the target file */
-	FILE *outfile = fopen(destination, "wb");
+	/* Create the target file ("-" means we stream the recording to stdout) */
+	FILE *outfile = use_stdout ? stdout : fopen(destination, "wb");
 	if(outfile == NULL) {
 		JANUS_LOG(LOG_ERR, "Couldn't open output file\n");
 		g_option_context_free(opts);
@@ -368,16 +378,20 @@ int main(int argc, char *argv[]) {
 done:
 	/* We're done */
 	pcap_close(pcap);
-	fclose(outfile);
-	outfile = fopen(destination, "rb");
-	if(outfile == NULL) {
-		JANUS_LOG(LOG_WARN, "No destination file %s??\n", destination);
+	if(use_stdout) {
+		fflush(outfile);
 	} else {
-		fseek(outfile, 0L, SEEK_END);
-		size_t fsize = ftell(outfile);
-		fseek(outfile, 0L, SEEK_SET);
-		JANUS_LOG(LOG_INFO, "%s is %zu bytes\n", destination, fsize);
 		fclose(outfile);
+		outfile = fopen(destination, "rb");
+		if(outfile == NULL) {
+			JANUS_LOG(LOG_WARN, "No destination file %s??\n", destination);
+		} else {
+			fseek(outfile, 0L, SEEK_END);
+			size_t fsize = ftell(outfile);
+			fseek(outfile, 0L, SEEK_SET);
+			JANUS_LOG(LOG_INFO, "%s is %zu bytes\n", destination, fsize);
+			fclose(outfile);
+		}
 	}
 
 	g_option_context_free(opts);
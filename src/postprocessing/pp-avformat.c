@@ -77,6 +77,46 @@ AVStream *janus_pp_new_audio_avstream(AVFormatContext *fctx, int codec_id, int s
 	return st;
 }
 
+int janus_pp_write_silence_run(AVFormatContext *fctx, int stream_index, uint8_t *data, int size,
+		int64_t start_ts, int count, int duration, AVRational timebase) {
+	if(fctx == NULL || data == NULL || count < 1)
+		return 0;
+#ifdef FF_API_INIT_PACKET
+	AVPacket *pkt = av_packet_alloc();
+#else
+	AVPacket apkt = { 0 }, *pkt = &apkt;
+#endif
+	/* All the packets in the run share the same payload and duration, so we
+	 * just bump the timestamps as we write them one after the other */
+	int written = 0, errors = 0, res = 0;
+	int64_t ts = start_ts;
+	while(written < count) {
+#ifdef FF_API_INIT_PACKET
+		av_packet_unref(pkt);
+#endif
+		pkt->stream_index = stream_index;
+		pkt->data = data;
+		pkt->size = size;
+		pkt->pts = pkt->dts = av_rescale_q(ts, timebase, fctx->streams[stream_index]->time_base);
+		pkt->duration = duration;
+		res = av_write_frame(fctx, pkt);
+		if(res < 0) {
+			/* Only log the first error: a long run would flood the output */
+			if(errors == 0) {
+				JANUS_LOG(LOG_ERR, "Error writing silence frame to file... (error %d, %s)\n",
+					res, av_err2str(res));
+			}
+			errors++;
+		}
+		ts += duration;
+		written++;
+	}
+#ifdef FF_API_INIT_PACKET
+	av_packet_free(&pkt);
+#endif
+	return written - errors;
+}
+
 AVStream *janus_pp_new_video_avstream(AVFormatContext *fctx, int codec_id, int width, int height) {
 	AVStream *st = avformat_new_stream(fctx, NULL);
 	if(!st)
@@ -52,5 +52,11 @@ AVFormatContext *janus_pp_create_avformatcontext(const char *format, const char
 AVStream *janus_pp_new_video_avstream(AVFormatContext *fctx, int codec_id, int width, int height);
 AVStream *janus_pp_new_audio_avstream(AVFormatContext *fctx, int codec_id, int samplerate, int channels, const uint8_t *extradata, int size);
 
+/* Write a run of identical packets (e.g., precomputed silence frames used to
+ * fill a timestamp gap), starting at start_ts and spaced by their duration:
+ * returns the number of packets successfully written */
+int janus_pp_write_silence_run(AVFormatContext *fctx, int stream_index, uint8_t *data, int size,
+	int64_t start_ts, int count, int duration, AVRational timebase);
+
 
 #endif
@@ -0,0 +1,105 @@
+/*! \file    pp-index.c
+ * \author   Lorenzo Miniero <lorenzo@meetecho.com>
+ * \copyright GNU General Public License v3
+ * \brief    Helper code to parse the .mjr frame index footer
+ * \details  Recent versions of the Janus recorder append an optional
+ * frame index to .mjr files, when a recording is closed, listing the
+ * offset, timestamp and keyframe flag of each saved frame: this code
+ * checks whether a recording ends with such a footer, and parses it,
+ * so that the post-processing tools can locate all frames right away,
+ * rather than scanning the whole file first (which can take a while,
+ * for long recordings). Recordings saved by older versions of Janus,
+ * or interrupted before the footer could be written, simply don't
+ * have an index, in which case the tools fall back to scanning.
+ *
+ * \ingroup postprocessing
+ * \ref postprocessing
+ */
+
+#include <arpa/inet.h>
+#include <string.h>
+
+#include "pp-index.h"
+#include "../debug.h"
+#include "../utils.h"
+
+/* The index is made of one or more chunks of 16-byte entries (offset[8],
+ * time[4], length[2], flags[1], reserved[1]), framed the same way as the
+ * info header ("MJRIDX01" + length) so that legacy parsers just skip them,
+ * followed by a fixed-size trailer ("MJRIDX00" + length + index offset[8]
+ * + frame count[4]) at the very end of the file */
+static const char *index_header = "MJRIDX01";
+static const char *index_trailer = "MJRIDX00";
+#define JANUS_PP_INDEX_ENTRY	16
+#define JANUS_PP_INDEX_TRAILER	(8 + sizeof(uint16_t) + sizeof(guint64) + sizeof(uint32_t))
+
+janus_pp_index_entry *janus_pp_index_parse(FILE *file, long fsize, uint32_t *count) {
+	if(file == NULL || count == NULL || fsize < (long)JANUS_PP_INDEX_TRAILER)
+		return NULL;
+	/* The last bytes of an indexed recording are a fixed-size trailer
+	 * pointing back at where the index chunks start */
+	char trailer[JANUS_PP_INDEX_TRAILER];
+	fseek(file, fsize - (long)sizeof(trailer), SEEK_SET);
+	if(fread(trailer, sizeof(char), sizeof(trailer), file) != sizeof(trailer))
+		return NULL;
+	if(memcmp(trailer, index_trailer, 8) != 0) {
+		/* No index footer, the recording will need to be scanned */
+		return NULL;
+	}
+	uint16_t tlen = 0;
+	memcpy(&tlen, trailer+8, sizeof(uint16_t));
+	if(ntohs(tlen) != sizeof(guint64) + sizeof(uint32_t))
+		return NULL;
+	guint64 ioffset = 0;
+	memcpy(&ioffset, trailer+10, sizeof(guint64));
+	ioffset = ntohll(ioffset);
+	uint32_t frames = 0;
+	memcpy(&frames, trailer+18, sizeof(uint32_t));
+	frames = ntohl(frames);
+	if(frames == 0 || ioffset >= (guint64)fsize ||
+			(guint64)frames * JANUS_PP_INDEX_ENTRY > (guint64)fsize)
+		return NULL;
+	/* Now parse the index chunks themselves */
+	janus_pp_index_entry *index = g_malloc(frames * sizeof(janus_pp_index_entry));
+	char *chunk = g_malloc(0xFFFF);
+	long offset = (long)ioffset;
+	uint32_t parsed = 0;
+	uint16_t clen = 0, i = 0;
+	while(parsed < frames && offset < fsize - (long)JANUS_PP_INDEX_TRAILER) {
+		/* Read the chunk header */
+		fseek(file, offset, SEEK_SET);
+		if(fread(chunk, sizeof(char), 10, file) != 10 || memcmp(chunk, index_header, 8) != 0)
+			break;
+		memcpy(&clen, chunk+8, sizeof(uint16_t));
+		clen = ntohs(clen);
+		if(clen == 0 || (clen % JANUS_PP_INDEX_ENTRY) != 0 ||
+				fread(chunk, sizeof(char), clen, file) != clen)
+			break;
+		offset += 10 + clen;
+		/* Traverse the entries in this chunk */
+		for(i = 0; i < clen/JANUS_PP_INDEX_ENTRY && parsed < frames; i++) {
+			char *entry = chunk + i*JANUS_PP_INDEX_ENTRY;
+			guint64 foffset = 0;
+			memcpy(&foffset, entry, sizeof(guint64));
+			index[parsed].offset = (long)ntohll(foffset);
+			uint32_t ftime = 0;
+			memcpy(&ftime, entry+8, sizeof(uint32_t));
+			index[parsed].time = ntohl(ftime);
+			uint16_t flen = 0;
+			memcpy(&flen, entry+12, sizeof(uint16_t));
+			index[parsed].len = ntohs(flen);
+			index[parsed].keyframe = (*(entry+14) & 0x01);
+			parsed++;
+		}
+	}
+	g_free(chunk);
+	if(parsed != frames) {
+		/* Truncated or corrupted index, better to scan the file instead */
+		JANUS_LOG(LOG_WARN, "Invalid frame index footer (%"SCNu32" != %"SCNu32" frames), ignoring it...\n",
+			parsed, frames);
+		g_free(index);
+		return NULL;
+	}
+	*count = frames;
+	return index;
+}
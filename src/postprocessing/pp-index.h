@@ -0,0 +1,47 @@
+/*! \file    pp-index.h
+ * \author   Lorenzo Miniero <lorenzo@meetecho.com>
+ * \copyright GNU General Public License v3
+ * \brief    Helper code to parse the .mjr frame index footer (headers)
+ * \details  Recent versions of the Janus recorder append an optional
+ * frame index to .mjr files, when a recording is closed, listing the
+ * offset, timestamp and keyframe flag of each saved frame: this code
+ * checks whether a recording ends with such a footer, and parses it,
+ * so that the post-processing tools can locate all frames right away,
+ * rather than scanning the whole file first (which can take a while,
+ * for long recordings). Recordings saved by older versions of Janus,
+ * or interrupted before the footer could be written, simply don't
+ * have an index, in which case the tools fall back to scanning.
+ *
+ * \ingroup postprocessing
+ * \ref postprocessing
+ */
+
+#ifndef JANUS_PP_INDEX
+#define JANUS_PP_INDEX
+
+#include <inttypes.h>
+#include <stdio.h>
+
+#include <glib.h>
+
+/*! \brief Helper struct to address a single frame in the recording */
+typedef struct janus_pp_index_entry {
+	/*! \brief Offset of the frame header in the file */
+	long offset;
+	/*! \brief Time the frame was saved at, in milliseconds since the recording started */
+	uint32_t time;
+	/*! \brief Length of the frame data */
+	uint16_t len;
+	/*! \brief Whether the frame is a video keyframe */
+	gboolean keyframe;
+} janus_pp_index_entry;
+
+/*! \brief Check if a recording ends with a frame index footer, and parse it
+ * @param[in] file The .mjr file to look for the footer in
+ * @param[in] fsize Size of the file, in bytes
+ * @param[out] count Number of frames in the returned index
+ * @returns An array of \c count index entries, if a valid footer was found,
+ * NULL otherwise (e.g., a legacy recording, which will need to be scanned) */
+janus_pp_index_entry *janus_pp_index_parse(FILE *file, long fsize, uint32_t *count);
+
+#endif
@@ -277,29 +277,23 @@ int janus_pp_opus_process(FILE *file, janus_pp_frame_packet *list, gboolean rest
 			/* use ts differ to insert silence packet */
 			pos = (tmp->prev->ts - list->ts) / 48 / 20 + 1;
 			JANUS_LOG(LOG_WARN, "[FILL] pos: %06"SCNu64", writing silences (count=%d)\n", pos, silence_count);
-			int i=0;
 			pos = tmp->prev->ts - list->ts;
-			for(i=0; i<silence_count; i++) {
-				pos += OPUS_PACKET_DURATION;
-				if(tmp->next != NULL && pos >= (tmp->next->ts - list->ts)) {
-					JANUS_LOG(LOG_WARN, "[SKIP] pos: %06" SCNu64 ", skipping remaining silence\n", pos / 48 / 20 + 1);
-					break;
-				}
-#ifdef FF_API_INIT_PACKET
-				av_packet_unref(pkt);
-#endif
-				pkt->stream_index = 0;
-				pkt->data = opus_silence;
-				pkt->size = sizeof(opus_silence);
-				pkt->pts = pkt->dts = av_rescale_q(pos, timebase, fctx->streams[0]->time_base);
-				pkt->duration = OPUS_PACKET_DURATION;
-
-				int res = av_write_frame(fctx, pkt);
-				if(res < 0) {
-					JANUS_LOG(LOG_ERR, "Error writing audio frame to file... (error %d, %s)\n",
-						res, av_err2str(res));
+			/* Cap the run length so that it doesn't overlap the packet that follows */
+			if(tmp->next != NULL) {
+				int64_t max_frames = ((int64_t)(tmp->next->ts - list->ts) - (int64_t)pos - 1) / OPUS_PACKET_DURATION;
+				if(max_frames < 0)
+					max_frames = 0;
+				if(silence_count > max_frames) {
+					JANUS_LOG(LOG_WARN, "[SKIP] pos: %06" SCNu64 ", skipping remaining silence\n",
+						(pos + (max_frames+1)*OPUS_PACKET_DURATION) / 48 / 20 + 1);
+					silence_count = (int)max_frames;
 				}
 			}
+			if(silence_count > 0) {
+				/* Write the whole run of precomputed silence frames in one go */
+				janus_pp_write_silence_run(fctx, 0, opus_silence, sizeof(opus_silence),
+					pos + OPUS_PACKET_DURATION, silence_count, OPUS_PACKET_DURATION, timebase);
+			}
 		}
 		if(tmp->drop) {
 			/* We marked this packet as one to drop, before */
@@ -20,13 +20,16 @@
 #include <arpa/inet.h>
 #include <sys/stat.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <libgen.h>
+#include <unistd.h>
 
 #include <glib.h>
 #include <jansson.h>
 
 #include "record.h"
 #include "debug.h"
+#include "lfq.h"
 #include "utils.h"
 
 
@@ -34,12 +37,367 @@
 static const char *header = "MJR00002";
 /* Frame header in the structured recording */
 static const char *frame_header = "MEET";
+/* Optional frame index, appended as a footer when a recording is closed
+ * so that the post-processing tools can locate all frames without having
+ * to scan the whole file first: it's made of one or more chunks of 16-byte
+ * entries (offset[8], time[4], length[2], flags[1], reserved[1]), framed
+ * the same way as the info header ("MJRIDX01" + length) so that legacy
+ * parsers just skip them, followed by a fixed-size trailer ("MJRIDX00" +
+ * length + index offset[8] + frame count[4]) at the very end of the file */
+static const char *index_header = "MJRIDX01";
+static const char *index_trailer = "MJRIDX00";
+#define JANUS_RECORDER_INDEX_ENTRY		16
+#define JANUS_RECORDER_INDEX_CHUNK		(4095*JANUS_RECORDER_INDEX_ENTRY)
+#define JANUS_RECORDER_INDEX_TRAILER	(8 + sizeof(uint16_t) + sizeof(guint64) + sizeof(uint32_t))
 
 /* Whether the filenames should have a temporary extension, while saving, or not (default=false) */
 static gboolean rec_tempname = FALSE;
 /* Extension to add in case tempnames is true (default="tmp" --> ".tmp") */
 static char *rec_tempext = NULL;
 
+/* Size of the user-space buffer file writes go through, to reduce IOPS */
+#define JANUS_RECORDER_IOBUF_SIZE	(512*1024)
+/* How many bytes we write before flushing to disk, to smooth the I/O out */
+#define JANUS_RECORDER_SYNC_BYTES	(4*1024*1024)
+/* Size of the extents recording files are preallocated in, if configured:
+ * growing the file in large extents, rather than write by write, keeps it
+ * from fragmenting when many streams are recorded concurrently (files are
+ * truncated back to their real size when the recording is closed) */
+static guint64 rec_prealloc_size = 0;
+/* Whether recordings should be rolled to a new segment file every N
+ * seconds and/or bytes: segments are cut at keyframe boundaries for
+ * video, and each finished segment is immediately renamed to its final
+ * name, so that it can be post-processed while the recording goes on */
+static gint64 rec_segment_time = 0;
+static guint64 rec_segment_bytes = 0;
+
+void janus_recorder_set_prealloc_size(guint64 bytes) {
+	rec_prealloc_size = bytes;
+	if(rec_prealloc_size > 0) {
+		JANUS_LOG(LOG_INFO, "Preallocating recording files in extents of %"SCNu64" bytes\n", rec_prealloc_size);
+	}
+}
+
+void janus_recorder_set_segmentation(guint seconds, guint64 bytes) {
+	rec_segment_time = (gint64)seconds * G_USEC_PER_SEC;
+	rec_segment_bytes = bytes;
+	if(rec_segment_time > 0 || rec_segment_bytes > 0) {
+		JANUS_LOG(LOG_INFO, "Segmenting recording files (every %u seconds and/or %"SCNu64" bytes)\n",
+			seconds, rec_segment_bytes);
+	}
+}
+
+/* Asynchronous writer: janus_recorder_save_frame doesn't touch the disk
+ * itself, as slow storage (e.g., NFS) would stall the media thread along
+ * with it; frames are serialized and queued instead, and a single writer
+ * thread, shared across all recorders, flushes each with one write. The
+ * backlog is bounded: when the writer falls too far behind, new frames
+ * are dropped and accounted, rather than piling up in memory */
+#define JANUS_RECORDER_MAX_PENDING	(32*1024*1024)
+typedef struct janus_recorder_frame {
+	janus_recorder *recorder;	/* Recorder this frame belongs to (we keep a reference) */
+	char *data;					/* Serialized bytes to append to the file, frame header included */
+	int length;					/* Size of the serialized frame */
+	int hskip;					/* Offset of the frame header in the serialized bytes (e.g., after the info header) */
+	guint32 time;				/* Time the frame was saved at, in milliseconds since the recording started */
+	guint16 mjrlen;				/* Length of the frame data, as saved in the frame header */
+	guint8 keyframe;			/* Whether this is a video keyframe */
+	gboolean roll;				/* Whether this is a request to roll to a new segment (data is the new filename) */
+} janus_recorder_frame;
+static janus_lfq *rec_writer_queue = NULL;
+static GThread *rec_writer_thread = NULL;
+static volatile gint rec_writer_stopping = 0;
+static volatile gint rec_pending_bytes = 0;
+static volatile gint rec_dropped_frames = 0;
+
+/* Static helper to append a serialized frame to a recorder's file */
+static void janus_recorder_write(janus_recorder *recorder, char *data, int length) {
+	int temp = 0, tot = length;
+	while(tot > 0) {
+		temp = fwrite(data+length-tot, sizeof(char), tot, recorder->file);
+		if(temp <= 0) {
+			JANUS_LOG(LOG_ERR, "Error saving frame...\n");
+			return;
+		}
+		tot -= temp;
+	}
+	recorder->written += length;
+	recorder->unsynced += length;
+#ifdef __linux__
+	if(recorder->allocated > 0 && recorder->written + JANUS_RECORDER_IOBUF_SIZE > recorder->allocated) {
+		/* We're about to outgrow the preallocated extent, extend it */
+		if(posix_fallocate(fileno(recorder->file), recorder->allocated, rec_prealloc_size) == 0)
+			recorder->allocated += rec_prealloc_size;
+	}
+	if(recorder->unsynced >= JANUS_RECORDER_SYNC_BYTES) {
+		/* Flush what we have so far, so that dirty pages don't pile up */
+		fflush(recorder->file);
+		fdatasync(fileno(recorder->file));
+		recorder->unsynced = 0;
+	}
+#endif
+}
+
+/* Static helper to add a frame to the index we'll append on close */
+static void janus_recorder_index_frame(janus_recorder *recorder,
+		guint64 offset, guint32 time, guint16 length, guint8 keyframe) {
+	if(recorder->index == NULL)
+		recorder->index = g_byte_array_new();
+	guint8 entry[JANUS_RECORDER_INDEX_ENTRY];
+	guint64 foffset = htonll(offset);
+	memcpy(entry, &foffset, sizeof(guint64));
+	uint32_t ftime = htonl(time);
+	memcpy(entry+8, &ftime, sizeof(uint32_t));
+	uint16_t flen = htons(length);
+	memcpy(entry+12, &flen, sizeof(uint16_t));
+	entry[14] = keyframe;
+	entry[15] = 0;
+	g_byte_array_append(recorder->index, entry, JANUS_RECORDER_INDEX_ENTRY);
+}
+
+/* Static helper to generate the JSON formatted info header */
+static gchar *janus_recorder_info_header(janus_recorder *recorder) {
+	json_t *info = json_object();
+	/* FIXME Codecs should be configurable in the future */
+	const char *type = NULL;
+	if(recorder->type == JANUS_RECORDER_AUDIO)
+		type = "a";
+	else if(recorder->type == JANUS_RECORDER_VIDEO)
+		type = "v";
+	else if(recorder->type == JANUS_RECORDER_DATA)
+		type = "d";
+	json_object_set_new(info, "t", json_string(type));								/* Audio/Video/Data */
+	json_object_set_new(info, "c", json_string(recorder->codec));					/* Media codec */
+	if(recorder->fmtp)
+		json_object_set_new(info, "f", json_string(recorder->fmtp));				/* Codec-specific info */
+	if(recorder->description)
+		json_object_set_new(info, "d", json_string(recorder->description));		/* Stream description */
+	if(recorder->extensions) {
+		/* Add the extmaps to the JSON object */
+		json_t *extmaps = NULL;
+		GHashTableIter iter;
+		gpointer key, value;
+		g_hash_table_iter_init(&iter, recorder->extensions);
+		while(g_hash_table_iter_next(&iter, &key, &value)) {
+			int id = GPOINTER_TO_INT(key);
+			char *extmap = (char *)value;
+			if(id > 0 && id < 16 && extmap != NULL) {
+				if(extmaps == NULL)
+					extmaps = json_object();
+				char id_str[3];
+				g_snprintf(id_str, sizeof(id_str), "%d", id);
+				json_object_set_new(extmaps, id_str, json_string(extmap));
+			}
+		}
+		if(extmaps != NULL)
+			json_object_set_new(info, "x", extmaps);
+	}
+	json_object_set_new(info, "s", json_integer(recorder->created));				/* Created time */
+	json_object_set_new(info, "u", json_integer(janus_get_real_time()));			/* First frame written time */
+	/* If this is audio and using RED, take note of the payload type */
+	if(recorder->type == JANUS_RECORDER_AUDIO && recorder->opusred_pt > 0)
+		json_object_set_new(info, "or", json_integer(recorder->opusred_pt));
+	/* If media will be end-to-end encrypted, mark it in the recording header */
+	if(recorder->encrypted)
+		json_object_set_new(info, "e", json_true());
+	/* If this is a segmented recording, add the segment number, so that the
+	 * different segments of the same recording can be linked back together */
+	if(recorder->base != NULL)
+		json_object_set_new(info, "sg", json_integer(recorder->seg));
+	gchar *info_text = json_dumps(info, JSON_PRESERVE_ORDER);
+	json_decref(info);
+	return info_text;
+}
+
+/* Static helper to open the recorder file and write the .mjr file header
+ * (called both when creating a recorder and when rolling to a new segment) */
+static int janus_recorder_open_file(janus_recorder *recorder) {
+	char path[1024];
+	memset(path, 0, 1024);
+	if(recorder->dir != NULL) {
+		g_snprintf(path, 1024, "%s/%s", recorder->dir, recorder->filename);
+	} else {
+		g_snprintf(path, 1024, "%s", recorder->filename);
+	}
+	/* Make sure folder to save to is not protected */
+	if(janus_is_folder_protected(path)) {
+		JANUS_LOG(LOG_ERR, "Target recording path '%s' is in protected folder...\n", path);
+		return -1;
+	}
+	recorder->file = fopen(path, "wb");
+	if(recorder->file == NULL) {
+		JANUS_LOG(LOG_ERR, "fopen error: %d\n", errno);
+		return -1;
+	}
+	/* Send the file writes through a large user-space buffer, to reduce IOPS */
+	if(recorder->iobuf == NULL)
+		recorder->iobuf = g_malloc(JANUS_RECORDER_IOBUF_SIZE);
+	setvbuf(recorder->file, recorder->iobuf, _IOFBF, JANUS_RECORDER_IOBUF_SIZE);
+	recorder->allocated = 0;
+#ifdef __linux__
+	if(rec_prealloc_size > 0) {
+		/* Preallocate an initial extent, to keep the file from fragmenting */
+		int fres = posix_fallocate(fileno(recorder->file), 0, rec_prealloc_size);
+		if(fres == 0) {
+			recorder->allocated = rec_prealloc_size;
+		} else {
+			JANUS_LOG(LOG_WARN, "Error preallocating the recording file... %d (%s)\n", fres, g_strerror(fres));
+		}
+	}
+#endif
+	/* Write the first part of the header */
+	size_t res = fwrite(header, sizeof(char), strlen(header), recorder->file);
+	if(res != strlen(header)) {
+		JANUS_LOG(LOG_ERR, "Couldn't write .mjr header (%zu != %zu, %s)\n",
+			res, strlen(header), g_strerror(errno));
+		return -1;
+	}
+	recorder->written = strlen(header);
+	recorder->unsynced = 0;
+	return 0;
+}
+
+/* Static helper to finalize the recorder file, called with the mutex held
+ * (writes the frame index footer, truncates any preallocated space that's
+ * left, and gets rid of the temporary extension, if one is in use) */
+static void janus_recorder_close_file(janus_recorder *recorder) {
+	if(recorder->file && recorder->index != NULL && recorder->index->len > 0) {
+		/* Append the frame index as a footer, so that the post-processing
+		 * tools can locate all frames without scanning the whole file */
+		guint64 index_offset = recorder->written;
+		uint32_t frames = recorder->index->len / JANUS_RECORDER_INDEX_ENTRY;
+		char *chunk = g_malloc(8 + sizeof(uint16_t) + JANUS_RECORDER_INDEX_CHUNK);
+		guint queued = 0, clen = 0;
+		while(queued < recorder->index->len) {
+			clen = recorder->index->len - queued;
+			if(clen > JANUS_RECORDER_INDEX_CHUNK)
+				clen = JANUS_RECORDER_INDEX_CHUNK;
+			memcpy(chunk, index_header, 8);
+			uint16_t chunk_bytes = htons(clen);
+			memcpy(chunk+8, &chunk_bytes, sizeof(uint16_t));
+			memcpy(chunk+10, recorder->index->data + queued, clen);
+			janus_recorder_write(recorder, chunk, 10 + clen);
+			queued += clen;
+		}
+		/* The fixed-size trailer at the very end points back at the index */
+		memcpy(chunk, index_trailer, 8);
+		uint16_t trailer_bytes = htons(sizeof(guint64) + sizeof(uint32_t));
+		memcpy(chunk+8, &trailer_bytes, sizeof(uint16_t));
+		guint64 ioffset = htonll(index_offset);
+		memcpy(chunk+10, &ioffset, sizeof(guint64));
+		uint32_t fcount = htonl(frames);
+		memcpy(chunk+18, &fcount, sizeof(uint32_t));
+		janus_recorder_write(recorder, chunk, JANUS_RECORDER_INDEX_TRAILER);
+		g_free(chunk);
+	}
+	if(recorder->index != NULL) {
+		g_byte_array_free(recorder->index, TRUE);
+		recorder->index = NULL;
+	}
+	if(recorder->file) {
+		fflush(recorder->file);
+		/* If we preallocated more space than we wrote, truncate to the real size */
+		if(recorder->allocated > recorder->written &&
+				ftruncate(fileno(recorder->file), recorder->written) < 0) {
+			JANUS_LOG(LOG_WARN, "Error truncating the recording file... %d (%s)\n", errno, g_strerror(errno));
+		}
+		fseek(recorder->file, 0L, SEEK_END);
+		size_t fsize = ftell(recorder->file);
+		fseek(recorder->file, 0L, SEEK_SET);
+		JANUS_LOG(LOG_INFO, "File is %zu bytes: %s\n", fsize, recorder->filename);
+	}
+	if(rec_tempname) {
+		/* We need to rename the file, to remove the temporary extension */
+		char newname[1024];
+		memset(newname, 0, 1024);
+		g_snprintf(newname, strlen(recorder->filename)-strlen(rec_tempext), "%s", recorder->filename);
+		char oldpath[1024];
+		memset(oldpath, 0, 1024);
+		char newpath[1024];
+		memset(newpath, 0, 1024);
+		if(recorder->dir) {
+			g_snprintf(newpath, 1024, "%s/%s", recorder->dir, newname);
+			g_snprintf(oldpath, 1024, "%s/%s", recorder->dir, recorder->filename);
+		} else {
+			g_snprintf(newpath, 1024, "%s", newname);
+			g_snprintf(oldpath, 1024, "%s", recorder->filename);
+		}
+		if(rename(oldpath, newpath) != 0) {
+			JANUS_LOG(LOG_ERR, "Error renaming %s to %s...\n", recorder->filename, newname);
+		} else {
+			JANUS_LOG(LOG_INFO, "Recording renamed: %s\n", newname);
+			g_free(recorder->filename);
+			recorder->filename = g_strdup(newname);
+		}
+	}
+}
+
+/* Static helper to roll a segmented recording to a new file, called with
+ * the mutex held: the current segment is finalized (and so can be
+ * post-processed right away), and the next one is started, with its own
+ * .mjr and info headers */
+static void janus_recorder_roll_file(janus_recorder *recorder, char *filename, guint seg) {
+	recorder->seg = seg;
+	/* Finalize the current segment */
+	janus_recorder_close_file(recorder);
+	if(recorder->file != NULL)
+		fclose(recorder->file);
+	recorder->file = NULL;
+	/* Move to the new one */
+	g_free(recorder->filename);
+	recorder->filename = g_strdup(filename);
+	if(janus_recorder_open_file(recorder) < 0) {
+		JANUS_LOG(LOG_ERR, "Error rolling recording to %s, stopping here...\n", filename);
+		if(recorder->file != NULL)
+			fclose(recorder->file);
+		recorder->file = NULL;
+		return;
+	}
+	/* Each segment starts with its own info header, so that it can be
+	 * processed on its own: the segment number in there (and the RTP
+	 * headers, which we never reset) link it to the other segments */
+	gchar *info_text = janus_recorder_info_header(recorder);
+	if(info_text != NULL) {
+		uint16_t info_bytes = htons(strlen(info_text));
+		janus_recorder_write(recorder, (char *)&info_bytes, sizeof(uint16_t));
+		janus_recorder_write(recorder, info_text, strlen(info_text));
+		free(info_text);
+	}
+}
+
+/* Loop of the shared writer thread */
+static void *janus_recorder_writer_thread(void *data) {
+	JANUS_LOG(LOG_VERB, "Joining recorder writer thread...\n");
+	janus_recorder_frame *frame = NULL;
+	while(!g_atomic_int_get(&rec_writer_stopping) || janus_lfq_length(rec_writer_queue) > 0) {
+		frame = (janus_recorder_frame *)janus_lfq_try_pop(rec_writer_queue);
+		if(frame == NULL) {
+			g_usleep(5000);
+			continue;
+		}
+		janus_recorder *recorder = frame->recorder;
+		janus_mutex_lock_nodebug(&recorder->mutex);
+		if(frame->roll) {
+			/* Not media, but a request to roll to a new segment file */
+			if(recorder->file != NULL)
+				janus_recorder_roll_file(recorder, frame->data, frame->time);
+		} else if(recorder->file != NULL) {
+			/* Index the frame (only now do we know its offset in the file) */
+			janus_recorder_index_frame(recorder, recorder->written + frame->hskip,
+				frame->time, frame->mjrlen, frame->keyframe);
+			janus_recorder_write(recorder, frame->data, frame->length);
+		}
+		janus_mutex_unlock_nodebug(&recorder->mutex);
+		g_atomic_int_add(&rec_pending_bytes, -frame->length);
+		g_atomic_int_add(&recorder->pending, -1);
+		janus_refcount_decrease(&recorder->ref);
+		g_free(frame->data);
+		g_free(frame);
+	}
+	JANUS_LOG(LOG_VERB, "Leaving recorder writer thread...\n");
+	return NULL;
+}
+
 void janus_recorder_init(gboolean tempnames, const char *extension) {
 	JANUS_LOG(LOG_INFO, "Initializing recorder code\n");
 	if(tempnames) {
@@ -52,11 +410,42 @@ void janus_recorder_init(gboolean tempnames, const char *extension) {
 			JANUS_LOG(LOG_INFO, "  -- Using temporary extension .%s\n", rec_tempext);
 		}
 	}
+	/* Spawn the shared thread recorded frames are flushed to disk from */
+	g_atomic_int_set(&rec_writer_stopping, 0);
+	rec_writer_queue = janus_lfq_new(1024);
+	GError *error = NULL;
+	rec_writer_thread = g_thread_try_new("rec writer", janus_recorder_writer_thread, NULL, &error);
+	if(error != NULL) {
+		/* Not fatal: we'll just write frames synchronously, as we used to */
+		JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the recorder writer thread...\n",
+			error->code, error->message ? error->message : "??");
+		g_error_free(error);
+		janus_lfq_destroy(rec_writer_queue);
+		rec_writer_queue = NULL;
+	}
 }
 
 void janus_recorder_deinit(void) {
 	rec_tempname = FALSE;
 	g_free(rec_tempext);
+	/* Stop the writer thread, which will drain its backlog before leaving */
+	if(rec_writer_thread != NULL) {
+		g_atomic_int_set(&rec_writer_stopping, 1);
+		g_thread_join(rec_writer_thread);
+		rec_writer_thread = NULL;
+	}
+	if(rec_writer_queue != NULL) {
+		janus_lfq_destroy(rec_writer_queue);
+		rec_writer_queue = NULL;
+	}
+}
+
+guint janus_recorder_pending_bytes(void) {
+	return (guint)g_atomic_int_get(&rec_pending_bytes);
+}
+
+guint janus_recorder_dropped_frames(void) {
+	return (guint)g_atomic_int_get(&rec_dropped_frames);
 }
 
 static void janus_recorder_free(const janus_refcount *recorder_ref) {
@@ -67,9 +456,13 @@ static void janus_recorder_free(const janus_refcount *recorder_ref) {
 	recorder->dir = NULL;
 	g_free(recorder->filename);
 	recorder->filename = NULL;
+	g_free(recorder->base);
+	recorder->base = NULL;
 	if(recorder->file != NULL)
 		fclose(recorder->file);
 	recorder->file = NULL;
+	g_free(recorder->iobuf);
+	recorder->iobuf = NULL;
 	g_free(recorder->codec);
 	recorder->codec = NULL;
 	g_free(recorder->fmtp);
@@ -78,6 +471,8 @@ static void janus_recorder_free(const janus_refcount *recorder_ref) {
 	recorder->description = NULL;
 	if(recorder->extensions != NULL)
 		g_hash_table_destroy(recorder->extensions);
+	if(recorder->index != NULL)
+		g_byte_array_free(recorder->index, TRUE);
 	janus_mutex_destroy(&recorder->mutex);
 	g_free(recorder);
 }
@@ -180,68 +575,41 @@ janus_recorder *janus_recorder_create_full(const char *dir, const char *codec, c
 			}
 		}
 	}
-	char newname[1024];
-	memset(newname, 0, 1024);
+	char base[1024];
+	memset(base, 0, 1024);
 	if(rec_file == NULL) {
 		/* Choose a random username */
+		g_snprintf(base, 1024, "janus-recording-%"SCNu32, janus_random_uint32());
+	} else {
+		g_snprintf(base, 1024, "%s", rec_file);
+	}
+	char newname[1024];
+	memset(newname, 0, 1024);
+	if(rec_segment_time > 0 || rec_segment_bytes > 0) {
+		/* Segmented recording: the files share the base name, plus a progressive segment number */
+		rc->base = g_strdup(base);
 		if(!rec_tempname) {
 			/* Use .mjr as an extension right away */
-			g_snprintf(newname, 1024, "janus-recording-%"SCNu32".mjr", janus_random_uint32());
+			g_snprintf(newname, 1024, "%s-%04u.mjr", base, rc->seg);
 		} else {
 			/* Append the temporary extension to .mjr, we'll rename when closing */
-			g_snprintf(newname, 1024, "janus-recording-%"SCNu32".mjr.%s", janus_random_uint32(), rec_tempext);
+			g_snprintf(newname, 1024, "%s-%04u.mjr.%s", base, rc->seg, rec_tempext);
 		}
 	} else {
-		/* Just append the extension */
 		if(!rec_tempname) {
 			/* Use .mjr as an extension right away */
-			g_snprintf(newname, 1024, "%s.mjr", rec_file);
+			g_snprintf(newname, 1024, "%s.mjr", base);
 		} else {
 			/* Append the temporary extension to .mjr, we'll rename when closing */
-			g_snprintf(newname, 1024, "%s.mjr.%s", rec_file, rec_tempext);
-		}
-	}
-	/* Try opening the file now */
-	if(rec_dir == NULL) {
-		/* Make sure folder to save to is not protected */
-		if(janus_is_folder_protected(newname)) {
-			JANUS_LOG(LOG_ERR, "Target recording path '%s' is in protected folder...\n", newname);
-			janus_recorder_destroy(rc);
-			g_free(copy_for_parent);
-			g_free(copy_for_base);
-			return NULL;
-		}
-		rc->file = fopen(newname, "wb");
-	} else {
-		char path[1024];
-		memset(path, 0, 1024);
-		g_snprintf(path, 1024, "%s/%s", rec_dir, newname);
-		/* Make sure folder to save to is not protected */
-		if(janus_is_folder_protected(path)) {
-			JANUS_LOG(LOG_ERR, "Target recording path '%s' is in protected folder...\n", path);
-			janus_recorder_destroy(rc);
-			g_free(copy_for_parent);
-			g_free(copy_for_base);
-			return NULL;
+			g_snprintf(newname, 1024, "%s.mjr.%s", base, rec_tempext);
 		}
-		rc->file = fopen(path, "wb");
-	}
-	if(rc->file == NULL) {
-		JANUS_LOG(LOG_ERR, "fopen error: %d\n", errno);
-		janus_recorder_destroy(rc);
-		g_free(copy_for_parent);
-		g_free(copy_for_base);
-		return NULL;
 	}
 	if(rec_dir)
 		rc->dir = g_strdup(rec_dir);
 	rc->filename = g_strdup(newname);
 	rc->type = type;
-	/* Write the first part of the header */
-	size_t res = fwrite(header, sizeof(char), strlen(header), rc->file);
-	if(res != strlen(header)) {
-		JANUS_LOG(LOG_ERR, "Couldn't write .mjr header (%zu != %zu, %s)\n",
-			res, strlen(header), g_strerror(errno));
+	/* Try opening the file now, and write the .mjr header */
+	if(janus_recorder_open_file(rc) < 0) {
 		janus_recorder_destroy(rc);
 		g_free(copy_for_parent);
 		g_free(copy_for_base);
@@ -349,134 +717,148 @@ int janus_recorder_save_frame(janus_recorder *recorder, char *buffer, uint lengt
 		return -5;
 	}
 	gint64 now = janus_get_monotonic_time();
-	if(!g_atomic_int_get(&recorder->header)) {
-		/* Write info header as a JSON formatted info */
-		json_t *info = json_object();
-		/* FIXME Codecs should be configurable in the future */
-		const char *type = NULL;
-		if(recorder->type == JANUS_RECORDER_AUDIO)
-			type = "a";
-		else if(recorder->type == JANUS_RECORDER_VIDEO)
-			type = "v";
-		else if(recorder->type == JANUS_RECORDER_DATA)
-			type = "d";
-		json_object_set_new(info, "t", json_string(type));								/* Audio/Video/Data */
-		json_object_set_new(info, "c", json_string(recorder->codec));					/* Media codec */
-		if(recorder->fmtp)
-			json_object_set_new(info, "f", json_string(recorder->fmtp));				/* Codec-specific info */
-		if(recorder->description)
-			json_object_set_new(info, "d", json_string(recorder->description));		/* Stream description */
-		if(recorder->extensions) {
-			/* Add the extmaps to the JSON object */
-			json_t *extmaps = NULL;
-			GHashTableIter iter;
-			gpointer key, value;
-			g_hash_table_iter_init(&iter, recorder->extensions);
-			while(g_hash_table_iter_next(&iter, &key, &value)) {
-				int id = GPOINTER_TO_INT(key);
-				char *extmap = (char *)value;
-				if(id > 0 && id < 16 && extmap != NULL) {
-					if(extmaps == NULL)
-						extmaps = json_object();
-					char id_str[3];
-					g_snprintf(id_str, sizeof(id_str), "%d", id);
-					json_object_set_new(extmaps, id_str, json_string(extmap));
-				}
-			}
-			if(extmaps != NULL)
-				json_object_set_new(info, "x", extmaps);
+	/* If the writer thread is too far behind (stalled disk?), drop the
+	 * frame rather than letting the backlog grow unbounded in memory */
+	if(rec_writer_queue != NULL &&
+			g_atomic_int_get(&rec_pending_bytes) + (gint)length + 64 > JANUS_RECORDER_MAX_PENDING) {
+		g_atomic_int_inc(&recorder->dropped);
+		g_atomic_int_inc(&rec_dropped_frames);
+		janus_mutex_unlock_nodebug(&recorder->mutex);
+		return -6;
+	}
+	/* If this is video, check if it's a keyframe, both to flag it in the
+	 * frame index and to decide whether we can roll to a new segment */
+	guint8 keyframe = 0;
+	if(recorder->type == JANUS_RECORDER_VIDEO && !recorder->encrypted) {
+		int plen = 0;
+		char *payload = janus_rtp_payload(buffer, length, &plen);
+		if(payload != NULL && plen > 0) {
+			if(!strcasecmp(recorder->codec, "vp8"))
+				keyframe = janus_vp8_is_keyframe(payload, plen);
+			else if(!strcasecmp(recorder->codec, "vp9"))
+				keyframe = janus_vp9_is_keyframe(payload, plen);
+			else if(!strcasecmp(recorder->codec, "h264"))
+				keyframe = janus_h264_is_keyframe(payload, plen);
+			else if(!strcasecmp(recorder->codec, "av1"))
+				keyframe = janus_av1_is_keyframe(payload, plen);
+			else if(!strcasecmp(recorder->codec, "h265"))
+				keyframe = janus_h265_is_keyframe(payload, plen);
 		}
-		json_object_set_new(info, "s", json_integer(recorder->created));				/* Created time */
-		json_object_set_new(info, "u", json_integer(janus_get_real_time()));			/* First frame written time */
-		/* If this is audio and using RED, take note of the payload type */
-		if(recorder->type == JANUS_RECORDER_AUDIO && recorder->opusred_pt > 0)
-			json_object_set_new(info, "or", json_integer(recorder->opusred_pt));
-		/* If media will be end-to-end encrypted, mark it in the recording header */
-		if(recorder->encrypted)
-			json_object_set_new(info, "e", json_true());
-		gchar *info_text = json_dumps(info, JSON_PRESERVE_ORDER);
-		json_decref(info);
+	}
+	gchar *info_text = NULL;
+	if(!g_atomic_int_get(&recorder->header)) {
+		/* Generate the JSON formatted info header */
+		info_text = janus_recorder_info_header(recorder);
 		if(info_text == NULL) {
 			JANUS_LOG(LOG_ERR, "Error converting header to text...\n");
 			janus_mutex_unlock_nodebug(&recorder->mutex);
 			return -5;
 		}
-		uint16_t info_bytes = htons(strlen(info_text));
-		size_t res = fwrite(&info_bytes, sizeof(uint16_t), 1, recorder->file);
-		if(res != 1) {
-			JANUS_LOG(LOG_WARN, "Couldn't write size of JSON header in .mjr file (%zu != %zu, %s), expect issues post-processing\n",
-				res, sizeof(uint16_t), g_strerror(errno));
-		}
-		res = fwrite(info_text, sizeof(char), strlen(info_text), recorder->file);
-		if(res != strlen(info_text)) {
-			JANUS_LOG(LOG_WARN, "Couldn't write JSON header in .mjr file (%zu != %zu, %s), expect issues post-processing\n",
-				res, strlen(info_text), g_strerror(errno));
-		}
-		free(info_text);
 		/* Done */
 		recorder->started = now;
+		recorder->seg_started = now;
 		g_atomic_int_set(&recorder->header, 1);
+	} else if(recorder->base != NULL) {
+		/* This is a segmented recording: check if it's time to roll to a
+		 * new segment file (for video, only at a keyframe boundary, so
+		 * that each segment can be decoded on its own) */
+		if(((rec_segment_time > 0 && (now - recorder->seg_started) >= rec_segment_time) ||
+				(rec_segment_bytes > 0 && recorder->seg_bytes >= rec_segment_bytes)) &&
+				(recorder->type != JANUS_RECORDER_VIDEO || keyframe)) {
+			recorder->seg_started = now;
+			recorder->seg_bytes = 0;
+			char newname[1024];
+			memset(newname, 0, 1024);
+			if(!rec_tempname) {
+				g_snprintf(newname, 1024, "%s-%04u.mjr", recorder->base, recorder->seg+1);
+			} else {
+				g_snprintf(newname, 1024, "%s-%04u.mjr.%s", recorder->base, recorder->seg+1, rec_tempext);
+			}
+			if(rec_writer_queue != NULL) {
+				/* Queue the roll for the shared writer thread: this keeps it
+				 * ordered with the frames that are already in the backlog,
+				 * and so with the segment they belong to */
+				janus_recorder_frame *frame = g_malloc0(sizeof(janus_recorder_frame));
+				janus_refcount_increase(&recorder->ref);
+				frame->recorder = recorder;
+				frame->data = g_strdup(newname);
+				frame->time = recorder->seg+1;
+				frame->roll = TRUE;
+				g_atomic_int_inc(&recorder->pending);
+				janus_lfq_push(rec_writer_queue, frame);
+				recorder->seg++;
+			} else {
+				/* No writer thread, roll synchronously */
+				janus_recorder_roll_file(recorder, newname, recorder->seg+1);
+				if(recorder->file == NULL) {
+					/* We couldn't open the new segment file */
+					janus_mutex_unlock_nodebug(&recorder->mutex);
+					return -3;
+				}
+			}
+		}
 	}
-	/* Write frame header (fixed part[4], timestamp[4], length[2]) */
-	size_t res = fwrite(frame_header, sizeof(char), strlen(frame_header), recorder->file);
-	if(res != strlen(frame_header)) {
-		JANUS_LOG(LOG_WARN, "Couldn't write frame header in .mjr file (%zu != %zu, %s), expect issues post-processing\n",
-			res, strlen(frame_header), g_strerror(errno));
+	/* Serialize the whole frame (and the info header, the first time) in a
+	 * single buffer, so that it can be flushed to disk with a single write */
+	int flen = (info_text ? (int)(sizeof(uint16_t) + strlen(info_text)) : 0) +
+		strlen(frame_header) + sizeof(uint32_t) + sizeof(uint16_t) +
+		(recorder->type == JANUS_RECORDER_DATA ? sizeof(gint64) : 0) + length;
+	char *data = g_malloc(flen);
+	int offset = 0;
+	if(info_text != NULL) {
+		/* The JSON formatted info header goes first */
+		uint16_t info_bytes = htons(strlen(info_text));
+		memcpy(data, &info_bytes, sizeof(uint16_t));
+		offset += sizeof(uint16_t);
+		memcpy(data+offset, info_text, strlen(info_text));
+		offset += strlen(info_text);
+		free(info_text);
 	}
+	/* Frame header (fixed part[4], timestamp[4], length[2]) */
+	int hskip = offset;
+	memcpy(data+offset, frame_header, strlen(frame_header));
+	offset += strlen(frame_header);
 	uint32_t timestamp = (uint32_t)(now > recorder->started ? ((now - recorder->started)/1000) : 0);
-	timestamp = htonl(timestamp);
-	res = fwrite(&timestamp, sizeof(uint32_t), 1, recorder->file);
-	if(res != 1) {
-		JANUS_LOG(LOG_WARN, "Couldn't write frame timestamp in .mjr file (%zu != %zu, %s), expect issues post-processing\n",
-			res, sizeof(uint32_t), g_strerror(errno));
-	}
-	uint16_t header_bytes = htons(recorder->type == JANUS_RECORDER_DATA ? (length+sizeof(gint64)) : length);
-	res = fwrite(&header_bytes, sizeof(uint16_t), 1, recorder->file);
-	if(res != 1) {
-		JANUS_LOG(LOG_WARN, "Couldn't write size of frame in .mjr file (%zu != %zu, %s), expect issues post-processing\n",
-			res, sizeof(uint16_t), g_strerror(errno));
-	}
+	uint32_t timestamp_n = htonl(timestamp);
+	memcpy(data+offset, &timestamp_n, sizeof(uint32_t));
+	offset += sizeof(uint32_t);
+	uint16_t mjrlen = (recorder->type == JANUS_RECORDER_DATA ? (length+sizeof(gint64)) : length);
+	uint16_t header_bytes = htons(mjrlen);
+	memcpy(data+offset, &header_bytes, sizeof(uint16_t));
+	offset += sizeof(uint16_t);
 	if(recorder->type == JANUS_RECORDER_DATA) {
 		/* If it's data, then we need to prepend timing related info, as it's not there by itself */
-		gint64 now = htonll((uint64_t)janus_get_real_time());
-		res = fwrite(&now, sizeof(gint64), 1, recorder->file);
-		if(res != 1) {
-			JANUS_LOG(LOG_WARN, "Couldn't write data timestamp in .mjr file (%zu != %zu, %s), expect issues post-processing\n",
-				res, sizeof(gint64), g_strerror(errno));
-		}
+		gint64 nowr = htonll((uint64_t)janus_get_real_time());
+		memcpy(data+offset, &nowr, sizeof(gint64));
+		offset += sizeof(gint64);
 	}
-	/* Edit packet header if needed */
-	janus_rtp_header *header = (janus_rtp_header *)buffer;
-	uint32_t ssrc = 0;
-	uint16_t seq = 0;
+	/* Copy the packet, editing the RTP header in the copy if needed: this
+	 * way we never have to touch (and then restore) the caller's buffer */
+	memcpy(data+offset, buffer, length);
 	if(recorder->type != JANUS_RECORDER_DATA) {
-		ssrc = ntohl(header->ssrc);
-		seq = ntohs(header->seq_number);
-		timestamp = ntohl(header->timestamp);
+		janus_rtp_header *header = (janus_rtp_header *)(data+offset);
 		janus_rtp_header_update(header, &recorder->context, recorder->type == JANUS_RECORDER_VIDEO, 0);
 	}
-	/* Save packet on file */
-	int temp = 0, tot = length;
-	while(tot > 0) {
-		temp = fwrite(buffer+length-tot, sizeof(char), tot, recorder->file);
-		if(temp <= 0) {
-			JANUS_LOG(LOG_ERR, "Error saving frame...\n");
-			if(recorder->type != JANUS_RECORDER_DATA) {
-				/* Restore packet header data */
-				header->ssrc = htonl(ssrc);
-				header->seq_number = htons(seq);
-				header->timestamp = htonl(timestamp);
-			}
-			janus_mutex_unlock_nodebug(&recorder->mutex);
-			return -6;
-		}
-		tot -= temp;
-	}
-	if(recorder->type != JANUS_RECORDER_DATA) {
-		/* Restore packet header data */
-		header->ssrc = htonl(ssrc);
-		header->seq_number = htons(seq);
-		header->timestamp = htonl(timestamp);
+	recorder->seg_bytes += flen;
+	if(rec_writer_queue != NULL) {
+		/* Queue the serialized frame for the shared writer thread */
+		janus_recorder_frame *frame = g_malloc0(sizeof(janus_recorder_frame));
+		janus_refcount_increase(&recorder->ref);
+		frame->recorder = recorder;
+		frame->data = data;
+		frame->length = flen;
+		frame->hskip = hskip;
+		frame->time = timestamp;
+		frame->mjrlen = mjrlen;
+		frame->keyframe = keyframe;
+		g_atomic_int_add(&rec_pending_bytes, flen);
+		g_atomic_int_inc(&recorder->pending);
+		janus_lfq_push(rec_writer_queue, frame);
+	} else {
+		/* No writer thread, index the frame and write it synchronously as we used to */
+		janus_recorder_index_frame(recorder, recorder->written + hskip, timestamp, mjrlen, keyframe);
+		janus_recorder_write(recorder, data, flen);
+		g_free(data);
 	}
 	/* Done */
 	janus_mutex_unlock_nodebug(&recorder->mutex);
@@ -486,37 +868,12 @@ int janus_recorder_save_frame(janus_recorder *recorder, char *buffer, uint lengt
 int janus_recorder_close(janus_recorder *recorder) {
 	if(!recorder || !g_atomic_int_compare_and_exchange(&recorder->writable, 1, 0))
 		return -1;
+	/* Wait for the writer thread to flush any frame of ours still pending */
+	while(g_atomic_int_get(&recorder->pending) > 0)
+		g_usleep(5000);
 	janus_mutex_lock_nodebug(&recorder->mutex);
-	if(recorder->file) {
-		fseek(recorder->file, 0L, SEEK_END);
-		size_t fsize = ftell(recorder->file);
-		fseek(recorder->file, 0L, SEEK_SET);
-		JANUS_LOG(LOG_INFO, "File is %zu bytes: %s\n", fsize, recorder->filename);
-	}
-	if(rec_tempname) {
-		/* We need to rename the file, to remove the temporary extension */
-		char newname[1024];
-		memset(newname, 0, 1024);
-		g_snprintf(newname, strlen(recorder->filename)-strlen(rec_tempext), "%s", recorder->filename);
-		char oldpath[1024];
-		memset(oldpath, 0, 1024);
-		char newpath[1024];
-		memset(newpath, 0, 1024);
-		if(recorder->dir) {
-			g_snprintf(newpath, 1024, "%s/%s", recorder->dir, newname);
-			g_snprintf(oldpath, 1024, "%s/%s", recorder->dir, recorder->filename);
-		} else {
-			g_snprintf(newpath, 1024, "%s", newname);
-			g_snprintf(oldpath, 1024, "%s", recorder->filename);
-		}
-		if(rename(oldpath, newpath) != 0) {
-			JANUS_LOG(LOG_ERR, "Error renaming %s to %s...\n", recorder->filename, newname);
-		} else {
-			JANUS_LOG(LOG_INFO, "Recording renamed: %s\n", newname);
-			g_free(recorder->filename);
-			recorder->filename = g_strdup(newname);
-		}
-	}
+	/* Finalize the file (or the last segment, for segmented recordings) */
+	janus_recorder_close_file(recorder);
 	janus_mutex_unlock_nodebug(&recorder->mutex);
 	return 0;
 }
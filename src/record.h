@@ -41,8 +41,15 @@ typedef enum janus_recorder_medium {
 typedef struct janus_recorder {
 	/*! \brief Absolute path to the directory where the recorder file is stored */
 	char *dir;
-	/*! \brief Filename of this recorder file */
+	/*! \brief Filename of this recorder file (the current segment, if the recording is segmented) */
 	char *filename;
+	/*! \brief Base filename segments share, if the recording is segmented (NULL otherwise) */
+	char *base;
+	/*! \brief Number of the segment we're currently writing to, if the recording is segmented */
+	guint seg;
+	/*! \brief When the current segment was started, and how many bytes we queued for it so far */
+	gint64 seg_started;
+	guint64 seg_bytes;
 	/*! \brief Recording file */
 	FILE *file;
 	/*! \brief Codec the packets to record are encoded in ("vp8", "vp9", "h264", "opus", "pcma", "pcmu", "g722") */
@@ -67,6 +74,20 @@ typedef struct janus_recorder {
 	volatile int writable;
 	/*! \brief Whether writing s/RTP packets/data is paused */
 	volatile int paused;
+	/*! \brief Large user-space buffer the file writes go through */
+	char *iobuf;
+	/*! \brief Bytes written to the file so far */
+	guint64 written;
+	/*! \brief Bytes preallocated on disk so far, if preallocation is in use */
+	guint64 allocated;
+	/*! \brief Bytes written since the last periodic flush to disk */
+	guint64 unsynced;
+	/*! \brief Index of the frames saved so far (offset, time, keyframe flag), appended to the file as a footer on close */
+	GByteArray *index;
+	/*! \brief Number of serialized frames of this recorder queued on the shared writer thread */
+	volatile gint pending;
+	/*! \brief Number of frames of this recorder dropped because the writer backlog was full */
+	volatile gint dropped;
 	/*! \brief RTP switching context for rewriting RTP headers */
 	janus_rtp_switching_context context;
 	/*! \brief Mutex to lock/unlock this recorder instance */
@@ -83,6 +104,31 @@ typedef struct janus_recorder {
 void janus_recorder_init(gboolean tempnames, const char *extension);
 /*! \brief De-initialize the recorder code */
 void janus_recorder_deinit(void);
+/*! \brief Configure the preallocation of recording files
+ * \note When enabled, recording files are grown with posix_fallocate() in
+ * extents of the provided size, rather than write by write, which keeps them
+ * from fragmenting when many streams are recorded concurrently; the files
+ * are truncated back to their real size when the recording is closed
+ * @param[in] bytes Size of the preallocation extents, in bytes (0 disables preallocation) */
+void janus_recorder_set_prealloc_size(guint64 bytes);
+/*! \brief Configure the segmentation of recording files
+ * \note When enabled, recordings are rolled to a new .mjr file every time the
+ * configured duration and/or size is exceeded, without losing any packet: video
+ * segments are only cut at a keyframe boundary, so that each file can be decoded
+ * on its own, and finished segments are immediately renamed to their final name,
+ * meaning they can be post-processed while the recording is still going on. The
+ * segment files share a base name, plus a progressive segment number, which is
+ * saved in the info header too ("sg"); RTP timestamps and sequence numbers are
+ * never reset across segments
+ * @param[in] seconds How often recordings should be rolled, in seconds (0 disables time-based segmentation)
+ * @param[in] bytes How often recordings should be rolled, in bytes (0 disables size-based segmentation) */
+void janus_recorder_set_segmentation(guint seconds, guint64 bytes);
+/*! \brief Get the current size of the backlog of frames queued on the shared writer thread
+ * @returns The backlog size, in bytes */
+guint janus_recorder_pending_bytes(void);
+/*! \brief Get the total number of frames dropped because the writer thread backlog was full
+ * @returns The number of dropped frames */
+guint janus_recorder_dropped_frames(void);
 
 /*! \brief Create a new recorder
  * \note If no target directory is provided, the current directory will be used. If no filename
@@ -146,6 +192,10 @@ int janus_recorder_encrypted(janus_recorder *recorder);
  * @returns 0 in case of success, a negative integer otherwise */
 int janus_recorder_save_frame(janus_recorder *recorder, char *buffer, uint length);
 /*! \brief Close the recorder
+ * \note Closing a recording also appends a frame index to the .mjr file
+ * (offset, time and keyframe flag of each saved frame), which the
+ * post-processing tools can use to locate all frames without scanning
+ * the whole file; legacy parsers will simply skip it
  * @param[in] recorder The janus_recorder instance to close
  * @returns 0 in case of success, a negative integer otherwise */
 int janus_recorder_close(janus_recorder *recorder);
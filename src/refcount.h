@@ -58,12 +58,44 @@ void my_free_function(janus_refcount *counter) {
 #define JANUS_REFCOUNT_H
 
 #include <glib.h>
+#include <jansson.h>
 #include "mutex.h"
 
 //~ #define REFCOUNT_DEBUG
 
 extern int refcount_debug;
 
+/*! \brief Sampling rate of the production reference tracker (0 = disabled)
+ * \details Unlike the REFCOUNT_DEBUG tracking above, which logs and tracks
+ * every single counter and so is unusable outside of the lab, the sampled
+ * tracker picks roughly one out of every N created objects and records
+ * where it was created and where its counter was last changed. Untracked
+ * objects only pay a predictable branch per operation, so this can be
+ * turned on (and off) at runtime on production instances to chase
+ * reference leaks there (see the set_refcount_sampling Admin API request) */
+extern volatile gint refcount_sample_rate;
+
+/* The g_atomic_int_* helpers are sequentially consistent, which is more
+ * than reference counting actually needs: the standard idiom is a relaxed
+ * increment (taking a reference only requires atomicity) and an acquire/
+ * release decrement (so that all accesses to the object happen-before its
+ * destruction). On x86 this makes no difference, but on weakly ordered
+ * architectures (e.g., ARM servers) it avoids a full barrier per ref/unref,
+ * which adds up since handles and sessions are ref'd on a per-packet basis.
+ * The debug-tracking variants stick to the GLib helpers, as performance is
+ * not a concern there. */
+#if defined(__ATOMIC_RELAXED) && !defined(REFCOUNT_DEBUG)
+#define janus_refcount_ref_relaxed(refp) \
+	__atomic_fetch_add(&(refp)->count, 1, __ATOMIC_RELAXED)
+#define janus_refcount_unref_acqrel(refp) \
+	(__atomic_fetch_sub(&(refp)->count, 1, __ATOMIC_ACQ_REL) == 1)
+#else
+#define janus_refcount_ref_relaxed(refp) \
+	g_atomic_int_inc((gint *)&(refp)->count)
+#define janus_refcount_unref_acqrel(refp) \
+	g_atomic_int_dec_and_test((gint *)&(refp)->count)
+#endif
+
 /*! \brief Macro to programmatically address the object itself from its counter
  * \details \c refptr is the pointer to the janus_refcount instance, \c type
  * is the type of the object itself (e.g., <code>struct mystruct</code>),
@@ -78,10 +110,29 @@ typedef struct janus_refcount janus_refcount;
 struct janus_refcount {
 	/*! \brief The reference counter itself */
 	gint count;
+	/*! \brief Whether this object was picked by the sampled reference tracker */
+	gint tracked;
 	/*! \brief Pointer to the function that will be used to free the object */
 	void (*free)(const janus_refcount *);
 };
 
+/*! \brief Register a newly initialized counter with the sampled tracker,
+ * which will pick it (and set \c tracked) roughly once every N creations
+ * @param refp Pointer to the Janus reference counter instance
+ * @param site The file:line the object was created at */
+void janus_refcount_sample_init(janus_refcount *refp, const char *site);
+/*! \brief Record an increase/decrease on a tracked counter
+ * @param refp Pointer to the Janus reference counter instance
+ * @param site The file:line of the operation
+ * @param increase Whether this is an increase or a decrease */
+void janus_refcount_sample_note(janus_refcount *refp, const char *site, gboolean increase);
+/*! \brief Drop a tracked counter from the registry (the object is being freed)
+ * @param refp Pointer to the Janus reference counter instance */
+void janus_refcount_sample_free(janus_refcount *refp);
+/*! \brief Summarize the objects the sampled tracker currently knows about
+ * @returns A json_t object with the sampling state and the live objects */
+json_t *janus_refcount_sample_summary(void);
+
 
 #ifdef REFCOUNT_DEBUG
 /* Reference counters debugging */
@@ -124,13 +175,17 @@ extern janus_mutex counters_mutex;
 #ifdef REFCOUNT_DEBUG
 #define janus_refcount_init_nodebug(refp, free_fn) { \
 	(refp)->count = 1; \
+	(refp)->tracked = 0; \
 	(refp)->free = free_fn; \
 	janus_refcount_track((refp)); \
 }
 #else
 #define janus_refcount_init_nodebug(refp, free_fn) { \
 	(refp)->count = 1; \
+	(refp)->tracked = 0; \
 	(refp)->free = free_fn; \
+	if(G_UNLIKELY(g_atomic_int_get(&refcount_sample_rate) > 0)) \
+		janus_refcount_sample_init((refp), __FILE__ ":" G_STRINGIFY(__LINE__)); \
 }
 #endif
 /*! \brief Janus reference counter initialization (debug)
@@ -142,6 +197,7 @@ extern janus_mutex counters_mutex;
 #ifdef REFCOUNT_DEBUG
 #define janus_refcount_init_debug(refp, free_fn) { \
 	(refp)->count = 1; \
+	(refp)->tracked = 0; \
 	JANUS_PRINT("[%s:%s:%d:init] %p (%d)\n", __FILE__, __FUNCTION__, __LINE__, refp, (refp)->count); \
 	(refp)->free = free_fn; \
 	janus_refcount_track((refp)); \
@@ -149,6 +205,7 @@ extern janus_mutex counters_mutex;
 #else
 #define janus_refcount_init_debug(refp, free_fn) { \
 	(refp)->count = 1; \
+	(refp)->tracked = 0; \
 	JANUS_PRINT("[%s:%s:%d:init] %p (%d)\n", __FILE__, __FUNCTION__, __LINE__, refp, (refp)->count); \
 	(refp)->free = free_fn; \
 }
@@ -166,7 +223,9 @@ extern janus_mutex counters_mutex;
 /*! \brief Increase the Janus reference counter (no debug)
  * @param refp Pointer to the Janus reference counter instance */
 #define janus_refcount_increase_nodebug(refp)  { \
-	g_atomic_int_inc((gint *)&(refp)->count); \
+	janus_refcount_ref_relaxed(refp); \
+	if(G_UNLIKELY(g_atomic_int_get(&(refp)->tracked))) \
+		janus_refcount_sample_note((refp), __FILE__ ":" G_STRINGIFY(__LINE__), TRUE); \
 }
 /*! \brief Increase the Janus reference counter (debug)
  * @param refp Pointer to the Janus reference counter instance */
@@ -209,14 +268,18 @@ extern janus_mutex counters_mutex;
  * @param refp Pointer to the Janus reference counter instance */
 #ifdef REFCOUNT_DEBUG
 #define janus_refcount_decrease_nodebug(refp)  { \
-	if(g_atomic_int_dec_and_test((gint *)&(refp)->count)) { \
+	if(janus_refcount_unref_acqrel(refp)) { \
 		(refp)->free(refp); \
 		janus_refcount_untrack((refp)); \
 	} \
 }
 #else
 #define janus_refcount_decrease_nodebug(refp)  { \
-	if(g_atomic_int_dec_and_test((gint *)&(refp)->count)) { \
+	if(G_UNLIKELY(g_atomic_int_get(&(refp)->tracked))) \
+		janus_refcount_sample_note((refp), __FILE__ ":" G_STRINGIFY(__LINE__), FALSE); \
+	if(janus_refcount_unref_acqrel(refp)) { \
+		if(G_UNLIKELY(g_atomic_int_get(&(refp)->tracked))) \
+			janus_refcount_sample_free(refp); \
 		(refp)->free(refp); \
 	} \
 }
@@ -17,6 +17,7 @@
 #include <stdlib.h>
 #include <sys/time.h>
 
+#include "bwe.h"
 #include "debug.h"
 #include "rtp.h"
 #include "rtcp.h"
@@ -309,15 +310,23 @@ static void janus_rtcp_incoming_transport_cc(janus_rtcp_context *ctx, janus_rtcp
 	JANUS_LOG(LOG_HUGE, "[TWCC] Recv Deltas (%d/%"SCNu16"):\n", g_list_length(list), status_count);
 	num = 0;
 	uint16_t delta = 0;
+	int16_t sdelta = 0;
 	uint32_t delta_us = 0;
+	/* If a bandwidth estimator was set for this context, we feed it with
+	 * the reconstructed arrival time of each packet the feedback covers:
+	 * the reference time is in multiples of 64ms, deltas in 250us units */
+	janus_bwe *bwe = (janus_bwe *)ctx->bwe;
+	gint64 arrival = ((gint64)reference)*64000;
 	GList *iter = list;
 	while(iter != NULL && total > 0) {
 		num++;
 		delta = 0;
+		sdelta = 0;
 		s = GPOINTER_TO_UINT(iter->data);
 		if(s == janus_rtp_packet_status_smalldelta) {
 			/* Small delta = 1 byte */
 			delta = *data;
+			sdelta = (int16_t)delta;
 			total--;
 			data++;
 		} else if(s == janus_rtp_packet_status_largeornegativedelta) {
@@ -326,6 +335,7 @@ static void janus_rtcp_incoming_transport_cc(janus_rtcp_context *ctx, janus_rtcp
 				break;
 			memcpy(&delta, data, sizeof(uint16_t));
 			delta = ntohs(delta);
+			sdelta = (int16_t)delta;
 			total -= 2;
 			data += 2;
 		}
@@ -333,9 +343,18 @@ static void janus_rtcp_incoming_transport_cc(janus_rtcp_context *ctx, janus_rtcp
 		/* Print summary */
 		JANUS_LOG(LOG_HUGE, "  [%02"SCNu16"][%"SCNu16"] %s (%"SCNu32"us)\n", num, (uint16_t)(base_seq+num-1),
 			janus_rtp_packet_status_description(s), delta_us);
+		if(bwe != NULL) {
+			gboolean received = (s == janus_rtp_packet_status_smalldelta ||
+				s == janus_rtp_packet_status_largeornegativedelta);
+			if(received)
+				arrival += ((gint64)sdelta)*250;
+			janus_bwe_packet_acked(bwe, (uint16_t)(base_seq+num-1), arrival, received);
+		}
 		iter = iter->next;
 	}
-	/* TODO Update the context with the feedback we got */
+	/* Update the estimator with the feedback we got */
+	if(bwe != NULL)
+		janus_bwe_feedback_done(bwe);
 	g_list_free(list);
 }
 
@@ -1115,6 +1134,132 @@ int janus_rtcp_fix_report_data(char *packet, int len, uint32_t base_ts, uint32_t
 	return status;
 }
 
+int janus_rtcp_inspect(char *packet, int len, janus_rtcp_summary *summary, GQueue *nacks) {
+	if(packet == NULL || len == 0 || summary == NULL)
+		return -1;
+	memset(summary, 0, sizeof(janus_rtcp_summary));
+	if(nacks != NULL)
+		g_queue_clear(nacks);
+	/* Parse the RTCP compound packet, collecting everything in one walk */
+	janus_rtcp_header *rtcp = (janus_rtcp_header *)packet;
+	int total = len;
+	while(rtcp) {
+		if(!janus_rtcp_check_len(rtcp, total))
+			return -2;
+		if(rtcp->version != 2)
+			return -2;
+		switch(rtcp->type) {
+			case RTCP_SR: {
+				/* SR, sender report */
+				janus_rtcp_sr *sr = (janus_rtcp_sr *)rtcp;
+				if(summary->sender_ssrc == 0)
+					summary->sender_ssrc = ntohl(sr->ssrc);
+				if(summary->receiver_ssrc == 0 && janus_rtcp_check_sr(rtcp, total) && sr->header.rc > 0)
+					summary->receiver_ssrc = ntohl(sr->rb[0].ssrc);
+				break;
+			}
+			case RTCP_RR: {
+				/* RR, receiver report */
+				janus_rtcp_rr *rr = (janus_rtcp_rr *)rtcp;
+				if(summary->sender_ssrc == 0)
+					summary->sender_ssrc = ntohl(rr->ssrc);
+				if(summary->receiver_ssrc == 0 && janus_rtcp_check_rr(rtcp, total) && rr->header.rc > 0)
+					summary->receiver_ssrc = ntohl(rr->rb[0].ssrc);
+				break;
+			}
+			case RTCP_BYE:
+				summary->has_bye = TRUE;
+				break;
+			case RTCP_FIR:
+				summary->has_fir = TRUE;
+				break;
+			case RTCP_RTPFB: {
+				/* RTPFB, Transport layer FB message (rfc4585) */
+				janus_rtcp_fb *rtcpfb = (janus_rtcp_fb *)rtcp;
+				if(summary->sender_ssrc == 0)
+					summary->sender_ssrc = ntohl(rtcpfb->ssrc);
+				gint fmt = rtcp->rc;
+				if(fmt == 1) {
+					/* NACK: the FCI size is 4 bytes */
+					if(!janus_rtcp_check_fci(rtcp, total, 4))
+						return -2;
+					if(summary->receiver_ssrc == 0)
+						summary->receiver_ssrc = ntohl(rtcpfb->media);
+					int nacks_num = ntohs(rtcp->length)-2;	/* Skip SSRCs */
+					if(nacks != NULL && nacks_num > 0) {
+						JANUS_LOG(LOG_DBG, "        Got %d nacks\n", nacks_num);
+						janus_rtcp_nack *nack = NULL;
+						uint16_t pid = 0;
+						uint16_t blp = 0;
+						int i=0, j=0;
+						for(i=0; i<nacks_num; i++) {
+							nack = (janus_rtcp_nack *)rtcpfb->fci + i;
+							pid = ntohs(nack->pid);
+							g_queue_push_head(nacks, GUINT_TO_POINTER(pid));
+							blp = ntohs(nack->blp);
+							for(j=0; j<16; j++) {
+								if((blp & (1 << j)) >> j)
+									g_queue_push_head(nacks, GUINT_TO_POINTER(pid+j+1));
+							}
+						}
+					}
+				} else if(summary->receiver_ssrc == 0 && janus_rtcp_check_fci(rtcp, total, 4)) {
+					summary->receiver_ssrc = ntohl(rtcpfb->media);
+				}
+				break;
+			}
+			case RTCP_PSFB: {
+				/* PSFB, Payload-specific FB message (rfc4585) */
+				janus_rtcp_fb *rtcpfb = (janus_rtcp_fb *)rtcp;
+				if(summary->sender_ssrc == 0)
+					summary->sender_ssrc = ntohl(rtcpfb->ssrc);
+				gint fmt = rtcp->rc;
+				if(fmt == 1) {
+					/* PLI (no FCI data) */
+					summary->has_pli = TRUE;
+					if(summary->receiver_ssrc == 0 && janus_rtcp_check_fci(rtcp, total, 0))
+						summary->receiver_ssrc = ntohl(rtcpfb->media);
+				} else if(fmt == 4) {
+					/* FIR */
+					summary->has_fir = TRUE;
+				} else if(fmt == 15 && summary->remb_bitrate == 0) {
+					/* REMB? */
+					janus_rtcp_fb_remb *remb = (janus_rtcp_fb_remb *)rtcpfb->fci;
+					if(janus_rtcp_check_remb(rtcp, total) && remb->id[0] == 'R' && remb->id[1] == 'E' && remb->id[2] == 'M' && remb->id[3] == 'B') {
+						/* FIXME From rtcp_utility.cc */
+						unsigned char *_ptrRTCPData = (unsigned char *)remb;
+						_ptrRTCPData += 4;	/* Skip unique identifier and num ssrc */
+						uint8_t brExp = (_ptrRTCPData[1] >> 2) & 0x3F;
+						uint32_t brMantissa = (_ptrRTCPData[1] & 0x03) << 16;
+						brMantissa += (_ptrRTCPData[2] << 8);
+						brMantissa += (_ptrRTCPData[3]);
+						summary->remb_bitrate = (uint64_t)brMantissa << brExp;
+					}
+				}
+				break;
+			}
+			case RTCP_XR: {
+				/* XR, extended reports (rfc3611) */
+				janus_rtcp_xr *xr = (janus_rtcp_xr *)rtcp;
+				if(summary->sender_ssrc == 0)
+					summary->sender_ssrc = ntohl(xr->ssrc);
+				break;
+			}
+			default:
+				break;
+		}
+		/* Is this a compound packet? */
+		int length = ntohs(rtcp->length);
+		if(length == 0)
+			break;
+		total -= length*4+4;
+		if(total <= 0)
+			break;
+		rtcp = (janus_rtcp_header *)((uint32_t*)rtcp + length + 1);
+	}
+	return 0;
+}
+
 gboolean janus_rtcp_has_bye(char *packet, int len) {
 	/* Parse RTCP compound packet */
 	janus_rtcp_header *rtcp = (janus_rtcp_header *)packet;
@@ -1546,6 +1691,19 @@ int janus_rtcp_pli(char *packet, int len) {
 	return 12;
 }
 
+gboolean janus_rtcp_pli_window_allow(janus_rtcp_pli_window *window, gint64 now) {
+	if(window == NULL)
+		return TRUE;
+	gint64 min_interval = window->min_interval > 0 ? window->min_interval : G_USEC_PER_SEC;
+	if(window->latest > 0 && (now - window->latest) < min_interval) {
+		/* A request was forwarded less than min_interval ago, suppress this one */
+		window->suppressed++;
+		return FALSE;
+	}
+	window->latest = now;
+	return TRUE;
+}
+
 /* Generate a new NACK message */
 int janus_rtcp_nacks(char *packet, int len, GSList *nacks) {
 	if(packet == NULL || len < 16 || nacks == NULL)
@@ -1811,9 +1969,6 @@ int janus_rtcp_transport_wide_cc_feedback(char *packet, size_t size, guint32 ssr
 				all_same = TRUE;
 			}
 		}
-		/* Free mem */
-		g_free(stat);
-
 		/* Get next packet stat */
 		stat = (janus_rtcp_transport_wide_cc_stats *) g_queue_pop_head (transport_wide_cc_stats);
 	}
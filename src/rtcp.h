@@ -281,7 +281,9 @@ typedef struct rtcp_context
 	double out_link_quality;
 	double out_media_link_quality;
 
-	/* TODO Incoming transport-wide CC feedback*/
+	/* Send-side bandwidth estimator to feed with incoming transport-wide
+	 * CC feedback, if any (opaque pointer to a janus_bwe instance) */
+	void *bwe;
 
 } rtcp_context;
 typedef rtcp_context janus_rtcp_context;
@@ -431,6 +433,34 @@ int janus_rtcp_process_incoming_rtp(janus_rtcp_context *ctx, char *packet, int l
  * @returns 0 in case of success, -1 on errors */
 int janus_rtcp_report_block(janus_rtcp_context *ctx, janus_report_block *rb);
 
+/*! \brief Summary of an RTCP compound packet, as filled in by janus_rtcp_inspect */
+typedef struct janus_rtcp_summary {
+	/*! \brief Whether the compound contains a BYE message */
+	gboolean has_bye;
+	/*! \brief Whether the compound contains a FIR request */
+	gboolean has_fir;
+	/*! \brief Whether the compound contains a PLI request */
+	gboolean has_pli;
+	/*! \brief SSRC of the sender of the first report or feedback message, if any (0 otherwise) */
+	guint32 sender_ssrc;
+	/*! \brief SSRC of the media the first report block or feedback message refers to, if any (0 otherwise) */
+	guint32 receiver_ssrc;
+	/*! \brief Bitrate advertised in a REMB block, if any (0 otherwise) */
+	guint32 remb_bitrate;
+} janus_rtcp_summary;
+/*! \brief Method to inspect an RTCP compound packet in a single pass
+ * \note This collects in one walk what janus_rtcp_has_bye, janus_rtcp_has_fir,
+ * janus_rtcp_has_pli, janus_rtcp_get_sender_ssrc, janus_rtcp_get_receiver_ssrc,
+ * janus_rtcp_get_remb and janus_rtcp_get_nacks would otherwise each re-walk
+ * the compound for, which matters on paths handling every RTCP arrival
+ * @param[in] packet The message data
+ * @param[in] len The message data length in bytes
+ * @param[out] summary The summary to fill in
+ * @param[out] nacks Optional queue to fill with the NACKed sequence numbers,
+ * if any (the queue is cleared first); NULL to skip NACK parsing
+ * @returns 0 in case of success, a negative integer on a malformed compound */
+int janus_rtcp_inspect(char *packet, int len, janus_rtcp_summary *summary, GQueue *nacks);
+
 /*! \brief Method to check whether an RTCP message contains a BYE message
  * @param[in] packet The message data
  * @param[in] len The message data length in bytes
@@ -522,6 +552,26 @@ int janus_rtcp_fir_legacy(char *packet, int len, int *seqnr);
  * @returns The message data length in bytes, if successful, -1 on errors */
 int janus_rtcp_pli(char *packet, int len);
 
+/*! \brief Helper struct to aggregate keyframe requests (PLI/FIR) towards a
+ * media source: concurrent requests falling within the configured window are
+ * collapsed into a single one, to avoid storms of back-to-back keyframes */
+typedef struct janus_rtcp_pli_window {
+	/*! \brief Minimum interval between two forwarded requests, in microseconds (0=default) */
+	gint64 min_interval;
+	/*! \brief Monotonic time of the latest forwarded request */
+	gint64 latest;
+	/*! \brief Number of requests suppressed because they fell within the window */
+	guint64 suppressed;
+} janus_rtcp_pli_window;
+
+/*! \brief Helper to check whether a new keyframe request should be forwarded
+ * to the media source, or suppressed because one was just forwarded: updates
+ * the suppression counter and, when forwarding, the time of the latest request
+ * @param[in] window The keyframe request aggregation state of the media source
+ * @param[in] now The current monotonic time
+ * @returns TRUE if the request should be forwarded, FALSE if suppressed */
+gboolean janus_rtcp_pli_window_allow(janus_rtcp_pli_window *window, gint64 now);
+
 /*! \brief Method to generate a new RTCP NACK message to report lost packets
  * @param[in] packet The buffer data (MUST be at least 16 chars)
  * @param[in] len The message data length in bytes (MUST be 16)
@@ -536,6 +586,8 @@ int janus_rtcp_nacks(char *packet, int len, GSList *nacks);
  * @param[in] media SSRC of the destination stream
  * @param[in] feedback_packet_count Feedback paccket count
  * @param[in] transport_wide_cc_stats List of rtp packet reception stats
+ * \note The stats are popped from the queue but not freed: the storage
+ * backing them (e.g., a preallocated array) is owned by the caller
  * @returns The message data length in bytes, if successful, -1 on errors */
 int janus_rtcp_transport_wide_cc_feedback(char *packet, size_t len, guint32 ssrc, guint32 media, guint8 feedback_packet_count, GQueue *transport_wide_cc_stats);
 
@@ -227,6 +227,78 @@ static int janus_rtp_header_extension_find(char *buf, int len, int id,
 	return -1;
 }
 
+int janus_rtp_header_extension_parse_all(char *buf, int len, janus_rtp_header_extension_index *index) {
+	if(index == NULL)
+		return -1;
+	memset(index, 0, sizeof(*index));
+	if(!buf || len < 12)
+		return -2;
+	janus_rtp_header *rtp = (janus_rtp_header *)buf;
+	if(rtp->version != 2) {
+		return -3;
+	}
+	int hlen = 12;
+	if(rtp->csrccount)	/* Skip CSRC if needed */
+		hlen += rtp->csrccount*4;
+	int count = 0;
+	if(rtp->extension && (len > hlen + (int)sizeof(janus_rtp_header_extension))) {
+		janus_rtp_header_extension *ext = (janus_rtp_header_extension *)(buf+hlen);
+		int extlen = ntohs(ext->length)*4;
+		hlen += 4;
+		if(len > (hlen + extlen)) {
+			if(ntohs(ext->type) == 0xBEDE) {
+				/* 1-Byte extensions */
+				const uint8_t padding = 0x00, reserved = 0xF;
+				uint8_t extid = 0, idlen = 0;
+				int i = 0;
+				while(i < extlen) {
+					extid = (uint8_t)buf[hlen+i] >> 4;
+					if(extid == reserved) {
+						break;
+					} else if(extid == padding) {
+						i++;
+						continue;
+					}
+					idlen = ((uint8_t)buf[hlen+i] & 0xF)+1;
+					i++;
+					if((i+idlen) <= extlen) {
+						/* Track where the payload of this extension is */
+						index->data[extid] = &buf[hlen+i];
+						index->length[extid] = idlen;
+						count++;
+					}
+					i += idlen;
+				}
+			} else if(ntohs(ext->type) == 0x1000) {
+				/* 2-Byte extensions */
+				const uint8_t padding = 0x00;
+				uint8_t extid = 0, idlen = 0;
+				int i = 0;
+				while(i < extlen) {
+					if((extlen-i) < 2)
+						break;
+					extid = buf[hlen+i];
+					if(extid == padding) {
+						i += 2;
+						continue;
+					}
+					i++;
+					idlen = buf[hlen+i];
+					i++;
+					if(extid < JANUS_RTP_EXTENSIONS_INDEX_SIZE && ((i+idlen) <= extlen)) {
+						/* Track where the payload of this extension is */
+						index->data[extid] = &buf[hlen+i];
+						index->length[extid] = idlen;
+						count++;
+					}
+					i += idlen;
+				}
+			}
+		}
+	}
+	return count;
+}
+
 int janus_rtp_header_extension_parse_audio_level(char *buf, int len, int id, gboolean *vad, int *level) {
 	uint8_t byte = 0, idlen = 0;
 	if(janus_rtp_header_extension_find(buf, len, id, &byte, NULL, NULL, &idlen) < 0)
@@ -445,12 +517,10 @@ int janus_rtp_header_extension_set_transport_wide_cc(char *buf, int len, int id,
 	return 0;
 }
 
-int janus_rtp_header_extension_parse_video_layers_allocation(char *buf, int len, int id,
+/* Static helper to decode a video-layers-allocation payload, shared by the
+ * parse and read variants of the related extension helpers */
+static int janus_rtp_header_extension_decode_video_layers_allocation(char *ext, uint8_t idlen,
 		int8_t *spatial_layers, int8_t *temporal_layers) {
-	char *ext = NULL;
-	uint8_t idlen = 0;
-	if(janus_rtp_header_extension_find(buf, len, id, NULL, NULL, &ext, &idlen) < 0)
-		return -1;
 	/* a=extmap:9 http://www.webrtc.org/experiments/rtp-hdrext/video-layers-allocation00 */
 	if(ext == NULL || idlen < 2)
 		return -2;
@@ -512,6 +582,135 @@ int janus_rtp_header_extension_parse_video_layers_allocation(char *buf, int len,
 	return 0;
 }
 
+int janus_rtp_header_extension_parse_video_layers_allocation(char *buf, int len, int id,
+		int8_t *spatial_layers, int8_t *temporal_layers) {
+	char *ext = NULL;
+	uint8_t idlen = 0;
+	if(janus_rtp_header_extension_find(buf, len, id, NULL, NULL, &ext, &idlen) < 0)
+		return -1;
+	return janus_rtp_header_extension_decode_video_layers_allocation(ext, idlen,
+		spatial_layers, temporal_layers);
+}
+
+int janus_rtp_header_extension_read_audio_level(janus_rtp_header_extension_index *index,
+		int id, gboolean *vad, int *level) {
+	if(index == NULL || id < 1 || id >= JANUS_RTP_EXTENSIONS_INDEX_SIZE ||
+			index->data[id] == NULL || index->length[id] < 1)
+		return -1;
+	/* a=extmap:1 urn:ietf:params:rtp-hdrext:ssrc-audio-level */
+	uint8_t byte = (uint8_t)index->data[id][0];
+	gboolean v = (byte & 0x80) >> 7;
+	int value = byte & 0x7F;
+	JANUS_LOG(LOG_DBG, "%02x --> v=%d, level=%d\n", byte, v, value);
+	if(vad)
+		*vad = v;
+	if(level)
+		*level = value;
+	return 0;
+}
+
+int janus_rtp_header_extension_read_video_orientation(janus_rtp_header_extension_index *index,
+		int id, gboolean *c, gboolean *f, gboolean *r1, gboolean *r0) {
+	if(index == NULL || id < 1 || id >= JANUS_RTP_EXTENSIONS_INDEX_SIZE ||
+			index->data[id] == NULL || index->length[id] < 1)
+		return -1;
+	/* a=extmap:4 urn:3gpp:video-orientation */
+	uint8_t byte = (uint8_t)index->data[id][0];
+	gboolean cbit = (byte & 0x08) >> 3;
+	gboolean fbit = (byte & 0x04) >> 2;
+	gboolean r1bit = (byte & 0x02) >> 1;
+	gboolean r0bit = byte & 0x01;
+	JANUS_LOG(LOG_DBG, "%02x --> c=%d, f=%d, r1=%d, r0=%d\n", byte, cbit, fbit, r1bit, r0bit);
+	if(c)
+		*c = cbit;
+	if(f)
+		*f = fbit;
+	if(r1)
+		*r1 = r1bit;
+	if(r0)
+		*r0 = r0bit;
+	return 0;
+}
+
+int janus_rtp_header_extension_read_playout_delay(janus_rtp_header_extension_index *index,
+		int id, uint16_t *min_delay, uint16_t *max_delay) {
+	if(index == NULL || id < 1 || id >= JANUS_RTP_EXTENSIONS_INDEX_SIZE ||
+			index->data[id] == NULL)
+		return -1;
+	if(index->length[id] < 3)
+		return -2;
+	/* a=extmap:6 http://www.webrtc.org/experiments/rtp-hdrext/playout-delay */
+	uint32_t bytes = 0;
+	if(index->length[id] >= 4) {
+		memcpy(&bytes, index->data[id], sizeof(uint32_t));
+		bytes = ntohl(bytes);
+	}
+	uint16_t min = (bytes & 0x00FFF000) >> 12;
+	uint16_t max = bytes & 0x00000FFF;
+	JANUS_LOG(LOG_DBG, "%"SCNu32"x --> min=%"SCNu16", max=%"SCNu16"\n", bytes, min, max);
+	if(min_delay)
+		*min_delay = min;
+	if(max_delay)
+		*max_delay = max;
+	return 0;
+}
+
+int janus_rtp_header_extension_read_dependency_desc(janus_rtp_header_extension_index *index,
+		int id, uint8_t *dd_item, int *dd_len) {
+	int buflen = *dd_len;
+	*dd_len = 0;
+	if(index == NULL || id < 1 || id >= JANUS_RTP_EXTENSIONS_INDEX_SIZE ||
+			index->data[id] == NULL)
+		return -1;
+	/* a=extmap:10 https://aomediacodec.github.io/av1-rtp-spec/#dependency-descriptor-rtp-header-extension */
+	uint8_t idlen = index->length[id];
+	if(idlen < 1)
+		return -2;
+	if(idlen > buflen) {
+		JANUS_LOG(LOG_WARN, "Buffer is too small (%d > %d), dependency descriptor will be cut\n", idlen, buflen);
+		idlen = buflen;
+	}
+	memcpy(dd_item, index->data[id], idlen);
+	*dd_len = idlen;
+	return 0;
+}
+
+int janus_rtp_header_extension_read_abs_capture_time(janus_rtp_header_extension_index *index,
+		int id, uint64_t *abs_ts) {
+	if(index == NULL || id < 1 || id >= JANUS_RTP_EXTENSIONS_INDEX_SIZE ||
+			index->data[id] == NULL)
+		return -1;
+	/* a=extmap:7 http://www.webrtc.org/experiments/rtp-hdrext/abs-capture-time */
+	if(index->length[id] < 8)
+		return -2;
+	uint64_t abs64 = 0;
+	memcpy(&abs64, index->data[id], 8);
+	if(abs_ts)
+		*abs_ts = ntohll(abs64);
+	return 0;
+}
+
+int janus_rtp_header_extension_read_transport_wide_cc(janus_rtp_header_extension_index *index,
+		int id, uint16_t *transSeqNum) {
+	if(index == NULL || id < 1 || id >= JANUS_RTP_EXTENSIONS_INDEX_SIZE ||
+			index->data[id] == NULL)
+		return -1;
+	if(index->length[id] < 2)
+		return -2;
+	memcpy(transSeqNum, index->data[id], sizeof(uint16_t));
+	*transSeqNum = ntohs(*transSeqNum);
+	return 0;
+}
+
+int janus_rtp_header_extension_read_video_layers_allocation(janus_rtp_header_extension_index *index,
+		int id, int8_t *spatial_layers, int8_t *temporal_layers) {
+	if(index == NULL || id < 1 || id >= JANUS_RTP_EXTENSIONS_INDEX_SIZE ||
+			index->data[id] == NULL)
+		return -1;
+	return janus_rtp_header_extension_decode_video_layers_allocation(index->data[id],
+		index->length[id], spatial_layers, temporal_layers);
+}
+
 int janus_rtp_header_extension_replace_id(char *buf, int len, int id, int new_id) {
 	if(!buf || len < 12)
 		return -1;
@@ -901,6 +1100,58 @@ void janus_rtp_header_update(janus_rtp_header *header, janus_rtp_switching_conte
 	context->last_time = janus_get_monotonic_time();
 }
 
+void janus_audiolevel_context_reset(janus_audiolevel_context *context) {
+	if(context == NULL)
+		return;
+	/* Reset the talk detection state */
+	context->talking = FALSE;
+	context->level_avg = 0;
+	context->active_packets = 0;
+	context->hangover = 0;
+}
+
+gboolean janus_audiolevel_context_process(janus_audiolevel_context *context,
+		int level, int active_packets, int level_average) {
+	if(context == NULL || level < 0)
+		return FALSE;
+	/* Fall back to the defaults the plugins have always used */
+	if(active_packets < 1)
+		active_packets = 100;
+	if(level_average < 1)
+		level_average = 25;
+	/* Update the moving average: the first level seeds it, so that we don't
+	 * have to wait for the average to drift away from zero (which in dBov
+	 * terms would mean starting from "very loud") */
+	if(context->active_packets == 0) {
+		context->level_avg = (double)level;
+	} else {
+		double alpha = 1.0 / (double)active_packets;
+		context->level_avg += alpha * ((double)level - context->level_avg);
+	}
+	if(context->active_packets < active_packets)
+		context->active_packets++;
+	if(!context->talking) {
+		/* Lower dBov means louder: flag the stream as talking as soon as
+		 * the smoothed level crosses the threshold */
+		if(context->level_avg < (double)level_average) {
+			context->talking = TRUE;
+			context->hangover = 0;
+			return TRUE;
+		}
+	} else {
+		/* Only flag the stream as silent after a full hangover window of
+		 * packets above the threshold, to avoid flapping on short pauses */
+		if(context->level_avg < (double)level_average) {
+			context->hangover = 0;
+		} else if(++context->hangover >= active_packets) {
+			context->talking = FALSE;
+			context->hangover = 0;
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
 
 /* SRTP stuff: we may need our own randomizer */
 #ifdef HAVE_SRTP_2
@@ -1200,9 +1451,70 @@ void janus_rtp_simulcasting_cleanup(int *rid_ext_id, uint32_t *ssrcs, char **rid
 		janus_mutex_unlock(rid_mutex);
 }
 
+/* Static helper to pack the layers state of a simulcast context in a single
+ * signature, so that we can cheaply detect when the precomputed relay
+ * decisions become stale (e.g., because the application changed a target) */
+static uint32_t janus_rtp_simulcasting_context_state(janus_rtp_simulcasting_context *context, janus_videocodec vcodec) {
+	return ((uint32_t)(context->substream+1)) | ((uint32_t)(context->substream_target+1) << 4) |
+		((uint32_t)(context->substream_target_temp+1) << 8) | ((uint32_t)(context->templayer+1) << 12) |
+		((uint32_t)(context->templayer_target+1) << 16) | ((uint32_t)vcodec << 20) | (1 << 24);
+}
+
+/* Static helper to refresh the precomputed relay decisions of a simulcast
+ * context: this is only invoked when the signature above changed, so the
+ * per-packet path normally just performs a lookup in the decisions table */
+static void janus_rtp_simulcasting_context_update_decisions(janus_rtp_simulcasting_context *context,
+		uint32_t state, janus_videocodec vcodec) {
+	context->decisions_state = state;
+	/* The shortcut only applies when no substream/temporal switch is pending */
+	context->decisions_steady = (context->substream != -1 &&
+		context->substream == context->substream_target &&
+		context->substream_target_temp == -1 &&
+		context->templayer == context->templayer_target);
+	context->decisions_need_tid = FALSE;
+	int tid = 0;
+	for(tid = 0; tid < 4; tid++) {
+		gboolean drop = FALSE;
+		if(vcodec == JANUS_VIDEOCODEC_VP8) {
+			drop = (context->templayer != -1 && tid > context->templayer);
+		} else if(vcodec == JANUS_VIDEOCODEC_VP9 || vcodec == JANUS_VIDEOCODEC_AV1) {
+			drop = (tid > context->templayer);
+		}
+		if(drop) {
+			context->decisions[tid] = JANUS_RTP_RELAY_DROP;
+			context->decisions_need_tid = TRUE;
+		} else {
+			context->decisions[tid] = JANUS_RTP_RELAY_FORWARD;
+		}
+	}
+}
+
+gboolean janus_rtp_is_keyframe(janus_videocodec vcodec, const char *payload, int plen) {
+	if(payload == NULL || plen < 1)
+		return FALSE;
+	if(vcodec == JANUS_VIDEOCODEC_VP8)
+		return janus_vp8_is_keyframe(payload, plen);
+	else if(vcodec == JANUS_VIDEOCODEC_VP9)
+		return janus_vp9_is_keyframe(payload, plen);
+	else if(vcodec == JANUS_VIDEOCODEC_H264)
+		return janus_h264_is_keyframe(payload, plen);
+	else if(vcodec == JANUS_VIDEOCODEC_AV1)
+		return janus_av1_is_keyframe(payload, plen);
+	else if(vcodec == JANUS_VIDEOCODEC_H265)
+		return janus_h265_is_keyframe(payload, plen);
+	return FALSE;
+}
+
 gboolean janus_rtp_simulcasting_context_process_rtp(janus_rtp_simulcasting_context *context,
 		char *buf, int len, uint8_t *dd_content, int dd_len, uint32_t *ssrcs, char **rids,
 		janus_videocodec vcodec, janus_rtp_switching_context *sc, janus_mutex *rid_mutex) {
+	return janus_rtp_simulcasting_context_process_rtp_full(context, buf, len,
+		dd_content, dd_len, ssrcs, rids, vcodec, sc, rid_mutex, -1);
+}
+
+gboolean janus_rtp_simulcasting_context_process_rtp_full(janus_rtp_simulcasting_context *context,
+		char *buf, int len, uint8_t *dd_content, int dd_len, uint32_t *ssrcs, char **rids,
+		janus_videocodec vcodec, janus_rtp_switching_context *sc, janus_mutex *rid_mutex, int keyframe) {
 	if(!context || !buf || len < 1)
 		return FALSE;
 	janus_rtp_header *header = (janus_rtp_header *)buf;
@@ -1253,6 +1565,57 @@ gboolean janus_rtp_simulcasting_context_process_rtp(janus_rtp_simulcasting_conte
 	char *payload = janus_rtp_payload(buf, len, &plen);
 	if(payload == NULL)
 		return FALSE;
+	/* Check if the precomputed decisions are stale (e.g., a target changed) */
+	uint32_t state = janus_rtp_simulcasting_context_state(context, vcodec);
+	if(state != context->decisions_state)
+		janus_rtp_simulcasting_context_update_decisions(context, state, vcodec);
+	/* If no switch is pending, the decision is just a table lookup */
+	if(context->decisions_steady) {
+		if(substream != context->substream) {
+			/* Not the substream we're relaying: drop it, unless the substream
+			 * we are relaying went silent and we may want to fall back */
+			if(context->substream == 0 ||
+					(now - context->last_relayed) <= (context->drop_trigger ? context->drop_trigger : 250000))
+				return FALSE;
+			/* Fall through to the slow path to evaluate a fallback */
+		} else if(!context->decisions_need_tid) {
+			/* The decision doesn't depend on the temporal layer either, so
+			 * we don't even need to parse the payload descriptor */
+			context->last_relayed = now;
+			return TRUE;
+		} else {
+			/* We only need the temporal layer of this packet for the lookup */
+			int tid = -1;
+			if(vcodec == JANUS_VIDEOCODEC_VP8) {
+				gboolean m = FALSE;
+				uint16_t picid = 0;
+				uint8_t tlzi = 0, t = 0, ybit = 0, keyidx = 0;
+				if(janus_vp8_parse_descriptor(payload, plen, &m, &picid, &tlzi, &t, &ybit, &keyidx) == 0)
+					tid = t;
+			} else if(vcodec == JANUS_VIDEOCODEC_VP9) {
+				gboolean found = FALSE;
+				janus_vp9_svc_info svc_info = { 0 };
+				if(janus_vp9_parse_svc(payload, plen, &found, &svc_info) == 0 && found)
+					tid = svc_info.temporal_layer;
+			} else if(vcodec == JANUS_VIDEOCODEC_AV1 && dd_content != NULL && dd_len > 0) {
+				janus_av1_svc_context *av1ctx = &context->av1_context[context->substream];
+				uint8_t template = 0;
+				if(janus_av1_svc_context_process_dd(av1ctx, dd_content, dd_len, &template, NULL)) {
+					janus_av1_svc_template *t = g_hash_table_lookup(av1ctx->templates, GUINT_TO_POINTER(template));
+					if(t)
+						tid = t->temporal;
+				}
+			}
+			context->last_relayed = now;
+			if(tid >= 0 && tid <= 3 && context->decisions[tid] == JANUS_RTP_RELAY_DROP) {
+				/* We increase the base sequence number, or there will be gaps when delivering later */
+				if(sc)
+					sc->base_seq++;
+				return FALSE;
+			}
+			return TRUE;
+		}
+	}
 	/* Check what's our target */
 	if(context->substream_target_temp != -1 && (substream > context->substream_target_temp ||
 			context->substream_target <= context->substream_target_temp)) {
@@ -1264,11 +1627,11 @@ gboolean janus_rtp_simulcasting_context_process_rtp(janus_rtp_simulcasting_conte
 	int target = (context->substream_target_temp == -1) ? context->substream_target : context->substream_target_temp;
 	/* Check what we need to do with the packet */
 	if(context->substream == -1) {
-		if((vcodec == JANUS_VIDEOCODEC_VP8 && janus_vp8_is_keyframe(payload, plen)) ||
-				(vcodec == JANUS_VIDEOCODEC_VP9 && janus_vp9_is_keyframe(payload, plen)) ||
-				(vcodec == JANUS_VIDEOCODEC_H264 && janus_h264_is_keyframe(payload, plen)) ||
-				(vcodec == JANUS_VIDEOCODEC_AV1 && janus_av1_is_keyframe(payload, plen)) ||
-				(vcodec == JANUS_VIDEOCODEC_H265 && janus_h265_is_keyframe(payload, plen))) {
+		/* Use the keyframe flag the caller precomputed, if any, and
+		 * only parse the payload descriptor ourselves otherwise */
+		if(keyframe == -1)
+			keyframe = janus_rtp_is_keyframe(vcodec, payload, plen) ? 1 : 0;
+		if(keyframe == 1) {
 			context->substream = substream;
 			/* Notify the caller that the substream changed */
 			context->changed_substream = TRUE;
@@ -1279,19 +1642,18 @@ gboolean janus_rtp_simulcasting_context_process_rtp(janus_rtp_simulcasting_conte
 		}
 	} else if(context->substream != target) {
 		/* We're not on the substream we'd like: let's wait for a keyframe on the target */
-		if(((context->substream < target && substream > context->substream) ||
-				(context->substream > target && substream < context->substream)) &&
-					((vcodec == JANUS_VIDEOCODEC_VP8 && janus_vp8_is_keyframe(payload, plen)) ||
-					(vcodec == JANUS_VIDEOCODEC_VP9 && janus_vp9_is_keyframe(payload, plen)) ||
-					(vcodec == JANUS_VIDEOCODEC_H264 && janus_h264_is_keyframe(payload, plen)) ||
-					(vcodec == JANUS_VIDEOCODEC_AV1 && janus_av1_is_keyframe(payload, plen)) ||
-					(vcodec == JANUS_VIDEOCODEC_H265 && janus_h265_is_keyframe(payload, plen)))) {
-			JANUS_LOG(LOG_VERB, "Received keyframe on #%d (SSRC %"SCNu32"), switching (was #%d/%"SCNu32")\n",
-				substream, ssrc, context->substream, *(ssrcs + context->substream));
-			context->substream = substream;
-			/* Notify the caller that the substream changed */
-			context->changed_substream = TRUE;
-			context->last_relayed = now;
+		if((context->substream < target && substream > context->substream) ||
+				(context->substream > target && substream < context->substream)) {
+			if(keyframe == -1)
+				keyframe = janus_rtp_is_keyframe(vcodec, payload, plen) ? 1 : 0;
+			if(keyframe == 1) {
+				JANUS_LOG(LOG_VERB, "Received keyframe on #%d (SSRC %"SCNu32"), switching (was #%d/%"SCNu32")\n",
+					substream, ssrc, context->substream, *(ssrcs + context->substream));
+				context->substream = substream;
+				/* Notify the caller that the substream changed */
+				context->changed_substream = TRUE;
+				context->last_relayed = now;
+			}
 		}
 	}
 	/* If we haven't received our desired substream yet, let's drop temporarily */
@@ -1440,6 +1802,26 @@ void janus_rtp_svc_context_reset(janus_rtp_svc_context *context) {
 	context->temporal = -1;
 }
 
+/* Static helpers to precompute the relay decisions of an SVC context, along
+ * the same lines as what we do for the simulcast contexts above */
+static uint32_t janus_rtp_svc_context_state(janus_rtp_svc_context *context) {
+	return ((uint32_t)(context->spatial+1)) | ((uint32_t)(context->spatial_target+1) << 4) |
+		((uint32_t)(context->temporal+1) << 8) | ((uint32_t)(context->temporal_target+1) << 12) | (1 << 16);
+}
+static void janus_rtp_svc_context_update_decisions(janus_rtp_svc_context *context, uint32_t state) {
+	context->decisions_state = state;
+	/* The shortcut only applies when no spatial/temporal switch is pending */
+	context->decisions_steady = (context->spatial == context->spatial_target &&
+		context->temporal == context->temporal_target);
+	int s = 0, t = 0;
+	for(s = 0; s < 3; s++) {
+		for(t = 0; t < 4; t++) {
+			context->decisions[s][t] = (s > context->spatial || t > context->temporal) ?
+				JANUS_RTP_RELAY_DROP : JANUS_RTP_RELAY_FORWARD;
+		}
+	}
+}
+
 gboolean janus_rtp_svc_context_process_rtp(janus_rtp_svc_context *context,
 		char *buf, int len, uint8_t *dd_content, int dd_len,
 		janus_videocodec vcodec, janus_vp9_svc_info *info, janus_rtp_switching_context *sc) {
@@ -1456,6 +1838,10 @@ gboolean janus_rtp_svc_context_process_rtp(janus_rtp_svc_context *context,
 	char *payload = janus_rtp_payload(buf, len, &plen);
 	if(payload == NULL)
 		return FALSE;
+	/* Check if the precomputed decisions are stale (e.g., a target changed) */
+	uint32_t state = janus_rtp_svc_context_state(context);
+	if(state != context->decisions_state)
+		janus_rtp_svc_context_update_decisions(context, state);
 	/* Check if we should use the Dependency Descriptor */
 	if(vcodec == JANUS_VIDEOCODEC_AV1) {
 		/* We do, make sure the data is there */
@@ -1473,6 +1859,21 @@ gboolean janus_rtp_svc_context_process_rtp(janus_rtp_svc_context *context,
 			/* We couldn't find the template, relay as it is */
 			return TRUE;
 		}
+		if(context->decisions_steady && t->spatial >= 0 && t->spatial <= 2 &&
+				t->temporal >= 0 && t->temporal <= 3) {
+			/* No switch is pending, the decision is just a table lookup */
+			context->last_spatial_layer[t->spatial] = now;
+			if(context->decisions[t->spatial][t->temporal] == JANUS_RTP_RELAY_DROP) {
+				/* Drop the packet: update the context to make sure sequence number is increased normally later */
+				if(sc)
+					sc->base_seq++;
+				return FALSE;
+			}
+			/* If we stop at layer 0, we may need to set the marker bit ourselves */
+			if(ebit && context->spatial == t->spatial && !header->markerbit)
+				header->markerbit = 1;
+			return TRUE;
+		}
 		/* Now let's check if we should let the packet through or not */
 		gboolean keyframe = janus_av1_is_keyframe((const char *)payload, plen);
 		gboolean override_mark_bit = FALSE, has_marker_bit = header->markerbit;
@@ -1572,6 +1973,21 @@ gboolean janus_rtp_svc_context_process_rtp(janus_rtp_svc_context *context,
 	} else {
 		svc_info = *info;
 	}
+	if(context->decisions_steady && svc_info.spatial_layer >= 0 && svc_info.spatial_layer <= 2 &&
+			svc_info.temporal_layer >= 0 && svc_info.temporal_layer <= 3) {
+		/* No switch is pending, the decision is just a table lookup */
+		context->last_spatial_layer[svc_info.spatial_layer] = now;
+		if(context->decisions[svc_info.spatial_layer][svc_info.temporal_layer] == JANUS_RTP_RELAY_DROP) {
+			/* Drop the packet: update the context to make sure sequence number is increased normally later */
+			if(sc)
+				sc->base_seq++;
+			return FALSE;
+		}
+		/* If we stop at layer 0, we may need to set the marker bit ourselves */
+		if(svc_info.ebit && context->spatial == svc_info.spatial_layer && !header->markerbit)
+			header->markerbit = 1;
+		return TRUE;
+	}
 	/* Note: Following code inspired by the excellent job done by Sergio Garcia Murillo here:
 	 * https://github.com/medooze/media-server/blob/master/src/vp9/VP9LayerSelector.cpp */
 	gboolean keyframe = janus_vp9_is_keyframe((const char *)payload, plen);
@@ -295,6 +295,82 @@ int janus_rtp_header_extension_set_transport_wide_cc(char *buf, int len, int id,
 int janus_rtp_header_extension_parse_video_layers_allocation(char *buf, int len, int id,
 	int8_t *spatial_layers, int8_t *temporal_layers);
 
+/*! \brief Index of all the RTP extensions found in a packet with a single scan
+ * of the extension block (see janus_rtp_header_extension_parse_all): media
+ * paths that are interested in more than one extension can use this, and the
+ * related read helpers, rather than rescanning the whole block once per
+ * extension with the individual parse helpers above */
+#define JANUS_RTP_EXTENSIONS_INDEX_SIZE	16
+typedef struct janus_rtp_header_extension_index {
+	/*! \brief Pointer to the payload of each extension ID (NULL if not in the packet) */
+	char *data[JANUS_RTP_EXTENSIONS_INDEX_SIZE];
+	/*! \brief Length of the payload of each extension ID */
+	uint8_t length[JANUS_RTP_EXTENSIONS_INDEX_SIZE];
+} janus_rtp_header_extension_index;
+/*! \brief Helper to index all the RTP extensions in a packet with a single scan
+ * @note Extension IDs beyond the index size are ignored, but we never negotiate them
+ * @param[in] buf The packet data
+ * @param[in] len The packet data length in bytes
+ * @param[out] index The index to fill in
+ * @returns The number of extensions found, or a negative integer on error */
+int janus_rtp_header_extension_parse_all(char *buf, int len, janus_rtp_header_extension_index *index);
+/*! \brief Helper to read a ssrc-audio-level RTP extension from an extensions index
+ * @param[in] index The extensions index to read from
+ * @param[in] id The extension ID to look for
+ * @param[out] vad Whether the encoder thinks there's voice activity
+ * @param[out] level The level value in dBov (0=max, 127=min)
+ * @returns 0 if found, -1 otherwise */
+int janus_rtp_header_extension_read_audio_level(janus_rtp_header_extension_index *index,
+	int id, gboolean *vad, int *level);
+/*! \brief Helper to read a video-orientation RTP extension from an extensions index
+ * @param[in] index The extensions index to read from
+ * @param[in] id The extension ID to look for
+ * @param[out] c The value of the Camera (C) bit
+ * @param[out] f The value of the Flip (F) bit
+ * @param[out] r1 The value of the first Rotation (R1) bit
+ * @param[out] r0 The value of the second Rotation (R0) bit
+ * @returns 0 if found, -1 otherwise */
+int janus_rtp_header_extension_read_video_orientation(janus_rtp_header_extension_index *index,
+	int id, gboolean *c, gboolean *f, gboolean *r1, gboolean *r0);
+/*! \brief Helper to read a playout-delay RTP extension from an extensions index
+ * @param[in] index The extensions index to read from
+ * @param[in] id The extension ID to look for
+ * @param[out] min_delay The minimum delay value
+ * @param[out] max_delay The maximum delay value
+ * @returns 0 if found, -1 otherwise */
+int janus_rtp_header_extension_read_playout_delay(janus_rtp_header_extension_index *index,
+	int id, uint16_t *min_delay, uint16_t *max_delay);
+/*! \brief Helper to read a dependency descriptor RTP extension from an extensions index
+ * @param[in] index The extensions index to read from
+ * @param[in] id The extension ID to look for
+ * @param[out] dd_item Buffer where the dependency descriptor will be written
+ * @param[out] dd_len Size of the input/output buffer, will be updated with the size of the data
+ * @returns 0 if found, -1 otherwise */
+int janus_rtp_header_extension_read_dependency_desc(janus_rtp_header_extension_index *index,
+	int id, uint8_t *dd_item, int *dd_len);
+/*! \brief Helper to read an abs-capture-time RTP extension from an extensions index
+ * @param[in] index The extensions index to read from
+ * @param[in] id The extension ID to look for
+ * @param[out] abs_ts Variable where the parsed abs-capture-time value will be stored
+ * @returns 0 if found, -1 otherwise */
+int janus_rtp_header_extension_read_abs_capture_time(janus_rtp_header_extension_index *index,
+	int id, uint64_t *abs_ts);
+/*! \brief Helper to read a transport wide sequence number from an extensions index
+ * @param[in] index The extensions index to read from
+ * @param[in] id The extension ID to look for
+ * @param[out] transSeqNum Variable to read the transport wide sequence number in
+ * @returns 0 if found, -1 otherwise */
+int janus_rtp_header_extension_read_transport_wide_cc(janus_rtp_header_extension_index *index,
+	int id, uint16_t *transSeqNum);
+/*! \brief Helper to read a video layers allocation from an extensions index
+ * @param[in] index The extensions index to read from
+ * @param[in] id The extension ID to look for
+ * @param[out] spatial_layers Variable where the parsed spatial layers value will be stored
+ * @param[out] temporal_layers Variable where the parsed temporal layers value will be stored
+ * @returns 0 if found, -1 otherwise */
+int janus_rtp_header_extension_read_video_layers_allocation(janus_rtp_header_extension_index *index,
+	int id, int8_t *spatial_layers, int8_t *temporal_layers);
+
 /*! \brief Helper to replace the ID of an RTP extension with a different one (e.g.,
  * to turn a repaired-rtp-stream-id into a rtp-stream-id after a successful rtx)
  * @param[in] buf The packet data
@@ -342,6 +418,37 @@ int janus_rtp_skew_compensate_audio(janus_rtp_header *header, janus_rtp_switchin
  * @returns 0 if no compensation is needed, -N if a N packets drop must be performed, N if a N sequence numbers jump has been performed */
 int janus_rtp_skew_compensate_video(janus_rtp_header *header, janus_rtp_switching_context *context, gint64 now);
 
+/*! \brief Talk detection context, tracking a smoothed audio level for a stream:
+ * since the core parses the ssrc-audio-level extension once at ingest, plugins
+ * interested in active speaker detection can feed those levels to one of these
+ * contexts, rather than each implementing their own accumulators. The level is
+ * tracked via an exponentially weighted moving average, so that a stream is
+ * flagged as talking as soon as the smoothed level crosses the threshold, while
+ * a hangover window prevents the state from flapping on short pauses */
+typedef struct janus_audiolevel_context {
+	/*! \brief Whether the stream is currently flagged as talking */
+	gboolean talking;
+	/*! \brief Smoothed audio level, in dBov (EWMA of the extension values) */
+	double level_avg;
+	/*! \brief Number of levels processed so far (saturates at the window size) */
+	int active_packets;
+	/*! \brief Consecutive packets above the threshold while talking (hangover) */
+	int hangover;
+} janus_audiolevel_context;
+
+/*! \brief Set (or reset) the context fields to their default values
+ * @param[in] context The context to (re)set */
+void janus_audiolevel_context_reset(janus_audiolevel_context *context);
+
+/*! \brief Feed a new audio level to a talk detection context
+ * @param[in] context The context to update
+ * @param[in] level The audio level from the RTP extension, in dBov (0=loudest, 127=muted)
+ * @param[in] active_packets How many packets the average should span (also used as the hangover window)
+ * @param[in] level_average The average level below which the stream is considered talking
+ * @returns TRUE if the talking state changed as a result of this packet, FALSE otherwise */
+gboolean janus_audiolevel_context_process(janus_audiolevel_context *context,
+	int level, int active_packets, int level_average);
+
 
 /** @name Janus AV1-SVC processing methods
  */
@@ -394,6 +501,19 @@ gboolean janus_av1_svc_context_process_dd(janus_av1_svc_context *context,
 /** @name Janus simulcast processing methods
  */
 ///@{
+/*! \brief Precomputed relay decisions for the per-packet path: when no layer
+ * switch is pending, the simulcast/SVC contexts below only need to look the
+ * decision up in a small table that's refreshed when the targets change,
+ * rather than evaluate all the transition conditionals on every packet */
+typedef enum janus_rtp_relay_decision {
+	/*! \brief No precomputed decision, run the full per-packet logic */
+	JANUS_RTP_RELAY_SLOW = 0,
+	/*! \brief Relay the packet as it is */
+	JANUS_RTP_RELAY_FORWARD,
+	/*! \brief Drop the packet, fixing the sequence numbers accordingly */
+	JANUS_RTP_RELAY_DROP
+} janus_rtp_relay_decision;
+
 /*! \brief Helper struct for processing and tracking simulcast streams */
 typedef struct janus_rtp_simulcasting_context {
 	/*! \brief RTP Stream extension ID, if any */
@@ -418,6 +538,18 @@ typedef struct janus_rtp_simulcasting_context {
 	gboolean changed_temporal;
 	/*! \brief Whether we need to send the user a keyframe request (PLI) */
 	gboolean need_pli;
+	/*! \brief Whether no substream/temporal switch is pending, meaning the
+	 * precomputed decisions below can be used on the per-packet path */
+	gboolean decisions_steady;
+	/*! \brief Whether the decision depends on the temporal layer of the
+	 * packet, meaning the payload descriptor needs to be parsed at all */
+	gboolean decisions_need_tid;
+	/*! \brief Precomputed relay decision for each temporal layer of the
+	 * current substream (see janus_rtp_relay_decision) */
+	int8_t decisions[4];
+	/*! \brief Signature of the layers state the decisions were computed for,
+	 * used to detect when the targets change and a refresh is needed */
+	uint32_t decisions_state;
 } janus_rtp_simulcasting_context;
 
 /*! \brief Set (or reset) the context fields to their default values
@@ -440,6 +572,13 @@ void janus_rtp_simulcasting_prepare(json_t *simulcast, int *rid_ext_id, uint32_t
  * @param[in] rid_mutex A mutex that must be acquired before cleaning up, if any */
 void janus_rtp_simulcasting_cleanup(int *rid_ext_id, uint32_t *ssrcs, char **rids, janus_mutex *rid_mutex);
 
+/*! \brief Helper method to check whether an RTP payload contains a keyframe, for the codecs where we can detect that
+ * @param[in] vcodec Video codec of the RTP payload
+ * @param[in] payload The RTP payload to process
+ * @param[in] plen The length of the RTP payload
+ * @returns TRUE if the payload contains a keyframe, FALSE otherwise */
+gboolean janus_rtp_is_keyframe(janus_videocodec vcodec, const char *payload, int plen);
+
 /*! \brief Process an RTP packet, and decide whether this should be relayed or not, updating the context accordingly
  * \note Calling this method resets the \c changed_substream , \c changed_temporal and \c need_pli
  * properties, and updates them according to the decisions made after processing the packet
@@ -457,6 +596,25 @@ void janus_rtp_simulcasting_cleanup(int *rid_ext_id, uint32_t *ssrcs, char **rid
 gboolean janus_rtp_simulcasting_context_process_rtp(janus_rtp_simulcasting_context *context,
 	char *buf, int len, uint8_t *dd_content, int dd_len, uint32_t *ssrcs, char **rids,
 	janus_videocodec vcodec, janus_rtp_switching_context *sc, janus_mutex *rid_mutex);
+
+/*! \brief Same as janus_rtp_simulcasting_context_process_rtp, but letting the caller pass a
+ * keyframe flag it already computed: when the same packet is processed by many contexts (e.g.,
+ * once per subscriber in a fan-out), this avoids parsing the payload descriptor each time
+ * @param[in] context The simulcasting context to use
+ * @param[in] buf The RTP packet to process
+ * @param[in] len The length of the RTP packet (header, extension and payload)
+ * @param[in] dd_content The Dependency Descriptor RTP extension data, if available
+ * @param[in] dd_len Length of the Dependency Descriptor data, if available
+ * @param[in] ssrcs The simulcast SSRCs to refer to (may be updated if rids are involved)
+ * @param[in] rids The simulcast rids to refer to, if any
+ * @param[in] vcodec Video codec of the RTP payload
+ * @param[in] sc RTP switching context to refer to, if any (only needed for VP8 and dropping temporal layers)
+ * @param[in] rid_mutex A mutex that must be acquired before reading the rids array, if any
+ * @param[in] keyframe Whether this packet is known to be (1) or not be (0) a keyframe, or -1 if unknown
+ * @returns TRUE if the packet should be relayed, FALSE if it should be dropped instead */
+gboolean janus_rtp_simulcasting_context_process_rtp_full(janus_rtp_simulcasting_context *context,
+	char *buf, int len, uint8_t *dd_content, int dd_len, uint32_t *ssrcs, char **rids,
+	janus_videocodec vcodec, janus_rtp_switching_context *sc, janus_mutex *rid_mutex, int keyframe);
 ///@}
 
 /** @name Janus SVC processing methods
@@ -484,6 +642,15 @@ typedef struct janus_rtp_svc_context {
 	gboolean changed_temporal;
 	/*! \brief Whether we need to send the user a keyframe request (PLI) */
 	gboolean need_pli;
+	/*! \brief Whether no spatial/temporal switch is pending, meaning the
+	 * precomputed decisions below can be used on the per-packet path */
+	gboolean decisions_steady;
+	/*! \brief Precomputed relay decision for each (spatial, temporal) layer
+	 * pair (see janus_rtp_relay_decision) */
+	int8_t decisions[3][4];
+	/*! \brief Signature of the layers state the decisions were computed for,
+	 * used to detect when the targets change and a refresh is needed */
+	uint32_t decisions_state;
 } janus_rtp_svc_context;
 
 /*! \brief Set (or reset) the context fields to their default values
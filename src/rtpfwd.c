@@ -13,7 +13,15 @@
  * \ref protocols
  */
 
+#ifdef __linux__
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <sys/socket.h>
+#endif
+
 #include "rtpfwd.h"
+#include "lfq.h"
 #include "rtcp.h"
 #include "utils.h"
 
@@ -21,6 +29,11 @@
 static janus_mutex rtpfwds_mutex = JANUS_MUTEX_INITIALIZER;
 static GHashTable *rtpfwds = NULL;
 static gboolean ipv6_disabled = FALSE;
+/* Inter-instance buses, indexed by "host:port" */
+static janus_mutex rtpbuses_mutex = JANUS_MUTEX_INITIALIZER;
+static GHashTable *rtpbuses = NULL;
+/* Magic word identifying bus frames ("JB") */
+#define JANUS_RTP_FORWARDER_BUS_MAGIC	0x4A42
 /* RTCP stuff */
 static GMainContext *rtcpfwd_ctx = NULL;
 static GMainLoop *rtcpfwd_loop = NULL;
@@ -34,10 +47,48 @@ static void *janus_rtp_forwarder_rtcp_thread(void *data) {
 	return NULL;
 }
 
+/* Crypto workers: SRTP forwarders don't encrypt inline on the media thread,
+ * but hand their packets over to a small pool of threads that take care of
+ * srtp_protect() and of the actual sending; each forwarder is pinned to one
+ * of the workers when it's created, so that its packets are always sent in
+ * order. The pool is only spawned when the first SRTP forwarder shows up,
+ * meaning setups that only do plain RTP forwarding never pay for it */
+#define JANUS_RTP_FORWARDER_CRYPTO_WORKERS	4
+#define JANUS_RTP_FORWARDER_CRYPTO_QUEUE	1024
+typedef struct janus_rtp_forwarder_crypto_job {
+	/* Forwarder the packet belongs to (we hold a reference while queued) */
+	janus_rtp_forwarder *rf;
+	/* Length of the plaintext packet */
+	int len;
+	/* Packet storage (encrypted in place, so it covers the SRTP overhead too) */
+	char buffer[1500];
+} janus_rtp_forwarder_crypto_job;
+static int crypto_workers = 0;
+static GThread *crypto_threads[JANUS_RTP_FORWARDER_CRYPTO_WORKERS];
+static janus_lfq *crypto_queues[JANUS_RTP_FORWARDER_CRYPTO_WORKERS];
+static janus_lfq *crypto_jobs_pool = NULL;
+static volatile gint crypto_stopping = 0;
+static guint crypto_assignments = 0;
+static void janus_rtp_forwarder_crypto_pool_start(void);
+static void *janus_rtp_forwarder_crypto_thread(void *data);
+/* Static helper to queue a packet on a batch, flushing it first when needed */
+static void janus_rtp_forwarder_batch_queue(janus_rtp_forwarder_batch *batch,
+	int fd, char *buffer, int len, struct sockaddr *address, socklen_t addrlen);
+
+/* Static helpers for the inter-instance buses */
+static void janus_rtp_forwarder_bus_free(const janus_refcount *b_ref);
+static gboolean janus_rtp_forwarder_bus_keepalive(gpointer user_data);
+static void janus_rtp_forwarder_bus_send(janus_rtp_forwarder_bus *bus, uint16_t stream_id,
+	char *buffer, int len, janus_rtp_forwarder_batch *batch);
+
 /* Static helper to quickly unref an RTP forwarder instance */
 static void janus_rtp_forwarder_unref(janus_rtp_forwarder *rf);
 /* Static helper to free an RTP forwarder instance when the reference goes to 0 */
 static void janus_rtp_forwarder_free(const janus_refcount *f_ref);
+/* Static helper implementing the actual forwarding, either right away or on a batch */
+static void janus_rtp_forwarder_send_rtp_internal(janus_rtp_forwarder *rf, char *buffer, int len, int substream,
+	uint32_t *ssrcs, char **rids, janus_videocodec vcodec, janus_mutex *rid_mutex,
+	janus_rtp_forwarder_batch *batch);
 
 /* \brief RTP forwarders code initialization
  * @returns 0 in case of success, a negative integer on errors */
@@ -45,6 +96,9 @@ int janus_rtp_forwarders_init(void) {
 	/* Initialize the forwarders table and muted */
 	rtpfwds = g_hash_table_new_full(g_str_hash, g_str_equal,
 		(GDestroyNotify)g_free, (GDestroyNotify)janus_rtp_forwarder_unref);
+	/* Initialize the table of inter-instance buses too */
+	rtpbuses = g_hash_table_new_full(g_str_hash, g_str_equal,
+		(GDestroyNotify)g_free, (GDestroyNotify)janus_rtp_forwarder_bus_unref);
 	/* Let's check if IPv6 is disabled, as we may need to know for forwarders */
 	int fd = socket(AF_INET6, SOCK_DGRAM, IPPROTO_UDP);
 	if(fd < 0) {
@@ -77,6 +131,26 @@ int janus_rtp_forwarders_init(void) {
 
 /* \brief RTP forwarders code de-initialization */
 void janus_rtp_forwarders_deinit(void) {
+	/* Tear down the inter-instance buses, if any */
+	janus_mutex_lock(&rtpbuses_mutex);
+	if(rtpbuses != NULL) {
+		GHashTableIter iter;
+		gpointer value;
+		g_hash_table_iter_init(&iter, rtpbuses);
+		while(g_hash_table_iter_next(&iter, NULL, &value)) {
+			janus_rtp_forwarder_bus *bus = (janus_rtp_forwarder_bus *)value;
+			g_atomic_int_set(&bus->destroyed, 1);
+			if(bus->keepalive != NULL) {
+				g_source_destroy(bus->keepalive);
+				g_source_unref(bus->keepalive);
+				bus->keepalive = NULL;
+				janus_refcount_decrease(&bus->ref);
+			}
+		}
+		g_hash_table_destroy(rtpbuses);
+		rtpbuses = NULL;
+	}
+	janus_mutex_unlock(&rtpbuses_mutex);
 	/* Stop the RTCP receiver thread */
 	if(rtcpfwd_thread != NULL) {
 		if(g_main_loop_is_running(rtcpfwd_loop)) {
@@ -86,6 +160,25 @@ void janus_rtp_forwarders_deinit(void) {
 		g_thread_join(rtcpfwd_thread);
 		rtcpfwd_thread = NULL;
 	}
+	/* Stop the crypto workers, if any (they drain their queues before leaving) */
+	if(crypto_workers > 0) {
+		g_atomic_int_set(&crypto_stopping, 1);
+		int i = 0;
+		for(i=0; i<crypto_workers; i++) {
+			g_thread_join(crypto_threads[i]);
+			crypto_threads[i] = NULL;
+			janus_lfq_destroy(crypto_queues[i]);
+			crypto_queues[i] = NULL;
+		}
+		crypto_workers = 0;
+	}
+	if(crypto_jobs_pool != NULL) {
+		janus_rtp_forwarder_crypto_job *job = NULL;
+		while((job = janus_lfq_try_pop(crypto_jobs_pool)) != NULL)
+			g_free(job);
+		janus_lfq_destroy(crypto_jobs_pool);
+		crypto_jobs_pool = NULL;
+	}
 	/* Get rid of the table */
 	janus_mutex_lock(&rtpfwds_mutex);
 	g_hash_table_destroy(rtpfwds);
@@ -141,6 +234,88 @@ static GSourceFuncs janus_rtp_forwarder_rtcp_funcs = {
 	NULL, NULL
 };
 
+/* Body of the crypto workers: each worker pops packets from its own queue,
+ * encrypts them and queues them on a local batch, which is flushed whenever
+ * the queue runs empty; since an SRTP forwarder is always served by the same
+ * worker, its packets are guaranteed to be sent in order */
+static void *janus_rtp_forwarder_crypto_thread(void *data) {
+	int id = GPOINTER_TO_INT(data);
+	janus_lfq *queue = crypto_queues[id];
+	JANUS_LOG(LOG_VERB, "Joining crypto thread #%d for RTP forwarders...\n", id);
+	janus_rtp_forwarder_batch *batch = g_malloc0(sizeof(janus_rtp_forwarder_batch));
+	janus_rtp_forwarder_crypto_job *job = NULL;
+	while(!g_atomic_int_get(&crypto_stopping) || janus_lfq_length(queue) > 0) {
+		job = (janus_rtp_forwarder_crypto_job *)janus_lfq_try_pop(queue);
+		if(job == NULL) {
+			/* Nothing queued: flush what we batched so far, and yield briefly */
+			janus_rtp_forwarder_batch_flush(batch);
+			g_usleep(500);
+			continue;
+		}
+		janus_rtp_forwarder *rf = job->rf;
+		if(!g_atomic_int_get(&rf->destroyed)) {
+			/* Encrypt the packet in place, and queue it for sending */
+			int protected = job->len;
+			int res = srtp_protect(rf->srtp_ctx, job->buffer, &protected);
+			if(res != srtp_err_status_ok) {
+				janus_rtp_header *header = (janus_rtp_header *)job->buffer;
+				guint32 timestamp = ntohl(header->timestamp);
+				guint16 seq = ntohs(header->seq_number);
+				JANUS_LOG(LOG_ERR, "Error encrypting %s packet... %s (len=%d-->%d, ts=%"SCNu32", seq=%"SCNu16")...\n",
+					(rf->is_video ? "Video" : "Audio"), janus_srtp_error_str(res), job->len, protected, timestamp, seq);
+			} else if(rf->bus != NULL) {
+				/* This forwarder is multiplexed on an inter-instance bus */
+				janus_rtp_forwarder_bus_send(rf->bus, rf->bus_stream_id, job->buffer, protected, batch);
+			} else {
+				struct sockaddr *address = (rf->serv_addr.sin_family == AF_INET ?
+					(struct sockaddr *)&rf->serv_addr : (struct sockaddr *)&rf->serv_addr6);
+				size_t addrlen = (rf->serv_addr.sin_family == AF_INET ? sizeof(rf->serv_addr) : sizeof(rf->serv_addr6));
+				janus_rtp_forwarder_batch_queue(batch, rf->udp_fd, job->buffer, protected, address, addrlen);
+			}
+		}
+		janus_refcount_decrease(&rf->ref);
+		/* Return the job to the pool, so that the media threads can reuse it */
+		job->rf = NULL;
+		if(!janus_lfq_try_push(crypto_jobs_pool, job))
+			g_free(job);
+	}
+	janus_rtp_forwarder_batch_flush(batch);
+	g_free(batch);
+	JANUS_LOG(LOG_VERB, "Leaving crypto thread #%d for RTP forwarders...\n", id);
+	return NULL;
+}
+
+/* Static helper to lazily spawn the crypto workers, the first time an SRTP
+ * forwarder is created (invoked with the rtpfwds_mutex held) */
+static void janus_rtp_forwarder_crypto_pool_start(void) {
+	if(crypto_workers > 0)
+		return;
+	g_atomic_int_set(&crypto_stopping, 0);
+	crypto_jobs_pool = janus_lfq_new(JANUS_RTP_FORWARDER_CRYPTO_QUEUE);
+	int workers = (int)MIN(JANUS_RTP_FORWARDER_CRYPTO_WORKERS, g_get_num_processors());
+	int i = 0;
+	for(i=0; i<workers; i++) {
+		crypto_queues[i] = janus_lfq_new(JANUS_RTP_FORWARDER_CRYPTO_QUEUE);
+		GError *error = NULL;
+		char tname[16];
+		g_snprintf(tname, sizeof(tname), "fwdcrypto %d", i);
+		crypto_threads[i] = g_thread_try_new(tname, janus_rtp_forwarder_crypto_thread, GINT_TO_POINTER(i), &error);
+		if(error != NULL) {
+			/* We show the error but it's not fatal: encryption stays inline */
+			JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch a crypto thread for RTP forwarders...\n",
+				error->code, error->message ? error->message : "??");
+			g_error_free(error);
+			janus_lfq_destroy(crypto_queues[i]);
+			crypto_queues[i] = NULL;
+			break;
+		}
+		crypto_workers++;
+	}
+	if(crypto_workers > 0) {
+		JANUS_LOG(LOG_INFO, "Spawned %d crypto worker(s) to encrypt the traffic of SRTP forwarders\n", crypto_workers);
+	}
+}
+
 /* Create a new forwarder */
 janus_rtp_forwarder *janus_rtp_forwarder_create(const char *ctx,
 		uint32_t stream_id, int udp_fd, const char *host, int port,
@@ -174,6 +349,8 @@ janus_rtp_forwarder *janus_rtp_forwarder_create(const char *ctx,
 	rf->rtcp_fd = -1;
 	rf->local_rtcp_port = 0;
 	rf->remote_rtcp_port = 0;
+	/* No crypto worker, unless SRTP is involved */
+	rf->crypto_worker = -1;
 	/* First of all, let's check if we need to setup an SRTP forwarder */
 	if(!is_data && srtp_suite > 0 && srtp_crypto != NULL) {
 		/* Base64 decode the crypto string and set it as the SRTP context */
@@ -209,6 +386,13 @@ janus_rtp_forwarder *janus_rtp_forwarder_create(const char *ctx,
 			return NULL;
 		}
 		rf->is_srtp = TRUE;
+		/* Encryption is offloaded to a crypto worker: spawn the pool
+		 * if this is the first SRTP forwarder (we have the mutex), and
+		 * pin the forwarder to one of the workers, round robin */
+		if(crypto_workers == 0)
+			janus_rtp_forwarder_crypto_pool_start();
+		if(crypto_workers > 0)
+			rf->crypto_worker = (int)(crypto_assignments++ % (guint)crypto_workers);
 	}
 	rf->is_video = is_video;
 	rf->payload_type = pt;
@@ -328,14 +512,89 @@ int janus_rtp_forwarder_add_rtcp(janus_rtp_forwarder *rf, int rtcp_port,
 	return 0;
 }
 
+/* Static helper to queue a packet on a batch, flushing it first if it's full
+ * or if the queued packets are directed to a different socket */
+static void janus_rtp_forwarder_batch_queue(janus_rtp_forwarder_batch *batch,
+		int fd, char *buffer, int len, struct sockaddr *address, socklen_t addrlen) {
+	if(len > 1500)
+		return;
+	if(batch->count == JANUS_RTP_FORWARDER_BATCH_SIZE || (batch->count > 0 && batch->fd != fd))
+		janus_rtp_forwarder_batch_flush(batch);
+	batch->fd = fd;
+	memcpy(batch->buffers[batch->count], buffer, len);
+	batch->lengths[batch->count] = len;
+	memcpy(&batch->addresses[batch->count], address, addrlen);
+	batch->addrlens[batch->count] = addrlen;
+	batch->count++;
+}
+
+/* Flush a batch of queued packets, with a single sendmmsg() where available */
+void janus_rtp_forwarder_batch_flush(janus_rtp_forwarder_batch *batch) {
+	if(batch == NULL || batch->count == 0)
+		return;
+#ifdef __linux__
+	struct mmsghdr msgs[JANUS_RTP_FORWARDER_BATCH_SIZE];
+	struct iovec iovs[JANUS_RTP_FORWARDER_BATCH_SIZE];
+	memset(msgs, 0, sizeof(msgs));
+	int i = 0;
+	for(i=0; i<batch->count; i++) {
+		iovs[i].iov_base = batch->buffers[i];
+		iovs[i].iov_len = batch->lengths[i];
+		msgs[i].msg_hdr.msg_iov = &iovs[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+		msgs[i].msg_hdr.msg_name = &batch->addresses[i];
+		msgs[i].msg_hdr.msg_namelen = batch->addrlens[i];
+	}
+	int sent = 0;
+	while(sent < batch->count) {
+		int res = sendmmsg(batch->fd, msgs + sent, batch->count - sent, 0);
+		if(res < 0) {
+			JANUS_LOG(LOG_HUGE, "Error flushing batch of forwarded RTP packets... %s (count=%d)\n",
+				g_strerror(errno), batch->count - sent);
+			break;
+		}
+		sent += res;
+	}
+#else
+	int i = 0;
+	for(i=0; i<batch->count; i++) {
+		if(sendto(batch->fd, batch->buffers[i], batch->lengths[i], 0,
+				(struct sockaddr *)&batch->addresses[i], batch->addrlens[i]) < 0) {
+			JANUS_LOG(LOG_HUGE, "Error forwarding batched RTP packet... %s (len=%d)\n",
+				g_strerror(errno), batch->lengths[i]);
+		}
+	}
+#endif
+	batch->count = 0;
+}
+
 /* Simplified frontend to the forwarder function */
 void janus_rtp_forwarder_send_rtp(janus_rtp_forwarder *rf, char *buffer, int len, int substream) {
-	janus_rtp_forwarder_send_rtp_full(rf, buffer, len, substream, NULL, NULL, JANUS_VIDEOCODEC_NONE, NULL);
+	janus_rtp_forwarder_send_rtp_internal(rf, buffer, len, substream, NULL, NULL, JANUS_VIDEOCODEC_NONE, NULL, NULL);
+}
+
+/* Batched frontend to the forwarder function */
+void janus_rtp_forwarder_send_rtp_batched(janus_rtp_forwarder *rf, char *buffer, int len, int substream,
+		janus_rtp_forwarder_batch *batch) {
+	janus_rtp_forwarder_send_rtp_internal(rf, buffer, len, substream, NULL, NULL, JANUS_VIDEOCODEC_NONE, NULL, batch);
 }
 
 /* Helper function to forward an RTP packet within the context of a forwarder */
 void janus_rtp_forwarder_send_rtp_full(janus_rtp_forwarder *rf, char *buffer, int len, int substream,
 		uint32_t *ssrcs, char **rids, janus_videocodec vcodec, janus_mutex *rid_mutex) {
+	janus_rtp_forwarder_send_rtp_internal(rf, buffer, len, substream, ssrcs, rids, vcodec, rid_mutex, NULL);
+}
+
+/* Batched frontend to the extended forwarder function */
+void janus_rtp_forwarder_send_rtp_full_batched(janus_rtp_forwarder *rf, char *buffer, int len, int substream,
+		uint32_t *ssrcs, char **rids, janus_videocodec vcodec, janus_mutex *rid_mutex,
+		janus_rtp_forwarder_batch *batch) {
+	janus_rtp_forwarder_send_rtp_internal(rf, buffer, len, substream, ssrcs, rids, vcodec, rid_mutex, batch);
+}
+
+static void janus_rtp_forwarder_send_rtp_internal(janus_rtp_forwarder *rf, char *buffer, int len, int substream,
+		uint32_t *ssrcs, char **rids, janus_videocodec vcodec, janus_mutex *rid_mutex,
+		janus_rtp_forwarder_batch *batch) {
 	if(!rf || g_atomic_int_get(&rf->destroyed) || !buffer || !janus_is_rtp(buffer, len))
 		return;
 	/* Access the RTP header */
@@ -369,12 +628,38 @@ void janus_rtp_forwarder_send_rtp_full(janus_rtp_forwarder *rf, char *buffer, in
 	/* Check if this is an RTP or SRTP forwarder */
 	if(!rf->is_srtp) {
 		/* Plain RTP */
-		struct sockaddr *address = (rf->serv_addr.sin_family == AF_INET ?
-			(struct sockaddr *)&rf->serv_addr : (struct sockaddr *)&rf->serv_addr6);
-		size_t addrlen = (rf->serv_addr.sin_family == AF_INET ? sizeof(rf->serv_addr) : sizeof(rf->serv_addr6));
-		if(sendto(rf->udp_fd, buffer, len, 0, address, addrlen) < 0) {
-			JANUS_LOG(LOG_HUGE, "Error forwarding RTP %s packet... %s (len=%d)...\n",
-				(rf->is_video ? "video" : "audio"), g_strerror(errno), len);
+		if(rf->bus != NULL) {
+			/* This forwarder is multiplexed on an inter-instance bus */
+			janus_rtp_forwarder_bus_send(rf->bus, rf->bus_stream_id, buffer, len, batch);
+		} else {
+			struct sockaddr *address = (rf->serv_addr.sin_family == AF_INET ?
+				(struct sockaddr *)&rf->serv_addr : (struct sockaddr *)&rf->serv_addr6);
+			size_t addrlen = (rf->serv_addr.sin_family == AF_INET ? sizeof(rf->serv_addr) : sizeof(rf->serv_addr6));
+			if(batch != NULL) {
+				janus_rtp_forwarder_batch_queue(batch, rf->udp_fd, buffer, len, address, addrlen);
+			} else if(sendto(rf->udp_fd, buffer, len, 0, address, addrlen) < 0) {
+				JANUS_LOG(LOG_HUGE, "Error forwarding RTP %s packet... %s (len=%d)...\n",
+					(rf->is_video ? "video" : "audio"), g_strerror(errno), len);
+			}
+		}
+	} else if(rf->crypto_worker != -1 && !g_atomic_int_get(&crypto_stopping)) {
+		/* SRTP, but this forwarder is pinned to a crypto worker: hand the
+		 * packet over, and let the worker encrypt and send it for us */
+		janus_rtp_forwarder_crypto_job *job = (janus_rtp_forwarder_crypto_job *)janus_lfq_try_pop(crypto_jobs_pool);
+		if(job == NULL)
+			job = g_malloc(sizeof(janus_rtp_forwarder_crypto_job));
+		memcpy(job->buffer, buffer, len);
+		job->len = len;
+		job->rf = rf;
+		janus_refcount_increase(&rf->ref);
+		if(!janus_lfq_try_push(crypto_queues[rf->crypto_worker], job)) {
+			/* The worker is falling behind, drop the packet rather than block the media thread */
+			JANUS_LOG(LOG_HUGE, "Crypto worker #%d backlog full, dropping %s packet... (len=%d)\n",
+				rf->crypto_worker, (rf->is_video ? "video" : "audio"), len);
+			janus_refcount_decrease(&rf->ref);
+			job->rf = NULL;
+			if(!janus_lfq_try_push(crypto_jobs_pool, job))
+				g_free(job);
 		}
 	} else {
 		/* SRTP: encrypt the packet before sending it */
@@ -388,11 +673,16 @@ void janus_rtp_forwarder_send_rtp_full(janus_rtp_forwarder *rf, char *buffer, in
 			guint16 seq = ntohs(header->seq_number);
 			JANUS_LOG(LOG_ERR, "Error encrypting %s packet... %s (len=%d-->%d, ts=%"SCNu32", seq=%"SCNu16")...\n",
 				(rf->is_video ? "Video" : "Audio"), janus_srtp_error_str(res), len, protected, timestamp, seq);
+		} else if(rf->bus != NULL) {
+			/* This forwarder is multiplexed on an inter-instance bus */
+			janus_rtp_forwarder_bus_send(rf->bus, rf->bus_stream_id, sbuf, protected, batch);
 		} else {
 			struct sockaddr *address = (rf->serv_addr.sin_family == AF_INET ?
 				(struct sockaddr *)&rf->serv_addr : (struct sockaddr *)&rf->serv_addr6);
 			size_t addrlen = (rf->serv_addr.sin_family == AF_INET ? sizeof(rf->serv_addr) : sizeof(rf->serv_addr6));
-			if(sendto(rf->udp_fd, sbuf, protected, 0, address, addrlen) < 0) {
+			if(batch != NULL) {
+				janus_rtp_forwarder_batch_queue(batch, rf->udp_fd, sbuf, protected, address, addrlen);
+			} else if(sendto(rf->udp_fd, sbuf, protected, 0, address, addrlen) < 0) {
 				JANUS_LOG(LOG_HUGE, "Error forwarding SRTP %s packet... %s (len=%d)...\n",
 					(rf->is_video ? "video" : "audio"), g_strerror(errno), protected);
 			}
@@ -405,6 +695,166 @@ void janus_rtp_forwarder_send_rtp_full(janus_rtp_forwarder *rf, char *buffer, in
 	rtp->seq_number = htons(seq_number);
 }
 
+/* Inter-instance buses: one multiplexed socket per remote instance, shared
+ * by all the streams headed there, rather than one socket+flow per stream */
+janus_rtp_forwarder_bus *janus_rtp_forwarder_bus_get(const char *host, uint16_t port) {
+	if(host == NULL || port == 0)
+		return NULL;
+	char id[1024];
+	g_snprintf(id, sizeof(id), "%s:%"SCNu16, host, port);
+	janus_mutex_lock(&rtpbuses_mutex);
+	if(rtpbuses == NULL) {
+		janus_mutex_unlock(&rtpbuses_mutex);
+		return NULL;
+	}
+	janus_rtp_forwarder_bus *bus = g_hash_table_lookup(rtpbuses, id);
+	if(bus != NULL) {
+		/* There's a bus to this instance already, reuse it */
+		janus_refcount_increase(&bus->ref);
+		janus_mutex_unlock(&rtpbuses_mutex);
+		return bus;
+	}
+	/* First stream headed to this instance, create the bus */
+	int fd = socket(strstr(host, ":") != NULL ? AF_INET6 : AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if(fd < 0) {
+		janus_mutex_unlock(&rtpbuses_mutex);
+		JANUS_LOG(LOG_ERR, "Error creating socket for bus to %s:%"SCNu16"... %d (%s)\n",
+			host, port, errno, g_strerror(errno));
+		return NULL;
+	}
+	bus = g_malloc0(sizeof(janus_rtp_forwarder_bus));
+	bus->host = g_strdup(host);
+	bus->port = port;
+	bus->fd = fd;
+	if(strstr(host, ":") != NULL) {
+		bus->serv_addr6.sin6_family = AF_INET6;
+		inet_pton(AF_INET6, host, &(bus->serv_addr6.sin6_addr));
+		bus->serv_addr6.sin6_port = htons(port);
+	} else {
+		bus->serv_addr.sin_family = AF_INET;
+		inet_pton(AF_INET, host, &(bus->serv_addr.sin_addr));
+		bus->serv_addr.sin_port = htons(port);
+	}
+	bus->next_stream_id = 1;	/* 0 is reserved for keepalives */
+	bus->last_sent = janus_get_monotonic_time();
+	janus_mutex_init(&bus->mutex);
+	janus_refcount_init(&bus->ref, janus_rtp_forwarder_bus_free);
+	/* Schedule periodic keepalives on the loop we already have for RTCP,
+	 * so that NAT bindings survive silence and the remote end can track
+	 * our liveness without each stream needing its own probing */
+	bus->keepalive = g_timeout_source_new_seconds(5);
+	janus_refcount_increase(&bus->ref);
+	g_source_set_callback(bus->keepalive, janus_rtp_forwarder_bus_keepalive, bus, NULL);
+	g_source_attach(bus->keepalive, rtcpfwd_ctx);
+	/* One more reference for the table */
+	janus_refcount_increase(&bus->ref);
+	g_hash_table_insert(rtpbuses, g_strdup(id), bus);
+	janus_mutex_unlock(&rtpbuses_mutex);
+	JANUS_LOG(LOG_INFO, "Created multiplexed bus to instance %s:%"SCNu16"\n", host, port);
+	return bus;
+}
+
+/* Release a reference to a bus */
+void janus_rtp_forwarder_bus_unref(janus_rtp_forwarder_bus *bus) {
+	if(bus)
+		janus_refcount_decrease(&bus->ref);
+}
+
+/* Attach an RTP forwarder to a bus, assigning it a compact stream ID */
+uint16_t janus_rtp_forwarder_bus_attach(janus_rtp_forwarder_bus *bus, janus_rtp_forwarder *rf) {
+	if(bus == NULL || g_atomic_int_get(&bus->destroyed) ||
+			rf == NULL || g_atomic_int_get(&rf->destroyed) || rf->bus != NULL)
+		return 0;
+	janus_mutex_lock(&bus->mutex);
+	uint16_t stream_id = bus->next_stream_id++;
+	if(bus->next_stream_id == 0) {
+		/* We wrapped around: 0 is reserved for keepalives */
+		bus->next_stream_id = 1;
+	}
+	bus->streams++;
+	janus_mutex_unlock(&bus->mutex);
+	/* The forwarder keeps its own reference to the bus */
+	janus_refcount_increase(&bus->ref);
+	rf->bus_stream_id = stream_id;
+	rf->bus = bus;
+	JANUS_LOG(LOG_VERB, "Attached %s forwarder to bus %s:%"SCNu16" (stream ID %"SCNu16")\n",
+		rf->is_data ? "data" : (rf->is_video ? "video" : "audio"), bus->host, bus->port, stream_id);
+	return stream_id;
+}
+
+/* Recognize a bus frame and extract the compact stream ID */
+int janus_rtp_forwarder_bus_demux(char *buffer, int len, uint16_t *stream_id) {
+	if(buffer == NULL || len < JANUS_RTP_FORWARDER_BUS_HDR)
+		return -1;
+	uint16_t word = 0;
+	memcpy(&word, buffer, sizeof(word));
+	if(ntohs(word) != JANUS_RTP_FORWARDER_BUS_MAGIC)
+		return -1;
+	memcpy(&word, buffer + 2, sizeof(word));
+	if(stream_id)
+		*stream_id = ntohs(word);
+	return JANUS_RTP_FORWARDER_BUS_HDR;
+}
+
+/* Write the multiplexing header at the beginning of a caller provided buffer */
+int janus_rtp_forwarder_bus_mux(char *buffer, int len, uint16_t stream_id) {
+	if(buffer == NULL || len < JANUS_RTP_FORWARDER_BUS_HDR)
+		return -1;
+	uint16_t word = htons(JANUS_RTP_FORWARDER_BUS_MAGIC);
+	memcpy(buffer, &word, sizeof(word));
+	word = htons(stream_id);
+	memcpy(buffer + 2, &word, sizeof(word));
+	return 0;
+}
+
+/* Static helper to send a frame on a bus, prefixing it with the multiplexing header */
+static void janus_rtp_forwarder_bus_send(janus_rtp_forwarder_bus *bus, uint16_t stream_id,
+		char *buffer, int len, janus_rtp_forwarder_batch *batch) {
+	if(bus == NULL || g_atomic_int_get(&bus->destroyed) ||
+			len < 0 || len + JANUS_RTP_FORWARDER_BUS_HDR > 1500)
+		return;
+	char mbuf[1500];
+	uint16_t word = htons(JANUS_RTP_FORWARDER_BUS_MAGIC);
+	memcpy(mbuf, &word, sizeof(word));
+	word = htons(stream_id);
+	memcpy(mbuf + 2, &word, sizeof(word));
+	if(buffer != NULL && len > 0)
+		memcpy(mbuf + JANUS_RTP_FORWARDER_BUS_HDR, buffer, len);
+	int mlen = len + JANUS_RTP_FORWARDER_BUS_HDR;
+	struct sockaddr *address = (bus->serv_addr.sin_family == AF_INET ?
+		(struct sockaddr *)&bus->serv_addr : (struct sockaddr *)&bus->serv_addr6);
+	size_t addrlen = (bus->serv_addr.sin_family == AF_INET ? sizeof(bus->serv_addr) : sizeof(bus->serv_addr6));
+	if(batch != NULL) {
+		janus_rtp_forwarder_batch_queue(batch, bus->fd, mbuf, mlen, address, addrlen);
+	} else if(sendto(bus->fd, mbuf, mlen, 0, address, addrlen) < 0) {
+		JANUS_LOG(LOG_HUGE, "Error sending frame on bus to %s:%"SCNu16"... %s (len=%d)\n",
+			bus->host, bus->port, g_strerror(errno), mlen);
+	}
+	/* Update the shared stats (approximate, we don't lock in the hot path) */
+	bus->sent_packets++;
+	bus->sent_bytes += mlen;
+	bus->last_sent = janus_get_monotonic_time();
+}
+
+/* Periodic keepalive: only sent if the bus has been silent for a while */
+static gboolean janus_rtp_forwarder_bus_keepalive(gpointer user_data) {
+	janus_rtp_forwarder_bus *bus = (janus_rtp_forwarder_bus *)user_data;
+	if(bus == NULL || g_atomic_int_get(&bus->destroyed))
+		return G_SOURCE_REMOVE;
+	if(janus_get_monotonic_time() - bus->last_sent > 4*G_USEC_PER_SEC)
+		janus_rtp_forwarder_bus_send(bus, 0, NULL, 0, NULL);
+	return G_SOURCE_CONTINUE;
+}
+
+/* Static helper to free a bus instance when the reference goes to 0 */
+static void janus_rtp_forwarder_bus_free(const janus_refcount *b_ref) {
+	janus_rtp_forwarder_bus *bus = janus_refcount_containerof(b_ref, janus_rtp_forwarder_bus, ref);
+	if(bus->fd > -1)
+		close(bus->fd);
+	g_free(bus->host);
+	g_free(bus);
+}
+
 /* Mark an RTP forwarder instance as destroyed */
 void janus_rtp_forwarder_destroy(janus_rtp_forwarder *rf) {
 	if(rf && g_atomic_int_compare_and_exchange(&rf->destroyed, 0, 1)) {
@@ -431,6 +881,12 @@ static void janus_rtp_forwarder_unref(janus_rtp_forwarder *rf) {
 /* Static helper to free an RTP forwarder instance when the reference goes to 0 */
 static void janus_rtp_forwarder_free(const janus_refcount *f_ref) {
 	janus_rtp_forwarder *rf = janus_refcount_containerof(f_ref, janus_rtp_forwarder, ref);
+	if(rf->bus != NULL) {
+		janus_mutex_lock(&rf->bus->mutex);
+		rf->bus->streams--;
+		janus_mutex_unlock(&rf->bus->mutex);
+		janus_refcount_decrease(&rf->bus->ref);
+	}
 	if(rf->rtcp_fd > -1)
 		close(rf->rtcp_fd);
 	if(rf->is_srtp) {
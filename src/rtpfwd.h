@@ -26,6 +26,8 @@ int janus_rtp_forwarders_init(void);
 /*! \brief RTP forwarders code de-initialization */
 void janus_rtp_forwarders_deinit(void);
 
+struct janus_rtp_forwarder_bus;
+
 /*! \brief Helper struct for implementing RTP forwarders */
 typedef struct janus_rtp_forwarder {
 	/* \brief Opaque pointer to the owner of this forwarder */
@@ -70,6 +72,15 @@ typedef struct janus_rtp_forwarder {
 	srtp_t srtp_ctx;
 	/* \brief The SRTP policy, in case SRTP is enabled */
 	srtp_policy_t srtp_policy;
+	/* \brief Crypto worker this forwarder is pinned to, in case SRTP is enabled
+	 * (-1 means encryption is performed inline, on the media thread) */
+	int crypto_worker;
+	/* \brief Inter-instance bus this forwarder is attached to, if any
+	 * \note While attached to a bus, packets are sent on the shared bus
+	 * socket, prefixed with the multiplexing header, and udp_fd is unused */
+	struct janus_rtp_forwarder_bus *bus;
+	/* \brief Compact stream ID identifying this forwarder on the bus */
+	uint16_t bus_stream_id;
 	/* \brief Opaque metadata property, in case it's useful to the owner
 	 * \note This can be anything (e.g., a string, an allocated struct, etc.),
 	 * as long as it can be freed with a single call to g_free(), as
@@ -132,8 +143,139 @@ void janus_rtp_forwarder_send_rtp(janus_rtp_forwarder *rf, char *buffer, int len
  * @param[in] rid_mutex A mutex that must be acquired before reading the rids array, if any */
 void janus_rtp_forwarder_send_rtp_full(janus_rtp_forwarder *rf, char *buffer, int len, int substream,
 	uint32_t *ssrcs, char **rids, janus_videocodec vcodec, janus_mutex *rid_mutex);
+
+/*! \brief Maximum number of packets a forwarders batch can hold before an implicit flush */
+#define JANUS_RTP_FORWARDER_BATCH_SIZE	64
+/*! \brief Helper struct to accumulate the packets that several forwarders sharing the
+ * same socket generate in a tight loop (e.g., one mixer iteration), so that they can
+ * be sent with a single sendmmsg() syscall per socket, rather than one sendto() each
+ * \note On platforms where sendmmsg() is not available, flushing a batch simply
+ * results in one sendto() per queued packet, as it used to be */
+typedef struct janus_rtp_forwarder_batch {
+	/*! \brief Socket all the currently queued packets will be sent on */
+	int fd;
+	/*! \brief Number of packets queued so far */
+	int count;
+	/*! \brief Lengths of the queued packets */
+	int lengths[JANUS_RTP_FORWARDER_BATCH_SIZE];
+	/*! \brief Recipient addresses of the queued packets */
+	struct sockaddr_storage addresses[JANUS_RTP_FORWARDER_BATCH_SIZE];
+	/*! \brief Sizes of the recipient addresses of the queued packets */
+	socklen_t addrlens[JANUS_RTP_FORWARDER_BATCH_SIZE];
+	/*! \brief Storage for the queued packets */
+	char buffers[JANUS_RTP_FORWARDER_BATCH_SIZE][1500];
+} janus_rtp_forwarder_batch;
+/*! \brief Batched version of janus_rtp_forwarder_send_rtp: instead of being sent
+ * right away, the packet is queued on the provided batch, which is implicitly
+ * flushed when full or when a packet for a different socket is queued; the caller
+ * must invoke janus_rtp_forwarder_batch_flush when done with the loop
+ * @param[in] rf The janus_rtp_forwarder instance to use
+ * @param[in] buffer The RTP packet buffer
+ * @param[in] len The length of the RTP packet buffer
+ * @param[in] substream In case the forwarder is relaying a single simulcast
+ * 		substream, the substream the packet belongs to (pass -1 to ignore)
+ * @param[in] batch The batch to queue the packet on (if NULL, the packet is sent right away) */
+void janus_rtp_forwarder_send_rtp_batched(janus_rtp_forwarder *rf, char *buffer, int len, int substream,
+	janus_rtp_forwarder_batch *batch);
+/*! \brief Batched version of janus_rtp_forwarder_send_rtp_full, for simulcast-aware
+ * forwarders that are iterated in a fan-out loop (e.g., all the forwarders of a
+ * publisher, which share the same socket); SRTP forwarders are batched too, as
+ * packets are encrypted before being queued
+ * @param[in] rf The janus_rtp_forwarder instance to use
+ * @param[in] buffer The RTP packet buffer
+ * @param[in] len The length of the RTP packet buffer
+ * @param[in] substream In case the forwarder is relaying a single simulcast
+ * 		substream, the substream the packet belongs to (pass -1 to ignore)
+ * @param[in] ssrcs The simulcast SSRCs to refer to (may be updated if rids are involved)
+ * @param[in] rids The simulcast rids to refer to, if any
+ * @param[in] vcodec Video codec of the RTP payload
+ * @param[in] rid_mutex A mutex that must be acquired before reading the rids array, if any
+ * @param[in] batch The batch to queue the packet on (if NULL, the packet is sent right away) */
+void janus_rtp_forwarder_send_rtp_full_batched(janus_rtp_forwarder *rf, char *buffer, int len, int substream,
+	uint32_t *ssrcs, char **rids, janus_videocodec vcodec, janus_mutex *rid_mutex,
+	janus_rtp_forwarder_batch *batch);
+/*! \brief Helper method to flush a batch of queued packets, sending them all at once
+ * @param[in] batch The janus_rtp_forwarder_batch instance to flush */
+void janus_rtp_forwarder_batch_flush(janus_rtp_forwarder_batch *batch);
+
 /*! \brief Helper method to free a janus_rtp_forwarder instance
  * @param[in] rf The janus_rtp_forwarder instance to free */
 void janus_rtp_forwarder_destroy(janus_rtp_forwarder *rf);
 
+/*! \brief Inter-instance media bus: a single multiplexed socket carrying many
+ * forwarded streams towards the same remote Janus instance, rather than one
+ * socket and flow per forwarded stream; every packet is prefixed with a small
+ * header containing a compact stream ID, so that the receiving end can
+ * demultiplex the streams, while keepalives and stats are shared by all the
+ * streams between the two instances */
+typedef struct janus_rtp_forwarder_bus {
+	/*! \brief Address of the remote instance */
+	char *host;
+	/*! \brief Port of the remote instance */
+	uint16_t port;
+	/*! \brief Single socket shared by all the streams on this bus */
+	int fd;
+	/*! \brief Remote address (IPv4) */
+	struct sockaddr_in serv_addr;
+	/*! \brief Remote address (IPv6) */
+	struct sockaddr_in6 serv_addr6;
+	/*! \brief Next compact stream ID to assign (0 is reserved for keepalives) */
+	uint16_t next_stream_id;
+	/*! \brief Number of streams currently multiplexed on this bus */
+	int streams;
+	/*! \brief Shared counters for all the streams on this bus (approximate,
+	 * as they're updated without locking in the hot path) */
+	guint64 sent_packets, sent_bytes;
+	/*! \brief Monotonic time we last sent something (used to suppress keepalives) */
+	gint64 last_sent;
+	/*! \brief Periodic keepalive GSource */
+	GSource *keepalive;
+	/*! \brief Mutex to serialize changes to this bus */
+	janus_mutex mutex;
+	/*! \brief Atomic flag to check if this instance has been destroyed */
+	volatile gint destroyed;
+	/*! \brief Reference counter for this instance */
+	janus_refcount ref;
+} janus_rtp_forwarder_bus;
+/*! \brief Size of the multiplexing header every packet on a bus is prefixed with */
+#define JANUS_RTP_FORWARDER_BUS_HDR		4
+/*! \brief Helper method to get the bus towards a remote instance, creating
+ * it (socket, keepalives) if this is the first stream headed there
+ * @note The caller owns a reference to the returned bus, and must release
+ * it with janus_rtp_forwarder_bus_unref when done attaching forwarders
+ * @param[in] host The address of the remote instance
+ * @param[in] port The port of the remote instance
+ * @returns A pointer to a valid janus_rtp_forwarder_bus instance, if successful, NULL otherwise */
+janus_rtp_forwarder_bus *janus_rtp_forwarder_bus_get(const char *host, uint16_t port);
+/*! \brief Helper method to release a reference to a bus
+ * @param[in] bus The janus_rtp_forwarder_bus instance to unref */
+void janus_rtp_forwarder_bus_unref(janus_rtp_forwarder_bus *bus);
+/*! \brief Helper method to attach an RTP forwarder to a bus: from then on,
+ * the forwarder's packets are sent on the shared bus socket, prefixed with
+ * the multiplexing header, and the forwarder's own socket is not used
+ * @note The forwarder keeps its own reference to the bus, which is released
+ * when the forwarder itself is destroyed
+ * @param[in] bus The janus_rtp_forwarder_bus instance to attach the forwarder to
+ * @param[in] rf The janus_rtp_forwarder instance to attach
+ * @returns The compact stream ID assigned to the forwarder on the bus, 0 otherwise */
+uint16_t janus_rtp_forwarder_bus_attach(janus_rtp_forwarder_bus *bus, janus_rtp_forwarder *rf);
+/*! \brief Helper method for the receiving end of a bus, to recognize the
+ * multiplexing header and extract the compact stream ID out of a packet
+ * @param[in] buffer The received packet
+ * @param[in] len The length of the received packet
+ * @param[out] stream_id The compact stream ID the packet belongs to
+ * 		(0 means it's just a keepalive, and carries no payload)
+ * @returns The size of the header to skip to access the payload, if the
+ * 		packet is a valid bus frame, -1 otherwise */
+int janus_rtp_forwarder_bus_demux(char *buffer, int len, uint16_t *stream_id);
+/*! \brief Helper method to write the multiplexing header at the beginning
+ * of a buffer, e.g., to send feedback back on a multiplexed flow: the
+ * first \c JANUS_RTP_FORWARDER_BUS_HDR bytes of the buffer are overwritten,
+ * so the payload (if any) is expected to start right after them
+ * @param[in] buffer The buffer to write the header to
+ * @param[in] len The size of the buffer
+ * @param[in] stream_id The compact stream ID to put in the header
+ * @returns 0 if successful, -1 otherwise */
+int janus_rtp_forwarder_bus_mux(char *buffer, int len, uint16_t stream_id);
+
 #endif
@@ -67,11 +67,15 @@ typedef struct janus_sctp_pending_message {
 	gboolean textdata;
 	char *buf;
 	size_t len;
+	uint16_t pr_policy;
+	uint32_t pr_value;
 } janus_sctp_pending_message;
-static janus_sctp_pending_message *janus_sctp_pending_message_create(uint16_t id, gboolean textdata, char *buf, size_t len) {
+static janus_sctp_pending_message *janus_sctp_pending_message_create(uint16_t id, gboolean textdata, char *buf, size_t len, uint16_t pr_policy, uint32_t pr_value) {
 	janus_sctp_pending_message *m = g_malloc(sizeof(janus_sctp_pending_message));
 	m->id = id;
 	m->textdata = textdata;
+	m->pr_policy = pr_policy;
+	m->pr_value = pr_value;
 	if(buf != NULL && len > 0) {
 		m->buf = g_malloc(len);
 		memcpy(m->buf, buf, len);
@@ -101,7 +105,7 @@ int janus_sctp_send_open_response_message(struct socket *sock, uint16_t stream);
 int janus_sctp_send_open_ack_message(struct socket *sock, uint16_t stream);
 void janus_sctp_send_deferred_messages(janus_sctp_association *sctp);
 int janus_sctp_open_channel(janus_sctp_association *sctp, char *label, char *protocol, uint8_t unordered, uint16_t pr_policy, uint32_t pr_value);
-int janus_sctp_send_text_or_binary(janus_sctp_association *sctp, uint16_t id, gboolean textdata, char *text, size_t length);
+int janus_sctp_send_text_or_binary(janus_sctp_association *sctp, uint16_t id, gboolean textdata, char *text, size_t length, uint16_t pr_policy, uint32_t pr_value);
 void janus_sctp_reset_outgoing_stream(janus_sctp_association *sctp, uint16_t stream);
 void janus_sctp_send_outgoing_stream_reset(janus_sctp_association *sctp);
 int janus_sctp_close_channel(janus_sctp_association *sctp, uint16_t id);
@@ -129,10 +133,72 @@ static void janus_sctp_association_unref(janus_sctp_association *sctp);
 
 /* SCTP management code */
 static gboolean sctp_running;
+/* Whether outgoing DATA chunks should be coalesced: WebRTC stacks disable
+ * Nagle on the SCTP socket for latency, but on deployments relaying tens of
+ * thousands of small data channel messages per second it pays off to leave
+ * it enabled, so that usrsctp bundles multiple DATA chunks into a single
+ * SCTP packet and we traverse the DTLS/ICE send path once per bundle */
+static gboolean sctp_data_coalescing = FALSE;
+void janus_sctp_set_data_coalescing(gboolean coalesce) {
+	sctp_data_coalescing = coalesce;
+	if(coalesce)
+		JANUS_LOG(LOG_INFO, "Data channel coalescing enabled (Nagle will be left on for SCTP associations)\n");
+}
+/* Throughput-oriented tunables: send/receive buffer sizes (0 leaves the
+ * usrsctp defaults), the stream scheduler to use (-1 leaves the default),
+ * and whether message interleaving (I-DATA) and NR-SACKs should be
+ * enabled. The usrsctp defaults are tuned for messaging, and cap what a
+ * single busy data channel can push */
+static int sctp_sndbuf_size = 0, sctp_rcvbuf_size = 0;
+static int sctp_scheduler = -1;
+static gboolean sctp_interleaving = FALSE, sctp_nrsack = FALSE;
+void janus_sctp_set_tuning(int sndbuf, int rcvbuf, const char *scheduler, gboolean interleaving, gboolean nr_sack) {
+	if(sndbuf > 0) {
+		sctp_sndbuf_size = sndbuf;
+		JANUS_LOG(LOG_INFO, "SCTP send buffer size: %d bytes\n", sndbuf);
+	}
+	if(rcvbuf > 0) {
+		sctp_rcvbuf_size = rcvbuf;
+		JANUS_LOG(LOG_INFO, "SCTP receive buffer size: %d bytes\n", rcvbuf);
+	}
+	if(scheduler != NULL) {
+#ifdef SCTP_PLUGGABLE_SS
+		if(!strcasecmp(scheduler, "default"))
+			sctp_scheduler = SCTP_SS_DEFAULT;
+		else if(!strcasecmp(scheduler, "rr"))
+			sctp_scheduler = SCTP_SS_ROUND_ROBIN;
+		else if(!strcasecmp(scheduler, "rr-packet"))
+			sctp_scheduler = SCTP_SS_RR_PACKET;
+		else if(!strcasecmp(scheduler, "prio"))
+			sctp_scheduler = SCTP_SS_PRIORITY;
+		else if(!strcasecmp(scheduler, "fcfs"))
+			sctp_scheduler = SCTP_SS_FIRST_COME;
+		else
+			JANUS_LOG(LOG_WARN, "Unknown SCTP stream scheduler '%s', ignoring\n", scheduler);
+		if(sctp_scheduler != -1)
+			JANUS_LOG(LOG_INFO, "SCTP stream scheduler: %s\n", scheduler);
+#else
+		JANUS_LOG(LOG_WARN, "This usrsctp doesn't expose pluggable stream schedulers, ignoring '%s'\n", scheduler);
+#endif
+	}
+	sctp_interleaving = interleaving;
+	if(interleaving)
+		JANUS_LOG(LOG_INFO, "SCTP message interleaving (I-DATA) enabled\n");
+	sctp_nrsack = nr_sack;
+	if(nr_sack)
+		JANUS_LOG(LOG_INFO, "SCTP NR-SACKs enabled\n");
+}
 int janus_sctp_init(void) {
 	/* Initialize the SCTP stack */
 	usrsctp_init(0, janus_sctp_data_to_dtls, NULL);
 	sctp_running = TRUE;
+	/* Apply the stack-wide tunables, if any were configured */
+	if(sctp_sndbuf_size > 0)
+		usrsctp_sysctl_set_sctp_sendspace(sctp_sndbuf_size);
+	if(sctp_rcvbuf_size > 0)
+		usrsctp_sysctl_set_sctp_recvspace(sctp_rcvbuf_size);
+	if(sctp_nrsack)
+		usrsctp_sysctl_set_sctp_nrsack_enable(1);
 
 #ifdef DEBUG_SCTP
 	JANUS_LOG(LOG_WARN, "SCTP debugging to files enabled: going to save them in %s\n", debug_folder);
@@ -199,6 +265,7 @@ janus_sctp_association *janus_sctp_association_create(janus_dtls_srtp *dtls, jan
 	sctp->buflen = 0;
 	sctp->offset = 0;
 	sctp->pending_messages = NULL;
+	sctp->last_channel_used = -1;
 #ifdef DEBUG_SCTP
 	sctp->debug_dump = NULL;
 #endif
@@ -282,8 +349,8 @@ janus_sctp_association *janus_sctp_association_create(janus_dtls_srtp *dtls, jan
 		janus_sctp_association_destroy(sctp);
 		return NULL;
 	}
-	/* Disable Nagle */
-	uint32_t nodelay = 1;
+	/* Disable Nagle, unless we've been told to coalesce outgoing messages */
+	uint32_t nodelay = sctp_data_coalescing ? 0 : 1;
 	if(usrsctp_setsockopt(sock, IPPROTO_SCTP, SCTP_NODELAY, &nodelay, sizeof(nodelay))) {
 		JANUS_LOG(LOG_ERR, "[%"SCNu64"] setsockopt error: SCTP_NODELAY (%d, %s)\n",
 			sctp->handle_id, errno, g_strerror(errno));
@@ -315,6 +382,49 @@ janus_sctp_association *janus_sctp_association_create(janus_dtls_srtp *dtls, jan
 		janus_sctp_association_destroy(sctp);
 		return NULL;
 	}
+	/* Apply the configured throughput tunables, if any: these are all
+	 * optional optimizations, so a failure here only gets a warning */
+	if(sctp_sndbuf_size > 0) {
+		int opt = sctp_sndbuf_size;
+		if(usrsctp_setsockopt(sock, SOL_SOCKET, SO_SNDBUF, &opt, sizeof(opt)) < 0) {
+			JANUS_LOG(LOG_WARN, "[%"SCNu64"] setsockopt error: SO_SNDBUF (%d, %s)\n",
+				sctp->handle_id, errno, g_strerror(errno));
+		}
+	}
+	if(sctp_rcvbuf_size > 0) {
+		int opt = sctp_rcvbuf_size;
+		if(usrsctp_setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &opt, sizeof(opt)) < 0) {
+			JANUS_LOG(LOG_WARN, "[%"SCNu64"] setsockopt error: SO_RCVBUF (%d, %s)\n",
+				sctp->handle_id, errno, g_strerror(errno));
+		}
+	}
+#ifdef SCTP_PLUGGABLE_SS
+	if(sctp_scheduler != -1) {
+		av.assoc_id = SCTP_ALL_ASSOC;
+		av.assoc_value = sctp_scheduler;
+		if(usrsctp_setsockopt(sock, IPPROTO_SCTP, SCTP_PLUGGABLE_SS, &av, sizeof(struct sctp_assoc_value)) < 0) {
+			JANUS_LOG(LOG_WARN, "[%"SCNu64"] setsockopt error: SCTP_PLUGGABLE_SS (%d, %s)\n",
+				sctp->handle_id, errno, g_strerror(errno));
+		}
+	}
+#endif
+#ifdef SCTP_INTERLEAVING_SUPPORTED
+	if(sctp_interleaving) {
+		/* I-DATA requires level-2 fragment interleaving first */
+		int level = 2;
+		if(usrsctp_setsockopt(sock, IPPROTO_SCTP, SCTP_FRAGMENT_INTERLEAVE, &level, sizeof(level)) < 0) {
+			JANUS_LOG(LOG_WARN, "[%"SCNu64"] setsockopt error: SCTP_FRAGMENT_INTERLEAVE (%d, %s)\n",
+				sctp->handle_id, errno, g_strerror(errno));
+		} else {
+			av.assoc_id = SCTP_ALL_ASSOC;
+			av.assoc_value = 1;
+			if(usrsctp_setsockopt(sock, IPPROTO_SCTP, SCTP_INTERLEAVING_SUPPORTED, &av, sizeof(struct sctp_assoc_value)) < 0) {
+				JANUS_LOG(LOG_WARN, "[%"SCNu64"] setsockopt error: SCTP_INTERLEAVING_SUPPORTED (%d, %s)\n",
+					sctp->handle_id, errno, g_strerror(errno));
+			}
+		}
+	}
+#endif
 	/* Bind our side of the communication, using AF_CONN as we're doing the actual delivery ourselves */
 	memset(&sconn, 0, sizeof(struct sockaddr_conn));
 	sconn.sconn_family = AF_CONN;
@@ -430,7 +540,7 @@ static int janus_sctp_incoming_data(struct socket *sock, union sctp_sockstore ad
 	return 1;
 }
 
-void janus_sctp_send_data(janus_sctp_association *sctp, char *label, char *protocol, gboolean textdata, char *buf, int len) {
+void janus_sctp_send_data(janus_sctp_association *sctp, char *label, char *protocol, gboolean textdata, char *buf, int len, uint16_t pr_policy, uint32_t pr_value) {
 	if(sctp == NULL)
 		return;
 
@@ -438,17 +548,31 @@ void janus_sctp_send_data(janus_sctp_association *sctp, char *label, char *proto
 		return;
 	if(label == NULL)
 		label = (char *)default_label;
+	if(pr_policy != SCTP_PR_SCTP_NONE && pr_policy != SCTP_PR_SCTP_TTL && pr_policy != SCTP_PR_SCTP_RTX) {
+		JANUS_LOG(LOG_WARN, "[%"SCNu64"] Invalid pr_policy %"SCNu16", sending reliably\n", sctp->handle_id, pr_policy);
+		pr_policy = SCTP_PR_SCTP_NONE;
+		pr_value = 0;
+	}
 	JANUS_LOG(LOG_VERB, "[%"SCNu64"] SCTP data to send (label=%s, %d bytes) coming from a plugin.\n",
 		  sctp->handle_id, label, len);
 	JANUS_LOG(LOG_HUGE, "[%"SCNu64"] Outgoing SCTP contents: %.*s\n",
 		  sctp->handle_id, len, buf);
 	/* FIXME Is there any open channel we can use? */
 	int i = 0, found = 0;
-	for(i = 0; i < NUMBER_OF_CHANNELS; i++) {
-		if(sctp->channels[i].state != DATA_CHANNEL_CLOSED && !strcmp(sctp->channels[i].label, label)) {
-			found = 1;
-			JANUS_LOG(LOG_VERB, "[%"SCNu64"]   -- Using open channel %i\n", sctp->handle_id, i);
-			break;
+	/* Shortcut: messages typically target the same channel over and over,
+	 * so check the last one we used before scanning all of them */
+	i = sctp->last_channel_used;
+	if(i >= 0 && i < NUMBER_OF_CHANNELS &&
+			sctp->channels[i].state != DATA_CHANNEL_CLOSED && !strcmp(sctp->channels[i].label, label)) {
+		found = 1;
+	}
+	if(!found) {
+		for(i = 0; i < NUMBER_OF_CHANNELS; i++) {
+			if(sctp->channels[i].state != DATA_CHANNEL_CLOSED && !strcmp(sctp->channels[i].label, label)) {
+				found = 1;
+				JANUS_LOG(LOG_VERB, "[%"SCNu64"]   -- Using open channel %i\n", sctp->handle_id, i);
+				break;
+			}
 		}
 	}
 	if(!found) {
@@ -470,25 +594,26 @@ void janus_sctp_send_data(janus_sctp_association *sctp, char *label, char *proto
 			return;
 		}
 	}
+	sctp->last_channel_used = i;
 	/* Send the data, whether it's text or binary */
 	if(sctp->pending_messages != NULL && !g_queue_is_empty(sctp->pending_messages)) {
 		/* We couldn't send all pending messages, queue the new one as well */
 		if(buf != NULL && len > 0) {
 			JANUS_LOG(LOG_WARN, "[%"SCNu64"] Couldn't send all pending messages, queueing new message\n",
 				sctp->handle_id);
-			janus_sctp_pending_message *m = janus_sctp_pending_message_create(i, textdata, buf, len);
+			janus_sctp_pending_message *m = janus_sctp_pending_message_create(i, textdata, buf, len, pr_policy, pr_value);
 			if(sctp->pending_messages == NULL)
 				sctp->pending_messages = g_queue_new();
 			g_queue_push_tail(sctp->pending_messages, m);
 		}
 		return;
 	}
-	int res = janus_sctp_send_text_or_binary(sctp, i, textdata, buf, len);
+	int res = janus_sctp_send_text_or_binary(sctp, i, textdata, buf, len, pr_policy, pr_value);
 	if(res == -2) {
 		/* Delivery failed with an EAGAIN, queue and retry later */
 		JANUS_LOG(LOG_WARN, "[%"SCNu64"] Got EAGAIN when trying to send message on channel %d, retrying later\n",
 			sctp->handle_id, i);
-		janus_sctp_pending_message *m = janus_sctp_pending_message_create(i, textdata, buf, len);
+		janus_sctp_pending_message *m = janus_sctp_pending_message_create(i, textdata, buf, len, pr_policy, pr_value);
 		if(sctp->pending_messages == NULL)
 			sctp->pending_messages = g_queue_new();
 		g_queue_push_tail(sctp->pending_messages, m);
@@ -786,7 +911,7 @@ int janus_sctp_open_channel(janus_sctp_association *sctp, char *label, char *pro
 	return 0;
 }
 
-int janus_sctp_send_text_or_binary(janus_sctp_association *sctp, uint16_t id, gboolean textdata, char *text, size_t length) {
+int janus_sctp_send_text_or_binary(janus_sctp_association *sctp, uint16_t id, gboolean textdata, char *text, size_t length, uint16_t pr_policy, uint32_t pr_value) {
 	if(id >= NUMBER_OF_CHANNELS || text == NULL)
 		return -1;
 	struct sctp_sendv_spa spa;
@@ -810,7 +935,13 @@ int janus_sctp_send_text_or_binary(janus_sctp_association *sctp, uint16_t id, gb
 	}
 	spa.sendv_sndinfo.snd_ppid = htonl(textdata ? DATA_CHANNEL_PPID_DOMSTRING : DATA_CHANNEL_PPID_BINARY);
 	spa.sendv_flags = SCTP_SEND_SNDINFO_VALID;
-	if((channel->pr_policy == SCTP_PR_SCTP_TTL) || (channel->pr_policy == SCTP_PR_SCTP_RTX)) {
+	if((pr_policy == SCTP_PR_SCTP_TTL) || (pr_policy == SCTP_PR_SCTP_RTX)) {
+		/* This message comes with its own partial reliability policy, which
+		 * overrides whatever the channel was negotiated with */
+		spa.sendv_prinfo.pr_policy = pr_policy;
+		spa.sendv_prinfo.pr_value = pr_value;
+		spa.sendv_flags |= SCTP_SEND_PRINFO_VALID;
+	} else if((channel->pr_policy == SCTP_PR_SCTP_TTL) || (channel->pr_policy == SCTP_PR_SCTP_RTX)) {
 		spa.sendv_prinfo.pr_policy = channel->pr_policy;
 		spa.sendv_prinfo.pr_value = channel->pr_value;
 		spa.sendv_flags |= SCTP_SEND_PRINFO_VALID;
@@ -895,7 +1026,7 @@ void janus_sctp_data_ready(janus_sctp_association *sctp) {
 		/* Messages waiting in the queue, send those first */
 		janus_sctp_pending_message *m = g_queue_peek_head(sctp->pending_messages);
 		while(m != NULL) {
-			int res = janus_sctp_send_text_or_binary(sctp, m->id, m->textdata, m->buf, m->len);
+			int res = janus_sctp_send_text_or_binary(sctp, m->id, m->textdata, m->buf, m->len, m->pr_policy, m->pr_value);
 			if(res == -2) {
 				JANUS_LOG(LOG_WARN, "[%"SCNu64"] Got EAGAIN when trying to resend pending message on channel %"SCNu16"\n",
 					sctp->handle_id, m->id);
@@ -50,6 +50,31 @@
 /*! \brief SCTP stuff initialization
  * \returns 0 on success, a negative integer otherwise */
 int janus_sctp_init(void);
+/*! \brief Method to enable or disable the coalescing of outgoing messages,
+ * to be invoked before janus_sctp_init
+ * \note By default Nagle is disabled on SCTP associations, as all WebRTC
+ * stacks do, which gives each message its own SCTP packet and so its own
+ * trip through the DTLS/ICE send path. When coalescing is enabled Nagle is
+ * left on instead, so that usrsctp can bundle multiple DATA chunks into a
+ * single packet: that trades a bit of latency for a much cheaper send path
+ * when relaying very high message rates
+ * @param[in] coalesce Whether outgoing messages should be coalesced */
+void janus_sctp_set_data_coalescing(gboolean coalesce);
+/*! \brief Method to tune the SCTP stack for throughput, to be invoked
+ * before janus_sctp_init
+ * \note The usrsctp defaults (small socket buffers, round-robin stream
+ * scheduling, no message interleaving) are tuned for messaging, and cap
+ * what a single busy data channel can push: file-transfer style
+ * workloads benefit from scaling the buffers and, when several channels
+ * compete, from a different stream scheduler. The janus-sctp-bench tool
+ * can be used to validate a combination of these knobs on your hardware
+ * @param[in] sndbuf Send buffer size in bytes (0 leaves the default)
+ * @param[in] rcvbuf Receive buffer size in bytes (0 leaves the default)
+ * @param[in] scheduler Stream scheduler to use ("default", "rr",
+ * "rr-packet", "prio" or "fcfs"; NULL leaves the default)
+ * @param[in] interleaving Whether message interleaving (I-DATA) should be offered
+ * @param[in] nr_sack Whether NR-SACKs should be enabled */
+void janus_sctp_set_tuning(int sndbuf, int rcvbuf, const char *scheduler, gboolean interleaving, gboolean nr_sack);
 
 /*! \brief SCTP stuff de-initialization */
 void janus_sctp_deinit(void);
@@ -129,6 +154,9 @@ typedef struct janus_sctp_association {
 	size_t offset;
 	/*! \brief Buffer of pending messages */
 	GQueue *pending_messages;
+	/*! \brief Index of the channel the last outgoing message was sent on
+	 * (messages usually target the same channel, so we check it first) */
+	int last_channel_used;
 #ifdef DEBUG_SCTP
 	FILE *debug_dump;
 #endif
@@ -212,8 +240,12 @@ void janus_sctp_data_from_dtls(janus_sctp_association *sctp, char *buf, int len)
  * @param[in] protocol The protocol of the data channel to use
  * @param[in] textdata Whether the buffer is text (domstring) or binary data
  * \param[in] buf The data buffer
- * \param[in] len The buffer length */
-void janus_sctp_send_data(janus_sctp_association *sctp, char *label, char *protocol, gboolean textdata, char *buf, int len);
+ * \param[in] len The buffer length
+ * \param[in] pr_policy The PR-SCTP partial reliability policy to send this message with
+ * (SCTP_PR_SCTP_TTL or SCTP_PR_SCTP_RTX; 0 means reliable delivery, using the channel defaults)
+ * \param[in] pr_value The partial reliability parameter (lifetime in milliseconds for TTL,
+ * number of retransmissions for RTX) */
+void janus_sctp_send_data(janus_sctp_association *sctp, char *label, char *protocol, gboolean textdata, char *buf, int len, uint16_t pr_policy, uint32_t pr_value);
 
 #endif
 
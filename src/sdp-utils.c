@@ -12,6 +12,8 @@
  * \ref core
  */
 
+#include <stdarg.h>
+#include <stdio.h>
 #include <string.h>
 
 #include "sdp-utils.h"
@@ -29,6 +31,67 @@ const char *janus_preferred_video_codecs[] = {
 };
 uint janus_video_codecs = sizeof(janus_preferred_video_codecs)/sizeof(*janus_preferred_video_codecs);
 
+/* Parsing an SDP can easily involve a few hundred small allocations (one
+ * struct and a couple of strings per attribute), which adds up quickly at
+ * scale: to reduce the pressure on the allocator, the parser carves the
+ * attributes it creates out of a per-SDP bump arena, which is released as
+ * a whole when the SDP instance itself is freed. Memory handed out by the
+ * arena is zeroed and never reclaimed individually, which is fine here
+ * since attributes are only ever destroyed, never re-homed to a different
+ * SDP. Attributes created dynamically (e.g., via the helper method
+ * janus_sdp_attribute_create) keep using the heap as before. */
+#define JANUS_SDP_ARENA_BLOCK_SIZE	4096
+typedef struct janus_sdp_arena_block {
+	/*! \brief Next block in the chain, if any */
+	struct janus_sdp_arena_block *next;
+	/*! \brief Size of the buffer that follows this header */
+	size_t size;
+	/*! \brief How much of the buffer has been handed out already */
+	size_t used;
+} janus_sdp_arena_block;
+typedef struct janus_sdp_arena {
+	/*! \brief Chain of blocks (most recent first) */
+	janus_sdp_arena_block *blocks;
+} janus_sdp_arena;
+
+static void *janus_sdp_arena_alloc(janus_sdp_arena *arena, size_t size) {
+	/* Keep allocations aligned so structs can be carved out too */
+	size = (size + 7) & ~(size_t)7;
+	janus_sdp_arena_block *block = arena->blocks;
+	if(block == NULL || block->used + size > block->size) {
+		size_t bsize = size > JANUS_SDP_ARENA_BLOCK_SIZE ? size : JANUS_SDP_ARENA_BLOCK_SIZE;
+		/* Blocks are zeroed on creation, so allocations come out zeroed as well */
+		block = g_malloc0(sizeof(janus_sdp_arena_block) + bsize);
+		block->size = bsize;
+		block->next = arena->blocks;
+		arena->blocks = block;
+	}
+	void *p = (char *)(block + 1) + block->used;
+	block->used += size;
+	return p;
+}
+
+static char *janus_sdp_arena_strdup(janus_sdp_arena *arena, const char *string) {
+	if(string == NULL)
+		return NULL;
+	size_t len = strlen(string) + 1;
+	char *copy = janus_sdp_arena_alloc(arena, len);
+	memcpy(copy, string, len);
+	return copy;
+}
+
+static void janus_sdp_arena_destroy(janus_sdp_arena *arena) {
+	if(arena == NULL)
+		return;
+	janus_sdp_arena_block *block = arena->blocks, *next = NULL;
+	while(block) {
+		next = block->next;
+		g_free(block);
+		block = next;
+	}
+	g_free(arena);
+}
+
 /* Reference counters management */
 void janus_sdp_destroy(janus_sdp *sdp) {
 	if(!sdp || !g_atomic_int_compare_and_exchange(&sdp->destroyed, 0, 1))
@@ -72,6 +135,8 @@ static void janus_sdp_free(const janus_refcount *sdp_ref) {
 	}
 	g_list_free(sdp->m_lines);
 	sdp->m_lines = NULL;
+	/* Release the arena last, attributes may have been carved out of it */
+	janus_sdp_arena_destroy((janus_sdp_arena *)sdp->arena);
 	g_free(sdp);
 }
 
@@ -93,11 +158,17 @@ static void janus_sdp_mline_free(const janus_refcount *mline_ref) {
 		temp = temp->next;
 	}
 	g_list_free(mline->attributes);
+	g_free(mline->cached);
+	g_list_free_full(mline->codec_table, (GDestroyNotify)g_free);
 	g_free(mline);
 }
 
 static void janus_sdp_attribute_free(const janus_refcount *attr_ref) {
 	janus_sdp_attribute *attr = janus_refcount_containerof(attr_ref, janus_sdp_attribute, ref);
+	if(attr->arena) {
+		/* Arena-backed attribute: the memory is released with the SDP instance */
+		return;
+	}
 	/* This SDP attribute instance can be destroyed, free all the resources */
 	g_free(attr->name);
 	g_free(attr->value);
@@ -175,6 +246,7 @@ janus_sdp_attribute *janus_sdp_attribute_create(const char *name, const char *va
 	janus_refcount_init(&a->ref, janus_sdp_attribute_free);
 	a->name = g_strdup(name);
 	a->direction = JANUS_SDP_DEFAULT;
+	a->arena = FALSE;
 	a->value = NULL;
 	if(value) {
 		char buffer[2048];
@@ -191,9 +263,24 @@ int janus_sdp_attribute_add_to_mline(janus_sdp_mline *mline, janus_sdp_attribute
 	if(!mline || !attr)
 		return -1;
 	mline->attributes = g_list_append(mline->attributes, attr);
+	janus_sdp_mline_invalidate(mline);
 	return 0;
 }
 
+void janus_sdp_mline_invalidate(janus_sdp_mline *mline) {
+	if(!mline)
+		return;
+	if(mline->cached != NULL) {
+		g_free(mline->cached);
+		mline->cached = NULL;
+	}
+	if(mline->codec_table != NULL) {
+		g_list_free_full(mline->codec_table, (GDestroyNotify)g_free);
+		mline->codec_table = NULL;
+	}
+	mline->codec_table_set = FALSE;
+}
+
 janus_sdp_mtype janus_sdp_parse_mtype(const char *type) {
 	if(type == NULL)
 		return JANUS_SDP_OTHER;
@@ -308,6 +395,9 @@ janus_sdp *janus_sdp_parse(const char *sdp, char *error, size_t errlen) {
 	janus_refcount_init(&imported->ref, janus_sdp_free);
 	imported->o_ipv4 = TRUE;
 	imported->c_ipv4 = TRUE;
+	/* Attributes are carved out of a per-SDP arena, released with the instance */
+	janus_sdp_arena *arena = g_malloc0(sizeof(janus_sdp_arena));
+	imported->arena = arena;
 
 	gboolean success = TRUE;
 	janus_sdp_mline *mline = NULL;
@@ -428,12 +518,13 @@ janus_sdp *janus_sdp_parse(const char *sdp, char *error, size_t errlen) {
 					break;
 				}
 				case 'a': {
-					janus_sdp_attribute *a = g_malloc0(sizeof(janus_sdp_attribute));
+					janus_sdp_attribute *a = janus_sdp_arena_alloc(arena, sizeof(janus_sdp_attribute));
+					a->arena = TRUE;
 					janus_refcount_init(&a->ref, janus_sdp_attribute_free);
 					line += 2;
 					char *semicolon = strchr(line, ':');
 					if(semicolon == NULL) {
-						a->name = g_strdup(line);
+						a->name = janus_sdp_arena_strdup(arena, line);
 						a->value = NULL;
 					} else {
 						if(*(semicolon+1) == '\0') {
@@ -444,8 +535,8 @@ janus_sdp *janus_sdp_parse(const char *sdp, char *error, size_t errlen) {
 							break;
 						}
 						*semicolon = '\0';
-						a->name = g_strdup(line);
-						a->value = g_strdup(semicolon+1);
+						a->name = janus_sdp_arena_strdup(arena, line);
+						a->value = janus_sdp_arena_strdup(arena, semicolon+1);
 						a->direction = JANUS_SDP_DEFAULT;
 						*semicolon = ':';
 						if(strstr(line, "/sendonly"))
@@ -597,7 +688,8 @@ janus_sdp *janus_sdp_parse(const char *sdp, char *error, size_t errlen) {
 					break;
 				}
 				case 'a': {
-					janus_sdp_attribute *a = g_malloc0(sizeof(janus_sdp_attribute));
+					janus_sdp_attribute *a = janus_sdp_arena_alloc(arena, sizeof(janus_sdp_attribute));
+					a->arena = TRUE;
 					janus_refcount_init(&a->ref, janus_sdp_attribute_free);
 					line += 2;
 					char *semicolon = strchr(line, ':');
@@ -609,7 +701,7 @@ janus_sdp *janus_sdp_parse(const char *sdp, char *error, size_t errlen) {
 							mline->direction = direction;
 							break;
 						}
-						a->name = g_strdup(line);
+						a->name = janus_sdp_arena_strdup(arena, line);
 						a->value = NULL;
 					} else {
 						if(*(semicolon+1) == '\0') {
@@ -620,8 +712,8 @@ janus_sdp *janus_sdp_parse(const char *sdp, char *error, size_t errlen) {
 							break;
 						}
 						*semicolon = '\0';
-						a->name = g_strdup(line);
-						a->value = g_strdup(semicolon+1);
+						a->name = janus_sdp_arena_strdup(arena, line);
+						a->value = janus_sdp_arena_strdup(arena, semicolon+1);
 						a->direction = JANUS_SDP_DEFAULT;
 						*semicolon = ':';
 						if(strstr(line, "/sendonly"))
@@ -701,6 +793,7 @@ int janus_sdp_remove_payload_type(janus_sdp *sdp, int index, int pt) {
 			}
 			ma = ma->next;
 		}
+		janus_sdp_mline_invalidate(m);
 		if(index != -1)
 			break;
 		ml = ml->next;
@@ -708,6 +801,73 @@ int janus_sdp_remove_payload_type(janus_sdp *sdp, int index, int pt) {
 	return 0;
 }
 
+/* Codec negotiation table: rather than walking the attribute list with string
+ * comparisons every time a codec property is queried (which plugins may do
+ * several times per join), we lazily build a per-m-line table of the payload
+ * types the first time one of the lookup helpers below is used, and answer
+ * all subsequent queries from that. The entries point into the rtpmap/fmtp
+ * attribute values, so they don't need to be freed separately, and the whole
+ * table is dropped by janus_sdp_mline_invalidate() when the m-line changes */
+typedef struct janus_sdp_codec_entry {
+	/* Payload type this entry refers to */
+	int pt;
+	/* Value of the rtpmap attribute for this payload type, if any */
+	const char *rtpmap;
+	/* Canonical codec name, once we've been asked to map it (may stay NULL) */
+	const char *codec;
+	/* Value of the fmtp attribute for this payload type, if any */
+	const char *fmtp;
+} janus_sdp_codec_entry;
+
+static void janus_sdp_mline_codec_table_build(janus_sdp_mline *m) {
+	/* Map all the rtpmap attributes first */
+	GList *ma = m->attributes;
+	while(ma) {
+		janus_sdp_attribute *a = (janus_sdp_attribute *)ma->data;
+		if(a->name != NULL && a->value != NULL && !strcasecmp(a->name, "rtpmap")) {
+			int pt = atoi(a->value);
+			if(pt < 0) {
+				JANUS_LOG(LOG_ERR, "Invalid payload type (%s)\n", a->value);
+			} else {
+				janus_sdp_codec_entry *c = g_malloc0(sizeof(janus_sdp_codec_entry));
+				c->pt = pt;
+				c->rtpmap = a->value;
+				m->codec_table = g_list_prepend(m->codec_table, c);
+			}
+		}
+		ma = ma->next;
+	}
+	m->codec_table = g_list_reverse(m->codec_table);
+	/* Then associate the fmtp attributes to the payload types we found */
+	ma = m->attributes;
+	while(ma) {
+		janus_sdp_attribute *a = (janus_sdp_attribute *)ma->data;
+		if(a->name != NULL && a->value != NULL && !strcasecmp(a->name, "fmtp")) {
+			int pt = atoi(a->value);
+			gboolean found = FALSE;
+			GList *cl = m->codec_table;
+			while(cl) {
+				janus_sdp_codec_entry *c = (janus_sdp_codec_entry *)cl->data;
+				if(c->pt == pt) {
+					found = TRUE;
+					if(c->fmtp == NULL)
+						c->fmtp = a->value;
+				}
+				cl = cl->next;
+			}
+			if(!found && pt >= 0) {
+				/* An fmtp without an rtpmap (e.g., a static payload type) */
+				janus_sdp_codec_entry *c = g_malloc0(sizeof(janus_sdp_codec_entry));
+				c->pt = pt;
+				c->fmtp = a->value;
+				m->codec_table = g_list_append(m->codec_table, c);
+			}
+		}
+		ma = ma->next;
+	}
+	m->codec_table_set = TRUE;
+}
+
 int janus_sdp_get_codec_pt(janus_sdp *sdp, int index, const char *codec) {
 	return janus_sdp_get_codec_pt_full(sdp, index, codec, NULL);
 }
@@ -790,76 +950,68 @@ int janus_sdp_get_codec_pt_full(janus_sdp *sdp, int index, const char *codec, co
 			ml = ml->next;
 			continue;
 		}
-		/* Look in all rtpmap attributes first */
-		GList *ma = m->attributes;
+		/* Make sure we have a codec table for this m-line, and look there */
+		if(!m->codec_table_set)
+			janus_sdp_mline_codec_table_build(m);
 		int pt = -1;
-		GList *pts = NULL;
-		while(ma) {
-			janus_sdp_attribute *a = (janus_sdp_attribute *)ma->data;
-			if(a->name != NULL && a->value != NULL && !strcasecmp(a->name, "rtpmap")) {
-				pt = atoi(a->value);
-				if(pt < 0) {
-					JANUS_LOG(LOG_ERR, "Invalid payload type (%s)\n", a->value);
-				} else if(strstr(a->value, format) || strstr(a->value, format2)) {
-					if(profile != NULL && (vp9 || h264)) {
-						/* Let's keep track of this payload type */
-						pts = g_list_append(pts, GINT_TO_POINTER(pt));
-					} else {
-						/* Payload type for codec found */
-						g_list_free(pts);
-						return pt;
-					}
+		GList *pts = NULL, *cl = m->codec_table;
+		while(cl) {
+			janus_sdp_codec_entry *c = (janus_sdp_codec_entry *)cl->data;
+			if(c->rtpmap != NULL && (strstr(c->rtpmap, format) || strstr(c->rtpmap, format2))) {
+				if(profile != NULL && (vp9 || h264)) {
+					/* Let's keep track of this payload type */
+					pts = g_list_append(pts, c);
+				} else {
+					/* Payload type for codec found */
+					return c->pt;
 				}
 			}
-			ma = ma->next;
+			cl = cl->next;
 		}
 		if(profile != NULL) {
-			/* Now look for the profile in the fmtp attributes */
-			ma = m->attributes;
-			while(ma) {
-				janus_sdp_attribute *a = (janus_sdp_attribute *)ma->data;
-				if(profile != NULL && a->name != NULL && a->value != NULL && !strcasecmp(a->name, "fmtp")) {
-					/* Does this match the payload types we're looking for? */
-					pt = atoi(a->value);
-					if(g_list_find(pts, GINT_TO_POINTER(pt)) == NULL) {
-						/* Not what we're looking for */
-						ma = ma->next;
-						continue;
+			/* Now look for the profile in the fmtp of the payload types we found */
+			cl = pts;
+			while(cl) {
+				janus_sdp_codec_entry *c = (janus_sdp_codec_entry *)cl->data;
+				if(c->fmtp == NULL) {
+					/* No fmtp for this payload type */
+					cl = cl->next;
+					continue;
+				}
+				pt = c->pt;
+				if(vp9) {
+					char profile_id[20];
+					g_snprintf(profile_id, sizeof(profile_id), "profile-id=%s", profile);
+					if(strstr(c->fmtp, profile_id) != NULL) {
+						/* Found */
+						JANUS_LOG(LOG_VERB, "VP9 profile %s found --> %d\n", profile, pt);
+						g_list_free(pts);
+						return pt;
 					}
-					if(vp9) {
-						char profile_id[20];
-						g_snprintf(profile_id, sizeof(profile_id), "profile-id=%s", profile);
-						if(strstr(a->value, profile_id) != NULL) {
-							/* Found */
-							JANUS_LOG(LOG_VERB, "VP9 profile %s found --> %d\n", profile, pt);
-							g_list_free(pts);
-							return pt;
-						}
-					} else if(h264 && strstr(a->value, "packetization-mode=0") == NULL) {
-						/* We only support packetization-mode=1, no matter the profile */
-						char profile_level_id[30];
-						char *profile_lower = g_ascii_strdown(profile, -1);
-						g_snprintf(profile_level_id, sizeof(profile_level_id), "profile-level-id=%s", profile_lower);
-						g_free(profile_lower);
-						if(strstr(a->value, profile_level_id) != NULL) {
-							/* Found */
-							JANUS_LOG(LOG_VERB, "H.264 profile %s found --> %d\n", profile, pt);
-							g_list_free(pts);
-							return pt;
-						}
-						/* Not found, try converting the profile to upper case */
-						char *profile_upper = g_ascii_strup(profile, -1);
-						g_snprintf(profile_level_id, sizeof(profile_level_id), "profile-level-id=%s", profile_upper);
-						g_free(profile_upper);
-						if(strstr(a->value, profile_level_id) != NULL) {
-							/* Found */
-							JANUS_LOG(LOG_VERB, "H.264 profile %s found --> %d\n", profile, pt);
-							g_list_free(pts);
-							return pt;
-						}
+				} else if(h264 && strstr(c->fmtp, "packetization-mode=0") == NULL) {
+					/* We only support packetization-mode=1, no matter the profile */
+					char profile_level_id[30];
+					char *profile_lower = g_ascii_strdown(profile, -1);
+					g_snprintf(profile_level_id, sizeof(profile_level_id), "profile-level-id=%s", profile_lower);
+					g_free(profile_lower);
+					if(strstr(c->fmtp, profile_level_id) != NULL) {
+						/* Found */
+						JANUS_LOG(LOG_VERB, "H.264 profile %s found --> %d\n", profile, pt);
+						g_list_free(pts);
+						return pt;
+					}
+					/* Not found, try converting the profile to upper case */
+					char *profile_upper = g_ascii_strup(profile, -1);
+					g_snprintf(profile_level_id, sizeof(profile_level_id), "profile-level-id=%s", profile_upper);
+					g_free(profile_upper);
+					if(strstr(c->fmtp, profile_level_id) != NULL) {
+						/* Found */
+						JANUS_LOG(LOG_VERB, "H.264 profile %s found --> %d\n", profile, pt);
+						g_list_free(pts);
+						return pt;
 					}
 				}
-				ma = ma->next;
+				cl = cl->next;
 			}
 		}
 		g_list_free(pts);
@@ -886,52 +1038,56 @@ const char *janus_sdp_get_codec_name(janus_sdp *sdp, int index, int pt) {
 			ml = ml->next;
 			continue;
 		}
-		/* Look in all rtpmap attributes */
-		GList *ma = m->attributes;
-		while(ma) {
-			janus_sdp_attribute *a = (janus_sdp_attribute *)ma->data;
-			if(a->name != NULL && a->value != NULL && !strcasecmp(a->name, "rtpmap")) {
-				int a_pt = atoi(a->value);
-				if(a_pt == pt) {
-					/* Found! */
-					if(strstr(a->value, "vp8") || strstr(a->value, "VP8"))
-						return "vp8";
-					if(strstr(a->value, "vp9") || strstr(a->value, "VP9"))
-						return "vp9";
-					if(strstr(a->value, "h264") || strstr(a->value, "H264"))
-						return "h264";
-					if(strstr(a->value, "av1") || strstr(a->value, "AV1"))
-						return "av1";
-					if(strstr(a->value, "h265") || strstr(a->value, "H265"))
-						return "h265";
-					if(strstr(a->value, "multiopus") || strstr(a->value, "MULTIOPUS"))
-						return "multiopus";
-					if(strstr(a->value, "opus") || strstr(a->value, "OPUS"))
-						return "opus";
-					if(strstr(a->value, "pcmu") || strstr(a->value, "PCMU"))
-						return "pcmu";
-					if(strstr(a->value, "pcma") || strstr(a->value, "PCMA"))
-						return "pcma";
-					if(strstr(a->value, "g722") || strstr(a->value, "G722"))
-						return "g722";
-					if(strstr(a->value, "isac/16") || strstr(a->value, "ISAC/16"))
-						return "isac16";
-					if(strstr(a->value, "isac/32") || strstr(a->value, "ISAC/32"))
-						return "isac32";
-					if(strstr(a->value, "l16/48") || strstr(a->value, "L16/48"))
-						return "l16-48";
-					if(strstr(a->value, "l16/16") || strstr(a->value, "L16/16"))
-						return "l16";
-					if(strstr(a->value, "telephone-event/8000") || strstr(a->value, "telephone-event/8000"))
-						return "dtmf";
+		/* Make sure we have a codec table for this m-line, and look there */
+		if(!m->codec_table_set)
+			janus_sdp_mline_codec_table_build(m);
+		GList *cl = m->codec_table;
+		while(cl) {
+			janus_sdp_codec_entry *c = (janus_sdp_codec_entry *)cl->data;
+			if(c->rtpmap != NULL && c->pt == pt) {
+				/* Found! Map the name, if we haven't done that already */
+				if(c->codec == NULL) {
+					if(strstr(c->rtpmap, "vp8") || strstr(c->rtpmap, "VP8"))
+						c->codec = "vp8";
+					else if(strstr(c->rtpmap, "vp9") || strstr(c->rtpmap, "VP9"))
+						c->codec = "vp9";
+					else if(strstr(c->rtpmap, "h264") || strstr(c->rtpmap, "H264"))
+						c->codec = "h264";
+					else if(strstr(c->rtpmap, "av1") || strstr(c->rtpmap, "AV1"))
+						c->codec = "av1";
+					else if(strstr(c->rtpmap, "h265") || strstr(c->rtpmap, "H265"))
+						c->codec = "h265";
+					else if(strstr(c->rtpmap, "multiopus") || strstr(c->rtpmap, "MULTIOPUS"))
+						c->codec = "multiopus";
+					else if(strstr(c->rtpmap, "opus") || strstr(c->rtpmap, "OPUS"))
+						c->codec = "opus";
+					else if(strstr(c->rtpmap, "pcmu") || strstr(c->rtpmap, "PCMU"))
+						c->codec = "pcmu";
+					else if(strstr(c->rtpmap, "pcma") || strstr(c->rtpmap, "PCMA"))
+						c->codec = "pcma";
+					else if(strstr(c->rtpmap, "g722") || strstr(c->rtpmap, "G722"))
+						c->codec = "g722";
+					else if(strstr(c->rtpmap, "isac/16") || strstr(c->rtpmap, "ISAC/16"))
+						c->codec = "isac16";
+					else if(strstr(c->rtpmap, "isac/32") || strstr(c->rtpmap, "ISAC/32"))
+						c->codec = "isac32";
+					else if(strstr(c->rtpmap, "l16/48") || strstr(c->rtpmap, "L16/48"))
+						c->codec = "l16-48";
+					else if(strstr(c->rtpmap, "l16/16") || strstr(c->rtpmap, "L16/16"))
+						c->codec = "l16";
+					else if(strstr(c->rtpmap, "telephone-event/8000"))
+						c->codec = "dtmf";
 					/* RED is not really a codec, but we need to detect it anyway */
-					if(strstr(a->value, "red") || strstr(a->value, "RED"))
-						return "red";
-					JANUS_LOG(LOG_ERR, "Unsupported codec '%s'\n", a->value);
-					return NULL;
+					else if(strstr(c->rtpmap, "red") || strstr(c->rtpmap, "RED"))
+						c->codec = "red";
+					if(c->codec == NULL) {
+						JANUS_LOG(LOG_ERR, "Unsupported codec '%s'\n", c->rtpmap);
+						return NULL;
+					}
 				}
+				return c->codec;
 			}
-			ma = ma->next;
+			cl = cl->next;
 		}
 		if(index != -1)
 			break;
@@ -1029,21 +1185,20 @@ const char *janus_sdp_get_fmtp(janus_sdp *sdp, int index, int pt) {
 			ml = ml->next;
 			continue;
 		}
-		/* Look in all fmtp attributes */
-		GList *ma = m->attributes;
-		while(ma) {
-			janus_sdp_attribute *a = (janus_sdp_attribute *)ma->data;
-			if(a->name != NULL && a->value != NULL && !strcasecmp(a->name, "fmtp")) {
-				int a_pt = atoi(a->value);
-				if(a_pt == pt) {
-					/* Found! */
-					char needle[10];
-					g_snprintf(needle, sizeof(needle), "%d ", pt);
-					if(strstr(a->value, needle) == a->value)
-						return a->value + strlen(needle);
-				}
+		/* Make sure we have a codec table for this m-line, and look there */
+		if(!m->codec_table_set)
+			janus_sdp_mline_codec_table_build(m);
+		GList *cl = m->codec_table;
+		while(cl) {
+			janus_sdp_codec_entry *c = (janus_sdp_codec_entry *)cl->data;
+			if(c->pt == pt && c->fmtp != NULL) {
+				/* Found! */
+				char needle[10];
+				g_snprintf(needle, sizeof(needle), "%d ", pt);
+				if(strstr(c->fmtp, needle) == c->fmtp)
+					return c->fmtp + strlen(needle);
 			}
-			ma = ma->next;
+			cl = cl->next;
 		}
 		if(index != -1)
 			break;
@@ -1098,16 +1253,15 @@ int janus_sdp_get_opusred_pt(janus_sdp *sdp, int index) {
 			ml = ml->next;
 			continue;
 		}
-		/* Look in all rtpmap attributes */
-		GList *ma = m->attributes;
-		while(ma) {
-			janus_sdp_attribute *a = (janus_sdp_attribute *)ma->data;
-			if(a->name != NULL && a->value != NULL && !strcasecmp(a->name, "rtpmap")) {
-				int pt = atoi(a->value);
-				if(strstr(a->value, "red/48000/2"))
-					return pt;
-			}
-			ma = ma->next;
+		/* Make sure we have a codec table for this m-line, and look there */
+		if(!m->codec_table_set)
+			janus_sdp_mline_codec_table_build(m);
+		GList *cl = m->codec_table;
+		while(cl) {
+			janus_sdp_codec_entry *c = (janus_sdp_codec_entry *)cl->data;
+			if(c->rtpmap != NULL && strstr(c->rtpmap, "red/48000/2"))
+				return c->pt;
+			cl = cl->next;
 		}
 		if(index != -1)
 			break;
@@ -1116,55 +1270,70 @@ int janus_sdp_get_opusred_pt(janus_sdp *sdp, int index) {
 	return -1;
 }
 
-char *janus_sdp_write(janus_sdp *imported) {
-	if(!imported)
-		return NULL;
-	janus_refcount_increase(&imported->ref);
-	char *sdp = g_malloc(2560), mline[8192], buffer[2048];
-	*sdp = '\0';
-	size_t sdplen = 2560, mlen = sizeof(mline), offset = 0, moffset = 0;
+/* Helper to append formatted text to the output buffer at the given offset,
+ * returning how many bytes the text needs: when out is NULL nothing is
+ * written and the text is only measured, which allows the serializer below
+ * to compute the exact size of an SDP before writing it in a single pass */
+static size_t janus_sdp_append(char *out, size_t outlen, size_t offset, const char *format, ...) G_GNUC_PRINTF(4, 5);
+static size_t janus_sdp_append(char *out, size_t outlen, size_t offset, const char *format, ...) {
+	char *dest = (out != NULL && offset < outlen) ? out + offset : NULL;
+	size_t space = (dest != NULL) ? outlen - offset : 0;
+	va_list args;
+	va_start(args, format);
+	int res = vsnprintf(dest, space, format, args);
+	va_end(args);
+	return res > 0 ? (size_t)res : 0;
+}
+
+/* The actual serializer: returns the length of the serialized SDP, writing
+ * it to the output buffer if one is provided (out == NULL just measures) */
+static size_t janus_sdp_serialize(janus_sdp *imported, char *out, size_t outlen) {
+	size_t offset = 0;
 	/* v= */
-	g_snprintf(buffer, sizeof(buffer), "v=%d\r\n", imported->version);
-	janus_strlcat_fast(sdp, buffer, sdplen, &offset);
+	offset += janus_sdp_append(out, outlen, offset, "v=%d\r\n", imported->version);
 	/* o= */
-	g_snprintf(buffer, sizeof(buffer), "o=%s %"SCNu64" %"SCNu64" IN %s %s\r\n",
+	offset += janus_sdp_append(out, outlen, offset, "o=%s %"SCNu64" %"SCNu64" IN %s %s\r\n",
 		imported->o_name, imported->o_sessid, imported->o_version,
 		imported->o_ipv4 ? "IP4" : "IP6", imported->o_addr);
-	janus_strlcat_fast(sdp, buffer, sdplen, &offset);
 	/* s= */
-	g_snprintf(buffer, sizeof(buffer), "s=%s\r\n", imported->s_name);
-	janus_strlcat_fast(sdp, buffer, sdplen, &offset);
+	offset += janus_sdp_append(out, outlen, offset, "s=%s\r\n", imported->s_name);
 	/* t= */
-	g_snprintf(buffer, sizeof(buffer), "t=%"SCNu64" %"SCNu64"\r\n", imported->t_start, imported->t_stop);
-	janus_strlcat_fast(sdp, buffer, sdplen, &offset);
+	offset += janus_sdp_append(out, outlen, offset, "t=%"SCNu64" %"SCNu64"\r\n", imported->t_start, imported->t_stop);
 	/* c= */
 	if(imported->c_addr != NULL) {
 		if(imported->c_ipv4 && imported->c_addr && strstr(imported->c_addr, ":"))
 			imported->c_ipv4 = FALSE;
-		g_snprintf(buffer, sizeof(buffer), "c=IN %s %s\r\n",
+		offset += janus_sdp_append(out, outlen, offset, "c=IN %s %s\r\n",
 			imported->c_ipv4 ? "IP4" : "IP6", imported->c_addr);
-		janus_strlcat_fast(sdp, buffer, sdplen, &offset);
 	}
 	/* a= */
 	GList *temp = imported->attributes;
 	while(temp) {
 		janus_sdp_attribute *a = (janus_sdp_attribute *)temp->data;
 		if(a->value != NULL) {
-			g_snprintf(buffer, sizeof(buffer), "a=%s:%s\r\n", a->name, a->value);
+			offset += janus_sdp_append(out, outlen, offset, "a=%s:%s\r\n", a->name, a->value);
 		} else {
-			g_snprintf(buffer, sizeof(buffer), "a=%s\r\n", a->name);
+			offset += janus_sdp_append(out, outlen, offset, "a=%s\r\n", a->name);
 		}
-		janus_strlcat_fast(sdp, buffer, sdplen, &offset);
 		temp = temp->next;
 	}
 	/* m= */
 	temp = imported->m_lines;
 	while(temp) {
-		mline[0] = '\0';
-		moffset = 0;
 		janus_sdp_mline *m = (janus_sdp_mline *)temp->data;
-		g_snprintf(buffer, sizeof(buffer), "m=%s %d %s", m->type_str, m->port, m->proto);
-		janus_strlcat_fast(mline, buffer, mlen, &moffset);
+		if(imported->mcache && m->cached != NULL) {
+			/* This m-line hasn't been invalidated, reuse the serialized text */
+			size_t cachedlen = strlen(m->cached);
+			if(out != NULL && offset < outlen) {
+				size_t copylen = cachedlen < outlen-offset-1 ? cachedlen : outlen-offset-1;
+				memcpy(out + offset, m->cached, copylen);
+			}
+			offset += cachedlen;
+			temp = temp->next;
+			continue;
+		}
+		size_t mstart = offset;
+		offset += janus_sdp_append(out, outlen, offset, "m=%s %d %s", m->type_str, m->port, m->proto);
 		if(m->port == 0 && m->type != JANUS_SDP_APPLICATION) {
 			/* Remove all payload types/formats if we're rejecting the media */
 			g_list_free_full(m->fmts, (GDestroyNotify)g_free);
@@ -1172,45 +1341,40 @@ char *janus_sdp_write(janus_sdp *imported) {
 			g_list_free(m->ptypes);
 			m->ptypes = NULL;
 			m->ptypes = g_list_append(m->ptypes, GINT_TO_POINTER(0));
-			janus_strlcat_fast(mline, " 0", mlen, &moffset);
+			offset += janus_sdp_append(out, outlen, offset, " 0");
 		} else {
 			if(m->proto != NULL && strstr(m->proto, "RTP") != NULL) {
 				/* RTP profile, use payload types */
 				GList *ptypes = m->ptypes;
 				while(ptypes) {
-					g_snprintf(buffer, sizeof(buffer), " %d", GPOINTER_TO_INT(ptypes->data));
-					janus_strlcat_fast(mline, buffer, mlen, &moffset);
+					offset += janus_sdp_append(out, outlen, offset, " %d", GPOINTER_TO_INT(ptypes->data));
 					ptypes = ptypes->next;
 				}
 			} else {
 				/* Something else, use formats */
 				GList *fmts = m->fmts;
 				while(fmts) {
-					g_snprintf(buffer, sizeof(buffer), " %s", (char *)(fmts->data));
-					janus_strlcat_fast(mline, buffer, mlen, &moffset);
+					offset += janus_sdp_append(out, outlen, offset, " %s", (char *)(fmts->data));
 					fmts = fmts->next;
 				}
 			}
 		}
-		janus_strlcat_fast(mline, "\r\n", mlen, &moffset);
+		offset += janus_sdp_append(out, outlen, offset, "\r\n");
 		/* c= */
 		if(m->c_addr != NULL) {
-			g_snprintf(buffer, sizeof(buffer), "c=IN %s %s\r\n",
+			offset += janus_sdp_append(out, outlen, offset, "c=IN %s %s\r\n",
 				m->c_ipv4 ? "IP4" : "IP6", m->c_addr);
-			janus_strlcat_fast(mline, buffer, mlen, &moffset);
 		}
 		if(m->port > 0) {
 			/* b= */
 			if(m->b_name != NULL) {
-				g_snprintf(buffer, sizeof(buffer), "b=%s:%"SCNu32"\r\n", m->b_name, m->b_value);
-				janus_strlcat_fast(mline, buffer, mlen, &moffset);
+				offset += janus_sdp_append(out, outlen, offset, "b=%s:%"SCNu32"\r\n", m->b_name, m->b_value);
 			}
 		}
 		/* a= (note that we don't format the direction if it's JANUS_SDP_DEFAULT) */
 		const char *direction = m->direction != JANUS_SDP_DEFAULT ? janus_sdp_mdirection_str(m->direction) : NULL;
 		if(direction != NULL) {
-			g_snprintf(buffer, sizeof(buffer), "a=%s\r\n", direction);
-			janus_strlcat_fast(mline, buffer, mlen, &moffset);
+			offset += janus_sdp_append(out, outlen, offset, "a=%s\r\n", direction);
 		}
 		GList *temp2 = m->attributes;
 		while(temp2) {
@@ -1221,32 +1385,47 @@ char *janus_sdp_write(janus_sdp *imported) {
 				continue;
 			}
 			if(a->value != NULL) {
-				g_snprintf(buffer, sizeof(buffer), "a=%s:%s\r\n", a->name, a->value);
+				offset += janus_sdp_append(out, outlen, offset, "a=%s:%s\r\n", a->name, a->value);
 			} else {
-				g_snprintf(buffer, sizeof(buffer), "a=%s\r\n", a->name);
+				offset += janus_sdp_append(out, outlen, offset, "a=%s\r\n", a->name);
 			}
-			janus_strlcat_fast(mline, buffer, mlen, &moffset);
 			temp2 = temp2->next;
 		}
-		/* Append the generated m-line to the SDP */
-		size_t cur_sdplen = strlen(sdp);
-		size_t mlinelen = strlen(mline);
-		if(cur_sdplen + mlinelen + 1 > sdplen) {
-			/* Increase the SDP buffer first */
-			if(sdplen < (mlinelen+1))
-				sdplen = cur_sdplen + mlinelen + 1;
-			else
-				sdplen = sdplen*2;
-			sdp = g_realloc(sdp, sdplen);
+		if(imported->mcache && out != NULL && offset <= outlen-1) {
+			/* Cache the serialized text, so that it can be reused next time */
+			g_free(m->cached);
+			m->cached = g_strndup(out + mstart, offset - mstart);
 		}
-		janus_strlcat_fast(sdp, mline, sdplen, &offset);
 		/* Move on */
 		temp = temp->next;
 	}
+	if(out != NULL && outlen > 0)
+		out[offset < outlen ? offset : outlen-1] = '\0';
+	return offset;
+}
+
+char *janus_sdp_write(janus_sdp *imported) {
+	if(!imported)
+		return NULL;
+	janus_refcount_increase(&imported->ref);
+	/* Measure the exact size of the serialized SDP first, then allocate
+	 * the buffer in one go and write the text with a single pass */
+	size_t size = janus_sdp_serialize(imported, NULL, 0);
+	char *sdp = g_malloc(size + 1);
+	janus_sdp_serialize(imported, sdp, size + 1);
 	janus_refcount_decrease(&imported->ref);
 	return sdp;
 }
 
+size_t janus_sdp_write_to(janus_sdp *imported, char *buffer, size_t buflen) {
+	if(!imported || buffer == NULL || buflen == 0)
+		return 0;
+	janus_refcount_increase(&imported->ref);
+	size_t size = janus_sdp_serialize(imported, buffer, buflen);
+	janus_refcount_decrease(&imported->ref);
+	return size;
+}
+
 void janus_sdp_find_preferred_codec(janus_sdp *sdp, janus_sdp_mtype type, int index, const char **codec) {
 	if(sdp == NULL)
 		return;
@@ -2314,3 +2493,95 @@ int janus_sdp_generate_answer_mline(janus_sdp *offer, janus_sdp *answer, janus_s
 
 	return 0;
 }
+
+/* Helper to grab the next whitespace-separated token into a fixed-size
+ * buffer (or to just skip it, when buf is NULL): returns where parsing
+ * should continue from, or NULL if there's no token or it doesn't fit */
+static const char *janus_sdp_candidate_token(const char *p, char *buf, size_t buflen) {
+	while(*p == ' ' || *p == '\t')
+		p++;
+	if(*p == '\0' || *p == '\r' || *p == '\n')
+		return NULL;
+	size_t len = 0;
+	while(*p != '\0' && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n') {
+		if(buf != NULL) {
+			if(len == buflen-1)
+				return NULL;
+			buf[len] = *p;
+		}
+		len++;
+		p++;
+	}
+	if(buf != NULL)
+		buf[len] = '\0';
+	return p;
+}
+
+/* Helper to grab the next token as an unsigned integer: returns where
+ * parsing should continue from, or NULL if it's not a plain number */
+static const char *janus_sdp_candidate_uint(const char *p, guint32 *num) {
+	while(*p == ' ' || *p == '\t')
+		p++;
+	guint32 value = 0;
+	gboolean digits = FALSE;
+	while(*p >= '0' && *p <= '9') {
+		value = value*10 + (guint32)(*p - '0');
+		digits = TRUE;
+		p++;
+	}
+	if(!digits || (*p != '\0' && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n'))
+		return NULL;
+	*num = value;
+	return p;
+}
+
+int janus_sdp_candidate_tokenize(const char *candidate, janus_sdp_candidate_tokens *tokens) {
+	if(candidate == NULL || tokens == NULL)
+		return -1;
+	memset(tokens, 0, sizeof(*tokens));
+	/* A single pass over the line, one field at a time: we bail out at
+	 * the first field that doesn't parse, and return how far we got */
+	int fields = 0;
+	const char *p = candidate;
+	char keyword[8];
+	do {
+		if((p = janus_sdp_candidate_token(p, tokens->foundation, sizeof(tokens->foundation))) == NULL)
+			break;
+		fields++;
+		if((p = janus_sdp_candidate_uint(p, &tokens->component)) == NULL)
+			break;
+		fields++;
+		if((p = janus_sdp_candidate_token(p, tokens->transport, sizeof(tokens->transport))) == NULL)
+			break;
+		fields++;
+		if((p = janus_sdp_candidate_uint(p, &tokens->priority)) == NULL)
+			break;
+		fields++;
+		if((p = janus_sdp_candidate_token(p, tokens->ip, sizeof(tokens->ip))) == NULL)
+			break;
+		fields++;
+		if((p = janus_sdp_candidate_uint(p, &tokens->port)) == NULL)
+			break;
+		fields++;
+		/* The type is preceded by the 'typ' keyword */
+		if((p = janus_sdp_candidate_token(p, keyword, sizeof(keyword))) == NULL || strcmp(keyword, "typ"))
+			break;
+		if((p = janus_sdp_candidate_token(p, tokens->type, sizeof(tokens->type))) == NULL)
+			break;
+		fields++;
+		/* Optionally, a related address and port follow (their keywords,
+		 * e.g., 'raddr' and 'rport', are skipped without constraints,
+		 * exactly as the sscanf-based parsing used to do) */
+		if((p = janus_sdp_candidate_token(p, NULL, 0)) == NULL)
+			break;
+		if((p = janus_sdp_candidate_token(p, tokens->relip, sizeof(tokens->relip))) == NULL)
+			break;
+		fields++;
+		if((p = janus_sdp_candidate_token(p, NULL, 0)) == NULL)
+			break;
+		if((p = janus_sdp_candidate_uint(p, &tokens->relport)) == NULL)
+			break;
+		fields++;
+	} while(0);
+	return fields;
+}
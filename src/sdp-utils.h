@@ -50,6 +50,13 @@ typedef struct janus_sdp {
 	GList *attributes;
 	/*! \brief List of m= m-lines */
 	GList *m_lines;
+	/*! \brief Arena the parsed attributes are carved from, if any (private, only set by the parser) */
+	void *arena;
+	/*! \brief Whether janus_sdp_write should cache the serialized text of each m-line
+	 * \note Only enable this on SDP objects that are kept around and re-serialized
+	 * across renegotiations: anything that modifies an m-line afterwards must call
+	 * janus_sdp_mline_invalidate() on it, or the serialized SDP will be stale */
+	gboolean mcache;
 	/*! \brief Atomic flag to check if this instance has been destroyed */
 	volatile gint destroyed;
 	/*! \brief Reference counter for this instance */
@@ -155,6 +162,13 @@ typedef struct janus_sdp_mline {
 	janus_sdp_mdirection direction;
 	/*! \brief List of m-line attributes */
 	GList *attributes;
+	/*! \brief Cached serialized text of this m-line, if caching is enabled (private, managed by janus_sdp_write) */
+	char *cached;
+	/*! \brief Codec table for this m-line, lazily built the first time one of the
+	 * codec lookup helpers is used and dropped by janus_sdp_mline_invalidate() (private) */
+	GList *codec_table;
+	/*! \brief Whether the codec table above has been built already */
+	gboolean codec_table_set;
 	/*! \brief Atomic flag to check if this instance has been destroyed */
 	volatile gint destroyed;
 	/*! \brief Reference counter for this instance */
@@ -174,6 +188,15 @@ janus_sdp_mline *janus_sdp_mline_create(janus_sdp_mtype type, guint16 port, cons
  * @note This method does not remove the m-line from the janus_sdp instance, that's up to the caller
  * @param[in] mline The janus_sdp_mline instance to free */
 void janus_sdp_mline_destroy(janus_sdp_mline *mline);
+/*! \brief Helper method to invalidate the cached serialized text of an m-line
+ * \note This must be called on any m-line that is modified after it's been
+ * serialized, when the owning SDP has m-line caching enabled (\c mcache ):
+ * the next janus_sdp_write will then re-serialize that m-line from scratch.
+ * This also drops the codec table the codec lookup helpers may have built for
+ * the m-line, so that the next lookup will rebuild it from the new attributes.
+ * It's a no-op when nothing has been cached, so it's always safe to call.
+ * @param[in] mline The janus_sdp_mline instance to invalidate */
+void janus_sdp_mline_invalidate(janus_sdp_mline *mline);
 /*! \brief Helper method to get the janus_sdp_mline associated to a media type
  * @note This currently returns the first m-line of the specified type it finds: as
  * such, it's mostly here for making things easier for plugins not doing multistream.
@@ -202,6 +225,8 @@ typedef struct janus_sdp_attribute {
 	char *value;
 	/*! \brief Attribute direction (e.g., for extmap) */
 	janus_sdp_mdirection direction;
+	/*! \brief Whether this attribute is backed by the arena of the SDP it was parsed from (private) */
+	gboolean arena;
 	/*! \brief Atomic flag to check if this instance has been destroyed */
 	volatile gint destroyed;
 	/*! \brief Reference counter for this instance */
@@ -241,6 +266,15 @@ int janus_sdp_remove_payload_type(janus_sdp *sdp, int index, int pt);
  * @param[in] sdp The janus_sdp object to serialize
  * @returns A pointer to a string with the serialized SDP, if successful, NULL otherwise */
 char *janus_sdp_write(janus_sdp *sdp);
+/*! \brief Method to serialize a janus_sdp object to a caller-provided buffer,
+ * avoiding any allocation when the buffer is large enough (e.g., when reusing
+ * a pooled buffer to regenerate large SDPs over and over)
+ * @param[in] sdp The janus_sdp object to serialize
+ * @param[in] buffer The buffer to write the serialized SDP to
+ * @param[in] buflen Size of the provided buffer
+ * @returns The length of the serialized SDP (if larger than or equal to the buffer
+ * size, the output was truncated and a larger buffer is needed), 0 otherwise */
+size_t janus_sdp_write_to(janus_sdp *sdp, char *buffer, size_t buflen);
 
 /*! \brief Method to quickly generate a janus_sdp instance from a few selected fields
  * @note This allocates the \c o_addr, \c s_name and \c c_addr properties: if you
@@ -435,4 +469,28 @@ char *janus_sdp_get_video_profile(janus_videocodec codec, const char *fmtp);
  * @returns The payload type, if found, or -1 otherwise */
 int janus_sdp_get_opusred_pt(janus_sdp *sdp, int index);
 
+/*! \brief Fields of a tokenized ICE candidate line: all fixed-size
+ * buffers, so that tokenizing a candidate needs no heap allocation */
+typedef struct janus_sdp_candidate_tokens {
+	char foundation[33];	/*!< Candidate foundation */
+	guint32 component;		/*!< Component ID */
+	char transport[4];		/*!< Transport (udp/tcp/tls) */
+	guint32 priority;		/*!< Candidate priority */
+	char ip[50];			/*!< Connection address */
+	guint32 port;			/*!< Connection port */
+	char type[6];			/*!< Candidate type (host/srflx/prflx/relay) */
+	char relip[40];			/*!< Related address, for reflexive/relayed candidates */
+	guint32 relport;		/*!< Related port, for reflexive/relayed candidates */
+} janus_sdp_candidate_tokens;
+/*! \brief Tokenize an ICE candidate line (the part after "candidate:")
+ * in a single pass, with no allocations: numbers must be plain decimal
+ * digits and tokens must fit the fixed-size fields above, which makes
+ * this slightly stricter than the sscanf-based parsing it replaced
+ * @param[in] candidate The candidate line to tokenize
+ * @param[out] tokens The structure to write the parsed fields to (zeroed first)
+ * @returns The number of fields successfully parsed, in the order they
+ * appear in the structure: 7 or more means a complete candidate (the
+ * related address and port are only there for some candidate types) */
+int janus_sdp_candidate_tokenize(const char *candidate, janus_sdp_candidate_tokens *tokens);
+
 #endif
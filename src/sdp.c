@@ -693,7 +693,7 @@ int janus_sdp_process_remote(void *ice_handle, janus_sdp *remote_sdp, gboolean r
 			}
 			if(m->type == JANUS_SDP_VIDEO) {
 				if((medium->ssrc_peer[1] || medium->rid[1] != NULL) && medium->rtcp_ctx[1] == NULL) {
-					medium->rtcp_ctx[1] = g_malloc0(sizeof(rtcp_context));
+					medium->rtcp_ctx[1] = janus_ice_arena_alloc(medium->arena, sizeof(rtcp_context));
 					medium->rtcp_ctx[1]->tb = 90000;
 					medium->rtcp_ctx[1]->in_link_quality = 100;
 					medium->rtcp_ctx[1]->in_media_link_quality = 100;
@@ -701,7 +701,7 @@ int janus_sdp_process_remote(void *ice_handle, janus_sdp *remote_sdp, gboolean r
 					medium->rtcp_ctx[1]->out_media_link_quality = 100;
 				}
 				if((medium->ssrc_peer[2] || medium->rid[rids_hml ? 2 : 0] != NULL) && medium->rtcp_ctx[2] == NULL) {
-					medium->rtcp_ctx[2] = g_malloc0(sizeof(rtcp_context));
+					medium->rtcp_ctx[2] = janus_ice_arena_alloc(medium->arena, sizeof(rtcp_context));
 					medium->rtcp_ctx[2]->tb = 90000;
 					medium->rtcp_ctx[2]->in_link_quality = 100;
 					medium->rtcp_ctx[2]->in_media_link_quality = 100;
@@ -920,45 +920,86 @@ typedef struct janus_sdp_mdns_candidate {
 	char *candidate, *local;
 	GCancellable *cancellable;
 } janus_sdp_mdns_candidate;
-static void janus_sdp_mdns_resolved(GObject *source_object, GAsyncResult *res, gpointer user_data) {
-	/* This callback is invoked when the address is resolved */
-	janus_sdp_mdns_candidate *mc = (janus_sdp_mdns_candidate *)user_data;
-	GResolver *resolver = g_resolver_get_default();
-	GError *error = NULL;
-	GList *list = g_resolver_lookup_by_name_finish(resolver, res, &error);
-	if(mc == NULL) {
-		g_resolver_free_addresses(list);
-		g_object_unref(resolver);
-		return;
-	}
-	char *resolved = NULL;
-	if(error != NULL || list == NULL || list->data == NULL) {
-		JANUS_LOG(LOG_WARN, "[%"SCNu64"] Error resolving mDNS address (%s): %s\n",
-			mc->handle->handle_id, mc->local, error ? error->message : "no results");
-	} else {
-		resolved = g_inet_address_to_string((GInetAddress *)list->data);
-		JANUS_LOG(LOG_VERB, "[%"SCNu64"] mDNS address (%s) resolved: %s\n",
-			mc->handle->handle_id, mc->local, resolved);
-	}
-	g_resolver_free_addresses(list);
-	g_object_unref(resolver);
+/* Browsers advertise the same .local hostname for every m-line, and for all
+ * the handles of the same client, so we cache resolved mDNS addresses for a
+ * while rather than paying a resolution per candidate: candidates that show
+ * up while a resolution for their hostname is already in flight just queue
+ * up on it, and are all applied in one batch when the answer arrives */
+typedef struct janus_sdp_mdns_entry {
+	char *address;		/* Resolved address (NULL while the resolution is in flight) */
+	gint64 resolved;	/* When the resolution completed (to enforce the TTL) */
+	GSList *pending;	/* Candidates waiting for this hostname to resolve */
+} janus_sdp_mdns_entry;
+#define JANUS_SDP_MDNS_TTL	(120*G_USEC_PER_SEC)
+static GHashTable *mdns_cache = NULL;
+static janus_mutex mdns_cache_mutex = JANUS_MUTEX_INITIALIZER;
+static void janus_sdp_mdns_entry_free(janus_sdp_mdns_entry *entry) {
+	g_free(entry->address);
+	g_free(entry);
+}
+/* Replace the .local address in a pending candidate with the resolved one,
+ * and feed the result back to the regular candidate parsing */
+static void janus_sdp_mdns_candidate_apply(janus_sdp_mdns_candidate *mc, const char *resolved) {
 	if(resolved != NULL && mc->handle->pc && mc->handle->app_handle &&
 			!g_atomic_int_get(&mc->handle->app_handle->stopped) &&
 			!g_atomic_int_get(&mc->handle->destroyed)) {
-		/* Replace the .local address with the resolved one in the candidate string */
 		mc->candidate = janus_string_replace(mc->candidate, mc->local, resolved);
 		/* Parse the candidate again */
 		janus_mutex_lock(&mc->handle->mutex);
 		(void)janus_sdp_parse_candidate(mc->handle->pc, mc->candidate, 1);
 		janus_mutex_unlock(&mc->handle->mutex);
 	}
-	g_free(resolved);
 	/* Get rid of the helper struct */
 	janus_refcount_decrease(&mc->handle->ref);
 	g_free(mc->candidate);
 	g_free(mc->local);
 	g_free(mc);
 }
+static void janus_sdp_mdns_resolved(GObject *source_object, GAsyncResult *res, gpointer user_data) {
+	/* This callback is invoked when the address is resolved */
+	char *hostname = (char *)user_data;
+	GResolver *resolver = g_resolver_get_default();
+	GError *error = NULL;
+	GList *list = g_resolver_lookup_by_name_finish(resolver, res, &error);
+	char *resolved = NULL;
+	if(error != NULL || list == NULL || list->data == NULL) {
+		JANUS_LOG(LOG_WARN, "Error resolving mDNS address (%s): %s\n",
+			hostname, error ? error->message : "no results");
+	} else {
+		resolved = g_inet_address_to_string((GInetAddress *)list->data);
+		JANUS_LOG(LOG_VERB, "mDNS address (%s) resolved: %s\n", hostname, resolved);
+	}
+	g_resolver_free_addresses(list);
+	g_object_unref(resolver);
+	if(error != NULL)
+		g_error_free(error);
+	/* Update the cache, and steal the list of candidates waiting on this name */
+	GSList *pending = NULL;
+	janus_mutex_lock(&mdns_cache_mutex);
+	janus_sdp_mdns_entry *entry = mdns_cache ? g_hash_table_lookup(mdns_cache, hostname) : NULL;
+	if(entry != NULL) {
+		pending = entry->pending;
+		entry->pending = NULL;
+		if(resolved != NULL) {
+			g_free(entry->address);
+			entry->address = g_strdup(resolved);
+			entry->resolved = janus_get_monotonic_time();
+		} else {
+			/* Don't cache failures, a later candidate will retry */
+			g_hash_table_remove(mdns_cache, hostname);
+		}
+	}
+	janus_mutex_unlock(&mdns_cache_mutex);
+	/* Apply all the pending candidates in one batch */
+	GSList *item = pending;
+	while(item != NULL) {
+		janus_sdp_mdns_candidate_apply((janus_sdp_mdns_candidate *)item->data, resolved);
+		item = item->next;
+	}
+	g_slist_free(pending);
+	g_free(resolved);
+	g_free(hostname);
+}
 
 int janus_sdp_parse_candidate(void *ice_pc, const char *candidate, int trickle) {
 	if(ice_pc == NULL || candidate == NULL)
@@ -976,11 +1017,13 @@ int janus_sdp_parse_candidate(void *ice_pc, const char *candidate, int trickle)
 		/* Skipping the 'candidate:' prefix Firefox puts in trickle candidates */
 		candidate += strlen("candidate:");
 	}
-	char rfoundation[33], rtransport[4], rip[50], rtype[6], rrelip[40];
-	guint32 rcomponent, rpriority, rport, rrelport;
-	int res = sscanf(candidate, "%32s %30u %3s %30u %49s %30u typ %5s %*s %39s %*s %30u",
-		rfoundation, &rcomponent, rtransport, &rpriority,
-			rip, &rport, rtype, rrelip, &rrelport);
+	/* Tokenize the candidate line in a single pass, no allocations involved */
+	janus_sdp_candidate_tokens tokens;
+	int res = janus_sdp_candidate_tokenize(candidate, &tokens);
+	char *rfoundation = tokens.foundation, *rtransport = tokens.transport,
+		*rip = tokens.ip, *rtype = tokens.type, *rrelip = tokens.relip;
+	guint32 rcomponent = tokens.component, rpriority = tokens.priority,
+		rport = tokens.port, rrelport = tokens.relport;
 	if(res < 7) {
 		/* Failed to parse this address, can it be IPv6? */
 		if(!janus_ice_is_ipv6_enabled()) {
@@ -997,19 +1040,62 @@ int janus_sdp_parse_candidate(void *ice_pc, const char *candidate, int trickle)
 				JANUS_LOG(LOG_VERB, "[%"SCNu64"] mDNS candidate ignored\n", handle->handle_id);
 				return 0;
 			}
-			/* We'll resolve this address asynchronously, in order not to keep this thread busy */
-			JANUS_LOG(LOG_VERB, "[%"SCNu64"] Resolving mDNS address (%s) asynchronously\n",
-				handle->handle_id, rip);
+			/* Check the cache first: the same hostname shows up for every
+			 * m-line, and for all the handles of the same client */
+			janus_mutex_lock(&mdns_cache_mutex);
+			if(mdns_cache == NULL) {
+				mdns_cache = g_hash_table_new_full(g_str_hash, g_str_equal,
+					(GDestroyNotify)g_free, (GDestroyNotify)janus_sdp_mdns_entry_free);
+			}
+			janus_sdp_mdns_entry *entry = g_hash_table_lookup(mdns_cache, rip);
+			if(entry != NULL && entry->address != NULL &&
+					(janus_get_monotonic_time() - entry->resolved) < JANUS_SDP_MDNS_TTL) {
+				/* Cache hit: rewrite the candidate and parse it right away */
+				char *resolved = g_strdup(entry->address);
+				janus_mutex_unlock(&mdns_cache_mutex);
+				JANUS_LOG(LOG_VERB, "[%"SCNu64"] mDNS address (%s) found in cache: %s\n",
+					handle->handle_id, rip, resolved);
+				char *resolved_candidate = janus_string_replace(g_strdup(candidate), rip, resolved);
+				g_free(resolved);
+				int rescached = janus_sdp_parse_candidate(pc, resolved_candidate, trickle);
+				g_free(resolved_candidate);
+				return rescached;
+			}
+			/* Cache miss (or expired entry): queue the candidate on the entry,
+			 * starting a resolution unless one is already in flight, so that
+			 * all the candidates with this hostname resolve in one batch */
 			janus_sdp_mdns_candidate *mc = g_malloc(sizeof(janus_sdp_mdns_candidate));
 			janus_refcount_increase(&handle->ref);
 			mc->handle = handle;
 			mc->candidate = g_strdup(candidate);
 			mc->local = g_strdup(rip);
 			mc->cancellable = NULL;
-			GResolver *resolver = g_resolver_get_default();
-			g_resolver_lookup_by_name_async(resolver, rip, NULL,
-				(GAsyncReadyCallback)janus_sdp_mdns_resolved, mc);
-			g_object_unref(resolver);
+			gboolean resolve = FALSE;
+			if(entry == NULL) {
+				entry = g_malloc0(sizeof(janus_sdp_mdns_entry));
+				g_hash_table_insert(mdns_cache, g_strdup(rip), entry);
+				resolve = TRUE;
+			} else if(entry->address != NULL) {
+				/* The cached address expired, resolve it again */
+				g_free(entry->address);
+				entry->address = NULL;
+				entry->resolved = 0;
+				resolve = TRUE;
+			}
+			entry->pending = g_slist_append(entry->pending, mc);
+			janus_mutex_unlock(&mdns_cache_mutex);
+			if(resolve) {
+				/* We'll resolve this address asynchronously, in order not to keep this thread busy */
+				JANUS_LOG(LOG_VERB, "[%"SCNu64"] Resolving mDNS address (%s) asynchronously\n",
+					handle->handle_id, rip);
+				GResolver *resolver = g_resolver_get_default();
+				g_resolver_lookup_by_name_async(resolver, rip, NULL,
+					(GAsyncReadyCallback)janus_sdp_mdns_resolved, g_strdup(rip));
+				g_object_unref(resolver);
+			} else {
+				JANUS_LOG(LOG_VERB, "[%"SCNu64"] Waiting on the in-flight mDNS resolution of %s\n",
+					handle->handle_id, rip);
+			}
 			return 0;
 		}
 		/* Add remote candidate */
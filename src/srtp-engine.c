@@ -0,0 +1,634 @@
+/*! \file    srtp-engine.c
+ * \author   Lorenzo Miniero <lorenzo@meetecho.com>
+ * \copyright GNU General Public License v3
+ * \brief    Pluggable SRTP crypto engines
+ * \details  Implementation of the crypto-engine abstraction described
+ * in srtp-engine.h. Two engines are provided here: a thin wrapper
+ * around libsrtp (which is also what everything falls back to when no
+ * engine applies), and an AES-GCM engine built directly on the OpenSSL
+ * EVP interface. The AES-GCM engine only accepts the two AEAD SRTP
+ * profiles (RFC 7714) and its main selling point is the batched
+ * protect: the key schedule lives in a single cipher context that's
+ * reused for every packet of a batch, so protecting a full egress
+ * batch is one engine call rather than one libsrtp call per packet.
+ *
+ * \ingroup protocols
+ * \ref protocols
+ */
+
+#include <string.h>
+#include <arpa/inet.h>
+
+#include <openssl/evp.h>
+
+#include "srtp-engine.h"
+#include "debug.h"
+#include "utils.h"
+
+/* Tag length of the AEAD SRTP profiles we implement (RFC 7714) */
+#define JANUS_SRTP_GCM_TAG_LENGTH	16
+/* Size of the replay window we keep per inbound stream */
+#define JANUS_SRTP_GCM_REPLAY_WINDOW	64
+
+
+/*
+ * libsrtp engine: a wrapper around a dedicated libsrtp session, mostly
+ * there so that the startup benchmark has a baseline to compare the
+ * other engines against (when this engine is the selected one, no
+ * context is ever handed out and the DTLS stack keeps using the
+ * sessions it creates by itself, exactly as it always did)
+ */
+
+static int janus_srtp_libsrtp_setup(janus_srtp_engine_ctx *ctx, gboolean inbound, janus_srtp_profile profile,
+		const unsigned char *key, size_t key_len, const unsigned char *salt, size_t salt_len) {
+	srtp_policy_t policy;
+	memset(&policy, 0, sizeof(policy));
+	switch(profile) {
+		case JANUS_SRTP_AES128_CM_SHA1_80:
+			srtp_crypto_policy_set_aes_cm_128_hmac_sha1_80(&(policy.rtp));
+			srtp_crypto_policy_set_aes_cm_128_hmac_sha1_80(&(policy.rtcp));
+			break;
+		case JANUS_SRTP_AES128_CM_SHA1_32:
+			srtp_crypto_policy_set_aes_cm_128_hmac_sha1_32(&(policy.rtp));
+			srtp_crypto_policy_set_aes_cm_128_hmac_sha1_80(&(policy.rtcp));
+			break;
+#ifdef HAVE_SRTP_AESGCM
+		case JANUS_SRTP_AEAD_AES_256_GCM:
+			srtp_crypto_policy_set_aes_gcm_256_16_auth(&(policy.rtp));
+			srtp_crypto_policy_set_aes_gcm_256_16_auth(&(policy.rtcp));
+			break;
+		case JANUS_SRTP_AEAD_AES_128_GCM:
+			srtp_crypto_policy_set_aes_gcm_128_16_auth(&(policy.rtp));
+			srtp_crypto_policy_set_aes_gcm_128_16_auth(&(policy.rtcp));
+			break;
+#endif
+		default:
+			return -1;
+	}
+	policy.ssrc.type = inbound ? ssrc_any_inbound : ssrc_any_outbound;
+	unsigned char master[SRTP_AESGCM256_MASTER_LENGTH > SRTP_MASTER_LENGTH ?
+		SRTP_AESGCM256_MASTER_LENGTH : SRTP_MASTER_LENGTH];
+	if(key_len + salt_len > sizeof(master))
+		return -1;
+	memcpy(master, key, key_len);
+	memcpy(master + key_len, salt, salt_len);
+	policy.key = master;
+	policy.next = NULL;
+	srtp_t session = NULL;
+	if(srtp_create(&session, &policy) != srtp_err_status_ok)
+		return -1;
+	ctx->priv = session;
+	return 0;
+}
+
+static srtp_err_status_t janus_srtp_libsrtp_protect(janus_srtp_engine_ctx *ctx, char *buf, int *len) {
+	return srtp_protect((srtp_t)ctx->priv, buf, len);
+}
+
+static srtp_err_status_t janus_srtp_libsrtp_unprotect(janus_srtp_engine_ctx *ctx, char *buf, int *len) {
+	return srtp_unprotect((srtp_t)ctx->priv, buf, len);
+}
+
+static srtp_err_status_t janus_srtp_libsrtp_protect_rtcp(janus_srtp_engine_ctx *ctx, char *buf, int *len) {
+	return srtp_protect_rtcp((srtp_t)ctx->priv, buf, len);
+}
+
+static srtp_err_status_t janus_srtp_libsrtp_unprotect_rtcp(janus_srtp_engine_ctx *ctx, char *buf, int *len) {
+	return srtp_unprotect_rtcp((srtp_t)ctx->priv, buf, len);
+}
+
+static void janus_srtp_libsrtp_teardown(janus_srtp_engine_ctx *ctx) {
+	if(ctx->priv != NULL)
+		srtp_dealloc((srtp_t)ctx->priv);
+	ctx->priv = NULL;
+}
+
+static const janus_srtp_engine janus_srtp_engine_libsrtp = {
+	.name = "libsrtp",
+	.setup = janus_srtp_libsrtp_setup,
+	.protect = janus_srtp_libsrtp_protect,
+	.unprotect = janus_srtp_libsrtp_unprotect,
+	.protect_rtcp = janus_srtp_libsrtp_protect_rtcp,
+	.unprotect_rtcp = janus_srtp_libsrtp_unprotect_rtcp,
+	.protect_batch = NULL,
+	.teardown = janus_srtp_libsrtp_teardown
+};
+
+
+/*
+ * AES-GCM engine (RFC 7714) on the OpenSSL EVP interface
+ */
+
+/* Per-SSRC state: rollover counter, highest sequence number seen, and
+ * a bitmask replay window for inbound streams */
+typedef struct janus_srtp_gcm_stream {
+	uint32_t roc;
+	uint16_t last_seq;
+	gboolean started;
+	uint64_t replay_window;
+} janus_srtp_gcm_stream;
+
+typedef struct janus_srtp_gcm_ctx {
+	gboolean inbound;
+	/* Cipher contexts: the key schedule is done once at setup, each
+	 * packet only re-inits the IV, which is what makes batching cheap */
+	EVP_CIPHER_CTX *evp_rtp, *evp_rtcp;
+	/* Session salts, derived from the master key/salt at setup */
+	unsigned char rtp_salt[12], rtcp_salt[12];
+	/* Per-SSRC stream state */
+	GHashTable *streams;
+	/* SRTCP index (outbound: last one we used; inbound: highest seen) */
+	uint32_t rtcp_index;
+	uint64_t rtcp_replay_window;
+	gboolean rtcp_started;
+} janus_srtp_gcm_ctx;
+
+/* AES-CM key derivation from RFC 3711, with the 96-bit GCM master salt
+ * zero-padded to 112 bits as RFC 7714 prescribes */
+static int janus_srtp_gcm_kdf(const unsigned char *master_key, size_t key_len,
+		const unsigned char *master_salt, size_t salt_len, uint8_t label,
+		unsigned char *out, size_t out_len) {
+	unsigned char block[16], keystream[32];
+	memset(block, 0, sizeof(block));
+	memcpy(block, master_salt, salt_len < 14 ? salt_len : 14);
+	block[7] ^= label;
+	EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+	if(ctx == NULL)
+		return -1;
+	const EVP_CIPHER *cipher = (key_len == 32) ? EVP_aes_256_ecb() : EVP_aes_128_ecb();
+	if(EVP_EncryptInit_ex(ctx, cipher, NULL, master_key, NULL) != 1) {
+		EVP_CIPHER_CTX_free(ctx);
+		return -1;
+	}
+	EVP_CIPHER_CTX_set_padding(ctx, 0);
+	size_t off = 0;
+	uint16_t counter = 0;
+	while(off < out_len) {
+		block[14] = counter >> 8;
+		block[15] = counter & 0xFF;
+		int outl = 0;
+		if(EVP_EncryptUpdate(ctx, keystream, &outl, block, 16) != 1 || outl < 16) {
+			EVP_CIPHER_CTX_free(ctx);
+			return -1;
+		}
+		size_t copy = (out_len - off) < 16 ? (out_len - off) : 16;
+		memcpy(out + off, keystream, copy);
+		off += copy;
+		counter++;
+	}
+	EVP_CIPHER_CTX_free(ctx);
+	return 0;
+}
+
+static EVP_CIPHER_CTX *janus_srtp_gcm_evp_create(gboolean inbound, const unsigned char *key, size_t key_len) {
+	EVP_CIPHER_CTX *evp = EVP_CIPHER_CTX_new();
+	if(evp == NULL)
+		return NULL;
+	const EVP_CIPHER *cipher = (key_len == 32) ? EVP_aes_256_gcm() : EVP_aes_128_gcm();
+	int ok = EVP_CipherInit_ex(evp, cipher, NULL, NULL, NULL, inbound ? 0 : 1) == 1 &&
+		EVP_CIPHER_CTX_ctrl(evp, EVP_CTRL_GCM_SET_IVLEN, 12, NULL) == 1 &&
+		EVP_CipherInit_ex(evp, NULL, NULL, key, NULL, -1) == 1;
+	if(!ok) {
+		EVP_CIPHER_CTX_free(evp);
+		return NULL;
+	}
+	return evp;
+}
+
+static int janus_srtp_gcm_setup(janus_srtp_engine_ctx *ctx, gboolean inbound, janus_srtp_profile profile,
+		const unsigned char *key, size_t key_len, const unsigned char *salt, size_t salt_len) {
+	if(profile != JANUS_SRTP_AEAD_AES_128_GCM && profile != JANUS_SRTP_AEAD_AES_256_GCM)
+		return -1;
+	if(key == NULL || salt == NULL || (key_len != 16 && key_len != 32) || salt_len != 12)
+		return -1;
+	/* Derive the RTP and RTCP session keys and salts */
+	unsigned char rtp_key[32], rtcp_key[32];
+	janus_srtp_gcm_ctx *gc = g_malloc0(sizeof(janus_srtp_gcm_ctx));
+	if(janus_srtp_gcm_kdf(key, key_len, salt, salt_len, 0x00, rtp_key, key_len) < 0 ||
+			janus_srtp_gcm_kdf(key, key_len, salt, salt_len, 0x02, gc->rtp_salt, 12) < 0 ||
+			janus_srtp_gcm_kdf(key, key_len, salt, salt_len, 0x03, rtcp_key, key_len) < 0 ||
+			janus_srtp_gcm_kdf(key, key_len, salt, salt_len, 0x05, gc->rtcp_salt, 12) < 0) {
+		g_free(gc);
+		return -1;
+	}
+	gc->inbound = inbound;
+	gc->evp_rtp = janus_srtp_gcm_evp_create(inbound, rtp_key, key_len);
+	gc->evp_rtcp = janus_srtp_gcm_evp_create(inbound, rtcp_key, key_len);
+	if(gc->evp_rtp == NULL || gc->evp_rtcp == NULL) {
+		if(gc->evp_rtp != NULL)
+			EVP_CIPHER_CTX_free(gc->evp_rtp);
+		if(gc->evp_rtcp != NULL)
+			EVP_CIPHER_CTX_free(gc->evp_rtcp);
+		g_free(gc);
+		return -1;
+	}
+	gc->streams = g_hash_table_new_full(NULL, NULL, NULL, (GDestroyNotify)g_free);
+	ctx->priv = gc;
+	return 0;
+}
+
+static janus_srtp_gcm_stream *janus_srtp_gcm_get_stream(janus_srtp_gcm_ctx *gc, uint32_t ssrc) {
+	janus_srtp_gcm_stream *stream = g_hash_table_lookup(gc->streams, GUINT_TO_POINTER(ssrc));
+	if(stream == NULL) {
+		stream = g_malloc0(sizeof(janus_srtp_gcm_stream));
+		g_hash_table_insert(gc->streams, GUINT_TO_POINTER(ssrc), stream);
+	}
+	return stream;
+}
+
+/* Size of the RTP header, including CSRCs and extensions: that's what
+ * goes in the additional authenticated data, the rest is encrypted */
+static int janus_srtp_gcm_header_length(unsigned char *buf, int len) {
+	if(len < 12)
+		return -1;
+	int hlen = 12 + (buf[0] & 0x0F)*4;
+	if(buf[0] & 0x10) {
+		/* Extension header */
+		if(len < hlen + 4)
+			return -1;
+		int extlen = (buf[hlen+2] << 8) | buf[hlen+3];
+		hlen += 4 + extlen*4;
+	}
+	return (hlen > len) ? -1 : hlen;
+}
+
+/* IV construction from RFC 7714, section 8.1 */
+static void janus_srtp_gcm_rtp_iv(unsigned char *iv, const unsigned char *salt,
+		uint32_t ssrc, uint32_t roc, uint16_t seq) {
+	memset(iv, 0, 12);
+	iv[2] = ssrc >> 24;
+	iv[3] = ssrc >> 16;
+	iv[4] = ssrc >> 8;
+	iv[5] = ssrc;
+	iv[6] = roc >> 24;
+	iv[7] = roc >> 16;
+	iv[8] = roc >> 8;
+	iv[9] = roc;
+	iv[10] = seq >> 8;
+	iv[11] = seq;
+	int i = 0;
+	for(i=0; i<12; i++)
+		iv[i] ^= salt[i];
+}
+
+static srtp_err_status_t janus_srtp_gcm_protect(janus_srtp_engine_ctx *ctx, char *buf, int *len) {
+	janus_srtp_gcm_ctx *gc = (janus_srtp_gcm_ctx *)ctx->priv;
+	unsigned char *p = (unsigned char *)buf;
+	int hlen = janus_srtp_gcm_header_length(p, *len);
+	if(hlen < 0)
+		return srtp_err_status_bad_param;
+	uint32_t ssrc = ((uint32_t)p[8] << 24) | (p[9] << 16) | (p[10] << 8) | p[11];
+	uint16_t seq = (p[2] << 8) | p[3];
+	janus_srtp_gcm_stream *stream = janus_srtp_gcm_get_stream(gc, ssrc);
+	/* We protect packets in send order, so a smaller sequence number
+	 * than the last one means the counter rolled over */
+	if(stream->started && seq < stream->last_seq && (uint16_t)(stream->last_seq - seq) > 0x8000)
+		stream->roc++;
+	stream->last_seq = seq;
+	stream->started = TRUE;
+	unsigned char iv[12];
+	janus_srtp_gcm_rtp_iv(iv, gc->rtp_salt, ssrc, stream->roc, seq);
+	EVP_CIPHER_CTX *evp = gc->evp_rtp;
+	int outl = 0, plen = *len - hlen;
+	int ok = EVP_EncryptInit_ex(evp, NULL, NULL, NULL, iv) == 1 &&
+		EVP_EncryptUpdate(evp, NULL, &outl, p, hlen) == 1 &&
+		EVP_EncryptUpdate(evp, p + hlen, &outl, p + hlen, plen) == 1 &&
+		EVP_EncryptFinal_ex(evp, p + *len, &outl) == 1 &&
+		EVP_CIPHER_CTX_ctrl(evp, EVP_CTRL_GCM_GET_TAG, JANUS_SRTP_GCM_TAG_LENGTH, p + *len) == 1;
+	if(!ok)
+		return srtp_err_status_cipher_fail;
+	*len += JANUS_SRTP_GCM_TAG_LENGTH;
+	return srtp_err_status_ok;
+}
+
+static srtp_err_status_t janus_srtp_gcm_unprotect(janus_srtp_engine_ctx *ctx, char *buf, int *len) {
+	janus_srtp_gcm_ctx *gc = (janus_srtp_gcm_ctx *)ctx->priv;
+	unsigned char *p = (unsigned char *)buf;
+	int hlen = janus_srtp_gcm_header_length(p, *len);
+	if(hlen < 0 || *len < hlen + JANUS_SRTP_GCM_TAG_LENGTH)
+		return srtp_err_status_bad_param;
+	uint32_t ssrc = ((uint32_t)p[8] << 24) | (p[9] << 16) | (p[10] << 8) | p[11];
+	uint16_t seq = (p[2] << 8) | p[3];
+	janus_srtp_gcm_stream *stream = janus_srtp_gcm_get_stream(gc, ssrc);
+	/* Estimate the rollover counter this packet belongs to (RFC 3711,
+	 * section 3.3.1) and check the replay window before decrypting */
+	uint32_t v = stream->roc;
+	if(stream->started) {
+		if(stream->last_seq < 0x8000) {
+			if(seq > (uint16_t)(stream->last_seq + 0x8000) && v > 0)
+				v = stream->roc - 1;
+		} else {
+			if(seq < (uint16_t)(stream->last_seq - 0x8000))
+				v = stream->roc + 1;
+		}
+	}
+	uint64_t index = ((uint64_t)v << 16) | seq;
+	uint64_t last = ((uint64_t)stream->roc << 16) | stream->last_seq;
+	if(stream->started && index <= last) {
+		uint64_t delta = last - index;
+		if(delta >= JANUS_SRTP_GCM_REPLAY_WINDOW)
+			return srtp_err_status_replay_old;
+		if(stream->replay_window & (G_GUINT64_CONSTANT(1) << delta))
+			return srtp_err_status_replay_fail;
+	}
+	unsigned char iv[12];
+	janus_srtp_gcm_rtp_iv(iv, gc->rtp_salt, ssrc, v, seq);
+	EVP_CIPHER_CTX *evp = gc->evp_rtp;
+	int outl = 0, clen = *len - hlen - JANUS_SRTP_GCM_TAG_LENGTH;
+	int ok = EVP_DecryptInit_ex(evp, NULL, NULL, NULL, iv) == 1 &&
+		EVP_CIPHER_CTX_ctrl(evp, EVP_CTRL_GCM_SET_TAG, JANUS_SRTP_GCM_TAG_LENGTH, p + hlen + clen) == 1 &&
+		EVP_DecryptUpdate(evp, NULL, &outl, p, hlen) == 1 &&
+		EVP_DecryptUpdate(evp, p + hlen, &outl, p + hlen, clen) == 1 &&
+		EVP_DecryptFinal_ex(evp, p + hlen + clen, &outl) == 1;
+	if(!ok)
+		return srtp_err_status_auth_fail;
+	/* Authenticated: update the stream state and replay window */
+	if(!stream->started || index > last) {
+		uint64_t delta = stream->started ? (index - last) : 0;
+		stream->replay_window = (delta >= JANUS_SRTP_GCM_REPLAY_WINDOW) ? 0 : (stream->replay_window << delta);
+		stream->replay_window |= 1;
+		stream->roc = v;
+		stream->last_seq = seq;
+		stream->started = TRUE;
+	} else {
+		stream->replay_window |= (G_GUINT64_CONSTANT(1) << (last - index));
+	}
+	*len = hlen + clen;
+	return srtp_err_status_ok;
+}
+
+/* IV construction from RFC 7714, section 9.1 */
+static void janus_srtp_gcm_rtcp_iv(unsigned char *iv, const unsigned char *salt,
+		uint32_t ssrc, uint32_t index) {
+	memset(iv, 0, 12);
+	iv[2] = ssrc >> 24;
+	iv[3] = ssrc >> 16;
+	iv[4] = ssrc >> 8;
+	iv[5] = ssrc;
+	iv[8] = index >> 24;
+	iv[9] = index >> 16;
+	iv[10] = index >> 8;
+	iv[11] = index;
+	int i = 0;
+	for(i=0; i<12; i++)
+		iv[i] ^= salt[i];
+}
+
+static srtp_err_status_t janus_srtp_gcm_protect_rtcp(janus_srtp_engine_ctx *ctx, char *buf, int *len) {
+	janus_srtp_gcm_ctx *gc = (janus_srtp_gcm_ctx *)ctx->priv;
+	unsigned char *p = (unsigned char *)buf;
+	if(*len < 8)
+		return srtp_err_status_bad_param;
+	uint32_t ssrc = ((uint32_t)p[4] << 24) | (p[5] << 16) | (p[6] << 8) | p[7];
+	uint32_t index = ++gc->rtcp_index & 0x7FFFFFFF;
+	/* The trailer (E bit plus SRTCP index) is part of the AAD */
+	unsigned char trailer[4];
+	uint32_t eindex = 0x80000000 | index;
+	trailer[0] = eindex >> 24;
+	trailer[1] = eindex >> 16;
+	trailer[2] = eindex >> 8;
+	trailer[3] = eindex;
+	unsigned char iv[12];
+	janus_srtp_gcm_rtcp_iv(iv, gc->rtcp_salt, ssrc, index);
+	EVP_CIPHER_CTX *evp = gc->evp_rtcp;
+	int outl = 0, plen = *len - 8;
+	int ok = EVP_EncryptInit_ex(evp, NULL, NULL, NULL, iv) == 1 &&
+		EVP_EncryptUpdate(evp, NULL, &outl, p, 8) == 1 &&
+		EVP_EncryptUpdate(evp, NULL, &outl, trailer, 4) == 1 &&
+		EVP_EncryptUpdate(evp, p + 8, &outl, p + 8, plen) == 1 &&
+		EVP_EncryptFinal_ex(evp, p + *len, &outl) == 1 &&
+		EVP_CIPHER_CTX_ctrl(evp, EVP_CTRL_GCM_GET_TAG, JANUS_SRTP_GCM_TAG_LENGTH, p + *len) == 1;
+	if(!ok)
+		return srtp_err_status_cipher_fail;
+	memcpy(p + *len + JANUS_SRTP_GCM_TAG_LENGTH, trailer, 4);
+	*len += JANUS_SRTP_GCM_TAG_LENGTH + 4;
+	return srtp_err_status_ok;
+}
+
+static srtp_err_status_t janus_srtp_gcm_unprotect_rtcp(janus_srtp_engine_ctx *ctx, char *buf, int *len) {
+	janus_srtp_gcm_ctx *gc = (janus_srtp_gcm_ctx *)ctx->priv;
+	unsigned char *p = (unsigned char *)buf;
+	if(*len < 8 + JANUS_SRTP_GCM_TAG_LENGTH + 4)
+		return srtp_err_status_bad_param;
+	unsigned char *trailer = p + *len - 4;
+	uint32_t eindex = ((uint32_t)trailer[0] << 24) | (trailer[1] << 16) | (trailer[2] << 8) | trailer[3];
+	if(!(eindex & 0x80000000)) {
+		/* WebRTC endpoints always encrypt RTCP, we don't support auth-only */
+		return srtp_err_status_cipher_fail;
+	}
+	uint32_t index = eindex & 0x7FFFFFFF;
+	/* Replay check, on the 31-bit SRTCP index */
+	if(gc->rtcp_started && index <= gc->rtcp_index) {
+		uint32_t delta = gc->rtcp_index - index;
+		if(delta >= JANUS_SRTP_GCM_REPLAY_WINDOW)
+			return srtp_err_status_replay_old;
+		if(gc->rtcp_replay_window & (G_GUINT64_CONSTANT(1) << delta))
+			return srtp_err_status_replay_fail;
+	}
+	uint32_t ssrc = ((uint32_t)p[4] << 24) | (p[5] << 16) | (p[6] << 8) | p[7];
+	unsigned char iv[12];
+	janus_srtp_gcm_rtcp_iv(iv, gc->rtcp_salt, ssrc, index);
+	EVP_CIPHER_CTX *evp = gc->evp_rtcp;
+	int outl = 0, clen = *len - 8 - JANUS_SRTP_GCM_TAG_LENGTH - 4;
+	int ok = EVP_DecryptInit_ex(evp, NULL, NULL, NULL, iv) == 1 &&
+		EVP_CIPHER_CTX_ctrl(evp, EVP_CTRL_GCM_SET_TAG, JANUS_SRTP_GCM_TAG_LENGTH, p + 8 + clen) == 1 &&
+		EVP_DecryptUpdate(evp, NULL, &outl, p, 8) == 1 &&
+		EVP_DecryptUpdate(evp, NULL, &outl, trailer, 4) == 1 &&
+		EVP_DecryptUpdate(evp, p + 8, &outl, p + 8, clen) == 1 &&
+		EVP_DecryptFinal_ex(evp, p + 8 + clen, &outl) == 1;
+	if(!ok)
+		return srtp_err_status_auth_fail;
+	if(!gc->rtcp_started || index > gc->rtcp_index) {
+		uint32_t delta = gc->rtcp_started ? (index - gc->rtcp_index) : 0;
+		gc->rtcp_replay_window = (delta >= JANUS_SRTP_GCM_REPLAY_WINDOW) ? 0 : (gc->rtcp_replay_window << delta);
+		gc->rtcp_replay_window |= 1;
+		gc->rtcp_index = index;
+		gc->rtcp_started = TRUE;
+	} else {
+		gc->rtcp_replay_window |= (G_GUINT64_CONSTANT(1) << (gc->rtcp_index - index));
+	}
+	*len = 8 + clen;
+	return srtp_err_status_ok;
+}
+
+static guint janus_srtp_gcm_protect_batch(janus_srtp_engine_ctx *ctx, char **bufs, int *lens, guint count) {
+	/* The single-packet protect already reuses the cipher context, so a
+	 * batch is just a tight loop over it: the key schedule, the context
+	 * allocations and the per-session locking libsrtp would do for each
+	 * packet are all paid zero times per batch here */
+	guint i = 0, protected = 0;
+	for(i=0; i<count; i++) {
+		if(janus_srtp_gcm_protect(ctx, bufs[i], &lens[i]) != srtp_err_status_ok)
+			lens[i] = -1;
+		else
+			protected++;
+	}
+	return protected;
+}
+
+static void janus_srtp_gcm_teardown(janus_srtp_engine_ctx *ctx) {
+	janus_srtp_gcm_ctx *gc = (janus_srtp_gcm_ctx *)ctx->priv;
+	if(gc == NULL)
+		return;
+	if(gc->evp_rtp != NULL)
+		EVP_CIPHER_CTX_free(gc->evp_rtp);
+	if(gc->evp_rtcp != NULL)
+		EVP_CIPHER_CTX_free(gc->evp_rtcp);
+	if(gc->streams != NULL)
+		g_hash_table_destroy(gc->streams);
+	g_free(gc);
+	ctx->priv = NULL;
+}
+
+static const janus_srtp_engine janus_srtp_engine_gcm = {
+	.name = "aes-gcm",
+	.setup = janus_srtp_gcm_setup,
+	.protect = janus_srtp_gcm_protect,
+	.unprotect = janus_srtp_gcm_unprotect,
+	.protect_rtcp = janus_srtp_gcm_protect_rtcp,
+	.unprotect_rtcp = janus_srtp_gcm_unprotect_rtcp,
+	.protect_batch = janus_srtp_gcm_protect_batch,
+	.teardown = janus_srtp_gcm_teardown
+};
+
+
+/*
+ * Engine registry, selection and benchmark
+ */
+
+static const janus_srtp_engine *janus_srtp_engines[] = {
+	&janus_srtp_engine_libsrtp,
+	&janus_srtp_engine_gcm,
+	NULL
+};
+/* The engine new PeerConnections will use: the default (libsrtp) is
+ * special cased in janus_srtp_engine_create_context */
+static const janus_srtp_engine *janus_srtp_engine_current = &janus_srtp_engine_libsrtp;
+
+/* Quick synthetic benchmark of an engine: how fast can it protect
+ * 1200-byte RTP packets, going through the batched path if there is one */
+static void janus_srtp_engine_run_benchmark(const janus_srtp_engine *engine) {
+	unsigned char key[32], salt[12];
+	memset(key, 0x24, sizeof(key));
+	memset(salt, 0x42, sizeof(salt));
+	janus_srtp_engine_ctx ctx = { .engine = engine, .priv = NULL };
+	janus_srtp_profile profile = JANUS_SRTP_AEAD_AES_128_GCM;
+	if(engine->setup(&ctx, FALSE, profile, key, 16, salt, 12) < 0) {
+		/* No AES-GCM support in this engine (old libsrtp?), use the default profile */
+		profile = JANUS_SRTP_AES128_CM_SHA1_80;
+		if(engine->setup(&ctx, FALSE, profile, key, SRTP_MASTER_KEY_LENGTH, salt, 12) < 0) {
+			JANUS_LOG(LOG_WARN, "SRTP engine '%s': benchmark setup failed, skipping\n", engine->name);
+			return;
+		}
+	}
+	/* We protect the same payload over and over, with fresh headers */
+	int iterations = 4096, batch_size = 32, plen = 1200;
+	char *bufs[32];
+	int lens[32];
+	int i = 0, j = 0;
+	for(j=0; j<batch_size; j++)
+		bufs[j] = g_malloc(plen + SRTP_MAX_TAG_LEN + 4);
+	uint16_t seq = 0;
+	gint64 start = janus_get_monotonic_time();
+	for(i=0; i<iterations/batch_size; i++) {
+		for(j=0; j<batch_size; j++) {
+			unsigned char *p = (unsigned char *)bufs[j];
+			memset(p, 0, 12);
+			p[0] = 0x80;
+			p[1] = 100;
+			seq++;
+			p[2] = seq >> 8;
+			p[3] = seq & 0xFF;
+			p[11] = 1;	/* SSRC */
+			memset(p + 12, 0xA5, plen - 12);
+			lens[j] = plen;
+		}
+		if(engine->protect_batch != NULL) {
+			engine->protect_batch(&ctx, bufs, lens, batch_size);
+		} else {
+			for(j=0; j<batch_size; j++)
+				engine->protect(&ctx, bufs[j], &lens[j]);
+		}
+	}
+	gint64 elapsed = janus_get_monotonic_time() - start;
+	for(j=0; j<batch_size; j++)
+		g_free(bufs[j]);
+	engine->teardown(&ctx);
+	double mbps = (elapsed > 0) ? ((double)iterations*plen*8/(double)elapsed) : 0.0;
+	JANUS_LOG(LOG_INFO, "SRTP engine '%s' (%s): %d packets of %d bytes in %"SCNi64"us (%.0f Mbit/s)\n",
+		engine->name, (profile == JANUS_SRTP_AEAD_AES_128_GCM) ? "AES-128-GCM" : "AES-128-CM-SHA1-80",
+		iterations, plen, elapsed, mbps);
+}
+
+int janus_srtp_engine_select(const char *name) {
+	/* First off, benchmark all the engines, so that deployers can see
+	 * at startup what each of them would buy them on this machine */
+	int i = 0;
+	for(i=0; janus_srtp_engines[i] != NULL; i++)
+		janus_srtp_engine_run_benchmark(janus_srtp_engines[i]);
+	if(name == NULL) {
+		janus_srtp_engine_current = &janus_srtp_engine_libsrtp;
+		return 0;
+	}
+	for(i=0; janus_srtp_engines[i] != NULL; i++) {
+		if(!strcasecmp(name, janus_srtp_engines[i]->name)) {
+			janus_srtp_engine_current = janus_srtp_engines[i];
+			JANUS_LOG(LOG_INFO, "Using SRTP crypto engine '%s'\n", name);
+			return 0;
+		}
+	}
+	JANUS_LOG(LOG_WARN, "Unknown SRTP crypto engine '%s', sticking to libsrtp\n", name);
+	janus_srtp_engine_current = &janus_srtp_engine_libsrtp;
+	return -1;
+}
+
+const char *janus_srtp_engine_selected(void) {
+	return janus_srtp_engine_current->name;
+}
+
+janus_srtp_engine_ctx *janus_srtp_engine_create_context(gboolean inbound, janus_srtp_profile profile,
+		const unsigned char *key, size_t key_len, const unsigned char *salt, size_t salt_len) {
+	if(janus_srtp_engine_current == &janus_srtp_engine_libsrtp) {
+		/* The default: no context, the DTLS stack uses its own sessions */
+		return NULL;
+	}
+	janus_srtp_engine_ctx *ctx = g_malloc0(sizeof(janus_srtp_engine_ctx));
+	ctx->engine = janus_srtp_engine_current;
+	if(ctx->engine->setup(ctx, inbound, profile, key, key_len, salt, salt_len) < 0) {
+		/* The engine doesn't support this profile: fall back to libsrtp */
+		g_free(ctx);
+		return NULL;
+	}
+	return ctx;
+}
+
+srtp_err_status_t janus_srtp_engine_protect(janus_srtp_engine_ctx *ctx, char *buf, int *len) {
+	return ctx->engine->protect(ctx, buf, len);
+}
+
+srtp_err_status_t janus_srtp_engine_unprotect(janus_srtp_engine_ctx *ctx, char *buf, int *len) {
+	return ctx->engine->unprotect(ctx, buf, len);
+}
+
+srtp_err_status_t janus_srtp_engine_protect_rtcp(janus_srtp_engine_ctx *ctx, char *buf, int *len) {
+	return ctx->engine->protect_rtcp(ctx, buf, len);
+}
+
+srtp_err_status_t janus_srtp_engine_unprotect_rtcp(janus_srtp_engine_ctx *ctx, char *buf, int *len) {
+	return ctx->engine->unprotect_rtcp(ctx, buf, len);
+}
+
+gboolean janus_srtp_engine_has_batch(janus_srtp_engine_ctx *ctx) {
+	return ctx != NULL && ctx->engine->protect_batch != NULL;
+}
+
+guint janus_srtp_engine_protect_batch(janus_srtp_engine_ctx *ctx, char **bufs, int *lens, guint count) {
+	return ctx->engine->protect_batch(ctx, bufs, lens, count);
+}
+
+void janus_srtp_engine_destroy_context(janus_srtp_engine_ctx *ctx) {
+	if(ctx == NULL)
+		return;
+	ctx->engine->teardown(ctx);
+	g_free(ctx);
+}
@@ -0,0 +1,116 @@
+/*! \file    srtp-engine.h
+ * \author   Lorenzo Miniero <lorenzo@meetecho.com>
+ * \copyright GNU General Public License v3
+ * \brief    Pluggable SRTP crypto engines (headers)
+ * \details  All SRTP protection and unprotection used to go through the
+ * libsrtp sessions created in dtls.c, one packet at a time. This module
+ * adds a thin crypto-engine abstraction on top of that: an engine is a
+ * set of function pointers to protect/unprotect RTP and RTCP, plus an
+ * optional batched protect that processes several packets in one call,
+ * which matches the batched egress path in ice.c. The engine to use is
+ * selected at startup (e.g., from the configuration file) and libsrtp
+ * remains the fallback: when the selected engine doesn't support the
+ * negotiated SRTP profile (or none was selected), the DTLS stack keeps
+ * using its own libsrtp sessions exactly as before. Besides libsrtp,
+ * an AES-GCM engine implemented directly on top of the OpenSSL EVP
+ * interface is provided, which reuses a single cipher context across
+ * all the packets of a batch.
+ *
+ * \ingroup protocols
+ * \ref protocols
+ */
+
+#ifndef JANUS_SRTP_ENGINE_H
+#define JANUS_SRTP_ENGINE_H
+
+#include <glib.h>
+
+#include "rtpsrtp.h"
+
+struct janus_srtp_engine;
+/*! \brief Per-direction crypto context created by an engine: it keeps a
+ * pointer to the engine that created it, plus engine-private state */
+typedef struct janus_srtp_engine_ctx {
+	/*! \brief Engine this context belongs to */
+	const struct janus_srtp_engine *engine;
+	/*! \brief Engine-private state */
+	void *priv;
+} janus_srtp_engine_ctx;
+
+/*! \brief SRTP crypto engine: all methods return a srtp_err_status_t
+ * compatible value, so that call sites can keep treating errors the way
+ * they treat libsrtp errors */
+typedef struct janus_srtp_engine {
+	/*! \brief Engine name (what's used to select it at startup) */
+	const char *name;
+	/*! \brief Initialize a context from the negotiated profile and keying material
+	 * @param[in] ctx Context to initialize (priv is engine's to fill)
+	 * @param[in] inbound Whether this context will unprotect (TRUE) or protect (FALSE)
+	 * @param[in] profile The negotiated SRTP profile
+	 * @param[in] key Master key (key_len bytes)
+	 * @param[in] salt Master salt (salt_len bytes)
+	 * @returns 0 in case of success, a negative integer if the engine
+	 * doesn't support the profile (the caller will fall back to libsrtp) */
+	int (* const setup)(janus_srtp_engine_ctx *ctx, gboolean inbound, janus_srtp_profile profile,
+		const unsigned char *key, size_t key_len, const unsigned char *salt, size_t salt_len);
+	/*! \brief Protect an RTP packet in place (buffer must have SRTP_MAX_TAG_LEN of headroom) */
+	srtp_err_status_t (* const protect)(janus_srtp_engine_ctx *ctx, char *buf, int *len);
+	/*! \brief Unprotect an SRTP packet in place */
+	srtp_err_status_t (* const unprotect)(janus_srtp_engine_ctx *ctx, char *buf, int *len);
+	/*! \brief Protect an RTCP packet in place (buffer must have SRTP_MAX_TAG_LEN+4 of headroom) */
+	srtp_err_status_t (* const protect_rtcp)(janus_srtp_engine_ctx *ctx, char *buf, int *len);
+	/*! \brief Unprotect an SRTCP packet in place */
+	srtp_err_status_t (* const unprotect_rtcp)(janus_srtp_engine_ctx *ctx, char *buf, int *len);
+	/*! \brief Protect a batch of RTP packets in one call (optional: NULL
+	 * when the engine has no batched implementation)
+	 * @param[in] ctx The outbound context to use
+	 * @param[in] bufs Array of packet buffers (each with tag headroom)
+	 * @param[in,out] lens Array of packet lengths, updated in place; the
+	 * length of a packet that failed to protect is set to -1
+	 * @param[in] count How many packets are in the batch
+	 * @returns How many packets were successfully protected */
+	guint (* const protect_batch)(janus_srtp_engine_ctx *ctx, char **bufs, int *lens, guint count);
+	/*! \brief Destroy the engine-private state of a context */
+	void (* const teardown)(janus_srtp_engine_ctx *ctx);
+} janus_srtp_engine;
+
+/*! \brief Select the crypto engine to use for new PeerConnections, and
+ * run a quick synthetic benchmark of all the available engines (the
+ * results are printed at startup, so that deployers can compare them)
+ * @param[in] name Name of the engine to select, or NULL for the default
+ * (libsrtp, i.e., the sessions the DTLS stack creates by itself)
+ * @returns 0 in case of success, a negative integer if no engine with
+ * that name exists (in which case the default stays selected) */
+int janus_srtp_engine_select(const char *name);
+/*! \brief Get the name of the currently selected engine */
+const char *janus_srtp_engine_selected(void);
+
+/*! \brief Create a per-direction context on the selected engine
+ * @note This returns NULL both when the default libsrtp engine is
+ * selected (the DTLS stack's own sessions are the "context" then) and
+ * when the selected engine doesn't support the negotiated profile:
+ * either way, a NULL return means "keep using libsrtp as before"
+ * @param[in] inbound Whether this context will unprotect (TRUE) or protect (FALSE)
+ * @param[in] profile The negotiated SRTP profile
+ * @param[in] key Master key (key_len bytes)
+ * @param[in] salt Master salt (salt_len bytes)
+ * @returns A new context, or NULL to fall back to libsrtp */
+janus_srtp_engine_ctx *janus_srtp_engine_create_context(gboolean inbound, janus_srtp_profile profile,
+	const unsigned char *key, size_t key_len, const unsigned char *salt, size_t salt_len);
+/*! \brief Protect an RTP packet via an engine context */
+srtp_err_status_t janus_srtp_engine_protect(janus_srtp_engine_ctx *ctx, char *buf, int *len);
+/*! \brief Unprotect an SRTP packet via an engine context */
+srtp_err_status_t janus_srtp_engine_unprotect(janus_srtp_engine_ctx *ctx, char *buf, int *len);
+/*! \brief Protect an RTCP packet via an engine context */
+srtp_err_status_t janus_srtp_engine_protect_rtcp(janus_srtp_engine_ctx *ctx, char *buf, int *len);
+/*! \brief Unprotect an SRTCP packet via an engine context */
+srtp_err_status_t janus_srtp_engine_unprotect_rtcp(janus_srtp_engine_ctx *ctx, char *buf, int *len);
+/*! \brief Check whether an engine context has a batched protect */
+gboolean janus_srtp_engine_has_batch(janus_srtp_engine_ctx *ctx);
+/*! \brief Protect a batch of RTP packets in one call (see the engine
+ * method for the semantics of the arrays) */
+guint janus_srtp_engine_protect_batch(janus_srtp_engine_ctx *ctx, char **bufs, int *lens, guint count);
+/*! \brief Destroy an engine context */
+void janus_srtp_engine_destroy_context(janus_srtp_engine_ctx *ctx);
+
+#endif
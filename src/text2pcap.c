@@ -152,6 +152,124 @@ static void janus_text2pcap_udp_header_init(janus_text2pcap_udp_header *udp, gbo
 }
 
 
+/* Size of the ring of records waiting to be written to file */
+#define JANUS_TEXT2PCAP_RING_SIZE	1024
+/* Max number of payload bytes a single record can carry */
+#define JANUS_TEXT2PCAP_RECORD_SIZE	2048
+
+/* Fixed-size record the capture path fills in: all the formatting and the
+ * actual file I/O are done by the writer thread, so that enabling a capture
+ * on a live handle doesn't change the timing of the media path */
+typedef struct janus_text2pcap_record {
+	/*! \brief Type of the captured packet */
+	janus_text2pcap_packet type;
+	/*! \brief Whether this was an incoming or outgoing packet */
+	gboolean incoming;
+	/*! \brief When the packet was captured */
+	struct timeval when;
+	/*! \brief Original length of the packet */
+	int len;
+	/*! \brief Number of payload bytes actually captured */
+	int saved;
+	/*! \brief Optional annotation to append to the line (text mode only) */
+	char custom[256];
+	/*! \brief Captured payload */
+	char data[JANUS_TEXT2PCAP_RECORD_SIZE];
+} janus_text2pcap_record;
+
+static void janus_text2pcap_write_record(janus_text2pcap *instance, janus_text2pcap_record *record) {
+	/* If we're saving to .pcap directly, generate a packet header and save the payload */
+	if(!instance->text) {
+		int size = record->saved;
+		int hsize = sizeof(janus_text2pcap_ethernet_header) + sizeof(janus_text2pcap_ip_header) +
+			sizeof(janus_text2pcap_udp_header);
+		int hsize_cut = hsize + size;
+		int hsize_tot = hsize + record->len;
+		/* We need a fake Ethernet/IP/UDP encapsulation for this packet */
+		janus_text2pcap_ethernet_header eth;
+		janus_text2pcap_ethernet_header_init(&eth);
+		janus_text2pcap_ip_header ip;
+		janus_text2pcap_ip_header_init(&ip, record->incoming, record->len);
+		janus_text2pcap_udp_header udp;
+		janus_text2pcap_udp_header_init(&udp, record->incoming, record->len);
+		/* Now prepare the packet header */
+		janus_text2pcap_packet_header header = {
+			record->when.tv_sec, record->when.tv_usec, hsize_cut, hsize_tot
+		};
+		fwrite(&header, sizeof(char), sizeof(header), instance->file);
+		fwrite(&eth, sizeof(char), sizeof(eth), instance->file);
+		fwrite(&ip, sizeof(char), sizeof(ip), instance->file);
+		fwrite(&udp, sizeof(char), sizeof(udp), instance->file);
+		/* The write the packet itself (or part of it) */
+		int temp = 0, tot = size;
+		while(tot > 0) {
+			temp = fwrite(record->data+size-tot, sizeof(char), tot, instance->file);
+			if(temp <= 0) {
+				JANUS_LOG(LOG_ERR, "Error dumping packet...\n");
+				return;
+			}
+			tot -= temp;
+		}
+		return;
+	}
+	/* If we got here, we need to prepare a text representation of the packet */
+	char buffer[5000], timestamp[20], usec[10], byte[10];
+	memset(timestamp, 0, sizeof(timestamp));
+	memset(usec, 0, sizeof(usec));
+	time_t t = record->when.tv_sec;
+	struct tm *tm = localtime(&t);
+	strftime(timestamp, sizeof(timestamp), "%H:%M:%S", tm);
+	g_snprintf(usec, sizeof(usec), ".%06ld", (long)record->when.tv_usec);
+	janus_strlcat(timestamp, usec, sizeof(timestamp));
+	memset(buffer, 0, sizeof(buffer));
+	g_snprintf(buffer, sizeof(buffer), "%s %s 000000 ", record->incoming ? "I" : "O", timestamp);
+	int i=0;
+	for(i=0; i<record->saved; i++) {
+		memset(byte, 0, sizeof(byte));
+		g_snprintf(byte, sizeof(byte), " %02x", (unsigned char)record->data[i]);
+		janus_strlcat(buffer, byte, sizeof(buffer));
+	}
+	janus_strlcat(buffer, " ", sizeof(buffer));
+	janus_strlcat(buffer, janus_text2pcap_packet_string(record->type), sizeof(buffer));
+	if(record->custom[0] != '\0') {
+		janus_strlcat(buffer, " ", sizeof(buffer));
+		janus_strlcat(buffer, record->custom, sizeof(buffer));
+	}
+	janus_strlcat(buffer, "\r\n", sizeof(buffer));
+	/* Save textified packet on file */
+	int temp = 0, buflen = strlen(buffer), tot = buflen;
+	while(tot > 0) {
+		temp = fwrite(buffer+buflen-tot, sizeof(char), tot, instance->file);
+		if(temp <= 0) {
+			JANUS_LOG(LOG_ERR, "Error dumping packet...\n");
+			return;
+		}
+		tot -= temp;
+	}
+}
+
+static void *janus_text2pcap_writer_thread(void *data) {
+	janus_text2pcap *instance = (janus_text2pcap *)data;
+	janus_text2pcap_record *record = NULL;
+	while(TRUE) {
+		record = (janus_text2pcap_record *)janus_lfq_try_pop(instance->ring);
+		if(record == NULL) {
+			/* Nothing to write: if the capture is over we're done,
+			 * otherwise just wait a bit for new records to show up */
+			if(!g_atomic_int_get(&instance->writable))
+				break;
+			g_usleep(20000);
+			continue;
+		}
+		janus_text2pcap_write_record(instance, record);
+		/* Return the record to the pool */
+		if(!janus_lfq_try_push(instance->pool, record))
+			g_free(record);
+	}
+	fflush(instance->file);
+	return NULL;
+}
+
 janus_text2pcap *janus_text2pcap_create(const char *dir, const char *filename, int truncate, gboolean text) {
 	janus_text2pcap *tp;
 	char newname[1024];
@@ -208,6 +326,33 @@ janus_text2pcap *janus_text2pcap_create(const char *dir, const char *filename, i
 		fwrite(&header, sizeof(char), sizeof(header), f);
 	}
 
+	/* Prepare the ring and the pool of free records, and spawn the
+	 * writer thread that will drain the captured packets to file */
+	tp->ring = janus_lfq_new(JANUS_TEXT2PCAP_RING_SIZE);
+	tp->pool = janus_lfq_new(JANUS_TEXT2PCAP_RING_SIZE);
+	guint i = 0;
+	for(i = 0; i < JANUS_TEXT2PCAP_RING_SIZE; i++)
+		janus_lfq_try_push(tp->pool, g_malloc(sizeof(janus_text2pcap_record)));
+	g_atomic_int_set(&tp->dropped, 0);
+	GError *error = NULL;
+	tp->thread = g_thread_try_new("t2p writer", &janus_text2pcap_writer_thread, tp, &error);
+	if(error != NULL) {
+		JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the text2pcap writer thread...\n",
+			error->code, error->message ? error->message : "??");
+		g_error_free(error);
+		g_atomic_int_set(&tp->writable, 0);
+		gpointer record = NULL;
+		while((record = janus_lfq_try_pop(tp->pool)) != NULL)
+			g_free(record);
+		janus_lfq_destroy(tp->ring);
+		janus_lfq_destroy(tp->pool);
+		fclose(f);
+		g_free(fname);
+		janus_mutex_destroy(&tp->mutex);
+		g_free(tp);
+		return NULL;
+	}
+
 	return tp;
 }
 
@@ -215,97 +360,39 @@ int janus_text2pcap_dump(janus_text2pcap *instance,
 		janus_text2pcap_packet type, gboolean incoming, char *buf, int len, const char *format, ...) {
 	if(instance == NULL || buf == NULL || len < 1)
 		return -1;
-	janus_mutex_lock_nodebug(&instance->mutex);
-	if(instance->file == NULL || !g_atomic_int_get(&instance->writable)) {
-		janus_mutex_unlock_nodebug(&instance->mutex);
+	if(instance->file == NULL || !g_atomic_int_get(&instance->writable))
 		return -1;
+	/* Grab a free record: if there's none, the writer is behind and we
+	 * drop the packet, rather than slow down the media path waiting */
+	janus_text2pcap_record *record = (janus_text2pcap_record *)janus_lfq_try_pop(instance->pool);
+	if(record == NULL) {
+		g_atomic_int_inc(&instance->dropped);
+		return -2;
 	}
-	/* If we're saving to .pcap directly, generate a packet header and save the payload */
-	if(!instance->text) {
-		/* Are we truncating? */
-		int size = instance->truncate ? (len > instance->truncate ? instance->truncate : len) : len;
-		int hsize = sizeof(janus_text2pcap_ethernet_header) + sizeof(janus_text2pcap_ip_header) +
-			sizeof(janus_text2pcap_udp_header);
-		int hsize_cut = hsize + size;
-		int hsize_tot = hsize + len;
-		/* We need a fake Ethernet/IP/UDP encapsulation for this packet */
-		janus_text2pcap_ethernet_header eth;
-		janus_text2pcap_ethernet_header_init(&eth);
-		janus_text2pcap_ip_header ip;
-		janus_text2pcap_ip_header_init(&ip, incoming, len);
-		janus_text2pcap_udp_header udp;
-		janus_text2pcap_udp_header_init(&udp, incoming, len);
-		/* Now prepare the packet header */
-		struct timeval tv;
-		gettimeofday(&tv, NULL);
-		janus_text2pcap_packet_header header = {
-			tv.tv_sec, tv.tv_usec, hsize_cut, hsize_tot
-		};
-		fwrite(&header, sizeof(char), sizeof(header), instance->file);
-		fwrite(&eth, sizeof(char), sizeof(eth), instance->file);
-		fwrite(&ip, sizeof(char), sizeof(ip), instance->file);
-		fwrite(&udp, sizeof(char), sizeof(udp), instance->file);
-		/* The write the packet itself (or part of it) */
-		int temp = 0, tot = size;
-		while(tot > 0) {
-			temp = fwrite(buf+size-tot, sizeof(char), tot, instance->file);
-			if(temp <= 0) {
-				JANUS_LOG(LOG_ERR, "Error dumping packet...\n");
-				janus_mutex_unlock_nodebug(&instance->mutex);
-				return -2;
-			}
-			tot -= temp;
-		}
-		/* Done */
-		janus_mutex_unlock_nodebug(&instance->mutex);
-		return 0;
-	}
-	/* If we got here, we need to prepare a text representation of the packet */
-	char buffer[5000], timestamp[20], usec[10], byte[10];
-	memset(timestamp, 0, sizeof(timestamp));
-	memset(usec, 0, sizeof(usec));
-	time_t t = time(NULL);
-	struct tm *tm = localtime(&t);
-	struct timeval tv;
-	gettimeofday(&tv, NULL);
-	strftime(timestamp, sizeof(timestamp), "%H:%M:%S", tm);
-	g_snprintf(usec, sizeof(usec), ".%06ld", tv.tv_usec);
-	janus_strlcat(timestamp, usec, sizeof(timestamp));
-	memset(buffer, 0, sizeof(buffer));
-	g_snprintf(buffer, sizeof(buffer), "%s %s 000000 ", incoming ? "I" : "O", timestamp);
-	int i=0;
-	int stop = instance->truncate ? (len > instance->truncate ? instance->truncate : len) : len;
-	for(i=0; i<stop; i++) {
-		memset(byte, 0, sizeof(byte));
-		g_snprintf(byte, sizeof(byte), " %02x", (unsigned char)buf[i]);
-		janus_strlcat(buffer, byte, sizeof(buffer));
-	}
-	janus_strlcat(buffer, " ", sizeof(buffer));
-	janus_strlcat(buffer, janus_text2pcap_packet_string(type), sizeof(buffer));
+	record->type = type;
+	record->incoming = incoming;
+	gettimeofday(&record->when, NULL);
+	record->len = len;
+	/* Are we truncating? */
+	int size = instance->truncate ? (len > instance->truncate ? instance->truncate : len) : len;
+	if(size > JANUS_TEXT2PCAP_RECORD_SIZE)
+		size = JANUS_TEXT2PCAP_RECORD_SIZE;
+	record->saved = size;
+	memcpy(record->data, buf, size);
+	record->custom[0] = '\0';
 	if(format) {
 		/* This callback has variable arguments (error string) */
-		char custom[512];
 		va_list ap;
 		va_start(ap, format);
-		g_vsnprintf(custom, sizeof(custom), format, ap);
+		g_vsnprintf(record->custom, sizeof(record->custom), format, ap);
 		va_end(ap);
-		janus_strlcat(buffer, " ", sizeof(buffer));
-		janus_strlcat(buffer, custom, sizeof(buffer));
 	}
-	janus_strlcat(buffer, "\r\n", sizeof(buffer));
-	/* Save textified packet on file */
-	int temp = 0, buflen = strlen(buffer), tot = buflen;
-	while(tot > 0) {
-		temp = fwrite(buffer+buflen-tot, sizeof(char), tot, instance->file);
-		if(temp <= 0) {
-			JANUS_LOG(LOG_ERR, "Error dumping packet...\n");
-			janus_mutex_unlock_nodebug(&instance->mutex);
-			return -2;
-		}
-		tot -= temp;
+	/* Queue the record for the writer thread */
+	if(!janus_lfq_try_push(instance->ring, record)) {
+		janus_lfq_try_push(instance->pool, record);
+		g_atomic_int_inc(&instance->dropped);
+		return -2;
 	}
-	/* Done */
-	janus_mutex_unlock_nodebug(&instance->mutex);
 	return 0;
 }
 
@@ -317,6 +404,16 @@ int janus_text2pcap_close(janus_text2pcap *instance) {
 		janus_mutex_unlock_nodebug(&instance->mutex);
 		return 0;
 	}
+	/* Wait for the writer thread to drain the pending records */
+	if(instance->thread != NULL) {
+		g_thread_join(instance->thread);
+		instance->thread = NULL;
+	}
+	int dropped = g_atomic_int_get(&instance->dropped);
+	if(dropped > 0) {
+		JANUS_LOG(LOG_WARN, "Dropped %d packets while capturing to %s (the writer couldn't keep up)\n",
+			dropped, instance->filename);
+	}
 	fclose(instance->file);
 	instance->file = NULL;
 	janus_mutex_unlock_nodebug(&instance->mutex);
@@ -327,6 +424,17 @@ void janus_text2pcap_free(janus_text2pcap *instance) {
 	if(instance == NULL)
 		return;
 	janus_text2pcap_close(instance);
+	gpointer record = NULL;
+	if(instance->ring != NULL) {
+		while((record = janus_lfq_try_pop(instance->ring)) != NULL)
+			g_free(record);
+		janus_lfq_destroy(instance->ring);
+	}
+	if(instance->pool != NULL) {
+		while((record = janus_lfq_try_pop(instance->pool)) != NULL)
+			g_free(record);
+		janus_lfq_destroy(instance->pool);
+	}
 	g_free(instance->filename);
 	janus_mutex_destroy(&instance->mutex);
 	g_free(instance);
@@ -43,6 +43,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "lfq.h"
 #include "mutex.h"
 
 /*! \brief Instance of a text2pcap recorder */
@@ -57,6 +58,14 @@ typedef struct janus_text2pcap {
 	gboolean text;
 	/*! \brief Whether we can write to this file or not */
 	volatile int writable;
+	/*! \brief Ring of captured records waiting to be written to file */
+	janus_lfq *ring;
+	/*! \brief Pool of free records, so that capturing never allocates */
+	janus_lfq *pool;
+	/*! \brief Writer thread, draining the ring to file */
+	GThread *thread;
+	/*! \brief Number of packets dropped because the writer couldn't keep up */
+	volatile gint dropped;
 	/*! \brief Mutex to lock/unlock this recorder instance */
 	janus_mutex mutex;
 } janus_text2pcap;
@@ -80,6 +89,10 @@ const char *janus_text2pcap_packet_string(janus_text2pcap_packet type);
 janus_text2pcap *janus_text2pcap_create(const char *dir, const char *filename, int truncate, gboolean text);
 
 /*! \brief Dump an RTP or RTCP packet
+ * \note This only copies the packet to a fixed-size record and queues it
+ * for the writer thread, so it's safe to invoke from the media path: all
+ * file I/O and formatting happen asynchronously. In case the writer can't
+ * keep up and the ring is full, the packet is dropped rather than blocking
  * @param[in] instance Instance of the janus_text2pcap recorder to dump the packet to
  * @param[in] type Type of the packet we're going to dump
  * @param[in] incoming Whether this is an incoming or outgoing packet
@@ -0,0 +1,230 @@
+/*! \file    timerwheel.c
+ * \author   Lorenzo Miniero <lorenzo@meetecho.com>
+ * \copyright GNU General Public License v3
+ * \brief    Timer wheel for periodic jobs
+ * \details  Implementation of a hashed timer wheel driven by a single
+ * GSource per event loop. Each handle used to attach several GSource
+ * timers to its loop (RTCP reports, stats, TWCC feedback, the DTLS
+ * retransmission timer): GLib keeps sources in a priority queue, so with
+ * thousands of handles sharing a static event loop every insertion and
+ * expiry paid a logarithmic bookkeeping cost. The wheel replaces them
+ * with an array of slots, one per tick of granularity: scheduling is a
+ * list prepend in the slot the deadline hashes to, and each tick only
+ * looks at its own slot. Jobs further away than a full turn of the wheel
+ * simply stay in their slot until their deadline actually falls due.
+ *
+ * \ingroup core
+ * \ref core
+ */
+
+#include "timerwheel.h"
+#include "mutex.h"
+#include "utils.h"
+#include "debug.h"
+
+/* Number of slots (power of two): with 50ms ticks a full turn is ~12.8s,
+ * which covers the periodic jobs we schedule without ever cascading */
+#define JANUS_TIMER_WHEEL_SLOTS		256
+
+struct janus_timer_job {
+	/*! \brief The wheel this job is scheduled on */
+	janus_timer_wheel *wheel;
+	/*! \brief Interval of the job, in ticks (at least 1) */
+	guint interval_ticks;
+	/*! \brief Whether the job re-arms itself after firing */
+	gboolean periodic;
+	/*! \brief Callback and user data */
+	janus_timer_wheel_callback callback;
+	gpointer user_data;
+	GDestroyNotify destroy;
+	/*! \brief Absolute tick the job is due at */
+	guint64 expiry_tick;
+	/*! \brief Whether the job has been cancelled (freed lazily) */
+	volatile gint cancelled;
+};
+
+struct janus_timer_wheel {
+	/*! \brief Context of the event loop the wheel is attached to */
+	GMainContext *ctx;
+	/*! \brief The GSource driving the wheel */
+	GSource *source;
+	/*! \brief Mutex to protect the slots (jobs can be added from other threads) */
+	janus_mutex mutex;
+	/*! \brief Slots of scheduled jobs (deadline tick modulo the number of slots) */
+	GSList *slots[JANUS_TIMER_WHEEL_SLOTS];
+	/*! \brief Number of jobs currently scheduled */
+	guint jobs;
+	/*! \brief Monotonic time the wheel was created (tick 0) */
+	gint64 base;
+	/*! \brief Last tick that has been processed */
+	guint64 current_tick;
+};
+
+typedef struct janus_timer_wheel_source {
+	GSource parent;
+	janus_timer_wheel *wheel;
+} janus_timer_wheel_source;
+
+static guint64 janus_timer_wheel_now(janus_timer_wheel *wheel) {
+	return (guint64)((janus_get_monotonic_time() - wheel->base) / (JANUS_TIMER_WHEEL_TICK_MS*1000));
+}
+
+static void janus_timer_job_free(janus_timer_job *job) {
+	if(job->destroy != NULL && job->user_data != NULL)
+		job->destroy(job->user_data);
+	g_free(job);
+}
+
+static gboolean janus_timer_wheel_prepare(GSource *source, gint *timeout) {
+	janus_timer_wheel *wheel = ((janus_timer_wheel_source *)source)->wheel;
+	janus_mutex_lock(&wheel->mutex);
+	guint jobs = wheel->jobs;
+	janus_mutex_unlock(&wheel->mutex);
+	if(jobs == 0) {
+		/* Nothing scheduled, sleep until someone adds a job and wakes us */
+		*timeout = -1;
+		return FALSE;
+	}
+	gint64 next = wheel->base + (gint64)(wheel->current_tick+1)*JANUS_TIMER_WHEEL_TICK_MS*1000;
+	gint64 now = janus_get_monotonic_time();
+	if(now >= next) {
+		*timeout = 0;
+		return TRUE;
+	}
+	*timeout = (gint)((next - now)/1000) + 1;
+	return FALSE;
+}
+
+static gboolean janus_timer_wheel_check(GSource *source) {
+	janus_timer_wheel *wheel = ((janus_timer_wheel_source *)source)->wheel;
+	return wheel->jobs > 0 && janus_timer_wheel_now(wheel) > wheel->current_tick;
+}
+
+static gboolean janus_timer_wheel_dispatch(GSource *source, GSourceFunc callback, gpointer user_data) {
+	janus_timer_wheel *wheel = ((janus_timer_wheel_source *)source)->wheel;
+	guint64 now_tick = janus_timer_wheel_now(wheel);
+	/* If we fell behind by more than a full turn, each slot is visited once */
+	guint64 tick = wheel->current_tick+1;
+	if(now_tick > tick + JANUS_TIMER_WHEEL_SLOTS)
+		tick = now_tick - JANUS_TIMER_WHEEL_SLOTS + 1;
+	GSList *due = NULL;
+	janus_mutex_lock(&wheel->mutex);
+	for(; tick <= now_tick; tick++) {
+		guint slot = (guint)(tick & (JANUS_TIMER_WHEEL_SLOTS-1));
+		GSList *l = wheel->slots[slot], *next = NULL;
+		while(l) {
+			next = l->next;
+			janus_timer_job *job = (janus_timer_job *)l->data;
+			if(g_atomic_int_get(&job->cancelled)) {
+				/* Lazily collect cancelled jobs */
+				wheel->slots[slot] = g_slist_delete_link(wheel->slots[slot], l);
+				wheel->jobs--;
+				janus_timer_job_free(job);
+			} else if(job->expiry_tick <= now_tick) {
+				/* Due: move out of the slot, we'll run it without the lock */
+				wheel->slots[slot] = g_slist_delete_link(wheel->slots[slot], l);
+				due = g_slist_prepend(due, job);
+			}
+			l = next;
+		}
+	}
+	wheel->current_tick = now_tick;
+	janus_mutex_unlock(&wheel->mutex);
+	/* Run the due jobs without holding the lock, so callbacks can schedule more */
+	GSList *d = due;
+	while(d) {
+		janus_timer_job *job = (janus_timer_job *)d->data;
+		gboolean again = FALSE;
+		if(!g_atomic_int_get(&job->cancelled))
+			again = job->callback(job->user_data) && job->periodic;
+		janus_mutex_lock(&wheel->mutex);
+		if(again && !g_atomic_int_get(&job->cancelled)) {
+			/* Re-arm the periodic job on its next deadline */
+			job->expiry_tick += job->interval_ticks;
+			if(job->expiry_tick <= now_tick)
+				job->expiry_tick = now_tick + job->interval_ticks;
+			guint slot = (guint)(job->expiry_tick & (JANUS_TIMER_WHEEL_SLOTS-1));
+			wheel->slots[slot] = g_slist_prepend(wheel->slots[slot], job);
+		} else {
+			wheel->jobs--;
+			janus_timer_job_free(job);
+		}
+		janus_mutex_unlock(&wheel->mutex);
+		d = d->next;
+	}
+	g_slist_free(due);
+	return G_SOURCE_CONTINUE;
+}
+
+static GSourceFuncs janus_timer_wheel_funcs = {
+	janus_timer_wheel_prepare,
+	janus_timer_wheel_check,
+	janus_timer_wheel_dispatch,
+	NULL, NULL, NULL
+};
+
+janus_timer_wheel *janus_timer_wheel_create(GMainContext *ctx) {
+	if(ctx == NULL)
+		return NULL;
+	janus_timer_wheel *wheel = g_malloc0(sizeof(janus_timer_wheel));
+	wheel->ctx = ctx;
+	janus_mutex_init(&wheel->mutex);
+	wheel->base = janus_get_monotonic_time();
+	wheel->source = g_source_new(&janus_timer_wheel_funcs, sizeof(janus_timer_wheel_source));
+	((janus_timer_wheel_source *)wheel->source)->wheel = wheel;
+	g_source_set_priority(wheel->source, G_PRIORITY_DEFAULT);
+	g_source_attach(wheel->source, ctx);
+	return wheel;
+}
+
+janus_timer_job *janus_timer_wheel_add(janus_timer_wheel *wheel, guint interval_ms,
+		gboolean periodic, janus_timer_wheel_callback callback, gpointer user_data, GDestroyNotify destroy) {
+	if(wheel == NULL || callback == NULL)
+		return NULL;
+	janus_timer_job *job = g_malloc0(sizeof(janus_timer_job));
+	job->wheel = wheel;
+	job->interval_ticks = (interval_ms + JANUS_TIMER_WHEEL_TICK_MS - 1)/JANUS_TIMER_WHEEL_TICK_MS;
+	if(job->interval_ticks == 0)
+		job->interval_ticks = 1;
+	job->periodic = periodic;
+	job->callback = callback;
+	job->user_data = user_data;
+	job->destroy = destroy;
+	janus_mutex_lock(&wheel->mutex);
+	job->expiry_tick = janus_timer_wheel_now(wheel) + job->interval_ticks;
+	guint slot = (guint)(job->expiry_tick & (JANUS_TIMER_WHEEL_SLOTS-1));
+	wheel->slots[slot] = g_slist_prepend(wheel->slots[slot], job);
+	wheel->jobs++;
+	janus_mutex_unlock(&wheel->mutex);
+	/* Wake the loop up, in case it's sleeping past the new deadline */
+	g_main_context_wakeup(wheel->ctx);
+	return job;
+}
+
+void janus_timer_job_cancel(janus_timer_job *job) {
+	if(job == NULL)
+		return;
+	/* Just flag it: the wheel frees it when its slot comes up again */
+	g_atomic_int_set(&job->cancelled, 1);
+}
+
+void janus_timer_wheel_destroy(janus_timer_wheel *wheel) {
+	if(wheel == NULL)
+		return;
+	g_source_destroy(wheel->source);
+	g_source_unref(wheel->source);
+	janus_mutex_lock(&wheel->mutex);
+	guint slot = 0;
+	for(slot = 0; slot < JANUS_TIMER_WHEEL_SLOTS; slot++) {
+		GSList *l = wheel->slots[slot];
+		while(l) {
+			janus_timer_job_free((janus_timer_job *)l->data);
+			l = l->next;
+		}
+		g_slist_free(wheel->slots[slot]);
+		wheel->slots[slot] = NULL;
+	}
+	janus_mutex_unlock(&wheel->mutex);
+	janus_mutex_destroy(&wheel->mutex);
+	g_free(wheel);
+}
@@ -0,0 +1,58 @@
+/*! \file    timerwheel.h
+ * \author   Lorenzo Miniero <lorenzo@meetecho.com>
+ * \copyright GNU General Public License v3
+ * \brief    Timer wheel for periodic jobs (headers)
+ * \details  A hashed timer wheel that multiplexes the periodic jobs of
+ * many handles (RTCP reports, stats, TWCC feedback, DTLS retransmissions)
+ * over a single GSource per event loop, instead of one GSource per job:
+ * with thousands of handles sharing a static event loop, this takes the
+ * per-job cost of timer bookkeeping out of GLib's priority queue.
+ *
+ * \ingroup core
+ * \ref core
+ */
+
+#ifndef JANUS_TIMERWHEEL_H
+#define JANUS_TIMERWHEEL_H
+
+#include <glib.h>
+
+/*! \brief Granularity of the wheel, in milliseconds: jobs fire on the
+ * first tick at or after their deadline, so intervals are effectively
+ * rounded up to a multiple of this */
+#define JANUS_TIMER_WHEEL_TICK_MS	50
+
+/*! \brief Opaque timer wheel instance (one per event loop) */
+typedef struct janus_timer_wheel janus_timer_wheel;
+/*! \brief Opaque handle to a job scheduled on a wheel */
+typedef struct janus_timer_job janus_timer_job;
+/*! \brief Callback jobs are invoked with; for periodic jobs, returning
+ * FALSE (G_SOURCE_REMOVE) stops the job, like a GSourceFunc would */
+typedef gboolean (*janus_timer_wheel_callback)(gpointer user_data);
+
+/*! \brief Create a new timer wheel, driven by a GSource attached to the provided context
+ * @param[in] ctx The GMainContext of the event loop this wheel will live on
+ * @returns A pointer to a valid janus_timer_wheel instance, if successful, NULL otherwise */
+janus_timer_wheel *janus_timer_wheel_create(GMainContext *ctx);
+/*! \brief Schedule a job on a wheel
+ * \note The callback runs on the thread of the event loop the wheel is attached to
+ * @param[in] wheel The wheel to schedule the job on
+ * @param[in] interval_ms Time to the (first) invocation, in milliseconds
+ * @param[in] periodic Whether the job should fire every interval_ms, or just once
+ * @param[in] callback The function to invoke when the job fires
+ * @param[in] user_data Opaque pointer passed to the callback as is
+ * @param[in] destroy Function to invoke on user_data when the job goes away, if any
+ * @returns A pointer to the scheduled job, that can be used to cancel it */
+janus_timer_job *janus_timer_wheel_add(janus_timer_wheel *wheel, guint interval_ms,
+	gboolean periodic, janus_timer_wheel_callback callback, gpointer user_data, GDestroyNotify destroy);
+/*! \brief Cancel a scheduled job
+ * \note Safe to invoke from the loop thread only: the callback is guaranteed
+ * not to run after this returns, while the job memory (and the user_data
+ * destroy notification) may be deferred to a later tick of the wheel
+ * @param[in] job The job to cancel */
+void janus_timer_job_cancel(janus_timer_job *job);
+/*! \brief Destroy a timer wheel, cancelling all the jobs still scheduled on it
+ * @param[in] wheel The wheel to destroy */
+void janus_timer_wheel_destroy(janus_timer_wheel *wheel);
+
+#endif
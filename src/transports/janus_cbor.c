@@ -0,0 +1,376 @@
+/*! \file   janus_cbor.c
+ * \author Lorenzo Miniero <lorenzo@meetecho.com>
+ * \copyright GNU General Public License v3
+ * \brief  CBOR serialization for API messages
+ * \details  This module implements a small, self contained CBOR codec
+ * (RFC 8949) for the Jansson values the Janus and Admin APIs are made
+ * of, so that transports sitting on message oriented channels (e.g.,
+ * WebSockets, Unix Sockets, Nanomsg) can offer clients a negotiable
+ * binary encoding as an alternative to \c json_dumps / \c json_loads .
+ *
+ * \ingroup transportapi
+ * \ref transportapi
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "janus_cbor.h"
+
+#include "../debug.h"
+
+/* CBOR major types (high 3 bits of the initial byte) */
+#define JANUS_CBOR_UINT			0
+#define JANUS_CBOR_NEGINT		1
+#define JANUS_CBOR_BYTES		2
+#define JANUS_CBOR_TEXT			3
+#define JANUS_CBOR_ARRAY		4
+#define JANUS_CBOR_MAP			5
+#define JANUS_CBOR_TAG			6
+#define JANUS_CBOR_SIMPLE		7
+/* Simple values and floats (major type 7) */
+#define JANUS_CBOR_FALSE		20
+#define JANUS_CBOR_TRUE			21
+#define JANUS_CBOR_NULL			22
+#define JANUS_CBOR_FLOAT16		25
+#define JANUS_CBOR_FLOAT32		26
+#define JANUS_CBOR_FLOAT64		27
+/* How deep we allow nested arrays/maps to go, when decoding */
+#define JANUS_CBOR_MAX_DEPTH	128
+
+
+gboolean janus_cbor_is_cbor(const char *buf, size_t len) {
+	if(buf == NULL || len == 0)
+		return FALSE;
+	/* Every Janus API message is an object, so a CBOR payload always
+	 * starts with a map header (0xa0-0xbb): JSON can't, since its first
+	 * byte is printable ASCII (typically '{') */
+	uint8_t byte = (uint8_t)buf[0];
+	return (byte >> 5) == JANUS_CBOR_MAP;
+}
+
+
+/* Where the encoder emits its bytes: a callback (with the same
+ * signature json_dump_callback uses), so that transports can stream the
+ * encoded message directly into their own buffers */
+typedef struct janus_cbor_sink {
+	json_dump_callback_t callback;
+	void *data;
+} janus_cbor_sink;
+static gboolean janus_cbor_sink_write(janus_cbor_sink *cb, const uint8_t *bytes, size_t len) {
+	return cb->callback((const char *)bytes, len, cb->data) == 0;
+}
+
+/* Growable buffer janus_cbor_encode collects the payload in: we use
+ * malloc/realloc rather than g_malloc, since transports free outgoing
+ * payloads with free() (they historically come from json_dumps) */
+typedef struct janus_cbor_buffer {
+	uint8_t *data;
+	size_t length;
+	size_t size;
+} janus_cbor_buffer;
+
+static int janus_cbor_buffer_append(const char *bytes, size_t len, void *data) {
+	janus_cbor_buffer *cb = (janus_cbor_buffer *)data;
+	if(cb->length + len > cb->size) {
+		size_t size = cb->size ? cb->size : 256;
+		while(cb->length + len > size)
+			size *= 2;
+		uint8_t *grown = realloc(cb->data, size);
+		if(grown == NULL)
+			return -1;
+		cb->data = grown;
+		cb->size = size;
+	}
+	memcpy(cb->data + cb->length, bytes, len);
+	cb->length += len;
+	return 0;
+}
+
+/* Write an initial byte plus its argument, using the shortest form */
+static gboolean janus_cbor_encode_head(janus_cbor_sink *cb, uint8_t major, uint64_t value) {
+	uint8_t head[9];
+	size_t len = 0;
+	if(value < 24) {
+		head[0] = (major << 5) | (uint8_t)value;
+		len = 1;
+	} else if(value <= 0xFF) {
+		head[0] = (major << 5) | 24;
+		head[1] = (uint8_t)value;
+		len = 2;
+	} else if(value <= 0xFFFF) {
+		head[0] = (major << 5) | 25;
+		head[1] = (uint8_t)(value >> 8);
+		head[2] = (uint8_t)value;
+		len = 3;
+	} else if(value <= 0xFFFFFFFF) {
+		head[0] = (major << 5) | 26;
+		head[1] = (uint8_t)(value >> 24);
+		head[2] = (uint8_t)(value >> 16);
+		head[3] = (uint8_t)(value >> 8);
+		head[4] = (uint8_t)value;
+		len = 5;
+	} else {
+		head[0] = (major << 5) | 27;
+		int i = 0;
+		for(i=0; i<8; i++)
+			head[1+i] = (uint8_t)(value >> (56 - 8*i));
+		len = 9;
+	}
+	return janus_cbor_sink_write(cb, head, len);
+}
+
+static gboolean janus_cbor_encode_value(janus_cbor_sink *cb, json_t *value) {
+	switch(json_typeof(value)) {
+		case JSON_NULL: {
+			uint8_t byte = (JANUS_CBOR_SIMPLE << 5) | JANUS_CBOR_NULL;
+			return janus_cbor_sink_write(cb, &byte, 1);
+		}
+		case JSON_TRUE:
+		case JSON_FALSE: {
+			uint8_t byte = (JANUS_CBOR_SIMPLE << 5) |
+				(json_is_true(value) ? JANUS_CBOR_TRUE : JANUS_CBOR_FALSE);
+			return janus_cbor_sink_write(cb, &byte, 1);
+		}
+		case JSON_INTEGER: {
+			json_int_t num = json_integer_value(value);
+			if(num >= 0)
+				return janus_cbor_encode_head(cb, JANUS_CBOR_UINT, (uint64_t)num);
+			return janus_cbor_encode_head(cb, JANUS_CBOR_NEGINT, (uint64_t)(-1 - num));
+		}
+		case JSON_REAL: {
+			/* We always use the 64-bit float encoding */
+			double num = json_real_value(value);
+			uint64_t bits = 0;
+			memcpy(&bits, &num, sizeof(bits));
+			uint8_t head[9];
+			head[0] = (JANUS_CBOR_SIMPLE << 5) | JANUS_CBOR_FLOAT64;
+			int i = 0;
+			for(i=0; i<8; i++)
+				head[1+i] = (uint8_t)(bits >> (56 - 8*i));
+			return janus_cbor_sink_write(cb, head, 9);
+		}
+		case JSON_STRING: {
+			size_t length = json_string_length(value);
+			if(!janus_cbor_encode_head(cb, JANUS_CBOR_TEXT, (uint64_t)length))
+				return FALSE;
+			return janus_cbor_sink_write(cb, (const uint8_t *)json_string_value(value), length);
+		}
+		case JSON_ARRAY: {
+			size_t num = json_array_size(value), i = 0;
+			if(!janus_cbor_encode_head(cb, JANUS_CBOR_ARRAY, (uint64_t)num))
+				return FALSE;
+			for(i=0; i<num; i++) {
+				if(!janus_cbor_encode_value(cb, json_array_get(value, i)))
+					return FALSE;
+			}
+			return TRUE;
+		}
+		case JSON_OBJECT: {
+			if(!janus_cbor_encode_head(cb, JANUS_CBOR_MAP, (uint64_t)json_object_size(value)))
+				return FALSE;
+			const char *key = NULL;
+			json_t *item = NULL;
+			json_object_foreach(value, key, item) {
+				size_t length = strlen(key);
+				if(!janus_cbor_encode_head(cb, JANUS_CBOR_TEXT, (uint64_t)length))
+					return FALSE;
+				if(!janus_cbor_sink_write(cb, (const uint8_t *)key, length))
+					return FALSE;
+				if(!janus_cbor_encode_value(cb, item))
+					return FALSE;
+			}
+			return TRUE;
+		}
+		default:
+			break;
+	}
+	return FALSE;
+}
+
+int janus_cbor_dump_callback(json_t *message, json_dump_callback_t callback, void *data) {
+	if(message == NULL || callback == NULL || !json_is_object(message))
+		return -1;
+	janus_cbor_sink sink = { .callback = callback, .data = data };
+	if(!janus_cbor_encode_value(&sink, message)) {
+		JANUS_LOG(LOG_ERR, "Error encoding message to CBOR...\n");
+		return -1;
+	}
+	return 0;
+}
+
+char *janus_cbor_encode(json_t *message, size_t *len) {
+	if(message == NULL || len == NULL)
+		return NULL;
+	janus_cbor_buffer cb = { 0 };
+	if(janus_cbor_dump_callback(message, janus_cbor_buffer_append, &cb) < 0) {
+		free(cb.data);
+		return NULL;
+	}
+	*len = cb.length;
+	return (char *)cb.data;
+}
+
+
+/* Decoding state: a cursor on the buffer we're traversing */
+typedef struct janus_cbor_cursor {
+	const uint8_t *data;
+	size_t length;
+	size_t offset;
+} janus_cbor_cursor;
+
+static gboolean janus_cbor_decode_head(janus_cbor_cursor *cursor, uint8_t *major, uint64_t *value) {
+	if(cursor->offset >= cursor->length)
+		return FALSE;
+	uint8_t byte = cursor->data[cursor->offset++];
+	*major = byte >> 5;
+	uint8_t info = byte & 0x1F;
+	if(info < 24) {
+		*value = info;
+		return TRUE;
+	}
+	if(info > 27) {
+		/* We don't support indefinite lengths or reserved values */
+		return FALSE;
+	}
+	size_t bytes = (size_t)1 << (info - 24);
+	if(cursor->offset + bytes > cursor->length)
+		return FALSE;
+	uint64_t num = 0;
+	size_t i = 0;
+	for(i=0; i<bytes; i++)
+		num = (num << 8) | cursor->data[cursor->offset++];
+	*value = num;
+	return TRUE;
+}
+
+static json_t *janus_cbor_decode_value(janus_cbor_cursor *cursor, int depth) {
+	if(depth > JANUS_CBOR_MAX_DEPTH)
+		return NULL;
+	uint8_t major = 0;
+	uint64_t value = 0;
+	if(!janus_cbor_decode_head(cursor, &major, &value))
+		return NULL;
+	/* Skip tags (e.g., timestamps added by some encoders), we only care
+	 * about the value they wrap */
+	while(major == JANUS_CBOR_TAG) {
+		if(!janus_cbor_decode_head(cursor, &major, &value))
+			return NULL;
+	}
+	switch(major) {
+		case JANUS_CBOR_UINT: {
+			if(value > (uint64_t)JSON_INTEGER_MAX)
+				return NULL;
+			return json_integer((json_int_t)value);
+		}
+		case JANUS_CBOR_NEGINT: {
+			if(value > (uint64_t)JSON_INTEGER_MAX)
+				return NULL;
+			return json_integer(-1 - (json_int_t)value);
+		}
+		case JANUS_CBOR_TEXT: {
+			if(value > cursor->length - cursor->offset)
+				return NULL;
+			json_t *string = json_stringn((const char *)cursor->data + cursor->offset, (size_t)value);
+			cursor->offset += (size_t)value;
+			return string;
+		}
+		case JANUS_CBOR_ARRAY: {
+			/* Each item takes at least a byte, so we can rule out bogus
+			 * huge counts before allocating anything */
+			if(value > cursor->length - cursor->offset)
+				return NULL;
+			json_t *array = json_array();
+			uint64_t i = 0;
+			for(i=0; i<value; i++) {
+				json_t *item = janus_cbor_decode_value(cursor, depth+1);
+				if(item == NULL) {
+					json_decref(array);
+					return NULL;
+				}
+				json_array_append_new(array, item);
+			}
+			return array;
+		}
+		case JANUS_CBOR_MAP: {
+			if(value > (cursor->length - cursor->offset)/2)
+				return NULL;
+			json_t *object = json_object();
+			uint64_t i = 0;
+			for(i=0; i<value; i++) {
+				/* Keys must be definite length text strings */
+				uint8_t kmajor = 0;
+				uint64_t klen = 0;
+				if(!janus_cbor_decode_head(cursor, &kmajor, &klen) ||
+						kmajor != JANUS_CBOR_TEXT || klen >= cursor->length - cursor->offset) {
+					json_decref(object);
+					return NULL;
+				}
+				char *key = g_strndup((const char *)cursor->data + cursor->offset, (size_t)klen);
+				cursor->offset += (size_t)klen;
+				json_t *item = janus_cbor_decode_value(cursor, depth+1);
+				if(item == NULL) {
+					g_free(key);
+					json_decref(object);
+					return NULL;
+				}
+				json_object_set_new(object, key, item);
+				g_free(key);
+			}
+			return object;
+		}
+		case JANUS_CBOR_SIMPLE: {
+			uint8_t info = cursor->data[cursor->offset-1] & 0x1F;
+			if(info == JANUS_CBOR_FALSE)
+				return json_false();
+			if(info == JANUS_CBOR_TRUE)
+				return json_true();
+			if(info == JANUS_CBOR_NULL)
+				return json_null();
+			if(info == JANUS_CBOR_FLOAT64) {
+				double num = 0;
+				memcpy(&num, &value, sizeof(num));
+				return json_real(num);
+			}
+			if(info == JANUS_CBOR_FLOAT32) {
+				uint32_t bits = (uint32_t)value;
+				float num = 0;
+				memcpy(&num, &bits, sizeof(num));
+				return json_real(num);
+			}
+			if(info == JANUS_CBOR_FLOAT16) {
+				/* Half precision, as per RFC 8949 appendix D */
+				uint16_t half = (uint16_t)value;
+				int exponent = (half >> 10) & 0x1F;
+				int mantissa = half & 0x3FF;
+				double num = 0;
+				if(exponent == 0)
+					num = ldexp(mantissa, -24);
+				else if(exponent != 31)
+					num = ldexp(mantissa + 1024, exponent - 25);
+				else
+					num = mantissa == 0 ? INFINITY : NAN;
+				return json_real(half & 0x8000 ? -num : num);
+			}
+			return NULL;
+		}
+		default:
+			break;
+	}
+	/* Byte strings have no JSON counterpart, so we reject them */
+	return NULL;
+}
+
+json_t *janus_cbor_decode(const char *buf, size_t len) {
+	if(buf == NULL || len == 0)
+		return NULL;
+	janus_cbor_cursor cursor = { .data = (const uint8_t *)buf, .length = len, .offset = 0 };
+	json_t *message = janus_cbor_decode_value(&cursor, 0);
+	if(message != NULL && !json_is_object(message)) {
+		/* API messages are always objects */
+		json_decref(message);
+		return NULL;
+	}
+	return message;
+}
@@ -0,0 +1,58 @@
+/*! \file   janus_cbor.h
+ * \author Lorenzo Miniero <lorenzo@meetecho.com>
+ * \copyright GNU General Public License v3
+ * \brief  CBOR serialization for API messages (headers)
+ * \details  This module implements a small, self contained CBOR codec
+ * (RFC 8949) for the Jansson values the Janus and Admin APIs are made
+ * of, so that transports sitting on message oriented channels (e.g.,
+ * WebSockets, Unix Sockets, Nanomsg) can offer clients a negotiable
+ * binary encoding as an alternative to \c json_dumps / \c json_loads .
+ * Only the subset of CBOR that maps 1:1 to JSON is supported: null,
+ * booleans, integers, doubles, UTF-8 strings, arrays and maps with
+ * string keys, all with definite lengths. Since every Janus API message
+ * is a JSON object, a valid payload always starts with a CBOR map, which
+ * is also what transports use to tell the two encodings apart (JSON
+ * messages always start with ASCII, \c '{' specifically).
+ *
+ * \ingroup transportapi
+ * \ref transportapi
+ */
+
+#ifndef JANUS_CBOR_H
+#define JANUS_CBOR_H
+
+#include <glib.h>
+#include <jansson.h>
+
+/*! \brief Helper to check whether a buffer looks like a CBOR encoded API
+ * message, rather than a JSON one
+ * @param[in] buf The buffer to inspect
+ * @param[in] len Length of the buffer
+ * @returns TRUE if the first byte is a CBOR map header, FALSE otherwise */
+gboolean janus_cbor_is_cbor(const char *buf, size_t len);
+
+/*! \brief Serialize a Jansson value to CBOR, streaming the encoded bytes
+ * to a callback (the CBOR equivalent of \c json_dump_callback ), so that
+ * callers can write directly into their own buffers
+ * @param[in] message The message to serialize (NOT unreferenced here)
+ * @param[in] callback Callback invoked with each chunk of encoded bytes
+ * @param[in] data Opaque pointer passed to the callback
+ * @returns 0 if successful, -1 otherwise */
+int janus_cbor_dump_callback(json_t *message, json_dump_callback_t callback, void *data);
+
+/*! \brief Serialize a Jansson value to CBOR
+ * \note The returned buffer is allocated with \c malloc , just like the
+ * output of \c json_dumps , so that transports can keep using \c free
+ * on outgoing payloads no matter how they were encoded.
+ * @param[in] message The message to serialize (NOT unreferenced here)
+ * @param[out] len Length of the encoded payload
+ * @returns A pointer to the encoded payload if successful, NULL otherwise */
+char *janus_cbor_encode(json_t *message, size_t *len);
+
+/*! \brief Parse a CBOR payload to a Jansson value
+ * @param[in] buf The buffer containing the payload to parse
+ * @param[in] len Length of the buffer
+ * @returns A valid Jansson value if successful, NULL otherwise */
+json_t *janus_cbor_decode(const char *buf, size_t len);
+
+#endif
@@ -13,13 +13,25 @@
  * itself and so on. GET requests instead are used for getting events
  * associated to a Janus session (and as such to all its plugin handles
  * and the events plugins push in the session itself), using a long poll
- * approach. A JavaScript library (janus.js) implements all of this on
- * the client side automatically.
+ * approach. Passing a <code>stream=true</code> query string argument to
+ * the same GET turns the request into a persistent (chunked) event
+ * stream instead: batches of events (still bounded by \c maxev) are
+ * appended to the response as newline-separated JSON as soon as they're
+ * available, which spares integrations that can't use WebSockets the
+ * request churn of one long poll per event batch. Notice that session
+ * keep-alives must still be sent as usual, as the stream itself only
+ * acts as a keep-alive when it's first opened. A JavaScript library
+ * (janus.js) implements all of this on the client side automatically.
  * \note There's a well known bug in libmicrohttpd that may cause it to
  * spike to 100% of the CPU when using HTTPS on some distributions. In
  * case you're interested in HTTPS support, it's better to just rely on
  * HTTP in Janus, and put a frontend like Apache HTTPD or nginx to take
  * care of securing the traffic. More details are available in \ref deploy.
+ * When terminating TLS here anyway, recent libmicrohttpd versions (0.9.75
+ * and later, with GnuTLS negotiating TLS 1.3) take care of session ticket
+ * resumption automatically, so reconnecting clients skip the full
+ * handshake; for HTTP/2 multiplexing a terminating frontend as described
+ * above is currently the only option, as libmicrohttpd doesn't speak it.
  *
  * \ingroup transports
  * \ref transports
@@ -48,6 +60,7 @@ typedef int janus_MHD_Result;
 #include "../config.h"
 #include "../mutex.h"
 #include "../ip-utils.h"
+#include "../metrics.h"
 #include "../utils.h"
 
 
@@ -113,6 +126,14 @@ janus_transport *create(void) {
 /* MHD uses this value as default */
 #define DEFAULT_CONNECTION_LIMIT (FD_SETSIZE-4)
 static unsigned int connection_limit = DEFAULT_CONNECTION_LIMIT;
+/* How many threads MHD should use to serve connections: with the epoll
+ * backend this is a bounded pool of event loops, not one thread per
+ * connection, so a small number goes a long way */
+#define DEFAULT_THREAD_POOL_SIZE 4
+static unsigned int thread_pool_size = DEFAULT_THREAD_POOL_SIZE;
+/* How long idle (keep-alive) connections should be kept around */
+#define DEFAULT_CONNECTION_TIMEOUT 120
+static unsigned int connection_timeout = DEFAULT_CONNECTION_TIMEOUT;
 
 /* Useful stuff */
 static gint initialized = 0, stopping = 0;
@@ -156,6 +177,12 @@ typedef struct janus_http_msg {
 	gint64 session_id;					/* Janus-Client session identifier this message belongs to */
 	char *response;						/* The response from the core as a string */
 	size_t resplen;						/* Length of the response in octets */
+	volatile void *stream_session;		/* Session this connection is a persistent event stream for, if any */
+	volatile gint flushing;				/* Whether a flush of the event stream has been scheduled already */
+	volatile gint stream_ended;			/* Whether the event stream should be closed */
+	char *stream_buf;					/* Pending event stream data we still have to send */
+	size_t stream_len, stream_off;		/* Length of the pending data, and how much we sent already */
+	janus_mutex stream_mutex;			/* Mutex to protect the event stream buffer */
 	GSource *timeout;					/* Timeout monitor, if any */
 	volatile gint timeout_flag;			/* Whether a timeout hasn't fired yet */
 	volatile gint destroyed;			/* Whether this session has been destroyed */
@@ -176,6 +203,8 @@ static void janus_http_msg_free(const janus_refcount *msg_ref) {
 	g_free(request->acrm);
 	g_free(request->xff);
 	g_free(request->response);
+	g_free(request->stream_buf);
+	janus_mutex_destroy(&request->stream_mutex);
 	g_free(request);
 }
 
@@ -191,6 +220,7 @@ typedef struct janus_http_session {
 	guint64 session_id;			/* Core session identifier */
 	GAsyncQueue *events;		/* Events to notify for this session */
 	GList *longpolls;			/* Long poll connection */
+	janus_transport_session *stream;	/* Persistent event stream connection, if any */
 	janus_mutex mutex;			/* Mutex to lock this instance */
 	volatile gint destroyed;	/* Whether this session has been destroyed */
 	janus_refcount ref;			/* Reference counter for this session */
@@ -282,10 +312,50 @@ static void janus_http_request_completed(void *cls, struct MHD_Connection *conne
 	void **con_cls, enum MHD_RequestTerminationCode toe);
 /* Callback to send data back after resuming a connection */
 static ssize_t janus_http_response_callback(void *cls, uint64_t pos, char *buf, size_t max);
+/* Callback to send data on a persistent event stream */
+static ssize_t janus_http_stream_callback(void *cls, uint64_t pos, char *buf, size_t max);
 /* Worker to handle requests that are actually long polls */
 static int janus_http_notifier(janus_http_msg *msg);
+/* Worker to flush pending events on a persistent event stream */
+static int janus_http_stream_flush(janus_http_msg *msg);
+
+/* Custom GSource for completing long polls: rather than resuming suspended
+ * connections inline, one by one, as soon as an event for their session shows
+ * up, we schedule the resume a few hundred microseconds in the future on the
+ * transport loop, so that events pushed back-to-back (as plugins often do)
+ * are coalesced in a single response (when maxev allows it) and in a single
+ * wakeup of the webserver threads, rather than one per event; the same
+ * source (and window) is used to schedule flushes of persistent event streams */
+#define JANUS_HTTP_RESUME_WINDOW	500		/* Microseconds */
+typedef struct janus_http_longpoll_resume {
+	GSource parent;
+	janus_http_msg *msg;
+} janus_http_longpoll_resume;
+static gboolean janus_http_longpoll_resume_dispatch(GSource *source, GSourceFunc callback, gpointer user_data) {
+	JANUS_LOG(LOG_DBG, "[%p] longpoll resume\n", source);
+	janus_http_longpoll_resume *r = (janus_http_longpoll_resume *)source;
+	if(g_atomic_pointer_get(&r->msg->stream_session) != NULL)
+		janus_http_stream_flush(r->msg);
+	else
+		janus_http_notifier(r->msg);
+	g_source_destroy(source);
+	g_source_unref(source);
+	return G_SOURCE_REMOVE;
+}
+static void janus_http_longpoll_resume_finalize(GSource *source) {
+	JANUS_LOG(LOG_DBG, "[%p] longpoll resume finalize\n", source);
+	janus_http_longpoll_resume *r = (janus_http_longpoll_resume *)source;
+	if(r && r->msg)
+		janus_refcount_decrease(&r->msg->ref);
+}
+static GSourceFuncs janus_http_longpoll_resume_funcs = {
+	NULL, NULL,
+	janus_http_longpoll_resume_dispatch,
+	janus_http_longpoll_resume_finalize,
+	NULL, NULL
+};
 /* Helper to quickly send a success response */
-static janus_MHD_Result janus_http_return_success(janus_transport_session *ts, char *payload);
+static janus_MHD_Result janus_http_return_success(janus_transport_session *ts, char *payload, size_t len);
 /* Helper to quickly send an error response */
 static janus_MHD_Result janus_http_return_error(janus_transport_session *ts, uint64_t session_id,
 	const char *transaction, gint error, const char *format, ...) G_GNUC_PRINTF(5, 6);
@@ -295,6 +365,8 @@ static janus_MHD_Result janus_http_return_error(janus_transport_session *ts, uin
 static struct MHD_Daemon *ws = NULL, *sws = NULL;
 static char *ws_path = NULL;
 static char *cert_pem_bytes = NULL, *cert_key_bytes = NULL;
+/* Optional path we serve the core metrics on, disabled by default */
+static char *metrics_path = NULL;
 
 /* Admin/Monitor MHD Web Server */
 static struct MHD_Daemon *admin_ws = NULL, *admin_sws = NULL;
@@ -396,6 +468,18 @@ static struct MHD_Daemon *janus_http_create_daemon(gboolean admin, char *path,
 		const char *server_pem, const char *server_key, const char *password, const char *ciphers) {
 	struct MHD_Daemon *daemon = NULL;
 	gboolean secure = server_pem && server_key;
+	/* Prefer the epoll backend, where available (Linux), with a bounded pool
+	 * of worker threads sharing the listener: thousands of long polls then
+	 * don't translate to thousands of threads, and wakeups stay cheap; on
+	 * other platforms we let MHD pick the best backend it has */
+	unsigned int flags = MHD_USE_AUTO_INTERNAL_THREAD | MHD_USE_AUTO | MHD_USE_SUSPEND_RESUME | mhd_debug_flag;
+	if(MHD_is_feature_supported(MHD_FEATURE_EPOLL))
+		flags = MHD_USE_EPOLL_INTERNAL_THREAD | MHD_USE_SUSPEND_RESUME | mhd_debug_flag;
+#if defined(MHD_VERSION) && MHD_VERSION >= 0x00095300
+	/* Tell MHD to favour speed over some optional safety syscalls (TURBO):
+	 * with connection-churning API clients that's measurable per-request CPU */
+	flags |= MHD_USE_TURBO;
+#endif
 	/* Any interface or IP address we need to limit ourselves to?
 	 * NOTE WELL: specifying an interface does NOT bind to all IPs associated
 	 * with that interface, but only to the first one that's detected */
@@ -507,15 +591,16 @@ static struct MHD_Daemon *janus_http_create_daemon(gboolean admin, char *path,
 			JANUS_LOG(LOG_VERB, "Binding to all interfaces for the %s API %s webserver\n",
 				admin ? "Admin" : "Janus", secure ? "HTTPS" : "HTTP");
 			daemon = MHD_start_daemon(
-				MHD_USE_AUTO_INTERNAL_THREAD | MHD_USE_AUTO | MHD_USE_SUSPEND_RESUME | MHD_USE_DUAL_STACK | mhd_debug_flag,
+				flags | MHD_USE_DUAL_STACK,
 				port,
 				admin ? &janus_http_admin_client_connect : &janus_http_client_connect,
 				NULL,
 				admin ? &janus_http_admin_handler : &janus_http_handler,
 				path,
 				MHD_OPTION_NOTIFY_COMPLETED, &janus_http_request_completed, NULL,
-				MHD_OPTION_CONNECTION_TIMEOUT, 120,
+				MHD_OPTION_CONNECTION_TIMEOUT, connection_timeout,
 				MHD_OPTION_CONNECTION_LIMIT, connection_limit,
+				MHD_OPTION_THREAD_POOL_SIZE, thread_pool_size,
 				MHD_OPTION_END);
 		} else {
 			/* Bind to the interface that was specified */
@@ -523,7 +608,7 @@ static struct MHD_Daemon *janus_http_create_daemon(gboolean admin, char *path,
 				ip ? "IP" : "interface", ip ? ip : interface,
 				admin ? "Admin" : "Janus", secure ? "HTTPS" : "HTTP");
 			daemon = MHD_start_daemon(
-				MHD_USE_AUTO_INTERNAL_THREAD | MHD_USE_AUTO | MHD_USE_SUSPEND_RESUME | (ipv6 ? MHD_USE_IPv6 : 0) | mhd_debug_flag,
+				flags | (ipv6 ? MHD_USE_IPv6 : 0),
 				port,
 				admin ? &janus_http_admin_client_connect : &janus_http_client_connect,
 				NULL,
@@ -531,8 +616,9 @@ static struct MHD_Daemon *janus_http_create_daemon(gboolean admin, char *path,
 				path,
 				MHD_OPTION_NOTIFY_COMPLETED, &janus_http_request_completed, NULL,
 				MHD_OPTION_SOCK_ADDR, ipv6 ? (struct sockaddr *)&addr6 : (struct sockaddr *)&addr,
-				MHD_OPTION_CONNECTION_TIMEOUT, 120,
+				MHD_OPTION_CONNECTION_TIMEOUT, connection_timeout,
 				MHD_OPTION_CONNECTION_LIMIT, connection_limit,
+				MHD_OPTION_THREAD_POOL_SIZE, thread_pool_size,
 				MHD_OPTION_END);
 		}
 	} else {
@@ -546,7 +632,7 @@ static struct MHD_Daemon *janus_http_create_daemon(gboolean admin, char *path,
 			JANUS_LOG(LOG_VERB, "Binding to all interfaces for the %s API %s webserver\n",
 				admin ? "Admin" : "Janus", secure ? "HTTPS" : "HTTP");
 			daemon = MHD_start_daemon(
-				MHD_USE_SSL | MHD_USE_AUTO_INTERNAL_THREAD | MHD_USE_AUTO | MHD_USE_SUSPEND_RESUME | MHD_USE_DUAL_STACK | mhd_debug_flag,
+				MHD_USE_SSL | flags | MHD_USE_DUAL_STACK,
 				port,
 				admin ? &janus_http_admin_client_connect : &janus_http_client_connect,
 				NULL,
@@ -557,8 +643,9 @@ static struct MHD_Daemon *janus_http_create_daemon(gboolean admin, char *path,
 				MHD_OPTION_HTTPS_MEM_CERT, cert_pem_bytes,
 				MHD_OPTION_HTTPS_MEM_KEY, cert_key_bytes,
 				MHD_OPTION_HTTPS_KEY_PASSWORD, password,
-				MHD_OPTION_CONNECTION_TIMEOUT, 120,
+				MHD_OPTION_CONNECTION_TIMEOUT, connection_timeout,
 				MHD_OPTION_CONNECTION_LIMIT, connection_limit,
+				MHD_OPTION_THREAD_POOL_SIZE, thread_pool_size,
 				MHD_OPTION_END);
 		} else {
 			/* Bind to the interface that was specified */
@@ -566,7 +653,7 @@ static struct MHD_Daemon *janus_http_create_daemon(gboolean admin, char *path,
 				ip ? "IP" : "interface", ip ? ip : interface,
 				admin ? "Admin" : "Janus", secure ? "HTTPS" : "HTTP");
 			daemon = MHD_start_daemon(
-				MHD_USE_SSL | MHD_USE_AUTO_INTERNAL_THREAD | MHD_USE_AUTO | MHD_USE_SUSPEND_RESUME | (ipv6 ? MHD_USE_IPv6 : 0) | mhd_debug_flag,
+				MHD_USE_SSL | flags | (ipv6 ? MHD_USE_IPv6 : 0),
 				port,
 				admin ? &janus_http_admin_client_connect : &janus_http_client_connect,
 				NULL,
@@ -578,8 +665,9 @@ static struct MHD_Daemon *janus_http_create_daemon(gboolean admin, char *path,
 				MHD_OPTION_HTTPS_MEM_KEY, cert_key_bytes,
 				MHD_OPTION_HTTPS_KEY_PASSWORD, password,
 				MHD_OPTION_SOCK_ADDR, ipv6 ? (struct sockaddr *)&addr6 : (struct sockaddr *)&addr,
-				MHD_OPTION_CONNECTION_TIMEOUT, 120,
+				MHD_OPTION_CONNECTION_TIMEOUT, connection_timeout,
 				MHD_OPTION_CONNECTION_LIMIT, connection_limit,
+				MHD_OPTION_THREAD_POOL_SIZE, thread_pool_size,
 				MHD_OPTION_END);
 		}
 	}
@@ -700,6 +788,19 @@ int janus_http_init(janus_transport_callbacks *callback, const char *config_path
 		} else {
 			ws_path = g_strdup("/janus");
 		}
+		/* Check if we should expose the core metrics somewhere too */
+		item = janus_config_get(config, config_general, janus_config_type_item, "metrics_path");
+		if(item && item->value) {
+			if(item->value[0] != '/') {
+				JANUS_LOG(LOG_FATAL, "Invalid metrics path %s (it should start with a /, e.g., /metrics\n", item->value);
+				return -1;
+			}
+			metrics_path = g_strdup(item->value);
+			if(strnlen(metrics_path, 1 + 1) > 1 && metrics_path[strlen(metrics_path)-1] == '/') {
+				/* Remove the trailing slash, it makes things harder when we parse requests later */
+				metrics_path[strlen(metrics_path)-1] = '\0';
+			}
+		}
 		/* Do the same for the admin/monitor interface */
 		item = janus_config_get(config, config_admin, janus_config_type_item, "admin_base_path");
 		if(item && item->value) {
@@ -721,6 +822,18 @@ int janus_http_init(janus_transport_callbacks *callback, const char *config_path
 			JANUS_LOG(LOG_ERR, "Invalid mhd_connection_limit (%s), falling back to default\n", item->value);
 			connection_limit = DEFAULT_CONNECTION_LIMIT;
 		}
+		/* How many threads should MHD use to serve connections? */
+		item = janus_config_get(config, config_general, janus_config_type_item, "mhd_threads");
+		if(item && item->value && (janus_string_to_uint32(item->value, &thread_pool_size) < 0 || thread_pool_size == 0)) {
+			JANUS_LOG(LOG_ERR, "Invalid mhd_threads (%s), falling back to default\n", item->value);
+			thread_pool_size = DEFAULT_THREAD_POOL_SIZE;
+		}
+		/* How long should idle (keep-alive) connections be kept around? */
+		item = janus_config_get(config, config_general, janus_config_type_item, "mhd_connection_timeout");
+		if(item && item->value && janus_string_to_uint32(item->value, &connection_timeout) < 0) {
+			JANUS_LOG(LOG_ERR, "Invalid mhd_connection_timeout (%s), falling back to default\n", item->value);
+			connection_timeout = DEFAULT_CONNECTION_TIMEOUT;
+		}
 		/* Should we set the debug flag in libmicrohttpd? */
 		item = janus_config_get(config, config_general, janus_config_type_item, "mhd_debug");
 		if(item && item->value && janus_is_true(item->value))
@@ -1075,11 +1188,31 @@ int janus_http_send_message(janus_transport_session *transport, void *request_id
 					g_source_unref(msg->timeout);
 				}
 				msg->timeout = NULL;
-				janus_http_notifier(msg);
-				janus_refcount_decrease(&msg->ref);
+				/* Complete the long poll on the transport loop, in a few hundred
+				 * microseconds, rather than inline: any other event pushed in the
+				 * meanwhile will be delivered in the same response (our reference
+				 * to the message is stolen by the source, and released there) */
+				GSource *resume = g_source_new(&janus_http_longpoll_resume_funcs, sizeof(janus_http_longpoll_resume));
+				((janus_http_longpoll_resume *)resume)->msg = msg;
+				g_source_set_ready_time(resume, janus_get_monotonic_time_internal() + JANUS_HTTP_RESUME_WINDOW);
+				g_source_attach(resume, httpctx);
 			}
 			session->longpolls = g_list_remove(session->longpolls, transport);
 		}
+		/* Is there a persistent event stream to feed too? */
+		if(session->stream != NULL) {
+			transport = (janus_transport_session *)session->stream;
+			msg = (janus_http_msg *)(transport ? transport->transport_p : NULL);
+			if(msg && g_atomic_int_compare_and_exchange(&msg->flushing, 0, 1)) {
+				/* Schedule a flush on the transport loop, with the same
+				 * coalescing window we use for completing long polls */
+				janus_refcount_increase(&msg->ref);
+				GSource *resume = g_source_new(&janus_http_longpoll_resume_funcs, sizeof(janus_http_longpoll_resume));
+				((janus_http_longpoll_resume *)resume)->msg = msg;
+				g_source_set_ready_time(resume, janus_get_monotonic_time_internal() + JANUS_HTTP_RESUME_WINDOW);
+				g_source_attach(resume, httpctx);
+			}
+		}
 		janus_mutex_unlock(&session->mutex);
 		janus_refcount_decrease(&session->ref);
 	} else {
@@ -1117,7 +1250,8 @@ int janus_http_send_message(janus_transport_session *transport, void *request_id
 			g_source_unref(msg->timeout);
 		}
 		msg->timeout = NULL;
-		char *response_text = json_dumps(message, json_format);
+		size_t resplen = 0;
+		char *response_text = janus_json_dump(message, json_format, &resplen);
 		json_decref(message);
 		if(response_text == NULL) {
 			JANUS_LOG(LOG_ERR, "Failed to stringify message...\n");
@@ -1125,7 +1259,7 @@ int janus_http_send_message(janus_transport_session *transport, void *request_id
 			return -1;
 		}
 		msg->response = response_text;
-		msg->resplen = strlen(response_text);
+		msg->resplen = resplen;
 		MHD_resume_connection(msg->connection);
 		janus_refcount_decrease(&msg->ref);
 	}
@@ -1147,6 +1281,7 @@ void janus_http_session_created(janus_transport_session *transport, guint64 sess
 	session->session_id = session_id;
 	session->events = g_async_queue_new();
 	session->longpolls = NULL;
+	session->stream = NULL;
 	janus_mutex_init(&session->mutex);
 	g_atomic_int_set(&session->destroyed, 0);
 	janus_refcount_init(&session->ref, janus_http_session_free);
@@ -1160,6 +1295,24 @@ void janus_http_session_over(janus_transport_session *transport, guint64 session
 		claimed ? "but has been claimed" : "and has not been claimed", session_id);
 	/* Get rid of the session's queue of events */
 	janus_mutex_lock(&sessions_mutex);
+	janus_http_session *session = g_hash_table_lookup(sessions, &session_id);
+	if(session != NULL) {
+		/* If there's a persistent event stream on this session, close it */
+		janus_mutex_lock(&session->mutex);
+		if(session->stream != NULL) {
+			janus_transport_session *transport = (janus_transport_session *)session->stream;
+			janus_http_msg *msg = (janus_http_msg *)(transport ? transport->transport_p : NULL);
+			if(msg != NULL) {
+				g_atomic_int_set(&msg->stream_ended, 1);
+				janus_mutex_lock(&msg->stream_mutex);
+				if(g_atomic_int_compare_and_exchange(&msg->suspended, 1, 0))
+					MHD_resume_connection(msg->connection);
+				janus_mutex_unlock(&msg->stream_mutex);
+			}
+			session->stream = NULL;
+		}
+		janus_mutex_unlock(&session->mutex);
+	}
 	g_hash_table_remove(sessions, &session_id);
 	janus_mutex_unlock(&sessions_mutex);
 }
@@ -1176,6 +1329,7 @@ void janus_http_session_claimed(janus_transport_session *transport, guint64 sess
 	session->session_id = session_id;
 	session->events = g_async_queue_new();
 	session->longpolls = NULL;
+	session->stream = NULL;
 	janus_mutex_init(&session->mutex);
 	g_atomic_int_set(&session->destroyed, 0);
 	janus_refcount_init(&session->ref, janus_http_session_free);
@@ -1205,6 +1359,19 @@ void janus_http_session_claimed(janus_transport_session *transport, guint64 sess
 		}
 		session->longpolls = g_list_remove(old_session->longpolls, transport);
 	}
+	if(old_session->stream != NULL) {
+		/* Close the persistent event stream on the old session too */
+		transport = (janus_transport_session *)old_session->stream;
+		msg = (janus_http_msg *)(transport ? transport->transport_p : NULL);
+		if(msg != NULL) {
+			g_atomic_int_set(&msg->stream_ended, 1);
+			janus_mutex_lock(&msg->stream_mutex);
+			if(g_atomic_int_compare_and_exchange(&msg->suspended, 1, 0))
+				MHD_resume_connection(msg->connection);
+			janus_mutex_unlock(&msg->stream_mutex);
+		}
+		old_session->stream = NULL;
+	}
 	janus_mutex_unlock(&old_session->mutex);
 	janus_refcount_decrease(&old_session->ref);
 }
@@ -1384,6 +1551,7 @@ static janus_MHD_Result janus_http_handler(void *cls, struct MHD_Connection *con
 		JANUS_LOG(LOG_DBG, " ... Just parsing headers for now...\n");
 		msg = g_malloc0(sizeof(janus_http_msg));
 		msg->connection = connection;
+		janus_mutex_init(&msg->stream_mutex);
 		janus_refcount_init(&msg->ref, janus_http_msg_free);
 		ts = janus_transport_session_create(msg, janus_http_msg_destroy);
 		janus_mutex_lock(&messages_mutex);
@@ -1444,6 +1612,20 @@ static janus_MHD_Result janus_http_handler(void *cls, struct MHD_Connection *con
 		ret = MHD_queue_response(connection, MHD_HTTP_OK, response);
 		MHD_destroy_response(response);
 	}
+	/* Is this a scrape of the metrics endpoint? If so, we serve it right
+	 * away: no JSON and no session state involved, just the counters */
+	if(metrics_path != NULL && !strcasecmp(url, metrics_path) && !strcasecmp(method, "GET")) {
+		if(firstround)
+			return ret;
+		char *metrics = janus_metrics_render();
+		response = MHD_create_response_from_buffer(strlen(metrics), (void *)metrics, MHD_RESPMEM_MUST_COPY);
+		g_free(metrics);
+		MHD_add_response_header(response, "Content-Type", "text/plain; version=0.0.4");
+		janus_http_add_cors_headers(msg, response);
+		ret = MHD_queue_response(connection, MHD_HTTP_OK, response);
+		MHD_destroy_response(response);
+		goto done;
+	}
 	/* Get path components */
 	if(strcasecmp(url, ws_path)) {
 		if(strnlen(ws_path, 1 + 1) > 1) {
@@ -1655,6 +1837,52 @@ static janus_MHD_Result janus_http_handler(void *cls, struct MHD_Connection *con
 				max_events = 1;
 			}
 		}
+		/* Is this a request for a persistent event stream, rather than a long poll? */
+		const char *stream = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "stream");
+		if(stream && janus_is_true(stream)) {
+			JANUS_LOG(LOG_VERB, "Session %"SCNu64" found... serving events on a persistent stream\n", session_id);
+			response = MHD_create_response_from_callback(MHD_SIZE_UNKNOWN,
+				4096, &janus_http_stream_callback, msg, NULL);
+			if(response == NULL) {
+				ret = MHD_NO;
+			} else {
+				janus_mutex_lock(&session->mutex);
+				if(session->stream != NULL) {
+					/* There's a stream serving this session already: close
+					 * it, as this new connection is going to replace it */
+					janus_transport_session *old_ts = (janus_transport_session *)session->stream;
+					janus_http_msg *old = (janus_http_msg *)(old_ts ? old_ts->transport_p : NULL);
+					if(old != NULL) {
+						g_atomic_int_set(&old->stream_ended, 1);
+						janus_mutex_lock(&old->stream_mutex);
+						if(g_atomic_int_compare_and_exchange(&old->suspended, 1, 0))
+							MHD_resume_connection(old->connection);
+						janus_mutex_unlock(&old->stream_mutex);
+					}
+					session->stream = NULL;
+				}
+				msg->max_events = max_events;
+				janus_refcount_increase(&session->ref);
+				g_atomic_pointer_set(&msg->stream_session, session);
+				session->stream = ts;
+				MHD_add_response_header(response, "Content-Type", "application/json");
+				janus_http_add_cors_headers(msg, response);
+				ret = MHD_queue_response(msg->connection, MHD_HTTP_OK, response);
+				MHD_destroy_response(response);
+				/* If there are events waiting already, schedule a flush right away */
+				if(g_async_queue_length(session->events) > 0 &&
+						g_atomic_int_compare_and_exchange(&msg->flushing, 0, 1)) {
+					janus_refcount_increase(&msg->ref);
+					GSource *resume = g_source_new(&janus_http_longpoll_resume_funcs, sizeof(janus_http_longpoll_resume));
+					((janus_http_longpoll_resume *)resume)->msg = msg;
+					g_source_set_ready_time(resume, janus_get_monotonic_time_internal() + JANUS_HTTP_RESUME_WINDOW);
+					g_source_attach(resume, httpctx);
+				}
+				janus_mutex_unlock(&session->mutex);
+			}
+			janus_refcount_decrease(&session->ref);
+			goto done;
+		}
 		JANUS_LOG(LOG_VERB, "Session %"SCNu64" found... returning up to %d messages\n", session_id, max_events);
 		/* Handle GET, taking the first message from the list */
 		janus_mutex_lock(&session->mutex);
@@ -1662,9 +1890,10 @@ static janus_MHD_Result janus_http_handler(void *cls, struct MHD_Connection *con
 		if(event != NULL) {
 			if(max_events == 1) {
 				/* Return just this message and leave */
-				char *event_text = json_dumps(event, json_format);
+				size_t event_len = 0;
+				char *event_text = janus_json_dump(event, json_format, &event_len);
 				json_decref(event);
-				ret = janus_http_return_success(ts, event_text);
+				ret = janus_http_return_success(ts, event_text, event_len);
 			} else {
 				/* The application is willing to receive more events at the same time, anything to report? */
 				json_t *list = json_array();
@@ -1678,9 +1907,10 @@ static janus_MHD_Result janus_http_handler(void *cls, struct MHD_Connection *con
 					events++;
 				}
 				/* Return the array of messages and leave */
-				char *list_text = json_dumps(list, json_format);
+				size_t list_len = 0;
+				char *list_text = janus_json_dump(list, json_format, &list_len);
 				json_decref(list);
-				ret = janus_http_return_success(ts, list_text);
+				ret = janus_http_return_success(ts, list_text, list_len);
 			}
 		} else {
 			/* Still no message, wait */
@@ -1808,6 +2038,7 @@ static janus_MHD_Result janus_http_admin_handler(void *cls, struct MHD_Connectio
 		JANUS_LOG(LOG_DBG, " ... Just parsing headers for now...\n");
 		msg = g_malloc0(sizeof(janus_http_msg));
 		msg->connection = connection;
+		janus_mutex_init(&msg->stream_mutex);
 		janus_refcount_init(&msg->ref, janus_http_msg_free);
 		ts = janus_transport_session_create(msg, janus_http_msg_destroy);
 		janus_mutex_lock(&messages_mutex);
@@ -2109,6 +2340,17 @@ static void janus_http_request_completed(void *cls, struct MHD_Connection *conne
 			janus_mutex_unlock(&session->mutex);
 			janus_refcount_decrease(&session->ref);
 		}
+		session = (janus_http_session *)g_atomic_pointer_get(&request->stream_session);
+		if(session != NULL) {
+			/* This connection was serving a persistent event stream */
+			g_atomic_pointer_set(&request->stream_session, NULL);
+			janus_mutex_lock(&session->mutex);
+			if(session->stream == ts)
+				session->stream = NULL;
+			janus_mutex_unlock(&session->mutex);
+			/* This was the reference the stream had on the session */
+			janus_refcount_decrease(&session->ref);
+		}
 		janus_refcount_decrease(&request->ref);
 	}
 	janus_mutex_lock(&messages_mutex);
@@ -2132,6 +2374,38 @@ static ssize_t janus_http_response_callback(void *cls, uint64_t pos, char *buf,
 	return bytes;
 }
 
+static ssize_t janus_http_stream_callback(void *cls, uint64_t pos, char *buf, size_t max) {
+	janus_http_msg *request = (janus_http_msg *)cls;
+	if(request == NULL)
+		return MHD_CONTENT_READER_END_WITH_ERROR;
+	if(g_atomic_int_get(&stopping) || g_atomic_int_get(&request->destroyed) ||
+			g_atomic_int_get(&request->stream_ended))
+		return MHD_CONTENT_READER_END_OF_STREAM;
+	janus_mutex_lock(&request->stream_mutex);
+	if(request->stream_buf == NULL || request->stream_off >= request->stream_len) {
+		/* Nothing to send right now: suspend the connection, the next flush
+		 * of events will resume it (checking and suspending under the lock
+		 * makes sure a flush can't sneak in between the two and be missed) */
+		g_atomic_int_set(&request->suspended, 1);
+		MHD_suspend_connection(request->connection);
+		janus_mutex_unlock(&request->stream_mutex);
+		return 0;
+	}
+	size_t bytes = request->stream_len - request->stream_off;
+	if(bytes > max)
+		bytes = max;
+	memcpy(buf, request->stream_buf + request->stream_off, bytes);
+	request->stream_off += bytes;
+	if(request->stream_off >= request->stream_len) {
+		g_free(request->stream_buf);
+		request->stream_buf = NULL;
+		request->stream_len = 0;
+		request->stream_off = 0;
+	}
+	janus_mutex_unlock(&request->stream_mutex);
+	return bytes;
+}
+
 /* Worker to handle notifications */
 static int janus_http_notifier(janus_http_msg *msg) {
 	if(!msg || !msg->connection)
@@ -2190,7 +2464,8 @@ static int janus_http_notifier(janus_http_msg *msg) {
 		}
 		/* FIXME Improve the Janus protocol keep-alive mechanism in JavaScript */
 	}
-	char *payload_text = json_dumps(max_events == 1 ? event : list, json_format);
+	size_t payload_len = 0;
+	char *payload_text = janus_json_dump(max_events == 1 ? event : list, json_format, &payload_len);
 	json_decref(max_events == 1 ? event : list);
 	if(payload_text == NULL) {
 		JANUS_LOG(LOG_ERR, "Failed to stringify message...\n");
@@ -2202,14 +2477,87 @@ static int janus_http_notifier(janus_http_msg *msg) {
 	JANUS_LOG(LOG_HUGE, "We have a message to serve...\n\t%s\n", payload_text);
 	/* Send event back */
 	msg->response = payload_text;
-	msg->resplen = strlen(payload_text);
+	msg->resplen = payload_len;
 	MHD_resume_connection(msg->connection);
 	janus_refcount_decrease(&session->ref);
 	return 0;
 }
 
+/* Worker to flush pending events on a persistent event stream */
+static int janus_http_stream_flush(janus_http_msg *msg) {
+	if(!msg || !msg->connection)
+		return -1;
+	g_atomic_int_set(&msg->flushing, 0);
+	if(g_atomic_int_get(&msg->stream_ended))
+		return 0;
+	janus_http_session *session = (janus_http_session *)g_atomic_pointer_get(&msg->stream_session);
+	if(session == NULL || g_atomic_int_get(&session->destroyed))
+		return -1;
+	janus_refcount_increase(&session->ref);
+	int max_events = msg->max_events;
+	if(max_events < 1)
+		max_events = 1;
+	JANUS_LOG(LOG_DBG, "... flushing event stream...\n");
+	/* Drain the queue of events, batching them as maxev allows */
+	GString *outgoing = NULL;
+	json_t *event = NULL, *list = NULL;
+	int events = 0;
+	while((event = g_async_queue_try_pop(session->events)) != NULL) {
+		json_t *batch = event;
+		if(max_events > 1) {
+			/* The application is willing to receive more events at the same time */
+			list = json_array();
+			json_array_append_new(list, event);
+			events = 1;
+			while(events < max_events) {
+				event = g_async_queue_try_pop(session->events);
+				if(event == NULL)
+					break;
+				json_array_append_new(list, event);
+				events++;
+			}
+			batch = list;
+		}
+		size_t payload_len = 0;
+		char *payload_text = janus_json_dump(batch, json_format, &payload_len);
+		json_decref(batch);
+		if(payload_text == NULL) {
+			JANUS_LOG(LOG_ERR, "Failed to stringify message...\n");
+			continue;
+		}
+		if(outgoing == NULL)
+			outgoing = g_string_new(NULL);
+		g_string_append_len(outgoing, payload_text, payload_len);
+		g_string_append_c(outgoing, '\n');
+		free(payload_text);
+	}
+	if(outgoing == NULL) {
+		/* Nothing to flush after all */
+		janus_refcount_decrease(&session->ref);
+		return 0;
+	}
+	JANUS_LOG(LOG_HUGE, "We have data to stream...\n\t%s\n", outgoing->str);
+	/* Append to the pending buffer, and resume the connection if it's suspended */
+	janus_mutex_lock(&msg->stream_mutex);
+	if(msg->stream_buf == NULL) {
+		msg->stream_len = outgoing->len;
+		msg->stream_off = 0;
+		msg->stream_buf = g_string_free(outgoing, FALSE);
+	} else {
+		msg->stream_buf = g_realloc(msg->stream_buf, msg->stream_len + outgoing->len);
+		memcpy(msg->stream_buf + msg->stream_len, outgoing->str, outgoing->len);
+		msg->stream_len += outgoing->len;
+		g_string_free(outgoing, TRUE);
+	}
+	if(g_atomic_int_compare_and_exchange(&msg->suspended, 1, 0))
+		MHD_resume_connection(msg->connection);
+	janus_mutex_unlock(&msg->stream_mutex);
+	janus_refcount_decrease(&session->ref);
+	return 0;
+}
+
 /* Helper to quickly send a success response */
-static janus_MHD_Result janus_http_return_success(janus_transport_session *ts, char *payload) {
+static janus_MHD_Result janus_http_return_success(janus_transport_session *ts, char *payload, size_t len) {
 	if(!payload) {
 		JANUS_LOG(LOG_ERR, "Invalid payload...\n");
 		return MHD_NO;
@@ -2225,7 +2573,7 @@ static janus_MHD_Result janus_http_return_success(janus_transport_session *ts, c
 	}
 	janus_refcount_increase(&msg->ref);
 	struct MHD_Response *response = MHD_create_response_from_buffer(
-		strlen(payload),
+		len,
 		(void*)payload,
 		MHD_RESPMEM_MUST_FREE);
 	MHD_add_response_header(response, "Content-Type", "application/json");
@@ -2265,10 +2613,11 @@ static janus_MHD_Result janus_http_return_error(janus_transport_session *ts, uin
 	json_object_set_new(error_data, "code", json_integer(error));
 	json_object_set_new(error_data, "reason", json_string(error_string));
 	json_object_set_new(reply, "error", error_data);
-	char *reply_text = json_dumps(reply, json_format);
+	size_t reply_len = 0;
+	char *reply_text = janus_json_dump(reply, json_format, &reply_len);
 	json_decref(reply);
 	/* Use janus_http_return_error to send the error response */
-	return janus_http_return_success(ts, reply_text);
+	return janus_http_return_success(ts, reply_text, reply_len);
 }
 
 /* Helper to handle timeouts */
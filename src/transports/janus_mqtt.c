@@ -174,6 +174,14 @@ typedef struct janus_mqtt_context {
 			int qos;
 		} publish;
 	} admin;
+	/* Pipelined publishing: in-flight window and pending queue */
+	struct {
+		janus_mutex mutex;
+		GQueue *pending;	/* Publishes waiting for a free slot in the window */
+		int inflight;		/* Publishes whose token hasn't completed yet */
+		int max_pending;
+		guint64 dropped;	/* Events dropped because the pending queue was full */
+	} pipeline;
 	/* SSL config, if needed */
 	gboolean ssl_enabled;
 	char *cacert_file;
@@ -198,6 +206,17 @@ typedef struct janus_mqtt_set_add_transaction_user_property_user_data {
 } janus_mqtt_set_add_transaction_user_property_user_data;
 #endif
 
+/* Outgoing publish, as queued when the in-flight window is full */
+typedef struct janus_mqtt_outgoing_message {
+	char *payload;
+	gboolean admin;
+	gboolean droppable;	/* Events may be dropped on overflow, API replies never are */
+#ifdef MQTTVERSION_5
+	MQTTProperties properties;
+	char *custom_topic;
+#endif
+} janus_mqtt_outgoing_message;
+
 /* Transport client methods */
 void janus_mqtt_client_connected(void *context, char *cause);
 void janus_mqtt_client_connection_lost(void *context, char *cause);
@@ -462,6 +481,16 @@ int janus_mqtt_init(janus_transport_callbacks *callback, const char *config_path
 		ctx->connect.max_buffered = 100;
 	}
 
+	janus_config_item *max_pending_item = janus_config_get(config, config_general, janus_config_type_item, "max_pending");
+	ctx->pipeline.max_pending = (max_pending_item && max_pending_item->value) ?
+		atoi(max_pending_item->value) : 256;
+	if(ctx->pipeline.max_pending < 1) {
+		JANUS_LOG(LOG_ERR, "Invalid max-pending value: %s (falling back to default)\n", max_pending_item->value);
+		ctx->pipeline.max_pending = 256;
+	}
+	janus_mutex_init(&ctx->pipeline.mutex);
+	ctx->pipeline.pending = g_queue_new();
+
 	janus_config_item *enabled_item = janus_config_get(config, config_general, janus_config_type_item, "enabled");
 	if(enabled_item == NULL) {
 		/* Try legacy property */
@@ -848,6 +877,99 @@ gboolean janus_mqtt_is_admin_api_enabled(void) {
 	return janus_mqtt_admin_api_enabled_;
 }
 
+static void janus_mqtt_outgoing_message_free(janus_mqtt_outgoing_message *message) {
+	if(message == NULL)
+		return;
+	free(message->payload);
+#ifdef MQTTVERSION_5
+	MQTTProperties_free(&message->properties);
+	g_free(message->custom_topic);
+#endif
+	g_free(message);
+}
+
+/* Hand an outgoing message to the Paho client and dispose of it: the
+ * library copies the payload, so nothing we own needs to outlive this */
+static int janus_mqtt_client_send_outgoing(janus_mqtt_context *ctx, janus_mqtt_outgoing_message *message) {
+	int rc;
+#ifdef MQTTVERSION_5
+	if(ctx->connect.mqtt_version == MQTTVERSION_5) {
+		rc = janus_mqtt_client_publish_message5(ctx, message->payload, message->admin, &message->properties, message->custom_topic);
+	} else {
+		rc = janus_mqtt_client_publish_message(ctx, message->payload, message->admin);
+	}
+#else
+	rc = janus_mqtt_client_publish_message(ctx, message->payload, message->admin);
+#endif
+	if(rc != MQTTASYNC_SUCCESS) {
+		JANUS_LOG(LOG_ERR, "Can't publish to MQTT topic: %s, return code: %d\n",
+			message->admin ? ctx->admin.publish.topic : ctx->publish.topic, rc);
+	}
+	janus_mqtt_outgoing_message_free(message);
+	return rc;
+}
+
+/* Publish a message right away if the in-flight window has room, or queue
+ * it otherwise; on overflow the oldest queued event is dropped to make
+ * room, while API replies are never dropped */
+static void janus_mqtt_client_publish_pipelined(janus_mqtt_context *ctx, janus_mqtt_outgoing_message *message) {
+	int window = ctx->connect.max_inflight > 0 ? ctx->connect.max_inflight : 65535;
+	janus_mutex_lock(&ctx->pipeline.mutex);
+	if(ctx->pipeline.inflight < window && g_queue_is_empty(ctx->pipeline.pending)) {
+		/* There's room in the window (and nothing queued ahead of us) */
+		ctx->pipeline.inflight++;
+		janus_mutex_unlock(&ctx->pipeline.mutex);
+		if(janus_mqtt_client_send_outgoing(ctx, message) != MQTTASYNC_SUCCESS) {
+			janus_mutex_lock(&ctx->pipeline.mutex);
+			ctx->pipeline.inflight--;
+			janus_mutex_unlock(&ctx->pipeline.mutex);
+		}
+		return;
+	}
+	/* Window is full: queue the publish until a token completes */
+	if(message->droppable && (int)g_queue_get_length(ctx->pipeline.pending) >= ctx->pipeline.max_pending) {
+		/* Too much backlog already: drop the oldest queued event */
+		GList *item = ctx->pipeline.pending->head;
+		while(item != NULL && !((janus_mqtt_outgoing_message *)item->data)->droppable)
+			item = item->next;
+		if(item != NULL) {
+			janus_mqtt_outgoing_message *old = item->data;
+			g_queue_delete_link(ctx->pipeline.pending, item);
+			janus_mqtt_outgoing_message_free(old);
+		} else {
+			/* Everything that's queued is an API reply: drop this event instead */
+			janus_mqtt_outgoing_message_free(message);
+			message = NULL;
+		}
+		ctx->pipeline.dropped++;
+	}
+	if(message != NULL)
+		g_queue_push_tail(ctx->pipeline.pending, message);
+	janus_mutex_unlock(&ctx->pipeline.mutex);
+}
+
+/* Invoked whenever a publish token completes (with or without success):
+ * tokens tend to complete in bursts, so rather than releasing a single
+ * slot we flush as many pending publishes as now fit in the window */
+static void janus_mqtt_client_publish_complete(janus_mqtt_context *ctx) {
+	if(ctx == NULL)
+		return;
+	int window = ctx->connect.max_inflight > 0 ? ctx->connect.max_inflight : 65535;
+	janus_mutex_lock(&ctx->pipeline.mutex);
+	if(ctx->pipeline.inflight > 0)
+		ctx->pipeline.inflight--;
+	while(ctx->pipeline.inflight < window && !g_queue_is_empty(ctx->pipeline.pending)) {
+		janus_mqtt_outgoing_message *message = g_queue_pop_head(ctx->pipeline.pending);
+		ctx->pipeline.inflight++;
+		janus_mutex_unlock(&ctx->pipeline.mutex);
+		int rc = janus_mqtt_client_send_outgoing(ctx, message);
+		janus_mutex_lock(&ctx->pipeline.mutex);
+		if(rc != MQTTASYNC_SUCCESS)
+			ctx->pipeline.inflight--;
+	}
+	janus_mutex_unlock(&ctx->pipeline.mutex);
+}
+
 int janus_mqtt_send_message(janus_transport_session *transport, void *request_id, gboolean admin, json_t *message) {
 	if(message == NULL || transport == NULL) return -1;
 
@@ -865,10 +987,14 @@ int janus_mqtt_send_message(janus_transport_session *transport, void *request_id
 	}
 	JANUS_LOG(LOG_HUGE, "Sending %s API message via MQTT: %s\n", admin ? "admin" : "Janus", payload);
 
-	int rc;
+	janus_mqtt_outgoing_message *outgoing = g_malloc0(sizeof(janus_mqtt_outgoing_message));
+	outgoing->payload = payload;
+	outgoing->admin = admin;
+	/* Replies to API requests must always make it to the broker, while
+	 * events may be dropped if we're queueing more than we can publish */
+	outgoing->droppable = (request_id == NULL);
 #ifdef MQTTVERSION_5
 	if(ctx->connect.mqtt_version == MQTTVERSION_5) {
-		char *response_topic = NULL;
 		MQTTProperties properties = MQTTProperties_initializer;
 		char *transaction = g_strdup(json_string_value(json_object_get(message, "transaction")));
 		janus_mqtt_transaction_state *state = NULL;
@@ -878,30 +1004,21 @@ int janus_mqtt_send_message(janus_transport_session *transport, void *request_id
 			state = g_hash_table_lookup(janus_mqtt_transaction_states, transaction);
 
 			if(state != NULL) {
-				response_topic = janus_mqtt_get_response_topic(state);
+				outgoing->custom_topic = janus_mqtt_get_response_topic(state);
 				janus_mqtt_proxy_properties(state, ctx->publish.proxy_transaction_user_properties, &properties);
 				janus_mqtt_add_properties(state, ctx->publish.add_transaction_user_properties, &properties);
 			}
 
 			g_rw_lock_reader_unlock(&janus_mqtt_transaction_states_lock);
+			g_free(transaction);
 		}
-
-		rc = janus_mqtt_client_publish_message5(ctx, payload, admin, &properties, response_topic);
-		if(response_topic != NULL) g_free(response_topic);
-		MQTTProperties_free(&properties);
-	} else {
-		rc = janus_mqtt_client_publish_message(ctx, payload, admin);
+		/* The message owns the properties now, they're freed with it */
+		outgoing->properties = properties;
 	}
-#else
-	rc = janus_mqtt_client_publish_message(ctx, payload, admin);
 #endif
-
-	if(rc != MQTTASYNC_SUCCESS) {
-		JANUS_LOG(LOG_ERR, "Can't publish to MQTT topic: %s, return code: %d\n", admin ? ctx->admin.publish.topic : ctx->publish.topic, rc);
-	}
+	janus_mqtt_client_publish_pipelined(ctx, outgoing);
 
 	json_decref(message);
-	free(payload);
 	return 0;
 }
 
@@ -1046,6 +1163,16 @@ json_t *janus_mqtt_query_transport(json_t *request) {
 				json_array_append_new(notes, json_string("Ignored unsupported indentation format"));
 			}
 		}
+	} else if(!strcasecmp(request_text, "stats")) {
+		/* Return the current depth of the publish pipeline */
+		json_object_set_new(response, "result", json_integer(200));
+		janus_mutex_lock(&context_->pipeline.mutex);
+		json_object_set_new(response, "inflight", json_integer(context_->pipeline.inflight));
+		json_object_set_new(response, "pending", json_integer(g_queue_get_length(context_->pipeline.pending)));
+		json_object_set_new(response, "dropped_events", json_integer(context_->pipeline.dropped));
+		janus_mutex_unlock(&context_->pipeline.mutex);
+		json_object_set_new(response, "max_inflight", json_integer(context_->connect.max_inflight));
+		json_object_set_new(response, "max_pending", json_integer(context_->pipeline.max_pending));
 	} else {
 		JANUS_LOG(LOG_VERB, "Unknown request '%s'\n", request_text);
 		error_code = JANUS_MQTT_ERROR_INVALID_REQUEST;
@@ -1557,11 +1684,13 @@ int janus_mqtt_client_publish_message5(janus_mqtt_context *ctx, char *payload, g
 
 void janus_mqtt_client_publish_janus_success(void *context, MQTTAsync_successData *response) {
 	janus_mqtt_client_publish_janus_success_impl(response->alt.pub.destinationName);
+	janus_mqtt_client_publish_complete((janus_mqtt_context *)context);
 }
 
 #ifdef MQTTVERSION_5
 void janus_mqtt_client_publish_janus_success5(void *context, MQTTAsync_successData5 *response) {
 	janus_mqtt_client_publish_janus_success_impl(response->alt.pub.destinationName);
+	janus_mqtt_client_publish_complete((janus_mqtt_context *)context);
 }
 #endif
 
@@ -1572,12 +1701,14 @@ void janus_mqtt_client_publish_janus_success_impl(char *topic) {
 void janus_mqtt_client_publish_janus_failure(void *context, MQTTAsync_failureData *response) {
 	int rc = janus_mqtt_client_get_response_code(response);
 	janus_mqtt_client_publish_janus_failure_impl(rc);
+	janus_mqtt_client_publish_complete((janus_mqtt_context *)context);
 }
 
 #ifdef MQTTVERSION_5
 void janus_mqtt_client_publish_janus_failure5(void *context, MQTTAsync_failureData5 *response) {
 	int rc = janus_mqtt_client_get_response_code5(response);
 	janus_mqtt_client_publish_janus_failure_impl(rc);
+	janus_mqtt_client_publish_complete((janus_mqtt_context *)context);
 }
 #endif
 
@@ -1587,11 +1718,13 @@ void janus_mqtt_client_publish_janus_failure_impl(int rc) {
 
 void janus_mqtt_client_publish_admin_success(void *context, MQTTAsync_successData *response) {
 	janus_mqtt_client_publish_admin_success_impl(response->alt.pub.destinationName);
+	janus_mqtt_client_publish_complete((janus_mqtt_context *)context);
 }
 
 #ifdef MQTTVERSION_5
 void janus_mqtt_client_publish_admin_success5(void *context, MQTTAsync_successData5 *response) {
 	janus_mqtt_client_publish_admin_success_impl(response->alt.pub.destinationName);
+	janus_mqtt_client_publish_complete((janus_mqtt_context *)context);
 }
 #endif
 
@@ -1602,12 +1735,14 @@ void janus_mqtt_client_publish_admin_success_impl(char *topic) {
 void janus_mqtt_client_publish_admin_failure(void *context, MQTTAsync_failureData *response) {
 	int rc = janus_mqtt_client_get_response_code(response);
 	janus_mqtt_client_publish_admin_failure_impl(rc);
+	janus_mqtt_client_publish_complete((janus_mqtt_context *)context);
 }
 
 #ifdef MQTTVERSION_5
 void janus_mqtt_client_publish_admin_failure5(void *context, MQTTAsync_failureData5 *response) {
 	int rc = janus_mqtt_client_get_response_code5(response);
 	janus_mqtt_client_publish_admin_failure_impl(rc);
+	janus_mqtt_client_publish_complete((janus_mqtt_context *)context);
 }
 #endif
 
@@ -1679,6 +1814,13 @@ void janus_mqtt_client_destroy_context(janus_mqtt_context **ptr) {
 		g_free(ctx->publish.topic);
 		g_free(ctx->connect.username);
 		g_free(ctx->connect.password);
+		if(ctx->pipeline.pending != NULL) {
+			janus_mqtt_outgoing_message *message = NULL;
+			while((message = g_queue_pop_head(ctx->pipeline.pending)) != NULL)
+				janus_mqtt_outgoing_message_free(message);
+			g_queue_free(ctx->pipeline.pending);
+			janus_mutex_destroy(&ctx->pipeline.mutex);
+		}
 		janus_mutex_destroy(&ctx->disconnect.mutex);
 		janus_condition_destroy(&ctx->disconnect.cond);
 		g_free(ctx->admin.subscribe.topic);
@@ -10,6 +10,11 @@
  * transport mechanism. Future versions may implement more, but for the
  * time being these should be enough to cover most development requirements.
  *
+ * Besides JSON, clients can also encode their requests in CBOR
+ * (RFC 8949): the first CBOR message a client sends switches their
+ * connection to the binary encoding, and all the following responses,
+ * events and notifications to that client will be CBOR too.
+ *
  * \ingroup transports
  * \ref transports
  */
@@ -22,6 +27,8 @@
 #include <nanomsg/ipc.h>
 #include <nanomsg/pipeline.h>
 
+#include "janus_cbor.h"
+
 #include "../debug.h"
 #include "../apierror.h"
 #include "../config.h"
@@ -122,10 +129,25 @@ static int nfd = -1, nfd_addr = -1, admin_nfd = -1, admin_nfd_addr = -1;
 /* Pipeline to notify about the need for outgoing data */
 static int write_nfd[2];
 
+/* Outgoing message, as queued for a client: we need the length besides
+ * the payload itself, since CBOR encoded messages can contain NUL bytes */
+typedef struct janus_nanomsg_message {
+	char *payload;					/* The serialized message to send */
+	size_t length;					/* Length of the payload */
+} janus_nanomsg_message;
+static void janus_nanomsg_message_free(janus_nanomsg_message *message) {
+	if(message == NULL)
+		return;
+	free(message->payload);
+	g_free(message);
+}
+
 /* Nanomsg client session */
 typedef struct janus_nanomsg_client {
 	gboolean admin;					/* Whether this client is for the Admin or Janus API */
+	gboolean binary;				/* Whether this client negotiated CBOR, and so should get binary responses */
 	GAsyncQueue *messages;			/* Queue of outgoing messages to push */
+	janus_nanomsg_message *pending;	/* Message we popped but couldn't send yet (socket was full) */
 	janus_transport_session *ts;	/* Janus core-transport session */
 } janus_nanomsg_client;
 /* We only handle a single client per API, since we use NN_PAIR and we bind locally */
@@ -398,15 +420,27 @@ gboolean janus_nanomsg_is_admin_api_enabled(void) {
 int janus_nanomsg_send_message(janus_transport_session *transport, void *request_id, gboolean admin, json_t *message) {
 	if(message == NULL)
 		return -1;
-	/* Convert to string */
-	char *payload = json_dumps(message, json_format);
+	/* Serialize (to CBOR or JSON, depending on what the client negotiated) */
+	gboolean binary = admin ? admin_client.binary : client.binary;
+	char *payload = NULL;
+	size_t length = 0;
+	if(binary) {
+		payload = janus_cbor_encode(message, &length);
+	} else {
+		payload = json_dumps(message, json_format);
+		if(payload != NULL)
+			length = strlen(payload);
+	}
 	json_decref(message);
 	if(payload == NULL) {
-		JANUS_LOG(LOG_ERR, "Failed to stringify message...\n");
+		JANUS_LOG(LOG_ERR, "Failed to serialize message...\n");
 		return -1;
 	}
 	/* Enqueue the packet and have poll tell us when it's time to send it */
-	g_async_queue_push(admin ? admin_client.messages : client.messages, payload);
+	janus_nanomsg_message *response = g_malloc(sizeof(janus_nanomsg_message));
+	response->payload = payload;
+	response->length = length;
+	g_async_queue_push(admin ? admin_client.messages : client.messages, response);
 	/* Notify the thread there's data to send */
 	(void)nn_send(write_nfd[1], "x", 1, 0);
 	return 0;
@@ -522,7 +556,7 @@ void *janus_nanomsg_thread(void *data) {
 			/* Janus API */
 			poll_nfds[fds].fd = nfd;
 			poll_nfds[fds].events = NN_POLLIN;
-			if(client.messages != NULL && g_async_queue_length(client.messages) > 0)
+			if(client.pending != NULL || (client.messages != NULL && g_async_queue_length(client.messages) > 0))
 				poll_nfds[fds].events |= NN_POLLOUT;
 			fds++;
 		}
@@ -530,7 +564,7 @@ void *janus_nanomsg_thread(void *data) {
 			/* Admin API */
 			poll_nfds[fds].fd = admin_nfd;
 			poll_nfds[fds].events = NN_POLLIN;
-			if(admin_client.messages != NULL && g_async_queue_length(admin_client.messages) > 0)
+			if(admin_client.pending != NULL || (admin_client.messages != NULL && g_async_queue_length(admin_client.messages) > 0))
 				poll_nfds[fds].events |= NN_POLLOUT;
 			fds++;
 		}
@@ -552,41 +586,77 @@ void *janus_nanomsg_thread(void *data) {
 			if(poll_nfds[i].revents & NN_POLLOUT) {
 				/* Find the client from its file descriptor */
 				if(poll_nfds[i].fd == nfd || poll_nfds[i].fd == admin_nfd) {
-					char *payload = NULL;
-					while((payload = g_async_queue_try_pop(poll_nfds[i].fd == nfd ? client.messages : admin_client.messages)) != NULL) {
-						int res = nn_send(poll_nfds[i].fd, payload, strlen(payload), 0);
-						/* FIXME Should we check if sent everything? */
-						JANUS_LOG(LOG_HUGE, "Written %d/%zu bytes on %d\n", res, strlen(payload), poll_nfds[i].fd);
-						free(payload);
+					janus_nanomsg_client *c = poll_nfds[i].fd == nfd ? &client : &admin_client;
+					/* Drain the queue: non-blocking sends, so that a full socket
+					 * can't stall the loop (we'll retry at the next wakeup) */
+					janus_nanomsg_message *payload = NULL;
+					while((payload = c->pending) != NULL ||
+							(payload = g_async_queue_try_pop(c->messages)) != NULL) {
+						int res = nn_send(poll_nfds[i].fd, payload->payload, payload->length, NN_DONTWAIT);
+						if(res < 0) {
+							if(errno == EAGAIN) {
+								/* Socket full: keep the message for the next NN_POLLOUT */
+								c->pending = payload;
+								break;
+							}
+							JANUS_LOG(LOG_WARN, "Error sending %s API message... %d (%s)\n",
+								poll_nfds[i].fd == nfd ? "Janus" : "Admin", errno, nn_strerror(errno));
+						} else {
+							/* FIXME Should we check if sent everything? */
+							JANUS_LOG(LOG_HUGE, "Written %d/%zu bytes on %d\n", res, payload->length, poll_nfds[i].fd);
+						}
+						c->pending = NULL;
+						janus_nanomsg_message_free(payload);
 					}
 				}
 			}
 			if(poll_nfds[i].revents & NN_POLLIN) {
 				if(poll_nfds[i].fd == write_nfd[0]) {
 					/* Read and ignore: we use this to unlock the poll if there's data to write */
-					(void)nn_recv(poll_nfds[i].fd, buffer, BUFFER_SIZE, 0);
-				} else if(poll_nfds[i].fd == nfd || poll_nfds[i].fd == admin_nfd) {
-					/* Janus/Admin API: get the message from the client */
-					int res = nn_recv(poll_nfds[i].fd, buffer, BUFFER_SIZE, 0);
-					if(res < 0) {
-						JANUS_LOG(LOG_WARN, "Error receiving %s API message... %d (%s)\n",
-							poll_nfds[i].fd == nfd ? "Janus" : "Admin", errno, nn_strerror(errno));
+					while(nn_recv(poll_nfds[i].fd, buffer, BUFFER_SIZE, NN_DONTWAIT) >= 0)
 						continue;
+				} else if(poll_nfds[i].fd == nfd || poll_nfds[i].fd == admin_nfd) {
+					/* Janus/Admin API: drain the socket, clients may send in bursts */
+					while(TRUE) {
+						int res = nn_recv(poll_nfds[i].fd, buffer, BUFFER_SIZE, NN_DONTWAIT);
+						if(res < 0) {
+							if(errno != EAGAIN) {
+								JANUS_LOG(LOG_WARN, "Error receiving %s API message... %d (%s)\n",
+									poll_nfds[i].fd == nfd ? "Janus" : "Admin", errno, nn_strerror(errno));
+							}
+							break;
+						}
+						/* If we got here, there's data to handle */
+						buffer[res] = '\0';
+						JANUS_LOG(LOG_VERB, "Got %s API message (%d bytes)\n",
+							poll_nfds[i].fd == nfd ? "Janus" : "Admin", res);
+						/* Parse the payload: it may be either CBOR or JSON */
+						janus_nanomsg_client *c = poll_nfds[i].fd == nfd ? &client : &admin_client;
+						json_error_t error;
+						json_t *root = NULL;
+						if(janus_cbor_is_cbor(buffer, res)) {
+							root = janus_cbor_decode(buffer, res);
+							if(root != NULL && !c->binary) {
+								/* The client speaks CBOR: switch them to the
+								 * binary encoding, our responses will be CBOR too */
+								JANUS_LOG(LOG_VERB, "%s API client negotiated the CBOR encoding\n",
+									poll_nfds[i].fd == nfd ? "Janus" : "Admin");
+								c->binary = TRUE;
+							}
+							memset(&error, 0, sizeof(error));
+							if(root == NULL)
+								g_snprintf(error.text, sizeof(error.text), "Invalid CBOR payload");
+						} else {
+							JANUS_LOG(LOG_HUGE, "%s\n", buffer);
+							root = json_loads(buffer, 0, &error);
+						}
+						/* Notify the core, passing both the object and, since it may be needed, the error */
+						gateway->incoming_request(&janus_nanomsg_transport,
+							poll_nfds[i].fd == nfd ? client.ts : admin_client.ts,
+							NULL,
+							poll_nfds[i].fd == nfd ? FALSE : TRUE,
+							root, &error);
 					}
-					/* If we got here, there's data to handle */
-					buffer[res] = '\0';
-					JANUS_LOG(LOG_VERB, "Got %s API message (%d bytes)\n",
-						poll_nfds[i].fd == nfd ? "Janus" : "Admin", res);
-					JANUS_LOG(LOG_HUGE, "%s\n", buffer);
-					/* Parse the JSON payload */
-					json_error_t error;
-					json_t *root = json_loads(buffer, 0, &error);
-					/* Notify the core, passing both the object and, since it may be needed, the error */
-					gateway->incoming_request(&janus_nanomsg_transport,
-						poll_nfds[i].fd == nfd ? client.ts : admin_client.ts,
-						NULL,
-						poll_nfds[i].fd == nfd ? FALSE : TRUE,
-						root, &error);
 				}
 			}
 		}
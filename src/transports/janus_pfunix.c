@@ -22,10 +22,22 @@
  * explicit request as the GET in the plain HTTP API. Closing a client
  * Unix Socket will also destroy all the sessions it created.
  *
+ * Besides JSON, clients can also encode their requests in CBOR
+ * (RFC 8949): the first CBOR message a client sends switches their
+ * connection to the binary encoding, and all the following responses,
+ * events and notifications to that client will be CBOR too.
+ *
  * \ingroup transports
  * \ref transports
  */
 
+#ifdef __linux__
+/* Needed for sendmmsg and recvmmsg */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#endif
+
 #include "transport.h"
 
 #include <arpa/inet.h>
@@ -37,9 +49,12 @@
 #include "systemd/sd-daemon.h"
 #endif /* HAVE_LIBSYSTEMD */
 
+#include "janus_cbor.h"
+
 #include "../debug.h"
 #include "../apierror.h"
 #include "../config.h"
+#include "../lfq.h"
 #include "../mutex.h"
 #include "../utils.h"
 
@@ -113,6 +128,10 @@ static gboolean notify_events = TRUE;
 static size_t json_format = JSON_INDENT(3) | JSON_PRESERVE_ORDER;
 
 #define BUFFER_SIZE		8192
+/* Size of the per-client ring of outgoing messages */
+#define JANUS_PFUNIX_QUEUE_SIZE		1024
+/* How many messages, at most, we batch in a single sendmmsg/recvmmsg */
+#define JANUS_PFUNIX_BATCH			32
 
 /* Parameter validation (for tweaking and queries via Admin API) */
 static struct janus_json_parameter request_parameters[] = {
@@ -147,12 +166,26 @@ static gboolean sd_socket = FALSE, admin_sd_socket = FALSE;
 /* Socket pair to notify about the need for outgoing data */
 static int write_fd[2];
 
+/* Outgoing message, as queued for a client: we need the length besides
+ * the payload itself, since CBOR encoded messages can contain NUL bytes */
+typedef struct janus_pfunix_message {
+	char *payload;					/* The serialized message to send */
+	size_t length;					/* Length of the payload */
+} janus_pfunix_message;
+static void janus_pfunix_message_free(janus_pfunix_message *message) {
+	if(message == NULL)
+		return;
+	free(message->payload);
+	g_free(message);
+}
+
 /* Unix Sockets client session */
 typedef struct janus_pfunix_client {
 	int fd;							/* Client socket (in case SOCK_SEQPACKET is used) */
 	struct sockaddr_un addr;		/* Client address (in case SOCK_DGRAM is used) */
 	gboolean admin;					/* Whether this client is for the Admin or Janus API */
-	GAsyncQueue *messages;			/* Queue of outgoing messages to push */
+	gboolean binary;				/* Whether this client negotiated CBOR, and so should get binary responses */
+	janus_lfq *messages;			/* Ring of outgoing messages to push */
 	gboolean session_timeout;		/* Whether a Janus session timeout occurred in the core */
 	janus_transport_session *ts;	/* Janus core-transport session */
 } janus_pfunix_client;
@@ -165,11 +198,11 @@ static void janus_pfunix_client_free(void *client_ref) {
 	JANUS_LOG(LOG_INFO, "Freeing unix sockets client\n");
 	janus_pfunix_client *client = (janus_pfunix_client *) client_ref;
 	if(client->messages != NULL) {
-		char *response = NULL;
-		while((response = g_async_queue_try_pop(client->messages)) != NULL) {
-			g_free(response);
+		janus_pfunix_message *response = NULL;
+		while((response = janus_lfq_try_pop(client->messages)) != NULL) {
+			janus_pfunix_message_free(response);
 		}
-		g_async_queue_unref(client->messages);
+		janus_lfq_destroy(client->messages);
 	}
 	g_free(client);
 }
@@ -446,16 +479,27 @@ int janus_pfunix_send_message(janus_transport_session *transport, void *request_
 		return -1;
 	}
 	janus_mutex_unlock(&clients_mutex);
-	/* Convert to string */
-	char *payload = json_dumps(message, json_format);
+	/* Serialize (to CBOR or JSON, depending on what the client negotiated) */
+	char *payload = NULL;
+	size_t length = 0;
+	if(client->binary) {
+		payload = janus_cbor_encode(message, &length);
+	} else {
+		payload = json_dumps(message, json_format);
+		if(payload != NULL)
+			length = strlen(payload);
+	}
 	json_decref(message);
 	if(payload == NULL) {
-		JANUS_LOG(LOG_ERR, "Failed to stringify message...\n");
+		JANUS_LOG(LOG_ERR, "Failed to serialize message...\n");
 		return -1;
 	}
 	if(client->fd != -1) {
 		/* SOCK_SEQPACKET, enqueue the packet and have poll tell us when it's time to send it */
-		g_async_queue_push(client->messages, payload);
+		janus_pfunix_message *response = g_malloc(sizeof(janus_pfunix_message));
+		response->payload = payload;
+		response->length = length;
+		janus_lfq_push(client->messages, response);
 		/* Notify the thread there's data to send */
 		int res = 0;
 		do {
@@ -465,7 +509,7 @@ int janus_pfunix_send_message(janus_transport_session *transport, void *request_
 		/* SOCK_DGRAM, send it right away */
 		int res = 0;
 		do {
-			res = sendto(client->admin ? admin_pfd : pfd, payload, strlen(payload), 0, (struct sockaddr *)&client->addr, sizeof(struct sockaddr_un));
+			res = sendto(client->admin ? admin_pfd : pfd, payload, length, 0, (struct sockaddr *)&client->addr, sizeof(struct sockaddr_un));
 		} while(res == -1 && errno == EINTR);
 		free(payload);
 	}
@@ -584,6 +628,68 @@ plugin_response:
 }
 
 
+/* Helper to handle a single datagram coming from a SOCK_DGRAM client,
+ * whether it was read with recvfrom() or as part of a recvmmsg() batch */
+static void janus_pfunix_handle_dgram(int fd, struct sockaddr_un *uaddr, char *buffer, int res) {
+	/* Is this a new client, or one we knew about already? */
+	if(strlen(uaddr->sun_path) == 0) {
+		/* No path provided, drop the packet */
+		JANUS_LOG(LOG_WARN, "Dropping packet from unknown source (no path provided)\n");
+		return;
+	}
+	janus_mutex_lock(&clients_mutex);
+	janus_pfunix_client *client = g_hash_table_lookup(clients_by_path, uaddr->sun_path);
+	if(client == NULL) {
+		JANUS_LOG(LOG_INFO, "Got new Unix Sockets %s API client: %s\n",
+			fd == pfd ? "Janus" : "Admin", uaddr->sun_path);
+		/* Allocate new client */
+		client = g_malloc(sizeof(janus_pfunix_client));
+		client->fd = -1;
+		memcpy(&client->addr, uaddr, sizeof(struct sockaddr_un));
+		client->admin = (fd == admin_pfd);	/* API client type */
+		client->binary = FALSE;
+		client->messages = janus_lfq_new(JANUS_PFUNIX_QUEUE_SIZE);
+		client->session_timeout = FALSE;
+		/* Create a transport instance as well */
+		client->ts = janus_transport_session_create(client, janus_pfunix_client_free);
+		/* Take note of this new client (we key by the copy of the path
+		 * we just made, which lives as long as the client itself does) */
+		g_hash_table_insert(clients_by_path, client->addr.sun_path, client);
+		g_hash_table_insert(clients, client, client);
+		/* Notify handlers about this new transport */
+		if(notify_events && gateway->events_is_enabled()) {
+			json_t *info = json_object();
+			json_object_set_new(info, "event", json_string("connected"));
+			json_object_set_new(info, "admin_api", client->admin ? json_true() : json_false());
+			json_object_set_new(info, "fd", json_integer(client->fd));
+			json_object_set_new(info, "type", json_string("SOCK_DGRAM"));
+			gateway->notify_event(&janus_pfunix_transport, client->ts, info);
+		}
+	}
+	janus_mutex_unlock(&clients_mutex);
+	JANUS_LOG(LOG_VERB, "Message from client %s (%d bytes)\n", uaddr->sun_path, res);
+	/* Parse the payload: it may be either CBOR or JSON */
+	json_error_t error;
+	json_t *root = NULL;
+	if(janus_cbor_is_cbor(buffer, res)) {
+		root = janus_cbor_decode(buffer, res);
+		if(root != NULL && !client->binary) {
+			/* The client speaks CBOR: switch them to the
+			 * binary encoding, our responses will be CBOR too */
+			JANUS_LOG(LOG_VERB, "Client %s negotiated the CBOR encoding\n", uaddr->sun_path);
+			client->binary = TRUE;
+		}
+		memset(&error, 0, sizeof(error));
+		if(root == NULL)
+			g_snprintf(error.text, sizeof(error.text), "Invalid CBOR payload");
+	} else {
+		JANUS_LOG(LOG_HUGE, "%s\n", buffer);
+		root = json_loads(buffer, 0, &error);
+	}
+	/* Notify the core, passing both the object and, since it may be needed, the error */
+	gateway->incoming_request(&janus_pfunix_transport, client->ts, NULL, client->admin, root, &error);
+}
+
 /* Thread */
 void *janus_pfunix_thread(void *data) {
 	JANUS_LOG(LOG_INFO, "Unix Sockets thread started\n");
@@ -599,6 +705,15 @@ void *janus_pfunix_thread(void *data) {
 	iov[0].iov_len = sizeof(buffer);
 	msg.msg_iov = iov;
 	msg.msg_iovlen = 1;
+#ifdef __linux__
+	/* State for the recvmmsg() batches on SOCK_DGRAM sockets (the buffers
+	 * are too large for the stack, so we keep them on the heap instead) */
+	char *rbufs = g_malloc(JANUS_PFUNIX_BATCH * BUFFER_SIZE);
+	struct mmsghdr rmsgs[JANUS_PFUNIX_BATCH];
+	struct iovec riovs[JANUS_PFUNIX_BATCH];
+	struct sockaddr_storage raddrs[JANUS_PFUNIX_BATCH];
+	memset(rmsgs, 0, sizeof(rmsgs));
+#endif
 
 	while(g_atomic_int_get(&initialized) && !g_atomic_int_get(&stopping)) {
 		/* Prepare poll list of file descriptors */
@@ -628,7 +743,7 @@ void *janus_pfunix_thread(void *data) {
 			janus_pfunix_client *client = value;
 			if(client->fd > -1) {
 				poll_fds[fds].fd = client->fd;
-				poll_fds[fds].events = g_async_queue_length(client->messages) > 0 ? POLLIN | POLLOUT : POLLIN;
+				poll_fds[fds].events = janus_lfq_length(client->messages) > 0 ? POLLIN | POLLOUT : POLLIN;
 				fds++;
 			}
 		}
@@ -713,18 +828,59 @@ void *janus_pfunix_thread(void *data) {
 				janus_mutex_lock(&clients_mutex);
 				janus_pfunix_client *client = g_hash_table_lookup(clients_by_fd, GINT_TO_POINTER(poll_fds[i].fd));
 				if(client != NULL) {
-					char *payload = NULL;
-					while((payload = g_async_queue_try_pop(client->messages)) != NULL) {
+#ifdef __linux__
+					/* Drain the ring in batches, so that bursts of small
+					 * messages cost a single sendmmsg() each, rather than
+					 * one write() per message */
+					janus_pfunix_message *batch[JANUS_PFUNIX_BATCH];
+					struct mmsghdr msgs[JANUS_PFUNIX_BATCH];
+					struct iovec iovs[JANUS_PFUNIX_BATCH];
+					while(client->fd > -1) {
+						int count = 0;
+						janus_pfunix_message *payload = NULL;
+						while(count < JANUS_PFUNIX_BATCH && (payload = janus_lfq_try_pop(client->messages)) != NULL)
+							batch[count++] = payload;
+						if(count == 0)
+							break;
+						memset(msgs, 0, count*sizeof(struct mmsghdr));
+						int j = 0;
+						for(j=0; j<count; j++) {
+							iovs[j].iov_base = batch[j]->payload;
+							iovs[j].iov_len = batch[j]->length;
+							msgs[j].msg_hdr.msg_iov = &iovs[j];
+							msgs[j].msg_hdr.msg_iovlen = 1;
+						}
+						int res = 0;
+						do {
+							res = sendmmsg(client->fd, msgs, count, 0);
+						} while(res == -1 && errno == EINTR);
+						if(res < 0)
+							res = 0;
+						JANUS_LOG(LOG_HUGE, "Written %d/%d queued messages on %d\n", res, count, client->fd);
+						for(j=0; j<res; j++)
+							janus_pfunix_message_free(batch[j]);
+						if(res < count) {
+							/* We couldn't send everything: requeue the rest,
+							 * in order, and wait for the next POLLOUT */
+							for(j=count-1; j>=res; j--)
+								janus_lfq_push_front(client->messages, batch[j]);
+							break;
+						}
+					}
+#else
+					janus_pfunix_message *payload = NULL;
+					while((payload = janus_lfq_try_pop(client->messages)) != NULL) {
 						int res = 0;
 						do {
 							if(client->fd < 0)
 								break;
-							res = write(client->fd, payload, strlen(payload));
+							res = write(client->fd, payload->payload, payload->length);
 						} while(res == -1 && errno == EINTR);
 						/* FIXME Should we check if sent everything? */
-						JANUS_LOG(LOG_HUGE, "Written %d/%zu bytes on %d\n", res, strlen(payload), client->fd);
-						g_free(payload);
+						JANUS_LOG(LOG_HUGE, "Written %d/%zu bytes on %d\n", res, payload->length, client->fd);
+						janus_pfunix_message_free(payload);
 					}
+#endif
 					if(client->session_timeout) {
 						/* We should actually get rid of this connection, now */
 						shutdown(SHUT_RDWR, poll_fds[i].fd);
@@ -734,11 +890,12 @@ void *janus_pfunix_thread(void *data) {
 						g_hash_table_remove(clients_by_fd, GINT_TO_POINTER(poll_fds[i].fd));
 						g_hash_table_remove(clients, client);
 						if(client->messages != NULL) {
-							char *response = NULL;
-							while((response = g_async_queue_try_pop(client->messages)) != NULL) {
-								g_free(response);
+							janus_pfunix_message *response = NULL;
+							while((response = janus_lfq_try_pop(client->messages)) != NULL) {
+								janus_pfunix_message_free(response);
 							}
-							g_async_queue_unref(client->messages);
+							janus_lfq_destroy(client->messages);
+							client->messages = NULL;
 						}
 						g_free(client);
 					}
@@ -764,7 +921,8 @@ void *janus_pfunix_thread(void *data) {
 							client->fd = cfd;
 							memset(&client->addr, 0, sizeof(client->addr));
 							client->admin = (poll_fds[i].fd == admin_pfd);	/* API client type */
-							client->messages = g_async_queue_new();
+							client->binary = FALSE;
+							client->messages = janus_lfq_new(JANUS_PFUNIX_QUEUE_SIZE);
 							client->session_timeout = FALSE;
 							/* Create a transport instance as well */
 							client->ts = janus_transport_session_create(client, janus_pfunix_client_free);
@@ -784,58 +942,43 @@ void *janus_pfunix_thread(void *data) {
 						}
 					} else {
 						/* SOCK_DGRAM */
-						struct sockaddr_storage address;
-						res = recvfrom(poll_fds[i].fd, buffer, sizeof(buffer), 0, (struct sockaddr *)&address, &addrlen);
-						if(res < 0) {
+#ifdef __linux__
+						/* Read as many datagrams as are queued with a single recvmmsg() */
+						int m = 0;
+						for(m=0; m<JANUS_PFUNIX_BATCH; m++) {
+							riovs[m].iov_base = rbufs + m*BUFFER_SIZE;
+							riovs[m].iov_len = BUFFER_SIZE-1;
+							rmsgs[m].msg_hdr.msg_iov = &riovs[m];
+							rmsgs[m].msg_hdr.msg_iovlen = 1;
+							rmsgs[m].msg_hdr.msg_name = &raddrs[m];
+							rmsgs[m].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+						}
+						int msgcount = recvmmsg(poll_fds[i].fd, rmsgs, JANUS_PFUNIX_BATCH, 0, NULL);
+						if(msgcount < 0) {
 							if(errno != EAGAIN && errno != EWOULDBLOCK) {
 								JANUS_LOG(LOG_ERR, "Error reading from client (%s API)...\n",
 									poll_fds[i].fd == pfd ? "Janus" : "Admin");
 							}
 							continue;
 						}
-						buffer[res] = '\0';
-						/* Is this a new client, or one we knew about already? */
-						struct sockaddr_un *uaddr = (struct sockaddr_un *)&address;
-						if(strlen(uaddr->sun_path) == 0) {
-							/* No path provided, drop the packet */
-							JANUS_LOG(LOG_WARN, "Dropping packet from unknown source (no path provided)\n");
-							continue;
+						for(m=0; m<msgcount; m++) {
+							char *mbuf = rbufs + m*BUFFER_SIZE;
+							mbuf[rmsgs[m].msg_len] = '\0';
+							janus_pfunix_handle_dgram(poll_fds[i].fd,
+								(struct sockaddr_un *)&raddrs[m], mbuf, (int)rmsgs[m].msg_len);
 						}
-						janus_mutex_lock(&clients_mutex);
-						janus_pfunix_client *client = g_hash_table_lookup(clients_by_path, uaddr->sun_path);
-						if(client == NULL) {
-							JANUS_LOG(LOG_INFO, "Got new Unix Sockets %s API client: %s\n",
-								poll_fds[i].fd == pfd ? "Janus" : "Admin", uaddr->sun_path);
-							/* Allocate new client */
-							client = g_malloc(sizeof(janus_pfunix_client));
-							client->fd = -1;
-							memcpy(&client->addr, uaddr, sizeof(struct sockaddr_un));
-							client->admin = (poll_fds[i].fd == admin_pfd);	/* API client type */
-							client->messages = g_async_queue_new();
-							client->session_timeout = FALSE;
-							/* Create a transport instance as well */
-							client->ts = janus_transport_session_create(client, janus_pfunix_client_free);
-							/* Take note of this new client */
-							g_hash_table_insert(clients_by_path, uaddr->sun_path, client);
-							g_hash_table_insert(clients, client, client);
-							/* Notify handlers about this new transport */
-							if(notify_events && gateway->events_is_enabled()) {
-								json_t *info = json_object();
-								json_object_set_new(info, "event", json_string("connected"));
-								json_object_set_new(info, "admin_api", client->admin ? json_true() : json_false());
-								json_object_set_new(info, "fd", json_integer(client->fd));
-								json_object_set_new(info, "type", json_string("SOCK_DGRAM"));
-								gateway->notify_event(&janus_pfunix_transport, client->ts, info);
+#else
+						res = recvfrom(poll_fds[i].fd, buffer, sizeof(buffer)-1, 0, (struct sockaddr *)&address, &addrlen);
+						if(res < 0) {
+							if(errno != EAGAIN && errno != EWOULDBLOCK) {
+								JANUS_LOG(LOG_ERR, "Error reading from client (%s API)...\n",
+									poll_fds[i].fd == pfd ? "Janus" : "Admin");
 							}
+							continue;
 						}
-						janus_mutex_unlock(&clients_mutex);
-						JANUS_LOG(LOG_VERB, "Message from client %s (%d bytes)\n", uaddr->sun_path, res);
-						JANUS_LOG(LOG_HUGE, "%s\n", buffer);
-						/* Parse the JSON payload */
-						json_error_t error;
-						json_t *root = json_loads(buffer, 0, &error);
-						/* Notify the core, passing both the object and, since it may be needed, the error */
-						gateway->incoming_request(&janus_pfunix_transport, client->ts, NULL, client->admin, root, &error);
+						buffer[res] = '\0';
+						janus_pfunix_handle_dgram(poll_fds[i].fd, &address, buffer, res);
+#endif
 					}
 				} else {
 					/* Client data: receive message */
@@ -889,10 +1032,24 @@ void *janus_pfunix_thread(void *data) {
 					/* If we got here, there's data to handle */
 					buffer[res] = '\0';
 					JANUS_LOG(LOG_VERB, "Message from client %d (%d bytes)\n", poll_fds[i].fd, res);
-					JANUS_LOG(LOG_HUGE, "%s\n", buffer);
-					/* Parse the JSON payload */
+					/* Parse the payload: it may be either CBOR or JSON */
 					json_error_t error;
-					json_t *root = json_loads(buffer, 0, &error);
+					json_t *root = NULL;
+					if(janus_cbor_is_cbor(buffer, res)) {
+						root = janus_cbor_decode(buffer, res);
+						if(root != NULL && !client->binary) {
+							/* The client speaks CBOR: switch them to the
+							 * binary encoding, our responses will be CBOR too */
+							JANUS_LOG(LOG_VERB, "Client %d negotiated the CBOR encoding\n", poll_fds[i].fd);
+							client->binary = TRUE;
+						}
+						memset(&error, 0, sizeof(error));
+						if(root == NULL)
+							g_snprintf(error.text, sizeof(error.text), "Invalid CBOR payload");
+					} else {
+						JANUS_LOG(LOG_HUGE, "%s\n", buffer);
+						root = json_loads(buffer, 0, &error);
+					}
 					/* Notify the core, passing both the object and, since it may be needed, the error */
 					gateway->incoming_request(&janus_pfunix_transport, client->ts, NULL, client->admin, root, &error);
 				}
@@ -933,6 +1090,10 @@ void *janus_pfunix_thread(void *data) {
 	admin_pfd = -1;
 	g_free(addr);
 
+#ifdef __linux__
+	g_free(rbufs);
+#endif
+
 	g_hash_table_destroy(clients_by_path);
 	g_hash_table_destroy(clients_by_fd);
 	g_hash_table_destroy(clients);
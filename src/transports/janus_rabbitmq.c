@@ -145,10 +145,19 @@ static struct janus_json_parameter configure_parameters[] = {
 #define JANUS_RABBITMQ_ERROR_UNKNOWN_ERROR			499
 
 
+/* Size limit for the round-robin pool of publish channels */
+#define JANUS_RABBITMQ_MAX_CHANNELS		16
+/* How many unconfirmed publishes we allow before pausing events */
+#define JANUS_RABBITMQ_MAX_UNCONFIRMED	128
+
 /* RabbitMQ client session: we only create a single one as of now */
 typedef struct janus_rabbitmq_client {
 	amqp_connection_state_t rmq_conn;		/* AMQP connection state */
-	amqp_channel_t rmq_channel;				/* AMQP channel */
+	amqp_channel_t rmq_channel;				/* AMQP channel for incoming messages */
+	amqp_channel_t reply_channel;			/* Dedicated channel for outgoing API replies */
+	int next_channel;						/* Index of the next publish channel to use for an event */
+	guint64 published[JANUS_RABBITMQ_MAX_CHANNELS+3];	/* Publishes per channel, when confirms are on */
+	guint64 confirmed[JANUS_RABBITMQ_MAX_CHANNELS+3];	/* Confirms per channel, when confirms are on */
 	gboolean janus_api_enabled;				/* Whether the Janus API via RabbitMQ is enabled */
 	amqp_bytes_t janus_exchange;			/* AMQP exchange for outgoing messages */
 	amqp_bytes_t to_janus_queue;			/* AMQP outgoing messages queue (Janus API) */
@@ -190,6 +199,20 @@ static gboolean declare_outgoing_queue = FALSE, declare_outgoing_queue_admin = F
 amqp_boolean_t queue_durable = 0, queue_exclusive = 0, queue_autodelete = 0,
 	queue_durable_admin = 0, queue_exclusive_admin = 0, queue_autodelete_admin = 0;
 static uint16_t heartbeat = 0;
+static int publish_channels = 4;
+static gboolean publisher_confirms = FALSE;
+
+/* Total number of publishes the broker hasn't confirmed yet (the caller
+ * must hold the client mutex, as the counters are updated under it) */
+static guint64 janus_rabbitmq_unconfirmed(janus_rabbitmq_client *client) {
+	guint64 total = 0;
+	int c = 0;
+	for(c = 0; c < publish_channels + 1; c++) {
+		amqp_channel_t channel = client->rmq_channel + 1 + c;
+		total += client->published[channel] - client->confirmed[channel];
+	}
+	return total;
+}
 
 /* Transport implementation */
 int janus_rabbitmq_init(janus_transport_callbacks *callback, const char *config_path) {
@@ -312,6 +335,19 @@ int janus_rabbitmq_init(janus_transport_callbacks *callback, const char *config_
 		heartbeat = 0;
 	}
 
+	/* Publish channel pool config */
+	item = janus_config_get(config, config_general, janus_config_type_item, "publish_channels");
+	if(item && item->value) {
+		publish_channels = atoi(item->value);
+		if(publish_channels < 1 || publish_channels > JANUS_RABBITMQ_MAX_CHANNELS) {
+			JANUS_LOG(LOG_ERR, "Invalid publish-channels value: %s (falling back to default)\n", item->value);
+			publish_channels = 4;
+		}
+	}
+	item = janus_config_get(config, config_general, janus_config_type_item, "publisher_confirms");
+	if(item && item->value)
+		publisher_confirms = janus_is_true(item->value);
+
 	/* Now check if the Janus API must be supported */
 	item = janus_config_get(config, config_general, janus_config_type_item, "enabled");
 	if(item == NULL) {
@@ -588,6 +624,31 @@ int janus_rabbitmq_connect(void) {
 		JANUS_LOG(LOG_FATAL, "Can't connect to RabbitMQ server: error opening channel... %s, %s\n", amqp_error_string2(result.library_error), amqp_method_name(result.reply.id));
 		return -1;
 	}
+	/* Open the round-robin pool of publish channels for events, plus the
+	 * dedicated channel API replies go out on (it's the last one we open) */
+	JANUS_LOG(LOG_VERB, "Opening %d publish channels...\n", publish_channels + 1);
+	int c = 0;
+	for(c = 0; c < publish_channels + 1; c++) {
+		amqp_channel_t channel = rmq_client->rmq_channel + 1 + c;
+		amqp_channel_open(rmq_client->rmq_conn, channel);
+		result = amqp_get_rpc_reply(rmq_client->rmq_conn);
+		if(result.reply_type != AMQP_RESPONSE_NORMAL) {
+			JANUS_LOG(LOG_FATAL, "Can't connect to RabbitMQ server: error opening channel... %s, %s\n", amqp_error_string2(result.library_error), amqp_method_name(result.reply.id));
+			return -1;
+		}
+		if(publisher_confirms) {
+			amqp_confirm_select(rmq_client->rmq_conn, channel);
+			result = amqp_get_rpc_reply(rmq_client->rmq_conn);
+			if(result.reply_type != AMQP_RESPONSE_NORMAL) {
+				JANUS_LOG(LOG_FATAL, "Can't connect to RabbitMQ server: error enabling publisher confirms... %s, %s\n", amqp_error_string2(result.library_error), amqp_method_name(result.reply.id));
+				return -1;
+			}
+		}
+		rmq_client->published[channel] = 0;
+		rmq_client->confirmed[channel] = 0;
+	}
+	rmq_client->reply_channel = rmq_client->rmq_channel + 1 + publish_channels;
+	rmq_client->next_channel = 0;
 	rmq_client->janus_exchange = amqp_empty_bytes;
 	if(janus_exchange != NULL) {
 		JANUS_LOG(LOG_VERB, "Declaring exchange...\n");
@@ -818,7 +879,12 @@ int janus_rabbitmq_send_message(janus_transport_session *transport, void *reques
 		return -1;
 	}
 	response->correlation_id = (char *)request_id;
-	g_async_queue_push(rmq_client->messages, response);
+	if(request_id != NULL) {
+		/* API replies skip whatever backlog of events may be queued */
+		g_async_queue_push_front(rmq_client->messages, response);
+	} else {
+		g_async_queue_push(rmq_client->messages, response);
+	}
 	return 0;
 }
 
@@ -966,6 +1032,29 @@ void *janus_rmq_in_thread(void *data) {
 		if(frame.frame_type != AMQP_FRAME_METHOD)
 			continue;
 		JANUS_LOG(LOG_VERB, "Method %s\n", amqp_method_name(frame.payload.method.id));
+		if(frame.payload.method.id == AMQP_BASIC_ACK_METHOD || frame.payload.method.id == AMQP_BASIC_NACK_METHOD) {
+			/* Publisher confirm on one of the publish channels: a single ack
+			 * with the multiple flag set covers a whole batch of publishes,
+			 * so all we do is update the cumulative per-channel counter */
+			uint64_t delivery_tag = 0;
+			amqp_boolean_t multiple = 0;
+			if(frame.payload.method.id == AMQP_BASIC_ACK_METHOD) {
+				amqp_basic_ack_t *ack = (amqp_basic_ack_t *)frame.payload.method.decoded;
+				delivery_tag = ack->delivery_tag;
+				multiple = ack->multiple;
+			} else {
+				amqp_basic_nack_t *nack = (amqp_basic_nack_t *)frame.payload.method.decoded;
+				delivery_tag = nack->delivery_tag;
+				multiple = nack->multiple;
+				JANUS_LOG(LOG_ERR, "Broker rejected publish #%"SCNu64" on channel %"SCNu16"\n", delivery_tag, frame.channel);
+			}
+			(void)multiple;	/* We only track the highest tag per channel, which covers batches too */
+			janus_mutex_lock(&rmq_client->mutex);
+			if(frame.channel < JANUS_RABBITMQ_MAX_CHANNELS+3 && delivery_tag > rmq_client->confirmed[frame.channel])
+				rmq_client->confirmed[frame.channel] = delivery_tag;
+			janus_mutex_unlock(&rmq_client->mutex);
+			continue;
+		}
 		gboolean admin = FALSE;
 		if(frame.payload.method.id == AMQP_BASIC_DELIVER_METHOD) {
 			amqp_basic_deliver_t *d = (amqp_basic_deliver_t *)frame.payload.method.decoded;
@@ -1067,11 +1156,32 @@ void *janus_rmq_out_thread(void *data) {
 			props._flags |= AMQP_BASIC_CONTENT_TYPE_FLAG;
 			props.content_type = amqp_cstring_bytes("application/json");
 			amqp_bytes_t message = amqp_cstring_bytes(payload_text);
-			int status = amqp_basic_publish(rmq_client->rmq_conn, rmq_client->rmq_channel, rmq_client->janus_exchange,
+			/* API replies go out on their own channel, so that a burst of
+			 * queued events can't delay them; events are spread round-robin
+			 * across the pool of publish channels instead */
+			amqp_channel_t channel = rmq_client->reply_channel;
+			if(response->correlation_id == NULL) {
+				channel = rmq_client->rmq_channel + 1 + rmq_client->next_channel;
+				rmq_client->next_channel = (rmq_client->next_channel + 1) % publish_channels;
+				if(publisher_confirms) {
+					/* Too many unconfirmed publishes? Wait for the broker to
+					 * catch up before handing it more events (confirms are
+					 * tallied in the in thread as the acks come in) */
+					while(!rmq_client->destroy && !g_atomic_int_get(&stopping) && rmq_client->connected &&
+							janus_rabbitmq_unconfirmed(rmq_client) >= JANUS_RABBITMQ_MAX_UNCONFIRMED) {
+						janus_mutex_unlock(&rmq_client->mutex);
+						g_usleep(1000);
+						janus_mutex_lock(&rmq_client->mutex);
+					}
+				}
+			}
+			int status = amqp_basic_publish(rmq_client->rmq_conn, channel, rmq_client->janus_exchange,
 				response->admin ? amqp_cstring_bytes(from_janus_admin) : amqp_cstring_bytes(from_janus),
 				0, 0, &props, message);
 			if(status != AMQP_STATUS_OK) {
 				JANUS_LOG(LOG_ERR, "Error publishing... %d, %s\n", status, amqp_error_string2(status));
+			} else if(publisher_confirms) {
+				rmq_client->published[channel]++;
 			}
 			janus_mutex_unlock(&rmq_client->mutex);
 		}
@@ -22,10 +22,26 @@
  * explicit request as the GET in the plain HTTP API. Closing a WebSocket
  * will also destroy all the sessions it created.
  *
+ * Besides JSON (text frames), clients can also talk CBOR (RFC 8949) on
+ * the same endpoints: sending a request in a binary WebSocket frame,
+ * encoded as a CBOR map, switches the connection to CBOR, and all the
+ * following responses, events and notifications to that client will be
+ * binary frames encoded the same way. The encoding is negotiated per
+ * connection, so different clients can mix and match.
+ *
  * \ingroup transports
  * \ref transports
  */
 
+#ifdef __linux__
+/* Needed for pthread_setaffinity_np and CPU_SET */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <sched.h>
+#include <pthread.h>
+#endif
+
 #include "transport.h"
 
 #include <arpa/inet.h>
@@ -34,6 +50,8 @@
 
 #include <libwebsockets.h>
 
+#include "janus_cbor.h"
+
 #include "../debug.h"
 #include "../apierror.h"
 #include "../config.h"
@@ -108,6 +126,9 @@ static janus_transport_callbacks *gateway = NULL;
 static gboolean ws_janus_api_enabled = FALSE;
 static gboolean ws_admin_api_enabled = FALSE;
 static gboolean notify_events = TRUE;
+/* How long we're willing to defer writes (in microseconds) to coalesce more
+ * outgoing messages in a single writeable callback (0 = write right away) */
+static guint64 ws_batch_delay = 0;
 
 /* Clients maps */
 #if (LWS_LIBRARY_VERSION_MAJOR >= 3)
@@ -173,24 +194,119 @@ static void janus_websockets_log_emit_function(int level, const char *line) {
 	JANUS_LOG(LOG_INFO, "[libwebsockets][%s] %s", janus_websockets_get_level_str(level), line);
 }
 
-/* WebSockets service thread */
-static GThread *ws_thread = NULL;
+/* WebSockets service threads: by default connections are all serviced by a
+ * single thread, but when lws is built with SMP support (LWS_MAX_SMP > 1)
+ * more can be configured, in which case lws shards the connections across
+ * them; a connection always stays on the thread that accepted it, so the
+ * ordering of the messages of a session is never affected */
+static int ws_service_threads = 1;
+static GThread **ws_threads_pool = NULL;
 void *janus_websockets_thread(void *data);
+/* Optional set of CPU cores to pin the service threads to,
+ * as configured via the threads_affinity property */
+static int *ws_threads_cores = NULL;
+static guint ws_threads_cores_num = 0;
+static void janus_websockets_parse_affinity(const char *cores) {
+	if(cores == NULL || *cores == '\0')
+		return;
+#ifndef __linux__
+	JANUS_LOG(LOG_WARN, "CPU affinity for the service threads is only supported on Linux, ignoring '%s'\n", cores);
+	return;
+#else
+	/* Parse a comma-separated list of cores and/or ranges, e.g., "0,2,4-7" */
+	GArray *list = g_array_new(FALSE, FALSE, sizeof(int));
+	gchar **tokens = g_strsplit(cores, ",", -1);
+	int i = 0;
+	for(i=0; tokens[i] != NULL; i++) {
+		char *token = g_strstrip(tokens[i]);
+		if(*token == '\0')
+			continue;
+		char *dash = strchr(token, '-');
+		int from = -1, to = -1;
+		if(dash != NULL) {
+			*dash = '\0';
+			from = atoi(token);
+			to = atoi(dash+1);
+		} else {
+			from = to = atoi(token);
+		}
+		if(from < 0 || to < from || to >= CPU_SETSIZE) {
+			JANUS_LOG(LOG_WARN, "Invalid core or range in threads affinity ('%s'), ignoring the whole setting\n", cores);
+			g_strfreev(tokens);
+			g_array_free(list, TRUE);
+			return;
+		}
+		int core = 0;
+		for(core=from; core<=to; core++)
+			g_array_append_val(list, core);
+	}
+	g_strfreev(tokens);
+	if(list->len == 0) {
+		g_array_free(list, TRUE);
+		return;
+	}
+	ws_threads_cores_num = list->len;
+	ws_threads_cores = (int *)g_array_free(list, FALSE);
+	JANUS_LOG(LOG_INFO, "WebSockets service threads will be pinned to %u CPU core(s) (%s)\n",
+		ws_threads_cores_num, cores);
+#endif
+}
 
 
+/* Outgoing message, as queued for a client: we queue the Jansson value
+ * itself, rather than a serialized copy, since the writeable callback
+ * serializes directly into the shared per-connection buffer */
+typedef struct janus_websockets_message {
+	json_t *message;						/* The message to serialize and send */
+	gboolean binary;						/* Whether it should be serialized to CBOR (binary frame) or JSON (text frame) */
+} janus_websockets_message;
+static void janus_websockets_message_free(janus_websockets_message *message) {
+	if(message == NULL)
+		return;
+	json_decref(message->message);
+	g_free(message);
+}
+
 /* WebSocket client session */
 typedef struct janus_websockets_client {
 	struct lws *wsi;						/* The libwebsockets client instance */
 	GAsyncQueue *messages;					/* Queue of outgoing messages to push */
 	char *incoming;							/* Buffer containing the incoming message to process (in case there are fragments) */
+	size_t incominglen;						/* How much of the incoming buffer is filled so far (CBOR can contain NUL bytes) */
+	gboolean incomingbinary;				/* Whether the message being reassembled arrived in a binary frame */
+	gboolean binary;						/* Whether this client negotiated CBOR, and so should get binary responses */
 	unsigned char *buffer;					/* Buffer containing the message to send */
 	size_t buflen;								/* Length of the buffer (may be resized after re-allocations) */
 	size_t bufpending;							/* Data an interrupted previous write couldn't send */
 	size_t bufoffset;							/* Offset from where the interrupted previous write should resume */
+	gboolean bufbinary;						/* Whether the message being written should go out in binary frames */
 	volatile gint destroyed;				/* Whether this libwebsockets client instance has been closed */
 	janus_transport_session *ts;			/* Janus core-transport session */
 } janus_websockets_client;
 
+/* Sink json_dump_callback/janus_cbor_dump_callback write to when we
+ * serialize an outgoing message: it grows the client's shared buffer as
+ * needed and appends there directly, so that large responses are never
+ * serialized to an intermediate string first */
+typedef struct janus_websockets_dump_state {
+	janus_websockets_client *client;		/* The client we're serializing for */
+	size_t offset;							/* Where in the shared buffer we're writing (starts past LWS_PRE) */
+} janus_websockets_dump_state;
+static int janus_websockets_dump_sink(const char *buffer, size_t size, void *data) {
+	janus_websockets_dump_state *state = (janus_websockets_dump_state *)data;
+	janus_websockets_client *client = state->client;
+	if(state->offset + size > client->buflen) {
+		size_t buflen = client->buflen ? client->buflen : 1024;
+		while(state->offset + size > buflen)
+			buflen *= 2;
+		client->buffer = g_realloc(client->buffer, buflen);
+		client->buflen = buflen;
+	}
+	memcpy(client->buffer + state->offset, buffer, size);
+	state->offset += size;
+	return 0;
+}
+
 
 /* libwebsockets WS context */
 static struct lws_context *wsc = NULL;
@@ -632,6 +748,40 @@ int janus_websockets_init(janus_transport_callbacks *callback, const char *confi
 		JANUS_LOG(LOG_INFO, "libwebsockets logging: %d\n", ws_log_level);
 		lws_set_log_level(ws_log_level, janus_websockets_log_emit_function);
 
+		/* Should we defer writes a bit, to coalesce bursts of small messages? */
+		item = janus_config_get(config, config_general, janus_config_type_item, "batch_delay");
+		if(item && item->value) {
+			int bd = atoi(item->value);
+			if(bd < 0) {
+				JANUS_LOG(LOG_ERR, "Invalid batch_delay (%d), ignoring...\n", bd);
+			} else {
+				ws_batch_delay = (guint64)bd * 1000;	/* Milliseconds to microseconds */
+#if !((LWS_LIBRARY_VERSION_MAJOR == 3 && LWS_LIBRARY_VERSION_MINOR >= 2) || (LWS_LIBRARY_VERSION_MAJOR > 3))
+				if(ws_batch_delay > 0) {
+					JANUS_LOG(LOG_WARN, "batch_delay needs libwebsockets >= 3.2, writing as soon as possible instead\n");
+					ws_batch_delay = 0;
+				}
+#endif
+			}
+		}
+
+		/* How many threads should lws service connections with? */
+		item = janus_config_get(config, config_general, janus_config_type_item, "threads");
+		if(item && item->value) {
+			ws_service_threads = atoi(item->value);
+			if(ws_service_threads < 1) {
+				JANUS_LOG(LOG_ERR, "Invalid threads (%s), falling back to 1\n", item->value);
+				ws_service_threads = 1;
+			} else if(ws_service_threads > LWS_MAX_SMP) {
+				JANUS_LOG(LOG_WARN, "This libwebsockets build only supports up to %d service thread(s) (LWS_MAX_SMP), lowering threads accordingly\n", LWS_MAX_SMP);
+				ws_service_threads = LWS_MAX_SMP;
+			}
+		}
+		/* Any CPU cores we should pin the service threads to? */
+		item = janus_config_get(config, config_general, janus_config_type_item, "threads_affinity");
+		if(item && item->value)
+			janus_websockets_parse_affinity(item->value);
+
 		/* Any ACL for either the Janus or Admin API? */
 		item = janus_config_get(config, config_general, janus_config_type_item, "ws_acl");
 		if(item && item->value) {
@@ -737,8 +887,9 @@ int janus_websockets_init(janus_transport_callbacks *callback, const char *confi
 		}
 #endif
 #endif
-		/* Force single-thread server */
-		wscinfo.count_threads = 1;
+		/* How many service threads lws should shard connections across
+		 * (1 by default, more need an SMP-enabled libwebsockets build) */
+		wscinfo.count_threads = ws_service_threads;
 
 		/* Create the base context */
 		wsc = lws_create_context(&wscinfo);
@@ -777,15 +928,21 @@ int janus_websockets_init(janus_transport_callbacks *callback, const char *confi
 	g_atomic_int_set(&initialized, 1);
 
 	GError *error = NULL;
-	/* Start the WebSocket service thread */
+	/* Start the WebSocket service thread(s) */
 	if(ws_janus_api_enabled || ws_admin_api_enabled) {
-		ws_thread = g_thread_try_new("ws thread", &janus_websockets_thread, wsc, &error);
-		if(error != NULL) {
-			g_atomic_int_set(&initialized, 0);
-			JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the WebSockets thread...\n",
-				error->code, error->message ? error->message : "??");
-			g_error_free(error);
-			return -1;
+		ws_threads_pool = g_malloc0(ws_service_threads * sizeof(GThread *));
+		int i = 0;
+		for(i=0; i<ws_service_threads; i++) {
+			char tname[16];
+			g_snprintf(tname, sizeof(tname), "ws thread %d", i);
+			ws_threads_pool[i] = g_thread_try_new(tname, &janus_websockets_thread, GINT_TO_POINTER(i), &error);
+			if(error != NULL) {
+				g_atomic_int_set(&initialized, 0);
+				JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the WebSockets thread...\n",
+					error->code, error->message ? error->message : "??");
+				g_error_free(error);
+				return -1;
+			}
 		}
 	}
 
@@ -802,11 +959,18 @@ void janus_websockets_destroy(void) {
 	lws_cancel_service(wsc);
 #endif
 
-	/* Stop the service thread */
-	if(ws_thread != NULL) {
-		g_thread_join(ws_thread);
-		ws_thread = NULL;
+	/* Stop the service thread(s) */
+	if(ws_threads_pool != NULL) {
+		int i = 0;
+		for(i=0; i<ws_service_threads; i++) {
+			if(ws_threads_pool[i] != NULL)
+				g_thread_join(ws_threads_pool[i]);
+		}
+		g_free(ws_threads_pool);
+		ws_threads_pool = NULL;
 	}
+	g_free(ws_threads_cores);
+	ws_threads_cores = NULL;
 
 	/* Destroy the context */
 	if(wsc != NULL) {
@@ -857,15 +1021,16 @@ static void janus_websockets_destroy_client(
 	ws_client->ts->transport_p = NULL;
 	/* Remove messages queue too, if needed */
 	if(ws_client->messages != NULL) {
-		char *response = NULL;
+		janus_websockets_message *response = NULL;
 		while((response = g_async_queue_try_pop(ws_client->messages)) != NULL) {
-			g_free(response);
+			janus_websockets_message_free(response);
 		}
 		g_async_queue_unref(ws_client->messages);
 	}
 	/* ... and the shared buffers */
 	g_free(ws_client->incoming);
 	ws_client->incoming = NULL;
+	ws_client->incominglen = 0;
 	g_free(ws_client->buffer);
 	ws_client->buffer = NULL;
 	ws_client->buflen = 0;
@@ -928,15 +1093,20 @@ int janus_websockets_send_message(janus_transport_session *transport, void *requ
 		janus_mutex_unlock(&transport->mutex);
 		return -1;
 	}
-	/* Convert to string and enqueue */
-	char *payload = json_dumps(message, json_format);
-	if(payload == NULL) {
-		JANUS_LOG(LOG_ERR, "Failed to stringify message...\n");
-		json_decref(message);
+	/* Enqueue the message: the writeable callback will serialize it (to
+	 * CBOR or JSON, depending on what the client negotiated) straight
+	 * into the shared per-connection buffer, with no intermediate copy */
+	janus_websockets_message *response = g_malloc(sizeof(janus_websockets_message));
+	response->message = message;
+	response->binary = client->binary;
+	g_async_queue_push(client->messages, response);
+	if(g_async_queue_length(client->messages) > 1) {
+		/* A wakeup was already scheduled for the messages in the queue, and
+		 * the writeable callback drains the whole queue: no need to wake the
+		 * event loop again, this message will tag along */
 		janus_mutex_unlock(&transport->mutex);
-		return -1;
+		return 0;
 	}
-	g_async_queue_push(client->messages, payload);
 #if (LWS_LIBRARY_VERSION_MAJOR >= 3)
 	/* On libwebsockets >= 3.x we use lws_cancel_service */
 	janus_mutex_lock(&writable_mutex);
@@ -951,7 +1121,6 @@ int janus_websockets_send_message(janus_transport_session *transport, void *requ
 	janus_mutex_unlock(&writable_mutex);
 #endif
 	janus_mutex_unlock(&transport->mutex);
-	json_decref(message);
 	return 0;
 }
 
@@ -1105,23 +1274,38 @@ plugin_response:
 
 /* Thread */
 void *janus_websockets_thread(void *data) {
-	struct lws_context *service = (struct lws_context *)data;
+	int tsi = GPOINTER_TO_INT(data);
+	struct lws_context *service = wsc;
 	if(service == NULL) {
 		JANUS_LOG(LOG_ERR, "Invalid service\n");
 		return NULL;
 	}
 
-	JANUS_LOG(LOG_INFO, "WebSockets thread started\n");
+	JANUS_LOG(LOG_INFO, "WebSockets thread #%d started\n", tsi);
+#ifdef __linux__
+	if(ws_threads_cores_num > 0) {
+		/* Pin this thread to one of the configured cores, round robin */
+		int core = ws_threads_cores[tsi % ws_threads_cores_num];
+		cpu_set_t cpuset;
+		CPU_ZERO(&cpuset);
+		CPU_SET(core, &cpuset);
+		if(pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset) != 0) {
+			JANUS_LOG(LOG_WARN, "Error pinning WebSockets thread #%d to core %d\n", tsi, core);
+		} else {
+			JANUS_LOG(LOG_VERB, "WebSockets thread #%d pinned to core %d\n", tsi, core);
+		}
+	}
+#endif
 
 	while(g_atomic_int_get(&initialized) && !g_atomic_int_get(&stopping)) {
-		/* libwebsockets is single thread, we cycle through events here */
-		lws_service(service, 50);
+		/* Cycle through the events of the connections sharded on this thread */
+		lws_service_tsi(service, 50, tsi);
 	}
 
 	/* Get rid of the WebSockets server */
 	lws_cancel_service(service);
 	/* Done */
-	JANUS_LOG(LOG_INFO, "WebSockets thread ended\n");
+	JANUS_LOG(LOG_INFO, "WebSockets thread #%d ended\n", tsi);
 	return NULL;
 }
 
@@ -1211,10 +1395,15 @@ static int janus_websockets_common_callback(
 			/* Prepare the session */
 			ws_client->wsi = wsi;
 			ws_client->messages = g_async_queue_new();
+			ws_client->incoming = NULL;
+			ws_client->incominglen = 0;
+			ws_client->incomingbinary = FALSE;
+			ws_client->binary = FALSE;
 			ws_client->buffer = NULL;
 			ws_client->buflen = 0;
 			ws_client->bufpending = 0;
 			ws_client->bufoffset = 0;
+			ws_client->bufbinary = FALSE;
 			g_atomic_int_set(&ws_client->destroyed, 0);
 			ws_client->ts = janus_transport_session_create(ws_client, NULL);
 #if (LWS_LIBRARY_VERSION_MAJOR >= 3)
@@ -1312,26 +1501,55 @@ static int janus_websockets_common_callback(
 			const size_t remaining = lws_remaining_packet_payload(wsi);
 			if(ws_client->incoming == NULL) {
 				JANUS_LOG(LOG_HUGE, "[%s-%p] First fragment: %zu bytes, %zu remaining\n", log_prefix, wsi, len, remaining);
+				/* Binary frames are how clients address us in CBOR */
+				ws_client->incomingbinary = lws_frame_is_binary(wsi);
 				ws_client->incoming = g_malloc(len+1);
 				memcpy(ws_client->incoming, in, len);
 				incoming_length = len;
 				ws_client->incoming[incoming_length] = '\0';
-				JANUS_LOG(LOG_HUGE, "%s\n", ws_client->incoming);
+				if(!ws_client->incomingbinary)
+					JANUS_LOG(LOG_HUGE, "%s\n", ws_client->incoming);
 			} else {
-				size_t offset = strlen(ws_client->incoming);
+				size_t offset = ws_client->incominglen;
 				JANUS_LOG(LOG_HUGE, "[%s-%p] Appending fragment: offset %zu, %zu bytes, %zu remaining\n", log_prefix, wsi, offset, len, remaining);
 				ws_client->incoming = g_realloc(ws_client->incoming, offset+len+1);
 				memcpy(ws_client->incoming+offset, in, len);
 				incoming_length = offset+len;
 				ws_client->incoming[incoming_length] = '\0';
-				JANUS_LOG(LOG_HUGE, "%s\n", ws_client->incoming+offset);
+				if(!ws_client->incomingbinary)
+					JANUS_LOG(LOG_HUGE, "%s\n", ws_client->incoming+offset);
 			}
+			ws_client->incominglen = incoming_length;
 			if(remaining > 0 || !lws_is_final_fragment(wsi)) {
 				/* Still waiting for some more fragments */
 				JANUS_LOG(LOG_HUGE, "[%s-%p] Waiting for more fragments\n", log_prefix, wsi);
 				return 0;
 			}
 			JANUS_LOG(LOG_HUGE, "[%s-%p] Done, parsing message: %zu bytes\n", log_prefix, wsi, incoming_length);
+			if(ws_client->incomingbinary) {
+				/* Binary frame: parse the CBOR payload (one message per frame) */
+				json_t *message = janus_cbor_decode(ws_client->incoming, incoming_length);
+				if(message != NULL) {
+					if(!ws_client->binary) {
+						/* The client speaks CBOR: switch the connection to
+						 * binary, all our responses will be CBOR too */
+						JANUS_LOG(LOG_VERB, "[%s-%p] Client negotiated the CBOR encoding\n", log_prefix, wsi);
+						ws_client->binary = TRUE;
+					}
+					/* Notify the core */
+					gateway->incoming_request(&janus_websockets_transport, ws_client->ts, NULL, admin, message, NULL);
+				} else {
+					/* Notify the core, passing an error since we have no message */
+					json_error_t error;
+					memset(&error, 0, sizeof(error));
+					g_snprintf(error.text, sizeof(error.text), "Invalid CBOR payload");
+					gateway->incoming_request(&janus_websockets_transport, ws_client->ts, NULL, admin, NULL, &error);
+				}
+				g_free(ws_client->incoming);
+				ws_client->incoming = NULL;
+				ws_client->incominglen = 0;
+				return 0;
+			}
 			/* If we got here, the message is complete: parse the JSON payload */
 			const char *incoming_curr = ws_client->incoming;
 			const char *incoming_end = ws_client->incoming + incoming_length;
@@ -1384,6 +1602,7 @@ static int janus_websockets_common_callback(
 			g_free(message_buffer);
 			g_free(ws_client->incoming);
 			ws_client->incoming = NULL;
+			ws_client->incominglen = 0;
 			return 0;
 		}
 #if (LWS_LIBRARY_VERSION_MAJOR >= 3)
@@ -1398,12 +1617,27 @@ static int janus_websockets_common_callback(
 				janus_websockets_client *client = value;
 				if(client == NULL || client->wsi == NULL)
 					continue;
+#if (LWS_LIBRARY_VERSION_MAJOR == 3 && LWS_LIBRARY_VERSION_MINOR >= 2) || (LWS_LIBRARY_VERSION_MAJOR > 3)
+				if(ws_batch_delay > 0) {
+					/* Defer the write a bit, to let more messages pile up
+					 * and be coalesced in the same writeable callback */
+					lws_set_timer_usecs(client->wsi, ws_batch_delay);
+					continue;
+				}
+#endif
 				lws_callback_on_writable(client->wsi);
 			}
 			g_hash_table_remove_all(writable_clients);
 			janus_mutex_unlock(&writable_mutex);
 			return 0;
 		}
+#endif
+#if (LWS_LIBRARY_VERSION_MAJOR == 3 && LWS_LIBRARY_VERSION_MINOR >= 2) || (LWS_LIBRARY_VERSION_MAJOR > 3)
+		case LWS_CALLBACK_TIMER: {
+			/* The coalescing window is over, time to actually write */
+			lws_callback_on_writable(wsi);
+			return 0;
+		}
 #endif
 		case LWS_CALLBACK_SERVER_WRITEABLE: {
 			if(ws_client == NULL || ws_client->wsi == NULL) {
@@ -1413,87 +1647,95 @@ static int janus_websockets_common_callback(
 			if(!g_atomic_int_get(&ws_client->destroyed) && !g_atomic_int_get(&stopping)) {
 				janus_mutex_lock(&ws_client->ts->mutex);
 
-				/* Check if Websockets send pipe is choked */
-				if(lws_send_pipe_choked(wsi)) {
-					if(ws_client->buffer && ws_client->bufpending > 0 && ws_client->bufoffset > 0) {
-						JANUS_LOG(LOG_WARN, "Websockets choked with buffer: %zu, trying again\n", ws_client->bufpending);
-						lws_callback_on_writable(wsi);
-					} else {
-						gint qlen = g_async_queue_length(ws_client->messages);
-						JANUS_LOG(LOG_WARN, "Websockets choked with queue: %d, trying again\n", qlen);
-						if(qlen > 0) {
+				/* Shoot all the pending messages: we keep writing until the pipe
+				 * chokes or there's nothing left to send, so that a single
+				 * writeable callback can flush a whole burst of small events */
+				while(TRUE) {
+					/* Check if Websockets send pipe is choked */
+					if(lws_send_pipe_choked(wsi)) {
+						if(ws_client->buffer && ws_client->bufpending > 0 && ws_client->bufoffset > 0) {
+							JANUS_LOG(LOG_WARN, "Websockets choked with buffer: %zu, trying again\n", ws_client->bufpending);
 							lws_callback_on_writable(wsi);
+						} else {
+							gint qlen = g_async_queue_length(ws_client->messages);
+							JANUS_LOG(LOG_WARN, "Websockets choked with queue: %d, trying again\n", qlen);
+							if(qlen > 0) {
+								lws_callback_on_writable(wsi);
+							}
 						}
-					}
-					janus_mutex_unlock(&ws_client->ts->mutex);
-					return 0;
-				}
-
-				/* Check if we have a pending/partial write to complete first */
-				if(ws_client->buffer && ws_client->bufpending > 0 && ws_client->bufoffset > 0) {
-					JANUS_LOG(LOG_HUGE, "[%s-%p] Completing pending WebSocket write (still need to write last %zu bytes)...\n",
-						log_prefix, wsi, ws_client->bufpending);
-				} else {
-					/* Shoot all the pending messages */
-					char *response = g_async_queue_try_pop(ws_client->messages);
-					if (!response) {
-						/* No messages found */
 						janus_mutex_unlock(&ws_client->ts->mutex);
 						return 0;
 					}
+
+					/* Check if we have a pending/partial write to complete first */
+					if(ws_client->buffer && ws_client->bufpending > 0 && ws_client->bufoffset > 0) {
+						JANUS_LOG(LOG_HUGE, "[%s-%p] Completing pending WebSocket write (still need to write last %zu bytes)...\n",
+							log_prefix, wsi, ws_client->bufpending);
+					} else {
+						/* Get the next message from the queue */
+						janus_websockets_message *response = g_async_queue_try_pop(ws_client->messages);
+						if (!response) {
+							/* No messages left, we're done for this round */
+							janus_mutex_unlock(&ws_client->ts->mutex);
+							return 0;
+						}
+						if (g_atomic_int_get(&ws_client->destroyed) || g_atomic_int_get(&stopping)) {
+							janus_websockets_message_free(response);
+							janus_mutex_unlock(&ws_client->ts->mutex);
+							return 0;
+						}
+						/* Gotcha! Serialize the message straight into the shared
+						 * buffer (past the LWS_PRE padding), growing it if needed */
+						janus_websockets_dump_state state = { .client = ws_client, .offset = LWS_PRE };
+						int res = 0;
+						if(response->binary)
+							res = janus_cbor_dump_callback(response->message, janus_websockets_dump_sink, &state);
+						else
+							res = json_dump_callback(response->message, janus_websockets_dump_sink, &state, json_format);
+						ws_client->bufbinary = response->binary;
+						/* We can get rid of the message */
+						janus_websockets_message_free(response);
+						if(res < 0) {
+							JANUS_LOG(LOG_ERR, "[%s-%p] Failed to serialize message, skipping it...\n", log_prefix, wsi);
+							continue;
+						}
+						JANUS_LOG(LOG_HUGE, "[%s-%p] Sending WebSocket message (%zu bytes)...\n", log_prefix, wsi, state.offset - LWS_PRE);
+						/* Initialize pending bytes count and buffer offset */
+						ws_client->bufpending = state.offset - LWS_PRE;
+						ws_client->bufoffset = LWS_PRE;
+					}
+
 					if (g_atomic_int_get(&ws_client->destroyed) || g_atomic_int_get(&stopping)) {
-						free(response);
 						janus_mutex_unlock(&ws_client->ts->mutex);
 						return 0;
 					}
-					/* Gotcha! */
-					JANUS_LOG(LOG_HUGE, "[%s-%p] Sending WebSocket message (%zu bytes)...\n", log_prefix, wsi, strlen(response));
-					size_t buflen = LWS_PRE + strlen(response);
-					if (buflen > ws_client->buflen) {
-						/* We need a larger shared buffer */
-						JANUS_LOG(LOG_HUGE, "[%s-%p] Re-allocating to %zu bytes (was %zu, response is %zu bytes)\n", log_prefix, wsi, buflen, ws_client->buflen, strlen(response));
-						ws_client->buflen = buflen;
-						ws_client->buffer = g_realloc(ws_client->buffer, buflen);
-					}
-					memcpy(ws_client->buffer + LWS_PRE, response, strlen(response));
-					/* Initialize pending bytes count and buffer offset */
-					ws_client->bufpending = strlen(response);
-					ws_client->bufoffset = LWS_PRE;
-					/* We can get rid of the message */
-					free(response);
-				}
-
-				if (g_atomic_int_get(&ws_client->destroyed) || g_atomic_int_get(&stopping)) {
-					janus_mutex_unlock(&ws_client->ts->mutex);
-					return 0;
-				}
 
-				/* Evaluate amount of data to send according to MESSAGE_CHUNK_SIZE */
-				int amount = ws_client->bufpending <= MESSAGE_CHUNK_SIZE ? ws_client->bufpending : MESSAGE_CHUNK_SIZE;
-				/* Set fragment flags */
-				int flags = lws_write_ws_flags(LWS_WRITE_TEXT, ws_client->bufoffset == LWS_PRE, ws_client->bufpending <= (size_t)amount);
-				/* Send the fragment with proper flags */
-				int sent = lws_write(wsi, ws_client->buffer + ws_client->bufoffset, (size_t)amount, flags);
-				JANUS_LOG(LOG_HUGE, "[%s-%p]   -- First=%d, Last=%d, Requested=%d bytes, Sent=%d bytes, Missing=%zu bytes\n", log_prefix, wsi, ws_client->bufoffset <= LWS_PRE, ws_client->bufpending <= (size_t)amount, amount, sent, ws_client->bufpending - amount);
-				if(sent < amount) {
-					/* Error on sending, abort operation */
-					JANUS_LOG(LOG_ERR, "Websocket sent only %d bytes (expected %d)\n", sent, amount);
-					ws_client->bufpending = 0;
-					ws_client->bufoffset = 0;
-				} else {
-					/* Fragment successfully sent, update status */
-					ws_client->bufpending -= amount;
-					ws_client->bufoffset += amount;
-					if(ws_client->bufpending > 0) {
-						/* We couldn't send everything in a single write, we'll complete this in the next round */
-						JANUS_LOG(LOG_HUGE, "[%s-%p]   -- Couldn't write all bytes (%zu missing), setting offset %zu\n",
-							log_prefix, wsi, ws_client->bufpending, ws_client->bufoffset);
+					/* Evaluate amount of data to send according to MESSAGE_CHUNK_SIZE */
+					int amount = ws_client->bufpending <= MESSAGE_CHUNK_SIZE ? ws_client->bufpending : MESSAGE_CHUNK_SIZE;
+					/* Set fragment flags */
+					int flags = lws_write_ws_flags(ws_client->bufbinary ? LWS_WRITE_BINARY : LWS_WRITE_TEXT,
+						ws_client->bufoffset == LWS_PRE, ws_client->bufpending <= (size_t)amount);
+					/* Send the fragment with proper flags */
+					int sent = lws_write(wsi, ws_client->buffer + ws_client->bufoffset, (size_t)amount, flags);
+					JANUS_LOG(LOG_HUGE, "[%s-%p]   -- First=%d, Last=%d, Requested=%d bytes, Sent=%d bytes, Missing=%zu bytes\n", log_prefix, wsi, ws_client->bufoffset <= LWS_PRE, ws_client->bufpending <= (size_t)amount, amount, sent, ws_client->bufpending - amount);
+					if(sent < amount) {
+						/* Error on sending, abort operation */
+						JANUS_LOG(LOG_ERR, "Websocket sent only %d bytes (expected %d)\n", sent, amount);
+						ws_client->bufpending = 0;
+						ws_client->bufoffset = 0;
+					} else {
+						/* Fragment successfully sent, update status */
+						ws_client->bufpending -= amount;
+						ws_client->bufoffset += amount;
+						if(ws_client->bufpending > 0) {
+							/* We couldn't send everything in a single write, we'll complete this in the next round */
+							JANUS_LOG(LOG_HUGE, "[%s-%p]   -- Couldn't write all bytes (%zu missing), setting offset %zu\n",
+								log_prefix, wsi, ws_client->bufpending, ws_client->bufoffset);
+						}
 					}
+					/* Done with this fragment: keep going with the rest of this
+					 * message, or the next one in the queue, until we choke */
 				}
-				/* Done for this round, check the next response/notification later */
-				lws_callback_on_writable(wsi);
-				janus_mutex_unlock(&ws_client->ts->mutex);
-				return 0;
 			}
 			return 0;
 		}
@@ -34,6 +34,22 @@ static gboolean api_http_get = FALSE;
 static uint api_timeout;
 static janus_mutex api_mutex = JANUS_MUTEX_INITIALIZER;
 
+/* Credentials are cached per user, with a validity derived from the TTL
+ * the backend returned: as long as the cache is warm, ICE setup is served
+ * from here without any blocking HTTP request, and credentials getting
+ * close to their TTL are refreshed by a background thread while we keep
+ * serving the cached ones. The blocking request only happens on a cold
+ * cache (first handle for a user, or expired credentials) */
+typedef struct janus_turnrest_cached {
+	char *user;							/* User these credentials belong to ("" when none was provided) */
+	janus_turnrest_response *response;	/* The cached credentials themselves */
+	gint64 expires;						/* When these credentials stop being valid */
+	gint64 refresh;						/* When we should start refreshing them in the background */
+	volatile gint refreshing;			/* Whether a refresh is already in progress */
+} janus_turnrest_cached;
+static GHashTable *credentials = NULL;
+static janus_mutex cache_mutex = JANUS_MUTEX_INITIALIZER;
+
 
 /* Buffer we use to receive the response via libcurl */
 typedef struct janus_turnrest_buffer {
@@ -56,14 +72,32 @@ static size_t janus_turnrest_callback(void *payload, size_t size, size_t nmemb,
 }
 
 
+static void janus_turnrest_cached_destroy(gpointer data) {
+	janus_turnrest_cached *cached = (janus_turnrest_cached *)data;
+	if(cached == NULL)
+		return;
+	g_free(cached->user);
+	janus_turnrest_response_destroy(cached->response);
+	g_free(cached);
+}
+
 void janus_turnrest_init(void) {
 	/* Initialize libcurl, needed for contacting the TURN REST API backend */
 	curl_global_init(CURL_GLOBAL_ALL);
+	/* Initialize the credentials cache too */
+	janus_mutex_lock(&cache_mutex);
+	credentials = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, janus_turnrest_cached_destroy);
+	janus_mutex_unlock(&cache_mutex);
 }
 
 void janus_turnrest_deinit(void) {
 	/* Cleanup the libcurl initialization */
 	curl_global_cleanup();
+	janus_mutex_lock(&cache_mutex);
+	if(credentials != NULL)
+		g_hash_table_destroy(credentials);
+	credentials = NULL;
+	janus_mutex_unlock(&cache_mutex);
 	janus_mutex_lock(&api_mutex);
 	g_free((char *)api_server);
 	g_free((char *)api_key);
@@ -97,6 +131,11 @@ void janus_turnrest_set_backend(const char *server, const char *key, const char
 		api_timeout = timeout;
 	}
 	janus_mutex_unlock(&api_mutex);
+	/* Flush the credentials cache, as it refers to the old backend */
+	janus_mutex_lock(&cache_mutex);
+	if(credentials != NULL)
+		g_hash_table_remove_all(credentials);
+	janus_mutex_unlock(&cache_mutex);
 }
 
 const char *janus_turnrest_get_backend(void) {
@@ -120,7 +159,8 @@ void janus_turnrest_response_destroy(janus_turnrest_response *response) {
 	g_free(response);
 }
 
-janus_turnrest_response *janus_turnrest_request(const char *user) {
+/* Helper to actually contact the backend (the blocking HTTP request) */
+static janus_turnrest_response *janus_turnrest_do_request(const char *user) {
 	janus_mutex_lock(&api_mutex);
 	if(api_server == NULL) {
 		janus_mutex_unlock(&api_mutex);
@@ -300,4 +340,112 @@ janus_turnrest_response *janus_turnrest_request(const char *user) {
 	return response;
 }
 
+/* Helper to duplicate a response, since callers destroy what we return
+ * and the cache needs to keep its own copy around */
+static janus_turnrest_response *janus_turnrest_response_copy(janus_turnrest_response *response) {
+	janus_turnrest_response *copy = g_malloc(sizeof(janus_turnrest_response));
+	copy->username = g_strdup(response->username);
+	copy->password = g_strdup(response->password);
+	copy->ttl = response->ttl;
+	copy->servers = NULL;
+	GList *item = response->servers;
+	while(item != NULL) {
+		janus_turnrest_instance *instance = (janus_turnrest_instance *)item->data;
+		janus_turnrest_instance *ic = g_malloc(sizeof(janus_turnrest_instance));
+		ic->server = g_strdup(instance->server);
+		ic->port = instance->port;
+		ic->transport = instance->transport;
+		copy->servers = g_list_append(copy->servers, ic);
+		item = item->next;
+	}
+	return copy;
+}
+
+/* Helper to cache freshly obtained credentials for a user */
+static void janus_turnrest_cache_response(const char *user, janus_turnrest_response *response) {
+	if(response->ttl == 0) {
+		/* The backend didn't return a TTL, we can't know how long these
+		 * credentials will stay valid, so we don't cache them at all */
+		return;
+	}
+	gint64 now = janus_get_monotonic_time();
+	janus_turnrest_cached *cached = g_malloc(sizeof(janus_turnrest_cached));
+	cached->user = g_strdup(user ? user : "");
+	cached->response = janus_turnrest_response_copy(response);
+	cached->expires = now + (gint64)response->ttl * G_USEC_PER_SEC;
+	/* Start refreshing in the background once 75% of the TTL is gone */
+	cached->refresh = now + ((gint64)response->ttl * G_USEC_PER_SEC / 4) * 3;
+	g_atomic_int_set(&cached->refreshing, 0);
+	janus_mutex_lock(&cache_mutex);
+	if(credentials != NULL)
+		g_hash_table_replace(credentials, cached->user, cached);
+	else
+		janus_turnrest_cached_destroy(cached);
+	janus_mutex_unlock(&cache_mutex);
+}
+
+/* Background refresh of credentials that are getting close to their TTL */
+static gpointer janus_turnrest_refresh_thread(gpointer data) {
+	char *user = (char *)data;
+	JANUS_LOG(LOG_VERB, "Refreshing TURN REST API credentials (user: '%s')\n", user);
+	janus_turnrest_response *response = janus_turnrest_do_request(*user ? user : NULL);
+	if(response != NULL) {
+		janus_turnrest_cache_response(*user ? user : NULL, response);
+		janus_turnrest_response_destroy(response);
+	} else {
+		/* The refresh failed: clear the flag, so that we can try again
+		 * (and eventually fall back to the blocking path, if these
+		 * credentials actually expire in the meanwhile) */
+		JANUS_LOG(LOG_WARN, "Error refreshing TURN REST API credentials (user: '%s')\n", user);
+		janus_mutex_lock(&cache_mutex);
+		janus_turnrest_cached *cached = credentials ? g_hash_table_lookup(credentials, user) : NULL;
+		if(cached != NULL)
+			g_atomic_int_set(&cached->refreshing, 0);
+		janus_mutex_unlock(&cache_mutex);
+	}
+	g_free(user);
+	return NULL;
+}
+
+janus_turnrest_response *janus_turnrest_request(const char *user) {
+	/* Check if we have valid cached credentials for this user first */
+	const char *key = user ? user : "";
+	janus_turnrest_response *response = NULL;
+	gboolean refresh = FALSE;
+	gint64 now = janus_get_monotonic_time();
+	janus_mutex_lock(&cache_mutex);
+	janus_turnrest_cached *cached = credentials ? g_hash_table_lookup(credentials, key) : NULL;
+	if(cached != NULL && now < cached->expires) {
+		response = janus_turnrest_response_copy(cached->response);
+		if(now >= cached->refresh && g_atomic_int_compare_and_exchange(&cached->refreshing, 0, 1))
+			refresh = TRUE;
+	}
+	janus_mutex_unlock(&cache_mutex);
+	if(refresh) {
+		/* These credentials are getting close to their TTL: refresh them
+		 * in the background, while we keep serving the cached ones */
+		GError *error = NULL;
+		GThread *thread = g_thread_try_new("turnrest refresh", janus_turnrest_refresh_thread, g_strdup(key), &error);
+		if(error != NULL) {
+			JANUS_LOG(LOG_WARN, "Got error %d (%s) trying to launch the TURN REST API refresh thread...\n",
+				error->code, error->message ? error->message : "??");
+			g_error_free(error);
+			janus_mutex_lock(&cache_mutex);
+			cached = credentials ? g_hash_table_lookup(credentials, key) : NULL;
+			if(cached != NULL)
+				g_atomic_int_set(&cached->refreshing, 0);
+			janus_mutex_unlock(&cache_mutex);
+		} else {
+			g_thread_unref(thread);
+		}
+	}
+	if(response != NULL)
+		return response;
+	/* Cold cache: do the blocking request, and cache what we get back */
+	response = janus_turnrest_do_request(user);
+	if(response != NULL)
+		janus_turnrest_cache_response(user, response);
+	return response;
+}
+
 #endif
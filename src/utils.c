@@ -26,6 +26,7 @@
 #include "utils.h"
 #include "debug.h"
 #include "mutex.h"
+#include "refcount.h"
 
 #if __MACH__
 #include "mach_gettime.h"
@@ -47,6 +48,17 @@ gint64 janus_get_monotonic_time(void) {
 	return janus_get_monotonic_time_internal() - janus_started;
 }
 
+static volatile gint64 janus_coarse_time = 0;
+void janus_update_monotonic_time_coarse(void) {
+	janus_coarse_time = janus_get_monotonic_time();
+}
+
+gint64 janus_get_monotonic_time_coarse(void) {
+	gint64 now = janus_coarse_time;
+	/* Until an event loop refreshes the cache, fall back to the precise call */
+	return now != 0 ? now : janus_get_monotonic_time();
+}
+
 gint64 janus_get_real_time(void) {
 	struct timespec ts;
 	clock_gettime (CLOCK_REALTIME, &ts);
@@ -155,6 +167,61 @@ guint64 janus_uint64_hash(guint64 num) {
 	return num;
 }
 
+/* Interned string IDs: each admitted string maps to a refcounted
+ * numeric handle, so that string-keyed room/participant tables in the
+ * plugins can be integer-keyed internally. Handles are assigned from a
+ * monotonic counter and never reused */
+typedef struct janus_string_id {
+	guint64 handle;
+	guint refs;
+} janus_string_id;
+static GHashTable *string_ids_table = NULL;
+static guint64 string_ids_handle = 0;
+static janus_mutex string_ids_mutex = JANUS_MUTEX_INITIALIZER;
+
+guint64 janus_string_id_intern(const char *id) {
+	if(id == NULL)
+		return 0;
+	janus_mutex_lock(&string_ids_mutex);
+	if(string_ids_table == NULL) {
+		string_ids_table = g_hash_table_new_full(g_str_hash, g_str_equal,
+			(GDestroyNotify)g_free, (GDestroyNotify)g_free);
+	}
+	janus_string_id *sid = g_hash_table_lookup(string_ids_table, id);
+	if(sid == NULL) {
+		sid = g_malloc(sizeof(janus_string_id));
+		sid->handle = ++string_ids_handle;
+		sid->refs = 0;
+		g_hash_table_insert(string_ids_table, g_strdup(id), sid);
+	}
+	sid->refs++;
+	guint64 handle = sid->handle;
+	janus_mutex_unlock(&string_ids_mutex);
+	return handle;
+}
+
+guint64 janus_string_id_find(const char *id) {
+	if(id == NULL)
+		return 0;
+	janus_mutex_lock(&string_ids_mutex);
+	janus_string_id *sid = string_ids_table ?
+		g_hash_table_lookup(string_ids_table, id) : NULL;
+	guint64 handle = sid ? sid->handle : 0;
+	janus_mutex_unlock(&string_ids_mutex);
+	return handle;
+}
+
+void janus_string_id_release(const char *id) {
+	if(id == NULL)
+		return;
+	janus_mutex_lock(&string_ids_mutex);
+	janus_string_id *sid = string_ids_table ?
+		g_hash_table_lookup(string_ids_table, id) : NULL;
+	if(sid != NULL && sid->refs > 0 && --sid->refs == 0)
+		g_hash_table_remove(string_ids_table, id);
+	janus_mutex_unlock(&string_ids_mutex);
+}
+
 int janus_string_to_uint8(const char *str, uint8_t *num) {
 	if(str == NULL || num == NULL)
 		return -EINVAL;
@@ -694,6 +761,129 @@ gboolean janus_json_is_valid(json_t *val, json_type jtype, unsigned int flags) {
 	return is_valid;
 }
 
+/* Precompiled parameter descriptor: besides the details from the
+ * original janus_json_parameter entry, we cache the bit this parameter
+ * occupies in the required-parameters mask, if it's a required one */
+typedef struct janus_json_validator_param {
+	char *name;
+	json_type jtype;
+	unsigned int flags;
+	guint64 required_bit;
+} janus_json_validator_param;
+struct janus_json_validator {
+	janus_json_validator_param *params;
+	size_t num;
+	GHashTable *by_name;		/* Parameter name --> descriptor */
+	guint64 required_mask;		/* Bits of all the required parameters */
+};
+
+janus_json_validator *janus_json_validator_create(const struct janus_json_parameter *params, size_t num) {
+	janus_json_validator *validator = g_malloc0(sizeof(janus_json_validator));
+	validator->params = g_malloc0(num * sizeof(janus_json_validator_param));
+	validator->num = num;
+	validator->by_name = g_hash_table_new(g_str_hash, g_str_equal);
+	guint64 bit = 1;
+	size_t i = 0;
+	for(i = 0; i < num; i++) {
+		janus_json_validator_param *param = &validator->params[i];
+		param->name = g_strdup(params[i].name);
+		param->jtype = params[i].jtype;
+		param->flags = params[i].flags;
+		if((param->flags & JANUS_JSON_PARAM_REQUIRED) != 0) {
+			param->required_bit = bit;
+			validator->required_mask |= bit;
+			bit = bit << 1;
+		}
+		g_hash_table_insert(validator->by_name, param->name, param);
+	}
+	return validator;
+}
+
+void janus_json_validator_destroy(janus_json_validator *validator) {
+	if(validator == NULL)
+		return;
+	g_hash_table_destroy(validator->by_name);
+	size_t i = 0;
+	for(i = 0; i < validator->num; i++)
+		g_free(validator->params[i].name);
+	g_free(validator->params);
+	g_free(validator);
+}
+
+int janus_json_validator_check(janus_json_validator *validator, json_t *obj, const char **param_name, char *type_name) {
+	/* A single pass over the object: parameters we don't know about are
+	 * simply allowed, as they always have been, known ones are checked
+	 * against the precompiled descriptor, and required ones are ticked
+	 * off the mask, so that we can tell what's missing at the end */
+	guint64 seen = 0;
+	const char *key = NULL;
+	json_t *val = NULL;
+	json_object_foreach(obj, key, val) {
+		janus_json_validator_param *param = g_hash_table_lookup(validator->by_name, key);
+		if(param == NULL)
+			continue;
+		if(!janus_json_is_valid(val, param->jtype, param->flags)) {
+			*param_name = param->name;
+			janus_get_json_type_name(param->jtype, param->flags, type_name);
+			return JANUS_JSON_VALIDATOR_INVALID;
+		}
+		seen |= param->required_bit;
+	}
+	if((seen & validator->required_mask) != validator->required_mask) {
+		size_t i = 0;
+		for(i = 0; i < validator->num; i++) {
+			janus_json_validator_param *param = &validator->params[i];
+			if(param->required_bit != 0 && (seen & param->required_bit) == 0) {
+				*param_name = param->name;
+				return JANUS_JSON_VALIDATOR_MISSING;
+			}
+		}
+	}
+	return JANUS_JSON_VALIDATOR_OK;
+}
+
+/* Growable buffer janus_json_dump streams the serialized JSON into: we
+ * use malloc/realloc so that the result can be free'd like the output
+ * of json_dumps */
+typedef struct janus_json_dump_buffer {
+	char *data;
+	size_t length;
+	size_t size;
+} janus_json_dump_buffer;
+static int janus_json_dump_callback(const char *buffer, size_t size, void *data) {
+	janus_json_dump_buffer *buf = (janus_json_dump_buffer *)data;
+	/* We always keep room for a terminating NUL byte */
+	if(buf->length + size + 1 > buf->size) {
+		size_t new_size = buf->size ? buf->size : 1024;
+		while(buf->length + size + 1 > new_size)
+			new_size *= 2;
+		char *new_data = realloc(buf->data, new_size);
+		if(new_data == NULL)
+			return -1;
+		buf->data = new_data;
+		buf->size = new_size;
+	}
+	memcpy(buf->data + buf->length, buffer, size);
+	buf->length += size;
+	return 0;
+}
+
+char *janus_json_dump(const json_t *root, size_t flags, size_t *len) {
+	if(root == NULL)
+		return NULL;
+	janus_json_dump_buffer buf = { 0 };
+	if(json_dump_callback(root, janus_json_dump_callback, &buf, flags) < 0) {
+		free(buf.data);
+		return NULL;
+	}
+	if(buf.data == NULL)
+		return NULL;
+	buf.data[buf.length] = '\0';
+	if(len != NULL)
+		*len = buf.length;
+	return buf.data;
+}
+
 /* The following code is more related to codec specific helpers */
 #if defined(__ppc__) || defined(__ppc64__)
 	# define swap2(d)  \
@@ -1456,3 +1646,96 @@ size_t janus_gzip_compress(int compression, char *text, size_t tlen, char *compr
 	return zs.total_out;
 }
 #endif
+
+/* Sampled reference tracking (see refcount.h): we pick roughly one out of
+ * every refcount_sample_rate created objects and keep a small record of
+ * where they were created and where their counter was last touched, so
+ * that reference leaks can be chased on production instances without the
+ * overhead (and noise) of a REFCOUNT_DEBUG build */
+volatile gint refcount_sample_rate = 0;
+typedef struct janus_refcount_sample {
+	const char *init_site;		/* Where the object was created */
+	const char *increase_site;	/* Where the counter was last increased */
+	const char *decrease_site;	/* Where the counter was last decreased */
+	gint64 created;				/* When the object was created */
+	guint64 increases;			/* How many increases we've seen */
+	guint64 decreases;			/* How many decreases we've seen */
+} janus_refcount_sample;
+static GHashTable *refcount_samples = NULL;
+static janus_mutex refcount_samples_mutex = JANUS_MUTEX_INITIALIZER;
+static volatile gint refcount_sample_counter = 0;
+
+void janus_refcount_sample_init(janus_refcount *refp, const char *site) {
+	gint rate = g_atomic_int_get(&refcount_sample_rate);
+	if(rate < 1)
+		return;
+	/* A plain global counter is good enough as a sampler: creation sites
+	 * interleave, so over time every site gets its share of samples */
+	if((g_atomic_int_add(&refcount_sample_counter, 1) % rate) != 0)
+		return;
+	janus_refcount_sample *sample = g_malloc0(sizeof(janus_refcount_sample));
+	sample->init_site = site;
+	sample->created = janus_get_monotonic_time();
+	janus_mutex_lock(&refcount_samples_mutex);
+	if(refcount_samples == NULL)
+		refcount_samples = g_hash_table_new_full(NULL, NULL, NULL, (GDestroyNotify)g_free);
+	g_hash_table_insert(refcount_samples, refp, sample);
+	janus_mutex_unlock(&refcount_samples_mutex);
+	g_atomic_int_set(&refp->tracked, 1);
+}
+
+void janus_refcount_sample_note(janus_refcount *refp, const char *site, gboolean increase) {
+	janus_mutex_lock(&refcount_samples_mutex);
+	janus_refcount_sample *sample = refcount_samples ?
+		g_hash_table_lookup(refcount_samples, refp) : NULL;
+	if(sample != NULL) {
+		if(increase) {
+			sample->increase_site = site;
+			sample->increases++;
+		} else {
+			sample->decrease_site = site;
+			sample->decreases++;
+		}
+	}
+	janus_mutex_unlock(&refcount_samples_mutex);
+}
+
+void janus_refcount_sample_free(janus_refcount *refp) {
+	janus_mutex_lock(&refcount_samples_mutex);
+	if(refcount_samples != NULL)
+		g_hash_table_remove(refcount_samples, refp);
+	janus_mutex_unlock(&refcount_samples_mutex);
+	g_atomic_int_set(&refp->tracked, 0);
+}
+
+json_t *janus_refcount_sample_summary(void) {
+	json_t *summary = json_object();
+	json_object_set_new(summary, "sample_rate", json_integer(g_atomic_int_get(&refcount_sample_rate)));
+	json_t *objects = json_array();
+	gint64 now = janus_get_monotonic_time();
+	janus_mutex_lock(&refcount_samples_mutex);
+	if(refcount_samples != NULL) {
+		GHashTableIter iter;
+		gpointer key = NULL, value = NULL;
+		g_hash_table_iter_init(&iter, refcount_samples);
+		while(g_hash_table_iter_next(&iter, &key, &value)) {
+			janus_refcount *refp = (janus_refcount *)key;
+			janus_refcount_sample *sample = (janus_refcount_sample *)value;
+			json_t *object = json_object();
+			json_object_set_new(object, "init_site", json_string(sample->init_site));
+			if(sample->increase_site != NULL)
+				json_object_set_new(object, "last_increase", json_string(sample->increase_site));
+			if(sample->decrease_site != NULL)
+				json_object_set_new(object, "last_decrease", json_string(sample->decrease_site));
+			json_object_set_new(object, "increases", json_integer(sample->increases));
+			json_object_set_new(object, "decreases", json_integer(sample->decreases));
+			json_object_set_new(object, "count", json_integer(g_atomic_int_get(&refp->count)));
+			json_object_set_new(object, "age", json_integer(now - sample->created));
+			json_array_append_new(objects, object);
+		}
+	}
+	json_object_set_new(summary, "live_objects", json_integer(json_array_size(objects)));
+	janus_mutex_unlock(&refcount_samples_mutex);
+	json_object_set_new(summary, "objects", objects);
+	return summary;
+}
@@ -54,6 +54,18 @@ gint64 janus_get_monotonic_time_internal(void);
  * @returns The system monotonic time */
 gint64 janus_get_monotonic_time(void);
 
+/*! \brief Helper to refresh the cached coarse monotonic time: the event
+ * loops invoke this once per loop iteration, so that per-packet consumers
+ * can read the time as a plain load instead of a clock_gettime each */
+void janus_update_monotonic_time_coarse(void);
+
+/*! \brief Helper to retrieve a coarse monotonic time, cached and refreshed
+ * once per event loop iteration: much cheaper than the precise call, which
+ * should only be preferred where sub-iteration accuracy actually matters
+ * @note The monotonic time will be normalized from the Janus start time
+ * @returns The cached monotonic time */
+gint64 janus_get_monotonic_time_coarse(void);
+
 /*! \brief Helper to retrieve the system real time, as Glib's
  * g_get_real_time may not be available (only since 2.28)
  * @returns The system real time */
@@ -144,6 +156,30 @@ guint64 *janus_uint64_dup(guint64 num);
  * @returns The hashed number */
 guint64 janus_uint64_hash(guint64 num);
 
+/*! \brief Helper to intern a string ID, mapping it to a compact numeric handle
+ * \details Plugins that accept string IDs for rooms and participants
+ * (\c string_ids) use these helpers to map each admitted string to a
+ * numeric handle, so that their internal hash tables can always be
+ * integer-keyed: UUID-length strings are then only hashed once per API
+ * request, when resolving them to a handle, rather than on every
+ * lookup. Handles are refcounted (the same string interned twice, e.g.,
+ * by participants with the same ID in different rooms, maps to the same
+ * handle) and never reused, and each successful call must be balanced
+ * by a janus_string_id_release when the ID is dismissed.
+ * @param id The string ID to intern
+ * @returns The numeric handle the string maps to (never 0) */
+guint64 janus_string_id_intern(const char *id);
+/*! \brief Helper to resolve a string ID to its interned numeric handle
+ * @note Contrary to janus_string_id_intern, this doesn't take a
+ * reference on the handle, and doesn't intern unknown strings.
+ * @param id The string ID to resolve
+ * @returns The numeric handle the string maps to, or 0 if the string
+ * hasn't been interned */
+guint64 janus_string_id_find(const char *id);
+/*! \brief Helper to release a reference to an interned string ID
+ * @param id The string ID to release */
+void janus_string_id_release(const char *id);
+
 /*! \brief Helper method to convert a string to a uint8_t
  * @note The value of \c num should be ignored, if the method returned an error
  * @param[in] str The string to convert
@@ -253,6 +289,48 @@ void janus_get_json_type_name(int jtype, unsigned int flags, char *type_name);
  * @returns TRUE if the value is valid */
 gboolean janus_json_is_valid(json_t *val, json_type jtype, unsigned int flags);
 
+/*! \brief Opaque precompiled validator for a janus_json_parameter table:
+ * the parameter names are indexed in a hash table and the required ones
+ * get a bit in a bitmask, so that validating a request is a single pass
+ * over the object instead of a lookup per parameter. Validators are
+ * compiled lazily (and then cached) by JANUS_VALIDATE_JSON_OBJECT, so
+ * existing parameter tables don't need any change */
+typedef struct janus_json_validator janus_json_validator;
+/*! \brief Compile a validator out of a janus_json_parameter table
+ * @param params Array of struct janus_json_parameter describing the parameters (names must be string literals or otherwise outlive the validator)
+ * @param num Number of entries in the array
+ * @returns A newly created janus_json_validator */
+janus_json_validator *janus_json_validator_create(const struct janus_json_parameter *params, size_t num);
+/*! \brief Destroy a precompiled validator
+ * @param validator The validator to destroy */
+void janus_json_validator_destroy(janus_json_validator *validator);
+/*! \brief Validation outcomes for janus_json_validator_check */
+#define JANUS_JSON_VALIDATOR_OK			0
+#define JANUS_JSON_VALIDATOR_MISSING	1
+#define JANUS_JSON_VALIDATOR_INVALID	2
+/*! \brief Validate a JSON object against a precompiled validator
+ * @param validator The precompiled validator to use
+ * @param obj The JSON object to be validated
+ * @param[out] param_name Set to the name of the offending parameter, on failure
+ * @param[out] type_name Filled in with the expected type description (as in janus_get_json_type_name, 20 bytes needed), when a parameter is invalid
+ * @returns JANUS_JSON_VALIDATOR_OK if the object is valid, JANUS_JSON_VALIDATOR_MISSING or JANUS_JSON_VALIDATOR_INVALID otherwise */
+int janus_json_validator_check(janus_json_validator *validator, json_t *obj, const char **param_name, char *type_name);
+
+/*! \brief Serializes a JSON value to a string, also returning its length
+ * \note Other than making the length available to the caller (so that,
+ * e.g., transports don't need to traverse a large response again with
+ * strlen), this differs from \c json_dumps in that the value is streamed
+ * via \c json_dump_callback into a single growable buffer, rather than
+ * serialized to an internal buffer and then copied: for the multi-megabyte
+ * replies some Admin API requests can generate, that saves a full-size
+ * allocation and copy per message. The returned buffer is allocated with
+ * \c malloc , just like the output of \c json_dumps , so \c free it when done.
+ * @param root The JSON value to serialize
+ * @param flags Serialization flags, as in \c json_dumps (e.g., JSON_INDENT(3))
+ * @param[out] len Length of the serialized string, if needed (may be NULL)
+ * @returns A pointer to the serialized string if successful, NULL otherwise */
+char *janus_json_dump(const json_t *root, size_t flags, size_t *len);
+
 /*! \brief Validates the JSON object against the description of its parameters
  * @param missing_format printf format to indicate a missing required parameter; needs one %s for the parameter name
  * @param invalid_format printf format to indicate an invalid parameter; needs two %s for parameter name and type description from janus_get_json_type_name
@@ -266,30 +344,31 @@ gboolean janus_json_is_valid(json_t *val, json_type jtype, unsigned int flags);
 #define JANUS_VALIDATE_JSON_OBJECT_FORMAT(missing_format, invalid_format, obj, params, error_code, error_cause, log_error, missing_code, invalid_code) \
 	do { \
 		error_code = 0; \
-		unsigned int i; \
-		for(i = 0; i < sizeof(params) / sizeof(struct janus_json_parameter); i++) { \
-			json_t *val = json_object_get(obj, params[i].name); \
-			if(!val) { \
-				if((params[i].flags & JANUS_JSON_PARAM_REQUIRED) != 0) {	\
-					error_code = (missing_code); \
-					if(log_error) \
-						JANUS_LOG(LOG_ERR, missing_format "\n", params[i].name); \
-					if(error_cause != NULL) \
-						g_snprintf(error_cause, sizeof(error_cause), missing_format, params[i].name); \
-					break; \
-				} \
-				continue; \
-			} \
-			if(!janus_json_is_valid(val, params[i].jtype, params[i].flags)) { \
-				error_code = (invalid_code); \
-				char type_name[20]; \
-				janus_get_json_type_name(params[i].jtype, params[i].flags, type_name); \
-				if(log_error) \
-					JANUS_LOG(LOG_ERR, invalid_format "\n", params[i].name, type_name); \
-				if(error_cause != NULL) \
-					g_snprintf(error_cause, sizeof(error_cause), invalid_format, params[i].name, type_name); \
-				break; \
-			} \
+		/* The validator for this parameter table is compiled on first
+		 * use, and then cached for all the subsequent requests */ \
+		static janus_json_validator *validator_cached = NULL; \
+		if(g_atomic_pointer_get(&validator_cached) == NULL) { \
+			janus_json_validator *validator_new = \
+				janus_json_validator_create(params, sizeof(params) / sizeof(struct janus_json_parameter)); \
+			if(!g_atomic_pointer_compare_and_exchange(&validator_cached, NULL, validator_new)) \
+				janus_json_validator_destroy(validator_new); \
+		} \
+		const char *validator_param = NULL; \
+		char validator_type[20]; \
+		int validator_res = janus_json_validator_check(g_atomic_pointer_get(&validator_cached), \
+			obj, &validator_param, validator_type); \
+		if(validator_res == JANUS_JSON_VALIDATOR_MISSING) { \
+			error_code = (missing_code); \
+			if(log_error) \
+				JANUS_LOG(LOG_ERR, missing_format "\n", validator_param); \
+			if(error_cause != NULL) \
+				g_snprintf(error_cause, sizeof(error_cause), missing_format, validator_param); \
+		} else if(validator_res == JANUS_JSON_VALIDATOR_INVALID) { \
+			error_code = (invalid_code); \
+			if(log_error) \
+				JANUS_LOG(LOG_ERR, invalid_format "\n", validator_param, validator_type); \
+			if(error_cause != NULL) \
+				g_snprintf(error_cause, sizeof(error_cause), invalid_format, validator_param, validator_type); \
 		} \
 	} while(0)
 